@@ -0,0 +1,671 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Python bindings of the simulator library
+ *
+ *  The module drives a machine of libmsim.a from Python. The memory
+ *  areas of the machine export the buffer protocol, so memoryview()
+ *  or numpy.frombuffer() read the memory of the simulator itself
+ *  without copying it. While a buffer is exported, the machine can
+ *  run but cannot be configured or closed (the memory could move).
+ *
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../../src/libmsim.h"
+
+/** Machine object */
+typedef struct {
+    PyObject_HEAD
+    msim_machine_t *machine; /**< NULL once closed */
+    Py_ssize_t exports; /**< Buffers of the memory areas exported */
+    uint64_t generation; /**< Configurations loaded (invalidates the areas) */
+} MachineObject;
+
+/** Memory area object */
+typedef struct {
+    PyObject_HEAD
+    MachineObject *owner;
+    uint64_t generation; /**< Configuration of the machine described */
+    msim_mem_area_t area;
+} AreaObject;
+
+static PyTypeObject MachineType;
+static PyTypeObject AreaType;
+
+/** Check that the machine has not been closed */
+static bool machine_alive(MachineObject *self)
+{
+    if (self->machine == NULL) {
+        PyErr_SetString(PyExc_ValueError, "The machine is closed");
+        return false;
+    }
+
+    return true;
+}
+
+/** Check that the memory does not change under an exported buffer */
+static bool machine_unexported(MachineObject *self)
+{
+    if (self->exports > 0) {
+        PyErr_SetString(PyExc_BufferError,
+                "The memory of the machine is exported (release the views first)");
+        return false;
+    }
+
+    return true;
+}
+
+/** Number of a register given by its number or its name */
+static bool machine_reg_index(MachineObject *self, unsigned int cpu,
+        PyObject *reg, unsigned int *index)
+{
+    if (PyLong_Check(reg)) {
+        unsigned long value = PyLong_AsUnsignedLong(reg);
+        if (PyErr_Occurred()) {
+            return false;
+        }
+
+        *index = (unsigned int) value;
+        return true;
+    }
+
+    const char *name = PyUnicode_AsUTF8(reg);
+    if (name == NULL) {
+        return false;
+    }
+
+    unsigned int count = msim_reg_count(self->machine, cpu);
+    for (unsigned int i = 0; i < count; i++) {
+        const char *reg_name = msim_reg_name(self->machine, cpu, i);
+
+        if ((reg_name != NULL) && (strcmp(reg_name, name) == 0)) {
+            *index = i;
+            return true;
+        }
+    }
+
+    PyErr_Format(PyExc_KeyError, "No register %s of the processor %u", name, cpu);
+    return false;
+}
+
+static PyObject *Machine_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "config", NULL };
+    const char *config = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|z", kwlist, &config)) {
+        return NULL;
+    }
+
+    msim_machine_t *machine = msim_machine_create();
+    if (machine == NULL) {
+        PyErr_SetString(PyExc_RuntimeError,
+                "Another machine exists (one machine per process)");
+        return NULL;
+    }
+
+    MachineObject *self = (MachineObject *) type->tp_alloc(type, 0);
+    if (self == NULL) {
+        msim_machine_destroy(machine);
+        return NULL;
+    }
+
+    self->machine = machine;
+    self->exports = 0;
+    self->generation = 0;
+
+    if ((config != NULL) && (!msim_load_config(machine, config))) {
+        PyErr_Format(PyExc_RuntimeError, "Configuration %s failed", config);
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    return (PyObject *) self;
+}
+
+static void Machine_dealloc(MachineObject *self)
+{
+    if (self->machine != NULL) {
+        msim_machine_destroy(self->machine);
+        self->machine = NULL;
+    }
+
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject *Machine_close(MachineObject *self, PyObject *unused)
+{
+    if (self->machine != NULL) {
+        if (!machine_unexported(self)) {
+            return NULL;
+        }
+
+        msim_machine_destroy(self->machine);
+        self->machine = NULL;
+        self->generation++;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *Machine_enter(MachineObject *self, PyObject *unused)
+{
+    Py_INCREF(self);
+    return (PyObject *) self;
+}
+
+static PyObject *Machine_exit(MachineObject *self, PyObject *args)
+{
+    return Machine_close(self, NULL);
+}
+
+static PyObject *Machine_load(MachineObject *self, PyObject *args)
+{
+    const char *config;
+
+    if ((!PyArg_ParseTuple(args, "s", &config)) || (!machine_alive(self))
+            || (!machine_unexported(self))) {
+        return NULL;
+    }
+
+    self->generation++;
+
+    if (!msim_load_config(self->machine, config)) {
+        PyErr_Format(PyExc_RuntimeError, "Configuration %s failed", config);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *Machine_run(MachineObject *self, PyObject *args)
+{
+    unsigned long long cycles;
+
+    if ((!PyArg_ParseTuple(args, "K", &cycles)) || (!machine_alive(self))) {
+        return NULL;
+    }
+
+    uint64_t done;
+
+    Py_BEGIN_ALLOW_THREADS
+    done = msim_run(self->machine, cycles);
+    Py_END_ALLOW_THREADS
+
+    return PyLong_FromUnsignedLongLong(done);
+}
+
+static PyObject *Machine_reset(MachineObject *self, PyObject *unused)
+{
+    if (!machine_alive(self)) {
+        return NULL;
+    }
+
+    return PyBool_FromLong(msim_reset(self->machine));
+}
+
+static PyObject *Machine_read(MachineObject *self, PyObject *args)
+{
+    unsigned long long addr;
+    Py_ssize_t size;
+
+    if ((!PyArg_ParseTuple(args, "Kn", &addr, &size)) || (!machine_alive(self))) {
+        return NULL;
+    }
+
+    if (size < 0) {
+        PyErr_SetString(PyExc_ValueError, "Negative size");
+        return NULL;
+    }
+
+    PyObject *bytes = PyBytes_FromStringAndSize(NULL, size);
+    if (bytes != NULL) {
+        msim_read_mem(self->machine, addr, PyBytes_AS_STRING(bytes), size);
+    }
+
+    return bytes;
+}
+
+static PyObject *Machine_write(MachineObject *self, PyObject *args)
+{
+    unsigned long long addr;
+    Py_buffer data;
+
+    if (!PyArg_ParseTuple(args, "Ky*", &addr, &data)) {
+        return NULL;
+    }
+
+    bool ok = machine_alive(self)
+            && msim_write_mem(self->machine, addr, data.buf, data.len);
+    PyBuffer_Release(&data);
+
+    if ((!ok) && (!PyErr_Occurred())) {
+        PyErr_SetString(PyExc_ValueError, "The bytes are not in writable memory");
+    }
+
+    if (!ok) {
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *Machine_memory(MachineObject *self, PyObject *unused)
+{
+    if (!machine_alive(self)) {
+        return NULL;
+    }
+
+    PyObject *list = PyList_New(0);
+    if (list == NULL) {
+        return NULL;
+    }
+
+    msim_mem_area_t area;
+    for (size_t i = 0; msim_mem_area(self->machine, i, &area); i++) {
+        AreaObject *obj = PyObject_New(AreaObject, &AreaType);
+        if (obj == NULL) {
+            Py_DECREF(list);
+            return NULL;
+        }
+
+        Py_INCREF(self);
+        obj->owner = self;
+        obj->generation = self->generation;
+        obj->area = area;
+
+        int rc = PyList_Append(list, (PyObject *) obj);
+        Py_DECREF(obj);
+
+        if (rc != 0) {
+            Py_DECREF(list);
+            return NULL;
+        }
+    }
+
+    return list;
+}
+
+static PyObject *Machine_reg(MachineObject *self, PyObject *args)
+{
+    unsigned int cpu;
+    PyObject *reg;
+    unsigned int index;
+    uint64_t value;
+
+    if ((!PyArg_ParseTuple(args, "IO", &cpu, &reg)) || (!machine_alive(self))
+            || (!machine_reg_index(self, cpu, reg, &index))) {
+        return NULL;
+    }
+
+    if (!msim_read_reg(self->machine, cpu, index, &value)) {
+        PyErr_Format(PyExc_KeyError, "No register %u of the processor %u",
+                index, cpu);
+        return NULL;
+    }
+
+    return PyLong_FromUnsignedLongLong(value);
+}
+
+static PyObject *Machine_set_reg(MachineObject *self, PyObject *args)
+{
+    unsigned int cpu;
+    PyObject *reg;
+    unsigned long long value;
+    unsigned int index;
+
+    if ((!PyArg_ParseTuple(args, "IOK", &cpu, &reg, &value))
+            || (!machine_alive(self))
+            || (!machine_reg_index(self, cpu, reg, &index))) {
+        return NULL;
+    }
+
+    if (!msim_write_reg(self->machine, cpu, index, value)) {
+        PyErr_Format(PyExc_KeyError, "No register %u of the processor %u",
+                index, cpu);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *Machine_regs(MachineObject *self, PyObject *args)
+{
+    unsigned int cpu = 0;
+
+    if ((!PyArg_ParseTuple(args, "|I", &cpu)) || (!machine_alive(self))) {
+        return NULL;
+    }
+
+    PyObject *dict = PyDict_New();
+    if (dict == NULL) {
+        return NULL;
+    }
+
+    unsigned int count = msim_reg_count(self->machine, cpu);
+    for (unsigned int i = 0; i < count; i++) {
+        const char *name = msim_reg_name(self->machine, cpu, i);
+        uint64_t value;
+
+        if (!msim_read_reg(self->machine, cpu, i, &value)) {
+            continue;
+        }
+
+        PyObject *key = (name != NULL) ? PyUnicode_FromString(name)
+                                       : PyLong_FromUnsignedLong(i);
+        PyObject *val = PyLong_FromUnsignedLongLong(value);
+
+        if ((key == NULL) || (val == NULL) || (PyDict_SetItem(dict, key, val) != 0)) {
+            Py_XDECREF(key);
+            Py_XDECREF(val);
+            Py_DECREF(dict);
+            return NULL;
+        }
+
+        Py_DECREF(key);
+        Py_DECREF(val);
+    }
+
+    return dict;
+}
+
+static PyObject *Machine_pc(MachineObject *self, PyObject *args)
+{
+    unsigned int cpu = 0;
+    uint64_t pc;
+
+    if ((!PyArg_ParseTuple(args, "|I", &cpu)) || (!machine_alive(self))) {
+        return NULL;
+    }
+
+    if (!msim_read_pc(self->machine, cpu, &pc)) {
+        PyErr_Format(PyExc_KeyError, "No processor %u", cpu);
+        return NULL;
+    }
+
+    return PyLong_FromUnsignedLongLong(pc);
+}
+
+static PyObject *Machine_add_breakpoint(MachineObject *self, PyObject *args)
+{
+    unsigned long long addr;
+    unsigned int cpu = 0;
+
+    if ((!PyArg_ParseTuple(args, "K|I", &addr, &cpu)) || (!machine_alive(self))) {
+        return NULL;
+    }
+
+    if (!msim_break_insert(self->machine, cpu, addr)) {
+        PyErr_Format(PyExc_KeyError, "No processor %u", cpu);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *Machine_remove_breakpoint(MachineObject *self, PyObject *args)
+{
+    unsigned long long addr;
+    unsigned int cpu = 0;
+
+    if ((!PyArg_ParseTuple(args, "K|I", &addr, &cpu)) || (!machine_alive(self))) {
+        return NULL;
+    }
+
+    if (!msim_break_remove(self->machine, cpu, addr)) {
+        PyErr_Format(PyExc_KeyError, "No breakpoint at %#llx", addr);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+/** Append a statistic to a list as a tuple */
+static void stats_append(const msim_stat_t *stat, void *arg)
+{
+    PyObject *list = (PyObject *) arg;
+
+    if (PyErr_Occurred()) {
+        return;
+    }
+
+    PyObject *row = Py_BuildValue("(sssOKd)",
+            (stat->device != NULL) ? stat->device : "", stat->name,
+            stat->labels, stat->counter ? Py_True : Py_False,
+            (unsigned long long) (stat->counter ? stat->count : 0),
+            stat->counter ? (double) stat->count : stat->value);
+
+    if (row != NULL) {
+        PyList_Append(list, row);
+        Py_DECREF(row);
+    }
+}
+
+/** Field types of the structured array of the statistics */
+#define STATS_DTYPE \
+    "[('device', 'U64'), ('name', 'U64'), ('labels', 'U48'), " \
+    "('counter', '?'), ('count', 'u8'), ('value', 'f8')]"
+
+static PyObject *Machine_stats(MachineObject *self, PyObject *unused)
+{
+    if (!machine_alive(self)) {
+        return NULL;
+    }
+
+    PyObject *list = PyList_New(0);
+    if (list == NULL) {
+        return NULL;
+    }
+
+    msim_stats(self->machine, stats_append, list);
+
+    if (PyErr_Occurred()) {
+        Py_DECREF(list);
+        return NULL;
+    }
+
+    /* A structured array if NumPy is installed, the rows otherwise */
+    PyObject *numpy = PyImport_ImportModule("numpy");
+    if (numpy == NULL) {
+        PyErr_Clear();
+        return list;
+    }
+
+    PyObject *dtype = PyRun_String(STATS_DTYPE, Py_eval_input,
+            PyEval_GetBuiltins(), NULL);
+    PyObject *array = (dtype != NULL)
+            ? PyObject_CallMethod(numpy, "array", "OO", list, dtype) : NULL;
+
+    Py_XDECREF(dtype);
+    Py_DECREF(numpy);
+    Py_DECREF(list);
+
+    return array;
+}
+
+static PyObject *Machine_get_cycles(MachineObject *self, void *closure)
+{
+    if (!machine_alive(self)) {
+        return NULL;
+    }
+
+    return PyLong_FromUnsignedLongLong(msim_cycles(self->machine));
+}
+
+static PyObject *Machine_get_halted(MachineObject *self, void *closure)
+{
+    if (!machine_alive(self)) {
+        return NULL;
+    }
+
+    return PyBool_FromLong(msim_halted(self->machine));
+}
+
+static PyMethodDef Machine_methods[] = {
+    { "close", (PyCFunction) Machine_close, METH_NOARGS,
+            "Destroy the machine (another one can be created then)" },
+    { "__enter__", (PyCFunction) Machine_enter, METH_NOARGS, NULL },
+    { "__exit__", (PyCFunction) Machine_exit, METH_VARARGS, NULL },
+    { "load", (PyCFunction) Machine_load, METH_VARARGS,
+            "Run the commands of a configuration file" },
+    { "run", (PyCFunction) Machine_run, METH_VARARGS,
+            "Run the machine for the cycles (less if it halts or stops at a breakpoint), return the cycles run" },
+    { "reset", (PyCFunction) Machine_reset, METH_NOARGS,
+            "Return to the reset point, False if there is none" },
+    { "read", (PyCFunction) Machine_read, METH_VARARGS,
+            "Read bytes of the physical memory" },
+    { "write", (PyCFunction) Machine_write, METH_VARARGS,
+            "Write bytes of the physical memory" },
+    { "memory", (PyCFunction) Machine_memory, METH_NOARGS,
+            "Memory areas, their buffers are the memory of the simulator" },
+    { "reg", (PyCFunction) Machine_reg, METH_VARARGS,
+            "Read a register of a processor (by its debugger number or name)" },
+    { "set_reg", (PyCFunction) Machine_set_reg, METH_VARARGS,
+            "Write a register of a processor (by its debugger number or name)" },
+    { "regs", (PyCFunction) Machine_regs, METH_VARARGS,
+            "Registers of a processor in a dictionary" },
+    { "pc", (PyCFunction) Machine_pc, METH_VARARGS,
+            "Address of the next instruction of a processor" },
+    { "add_breakpoint", (PyCFunction) Machine_add_breakpoint, METH_VARARGS,
+            "Stop the runs before the instruction at the virtual address" },
+    { "remove_breakpoint", (PyCFunction) Machine_remove_breakpoint, METH_VARARGS,
+            "Remove a breakpoint" },
+    { "stats", (PyCFunction) Machine_stats, METH_NOARGS,
+            "Statistics of the machine and of the devices (a NumPy structured array if NumPy is installed)" },
+    { NULL }
+};
+
+static PyGetSetDef Machine_getset[] = {
+    { "cycles", (getter) Machine_get_cycles, NULL, "Cycles simulated", NULL },
+    { "halted", (getter) Machine_get_halted, NULL, "The machine has halted", NULL },
+    { NULL }
+};
+
+static PyTypeObject MachineType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "msim.Machine",
+    .tp_doc = "Simulated machine (at most one per process)",
+    .tp_basicsize = sizeof(MachineObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = Machine_new,
+    .tp_dealloc = (destructor) Machine_dealloc,
+    .tp_methods = Machine_methods,
+    .tp_getset = Machine_getset
+};
+
+static void Area_dealloc(AreaObject *self)
+{
+    Py_DECREF(self->owner);
+    PyObject_Del(self);
+}
+
+/** Export the contents of the area (read-only) */
+static int Area_getbuffer(AreaObject *self, Py_buffer *view, int flags)
+{
+    if ((self->owner->machine == NULL)
+            || (self->generation != self->owner->generation)) {
+        PyErr_SetString(PyExc_ValueError, "The memory area no longer exists");
+        view->obj = NULL;
+        return -1;
+    }
+
+    if (PyBuffer_FillInfo(view, (PyObject *) self, (void *) self->area.data,
+                self->area.size, 1, flags) != 0) {
+        return -1;
+    }
+
+    self->owner->exports++;
+    return 0;
+}
+
+static void Area_releasebuffer(AreaObject *self, Py_buffer *view)
+{
+    self->owner->exports--;
+}
+
+static PyBufferProcs Area_as_buffer = {
+    .bf_getbuffer = (getbufferproc) Area_getbuffer,
+    .bf_releasebuffer = (releasebufferproc) Area_releasebuffer
+};
+
+static PyObject *Area_get_name(AreaObject *self, void *closure)
+{
+    return PyUnicode_FromString(self->area.name);
+}
+
+static PyObject *Area_get_addr(AreaObject *self, void *closure)
+{
+    return PyLong_FromUnsignedLongLong(self->area.addr);
+}
+
+static PyObject *Area_get_size(AreaObject *self, void *closure)
+{
+    return PyLong_FromUnsignedLongLong(self->area.size);
+}
+
+static PyObject *Area_get_writable(AreaObject *self, void *closure)
+{
+    return PyBool_FromLong(self->area.writable);
+}
+
+static PyGetSetDef Area_getset[] = {
+    { "name", (getter) Area_get_name, NULL, "Name of the memory device", NULL },
+    { "addr", (getter) Area_get_addr, NULL, "Physical address", NULL },
+    { "size", (getter) Area_get_size, NULL, "Size in bytes", NULL },
+    { "writable", (getter) Area_get_writable, NULL, "Writable by the guest", NULL },
+    { NULL }
+};
+
+static PyTypeObject AreaType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "msim.Area",
+    .tp_doc = "Memory area of a machine (read-only buffer of its contents)",
+    .tp_basicsize = sizeof(AreaObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor) Area_dealloc,
+    .tp_as_buffer = &Area_as_buffer,
+    .tp_getset = Area_getset
+};
+
+static struct PyModuleDef msim_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "msim",
+    .m_doc = "Python bindings of the MSIM simulator library",
+    .m_size = -1
+};
+
+PyMODINIT_FUNC PyInit_msim(void)
+{
+    if ((PyType_Ready(&MachineType) < 0) || (PyType_Ready(&AreaType) < 0)) {
+        return NULL;
+    }
+
+    PyObject *module = PyModule_Create(&msim_module);
+    if (module == NULL) {
+        return NULL;
+    }
+
+    Py_INCREF(&MachineType);
+    Py_INCREF(&AreaType);
+
+    if ((PyModule_AddObject(module, "Machine", (PyObject *) &MachineType) < 0)
+            || (PyModule_AddObject(module, "Area", (PyObject *) &AreaType) < 0)) {
+        Py_DECREF(&MachineType);
+        Py_DECREF(&AreaType);
+        Py_DECREF(module);
+        return NULL;
+    }
+
+    return module;
+}
@@ -0,0 +1,28 @@
+#!/usr/bin/env python3
+
+"""
+Build of the Python bindings of the simulator library.
+
+Build the library first (make in the top directory), then
+python3 setup.py build_ext --inplace here.
+"""
+
+import os
+
+from setuptools import Extension, setup
+
+TOP = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..')
+
+setup(
+    name='msim',
+    version='3.0.0',
+    description='Python bindings of the MSIM simulator library',
+    ext_modules=[
+        Extension(
+            'msim',
+            sources=['msimmodule.c'],
+            extra_objects=[os.path.join(TOP, 'libmsim.a')],
+            libraries=['z', 'pthread', 'readline'],
+        )
+    ],
+)
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Placement of the simulation on the host cores and NUMA nodes
+ *
+ */
+
+#ifndef AFFINITY_H_
+#define AFFINITY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Placement of the host memory backing a memory area */
+typedef enum {
+    HOST_MEM_LOCAL = 0, /**< Node of the thread touching a page first */
+    HOST_MEM_BIND = 1, /**< A single node */
+    HOST_MEM_INTERLEAVE = 2 /**< Pages interleaved over all nodes */
+} host_mem_policy_t;
+
+extern unsigned int host_core_count(void);
+extern bool host_pin_thread(int core);
+
+extern bool host_node_allowed(unsigned int node);
+extern bool host_mem_place(void *ptr, size_t size, host_mem_policy_t policy,
+        unsigned int node, bool move);
+
+#endif
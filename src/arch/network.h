@@ -17,7 +17,9 @@
 #else
 
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 
 #endif /* __WIN32__ */
 
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Placement of the simulation on the host cores and NUMA nodes
+ *
+ *  Only Linux hosts allow to pin the threads and to place the memory,
+ *  the system calls are used directly (without libnuma). Elsewhere
+ *  everything but the default placement fails with ENOSYS.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "../affinity.h"
+
+#ifndef __WIN32__
+
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sched.h>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#endif
+
+/** Largest number of host NUMA nodes supported */
+#define HOST_NODES 1024
+#define HOST_NODE_WORD_BITS (8 * sizeof(unsigned long))
+
+/** Number of the host cores (at least 1) */
+unsigned int host_core_count(void)
+{
+#ifdef _SC_NPROCESSORS_CONF
+    long count = sysconf(_SC_NPROCESSORS_CONF);
+
+    if (count > 0) {
+        return (unsigned int) count;
+    }
+#endif
+
+    return 1;
+}
+
+/** Pin the calling thread to a host core
+ *
+ * @param core Host core, negative to allow all cores again.
+ *
+ * @return False (with errno set) if the thread cannot be pinned.
+ *
+ */
+bool host_pin_thread(int core)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if (core >= CPU_SETSIZE) {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (core >= 0) {
+        CPU_SET(core, &set);
+    } else {
+        unsigned int count = host_core_count();
+
+        for (unsigned int i = 0; (i < count) && (i < CPU_SETSIZE); i++) {
+            CPU_SET(i, &set);
+        }
+    }
+
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    if (rc != 0) {
+        errno = rc;
+        return false;
+    }
+
+    return true;
+#else
+    if (core < 0) {
+        return true;
+    }
+
+    errno = ENOSYS;
+    return false;
+#endif
+}
+
+#ifdef __linux__
+
+/** Host NUMA nodes the process may allocate from */
+static bool host_nodes_allowed(unsigned long *mask)
+{
+    return syscall(SYS_get_mempolicy, NULL, mask, (unsigned long) HOST_NODES,
+                   NULL, (unsigned long) MPOL_F_MEMS_ALLOWED)
+            == 0;
+}
+
+#endif
+
+/** Check whether the memory can be placed on a host NUMA node */
+bool host_node_allowed(unsigned int node)
+{
+#ifdef __linux__
+    unsigned long mask[HOST_NODES / HOST_NODE_WORD_BITS] = { 0 };
+
+    if ((node >= HOST_NODES) || (!host_nodes_allowed(mask))) {
+        return false;
+    }
+
+    return (mask[node / HOST_NODE_WORD_BITS] & (1UL << (node % HOST_NODE_WORD_BITS))) != 0;
+#else
+    return false;
+#endif
+}
+
+/** Set the placement of the host pages of a memory range
+ *
+ * Unless moved, only the pages touched after the call follow the
+ * placement. The range is expected to start on a host page boundary,
+ * the mappings replacing a part of it later get the default placement.
+ *
+ * @param policy Placement of the pages.
+ * @param node   Host node (only used by HOST_MEM_BIND).
+ * @param move   Move the pages already touched as well.
+ *
+ * @return False (with errno set) if the placement cannot be set.
+ *
+ */
+bool host_mem_place(void *ptr, size_t size, host_mem_policy_t policy,
+        unsigned int node, bool move)
+{
+#ifdef __linux__
+    unsigned long mask[HOST_NODES / HOST_NODE_WORD_BITS] = { 0 };
+    int mode;
+
+    switch (policy) {
+    case HOST_MEM_BIND:
+        if (node >= HOST_NODES) {
+            errno = EINVAL;
+            return false;
+        }
+
+        mask[node / HOST_NODE_WORD_BITS] = 1UL << (node % HOST_NODE_WORD_BITS);
+        mode = MPOL_BIND;
+        break;
+    case HOST_MEM_INTERLEAVE:
+        if (!host_nodes_allowed(mask)) {
+            return false;
+        }
+
+        mode = MPOL_INTERLEAVE;
+        break;
+    default:
+        mode = MPOL_DEFAULT;
+        break;
+    }
+
+    /* The kernel takes one bit less than the node count passed */
+    unsigned long maxnode = (mode == MPOL_DEFAULT) ? 0 : HOST_NODES + 1;
+
+    return syscall(SYS_mbind, ptr, (unsigned long) size, (unsigned long) mode,
+                   (mode == MPOL_DEFAULT) ? NULL : mask, maxnode,
+                   ((move) && (mode != MPOL_DEFAULT)) ? (unsigned int) MPOL_MF_MOVE : 0U)
+            == 0;
+#else
+    if (policy == HOST_MEM_LOCAL) {
+        return true;
+    }
+
+    errno = ENOSYS;
+    return false;
+#endif
+}
+
+#endif /* __WIN32__ */
@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "../../debug/flight.h"
 #include "../../fault.h"
 #include "../../input.h"
 #include "../../main.h"
@@ -28,12 +29,13 @@ static void machine_user_break(int signo)
     }
 
     machine_break = true;
+    flight_requested = true;
 
     if (!machine_interactive) {
         machine_newline = true;
     }
 
-    machine_interactive = true;
+    __atomic_store_n(&machine_interactive, true, __ATOMIC_RELEASE);
 }
 
 static void termination_signals_handler(int signo)
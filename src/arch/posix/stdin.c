@@ -4,38 +4,285 @@
  *
  * Distributed under the terms of GPL.
  *
+ *
+ *  The standard input is read by a thread, which is started by the
+ *  first poll. The characters are passed through a ring with a single
+ *  producer and a single consumer, so a poll does not enter the kernel.
+ *  The thread is paused while the interactive mode reads the commands
+ *  from the same input. The simulation can also sleep until the thread
+ *  reads a character.
+ *
  */
 
 #include "../stdin.h"
 
 #ifndef __WIN32__
 
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <time.h>
 #include <unistd.h>
-#include <sys/select.h>
+
+/** Size of the ring of characters read ahead (must be a power of two) */
+#define STDIN_RING_SIZE 256
+
+/** Ring of the characters read by the thread */
+static char ring[STDIN_RING_SIZE];
+static size_t ring_head = 0; /**< Written by the thread only */
+static size_t ring_tail = 0; /**< Written by the polling side only */
+
+static pthread_t reader;
+static pthread_mutex_t reader_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reader_cond = PTHREAD_COND_INITIALIZER;
+
+static bool reader_started = false;
+static bool reader_created = false;
+static bool reader_running = false; /**< False once the input has ended */
+static bool reader_paused = false;
+static bool reader_parked = false; /**< The paused thread does not read */
+static bool reader_quit = false;
+
+/** Pipe waking the thread from poll() */
+static int reader_wake[2] = { -1, -1 };
+
+/** Wait while the thread is paused
+ *
+ * @return False, if the thread is to terminate.
+ *
+ */
+static bool reader_wait(void)
+{
+    pthread_mutex_lock(&reader_mutex);
+
+    while ((reader_paused) && (!reader_quit)) {
+        reader_parked = true;
+        pthread_cond_broadcast(&reader_cond);
+        pthread_cond_wait(&reader_cond, &reader_mutex);
+    }
+
+    reader_parked = false;
+    bool quit = reader_quit;
+
+    pthread_mutex_unlock(&reader_mutex);
+    return !quit;
+}
+
+static void *reader_thread(void *arg)
+{
+    while (reader_wait()) {
+        size_t head = ring_head;
+        bool full = (head - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE)
+                == STDIN_RING_SIZE);
+
+        struct pollfd fds[2] = {
+            { .fd = reader_wake[0], .events = POLLIN },
+            { .fd = 0, .events = POLLIN }
+        };
+
+        /* A full ring is retried after a while */
+        int retval = poll(fds, full ? 1 : 2, full ? 10 : -1);
+
+        if (retval < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            break;
+        }
+
+        if ((fds[0].revents & POLLIN) != 0) {
+            char dummy;
+            (void) read(reader_wake[0], &dummy, 1);
+            continue;
+        }
+
+        if ((full) || (fds[1].revents == 0)) {
+            continue;
+        }
+
+        char key;
+        if (read(0, &key, 1) <= 0) {
+            /* End of input */
+            break;
+        }
+
+        ring[head & (STDIN_RING_SIZE - 1)] = key;
+        __atomic_store_n(&ring_head, head + 1, __ATOMIC_RELEASE);
+
+        /* Wake the simulation sleeping in stdin_wait() */
+        pthread_mutex_lock(&reader_mutex);
+        pthread_cond_broadcast(&reader_cond);
+        pthread_mutex_unlock(&reader_mutex);
+    }
+
+    pthread_mutex_lock(&reader_mutex);
+    reader_running = false;
+    pthread_cond_broadcast(&reader_cond);
+    pthread_mutex_unlock(&reader_mutex);
+
+    return NULL;
+}
+
+/** Start the thread reading the standard input
+ *
+ * If the thread cannot be started, nothing is read.
+ *
+ */
+static void reader_start(void)
+{
+    reader_started = true;
+
+    if (pipe(reader_wake) != 0) {
+        return;
+    }
+
+    reader_running = true;
+    reader_created = (pthread_create(&reader, NULL, reader_thread, NULL) == 0);
+
+    if (!reader_created) {
+        reader_running = false;
+        close(reader_wake[0]);
+        close(reader_wake[1]);
+    }
+}
+
+/** Wake the thread from poll() */
+static void reader_kick(void)
+{
+    char dummy = 0;
+    (void) write(reader_wake[1], &dummy, 1);
+}
 
 bool stdin_poll(char *key)
 {
-    /* Check new character */
-    fd_set rfds;
+    if (!reader_started) {
+        reader_start();
+    }
+
+    size_t tail = ring_tail;
+
+    if (__atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) == tail) {
+        return false;
+    }
+
+    *key = ring[tail & (STDIN_RING_SIZE - 1)];
+    __atomic_store_n(&ring_tail, tail + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/** Sleep until a character is read or the timeout expires
+ *
+ * If no input is being read (i.e. nothing has polled the input yet
+ * or the input has ended), the call just sleeps.
+ *
+ * @param timeout Timeout in milliseconds.
+ *
+ * @return True if a character is ready to be polled.
+ *
+ */
+bool stdin_wait(unsigned int timeout)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (long) (timeout % 1000) * 1000000;
+
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
 
-    /* Watch stdin */
-    FD_ZERO(&rfds);
-    FD_SET(0, &rfds);
+    pthread_mutex_lock(&reader_mutex);
 
-    struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = 0;
+    bool ready = false;
 
-    int retval = select(1, &rfds, NULL, NULL, &tv);
+    while (true) {
+        ready = (__atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) != ring_tail);
 
-    if (retval == 1) {
-        /* There is a new character */
-        if (read(0, key, 1) > 0) {
-            return true;
+        if ((ready) || (pthread_cond_timedwait(&reader_cond, &reader_mutex,
+                &deadline) == ETIMEDOUT)) {
+            break;
         }
     }
 
-    return false;
+    pthread_mutex_unlock(&reader_mutex);
+    return ready;
+}
+
+/** Stop reading the standard input
+ *
+ * Returns once the thread does not read anymore, so the characters
+ * typed from now on are left to the caller.
+ *
+ */
+void stdin_pause(void)
+{
+    if (!reader_started) {
+        return;
+    }
+
+    pthread_mutex_lock(&reader_mutex);
+    reader_paused = true;
+
+    if (reader_running) {
+        reader_kick();
+
+        while ((reader_running) && (!reader_parked)) {
+            pthread_cond_wait(&reader_cond, &reader_mutex);
+        }
+    }
+
+    pthread_mutex_unlock(&reader_mutex);
+}
+
+/** Continue reading the standard input */
+void stdin_resume(void)
+{
+    if (!reader_started) {
+        return;
+    }
+
+    pthread_mutex_lock(&reader_mutex);
+    reader_paused = false;
+    pthread_cond_broadcast(&reader_cond);
+    pthread_mutex_unlock(&reader_mutex);
+}
+
+/** Terminate the thread */
+void stdin_done(void)
+{
+    if (!reader_started) {
+        return;
+    }
+
+    pthread_mutex_lock(&reader_mutex);
+    reader_quit = true;
+    pthread_cond_broadcast(&reader_cond);
+
+    if (reader_running) {
+        reader_kick();
+    }
+
+    pthread_mutex_unlock(&reader_mutex);
+
+    if (reader_created) {
+        pthread_join(reader, NULL);
+        close(reader_wake[0]);
+        close(reader_wake[1]);
+    }
+
+    /* Another machine may start the thread again */
+    reader_started = false;
+    reader_created = false;
+    reader_running = false;
+    reader_paused = false;
+    reader_parked = false;
+    reader_quit = false;
+    ring_head = 0;
+    ring_tail = 0;
 }
 
 #endif /* !__WIN32__ */
@@ -12,5 +12,9 @@
 #include <stdbool.h>
 
 extern bool stdin_poll(char *key);
+extern bool stdin_wait(unsigned int timeout);
+extern void stdin_pause(void);
+extern void stdin_resume(void);
+extern void stdin_done(void);
 
 #endif
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ */
+
+#include "../affinity.h"
+
+#ifdef __WIN32__
+
+#include <errno.h>
+
+unsigned int host_core_count(void)
+{
+    return 1;
+}
+
+bool host_pin_thread(int core)
+{
+    if (core < 0) {
+        return true;
+    }
+
+    errno = ENOSYS;
+    return false;
+}
+
+bool host_node_allowed(unsigned int node)
+{
+    return false;
+}
+
+bool host_mem_place(void *ptr, size_t size, host_mem_policy_t policy,
+        unsigned int node, bool move)
+{
+    if (policy == HOST_MEM_LOCAL) {
+        return true;
+    }
+
+    errno = ENOSYS;
+    return false;
+}
+
+#endif /* __WIN32__ */
@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include <windows.h>
 
+#include "../../debug/flight.h"
 #include "../../fault.h"
 #include "../../input.h"
 #include "../../main.h"
@@ -30,12 +31,13 @@ static BOOL machine_user_break(DWORD fdwCtrlType)
         }
 
         machine_break = true;
+        flight_requested = true;
 
         if (!machine_interactive) {
             machine_newline = true;
         }
 
-        machine_interactive = true;
+        __atomic_store_n(&machine_interactive, true, __ATOMIC_RELEASE);
 
         return true;
     }
@@ -51,4 +51,31 @@ bool stdin_poll(char *key)
     return false;
 }
 
+/** Sleep until there is some input or the timeout expires
+ *
+ * @param timeout Timeout in milliseconds.
+ *
+ * @return True if there may be some input to be polled.
+ *
+ */
+bool stdin_wait(unsigned int timeout)
+{
+    HANDLE stdin = GetStdHandle(STD_INPUT_HANDLE);
+    return (WaitForSingleObject(stdin, timeout) == WAIT_OBJECT_0);
+}
+
+/* The console is polled directly, there is no reader to pause */
+
+void stdin_pause(void)
+{
+}
+
+void stdin_resume(void)
+{
+}
+
+void stdin_done(void)
+{
+}
+
 #endif /* __WIN32__ */
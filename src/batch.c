@@ -0,0 +1,742 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Batch of test cases run by forked simulators
+ *
+ *  The machine configured before the batch starts (the shared prefix)
+ *  is inherited by a forked child for each test case, so it is set up
+ *  only once and its memory is shared copy-on-write. The child runs
+ *  the configuration file of the test case in the directory of the
+ *  test case and its output is compared with the expected output.
+ *  Several children run at the same time.
+ *
+ *  Each line of the batch file names the directory of a test case,
+ *  the file with the expected output and optionally the output file
+ *  written by the test (e.g. the printer redirection). The standard
+ *  output of the simulator is compared if no output file is named.
+ *  Empty lines and lines starting with # are skipped.
+ *
+ *  The same pool of children runs independent machines given by their
+ *  configuration files. Their output is copied to the output of the
+ *  simulator in the order of the configuration files, as if the
+ *  machines ran one after another.
+ *
+ *  The server forks a child for each job received over a UNIX socket
+ *  instead. The job is the configuration read from the connection
+ *  (until the client shuts down its side) and the output of the child
+ *  is written back to the connection.
+ *
+ */
+
+#include "batch.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assert.h"
+#include "fault.h"
+#include "list.h"
+#include "main.h"
+#include "utils.h"
+
+#ifndef __WIN32__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/** Time limit of a single test case (in seconds) */
+#define BATCH_TIME_LIMIT 60
+
+/** Test case of the batch */
+typedef struct {
+    item_t item;
+
+    char *dir; /**< NULL for a machine run in the current directory */
+    char *config; /**< Configuration file of the simulation */
+    char *expected; /**< NULL for a machine */
+    char *output; /**< NULL if the standard output is compared */
+
+    FILE *stdout_file; /**< Captured standard output of the child */
+    FILE *stderr_file; /**< Captured standard error of the child */
+    pid_t pid; /**< Child process (0 if not running) */
+
+    bool passed;
+    const char *reason; /**< Reason of the failure */
+    char *log; /**< Standard error of the failed test case */
+} batch_test_t;
+
+static list_t tests = LIST_INITIALIZER;
+static size_t test_count = 0;
+
+/** Build the path of a file of the test case */
+static char *test_path(batch_test_t *test, const char *name)
+{
+    if (name[0] == '/') {
+        return safe_strdup(name);
+    }
+
+    size_t len = strlen(test->dir) + strlen(name) + 2;
+    char *path = (char *) safe_malloc(len);
+    snprintf(path, len, "%s/%s", test->dir, name);
+
+    return path;
+}
+
+/** Read the test cases from the batch file
+ *
+ * @return True if successful.
+ *
+ */
+static bool batch_load(const char *path)
+{
+    FILE *file = try_fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+
+    string_t str;
+    string_init(&str);
+    string_fread(&str, file);
+    safe_fclose(file, path);
+
+    unsigned int lineno = 0;
+    bool ok = true;
+
+    char *next;
+    for (char *line = str.str; line != NULL; line = next) {
+        next = strchr(line, '\n');
+        if (next != NULL) {
+            *next = 0;
+            next++;
+        }
+
+        lineno++;
+
+        char *words[4] = { NULL, NULL, NULL, NULL };
+        size_t count = 0;
+        char *save;
+
+        for (char *word = strtok_r(line, " \t\r", &save);
+                (word != NULL) && (count < 4);
+                word = strtok_r(NULL, " \t\r", &save)) {
+            words[count++] = word;
+        }
+
+        if ((count == 0) || (words[0][0] == '#')) {
+            continue;
+        }
+
+        if ((count < 2) || (count > 3)) {
+            error("Invalid test case in %s on line %u", path, lineno);
+            ok = false;
+            break;
+        }
+
+        batch_test_t *test = safe_malloc_t(batch_test_t);
+        memset(test, 0, sizeof(batch_test_t));
+        item_init(&test->item);
+        list_append(&tests, &test->item);
+        test_count++;
+
+        test->dir = safe_strdup(words[0]);
+        test->config = safe_strdup("msim.conf");
+        test->expected = test_path(test, words[1]);
+        test->output = (count == 3) ? test_path(test, words[2]) : NULL;
+    }
+
+    string_done(&str);
+    return ok;
+}
+
+/** Run the simulation of a test case in the forked child */
+static void batch_child(batch_test_t *test, batch_simulate_t simulate)
+{
+    int null = open("/dev/null", O_RDONLY);
+
+    if ((null < 0) || (dup2(null, STDIN_FILENO) < 0)
+            || (dup2(fileno(test->stdout_file), STDOUT_FILENO) < 0)
+            || (dup2(fileno(test->stderr_file), STDERR_FILENO) < 0)) {
+        exit(ERR_IO);
+    }
+
+    close(null);
+
+    if (test->dir == NULL) {
+        /* Machines are not limited in time */
+        exit(simulate(test->config));
+    }
+
+    if (chdir(test->dir) != 0) {
+        io_die(ERR_IO, test->dir);
+    }
+
+    alarm(BATCH_TIME_LIMIT);
+    exit(simulate(test->config));
+}
+
+/** Start the child process of a test case
+ *
+ * The output file left behind by a previous run is removed first,
+ * so that it cannot be mistaken for the output of this run.
+ *
+ * @return True if the child has been started.
+ *
+ */
+static bool batch_start(batch_test_t *test, batch_simulate_t simulate)
+{
+    if ((test->output != NULL) && (unlink(test->output) != 0)
+            && (errno != ENOENT)) {
+        io_error(test->output);
+    }
+
+    test->stdout_file = tmpfile();
+    test->stderr_file = tmpfile();
+
+    if ((test->stdout_file == NULL) || (test->stderr_file == NULL)) {
+        io_error("temporary file");
+
+        if (test->stdout_file != NULL) {
+            fclose(test->stdout_file);
+        }
+
+        if (test->stderr_file != NULL) {
+            fclose(test->stderr_file);
+        }
+
+        test->stdout_file = NULL;
+        test->stderr_file = NULL;
+        return false;
+    }
+
+    /* The child must not print the buffered output again */
+    fflush(NULL);
+
+    test->pid = fork();
+
+    if (test->pid < 0) {
+        io_error("fork");
+        test->pid = 0;
+        fclose(test->stdout_file);
+        fclose(test->stderr_file);
+        test->stdout_file = NULL;
+        test->stderr_file = NULL;
+        return false;
+    }
+
+    if (test->pid == 0) {
+        batch_child(test, simulate);
+    }
+
+    return true;
+}
+
+/** Compare the contents of two files
+ *
+ * @return True if both files can be read and are the same.
+ *
+ */
+static bool files_equal(FILE *a, FILE *b)
+{
+    char buf_a[4096];
+    char buf_b[4096];
+
+    while (true) {
+        size_t len_a = fread(buf_a, 1, sizeof(buf_a), a);
+        size_t len_b = fread(buf_b, 1, sizeof(buf_b), b);
+
+        if ((len_a != len_b) || (memcmp(buf_a, buf_b, len_a) != 0)) {
+            return false;
+        }
+
+        if (len_a < sizeof(buf_a)) {
+            return (!ferror(a)) && (!ferror(b));
+        }
+    }
+}
+
+/** Check the output of a test case whose child has terminated
+ *
+ * The captured output of a machine is kept for batch_report_machines().
+ *
+ */
+static void batch_check(batch_test_t *test, int status)
+{
+    test->passed = false;
+    test->pid = 0;
+
+    if (test->expected == NULL) {
+        test->passed = (WIFEXITED(status)) && (WEXITSTATUS(status) == ERR_OK);
+        test->reason = (WIFSIGNALED(status)) ? "killed by a signal"
+                : "simulator failed";
+        return;
+    }
+
+    if (WIFSIGNALED(status)) {
+        test->reason = (WTERMSIG(status) == SIGALRM) ? "time limit exceeded"
+                : "killed by a signal";
+    } else if ((WIFEXITED(status)) && (WEXITSTATUS(status) == ERR_MISMATCH)) {
+        test->reason = "output differs";
+    } else if ((!WIFEXITED(status)) || (WEXITSTATUS(status) != ERR_OK)) {
+        test->reason = "simulator failed";
+    } else {
+        FILE *expected = fopen(test->expected, "rb");
+        FILE *output = test->stdout_file;
+
+        if (test->output != NULL) {
+            output = fopen(test->output, "rb");
+        } else {
+            rewind(output);
+        }
+
+        if ((expected == NULL) || (output == NULL)) {
+            test->reason = "missing output";
+        } else if (!files_equal(expected, output)) {
+            test->reason = "output differs";
+        } else {
+            test->passed = true;
+        }
+
+        if (expected != NULL) {
+            fclose(expected);
+        }
+
+        if ((output != NULL) && (output != test->stdout_file)) {
+            fclose(output);
+        }
+    }
+
+    if (!test->passed) {
+        string_t str;
+        string_init(&str);
+        rewind(test->stderr_file);
+        string_fread(&str, test->stderr_file);
+        test->log = safe_strdup(str.str);
+        string_done(&str);
+    }
+
+    fclose(test->stdout_file);
+    fclose(test->stderr_file);
+}
+
+/** Find the test case run by a child */
+static batch_test_t *batch_find(pid_t pid)
+{
+    batch_test_t *test;
+
+    for_each(tests, test, batch_test_t) {
+        if (test->pid == pid) {
+            return test;
+        }
+    }
+
+    return NULL;
+}
+
+/** Print the results of the test cases in the order of the batch file
+ *
+ * @return Number of the failed test cases.
+ *
+ */
+static size_t batch_report(void)
+{
+    size_t failed = 0;
+    batch_test_t *test;
+
+    for_each(tests, test, batch_test_t) {
+        if (test->passed) {
+            printf("%-40s ok\n", test->dir);
+            continue;
+        }
+
+        failed++;
+        printf("%-40s failed (%s)\n", test->dir, test->reason);
+
+        if ((test->log != NULL) && (test->log[0] != 0)) {
+            fputs(test->log, stdout);
+        }
+    }
+
+    printf("%zu tests, %zu failed\n", test_count, failed);
+    return failed;
+}
+
+/** Copy the captured output of a child */
+static void copy_output(FILE *src, FILE *dst)
+{
+    char buf[4096];
+    size_t len;
+
+    rewind(src);
+    while ((len = fread(buf, 1, sizeof(buf), src)) > 0) {
+        fwrite(buf, 1, len, dst);
+    }
+
+    fclose(src);
+}
+
+/** Print the output of the machines in the order of their configurations
+ *
+ * @return Number of the failed machines.
+ *
+ */
+static size_t batch_report_machines(void)
+{
+    size_t failed = 0;
+    batch_test_t *test;
+
+    for_each(tests, test, batch_test_t) {
+        if (test->stdout_file == NULL) {
+            error("Machine %s not started", test->config);
+            failed++;
+            continue;
+        }
+
+        fflush(stderr);
+        copy_output(test->stdout_file, stdout);
+        fflush(stdout);
+        copy_output(test->stderr_file, stderr);
+
+        if (!test->passed) {
+            error("Machine %s failed (%s)", test->config, test->reason);
+            failed++;
+        }
+    }
+
+    fflush(NULL);
+    return failed;
+}
+
+/** Release the test cases */
+static void batch_done(void)
+{
+    while (!is_empty(&tests)) {
+        batch_test_t *test = (batch_test_t *) tests.head;
+        list_remove(&tests, &test->item);
+
+        safe_free(test->dir);
+        safe_free(test->config);
+        safe_free(test->expected);
+        safe_free(test->output);
+        safe_free(test->log);
+        safe_free(test);
+    }
+
+    test_count = 0;
+}
+
+/** Run the simulations of the test cases in the children
+ *
+ * @param jobs     Number of children run at the same time
+ *                 (0 for one per host processor).
+ * @param simulate Simulation run by the child.
+ *
+ */
+static void batch_pool(unsigned int jobs, batch_simulate_t simulate)
+{
+    if (jobs == 0) {
+        long int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = (cpus > 0) ? cpus : 1;
+    }
+
+    batch_test_t *next = (batch_test_t *) tests.head;
+    size_t running = 0;
+
+    while ((next != NULL) || (running > 0)) {
+        while ((next != NULL) && (running < jobs)) {
+            batch_test_t *test = next;
+            next = (batch_test_t *) next->item.next;
+
+            if (batch_start(test, simulate)) {
+                running++;
+            } else {
+                test->reason = "not started";
+            }
+        }
+
+        if (running == 0) {
+            continue;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            io_die(ERR_INTERN, "waitpid");
+        }
+
+        batch_test_t *test = batch_find(pid);
+        if (test != NULL) {
+            batch_check(test, status);
+            running--;
+        }
+    }
+}
+
+/** Run the test cases of a batch file
+ *
+ * @param path     Name of the batch file.
+ * @param jobs     Number of test cases run at the same time
+ *                 (0 for one per host processor).
+ * @param simulate Simulation of a test case run by the child
+ *                 in the directory of the test case.
+ *
+ * @return True if all test cases have passed.
+ *
+ */
+bool batch_run(const char *path, unsigned int jobs, batch_simulate_t simulate)
+{
+    ASSERT(path != NULL);
+    ASSERT(simulate != NULL);
+
+    if (!batch_load(path)) {
+        batch_done();
+        return false;
+    }
+
+    batch_pool(jobs, simulate);
+
+    bool ok = (batch_report() == 0);
+    batch_done();
+    return ok;
+}
+
+/** Run independent machines
+ *
+ * Each machine is simulated by a child in the current directory.
+ * The standard output and the standard error output of the machines
+ * are printed once all of them have finished.
+ *
+ * @param configs  Configuration files of the machines.
+ * @param count    Number of the machines.
+ * @param jobs     Number of machines run at the same time
+ *                 (0 for one per host processor).
+ * @param simulate Simulation of a machine run by the child.
+ *
+ * @return True if all machines have finished successfully.
+ *
+ */
+bool batch_run_machines(char *const *configs, size_t count,
+        unsigned int jobs, batch_simulate_t simulate)
+{
+    ASSERT(configs != NULL);
+    ASSERT(simulate != NULL);
+
+    for (size_t i = 0; i < count; i++) {
+        batch_test_t *test = safe_malloc_t(batch_test_t);
+        memset(test, 0, sizeof(batch_test_t));
+        item_init(&test->item);
+        list_append(&tests, &test->item);
+        test_count++;
+
+        test->config = safe_strdup(configs[i]);
+    }
+
+    batch_pool(jobs, simulate);
+
+    bool ok = (batch_report_machines() == 0);
+    batch_done();
+    return ok;
+}
+
+/** Number of the connections waiting for the server */
+#define SERVE_BACKLOG 64
+
+/** Open the UNIX socket of the server
+ *
+ * @return Listening socket or -1 on failure.
+ *
+ */
+static int serve_listen(const char *path)
+{
+    struct sockaddr_un sa;
+
+    if (strlen(path) >= sizeof(sa.sun_path)) {
+        error("Socket path too long");
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        io_error("socket");
+        return -1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, path);
+    unlink(path);
+
+    if ((bind(fd, (struct sockaddr *) &sa, sizeof(sa)) < 0)
+            || (listen(fd, SERVE_BACKLOG) < 0)) {
+        io_error(path);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/** Run a job received by the server in the forked child */
+static void serve_child(int listen_fd, int fd, batch_serve_t serve)
+{
+    close(listen_fd);
+
+    int null = open("/dev/null", O_RDONLY);
+    FILE *job = fdopen(fd, "r");
+
+    if ((null < 0) || (job == NULL) || (dup2(null, STDIN_FILENO) < 0)
+            || (dup2(fd, STDOUT_FILENO) < 0)
+            || (dup2(fd, STDERR_FILENO) < 0)) {
+        exit(ERR_IO);
+    }
+
+    close(null);
+    exit(serve(job));
+}
+
+/** Reap the children of the finished jobs
+ *
+ * @param running Number of the jobs running.
+ * @param wait    Wait until a job finishes.
+ *
+ */
+static void serve_reap(size_t *running, bool wait)
+{
+    while (*running > 0) {
+        int status;
+        pid_t pid = waitpid(-1, &status, wait ? 0 : WNOHANG);
+
+        if (pid > 0) {
+            (*running)--;
+            wait = false;
+            continue;
+        }
+
+        if ((pid < 0) && (errno == EINTR) && (!machine_break)) {
+            continue;
+        }
+
+        break;
+    }
+}
+
+/** Serve the jobs received over a UNIX socket
+ *
+ * Each job is run by a forked child, so the machine set up before
+ * (e.g. restored from a checkpoint of a booted system) is shared
+ * copy-on-write by the jobs and every job starts from its state.
+ * The server runs until it is interrupted.
+ *
+ * @param path  Path of the socket.
+ * @param jobs  Number of jobs run at the same time
+ *              (0 for one per host processor).
+ * @param serve Simulation of a job run by the child.
+ *
+ * @return False if the socket cannot be opened.
+ *
+ */
+bool batch_serve(const char *path, unsigned int jobs, batch_serve_t serve)
+{
+    ASSERT(path != NULL);
+    ASSERT(serve != NULL);
+
+    if (jobs == 0) {
+        long int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = (cpus > 0) ? cpus : 1;
+    }
+
+    int listen_fd = serve_listen(path);
+    if (listen_fd < 0) {
+        return false;
+    }
+
+    alert("Serving jobs on %s", path);
+
+    size_t running = 0;
+
+    while (!machine_break) {
+        serve_reap(&running, running >= jobs);
+
+        int fd = accept(listen_fd, NULL, NULL);
+
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            io_error("accept");
+            break;
+        }
+
+        if (machine_break) {
+            close(fd);
+            break;
+        }
+
+        /* The child must not print the buffered output again */
+        fflush(NULL);
+
+        pid_t pid = fork();
+
+        if (pid == 0) {
+            serve_child(listen_fd, fd, serve);
+        }
+
+        close(fd);
+
+        if (pid < 0) {
+            io_error("fork");
+        } else {
+            running++;
+        }
+    }
+
+    close(listen_fd);
+    unlink(path);
+
+    machine_break = false;
+    while (running > 0) {
+        serve_reap(&running, true);
+    }
+
+    return true;
+}
+
+#else /* __WIN32__ */
+
+bool batch_run(const char *path, unsigned int jobs, batch_simulate_t simulate)
+{
+    error("The batch mode is not supported on this host");
+    return false;
+}
+
+bool batch_run_machines(char *const *configs, size_t count,
+        unsigned int jobs, batch_simulate_t simulate)
+{
+    error("Running several machines is not supported on this host");
+    return false;
+}
+
+bool batch_serve(const char *path, unsigned int jobs, batch_serve_t serve)
+{
+    error("Serving jobs is not supported on this host");
+    return false;
+}
+
+#endif /* __WIN32__ */
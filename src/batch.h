@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Batch of test cases run by forked simulators
+ *
+ */
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/** Simulation of a single test case or machine given its configuration
+ *
+ * Returns the exit status of the simulation.
+ *
+ */
+typedef int (*batch_simulate_t)(const char *config);
+
+/** Simulation of a job of the server given its configuration
+ *
+ * The configuration is read from the stream. Returns the exit
+ * status of the simulation.
+ *
+ */
+typedef int (*batch_serve_t)(FILE *job);
+
+extern bool batch_run(const char *path, unsigned int jobs,
+        batch_simulate_t simulate);
+extern bool batch_run_machines(char *const *configs, size_t count,
+        unsigned int jobs, batch_simulate_t simulate);
+extern bool batch_serve(const char *path, unsigned int jobs,
+        batch_serve_t serve);
+
+#endif
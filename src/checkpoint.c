@@ -0,0 +1,862 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Machine checkpoints
+ *
+ *  A checkpoint holds the state of all devices which can save it
+ *  (processors, memories and peripherals), the scheduled device
+ *  events and the machine cycle counter. It is restored into a
+ *  machine with the same configuration, typically by the `restore'
+ *  command at the end of the configuration file, so the devices
+ *  are looked up by their names.
+ *
+ *  The state is stored in the host representation and only the
+ *  touched pages of the memories are stored, so the checkpoint is
+ *  specific to the MSIM build and host which created it.
+ *
+ *  An incremental checkpoint refers to the checkpoint saved or
+ *  restored before it (its base) and stores only the memory frames
+ *  written to since then, the rest of the state is stored in full.
+ *  Restoring it restores the chain of its bases first.
+ *
+ *  A checkpoint saved in the background is written by a forked
+ *  process, which holds a copy-on-write image of the machine, while
+ *  the simulation goes on. The simulation only waits for the writer
+ *  once another checkpoint is saved or restored.
+ *
+ *  The reset point is an unnamed checkpoint kept in a temporary file
+ *  without the memory contents, the memories save the frames written
+ *  to after it themselves (see physmem_reset_mark()). The reset thus
+ *  costs the state of the devices and the frames written to since.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef __WIN32__
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "../config.h"
+#include "assert.h"
+#include "checkpoint.h"
+#include "debug/callstack.h"
+#include "debug/pcprofile.h"
+#include "device/device.h"
+#include "fault.h"
+#include "main.h"
+#include "output.h"
+#include "physmem.h"
+#include "profile.h"
+#include "utils.h"
+
+/** Longest string stored in a checkpoint */
+#define CHECKPOINT_STR_LIMIT 4096
+
+/** Terminator of the list of stored pages */
+#define CHECKPOINT_PAGES_END UINT64_MAX
+
+/** Longest chain of incremental checkpoints */
+#define CHECKPOINT_CHAIN_LIMIT 1024
+
+static const uint8_t zero_page[FRAME_SIZE];
+
+/** Last checkpoint saved or restored (NULL if none)
+ *
+ * The memory frames are clean since then, so it is the base
+ * of the next incremental checkpoint.
+ *
+ */
+static char *last_path = NULL;
+static uint64_t last_id = 0;
+
+/** State of the devices at the reset point (NULL if none) */
+static FILE *reset_file = NULL;
+
+#ifndef __WIN32__
+
+/** Process writing a checkpoint in the background (0 if none) */
+static pid_t writer_pid = 0;
+static char *writer_path = NULL;
+
+#endif
+
+/** Generate an identifier of a new checkpoint
+ *
+ * The identifier is stored along with the path of the base of an
+ * incremental checkpoint, so a base overwritten in the meantime
+ * is detected.
+ *
+ */
+static uint64_t checkpoint_new_id(void)
+{
+    static uint64_t counter = 0;
+
+    return (current_timestamp() << 20) ^ (++counter);
+}
+
+/** Remember the last checkpoint saved or restored */
+static void checkpoint_set_last(const char *path, uint64_t id)
+{
+    safe_free(last_path);
+
+    if (path != NULL) {
+        last_path = safe_strdup(path);
+    }
+
+    last_id = id;
+}
+
+/** Get the last checkpoint saved or restored
+ *
+ * @return Path of the checkpoint the next incremental checkpoint
+ *         is based on (NULL if none).
+ *
+ */
+const char *checkpoint_last(void)
+{
+    return last_path;
+}
+
+/** Report an I/O error of the checkpoint file once */
+static bool checkpoint_io_error(checkpoint_t *ckpt)
+{
+    if (!ckpt->failed) {
+        if (feof(ckpt->file)) {
+            error("Checkpoint file %s is truncated", ckpt->path);
+        } else {
+            io_error(ckpt->path);
+        }
+
+        ckpt->failed = true;
+    }
+
+    return false;
+}
+
+/** Get the position in the checkpoint file */
+static bool checkpoint_tell(checkpoint_t *ckpt, uint64_t *pos)
+{
+    long lpos = ftell(ckpt->file);
+
+    if (lpos < 0) {
+        return checkpoint_io_error(ckpt);
+    }
+
+    *pos = (uint64_t) lpos;
+    return true;
+}
+
+/** Set the position in the checkpoint file */
+static bool checkpoint_seek(checkpoint_t *ckpt, uint64_t pos)
+{
+    if (fseek(ckpt->file, (long) pos, SEEK_SET) != 0) {
+        return checkpoint_io_error(ckpt);
+    }
+
+    return true;
+}
+
+bool checkpoint_write(checkpoint_t *ckpt, const void *data, size_t size)
+{
+    ASSERT(ckpt != NULL);
+
+    if (ckpt->failed) {
+        return false;
+    }
+
+    if ((size > 0) && (fwrite(data, size, 1, ckpt->file) != 1)) {
+        return checkpoint_io_error(ckpt);
+    }
+
+    return true;
+}
+
+bool checkpoint_read(checkpoint_t *ckpt, void *data, size_t size)
+{
+    ASSERT(ckpt != NULL);
+
+    if (ckpt->failed) {
+        return false;
+    }
+
+    if ((size > 0) && (fread(data, size, 1, ckpt->file) != 1)) {
+        return checkpoint_io_error(ckpt);
+    }
+
+    return true;
+}
+
+bool checkpoint_write_uint64(checkpoint_t *ckpt, uint64_t val)
+{
+    return checkpoint_write_var(ckpt, val);
+}
+
+bool checkpoint_read_uint64(checkpoint_t *ckpt, uint64_t *val)
+{
+    return checkpoint_read(ckpt, val, sizeof(*val));
+}
+
+bool checkpoint_write_str(checkpoint_t *ckpt, const char *str)
+{
+    ASSERT(str != NULL);
+
+    size_t len = strlen(str);
+    return checkpoint_write_uint64(ckpt, len)
+            && checkpoint_write(ckpt, str, len);
+}
+
+/** Read a string
+ *
+ * @return The string allocated by safe_malloc() or NULL on failure.
+ *
+ */
+char *checkpoint_read_str(checkpoint_t *ckpt)
+{
+    uint64_t len;
+
+    if (!checkpoint_read_uint64(ckpt, &len)) {
+        return NULL;
+    }
+
+    if (len > CHECKPOINT_STR_LIMIT) {
+        error("Checkpoint file %s is corrupted", ckpt->path);
+        ckpt->failed = true;
+        return NULL;
+    }
+
+    char *str = (char *) safe_malloc(len + 1);
+
+    if (!checkpoint_read(ckpt, str, len)) {
+        safe_free(str);
+        return NULL;
+    }
+
+    str[len] = 0;
+    return str;
+}
+
+/** Write memory contents
+ *
+ * Only the pages which are not filled with zeros are stored.
+ *
+ */
+bool checkpoint_write_pages(checkpoint_t *ckpt, const uint8_t *data,
+        size_t size)
+{
+    for (size_t offset = 0; offset < size; offset += FRAME_SIZE) {
+        size_t len = (size - offset < FRAME_SIZE) ? size - offset : FRAME_SIZE;
+
+        if (memcmp(data + offset, zero_page, len) == 0) {
+            continue;
+        }
+
+        if (!checkpoint_write_uint64(ckpt, offset / FRAME_SIZE)
+                || !checkpoint_write(ckpt, data + offset, len)) {
+            return false;
+        }
+    }
+
+    return checkpoint_write_uint64(ckpt, CHECKPOINT_PAGES_END);
+}
+
+/** Read memory contents written by checkpoint_write_pages()
+ *
+ * The pages are read in place, the memory has to be cleared
+ * by the caller (the pages which are not stored are zeros).
+ *
+ */
+bool checkpoint_read_pages(checkpoint_t *ckpt, uint8_t *data, size_t size)
+{
+    while (true) {
+        uint64_t page;
+
+        if (!checkpoint_read_uint64(ckpt, &page)) {
+            return false;
+        }
+
+        if (page == CHECKPOINT_PAGES_END) {
+            return true;
+        }
+
+        if (page >= (size + FRAME_SIZE - 1) / FRAME_SIZE) {
+            error("Checkpoint file %s is corrupted", ckpt->path);
+            ckpt->failed = true;
+            return false;
+        }
+
+        size_t offset = page * FRAME_SIZE;
+        size_t len = (size - offset < FRAME_SIZE) ? size - offset : FRAME_SIZE;
+
+        if (!checkpoint_read(ckpt, data + offset, len)) {
+            return false;
+        }
+    }
+}
+
+/** Write the frames of an area written to since the last checkpoint
+ *
+ * The frames are stored in the format of checkpoint_write_pages()
+ * (including the frames filled with zeros), so they are read by
+ * checkpoint_read_pages() over the contents of the base checkpoint.
+ *
+ */
+bool checkpoint_write_frames(checkpoint_t *ckpt, physmem_area_t *area)
+{
+    ASSERT(area != NULL);
+    ASSERT(area->frames != NULL);
+
+    for (pfn_t pfn = 0; pfn < area->count; pfn++) {
+        if (!area->frames[pfn].dirty) {
+            continue;
+        }
+
+        if (!checkpoint_write_uint64(ckpt, pfn)
+                || !checkpoint_write(ckpt, area->data + FRAMES2SIZE(pfn), FRAME_SIZE)) {
+            return false;
+        }
+    }
+
+    return checkpoint_write_uint64(ckpt, CHECKPOINT_PAGES_END);
+}
+
+/** Save the state of a device as a section of the checkpoint
+ *
+ * The section starts with the device name, the device type name and
+ * the size of the state, so the restore can check that the device is
+ * configured in the same way.
+ *
+ */
+static bool checkpoint_save_device(checkpoint_t *ckpt, device_t *dev)
+{
+    uint64_t size_pos;
+    uint64_t end_pos;
+
+    return checkpoint_write_str(ckpt, dev->name)
+            && checkpoint_write_str(ckpt, dev->type->name)
+            && checkpoint_tell(ckpt, &size_pos)
+            && checkpoint_write_uint64(ckpt, 0)
+            && dev->type->save(dev, ckpt)
+            && checkpoint_tell(ckpt, &end_pos)
+            && checkpoint_seek(ckpt, size_pos)
+            && checkpoint_write_uint64(ckpt, end_pos - size_pos - sizeof(uint64_t))
+            && checkpoint_seek(ckpt, end_pos);
+}
+
+/** Write the state of all devices and the scheduled events
+ *
+ */
+static bool checkpoint_write_devices(checkpoint_t *ckpt)
+{
+    bool ok = true;
+
+    device_t *dev = NULL;
+    while ((ok) && (dev_next(&dev, DEVICE_FILTER_ALL))) {
+        if (dev->type->save != NULL) {
+            ok = checkpoint_save_device(ckpt, dev);
+        }
+    }
+
+    /* The list of devices ends with an empty name */
+    return ok && checkpoint_write_str(ckpt, "") && dev_save_events(ckpt);
+}
+
+/** Write the machine state into a checkpoint file
+ *
+ * @return True if successful.
+ *
+ */
+static bool checkpoint_write_file(const char *path, bool incremental,
+        uint64_t id)
+{
+    checkpoint_t ckpt = {
+        .file = try_fopen(path, "wb"),
+        .path = path,
+        .failed = false,
+        .incremental = incremental
+    };
+
+    if (ckpt.file == NULL) {
+        return false;
+    }
+
+    uint32_t version = CHECKPOINT_VERSION;
+    bool ok = checkpoint_write(&ckpt, CHECKPOINT_MAGIC, strlen(CHECKPOINT_MAGIC))
+            && checkpoint_write_var(&ckpt, version)
+            && checkpoint_write_str(&ckpt, PACKAGE_VERSION)
+            && checkpoint_write_uint64(&ckpt, id)
+            && checkpoint_write_str(&ckpt, incremental ? last_path : "")
+            && checkpoint_write_uint64(&ckpt, incremental ? last_id : 0)
+            && checkpoint_write_uint64(&ckpt, steps)
+            && checkpoint_write_devices(&ckpt);
+
+    if (fclose(ckpt.file) != 0) {
+        checkpoint_io_error(&ckpt);
+        ok = false;
+    }
+
+    return ok;
+}
+
+/** Write the machine state into a checkpoint file by a forked process
+ *
+ * The memory frames are marked clean as if the checkpoint was saved
+ * by the simulator itself.
+ *
+ * @return False if the process cannot be forked, the checkpoint
+ *         has to be saved right away.
+ *
+ */
+static bool checkpoint_fork(const char *path, bool incremental, uint64_t id)
+{
+#ifndef __WIN32__
+    device_t *dev = NULL;
+    while (dev_next(&dev, DEVICE_FILTER_ALL)) {
+        if ((dev->type->prefork != NULL) && (!dev->type->prefork(dev))) {
+            return false;
+        }
+    }
+
+    /* The child must not print the buffered output again */
+    fflush(NULL);
+
+    pid_t pid = fork();
+
+    if (pid < 0) {
+        return false;
+    }
+
+    if (pid == 0) {
+        _exit(checkpoint_write_file(path, incremental, id) ? 0 : 1);
+    }
+
+    writer_pid = pid;
+    writer_path = safe_strdup(path);
+
+    dev = NULL;
+    while (dev_next(&dev, DEVICE_FILTER_MEMORY)) {
+        physmem_area_t *area = (physmem_area_t *) dev->data;
+
+        if ((area->type != MEMT_NONE) && (area->writable)) {
+            physmem_area_clean(area);
+        }
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+/** Wait for the checkpoint being saved in the background
+ *
+ * The checkpoint which could not be saved is not the base
+ * of the following incremental checkpoints.
+ *
+ */
+void checkpoint_wait(void)
+{
+#ifndef __WIN32__
+    if (writer_pid == 0) {
+        return;
+    }
+
+    int status;
+    pid_t pid;
+
+    do {
+        pid = waitpid(writer_pid, &status, 0);
+    } while ((pid < 0) && (errno == EINTR));
+
+    bool ok = (pid == writer_pid) && (WIFEXITED(status))
+            && (WEXITSTATUS(status) == 0);
+
+    if (!ok) {
+        if ((last_path != NULL) && (strcmp(last_path, writer_path) == 0)) {
+            checkpoint_set_last(NULL, 0);
+        }
+
+        error("Checkpoint %s has not been saved in the background", writer_path);
+    }
+
+    safe_free(writer_path);
+    writer_pid = 0;
+#endif
+}
+
+/** Save the machine state into a checkpoint file
+ *
+ * The buffered device output is flushed first, so it is neither
+ * lost nor printed twice when the checkpoint is restored.
+ *
+ * The memory frames are marked clean as they are stored. If the
+ * checkpoint cannot be saved, there is no base for the following
+ * incremental checkpoints until a full one is saved.
+ *
+ * A checkpoint saved in the background is written by a forked process
+ * unless the host cannot fork or a device cannot be saved so (then it
+ * is saved right away). Its errors are reported once the simulator
+ * waits for it (see checkpoint_wait()).
+ *
+ * @param path        Name of the checkpoint file.
+ * @param incremental Store only the memory frames written to
+ *                    since the last checkpoint.
+ * @param background  Save the checkpoint while the simulation goes on.
+ *
+ * @return True if successful.
+ *
+ */
+bool checkpoint_save(const char *path, bool incremental, bool background)
+{
+    ASSERT(path != NULL);
+
+    /* The checkpoint may be based on the one being written */
+    checkpoint_wait();
+
+    if (incremental) {
+        if (last_path == NULL) {
+            error("No checkpoint to base the incremental checkpoint on");
+            return false;
+        }
+
+        if (strcmp(path, last_path) == 0) {
+            error("Incremental checkpoint cannot overwrite its base");
+            return false;
+        }
+    }
+
+    output_flush_all();
+
+    uint64_t id = checkpoint_new_id();
+
+    if ((background) && (checkpoint_fork(path, incremental, id))) {
+        checkpoint_set_last(path, id);
+        return true;
+    }
+
+    bool ok = checkpoint_write_file(path, incremental, id);
+
+    if (ok) {
+        checkpoint_set_last(path, id);
+    } else {
+        checkpoint_set_last(NULL, 0);
+        error("Unable to save the checkpoint");
+    }
+
+    return ok;
+}
+
+/** Restore the state of a device from a section of the checkpoint
+ *
+ */
+static bool checkpoint_restore_device(checkpoint_t *ckpt, const char *name)
+{
+    char *type = checkpoint_read_str(ckpt);
+    uint64_t size;
+
+    if ((type == NULL) || (!checkpoint_read_uint64(ckpt, &size))) {
+        safe_free(type);
+        return false;
+    }
+
+    device_t *dev = dev_by_name(name);
+    bool match = (dev != NULL) && (strcmp(dev->type->name, type) == 0)
+            && (dev->type->load != NULL);
+    safe_free(type);
+
+    if (!match) {
+        error("Device %s of the checkpoint is not configured", name);
+        return false;
+    }
+
+    uint64_t start_pos;
+    uint64_t end_pos;
+
+    if (!checkpoint_tell(ckpt, &start_pos)) {
+        return false;
+    }
+
+    if (!dev->type->load(dev, ckpt)) {
+        if (!ckpt->failed) {
+            error("Device %s is configured differently than in the checkpoint",
+                    name);
+        }
+        return false;
+    }
+
+    if (!checkpoint_tell(ckpt, &end_pos)) {
+        return false;
+    }
+
+    if (end_pos - start_pos != size) {
+        error("Device %s is configured differently than in the checkpoint",
+                name);
+        return false;
+    }
+
+    return true;
+}
+
+/** Restore the state of the devices, the scheduled events and the cycles
+ *
+ * @param saved_steps Machine cycle counter of the checkpoint.
+ * @param changed     Set to true once the machine state is being changed.
+ *
+ */
+static bool checkpoint_read_devices(checkpoint_t *ckpt, uint64_t saved_steps,
+        bool *changed)
+{
+    bool ok = true;
+
+    while (ok) {
+        *changed = true;
+
+        char *name = checkpoint_read_str(ckpt);
+
+        if (name == NULL) {
+            ok = false;
+            break;
+        }
+
+        if (name[0] == 0) {
+            safe_free(name);
+            break;
+        }
+
+        ok = checkpoint_restore_device(ckpt, name);
+        safe_free(name);
+    }
+
+    ok = ok && dev_load_events(ckpt);
+
+    if (ok) {
+        steps = saved_steps;
+
+        /* The profile starts over with the restored cycle counter */
+        profile_set_period(profile_period);
+        pcprofile_rebase();
+
+        /* The restored processors are not in the calls made so far */
+        callstack_reset();
+    }
+
+    return ok;
+}
+
+/** Restore the machine state from a checkpoint file and its bases
+ *
+ * @param path    Name of the checkpoint file.
+ * @param id      Identifier of the checkpoint read from the file.
+ * @param depth   Number of incremental checkpoints based on this one.
+ * @param changed Set to true once the machine state is being changed.
+ *
+ * @return True if successful.
+ *
+ */
+static bool checkpoint_load(const char *path, uint64_t *id, unsigned int depth,
+        bool *changed)
+{
+    checkpoint_t ckpt = {
+        .file = try_fopen(path, "rb"),
+        .path = path,
+        .failed = false,
+        .incremental = false
+    };
+
+    if (ckpt.file == NULL) {
+        return false;
+    }
+
+    char magic[sizeof(CHECKPOINT_MAGIC)] = { 0 };
+    uint32_t version = 0;
+    char *package_version = NULL;
+    char *base = NULL;
+    uint64_t base_id = 0;
+    uint64_t saved_steps = 0;
+
+    bool ok = checkpoint_read(&ckpt, magic, strlen(CHECKPOINT_MAGIC))
+            && checkpoint_read_var(&ckpt, version)
+            && ((package_version = checkpoint_read_str(&ckpt)) != NULL);
+
+    if ((ok) && ((strcmp(magic, CHECKPOINT_MAGIC) != 0)
+                        || (version != CHECKPOINT_VERSION)
+                        || (strcmp(package_version, PACKAGE_VERSION) != 0))) {
+        error("%s is not a checkpoint of this MSIM version", path);
+        ok = false;
+    }
+
+    safe_free(package_version);
+
+    ok = ok && checkpoint_read_uint64(&ckpt, id)
+            && ((base = checkpoint_read_str(&ckpt)) != NULL)
+            && checkpoint_read_uint64(&ckpt, &base_id)
+            && checkpoint_read_uint64(&ckpt, &saved_steps);
+
+    if ((ok) && (base[0] != 0)) {
+        ckpt.incremental = true;
+
+        if (depth >= CHECKPOINT_CHAIN_LIMIT) {
+            error("Too many incremental checkpoints based on %s", base);
+            ok = false;
+        } else {
+            uint64_t loaded_id;
+            ok = checkpoint_load(base, &loaded_id, depth + 1, changed);
+
+            if ((ok) && (loaded_id != base_id)) {
+                error("Checkpoint %s is not the base of %s", base, path);
+                ok = false;
+            }
+        }
+    }
+
+    safe_free(base);
+
+    ok = ok && checkpoint_read_devices(&ckpt, saved_steps, changed);
+
+    safe_fclose(ckpt.file, path);
+    return ok;
+}
+
+/** Restore the machine state from a checkpoint file
+ *
+ * The machine has to be configured in the same way as the machine
+ * which saved the checkpoint. The devices which are not stored in
+ * the checkpoint keep their state. The bases of an incremental
+ * checkpoint are restored first. The reset point is dropped.
+ *
+ * @return True if successful.
+ *
+ */
+bool checkpoint_restore(const char *path)
+{
+    ASSERT(path != NULL);
+
+    uint64_t id;
+    bool changed = false;
+
+    checkpoint_wait();
+    checkpoint_reset_drop();
+
+    if (checkpoint_load(path, &id, 0, &changed)) {
+        checkpoint_set_last(path, id);
+        return true;
+    }
+
+    if (!changed) {
+        return false;
+    }
+
+    checkpoint_set_last(NULL, 0);
+    error("Unable to restore the checkpoint, the machine state is inconsistent");
+    return false;
+}
+
+/** Set the reset point
+ *
+ * The current state of the machine is the one checkpoint_reset()
+ * returns it to, a previous reset point is dropped. The state of the
+ * devices is kept in a temporary file, the memories only start to
+ * save the frames written to from now on.
+ *
+ * @return True if successful.
+ *
+ */
+bool checkpoint_reset_mark(void)
+{
+    checkpoint_reset_drop();
+
+    checkpoint_t ckpt = {
+        .file = tmpfile(),
+        .path = "reset point",
+        .failed = false,
+        .incremental = false,
+        .reset = true
+    };
+
+    if (ckpt.file == NULL) {
+        io_error("reset point");
+        return false;
+    }
+
+    if ((!checkpoint_write_uint64(&ckpt, steps))
+            || (!checkpoint_write_devices(&ckpt))) {
+        fclose(ckpt.file);
+        checkpoint_reset_drop();
+        error("Unable to set the reset point");
+        return false;
+    }
+
+    reset_file = ckpt.file;
+    return true;
+}
+
+/** Return the machine to the reset point
+ *
+ * The devices get their state at the reset point back, only the
+ * memory frames written to since the reset point are copied back,
+ * so the decoded instructions of the other frames are kept. The
+ * devices added after the reset point keep their state.
+ *
+ * @return True if successful.
+ *
+ */
+bool checkpoint_reset(void)
+{
+    if (reset_file == NULL) {
+        error("No reset point");
+        return false;
+    }
+
+    output_flush_all();
+
+    checkpoint_t ckpt = {
+        .file = reset_file,
+        .path = "reset point",
+        .failed = false,
+        .incremental = false,
+        .reset = true
+    };
+
+    uint64_t saved_steps;
+    bool changed = false;
+
+    if ((fseek(reset_file, 0, SEEK_SET) == 0)
+            && (checkpoint_read_uint64(&ckpt, &saved_steps))
+            && (checkpoint_read_devices(&ckpt, saved_steps, &changed))) {
+        return true;
+    }
+
+    if (changed) {
+        error("Unable to reset the machine, the machine state is inconsistent");
+    } else {
+        error("Unable to reset the machine");
+    }
+
+    return false;
+}
+
+/** Drop the reset point
+ *
+ */
+void checkpoint_reset_drop(void)
+{
+    if (reset_file != NULL) {
+        fclose(reset_file);
+        reset_file = NULL;
+    }
+
+    device_t *dev = NULL;
+    while (dev_next(&dev, DEVICE_FILTER_MEMORY)) {
+        physmem_reset_drop((physmem_area_t *) dev->data);
+    }
+}
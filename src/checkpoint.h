@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Machine checkpoints
+ *
+ */
+
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "physmem.h"
+
+/** Identification of the checkpoint file */
+#define CHECKPOINT_MAGIC "MSIMCKPT"
+#define CHECKPOINT_VERSION 4
+
+/** Checkpoint file being written or read */
+typedef struct checkpoint {
+    FILE *file;
+    const char *path;
+    bool failed; /**< An I/O error has been reported */
+    bool incremental; /**< Only the memory frames dirty since the base */
+    bool reset; /**< Reset point (the memories save the written frames) */
+} checkpoint_t;
+
+extern bool checkpoint_save(const char *path, bool incremental,
+        bool background);
+extern bool checkpoint_restore(const char *path);
+extern const char *checkpoint_last(void);
+extern void checkpoint_wait(void);
+extern bool checkpoint_reset_mark(void);
+extern bool checkpoint_reset(void);
+extern void checkpoint_reset_drop(void);
+
+/*
+ * Serialization used by the devices
+ */
+extern bool checkpoint_write(checkpoint_t *ckpt, const void *data, size_t size);
+extern bool checkpoint_read(checkpoint_t *ckpt, void *data, size_t size);
+extern bool checkpoint_write_uint64(checkpoint_t *ckpt, uint64_t val);
+extern bool checkpoint_read_uint64(checkpoint_t *ckpt, uint64_t *val);
+extern bool checkpoint_write_str(checkpoint_t *ckpt, const char *str);
+extern char *checkpoint_read_str(checkpoint_t *ckpt);
+extern bool checkpoint_write_pages(checkpoint_t *ckpt, const uint8_t *data,
+        size_t size);
+extern bool checkpoint_read_pages(checkpoint_t *ckpt, uint8_t *data,
+        size_t size);
+extern bool checkpoint_write_frames(checkpoint_t *ckpt, physmem_area_t *area);
+
+/** Write a variable in the host representation */
+#define checkpoint_write_var(ckpt, var) \
+    checkpoint_write((ckpt), &(var), sizeof(var))
+
+/** Read a variable in the host representation */
+#define checkpoint_read_var(ckpt, var) \
+    checkpoint_read((ckpt), &(var), sizeof(var))
+
+#endif
@@ -20,17 +20,34 @@
 #include <sys/types.h>
 
 #include "assert.h"
+#include "checkpoint.h"
 #include "cmd.h"
 #include "debug/breakpoint.h"
+#include "debug/cosim.h"
+#include "debug/coverage.h"
 #include "debug/debug.h"
+#include "debug/flight.h"
+#include "debug/memtrace.h"
+#include "debug/pcprofile.h"
+#include "debug/reverse.h"
+#include "debug/tracefilter.h"
 #include "device/cpu/mips_r4000/cpu.h"
 #include "device/cpu/mips_r4000/debug.h"
 #include "device/cpu/riscv_rv32ima/cpu.h"
 #include "device/cpu/riscv_rv32ima/debug.h"
+#undef XLEN
+#include "device/cpu/riscv_rv64ima/debug.h"
+#undef XLEN
+#include "device/cpu/isa.h"
 #include "device/device.h"
+#include "elf.h"
 #include "env.h"
 #include "fault.h"
+#include "hostperf.h"
 #include "main.h"
+#include "mdesc.h"
+#include "pace.h"
+#include "profile.h"
 #include "utils.h"
 
 static cmd_t *system_cmds;
@@ -130,6 +147,41 @@ static bool system_step(token_t *parm, void *data)
     return true;
 }
 
+/** Back command implementation
+ *
+ * Go back by one or a specified number of machine cycles.
+ *
+ */
+static bool system_back(token_t *parm, void *data)
+{
+    ASSERT(parm != NULL);
+
+    uint64_t cycles;
+
+    switch (parm_type(parm)) {
+    case tt_end:
+        cycles = 1;
+        break;
+    case tt_uint:
+        cycles = parm_uint(parm);
+        break;
+    default:
+        intr_error("Unexpected parameter type");
+        return false;
+    }
+
+    bool begin;
+    if (!reverse_back(cycles, &begin)) {
+        return false;
+    }
+
+    if (begin) {
+        alert("Reached the oldest snapshot in cycle %" PRIu64, steps);
+    }
+
+    return true;
+}
+
 /** Set command implementation
  *
  * Set configuration variable.
@@ -165,8 +217,8 @@ static bool system_dumpins(token_t *parm, void *data)
     uint64_t _addr = ALIGN_DOWN(parm_uint_next(&parm), 4);
     uint64_t _cnt = parm_uint(parm);
 
-    bool is_rv = strcmp(_cpu, "rv") == 0;
-    bool is_r4k = strcmp(_cpu, "r4k") == 0;
+    bool is_rv = (ISA_RV32 || ISA_RV64) && (strcmp(_cpu, "rv") == 0);
+    bool is_r4k = ISA_R4K && (strcmp(_cpu, "r4k") == 0);
     if (!is_rv && !is_r4k) {
         error("Unknown CPU type (supported types: r4k, rv)");
         return false;
@@ -193,15 +245,24 @@ static bool system_dumpins(token_t *parm, void *data)
     for (addr = (ptr36_t) _addr, cnt = (len36_t) _cnt; cnt > 0;
             addr += 4, cnt--) {
 
+#if ISA_R4K
         if (is_r4k) {
             r4k_instr_t instr;
             instr.val = physmem_read32(-1, addr, false);
             r4k_idump_phys(addr, instr);
-        } else if (is_rv) {
+        }
+#endif
+#if ISA_RV32 || ISA_RV64
+        if (is_rv) {
             rv_instr_t instr;
             instr.val = physmem_read32(-1, addr, false);
+#if ISA_RV32
             rv32_idump_phys(addr, instr);
+#else
+            rv64_idump_phys(addr, instr);
+#endif
         }
+#endif
     }
 
     return true;
@@ -321,12 +382,52 @@ static bool system_stat(token_t *parm, void *data)
 {
     ASSERT(parm != NULL);
     dbg_print_devices_stat(DEVICE_FILTER_ALL);
+    profile_print();
+    hostperf_print();
+    pace_print();
+    cosim_print();
     return true;
 }
 
+/** Number of words read at once by the dumpmem command (whole rows) */
+#define DUMPMEM_CHUNK 1024
+
+/** Length of a dumpmem row ("  0x000000000   " and four words) */
+#define DUMPMEM_ROW (16 + 4 * 9 + 1)
+
+/** Format a number as the given count of hexadecimal digits */
+static char *format_hex(char *str, uint64_t val, unsigned int digits)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    for (unsigned int i = digits; i > 0; i--) {
+        str[i - 1] = hex[val & 0x0fU];
+        val >>= 4;
+    }
+
+    return str + digits;
+}
+
+/** Format the beginning of a dumpmem row
+ *
+ * The same as printing "  %#011" PRIx64 "   " (without the 0x
+ * prefix for the zero address).
+ *
+ * @return The end of the formatted text.
+ *
+ */
+static char *format_row(char *str, ptr36_t addr)
+{
+    memcpy(str, "  0x", 4);
+    str = (addr == 0) ? format_hex(str + 2, 0, 11) : format_hex(str + 4, addr, 9);
+    memcpy(str, "   ", 3);
+    return str + 3;
+}
+
 /** Dump memory command implementation
  *
- * Dump physical memory.
+ * Dump physical memory. The words are read by blocks
+ * of whole rows and each block is printed at once.
  *
  */
 static bool system_dumpmem(token_t *parm, void *data)
@@ -351,25 +452,38 @@ static bool system_dumpmem(token_t *parm, void *data)
         return false;
     }
 
-    ptr36_t addr;
-    len36_t cnt;
-    len36_t i;
+    uint32_t words[DUMPMEM_CHUNK];
+    char text[DUMPMEM_CHUNK / 4 * DUMPMEM_ROW];
 
-    for (addr = (ptr36_t) _addr, cnt = (len36_t) _cnt, i = 0;
-            i < cnt; addr += 4, i++) {
-        if ((i & 0x03U) == 0) {
-            printf("  %#011" PRIx64 "   ", addr);
-        }
+    ptr36_t addr = (ptr36_t) _addr;
+    len36_t cnt = (len36_t) _cnt;
+
+    while (cnt > 0) {
+        size_t chunk = MIN(cnt, DUMPMEM_CHUNK);
+        char *pos = text;
 
-        uint32_t val = physmem_read32(-1, addr, false);
-        printf("%08" PRIx32 " ", val);
+        physmem_read_block32(-1, addr, words, chunk, false);
+
+        for (size_t i = 0; i < chunk; i++) {
+            if ((i & 0x03U) == 0) {
+                pos = format_row(pos, addr + i * 4);
+            }
 
-        if ((i & 0x03U) == 3) {
-            printf("\n");
+            pos = format_hex(pos, words[i], 8);
+            *pos++ = ' ';
+
+            if ((i & 0x03U) == 3) {
+                *pos++ = '\n';
+            }
         }
+
+        fwrite(text, 1, pos - text, stdout);
+
+        addr += chunk * 4;
+        cnt -= chunk;
     }
 
-    if (i != 0) {
+    if (_cnt != 0) {
         printf("\n");
     }
 
@@ -421,6 +535,226 @@ static bool system_echo(token_t *parm, void *data)
     return true;
 }
 
+/** Checkpoint command implementation
+ *
+ * Save the machine state into a file.
+ *
+ */
+static bool system_checkpoint(token_t *parm, void *data)
+{
+    ASSERT(parm != NULL);
+
+    const char *const path = parm_str_next(&parm);
+    bool incremental = false;
+    bool background = false;
+
+    while (parm_type(parm) != tt_end) {
+        const char *const mode = parm_str_next(&parm);
+
+        if (strcmp(mode, "incremental") == 0) {
+            incremental = true;
+        } else if (strcmp(mode, "background") == 0) {
+            background = true;
+        } else {
+            error("Unknown checkpoint mode <%s> (use incremental or background)",
+                    mode);
+            return false;
+        }
+    }
+
+    return checkpoint_save(path, incremental, background);
+}
+
+/** Restore command implementation
+ *
+ * Restore the machine state saved by the checkpoint command.
+ *
+ */
+static bool system_restore(token_t *parm, void *data)
+{
+    ASSERT(parm != NULL);
+    return checkpoint_restore(parm_str(parm));
+}
+
+/** Reset command implementation
+ *
+ * Set the reset point or return the machine to it.
+ *
+ */
+static bool system_reset(token_t *parm, void *data)
+{
+    ASSERT(parm != NULL);
+
+    if (parm_type(parm) == tt_end) {
+        return checkpoint_reset();
+    }
+
+    const char *const action = parm_str(parm);
+
+    if (strcmp(action, "point") != 0) {
+        error("Unknown reset action <%s> (use point)", action);
+        return false;
+    }
+
+    return checkpoint_reset_mark();
+}
+
+/** Elf command implementation
+ *
+ * Load an executable into the memory.
+ *
+ */
+static bool system_elf(token_t *parm, void *data)
+{
+    ASSERT(parm != NULL);
+    return elf_load(parm_str(parm), NULL);
+}
+
+/** Pcprofile command implementation
+ *
+ * Write or reset the profile of the program counters.
+ *
+ */
+static bool system_pcprofile(token_t *parm, void *data)
+{
+    ASSERT(parm != NULL);
+
+    const char *const action = parm_str_next(&parm);
+
+    if (strcmp(action, "reset") == 0) {
+        if (parm_type(parm) != tt_end) {
+            error("Too many parameters");
+            return false;
+        }
+
+        pcprofile_reset();
+        return true;
+    }
+
+    if (strcmp(action, "dump") != 0) {
+        error("Unknown pcprofile action <%s> (use dump or reset)", action);
+        return false;
+    }
+
+    if (parm_type(parm) == tt_end) {
+        error("Output file name expected");
+        return false;
+    }
+
+    const char *const path = parm_str_next(&parm);
+    pcprofile_format_t format = PCPROFILE_FLAT;
+
+    if (parm_type(parm) != tt_end) {
+        const char *const name = parm_str(parm);
+
+        if (!pcprofile_parse_format(name, &format)) {
+            error("Unknown profile format <%s> (use flat or folded)", name);
+            return false;
+        }
+    }
+
+    return pcprofile_write(path, format);
+}
+
+/** Coverage command implementation
+ *
+ * Write or reset the coverage of the guest code.
+ *
+ */
+static bool system_coverage(token_t *parm, void *data)
+{
+    ASSERT(parm != NULL);
+
+    const char *const action = parm_str_next(&parm);
+
+    if (strcmp(action, "reset") == 0) {
+        if (parm_type(parm) != tt_end) {
+            error("Too many parameters");
+            return false;
+        }
+
+        coverage_reset();
+        return true;
+    }
+
+    if (strcmp(action, "dump") != 0) {
+        error("Unknown coverage action <%s> (use dump or reset)", action);
+        return false;
+    }
+
+    if (parm_type(parm) == tt_end) {
+        error("Output file name expected");
+        return false;
+    }
+
+    const char *const path = parm_str_next(&parm);
+    coverage_format_t format = COVERAGE_RANGES;
+
+    if (parm_type(parm) != tt_end) {
+        const char *const name = parm_str(parm);
+
+        if (!coverage_parse_format(name, &format)) {
+            error("Unknown coverage format <%s> (use ranges or drcov)", name);
+            return false;
+        }
+    }
+
+    return coverage_write(path, format);
+}
+
+/** Flight command implementation
+ *
+ * Disassemble the last instructions kept by the flight recorder.
+ *
+ */
+static bool system_flight(token_t *parm, void *data)
+{
+    ASSERT(parm != NULL);
+
+    if (flight_size == 0) {
+        error("Flight recorder disabled (see the flight variable)");
+        return false;
+    }
+
+    unsigned int limit = 0;
+
+    switch (parm_type(parm)) {
+    case tt_end:
+        break;
+    case tt_uint:
+        limit = parm_uint(parm);
+        break;
+    default:
+        intr_error("Unexpected parameter type");
+        return false;
+    }
+
+    flight_dump(limit);
+    return true;
+}
+
+/** Tracefilter command implementation
+ *
+ * Narrow down the instructions traced.
+ *
+ */
+static bool system_tracefilter(token_t *parm, void *data)
+{
+    ASSERT(parm != NULL);
+    return trace_filter_cmd(parm);
+}
+
+/** Memtrace command implementation
+ *
+ * Start, stop or filter the memory access trace.
+ *
+ */
+static bool system_memtrace(token_t *parm, void *data)
+{
+    ASSERT(parm != NULL);
+    return memtrace_cmd(parm);
+}
+
 /** Help command implementation
  *
  * Print the help.
@@ -434,42 +768,48 @@ static bool system_help(token_t *parm, void *data)
     return true;
 }
 
-/** Interprets the command line.
- *
- * Line is terminated by '\0' or '\n'.
+/** Run the command of a parsed line
  *
  */
-bool interpret(const char *str)
+bool interpret_parm(token_t *parm)
 {
-    ASSERT(str != NULL);
-
-    /* Parse input */
-    token_t *parm = parm_parse(str);
+    ASSERT(parm != NULL);
 
     if (parm_type(parm) == tt_end) {
-        parm_delete(parm);
         return true;
     }
 
     if (parm_type(parm) != tt_str) {
         error("Command name expected");
-        parm_delete(parm);
         return true;
     }
 
     const char *name = parm_str(parm);
-    bool ret;
     device_t *dev = dev_by_name(name);
 
     if (dev) {
         /* Device command */
         parm_next(&parm);
-        ret = cmd_run_by_parm(parm, dev->type->cmds, dev);
-    } else {
-        /* System command */
-        ret = cmd_run_by_parm(parm, system_cmds, NULL);
+        return cmd_run_by_parm(parm, dev->type->cmds, dev);
     }
 
+    /* System command */
+    return cmd_run_by_parm(parm, system_cmds, NULL);
+}
+
+/** Interprets the command line.
+ *
+ * Line is terminated by '\0' or '\n'.
+ *
+ */
+bool interpret(const char *str)
+{
+    ASSERT(str != NULL);
+
+    /* Parse input */
+    token_t *parm = parm_parse(str);
+    bool ret = interpret_parm(parm);
+
     parm_delete(parm);
     return ret;
 }
@@ -485,7 +825,17 @@ static bool setup_apply(const char *buf)
 
     while ((*buf) && (!machine_halt)) {
         set_lineno(lineno);
-        if (!interpret(buf)) {
+
+        token_t *parm = parm_parse(buf);
+
+        if (mdesc_recording) {
+            mdesc_record(lineno, parm);
+        }
+
+        bool ok = interpret_parm(parm);
+        parm_delete(parm);
+
+        if (!ok) {
             return false;
         }
 
@@ -504,6 +854,30 @@ static bool setup_apply(const char *buf)
     return true;
 }
 
+/** Interpret an opened configuration file
+ *
+ * The script stage is left to the caller, so that a fault
+ * is still reported with the line of the error.
+ *
+ * @return False if an error was found in the file.
+ *
+ */
+static bool script_apply(FILE *file, const char *fname)
+{
+    set_script(fname);
+
+    string_t str;
+    string_init(&str);
+    string_fread(&str, file);
+
+    safe_fclose(file, fname);
+
+    bool ok = setup_apply(str.str);
+    string_done(&str);
+
+    return ok;
+}
+
 /** Interpret configuration file
  *
  */
@@ -517,6 +891,16 @@ void script(void)
         }
     }
 
+    /* A machine description stands for its configuration file */
+    char *source = NULL;
+    if ((!mdesc_recording) && (mdesc_run(config_file, &source))) {
+        return;
+    }
+
+    if (source != NULL) {
+        config_file = source;
+    }
+
     /* Open configuration file */
     FILE *file = fopen(config_file, "r");
     if (file == NULL) {
@@ -538,20 +922,61 @@ void script(void)
         return;
     }
 
-    set_script(config_file);
+    if (!script_apply(file, config_file)) {
+        die(ERR_INIT, "Error in configuration file");
+    }
 
-    string_t str;
-    string_init(&str);
-    string_fread(&str, file);
+    unset_script();
+}
 
-    safe_fclose(file, config_file);
+/** Interpret the configuration read from an opened stream
+ *
+ * As with script(), an error in the configuration is fatal.
+ * The stream is closed.
+ *
+ */
+void script_stream(FILE *file, const char *name)
+{
+    ASSERT(file != NULL);
+    ASSERT(name != NULL);
 
-    if (!setup_apply(str.str)) {
+    if (!script_apply(file, name)) {
         die(ERR_INIT, "Error in configuration file");
     }
 
     unset_script();
-    string_done(&str);
+}
+
+/** Interpret a configuration file without leaving the simulator
+ *
+ * Unlike script(), a missing file or an error in the file
+ * is reported to the caller.
+ *
+ * @param fname Name of the configuration file.
+ *
+ * @return False if the file cannot be read or contains an error.
+ *
+ */
+bool script_load(const char *fname)
+{
+    ASSERT(fname != NULL);
+
+    FILE *file = fopen(fname, "r");
+    if (file == NULL) {
+        io_error(fname);
+        return false;
+    }
+
+    if (check_isdir(file)) {
+        error("Path \"%s\" is a directory", fname);
+        safe_fclose(file, fname);
+        return false;
+    }
+
+    bool ok = script_apply(file, fname);
+    unset_script();
+
+    return ok;
 }
 
 /** Generate a list of device types
@@ -913,6 +1338,75 @@ static cmd_t system_cmds_array[] = {
             "Print system statistics",
             "Print system statistics",
             NOCMD },
+    { "checkpoint",
+            system_checkpoint,
+            DEFAULT,
+            DEFAULT,
+            "Save the machine state into a file",
+            "Save the state of the processors, memories and devices into a file. The state can be restored into a machine with the same configuration. An incremental checkpoint stores only the memory written to since the last checkpoint. A checkpoint saved in the background is written by a forked process while the simulation goes on.",
+            REQ STR "filename/checkpoint file name" NEXT
+                    OPT STR "mode/incremental or background" NEXT
+                    OPT STR "mode/background" END },
+    { "restore",
+            system_restore,
+            DEFAULT,
+            DEFAULT,
+            "Restore the machine state from a file",
+            "Restore the state saved by the checkpoint command. The machine has to be configured in the same way as the machine which saved the checkpoint.",
+            REQ STR "filename/checkpoint file name" END },
+    { "reset",
+            system_reset,
+            DEFAULT,
+            DEFAULT,
+            "Return the machine to the reset point",
+            "Return the processors, memories and devices to their state at the reset point set by the reset point command. Only the memory written to since the reset point is copied back.",
+            OPT STR "action/point" END },
+    { "elf",
+            system_elf,
+            DEFAULT,
+            DEFAULT,
+            "Load an ELF executable into the memory",
+            "Map the loadable segments of an ELF executable into the generic memories at their physical addresses, set the program counters of all processors to the entry point and load the symbols of the file. The file itself is never modified.",
+            REQ STR "filename/executable file name" END },
+    { "pcprofile",
+            system_pcprofile,
+            DEFAULT,
+            DEFAULT,
+            "Write or reset the profile of the program counters",
+            "The dump action writes the program counters sampled according to the pcprofile variable into a file, either as a flat profile of the functions and of the program counters (default) or as folded stacks for the flame graph tools. The reset action forgets the samples.",
+            REQ STR "action/dump or reset" NEXT
+                    OPT STR "filename/profile file name" NEXT
+                            OPT STR "format/flat or folded" END },
+    { "coverage",
+            system_coverage,
+            DEFAULT,
+            DEFAULT,
+            "Write or reset the coverage of the guest code",
+            "The dump action writes the instructions executed while the coverage variable is enabled into a file, either as the ranges of the executed instructions (default) or in the drcov format of the coverage tools. The reset action forgets the coverage.",
+            REQ STR "action/dump or reset" NEXT
+                    OPT STR "filename/coverage file name" NEXT
+                            OPT STR "format/ranges or drcov" END },
+    { "flight",
+            system_flight,
+            DEFAULT,
+            DEFAULT,
+            "Disassemble the last instructions of the flight recorder",
+            "Disassemble the last instructions recorded while the flight variable is set, all of them or the given number per processor, in the order of the machine cycles.",
+            OPT INT "cnt/instruction count per processor" END },
+    { "tracefilter",
+            system_tracefilter,
+            DEFAULT,
+            DEFAULT,
+            "Add, clear or print the trace filters",
+            "The add action adds a filter given by the conditions cpu N, pc FROM TO (the first address after the range), mode user or kernel, asid N (of EntryHi or satp) and cycles FROM TO (the first cycle after the window). The trace mode traces only the instructions matching all conditions of some filter, everything is traced without filters. The clear action removes all filters, the print action (default) prints them.",
+            OPT STR "action/add, clear or print" CONT },
+    { "memtrace",
+            system_memtrace,
+            DEFAULT,
+            DEFAULT,
+            "Start, stop, filter or print the memory access trace",
+            "The start action writes a record of every load, store and instruction fetch of the processors to a file (see the --memtrace-decode option), the stop action writes out the rest of the records and closes the file. The filter action narrows the trace down to the processors given by the conditions cpu N (repeated for more processors) and to the physical addresses given by range FROM TO (the first address after the range), the clear action removes the filter. The print action (default) prints the trace file and the filter.",
+            OPT STR "action/start, stop, filter, clear or print" CONT },
     { "echo",
             system_echo,
             DEFAULT,
@@ -934,6 +1428,15 @@ static cmd_t system_cmds_array[] = {
             "Simulate one or a specified number of instructions",
             "Simulate one or a specified number of instructions",
             OPT INT "cnt/intruction count" END },
+    { "back",
+            system_back,
+            DEFAULT,
+            DEFAULT,
+            "Go back by one or a specified number of machine cycles",
+            "Restore the nearest snapshot (see the snapshots variable) "
+            "and simulate again up to the given number of machine cycles "
+            "before the current one.",
+            OPT INT "cnt/cycle count" END },
     { "set",
             system_set,
             system_set_find_generator,
@@ -12,10 +12,15 @@
 #ifndef CMD_H_
 #define CMD_H_
 
+#include <stdio.h>
+
 #include "parser.h"
 
 extern bool interpret(const char *str);
+extern bool interpret_parm(token_t *parm);
 extern void script(void);
+extern void script_stream(FILE *file, const char *name);
+extern bool script_load(const char *fname);
 extern gen_t find_completion_generator(token_t **parm, const void **data);
 
 #endif
@@ -0,0 +1,867 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Conditions of code breakpoints
+ *
+ *  The conditions are evaluated by the simulator whenever a processor
+ *  reaches the breakpoint, so that the machine only stops when the
+ *  condition holds. Both the conditions sent by the debugger and the
+ *  conditions of the break commands are programs in the bytecode of
+ *  the GDB agent expressions. The latter are compiled from a small
+ *  expression language with the registers of the debugger, memory
+ *  reads, the hit count and the processor number. The hit count and
+ *  the processor number are private extensions of the bytecode.
+ *
+ *  A condition which cannot be evaluated (an unmapped address, a
+ *  division by zero or a runaway program) holds, so the user gets
+ *  to see the breakpoint instead of missing it.
+ *
+ */
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../assert.h"
+#include "../device/cpu/general_cpu.h"
+#include "../fault.h"
+#include "../physmem.h"
+#include "../utils.h"
+#include "bpcond.h"
+
+/** Most bytes of a compiled condition */
+#define BPCOND_CODE_SIZE 256
+
+/** Depth of the evaluation stack */
+#define BPCOND_STACK 32
+
+/** Most bytecodes executed by an evaluation */
+#define BPCOND_STEPS 1024
+
+/** Bytecodes of the agent expressions */
+typedef enum {
+    AX_ADD = 0x02,
+    AX_SUB = 0x03,
+    AX_MUL = 0x04,
+    AX_DIV_SIGNED = 0x05,
+    AX_DIV_UNSIGNED = 0x06,
+    AX_REM_SIGNED = 0x07,
+    AX_REM_UNSIGNED = 0x08,
+    AX_LSH = 0x09,
+    AX_RSH_SIGNED = 0x0a,
+    AX_RSH_UNSIGNED = 0x0b,
+    AX_LOG_NOT = 0x0e,
+    AX_BIT_AND = 0x0f,
+    AX_BIT_OR = 0x10,
+    AX_BIT_XOR = 0x11,
+    AX_BIT_NOT = 0x12,
+    AX_EQUAL = 0x13,
+    AX_LESS_SIGNED = 0x14,
+    AX_LESS_UNSIGNED = 0x15,
+    AX_EXT = 0x16,
+    AX_REF8 = 0x17,
+    AX_REF16 = 0x18,
+    AX_REF32 = 0x19,
+    AX_REF64 = 0x1a,
+    AX_IF_GOTO = 0x20,
+    AX_GOTO = 0x21,
+    AX_CONST8 = 0x22,
+    AX_CONST16 = 0x23,
+    AX_CONST32 = 0x24,
+    AX_CONST64 = 0x25,
+    AX_REG = 0x26,
+    AX_END = 0x27,
+    AX_DUP = 0x28,
+    AX_POP = 0x29,
+    AX_ZERO_EXT = 0x2a,
+    AX_SWAP = 0x2b,
+    AX_PICK = 0x32,
+    AX_ROT = 0x33,
+    /* Extensions of the simulator */
+    AX_HITS = 0xf0,
+    AX_CPU = 0xf1
+} ax_op_t;
+
+/** Number of operand bytes of a bytecode (-1 if not supported) */
+static int ax_operand_size(uint8_t op)
+{
+    switch (op) {
+    case AX_EXT:
+    case AX_CONST8:
+    case AX_ZERO_EXT:
+    case AX_PICK:
+        return 1;
+    case AX_IF_GOTO:
+    case AX_GOTO:
+    case AX_CONST16:
+    case AX_REG:
+        return 2;
+    case AX_CONST32:
+        return 4;
+    case AX_CONST64:
+        return 8;
+    case AX_ADD:
+    case AX_SUB:
+    case AX_MUL:
+    case AX_DIV_SIGNED:
+    case AX_DIV_UNSIGNED:
+    case AX_REM_SIGNED:
+    case AX_REM_UNSIGNED:
+    case AX_LSH:
+    case AX_RSH_SIGNED:
+    case AX_RSH_UNSIGNED:
+    case AX_LOG_NOT:
+    case AX_BIT_AND:
+    case AX_BIT_OR:
+    case AX_BIT_XOR:
+    case AX_BIT_NOT:
+    case AX_EQUAL:
+    case AX_LESS_SIGNED:
+    case AX_LESS_UNSIGNED:
+    case AX_REF8:
+    case AX_REF16:
+    case AX_REF32:
+    case AX_REF64:
+    case AX_END:
+    case AX_DUP:
+    case AX_POP:
+    case AX_SWAP:
+    case AX_ROT:
+    case AX_HITS:
+    case AX_CPU:
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+/** Operand of a bytecode (big endian) */
+static uint64_t ax_operand(const uint8_t *code, int size)
+{
+    uint64_t val = 0;
+
+    for (int i = 0; i < size; i++) {
+        val = (val << 8) | code[i];
+    }
+
+    return val;
+}
+
+/** Allocate a condition for a bytecode program */
+static bpcond_t *bpcond_alloc(const uint8_t *code, size_t size)
+{
+    bpcond_t *cond = (bpcond_t *) safe_malloc(sizeof(bpcond_t) + size);
+
+    cond->next = NULL;
+    cond->text = NULL;
+    cond->size = size;
+    memcpy(cond->code, code, size);
+
+    return cond;
+}
+
+/** Create a condition from the bytecode of the debugger
+ *
+ * Only the bytecodes needed by the conditions are supported
+ * (no tracing, no trace state variables and no floats).
+ *
+ * @return The condition or NULL if the bytecode is not supported.
+ *
+ */
+bpcond_t *bpcond_bytecode(const uint8_t *code, size_t size)
+{
+    if ((size == 0) || (size > BPCOND_CODE_SIZE)) {
+        return NULL;
+    }
+
+    size_t pc = 0;
+
+    while (pc < size) {
+        int operand = ax_operand_size(code[pc]);
+
+        /* The extensions are reserved for the simulator */
+        if ((operand < 0) || (code[pc] == AX_HITS) || (code[pc] == AX_CPU)
+                || (pc + 1 + operand > size)) {
+            return NULL;
+        }
+
+        pc += 1 + operand;
+    }
+
+    return bpcond_alloc(code, size);
+}
+
+/** Free a condition with all its alternatives */
+void bpcond_free(bpcond_t *cond)
+{
+    while (cond != NULL) {
+        bpcond_t *next = cond->next;
+
+        if (cond->text != NULL) {
+            safe_free(cond->text);
+        }
+
+        safe_free(cond);
+        cond = next;
+    }
+}
+
+/** Read a little endian value from virtual memory
+ *
+ * The addresses of the R4000 are given in 32 bits
+ * in the same way as the debugger does.
+ *
+ * @return False if any byte is not mapped.
+ *
+ */
+static bool bpcond_read(general_cpu_t *cpu, uint64_t address,
+        unsigned int size, uint64_t *val)
+{
+    const cpu_regs_t *regs = cpu_regs(cpu);
+
+    if ((regs != NULL) && (regs->kseg) && (address <= UINT32_MAX)) {
+        address = (uint64_t) (int64_t) (int32_t) address;
+    }
+
+    *val = 0;
+
+    for (unsigned int i = 0; i < size; i++) {
+        ptr64_t virt;
+        ptr36_t phys;
+        uint8_t byte;
+
+        virt.ptr = address + i;
+
+        if (!cpu_convert_addr(cpu, virt, &phys, false)) {
+            return false;
+        }
+
+        physmem_read_block8(-1 /*NULL*/, phys, &byte, 1, false);
+        *val |= ((uint64_t) byte) << (8 * i);
+    }
+
+    return true;
+}
+
+/** Evaluate a single condition
+ *
+ * @param value Value left on the top of the stack.
+ *
+ * @return False if the condition cannot be evaluated.
+ *
+ */
+static bool bpcond_eval(const bpcond_t *cond, general_cpu_t *cpu,
+        uint64_t hits, uint64_t *value)
+{
+    uint64_t stack[BPCOND_STACK];
+    unsigned int top = 0;
+    size_t pc = 0;
+
+    for (unsigned int step = 0; step < BPCOND_STEPS; step++) {
+        if (pc >= cond->size) {
+            return false;
+        }
+
+        uint8_t op = cond->code[pc];
+        int operand_size = ax_operand_size(op);
+
+        /* A jump may land in the middle of an operand */
+        if ((operand_size < 0) || (pc + 1 + operand_size > cond->size)) {
+            return false;
+        }
+
+        uint64_t operand = ax_operand(cond->code + pc + 1, operand_size);
+        pc += 1 + operand_size;
+
+        /* Check the stack before the operation */
+        unsigned int pops;
+        unsigned int pushes;
+
+        switch (op) {
+        case AX_CONST8:
+        case AX_CONST16:
+        case AX_CONST32:
+        case AX_CONST64:
+        case AX_REG:
+        case AX_HITS:
+        case AX_CPU:
+            pops = 0;
+            pushes = 1;
+            break;
+        case AX_GOTO:
+            pops = 0;
+            pushes = 0;
+            break;
+        case AX_PICK:
+            pops = operand + 1;
+            pushes = pops + 1;
+            break;
+        case AX_ROT:
+            pops = 3;
+            pushes = 3;
+            break;
+        case AX_SWAP:
+            pops = 2;
+            pushes = 2;
+            break;
+        case AX_DUP:
+            pops = 1;
+            pushes = 2;
+            break;
+        case AX_IF_GOTO:
+        case AX_POP:
+            pops = 1;
+            pushes = 0;
+            break;
+        case AX_LOG_NOT:
+        case AX_BIT_NOT:
+        case AX_EXT:
+        case AX_ZERO_EXT:
+        case AX_REF8:
+        case AX_REF16:
+        case AX_REF32:
+        case AX_REF64:
+        case AX_END:
+            pops = 1;
+            pushes = 1;
+            break;
+        default:
+            pops = 2;
+            pushes = 1;
+            break;
+        }
+
+        if ((top < pops) || (top - pops + pushes > BPCOND_STACK)) {
+            return false;
+        }
+
+        /* The operands on the top of the stack */
+        uint64_t *a = (top >= 2) ? &stack[top - 2] : NULL;
+        uint64_t b = (top >= 1) ? stack[top - 1] : 0;
+
+        switch (op) {
+        case AX_ADD:
+            *a += b;
+            break;
+        case AX_SUB:
+            *a -= b;
+            break;
+        case AX_MUL:
+            *a *= b;
+            break;
+        case AX_DIV_SIGNED:
+        case AX_REM_SIGNED:
+            if ((b == 0) || (((int64_t) *a == INT64_MIN) && ((int64_t) b == -1))) {
+                return false;
+            }
+
+            *a = (op == AX_DIV_SIGNED)
+                    ? (uint64_t) ((int64_t) *a / (int64_t) b)
+                    : (uint64_t) ((int64_t) *a % (int64_t) b);
+            break;
+        case AX_DIV_UNSIGNED:
+        case AX_REM_UNSIGNED:
+            if (b == 0) {
+                return false;
+            }
+
+            *a = (op == AX_DIV_UNSIGNED) ? *a / b : *a % b;
+            break;
+        case AX_LSH:
+            *a = (b < 64) ? *a << b : 0;
+            break;
+        case AX_RSH_SIGNED:
+            *a = (uint64_t) ((int64_t) *a >> ((b < 64) ? b : 63));
+            break;
+        case AX_RSH_UNSIGNED:
+            *a = (b < 64) ? *a >> b : 0;
+            break;
+        case AX_BIT_AND:
+            *a &= b;
+            break;
+        case AX_BIT_OR:
+            *a |= b;
+            break;
+        case AX_BIT_XOR:
+            *a ^= b;
+            break;
+        case AX_EQUAL:
+            *a = (*a == b);
+            break;
+        case AX_LESS_SIGNED:
+            *a = ((int64_t) *a < (int64_t) b);
+            break;
+        case AX_LESS_UNSIGNED:
+            *a = (*a < b);
+            break;
+        case AX_LOG_NOT:
+            stack[top - 1] = (b == 0);
+            break;
+        case AX_BIT_NOT:
+            stack[top - 1] = ~b;
+            break;
+        case AX_EXT:
+            if ((operand > 0) && (operand < 64)) {
+                unsigned int shift = 64 - operand;
+                stack[top - 1] = (uint64_t) (((int64_t) (b << shift)) >> shift);
+            }
+            break;
+        case AX_ZERO_EXT:
+            if (operand < 64) {
+                stack[top - 1] = b & ((UINT64_C(1) << operand) - 1);
+            }
+            break;
+        case AX_REF8:
+        case AX_REF16:
+        case AX_REF32:
+        case AX_REF64:
+            if (!bpcond_read(cpu, b, 1 << (op - AX_REF8), &stack[top - 1])) {
+                return false;
+            }
+            break;
+        case AX_IF_GOTO:
+            if (b != 0) {
+                pc = operand;
+            }
+            break;
+        case AX_GOTO:
+            pc = operand;
+            break;
+        case AX_CONST8:
+        case AX_CONST16:
+        case AX_CONST32:
+        case AX_CONST64:
+            stack[top] = operand;
+            break;
+        case AX_REG:
+            if (!cpu_reg_read(cpu, operand, &stack[top])) {
+                return false;
+            }
+            break;
+        case AX_HITS:
+            stack[top] = hits;
+            break;
+        case AX_CPU:
+            stack[top] = cpu->cpuno;
+            break;
+        case AX_END:
+            *value = b;
+            return true;
+        case AX_DUP:
+            stack[top] = b;
+            break;
+        case AX_SWAP:
+            stack[top - 1] = *a;
+            *a = b;
+            break;
+        case AX_PICK:
+            stack[top] = stack[top - 1 - operand];
+            break;
+        case AX_ROT: {
+            uint64_t c = stack[top - 3];
+            stack[top - 3] = b;
+            stack[top - 1] = *a;
+            *a = c;
+            break;
+        }
+        case AX_POP:
+            break;
+        default:
+            return false;
+        }
+
+        top = top - pops + pushes;
+    }
+
+    return false;
+}
+
+/** Tell whether a breakpoint stops
+ *
+ * @param cond  Condition of the breakpoint (with the alternatives).
+ * @param cpuno Processor which has reached the breakpoint.
+ * @param hits  Number of times the breakpoint has been reached
+ *              (including this time).
+ *
+ * @return True if any alternative holds or cannot be evaluated.
+ *
+ */
+bool bpcond_holds(const bpcond_t *cond, unsigned int cpuno, uint64_t hits)
+{
+    general_cpu_t *cpu = get_cpu(cpuno);
+    ASSERT(cpu != NULL);
+
+    for (; cond != NULL; cond = cond->next) {
+        uint64_t value;
+
+        if (!bpcond_eval(cond, cpu, hits, &value)) {
+            alert("Debug: Breakpoint condition cannot be evaluated");
+            return true;
+        }
+
+        if (value != 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/** Compiler of the conditions of the break commands */
+typedef struct {
+    const char *pos;
+    const cpu_regs_t *regs;
+    uint8_t code[BPCOND_CODE_SIZE];
+    size_t size;
+    bool failed;
+} bpcond_parser_t;
+
+static void parse_or(bpcond_parser_t *parser);
+
+/** Report a compilation error (only the first one is reported) */
+static void parse_error(bpcond_parser_t *parser, const char *msg)
+{
+    if (parser->failed) {
+        return;
+    }
+
+    if (*parser->pos == 0) {
+        error("%s at the end of breakpoint condition", msg);
+    } else {
+        error("%s in breakpoint condition at \"%s\"", msg, parser->pos);
+    }
+
+    parser->failed = true;
+}
+
+/** Emit a bytecode with a big endian operand */
+static void emit(bpcond_parser_t *parser, uint8_t op, uint64_t operand)
+{
+    int size = ax_operand_size(op);
+
+    if (parser->size + 1 + size > BPCOND_CODE_SIZE) {
+        parse_error(parser, "Too long expression");
+        return;
+    }
+
+    parser->code[parser->size++] = op;
+
+    for (int i = size - 1; i >= 0; i--) {
+        parser->code[parser->size++] = (uint8_t) (operand >> (8 * i));
+    }
+}
+
+/** Emit the shortest constant */
+static void emit_const(bpcond_parser_t *parser, uint64_t val)
+{
+    if (val <= UINT8_MAX) {
+        emit(parser, AX_CONST8, val);
+    } else if (val <= UINT16_MAX) {
+        emit(parser, AX_CONST16, val);
+    } else if (val <= UINT32_MAX) {
+        emit(parser, AX_CONST32, val);
+    } else {
+        emit(parser, AX_CONST64, val);
+    }
+}
+
+/** Skip the white space and match an operator */
+static bool parse_match(bpcond_parser_t *parser, const char *op)
+{
+    while (isspace((unsigned char) *parser->pos)) {
+        parser->pos++;
+    }
+
+    size_t len = strlen(op);
+
+    if (strncmp(parser->pos, op, len) != 0) {
+        return false;
+    }
+
+    /* Do not take the first character of && or || */
+    if ((len == 1) && ((op[0] == '&') || (op[0] == '|'))
+            && (parser->pos[1] == op[0])) {
+        return false;
+    }
+
+    parser->pos += len;
+    return true;
+}
+
+/** Compile a register of the debugger given by its name */
+static void parse_register(bpcond_parser_t *parser, const char *name,
+        size_t len)
+{
+    if (parser->regs == NULL) {
+        parse_error(parser, "Registers not available");
+        return;
+    }
+
+    if ((len == 2) && (strncmp(name, "pc", 2) == 0)) {
+        emit(parser, AX_REG, parser->regs->pc);
+        return;
+    }
+
+    size_t digits = 1;
+
+    while ((digits < len) && (isdigit((unsigned char) name[digits]))) {
+        digits++;
+    }
+
+    if ((name[0] == 'r') && (len > 1) && (digits == len)) {
+        unsigned int reg = (unsigned int) strtoul(name + 1, NULL, 10);
+
+        if (reg < parser->regs->count) {
+            emit(parser, AX_REG, reg);
+            return;
+        }
+    }
+
+    if (parser->regs->names != NULL) {
+        for (unsigned int reg = 0; reg < parser->regs->count; reg++) {
+            const char *reg_name = parser->regs->names[reg];
+
+            if ((strlen(reg_name) == len) && (strncmp(reg_name, name, len) == 0)) {
+                emit(parser, AX_REG, reg);
+                return;
+            }
+        }
+    }
+
+    parse_error(parser, "Unknown register");
+}
+
+/** Compile a number, a variable, a register or a memory read */
+static void parse_primary(bpcond_parser_t *parser)
+{
+    if (parse_match(parser, "(")) {
+        parse_or(parser);
+
+        if (!parse_match(parser, ")")) {
+            parse_error(parser, "Missing )");
+        }
+
+        return;
+    }
+
+    const char *start = parser->pos;
+
+    if (isdigit((unsigned char) *start)) {
+        char *end;
+        emit_const(parser, strtoull(start, &end, 0));
+        parser->pos = end;
+        return;
+    }
+
+    size_t len = 0;
+
+    while ((isalnum((unsigned char) start[len])) || (start[len] == '_')) {
+        len++;
+    }
+
+    if (len == 0) {
+        parse_error(parser, "Syntax error");
+        return;
+    }
+
+    parser->pos += len;
+
+    static const char *const refs[] = { "mem8", "mem16", "mem32", "mem64" };
+
+    for (unsigned int i = 0; i < 4; i++) {
+        if ((strlen(refs[i]) == len) && (strncmp(start, refs[i], len) == 0)) {
+            if (!parse_match(parser, "[")) {
+                parse_error(parser, "Missing [");
+                return;
+            }
+
+            parse_or(parser);
+
+            if (!parse_match(parser, "]")) {
+                parse_error(parser, "Missing ]");
+                return;
+            }
+
+            emit(parser, AX_REF8 + i, 0);
+            return;
+        }
+    }
+
+    if ((len == 4) && (strncmp(start, "hits", 4) == 0)) {
+        emit(parser, AX_HITS, 0);
+    } else if ((len == 3) && (strncmp(start, "cpu", 3) == 0)) {
+        emit(parser, AX_CPU, 0);
+    } else {
+        parser->pos = start;
+        parse_register(parser, start, len);
+        parser->pos = start + len;
+    }
+}
+
+/** Compile the unary operators */
+static void parse_unary(bpcond_parser_t *parser)
+{
+    if (parse_match(parser, "!")) {
+        parse_unary(parser);
+        emit(parser, AX_LOG_NOT, 0);
+    } else if (parse_match(parser, "~")) {
+        parse_unary(parser);
+        emit(parser, AX_BIT_NOT, 0);
+    } else if (parse_match(parser, "-")) {
+        emit(parser, AX_CONST8, 0);
+        parse_unary(parser);
+        emit(parser, AX_SUB, 0);
+    } else {
+        parse_primary(parser);
+    }
+}
+
+/** Compile the additive operators */
+static void parse_sum(bpcond_parser_t *parser)
+{
+    parse_unary(parser);
+
+    while (!parser->failed) {
+        if (parse_match(parser, "+")) {
+            parse_unary(parser);
+            emit(parser, AX_ADD, 0);
+        } else if (parse_match(parser, "-")) {
+            parse_unary(parser);
+            emit(parser, AX_SUB, 0);
+        } else {
+            break;
+        }
+    }
+}
+
+/** Compile the bitwise operators (all of the same precedence) */
+static void parse_bits(bpcond_parser_t *parser)
+{
+    parse_sum(parser);
+
+    while (!parser->failed) {
+        if (parse_match(parser, "&")) {
+            parse_sum(parser);
+            emit(parser, AX_BIT_AND, 0);
+        } else if (parse_match(parser, "|")) {
+            parse_sum(parser);
+            emit(parser, AX_BIT_OR, 0);
+        } else if (parse_match(parser, "^")) {
+            parse_sum(parser);
+            emit(parser, AX_BIT_XOR, 0);
+        } else {
+            break;
+        }
+    }
+}
+
+/** Compile a comparison (the values are unsigned) */
+static void parse_compare(bpcond_parser_t *parser)
+{
+    parse_bits(parser);
+
+    if (parse_match(parser, "==")) {
+        parse_bits(parser);
+        emit(parser, AX_EQUAL, 0);
+    } else if (parse_match(parser, "!=")) {
+        parse_bits(parser);
+        emit(parser, AX_EQUAL, 0);
+        emit(parser, AX_LOG_NOT, 0);
+    } else if (parse_match(parser, "<=")) {
+        parse_bits(parser);
+        emit(parser, AX_SWAP, 0);
+        emit(parser, AX_LESS_UNSIGNED, 0);
+        emit(parser, AX_LOG_NOT, 0);
+    } else if (parse_match(parser, ">=")) {
+        parse_bits(parser);
+        emit(parser, AX_LESS_UNSIGNED, 0);
+        emit(parser, AX_LOG_NOT, 0);
+    } else if (parse_match(parser, "<")) {
+        parse_bits(parser);
+        emit(parser, AX_LESS_UNSIGNED, 0);
+    } else if (parse_match(parser, ">")) {
+        parse_bits(parser);
+        emit(parser, AX_SWAP, 0);
+        emit(parser, AX_LESS_UNSIGNED, 0);
+    }
+}
+
+/** Compile the logical and (both sides are evaluated) */
+static void parse_and(bpcond_parser_t *parser)
+{
+    parse_compare(parser);
+
+    while ((!parser->failed) && (parse_match(parser, "&&"))) {
+        emit(parser, AX_LOG_NOT, 0);
+        parse_compare(parser);
+        emit(parser, AX_LOG_NOT, 0);
+        emit(parser, AX_BIT_OR, 0);
+        emit(parser, AX_LOG_NOT, 0);
+    }
+}
+
+/** Compile the logical or (both sides are evaluated) */
+static void parse_or(bpcond_parser_t *parser)
+{
+    parse_and(parser);
+
+    while ((!parser->failed) && (parse_match(parser, "||"))) {
+        parse_and(parser);
+        emit(parser, AX_BIT_OR, 0);
+    }
+}
+
+/** Compile the condition of a break command
+ *
+ * The expression compares the registers of the debugger (by their
+ * names, as rN by their numbers, or pc), the memory at the virtual
+ * addresses (mem8[addr] to mem64[addr]), the number of times the
+ * breakpoint has been reached (hits) and the processor number (cpu)
+ * by the C operators.
+ *
+ * @param cpuno Processor of the breakpoint.
+ * @param text  Expression of the condition.
+ *
+ * @return The condition or NULL if the expression is not valid.
+ *
+ */
+bpcond_t *bpcond_compile(unsigned int cpuno, const char *text)
+{
+    general_cpu_t *cpu = get_cpu(cpuno);
+    ASSERT(cpu != NULL);
+
+    bpcond_parser_t parser;
+    parser.pos = text;
+    parser.regs = cpu_regs(cpu);
+    parser.size = 0;
+    parser.failed = false;
+
+    parse_or(&parser);
+
+    while (isspace((unsigned char) *parser.pos)) {
+        parser.pos++;
+    }
+
+    if (*parser.pos != 0) {
+        parse_error(&parser, "Syntax error");
+    }
+
+    emit(&parser, AX_END, 0);
+
+    if (parser.failed) {
+        return NULL;
+    }
+
+    bpcond_t *cond = bpcond_alloc(parser.code, parser.size);
+    cond->text = safe_strdup(text);
+
+    return cond;
+}
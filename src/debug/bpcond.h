@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Conditions of code breakpoints
+ *
+ */
+
+#ifndef BPCOND_H_
+#define BPCOND_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Compiled condition of a code breakpoint
+ *
+ * The condition is a program in the bytecode of the GDB agent
+ * expressions. A breakpoint with several conditions (a debugger
+ * breakpoint shared by several locations) stops if any of them holds.
+ *
+ */
+typedef struct bpcond {
+    /** Next alternative condition */
+    struct bpcond *next;
+
+    /** Source of the condition (NULL for the bytecode of the debugger) */
+    char *text;
+
+    size_t size;
+    uint8_t code[];
+} bpcond_t;
+
+extern bpcond_t *bpcond_compile(unsigned int cpuno, const char *text);
+extern bpcond_t *bpcond_bytecode(const uint8_t *code, size_t size);
+extern void bpcond_free(bpcond_t *cond);
+extern bool bpcond_holds(const bpcond_t *cond, unsigned int cpuno,
+        uint64_t hits);
+
+#endif
@@ -12,11 +12,13 @@
  * address. (stopping after is probably a wrong behavior, because the gdb
  * expects stopping before the execution of instruction) The memory
  *
- * The memory and code breakpoints have independent implementation. The memory
- * breakpoints implementation resides completely in this module. Addition or
- * removal of code breakpoints is not implemented here, because the code
- * breakpoints list is associated with each processor structure. The code
- * and memory breakpoints have some similar things, which could be united.
+ * The memory and code breakpoints have independent implementation, both
+ * reside completely in this module. The code breakpoints of all processors
+ * are kept in a hash set indexed by the processor number and the virtual
+ * page, so the processors without breakpoints are not slowed down and the
+ * processors with breakpoints can still execute blocks of instructions
+ * on the pages without them. The code and memory breakpoints have some
+ * similar things, which could be united.
  *
  * The memory breakpoints can be currently set only from the simulator.
  * The user of the simulator is notified after the breakpoint hit and
@@ -27,28 +29,181 @@
  * breakpoint hit is handled by notifying the debugger and waiting for
  * the next command from the debugger. Simulator breakpoint hit is handled
  * by showing message to the user of the simulator and waiting for next command
- * from him. They work with virtual address.
+ * from him. They work with virtual address. A code breakpoint may carry
+ * a condition evaluated by the simulator, the machine stops only when
+ * the condition holds.
  */
 
 #include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "../assert.h"
 #include "../device/cpu/general_cpu.h"
-#include "../device/cpu/mips_r4000/cpu.h"
 #include "../device/device.h"
-#include "../device/dr4kcpu.h"
 #include "../fault.h"
 #include "../main.h"
+#include "../physmem.h"
+#include "../profile.h"
 #include "../utils.h"
+#include "bpcond.h"
 #include "breakpoint.h"
 #include "gdb.h"
+#include "reverse.h"
 
 list_t physmem_breakpoints = LIST_INITIALIZER;
 
+/** Memory breakpoints sorted by address
+ *
+ * Together with the reach of each entry this forms a flattened
+ * interval tree: all breakpoints overlapping an address lie in front
+ * of the first entry starting past it and behind the last entry whose
+ * reach does not cover it.
+ *
+ */
+static physmem_breakpoint_t **physmem_breakpoint_index = NULL;
+static size_t physmem_breakpoint_index_count = 0;
+
 /************************************************************************/
 /* Memory breakpoints                                                   */
 /************************************************************************/
 
+/** End of the area watched by a memory breakpoint
+ *
+ * Breakpoints of zero size watch a single byte.
+ *
+ */
+static ptr36_t physmem_breakpoint_end(physmem_breakpoint_t *breakpoint)
+{
+    return breakpoint->addr + ((breakpoint->size > 0) ? breakpoint->size : 1);
+}
+
+static int physmem_breakpoint_compare(const void *a, const void *b)
+{
+    ptr36_t addr_a = (*(physmem_breakpoint_t *const *) a)->addr;
+    ptr36_t addr_b = (*(physmem_breakpoint_t *const *) b)->addr;
+
+    if (addr_a < addr_b) {
+        return -1;
+    }
+
+    return (addr_a > addr_b) ? 1 : 0;
+}
+
+/** Rebuild the address index of the memory breakpoints
+ *
+ */
+static void physmem_breakpoint_reindex(void)
+{
+    size_t count = 0;
+    physmem_breakpoint_t *breakpoint;
+
+    for_each(physmem_breakpoints, breakpoint, physmem_breakpoint_t)
+    {
+        count++;
+    }
+
+    safe_free(physmem_breakpoint_index);
+    physmem_breakpoint_index_count = count;
+
+    if (count == 0) {
+        return;
+    }
+
+    physmem_breakpoint_index = safe_malloc(count * sizeof(physmem_breakpoint_t *));
+
+    size_t i = 0;
+    for_each(physmem_breakpoints, breakpoint, physmem_breakpoint_t)
+    {
+        physmem_breakpoint_index[i++] = breakpoint;
+    }
+
+    qsort(physmem_breakpoint_index, count, sizeof(physmem_breakpoint_t *),
+            physmem_breakpoint_compare);
+
+    ptr36_t reach = 0;
+    for (i = 0; i < count; i++) {
+        ptr36_t end = physmem_breakpoint_end(physmem_breakpoint_index[i]);
+        if (end > reach) {
+            reach = end;
+        }
+
+        physmem_breakpoint_index[i]->reach = reach;
+    }
+}
+
+/** Number of indexed breakpoints starting before the given address
+ *
+ */
+static size_t physmem_breakpoint_bound(ptr36_t addr)
+{
+    size_t lo = 0;
+    size_t hi = physmem_breakpoint_index_count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (physmem_breakpoint_index[mid]->addr < addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/** Find a memory breakpoint hit by a memory access
+ *
+ * @param addr        First address of the access.
+ * @param size        Size of the access.
+ * @param access_type Type of the access.
+ *
+ * @return Breakpoint with the highest address among those overlapping
+ *         the access and matching its type, NULL if there is none.
+ *
+ */
+physmem_breakpoint_t *physmem_breakpoint_find(ptr36_t addr, len36_t size,
+        access_t access_type)
+{
+    for (size_t i = physmem_breakpoint_bound(addr + size); i > 0; i--) {
+        physmem_breakpoint_t *breakpoint = physmem_breakpoint_index[i - 1];
+
+        if (breakpoint->reach <= addr) {
+            break;
+        }
+
+        if ((physmem_breakpoint_end(breakpoint) > addr)
+                && ((access_type & breakpoint->access_flags) != 0)) {
+            return breakpoint;
+        }
+    }
+
+    return NULL;
+}
+
+/** Count memory breakpoints overlapping an area
+ *
+ */
+unsigned int physmem_breakpoint_count(ptr36_t addr, len36_t size)
+{
+    unsigned int count = 0;
+
+    for (size_t i = physmem_breakpoint_bound(addr + size); i > 0; i--) {
+        physmem_breakpoint_t *breakpoint = physmem_breakpoint_index[i - 1];
+
+        if (breakpoint->reach <= addr) {
+            break;
+        }
+
+        if (physmem_breakpoint_end(breakpoint) > addr) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
 /** Allocate and initialize a memory breakpoint
  *
  * @param address      Address, where the breakpoint can be hit.
@@ -72,6 +227,7 @@ static physmem_breakpoint_t *physmem_breakpoint_init(ptr36_t address,
     breakpoint->size = size;
     breakpoint->hits = 0;
     breakpoint->access_flags = access_flags;
+    breakpoint->debugger_addr = 0;
 
     return breakpoint;
 }
@@ -85,13 +241,19 @@ static physmem_breakpoint_t *physmem_breakpoint_init(ptr36_t address,
  * @param access_flags Specifies the access condition, under the breakpoint
  *                     will be hit.
  *
+ * @return The new breakpoint.
+ *
  */
-void physmem_breakpoint_add(ptr36_t address, len36_t length,
+physmem_breakpoint_t *physmem_breakpoint_add(ptr36_t address, len36_t length,
         breakpoint_kind_t kind, access_filter_t access_flags)
 {
     physmem_breakpoint_t *breakpoint = physmem_breakpoint_init(address, length, kind, access_flags);
 
     list_append(&physmem_breakpoints, &breakpoint->item);
+    physmem_breakpoint_reindex();
+    physmem_watch(address, physmem_breakpoint_end(breakpoint) - address, true);
+
+    return breakpoint;
 }
 
 /** Deactivate memory breakpoint with specified address
@@ -108,6 +270,8 @@ bool physmem_breakpoint_remove(ptr36_t address)
     while (breakpoint != NULL) {
         if (breakpoint->addr == address) {
             list_remove(&physmem_breakpoints, &breakpoint->item);
+            physmem_breakpoint_reindex();
+            physmem_watch(address, physmem_breakpoint_end(breakpoint) - address, false);
             safe_free(breakpoint);
 
             return true;
@@ -119,6 +283,41 @@ bool physmem_breakpoint_remove(ptr36_t address)
     return false;
 }
 
+/** Deactivate a memory breakpoint of the given kind and access condition
+ *
+ * Breakpoints of other kinds at the same address (set by the user
+ * of the simulator while debugging, for instance) are kept.
+ *
+ * @param address      Address, where the breakpoint can be hit.
+ * @param size         Size of the breakpoint area.
+ * @param kind         Kind of the breakpoint.
+ * @param access_flags Access condition of the breakpoint.
+ *
+ * @return True, if some breakpoint has been deactivated.
+ *
+ */
+bool physmem_breakpoint_remove_kind(ptr36_t address, len36_t size,
+        breakpoint_kind_t kind, access_filter_t access_flags)
+{
+    physmem_breakpoint_t *breakpoint = NULL;
+
+    for_each(physmem_breakpoints, breakpoint, physmem_breakpoint_t)
+    {
+        if ((breakpoint->addr == address) && (breakpoint->size == size)
+                && (breakpoint->kind == kind)
+                && (breakpoint->access_flags == access_flags)) {
+            list_remove(&physmem_breakpoints, &breakpoint->item);
+            physmem_breakpoint_reindex();
+            physmem_watch(address, physmem_breakpoint_end(breakpoint) - address, false);
+            safe_free(breakpoint);
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
 /** Deactivate all memory breakpoints which matches the given filter.
  *
  * @param filter Filter for selecting breakpoints to be deactivated.
@@ -138,8 +337,12 @@ void physmem_breakpoint_remove_filtered(breakpoint_filter_t filter)
         }
 
         list_remove(&physmem_breakpoints, &removed->item);
+        physmem_watch(removed->addr,
+                physmem_breakpoint_end(removed) - removed->addr, false);
         safe_free(removed);
     }
+
+    physmem_breakpoint_reindex();
 }
 
 /** Print activated memory breakpoints for the user */
@@ -166,14 +369,21 @@ void physmem_breakpoint_print_list(void)
  * and for debugger breakpoints the debugger is notified.
  *
  * @param breakpoint  Breakpoint to be fired.
+ * @param addr        First address of the access operation.
  * @param access_type Specifies type of access operation.
  *
  */
-void physmem_breakpoint_hit(physmem_breakpoint_t *breakpoint,
+void physmem_breakpoint_hit(physmem_breakpoint_t *breakpoint, ptr36_t addr,
         access_t access_type)
 {
     ASSERT(breakpoint != NULL);
 
+    /* The hits re-executed have been counted already */
+    if (reverse_rerun) {
+        reverse_hit_memory(breakpoint, addr);
+        return;
+    }
+
     switch (breakpoint->kind) {
     case BREAKPOINT_KIND_SIMULATOR:
         if (access_type == ACCESS_READ) {
@@ -188,7 +398,8 @@ void physmem_breakpoint_hit(physmem_breakpoint_t *breakpoint,
         machine_interactive = true;
         break;
     case BREAKPOINT_KIND_DEBUGGER:
-        gdb_handle_event(GDB_EVENT_BREAKPOINT);
+        breakpoint->hits++;
+        gdb_handle_watchpoint(breakpoint, addr);
         break;
     default:
         die(ERR_INTERN, "Unexpected physical memory breakpoint kind");
@@ -199,34 +410,310 @@ void physmem_breakpoint_hit(physmem_breakpoint_t *breakpoint,
 /* Code breakpoints                                                     */
 /************************************************************************/
 
+/** Number of buckets of the hash set of code breakpoints */
+#define CODE_BUCKETS 256
+
+/** Bucket of the code breakpoints of a processor on a virtual page */
+#define CODE_BUCKET(cpuno, addr) \
+    ((((addr) >> FRAME_WIDTH) + ((uint64_t) (cpuno) * 61)) % CODE_BUCKETS)
+
+list_t code_breakpoints = LIST_INITIALIZER;
+unsigned int code_breakpoint_count[MAX_CPUS];
+
+/** Hash set of the code breakpoints
+ *
+ * The breakpoints of a processor on the same virtual page share
+ * a bucket, so the buckets also tell whether a page contains
+ * any breakpoints.
+ *
+ */
+static breakpoint_t *code_buckets[CODE_BUCKETS];
+
+/** Processors with code breakpoints (see breakpoint_code_prepare()) */
+static general_cpu_t *code_cpus[MAX_CPUS];
+static unsigned int code_cpu_count = 0;
+
 /** Allocate and initialize a code breakpoint
  *
+ * @param cpuno   Processor, which can hit the breakpoint.
  * @param address Address, where the breakpoint can be hit.
  * @param kind    Specifies, how the breakpoint hit will be handled.
  *
  * @return Initialized code breakpoint structure.
  *
  */
-breakpoint_t *breakpoint_init(ptr64_t address, breakpoint_kind_t kind)
+static breakpoint_t *breakpoint_init(unsigned int cpuno, ptr64_t address,
+        breakpoint_kind_t kind)
 {
     breakpoint_t *breakpoint = (breakpoint_t *) safe_malloc_t(breakpoint_t);
 
     item_init(&breakpoint->item);
+    breakpoint->cpuno = cpuno;
     breakpoint->pc = address;
     breakpoint->hits = 0;
+    breakpoint->cond = NULL;
     breakpoint->kind = kind;
+    breakpoint->bucket_next = NULL;
+
+    return breakpoint;
+}
+
+/** Search for a code breakpoint
+ *
+ * @param cpuno   Processor, which can hit the breakpoint.
+ * @param address Address, where the breakpoint can be hit.
+ * @param filter  Filters considered breakpoints according to the kind.
+ *
+ * @return Found breakpoint structure or NULL, if there is not any.
+ *
+ */
+breakpoint_t *breakpoint_code_find(unsigned int cpuno, ptr64_t address,
+        breakpoint_filter_t filter)
+{
+    ASSERT(cpuno < MAX_CPUS);
+
+    if (code_breakpoint_count[cpuno] == 0) {
+        return NULL;
+    }
+
+    breakpoint_t *breakpoint = code_buckets[CODE_BUCKET(cpuno, address.ptr)];
+
+    while (breakpoint != NULL) {
+        if ((breakpoint->cpuno == cpuno) && (breakpoint->pc.ptr == address.ptr)
+                && ((breakpoint->kind & filter) != 0)) {
+            return breakpoint;
+        }
+
+        breakpoint = breakpoint->bucket_next;
+    }
+
+    return NULL;
+}
+
+/** Add a code breakpoint
+ *
+ * The insertion is idempotent, a breakpoint of the same kind
+ * already set on the address is returned instead.
+ *
+ * @param cpuno   Processor, which can hit the breakpoint.
+ * @param address Address, where the breakpoint can be hit.
+ * @param kind    Specifies, how the breakpoint hit will be handled.
+ *
+ * @return The breakpoint on the address.
+ *
+ */
+breakpoint_t *breakpoint_code_insert(unsigned int cpuno, ptr64_t address,
+        breakpoint_kind_t kind)
+{
+    breakpoint_t *breakpoint = breakpoint_code_find(cpuno, address,
+            (breakpoint_filter_t) kind);
+
+    if (breakpoint != NULL) {
+        return breakpoint;
+    }
+
+    breakpoint = breakpoint_init(cpuno, address, kind);
+
+    breakpoint_t **bucket = &code_buckets[CODE_BUCKET(cpuno, address.ptr)];
+    breakpoint->bucket_next = *bucket;
+    *bucket = breakpoint;
+
+    list_append(&code_breakpoints, &breakpoint->item);
+    code_breakpoint_count[cpuno]++;
 
     return breakpoint;
 }
 
+/** Replace the condition of a code breakpoint
+ *
+ * @param breakpoint Breakpoint to be changed.
+ * @param cond       New condition (NULL for an unconditional breakpoint),
+ *                   owned by the breakpoint from now on.
+ *
+ */
+void breakpoint_code_condition(breakpoint_t *breakpoint, bpcond_t *cond)
+{
+    bpcond_free(breakpoint->cond);
+    breakpoint->cond = cond;
+}
+
+/** Add a code breakpoint of the simulator with an optional condition
+ *
+ * A breakpoint already set on the address gets the new condition.
+ *
+ * @param cpuno   Processor, which can hit the breakpoint.
+ * @param address Address, where the breakpoint can be hit.
+ * @param text    Expression of the condition (NULL for none).
+ *
+ * @return False, if the condition is not valid.
+ *
+ */
+bool breakpoint_code_set(unsigned int cpuno, ptr64_t address,
+        const char *text)
+{
+    bpcond_t *cond = NULL;
+
+    if (text != NULL) {
+        cond = bpcond_compile(cpuno, text);
+
+        if (cond == NULL) {
+            return false;
+        }
+    }
+
+    breakpoint_t *breakpoint = breakpoint_code_insert(cpuno, address,
+            BREAKPOINT_KIND_SIMULATOR);
+    breakpoint_code_condition(breakpoint, cond);
+
+    return true;
+}
+
+/** Remove a code breakpoint from the hash set and free it
+ *
+ */
+static void breakpoint_code_unlink(breakpoint_t *breakpoint)
+{
+    breakpoint_t **link = &code_buckets[CODE_BUCKET(breakpoint->cpuno,
+            breakpoint->pc.ptr)];
+
+    while (*link != breakpoint) {
+        ASSERT(*link != NULL);
+        link = &(*link)->bucket_next;
+    }
+
+    *link = breakpoint->bucket_next;
+
+    list_remove(&code_breakpoints, &breakpoint->item);
+    code_breakpoint_count[breakpoint->cpuno]--;
+    bpcond_free(breakpoint->cond);
+    safe_free(breakpoint);
+}
+
+/** Remove a code breakpoint
+ *
+ * @param cpuno   Processor of the breakpoint.
+ * @param address Address of the breakpoint.
+ * @param filter  Kinds of the breakpoint to be removed.
+ *
+ * @return False, if there is no such breakpoint.
+ *
+ */
+bool breakpoint_code_remove(unsigned int cpuno, ptr64_t address,
+        breakpoint_filter_t filter)
+{
+    breakpoint_t *breakpoint = breakpoint_code_find(cpuno, address, filter);
+
+    if (breakpoint == NULL) {
+        return false;
+    }
+
+    breakpoint_code_unlink(breakpoint);
+    return true;
+}
+
+/** Remove all code breakpoints of a processor with the given kind
+ *
+ * @param cpuno  Processor of the breakpoints.
+ * @param filter Kinds of the breakpoints to be removed.
+ *
+ */
+void breakpoint_code_remove_filtered(unsigned int cpuno,
+        breakpoint_filter_t filter)
+{
+    breakpoint_t *breakpoint = (breakpoint_t *) code_breakpoints.head;
+
+    while (breakpoint != NULL) {
+        breakpoint_t *removed = breakpoint;
+        breakpoint = (breakpoint_t *) breakpoint->item.next;
+
+        if ((removed->cpuno == cpuno) && ((removed->kind & filter) != 0)) {
+            breakpoint_code_unlink(removed);
+        }
+    }
+}
+
+/** Check whether a processor has a code breakpoint on a virtual page
+ *
+ * @param cpuno   Processor of the breakpoints.
+ * @param address Any address on the page.
+ *
+ * @return True, if any breakpoint of the processor is on the page.
+ *
+ */
+bool breakpoint_code_on_page(unsigned int cpuno, ptr64_t address)
+{
+    uint64_t page = address.ptr >> FRAME_WIDTH;
+    breakpoint_t *breakpoint = code_buckets[CODE_BUCKET(cpuno, address.ptr)];
+
+    while (breakpoint != NULL) {
+        if ((breakpoint->cpuno == cpuno)
+                && ((breakpoint->pc.ptr >> FRAME_WIDTH) == page)) {
+            return true;
+        }
+
+        breakpoint = breakpoint->bucket_next;
+    }
+
+    return false;
+}
+
+/** Print the code breakpoints of a processor
+ *
+ */
+void breakpoint_code_print_list(unsigned int cpuno)
+{
+    printf("[address ] [hits              ] [kind    ]\n");
+
+    breakpoint_t *breakpoint = NULL;
+    for_each(code_breakpoints, breakpoint, breakpoint_t)
+    {
+        if (breakpoint->cpuno != cpuno) {
+            continue;
+        }
+
+        const char *kind = (breakpoint->kind == BREAKPOINT_KIND_SIMULATOR)
+                ? "Simulator"
+                : "Debugger";
+
+        printf("%#018" PRIx64 " %20" PRIu64 " %s",
+                breakpoint->pc.ptr, breakpoint->hits, kind);
+
+        if (breakpoint->cond == NULL) {
+            printf("\n");
+        } else if (breakpoint->cond->text != NULL) {
+            printf(" if %s\n", breakpoint->cond->text);
+        } else {
+            printf(" if <debugger condition>\n");
+        }
+    }
+}
+
 /** Fires given breakpoint
+ *
+ * The breakpoint is reached, but it only stops the machine
+ * if its condition holds. The hits are not counted again
+ * while the cycles are re-executed by the reverse execution.
  *
  * @param breakpoint Breakpoint structure to be fired
  *
+ * @return True if the breakpoint has stopped the machine.
+ *
  */
-static void breakpoint_hit(breakpoint_t *breakpoint)
+static bool breakpoint_hit(breakpoint_t *breakpoint)
 {
-    breakpoint->hits++;
+    if (!reverse_rerun) {
+        breakpoint->hits++;
+    }
+
+    if ((breakpoint->cond != NULL)
+            && (!bpcond_holds(breakpoint->cond, breakpoint->cpuno, breakpoint->hits))) {
+        return false;
+    }
+
+    if (reverse_rerun) {
+        reverse_hit_code(breakpoint->cpuno);
+        return true;
+    }
 
     switch (breakpoint->kind) {
     case BREAKPOINT_KIND_SIMULATOR:
@@ -234,90 +721,131 @@ static void breakpoint_hit(breakpoint_t *breakpoint)
         machine_interactive = true;
         break;
     case BREAKPOINT_KIND_DEBUGGER:
-        gdb_handle_event(GDB_EVENT_BREAKPOINT);
+        gdb_handle_breakpoint(breakpoint->cpuno);
         break;
     default:
         die(ERR_INTERN, "Unexpected breakpoint kind");
     }
+
+    return true;
 }
 
-/** Search for a breakpoint
- *
- * Search for a breakpoint in given list which should be
- * fired on given address and fire it.
+/** Fire the code breakpoints of a processor on an address
  *
- * @param breakpoints List of code breakpoints of some processor.
- * @param address     Address of executed instruction.
+ * @param cpuno   Processor, which is going to execute the instruction.
+ * @param address Address of the instruction.
  *
- * @return True, if at least one breakpoint has been hit.
+ * @return True, if at least one breakpoint has stopped the machine.
  *
  */
-static bool breakpoint_hit_by_address(list_t breakpoints, ptr64_t address)
+static bool breakpoint_hit_by_address(unsigned int cpuno, ptr64_t address)
 {
     bool hit = false;
+    breakpoint_t *breakpoint = code_buckets[CODE_BUCKET(cpuno, address.ptr)];
 
-    breakpoint_t *breakpoint = NULL;
-    for_each(breakpoints, breakpoint, breakpoint_t)
-    {
-        if (breakpoint->pc.ptr == address.ptr) {
-            breakpoint_hit(breakpoint);
+    while (breakpoint != NULL) {
+        if ((breakpoint->cpuno == cpuno) && (breakpoint->pc.ptr == address.ptr)
+                && (breakpoint_hit(breakpoint))) {
             hit = true;
         }
+
+        breakpoint = breakpoint->bucket_next;
     }
 
     return hit;
 }
 
-/** Search for a breakpoint
- *
- * Search for a breakpoint in given list which should be
- * fired on given address and has kind which matches to the
- * given filter.
+/** Search all of the processors
  *
- * @param breakpoints List of code breakpoints of some processor.
- * @param address     Address, where the breakpoint can be hit.
- * @param filter      Filters considered breakpoints according to the kind.
+ * Search all of the processors whether any of them is going to
+ * execute instruction where a code breakpoint is located. All such
+ * breakpoints are fired. Processors without code breakpoints
+ * are skipped without looking at their program counter.
  *
- * @return Found breakpoint structure or NULL, if there is not any.
+ * @return True, if at least one breakpoint has been fired.
  *
  */
-breakpoint_t *breakpoint_find_by_address(list_t breakpoints,
-        ptr64_t address, breakpoint_filter_t filter)
+bool breakpoint_check_for_code_breakpoints(void)
 {
-    breakpoint_t *breakpoint = NULL;
+    bool hit = false;
 
-    for_each(breakpoints, breakpoint, breakpoint_t)
-    {
-        if ((breakpoint->pc.ptr == address.ptr) && ((breakpoint->kind & filter) != 0)) {
-            return breakpoint;
+    profile_region_enter(PROFILE_BREAKPOINTS);
+
+    for (unsigned int i = 0; i < get_cpu_count(); i++) {
+        general_cpu_t *cpu = get_cpu_by_index(i);
+
+        if (code_breakpoint_count[cpu->cpuno] == 0) {
+            continue;
+        }
+
+        if (breakpoint_hit_by_address(cpu->cpuno, cpu_get_pc(cpu))) {
+            hit = true;
         }
     }
 
-    return NULL;
+    profile_region_leave();
+    return hit;
 }
 
-/** Search all of the processors
+/** Collect the processors for breakpoint_code_pending()
  *
- * Search all of the processors whether any of them is going to
- * execute instruction where a code breakpoint is located. All such
- * breakpoints are fired.
+ * The code breakpoints can only change while the simulation is
+ * stopped (in the interactive mode or in a debugger session),
+ * so they are collected whenever the simulation is resumed.
  *
- * @return True, if at least one breakpoint has been fired.
+ */
+void breakpoint_code_prepare(void)
+{
+    code_cpu_count = 0;
+
+    for (unsigned int i = 0; i < get_cpu_count(); i++) {
+        general_cpu_t *cpu = get_cpu_by_index(i);
+
+        if (code_breakpoint_count[cpu->cpuno] > 0) {
+            code_cpus[code_cpu_count] = cpu;
+            code_cpu_count++;
+        }
+    }
+}
+
+/** Check whether a processor is going to hit a code breakpoint
+ *
+ * Unlike breakpoint_check_for_code_breakpoints(), the breakpoints
+ * are not fired. Only the processors collected by the last
+ * breakpoint_code_prepare() are checked.
+ *
+ * @return True, if breakpoint_check_for_code_breakpoints()
+ *         would fire a breakpoint.
  *
  */
-bool breakpoint_check_for_code_breakpoints(void)
+bool breakpoint_code_pending(void)
 {
-    // TODO: add RV support
-    bool hit = false;
-    device_t *dev = NULL;
+    if (code_cpu_count == 0) {
+        return false;
+    }
 
-    while (dev_next(&dev, DEVICE_FILTER_R4K_PROCESSOR)) {
-        r4k_cpu_t *cpu = get_r4k(dev);
+    bool pending = false;
+    profile_region_enter(PROFILE_BREAKPOINTS);
 
-        if (breakpoint_hit_by_address(cpu->bps, cpu->pc)) {
-            hit = true;
+    for (unsigned int i = 0; i < code_cpu_count; i++) {
+        general_cpu_t *cpu = code_cpus[i];
+
+        if (breakpoint_code_find(cpu->cpuno, cpu_get_pc(cpu), BREAKPOINT_FILTER_ANY) != NULL) {
+            pending = true;
+            break;
         }
     }
 
-    return hit;
+    profile_region_leave();
+    return pending;
+}
+
+/** Check whether any code or memory breakpoint is set
+ *
+ * @return True, if the machine has to be observed cycle by cycle.
+ *
+ */
+bool breakpoint_any_set(void)
+{
+    return (!is_empty(&physmem_breakpoints)) || (!is_empty(&code_breakpoints));
 }
@@ -42,12 +42,21 @@ typedef enum {
 } access_filter_t;
 
 /** Structure for the code breakpoints */
-typedef struct {
+typedef struct breakpoint {
     item_t item;
 
     breakpoint_kind_t kind;
+    unsigned int cpuno;
     ptr64_t pc;
+
+    /** Number of times the breakpoint has been reached */
     uint64_t hits;
+
+    /** Condition of the stop (NULL for an unconditional breakpoint) */
+    struct bpcond *cond;
+
+    /** Next breakpoint in the same bucket of the hash set */
+    struct breakpoint *bucket_next;
 } breakpoint_t;
 
 /** Structure for the memory breakpoints */
@@ -59,26 +68,69 @@ typedef struct {
     len36_t size;
     uint64_t hits;
     access_filter_t access_flags;
+
+    /** Virtual address of the watched area given by the debugger */
+    uint64_t debugger_addr;
+
+    /** Maximal end of this and all preceding breakpoints in the index */
+    ptr36_t reach;
 } physmem_breakpoint_t;
 
 /** List of all the memory breakpoints */
 extern list_t physmem_breakpoints;
 
+/** List of all the code breakpoints (in the order of insertion) */
+extern list_t code_breakpoints;
+
+/** Number of code breakpoints of each processor */
+extern unsigned int code_breakpoint_count[MAX_CPUS];
+
 /* Memory breakpoints interface */
 
-extern void physmem_breakpoint_add(ptr36_t address, len36_t size,
-        breakpoint_kind_t kind, access_filter_t access_flags);
+extern physmem_breakpoint_t *physmem_breakpoint_add(ptr36_t address,
+        len36_t size, breakpoint_kind_t kind, access_filter_t access_flags);
 extern bool physmem_breakpoint_remove(ptr36_t address);
+extern bool physmem_breakpoint_remove_kind(ptr36_t address, len36_t size,
+        breakpoint_kind_t kind, access_filter_t access_flags);
 extern void physmem_breakpoint_remove_filtered(breakpoint_filter_t filter);
 extern void physmem_breakpoint_hit(physmem_breakpoint_t *breakpoint,
-        access_t access_type);
+        ptr36_t addr, access_t access_type);
 extern void physmem_breakpoint_print_list(void);
+extern physmem_breakpoint_t *physmem_breakpoint_find(ptr36_t addr,
+        len36_t size, access_t access_type);
+extern unsigned int physmem_breakpoint_count(ptr36_t addr, len36_t size);
 
 /* Code breakpoints interface */
 
-extern breakpoint_t *breakpoint_init(ptr64_t address, breakpoint_kind_t kind);
-extern breakpoint_t *breakpoint_find_by_address(list_t breakpoints,
+extern breakpoint_t *breakpoint_code_insert(unsigned int cpuno,
+        ptr64_t address, breakpoint_kind_t kind);
+extern bool breakpoint_code_set(unsigned int cpuno, ptr64_t address,
+        const char *text);
+extern void breakpoint_code_condition(breakpoint_t *breakpoint,
+        struct bpcond *cond);
+extern bool breakpoint_code_remove(unsigned int cpuno, ptr64_t address,
+        breakpoint_filter_t filter);
+extern void breakpoint_code_remove_filtered(unsigned int cpuno,
+        breakpoint_filter_t filter);
+extern breakpoint_t *breakpoint_code_find(unsigned int cpuno,
         ptr64_t address, breakpoint_filter_t filter);
+extern bool breakpoint_code_on_page(unsigned int cpuno, ptr64_t address);
+extern void breakpoint_code_print_list(unsigned int cpuno);
 extern bool breakpoint_check_for_code_breakpoints(void);
+extern void breakpoint_code_prepare(void);
+extern bool breakpoint_code_pending(void);
+extern bool breakpoint_any_set(void);
+
+/** Check whether a code breakpoint may be hit on the page of an address
+ *
+ * Processors without code breakpoints only test their counter,
+ * the hash set is searched otherwise.
+ *
+ */
+static inline bool breakpoint_code_page_set(unsigned int cpuno, ptr64_t address)
+{
+    return (code_breakpoint_count[cpuno] > 0)
+            && (breakpoint_code_on_page(cpuno, address));
+}
 
 #endif
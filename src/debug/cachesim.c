@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Cache hierarchy model
+ *
+ *  The processors configured to do so model the hit and miss counts
+ *  of private set-associative L1 instruction, L1 data and unified L2
+ *  caches with the LRU replacement (by physical addresses, without
+ *  the timing of the accesses). The processors only buffer the data
+ *  accesses and the instruction fetches, the buffer is modeled in
+ *  bulk once it fills up. No processor modeling the caches thus
+ *  costs a single test per access (and per executed block).
+ *
+ */
+
+#include "cachesim.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../assert.h"
+#include "../fault.h"
+#include "../physmem.h"
+#include "../utils.h"
+
+cachesim_t *cachesim_cpus[MAX_CPUS];
+bool cachesim_enabled = false;
+
+/** Names of the levels */
+static const char *const cachesim_level_names[CACHESIM_LEVELS] = {
+    "l1i",
+    "l1d",
+    "l2"
+};
+
+/** Find a level by its name
+ *
+ * @return False if the name is not known
+ *
+ */
+bool cachesim_level_from_name(const char *name, cachesim_level_no_t *level)
+{
+    ASSERT(name != NULL);
+    ASSERT(level != NULL);
+
+    for (unsigned int i = 0; i < CACHESIM_LEVELS; i++) {
+        if (strcmp(name, cachesim_level_names[i]) == 0) {
+            *level = (cachesim_level_no_t) i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/** Binary logarithm of a power of two (-1 otherwise) */
+static int cachesim_log2(uint64_t value)
+{
+    if ((value == 0) || ((value & (value - 1)) != 0)) {
+        return -1;
+    }
+
+    return __builtin_ctzll(value);
+}
+
+/** Look up a line in a level, bringing it in on a miss
+ *
+ * @return True on a hit
+ *
+ */
+static bool cachesim_access(cachesim_level_t *level, uint64_t addr)
+{
+    uint64_t line = addr >> level->line_width;
+    uint64_t *set = &level->lines[(line & (level->sets - 1)) * level->ways];
+    uint64_t tag = line + 1;
+    unsigned int way;
+
+    for (way = 0; way < level->ways; way++) {
+        if (set[way] == tag) {
+            break;
+        }
+    }
+
+    bool hit = (way < level->ways);
+
+    if (hit) {
+        level->hits++;
+    } else {
+        level->misses++;
+        way = level->ways - 1;
+    }
+
+    /* The line becomes the most recently used one */
+    memmove(&set[1], &set[0], way * sizeof(uint64_t));
+    set[0] = tag;
+
+    return hit;
+}
+
+/** Model the buffered accesses of a processor
+ *
+ * The misses of the first level caches go to the L2 cache
+ * (the accesses go there directly without the first level).
+ *
+ */
+void cachesim_flush(cachesim_t *cache)
+{
+    ASSERT(cache != NULL);
+
+    cachesim_level_t *l2 = &cache->levels[CACHESIM_L2];
+
+    for (unsigned int i = 0; i < cache->pending; i++) {
+        uint64_t entry = cache->buffer[i];
+        uint64_t addr = entry >> 1;
+        cachesim_level_t *l1 = &cache->levels[((entry & 1) != 0) ? CACHESIM_L1I : CACHESIM_L1D];
+
+        if ((l1->sets > 0) && (cachesim_access(l1, addr))) {
+            continue;
+        }
+
+        if (l2->sets > 0) {
+            cachesim_access(l2, addr);
+        }
+    }
+
+    cache->pending = 0;
+}
+
+/** Update whether any processor models the caches */
+static void cachesim_update_enabled(void)
+{
+    cachesim_enabled = false;
+
+    for (unsigned int i = 0; i < MAX_CPUS; i++) {
+        cachesim_enabled = cachesim_enabled || (cachesim_cpus[i] != NULL);
+    }
+}
+
+/** Configure a cache level of a processor
+ *
+ * The level starts empty and its counters are cleared, the size 0
+ * removes the level. The hierarchy without any level is removed.
+ *
+ * @param cpuno Processor number
+ * @param level Cache level
+ * @param size  Size of the level in bytes (0 to remove it)
+ * @param ways  Associativity of the level
+ * @param line  Size of the lines in bytes
+ *
+ * @return False if the geometry is not valid
+ *
+ */
+bool cachesim_configure(unsigned int cpuno, cachesim_level_no_t level,
+        uint64_t size, uint64_t ways, uint64_t line)
+{
+    ASSERT(cpuno < MAX_CPUS);
+    ASSERT(level < CACHESIM_LEVELS);
+
+    int line_width = cachesim_log2(line);
+    uint64_t sets = 0;
+
+    if (size > 0) {
+        if ((line_width < 2) || (line > FRAME_SIZE)) {
+            error("Line size has to be a power of two from 4 to %u bytes", FRAME_SIZE);
+            return false;
+        }
+
+        if ((ways == 0) || (ways > 64)) {
+            error("Associativity out of range (1 to 64)");
+            return false;
+        }
+
+        sets = size / (ways * line);
+
+        if ((sets * ways * line != size) || (cachesim_log2(sets) < 0)) {
+            error("Size has to be a power of two multiple of the ways times the line size");
+            return false;
+        }
+    }
+
+    cachesim_t *cache = cachesim_cpus[cpuno];
+
+    if (cache == NULL) {
+        if (size == 0) {
+            return true;
+        }
+
+        cache = safe_malloc(sizeof(cachesim_t));
+        memset(cache, 0, sizeof(cachesim_t));
+        cachesim_cpus[cpuno] = cache;
+    }
+
+    /* The accesses so far go to the previous configuration */
+    cachesim_flush(cache);
+
+    cachesim_level_t *lvl = &cache->levels[level];
+    safe_free(lvl->lines);
+    memset(lvl, 0, sizeof(cachesim_level_t));
+
+    if (size > 0) {
+        lvl->sets = sets;
+        lvl->ways = ways;
+        lvl->line_width = line_width;
+        lvl->lines = safe_malloc(sets * ways * sizeof(uint64_t));
+        memset(lvl->lines, 0, sets * ways * sizeof(uint64_t));
+    }
+
+    bool empty = true;
+    for (unsigned int i = 0; i < CACHESIM_LEVELS; i++) {
+        empty = empty && (cache->levels[i].sets == 0);
+    }
+
+    if (empty) {
+        cachesim_done(cpuno);
+    }
+
+    cachesim_update_enabled();
+    return true;
+}
+
+/** Print the cache levels of a processor */
+void cachesim_print_config(unsigned int cpuno)
+{
+    ASSERT(cpuno < MAX_CPUS);
+
+    cachesim_t *cache = cachesim_cpus[cpuno];
+
+    if (cache == NULL) {
+        printf("Cache model: none\n");
+        return;
+    }
+
+    for (unsigned int i = 0; i < CACHESIM_LEVELS; i++) {
+        cachesim_level_t *level = &cache->levels[i];
+
+        if (level->sets == 0) {
+            continue;
+        }
+
+        uint64_t line = UINT64_C(1) << level->line_width;
+        uint64_t size = level->sets * level->ways * line;
+
+        printf("Cache %s: %" PRIu64 " KiB, %u-way, %" PRIu64 " B lines\n",
+                cachesim_level_names[i], size / 1024, level->ways, line);
+    }
+}
+
+/** Print the hits and misses of the cache levels of a processor
+ *
+ * Nothing is printed if the processor does not model the caches.
+ *
+ */
+void cachesim_print(unsigned int cpuno)
+{
+    ASSERT(cpuno < MAX_CPUS);
+
+    cachesim_t *cache = cachesim_cpus[cpuno];
+
+    if (cache == NULL) {
+        return;
+    }
+
+    cachesim_flush(cache);
+
+    printf("[Cache level       ] [Hits              ] [Misses            ] [Miss rate (%%)     ]\n");
+
+    for (unsigned int i = 0; i < CACHESIM_LEVELS; i++) {
+        cachesim_level_t *level = &cache->levels[i];
+
+        if (level->sets == 0) {
+            continue;
+        }
+
+        uint64_t accesses = level->hits + level->misses;
+        double miss_rate = (accesses == 0) ? 0.0 : 100.0 * level->misses / accesses;
+
+        printf("%20s %20" PRIu64 " %20" PRIu64 " %20.2f\n",
+                cachesim_level_names[i], level->hits, level->misses, miss_rate);
+    }
+
+    printf("\n");
+}
+
+/** Remove the cache hierarchy of a processor */
+void cachesim_done(unsigned int cpuno)
+{
+    ASSERT(cpuno < MAX_CPUS);
+
+    cachesim_t *cache = cachesim_cpus[cpuno];
+
+    if (cache == NULL) {
+        return;
+    }
+
+    for (unsigned int i = 0; i < CACHESIM_LEVELS; i++) {
+        safe_free(cache->levels[i].lines);
+    }
+
+    safe_free(cache);
+    cachesim_cpus[cpuno] = NULL;
+    cachesim_update_enabled();
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Cache hierarchy model
+ *
+ */
+
+#ifndef CACHESIM_H_
+#define CACHESIM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../main.h"
+
+/** Levels of the modeled hierarchy */
+typedef enum {
+    CACHESIM_L1I = 0,
+    CACHESIM_L1D = 1,
+    CACHESIM_L2 = 2,
+    CACHESIM_LEVELS
+} cachesim_level_no_t;
+
+/** Number of the accesses buffered before they are modeled */
+#define CACHESIM_BUFFER 256
+
+/** Default size of the cache lines */
+#define CACHESIM_DEFAULT_LINE 64
+
+/** Set-associative cache level with the LRU replacement */
+typedef struct {
+    unsigned int sets; /**< 0 if the level is not modeled */
+    unsigned int ways;
+    unsigned int line_width; /**< Binary logarithm of the line size */
+
+    /** Lines of the sets (line number + 1, 0 if empty), most recent first */
+    uint64_t *lines;
+
+    uint64_t hits;
+    uint64_t misses;
+} cachesim_level_t;
+
+/** Cache hierarchy of a processor
+ *
+ * The accesses are only appended to the buffer by the processor
+ * and modeled in bulk once the buffer fills up (or the statistics
+ * are printed), each buffered access is the physical address shifted
+ * left by one with the lowest bit set for the instruction fetches.
+ *
+ */
+typedef struct {
+    cachesim_level_t levels[CACHESIM_LEVELS];
+
+    uint64_t buffer[CACHESIM_BUFFER];
+    unsigned int pending;
+} cachesim_t;
+
+/** Cache hierarchies of the processors (NULL if not modeled) */
+extern cachesim_t *cachesim_cpus[MAX_CPUS];
+
+/** Any processor has a cache hierarchy */
+extern bool cachesim_enabled;
+
+extern bool cachesim_configure(unsigned int cpuno, cachesim_level_no_t level,
+        uint64_t size, uint64_t ways, uint64_t line);
+extern bool cachesim_level_from_name(const char *name, cachesim_level_no_t *level);
+extern void cachesim_flush(cachesim_t *cache);
+extern void cachesim_print_config(unsigned int cpuno);
+extern void cachesim_print(unsigned int cpuno);
+extern void cachesim_done(unsigned int cpuno);
+
+/** Buffer an access of a processor */
+static inline void cachesim_append(cachesim_t *cache, uint64_t entry)
+{
+    cache->buffer[cache->pending++] = entry;
+
+    if (cache->pending == CACHESIM_BUFFER) {
+        cachesim_flush(cache);
+    }
+}
+
+/** Account a data access of a processor
+ *
+ * A single test unless a cache hierarchy is modeled.
+ *
+ */
+static inline void cachesim_data(unsigned int cpuno, ptr36_t addr)
+{
+    if (!cachesim_enabled) {
+        return;
+    }
+
+    cachesim_t *cache = cachesim_cpus[cpuno];
+
+    if (cache != NULL) {
+        cachesim_append(cache, ((uint64_t) addr) << 1);
+    }
+}
+
+/** Account the fetches of a straight-line run of instructions
+ *
+ * The fetches of a block are accounted at once when the block
+ * ends. A single test unless a cache hierarchy is modeled.
+ *
+ * @param phys  Physical address of the first instruction.
+ * @param count Number of the (4 byte) instructions.
+ *
+ */
+static inline void cachesim_fetch(unsigned int cpuno, ptr36_t phys,
+        unsigned int count)
+{
+    if (!cachesim_enabled) {
+        return;
+    }
+
+    cachesim_t *cache = cachesim_cpus[cpuno];
+
+    if ((cache == NULL) || (count == 0)) {
+        return;
+    }
+
+    /* The first level the fetches reach decides the lines fetched */
+    cachesim_level_t *level = &cache->levels[CACHESIM_L1I];
+    if (level->sets == 0) {
+        level = &cache->levels[CACHESIM_L2];
+    }
+
+    if (level->sets == 0) {
+        return;
+    }
+
+    unsigned int width = level->line_width;
+    uint64_t first = phys >> width;
+    uint64_t last = (phys + 4 * ((uint64_t) count - 1)) >> width;
+
+    for (uint64_t line = first; line <= last; line++) {
+        cachesim_append(cache, ((line << width) << 1) | 1);
+    }
+
+    /* The other instructions of a line hit the line just fetched */
+    level->hits += count - (last - first + 1);
+}
+
+#endif
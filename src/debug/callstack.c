@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Shadow call stacks of the processors
+ *
+ *  While the call stacks are enabled, the decoded instruction pages
+ *  hold call and return variants of the jumps linking the return
+ *  address register (JAL, JALR, BGEZAL and BLTZAL, jal and jalr
+ *  linking ra or t0) and of the jumps to it (JR ra, ret). The
+ *  variants push or pop a call on the stack of the processor after
+ *  the jump, the other instructions run as usual. The stacks are
+ *  sampled by the PC profile into the folded stacks.
+ *
+ *  The stacks are not exact: the calls made before the stacks were
+ *  enabled are missing, the traps and the kernel thread switches
+ *  are not calls. The returns therefore pop all the calls up to the
+ *  one they return from (see callstack_return()).
+ *
+ */
+
+#include "callstack.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "../device/cpu/decode_cache.h"
+#include "../main.h"
+
+bool callstack_enabled = false;
+
+callstack_t callstacks[MAX_CPUS];
+
+/** Forget the calls on the stacks of all processors */
+void callstack_reset(void)
+{
+    for (unsigned int i = 0; i < MAX_CPUS; i++) {
+        callstacks[i].depth = 0;
+    }
+}
+
+/** Enable or disable the call stacks
+ *
+ * The decoded pages are flushed to be decoded again with
+ * or without the call and return variants of the jumps.
+ *
+ */
+bool callstack_set(bool enabled)
+{
+    callstack_enabled = enabled;
+    callstack_reset();
+
+    for (unsigned int isa = 0; isa < DECODE_ISA_COUNT; isa++) {
+        decode_cache_flush(isa);
+    }
+
+    return true;
+}
+
+/** Forget the outermost call of a full stack */
+void callstack_shift(callstack_t *stack)
+{
+    memmove(&stack->target[0], &stack->target[1],
+            (CALLSTACK_DEPTH - 1) * sizeof(stack->target[0]));
+    memmove(&stack->ret[0], &stack->ret[1],
+            (CALLSTACK_DEPTH - 1) * sizeof(stack->ret[0]));
+    stack->depth--;
+}
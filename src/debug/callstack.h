@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Shadow call stacks of the processors
+ *
+ */
+
+#ifndef CALLSTACK_H_
+#define CALLSTACK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../main.h"
+
+/** Number of the innermost calls kept on each stack */
+#define CALLSTACK_DEPTH 64
+
+/** Shadow call stack of a processor */
+typedef struct {
+    /** Called functions (the outermost first) */
+    uint64_t target[CALLSTACK_DEPTH];
+    /** Return addresses of the calls */
+    uint64_t ret[CALLSTACK_DEPTH];
+    /** Number of the kept calls */
+    unsigned int depth;
+} callstack_t;
+
+/** The processors keep the shadow call stacks */
+extern bool callstack_enabled;
+
+extern callstack_t callstacks[MAX_CPUS];
+
+extern bool callstack_set(bool enabled);
+extern void callstack_reset(void);
+extern void callstack_shift(callstack_t *stack);
+
+/** Push a call on the stack of a processor
+ *
+ * The outermost call is forgotten if the stack is full.
+ *
+ * @param target Called function.
+ * @param ret    Return address of the call.
+ *
+ */
+static inline void callstack_call(unsigned int cpuno, uint64_t target,
+        uint64_t ret)
+{
+    callstack_t *stack = &callstacks[cpuno];
+
+    if (stack->depth == CALLSTACK_DEPTH) {
+        callstack_shift(stack);
+    }
+
+    stack->target[stack->depth] = target;
+    stack->ret[stack->depth] = ret;
+    stack->depth++;
+}
+
+/** Pop the calls returned from on the stack of a processor
+ *
+ * The calls up to the one with the return address are popped,
+ * so that the calls left by a longjmp or by a switch of the
+ * kernel stacks are popped as well. A return to an address not
+ * on the stack pops the innermost call.
+ *
+ * @param addr Address returned to.
+ *
+ */
+static inline void callstack_return(unsigned int cpuno, uint64_t addr)
+{
+    callstack_t *stack = &callstacks[cpuno];
+
+    for (unsigned int i = stack->depth; i > 0; i--) {
+        if (stack->ret[i - 1] == addr) {
+            stack->depth = i - 1;
+            return;
+        }
+    }
+
+    if (stack->depth > 0) {
+        stack->depth--;
+    }
+}
+
+#endif
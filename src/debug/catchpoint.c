@@ -0,0 +1,413 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Exception, register write and mode catchpoints
+ *
+ *  A catchpoint stops the simulation (or only logs the event) when
+ *  a processor takes an exception or an interrupt, writes a CSR or
+ *  a CP0 register or changes its privilege mode. The processors
+ *  report these events from the exception handling and from the
+ *  system instructions, only when some catchpoint of the kind is set
+ *  on them (see catchpoint_armed()), so the instructions executed in
+ *  between pay nothing.
+ *
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "../assert.h"
+#include "../device/cpu/general_cpu.h"
+#include "../fault.h"
+#include "../list.h"
+#include "../main.h"
+#include "../parser.h"
+#include "../utils.h"
+#include "catchpoint.h"
+#include "reverse.h"
+
+/** Code of a mode catchpoint catching any change */
+#define CATCH_ANY_MODE cpu_mode_count
+
+/** Catchpoint of a processor */
+typedef struct {
+    item_t item;
+
+    unsigned int cpuno;
+    catch_kind_t kind;
+
+    /** Exception code, interrupt number, register or mode entered */
+    unsigned int code;
+
+    /** Name of the register caught */
+    const char *reg_name;
+
+    /** Only log the event, do not stop */
+    bool log;
+
+    uint64_t hits;
+} catchpoint_t;
+
+unsigned int catch_armed[MAX_CPUS];
+
+/** All catchpoints (in the order of insertion) */
+static list_t catchpoints = LIST_INITIALIZER;
+
+/** Modes of the processors when they were last checked */
+static cpu_mode_t catch_modes[MAX_CPUS];
+
+/** Recompute the events caught by a processor */
+static void catchpoint_arm(unsigned int cpuno)
+{
+    catch_armed[cpuno] = 0;
+
+    catchpoint_t *catchpoint;
+    for_each(catchpoints, catchpoint, catchpoint_t)
+    {
+        if (catchpoint->cpuno == cpuno) {
+            catch_armed[cpuno] |= catchpoint->kind;
+        }
+    }
+}
+
+/** Add a catchpoint (an existing one of the event only changes its action) */
+static void catchpoint_add(unsigned int cpuno, catch_kind_t kind,
+        unsigned int code, const char *reg_name, bool log)
+{
+    ASSERT(cpuno < MAX_CPUS);
+
+    catchpoint_t *catchpoint;
+    for_each(catchpoints, catchpoint, catchpoint_t)
+    {
+        if ((catchpoint->cpuno == cpuno) && (catchpoint->kind == kind)
+                && (catchpoint->code == code)) {
+            catchpoint->log = log;
+            return;
+        }
+    }
+
+    catchpoint = safe_malloc_t(catchpoint_t);
+    item_init(&catchpoint->item);
+    catchpoint->cpuno = cpuno;
+    catchpoint->kind = kind;
+    catchpoint->code = code;
+    catchpoint->reg_name = reg_name;
+    catchpoint->log = log;
+    catchpoint->hits = 0;
+
+    list_append(&catchpoints, &catchpoint->item);
+
+    if (kind == CATCH_MODE) {
+        catch_modes[cpuno] = cpu_mode(get_cpu(cpuno));
+    }
+
+    catchpoint_arm(cpuno);
+}
+
+/** Remove all catchpoints of a processor */
+static void catchpoint_clear(unsigned int cpuno)
+{
+    catchpoint_t *catchpoint = (catchpoint_t *) catchpoints.head;
+
+    while (catchpoint != NULL) {
+        catchpoint_t *removed = catchpoint;
+        catchpoint = (catchpoint_t *) catchpoint->item.next;
+
+        if (removed->cpuno == cpuno) {
+            list_remove(&catchpoints, &removed->item);
+            safe_free(removed);
+        }
+    }
+
+    catchpoint_arm(cpuno);
+}
+
+/** Print the catchpoints of a processor */
+static void catchpoint_print_list(unsigned int cpuno)
+{
+    printf("[event                  ] [hits              ] [action]\n");
+
+    catchpoint_t *catchpoint;
+    for_each(catchpoints, catchpoint, catchpoint_t)
+    {
+        if (catchpoint->cpuno != cpuno) {
+            continue;
+        }
+
+        char event[32];
+
+        switch (catchpoint->kind) {
+        case CATCH_EXCEPTION:
+            snprintf(event, sizeof(event), "exception %u", catchpoint->code);
+            break;
+        case CATCH_INTERRUPT:
+            snprintf(event, sizeof(event), "interrupt %u", catchpoint->code);
+            break;
+        case CATCH_WRITE:
+            snprintf(event, sizeof(event), "write %s", catchpoint->reg_name);
+            break;
+        default:
+            snprintf(event, sizeof(event), "mode %s",
+                    (catchpoint->code == CATCH_ANY_MODE)
+                            ? "any"
+                            : cpu_mode_name(catchpoint->code));
+            break;
+        }
+
+        printf("%-25s %20" PRIu64 " %s\n", event, catchpoint->hits,
+                catchpoint->log ? "log" : "stop");
+    }
+}
+
+/** Fire the catchpoints of an event
+ *
+ * @param what Description of the event for the user.
+ *
+ */
+static void catchpoint_fire(unsigned int cpuno, catch_kind_t kind,
+        unsigned int code, const char *what)
+{
+    /* The events re-executed have been caught already */
+    if (reverse_rerun) {
+        return;
+    }
+
+    catchpoint_t *catchpoint;
+    for_each(catchpoints, catchpoint, catchpoint_t)
+    {
+        if ((catchpoint->cpuno != cpuno) || (catchpoint->kind != kind)) {
+            continue;
+        }
+
+        if ((catchpoint->code != code)
+                && ((kind != CATCH_MODE) || (catchpoint->code != CATCH_ANY_MODE))) {
+            continue;
+        }
+
+        catchpoint->hits++;
+        alert("Debug: cpu%u caught %s", cpuno, what);
+
+        if (!catchpoint->log) {
+            __atomic_store_n(&machine_interactive, true, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+/** Report an exception or an interrupt taken by a processor
+ *
+ * @param interrupt True for an interrupt.
+ * @param code      Exception code or interrupt number.
+ *
+ */
+void catchpoint_trap(unsigned int cpuno, bool interrupt, unsigned int code)
+{
+    char what[32];
+    snprintf(what, sizeof(what), "%s %u",
+            interrupt ? "interrupt" : "exception", code);
+
+    catchpoint_fire(cpuno, interrupt ? CATCH_INTERRUPT : CATCH_EXCEPTION,
+            code, what);
+}
+
+/** Report a write to a CSR or CP0 register
+ *
+ * @param reg Number of the register.
+ * @param val Value of the register after the write.
+ *
+ */
+void catchpoint_write(unsigned int cpuno, unsigned int reg, uint64_t val)
+{
+    catchpoint_t *catchpoint;
+    for_each(catchpoints, catchpoint, catchpoint_t)
+    {
+        if ((catchpoint->cpuno == cpuno) && (catchpoint->kind == CATCH_WRITE)
+                && (catchpoint->code == reg)) {
+            char what[64];
+            snprintf(what, sizeof(what), "write of %s (%#" PRIx64 ")",
+                    catchpoint->reg_name, val);
+
+            catchpoint_fire(cpuno, CATCH_WRITE, reg, what);
+            return;
+        }
+    }
+}
+
+/** Report a possible change of the privilege mode of a processor
+ *
+ * Called after the exceptions, the returns from them and the writes
+ * of the registers which hold the mode.
+ *
+ */
+void catchpoint_mode(unsigned int cpuno)
+{
+    cpu_mode_t mode = cpu_mode(get_cpu(cpuno));
+
+    if (mode == catch_modes[cpuno]) {
+        return;
+    }
+
+    char what[64];
+    snprintf(what, sizeof(what), "mode change from %s to %s",
+            cpu_mode_name(catch_modes[cpuno]), cpu_mode_name(mode));
+
+    catch_modes[cpuno] = mode;
+    catchpoint_fire(cpuno, CATCH_MODE, mode, what);
+}
+
+/** Find a register by its name or number
+ *
+ * @return False if there is no such register.
+ *
+ */
+static bool catchpoint_reg(token_t *parm, char *const *reg_names,
+        unsigned int reg_count, unsigned int *reg)
+{
+    if (parm_type(parm) == tt_uint) {
+        *reg = parm_uint(parm);
+        return (*reg < reg_count) && (reg_names[*reg] != NULL);
+    }
+
+    const char *name = parm_str(parm);
+
+    for (unsigned int i = 0; i < reg_count; i++) {
+        if ((reg_names[i] != NULL) && (strcasecmp(reg_names[i], name) == 0)) {
+            *reg = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/** Parse the action of a catchpoint
+ *
+ * @return False if the action is not known.
+ *
+ */
+static bool catchpoint_action(token_t *parm, bool *log)
+{
+    if (parm_type(parm) == tt_end) {
+        *log = false;
+        return true;
+    }
+
+    if (parm_type(parm) == tt_str) {
+        const char *action = parm_str(parm);
+
+        if ((strcmp(action, "stop") == 0) || (strcmp(action, "log") == 0)) {
+            *log = (strcmp(action, "log") == 0);
+            return true;
+        }
+    }
+
+    error("Action has to be stop or log");
+    return false;
+}
+
+/** Catch command implementation shared by the processors
+ *
+ * Without arguments the catchpoints of the processor are listed.
+ * Otherwise a catchpoint is added:
+ *
+ *   catch exception code [stop|log]
+ *   catch interrupt number [stop|log]
+ *   catch write register [stop|log]
+ *   catch mode [mode] [stop|log]
+ *   catch clear
+ *
+ * @param reg_names Names of the CSR or CP0 registers of the processor
+ *                  (NULL for the numbers not implemented).
+ * @param reg_count Number of the registers.
+ *
+ */
+bool catchpoint_cmd(token_t *parm, unsigned int cpuno,
+        char *const *reg_names, unsigned int reg_count)
+{
+    if (parm_type(parm) == tt_end) {
+        catchpoint_print_list(cpuno);
+        return true;
+    }
+
+    const char *what = parm_str_next(&parm);
+    bool log;
+
+    if (strcmp(what, "clear") == 0) {
+        catchpoint_clear(cpuno);
+        return true;
+    }
+
+    if (strcmp(what, "mode") == 0) {
+        unsigned int mode = CATCH_ANY_MODE;
+
+        if (parm_type(parm) == tt_str) {
+            for (unsigned int i = 0; i < cpu_mode_count; i++) {
+                if (strcmp(parm_str(parm), cpu_mode_name(i)) == 0) {
+                    mode = i;
+                    parm_next(&parm);
+                    break;
+                }
+            }
+        }
+
+        if (!catchpoint_action(parm, &log)) {
+            return false;
+        }
+
+        catchpoint_add(cpuno, CATCH_MODE, mode, NULL, log);
+        return true;
+    }
+
+    catch_kind_t kind;
+
+    if (strcmp(what, "exception") == 0) {
+        kind = CATCH_EXCEPTION;
+    } else if (strcmp(what, "interrupt") == 0) {
+        kind = CATCH_INTERRUPT;
+    } else if (strcmp(what, "write") == 0) {
+        kind = CATCH_WRITE;
+    } else {
+        error("Unknown event (exception, interrupt, write or mode)");
+        return false;
+    }
+
+    if (parm_type(parm) == tt_end) {
+        error("Missing %s", (kind == CATCH_WRITE) ? "register" : "code");
+        return false;
+    }
+
+    unsigned int code;
+    const char *reg_name = NULL;
+
+    if (kind == CATCH_WRITE) {
+        if (!catchpoint_reg(parm, reg_names, reg_count, &code)) {
+            error("Unknown register");
+            return false;
+        }
+
+        reg_name = reg_names[code];
+    } else {
+        if (parm_type(parm) != tt_uint) {
+            error("Code has to be a number");
+            return false;
+        }
+
+        code = parm_uint(parm);
+    }
+
+    parm_next(&parm);
+
+    if (!catchpoint_action(parm, &log)) {
+        return false;
+    }
+
+    catchpoint_add(cpuno, kind, code, reg_name, log);
+    return true;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Exception, register write and mode catchpoints
+ *
+ */
+
+#ifndef CATCHPOINT_H_
+#define CATCHPOINT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../main.h"
+#include "../parser.h"
+
+/** Events caught by the catchpoints */
+typedef enum {
+    CATCH_EXCEPTION = 0x01, /**< Exception taken (by its code) */
+    CATCH_INTERRUPT = 0x02, /**< Interrupt taken (by its number) */
+    CATCH_WRITE = 0x04, /**< Write to a CSR or CP0 register */
+    CATCH_MODE = 0x08 /**< Change of the privilege mode */
+} catch_kind_t;
+
+/** Events caught on each processor (a mask of the kinds) */
+extern unsigned int catch_armed[MAX_CPUS];
+
+extern bool catchpoint_cmd(token_t *parm, unsigned int cpuno,
+        char *const *reg_names, unsigned int reg_count);
+extern void catchpoint_trap(unsigned int cpuno, bool interrupt,
+        unsigned int code);
+extern void catchpoint_write(unsigned int cpuno, unsigned int reg,
+        uint64_t val);
+extern void catchpoint_mode(unsigned int cpuno);
+
+/** Tell whether a processor catches some kind of events
+ *
+ * The events are reported from the cold paths of the processors
+ * (exceptions, register writes of the system instructions), so the
+ * test is the only cost while nothing is caught.
+ *
+ */
+static inline bool catchpoint_armed(unsigned int cpuno, unsigned int kinds)
+{
+    return (catch_armed[cpuno] & kinds) != 0;
+}
+
+#endif
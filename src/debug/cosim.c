@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Lockstep differential checking
+ *
+ *  While the cosim variable is set, each step in which a processor
+ *  executes a block (see the block and jit commands of the processors
+ *  and the fast variable) is checked against the interpreter. The
+ *  processor state is kept before the step and the step is executed
+ *  by the fast engine while the bytes it stores are journaled. Then
+ *  the memory is rolled back, the processor state is restored and the
+ *  same number of instructions is interpreted one by one (with the
+ *  interrupts taken only after the last one, as after a block). The
+ *  architectural state and the memory written by either run have to
+ *  end up the same, the first divergence is reported with the
+ *  disassembly of the interpreted instructions and the simulation
+ *  enters the interactive mode. The state of the interpreter is kept.
+ *
+ *  The memory frames do not allow direct writes while the checking
+ *  is enabled, so that every store reaches the journal. The steps
+ *  accessing a device are not checked, as the accesses cannot be
+ *  repeated without their side effects.
+ *
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../assert.h"
+#include "../device/device.h"
+#include "../fault.h"
+#include "../main.h"
+#include "../physmem.h"
+#include "../utils.h"
+#include "cosim.h"
+#include "trace.h"
+
+/** Growth of the journal and of the instruction records */
+#define COSIM_GRANULARITY 256
+
+/** Journaled byte of the memory */
+typedef struct {
+    frame_t *frame;
+    ptr36_t addr;
+    size_t seq; /**< Order of the write */
+    uint8_t old; /**< Value before the write */
+    uint8_t fast; /**< Value left by the fast run */
+    bool reference; /**< Written by the interpreter */
+} cosim_byte_t;
+
+/** True if the steps are checked */
+bool cosim_enabled = false;
+
+/** True while the stores are journaled */
+bool cosim_journaling = false;
+
+/** True if a device was accessed since the journal started */
+bool cosim_device_accessed = false;
+
+/** Journal of the stored bytes */
+static cosim_byte_t *journal = NULL;
+static size_t journal_count = 0;
+
+/** True once the interpreter runs */
+static bool journal_reference = false;
+
+/** Instructions of the checked step */
+static trace_record_t *records = NULL;
+static size_t record_count = 0;
+
+/** Statistics */
+static uint64_t cosim_checked = 0;
+static uint64_t cosim_instrs = 0;
+static uint64_t cosim_skipped = 0;
+static uint64_t cosim_divergences = 0;
+
+/** Enable or disable the checking
+ *
+ * The memory areas are updated to allow or deny the direct writes.
+ *
+ */
+bool cosim_set(bool enabled)
+{
+    cosim_enabled = enabled;
+
+    device_t *dev = NULL;
+    while (dev_next(&dev, DEVICE_FILTER_MEMORY)) {
+        physmem_area_update((physmem_area_t *) dev->data);
+    }
+
+    return true;
+}
+
+/** Start journaling the stores of the fast run */
+void cosim_begin(void)
+{
+    journal_count = 0;
+    record_count = 0;
+    journal_reference = false;
+    cosim_device_accessed = false;
+    cosim_journaling = true;
+}
+
+/** Stop journaling, the step is not checked */
+void cosim_cancel(void)
+{
+    cosim_journaling = false;
+}
+
+/** Undo the stores of the fast run
+ *
+ * The values left by the fast run are kept to be compared and the
+ * journal continues with the stores of the interpreter. The bytes
+ * are restored without breaking the reservations of the processors,
+ * so the caller has to keep the state of the fast run before.
+ *
+ * @return False if the step is not to be checked because
+ *         of a device access.
+ *
+ */
+bool cosim_rollback(void)
+{
+    cosim_journaling = false;
+
+    if (cosim_device_accessed) {
+        cosim_skipped++;
+        return false;
+    }
+
+    for (size_t i = 0; i < journal_count; i++) {
+        cosim_byte_t *byte = &journal[i];
+        byte->fast = byte->frame->data[byte->addr & FRAME_MASK];
+    }
+
+    for (size_t i = journal_count; i > 0; i--) {
+        cosim_byte_t *byte = &journal[i - 1];
+        physmem_frame_restore8(byte->frame, byte->addr, byte->old);
+    }
+
+    journal_reference = true;
+    cosim_journaling = true;
+    return true;
+}
+
+/** Journal a store of the given size
+ *
+ * Called before the memory frame is written.
+ *
+ */
+void cosim_journal(frame_t *frame, ptr36_t addr, unsigned int size)
+{
+    ASSERT(frame != NULL);
+
+    for (unsigned int i = 0; i < size; i++) {
+        if ((journal_count % COSIM_GRANULARITY) == 0) {
+            journal = (cosim_byte_t *) realloc(journal,
+                    (journal_count + COSIM_GRANULARITY) * sizeof(cosim_byte_t));
+            if (journal == NULL) {
+                die(ERR_MEM, "Not enough memory");
+            }
+        }
+
+        cosim_byte_t *byte = &journal[journal_count];
+
+        byte->frame = frame;
+        byte->addr = addr + i;
+        byte->seq = journal_count;
+        byte->old = frame->data[(addr + i) & FRAME_MASK];
+        byte->fast = byte->old;
+        byte->reference = journal_reference;
+
+        journal_count++;
+    }
+}
+
+/** Record an instruction interpreted by the check */
+void cosim_record(unsigned int cpuno, trace_arch_t arch, uint64_t pc,
+        uint32_t instr)
+{
+    if ((record_count % COSIM_GRANULARITY) == 0) {
+        records = (trace_record_t *) realloc(records,
+                (record_count + COSIM_GRANULARITY) * sizeof(trace_record_t));
+        if (records == NULL) {
+            die(ERR_MEM, "Not enough memory");
+        }
+    }
+
+    trace_record_t *record = &records[record_count++];
+
+    record->kind = TRACE_RECORD_INSTR;
+    record->cpuno = cpuno;
+    record->arch = arch;
+    record->reg = 0;
+    record->instr = instr;
+    record->value = pc;
+}
+
+/** Order of the journaled bytes (by the address, the fast run first) */
+static int cosim_byte_compare(const void *a, const void *b)
+{
+    const cosim_byte_t *ba = (const cosim_byte_t *) a;
+    const cosim_byte_t *bb = (const cosim_byte_t *) b;
+
+    if (ba->addr != bb->addr) {
+        return (ba->addr < bb->addr) ? -1 : 1;
+    }
+
+    if (ba->reference != bb->reference) {
+        return ba->reference ? 1 : -1;
+    }
+
+    return (ba->seq < bb->seq) ? -1 : (ba->seq > bb->seq);
+}
+
+/** Compare the memory written by the fast run and by the interpreter
+ *
+ * A byte written only by the interpreter is expected to keep its
+ * value from before the step.
+ *
+ * @return False if the memory diverges (the divergence is reported).
+ *
+ */
+bool cosim_check_memory(unsigned int cpuno)
+{
+    cosim_journaling = false;
+
+    qsort(journal, journal_count, sizeof(cosim_byte_t), cosim_byte_compare);
+
+    for (size_t i = 0; i < journal_count; i++) {
+        const cosim_byte_t *byte = &journal[i];
+
+        if ((i > 0) && (journal[i - 1].addr == byte->addr)) {
+            continue;
+        }
+
+        uint8_t fast = byte->reference ? byte->old : byte->fast;
+        uint8_t reference = byte->frame->data[byte->addr & FRAME_MASK];
+
+        if (fast != reference) {
+            char name[32];
+            snprintf(name, sizeof(name), "memory at %#011" PRIx64, byte->addr);
+            cosim_diverged(cpuno, name, fast, reference);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/** Report a divergence of the fast run from the interpreter
+ *
+ * @param name Name of the register or of the memory location.
+ *
+ */
+void cosim_diverged(unsigned int cpuno, const char *name, uint64_t fast,
+        uint64_t reference)
+{
+    cosim_divergences++;
+
+    alert("Cosimulation: cpu%u diverges in the step at %#" PRIx64
+            ", %s is %#" PRIx64 " after the fast execution and %#" PRIx64
+            " after the interpretation",
+            cpuno, (record_count > 0) ? records[0].value : 0,
+            name, fast, reference);
+
+    printf("Interpreted instructions of the step:\n");
+
+    for (size_t i = 0; i < record_count; i++) {
+        trace_print_instr(&records[i]);
+    }
+
+    machine_interactive = true;
+}
+
+/** Finish the check of a step */
+void cosim_finish(void)
+{
+    cosim_journaling = false;
+    cosim_checked++;
+    cosim_instrs += record_count;
+}
+
+/** Print the statistics of the checking */
+void cosim_print(void)
+{
+    if ((!cosim_enabled) && (cosim_checked == 0) && (cosim_skipped == 0)) {
+        return;
+    }
+
+    printf("Cosimulation: %" PRIu64 " steps checked (%" PRIu64
+            " instructions), %" PRIu64 " skipped, %" PRIu64
+            " divergences\n",
+            cosim_checked, cosim_instrs, cosim_skipped, cosim_divergences);
+}
+
+/** Drop the journal */
+void cosim_done(void)
+{
+    safe_free(journal);
+    safe_free(records);
+    journal_count = 0;
+    record_count = 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Lockstep differential checking
+ *
+ */
+
+#ifndef COSIM_H_
+#define COSIM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../physmem.h"
+#include "trace.h"
+
+extern bool cosim_enabled;
+extern bool cosim_journaling;
+extern bool cosim_device_accessed;
+
+extern bool cosim_set(bool enabled);
+extern void cosim_begin(void);
+extern void cosim_cancel(void);
+extern bool cosim_rollback(void);
+extern void cosim_journal(frame_t *frame, ptr36_t addr, unsigned int size);
+extern void cosim_record(unsigned int cpuno, trace_arch_t arch, uint64_t pc,
+        uint32_t instr);
+extern bool cosim_check_memory(unsigned int cpuno);
+extern void cosim_diverged(unsigned int cpuno, const char *name,
+        uint64_t fast, uint64_t reference);
+extern void cosim_finish(void);
+extern void cosim_print(void);
+extern void cosim_done(void);
+
+/** Note an access to a device while the memory is journaled
+ *
+ * The steps accessing the devices are not checked, as the accesses
+ * cannot be repeated without their side effects.
+ *
+ */
+static inline void cosim_device_access(void)
+{
+    if (cosim_journaling) {
+        cosim_device_accessed = true;
+    }
+}
+
+#endif
@@ -0,0 +1,481 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Coverage of the guest code
+ *
+ *  Each executed instruction sets its bit in the bitmap of its virtual
+ *  page. The processors record whole runs of instructions at once
+ *  (a decoded block or a chain of them), the last page of each
+ *  processor is kept, so that the bitmap is only looked up when the
+ *  execution moves to another page. A bit is written just once, the
+ *  code executed again only reads the bitmap.
+ *
+ *  The same hooks count the edges between the recorded runs in the
+ *  counters of a fuzzer (see fuzz.c), hashed as by AFL.
+ *
+ *  The coverage is written as the ranges of the executed instructions
+ *  (symbolized by the loaded ELF symbols) or in the drcov format of
+ *  DynamoRIO read by the coverage tools (Lighthouse, bncov, ...).
+ *  The address spaces of the processors are not told apart.
+ *
+ */
+
+#include "coverage.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../assert.h"
+#include "../fault.h"
+#include "../main.h"
+#include "../utils.h"
+#include "symtab.h"
+
+/** Initial number of the page slots (a power of 2) */
+#define COVERAGE_INITIAL_SLOTS 256
+
+/** Largest basic block of the drcov format */
+#define COVERAGE_DRCOV_BLOCK 0xfffc
+
+bool coverage_enabled = false;
+coverage_page_t *coverage_last[MAX_CPUS];
+uint8_t *coverage_edges = NULL;
+size_t coverage_edge_mask = 0;
+uint64_t coverage_prev[MAX_CPUS];
+
+/** Pages of the bitmaps (open addressing hash table)
+ *
+ * The pages are never moved, the processors keep pointers to them.
+ *
+ */
+static coverage_page_t **slots = NULL;
+static size_t slot_count = 0;
+static size_t used_count = 0;
+
+/** Guard of the table (the processors may run in parallel) */
+static pthread_mutex_t coverage_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** File the coverage is written to at the exit (NULL if none) */
+static char *output_path = NULL;
+
+/** Format of the output file */
+static coverage_format_t output_format = COVERAGE_RANGES;
+
+/** Range of the executed instructions */
+typedef struct {
+    uint64_t start;
+    uint64_t end; /**< Address after the last instruction */
+} coverage_range_t;
+
+static size_t coverage_hash(uint64_t vpage)
+{
+    /* Fibonacci hashing */
+    return (size_t) ((vpage * UINT64_C(0x9e3779b97f4a7c15)) >> 32) & (slot_count - 1);
+}
+
+/** Find the slot of a page (or the free slot for it) */
+static coverage_page_t **coverage_slot(uint64_t vpage)
+{
+    size_t i = coverage_hash(vpage);
+
+    while (true) {
+        coverage_page_t **slot = &slots[i];
+
+        if ((*slot == NULL) || ((*slot)->vpage == vpage)) {
+            return slot;
+        }
+
+        i = (i + 1) & (slot_count - 1);
+    }
+}
+
+/** Double the number of the page slots */
+static void coverage_grow(void)
+{
+    coverage_page_t **old = slots;
+    size_t old_count = slot_count;
+
+    slot_count = (old_count == 0) ? COVERAGE_INITIAL_SLOTS : 2 * old_count;
+    slots = (coverage_page_t **) safe_malloc(slot_count * sizeof(coverage_page_t *));
+    memset(slots, 0, slot_count * sizeof(coverage_page_t *));
+
+    for (size_t i = 0; i < old_count; i++) {
+        if (old[i] != NULL) {
+            *coverage_slot(old[i]->vpage) = old[i];
+        }
+    }
+
+    safe_free(old);
+}
+
+/** Find the bitmap of a virtual page
+ *
+ * The bitmap is created when the page is executed for the first time.
+ *
+ * @param vpage Page aligned virtual address.
+ *
+ */
+coverage_page_t *coverage_page(uint64_t vpage)
+{
+    pthread_mutex_lock(&coverage_mutex);
+
+    /* Keep at least a quarter of the slots free */
+    if (4 * (used_count + 1) > 3 * slot_count) {
+        coverage_grow();
+    }
+
+    coverage_page_t **slot = coverage_slot(vpage);
+
+    if (*slot == NULL) {
+        coverage_page_t *page = (coverage_page_t *) safe_malloc(sizeof(coverage_page_t));
+        memset(page, 0, sizeof(coverage_page_t));
+        page->vpage = vpage;
+
+        *slot = page;
+        used_count++;
+    }
+
+    coverage_page_t *page = *slot;
+    pthread_mutex_unlock(&coverage_mutex);
+
+    return page;
+}
+
+/** Set the counters of the edges
+ *
+ * The counters belong to the caller (e.g. the coverage map of
+ * a fuzzer), they are only incremented.
+ *
+ * @param map  Counters (NULL stops counting the edges).
+ * @param size Number of the counters (a power of 2).
+ *
+ */
+void coverage_set_edges(uint8_t *map, size_t size)
+{
+    ASSERT((map == NULL) || ((size > 0) && ((size & (size - 1)) == 0)));
+
+    coverage_edges = map;
+    coverage_edge_mask = (map != NULL) ? size - 1 : 0;
+    coverage_edges_restart();
+}
+
+/** Start the edges of all processors anew
+ *
+ * The first run recorded afterwards has no predecessor, so that
+ * the same execution counts the same edges.
+ *
+ */
+void coverage_edges_restart(void)
+{
+    memset(coverage_prev, 0, sizeof(coverage_prev));
+}
+
+/** Forget the coverage collected so far
+ *
+ * The pages are kept (only cleared), as the processors
+ * may point to them.
+ *
+ */
+void coverage_reset(void)
+{
+    pthread_mutex_lock(&coverage_mutex);
+
+    for (size_t i = 0; i < slot_count; i++) {
+        if (slots[i] != NULL) {
+            memset(slots[i]->bits, 0, sizeof(slots[i]->bits));
+        }
+    }
+
+    pthread_mutex_unlock(&coverage_mutex);
+}
+
+/** Parse the name of a coverage format
+ *
+ * @return True if the name is known.
+ *
+ */
+bool coverage_parse_format(const char *name, coverage_format_t *format)
+{
+    if (strcmp(name, "ranges") == 0) {
+        *format = COVERAGE_RANGES;
+        return true;
+    }
+
+    if (strcmp(name, "drcov") == 0) {
+        *format = COVERAGE_DRCOV;
+        return true;
+    }
+
+    return false;
+}
+
+static int page_compare(const void *a, const void *b)
+{
+    const coverage_page_t *pa = *(const coverage_page_t *const *) a;
+    const coverage_page_t *pb = *(const coverage_page_t *const *) b;
+
+    if (pa->vpage != pb->vpage) {
+        return (pa->vpage < pb->vpage) ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/** Merge the executed instructions into ranges
+ *
+ * The runs of the set bits of the neighbouring pages
+ * are joined.
+ *
+ * @param count        Number of the ranges.
+ * @param instructions Number of the executed instructions.
+ *
+ */
+static coverage_range_t *coverage_ranges(size_t *count, uint64_t *instructions)
+{
+    coverage_page_t **pages = (coverage_page_t **)
+            safe_malloc((used_count + 1) * sizeof(coverage_page_t *));
+    size_t page_count = 0;
+
+    for (size_t i = 0; i < slot_count; i++) {
+        if (slots[i] != NULL) {
+            pages[page_count++] = slots[i];
+        }
+    }
+
+    qsort(pages, page_count, sizeof(coverage_page_t *), page_compare);
+
+    coverage_range_t *ranges = NULL;
+    size_t range_count = 0;
+    size_t range_size = 0;
+
+    *instructions = 0;
+
+    for (size_t i = 0; i < page_count; i++) {
+        for (unsigned int slot = 0; slot < COVERAGE_PAGE_SLOTS; slot++) {
+            if ((pages[i]->bits[slot / 64] & (UINT64_C(1) << (slot % 64))) == 0) {
+                continue;
+            }
+
+            uint64_t addr = pages[i]->vpage + 4 * slot;
+            (*instructions)++;
+
+            if ((range_count > 0) && (ranges[range_count - 1].end == addr)) {
+                ranges[range_count - 1].end = addr + 4;
+                continue;
+            }
+
+            if (range_count == range_size) {
+                range_size = (range_size == 0) ? 64 : 2 * range_size;
+                ranges = (coverage_range_t *) realloc(ranges,
+                        range_size * sizeof(coverage_range_t));
+                if (ranges == NULL) {
+                    die(ERR_MEM, "Not enough memory");
+                }
+            }
+
+            ranges[range_count].start = addr;
+            ranges[range_count].end = addr + 4;
+            range_count++;
+        }
+    }
+
+    safe_free(pages);
+
+    *count = range_count;
+    return ranges;
+}
+
+/** Write the ranges of the executed instructions */
+static void coverage_write_ranges(FILE *file, coverage_range_t *ranges,
+        size_t count, uint64_t instructions)
+{
+    fprintf(file, "Coverage (%" PRIu64 " instructions in %zu ranges)\n",
+            instructions, count);
+    fprintf(file, "  %-18s %-18s %12s  %s\n", "start", "end",
+            "instructions", "location");
+
+    for (size_t i = 0; i < count; i++) {
+        coverage_range_t *range = &ranges[i];
+        const symbol_t *symbol = symtab_find(range->start);
+
+        fprintf(file, "  %#018" PRIx64 " %#018" PRIx64 " %12" PRIu64 "  ",
+                range->start, range->end, (range->end - range->start) / 4);
+
+        if (symbol == NULL) {
+            fprintf(file, "[unknown]\n");
+        } else if (range->start == symbol->addr) {
+            fprintf(file, "%s\n", symbol->name);
+        } else {
+            fprintf(file, "%s+%#" PRIx64 "\n", symbol->name,
+                    range->start - symbol->addr);
+        }
+    }
+}
+
+/** Basic block of the drcov format */
+typedef struct __attribute__((packed)) {
+    uint32_t start; /**< Offset in the module */
+    uint16_t size;
+    uint16_t mod_id;
+} coverage_drcov_block_t;
+
+/** Write the coverage in the drcov format (version 2)
+ *
+ * The drcov offsets are 32-bit, so each 4 GiB region of the address
+ * space holding executed code is a module named guest. The ranges
+ * are split into the basic blocks of at most COVERAGE_DRCOV_BLOCK
+ * bytes.
+ *
+ */
+static void coverage_write_drcov(FILE *file, coverage_range_t *ranges,
+        size_t count)
+{
+    uint64_t *modules = (uint64_t *) safe_malloc((count + 1) * sizeof(uint64_t));
+    size_t module_count = 0;
+    size_t block_count = 0;
+
+    /* The ranges are sorted, so are the modules */
+    for (size_t i = 0; i < count; i++) {
+        for (uint64_t addr = ranges[i].start; addr < ranges[i].end;) {
+            uint64_t base = addr >> 32;
+            uint64_t size = MIN(ranges[i].end - addr, (addr | UINT32_MAX) - addr + 1);
+
+            if ((module_count == 0) || (modules[module_count - 1] != base)) {
+                modules = (uint64_t *) realloc(modules,
+                        (module_count + count + 1) * sizeof(uint64_t));
+                if (modules == NULL) {
+                    die(ERR_MEM, "Not enough memory");
+                }
+
+                modules[module_count++] = base;
+            }
+
+            block_count += (size + COVERAGE_DRCOV_BLOCK - 1) / COVERAGE_DRCOV_BLOCK;
+            addr += size;
+        }
+    }
+
+    fprintf(file, "DRCOV VERSION: 2\n");
+    fprintf(file, "DRCOV FLAVOR: msim\n");
+    fprintf(file, "Module Table: version 2, count %zu\n", module_count);
+    fprintf(file, "Columns: id, base, end, entry, checksum, timestamp, path\n");
+
+    for (size_t i = 0; i < module_count; i++) {
+        uint64_t base = modules[i] << 32;
+
+        fprintf(file, "%zu, %#018" PRIx64 ", %#018" PRIx64
+                ", 0x0000000000000000, 0x00000000, 0x00000000, guest\n",
+                i, base, base + UINT32_MAX);
+    }
+
+    fprintf(file, "BB Table: %zu bbs\n", block_count);
+
+    size_t module = 0;
+    for (size_t i = 0; i < count; i++) {
+        for (uint64_t addr = ranges[i].start; addr < ranges[i].end;) {
+            while (modules[module] != (addr >> 32)) {
+                module++;
+            }
+
+            uint64_t size = MIN(ranges[i].end - addr, (addr | UINT32_MAX) - addr + 1);
+            size = MIN(size, COVERAGE_DRCOV_BLOCK);
+
+            coverage_drcov_block_t block = {
+                .start = (uint32_t) addr,
+                .size = (uint16_t) size,
+                .mod_id = (uint16_t) module
+            };
+
+            fwrite(&block, sizeof(block), 1, file);
+            addr += size;
+        }
+    }
+
+    safe_free(modules);
+}
+
+/** Write the coverage collected so far into a file
+ *
+ * @return True if successful.
+ *
+ */
+bool coverage_write(const char *path, coverage_format_t format)
+{
+    ASSERT(path != NULL);
+
+    FILE *file = try_fopen(path, (format == COVERAGE_DRCOV) ? "wb" : "w");
+    if (file == NULL) {
+        return false;
+    }
+
+    pthread_mutex_lock(&coverage_mutex);
+
+    size_t count;
+    uint64_t instructions;
+    coverage_range_t *ranges = coverage_ranges(&count, &instructions);
+
+    pthread_mutex_unlock(&coverage_mutex);
+
+    switch (format) {
+    case COVERAGE_RANGES:
+        coverage_write_ranges(file, ranges, count, instructions);
+        break;
+    case COVERAGE_DRCOV:
+        coverage_write_drcov(file, ranges, count);
+        break;
+    }
+
+    safe_free(ranges);
+    safe_fclose(file, path);
+
+    return true;
+}
+
+/** Set the file the coverage is written to at the exit
+ *
+ * The drcov format is written if the file name ends
+ * with .drcov, the ranges otherwise.
+ *
+ */
+void coverage_set_output(const char *path)
+{
+    ASSERT(path != NULL);
+
+    size_t len = strlen(path);
+    bool drcov = (len >= 6) && (strcmp(path + len - 6, ".drcov") == 0);
+
+    safe_free(output_path);
+    output_path = safe_strdup(path);
+    output_format = drcov ? COVERAGE_DRCOV : COVERAGE_RANGES;
+}
+
+/** Write the coverage into the output file and release the bitmaps
+ *
+ * Called before the symbols are released.
+ *
+ */
+void coverage_done(void)
+{
+    if (output_path != NULL) {
+        coverage_write(output_path, output_format);
+        safe_free(output_path);
+    }
+
+    for (size_t i = 0; i < slot_count; i++) {
+        safe_free(slots[i]);
+    }
+
+    safe_free(slots);
+    slot_count = 0;
+    used_count = 0;
+    memset(coverage_last, 0, sizeof(coverage_last));
+}
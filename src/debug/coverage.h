@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Coverage of the guest code
+ *
+ */
+
+#ifndef COVERAGE_H_
+#define COVERAGE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../main.h"
+
+/** Virtual page of the coverage bitmaps */
+#define COVERAGE_PAGE_SIZE 4096
+
+/** Instruction slots of a page (4 byte instructions) */
+#define COVERAGE_PAGE_SLOTS (COVERAGE_PAGE_SIZE / 4)
+
+/** Executed instruction slots of a virtual page */
+typedef struct {
+    uint64_t vpage; /**< Virtual address of the page */
+    uint64_t bits[COVERAGE_PAGE_SLOTS / 64]; /**< A bit per instruction slot */
+} coverage_page_t;
+
+/** Formats of the written coverage */
+typedef enum {
+    COVERAGE_RANGES, /**< Address ranges of the executed instructions */
+    COVERAGE_DRCOV /**< DynamoRIO drcov (version 2) basic blocks */
+} coverage_format_t;
+
+/** True if the executed instructions are recorded */
+extern bool coverage_enabled;
+
+/** Page of the last instruction recorded for each processor */
+extern coverage_page_t *coverage_last[MAX_CPUS];
+
+/** Counters of the edges between the recorded runs (NULL if none) */
+extern uint8_t *coverage_edges;
+extern size_t coverage_edge_mask;
+
+/** Location of the last run recorded for each processor */
+extern uint64_t coverage_prev[MAX_CPUS];
+
+extern coverage_page_t *coverage_page(uint64_t vpage);
+extern void coverage_reset(void);
+extern bool coverage_write(const char *path, coverage_format_t format);
+extern bool coverage_parse_format(const char *name, coverage_format_t *format);
+extern void coverage_set_output(const char *path);
+extern void coverage_done(void);
+extern void coverage_set_edges(uint8_t *map, size_t size);
+extern void coverage_edges_restart(void);
+
+/** Count the edge from the last run of a processor to a run
+ *
+ * The edges are hashed into the counters as by AFL, the location
+ * of the previous run is shifted so that the back edges and the
+ * tight loops are told apart.
+ *
+ */
+static inline void coverage_edge(unsigned int cpuno, uint64_t pc)
+{
+    uint64_t loc = (pc * UINT64_C(0x9e3779b97f4a7c15)) >> 40;
+
+    coverage_edges[(loc ^ coverage_prev[cpuno]) & coverage_edge_mask]++;
+    coverage_prev[cpuno] = loc >> 1;
+}
+
+/** Mark the slots of a page as executed
+ *
+ * The words are only written while some of their bits are still
+ * clear, so the code executed before costs just the reads. The
+ * processors running in parallel may share the page.
+ *
+ */
+static inline void coverage_mark(coverage_page_t *page, unsigned int slot,
+        unsigned int count)
+{
+    while (count > 0) {
+        unsigned int bit = slot % 64;
+        unsigned int n = (count < 64 - bit) ? count : 64 - bit;
+        uint64_t mask = ((n == 64) ? UINT64_MAX : ((UINT64_C(1) << n) - 1)) << bit;
+        uint64_t *word = &page->bits[slot / 64];
+
+        if ((*word & mask) != mask) {
+            __atomic_fetch_or(word, mask, __ATOMIC_RELAXED);
+        }
+
+        slot += n;
+        count -= n;
+    }
+}
+
+/** Record executed instructions
+ *
+ * Two tests unless the coverage or the edges are recorded, then
+ * a comparison with the last page of the processor and a read of
+ * the bitmap for the instructions executed before.
+ *
+ * @param count Number of the (4 byte) instructions starting at pc.
+ *
+ */
+static inline void coverage_record(unsigned int cpuno, uint64_t pc,
+        unsigned int count)
+{
+    if (coverage_edges != NULL) {
+        coverage_edge(cpuno, pc);
+    }
+
+    if (!coverage_enabled) {
+        return;
+    }
+
+    while (count > 0) {
+        uint64_t vpage = pc & ~((uint64_t) COVERAGE_PAGE_SIZE - 1);
+        coverage_page_t *page = coverage_last[cpuno];
+
+        if ((page == NULL) || (page->vpage != vpage)) {
+            page = coverage_page(vpage);
+            coverage_last[cpuno] = page;
+        }
+
+        unsigned int slot = (pc & (COVERAGE_PAGE_SIZE - 1)) / 4;
+        unsigned int n = (count < COVERAGE_PAGE_SLOTS - slot)
+                ? count : COVERAGE_PAGE_SLOTS - slot;
+
+        coverage_mark(page, slot, n);
+
+        pc += 4 * n;
+        count -= n;
+    }
+}
+
+#endif
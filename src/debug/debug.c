@@ -31,12 +31,40 @@ void dbg_print_device_info(device_t *dev)
 }
 
 /** Show statistics for specified device
+ *
+ * The register accesses counted while the mixstat variable
+ * is set follow the statistics of the device itself.
  *
  */
 void dbg_print_device_stat(device_t *dev)
 {
+    token_t token_end[] = {
+        { .ttype = tt_end }
+    };
+
     printf("%-10s %-10s ", dev->name, dev->type->name);
-    // FIXME cmd_run_by_name("stat", &pars_end, dev->type->cmds, dev);
+
+    bool mmio = (dev->mmio_read_bytes != 0) || (dev->mmio_write_bytes != 0);
+
+    const cmd_t *cmd = NULL;
+    if (cmd_find("stat", dev->type->cmds, &cmd) == CMP_HIT) {
+        printf("\n");
+        cmd_run_by_spec(cmd, token_end, dev);
+
+        if (mmio) {
+            printf("\n");
+        }
+    } else if (mmio) {
+        printf("\n");
+    } else {
+        printf("no statistics\n");
+    }
+
+    if (mmio) {
+        printf("[MMIO bytes read   ] [MMIO bytes written]\n");
+        printf("%20" PRIu64 " %20" PRIu64 "\n",
+                dev->mmio_read_bytes, dev->mmio_write_bytes);
+    }
 }
 
 void dbg_print_devices(device_filter_t filter)
@@ -62,5 +90,17 @@ void dbg_print_devices(device_filter_t filter)
 
 void dbg_print_devices_stat(device_filter_t filter)
 {
-    // FIXME
+    printf("[  name  ] [  type  ] [ statistics...\n");
+
+    device_t *device = NULL;
+    bool device_found = false;
+
+    while (dev_next(&device, filter)) {
+        device_found = true;
+        dbg_print_device_stat(device);
+    }
+
+    if (!device_found) {
+        printf("No matching devices found.\n");
+    }
 }
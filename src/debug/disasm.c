@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Cache of the disassembled instructions
+ *
+ *  The instructions traced and dumped are mostly the same few
+ *  instructions of the loops executed over and over again. Their
+ *  mnemonics and comments are kept in a direct-mapped table indexed
+ *  by the address, so only the first of the dumps disassembles the
+ *  instruction. The dumps then format their lines in a buffer of
+ *  their own and print them at once.
+ *
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../assert.h"
+#include "../utils.h"
+#include "disasm.h"
+
+static disasm_slot_t disasm_slots[DISASM_SLOTS];
+
+/** Get a disassembled instruction
+ *
+ * The instruction is disassembled unless found in the cache.
+ *
+ * @param arch Architecture of the instruction.
+ * @param addr Address the instruction is disassembled at.
+ * @param word Instruction word.
+ * @param fnc  Disassembler of the architecture.
+ *
+ * @return The slot of the instruction, valid until the next call.
+ *
+ */
+const disasm_slot_t *disasm_get(trace_arch_t arch, uint64_t addr,
+        uint32_t word, disasm_fnc_t fnc)
+{
+    ASSERT(fnc != NULL);
+
+    disasm_slot_t *slot = &disasm_slots[(addr >> 2) & (DISASM_SLOTS - 1)];
+
+    if ((slot->valid) && (slot->arch == arch) && (slot->addr == addr)
+            && (slot->word == word)) {
+        return slot;
+    }
+
+    string_t mnemonics;
+    string_t comments;
+
+    string_init(&mnemonics);
+    string_init(&comments);
+    fnc(addr, word, &mnemonics, &comments);
+
+    safe_free(slot->mnemonics);
+    safe_free(slot->comments);
+
+    slot->valid = true;
+    slot->arch = arch;
+    slot->word = word;
+    slot->addr = addr;
+    slot->mnemonics = mnemonics.str;
+    slot->comments = comments.str;
+
+    return slot;
+}
+
+/** Drop all the disassembled instructions
+ *
+ * Called when the register names change.
+ *
+ */
+void disasm_flush(void)
+{
+    for (size_t i = 0; i < DISASM_SLOTS; i++) {
+        disasm_slot_t *slot = &disasm_slots[i];
+
+        safe_free(slot->mnemonics);
+        safe_free(slot->comments);
+        slot->valid = false;
+    }
+}
+
+/** Append formatted text to a line
+ *
+ * The text not fitting the line is cut off.
+ *
+ */
+void disasm_line_add(disasm_line_t *line, const char *fmt, ...)
+{
+    ASSERT(line != NULL);
+    ASSERT(line->len < DISASM_LINE_SIZE);
+
+    va_list va;
+    va_start(va, fmt);
+    int len = vsnprintf(line->buf + line->len, DISASM_LINE_SIZE - line->len,
+            fmt, va);
+    va_end(va);
+
+    /* The last byte is kept for the new line */
+    if (len > 0) {
+        line->len = MIN(line->len + len, DISASM_LINE_SIZE - 2);
+    }
+}
+
+/** Print a line ended by a new line and make it empty again
+ *
+ */
+void disasm_line_print(disasm_line_t *line)
+{
+    ASSERT(line != NULL);
+
+    line->buf[line->len] = '\n';
+    fwrite(line->buf, 1, line->len + 1, stdout);
+    line->len = 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Cache of the disassembled instructions
+ *
+ */
+
+#ifndef DISASM_H_
+#define DISASM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../utils.h"
+#include "trace.h"
+
+/** Number of the instructions kept disassembled (a power of two) */
+#define DISASM_SLOTS 4096
+
+/** Size of the buffer of a printed line */
+#define DISASM_LINE_SIZE 512
+
+/** Disassembler of an instruction (architecture specific) */
+typedef void (*disasm_fnc_t)(uint64_t addr, uint32_t word,
+        string_t *mnemonics, string_t *comments);
+
+/** Disassembled instruction
+ *
+ * The text depends only on the instruction word, its address
+ * and the register name mode.
+ *
+ */
+typedef struct {
+    bool valid;
+    trace_arch_t arch;
+    uint32_t word;
+    uint64_t addr;
+    char *mnemonics;
+    char *comments;
+} disasm_slot_t;
+
+/** Line of the output formatted before it is printed at once */
+typedef struct {
+    char buf[DISASM_LINE_SIZE];
+    size_t len;
+} disasm_line_t;
+
+extern const disasm_slot_t *disasm_get(trace_arch_t arch, uint64_t addr,
+        uint32_t word, disasm_fnc_t fnc);
+extern void disasm_flush(void);
+
+extern void disasm_line_add(disasm_line_t *line, const char *fmt, ...)
+        __attribute__((format(printf, 2, 3)));
+extern void disasm_line_print(disasm_line_t *line);
+
+#endif
@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Flight recorder
+ *
+ *  While the flight variable is set, each processor keeps the last
+ *  instructions it has executed in a ring. The blocks of instructions
+ *  take a single entry per straight-line run, so the recorder costs
+ *  little enough to stay enabled during whole runs. The rings are
+ *  disassembled (in the order of the machine cycles) when the machine
+ *  is halted by dnomem, when the simulation is broken by the user and
+ *  on demand by the flight command. The first two only request the
+ *  dump, which follows once the instruction (or the block) at fault
+ *  is recorded.
+ *
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../assert.h"
+#include "../fault.h"
+#include "../main.h"
+#include "../physmem.h"
+#include "../utils.h"
+#include "flight.h"
+#include "trace.h"
+
+/** Largest ring */
+#define FLIGHT_SIZE_MAX (UINT32_C(1) << 20)
+
+/** Number of the entries of each ring (0 for no recording) */
+unsigned int flight_size = 0;
+
+/** Rings of the processors */
+flight_ring_t flight_rings[MAX_CPUS];
+
+/** True if the rings are to be dumped (set by the signal handler) */
+volatile bool flight_requested = false;
+
+/** Instruction of the dump */
+typedef struct {
+    uint64_t cycle;
+    uint64_t seq; /**< Order of the instruction on its processor */
+    trace_record_t record;
+} flight_instr_t;
+
+/** Allocate the ring of a processor */
+void flight_ring_init(flight_ring_t *ring)
+{
+    ASSERT(ring != NULL);
+    ASSERT(flight_size > 0);
+
+    ring->entries = (flight_entry_t *) safe_malloc(flight_size * sizeof(flight_entry_t));
+    ring->recorded = 0;
+}
+
+/** Drop the rings of all processors */
+void flight_done(void)
+{
+    for (unsigned int i = 0; i < MAX_CPUS; i++) {
+        safe_free(flight_rings[i].entries);
+        flight_rings[i].recorded = 0;
+    }
+}
+
+/** Change the flight variable
+ *
+ * The size is rounded up to a power of two, the instructions
+ * recorded so far are forgotten.
+ *
+ */
+bool flight_set_size(unsigned int size)
+{
+    if (size > FLIGHT_SIZE_MAX) {
+        error("At most %" PRIu32 " entries per processor", FLIGHT_SIZE_MAX);
+        return false;
+    }
+
+    flight_done();
+
+    unsigned int rounded = (size > 0) ? 1 : 0;
+    while (rounded < size) {
+        rounded <<= 1;
+    }
+
+    flight_size = rounded;
+    return true;
+}
+
+/** Order of the dumped instructions */
+static int flight_instr_compare(const void *a, const void *b)
+{
+    const flight_instr_t *ia = (const flight_instr_t *) a;
+    const flight_instr_t *ib = (const flight_instr_t *) b;
+
+    if (ia->cycle != ib->cycle) {
+        return (ia->cycle < ib->cycle) ? -1 : 1;
+    }
+
+    if (ia->record.cpuno != ib->record.cpuno) {
+        return (ia->record.cpuno < ib->record.cpuno) ? -1 : 1;
+    }
+
+    return (ia->seq < ib->seq) ? -1 : (ia->seq > ib->seq);
+}
+
+/** Count the instructions recorded by a processor */
+static uint64_t flight_ring_instrs(const flight_ring_t *ring)
+{
+    uint64_t first = (ring->recorded > flight_size) ? ring->recorded - flight_size : 0;
+    uint64_t count = 0;
+
+    for (uint64_t i = first; i < ring->recorded; i++) {
+        count += ring->entries[i & (flight_size - 1)].count;
+    }
+
+    return count;
+}
+
+/** Expand the entries of a processor into the dumped instructions
+ *
+ * The instructions of an entry share its cycle (the fast mode runs
+ * whole blocks in a cycle), the cycles never decrease on a processor
+ * (even across a restored checkpoint), so the instructions of each
+ * processor stay in their order when sorted by the cycles.
+ *
+ * @param skip Number of the oldest instructions left out.
+ *
+ */
+static size_t flight_ring_expand(const flight_ring_t *ring, unsigned int cpuno,
+        uint64_t skip, flight_instr_t *instrs)
+{
+    uint64_t first = (ring->recorded > flight_size) ? ring->recorded - flight_size : 0;
+    uint64_t seq = 0;
+    uint64_t cycle = 0;
+    size_t count = 0;
+
+    for (uint64_t i = first; i < ring->recorded; i++) {
+        const flight_entry_t *entry = &ring->entries[i & (flight_size - 1)];
+
+        if (entry->cycle > cycle) {
+            cycle = entry->cycle;
+        }
+
+        for (unsigned int j = 0; j < entry->count; j++, seq++) {
+            if (seq < skip) {
+                continue;
+            }
+
+            flight_instr_t *instr = &instrs[count++];
+
+            instr->cycle = cycle;
+            instr->seq = seq;
+            instr->record.kind = TRACE_RECORD_INSTR;
+            instr->record.cpuno = cpuno;
+            instr->record.arch = entry->arch;
+            instr->record.reg = 0;
+            instr->record.value = entry->pc + j * sizeof(uint32_t);
+            instr->record.instr = (j == 0)
+                    ? entry->instr
+                    : physmem_read32(cpuno, entry->phys + j * sizeof(uint32_t), false);
+        }
+    }
+
+    return count;
+}
+
+/** Disassemble the last recorded instructions
+ *
+ * @param limit Most instructions of each processor (0 for all).
+ *
+ */
+void flight_dump(unsigned int limit)
+{
+    if (flight_size == 0) {
+        return;
+    }
+
+    uint64_t total = 0;
+    uint64_t skip[MAX_CPUS];
+
+    for (unsigned int i = 0; i < MAX_CPUS; i++) {
+        const flight_ring_t *ring = &flight_rings[i];
+        skip[i] = 0;
+
+        if (ring->entries == NULL) {
+            continue;
+        }
+
+        uint64_t count = flight_ring_instrs(ring);
+        if ((limit > 0) && (count > limit)) {
+            skip[i] = count - limit;
+        }
+
+        total += count - skip[i];
+    }
+
+    if (total == 0) {
+        printf("Flight recorder is empty\n");
+        return;
+    }
+
+    flight_instr_t *instrs = (flight_instr_t *) safe_malloc(total * sizeof(flight_instr_t));
+    size_t count = 0;
+
+    for (unsigned int i = 0; i < MAX_CPUS; i++) {
+        if (flight_rings[i].entries != NULL) {
+            count += flight_ring_expand(&flight_rings[i], i, skip[i], instrs + count);
+        }
+    }
+
+    ASSERT(count == total);
+    qsort(instrs, count, sizeof(flight_instr_t), flight_instr_compare);
+
+    printf("Flight recorder (last %zu instructions):\n", count);
+
+    for (size_t i = 0; i < count; i++) {
+        trace_print_instr(&instrs[i].record);
+    }
+
+    safe_free(instrs);
+}
+
+/** Disassemble all recorded instructions if requested */
+void flight_dump_requested(void)
+{
+    if (flight_requested) {
+        flight_requested = false;
+        flight_dump(0);
+    }
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Flight recorder
+ *
+ */
+
+#ifndef FLIGHT_H_
+#define FLIGHT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../main.h"
+#include "../physmem.h"
+#include "trace.h"
+
+/** Entry of the flight recorder
+ *
+ * An entry records a single instruction or a straight-line run
+ * of instructions executed as a block. The instructions of a run
+ * following the first one are read from the memory when the
+ * recorder is dumped (the run ends if its page is written).
+ *
+ */
+typedef struct {
+    uint64_t cycle; /**< Machine cycle of the first instruction */
+    uint64_t pc; /**< Address of the first instruction */
+    ptr36_t phys; /**< Physical address of the first instruction */
+    uint32_t instr; /**< First instruction */
+    uint16_t count; /**< Number of the instructions */
+    uint8_t arch; /**< Processor architecture (trace_arch_t) */
+} flight_entry_t;
+
+/** Ring of the last entries of a processor */
+typedef struct {
+    flight_entry_t *entries;
+    uint64_t recorded; /**< Number of the entries recorded so far */
+} flight_ring_t;
+
+extern unsigned int flight_size;
+extern flight_ring_t flight_rings[MAX_CPUS];
+extern volatile bool flight_requested;
+
+extern bool flight_set_size(unsigned int size);
+extern void flight_ring_init(flight_ring_t *ring);
+extern void flight_dump(unsigned int limit);
+extern void flight_dump_requested(void);
+extern void flight_done(void);
+
+/** Record executed instructions
+ *
+ * Costs a few stores per instruction or per block while the
+ * recorder is enabled, a single test otherwise.
+ *
+ * @param count Number of the instructions starting at pc.
+ *
+ */
+static inline void flight_record(unsigned int cpuno, trace_arch_t arch,
+        uint64_t pc, ptr36_t phys, uint32_t instr, unsigned int count)
+{
+    if ((flight_size == 0) || (count == 0)) {
+        return;
+    }
+
+    flight_ring_t *ring = &flight_rings[cpuno];
+
+    if (ring->entries == NULL) {
+        flight_ring_init(ring);
+    }
+
+    flight_entry_t *entry = &ring->entries[ring->recorded & (flight_size - 1)];
+
+    entry->cycle = steps;
+    entry->pc = pc;
+    entry->phys = phys;
+    entry->instr = instr;
+    entry->count = count;
+    entry->arch = arch;
+
+    ring->recorded++;
+}
+
+#endif
@@ -26,17 +26,17 @@
 #include "../arch/network.h"
 #include "../assert.h"
 #include "../device/cpu/general_cpu.h"
-#include "../device/cpu/mips_r4000/cpu.h"
-#include "../device/cpu/riscv_rv32ima/cpu.h"
-#include "../device/dr4kcpu.h"
-#include "../endian.h"
+#include "../device/device.h"
 #include "../fault.h"
 #include "../main.h"
 #include "../parser.h"
+#include "../physmem.h"
 #include "../text.h"
 #include "../utils.h"
+#include "bpcond.h"
 #include "breakpoint.h"
 #include "gdb.h"
+#include "reverse.h"
 
 #ifdef GDB_DEBUG
 
@@ -52,6 +52,17 @@
 #define MAX_BAD_CHECKSUMS 10
 #define GRANULARITY 1024
 
+/** Maximum size of a packet accepted by the stub */
+#define GDB_PACKET_SIZE 16384
+
+/** Escape character of binary data */
+#define GDB_ESCAPE 0x7d
+
+/** Unmapped R4000 segments described in the memory map */
+#define GDB_KSEG0 UINT32_C(0x80000000)
+#define GDB_KSEG1 UINT32_C(0xa0000000)
+#define GDB_KSEG_SIZE UINT64_C(0x20000000)
+
 #define GDB_NOT_SUPPORTED ""
 #define GDB_REPLY_OK "OK"
 #define GDB_REPLY_WARNING "W00"
@@ -60,26 +71,28 @@
 #define GDB_REPLY_MEMORY_READ_FAIL "E02"
 #define GDB_REPLY_BAD_BREAKPOINT "E04"
 #define GDB_REPLY_REGISTER_WRITE_FAIL "E05"
-
-#define GDB_REGISTER_STATUS 32
-#define GDB_REGISTER_MULTIPLY_LOW 33
-#define GDB_REGISTER_MULTIPLY_HIGH 34
-#define GDB_REGISTER_BAD 35
-#define GDB_REGISTER_CAUSE 36
-#define GDB_REGISTER_PC 37
-
-typedef union {
-    uint8_t uint8[8];
-    uint64_t uint64;
-} __attribute__((packed)) union64_t;
+#define GDB_REPLY_REGISTER_READ_FAIL "E06"
+#define GDB_REPLY_BAD_THREAD "E07"
+#define GDB_REPLY_REVERSE_FAIL "E08"
 
 static int gdb_fd = -1;
+/** Processors are the threads of the debugger (thread id is cpuno + 1) */
 static unsigned int cpuno_global = 0;
 static unsigned int cpuno_step = 0;
 
+/** Data received from gdb and not consumed yet */
+static char gdb_in[GRANULARITY];
+static size_t gdb_in_pos = 0;
+static size_t gdb_in_len = 0;
+
+/** Data to be sent to gdb (a whole packet fits in) */
+static char gdb_out[GDB_PACKET_SIZE + 4];
+static size_t gdb_out_len = 0;
+
 /** Read one character from gdb remote descriptor.
  *
- * The bit 7 is cleared.
+ * The characters are read from the descriptor in blocks, so that
+ * a whole packet is usually received by a single system call.
  *
  * @param c Character read.
  *
@@ -88,19 +101,60 @@ static unsigned int cpuno_step = 0;
  */
 static bool gdb_safe_read(char *c)
 {
-    ssize_t rd = read(gdb_fd, c, 1);
-    if (rd == -1) {
-        io_error("gdb");
-        return false;
+    if (gdb_in_pos == gdb_in_len) {
+        ssize_t rd = read(gdb_fd, gdb_in, sizeof(gdb_in));
+        if (rd == -1) {
+            io_error("gdb");
+            return false;
+        }
+
+        if (rd == 0) {
+            alert("GDB: Connection closed");
+            return false;
+        }
+
+        gdb_in_pos = 0;
+        gdb_in_len = (size_t) rd;
     }
 
-    /* Normalize */
-    *c &= 0x7f;
+    *c = gdb_in[gdb_in_pos];
+    gdb_in_pos++;
 
     return true;
 }
 
+/** Send all buffered characters to gdb remote descriptor.
+ *
+ * @return True if successful.
+ *
+ */
+static bool gdb_flush(void)
+{
+    size_t pos = 0;
+
+    while (pos < gdb_out_len) {
+        ssize_t written = write(gdb_fd, gdb_out + pos, gdb_out_len - pos);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            io_error("gdb");
+            gdb_out_len = 0;
+            return false;
+        }
+
+        pos += (size_t) written;
+    }
+
+    gdb_out_len = 0;
+    return true;
+}
+
 /** Write one character to gdb remote descriptor.
+ *
+ * The character is buffered until gdb_flush() is called
+ * or the buffer is full.
  *
  * @param c Char to be written.
  *
@@ -109,21 +163,25 @@ static bool gdb_safe_read(char *c)
  */
 static bool gdb_safe_write(char c)
 {
-    ssize_t written = write(gdb_fd, &c, 1);
-    if (written == -1) {
-        io_error("gdb");
+    if ((gdb_out_len == sizeof(gdb_out)) && (!gdb_flush())) {
         return false;
     }
 
+    gdb_out[gdb_out_len] = c;
+    gdb_out_len++;
+
     return true;
 }
 
 /** Read request from gdb and test for correctness
+ *
+ * @param length Length of the request (binary requests
+ *               may contain zero characters).
  *
  * @return Allocated request buffer or NULL on failture.
  *
  */
-static char *gdb_get_request(void)
+static char *gdb_get_request(size_t *length)
 {
     string_t req;
     string_init(&req);
@@ -190,7 +248,7 @@ static char *gdb_get_request(void)
         }
 
         /* Checksum error, ask for re-send */
-        if (!gdb_safe_write('-')) {
+        if ((!gdb_safe_write('-')) || (!gdb_flush())) {
             string_done(&req);
             return NULL;
         }
@@ -203,12 +261,13 @@ static char *gdb_get_request(void)
     }
 
     /* Send acknowledgement */
-    if (!gdb_safe_write('+')) {
+    if ((!gdb_safe_write('+')) || (!gdb_flush())) {
         string_done(&req);
         return NULL;
     }
 
     gdb_debug("<- %s\n", req.str);
+    *length = req.pos;
     return req.str;
 }
 
@@ -259,6 +318,10 @@ static bool gdb_send_reply(char *reply)
             return false;
         }
 
+        if (!gdb_flush()) {
+            return false;
+        }
+
         char c;
         if (!gdb_safe_read(&c)) {
             return false;
@@ -278,182 +341,294 @@ static bool gdb_send_reply(char *reply)
     return true;
 }
 
-/** Read length bytes from address of machine memory
+/** Processor selected by the debugger
  *
  */
-static void gdb_read_physmem(ptr36_t addr, len36_t length)
+static general_cpu_t *gdb_cpu(void)
 {
-    string_t str;
-    string_init(&str);
+    return get_cpu(cpuno_global);
+}
 
-    /*
-     * We read the memory byte by byte. This ensures
-     * that we will send the content of memory with correct
-     * endianess.
-     */
-    while (length > 0) {
-        uint8_t value = physmem_read8(-1 /*NULL*/, addr, false);
-        string_printf(&str, "%02" PRIx8, value);
+/** Virtual address of an address sent by the debugger
+ *
+ * The MIPS debugger uses 32-bit addresses, which are
+ * sign-extended to the 64-bit R4000 segments.
+ *
+ */
+static ptr64_t gdb_virt(uint64_t address)
+{
+    ptr64_t virt;
+    virt.ptr = address;
 
-        length--;
-        addr++;
+    if ((cpu_regs(gdb_cpu())->kseg) && (address <= UINT32_MAX)) {
+        virt.ptr = (uint64_t) (int64_t) (int32_t) address;
     }
 
-    gdb_send_reply(str.str);
-    string_done(&str);
+    return virt;
+}
+
+/** Address translation of a debugger memory access
+ *
+ * Each page of the accessed range is translated separately, so that
+ * accesses crossing page boundaries work in mapped segments as well.
+ *
+ * @param virt   Virtual address of the access.
+ * @param length Number of bytes left to access.
+ * @param phys   Translated physical address.
+ * @param chunk  Number of bytes which may be accessed from phys
+ *               (at most up to the end of the page).
+ * @param write  True for write accesses.
+ *
+ * @return True if the address is mapped.
+ *
+ */
+static bool gdb_convert_chunk(ptr64_t virt, len36_t length, ptr36_t *phys,
+        len36_t *chunk, bool write)
+{
+    len36_t room = FRAME_SIZE - (virt.ptr & FRAME_MASK);
+    *chunk = (length < room) ? length : room;
+
+    return cpu_convert_addr(gdb_cpu(), virt, phys, write);
+}
+
+/** Read length bytes from virtual address of machine memory
+ *
+ * The memory is copied frame by frame and hex encoded at once. If only
+ * a part of the range is mapped, the accessible prefix is sent.
+ *
+ */
+static void gdb_read_memory(ptr64_t virt, len36_t length)
+{
+    if (length > GDB_PACKET_SIZE / 2) {
+        length = GDB_PACKET_SIZE / 2;
+    }
+
+    uint8_t *data = safe_malloc(length + 1);
+    len36_t done = 0;
+
+    while (done < length) {
+        ptr36_t phys;
+        len36_t chunk;
+
+        if (!gdb_convert_chunk(virt, length - done, &phys, &chunk, false)) {
+            break;
+        }
+
+        physmem_read_block8(-1 /*NULL*/, phys, data + done, chunk, false);
+
+        virt.ptr += chunk;
+        done += chunk;
+    }
+
+    if ((done == 0) && (length > 0)) {
+        safe_free(data);
+        gdb_send_reply(GDB_REPLY_MEMORY_READ_FAIL);
+        return;
+    }
+
+    char *reply = safe_malloc(2 * done + 1);
+
+    for (len36_t i = 0; i < done; i++) {
+        reply[2 * i] = hexchar[data[i] >> 4];
+        reply[2 * i + 1] = hexchar[data[i] & 0x0f];
+    }
+
+    reply[2 * done] = 0;
+
+    gdb_send_reply(reply);
+    safe_free(reply);
+    safe_free(data);
 }
 
-/** Write length bytes to address in memory from hex string
+/** Write length bytes to virtual address of machine memory
  *
  */
-static void gdb_write_physmem(ptr36_t addr, len36_t length, char *data)
+static void gdb_write_memory(ptr64_t virt, len36_t length, const uint8_t *data)
 {
-    while (length > 0) {
-        /* Read one byte */
-        unsigned int value;
-        int matched = sscanf(data, "%02x", &value);
-        if (matched != 1) {
-            gdb_send_reply(GDB_REPLY_BAD_MEMORY_COMMAND);
+    len36_t done = 0;
+
+    while (done < length) {
+        ptr36_t phys;
+        len36_t chunk;
+
+        if (!gdb_convert_chunk(virt, length - done, &phys, &chunk, true)) {
+            gdb_send_reply(GDB_REPLY_MEMORY_WRITE_FAIL);
             return;
         }
 
-        /* Write it */
-        if (!physmem_write8(-1 /*NULL*/, addr, (uint8_t) value, false)) {
+        if (!physmem_write_block8(-1 /*NULL*/, phys, data + done, chunk, false)) {
             gdb_send_reply(GDB_REPLY_MEMORY_WRITE_FAIL);
             return;
         }
 
-        data += 2;
-        length--;
-        addr++;
+        virt.ptr += chunk;
+        done += chunk;
     }
 
+    reverse_changed();
     gdb_send_reply(GDB_REPLY_OK);
 }
 
-/** Dump one register into given buffer in hex
+/** Value of a hex digit
+ *
+ * @return Value of the digit or -1 if the character is not a hex digit.
  *
  */
-static void gdb_register_dump(string_t *str, uint64_t val)
+static int gdb_hex_digit(char c)
 {
-    /*
-     * Gdb expects even the registers with the endianness
-     * of the remote target.
-     *
-     * The registers are not manipulated as raw memory, so
-     * they are stored in the memory with endianness
-     * defined by the compiler of MSIM. So we first convert
-     * it according to the endianness of the simulated
-     * program and then we send it byte by byte to the
-     * debugger.
-     */
+    if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+    }
+
+    if ((c >= 'a') && (c <= 'f')) {
+        return c - 'a' + 10;
+    }
 
-    union64_t value;
-    value.uint64 = convert_uint64_t_endian(val);
+    if ((c >= 'A') && (c <= 'F')) {
+        return c - 'A' + 10;
+    }
 
-    string_printf(str, "%02x%02x%02x%02x%02x%02x%02x%02x",
-            value.uint8[0], value.uint8[1],
-            value.uint8[2], value.uint8[3],
-            value.uint8[4], value.uint8[5],
-            value.uint8[6], value.uint8[7]);
+    return -1;
 }
 
-/** Dump given count of registers into given buffer in hex
+/** Decode length bytes from hex string
  *
+ * @return True if the string contains length hex encoded bytes.
  *
  */
-static void gdb_registers_dump(string_t *str, reg64_t *regs,
-        unsigned int count)
+static bool gdb_decode_hex(const char *str, uint8_t *data, len36_t length)
 {
-    unsigned int i;
+    for (len36_t i = 0; i < length; i++) {
+        int high = gdb_hex_digit(str[2 * i]);
+        if (high < 0) {
+            return false;
+        }
 
-    for (i = 0; i < count; i++) {
-        gdb_register_dump(str, regs[i].val);
+        int low = gdb_hex_digit(str[2 * i + 1]);
+        if (low < 0) {
+            return false;
+        }
+
+        data[i] = (uint8_t) ((high << 4) | low);
     }
+
+    return true;
 }
 
-/** Write new value of one register from given hex string
+/** Decode length bytes of escaped binary data
  *
- * @param data Buffer containing the hex string. The pointer
- *             is modified to point to the end of written part.
- * @param val  Pointer to value.
+ * Characters which have a special meaning in the protocol are sent
+ * as the escape character followed by the character xored with 0x20.
  *
- * @return True if the hex string was in the correct form.
+ * @return True if the data contain exactly length bytes.
  *
  */
-static bool gdb_register_upload(char **data, uint64_t *val)
+static bool gdb_decode_binary(const char *str, size_t size, uint8_t *data,
+        len36_t length)
 {
-    unsigned int values[8];
+    len36_t count = 0;
 
-    /* Read 4 bytes */
-    int matched = sscanf(*data, "%02x%02x%02x%02x%02x%02x%02x%02x",
-            &values[0], &values[1], &values[2], &values[3],
-            &values[4], &values[5], &values[6], &values[7]);
+    for (size_t pos = 0; pos < size; pos++) {
+        uint8_t c = (uint8_t) str[pos];
 
-    if (matched != 8) {
-        gdb_send_reply(GDB_REPLY_REGISTER_WRITE_FAIL);
-        return false;
+        if (c == GDB_ESCAPE) {
+            pos++;
+            if (pos == size) {
+                return false;
+            }
+
+            c = ((uint8_t) str[pos]) ^ 0x20;
+        }
+
+        if (count == length) {
+            return false;
+        }
+
+        data[count] = c;
+        count++;
     }
 
-    /* Convert it to uint32_t and handle the endianness */
-    union64_t value;
-    value.uint8[0] = values[0];
-    value.uint8[1] = values[1];
-    value.uint8[2] = values[2];
-    value.uint8[3] = values[3];
-    value.uint8[4] = values[4];
-    value.uint8[5] = values[5];
-    value.uint8[6] = values[6];
-    value.uint8[7] = values[7];
+    return (count == length);
+}
 
-    *val = convert_uint64_t_endian(value.uint64);
-    *data += 16;
-    return true;
+/** Dump one register into given buffer in hex
+ *
+ * Gdb expects the registers with the endianness of the target,
+ * which is little-endian for all the simulated processors.
+ *
+ */
+static void gdb_register_dump(string_t *str, uint64_t val, unsigned int width)
+{
+    for (unsigned int i = 0; i < width; i++) {
+        string_printf(str, "%02x", (unsigned int) ((val >> (8 * i)) & 0xff));
+    }
 }
 
-/** Write new value of registers from given hex string
+/** Read new value of one register from given hex string
  *
- * @param data Buffer containing the hex string. The pointer
- *             is modified to point to the end of written part.
- * @param regs  Array of registers to change.
- * @param count Number of registers to change.
+ * @param data  Buffer containing the hex string. The pointer
+ *              is modified to point to the end of the value.
+ * @param val   Pointer to value.
+ * @param width Size of the register in bytes.
  *
  * @return True if the hex string was in the correct form.
  *
  */
-static bool gdb_registers_upload(char **data, reg64_t *regs,
-        unsigned int count)
+static bool gdb_register_upload(char **data, uint64_t *val, unsigned int width)
 {
-    unsigned int i;
+    uint64_t value = 0;
+
+    for (unsigned int i = 0; i < width; i++) {
+        int hi = gdb_hex_digit((*data)[2 * i]);
+        int lo = (hi < 0) ? -1 : gdb_hex_digit((*data)[2 * i + 1]);
 
-    for (i = 0; i < count; i++) {
-        if (!gdb_register_upload(data, &regs[i].val)) {
+        if (lo < 0) {
             return false;
         }
+
+        value |= (uint64_t) ((hi << 4) | lo) << (8 * i);
     }
 
+    *val = value;
+    *data += 2 * width;
     return true;
 }
 
-/** Notify the debugger about an event
+/** Send a stop reply to the debugger
  *
- * Send the event number and current PC to the debugger
- * and make the simulator wait for next command from the debugger.
+ * The reply carries the event number, the thread (processor),
+ * its PC and for watchpoints the kind of the watchpoint and
+ * the data address. The simulator then waits for next command
+ * from the debugger. Only the first event of a machine cycle
+ * is reported (several processors may hit a breakpoint at once).
  *
  * @param event Signal value, which specifies what happened.
+ * @param reason Stop reason pairs (e.g. the watchpoint hit, NULL for none).
  *
  */
-void gdb_handle_event(gdb_event_t event)
+static void gdb_stop(gdb_event_t event, const char *reason)
 {
+    if (remote_gdb_listen) {
+        return;
+    }
+
+    const cpu_regs_t *regs = cpu_regs(gdb_cpu());
+    uint64_t pc = 0;
+
     string_t msg;
     string_init(&msg);
 
-    // TODO: implement for both
-    r4k_cpu_t *cpu = (r4k_cpu_t *) get_cpu(cpuno_global)->data;
-    // TODO: ASSERT that it really us r4k
+    string_printf(&msg, "T%02x", event);
+
+    if (reason != NULL) {
+        string_printf(&msg, "%s", reason);
+    }
 
-    string_printf(&msg, "T%02x%02x:", event, GDB_REGISTER_PC);
-    gdb_register_dump(&msg, cpu->pc.ptr);
+    string_printf(&msg, "thread:%x;", cpuno_global + 1);
+
+    cpu_reg_read(gdb_cpu(), regs->pc, &pc);
+    string_printf(&msg, "%02x:", regs->pc);
+    gdb_register_dump(&msg, pc, regs->width);
     string_push(&msg, ';');
 
     gdb_send_reply(msg.str);
@@ -462,27 +637,89 @@ void gdb_handle_event(gdb_event_t event)
     remote_gdb_listen = true;
 }
 
+/** Notify the debugger about an event
+ *
+ * Send the event number and current PC to the debugger
+ * and make the simulator wait for next command from the debugger.
+ *
+ * @param event Signal value, which specifies what happened.
+ *
+ */
+void gdb_handle_event(gdb_event_t event)
+{
+    gdb_stop(event, NULL);
+}
+
+/** Notify the debugger about a hit code breakpoint
+ *
+ * The processor which hit the breakpoint becomes
+ * the selected thread of the debugger.
+ *
+ * @param cpuno Processor which hit the breakpoint.
+ *
+ */
+void gdb_handle_breakpoint(unsigned int cpuno)
+{
+    if ((!remote_gdb_listen) && (get_cpu(cpuno) != NULL)) {
+        cpuno_global = cpuno;
+    }
+
+    gdb_stop(GDB_EVENT_BREAKPOINT, NULL);
+}
+
+/** Notify the debugger about a hit watchpoint
+ *
+ * The watched data address is reported in the virtual address
+ * space the debugger has set the watchpoint in.
+ *
+ * @param breakpoint Memory breakpoint of the watchpoint.
+ * @param addr       Physical address of the access.
+ *
+ */
+void gdb_handle_watchpoint(physmem_breakpoint_t *breakpoint, ptr36_t addr)
+{
+    const char *watch;
+
+    switch (breakpoint->access_flags) {
+    case ACCESS_FILTER_WRITE:
+        watch = "watch";
+        break;
+    case ACCESS_FILTER_READ:
+        watch = "rwatch";
+        break;
+    default:
+        watch = "awatch";
+        break;
+    }
+
+    uint64_t offset = (addr > breakpoint->addr) ? addr - breakpoint->addr : 0;
+
+    string_t reason;
+    string_init(&reason);
+    string_printf(&reason, "%s:%" PRIx64 ";", watch,
+            breakpoint->debugger_addr + offset);
+
+    gdb_stop(GDB_EVENT_BREAKPOINT, reason.str);
+    string_done(&reason);
+}
+
 /** Read register contents
  *
- * Read register contents and send it in a suitable
- * format for the debugger.
+ * Read register contents of the selected processor and send them
+ * in the layout of its target description.
  *
  */
 static void gdb_read_registers(void)
 {
-    // TODO: implement for both
-    r4k_cpu_t *cpu = (r4k_cpu_t *) get_cpu(cpuno_global)->data;
-    // TODO: ASSERT that it really us r4k
+    const cpu_regs_t *regs = cpu_regs(gdb_cpu());
     string_t str;
     string_init(&str);
 
-    gdb_registers_dump(&str, cpu->regs, 32);
-    gdb_register_dump(&str, cpu->cp0[cp0_Status].val);
-    gdb_register_dump(&str, cpu->loreg.val);
-    gdb_register_dump(&str, cpu->hireg.val);
-    gdb_register_dump(&str, cpu->cp0[cp0_BadVAddr].val);
-    gdb_register_dump(&str, cpu->cp0[cp0_Cause].val);
-    gdb_register_dump(&str, cpu->pc.ptr);
+    for (unsigned int i = 0; i < regs->count; i++) {
+        uint64_t val = 0;
+        cpu_reg_read(gdb_cpu(), i, &val);
+        gdb_register_dump(&str, val, regs->width);
+    }
 
     gdb_send_reply(str.str);
     string_done(&str);
@@ -491,96 +728,142 @@ static void gdb_read_registers(void)
 /** Set new content of registers
  *
  * Set new content of registers according to the hex string
- * from the debugger.
+ * from the debugger. The registers missing at the end of
+ * the string are kept.
  *
  * @param req Debugger request.
  *
  */
 static void gdb_write_registers(char *req)
 {
+    const cpu_regs_t *regs = cpu_regs(gdb_cpu());
     char *query = req + 1;
-    // TODO: implement for both
-    r4k_cpu_t *cpu = (r4k_cpu_t *) get_cpu(cpuno_global)->data;
-    // TODO: ASSERT that it really us r4k
 
-    if (!gdb_registers_upload(&query, cpu->regs, 32)) {
-        return;
-    }
+    for (unsigned int i = 0; (i < regs->count) && (*query != 0); i++) {
+        uint64_t val;
 
-    if (!gdb_register_upload(&query, &cpu->cp0[cp0_Status].val)) {
-        return;
+        if ((!gdb_register_upload(&query, &val, regs->width))
+                || (!cpu_reg_write(gdb_cpu(), i, val))) {
+            gdb_send_reply(GDB_REPLY_REGISTER_WRITE_FAIL);
+            return;
+        }
     }
 
-    if (!gdb_register_upload(&query, &cpu->loreg.val)) {
-        return;
-    }
+    reverse_changed();
+    gdb_send_reply(GDB_REPLY_OK);
+}
 
-    if (!gdb_register_upload(&query, &cpu->hireg.val)) {
-        return;
-    }
+/** Read a single register
+ *
+ * @param req Debugger request (register number).
+ *
+ */
+static void gdb_read_register(char *req)
+{
+    const cpu_regs_t *regs = cpu_regs(gdb_cpu());
+    unsigned int reg;
+    uint64_t val;
 
-    if (!gdb_register_upload(&query, &cpu->cp0[cp0_BadVAddr].val)) {
+    if ((sscanf(req + 1, "%x", &reg) != 1)
+            || (!cpu_reg_read(gdb_cpu(), reg, &val))) {
+        gdb_send_reply(GDB_REPLY_REGISTER_READ_FAIL);
         return;
     }
 
-    if (!gdb_register_upload(&query, &cpu->cp0[cp0_Cause].val)) {
+    string_t str;
+    string_init(&str);
+
+    gdb_register_dump(&str, val, regs->width);
+    gdb_send_reply(str.str);
+
+    string_done(&str);
+}
+
+/** Write a single register
+ *
+ * @param req Debugger request (register number and value).
+ *
+ */
+static void gdb_write_register(char *req)
+{
+    const cpu_regs_t *regs = cpu_regs(gdb_cpu());
+    unsigned int reg;
+    char *data = strchr(req, '=');
+    uint64_t val;
+
+    if ((data == NULL) || (sscanf(req + 1, "%x", &reg) != 1)) {
+        gdb_send_reply(GDB_REPLY_REGISTER_WRITE_FAIL);
         return;
     }
 
-    if (!gdb_register_upload(&query, &cpu->pc.ptr)) {
+    data++;
+
+    if ((!gdb_register_upload(&data, &val, regs->width))
+            || (!cpu_reg_write(gdb_cpu(), reg, val))) {
+        gdb_send_reply(GDB_REPLY_REGISTER_WRITE_FAIL);
         return;
     }
 
+    reverse_changed();
     gdb_send_reply(GDB_REPLY_OK);
 }
 
 /** Read or write memory
+ *
+ * Handles the hex encoded read (m) and write (M) commands
+ * and the binary write (X) command.
  *
  * @param req  Whole debugger request.
- * @param read True to read from the memory.
+ * @param size Length of the request.
  *
  */
-static void gdb_cmd_mem_operation(char *req, bool read)
+static void gdb_cmd_mem_operation(char *req, size_t size)
 {
     char *query = req + 1;
 
     /* Parse the query */
-    unsigned int address = 0;
+    uint64_t address = 0;
     unsigned int length = 0;
-    int matched = sscanf(query, "%x,%d", &address, &length);
+    int matched = sscanf(query, "%" SCNx64 ",%x", &address, &length);
     if (matched != 2) {
         gdb_send_reply(GDB_NOT_SUPPORTED);
         return;
     }
 
-    /* Addresses are physical */
+    ptr64_t virt = gdb_virt(address);
 
-    ptr64_t virt;
-    virt.ptr = address;
-    len64_t len = length;
-    ptr36_t phys;
-
-    if (cpu_convert_addr(get_cpu(cpuno_global), virt, &phys, !read)) {
-        if (!read) {
-            /* Move the pointer to the data to be written */
-            query = strchr(query, ':');
-            if (query == NULL) {
-                gdb_send_reply(GDB_REPLY_BAD_MEMORY_COMMAND);
-                return;
-            }
+    if (req[0] == 'm') {
+        gdb_read_memory(virt, length);
+        return;
+    }
 
-            query++;
-            gdb_write_physmem(phys, len, query);
-        } else {
-            gdb_read_physmem(phys, len);
-        }
+    /* Move the pointer to the data to be written */
+    char *data = memchr(query, ':', size - 1);
+    if (data == NULL) {
+        gdb_send_reply(GDB_REPLY_BAD_MEMORY_COMMAND);
+        return;
+    }
+
+    data++;
+
+    uint8_t *bytes = safe_malloc(length + 1);
+    bool decoded;
+
+    if (req[0] == 'X') {
+        decoded = gdb_decode_binary(data, size - (size_t) (data - req),
+                bytes, length);
     } else {
-        if (!read) {
-            gdb_send_reply(GDB_REPLY_MEMORY_WRITE_FAIL);
-        } else {
-            gdb_send_reply(GDB_REPLY_MEMORY_READ_FAIL);
-        }
+        decoded = (size - (size_t) (data - req) >= 2 * (size_t) length)
+                && gdb_decode_hex(data, bytes, length);
     }
+
+    if (decoded) {
+        gdb_write_memory(virt, length, bytes);
+    } else {
+        gdb_send_reply(GDB_REPLY_BAD_MEMORY_COMMAND);
+    }
+
+    safe_free(bytes);
 }
 
 /** Step or continue command from the debugger
@@ -598,21 +881,202 @@ static void gdb_cmd_step(char *req, bool step)
      * resume.  If not specified, use the current PC.
      * How is this useful?
      */
-    unsigned int address;
-    int matched = sscanf(query, "%x", &address);
+    uint64_t address;
+    int matched = sscanf(query, "%" SCNx64, &address);
     if (matched == 1) {
-        ptr64_t addr;
-        addr.ptr = address;
-        // TODO: implement for both
-        r4k_cpu_t *cpu = (r4k_cpu_t *) get_cpu(cpuno_global)->data;
-        // TODO: ASSERT that it really us r4k
-        r4k_set_pc(cpu, addr);
+        cpu_set_pc(gdb_cpu(), gdb_virt(address));
     }
 
     remote_gdb_step = step;
     remote_gdb_listen = step;
 }
 
+/** Describe a memory area in the memory map
+ *
+ */
+static void gdb_memory_map_region(string_t *map, physmem_area_t *area,
+        uint32_t base)
+{
+    ptr36_t start = FRAME2ADDR(area->start);
+    ptr36_t end = FRAME2ADDR(area->start + area->count);
+
+    if (start >= GDB_KSEG_SIZE) {
+        return;
+    }
+
+    if (end > GDB_KSEG_SIZE) {
+        end = GDB_KSEG_SIZE;
+    }
+
+    string_printf(map, "<memory type=\"%s\" start=\"0x%" PRIx64
+            "\" length=\"0x%" PRIx64 "\"/>",
+            area->writable ? "ram" : "rom",
+            (uint64_t) (base + start), (uint64_t) (end - start));
+}
+
+/** Build the memory map of the machine
+ *
+ * The debugger uses 32-bit R4000 addresses. The memory areas are
+ * described at their kseg0 and kseg1 aliases, the mapped segments
+ * (kuseg, kseg2 and kseg3) are described as RAM, since their
+ * contents depend on the TLB.
+ *
+ */
+static void gdb_memory_map(string_t *map)
+{
+    string_append(map, "<?xml version=\"1.0\"?>"
+            "<!DOCTYPE memory-map PUBLIC \"+//IDN gnu.org//DTD GDB Memory Map V1.0//EN\""
+            " \"http://sourceware.org/gdb/gdb-memory-map.dtd\">"
+            "<memory-map>"
+            "<memory type=\"ram\" start=\"0x0\" length=\"0x80000000\"/>");
+
+    uint32_t bases[] = { GDB_KSEG0, GDB_KSEG1 };
+
+    for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); i++) {
+        device_t *dev = NULL;
+
+        while (dev_next(&dev, DEVICE_FILTER_MEMORY)) {
+            physmem_area_t *area = (physmem_area_t *) dev->data;
+
+            if ((area->type != MEMT_NONE) && (area->count > 0)) {
+                gdb_memory_map_region(map, area, bases[i]);
+            }
+        }
+    }
+
+    string_append(map, "<memory type=\"ram\" start=\"0xc0000000\" length=\"0x40000000\"/>"
+            "</memory-map>");
+}
+
+/** Build the target description of the selected processor
+ *
+ * Describes the registers in the order of the register packets.
+ *
+ */
+static void gdb_target_description(string_t *xml)
+{
+    const cpu_regs_t *regs = cpu_regs(gdb_cpu());
+
+    string_printf(xml, "<?xml version=\"1.0\"?>"
+            "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+            "<target version=\"1.0\">"
+            "<architecture>%s</architecture>"
+            "<feature name=\"%s\">", regs->arch, regs->feature);
+
+    for (unsigned int i = 0; i < regs->count; i++) {
+        const char *type = "int";
+
+        if (i == regs->pc) {
+            type = "code_ptr";
+        } else if (strcmp(regs->names[i], "sp") == 0) {
+            type = "data_ptr";
+        }
+
+        string_printf(xml, "<reg name=\"%s\" bitsize=\"%u\" type=\"%s\"/>",
+                regs->names[i], 8 * regs->width, type);
+    }
+
+    string_append(xml, "</feature></target>");
+}
+
+/** Send a part of an XML document
+ *
+ * @param doc   Whole document.
+ * @param query Offset and length of the requested part.
+ *
+ */
+static void gdb_xfer(string_t *doc, char *query)
+{
+    unsigned int offset;
+    unsigned int length;
+    int matched = sscanf(query, "%x,%x", &offset, &length);
+    if (matched != 2) {
+        gdb_send_reply(GDB_REPLY_BAD_MEMORY_COMMAND);
+        return;
+    }
+
+    if (offset > doc->pos) {
+        offset = doc->pos;
+    }
+
+    size_t left = doc->pos - offset;
+    if (length > GDB_PACKET_SIZE - 1) {
+        length = GDB_PACKET_SIZE - 1;
+    }
+
+    string_t reply;
+    string_init(&reply);
+
+    /* The documents contain no characters which would need escaping */
+    if (left > length) {
+        string_push(&reply, 'm');
+        left = length;
+    } else {
+        string_push(&reply, 'l');
+    }
+
+    for (size_t i = 0; i < left; i++) {
+        string_push(&reply, doc->str[offset + i]);
+    }
+
+    gdb_send_reply(reply.str);
+    string_done(&reply);
+}
+
+/** Send a part of the memory map
+ *
+ * @param query Offset and length of the requested part.
+ *
+ */
+static void gdb_xfer_memory_map(char *query)
+{
+    string_t map;
+    string_init(&map);
+
+    gdb_memory_map(&map);
+    gdb_xfer(&map, query);
+
+    string_done(&map);
+}
+
+/** Send a part of the target description
+ *
+ * @param query Offset and length of the requested part.
+ *
+ */
+static void gdb_xfer_features(char *query)
+{
+    string_t xml;
+    string_init(&xml);
+
+    gdb_target_description(&xml);
+    gdb_xfer(&xml, query);
+
+    string_done(&xml);
+}
+
+/** Send the list of the threads (processors)
+ *
+ */
+static void gdb_thread_info(void)
+{
+    string_t reply;
+    string_init(&reply);
+
+    string_push(&reply, 'm');
+
+    for (unsigned int i = 0; i < get_cpu_count(); i++) {
+        if (i > 0) {
+            string_push(&reply, ',');
+        }
+
+        string_printf(&reply, "%x", get_cpu_by_index(i)->cpuno + 1);
+    }
+
+    gdb_send_reply(reply.str);
+    string_done(&reply);
+}
+
 /** Process debugger query
  *
  */
@@ -620,23 +1084,53 @@ static void gdb_process_query(char *req)
 {
     char *query = req + 1;
 
+    const cpu_regs_t *regs = cpu_regs(gdb_cpu());
+
     if (strncmp(query, "Supported", 9) == 0) {
-        /* No extensions are supported */
-        gdb_send_reply(GDB_NOT_SUPPORTED);
+        char reply[160];
+
+        /* The memory map describes the R4000 segments */
+        snprintf(reply, sizeof(reply),
+                "PacketSize=%x;ConditionalBreakpoints+%s%s%s", GDB_PACKET_SIZE,
+                regs->kseg ? ";qXfer:memory-map:read+" : "",
+                (regs->arch != NULL) ? ";qXfer:features:read+" : "",
+                (reverse_interval > 0) ? ";ReverseStep+;ReverseContinue+" : "");
+        gdb_send_reply(reply);
+        return;
+    }
+
+    if ((regs->kseg) && (strncmp(query, "Xfer:memory-map:read::", 22) == 0)) {
+        gdb_xfer_memory_map(query + 22);
+        return;
+    }
+
+    if ((regs->arch != NULL)
+            && (strncmp(query, "Xfer:features:read:target.xml:", 30) == 0)) {
+        gdb_xfer_features(query + 30);
         return;
     }
 
     if (strcmp(query, "C") == 0) {
-        char reply[5];
+        char reply[16];
 
         ASSERT(cpuno_global < MAX_CPUS);
 
         /* Represent processors as threads */
-        snprintf(reply, 5, "QC%02x", cpuno_global);
+        snprintf(reply, sizeof(reply), "QC%x", cpuno_global + 1);
         gdb_send_reply(reply);
         return;
     }
 
+    if (strcmp(query, "fThreadInfo") == 0) {
+        gdb_thread_info();
+        return;
+    }
+
+    if (strcmp(query, "sThreadInfo") == 0) {
+        gdb_send_reply("l");
+        return;
+    }
+
     if (strcmp(query, "Attached") == 0) {
         /*
          * We pretend that we have attached to aprocess,
@@ -668,17 +1162,31 @@ static void gdb_process_query(char *req)
     gdb_send_reply(GDB_NOT_SUPPORTED);
 }
 
-static unsigned int gdb_decode_threadid(char *threadid)
+/** Decode a thread id of the debugger
+ *
+ * @param threadid Thread id (hex).
+ * @param cpuno    Processor of the thread (unchanged for any thread).
+ *
+ * @return False if there is no such thread.
+ *
+ */
+static bool gdb_decode_threadid(char *threadid, unsigned int *cpuno)
 {
+    /* Any or all threads keep the current selection */
     if ((strcmp(threadid, "-1") == 0)
             || (strcmp(threadid, "0") == 0)) {
-        gdb_send_reply(GDB_REPLY_OK);
-        return 0;
+        return true;
     }
 
-    // TODO: decode specific threadids
-    gdb_send_reply(GDB_NOT_SUPPORTED);
-    return 0;
+    unsigned int tid;
+
+    if ((sscanf(threadid, "%x", &tid) != 1) || (tid == 0)
+            || (get_cpu(tid - 1) == NULL)) {
+        return false;
+    }
+
+    *cpuno = tid - 1;
+    return true;
 }
 
 /** Process debugger thread selection
@@ -687,18 +1195,36 @@ static unsigned int gdb_decode_threadid(char *threadid)
 static void gdb_process_thread(char *req)
 {
     char *query = req + 1;
+    unsigned int *cpuno;
 
     switch (query[0]) {
     case 'g':
-        cpuno_global = gdb_decode_threadid(query + 1);
+        cpuno = &cpuno_global;
         break;
     case 'c':
-        cpuno_step = gdb_decode_threadid(query + 1);
+        cpuno = &cpuno_step;
         break;
     default:
         /* Unsupported kind */
         gdb_send_reply(GDB_NOT_SUPPORTED);
+        return;
     }
+
+    gdb_send_reply(gdb_decode_threadid(query + 1, cpuno)
+                    ? GDB_REPLY_OK
+                    : GDB_REPLY_BAD_THREAD);
+}
+
+/** Tell whether a thread is alive
+ *
+ */
+static void gdb_thread_alive(char *req)
+{
+    unsigned int cpuno = cpuno_global;
+
+    gdb_send_reply(gdb_decode_threadid(req + 1, &cpuno)
+                    ? GDB_REPLY_OK
+                    : GDB_REPLY_BAD_THREAD);
 }
 
 static void gdb_reply_event(gdb_event_t event)
@@ -712,45 +1238,167 @@ static void gdb_reply_event(gdb_event_t event)
     string_done(&reply);
 }
 
-/** Activate code breakpoint
+/** Run backwards
+ *
+ * Handles the reverse step (bs), which goes back by one machine
+ * cycle, and the reverse continue (bc), which goes back to the last
+ * breakpoint or watchpoint hit. The stop is reported as by the
+ * forward simulation, the oldest snapshot reached is reported
+ * as the beginning of the replay log.
+ *
+ * @param req Debugger request.
  *
  */
-static void gdb_insert_code_breakpoint(r4k_cpu_t *cpu, ptr64_t addr)
+static void gdb_cmd_reverse(char *req)
 {
-    /*
-     * Breakpoint insertion should be done in an idempotent way,
-     * so if the breakpoint to given address is already inserted,
-     * we will not insert a new breakpoint and we will not consider
-     * this as faulty behavior.
-     */
-    breakpoint_t *breakpoint = breakpoint_find_by_address(cpu->bps,
-            addr, BREAKPOINT_FILTER_DEBUGGER);
+    bool step = (strcmp(req, "bs") == 0);
+    reverse_hit_t hit;
+    bool begin;
 
-    if (breakpoint != NULL) {
+    if ((!step) && (strcmp(req, "bc") != 0)) {
+        gdb_send_reply(GDB_NOT_SUPPORTED);
         return;
     }
 
-    /* Breakpoint not found, thus insert it now. */
-    breakpoint_t *inserted_breakpoint = breakpoint_init(addr, BREAKPOINT_KIND_DEBUGGER);
+    if (!(step ? reverse_back(1, &begin) : reverse_continue(&hit, &begin))) {
+        gdb_send_reply(GDB_REPLY_REVERSE_FAIL);
+        return;
+    }
 
-    list_append(&cpu->bps, &inserted_breakpoint->item);
+    /* Report the stop as a new one */
+    remote_gdb_listen = false;
+
+    if (begin) {
+        gdb_stop(GDB_EVENT_BREAKPOINT, "replaylog:begin;");
+    } else if (step) {
+        gdb_handle_event(GDB_EVENT_BREAKPOINT);
+    } else if (hit.watch != NULL) {
+        gdb_handle_watchpoint(hit.watch, hit.addr);
+    } else {
+        gdb_handle_breakpoint(hit.cpuno);
+    }
 }
 
-/** Deactivate code breakpoint
+/** Insert or remove a watchpoint
+ *
+ * The watched area is translated page by page, every page
+ * gets its own memory breakpoint, so the accesses are checked
+ * only in the frames the area lies in.
+ *
+ * @param address Address of the watched area sent by the debugger.
+ * @param length  Size of the watched area.
+ * @param access  Accesses which hit the watchpoint.
+ * @param insert  True if the watchpoint should be inserted.
+ *
+ * @return False if the area is not mapped.
  *
  */
-static void gdb_remove_code_breakpoint(r4k_cpu_t *cpu, ptr64_t addr)
+static bool gdb_watchpoint(uint64_t address, len36_t length,
+        access_filter_t access, bool insert)
 {
-    breakpoint_t *breakpoint = breakpoint_find_by_address(cpu->bps,
-            addr, BREAKPOINT_FILTER_DEBUGGER);
+    ptr64_t virt = gdb_virt(address);
+    ptr36_t phys[2];
+    len36_t chunks[2];
+    uint64_t addrs[2];
+    unsigned int count = 0;
+    len36_t done = 0;
+
+    if ((length == 0) || (length > FRAME_SIZE)) {
+        return false;
+    }
 
-    /* Removing non existent breakpoint is not considered as a bug */
-    if (breakpoint == NULL) {
-        return;
+    /* Translate the whole area first, so a failure changes nothing */
+    while (done < length) {
+        addrs[count] = address + done;
+
+        if (!gdb_convert_chunk(virt, length - done, &phys[count],
+                    &chunks[count], false)) {
+            return false;
+        }
+
+        virt.ptr += chunks[count];
+        done += chunks[count];
+        count++;
+    }
+
+    /*
+     * Both the insertion and the removal are idempotent
+     * as with the code breakpoints.
+     */
+    for (unsigned int i = 0; i < count; i++) {
+        physmem_breakpoint_remove_kind(phys[i], chunks[i],
+                BREAKPOINT_KIND_DEBUGGER, access);
+
+        if (insert) {
+            physmem_breakpoint_t *breakpoint = physmem_breakpoint_add(phys[i],
+                    chunks[i], BREAKPOINT_KIND_DEBUGGER, access);
+            breakpoint->debugger_addr = addrs[i];
+        }
+    }
+
+    return true;
+}
+
+/** Decode the conditions of a code breakpoint
+ *
+ * The conditions follow the address and the kind of the breakpoint
+ * as ";X len,bytecode" in the hex encoded bytecode of the agent
+ * expressions. Other parameters (the commands of the breakpoint)
+ * are ignored, they are not offered by the simulator.
+ *
+ * @param params Parameters of the breakpoint (NULL for none).
+ * @param cond   Decoded conditions (NULL for an unconditional breakpoint).
+ *
+ * @return False if any condition is not supported.
+ *
+ */
+static bool gdb_breakpoint_conditions(const char *params, bpcond_t **cond)
+{
+    *cond = NULL;
+    bpcond_t **tail = cond;
+
+    while ((params != NULL) && (*params == ';')) {
+        params++;
+
+        if (*params == 'X') {
+            unsigned int size;
+            int used;
+
+            if (sscanf(params + 1, "%x,%n", &size, &used) != 1) {
+                break;
+            }
+
+            const char *hex = params + 1 + used;
+            uint8_t *code = safe_malloc(size + 1);
+
+            bpcond_t *alternative = NULL;
+
+            if ((strlen(hex) >= 2 * (size_t) size)
+                    && (gdb_decode_hex(hex, code, size))) {
+                alternative = bpcond_bytecode(code, size);
+            }
+
+            safe_free(code);
+
+            if (alternative == NULL) {
+                break;
+            }
+
+            *tail = alternative;
+            tail = &alternative->next;
+            params = hex + 2 * size;
+        } else {
+            params = strchr(params, ';');
+        }
     }
 
-    list_remove(&cpu->bps, &breakpoint->item);
-    safe_free(breakpoint);
+    if ((params != NULL) && (*params != 0)) {
+        bpcond_free(*cond);
+        *cond = NULL;
+        return false;
+    }
+
+    return true;
 }
 
 /** Handle code or memory breakpoint commands from the debugger
@@ -792,21 +1440,16 @@ static void gdb_breakpoint(char *req, bool insert)
 
     /* Decode the breakpoint address and length */
     char *arguments = req + 2;
-    unsigned int address;
+    uint64_t address;
     unsigned int length;
-    int matched = sscanf(arguments, ",%x,%x", &address, &length);
+    int matched = sscanf(arguments, ",%" SCNx64 ",%x", &address, &length);
 
     if (matched != 2) {
         gdb_send_reply(GDB_REPLY_BAD_BREAKPOINT);
         return;
     }
 
-    ptr64_t virt;
-    // Extend the address as the GDB sends the address in 32bits.
-    virt.ptr = UINT64_C(0xffffffff00000000) | address;
-    // TODO: implement for both
-    r4k_cpu_t *cpu = (r4k_cpu_t *) get_cpu(cpuno_global)->data;
-    // TODO: ASSERT that it really us r4k
+    ptr64_t virt = gdb_virt(address);
 
     if (code_breakpoint) {
         if (length != 4) {
@@ -814,25 +1457,36 @@ static void gdb_breakpoint(char *req, bool insert)
             return;
         }
 
+        /*
+         * Both the insertion and the removal are idempotent,
+         * removing a non existent breakpoint is not considered
+         * as a bug. The debugger inserts the breakpoint again
+         * when its conditions change.
+         */
         if (insert) {
-            gdb_insert_code_breakpoint(cpu, virt);
-        } else {
-            gdb_remove_code_breakpoint(cpu, virt);
-        }
-    } else {
-        ptr36_t phys;
+            bpcond_t *cond;
+
+            if (!gdb_breakpoint_conditions(strchr(arguments, ';'), &cond)) {
+                gdb_send_reply(GDB_REPLY_BAD_BREAKPOINT);
+                return;
+            }
+
+            cpu_insert_breakpoint(gdb_cpu(), virt, BREAKPOINT_KIND_DEBUGGER);
+
+            breakpoint_t *breakpoint = breakpoint_code_find(gdb_cpu()->cpuno,
+                    virt, BREAKPOINT_FILTER_DEBUGGER);
 
-        if (cpu_convert_addr(get_cpu(cpuno_global), virt, &phys, false)) {
-            if (insert) {
-                physmem_breakpoint_add(phys, length,
-                        BREAKPOINT_KIND_DEBUGGER, memory_access);
+            if (breakpoint != NULL) {
+                breakpoint_code_condition(breakpoint, cond);
             } else {
-                physmem_breakpoint_remove(phys);
+                bpcond_free(cond);
             }
         } else {
-            gdb_send_reply(GDB_REPLY_BAD_BREAKPOINT);
-            return;
+            cpu_remove_breakpoint(gdb_cpu(), virt, BREAKPOINT_KIND_DEBUGGER);
         }
+    } else if (!gdb_watchpoint(address, length, memory_access, insert)) {
+        gdb_send_reply(GDB_REPLY_BAD_BREAKPOINT);
+        return;
     }
 
     gdb_send_reply(GDB_REPLY_OK);
@@ -843,10 +1497,6 @@ static void gdb_breakpoint(char *req, bool insert)
  */
 static void gdb_remote_done(bool fail, bool remote_request)
 {
-    // TODO: implement for both
-    r4k_cpu_t *cpu = (r4k_cpu_t *) get_cpu(cpuno_global)->data;
-    // TODO: ASSERT that it really us r4k
-
     if (!fail) {
         gdb_send_reply(remote_request ? GDB_REPLY_OK : GDB_REPLY_WARNING);
     }
@@ -856,6 +1506,9 @@ static void gdb_remote_done(bool fail, bool remote_request)
     }
 
     gdb_fd = -1;
+    gdb_in_pos = 0;
+    gdb_in_len = 0;
+    gdb_out_len = 0;
     cpuno_global = 0;
     cpuno_step = 0;
 
@@ -863,13 +1516,8 @@ static void gdb_remote_done(bool fail, bool remote_request)
     remote_gdb_conn = false;
 
     /* Remove all the debugger breakpoints. */
-    breakpoint_t *breakpoint = (breakpoint_t *) cpu->bps.head;
-    while (breakpoint != NULL) {
-        breakpoint_t *removed = breakpoint;
-        breakpoint = (breakpoint_t *) breakpoint->item.next;
-
-        list_remove(&cpu->bps, &removed->item);
-        safe_free(removed);
+    for (unsigned int cpuno = 0; cpuno < MAX_CPUS; cpuno++) {
+        breakpoint_code_remove_filtered(cpuno, BREAKPOINT_FILTER_DEBUGGER);
     }
 
     physmem_breakpoint_remove_filtered(BREAKPOINT_FILTER_DEBUGGER);
@@ -892,7 +1540,8 @@ void gdb_session(void)
 
     while (true) {
         /* Read the command. */
-        char *req = gdb_get_request();
+        size_t size;
+        char *req = gdb_get_request(&size);
         if (req == NULL) {
             gdb_remote_done(true, false);
             return;
@@ -911,11 +1560,19 @@ void gdb_session(void)
         case 'G': /* Write registers */
             gdb_write_registers(req);
             break;
-        case 'm': /* Memory read */
-            gdb_cmd_mem_operation(req, true);
+        case 'p': /* Read register */
+            gdb_read_register(req);
             break;
+        case 'P': /* Write register */
+            gdb_write_register(req);
+            break;
+        case 'T': /* Thread alive */
+            gdb_thread_alive(req);
+            break;
+        case 'm': /* Memory read */
         case 'M': /* Memory write */
-            gdb_cmd_mem_operation(req, false);
+        case 'X': /* Binary memory write */
+            gdb_cmd_mem_operation(req, size);
             break;
         case 'c': /* Continue */
             gdb_cmd_step(req, false);
@@ -923,6 +1580,9 @@ void gdb_session(void)
         case 's': /* Step */
             gdb_cmd_step(req, true);
             return;
+        case 'b': /* Reverse step or continue */
+            gdb_cmd_reverse(req);
+            break;
         case 'D': /* Detach */
             alert("GDB: Detached");
             gdb_remote_done(false, true);
@@ -999,6 +1659,14 @@ bool gdb_remote_init(void)
         return false;
     }
 
+    /*
+     * Every packet is acknowledged before the next one is sent,
+     * do not let the packets wait for more data.
+     */
+    if (setsockopt(gdb_fd, IPPROTO_TCP, TCP_NODELAY, (void *) &yes, sizeof(yes))) {
+        io_error("setsockopt");
+    }
+
     alert("GDB: Connected");
 
     return true;
@@ -16,6 +16,7 @@
 #include <stdbool.h>
 
 #include "../list.h"
+#include "breakpoint.h"
 
 /** gdb signal numbers */
 typedef enum {
@@ -34,5 +35,8 @@ typedef enum {
 extern bool gdb_remote_init(void);
 extern void gdb_session(void);
 extern void gdb_handle_event(gdb_event_t event);
+extern void gdb_handle_breakpoint(unsigned int cpuno);
+extern void gdb_handle_watchpoint(physmem_breakpoint_t *breakpoint,
+        ptr36_t addr);
 
 #endif
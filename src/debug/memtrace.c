@@ -0,0 +1,507 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Binary memory access trace
+ *
+ *  The memory access trace writes a fixed-size record of every load,
+ *  store and instruction fetch of the processors to a file, for the
+ *  studies the cache model does not cover. Each processor fills its
+ *  own block of records and hands the full block over to a writer
+ *  thread, so the simulation only waits for the file when the writer
+ *  falls behind by all the blocks. The records of a processor keep
+ *  their order, the blocks of the processors are interleaved (the
+ *  records are stamped by the machine cycles to be merged offline).
+ *
+ */
+
+#include "memtrace.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../assert.h"
+#include "../endian.h"
+#include "../fault.h"
+#include "../main.h"
+#include "../utils.h"
+
+/** Number of the blocks the writer can fall behind by */
+#define MEMTRACE_BLOCKS_MAX 64
+
+bool memtrace_active = false;
+ptr36_t memtrace_from = 0;
+ptr36_t memtrace_to = UINT64_MAX;
+memtrace_cpu_t memtrace_cpus[MAX_CPUS];
+
+/** Processors traced (all of them without a processor filter) */
+static bool memtrace_all_cpus = true;
+
+static FILE *memtrace_file = NULL;
+static char *memtrace_path = NULL;
+static pthread_t memtrace_writer;
+
+/** Queue of the full blocks, the free blocks and their guard */
+static pthread_mutex_t memtrace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t memtrace_full_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t memtrace_free_cond = PTHREAD_COND_INITIALIZER;
+static memtrace_block_t *memtrace_full_head = NULL;
+static memtrace_block_t *memtrace_full_tail = NULL;
+static memtrace_block_t *memtrace_free = NULL;
+static unsigned int memtrace_blocks = 0;
+static bool memtrace_stopping = false;
+static bool memtrace_failed = false;
+
+static void put_uint32(uint8_t *dst, uint32_t val)
+{
+    val = convert_uint32_t_endian(val);
+    memcpy(dst, &val, sizeof(val));
+}
+
+static uint32_t get_uint32(const uint8_t *src)
+{
+    uint32_t val;
+    memcpy(&val, src, sizeof(val));
+    return convert_uint32_t_endian(val);
+}
+
+static uint64_t get_uint64(const uint8_t *src)
+{
+    uint64_t val;
+    memcpy(&val, src, sizeof(val));
+    return convert_uint64_t_endian(val);
+}
+
+/** Write the full blocks to the file until the trace is closed */
+static void *memtrace_write_blocks(void *arg)
+{
+    pthread_mutex_lock(&memtrace_mutex);
+
+    while (true) {
+        while ((memtrace_full_head == NULL) && (!memtrace_stopping)) {
+            pthread_cond_wait(&memtrace_full_cond, &memtrace_mutex);
+        }
+
+        memtrace_block_t *block = memtrace_full_head;
+
+        if (block == NULL) {
+            break;
+        }
+
+        memtrace_full_head = block->next;
+        if (memtrace_full_head == NULL) {
+            memtrace_full_tail = NULL;
+        }
+
+        pthread_mutex_unlock(&memtrace_mutex);
+
+        bool written = (memtrace_failed)
+                || (fwrite(block->data, block->len, 1, memtrace_file) == 1);
+
+        pthread_mutex_lock(&memtrace_mutex);
+
+        memtrace_failed = !written;
+        block->next = memtrace_free;
+        memtrace_free = block;
+        pthread_cond_signal(&memtrace_free_cond);
+    }
+
+    pthread_mutex_unlock(&memtrace_mutex);
+    return NULL;
+}
+
+/** Queue the block of a processor for the writer (with the lock held)
+ *
+ * An empty block goes back to the free blocks.
+ *
+ */
+static void memtrace_queue(memtrace_cpu_t *cpu)
+{
+    memtrace_block_t *block = cpu->block;
+
+    if (block == NULL) {
+        return;
+    }
+
+    if (cpu->len == 0) {
+        block->next = memtrace_free;
+        memtrace_free = block;
+    } else {
+        block->len = cpu->len;
+        block->next = NULL;
+
+        if (memtrace_full_tail == NULL) {
+            memtrace_full_head = block;
+        } else {
+            memtrace_full_tail->next = block;
+        }
+
+        memtrace_full_tail = block;
+        pthread_cond_signal(&memtrace_full_cond);
+    }
+
+    cpu->block = NULL;
+    cpu->len = MEMTRACE_BLOCK_SIZE;
+}
+
+/** Hand the full block of a processor over to the writer
+ *
+ * The processor gets an empty block, waiting for the writer
+ * if all the blocks are already taken.
+ *
+ */
+void memtrace_submit(memtrace_cpu_t *cpu)
+{
+    ASSERT(cpu != NULL);
+
+    pthread_mutex_lock(&memtrace_mutex);
+
+    memtrace_queue(cpu);
+
+    while ((memtrace_free == NULL) && (memtrace_blocks == MEMTRACE_BLOCKS_MAX)) {
+        pthread_cond_wait(&memtrace_free_cond, &memtrace_mutex);
+    }
+
+    if (memtrace_free != NULL) {
+        cpu->block = memtrace_free;
+        memtrace_free = cpu->block->next;
+    } else {
+        cpu->block = safe_malloc(sizeof(memtrace_block_t));
+        memtrace_blocks++;
+    }
+
+    pthread_mutex_unlock(&memtrace_mutex);
+
+    cpu->len = 0;
+}
+
+/** Select the processors traced by the filter */
+static void memtrace_update_cpus(const bool *cpus)
+{
+    for (unsigned int i = 0; i < MAX_CPUS; i++) {
+        memtrace_cpus[i].traced = (cpus == NULL) || (cpus[i]);
+    }
+
+    memtrace_all_cpus = (cpus == NULL);
+}
+
+/** Open the memory access trace file
+ *
+ * The file is created (or truncated) and the header is written,
+ * the accesses are traced from now on. A trace opened before is
+ * closed first.
+ *
+ * @return True if successful.
+ *
+ */
+bool memtrace_open(const char *path)
+{
+    ASSERT(path != NULL);
+
+    memtrace_close();
+
+    memtrace_file = fopen(path, "wb");
+    if (memtrace_file == NULL) {
+        io_error(path);
+        return false;
+    }
+
+    uint8_t header[MEMTRACE_HEADER_SIZE];
+    memcpy(header, MEMTRACE_MAGIC, sizeof(MEMTRACE_MAGIC));
+    put_uint32(header + 8, MEMTRACE_VERSION);
+    put_uint32(header + 12, MEMTRACE_RECORD_SIZE);
+
+    if (fwrite(header, sizeof(header), 1, memtrace_file) != 1) {
+        io_error(path);
+        fclose(memtrace_file);
+        memtrace_file = NULL;
+        return false;
+    }
+
+    memtrace_stopping = false;
+    memtrace_failed = false;
+
+    if (pthread_create(&memtrace_writer, NULL, memtrace_write_blocks, NULL) != 0) {
+        error("Unable to start the memory access trace writer");
+        fclose(memtrace_file);
+        memtrace_file = NULL;
+        return false;
+    }
+
+    /* Every processor takes a block on its first access */
+    for (unsigned int i = 0; i < MAX_CPUS; i++) {
+        memtrace_cpus[i].block = NULL;
+        memtrace_cpus[i].len = MEMTRACE_BLOCK_SIZE;
+    }
+
+    if (memtrace_all_cpus) {
+        memtrace_update_cpus(NULL);
+    }
+
+    memtrace_path = safe_strdup(path);
+    memtrace_active = true;
+    return true;
+}
+
+/** Write the remaining records and close the trace file */
+void memtrace_close(void)
+{
+    if (memtrace_file == NULL) {
+        return;
+    }
+
+    memtrace_active = false;
+
+    pthread_mutex_lock(&memtrace_mutex);
+
+    for (unsigned int i = 0; i < MAX_CPUS; i++) {
+        memtrace_queue(&memtrace_cpus[i]);
+    }
+
+    memtrace_stopping = true;
+    pthread_cond_signal(&memtrace_full_cond);
+    pthread_mutex_unlock(&memtrace_mutex);
+
+    pthread_join(memtrace_writer, NULL);
+
+    bool closed = (fclose(memtrace_file) == 0);
+
+    if ((memtrace_failed) || (!closed)) {
+        error("Unable to write the memory access trace %s", memtrace_path);
+    }
+
+    memtrace_file = NULL;
+    safe_free(memtrace_path);
+
+    while (memtrace_free != NULL) {
+        memtrace_block_t *block = memtrace_free;
+        memtrace_free = block->next;
+        safe_free(block);
+    }
+
+    memtrace_blocks = 0;
+}
+
+/** Print a memory access trace file to the standard output
+ *
+ * @return True if the whole file was decoded.
+ *
+ */
+bool memtrace_decode(const char *path)
+{
+    ASSERT(path != NULL);
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        io_error(path);
+        return false;
+    }
+
+    uint8_t header[MEMTRACE_HEADER_SIZE];
+
+    if ((fread(header, sizeof(header), 1, file) != 1)
+            || (memcmp(header, MEMTRACE_MAGIC, sizeof(MEMTRACE_MAGIC)) != 0)
+            || (get_uint32(header + 8) != MEMTRACE_VERSION)
+            || (get_uint32(header + 12) != MEMTRACE_RECORD_SIZE)) {
+        error("%s is not a memory access trace of this MSIM version", path);
+        fclose(file);
+        return false;
+    }
+
+    static const char kinds[] = { 'R', 'W', 'X' };
+    uint8_t src[MEMTRACE_RECORD_SIZE];
+    size_t read;
+
+    while ((read = fread(src, 1, sizeof(src), file)) == sizeof(src)) {
+        uint64_t cycle = get_uint64(src);
+        uint64_t virt = get_uint64(src + 8);
+        uint64_t word = get_uint64(src + 16);
+        unsigned int kind = word >> 56;
+
+        if (kind >= sizeof(kinds)) {
+            error("Unknown memory access kind %u", kind);
+            fclose(file);
+            return false;
+        }
+
+        printf("cpu%-2u %20" PRIu64 " %c %u 0x%016" PRIx64 " 0x%09" PRIx64 "\n",
+                (unsigned int) ((word >> 40) & 0xff), cycle, kinds[kind],
+                (unsigned int) ((word >> 48) & 0xff), virt,
+                word & ((UINT64_C(1) << 40) - 1));
+    }
+
+    fclose(file);
+
+    if (read != 0) {
+        error("Memory access trace %s is truncated", path);
+        return false;
+    }
+
+    return true;
+}
+
+/** Print the state of the trace and the filter */
+static void memtrace_print(void)
+{
+    if (memtrace_active) {
+        printf("Memory access trace: %s\n", memtrace_path);
+    } else {
+        printf("Memory access trace: off\n");
+    }
+
+    if (memtrace_all_cpus) {
+        printf("Processors: all\n");
+    } else {
+        printf("Processors:");
+        for (unsigned int i = 0; i < MAX_CPUS; i++) {
+            if (memtrace_cpus[i].traced) {
+                printf(" %u", i);
+            }
+        }
+        printf("\n");
+    }
+
+    if ((memtrace_from == 0) && (memtrace_to == UINT64_MAX)) {
+        printf("Physical addresses: all\n");
+    } else {
+        printf("Physical addresses: 0x%09" PRIx64 " - 0x%09" PRIx64 "\n",
+                memtrace_from, memtrace_to);
+    }
+}
+
+/** Parse the conditions of the filter
+ *
+ * The conditions are cpu N (repeated for more processors) and
+ * range FROM TO (the first physical address after the range).
+ *
+ */
+static bool memtrace_filter(token_t *parm)
+{
+    bool cpus[MAX_CPUS];
+    bool any_cpu = true;
+    ptr36_t from = 0;
+    ptr36_t to = UINT64_MAX;
+
+    memset(cpus, 0, sizeof(cpus));
+
+    while (parm_type(parm) != tt_end) {
+        if (parm_type(parm) != tt_str) {
+            error("Filter condition name expected");
+            return false;
+        }
+
+        const char *const name = parm_str_next(&parm);
+
+        if (strcmp(name, "cpu") == 0) {
+            if (parm_type(parm) != tt_uint) {
+                error("Number expected after <%s>", name);
+                return false;
+            }
+
+            uint64_t cpuno = parm_uint_next(&parm);
+
+            if (cpuno >= MAX_CPUS) {
+                error("Processor number out of range");
+                return false;
+            }
+
+            cpus[cpuno] = true;
+            any_cpu = false;
+        } else if (strcmp(name, "range") == 0) {
+            if (parm_type(parm) != tt_uint) {
+                error("Number expected after <%s>", name);
+                return false;
+            }
+
+            from = parm_uint_next(&parm);
+
+            if (parm_type(parm) != tt_uint) {
+                error("Number expected after <%s>", name);
+                return false;
+            }
+
+            to = parm_uint_next(&parm);
+
+            if (to <= from) {
+                error("Empty range of <%s>", name);
+                return false;
+            }
+        } else {
+            error("Unknown filter condition <%s> (use cpu or range)", name);
+            return false;
+        }
+    }
+
+    memtrace_update_cpus(any_cpu ? NULL : cpus);
+    memtrace_from = from;
+    memtrace_to = to;
+    return true;
+}
+
+/** Memtrace command implementation
+ *
+ * Start or stop the trace, set or clear the filter or print them.
+ *
+ */
+bool memtrace_cmd(token_t *parm)
+{
+    ASSERT(parm != NULL);
+
+    if (parm_type(parm) == tt_end) {
+        memtrace_print();
+        return true;
+    }
+
+    const char *const action = parm_str_next(&parm);
+
+    if (strcmp(action, "start") == 0) {
+        if (parm_type(parm) != tt_str) {
+            error("Trace file name expected");
+            return false;
+        }
+
+        const char *const path = parm_str_next(&parm);
+
+        if (parm_type(parm) != tt_end) {
+            error("Too many parameters");
+            return false;
+        }
+
+        return memtrace_open(path);
+    }
+
+    if (strcmp(action, "filter") == 0) {
+        return memtrace_filter(parm);
+    }
+
+    if ((strcmp(action, "stop") != 0) && (strcmp(action, "clear") != 0)
+            && (strcmp(action, "print") != 0)) {
+        error("Unknown memtrace action <%s> "
+              "(use start, stop, filter, clear or print)", action);
+        return false;
+    }
+
+    if (parm_type(parm) != tt_end) {
+        error("Too many parameters");
+        return false;
+    }
+
+    if (strcmp(action, "stop") == 0) {
+        memtrace_close();
+    } else if (strcmp(action, "clear") == 0) {
+        memtrace_update_cpus(NULL);
+        memtrace_from = 0;
+        memtrace_to = UINT64_MAX;
+    } else {
+        memtrace_print();
+    }
+
+    return true;
+}
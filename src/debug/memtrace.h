@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Binary memory access trace
+ *
+ */
+
+#ifndef MEMTRACE_H_
+#define MEMTRACE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../endian.h"
+#include "../main.h"
+#include "../parser.h"
+
+/** Identification of the memory access trace file */
+#define MEMTRACE_MAGIC "MSIMMEM"
+#define MEMTRACE_VERSION 1
+
+/** Size of the trace file header and of each record */
+#define MEMTRACE_HEADER_SIZE 16
+#define MEMTRACE_RECORD_SIZE 24
+
+/** Number of the records of a processor written out at once */
+#define MEMTRACE_BLOCK_RECORDS 65536
+#define MEMTRACE_BLOCK_SIZE (MEMTRACE_BLOCK_RECORDS * MEMTRACE_RECORD_SIZE)
+
+/** Kind of a memory access */
+typedef enum {
+    MEMTRACE_READ = 0,
+    MEMTRACE_WRITE = 1,
+    MEMTRACE_FETCH = 2
+} memtrace_kind_t;
+
+/** Block of the records of a processor */
+typedef struct memtrace_block {
+    struct memtrace_block *next;
+    size_t len;
+    uint8_t data[MEMTRACE_BLOCK_SIZE];
+} memtrace_block_t;
+
+/** Accesses of a processor */
+typedef struct {
+    /** The accesses of the processor are traced */
+    bool traced;
+
+    /** Block being filled (NULL before the first access) */
+    memtrace_block_t *block;
+
+    /** Bytes of the block filled */
+    size_t len;
+} memtrace_cpu_t;
+
+/** True if the memory accesses are traced to a file */
+extern bool memtrace_active;
+
+/** Physical address range traced (the first address after the range) */
+extern ptr36_t memtrace_from;
+extern ptr36_t memtrace_to;
+
+extern memtrace_cpu_t memtrace_cpus[MAX_CPUS];
+
+extern bool memtrace_open(const char *path);
+extern void memtrace_close(void);
+extern void memtrace_submit(memtrace_cpu_t *cpu);
+extern bool memtrace_decode(const char *path);
+extern bool memtrace_cmd(token_t *parm);
+
+/** Record a memory access of a processor
+ *
+ * A single test unless the accesses are traced. The record
+ * is the machine cycle, the virtual address and a word with the
+ * physical address (bits 0 to 39), the processor number (bits
+ * 40 to 47), the size (bits 48 to 55) and the kind of the access
+ * (bits 56 to 63), all stored in the little-endian byte order.
+ *
+ */
+static inline void memtrace_access(unsigned int cpuno, uint64_t virt,
+        ptr36_t phys, unsigned int size, memtrace_kind_t kind)
+{
+    if (!memtrace_active) {
+        return;
+    }
+
+    memtrace_cpu_t *cpu = &memtrace_cpus[cpuno];
+
+    if ((!cpu->traced) || (phys < memtrace_from) || (phys >= memtrace_to)) {
+        return;
+    }
+
+    if (cpu->len == MEMTRACE_BLOCK_SIZE) {
+        memtrace_submit(cpu);
+    }
+
+    uint8_t *dst = cpu->block->data + cpu->len;
+    uint64_t val[3] = {
+        convert_uint64_t_endian(steps),
+        convert_uint64_t_endian(virt),
+        convert_uint64_t_endian(phys | ((uint64_t) cpuno << 40)
+                | ((uint64_t) size << 48) | ((uint64_t) kind << 56))
+    };
+
+    memcpy(dst, val, sizeof(val));
+    cpu->len += MEMTRACE_RECORD_SIZE;
+}
+
+/** Record the fetches of a straight-line run of (4 byte) instructions */
+static inline void memtrace_fetch(unsigned int cpuno, uint64_t pc,
+        ptr36_t phys, unsigned int count)
+{
+    if (!memtrace_active) {
+        return;
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+        memtrace_access(cpuno, pc + 4 * i, phys + 4 * i, 4, MEMTRACE_FETCH);
+    }
+}
+
+#endif
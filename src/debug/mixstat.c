@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Instruction mix and memory access statistics
+ *
+ *  While the statistics are enabled, the decoded instruction pages
+ *  hold a counting wrapper instead of the instruction implementations
+ *  and the memory frames do not allow direct accesses, so that the
+ *  loads and stores reach the physical memory access functions.
+ *  Disabled statistics thus cost nothing on the execution paths.
+ *
+ */
+
+#include "mixstat.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../assert.h"
+#include "../device/cpu/decode_cache.h"
+#include "../device/device.h"
+#include "../physmem.h"
+#include "../utils.h"
+
+bool mixstat_enabled = false;
+
+/** Enable or disable the statistics
+ *
+ * The decoded pages are flushed to be decoded again
+ * with or without the counting wrapper.
+ *
+ */
+bool mixstat_set(bool enabled)
+{
+    mixstat_enabled = enabled;
+
+    for (unsigned int isa = 0; isa < DECODE_ISA_COUNT; isa++) {
+        decode_cache_flush(isa);
+    }
+
+    device_t *dev = NULL;
+    while (dev_next(&dev, DEVICE_FILTER_MEMORY)) {
+        physmem_area_update((physmem_area_t *) dev->data);
+    }
+
+    return true;
+}
+
+/** Order of the printed entries (most executed first) */
+static int mixstat_compare(const void *a, const void *b)
+{
+    const mixstat_entry_t *ea = *((const mixstat_entry_t **) a);
+    const mixstat_entry_t *eb = *((const mixstat_entry_t **) b);
+
+    if (ea->count != eb->count) {
+        return (ea->count > eb->count) ? -1 : 1;
+    }
+
+    if (ea->word != eb->word) {
+        return (ea->word < eb->word) ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/** Print the instruction mix of a processor
+ *
+ * Nothing is printed if no instruction has been counted.
+ *
+ * @param mix  Instruction mix.
+ * @param name Function naming the instruction classes.
+ *
+ */
+void mixstat_print(const mixstat_t *mix, mixstat_name_t name)
+{
+    ASSERT(mix != NULL);
+    ASSERT(name != NULL);
+
+    const mixstat_entry_t *used[MIXSTAT_SLOTS];
+    unsigned int count = 0;
+    uint64_t total = mix->other;
+
+    for (unsigned int i = 0; i < MIXSTAT_SLOTS; i++) {
+        if (mix->entries[i].handler != NULL) {
+            used[count++] = &mix->entries[i];
+            total += mix->entries[i].count;
+        }
+    }
+
+    if (total == 0) {
+        return;
+    }
+
+    qsort(used, count, sizeof(used[0]), mixstat_compare);
+
+    printf("\n[Instruction       ] [Executed          ] [Share             ]\n");
+
+    string_t str;
+    string_init(&str);
+
+    for (unsigned int i = 0; i < count; i++) {
+        string_clear(&str);
+        name(used[i]->word, &str);
+
+        /* Only the mnemonic without the operands */
+        size_t len = 0;
+        while ((str.str[len] != 0) && (str.str[len] != ' ')) {
+            len++;
+        }
+
+        printf("%-20.*s %20" PRIu64 " %19.2f%%\n", (int) len, str.str,
+                used[i]->count, 100.0 * used[i]->count / total);
+    }
+
+    string_done(&str);
+
+    if (mix->other > 0) {
+        printf("%-20s %20" PRIu64 " %19.2f%%\n", "(other)", mix->other,
+                100.0 * mix->other / total);
+    }
+}
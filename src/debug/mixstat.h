@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Instruction mix and memory access statistics
+ *
+ */
+
+#ifndef MIXSTAT_H_
+#define MIXSTAT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../utils.h"
+
+/** Number of distinct instruction handlers counted per processor */
+#define MIXSTAT_SLOTS 512
+
+/** Instruction implementation as seen by the statistics */
+typedef void (*mixstat_handler_t)(void);
+
+/** Executions of a single instruction implementation */
+typedef struct {
+    mixstat_handler_t handler; /**< NULL if the slot is free */
+    uint32_t word; /**< First instruction word executed by the handler */
+    uint64_t count;
+} mixstat_entry_t;
+
+/** Instruction mix of a processor
+ *
+ * Open addressing table keyed by the instruction implementation,
+ * i.e. by the class of instructions sharing the same handler.
+ *
+ */
+typedef struct {
+    mixstat_entry_t entries[MIXSTAT_SLOTS];
+    uint64_t other; /**< Executions not fitting into the table */
+} mixstat_t;
+
+/** Write the name of the instruction class of an instruction word */
+typedef void (*mixstat_name_t)(uint32_t word, string_t *name);
+
+/** Instruction mix and memory access statistics are being collected */
+extern bool mixstat_enabled;
+
+extern bool mixstat_set(bool enabled);
+extern void mixstat_print(const mixstat_t *mix, mixstat_name_t name);
+
+/** Count an execution of an instruction implementation */
+static inline void mixstat_count(mixstat_t *mix, mixstat_handler_t handler,
+        uint32_t word)
+{
+    uintptr_t hash = (uintptr_t) handler;
+    unsigned int slot = ((hash >> 4) ^ (hash >> 13)) % MIXSTAT_SLOTS;
+
+    for (unsigned int probe = 0; probe < MIXSTAT_SLOTS; probe++) {
+        mixstat_entry_t *entry = &mix->entries[slot];
+
+        if (entry->handler == handler) {
+            entry->count++;
+            return;
+        }
+
+        if (entry->handler == NULL) {
+            entry->handler = handler;
+            entry->word = word;
+            entry->count = 1;
+            return;
+        }
+
+        slot = (slot + 1) % MIXSTAT_SLOTS;
+    }
+
+    mix->other++;
+}
+
+/** Count the bytes of a memory access
+ *
+ * The counters of the memory areas and the devices are shared
+ * by the processors, which may run in parallel.
+ *
+ */
+static inline void mixstat_count_bytes(uint64_t *counter, unsigned int bytes)
+{
+    __atomic_fetch_add(counter, bytes, __ATOMIC_RELAXED);
+}
+
+#endif
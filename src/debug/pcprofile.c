@@ -0,0 +1,803 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Sampled profile of the guest program counters
+ *
+ *  Every pcprofile_period-th machine cycle, the program counter and
+ *  the privilege mode of each processor are counted in a histogram.
+ *  The other cycles only compare the cycle counter with the cycle of
+ *  the next sample. The distance of the samples varies randomly around
+ *  the period, so that loops whose length divides the period are not
+ *  always sampled in the same instruction.
+ *
+ *  The profile is written as a flat profile of the functions and of
+ *  the program counters (symbolized by the loaded ELF symbols) or in
+ *  the folded stack format of the flame graph tools. The frames are
+ *  the processor, the mode and the function. While the callstacks
+ *  variable is set, the shadow call stacks of the processors (see
+ *  callstack.c) are sampled as well and the called functions are the
+ *  frames between the mode and the function. The samples of the same
+ *  program counter with different call stacks are counted apart and
+ *  merged by the flat profile.
+ *
+ *  The skipped standby cycles are sampled as well (the processors do
+ *  not move while standing by), the cycles run by the processors in
+ *  parallel are not.
+ *
+ */
+
+#include "pcprofile.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../assert.h"
+#include "../device/cpu/general_cpu.h"
+#include "../fault.h"
+#include "../main.h"
+#include "../utils.h"
+#include "callstack.h"
+#include "symtab.h"
+
+/** Initial number of the histogram slots (a power of 2) */
+#define PCPROFILE_INITIAL_SLOTS 1024
+
+/** Initial number of the call path slots (a power of 2) */
+#define PCPROFILE_INITIAL_PATH_SLOTS 256
+
+unsigned int pcprofile_period = 0;
+uint64_t pcprofile_next = UINT64_MAX;
+
+/** Sampled program counter of a processor */
+typedef struct {
+    uint64_t pc;
+    uint64_t count; /**< Zero if the slot is free */
+    unsigned int cpuno;
+    cpu_mode_t mode;
+    unsigned int path; /**< Sampled call stack (0 if none) */
+} pcprofile_entry_t;
+
+/** Sampled call stack (the called functions, the outermost first) */
+typedef struct {
+    size_t first; /**< Index of the first function in path_frames */
+    unsigned int depth;
+    uint64_t hash;
+} pcprofile_path_t;
+
+/** Histogram of the samples (open addressing hash table) */
+static pcprofile_entry_t *slots = NULL;
+static size_t slot_count = 0;
+static size_t used_count = 0;
+
+/** Distinct sampled call stacks (the first one is empty) */
+static pcprofile_path_t *paths = NULL;
+static size_t path_count = 0;
+static size_t path_capacity = 0;
+
+/** Functions of the sampled call stacks */
+static uint64_t *path_frames = NULL;
+static size_t path_frame_count = 0;
+static size_t path_frame_capacity = 0;
+
+/** Index of the call stacks (open addressing hash table, 0 if free) */
+static unsigned int *path_slots = NULL;
+static size_t path_slot_count = 0;
+
+/** Number of the samples taken (for each processor) */
+static uint64_t samples = 0;
+
+/** State of the generator of the sample distances */
+static uint64_t jitter_state = 1;
+
+/** File the profile is written to at the exit (NULL if none) */
+static char *output_path = NULL;
+
+/** Distance of the next sample (in machine cycles)
+ *
+ * Uniformly distributed between one half and three halves
+ * of the period, so that the mean distance is the period.
+ *
+ */
+static uint64_t pcprofile_distance(void)
+{
+    /* Xorshift generator */
+    jitter_state ^= jitter_state << 13;
+    jitter_state ^= jitter_state >> 7;
+    jitter_state ^= jitter_state << 17;
+
+    uint64_t half = pcprofile_period / 2;
+    return pcprofile_period - half + (jitter_state % (2 * half + 1));
+}
+
+static size_t pcprofile_hash(uint64_t pc, unsigned int cpuno, cpu_mode_t mode,
+        unsigned int path)
+{
+    uint64_t key = pc ^ ((uint64_t) cpuno << 56) ^ ((uint64_t) mode << 48)
+            ^ ((uint64_t) path << 24);
+
+    /* Fibonacci hashing */
+    return (size_t) ((key * UINT64_C(0x9e3779b97f4a7c15)) >> 32) & (slot_count - 1);
+}
+
+/** Find the slot of a program counter (or the free slot for it) */
+static pcprofile_entry_t *pcprofile_slot(uint64_t pc, unsigned int cpuno,
+        cpu_mode_t mode, unsigned int path)
+{
+    size_t i = pcprofile_hash(pc, cpuno, mode, path);
+
+    while (true) {
+        pcprofile_entry_t *entry = &slots[i];
+
+        if ((entry->count == 0) || ((entry->pc == pc) && (entry->cpuno == cpuno)
+                && (entry->mode == mode) && (entry->path == path))) {
+            return entry;
+        }
+
+        i = (i + 1) & (slot_count - 1);
+    }
+}
+
+/** Double the number of the histogram slots */
+static void pcprofile_grow(void)
+{
+    pcprofile_entry_t *old = slots;
+    size_t old_count = slot_count;
+
+    slot_count = (old_count == 0) ? PCPROFILE_INITIAL_SLOTS : 2 * old_count;
+    slots = (pcprofile_entry_t *) safe_malloc(slot_count * sizeof(pcprofile_entry_t));
+    memset(slots, 0, slot_count * sizeof(pcprofile_entry_t));
+
+    for (size_t i = 0; i < old_count; i++) {
+        if (old[i].count != 0) {
+            *pcprofile_slot(old[i].pc, old[i].cpuno, old[i].mode,
+                    old[i].path) = old[i];
+        }
+    }
+
+    safe_free(old);
+}
+
+static void pcprofile_count(uint64_t pc, unsigned int cpuno, cpu_mode_t mode,
+        unsigned int path, uint64_t count)
+{
+    /* Keep at least a quarter of the slots free */
+    if (4 * (used_count + 1) > 3 * slot_count) {
+        pcprofile_grow();
+    }
+
+    pcprofile_entry_t *entry = pcprofile_slot(pc, cpuno, mode, path);
+
+    if (entry->count == 0) {
+        entry->pc = pc;
+        entry->cpuno = cpuno;
+        entry->mode = mode;
+        entry->path = path;
+        used_count++;
+    }
+
+    entry->count += count;
+}
+
+/** Find the slot of a call stack (or the free slot for it) */
+static unsigned int *pcprofile_path_slot(const uint64_t *frames,
+        unsigned int depth, uint64_t hash)
+{
+    size_t i = (size_t) (hash >> 32) & (path_slot_count - 1);
+
+    while (true) {
+        unsigned int *slot = &path_slots[i];
+
+        if (*slot == 0) {
+            return slot;
+        }
+
+        const pcprofile_path_t *path = &paths[*slot];
+        if ((path->hash == hash) && (path->depth == depth)
+                && (memcmp(&path_frames[path->first], frames,
+                        depth * sizeof(uint64_t)) == 0)) {
+            return slot;
+        }
+
+        i = (i + 1) & (path_slot_count - 1);
+    }
+}
+
+/** Double the number of the call path slots */
+static void pcprofile_path_grow(void)
+{
+    safe_free(path_slots);
+
+    path_slot_count = (path_slot_count == 0)
+            ? PCPROFILE_INITIAL_PATH_SLOTS : 2 * path_slot_count;
+    path_slots = (unsigned int *) safe_malloc(path_slot_count * sizeof(unsigned int));
+    memset(path_slots, 0, path_slot_count * sizeof(unsigned int));
+
+    for (size_t i = 1; i < path_count; i++) {
+        const pcprofile_path_t *path = &paths[i];
+
+        *pcprofile_path_slot(&path_frames[path->first], path->depth,
+                path->hash) = (unsigned int) i;
+    }
+}
+
+/** Make room for the given numbers of the call stacks and their functions */
+static void pcprofile_path_reserve(size_t count, size_t frame_count)
+{
+    if (count > path_capacity) {
+        path_capacity = MAX(2 * path_capacity, 64);
+        paths = (pcprofile_path_t *) realloc(paths,
+                path_capacity * sizeof(pcprofile_path_t));
+        if (paths == NULL) {
+            die(ERR_MEM, "Not enough memory");
+        }
+    }
+
+    if (frame_count > path_frame_capacity) {
+        path_frame_capacity = MAX(2 * path_frame_capacity,
+                MAX(frame_count, 1024));
+        path_frames = (uint64_t *) realloc(path_frames,
+                path_frame_capacity * sizeof(uint64_t));
+        if (path_frames == NULL) {
+            die(ERR_MEM, "Not enough memory");
+        }
+    }
+}
+
+/** Get the sampled call stack of a processor
+ *
+ * A MIPS call pushed by a jump whose delay slot is sampled
+ * has not entered the called function yet, so it is left out.
+ *
+ * @param pc Sampled program counter of the processor.
+ *
+ * @return Index of the call stack in paths (0 if there are no calls).
+ *
+ */
+static unsigned int pcprofile_path(unsigned int cpuno, uint64_t pc)
+{
+    const callstack_t *stack = &callstacks[cpuno];
+
+    if (!callstack_enabled) {
+        return 0;
+    }
+
+    unsigned int depth = stack->depth;
+    if ((depth > 0) && (stack->ret[depth - 1] == pc + 4)) {
+        depth--;
+    }
+
+    if (depth == 0) {
+        return 0;
+    }
+
+    /* FNV-1a of the called functions */
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+    for (unsigned int i = 0; i < depth; i++) {
+        hash = (hash ^ stack->target[i]) * UINT64_C(0x100000001b3);
+    }
+
+    /* The first path stands for no calls */
+    if (path_count == 0) {
+        pcprofile_path_reserve(1, 0);
+        memset(&paths[0], 0, sizeof(pcprofile_path_t));
+        path_count = 1;
+    }
+
+    /* Keep at least a quarter of the slots free */
+    if (4 * path_count > 3 * path_slot_count) {
+        pcprofile_path_grow();
+    }
+
+    unsigned int *slot = pcprofile_path_slot(stack->target, depth, hash);
+    if (*slot != 0) {
+        return *slot;
+    }
+
+    pcprofile_path_reserve(path_count + 1, path_frame_count + depth);
+
+    pcprofile_path_t *path = &paths[path_count];
+    path->first = path_frame_count;
+    path->depth = depth;
+    path->hash = hash;
+
+    memcpy(&path_frames[path_frame_count], stack->target,
+            depth * sizeof(uint64_t));
+    path_frame_count += depth;
+
+    *slot = (unsigned int) path_count;
+    return (unsigned int) path_count++;
+}
+
+/** Count the given number of samples of all processors */
+static void pcprofile_sample_all(uint64_t count)
+{
+    for (unsigned int i = 0; i < get_cpu_count(); i++) {
+        general_cpu_t *cpu = get_cpu_by_index(i);
+        uint64_t pc = cpu_get_pc(cpu).ptr;
+
+        pcprofile_count(pc, cpu->cpuno, cpu_mode(cpu),
+                pcprofile_path(cpu->cpuno, pc), count);
+    }
+
+    samples += count;
+}
+
+/** Forget the profile collected so far */
+void pcprofile_reset(void)
+{
+    if (slots != NULL) {
+        memset(slots, 0, slot_count * sizeof(pcprofile_entry_t));
+    }
+
+    if (path_slots != NULL) {
+        memset(path_slots, 0, path_slot_count * sizeof(unsigned int));
+    }
+
+    used_count = 0;
+    path_count = 0;
+    path_frame_count = 0;
+    samples = 0;
+}
+
+/** Change the pcprofile variable
+ *
+ * The profile collected so far is forgotten.
+ *
+ * @param period Number of machine cycles between the samples
+ *               (0 disables the profiling).
+ *
+ * @return True (any period is valid).
+ *
+ */
+bool pcprofile_set_period(unsigned int period)
+{
+    pcprofile_reset();
+    pcprofile_period = period;
+    pcprofile_rebase();
+    return true;
+}
+
+/** Schedule the next sample from the current machine cycle
+ *
+ * Called when the cycle counter changes other than by running
+ * (i.e. when a checkpoint is restored). The profile is kept.
+ *
+ */
+void pcprofile_rebase(void)
+{
+    pcprofile_next = (pcprofile_period > 0)
+            ? steps + pcprofile_distance() : UINT64_MAX;
+}
+
+/** Stop sampling
+ *
+ * The profile collected so far is kept to be written. The sampling
+ * is started again by setting the pcprofile variable (or by the
+ * next rebase).
+ *
+ */
+void pcprofile_stop(void)
+{
+    pcprofile_next = UINT64_MAX;
+}
+
+/** Sample the current machine cycle
+ *
+ * Called by the main loop when the cycle counter reaches
+ * pcprofile_next, before the cycle runs.
+ *
+ */
+void pcprofile_sample(void)
+{
+    if (pcprofile_period == 0) {
+        return;
+    }
+
+    pcprofile_sample_all(1);
+    pcprofile_next = steps + pcprofile_distance();
+}
+
+/** Sample the standby cycles about to be skipped
+ *
+ * The processors stay at the same program counters during the
+ * skipped cycles, so the samples are the same as if the cycles
+ * were simulated one by one.
+ *
+ */
+void pcprofile_skip(uint64_t cycles)
+{
+    if (pcprofile_period == 0) {
+        return;
+    }
+
+    uint64_t next = MAX(pcprofile_next, steps);
+    uint64_t count = 0;
+
+    while (next < steps + cycles) {
+        count++;
+        next += pcprofile_distance();
+    }
+
+    if (count > 0) {
+        pcprofile_sample_all(count);
+    }
+
+    pcprofile_next = next;
+}
+
+/** Parse the name of a profile format
+ *
+ * @return True if the name is known.
+ *
+ */
+bool pcprofile_parse_format(const char *name, pcprofile_format_t *format)
+{
+    if (strcmp(name, "flat") == 0) {
+        *format = PCPROFILE_FLAT;
+        return true;
+    }
+
+    if (strcmp(name, "folded") == 0) {
+        *format = PCPROFILE_FOLDED;
+        return true;
+    }
+
+    return false;
+}
+
+/** Copy the used histogram slots into an array
+ *
+ * @param count Number of the entries.
+ *
+ */
+static pcprofile_entry_t *pcprofile_entries(size_t *count)
+{
+    pcprofile_entry_t *entries = (pcprofile_entry_t *)
+            safe_malloc((used_count + 1) * sizeof(pcprofile_entry_t));
+    size_t n = 0;
+
+    for (size_t i = 0; i < slot_count; i++) {
+        if (slots[i].count != 0) {
+            entries[n++] = slots[i];
+        }
+    }
+
+    *count = n;
+    return entries;
+}
+
+/** Function of the flat profile */
+typedef struct {
+    const symbol_t *symbol; /**< NULL for the unknown functions */
+    cpu_mode_t mode;
+    uint64_t count;
+} pcprofile_function_t;
+
+/** Order of the functions by the symbol and the mode */
+static int function_compare_key(const void *a, const void *b)
+{
+    const pcprofile_function_t *fa = (const pcprofile_function_t *) a;
+    const pcprofile_function_t *fb = (const pcprofile_function_t *) b;
+
+    if (fa->symbol != fb->symbol) {
+        if ((fa->symbol == NULL) || (fb->symbol == NULL)) {
+            return (fa->symbol == NULL) ? 1 : -1;
+        }
+
+        return (fa->symbol->addr < fb->symbol->addr) ? -1 : 1;
+    }
+
+    return (int) fa->mode - (int) fb->mode;
+}
+
+/** Order of the functions by the samples (most sampled first) */
+static int function_compare_count(const void *a, const void *b)
+{
+    const pcprofile_function_t *fa = (const pcprofile_function_t *) a;
+    const pcprofile_function_t *fb = (const pcprofile_function_t *) b;
+
+    if (fa->count != fb->count) {
+        return (fa->count > fb->count) ? -1 : 1;
+    }
+
+    return function_compare_key(a, b);
+}
+
+/** Order of the program counters by the address, the processor and the mode */
+static int entry_compare_key(const void *a, const void *b)
+{
+    const pcprofile_entry_t *ea = (const pcprofile_entry_t *) a;
+    const pcprofile_entry_t *eb = (const pcprofile_entry_t *) b;
+
+    if (ea->pc != eb->pc) {
+        return (ea->pc < eb->pc) ? -1 : 1;
+    }
+
+    if (ea->cpuno != eb->cpuno) {
+        return (ea->cpuno < eb->cpuno) ? -1 : 1;
+    }
+
+    return (int) ea->mode - (int) eb->mode;
+}
+
+/** Order of the program counters by the samples (most sampled first) */
+static int entry_compare_count(const void *a, const void *b)
+{
+    const pcprofile_entry_t *ea = (const pcprofile_entry_t *) a;
+    const pcprofile_entry_t *eb = (const pcprofile_entry_t *) b;
+
+    if (ea->count != eb->count) {
+        return (ea->count > eb->count) ? -1 : 1;
+    }
+
+    return entry_compare_key(a, b);
+}
+
+static double pcprofile_share(uint64_t count, uint64_t total)
+{
+    return (total > 0) ? 100.0 * count / total : 0;
+}
+
+/** Write the flat profile of the functions and the program counters */
+static void pcprofile_write_flat(FILE *file, pcprofile_entry_t *entries,
+        size_t count)
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += entries[i].count;
+    }
+
+    fprintf(file, "PC profile (1 of %u cycles sampled, %" PRIu64 " samples)\n",
+            pcprofile_period, samples);
+
+    /* Merge the program counters of the same function and mode */
+    pcprofile_function_t *functions = (pcprofile_function_t *)
+            safe_malloc((count + 1) * sizeof(pcprofile_function_t));
+
+    for (size_t i = 0; i < count; i++) {
+        functions[i].symbol = symtab_find(entries[i].pc);
+        functions[i].mode = entries[i].mode;
+        functions[i].count = entries[i].count;
+    }
+
+    qsort(functions, count, sizeof(pcprofile_function_t), function_compare_key);
+
+    size_t function_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        if ((function_count > 0)
+                && (function_compare_key(&functions[function_count - 1], &functions[i]) == 0)) {
+            functions[function_count - 1].count += functions[i].count;
+        } else {
+            functions[function_count++] = functions[i];
+        }
+    }
+
+    qsort(functions, function_count, sizeof(pcprofile_function_t),
+            function_compare_count);
+
+    fprintf(file, "\nFunctions:\n");
+    fprintf(file, "  %10s %7s %7s  %-10s %s\n", "samples", "share",
+            "total", "mode", "function");
+
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < function_count; i++) {
+        pcprofile_function_t *function = &functions[i];
+        cumulative += function->count;
+
+        fprintf(file, "  %10" PRIu64 " %6.2f%% %6.2f%%  %-10s %s\n",
+                function->count, pcprofile_share(function->count, total),
+                pcprofile_share(cumulative, total), cpu_mode_name(function->mode),
+                (function->symbol != NULL) ? function->symbol->name : "[unknown]");
+    }
+
+    safe_free(functions);
+
+    /* Merge the samples of the same program counter with different call stacks */
+    qsort(entries, count, sizeof(pcprofile_entry_t), entry_compare_key);
+
+    size_t merged = 0;
+    for (size_t i = 0; i < count; i++) {
+        if ((merged > 0) && (entry_compare_key(&entries[merged - 1], &entries[i]) == 0)) {
+            entries[merged - 1].count += entries[i].count;
+        } else {
+            entries[merged++] = entries[i];
+        }
+    }
+
+    count = merged;
+    qsort(entries, count, sizeof(pcprofile_entry_t), entry_compare_count);
+
+    fprintf(file, "\nProgram counters:\n");
+    fprintf(file, "  %10s %7s %4s  %-10s %-18s  %s\n", "samples", "share",
+            "cpu", "mode", "pc", "location");
+
+    for (size_t i = 0; i < count; i++) {
+        pcprofile_entry_t *entry = &entries[i];
+        const symbol_t *symbol = symtab_find(entry->pc);
+
+        fprintf(file, "  %10" PRIu64 " %6.2f%% %4u  %-10s %#018" PRIx64 "  ",
+                entry->count, pcprofile_share(entry->count, total),
+                entry->cpuno, cpu_mode_name(entry->mode), entry->pc);
+
+        if (symbol == NULL) {
+            fprintf(file, "[unknown]\n");
+        } else if (entry->pc == symbol->addr) {
+            fprintf(file, "%s\n", symbol->name);
+        } else {
+            fprintf(file, "%s+%#" PRIx64 "\n", symbol->name, entry->pc - symbol->addr);
+        }
+    }
+}
+
+/** Folded stack of the profile */
+typedef struct {
+    char *frames;
+    uint64_t count;
+} pcprofile_stack_t;
+
+static int stack_compare(const void *a, const void *b)
+{
+    return strcmp(((const pcprofile_stack_t *) a)->frames,
+            ((const pcprofile_stack_t *) b)->frames);
+}
+
+/** Append the called functions of a call stack to a folded stack
+ *
+ * @param symbol Function of the sampled program counter.
+ *
+ */
+static void pcprofile_append_path(string_t *str, const pcprofile_path_t *path,
+        const symbol_t *symbol)
+{
+    for (unsigned int i = 0; i < path->depth; i++) {
+        uint64_t target = path_frames[path->first + i];
+        const symbol_t *callee = symtab_find(target);
+
+        if ((i + 1 == path->depth) && (callee != NULL) && (callee == symbol)) {
+            break;
+        }
+
+        if (callee != NULL) {
+            string_printf(str, "%s;", callee->name);
+        } else {
+            string_printf(str, "%#" PRIx64 ";", target);
+        }
+    }
+}
+
+/** Write the profile as folded stacks
+ *
+ * Each line holds the processor, the mode, the called functions of
+ * the sampled call stack (if any) and the function separated by
+ * semicolons and the number of the samples. The program counters
+ * without a symbol are their own functions. The innermost call is
+ * usually the call of the function itself, so it is left out then.
+ *
+ */
+static void pcprofile_write_folded(FILE *file, pcprofile_entry_t *entries,
+        size_t count)
+{
+    pcprofile_stack_t *stacks = (pcprofile_stack_t *)
+            safe_malloc((count + 1) * sizeof(pcprofile_stack_t));
+
+    for (size_t i = 0; i < count; i++) {
+        const symbol_t *symbol = symtab_find(entries[i].pc);
+        string_t str;
+
+        string_init(&str);
+        string_printf(&str, "cpu%u;%s;", entries[i].cpuno,
+                cpu_mode_name(entries[i].mode));
+
+        if (entries[i].path != 0) {
+            pcprofile_append_path(&str, &paths[entries[i].path], symbol);
+        }
+
+        if (symbol != NULL) {
+            string_append(&str, symbol->name);
+        } else {
+            string_printf(&str, "%#" PRIx64, entries[i].pc);
+        }
+
+        stacks[i].frames = safe_strdup(str.str);
+        stacks[i].count = entries[i].count;
+        string_done(&str);
+    }
+
+    qsort(stacks, count, sizeof(pcprofile_stack_t), stack_compare);
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t total = stacks[i].count;
+
+        while ((i + 1 < count) && (strcmp(stacks[i].frames, stacks[i + 1].frames) == 0)) {
+            safe_free(stacks[i].frames);
+            i++;
+            total += stacks[i].count;
+        }
+
+        fprintf(file, "%s %" PRIu64 "\n", stacks[i].frames, total);
+        safe_free(stacks[i].frames);
+    }
+
+    safe_free(stacks);
+}
+
+/** Write the profile collected so far into a file
+ *
+ * @return True if successful.
+ *
+ */
+bool pcprofile_write(const char *path, pcprofile_format_t format)
+{
+    ASSERT(path != NULL);
+
+    FILE *file = try_fopen(path, "w");
+    if (file == NULL) {
+        return false;
+    }
+
+    size_t count;
+    pcprofile_entry_t *entries = pcprofile_entries(&count);
+
+    switch (format) {
+    case PCPROFILE_FLAT:
+        pcprofile_write_flat(file, entries, count);
+        break;
+    case PCPROFILE_FOLDED:
+        pcprofile_write_folded(file, entries, count);
+        break;
+    }
+
+    safe_free(entries);
+    safe_fclose(file, path);
+
+    return true;
+}
+
+/** Set the file the profile is written to at the exit
+ *
+ * The folded format is written if the file name ends
+ * with .folded, the flat profile otherwise.
+ *
+ */
+void pcprofile_set_output(const char *path)
+{
+    ASSERT(path != NULL);
+
+    safe_free(output_path);
+    output_path = safe_strdup(path);
+}
+
+/** Write the profile into the output file and release the profile */
+void pcprofile_done(void)
+{
+    if (output_path != NULL) {
+        size_t len = strlen(output_path);
+        bool folded = (len >= 7) && (strcmp(output_path + len - 7, ".folded") == 0);
+
+        pcprofile_write(output_path, folded ? PCPROFILE_FOLDED : PCPROFILE_FLAT);
+        safe_free(output_path);
+    }
+
+    safe_free(slots);
+    slot_count = 0;
+    used_count = 0;
+
+    safe_free(path_slots);
+    safe_free(paths);
+    safe_free(path_frames);
+    path_slot_count = 0;
+    path_count = 0;
+    path_capacity = 0;
+    path_frame_count = 0;
+    path_frame_capacity = 0;
+
+    symtab_done();
+}
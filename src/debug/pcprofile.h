@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Sampled profile of the guest program counters
+ *
+ */
+
+#ifndef PCPROFILE_H_
+#define PCPROFILE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Sampling period used if only the output file is given */
+#define PCPROFILE_DEFAULT_PERIOD 1000
+
+/** Formats of the written profile */
+typedef enum {
+    PCPROFILE_FLAT, /**< Functions and program counters by the samples */
+    PCPROFILE_FOLDED /**< Folded stacks (processor;mode;function count) */
+} pcprofile_format_t;
+
+/** Number of machine cycles between the samples (0 = no profiling) */
+extern unsigned int pcprofile_period;
+
+/** Machine cycle of the next sample (UINT64_MAX if not profiling) */
+extern uint64_t pcprofile_next;
+
+extern bool pcprofile_set_period(unsigned int period);
+extern void pcprofile_sample(void);
+extern void pcprofile_skip(uint64_t cycles);
+extern void pcprofile_rebase(void);
+extern void pcprofile_reset(void);
+extern void pcprofile_stop(void);
+extern bool pcprofile_write(const char *path, pcprofile_format_t format);
+extern bool pcprofile_parse_format(const char *name, pcprofile_format_t *format);
+extern void pcprofile_set_output(const char *path);
+extern void pcprofile_done(void);
+
+#endif
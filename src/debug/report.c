@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Run report
+ *
+ *  When the simulation ends, a JSON file (see the --report option)
+ *  is written with the machine cycles, the executed instructions,
+ *  the exit status, the host wall clock and CPU time of the run,
+ *  the simulated MIPS, the peak resident set size and the counters
+ *  exported by the devices (the same as those of the statistics
+ *  endpoint, see statsrv.c).
+ *
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifndef __WIN32__
+#include <sys/resource.h>
+#endif
+
+#include "../assert.h"
+#include "../device/cpu/general_cpu.h"
+#include "../fault.h"
+#include "../main.h"
+#include "../utils.h"
+#include "report.h"
+#include "statsrv.h"
+
+/** Path of the report (NULL for none) */
+static char *output_path = NULL;
+
+/** Host time the run started at (in seconds) */
+static double start_time = 0;
+
+static double report_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Get the host CPU time and the peak resident set size of the simulator
+ *
+ * @param rss Set to the peak resident set size in KiB (0 if unknown).
+ *
+ * @return CPU time (user and system) in seconds.
+ *
+ */
+static double report_usage(uint64_t *rss)
+{
+#ifdef __WIN32__
+    *rss = 0;
+    return (double) clock() / CLOCKS_PER_SEC;
+#else
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        *rss = 0;
+        return 0;
+    }
+
+#ifdef __APPLE__
+    /* Reported in bytes */
+    *rss = usage.ru_maxrss / 1024;
+#else
+    *rss = usage.ru_maxrss;
+#endif
+
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+            + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#endif
+}
+
+/** Set the path of the report written at the end
+ *
+ * The run is timed from the call.
+ *
+ */
+void report_set_output(const char *path)
+{
+    ASSERT(path != NULL);
+
+    safe_free(output_path);
+    output_path = safe_strdup(path);
+    start_time = report_time();
+}
+
+/** Write the report of the run
+ *
+ * Called at the end of the simulation, nothing is done unless
+ * the path of the report is set.
+ *
+ * @return True if successful.
+ *
+ */
+bool report_write(void)
+{
+    if (output_path == NULL) {
+        return true;
+    }
+
+    uint64_t instructions = cpu_instructions_all();
+    double seconds = report_time() - start_time;
+    uint64_t rss;
+    double cpu_seconds = report_usage(&rss);
+
+    string_t out;
+    string_init(&out);
+
+    string_printf(&out, "{\"cycles\":%" PRIu64 ",\"instructions\":%" PRIu64
+                        ",\"exit_status\":%d,\"wall_seconds\":%.3f"
+                        ",\"cpu_seconds\":%.3f,\"mips\":%.3f"
+                        ",\"peak_rss_kib\":%" PRIu64 ",\"devices\":",
+            steps, instructions, machine_exit_status, seconds, cpu_seconds,
+            (seconds > 0) ? instructions / seconds / 1e6 : 0, rss);
+    statsrv_write_devices(&out);
+    string_append(&out, "}\n");
+
+    FILE *file = fopen(output_path, "w");
+    bool ok = (file != NULL);
+
+    if (ok) {
+        ok = (fwrite(out.str, 1, out.pos, file) == out.pos);
+        ok = (fclose(file) == 0) && ok;
+    }
+
+    if (!ok) {
+        io_error(output_path);
+    }
+
+    string_done(&out);
+    return ok;
+}
@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Run report
+ *
+ */
+
+#ifndef REPORT_H_
+#define REPORT_H_
+
+#include <stdbool.h>
+
+extern void report_set_output(const char *path);
+extern bool report_write(void);
+
+#endif
@@ -0,0 +1,482 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Reverse execution
+ *
+ *  The machine state is saved into a snapshot every few machine
+ *  cycles (see the snapshots variable). The snapshots are checkpoints
+ *  in temporary files, most of them incremental, and they keep
+ *  a mark of the non-deterministic inputs taken so far (see replay.c).
+ *
+ *  Going back restores the nearest snapshot before the target cycle
+ *  and re-executes the machine up to the target, taking the inputs
+ *  kept since the mark. Going back to a breakpoint re-executes the
+ *  intervals between the snapshots from the latest one and stops at
+ *  the last breakpoint hit before the current cycle. Either way the
+ *  cost is bounded by the interval between the snapshots (per
+ *  interval searched). The device output is suppressed while the
+ *  cycles are re-executed.
+ *
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../assert.h"
+#include "../checkpoint.h"
+#include "../fault.h"
+#include "../machine.h"
+#include "../main.h"
+#include "../output.h"
+#include "../replay.h"
+#include "../utils.h"
+#include "reverse.h"
+
+/** Most snapshots kept (the oldest ones are dropped) */
+#define REVERSE_SNAPSHOTS 256
+
+/** Longest chain of incremental snapshots */
+#define REVERSE_CHAIN 16
+
+/** Snapshot of the machine state */
+typedef struct {
+    uint64_t cycle; /**< Machine cycle of the state */
+    char *path; /**< Checkpoint file */
+    unsigned int serial; /**< Number of the snapshot */
+    unsigned int depth; /**< Length of the chain of its bases (0 if full) */
+    unsigned int base; /**< Serial of its base (its own if full) */
+    replay_mark_t mark; /**< Position in the non-deterministic inputs */
+} snapshot_t;
+
+/** Cycles between the snapshots (0 for no reverse execution) */
+unsigned int reverse_interval = 0;
+
+/** Cycle of the next snapshot (UINT64_MAX for none) */
+uint64_t reverse_next = UINT64_MAX;
+
+/** True while the cycles are re-executed */
+bool reverse_rerun = false;
+
+static snapshot_t snapshots[REVERSE_SNAPSHOTS];
+static unsigned int snapshot_count = 0;
+static unsigned int snapshot_serial = 0;
+
+/** Snapshot the next incremental snapshot is based on */
+static unsigned int base_serial = 0;
+static bool base_valid = false;
+
+/** First machine cycle not simulated yet */
+static uint64_t horizon = 0;
+
+/** Last breakpoint hit before the limit */
+static reverse_hit_t last_hit;
+static bool hit_found = false;
+static uint64_t hit_limit = 0;
+
+static snapshot_t *snapshot_find(unsigned int serial)
+{
+    for (unsigned int i = 0; i < snapshot_count; i++) {
+        if (snapshots[i].serial == serial) {
+            return &snapshots[i];
+        }
+    }
+
+    return NULL;
+}
+
+/** Name the file of a snapshot in the temporary directory */
+static char *snapshot_path(unsigned int serial)
+{
+    const char *dir = getenv("TMPDIR");
+    if ((dir == NULL) || (dir[0] == 0)) {
+        dir = "/tmp";
+    }
+
+    string_t path;
+    string_init(&path);
+    string_printf(&path, "%s/msim-%ld-%u.snapshot", dir, (long) getpid(),
+            serial);
+
+    char *result = safe_strdup(path.str);
+    string_done(&path);
+
+    return result;
+}
+
+static void snapshot_done(snapshot_t *snapshot)
+{
+    remove(snapshot->path);
+    safe_free(snapshot->path);
+    replay_mark_done(&snapshot->mark);
+
+    if ((base_valid) && (base_serial == snapshot->serial)) {
+        base_valid = false;
+    }
+}
+
+/** Drop the oldest snapshots to make room for a new one
+ *
+ * The snapshots are dropped up to a full snapshot which no later
+ * snapshot is based on an earlier snapshot than.
+ *
+ * @return True if a room has been made.
+ *
+ */
+static bool reverse_drop(void)
+{
+    for (unsigned int i = 1; i < snapshot_count; i++) {
+        if (snapshots[i].depth != 0) {
+            continue;
+        }
+
+        bool independent = true;
+        for (unsigned int j = i; j < snapshot_count; j++) {
+            if (snapshots[j].base < snapshots[i].serial) {
+                independent = false;
+                break;
+            }
+        }
+
+        if (!independent) {
+            continue;
+        }
+
+        for (unsigned int j = 0; j < i; j++) {
+            snapshot_done(&snapshots[j]);
+        }
+
+        snapshot_count -= i;
+        memmove(snapshots, snapshots + i, snapshot_count * sizeof(snapshot_t));
+
+        replay_forget(&snapshots[0].mark);
+        return true;
+    }
+
+    return false;
+}
+
+/** Take a snapshot of the machine state
+ *
+ * Called by the main loop once the cycle of the next snapshot is
+ * reached. No snapshots are taken while the cycles simulated before
+ * are simulated again (they have their snapshots already).
+ *
+ */
+void reverse_snapshot(void)
+{
+    if (reverse_interval == 0) {
+        reverse_next = UINT64_MAX;
+        return;
+    }
+
+    if (steps < horizon) {
+        reverse_next = horizon;
+        return;
+    }
+
+    reverse_next = steps + reverse_interval;
+
+    if ((snapshot_count > 0) && (snapshots[snapshot_count - 1].cycle == steps)) {
+        return;
+    }
+
+    if ((snapshot_count == REVERSE_SNAPSHOTS) && (!reverse_drop())) {
+        return;
+    }
+
+    if (snapshot_serial == 0) {
+        atexit(reverse_done);
+    }
+
+    /* The base has to be the checkpoint saved or restored last */
+    snapshot_t *base = base_valid ? snapshot_find(base_serial) : NULL;
+    const char *last = checkpoint_last();
+    bool incremental = (base != NULL) && (last != NULL)
+            && (strcmp(last, base->path) == 0)
+            && (base->depth + 1 < REVERSE_CHAIN);
+
+    snapshot_t *snapshot = &snapshots[snapshot_count];
+    snapshot->serial = snapshot_serial++;
+    snapshot->path = snapshot_path(snapshot->serial);
+    snapshot->cycle = steps;
+    snapshot->depth = incremental ? base->depth + 1 : 0;
+    snapshot->base = incremental ? base->serial : snapshot->serial;
+
+    if (!checkpoint_save(snapshot->path, incremental, false)) {
+        remove(snapshot->path);
+        safe_free(snapshot->path);
+        base_valid = false;
+        return;
+    }
+
+    replay_mark(&snapshot->mark);
+    snapshot_count++;
+
+    base_serial = snapshot->serial;
+    base_valid = true;
+}
+
+/** Drop all snapshots
+ *
+ * The reverse execution starts over with the next snapshot.
+ *
+ */
+void reverse_done(void)
+{
+    for (unsigned int i = 0; i < snapshot_count; i++) {
+        snapshot_done(&snapshots[i]);
+    }
+
+    snapshot_count = 0;
+    horizon = 0;
+    base_valid = false;
+    reverse_next = (reverse_interval > 0) ? 0 : UINT64_MAX;
+}
+
+/** Change the snapshots variable
+ *
+ * Unsetting the variable drops the snapshots, setting it takes
+ * a snapshot before the next cycle.
+ *
+ */
+bool reverse_set_interval(unsigned int interval)
+{
+    reverse_interval = interval;
+
+    if (interval == 0) {
+        reverse_done();
+    } else {
+        reverse_next = steps;
+    }
+
+    return true;
+}
+
+/** Restore a snapshot
+ *
+ * The inputs are re-executed from its mark up to the horizon.
+ *
+ */
+static bool snapshot_restore(snapshot_t *snapshot)
+{
+    output_flush_all();
+
+    if (!checkpoint_restore(snapshot->path)) {
+        return false;
+    }
+
+    replay_rewind(&snapshot->mark, horizon);
+
+    base_serial = snapshot->serial;
+    base_valid = true;
+    reverse_next = horizon;
+
+    return true;
+}
+
+/** Re-execute the machine cycles up to the target cycle */
+static void reverse_run(uint64_t target)
+{
+    reverse_rerun = true;
+    output_muted = true;
+
+    machine_rerun(target);
+
+    output_muted = false;
+    reverse_rerun = false;
+}
+
+/** Find the latest snapshot before or at a cycle
+ *
+ * @return Index of the snapshot, -1 if there is none.
+ *
+ */
+static int snapshot_before(uint64_t cycle)
+{
+    for (int i = snapshot_count - 1; i >= 0; i--) {
+        if (snapshots[i].cycle <= cycle) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static bool reverse_possible(void)
+{
+    if (snapshot_count == 0) {
+        error("No snapshots to go back to (see the snapshots variable)");
+        return false;
+    }
+
+    if (steps > horizon) {
+        horizon = steps;
+    }
+
+    return true;
+}
+
+/** Go back by a number of machine cycles
+ *
+ * @param cycles Number of cycles.
+ * @param begin  Set to true if the oldest snapshot has been reached
+ *               before the cycles.
+ *
+ * @return True if successful.
+ *
+ */
+bool reverse_back(uint64_t cycles, bool *begin)
+{
+    ASSERT(begin != NULL);
+
+    if (!reverse_possible()) {
+        return false;
+    }
+
+    uint64_t target = (cycles < steps) ? steps - cycles : 0;
+    *begin = (target < snapshots[0].cycle);
+
+    if (*begin) {
+        target = snapshots[0].cycle;
+    }
+
+    if (!snapshot_restore(&snapshots[snapshot_before(target)])) {
+        return false;
+    }
+
+    hit_limit = 0;
+    reverse_run(target);
+    return true;
+}
+
+/** Go back to the last breakpoint hit
+ *
+ * The intervals between the snapshots are re-executed from the
+ * latest one until a breakpoint (a code or a memory breakpoint of
+ * any kind) is hit before the current cycle. The machine stops where
+ * the forward simulation would have stopped at the last such hit.
+ *
+ * @param hit   Breakpoint hit found.
+ * @param begin Set to true if no breakpoint has been hit since the
+ *              oldest snapshot, the machine stops at the snapshot.
+ *
+ * @return True if successful.
+ *
+ */
+bool reverse_continue(reverse_hit_t *hit, bool *begin)
+{
+    ASSERT(hit != NULL);
+    ASSERT(begin != NULL);
+
+    if (!reverse_possible()) {
+        return false;
+    }
+
+    uint64_t end = steps;
+    *begin = false;
+
+    for (int i = snapshot_before(end); i >= 0; i--) {
+        if (snapshots[i].cycle == end) {
+            continue;
+        }
+
+        uint64_t window_end = ((i + 1 < (int) snapshot_count)
+                                      && (snapshots[i + 1].cycle < end))
+                ? snapshots[i + 1].cycle
+                : end;
+
+        if (!snapshot_restore(&snapshots[i])) {
+            return false;
+        }
+
+        hit_found = false;
+        hit_limit = end;
+        reverse_run(window_end);
+
+        if (hit_found) {
+            *hit = last_hit;
+            hit_limit = 0;
+
+            if (!snapshot_restore(&snapshots[i])) {
+                return false;
+            }
+
+            reverse_run(hit->cycle);
+            return true;
+        }
+    }
+
+    *begin = true;
+    hit_limit = 0;
+
+    if (!snapshot_restore(&snapshots[0])) {
+        return false;
+    }
+
+    reverse_run(snapshots[0].cycle);
+    return true;
+}
+
+/** Forget the future of a re-executed machine whose state has changed
+ *
+ * The snapshots after the current cycle and the inputs kept after it
+ * no longer describe the machine, the simulation goes on as if the
+ * current cycle were the furthest one reached.
+ *
+ */
+void reverse_changed(void)
+{
+    if (steps >= horizon) {
+        return;
+    }
+
+    while ((snapshot_count > 0)
+            && (snapshots[snapshot_count - 1].cycle > steps)) {
+        snapshot_count--;
+        snapshot_done(&snapshots[snapshot_count]);
+    }
+
+    horizon = steps;
+    replay_cut();
+
+    if (reverse_interval > 0) {
+        reverse_next = steps + reverse_interval;
+    }
+}
+
+/** Note a code breakpoint hit while the cycles are re-executed */
+void reverse_hit_code(unsigned int cpuno)
+{
+    if (steps < hit_limit) {
+        last_hit.cycle = steps;
+        last_hit.cpuno = cpuno;
+        last_hit.watch = NULL;
+        last_hit.addr = 0;
+        hit_found = true;
+    }
+}
+
+/** Note a memory breakpoint hit while the cycles are re-executed
+ *
+ * The simulation stops after the cycle of the access.
+ *
+ */
+void reverse_hit_memory(physmem_breakpoint_t *breakpoint, ptr36_t addr)
+{
+    if (steps + 1 < hit_limit) {
+        last_hit.cycle = steps + 1;
+        last_hit.cpuno = 0;
+        last_hit.watch = breakpoint;
+        last_hit.addr = addr;
+        hit_found = true;
+    }
+}
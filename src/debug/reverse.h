@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Reverse execution
+ *
+ */
+
+#ifndef REVERSE_H_
+#define REVERSE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "breakpoint.h"
+
+/** Breakpoint hit found by the reverse execution */
+typedef struct {
+    uint64_t cycle; /**< Machine cycle the simulation stopped in */
+    unsigned int cpuno; /**< Processor of a code breakpoint */
+    physmem_breakpoint_t *watch; /**< Memory breakpoint (NULL for code) */
+    ptr36_t addr; /**< Address of the access of a memory breakpoint */
+} reverse_hit_t;
+
+extern unsigned int reverse_interval;
+extern uint64_t reverse_next;
+extern bool reverse_rerun;
+
+extern bool reverse_set_interval(unsigned int interval);
+extern void reverse_snapshot(void);
+extern void reverse_done(void);
+
+extern bool reverse_back(uint64_t cycles, bool *begin);
+extern bool reverse_continue(reverse_hit_t *hit, bool *begin);
+extern void reverse_changed(void);
+
+extern void reverse_hit_code(unsigned int cpuno);
+extern void reverse_hit_memory(physmem_breakpoint_t *breakpoint, ptr36_t addr);
+
+#endif
@@ -0,0 +1,641 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Statistics endpoint
+ *
+ *  The simulator listens on a TCP port or on a UNIX socket (see the
+ *  --stats-socket option) and answers each connection with the current
+ *  statistics of the machine: the cycles, the executed instructions,
+ *  the simulated MIPS since the previous request and the counters
+ *  exported by the devices (see the stats method of the device types).
+ *
+ *  The socket is polled by the main loop every STATSRV_POLL_CYCLES
+ *  machine cycles and never blocks the simulation. A request reading
+ *  "json" (or an HTTP request of a path ending with "json") gets the
+ *  statistics in JSON, any other request (or none within a short
+ *  while) gets them in the Prometheus text format.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "../arch/network.h"
+#include "../assert.h"
+#include "../device/cpu/general_cpu.h"
+#include "../device/device.h"
+#include "../fault.h"
+#include "../main.h"
+#include "../utils.h"
+#include "statsrv.h"
+
+/** Machine cycles between the polls of the socket */
+#define STATSRV_POLL_CYCLES 65536
+
+/** Host time a client is given to send its request (in seconds) */
+#define STATSRV_REQUEST_TIMEOUT 0.5
+
+/** Longest request read */
+#define STATSRV_REQUEST_SIZE 512
+
+/** Number of metrics allocated at once */
+#define STATSRV_GRANULARITY 32
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/** Value of a metric */
+typedef struct {
+    const char *device; /**< Name of the device (NULL for the machine) */
+    const char *type; /**< Device type */
+    const char *name;
+    const char *help;
+    char labels[STATSRV_LABELS_SIZE]; /**< Further labels (empty for none) */
+    bool counter; /**< Counter (a gauge otherwise) */
+    uint64_t count;
+    double value;
+} statsrv_metric_t;
+
+struct statsrv {
+    statsrv_metric_t *metrics;
+    size_t count;
+    device_t *dev; /**< Device exporting its counters */
+};
+
+/** Machine cycle of the next poll (UINT64_MAX for no endpoint) */
+uint64_t statsrv_next = UINT64_MAX;
+
+static int listen_fd = -1;
+
+/** Client waiting for the answer (-1 for none) */
+static int client_fd = -1;
+static char request[STATSRV_REQUEST_SIZE + 1];
+static size_t request_len = 0;
+static double request_deadline = 0;
+
+/** UNIX socket to unlink when done (NULL for a TCP port) */
+static char *socket_path = NULL;
+
+/** Process which created the socket (not the forked batch machines) */
+static pid_t socket_owner = 0;
+
+/** Instructions and host time of the previous answer (for the MIPS) */
+static uint64_t last_instructions = 0;
+static double last_time = 0;
+
+static double statsrv_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool statsrv_nonblocking(int fd)
+{
+#ifdef __WIN32__
+    u_long yes = 1;
+    return ioctlsocket(fd, FIONBIO, &yes) == 0;
+#else
+    int flags = fcntl(fd, F_GETFL, 0);
+    return (flags != -1) && (fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1);
+#endif
+}
+
+static statsrv_metric_t *statsrv_add(statsrv_t *stats, const char *name,
+        const char *help)
+{
+    ASSERT(stats != NULL);
+
+    if ((stats->count % STATSRV_GRANULARITY) == 0) {
+        stats->metrics = (statsrv_metric_t *) realloc(stats->metrics,
+                (stats->count + STATSRV_GRANULARITY) * sizeof(statsrv_metric_t));
+        if (stats->metrics == NULL) {
+            die(ERR_MEM, "Not enough memory");
+        }
+    }
+
+    statsrv_metric_t *metric = &stats->metrics[stats->count++];
+
+    metric->device = (stats->dev != NULL) ? stats->dev->name : NULL;
+    metric->type = (stats->dev != NULL) ? stats->dev->type->name : NULL;
+    metric->name = name;
+    metric->help = help;
+    metric->labels[0] = 0;
+
+    return metric;
+}
+
+/** Export a counter
+ *
+ * Called by the stats methods of the devices, the counter
+ * is labeled by the device.
+ *
+ * @param name Name of the counter (ending with _total).
+ *
+ */
+void statsrv_counter(statsrv_t *stats, const char *name, const char *help,
+        uint64_t value)
+{
+    statsrv_metric_t *metric = statsrv_add(stats, name, help);
+
+    metric->counter = true;
+    metric->count = value;
+}
+
+/** Export a counter distinguished by further labels
+ *
+ * The counters of the same name and device differ by the labels,
+ * such as the buckets of a histogram.
+ *
+ * @param labels Labels in the Prometheus format (name="value",...).
+ *
+ */
+void statsrv_counter_labeled(statsrv_t *stats, const char *name,
+        const char *help, const char *labels, uint64_t value)
+{
+    ASSERT(strlen(labels) < STATSRV_LABELS_SIZE);
+
+    statsrv_metric_t *metric = statsrv_add(stats, name, help);
+
+    strcpy(metric->labels, labels);
+    metric->counter = true;
+    metric->count = value;
+}
+
+/** Export a value that can go up and down */
+void statsrv_gauge(statsrv_t *stats, const char *name, const char *help,
+        double value)
+{
+    statsrv_metric_t *metric = statsrv_add(stats, name, help);
+
+    metric->counter = false;
+    metric->value = value;
+}
+
+/** Collect the statistics of the machine and of the devices */
+static void statsrv_collect(statsrv_t *stats)
+{
+    uint64_t instructions = cpu_instructions_all();
+    double now = statsrv_time();
+    double seconds = now - last_time;
+
+    stats->metrics = NULL;
+    stats->count = 0;
+    stats->dev = NULL;
+
+    statsrv_counter(stats, "cycles_total", "Machine cycles", steps);
+    statsrv_counter(stats, "instructions_total",
+            "Instructions executed by all processors", instructions);
+    statsrv_gauge(stats, "mips",
+            "Simulated instructions per microsecond since the previous request",
+            ((seconds > 0) && (instructions >= last_instructions))
+                    ? (instructions - last_instructions) / seconds / 1e6
+                    : 0);
+
+    last_instructions = instructions;
+    last_time = now;
+
+    device_t *dev = NULL;
+    while (dev_next(&dev, DEVICE_FILTER_ALL)) {
+        if (dev->type->stats != NULL) {
+            stats->dev = dev;
+            dev->type->stats(dev, stats);
+        }
+    }
+}
+
+static void statsrv_print_value(string_t *out, const statsrv_metric_t *metric)
+{
+    if (metric->counter) {
+        string_printf(out, "%" PRIu64, metric->count);
+    } else {
+        string_printf(out, "%.3f", metric->value);
+    }
+}
+
+/** Format the statistics in the Prometheus text format
+ *
+ * The metrics of the same name are grouped under a single
+ * description, labeled by the devices.
+ *
+ */
+static void statsrv_prometheus(const statsrv_t *stats, string_t *out)
+{
+    for (size_t i = 0; i < stats->count; i++) {
+        const statsrv_metric_t *first = &stats->metrics[i];
+        bool described = false;
+
+        for (size_t j = 0; j < i; j++) {
+            if (strcmp(stats->metrics[j].name, first->name) == 0) {
+                described = true;
+                break;
+            }
+        }
+
+        if (described) {
+            continue;
+        }
+
+        string_printf(out, "# HELP msim_%s %s\n", first->name, first->help);
+        string_printf(out, "# TYPE msim_%s %s\n", first->name,
+                first->counter ? "counter" : "gauge");
+
+        for (size_t j = i; j < stats->count; j++) {
+            const statsrv_metric_t *metric = &stats->metrics[j];
+
+            if (strcmp(metric->name, first->name) != 0) {
+                continue;
+            }
+
+            if (metric->device != NULL) {
+                string_printf(out, "msim_%s{device=\"%s\",type=\"%s\"%s%s} ",
+                        metric->name, metric->device, metric->type,
+                        (metric->labels[0] != 0) ? "," : "", metric->labels);
+            } else if (metric->labels[0] != 0) {
+                string_printf(out, "msim_%s{%s} ", metric->name, metric->labels);
+            } else {
+                string_printf(out, "msim_%s ", metric->name);
+            }
+
+            statsrv_print_value(out, metric);
+            string_push(out, '\n');
+        }
+    }
+}
+
+/** Format a metric as a JSON member */
+static void statsrv_json_member(const statsrv_metric_t *metric, bool first,
+        string_t *out)
+{
+    string_printf(out, "%s\"%s", first ? "" : ",", metric->name);
+
+    /* The labels are a part of the name, with the quotes escaped */
+    if (metric->labels[0] != 0) {
+        string_push(out, '{');
+        for (const char *c = metric->labels; *c != 0; c++) {
+            if (*c == '"') {
+                string_push(out, '\\');
+            }
+            string_push(out, *c);
+        }
+        string_push(out, '}');
+    }
+
+    string_append(out, "\":");
+    statsrv_print_value(out, metric);
+}
+
+/** Format the counters of the devices in JSON
+ *
+ * The counters are objects named by the devices.
+ *
+ * @param from Index of the first metric of the devices.
+ *
+ */
+static void statsrv_json_devices(const statsrv_t *stats, size_t from,
+        string_t *out)
+{
+    const char *device = NULL;
+
+    string_append(out, "{");
+
+    for (size_t i = from; i < stats->count; i++) {
+        const statsrv_metric_t *metric = &stats->metrics[i];
+
+        if (metric->device != device) {
+            string_printf(out, "%s\"%s\":{\"type\":\"%s\"",
+                    (device != NULL) ? "}," : "", metric->device, metric->type);
+            device = metric->device;
+        }
+
+        statsrv_json_member(metric, false, out);
+    }
+
+    string_append(out, (device != NULL) ? "}}" : "}");
+}
+
+/** Format the statistics in JSON
+ *
+ * The counters of the devices are objects named by the devices.
+ *
+ */
+static void statsrv_json(const statsrv_t *stats, string_t *out)
+{
+    size_t i;
+
+    string_append(out, "{");
+
+    /* The machine metrics precede the ones of the devices */
+    for (i = 0; (i < stats->count) && (stats->metrics[i].device == NULL); i++) {
+        statsrv_json_member(&stats->metrics[i], i == 0, out);
+    }
+
+    if (i < stats->count) {
+        string_append(out, ",\"devices\":");
+        statsrv_json_devices(stats, i, out);
+    }
+
+    string_append(out, "}\n");
+}
+
+/** Answer the waiting client and close the connection */
+static void statsrv_answer(void)
+{
+    request[request_len] = 0;
+
+    char *end = strpbrk(request, "\r\n");
+    if (end != NULL) {
+        *end = 0;
+    }
+
+    /* The path of an HTTP request */
+    bool http = (strncmp(request, "GET ", 4) == 0);
+    char *what = http ? request + 4 : request;
+
+    end = strchr(what, ' ');
+    if (end != NULL) {
+        *end = 0;
+    }
+
+    size_t len = strlen(what);
+    bool json = (len >= 4) && (strcmp(what + len - 4, "json") == 0);
+
+    statsrv_t stats;
+    statsrv_collect(&stats);
+
+    string_t body;
+    string_init(&body);
+
+    if (json) {
+        statsrv_json(&stats, &body);
+    } else {
+        statsrv_prometheus(&stats, &body);
+    }
+
+    string_t out;
+    string_init(&out);
+
+    if (http) {
+        string_printf(&out, "HTTP/1.0 200 OK\r\n"
+                            "Content-Type: %s\r\n"
+                            "Content-Length: %zu\r\n"
+                            "Connection: close\r\n\r\n",
+                json ? "application/json" : "text/plain; version=0.0.4",
+                body.pos);
+    }
+
+    string_append(&out, body.str);
+
+    /* The answer fits into the socket buffer, the client is not waited for */
+    size_t pos = 0;
+    while (pos < out.pos) {
+        ssize_t written = send(client_fd, out.str + pos, out.pos - pos, MSG_NOSIGNAL);
+        if (written <= 0) {
+            break;
+        }
+
+        pos += written;
+    }
+
+    string_done(&out);
+    string_done(&body);
+    safe_free(stats.metrics);
+
+    close(client_fd);
+    client_fd = -1;
+}
+
+/** Collect the statistics and pass them to a visitor
+ *
+ * The statistics are those of an answer of the endpoint (the MIPS
+ * is measured since the previous answer or visit). The strings are
+ * valid during the call of the visitor only.
+ *
+ */
+void statsrv_visit(statsrv_visit_fnc_t fnc, void *arg)
+{
+    statsrv_t stats;
+    statsrv_collect(&stats);
+
+    for (size_t i = 0; i < stats.count; i++) {
+        const statsrv_metric_t *metric = &stats.metrics[i];
+
+        fnc(arg, metric->device, metric->name, metric->labels,
+                metric->counter, metric->count, metric->value);
+    }
+
+    safe_free(stats.metrics);
+}
+
+/** Format the counters of the devices in JSON
+ *
+ * The counters are objects named by the devices (see the answers
+ * of the endpoint in JSON).
+ *
+ */
+void statsrv_write_devices(string_t *out)
+{
+    statsrv_t stats;
+    statsrv_collect(&stats);
+
+    size_t i = 0;
+    while ((i < stats.count) && (stats.metrics[i].device == NULL)) {
+        i++;
+    }
+
+    statsrv_json_devices(&stats, i, out);
+    safe_free(stats.metrics);
+}
+
+/** Read the request of the waiting client
+ *
+ * @return True if the request is complete (or is not going to be).
+ *
+ */
+static bool statsrv_receive(void)
+{
+    while (request_len < STATSRV_REQUEST_SIZE) {
+        ssize_t rd = recv(client_fd, request + request_len,
+                STATSRV_REQUEST_SIZE - request_len, 0);
+
+        if (rd == 0) {
+            return true;
+        }
+
+        if (rd < 0) {
+            return ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                    || (statsrv_time() >= request_deadline);
+        }
+
+        request_len += rd;
+
+        if (memchr(request, '\n', request_len) != NULL) {
+            return true;
+        }
+    }
+
+    return true;
+}
+
+/** Serve the waiting client and accept a new one
+ *
+ * Called by the main loop, never blocks.
+ *
+ */
+void statsrv_poll(void)
+{
+    statsrv_next = steps + STATSRV_POLL_CYCLES;
+
+    if ((client_fd != -1) && (statsrv_receive())) {
+        statsrv_answer();
+    }
+
+    if (client_fd != -1) {
+        return;
+    }
+
+    client_fd = accept(listen_fd, NULL, NULL);
+    if (client_fd < 0) {
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+            io_error("accept");
+        }
+
+        client_fd = -1;
+        return;
+    }
+
+    if (!statsrv_nonblocking(client_fd)) {
+        io_error("fcntl");
+    }
+
+    request_len = 0;
+    request_deadline = statsrv_time() + STATSRV_REQUEST_TIMEOUT;
+
+    if (statsrv_receive()) {
+        statsrv_answer();
+    }
+}
+
+/** Open the statistics endpoint
+ *
+ * @param address Port number of the TCP socket or the path of the
+ *                UNIX socket (replaced if it exists).
+ *
+ * @return True if successful.
+ *
+ */
+bool statsrv_open(const char *address)
+{
+    ASSERT(address != NULL);
+
+    char *endp;
+    long int port = strtol(address, &endp, 10);
+    bool tcp = (address[0] != 0) && (*endp == 0);
+
+    if ((tcp) && ((port < 0) || (port > 65535))) {
+        error("Invalid port number");
+        return false;
+    }
+
+#ifdef __WIN32__
+    if (!tcp) {
+        error("UNIX sockets are not supported on this platform");
+        return false;
+    }
+#endif
+
+    listen_fd = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        io_error("socket");
+        return false;
+    }
+
+    int rc = -1;
+
+    if (tcp) {
+        int yes = 1;
+        if (setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, (void *) &yes, sizeof(yes))) {
+            io_error("setsockopt");
+        }
+
+        struct sockaddr_in sa;
+        memset(&sa, 0, sizeof(sa));
+
+        sa.sin_family = AF_INET;
+        sa.sin_addr.s_addr = htonl(INADDR_ANY);
+        sa.sin_port = htons(port);
+
+        rc = bind(listen_fd, (struct sockaddr *) &sa, sizeof(sa));
+    } else {
+#ifndef __WIN32__
+        struct sockaddr_un sa;
+        memset(&sa, 0, sizeof(sa));
+
+        if (strlen(address) >= sizeof(sa.sun_path)) {
+            error("Socket path too long");
+            close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+
+        sa.sun_family = AF_UNIX;
+        strcpy(sa.sun_path, address);
+        unlink(address);
+
+        rc = bind(listen_fd, (struct sockaddr *) &sa, sizeof(sa));
+        socket_path = safe_strdup(address);
+        socket_owner = getpid();
+#endif
+    }
+
+    if ((rc < 0) || (listen(listen_fd, 4) < 0)
+            || (!statsrv_nonblocking(listen_fd))) {
+        io_error(address);
+        statsrv_done();
+        return false;
+    }
+
+    last_time = statsrv_time();
+    statsrv_next = 0;
+    atexit(statsrv_done);
+
+    return true;
+}
+
+/** Close the statistics endpoint */
+void statsrv_done(void)
+{
+    if (client_fd != -1) {
+        close(client_fd);
+        client_fd = -1;
+    }
+
+    if (listen_fd != -1) {
+        close(listen_fd);
+        listen_fd = -1;
+    }
+
+    if (socket_path != NULL) {
+        if (socket_owner == getpid()) {
+            unlink(socket_path);
+        }
+
+        safe_free(socket_path);
+    }
+
+    statsrv_next = UINT64_MAX;
+}
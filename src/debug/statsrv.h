@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Statistics endpoint
+ *
+ */
+
+#ifndef STATSRV_H_
+#define STATSRV_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../utils.h"
+
+/** Longest labels of a metric (besides the device) */
+#define STATSRV_LABELS_SIZE 48
+
+/** Statistics collected for a request */
+typedef struct statsrv statsrv_t;
+
+/** Visitor of the collected metrics (see statsrv_visit())
+ *
+ * @param device Name of the device (NULL for the machine).
+ * @param labels Further labels (empty for none).
+ * @param count  Value of a counter.
+ * @param value  Value of a gauge.
+ *
+ */
+typedef void (*statsrv_visit_fnc_t)(void *arg, const char *device,
+        const char *name, const char *labels, bool counter, uint64_t count,
+        double value);
+
+extern uint64_t statsrv_next;
+
+extern bool statsrv_open(const char *address);
+extern void statsrv_poll(void);
+extern void statsrv_done(void);
+extern void statsrv_visit(statsrv_visit_fnc_t fnc, void *arg);
+extern void statsrv_write_devices(string_t *out);
+
+extern void statsrv_counter(statsrv_t *stats, const char *name,
+        const char *help, uint64_t value);
+extern void statsrv_counter_labeled(statsrv_t *stats, const char *name,
+        const char *help, const char *labels, uint64_t value);
+extern void statsrv_gauge(statsrv_t *stats, const char *name,
+        const char *help, double value);
+
+#endif
@@ -0,0 +1,344 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Symbols of the guest code read from ELF files
+ *
+ *  The function symbols and the global untyped labels (the local ones
+ *  are mostly the branch targets of assembly code) defined in the symbol
+ *  tables of 32-bit and 64-bit ELF files (of either endianness) are
+ *  read into a table sorted by the address. The addresses of 32-bit
+ *  MIPS files are sign-extended like the program counter of R4000.
+ *  Several files (e.g. a kernel and its user programs) may be loaded.
+ *
+ */
+
+#include "symtab.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../assert.h"
+#include "../elf.h"
+#include "../fault.h"
+#include "../utils.h"
+
+/** Symbols sorted by the address */
+static symbol_t *symbols = NULL;
+static size_t symbol_count = 0;
+static size_t symbol_capacity = 0;
+
+static void symbol_add(uint64_t addr, uint64_t size, const char *name)
+{
+    if (symbol_count == symbol_capacity) {
+        symbol_capacity = (symbol_capacity == 0) ? 256 : 2 * symbol_capacity;
+        symbols = (symbol_t *) realloc(symbols,
+                symbol_capacity * sizeof(symbol_t));
+
+        if (symbols == NULL) {
+            die(ERR_MEM, "Not enough memory");
+        }
+    }
+
+    symbol_t *symbol = &symbols[symbol_count++];
+    symbol->addr = addr;
+    symbol->size = size;
+    symbol->name = safe_strdup(name);
+}
+
+/** Order of the symbols
+ *
+ * Of the symbols with the same address, the sized one goes first.
+ *
+ */
+static int symbol_compare(const void *a, const void *b)
+{
+    const symbol_t *sa = (const symbol_t *) a;
+    const symbol_t *sb = (const symbol_t *) b;
+
+    if (sa->addr != sb->addr) {
+        return (sa->addr < sb->addr) ? -1 : 1;
+    }
+
+    if (sa->size != sb->size) {
+        return (sa->size > sb->size) ? -1 : 1;
+    }
+
+    return strcmp(sa->name, sb->name);
+}
+
+/** Sort the symbols and keep only the first one of each address */
+static void symbols_sort(void)
+{
+    qsort(symbols, symbol_count, sizeof(symbol_t), symbol_compare);
+
+    size_t kept = 0;
+
+    for (size_t i = 0; i < symbol_count; i++) {
+        if ((kept > 0) && (symbols[kept - 1].addr == symbols[i].addr)) {
+            safe_free(symbols[i].name);
+            continue;
+        }
+
+        symbols[kept++] = symbols[i];
+    }
+
+    symbol_count = kept;
+}
+
+/** Read the symbols of a symbol table section
+ *
+ * @return True if the section is valid.
+ *
+ */
+static bool elf_read_symtab(const elf_file_t *elf, size_t shdr,
+        size_t shentsize, size_t shnum, bool sign_extend)
+{
+    uint64_t offset;
+    uint64_t size;
+    uint32_t link;
+    size_t symentsize;
+
+    if (elf->is64) {
+        offset = elf_get(elf, shdr + 24, 8);
+        size = elf_get(elf, shdr + 32, 8);
+        link = elf_get(elf, shdr + 40, 4);
+        symentsize = 24;
+    } else {
+        offset = elf_get(elf, shdr + 16, 4);
+        size = elf_get(elf, shdr + 20, 4);
+        link = elf_get(elf, shdr + 24, 4);
+        symentsize = 16;
+    }
+
+    if ((!elf_contains(elf, offset, size)) || (link >= shnum)) {
+        return false;
+    }
+
+    /* String table of the symbol names */
+    size_t strhdr = elf_get(elf, elf->is64 ? 40 : 32, elf->is64 ? 8 : 4)
+            + link * shentsize;
+    uint64_t stroff = elf_get(elf, strhdr + (elf->is64 ? 24 : 16), elf->is64 ? 8 : 4);
+    uint64_t strsize = elf_get(elf, strhdr + (elf->is64 ? 32 : 20), elf->is64 ? 8 : 4);
+
+    if ((!elf_contains(elf, stroff, strsize)) || (strsize == 0)
+            || (elf->data[stroff + strsize - 1] != 0)) {
+        return false;
+    }
+
+    for (uint64_t sym = offset; sym + symentsize <= offset + size; sym += symentsize) {
+        uint32_t name = elf_get(elf, sym, 4);
+        uint64_t value;
+        uint64_t symsize;
+        uint8_t info;
+        uint16_t shndx;
+
+        if (elf->is64) {
+            info = elf->data[sym + 4];
+            shndx = elf_get(elf, sym + 6, 2);
+            value = elf_get(elf, sym + 8, 8);
+            symsize = elf_get(elf, sym + 16, 8);
+        } else {
+            value = elf_get(elf, sym + 4, 4);
+            symsize = elf_get(elf, sym + 8, 4);
+            info = elf->data[sym + 12];
+            shndx = elf_get(elf, sym + 14, 2);
+        }
+
+        unsigned int type = info & 0x0f;
+        unsigned int bind = info >> 4;
+
+        if (((type != ELF_SYMBOL_FUNC)
+                && ((type != ELF_SYMBOL_NOTYPE) || (bind == ELF_BIND_LOCAL)))
+                || (shndx == ELF_SECTION_UNDEF) || (shndx == ELF_SECTION_ABS)
+                || (name >= strsize)) {
+            continue;
+        }
+
+        const char *str = (const char *) elf->data + stroff + name;
+
+        /* Skip the anonymous, local and mapping labels */
+        if ((str[0] == 0) || (str[0] == '$') || (prefix(".L", str))) {
+            continue;
+        }
+
+        if (sign_extend) {
+            value = (uint64_t) (int64_t) (int32_t) value;
+        }
+
+        symbol_add(value, symsize, str);
+    }
+
+    return true;
+}
+
+/** Read the symbols of an ELF file in the memory
+ *
+ * @return True if the file is valid.
+ *
+ */
+static bool elf_read(elf_file_t *elf)
+{
+    if (!elf_identify(elf)) {
+        return false;
+    }
+
+    bool sign_extend = (!elf->is64)
+            && (elf_get(elf, 18, 2) == ELF_MACHINE_MIPS);
+
+    uint64_t shoff = elf_get(elf, elf->is64 ? 40 : 32, elf->is64 ? 8 : 4);
+    size_t shentsize = elf_get(elf, elf->is64 ? 58 : 46, 2);
+    size_t shnum = elf_get(elf, elf->is64 ? 60 : 48, 2);
+
+    if ((shentsize < (elf->is64 ? 64 : 40))
+            || (!elf_contains(elf, shoff, (uint64_t) shentsize * shnum))) {
+        return false;
+    }
+
+    for (size_t i = 0; i < shnum; i++) {
+        size_t shdr = shoff + i * shentsize;
+
+        if ((elf_get(elf, shdr + 4, 4) == ELF_SECTION_SYMTAB)
+                && (!elf_read_symtab(elf, shdr, shentsize, shnum, sign_extend))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/** Read the symbols of an ELF file in the memory
+ *
+ * The symbols are added to the symbols loaded before.
+ *
+ * @param data File contents.
+ * @param size File size.
+ * @param path File name for the error messages.
+ *
+ * @return True if successful.
+ *
+ */
+bool symtab_read(const uint8_t *data, size_t size, const char *path)
+{
+    ASSERT(data != NULL);
+    ASSERT(path != NULL);
+
+    elf_file_t elf = {
+        .data = data,
+        .size = size
+    };
+
+    size_t count = symbol_count;
+
+    if (!elf_read(&elf)) {
+        /* Forget the symbols read from the invalid file */
+        while (symbol_count > count) {
+            safe_free(symbols[--symbol_count].name);
+        }
+
+        error("%s is not a valid ELF file", path);
+        return false;
+    }
+
+    symbols_sort();
+    return true;
+}
+
+/** Load the symbols of an ELF file
+ *
+ * The symbols are added to the symbols loaded before.
+ *
+ * @return True if successful.
+ *
+ */
+bool symtab_load(const char *path)
+{
+    ASSERT(path != NULL);
+
+    FILE *file = try_fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    if (!try_fseek(file, 0, SEEK_END, path)) {
+        return false;
+    }
+
+    size_t size;
+    if (!try_ftell(file, path, &size)) {
+        return false;
+    }
+
+    if (!try_fseek(file, 0, SEEK_SET, path)) {
+        return false;
+    }
+
+    uint8_t *data = (uint8_t *) safe_malloc(size + 1);
+
+    if (fread(data, 1, size, file) != size) {
+        io_error(path);
+        safe_free(data);
+        safe_fclose(file, path);
+        return false;
+    }
+
+    safe_fclose(file, path);
+
+    bool ok = symtab_read(data, size, path);
+    safe_free(data);
+
+    return ok;
+}
+
+/** Find the symbol of an address
+ *
+ * @return The symbol with the highest address not above the address
+ *         which covers it, NULL if there is none.
+ *
+ */
+const symbol_t *symtab_find(uint64_t addr)
+{
+    size_t lo = 0;
+    size_t hi = symbol_count;
+
+    /* The first symbol above the address */
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (symbols[mid].addr <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == 0) {
+        return NULL;
+    }
+
+    const symbol_t *symbol = &symbols[lo - 1];
+
+    if ((symbol->size != 0) && (addr - symbol->addr >= symbol->size)) {
+        return NULL;
+    }
+
+    return symbol;
+}
+
+/** Release the loaded symbols */
+void symtab_done(void)
+{
+    for (size_t i = 0; i < symbol_count; i++) {
+        safe_free(symbols[i].name);
+    }
+
+    safe_free(symbols);
+    symbol_count = 0;
+    symbol_capacity = 0;
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Symbols of the guest code read from ELF files
+ *
+ */
+
+#ifndef SYMTAB_H_
+#define SYMTAB_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Symbol of the guest code */
+typedef struct {
+    uint64_t addr; /**< Virtual address as seen in the program counter */
+    uint64_t size; /**< Zero if the symbol extends up to the next one */
+    char *name;
+} symbol_t;
+
+extern bool symtab_load(const char *path);
+extern bool symtab_read(const uint8_t *data, size_t size, const char *path);
+extern const symbol_t *symtab_find(uint64_t addr);
+extern void symtab_done(void);
+
+#endif
@@ -0,0 +1,443 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Binary execution trace
+ *
+ *  Instead of disassembling each executed instruction as it runs,
+ *  the trace mode can write fixed-size records (the instruction
+ *  address, the raw instruction and optionally the changed general
+ *  registers) to a file. The records are buffered and written out in
+ *  large blocks. The file is disassembled offline by the decoder,
+ *  which uses the same mnemonics tables as the trace mode.
+ *
+ *  The system events (the exceptions, the interrupts, the changes of
+ *  the address translation and the device register accesses) can be
+ *  recorded on their own by the events variable, which costs only a
+ *  test on the paths of the events. They are written to the trace
+ *  file if one is open, printed as they happen otherwise.
+ *
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../assert.h"
+#include "../endian.h"
+#include "../fault.h"
+#include "../main.h"
+#include "../utils.h"
+#include "trace.h"
+
+#include "../device/cpu/mips_r4000/cpu.h"
+#include "../device/cpu/mips_r4000/debug.h"
+
+/** This is necessary evil... */
+#include "../device/cpu/riscv_rv32ima/cpu.h"
+#include "../device/cpu/riscv_rv32ima/debug.h"
+#undef XLEN
+#include "../device/cpu/riscv_rv64ima/cpu.h"
+#include "../device/cpu/riscv_rv64ima/debug.h"
+#undef XLEN
+
+#include "../device/cpu/isa.h"
+
+/** Number of records buffered before they are written out */
+#define TRACE_BUFFER_RECORDS 4096
+
+bool trace_active = false;
+bool trace_events = false;
+
+static FILE *trace_file = NULL;
+static uint8_t trace_buffer[TRACE_BUFFER_RECORDS * TRACE_RECORD_SIZE];
+static size_t trace_len = 0;
+
+/** Last printed event (names the values of the argument records) */
+static trace_event_kind_t last_event = 0;
+static trace_arch_t last_arch = TRACE_ARCH_NONE;
+static unsigned int last_args = 0;
+
+static void put_uint32(uint8_t *dst, uint32_t val)
+{
+    val = convert_uint32_t_endian(val);
+    memcpy(dst, &val, sizeof(val));
+}
+
+static void put_uint64(uint8_t *dst, uint64_t val)
+{
+    val = convert_uint64_t_endian(val);
+    memcpy(dst, &val, sizeof(val));
+}
+
+static uint32_t get_uint32(const uint8_t *src)
+{
+    uint32_t val;
+    memcpy(&val, src, sizeof(val));
+    return convert_uint32_t_endian(val);
+}
+
+static uint64_t get_uint64(const uint8_t *src)
+{
+    uint64_t val;
+    memcpy(&val, src, sizeof(val));
+    return convert_uint64_t_endian(val);
+}
+
+/** Open the trace file
+ *
+ * The file is created (or truncated) and the header is written.
+ * A trace file opened before is closed first.
+ *
+ * @return True if successful.
+ *
+ */
+bool trace_open(const char *path)
+{
+    ASSERT(path != NULL);
+
+    trace_close();
+
+    trace_file = fopen(path, "wb");
+    if (trace_file == NULL) {
+        io_error(path);
+        return false;
+    }
+
+    uint8_t header[TRACE_HEADER_SIZE];
+    memcpy(header, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    put_uint32(header + 8, TRACE_VERSION);
+    put_uint32(header + 12, TRACE_RECORD_SIZE);
+
+    if (fwrite(header, sizeof(header), 1, trace_file) != 1) {
+        io_error(path);
+        fclose(trace_file);
+        trace_file = NULL;
+        return false;
+    }
+
+    trace_active = true;
+    return true;
+}
+
+/** Write the buffered records to the trace file */
+void trace_flush(void)
+{
+    if ((trace_file == NULL) || (trace_len == 0)) {
+        return;
+    }
+
+    if (fwrite(trace_buffer, trace_len, 1, trace_file) != 1) {
+        error("Unable to write the trace file, tracing to a file stopped");
+        fclose(trace_file);
+        trace_file = NULL;
+        trace_active = false;
+    }
+
+    trace_len = 0;
+}
+
+/** Flush and close the trace file */
+void trace_close(void)
+{
+    if (trace_file == NULL) {
+        return;
+    }
+
+    trace_flush();
+
+    if (trace_file != NULL) {
+        fclose(trace_file);
+        trace_file = NULL;
+    }
+
+    trace_active = false;
+}
+
+/** Append a record to the trace file */
+void trace_record(const trace_record_t *record)
+{
+    ASSERT(record != NULL);
+    ASSERT(trace_active);
+
+    uint8_t *dst = trace_buffer + trace_len;
+
+    dst[0] = record->kind;
+    dst[1] = record->cpuno;
+    dst[2] = record->arch;
+    dst[3] = record->reg;
+    put_uint32(dst + 4, record->instr);
+    put_uint64(dst + 8, record->value);
+
+    trace_len += TRACE_RECORD_SIZE;
+
+    if (trace_len == sizeof(trace_buffer)) {
+        trace_flush();
+    }
+}
+
+/** Print an instruction record as the trace mode does */
+void trace_print_instr(const trace_record_t *record)
+{
+    printf("cpu%-2u ", record->cpuno);
+
+    switch (record->arch) {
+#if ISA_R4K
+    case TRACE_ARCH_R4K: {
+        ptr64_t addr;
+        addr.ptr = record->value;
+
+        r4k_instr_t instr;
+        instr.val = record->instr;
+
+        r4k_idump(NULL, addr, instr, false);
+        break;
+    }
+#endif
+#if ISA_RV32
+    case TRACE_ARCH_RV32: {
+        rv_instr_t instr;
+        instr.val = record->instr;
+
+        rv32_idump(NULL, (uint32_t) record->value, instr);
+        break;
+    }
+#endif
+#if ISA_RV64
+    case TRACE_ARCH_RV64: {
+        rv_instr_t instr;
+        instr.val = record->instr;
+
+        rv64_idump(NULL, (uint32_t) record->value, instr);
+        break;
+    }
+#endif
+    default:
+        printf("%#018" PRIx64 " unknown architecture %u\n",
+                record->value, record->arch);
+    }
+}
+
+/** Print an event record */
+static void print_event(const trace_record_t *record)
+{
+    last_event = record->reg;
+    last_arch = record->arch;
+    last_args = 0;
+
+    printf("cpu%-2u ", record->cpuno);
+
+    switch (record->reg) {
+    case TRACE_EVENT_EXCEPTION:
+        printf("exception %u at %#" PRIx64 "\n", record->instr, record->value);
+        break;
+    case TRACE_EVENT_INTERRUPT:
+        printf("interrupt %u at %#" PRIx64 "\n", record->instr, record->value);
+        break;
+    case TRACE_EVENT_RAISE:
+        printf("interrupt %u raised\n", record->instr);
+        break;
+    case TRACE_EVENT_CANCEL:
+        printf("interrupt %u cancelled\n", record->instr);
+        break;
+    case TRACE_EVENT_TLB_FLUSH:
+        printf("sfence.vma ");
+
+        if (record->value == UINT64_MAX) {
+            printf("all addresses");
+        } else {
+            printf("%#" PRIx64, record->value);
+        }
+
+        if (record->instr == UINT32_MAX) {
+            printf(", all ASIDs\n");
+        } else {
+            printf(", ASID %u\n", record->instr);
+        }
+        break;
+    case TRACE_EVENT_TLB_WRITE:
+        printf("TLB entry %u written, EntryHi %#" PRIx64 "\n",
+                record->instr, record->value);
+        break;
+    case TRACE_EVENT_SPACE:
+        printf("%s %#" PRIx64 "\n",
+                (record->arch == TRACE_ARCH_R4K) ? "EntryHi" : "satp",
+                record->value);
+        break;
+    case TRACE_EVENT_MMIO_READ:
+        printf("mmio read%u %#" PRIx64 "\n", record->instr * 8, record->value);
+        break;
+    case TRACE_EVENT_MMIO_WRITE:
+        printf("mmio write%u %#" PRIx64 "\n", record->instr * 8, record->value);
+        break;
+    default:
+        printf("unknown event %u\n", record->reg);
+    }
+}
+
+/** Print an argument record of the last event */
+static void print_event_arg(const trace_record_t *record)
+{
+    const char *name;
+
+    switch (last_event) {
+    case TRACE_EVENT_EXCEPTION:
+        name = (last_arch == TRACE_ARCH_R4K) ? "BadVAddr" : "tval";
+        break;
+    case TRACE_EVENT_TLB_WRITE:
+        name = (last_args == 0) ? "EntryLo0" : "EntryLo1";
+        break;
+    default:
+        name = "value";
+    }
+
+    last_args++;
+    printf("      %s: %#" PRIx64 "\n", name, record->value);
+}
+
+/** Record a system event
+ *
+ * Called only while the events variable is set. The further
+ * values of the event are recorded by trace_event_arg() right
+ * after the event.
+ *
+ * @param code Exception code, interrupt number, TLB index
+ *             or access size (see trace_event_kind_t).
+ * @param addr Address of the event.
+ *
+ */
+void trace_event(unsigned int cpuno, trace_arch_t arch,
+        trace_event_kind_t kind, uint32_t code, uint64_t addr)
+{
+    trace_record_t record = {
+        .kind = TRACE_RECORD_EVENT,
+        .cpuno = cpuno,
+        .arch = arch,
+        .reg = kind,
+        .instr = code,
+        .value = addr
+    };
+
+    if (trace_active) {
+        trace_record(&record);
+    } else {
+        print_event(&record);
+    }
+}
+
+/** Record a further value of the last system event */
+void trace_event_arg(uint64_t value)
+{
+    trace_record_t record = {
+        .kind = TRACE_RECORD_ARG,
+        .value = value
+    };
+
+    if (trace_active) {
+        trace_record(&record);
+    } else {
+        print_event_arg(&record);
+    }
+}
+
+/** Print a register record */
+static void decode_reg(const trace_record_t *record)
+{
+    const char *name;
+
+    switch (record->arch) {
+#if ISA_R4K
+    case TRACE_ARCH_R4K:
+        name = r4k_regname[record->reg & 31];
+        break;
+#endif
+#if ISA_RV32
+    case TRACE_ARCH_RV32:
+        name = rv_regnames[record->reg & 31];
+        break;
+#endif
+#if ISA_RV64
+    case TRACE_ARCH_RV64:
+        name = rv64_regnames[record->reg & 31];
+        break;
+#endif
+    default:
+        name = "?";
+    }
+
+    printf("      %s: %#" PRIx64 "\n", name, record->value);
+}
+
+/** Disassemble a trace file to the standard output
+ *
+ * @return True if the whole file was decoded.
+ *
+ */
+bool trace_decode(const char *path)
+{
+    ASSERT(path != NULL);
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        io_error(path);
+        return false;
+    }
+
+    uint8_t header[TRACE_HEADER_SIZE];
+
+    if ((fread(header, sizeof(header), 1, file) != 1)
+            || (memcmp(header, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0)
+            || (get_uint32(header + 8) != TRACE_VERSION)
+            || (get_uint32(header + 12) != TRACE_RECORD_SIZE)) {
+        error("%s is not a trace file of this MSIM version", path);
+        fclose(file);
+        return false;
+    }
+
+    uint8_t src[TRACE_RECORD_SIZE];
+    size_t read;
+
+    while ((read = fread(src, 1, sizeof(src), file)) == sizeof(src)) {
+        trace_record_t record = {
+            .kind = src[0],
+            .cpuno = src[1],
+            .arch = src[2],
+            .reg = src[3],
+            .instr = get_uint32(src + 4),
+            .value = get_uint64(src + 8)
+        };
+
+        switch (record.kind) {
+        case TRACE_RECORD_INSTR:
+            trace_print_instr(&record);
+            break;
+        case TRACE_RECORD_REG:
+            decode_reg(&record);
+            break;
+        case TRACE_RECORD_EVENT:
+            print_event(&record);
+            break;
+        case TRACE_RECORD_ARG:
+            print_event_arg(&record);
+            break;
+        default:
+            error("Unknown trace record kind %u", record.kind);
+            fclose(file);
+            return false;
+        }
+    }
+
+    fclose(file);
+
+    if (read != 0) {
+        error("Trace file %s is truncated", path);
+        return false;
+    }
+
+    return true;
+}
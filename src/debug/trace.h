@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Binary execution trace
+ *
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Identification of the trace file */
+#define TRACE_MAGIC "MSIMTRC"
+#define TRACE_VERSION 1
+
+/** Size of the trace file header and of each record */
+#define TRACE_HEADER_SIZE 16
+#define TRACE_RECORD_SIZE 16
+
+/** Architecture of the traced processor */
+typedef enum {
+    TRACE_ARCH_R4K = 0,
+    TRACE_ARCH_RV32 = 1,
+    TRACE_ARCH_RV64 = 2,
+    TRACE_ARCH_NONE = 255 /**< Events of no particular architecture */
+} trace_arch_t;
+
+/** Kind of a trace record */
+typedef enum {
+    TRACE_RECORD_INSTR = 1, /**< Executed instruction */
+    TRACE_RECORD_REG = 2, /**< New value of a general register */
+    TRACE_RECORD_EVENT = 3, /**< System event (see trace_event_kind_t) */
+    TRACE_RECORD_ARG = 4 /**< Further value of the preceding event */
+} trace_record_kind_t;
+
+/** Kind of a system event
+ *
+ * Stored in the reg member of the event records. The instr
+ * member holds the code and the value member the address of
+ * the event, the further values follow as argument records.
+ *
+ */
+typedef enum {
+    TRACE_EVENT_EXCEPTION = 1, /**< Exception taken (code, EPC, tval or BadVAddr) */
+    TRACE_EVENT_INTERRUPT = 2, /**< Interrupt taken (number, EPC) */
+    TRACE_EVENT_RAISE = 3, /**< Interrupt line raised (number) */
+    TRACE_EVENT_CANCEL = 4, /**< Interrupt line cancelled (number) */
+    TRACE_EVENT_TLB_FLUSH = 5, /**< SFENCE.VMA (ASID, address, all ones for all) */
+    TRACE_EVENT_TLB_WRITE = 6, /**< TLBWI or TLBWR (index, EntryHi, EntryLo0, EntryLo1) */
+    TRACE_EVENT_SPACE = 7, /**< Address space switched (satp or EntryHi) */
+    TRACE_EVENT_MMIO_READ = 8, /**< Device register read (size, address, value) */
+    TRACE_EVENT_MMIO_WRITE = 9 /**< Device register write (size, address, value) */
+} trace_event_kind_t;
+
+/** Trace record
+ *
+ * The records are stored in the little-endian byte order
+ * in the order of the members.
+ *
+ */
+typedef struct {
+    uint8_t kind; /**< Record kind (trace_record_kind_t) */
+    uint8_t cpuno; /**< Processor number */
+    uint8_t arch; /**< Processor architecture (trace_arch_t) */
+    uint8_t reg; /**< Register number (register records) */
+    uint32_t instr; /**< Raw instruction (instruction records) */
+    uint64_t value; /**< Instruction address or register value */
+} trace_record_t;
+
+/** True if the trace is written to a file instead of being disassembled */
+extern bool trace_active;
+
+/** Record the system events (into the trace file if open, printed otherwise) */
+extern bool trace_events;
+
+extern bool trace_open(const char *path);
+extern void trace_close(void);
+extern void trace_flush(void);
+extern void trace_record(const trace_record_t *record);
+extern bool trace_decode(const char *path);
+extern void trace_print_instr(const trace_record_t *record);
+extern void trace_event(unsigned int cpuno, trace_arch_t arch,
+        trace_event_kind_t kind, uint32_t code, uint64_t addr);
+extern void trace_event_arg(uint64_t value);
+
+/** Record an executed instruction */
+static inline void trace_instr(unsigned int cpuno, trace_arch_t arch,
+        uint64_t addr, uint32_t instr)
+{
+    trace_record_t record = {
+        .kind = TRACE_RECORD_INSTR,
+        .cpuno = cpuno,
+        .arch = arch,
+        .instr = instr,
+        .value = addr
+    };
+
+    trace_record(&record);
+}
+
+/** Record a new value of a general register */
+static inline void trace_reg(unsigned int cpuno, trace_arch_t arch,
+        unsigned int reg, uint64_t value)
+{
+    trace_record_t record = {
+        .kind = TRACE_RECORD_REG,
+        .cpuno = cpuno,
+        .arch = arch,
+        .reg = reg,
+        .value = value
+    };
+
+    trace_record(&record);
+}
+
+/** Record a device register access as a system event
+ *
+ * @param procno Processor performing the access.
+ * @param size   Size of the access in bytes.
+ *
+ */
+static inline void trace_mmio(unsigned int procno, bool write, uint64_t addr,
+        unsigned int size, uint64_t value)
+{
+    trace_event(procno, TRACE_ARCH_NONE,
+            write ? TRACE_EVENT_MMIO_WRITE : TRACE_EVENT_MMIO_READ, size, addr);
+    trace_event_arg(value);
+}
+
+#endif
@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Trace filters
+ *
+ *  Without filters the trace mode traces every instruction of every
+ *  processor. The filters narrow the trace down to the instructions
+ *  in an address range, in the user or kernel mode, with an ASID, on
+ *  a processor or in a window of machine cycles.
+ *
+ *  The filters are not matched per instruction. Each processor keeps
+ *  the decision for its current code page (nothing, everything or
+ *  some instructions traced), so the untraced pages still execute
+ *  blocks of instructions and cost a single comparison per step.
+ *
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../assert.h"
+#include "../fault.h"
+#include "../main.h"
+#include "../parser.h"
+#include "../utils.h"
+#include "tracefilter.h"
+
+/** Number of filters allocated at once */
+#define TRACE_FILTER_GRANULARITY 8
+
+/** Number of filters set (0 for tracing everything) */
+unsigned int trace_filter_count = 0;
+
+/** Version of the filters (the page decisions of other versions are stale) */
+unsigned int trace_filter_epoch = 1;
+
+/** Decisions of the processors for their code pages */
+trace_page_t trace_pages[MAX_CPUS];
+
+static trace_filter_t *filters = NULL;
+
+/** Tell whether a filter applies to the context of a processor */
+static bool filter_context(const trace_filter_t *filter, unsigned int cpuno,
+        bool user, unsigned int asid)
+{
+    if ((!filter->any_cpu) && (filter->cpuno != cpuno)) {
+        return false;
+    }
+
+    if ((!filter->any_asid) && (filter->asid != asid)) {
+        return false;
+    }
+
+    switch (filter->mode) {
+    case TRACE_MODE_USER:
+        return user;
+    case TRACE_MODE_KERNEL:
+        return !user;
+    default:
+        return true;
+    }
+}
+
+/** Tell whether the current machine cycle is in the window of a filter */
+static bool filter_window(const trace_filter_t *filter)
+{
+    return (steps >= filter->cycle_from) && (steps < filter->cycle_to);
+}
+
+/** Make the decision of a processor for its code page
+ *
+ * The decision also keeps the window of the machine cycles
+ * in which none of the filters starts or stops applying.
+ *
+ */
+void trace_page_update(unsigned int cpuno, uint64_t pc, bool user,
+        unsigned int asid)
+{
+    ASSERT(cpuno < MAX_CPUS);
+
+    trace_page_t *page = &trace_pages[cpuno];
+
+    page->epoch = trace_filter_epoch;
+    page->page = pc & ~((uint64_t) FRAME_MASK);
+    page->user = user;
+    page->asid = asid;
+    page->cycle_from = 0;
+    page->cycle_to = UINT64_MAX;
+    page->scope = TRACE_PAGE_NONE;
+
+    uint64_t page_end = page->page + FRAME_SIZE;
+
+    for (unsigned int i = 0; i < trace_filter_count; i++) {
+        const trace_filter_t *filter = &filters[i];
+
+        if (!filter_context(filter, cpuno, user, asid)) {
+            continue;
+        }
+
+        /* Narrow the window of the decision */
+        if (steps < filter->cycle_from) {
+            page->cycle_to = MIN(page->cycle_to, filter->cycle_from);
+            continue;
+        }
+
+        if (steps >= filter->cycle_to) {
+            page->cycle_from = MAX(page->cycle_from, filter->cycle_to);
+            continue;
+        }
+
+        page->cycle_from = MAX(page->cycle_from, filter->cycle_from);
+        page->cycle_to = MIN(page->cycle_to, filter->cycle_to);
+
+        if ((filter->pc_from <= page->page) && (filter->pc_to >= page_end)) {
+            page->scope = TRACE_PAGE_ALL;
+        } else if ((filter->pc_from < page_end) && (filter->pc_to > page->page)
+                && (page->scope == TRACE_PAGE_NONE)) {
+            page->scope = TRACE_PAGE_SOME;
+        }
+    }
+}
+
+/** Tell whether an instruction matches any of the filters */
+bool trace_filter_match(unsigned int cpuno, uint64_t pc, bool user,
+        unsigned int asid)
+{
+    for (unsigned int i = 0; i < trace_filter_count; i++) {
+        const trace_filter_t *filter = &filters[i];
+
+        if ((pc >= filter->pc_from) && (pc < filter->pc_to)
+                && (filter_window(filter))
+                && (filter_context(filter, cpuno, user, asid))) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/** Add a trace filter
+ *
+ * The instructions matching any of the filters are traced.
+ *
+ */
+void trace_filter_add(const trace_filter_t *filter)
+{
+    ASSERT(filter != NULL);
+
+    if ((trace_filter_count % TRACE_FILTER_GRANULARITY) == 0) {
+        filters = (trace_filter_t *) realloc(filters,
+                (trace_filter_count + TRACE_FILTER_GRANULARITY)
+                        * sizeof(trace_filter_t));
+        if (filters == NULL) {
+            die(ERR_MEM, "Not enough memory");
+        }
+    }
+
+    filters[trace_filter_count] = *filter;
+    trace_filter_count++;
+    trace_filter_epoch++;
+}
+
+/** Remove all trace filters (everything is traced again) */
+void trace_filter_clear(void)
+{
+    trace_filter_count = 0;
+    trace_filter_epoch++;
+}
+
+/** Print the trace filters */
+void trace_filter_print(void)
+{
+    if (trace_filter_count == 0) {
+        printf("No trace filters, everything is traced\n");
+        return;
+    }
+
+    printf("[cpu] [address range                        ] [mode] [asid] "
+           "[cycles]\n");
+
+    for (unsigned int i = 0; i < trace_filter_count; i++) {
+        const trace_filter_t *filter = &filters[i];
+
+        if (filter->any_cpu) {
+            printf("any   ");
+        } else {
+            printf("%-5u ", filter->cpuno);
+        }
+
+        printf("%#018" PRIx64 " - %#018" PRIx64 " ", filter->pc_from,
+                filter->pc_to);
+
+        switch (filter->mode) {
+        case TRACE_MODE_USER:
+            printf("user   ");
+            break;
+        case TRACE_MODE_KERNEL:
+            printf("kernel ");
+            break;
+        default:
+            printf("any    ");
+            break;
+        }
+
+        if (filter->any_asid) {
+            printf("any    ");
+        } else {
+            printf("%-6u ", filter->asid);
+        }
+
+        if (filter->cycle_to == UINT64_MAX) {
+            printf("%" PRIu64 " -\n", filter->cycle_from);
+        } else {
+            printf("%" PRIu64 " - %" PRIu64 "\n", filter->cycle_from,
+                    filter->cycle_to);
+        }
+    }
+}
+
+/** Read a number of a filter condition */
+static bool filter_uint(token_t **parm, const char *name, uint64_t *val)
+{
+    if (parm_type(*parm) != tt_uint) {
+        error("Number expected after <%s>", name);
+        return false;
+    }
+
+    *val = parm_uint_next(parm);
+    return true;
+}
+
+/** Read a range of a filter condition */
+static bool filter_range(token_t **parm, const char *name, uint64_t *from,
+        uint64_t *to)
+{
+    if ((!filter_uint(parm, name, from)) || (!filter_uint(parm, name, to))) {
+        return false;
+    }
+
+    if (*to <= *from) {
+        error("Empty range of <%s>", name);
+        return false;
+    }
+
+    return true;
+}
+
+/** Parse the conditions of a new filter
+ *
+ * The conditions are the pairs of a name and a value (or a range
+ * of values): cpu N, pc FROM TO, mode user|kernel, asid N,
+ * cycles FROM TO. A condition missing matches everything.
+ *
+ */
+static bool filter_parse(token_t *parm, trace_filter_t *filter)
+{
+    filter->any_cpu = true;
+    filter->cpuno = 0;
+    filter->pc_from = 0;
+    filter->pc_to = UINT64_MAX;
+    filter->mode = TRACE_MODE_ANY;
+    filter->any_asid = true;
+    filter->asid = 0;
+    filter->cycle_from = 0;
+    filter->cycle_to = UINT64_MAX;
+
+    while (parm_type(parm) != tt_end) {
+        if (parm_type(parm) != tt_str) {
+            error("Filter condition name expected");
+            return false;
+        }
+
+        const char *const name = parm_str_next(&parm);
+        uint64_t val;
+
+        if (strcmp(name, "cpu") == 0) {
+            if (!filter_uint(&parm, name, &val)) {
+                return false;
+            }
+
+            if (val >= MAX_CPUS) {
+                error("Processor number out of range");
+                return false;
+            }
+
+            filter->any_cpu = false;
+            filter->cpuno = val;
+        } else if (strcmp(name, "asid") == 0) {
+            if (!filter_uint(&parm, name, &val)) {
+                return false;
+            }
+
+            filter->any_asid = false;
+            filter->asid = val;
+        } else if (strcmp(name, "pc") == 0) {
+            if (!filter_range(&parm, name, &filter->pc_from, &filter->pc_to)) {
+                return false;
+            }
+        } else if (strcmp(name, "cycles") == 0) {
+            if (!filter_range(&parm, name, &filter->cycle_from,
+                        &filter->cycle_to)) {
+                return false;
+            }
+        } else if (strcmp(name, "mode") == 0) {
+            if (parm_type(parm) != tt_str) {
+                error("Mode expected (use user or kernel)");
+                return false;
+            }
+
+            const char *const mode = parm_str_next(&parm);
+
+            if (strcmp(mode, "user") == 0) {
+                filter->mode = TRACE_MODE_USER;
+            } else if (strcmp(mode, "kernel") == 0) {
+                filter->mode = TRACE_MODE_KERNEL;
+            } else {
+                error("Unknown mode <%s> (use user or kernel)", mode);
+                return false;
+            }
+        } else {
+            error("Unknown filter condition <%s> "
+                  "(use cpu, pc, mode, asid or cycles)", name);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/** Tracefilter command implementation
+ *
+ * Add a filter, remove all filters or print them.
+ *
+ */
+bool trace_filter_cmd(token_t *parm)
+{
+    ASSERT(parm != NULL);
+
+    if (parm_type(parm) == tt_end) {
+        trace_filter_print();
+        return true;
+    }
+
+    const char *const action = parm_str_next(&parm);
+
+    if (strcmp(action, "add") == 0) {
+        trace_filter_t filter;
+
+        if (!filter_parse(parm, &filter)) {
+            return false;
+        }
+
+        trace_filter_add(&filter);
+        return true;
+    }
+
+    if ((strcmp(action, "clear") != 0) && (strcmp(action, "print") != 0)) {
+        error("Unknown tracefilter action <%s> (use add, clear or print)",
+                action);
+        return false;
+    }
+
+    if (parm_type(parm) != tt_end) {
+        error("Too many parameters");
+        return false;
+    }
+
+    if (strcmp(action, "clear") == 0) {
+        trace_filter_clear();
+    } else {
+        trace_filter_print();
+    }
+
+    return true;
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Trace filters
+ *
+ */
+
+#ifndef TRACEFILTER_H_
+#define TRACEFILTER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../main.h"
+#include "../parser.h"
+#include "../physmem.h"
+
+/** Privilege mode traced by a filter */
+typedef enum {
+    TRACE_MODE_ANY = 0,
+    TRACE_MODE_USER = 1,
+    TRACE_MODE_KERNEL = 2 /**< Any mode but the user mode */
+} trace_mode_t;
+
+/** Trace filter
+ *
+ * An instruction is traced if it matches all conditions of a filter.
+ *
+ */
+typedef struct {
+    bool any_cpu;
+    unsigned int cpuno;
+    uint64_t pc_from; /**< First address traced */
+    uint64_t pc_to; /**< First address after the traced range */
+    trace_mode_t mode;
+    bool any_asid;
+    unsigned int asid;
+    uint64_t cycle_from; /**< First machine cycle traced */
+    uint64_t cycle_to; /**< First machine cycle after the traced window */
+} trace_filter_t;
+
+/** How much of a code page is traced */
+typedef enum {
+    TRACE_PAGE_NONE = 0,
+    TRACE_PAGE_SOME = 1, /**< The filters are matched per instruction */
+    TRACE_PAGE_ALL = 2
+} trace_page_scope_t;
+
+/** Trace decision of a processor for its current code page
+ *
+ * The decision holds while the processor stays on the page in
+ * the same mode and with the same ASID, the machine cycle is
+ * within the window and the filters do not change.
+ *
+ */
+typedef struct {
+    unsigned int epoch; /**< Filters the decision was made for */
+    uint64_t page;
+    bool user;
+    unsigned int asid;
+    uint64_t cycle_from;
+    uint64_t cycle_to;
+    trace_page_scope_t scope;
+} trace_page_t;
+
+extern unsigned int trace_filter_count;
+extern unsigned int trace_filter_epoch;
+extern trace_page_t trace_pages[MAX_CPUS];
+
+extern void trace_filter_add(const trace_filter_t *filter);
+extern void trace_filter_clear(void);
+extern void trace_filter_print(void);
+extern bool trace_filter_cmd(token_t *parm);
+
+extern void trace_page_update(unsigned int cpuno, uint64_t pc, bool user,
+        unsigned int asid);
+extern bool trace_filter_match(unsigned int cpuno, uint64_t pc, bool user,
+        unsigned int asid);
+
+/** Tell how much of the code page of a processor is traced
+ *
+ * Without filters everything is traced. The decision of the page
+ * is made again only when the processor leaves the page or changes
+ * its context.
+ *
+ */
+static inline trace_page_scope_t trace_page_scope(unsigned int cpuno,
+        uint64_t pc, bool user, unsigned int asid)
+{
+    if (trace_filter_count == 0) {
+        return TRACE_PAGE_ALL;
+    }
+
+    trace_page_t *page = &trace_pages[cpuno];
+
+    if ((page->epoch != trace_filter_epoch)
+            || (page->page != (pc & ~((uint64_t) FRAME_MASK)))
+            || (page->user != user) || (page->asid != asid)
+            || (steps < page->cycle_from) || (steps >= page->cycle_to)) {
+        trace_page_update(cpuno, pc, user, asid);
+    }
+
+    return page->scope;
+}
+
+/** Tell whether an instruction is traced */
+static inline bool trace_filter_hit(unsigned int cpuno, uint64_t pc,
+        bool user, unsigned int asid)
+{
+    switch (trace_page_scope(cpuno, pc, user, asid)) {
+    case TRACE_PAGE_NONE:
+        return false;
+    case TRACE_PAGE_ALL:
+        return true;
+    default:
+        return trace_filter_match(cpuno, pc, user, asid);
+    }
+}
+
+/** Tell whether the next cycles of a processor are not traced
+ *
+ * Blocks of instructions are executed only on the pages without
+ * any traced instruction, and not across the start of a cycle window.
+ *
+ * @param cycles Most cycles the processor is going to run.
+ *
+ */
+static inline bool trace_page_quiet(unsigned int cpuno, uint64_t pc,
+        bool user, unsigned int asid, uint64_t cycles)
+{
+    return (trace_page_scope(cpuno, pc, user, asid) == TRACE_PAGE_NONE)
+            && (trace_pages[cpuno].cycle_to - steps > cycles);
+}
+
+#endif
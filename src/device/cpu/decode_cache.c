@@ -0,0 +1,654 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Decoded instruction pages attached to physical frames
+ *
+ *  Each frame owns at most one decoded page per instruction set,
+ *  so the instruction fetch reaches the decoded instruction by the
+ *  frame table walk it performs anyway. Pages of every instruction
+ *  set are kept in a bounded pool which decides which page to drop
+ *  when a new one is needed.
+ *
+ */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../../assert.h"
+#include "../../parallel.h"
+#include "../../utils.h"
+#include "decode_cache.h"
+#include "decode_store.h"
+
+#define DECODE_POOL_INITIALIZER \
+    { \
+        .pages = LIST_INITIALIZER, \
+        .free = LIST_INITIALIZER, \
+        .retired = LIST_INITIALIZER, \
+        .slabs = LIST_INITIALIZER, \
+        .page_size = 0, \
+        .memory = 0, \
+        .count = 0, \
+        .capacity = DECODE_CACHE_SIZE, \
+        .policy = decode_policy_lru, \
+        .clock = 0, \
+        .evictions = 0, \
+        .restored = 0, \
+        .predecode = NULL, \
+        .restore = NULL \
+    }
+
+/** Header of a slab, followed by the memory of its pages */
+typedef struct {
+    item_t item;
+} decode_slab_t;
+
+/** Offset of the first page of a slab (aligned for any page structure) */
+#define DECODE_SLAB_HEADER ALIGN_UP(sizeof(decode_slab_t), sizeof(max_align_t))
+
+decode_pool_t decode_pools[DECODE_ISA_COUNT] = {
+    DECODE_POOL_INITIALIZER,
+    DECODE_POOL_INITIALIZER,
+    DECODE_POOL_INITIALIZER
+};
+
+decode_handlers_t decode_handlers[DECODE_ISA_COUNT];
+
+/** Pre-decode the loaded images (see decode_cache_predecode()) */
+bool decode_predecode = false;
+
+/** Pages pre-decoded by the host threads */
+typedef struct {
+    decoded_page_t **pages;
+    size_t count;
+    decode_chunks_t decode;
+    size_t next; /**< Next page to be taken by a thread */
+} decode_batch_t;
+
+/** Guard of the additions of the implementations */
+static pthread_mutex_t decode_handlers_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** First slot of the hash of an implementation */
+static size_t decode_handler_slot(decode_handler_t handler)
+{
+    uint64_t hash = (uint64_t) (uintptr_t) handler * UINT64_C(0x9e3779b97f4a7c15);
+    return (hash >> 32) & (DECODE_HANDLER_SLOTS - 1);
+}
+
+/** Find the slot of an implementation (or the free slot for it) */
+static size_t decode_handler_find(decode_handlers_t *table, decode_handler_t handler)
+{
+    size_t slot = decode_handler_slot(handler);
+
+    while (true) {
+        uint16_t index = __atomic_load_n(&table->slots[slot], __ATOMIC_ACQUIRE);
+
+        if ((index == 0) || (table->handlers[index] == handler)) {
+            return slot;
+        }
+
+        slot = (slot + 1) & (DECODE_HANDLER_SLOTS - 1);
+    }
+}
+
+/** Get the index of an instruction implementation
+ *
+ * The implementation gets a new index when first seen. The lookups
+ * take no lock, the processors running in parallel only serialize
+ * the additions.
+ *
+ */
+uint16_t decode_handler_index(decode_isa_t isa, decode_handler_t handler)
+{
+    ASSERT(isa < DECODE_ISA_COUNT);
+    ASSERT(handler != NULL);
+
+    decode_handlers_t *table = &decode_handlers[isa];
+    size_t slot = decode_handler_find(table, handler);
+    uint16_t index = __atomic_load_n(&table->slots[slot], __ATOMIC_ACQUIRE);
+
+    if (index != 0) {
+        return index;
+    }
+
+    pthread_mutex_lock(&decode_handlers_mutex);
+
+    /* Added by another processor in the meantime */
+    slot = decode_handler_find(table, handler);
+    index = table->slots[slot];
+
+    if (index == 0) {
+        ASSERT(table->count + 1 < DECODE_HANDLERS);
+
+        index = ++table->count;
+        table->handlers[index] = handler;
+        __atomic_store_n(&table->slots[slot], index, __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_unlock(&decode_handlers_mutex);
+    return index;
+}
+
+/** Get the memory of a page from the free list of the pool
+ *
+ * A new slab is allocated when the free list is empty. Small pools
+ * get slabs of their capacity.
+ *
+ */
+static decoded_page_t *decode_page_get(decode_pool_t *pool)
+{
+    if (is_empty(&pool->free)) {
+        size_t count = MIN(pool->capacity, DECODE_SLAB_PAGES);
+        size_t size = DECODE_SLAB_HEADER + count * pool->page_size;
+        decode_slab_t *slab = (decode_slab_t *) safe_malloc(size);
+        uint8_t *pages = (uint8_t *) slab + DECODE_SLAB_HEADER;
+
+        item_init(&slab->item);
+        list_append(&pool->slabs, &slab->item);
+        pool->memory += size;
+
+        for (size_t i = 0; i < count; i++) {
+            decoded_page_t *page = (decoded_page_t *) (pages + i * pool->page_size);
+            item_init(&page->item);
+            list_append(&pool->free, &page->item);
+        }
+    }
+
+    decoded_page_t *page = (decoded_page_t *) pool->free.head;
+    list_remove(&pool->free, &page->item);
+
+    return page;
+}
+
+/** Return the memory of a page to the free list of the pool */
+static void decode_page_put(decode_pool_t *pool, decoded_page_t *page)
+{
+    list_push(&pool->free, &page->item);
+}
+
+/** Detach the page from its frame and from the pool */
+static void decode_cache_unlink(decoded_page_t *page)
+{
+    decode_pool_t *pool = &decode_pools[page->isa];
+
+    ASSERT(page->frame->decoded[page->isa] == page);
+
+    page->frame->decoded[page->isa] = NULL;
+    physmem_frame_update(page->frame);
+    list_remove(&pool->pages, &page->item);
+    pool->count--;
+}
+
+/** Find the page to be replaced according to the pool policy */
+static decoded_page_t *decode_cache_victim(decode_pool_t *pool)
+{
+    decoded_page_t *victim = NULL;
+    decoded_page_t *page;
+
+    for_each(pool->pages, page, decoded_page_t)
+    {
+        if ((victim == NULL) || (page->stamp < victim->stamp)) {
+            victim = page;
+        }
+    }
+
+    return victim;
+}
+
+/** Attach a new decoded page to the frame
+ *
+ * If the pool of the instruction set is full, the memory of the page
+ * chosen by the replacement policy is reused. While the processors
+ * run in parallel, other processors may still execute from the
+ * victim, so the pool grows over its capacity instead and is
+ * trimmed by decode_cache_trim() after the quantum. A page attached
+ * to the frame by another processor in the meantime is returned
+ * as well.
+ *
+ * The page is restored from the decoded page file if it holds the
+ * frame contents (see decode_store_restore()), decoded otherwise.
+ * The page is decoded before it is published in the frame, so the
+ * processors reading the decoded pages without the lock never see
+ * a page decoded only partly.
+ *
+ * @param isa    Instruction set of the page.
+ * @param frame  Frame the page is decoded from.
+ * @param size   Size of the instruction set specific page structure.
+ * @param decode Instruction set specific decoder of the chunks.
+ *
+ * @return The decoded page.
+ *
+ */
+decoded_page_t *decode_cache_alloc(decode_isa_t isa, frame_t *frame,
+        size_t size, decode_chunks_t decode)
+{
+    ASSERT(isa < DECODE_ISA_COUNT);
+    ASSERT(frame != NULL);
+    ASSERT(size >= sizeof(decoded_page_t));
+    ASSERT(decode != NULL);
+
+    decode_pool_t *pool = &decode_pools[isa];
+    decoded_page_t *page;
+
+    size = ALIGN_UP(size, sizeof(max_align_t));
+    ASSERT((pool->page_size == 0) || (pool->page_size == size));
+
+    machine_lock();
+
+    if (frame->decoded[isa] != NULL) {
+        page = frame->decoded[isa];
+        machine_unlock();
+        return page;
+    }
+
+    if ((pool->count >= pool->capacity) && (pool->count > 0) && (!parallel_active)) {
+        page = decode_cache_victim(pool);
+        decode_cache_unlink(page);
+        pool->evictions++;
+    } else {
+        pool->page_size = size;
+        page = decode_page_get(pool);
+    }
+
+    item_init(&page->item);
+    page->frame = frame;
+    page->isa = isa;
+    page->generation = frame->generation;
+    page->written = 0;
+    page->stamp = ++pool->clock;
+
+    if (decode_store_restore(page, frame)) {
+        pool->restored++;
+    } else {
+        decode(page, frame, DECODE_CHUNKS_ALL);
+    }
+
+    list_push(&pool->pages, &page->item);
+    pool->count++;
+    __atomic_store_n(&frame->decoded[isa], page, __ATOMIC_RELEASE);
+    physmem_frame_update(frame);
+
+    machine_unlock();
+
+    return page;
+}
+
+/** Register the eager decoder of an instruction set
+ *
+ * Called by the processors when configured, so only the
+ * instruction sets of the machine are pre-decoded.
+ *
+ * @param isa       Instruction set of the pages.
+ * @param size      Size of the instruction set specific page structure.
+ * @param predecode Decoder of whole pages which also looks up the
+ *                  implementations of all the instructions.
+ * @param restore   Preparation of the pages restored from the
+ *                  decoded page file (see decode_store_restore()).
+ *
+ */
+void decode_cache_register(decode_isa_t isa, size_t size,
+        decode_chunks_t predecode, decode_restore_t restore)
+{
+    ASSERT(isa < DECODE_ISA_COUNT);
+    ASSERT(size >= sizeof(decoded_page_t));
+    ASSERT(predecode != NULL);
+    ASSERT(restore != NULL);
+
+    decode_pool_t *pool = &decode_pools[isa];
+
+    size = ALIGN_UP(size, sizeof(max_align_t));
+    ASSERT((pool->page_size == 0) || (pool->page_size == size));
+
+    pool->page_size = size;
+    pool->predecode = predecode;
+    pool->restore = restore;
+    decode_store_open(isa, size);
+}
+
+/** Body of a pre-decoding thread
+ *
+ * The threads take the pages one by one, each page is decoded
+ * by a single thread. Only the lookup of the implementations
+ * is shared (see decode_handler_index()).
+ *
+ */
+static void *decode_predecode_thread(void *arg)
+{
+    decode_batch_t *batch = (decode_batch_t *) arg;
+
+    while (true) {
+        size_t i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+
+        if (i >= batch->count) {
+            return NULL;
+        }
+
+        decoded_page_t *page = batch->pages[i];
+
+        if (decode_store_restore(page, page->frame)) {
+            __atomic_fetch_add(&decode_pools[page->isa].restored, 1, __ATOMIC_RELAXED);
+        } else {
+            batch->decode(page, page->frame, DECODE_CHUNKS_ALL);
+        }
+    }
+}
+
+/** Decode the pages of a batch on the host threads
+ *
+ * The calling thread decodes as well, the pages are decoded by
+ * the calling thread alone if no other thread can be started.
+ *
+ */
+static void decode_predecode_run(decode_batch_t *batch)
+{
+    long int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = (cpus > 1) ? (size_t) cpus - 1 : 0;
+    threads = MIN(MIN(threads, batch->count - 1), DECODE_PREDECODE_THREADS);
+
+    pthread_t ids[DECODE_PREDECODE_THREADS];
+    size_t started = 0;
+
+    while ((started < threads) && (pthread_create(&ids[started], NULL,
+                                          decode_predecode_thread, batch) == 0)) {
+        started++;
+    }
+
+    decode_predecode_thread(batch);
+
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(ids[i], NULL);
+    }
+}
+
+/** Pre-decode a physical memory range just loaded
+ *
+ * Unless disabled by the predecode variable, the frames of the
+ * range get the decoded pages of all the instruction sets of the
+ * configured processors before the simulation runs, so the first
+ * fetches do not decode them one by one. The pages are decoded on
+ * the host threads and published in the frames afterwards. Only
+ * the free capacity of the pools is filled, no page is evicted.
+ *
+ * @param addr Physical address of the range.
+ * @param size Size of the range in bytes.
+ *
+ */
+void decode_cache_predecode(ptr36_t addr, len36_t size)
+{
+    if ((!decode_predecode) || (size == 0)) {
+        return;
+    }
+
+    ptr36_t first = ALIGN_DOWN(addr, FRAME_SIZE);
+    size_t frames = (ALIGN_UP(addr + size, FRAME_SIZE) - first) / FRAME_SIZE;
+
+    for (unsigned int isa = 0; isa < DECODE_ISA_COUNT; isa++) {
+        decode_pool_t *pool = &decode_pools[isa];
+
+        if ((pool->predecode == NULL) || (pool->count >= pool->capacity)) {
+            continue;
+        }
+
+        decode_batch_t batch = {
+            .pages = (decoded_page_t **) safe_malloc(
+                    MIN(frames, pool->capacity - pool->count) * sizeof(decoded_page_t *)),
+            .count = 0,
+            .decode = pool->predecode,
+            .next = 0
+        };
+
+        machine_lock();
+
+        for (size_t i = 0; (i < frames) && (pool->count + batch.count < pool->capacity); i++) {
+            frame_t *frame = physmem_find_frame(first + i * FRAME_SIZE);
+
+            if ((frame == NULL) || (frame->decoded[isa] != NULL)) {
+                continue;
+            }
+
+            decoded_page_t *page = decode_page_get(pool);
+
+            item_init(&page->item);
+            page->frame = frame;
+            page->isa = isa;
+            page->generation = frame->generation;
+            page->written = 0;
+            page->stamp = ++pool->clock;
+
+            batch.pages[batch.count] = page;
+            batch.count++;
+        }
+
+        machine_unlock();
+
+        if (batch.count > 0) {
+            decode_predecode_run(&batch);
+        }
+
+        machine_lock();
+
+        for (size_t i = 0; i < batch.count; i++) {
+            decoded_page_t *page = batch.pages[i];
+
+            list_push(&pool->pages, &page->item);
+            pool->count++;
+            __atomic_store_n(&page->frame->decoded[isa], page, __ATOMIC_RELEASE);
+            physmem_frame_update(page->frame);
+        }
+
+        machine_unlock();
+        safe_free(batch.pages);
+    }
+}
+
+/** Decode the chunks of a page written to since the last decoding
+ *
+ * During the serial simulation the page is decoded again in place.
+ * While the processors run in parallel, other processors may execute
+ * from the page, so the page is copied, the copy is decoded and then
+ * published in the frame in place of the page. The page itself is
+ * retired: it is kept intact until decode_cache_trim() after the
+ * quantum, when no processor can execute from it any more.
+ *
+ * The stores to the frame are done under the machine lock, so no
+ * chunk written to is missed by the copy. A page renewed by another
+ * processor in the meantime is returned as is.
+ *
+ * @param page   Page of the frame with an old generation.
+ * @param decode Instruction set specific decoder of the chunks.
+ *
+ * @return The up-to-date page of the frame.
+ *
+ */
+decoded_page_t *decode_cache_renew(decoded_page_t *page, decode_chunks_t decode)
+{
+    ASSERT(page != NULL);
+    ASSERT(decode != NULL);
+
+    decode_pool_t *pool = &decode_pools[page->isa];
+    frame_t *frame = page->frame;
+
+    machine_lock();
+
+    decoded_page_t *current = frame->decoded[page->isa];
+
+    if (current != page) {
+        machine_unlock();
+        return current;
+    }
+
+    uint64_t chunks = decode_cache_take_written(page);
+
+    if (parallel_active) {
+        current = decode_page_get(pool);
+        memcpy(current, page, pool->page_size);
+
+        item_init(&current->item);
+        list_remove(&pool->pages, &page->item);
+        list_push(&pool->pages, &current->item);
+        list_append(&pool->retired, &page->item);
+    }
+
+    if (chunks != 0) {
+        decode(current, frame, chunks);
+    }
+
+    current->generation = frame->generation;
+
+    if (current != page) {
+        __atomic_store_n(&frame->decoded[page->isa], current, __ATOMIC_RELEASE);
+    }
+
+    machine_unlock();
+
+    return current;
+}
+
+/** Shrink the pools to their capacity
+ *
+ * Called after each parallel quantum, which also starts a new period
+ * of the LRU clock used by the processors running in parallel. The
+ * pages retired during the quantum are freed.
+ *
+ */
+void decode_cache_trim(void)
+{
+    for (unsigned int isa = 0; isa < DECODE_ISA_COUNT; isa++) {
+        decode_pool_t *pool = &decode_pools[isa];
+
+        while (!is_empty(&pool->retired)) {
+            decoded_page_t *page = (decoded_page_t *) pool->retired.head;
+            list_remove(&pool->retired, &page->item);
+            decode_page_put(pool, page);
+        }
+
+        while (pool->count > pool->capacity) {
+            decoded_page_t *page = decode_cache_victim(pool);
+            decode_cache_unlink(page);
+            decode_page_put(pool, page);
+            pool->evictions++;
+        }
+
+        pool->clock++;
+    }
+}
+
+/** Check whether a pool has grown over its capacity or retired pages
+ *
+ * Used by the relaxed parallel simulation, which stops the processors
+ * to trim the pools only when needed.
+ *
+ */
+bool decode_cache_over(void)
+{
+    for (unsigned int isa = 0; isa < DECODE_ISA_COUNT; isa++) {
+        if ((decode_pools[isa].count > decode_pools[isa].capacity)
+                || (!is_empty(&decode_pools[isa].retired))) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/** Dispose all decoded pages of a frame
+ *
+ * Called when the frame is removed from the physical memory.
+ *
+ */
+void decode_cache_drop_frame(frame_t *frame)
+{
+    ASSERT(frame != NULL);
+
+    for (unsigned int isa = 0; isa < DECODE_ISA_COUNT; isa++) {
+        decoded_page_t *page = frame->decoded[isa];
+
+        if (page != NULL) {
+            decode_cache_unlink(page);
+            decode_page_put(&decode_pools[isa], page);
+        }
+    }
+}
+
+/** Dispose all decoded pages of an instruction set
+ *
+ * The memory of the slabs is released as well.
+ *
+ */
+void decode_cache_flush(decode_isa_t isa)
+{
+    ASSERT(isa < DECODE_ISA_COUNT);
+
+    decode_pool_t *pool = &decode_pools[isa];
+
+    while (!is_empty(&pool->pages)) {
+        decode_cache_unlink((decoded_page_t *) pool->pages.head);
+    }
+
+    while (!is_empty(&pool->slabs)) {
+        decode_slab_t *slab = (decode_slab_t *) pool->slabs.head;
+        list_remove(&pool->slabs, &slab->item);
+        safe_free(slab);
+    }
+
+    list_init(&pool->free);
+    list_init(&pool->retired);
+    pool->memory = 0;
+}
+
+/** Change the capacity and the replacement policy of a pool
+ *
+ * The pool is flushed in the process.
+ *
+ */
+void decode_cache_configure(decode_isa_t isa, size_t capacity,
+        decode_policy_t policy)
+{
+    ASSERT(isa < DECODE_ISA_COUNT);
+    ASSERT(capacity > 0);
+
+    decode_cache_flush(isa);
+
+    decode_pools[isa].capacity = capacity;
+    decode_pools[isa].policy = policy;
+}
+
+/** Get the host memory taken by the decoded pages of an instruction set
+ *
+ * @return Size of all the slabs of the pool in bytes.
+ *
+ */
+size_t decode_cache_memory(decode_isa_t isa)
+{
+    ASSERT(isa < DECODE_ISA_COUNT);
+
+    return decode_pools[isa].memory;
+}
+
+const char *decode_policy_name(decode_policy_t policy)
+{
+    return (policy == decode_policy_fifo) ? "fifo" : "lru";
+}
+
+bool decode_policy_from_name(const char *name, decode_policy_t *policy)
+{
+    if (strcmp(name, "lru") == 0) {
+        *policy = decode_policy_lru;
+        return true;
+    }
+
+    if (strcmp(name, "fifo") == 0) {
+        *policy = decode_policy_fifo;
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Decoded instruction pages attached to physical frames
+ *
+ */
+
+#ifndef DECODE_CACHE_H_
+#define DECODE_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../../list.h"
+#include "../../parallel.h"
+#include "../../physmem.h"
+
+/** Default number of decoded pages kept per instruction set */
+#define DECODE_CACHE_SIZE 1024
+
+/** Maximal number of decoded pages allocated at once */
+#define DECODE_SLAB_PAGES 16
+
+/** Granularity of the invalidation of the decoded pages (in bytes)
+ *
+ * FRAME_SIZE / DECODE_CHUNK_SIZE chunks fit into the 64-bit
+ * bitmap of the written chunks of a page.
+ *
+ */
+#define DECODE_CHUNK_SIZE 64
+#define DECODE_CHUNKS (FRAME_SIZE / DECODE_CHUNK_SIZE)
+
+/** Bitmap of all the chunks of a page */
+#define DECODE_CHUNKS_ALL UINT64_MAX
+
+/** Maximal number of the host threads pre-decoding a loaded image */
+#define DECODE_PREDECODE_THREADS 16
+
+/** Replacement policy used when the pool is full */
+typedef enum {
+    decode_policy_lru, /**< Evict the least recently used page */
+    decode_policy_fifo /**< Evict the page decoded first */
+} decode_policy_t;
+
+/** Common header of a decoded instruction page
+ *
+ * Instruction set specific page structures embed this
+ * header as their first member.
+ *
+ */
+typedef struct decoded_page {
+    item_t item; /**< Membership in the pool of the instruction set */
+    frame_t *frame; /**< Frame the page was decoded from */
+    decode_isa_t isa;
+    uint64_t generation; /**< Frame generation at the time of decoding */
+    uint64_t written; /**< Chunks written to since the decoding */
+    uint64_t stamp; /**< Time of last use (LRU) or of allocation (FIFO) */
+} decoded_page_t;
+
+/** Decoder of the written chunks of a page (instruction set specific) */
+typedef void (*decode_chunks_t)(decoded_page_t *page, frame_t *frame, uint64_t chunks);
+
+/** Preparation of a page restored from the decoded page file (see decode_store_restore()) */
+typedef void (*decode_restore_t)(decoded_page_t *page);
+
+/** Pool of decoded pages of a single instruction set
+ *
+ * The memory of the pages is allocated by slabs of up to
+ * DECODE_SLAB_PAGES pages, pages dropped from the pool are kept
+ * in the free list.
+ *
+ */
+typedef struct {
+    list_t pages;
+    list_t free; /**< Unused pages of the slabs */
+    list_t retired; /**< Pages replaced during the quantum (see decode_cache_renew()) */
+    list_t slabs;
+    size_t page_size; /**< Size of the instruction set specific pages */
+    size_t memory; /**< Size of all the slabs */
+    size_t count;
+    size_t capacity;
+    decode_policy_t policy;
+    uint64_t clock;
+    uint64_t evictions;
+    uint64_t restored; /**< Pages restored from the decoded page file */
+
+    /** Decoder of whole pages including the implementations of all
+        the instructions (NULL until a processor is configured) */
+    decode_chunks_t predecode;
+
+    /** Preparation of the restored pages (NULL until a processor is configured) */
+    decode_restore_t restore;
+} decode_pool_t;
+
+/** Per-CPU decode statistics */
+typedef struct {
+    uint64_t hits; /**< Fetches served from an up-to-date page */
+    uint64_t misses; /**< Fetches from frames without a decoded page */
+    uint64_t redecodes; /**< Pages decoded again after a store */
+} decode_stats_t;
+
+/** Maximal number of the instruction implementations of an instruction set */
+#define DECODE_HANDLERS 1024
+
+/** Size of the hash of the implementations to their indices */
+#define DECODE_HANDLER_SLOTS (2 * DECODE_HANDLERS)
+
+/** Implementation of a decoded instruction (cast to its own type) */
+typedef void (*decode_handler_t)(void);
+
+/** Implementations of the decoded instructions of an instruction set
+ *
+ * The decoded instructions refer to their implementations by 16-bit
+ * indices instead of pointers, which halves their size. Each
+ * implementation gets its index when first decoded, the index 0
+ * is never given and marks an instruction not decoded yet.
+ *
+ */
+typedef struct {
+    decode_handler_t handlers[DECODE_HANDLERS];
+    uint16_t slots[DECODE_HANDLER_SLOTS]; /**< Indices by the hash (0 if free) */
+    unsigned int count;
+} decode_handlers_t;
+
+extern bool decode_predecode;
+extern decode_pool_t decode_pools[DECODE_ISA_COUNT];
+extern decode_handlers_t decode_handlers[DECODE_ISA_COUNT];
+
+extern decoded_page_t *decode_cache_alloc(decode_isa_t isa, frame_t *frame,
+        size_t size, decode_chunks_t decode);
+extern decoded_page_t *decode_cache_renew(decoded_page_t *page, decode_chunks_t decode);
+extern void decode_cache_register(decode_isa_t isa, size_t size,
+        decode_chunks_t predecode, decode_restore_t restore);
+extern void decode_cache_predecode(ptr36_t addr, len36_t size);
+extern void decode_cache_drop_frame(frame_t *frame);
+extern void decode_cache_flush(decode_isa_t isa);
+extern void decode_cache_trim(void);
+extern bool decode_cache_over(void);
+extern void decode_cache_configure(decode_isa_t isa, size_t capacity,
+        decode_policy_t policy);
+extern size_t decode_cache_memory(decode_isa_t isa);
+extern uint16_t decode_handler_index(decode_isa_t isa, decode_handler_t handler);
+
+extern const char *decode_policy_name(decode_policy_t policy);
+extern bool decode_policy_from_name(const char *name, decode_policy_t *policy);
+
+/** Get the implementation of a decoded instruction by its index */
+static inline decode_handler_t decode_handler(decode_isa_t isa, uint16_t index)
+{
+    return decode_handlers[isa].handlers[index];
+}
+
+/** Record a use of the page for the replacement policy
+ *
+ * While the processors run in parallel, the clock is not advanced
+ * and the pages used within a quantum share the same stamp (stored
+ * by any of the processors, only compared after the quantum).
+ *
+ */
+static inline void decode_cache_touch(decoded_page_t *page)
+{
+    decode_pool_t *pool = &decode_pools[page->isa];
+
+    if (pool->policy != decode_policy_lru) {
+        return;
+    }
+
+    if (parallel_active) {
+        __atomic_store_n(&page->stamp,
+                __atomic_load_n(&pool->clock, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    } else {
+        page->stamp = ++pool->clock;
+    }
+}
+
+/** Record a write to the decoded pages of a frame
+ *
+ * Called by the physical memory with the frame generation changed
+ * right after, so the processors decode the written chunks again.
+ *
+ * @param offset Offset of the written bytes in the frame.
+ * @param size   Number of the written bytes (within the frame).
+ *
+ */
+static inline void decode_cache_written(frame_t *frame, size_t offset, size_t size)
+{
+    uint64_t chunks = DECODE_CHUNKS_ALL;
+
+    if (size < FRAME_SIZE) {
+        size_t first = offset / DECODE_CHUNK_SIZE;
+        size_t last = (offset + size - 1) / DECODE_CHUNK_SIZE;
+
+        chunks = (DECODE_CHUNKS_ALL >> (DECODE_CHUNKS - 1 - last))
+                & (DECODE_CHUNKS_ALL << first);
+    }
+
+    for (unsigned int isa = 0; isa < DECODE_ISA_COUNT; isa++) {
+        decoded_page_t *page = frame->decoded[isa];
+
+        if (page != NULL) {
+            __atomic_fetch_or(&page->written, chunks, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/** Take the chunks of the page written to since the last decoding
+ *
+ * The frame generation is to be read before, so that a write
+ * racing with the decoding changes the generation again.
+ *
+ * @return The bitmap of the chunks.
+ *
+ */
+static inline uint64_t decode_cache_take_written(decoded_page_t *page)
+{
+    return __atomic_exchange_n(&page->written, 0, __ATOMIC_ACQUIRE);
+}
+
+#endif
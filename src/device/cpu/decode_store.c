@@ -0,0 +1,542 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Decoded instruction pages kept on disk between the runs
+ *
+ *  The pages decoded by a run are written into a file per
+ *  instruction set when the machine is removed. The next run maps
+ *  the file and a frame without a decoded page gets a copy of the
+ *  stored page of the same contents instead of being decoded. The
+ *  copy includes the implementations looked up and the heat of the
+ *  blocks, so the blocks translated by the previous run are
+ *  translated again on their first execution.
+ *
+ *  The pages refer to the implementations by their indices (see
+ *  decode_handler_index()), so the file lists the implementations
+ *  in the order of their indices and is only used by the same
+ *  simulator binary, which gives them the same indices again.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../../../config.h"
+#include "../../arch/mmap.h"
+#include "../../assert.h"
+#include "../../debug/callstack.h"
+#include "../../debug/mixstat.h"
+#include "../../fault.h"
+#include "../../main.h"
+#include "../../utils.h"
+#include "decode_store.h"
+
+#define DECODE_STORE_MAGIC "MSIMDPG"
+#define DECODE_STORE_VERSION 1
+
+/** FNV-1a hash of the frames and of the simulator identity */
+#define DECODE_STORE_HASH_BASIS UINT64_C(0xcbf29ce484222325)
+#define DECODE_STORE_HASH_PRIME UINT64_C(0x100000001b3)
+
+/** Configuration changing the decoded pages */
+#define DECODE_STORE_SPECIFIC 0x01 /**< machine_specific_instructions */
+#define DECODE_STORE_CALLSTACK 0x02 /**< callstacks */
+
+/** Header of a decoded page file
+ *
+ * Followed by the offsets of the implementations (see
+ * decode_store_offset()), by the sorted hashes of the pages
+ * and by the pages. Each page is stored as the frame contents
+ * followed by the instruction set specific part of the page.
+ *
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t isa;
+    uint64_t engine; /**< Identity of the simulator binary */
+    uint64_t flags; /**< Configuration of the decoding */
+    uint64_t page_size;
+    uint64_t handlers;
+    uint64_t pages;
+} decode_store_header_t;
+
+/** Mapped decoded page file of an instruction set */
+typedef struct {
+    bool opened; /**< The file has been looked for */
+    void *map; /**< NULL if there is no usable file */
+    size_t size;
+    const uint64_t *hashes;
+    const uint8_t *records;
+    size_t count;
+    size_t record_size;
+    size_t page_size;
+} decode_store_t;
+
+/** Page to be written */
+typedef struct {
+    uint64_t hash;
+    const uint8_t *data;
+    const uint8_t *body;
+    size_t order; /**< The pages of the run come first */
+} decode_store_entry_t;
+
+char *decode_store_dir = NULL;
+
+static decode_store_t decode_stores[DECODE_ISA_COUNT];
+
+static const char *const decode_store_names[DECODE_ISA_COUNT] = {
+    [DECODE_R4K] = "r4k",
+    [DECODE_RV32] = "rv32",
+    [DECODE_RV64] = "rv64"
+};
+
+static uint64_t decode_store_mix(uint64_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *) data;
+
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * DECODE_STORE_HASH_PRIME;
+    }
+
+    return hash;
+}
+
+/** Hash of the contents of a frame (by 64-bit words) */
+static uint64_t decode_store_hash(const uint8_t *data)
+{
+    uint64_t hash = DECODE_STORE_HASH_BASIS;
+
+    for (size_t i = 0; i < FRAME_SIZE; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * DECODE_STORE_HASH_PRIME;
+    }
+
+    return hash;
+}
+
+/** Identity of the simulator binary
+ *
+ * Derived from the version and from the executable file, which
+ * changes with every build.
+ *
+ * @return The identity, 0 if the executable cannot be found.
+ *
+ */
+static uint64_t decode_store_engine(void)
+{
+    struct stat st;
+
+    if (stat("/proc/self/exe", &st) != 0) {
+        return 0;
+    }
+
+    uint64_t ids[] = {
+        (uint64_t) st.st_dev,
+        (uint64_t) st.st_ino,
+        (uint64_t) st.st_size,
+        (uint64_t) st.st_mtime
+    };
+
+    uint64_t hash = decode_store_mix(DECODE_STORE_HASH_BASIS,
+            PACKAGE_VERSION, strlen(PACKAGE_VERSION));
+    return decode_store_mix(hash, ids, sizeof(ids));
+}
+
+static uint64_t decode_store_flags(void)
+{
+    return (machine_specific_instructions ? DECODE_STORE_SPECIFIC : 0)
+            | (callstack_enabled ? DECODE_STORE_CALLSTACK : 0);
+}
+
+/** Position independent reference to an implementation
+ *
+ * @return Offset of the implementation from a function of the simulator.
+ *
+ */
+static int64_t decode_store_offset(decode_handler_t handler)
+{
+    return (int64_t) ((uintptr_t) handler
+            - (uintptr_t) (decode_handler_t) decode_store_open);
+}
+
+static decode_handler_t decode_store_handler(int64_t offset)
+{
+    return (decode_handler_t) ((uintptr_t) (decode_handler_t) decode_store_open
+            + (uintptr_t) offset);
+}
+
+static void decode_store_path(string_t *path, decode_isa_t isa)
+{
+    string_init(path);
+    string_printf(path, "%s/%s.dcache", decode_store_dir,
+            decode_store_names[isa]);
+}
+
+/** Size of a stored page (the frame and the decoded instructions) */
+static size_t decode_store_record_size(size_t page_size)
+{
+    return ALIGN_UP(FRAME_SIZE + page_size - sizeof(decoded_page_t),
+            sizeof(uint64_t));
+}
+
+/** Check the mapped file and give its implementations their indices
+ *
+ * @return True if the pages of the file can be used.
+ *
+ */
+static bool decode_store_check(decode_store_t *store, decode_isa_t isa)
+{
+    if (store->size < sizeof(decode_store_header_t)) {
+        return false;
+    }
+
+    const decode_store_header_t *header = (const decode_store_header_t *) store->map;
+
+    if ((memcmp(header->magic, DECODE_STORE_MAGIC, sizeof(DECODE_STORE_MAGIC)) != 0)
+            || (header->version != DECODE_STORE_VERSION)
+            || (header->isa != isa)
+            || (header->engine != decode_store_engine())
+            || (header->flags != decode_store_flags())
+            || (header->page_size != store->page_size)
+            || (header->handlers >= DECODE_HANDLERS)
+            || (header->pages > DECODE_STORE_PAGES)) {
+        return false;
+    }
+
+    size_t record_size = decode_store_record_size(store->page_size);
+    const int64_t *offsets = (const int64_t *) (header + 1);
+    const uint64_t *hashes = (const uint64_t *) (offsets + header->handlers);
+    const uint8_t *records = (const uint8_t *) (hashes + header->pages);
+
+    if ((size_t) (records - (const uint8_t *) store->map)
+                    + header->pages * record_size
+            != store->size) {
+        return false;
+    }
+
+    /* The implementations have the indices of the run which wrote the file */
+    for (uint64_t i = 0; i < header->handlers; i++) {
+        if (decode_handler_index(isa, decode_store_handler(offsets[i])) != i + 1) {
+            return false;
+        }
+    }
+
+    store->hashes = hashes;
+    store->records = records;
+    store->count = header->pages;
+    store->record_size = record_size;
+
+    return true;
+}
+
+/** Map the decoded page file of an instruction set
+ *
+ * Called when the pages of the instruction set are registered
+ * (see decode_cache_register()), before any of them is decoded.
+ * A missing file or a file written by another build or another
+ * configuration is ignored.
+ *
+ */
+void decode_store_open(decode_isa_t isa, size_t page_size)
+{
+    ASSERT(isa < DECODE_ISA_COUNT);
+
+    decode_store_t *store = &decode_stores[isa];
+
+    if ((decode_store_dir == NULL) || (store->opened)) {
+        return;
+    }
+
+    store->opened = true;
+    store->page_size = page_size;
+
+    string_t path;
+    decode_store_path(&path, isa);
+
+    int fd = open(path.str, O_RDONLY);
+    string_done(&path);
+
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || (!S_ISREG(st.st_mode)) || (st.st_size == 0)) {
+        close(fd);
+        return;
+    }
+
+    store->size = st.st_size;
+    store->map = mmap(NULL, store->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (store->map == MAP_FAILED) {
+        store->map = NULL;
+        return;
+    }
+
+    if (!decode_store_check(store, isa)) {
+        munmap(store->map, store->size);
+        store->map = NULL;
+    }
+}
+
+/** Restore a page from the decoded page file
+ *
+ * The stored page of the same frame contents is copied into the
+ * page and prepared by the processor (see decode_restore_t). The
+ * contents are compared, the hash only finds the page. Safe to be
+ * called by several host threads at once.
+ *
+ * @param page  Page attached to the frame (with its header set).
+ * @param frame Frame of the page.
+ *
+ * @return True if the page has been restored, false if it is to be decoded.
+ *
+ */
+bool decode_store_restore(decoded_page_t *page, frame_t *frame)
+{
+    decode_store_t *store = &decode_stores[page->isa];
+
+    /* The stored implementations do not count the instruction mix
+       and keep the call stacks only if they were kept when stored */
+    if ((store->map == NULL) || (mixstat_enabled)
+            || (((const decode_store_header_t *) store->map)->flags != decode_store_flags())) {
+        return false;
+    }
+
+    uint64_t hash = decode_store_hash(frame->data);
+    size_t low = 0;
+    size_t high = store->count;
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+
+        if (store->hashes[mid] < hash) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    for (size_t i = low; (i < store->count) && (store->hashes[i] == hash); i++) {
+        const uint8_t *record = store->records + i * store->record_size;
+
+        if (memcmp(record, frame->data, FRAME_SIZE) == 0) {
+            memcpy((uint8_t *) page + sizeof(decoded_page_t), record + FRAME_SIZE,
+                    store->page_size - sizeof(decoded_page_t));
+            decode_pools[page->isa].restore(page);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int decode_store_compare(const void *a, const void *b)
+{
+    const decode_store_entry_t *first = (const decode_store_entry_t *) a;
+    const decode_store_entry_t *second = (const decode_store_entry_t *) b;
+
+    if (first->hash != second->hash) {
+        return (first->hash < second->hash) ? -1 : 1;
+    }
+
+    return (first->order < second->order) ? -1 : (first->order > second->order);
+}
+
+/** Collect the pages to be written
+ *
+ * The up-to-date pages of the pool come first, the pages of the
+ * file fill the rest. The entries are sorted by their hashes and
+ * only the first page of the same frame contents is kept.
+ *
+ * @return Number of the entries.
+ *
+ */
+static size_t decode_store_collect(decode_store_t *store, decode_isa_t isa,
+        decode_store_entry_t *entries)
+{
+    decode_pool_t *pool = &decode_pools[isa];
+    decoded_page_t *page;
+    size_t count = 0;
+
+    for_each(pool->pages, page, decoded_page_t)
+    {
+        if ((count == DECODE_STORE_PAGES) || (page->generation != page->frame->generation)
+                || (page->written != 0)) {
+            continue;
+        }
+
+        entries[count].data = page->frame->data;
+        entries[count].body = (const uint8_t *) page + sizeof(decoded_page_t);
+        entries[count].order = count;
+        count++;
+    }
+
+    for (size_t i = 0; (store->map != NULL) && (i < store->count)
+            && (count < DECODE_STORE_PAGES);
+            i++) {
+        const uint8_t *record = store->records + i * store->record_size;
+
+        entries[count].data = record;
+        entries[count].body = record + FRAME_SIZE;
+        entries[count].order = count;
+        count++;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        entries[i].hash = decode_store_hash(entries[i].data);
+    }
+
+    qsort(entries, count, sizeof(decode_store_entry_t), decode_store_compare);
+
+    size_t kept = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        bool duplicate = false;
+
+        for (size_t j = kept; (j-- > 0) && (entries[j].hash == entries[i].hash);) {
+            if (memcmp(entries[j].data, entries[i].data, FRAME_SIZE) == 0) {
+                duplicate = true;
+                break;
+            }
+        }
+
+        if (!duplicate) {
+            entries[kept++] = entries[i];
+        }
+    }
+
+    return kept;
+}
+
+static bool decode_store_write(FILE *file, decode_isa_t isa, size_t page_size,
+        const decode_store_entry_t *entries, size_t count)
+{
+    decode_handlers_t *table = &decode_handlers[isa];
+    size_t record_size = decode_store_record_size(page_size);
+    size_t body_size = page_size - sizeof(decoded_page_t);
+    size_t padding_size = record_size - FRAME_SIZE - body_size;
+    uint8_t padding[sizeof(uint64_t)] = { 0 };
+
+    decode_store_header_t header = {
+        .version = DECODE_STORE_VERSION,
+        .isa = isa,
+        .engine = decode_store_engine(),
+        .flags = decode_store_flags(),
+        .page_size = page_size,
+        .handlers = table->count,
+        .pages = count
+    };
+
+    memcpy(header.magic, DECODE_STORE_MAGIC, sizeof(DECODE_STORE_MAGIC));
+
+    bool ok = (fwrite(&header, sizeof(header), 1, file) == 1);
+
+    for (unsigned int i = 1; (ok) && (i <= table->count); i++) {
+        int64_t offset = decode_store_offset(table->handlers[i]);
+        ok = (fwrite(&offset, sizeof(offset), 1, file) == 1);
+    }
+
+    for (size_t i = 0; (ok) && (i < count); i++) {
+        ok = (fwrite(&entries[i].hash, sizeof(uint64_t), 1, file) == 1);
+    }
+
+    for (size_t i = 0; (ok) && (i < count); i++) {
+        ok = (fwrite(entries[i].data, FRAME_SIZE, 1, file) == 1)
+                && (fwrite(entries[i].body, body_size, 1, file) == 1)
+                && (fwrite(padding, 1, padding_size, file) == padding_size);
+    }
+
+    return ok;
+}
+
+/** Write the decoded page file of an instruction set
+ *
+ * The file is written under a temporary name and renamed, so
+ * the simulators running at the same time map either the old
+ * file or the new one.
+ *
+ */
+static void decode_store_save(decode_store_t *store, decode_isa_t isa)
+{
+    decode_pool_t *pool = &decode_pools[isa];
+
+    if ((pool->count == 0) || (mixstat_enabled) || (decode_store_engine() == 0)) {
+        return;
+    }
+
+    decode_store_entry_t *entries = (decode_store_entry_t *) safe_malloc(
+            DECODE_STORE_PAGES * sizeof(decode_store_entry_t));
+    size_t count = decode_store_collect(store, isa, entries);
+
+    string_t path;
+    string_t temp;
+
+    decode_store_path(&path, isa);
+    string_init(&temp);
+    string_printf(&temp, "%s.%ld", path.str, (long int) getpid());
+
+    if ((mkdir(decode_store_dir, 0777) != 0) && (errno != EEXIST)) {
+        io_error(decode_store_dir);
+    }
+
+    FILE *file = fopen(temp.str, "wb");
+    bool ok = (file != NULL)
+            && decode_store_write(file, isa, pool->page_size, entries, count);
+
+    if ((file != NULL) && (fclose(file) != 0)) {
+        ok = false;
+    }
+
+    if ((ok) && (rename(temp.str, path.str) != 0)) {
+        ok = false;
+    }
+
+    if (!ok) {
+        error("Unable to write the decoded pages %s", path.str);
+        remove(temp.str);
+    }
+
+    string_done(&temp);
+    string_done(&path);
+    safe_free(entries);
+}
+
+/** Write and unmap the decoded page files
+ *
+ * Called when the machine is removed, while the decoded
+ * pages are still attached to the frames.
+ *
+ */
+void decode_store_close(void)
+{
+    for (unsigned int isa = 0; isa < DECODE_ISA_COUNT; isa++) {
+        decode_store_t *store = &decode_stores[isa];
+
+        if (!store->opened) {
+            continue;
+        }
+
+        decode_store_save(store, isa);
+
+        if (store->map != NULL) {
+            munmap(store->map, store->size);
+        }
+
+        memset(store, 0, sizeof(decode_store_t));
+    }
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Decoded instruction pages kept on disk between the runs
+ *
+ */
+
+#ifndef DECODE_STORE_H_
+#define DECODE_STORE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "decode_cache.h"
+
+/** Maximal number of the pages kept per instruction set */
+#define DECODE_STORE_PAGES 8192
+
+/** Directory of the decoded page files (NULL if not kept) */
+extern char *decode_store_dir;
+
+extern void decode_store_open(decode_isa_t isa, size_t page_size);
+extern bool decode_store_restore(decoded_page_t *page, frame_t *frame);
+extern void decode_store_close(void);
+
+#endif
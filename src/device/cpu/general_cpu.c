@@ -9,23 +9,58 @@
  *
  */
 
+#include <stdint.h>
+
 #include "../../assert.h"
+#include "../../debug/trace.h"
 #include "../../main.h"
+#include "../../parallel.h"
 #include "general_cpu.h"
+#include "isa.h"
+
+/** Processors indexed by their numbers (NULL if unused) */
+static general_cpu_t *cpus[MAX_CPUS];
+
+/** Processors in the order of their numbers
+ *
+ * The loops over all processors run over this dense array,
+ * so they do not depend on MAX_CPUS.
+ *
+ */
+static general_cpu_t *active_cpus[MAX_CPUS];
+static unsigned int active_count = 0;
+
+bool cpu_standby_entered = false;
 
-// list of all cpus
-list_t cpu_list = LIST_INITIALIZER;
+/** Number of the failing instruction fetches reported by each processor */
+unsigned int cpu_fetch_alerts = 0;
+
+/** \{ \name Posted interrupt requests
+ *
+ * The lower half of the posted word marks the interrupts whose
+ * state is to be changed, the upper half holds the requested state.
+ *
+ */
+#define POSTED_LINES 16
+#define POSTED_CHANGE(no) (UINT32_C(1) << (no))
+#define POSTED_LEVEL(no) (UINT32_C(1) << ((no) + POSTED_LINES))
+/* \} */
 
 general_cpu_t *get_cpu(unsigned int no)
 {
-    general_cpu_t *cpu;
-    for_each(cpu_list, cpu, general_cpu_t)
-    {
-        if (cpu->cpuno == no) {
-            return cpu;
-        }
-    }
-    return NULL;
+    return (no < MAX_CPUS) ? cpus[no] : NULL;
+}
+
+unsigned int get_cpu_count(void)
+{
+    return active_count;
+}
+
+general_cpu_t *get_cpu_by_index(unsigned int index)
+{
+    ASSERT(index < active_count);
+
+    return active_cpus[index];
 }
 
 /**
@@ -37,16 +72,9 @@ general_cpu_t *get_cpu(unsigned int no)
 unsigned int get_free_cpuno(void)
 {
     unsigned int c;
-    unsigned int id_mask = 0;
-    general_cpu_t *cpu;
-
-    for_each(cpu_list, cpu, general_cpu_t)
-    {
-        id_mask |= 1 << (cpu->cpuno);
-    }
 
-    for (c = 0; c < MAX_CPUS; c++, id_mask >>= 1) {
-        if (!(id_mask & 1)) {
+    for (c = 0; c < MAX_CPUS; c++) {
+        if (cpus[c] == NULL) {
             return c;
         }
     }
@@ -56,23 +84,119 @@ unsigned int get_free_cpuno(void)
 
 void add_cpu(general_cpu_t *cpu)
 {
-    item_init(&cpu->item);
-    list_append(&cpu_list, &cpu->item);
+    ASSERT(cpu->cpuno < MAX_CPUS);
+    ASSERT(cpus[cpu->cpuno] == NULL);
+
+    cpu->posted = 0;
+    cpu->parked = false;
+    cpu->host_core = -1;
+    cpus[cpu->cpuno] = cpu;
+
+    /* Keep the active processors ordered by their numbers */
+    unsigned int index = active_count;
+    while ((index > 0) && (active_cpus[index - 1]->cpuno > cpu->cpuno)) {
+        active_cpus[index] = active_cpus[index - 1];
+        index--;
+    }
+
+    active_cpus[index] = cpu;
+    active_count++;
 }
 
 void remove_cpu(general_cpu_t *cpu)
 {
-    list_remove(&cpu_list, &cpu->item);
+    ASSERT(cpus[cpu->cpuno] == cpu);
+
+    cpus[cpu->cpuno] = NULL;
+
+    unsigned int index = 0;
+    while (active_cpus[index] != cpu) {
+        index++;
+    }
+
+    active_count--;
+    for (; index < active_count; index++) {
+        active_cpus[index] = active_cpus[index + 1];
+    }
 }
 
 static general_cpu_t *get_fallback_cpu(void)
 {
-    general_cpu_t *cpu = get_cpu(0);
-    if (cpu == NULL) {
-        cpu = (general_cpu_t *) cpu_list.head;
+    ASSERT(active_count > 0);
+
+    return active_cpus[0];
+}
+
+/** Post an interrupt request to a processor running on another thread
+ *
+ * The request replaces any earlier request of the same interrupt
+ * which has not been delivered yet.
+ *
+ */
+static void cpu_post_interrupt(general_cpu_t *cpu, unsigned int no, bool up)
+{
+    ASSERT(no < POSTED_LINES);
+
+    uint32_t old = __atomic_load_n(&cpu->posted, __ATOMIC_RELAXED);
+    uint32_t new;
+
+    do {
+        new = (old | POSTED_CHANGE(no)) & ~POSTED_LEVEL(no);
+        if (up) {
+            new |= POSTED_LEVEL(no);
+        }
+    } while (!__atomic_compare_exchange_n(&cpu->posted, &old, new, true,
+            __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/** Raise or cancel an interrupt of the processor directly */
+static inline void cpu_interrupt_apply(general_cpu_t *cpu, unsigned int no, bool up)
+{
+    if (trace_events) {
+        trace_event(cpu->cpuno, TRACE_ARCH_NONE,
+                up ? TRACE_EVENT_RAISE : TRACE_EVENT_CANCEL, no, 0);
+    }
+
+#if ISA_SINGLE
+    isa_interrupt(cpu, no, up);
+#else
+    if (up) {
+        cpu->type->interrupt_up(cpu->data, no);
+    } else {
+        cpu->type->interrupt_down(cpu->data, no);
+    }
+#endif
+}
+
+/** Apply the posted interrupt requests to the processor
+ *
+ * @see cpu_deliver_interrupts
+ *
+ */
+void cpu_deliver_posted(general_cpu_t *cpu)
+{
+    uint32_t posted = __atomic_exchange_n(&cpu->posted, 0, __ATOMIC_ACQUIRE);
+
+    for (unsigned int no = 0; no < POSTED_LINES; no++) {
+        if ((posted & POSTED_CHANGE(no)) == 0) {
+            continue;
+        }
+
+        cpu_interrupt_apply(cpu, no, (posted & POSTED_LEVEL(no)) != 0);
+    }
+}
+
+/** Apply the posted interrupt requests to all processors
+ *
+ * Called after each parallel quantum, so that no requests
+ * are left pending while the machine is simulated serially.
+ *
+ */
+void cpu_deliver_all(void)
+{
+    for (unsigned int c = 0; c < active_count; c++) {
+        cpu_deliver_interrupts(active_cpus[c]);
     }
-    ASSERT(cpu != NULL);
-    return cpu;
 }
 
 void cpu_interrupt_up(general_cpu_t *cpu, unsigned int no)
@@ -80,7 +204,16 @@ void cpu_interrupt_up(general_cpu_t *cpu, unsigned int no)
     if (cpu == NULL) {
         cpu = get_fallback_cpu();
     }
-    cpu->type->interrupt_up(cpu->data, no);
+
+    if (cpu->parked) {
+        dev_unpark_cpu(cpu);
+    }
+
+    if (parallel_active) {
+        cpu_post_interrupt(cpu, no, true);
+    } else {
+        cpu_interrupt_apply(cpu, no, true);
+    }
 }
 
 void cpu_interrupt_down(general_cpu_t *cpu, unsigned int no)
@@ -88,22 +221,31 @@ void cpu_interrupt_down(general_cpu_t *cpu, unsigned int no)
     if (cpu == NULL) {
         cpu = get_fallback_cpu();
     }
-    cpu->type->interrupt_down(cpu->data, no);
+
+    if (cpu->parked) {
+        dev_unpark_cpu(cpu);
+    }
+
+    if (parallel_active) {
+        cpu_post_interrupt(cpu, no, false);
+    } else {
+        cpu_interrupt_apply(cpu, no, false);
+    }
 }
 
-void cpu_insert_breakpoint(general_cpu_t *cpu, ptr64_t addr, breakpoint_t kind)
+void cpu_insert_breakpoint(general_cpu_t *cpu, ptr64_t addr, breakpoint_kind_t kind)
 {
     if (cpu == NULL) {
         cpu = get_fallback_cpu();
     }
     cpu->type->insert_breakpoint(cpu->data, addr, kind);
 }
-void cpu_remove_breakpoint(general_cpu_t *cpu, ptr64_t addr)
+void cpu_remove_breakpoint(general_cpu_t *cpu, ptr64_t addr, breakpoint_kind_t kind)
 {
     if (cpu == NULL) {
         cpu = get_fallback_cpu();
     }
-    cpu->type->remove_breakpoint(cpu->data, addr);
+    cpu->type->remove_breakpoint(cpu->data, addr, kind);
 }
 
 /**
@@ -121,7 +263,11 @@ bool cpu_convert_addr(general_cpu_t *cpu, ptr64_t virt, ptr36_t *phys, bool writ
     if (cpu == NULL) {
         cpu = get_fallback_cpu();
     }
+#if ISA_SINGLE
+    return isa_convert_addr(cpu, virt, phys, write);
+#else
     return cpu->type->convert_addr(cpu->data, virt, phys, write);
+#endif
 }
 
 void cpu_reg_dump(general_cpu_t *cpu)
@@ -139,6 +285,15 @@ void cpu_set_pc(general_cpu_t *cpu, ptr64_t pc)
     }
     cpu->type->set_pc(cpu->data, pc);
 }
+
+ptr64_t cpu_get_pc(general_cpu_t *cpu)
+{
+    if (cpu == NULL) {
+        cpu = get_fallback_cpu();
+    }
+    return cpu->type->get_pc(cpu->data);
+}
+
 /**
  * @brief signals to the cpu, that an address has been written to, for sc control
  *
@@ -152,5 +307,234 @@ extern bool cpu_sc_access(general_cpu_t *cpu, ptr36_t addr, int size)
     if (cpu == NULL) {
         cpu = get_fallback_cpu();
     }
-    return cpu->type->sc_access(cpu->data, addr, size);
+
+#if ISA_SINGLE
+    bool hit = isa_sc_access(cpu, addr, size);
+#else
+    bool hit = cpu->type->sc_access(cpu->data, addr, size);
+#endif
+
+    // The cpu may be parked spinning on the reservation
+    if (hit && cpu->parked) {
+        dev_unpark_cpu(cpu);
+    }
+
+    return hit;
+}
+
+/**
+ * @brief Tells how many cycles all cpus are going to stand by
+ *
+ * The cpus which do not implement the skipping of the standby cycles
+ * are considered running, as are the cpus with posted interrupts.
+ *
+ * @param cycles Number of cycles which can be skipped
+ * @return false if some cpu is running or there are no cpus
+ */
+bool cpu_standby_all(uint64_t *cycles)
+{
+    uint64_t limit = UINT64_MAX;
+    bool any = false;
+
+    for (unsigned int c = 0; c < active_count; c++) {
+        general_cpu_t *cpu = active_cpus[c];
+        uint64_t cpu_cycles;
+
+        if (cpu->parked) {
+            /* Parked until the first cycle it can notice something */
+            cpu_cycles = (cpu->parked_until > steps) ? cpu->parked_until - steps : 0;
+        } else if ((cpu->type->standby == NULL) || (cpu->posted != 0)
+                || (!cpu->type->standby(cpu->data, &cpu_cycles))) {
+            return false;
+        }
+
+        if (cpu_cycles < limit) {
+            limit = cpu_cycles;
+        }
+
+        any = true;
+    }
+
+    *cycles = limit;
+    return any;
+}
+
+/**
+ * @brief Tells how long all cpus are going to stand by in host time
+ *
+ * Expected to be called only when all cpus stand by. A cpu waiting for
+ * a timer driven by the simulated cycles does not let the host sleep.
+ *
+ * @param wait Milliseconds until the host clock may end the standby
+ *             (UINT64_MAX if only a device can end it)
+ * @return false if the standby of some cpu may end without the host
+ */
+bool cpu_standby_host_all(uint64_t *wait)
+{
+    uint64_t limit = UINT64_MAX;
+
+    for (unsigned int c = 0; c < active_count; c++) {
+        general_cpu_t *cpu = active_cpus[c];
+        uint64_t cpu_wait;
+
+        if (cpu->parked) {
+            dev_unpark_cpu(cpu);
+        }
+
+        if ((cpu->type->standby_host == NULL)
+                || (!cpu->type->standby_host(cpu->data, &cpu_wait))) {
+            return false;
+        }
+
+        if (cpu_wait < limit) {
+            limit = cpu_wait;
+        }
+    }
+
+    *wait = limit;
+    return true;
+}
+
+/**
+ * @brief Tells whether all cpus loop forever without taking interrupts
+ *
+ * The cpus which do not tell it are considered running.
+ *
+ * @return false if some cpu may still do anything or there are no cpus
+ */
+bool cpu_deadloop_all(void)
+{
+    for (unsigned int c = 0; c < active_count; c++) {
+        general_cpu_t *cpu = active_cpus[c];
+
+        if ((cpu->type->deadloop == NULL) || (cpu->posted != 0)
+                || (!cpu->type->deadloop(cpu->data))) {
+            return false;
+        }
+    }
+
+    return active_count > 0;
+}
+
+void cpu_skip_all(uint64_t cycles)
+{
+    for (unsigned int c = 0; c < active_count; c++) {
+        /* The parked cpus account the cycles once unparked */
+        if (!active_cpus[c]->parked) {
+            active_cpus[c]->type->skip(active_cpus[c]->data, cycles);
+        }
+    }
+}
+
+/** Total number of instructions executed by all processors
+ *
+ */
+uint64_t cpu_instructions_all(void)
+{
+    uint64_t total = 0;
+
+    for (unsigned int c = 0; c < active_count; c++) {
+        general_cpu_t *cpu = active_cpus[c];
+
+        if (cpu->type->instructions != NULL) {
+            total += cpu->type->instructions(cpu->data);
+        }
+    }
+
+    return total;
+}
+
+/** Current privilege mode of the cpu
+ *
+ * The cpus which do not tell their mode are considered
+ * to run in the most privileged mode.
+ *
+ */
+cpu_mode_t cpu_mode(general_cpu_t *cpu)
+{
+    if (cpu == NULL) {
+        cpu = get_fallback_cpu();
+    }
+
+    if (cpu->type->mode == NULL) {
+        return cpu_mode_kernel;
+    }
+
+    return cpu->type->mode(cpu->data);
+}
+
+const char *cpu_mode_name(cpu_mode_t mode)
+{
+    static const char *const names[cpu_mode_count] = {
+        [cpu_mode_user] = "user",
+        [cpu_mode_supervisor] = "supervisor",
+        [cpu_mode_kernel] = "kernel",
+        [cpu_mode_machine] = "machine"
+    };
+
+    ASSERT(mode < cpu_mode_count);
+    return names[mode];
+}
+
+bool cpu_timer_read(general_cpu_t *cpu, cpu_timer_t reg, uint64_t *val)
+{
+    ASSERT(cpu != NULL);
+    ASSERT(val != NULL);
+
+    if (cpu->parked) {
+        dev_unpark_cpu(cpu);
+    }
+
+    if (cpu->type->timer_read == NULL) {
+        return false;
+    }
+
+    *val = cpu->type->timer_read(cpu->data, reg);
+    return true;
+}
+
+bool cpu_timer_write(general_cpu_t *cpu, cpu_timer_t reg, uint64_t val)
+{
+    ASSERT(cpu != NULL);
+
+    if (cpu->parked) {
+        dev_unpark_cpu(cpu);
+    }
+
+    if (cpu->type->timer_write == NULL) {
+        return false;
+    }
+
+    cpu->type->timer_write(cpu->data, reg, val);
+    return true;
+}
+
+const cpu_regs_t *cpu_regs(general_cpu_t *cpu)
+{
+    ASSERT(cpu != NULL);
+
+    return cpu->type->regs;
+}
+
+bool cpu_reg_read(general_cpu_t *cpu, unsigned int reg, uint64_t *val)
+{
+    ASSERT(cpu != NULL);
+    ASSERT(val != NULL);
+
+    if ((cpu->type->reg_read == NULL) || (reg >= cpu->type->regs->count)) {
+        return false;
+    }
+
+    return cpu->type->reg_read(cpu->data, reg, val);
+}
+
+bool cpu_reg_write(general_cpu_t *cpu, unsigned int reg, uint64_t val)
+{
+    ASSERT(cpu != NULL);
+
+    if ((cpu->type->reg_write == NULL) || (reg >= cpu->type->regs->count)) {
+        return false;
+    }
+
+    return cpu->type->reg_write(cpu->data, reg, val);
 }
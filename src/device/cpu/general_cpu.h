@@ -13,6 +13,7 @@
 #define GENERAL_CPU_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "../../debug/breakpoint.h"
 #include "../../main.h"
@@ -20,17 +21,65 @@
 /** Function type for raising and canceling interrupts */
 typedef void (*interrupt_func_t)(void *, unsigned int);
 /** Function type for inserting breakpoints */
-typedef void (*insert_breakpoint_func_t)(void *, ptr64_t, breakpoint_t);
+typedef void (*insert_breakpoint_func_t)(void *, ptr64_t, breakpoint_kind_t);
 /** Function type for removing breakpoints */
-typedef void (*remove_breakpoint_func_t)(void *, ptr64_t);
+typedef void (*remove_breakpoint_func_t)(void *, ptr64_t, breakpoint_kind_t);
 /** Function type for converting addresses */
 typedef bool (*convert_addr_func_t)(void *, ptr64_t, ptr36_t *, bool);
 /** Function type for dumping register content */
 typedef void (*reg_dump_func_t)(void *);
 /** Function type for setting the program counter of a cpu */
 typedef void (*set_pc_func_t)(void *, ptr64_t);
+/** Function type for reading the program counter of a cpu */
+typedef ptr64_t (*get_pc_func_t)(void *);
 /** Function type for notifying the processor about a write to a memory location, used for implementing SC atomic*/
 typedef bool (*sc_access_func_t)(void *, ptr36_t, int);
+/** Function type for telling how many standby cycles of a cpu can be skipped */
+typedef bool (*standby_func_t)(void *, uint64_t *);
+/** Function type for accounting skipped standby cycles */
+typedef void (*skip_func_t)(void *, uint64_t);
+/** Function type for telling how long a cpu stands by in host time */
+typedef bool (*standby_host_func_t)(void *, uint64_t *);
+/** Function type for telling whether a cpu loops forever */
+typedef bool (*deadloop_func_t)(void *);
+typedef uint64_t (*instructions_func_t)(void *);
+
+/** Privilege modes of the processors */
+typedef enum {
+    cpu_mode_user,
+    cpu_mode_supervisor,
+    cpu_mode_kernel, /**< Kernel mode of MIPS */
+    cpu_mode_machine, /**< Machine mode of RISC-V */
+    cpu_mode_count
+} cpu_mode_t;
+
+/** Function type for telling the current privilege mode of a cpu */
+typedef cpu_mode_t (*mode_func_t)(void *);
+
+/** Timer registers of the cpus */
+typedef enum {
+    cpu_timer_time, /**< Current time (mtime of RISC-V) */
+    cpu_timer_compare /**< Time of the timer interrupt (mtimecmp of RISC-V) */
+} cpu_timer_t;
+
+/** Function types for accessing the timer registers of a cpu */
+typedef uint64_t (*timer_read_func_t)(void *, cpu_timer_t);
+typedef void (*timer_write_func_t)(void *, cpu_timer_t, uint64_t);
+
+/** Function types for accessing the registers in the order of the debugger */
+typedef bool (*reg_read_func_t)(void *, unsigned int, uint64_t *);
+typedef bool (*reg_write_func_t)(void *, unsigned int, uint64_t);
+
+/** Registers of a cpu as described to the debugger */
+typedef struct {
+    const char *arch; /**< Architecture of the target description (NULL for none) */
+    const char *feature; /**< Feature of the target description */
+    const char *const *names; /**< Names of the registers */
+    unsigned int count; /**< Number of registers */
+    unsigned int width; /**< Size of a register in bytes */
+    unsigned int pc; /**< Number of the program counter */
+    bool kseg; /**< The debugger uses 32-bit addresses of the R4000 segments */
+} cpu_regs_t;
 
 /** Cpu method table
  *
@@ -44,21 +93,53 @@ typedef struct {
     convert_addr_func_t convert_addr;
     reg_dump_func_t reg_dump;
     set_pc_func_t set_pc;
+    get_pc_func_t get_pc;
     sc_access_func_t sc_access;
+    standby_func_t standby; /** Tell the skippable standby cycles */
+    skip_func_t skip; /** Account skipped standby cycles */
+    standby_host_func_t standby_host; /** Tell the host time the standby lasts */
+    deadloop_func_t deadloop; /** Tell whether the cpu loops forever */
+    instructions_func_t instructions; /** Tell the number of executed instructions */
+    mode_func_t mode; /** Tell the current privilege mode */
+    timer_read_func_t timer_read; /** Read a timer register */
+    timer_write_func_t timer_write; /** Write a timer register */
+    const cpu_regs_t *regs; /** Registers seen by the debugger */
+    reg_read_func_t reg_read; /** Read a register of the debugger */
+    reg_write_func_t reg_write; /** Write a register of the debugger */
 } cpu_ops_t;
 
 /** Structure describinfg cpu methods */
 typedef struct {
-    item_t item;
     unsigned int cpuno;
     const cpu_ops_t *type;
     void *data;
+    uint32_t posted; /**< Interrupt requests from other threads */
+    bool parked; /**< Left out of the step loop while standing by */
+    uint64_t parked_since; /**< First cycle not stepped while parked */
+    uint64_t parked_until; /**< Cycle the parked cpu has to be stepped in */
+    int host_core; /**< Host core simulating the cpu in parallel (-1 = any) */
 } general_cpu_t;
 
+/** Set when a cpu enters the standby mode */
+extern bool cpu_standby_entered;
+
+/** Number of the failing instruction fetches reported by each processor */
+extern unsigned int cpu_fetch_alerts;
+
 /**
  * @brief Retrieves the general_cpu_t structure based on the given cpu id
  */
 extern general_cpu_t *get_cpu(unsigned int no);
+/**
+ * @brief Returns the number of cpus
+ */
+extern unsigned int get_cpu_count(void);
+/**
+ * @brief Retrieves the cpu at the given position in the order of cpu ids
+ *
+ * Used for the loops over all cpus, which do not depend on MAX_CPUS then.
+ */
+extern general_cpu_t *get_cpu_by_index(unsigned int index);
 /**
  * @brief Returns the lowest unused cpu id or MAX_CPUS if none are available
  */
@@ -89,8 +170,31 @@ extern void cpu_interrupt_up(general_cpu_t *cpu, unsigned int no);
  */
 extern void cpu_interrupt_down(general_cpu_t *cpu, unsigned int no);
 
-extern void cpu_insert_breakpoint(general_cpu_t *cpu, ptr64_t addr, breakpoint_t kind);
-extern void cpu_remove_breakpoint(general_cpu_t *cpu, ptr64_t addr);
+extern void cpu_deliver_posted(general_cpu_t *cpu);
+extern void cpu_deliver_all(void);
+
+/**
+ * @brief Applies the interrupt requests posted to the cpu
+ *
+ * While the processors run in parallel, interrupts are not raised
+ * or canceled directly, but posted to the processor, which applies
+ * them before its next step. Called by the processor itself.
+ */
+static inline void cpu_deliver_interrupts(general_cpu_t *cpu)
+{
+    if (__atomic_load_n(&cpu->posted, __ATOMIC_RELAXED) != 0) {
+        cpu_deliver_posted(cpu);
+    }
+}
+
+/**
+ * @brief Sets a code breakpoint of the given kind on a virtual address
+ */
+extern void cpu_insert_breakpoint(general_cpu_t *cpu, ptr64_t addr, breakpoint_kind_t kind);
+/**
+ * @brief Removes the code breakpoint of the given kind from a virtual address
+ */
+extern void cpu_remove_breakpoint(general_cpu_t *cpu, ptr64_t addr, breakpoint_kind_t kind);
 
 /**
  * @brief converts an address from virtual to physical memory, not modifying cpu state
@@ -111,6 +215,11 @@ extern void cpu_reg_dump(general_cpu_t *cpu);
 
 extern void cpu_set_pc(general_cpu_t *cpu, ptr64_t pc);
 
+/**
+ * @brief Returns the address of the instruction to be executed next
+ */
+extern ptr64_t cpu_get_pc(general_cpu_t *cpu);
+
 /**
  * @brief signals to the cpu, that an address has been written to, for sc control
  *
@@ -121,4 +230,84 @@ extern void cpu_set_pc(general_cpu_t *cpu, ptr64_t pc);
  */
 extern bool cpu_sc_access(general_cpu_t *cpu, ptr36_t addr, int size);
 
+/**
+ * @brief Tells how many cycles all cpus are going to stand by
+ *
+ * @param cycles Number of cycles which can be skipped
+ * @return false if some cpu is running
+ */
+extern bool cpu_standby_all(uint64_t *cycles);
+
+/**
+ * @brief Tells how long all cpus are going to stand by in host time
+ *
+ * @param wait Milliseconds until the host clock may end the standby
+ *             (UINT64_MAX if only a device can end it)
+ * @return false if the standby of some cpu may end without the host
+ */
+extern bool cpu_standby_host_all(uint64_t *wait);
+
+/**
+ * @brief Tells whether all cpus loop forever without taking interrupts
+ */
+extern bool cpu_deadloop_all(void);
+
+/**
+ * @brief Accounts the given number of standby cycles in all cpus
+ */
+extern void cpu_skip_all(uint64_t cycles);
+
+/**
+ * @brief Puts a parked cpu back into the step loop of the devices
+ *
+ * The standby cycles the cpu was not stepped in are accounted.
+ */
+extern void dev_unpark_cpu(general_cpu_t *cpu);
+extern uint64_t cpu_instructions_all(void);
+
+/**
+ * @brief Returns the current privilege mode of the cpu
+ */
+extern cpu_mode_t cpu_mode(general_cpu_t *cpu);
+
+/**
+ * @brief Returns the name of a privilege mode
+ */
+extern const char *cpu_mode_name(cpu_mode_t mode);
+
+/**
+ * @brief Reads a timer register of the cpu
+ *
+ * @return false if the cpu has no timer registers
+ */
+extern bool cpu_timer_read(general_cpu_t *cpu, cpu_timer_t reg, uint64_t *val);
+
+/**
+ * @brief Writes a timer register of the cpu
+ *
+ * @return false if the cpu has no timer registers
+ */
+extern bool cpu_timer_write(general_cpu_t *cpu, cpu_timer_t reg, uint64_t val);
+
+/**
+ * @brief Returns the registers of the cpu as seen by the debugger
+ *
+ * @return NULL if the cpu cannot be debugged
+ */
+extern const cpu_regs_t *cpu_regs(general_cpu_t *cpu);
+
+/**
+ * @brief Reads a register of the cpu in the numbering of the debugger
+ *
+ * @return false if the register does not exist
+ */
+extern bool cpu_reg_read(general_cpu_t *cpu, unsigned int reg, uint64_t *val);
+
+/**
+ * @brief Writes a register of the cpu in the numbering of the debugger
+ *
+ * @return false if the register does not exist
+ */
+extern bool cpu_reg_write(general_cpu_t *cpu, unsigned int reg, uint64_t val);
+
 #endif // GENERAL_CPU_H_
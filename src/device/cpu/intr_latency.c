@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Interrupt latency histograms
+ *
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../../assert.h"
+#include "../../debug/statsrv.h"
+#include "intr_latency.h"
+
+/** Take the state of the interrupt lines without stamping them
+ *
+ * Used when the lines are restored (from a checkpoint), the lines
+ * up are not accounted once taken.
+ *
+ */
+void intr_latency_sync(intr_latency_t *latency, uint32_t lines)
+{
+    ASSERT(latency != NULL);
+
+    latency->lines = lines;
+    latency->waiting = 0;
+}
+
+/** Number of the latencies of a line */
+static uint64_t intr_latency_count(const intr_latency_t *latency, unsigned int no)
+{
+    uint64_t count = 0;
+
+    for (unsigned int i = 0; i < INTR_LATENCY_BUCKETS; i++) {
+        count += latency->buckets[no][i];
+    }
+
+    return count;
+}
+
+/** Lowest latency of a bucket */
+static uint64_t intr_latency_low(unsigned int bucket)
+{
+    return (bucket == 0) ? 0 : UINT64_C(1) << (bucket - 1);
+}
+
+/** Highest latency of a bucket */
+static uint64_t intr_latency_high(unsigned int bucket)
+{
+    return (UINT64_C(1) << bucket) - 1;
+}
+
+/** Print the latencies of the lines taken at least once
+ *
+ */
+void intr_latency_print(const intr_latency_t *latency)
+{
+    ASSERT(latency != NULL);
+
+    for (unsigned int no = 0; no < INTR_LATENCY_SOURCES; no++) {
+        uint64_t count = intr_latency_count(latency, no);
+
+        if (count == 0) {
+            continue;
+        }
+
+        printf("[Interrupt %-2u taken] [Mean latency      ] [Max latency       ]\n", no);
+        printf("%20" PRIu64 " %20.2f %20" PRIu64 "\n\n",
+                count, (double) latency->sum[no] / count, latency->max[no]);
+
+        printf("[Latency (cycles)  ] [Interrupts        ]\n");
+
+        for (unsigned int i = 0; i < INTR_LATENCY_BUCKETS; i++) {
+            if (latency->buckets[no][i] == 0) {
+                continue;
+            }
+
+            char range[24];
+            uint64_t low = intr_latency_low(i);
+            uint64_t high = intr_latency_high(i);
+
+            if (i == INTR_LATENCY_BUCKETS - 1) {
+                snprintf(range, sizeof(range), "%" PRIu64 "+", low);
+            } else if (low == high) {
+                snprintf(range, sizeof(range), "%" PRIu64, low);
+            } else {
+                snprintf(range, sizeof(range), "%" PRIu64 "-%" PRIu64, low, high);
+            }
+
+            printf("%20s %20" PRIu64 "\n", range, latency->buckets[no][i]);
+        }
+
+        printf("\n");
+    }
+}
+
+/** Export the latencies to the statistics endpoint
+ *
+ * The histograms follow the Prometheus convention, the buckets
+ * are cumulative and labeled by their upper bounds.
+ *
+ */
+void intr_latency_stats(const intr_latency_t *latency, statsrv_t *stats)
+{
+    ASSERT(latency != NULL);
+
+    char labels[STATSRV_LABELS_SIZE];
+
+    for (unsigned int no = 0; no < INTR_LATENCY_SOURCES; no++) {
+        uint64_t count = intr_latency_count(latency, no);
+
+        if (count == 0) {
+            continue;
+        }
+
+        uint64_t cumulative = 0;
+
+        for (unsigned int i = 0; i < INTR_LATENCY_BUCKETS; i++) {
+            cumulative += latency->buckets[no][i];
+
+            if (i == INTR_LATENCY_BUCKETS - 1) {
+                snprintf(labels, sizeof(labels), "source=\"%u\",le=\"+Inf\"", no);
+            } else {
+                snprintf(labels, sizeof(labels), "source=\"%u\",le=\"%" PRIu64 "\"",
+                        no, intr_latency_high(i));
+            }
+
+            statsrv_counter_labeled(stats, "cpu_interrupt_latency_cycles_bucket",
+                    "Interrupts taken within the cycles since the line went up",
+                    labels, cumulative);
+        }
+
+        snprintf(labels, sizeof(labels), "source=\"%u\"", no);
+        statsrv_counter_labeled(stats, "cpu_interrupt_latency_cycles_sum",
+                "Cycles the taken interrupts waited", labels, latency->sum[no]);
+        statsrv_counter_labeled(stats, "cpu_interrupt_latency_cycles_count",
+                "Interrupts taken", labels, count);
+    }
+}
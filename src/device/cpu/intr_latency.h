@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Interrupt latency histograms
+ *
+ *  The processors note the machine cycle when an interrupt line goes
+ *  up and, when the trap for the line is taken, the cycles in between
+ *  are counted in a histogram of the line. The buckets grow by powers
+ *  of two, the bucket b > 0 counts the latencies from 2^(b-1) up to
+ *  2^b - 1 cycles, the last one all the longer ones.
+ *
+ */
+
+#ifndef INTR_LATENCY_H_
+#define INTR_LATENCY_H_
+
+#include <stdint.h>
+
+#include "../../main.h"
+
+struct statsrv;
+
+/** Number of interrupt lines of a processor */
+#define INTR_LATENCY_SOURCES 16
+
+/** Number of the buckets of a histogram */
+#define INTR_LATENCY_BUCKETS 24
+
+/** Latencies of the interrupts of a processor */
+typedef struct {
+    /** Lines up (bitmap) as of the last update */
+    uint32_t lines;
+
+    /** Lines up which have not been taken yet (bitmap) */
+    uint32_t waiting;
+
+    /** Machine cycle each line went up */
+    uint64_t raised[INTR_LATENCY_SOURCES];
+
+    /** Histograms of the lines */
+    uint64_t buckets[INTR_LATENCY_SOURCES][INTR_LATENCY_BUCKETS];
+
+    /** Sums and maxima of the latencies of the lines */
+    uint64_t sum[INTR_LATENCY_SOURCES];
+    uint64_t max[INTR_LATENCY_SOURCES];
+} intr_latency_t;
+
+/** Note the current state of the interrupt lines
+ *
+ * Has to follow every change of the lines, the lines going up are
+ * stamped by the current machine cycle. Nothing but a compare is
+ * done unless the lines change.
+ *
+ */
+static inline void intr_latency_update(intr_latency_t *latency, uint32_t lines)
+{
+    uint32_t changed = lines ^ latency->lines;
+
+    if (changed == 0) {
+        return;
+    }
+
+    for (uint32_t raised = changed & lines; raised != 0; raised &= raised - 1) {
+        latency->raised[__builtin_ctz(raised)] = steps;
+    }
+
+    latency->waiting = (latency->waiting | changed) & lines;
+    latency->lines = lines;
+}
+
+/** Account the trap taken for an interrupt line
+ *
+ * A line is accounted only once per going up.
+ *
+ */
+static inline void intr_latency_take(intr_latency_t *latency, unsigned int no)
+{
+    uint32_t mask = UINT32_C(1) << no;
+
+    if ((latency->waiting & mask) == 0) {
+        return;
+    }
+
+    uint64_t cycles = steps - latency->raised[no];
+    unsigned int bucket = (cycles == 0) ? 0 : 64 - __builtin_clzll(cycles);
+
+    if (bucket >= INTR_LATENCY_BUCKETS) {
+        bucket = INTR_LATENCY_BUCKETS - 1;
+    }
+
+    latency->buckets[no][bucket]++;
+    latency->sum[no] += cycles;
+
+    if (cycles > latency->max[no]) {
+        latency->max[no] = cycles;
+    }
+
+    latency->waiting &= ~mask;
+}
+
+extern void intr_latency_sync(intr_latency_t *latency, uint32_t lines);
+extern void intr_latency_print(const intr_latency_t *latency);
+extern void intr_latency_stats(const intr_latency_t *latency,
+        struct statsrv *stats);
+
+#endif
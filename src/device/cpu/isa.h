@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Instruction sets of the processors supported by the build
+ *
+ *  By default, any mix of the R4000, RV32IMA and RV64IMA processors
+ *  can be simulated and the processors are reached through their
+ *  method tables (see cpu_ops_t). A build configured by the
+ *  --enable-isa option supports the processors of a single
+ *  instruction set only, the other processor types are not offered
+ *  and the processors are stepped, interrupted and asked for the
+ *  address translations by direct calls.
+ *
+ */
+
+#ifndef ISA_H_
+#define ISA_H_
+
+#include <stdbool.h>
+
+#include "../../../config.h"
+#include "../../main.h"
+#include "general_cpu.h"
+
+#if defined(ISA_ONLY_R4K)
+#define ISA_SINGLE 1
+#define ISA_R4K 1
+#define ISA_RV32 0
+#define ISA_RV64 0
+#elif defined(ISA_ONLY_RV32)
+#define ISA_SINGLE 1
+#define ISA_R4K 0
+#define ISA_RV32 1
+#define ISA_RV64 0
+#elif defined(ISA_ONLY_RV64)
+#define ISA_SINGLE 1
+#define ISA_R4K 0
+#define ISA_RV32 0
+#define ISA_RV64 1
+#else
+#define ISA_SINGLE 0
+#define ISA_R4K 1
+#define ISA_RV32 1
+#define ISA_RV64 1
+#endif
+
+#if ISA_SINGLE
+
+/* The RISC-V headers cannot be included together (see XLEN) */
+#if ISA_R4K
+#include "mips_r4000/cpu.h"
+#elif ISA_RV32
+#include "riscv_rv32ima/cpu.h"
+#else
+#include "riscv_rv64ima/cpu.h"
+#endif
+
+/** Execute one step of a processor
+ *
+ * The interrupts posted to the processor are delivered first
+ * (as by the step function of the processor device).
+ *
+ */
+static inline void isa_step(general_cpu_t *cpu)
+{
+    cpu_deliver_interrupts(cpu);
+
+#if ISA_R4K
+    r4k_step((r4k_cpu_t *) cpu->data);
+#elif ISA_RV32
+    rv32_cpu_step((rv32_cpu_t *) cpu->data);
+#else
+    rv64_cpu_step((rv64_cpu_t *) cpu->data);
+#endif
+}
+
+/** Raise or cancel an interrupt of a processor */
+static inline void isa_interrupt(general_cpu_t *cpu, unsigned int no, bool up)
+{
+#if ISA_R4K
+    if (up) {
+        r4k_interrupt_up((r4k_cpu_t *) cpu->data, no);
+    } else {
+        r4k_interrupt_down((r4k_cpu_t *) cpu->data, no);
+    }
+#elif ISA_RV32
+    if (up) {
+        rv32_interrupt_up((rv32_cpu_t *) cpu->data, no);
+    } else {
+        rv32_interrupt_down((rv32_cpu_t *) cpu->data, no);
+    }
+#else
+    if (up) {
+        rv64_interrupt_up((rv64_cpu_t *) cpu->data, no);
+    } else {
+        rv64_interrupt_down((rv64_cpu_t *) cpu->data, no);
+    }
+#endif
+}
+
+/** Tell a processor about a write to a reserved address */
+static inline bool isa_sc_access(general_cpu_t *cpu, ptr36_t addr, int size)
+{
+#if ISA_R4K
+    return r4k_sc_access((r4k_cpu_t *) cpu->data, addr, size);
+#elif ISA_RV32
+    return rv32_sc_access((rv32_cpu_t *) cpu->data, addr, size);
+#else
+    return rv64_sc_access((rv64_cpu_t *) cpu->data, addr, size);
+#endif
+}
+
+/** Translate a virtual address without changing the processor state */
+static inline bool isa_convert_addr(general_cpu_t *cpu, ptr64_t virt,
+        ptr36_t *phys, bool write)
+{
+#if ISA_R4K
+    return r4k_convert_addr((r4k_cpu_t *) cpu->data, virt, phys, write,
+                   false)
+            == r4k_excNone;
+#elif ISA_RV32
+    return rv32_convert_addr((rv32_cpu_t *) cpu->data, virt.lo, phys, write,
+                   false, false)
+            == rv_exc_none;
+#else
+    return rv64_convert_addr((rv64_cpu_t *) cpu->data, virt.ptr, phys, write,
+                   false, false)
+            == rv_exc_none;
+#endif
+}
+
+#endif
+
+#endif
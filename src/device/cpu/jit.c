@@ -0,0 +1,434 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Translation of hot blocks into host code
+ *
+ *  The translated code is kept in a single executable buffer and
+ *  found by the decoded instruction it starts at (the key). Once the
+ *  buffer or the table of the translations is full, all translations
+ *  are dropped at once and the hot blocks are translated again.
+ *
+ *  The instruction set specific translators emit the host code,
+ *  only x86-64 hosts are supported. The parts of the code shared
+ *  by the translators (the frame of the block, the calls of the
+ *  instruction implementations and the exits) are emitted here.
+ *
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../../assert.h"
+#include "jit.h"
+
+#if defined(__x86_64__) && !defined(__WIN32__)
+#define JIT_HOST_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+/** Size of the buffer of the translated code */
+#define JIT_CODE_SIZE (16 * 1024 * 1024)
+
+/** Number of the slots of the table of translations (a power of two) */
+#define JIT_TABLE_SIZE 65536
+
+/** Translations kept at most (keeps the probe sequences short) */
+#define JIT_TABLE_LIMIT (JIT_TABLE_SIZE / 4 * 3)
+
+/** Translation of a block */
+typedef struct {
+    const void *key; /**< Decoded instruction starting the block */
+    unsigned int shape; /**< Shape of the block (see jit_lookup()) */
+    jit_code_t code;
+} jit_entry_t;
+
+jit_stats_t jit_stats = { 0, 0, 0 };
+
+static jit_entry_t table[JIT_TABLE_SIZE];
+static size_t table_count = 0;
+
+static uint8_t *code = NULL;
+static size_t code_used = 0;
+
+/** Tells whether the code buffer cannot be allocated */
+static bool code_failed = false;
+
+/** Slot of the table where the key is (or would be) stored */
+static size_t jit_slot(const void *key)
+{
+    uint64_t hash = (uint64_t) (uintptr_t) key * UINT64_C(0x9e3779b97f4a7c15);
+    size_t slot = (size_t) (hash >> 48) & (JIT_TABLE_SIZE - 1);
+
+    while ((table[slot].key != NULL) && (table[slot].key != key)) {
+        slot = (slot + 1) & (JIT_TABLE_SIZE - 1);
+    }
+
+    return slot;
+}
+
+/** Tells whether the blocks can be translated on this host
+ *
+ * The executable buffer is allocated on the first call.
+ *
+ */
+bool jit_supported(void)
+{
+#ifdef JIT_HOST_SUPPORTED
+    if ((code == NULL) && (!code_failed)) {
+        void *mem = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (mem == MAP_FAILED) {
+            code_failed = true;
+        } else {
+            code = (uint8_t *) mem;
+        }
+    }
+
+    return code != NULL;
+#else
+    return false;
+#endif
+}
+
+/** Find the translation of a block
+ *
+ * @param key   Decoded instruction starting the block.
+ * @param shape Shape of the block (its number of instructions,
+ *              possibly combined with the mode of the translation).
+ *
+ * @return The translated code or NULL if the block has not been
+ *         translated with the given shape.
+ *
+ */
+jit_code_t jit_lookup(const void *key, unsigned int shape)
+{
+    jit_entry_t *entry = &table[jit_slot(key)];
+
+    if ((entry->key == NULL) || (entry->shape != shape)) {
+        return NULL;
+    }
+
+    return entry->code;
+}
+
+/** Drop all translations */
+void jit_flush(void)
+{
+    memset(table, 0, sizeof(table));
+    table_count = 0;
+    code_used = 0;
+
+    jit_stats.flushes++;
+    jit_stats.code_size = 0;
+}
+
+/** Start emitting the code of a block
+ *
+ * All translations are dropped if the code does not fit.
+ *
+ * @param size Maximal size of the code of the block.
+ *
+ * @return False if the code cannot be emitted at all.
+ *
+ */
+bool jit_begin(jit_buffer_t *buf, size_t size)
+{
+    ASSERT(buf != NULL);
+
+    if ((!jit_supported()) || (size > JIT_CODE_SIZE)) {
+        return false;
+    }
+
+    if ((code_used + size > JIT_CODE_SIZE) || (table_count >= JIT_TABLE_LIMIT)) {
+        jit_flush();
+    }
+
+    buf->start = code + code_used;
+    buf->pos = buf->start;
+    buf->end = buf->start + size;
+
+    return true;
+}
+
+/** Finish the code of a block and remember its translation
+ *
+ * @param key   Decoded instruction starting the block.
+ * @param shape Shape of the block (see jit_lookup()).
+ *
+ * @return The translated code.
+ *
+ */
+jit_code_t jit_commit(jit_buffer_t *buf, const void *key, unsigned int shape)
+{
+    ASSERT(buf != NULL);
+    ASSERT(key != NULL);
+    ASSERT(buf->pos <= buf->end);
+
+    size_t size = buf->pos - buf->start;
+    code_used += size;
+
+    jit_entry_t *entry = &table[jit_slot(key)];
+
+    if (entry->key == NULL) {
+        table_count++;
+    }
+
+    entry->key = key;
+    entry->shape = shape;
+    entry->code = (jit_code_t) (void *) buf->start;
+
+    jit_stats.translations++;
+    jit_stats.code_size = code_used;
+
+    return entry->code;
+}
+
+/** Emit a conditional jump (jne rel32) and return the position of its displacement */
+static uint8_t *jit_emit_jne(jit_buffer_t *buf)
+{
+    jit_emit8(buf, 0x0f);
+    jit_emit8(buf, 0x85);
+
+    uint8_t *patch = buf->pos;
+    jit_emit32(buf, 0);
+    return patch;
+}
+
+/** Emit the entry of the translated code
+ *
+ * Saves the callee-saved registers used by the code,
+ * loads the arguments and starts the first pass.
+ *
+ */
+void jit_emit_prologue(jit_buffer_t *buf)
+{
+    /* push rbx; push r12; push r13; push r14; push r15 */
+    jit_emit8(buf, 0x53);
+    for (uint8_t reg = 0x54; reg <= 0x57; reg++) {
+        jit_emit8(buf, 0x41);
+        jit_emit8(buf, reg);
+    }
+
+    /* mov rbx, rdi; mov r13, rsi; mov r12, [rsi]; mov r14, rdx */
+    static const uint8_t setup[] = {
+        0x48, 0x89, 0xfb, 0x49, 0x89, 0xf5,
+        0x4c, 0x8b, 0x26, 0x49, 0x89, 0xd6
+    };
+
+    for (size_t i = 0; i < sizeof(setup); i++) {
+        jit_emit8(buf, setup[i]);
+    }
+
+    /* xor r15d, r15d */
+    jit_emit8(buf, 0x45);
+    jit_emit8(buf, 0x31);
+    jit_emit8(buf, 0xff);
+}
+
+/** Emit the return from the translated code */
+void jit_emit_epilogue(jit_buffer_t *buf)
+{
+    /* pop r15; pop r14; pop r13; pop r12; pop rbx; ret */
+    for (uint8_t reg = 0x5f; reg >= 0x5c; reg--) {
+        jit_emit8(buf, 0x41);
+        jit_emit8(buf, reg);
+    }
+
+    jit_emit8(buf, 0x5b);
+    jit_emit8(buf, 0xc3);
+}
+
+/** Emit an instruction working on a field of the processor
+ *
+ * The memory operand is [rbx + disp32].
+ *
+ * @param wide   Whether the operation is 64-bit (REX.W).
+ * @param opcode Opcode of the instruction.
+ * @param reg    The reg field of the ModRM byte (register number
+ *               below 8 or the opcode extension).
+ * @param offset Offset of the field in the processor structure.
+ *
+ */
+void jit_emit_cpu(jit_buffer_t *buf, bool wide, uint8_t opcode, uint8_t reg,
+        size_t offset)
+{
+    ASSERT(reg < 8);
+    ASSERT(offset <= INT32_MAX);
+
+    if (wide) {
+        jit_emit8(buf, 0x48);
+    }
+
+    jit_emit8(buf, opcode);
+    jit_emit8(buf, 0x83 | (reg << 3));
+    jit_emit32(buf, (uint32_t) offset);
+}
+
+/** Emit a call of func(cpu, arg)
+ *
+ * The result of the function is left in eax.
+ *
+ */
+void jit_emit_call(jit_buffer_t *buf, jit_func_t func, uint32_t arg)
+{
+    /* mov rdi, rbx; mov esi, arg; movabs rax, func; call rax */
+    jit_emit8(buf, 0x48);
+    jit_emit8(buf, 0x89);
+    jit_emit8(buf, 0xdf);
+    jit_emit8(buf, 0xbe);
+    jit_emit32(buf, arg);
+    jit_emit8(buf, 0x48);
+    jit_emit8(buf, 0xb8);
+    jit_emit64(buf, (uint64_t) (uintptr_t) func);
+    jit_emit8(buf, 0xff);
+    jit_emit8(buf, 0xd0);
+}
+
+/** Emit the store of the number of the completed instructions
+ *
+ * @param count Instructions completed by the current pass.
+ *
+ */
+void jit_emit_done(jit_buffer_t *buf, unsigned int count)
+{
+    /* lea ecx, [r15 + count]; mov [r14], ecx */
+    jit_emit8(buf, 0x41);
+    jit_emit8(buf, 0x8d);
+    jit_emit8(buf, 0x8f);
+    jit_emit32(buf, count);
+    jit_emit8(buf, 0x41);
+    jit_emit8(buf, 0x89);
+    jit_emit8(buf, 0x0e);
+}
+
+/** Emit the start of another pass of a repeated block
+ *
+ * @param count Instructions completed by the finished pass.
+ *
+ */
+void jit_emit_repeat(jit_buffer_t *buf, unsigned int count)
+{
+    /* add r15d, count */
+    jit_emit8(buf, 0x41);
+    jit_emit8(buf, 0x81);
+    jit_emit8(buf, 0xc7);
+    jit_emit32(buf, count);
+}
+
+/** Emit the setting of the result of the translated code */
+void jit_emit_result(jit_buffer_t *buf, uint32_t value)
+{
+    /* mov eax, value */
+    jit_emit8(buf, 0xb8);
+    jit_emit32(buf, value);
+}
+
+/** Emit an unconditional jump
+ *
+ * @return Position of the displacement of the jump (see jit_patch32()).
+ *
+ */
+uint8_t *jit_emit_jump(jit_buffer_t *buf)
+{
+    /* jmp rel32 */
+    jit_emit8(buf, 0xe9);
+
+    uint8_t *patch = buf->pos;
+    jit_emit32(buf, 0);
+    return patch;
+}
+
+/** Emit a jump taken unless the result of a call is the given value
+ *
+ * @return Position of the displacement of the jump (see jit_patch32()).
+ *
+ */
+uint8_t *jit_emit_exit_unless_result(jit_buffer_t *buf, uint32_t value)
+{
+    /* cmp eax, value */
+    jit_emit8(buf, 0x3d);
+    jit_emit32(buf, value);
+    return jit_emit_jne(buf);
+}
+
+/** Emit a jump taken once the generation of the frame changes
+ *
+ * @return Position of the displacement of the jump (see jit_patch32()).
+ *
+ */
+uint8_t *jit_emit_exit_if_written(jit_buffer_t *buf)
+{
+    /* cmp [r13], r12 */
+    jit_emit8(buf, 0x4d);
+    jit_emit8(buf, 0x39);
+    jit_emit8(buf, 0x65);
+    jit_emit8(buf, 0x00);
+    return jit_emit_jne(buf);
+}
+
+/** Emit a jump taken if the global flag is set
+ *
+ * @return Position of the displacement of the jump (see jit_patch32()).
+ *
+ */
+uint8_t *jit_emit_exit_if_set(jit_buffer_t *buf, const bool *flag)
+{
+    /* movabs rcx, flag; cmp byte [rcx], 0 */
+    jit_emit8(buf, 0x48);
+    jit_emit8(buf, 0xb9);
+    jit_emit64(buf, (uint64_t) (uintptr_t) flag);
+    jit_emit8(buf, 0x80);
+    jit_emit8(buf, 0x39);
+    jit_emit8(buf, 0x00);
+    return jit_emit_jne(buf);
+}
+
+/** Emit a jump taken if the flag of the processor is set
+ *
+ * @param offset Offset of the flag in the processor structure.
+ *
+ * @return Position of the displacement of the jump (see jit_patch32()).
+ *
+ */
+uint8_t *jit_emit_exit_if_cpu_set(jit_buffer_t *buf, size_t offset)
+{
+    /* cmp byte [rbx + offset], 0 */
+    jit_emit_cpu(buf, false, 0x80, 7, offset);
+    jit_emit8(buf, 0x00);
+    return jit_emit_jne(buf);
+}
+
+/** Emit a jump taken unless the block may complete more instructions
+ *
+ * The most instructions the block may complete are given
+ * by the caller (see jit_code_t).
+ *
+ * @param count Instructions the current pass would complete.
+ *
+ * @return Position of the displacement of the jump (see jit_patch32()).
+ *
+ */
+uint8_t *jit_emit_exit_unless_room(jit_buffer_t *buf, unsigned int count)
+{
+    /* lea ecx, [r15 + count]; cmp ecx, [r14]; ja rel32 */
+    jit_emit8(buf, 0x41);
+    jit_emit8(buf, 0x8d);
+    jit_emit8(buf, 0x8f);
+    jit_emit32(buf, count);
+    jit_emit8(buf, 0x41);
+    jit_emit8(buf, 0x3b);
+    jit_emit8(buf, 0x0e);
+    jit_emit8(buf, 0x0f);
+    jit_emit8(buf, 0x87);
+
+    uint8_t *patch = buf->pos;
+    jit_emit32(buf, 0);
+    return patch;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Translation of hot blocks into host code
+ *
+ */
+
+#ifndef JIT_H_
+#define JIT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Maximal number of executions of a block before its translation */
+#define JIT_THRESHOLD_MAX (UINT16_MAX - 1)
+
+/** Translated code of a block of instructions
+ *
+ * @param cpu        Processor executing the block.
+ * @param generation Generation of the frame holding the block, the block
+ *                   stops once it changes (i.e. the frame is written to).
+ * @param done       Most instructions the block may complete when it
+ *                   repeats itself on the entry, the number of the
+ *                   instructions completed by the block on the return.
+ *
+ * @return Exception raised by the instruction following the completed
+ *         ones (in the encoding of the translated instruction set).
+ *
+ */
+typedef int (*jit_code_t)(void *cpu, const uint64_t *generation,
+        unsigned int *done);
+
+/** Function called by the translated code (cast to the real type) */
+typedef void (*jit_func_t)(void);
+
+/** Code being emitted
+ *
+ * Between the prologue and the epilogue the translated code keeps
+ * the processor in rbx, the generation at the entry in r12, the
+ * pointer to the generation in r13, the pointer to the number
+ * of the completed instructions in r14 and the instructions
+ * completed by the earlier passes of a repeated block in r15.
+ *
+ */
+typedef struct {
+    uint8_t *start;
+    uint8_t *pos;
+    uint8_t *end;
+} jit_buffer_t;
+
+/** Global translation statistics */
+typedef struct {
+    uint64_t translations; /**< Blocks translated */
+    uint64_t flushes; /**< Flushes of all translations */
+    size_t code_size; /**< Bytes of the live translated code */
+} jit_stats_t;
+
+extern jit_stats_t jit_stats;
+
+extern bool jit_supported(void);
+extern jit_code_t jit_lookup(const void *key, unsigned int shape);
+extern bool jit_begin(jit_buffer_t *buf, size_t size);
+extern jit_code_t jit_commit(jit_buffer_t *buf, const void *key,
+        unsigned int shape);
+extern void jit_flush(void);
+
+extern void jit_emit_prologue(jit_buffer_t *buf);
+extern void jit_emit_epilogue(jit_buffer_t *buf);
+extern void jit_emit_cpu(jit_buffer_t *buf, bool wide, uint8_t opcode,
+        uint8_t reg, size_t offset);
+extern void jit_emit_call(jit_buffer_t *buf, jit_func_t func, uint32_t arg);
+extern void jit_emit_done(jit_buffer_t *buf, unsigned int count);
+extern void jit_emit_repeat(jit_buffer_t *buf, unsigned int count);
+extern void jit_emit_result(jit_buffer_t *buf, uint32_t value);
+extern uint8_t *jit_emit_jump(jit_buffer_t *buf);
+extern uint8_t *jit_emit_exit_unless_result(jit_buffer_t *buf, uint32_t value);
+extern uint8_t *jit_emit_exit_if_written(jit_buffer_t *buf);
+extern uint8_t *jit_emit_exit_if_set(jit_buffer_t *buf, const bool *flag);
+extern uint8_t *jit_emit_exit_if_cpu_set(jit_buffer_t *buf, size_t offset);
+extern uint8_t *jit_emit_exit_unless_room(jit_buffer_t *buf, unsigned int count);
+
+static inline void jit_emit8(jit_buffer_t *buf, uint8_t val)
+{
+    *buf->pos++ = val;
+}
+
+static inline void jit_emit32(jit_buffer_t *buf, uint32_t val)
+{
+    for (unsigned int i = 0; i < 4; i++) {
+        *buf->pos++ = (uint8_t) (val >> (8 * i));
+    }
+}
+
+static inline void jit_emit64(jit_buffer_t *buf, uint64_t val)
+{
+    jit_emit32(buf, (uint32_t) val);
+    jit_emit32(buf, (uint32_t) (val >> 32));
+}
+
+/** Fill in a 32-bit displacement emitted at the given position
+ *
+ * The displacement is relative to the end of the displacement.
+ *
+ */
+static inline void jit_patch32(uint8_t *pos, const uint8_t *target)
+{
+    int32_t disp = (int32_t) (target - (pos + 4));
+
+    for (unsigned int i = 0; i < 4; i++) {
+        pos[i] = (uint8_t) ((uint32_t) disp >> (8 * i));
+    }
+}
+
+#endif
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Lockstep differential checking of the R4000 blocks
+ *
+ *  Included by the CPU implementation after the step (cpu_step())
+ *  is defined. The step executing a block is repeated by the
+ *  interpreter and both are compared (see cosim.c of the debugging
+ *  features).
+ *
+ */
+
+#include "../../../debug/cosim.h"
+
+/** Compare a TLB entry after the fast run and after the interpretation */
+static bool tlb_entry_same(const tlb_entry_t *fast, const tlb_entry_t *reference)
+{
+    if ((fast->mask != reference->mask) || (fast->vpn2 != reference->vpn2)
+            || (fast->global != reference->global)
+            || (fast->asid != reference->asid)) {
+        return false;
+    }
+
+    for (unsigned int i = 0; i < 2; i++) {
+        const tlb_rec_t *fast_pg = &fast->pg[i];
+        const tlb_rec_t *reference_pg = &reference->pg[i];
+
+        if ((fast_pg->pfn != reference_pg->pfn)
+                || (fast_pg->cohh != reference_pg->cohh)
+                || (fast_pg->dirty != reference_pg->dirty)
+                || (fast_pg->valid != reference_pg->valid)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/** Compare the architectural state after the fast run and after the interpretation
+ *
+ * Random is not compared, it follows Count (see r4k_sync_random()).
+ *
+ * @return False if the state diverges (the first divergence
+ *         is reported).
+ *
+ */
+static bool r4k_cosim_compare(const r4k_cpu_t *fast, const r4k_cpu_t *reference)
+{
+    unsigned int cpuno = reference->procno;
+    char name[32];
+
+    if (fast->pc.ptr != reference->pc.ptr) {
+        cosim_diverged(cpuno, "pc", fast->pc.ptr, reference->pc.ptr);
+        return false;
+    }
+
+    if (fast->pc_next.ptr != reference->pc_next.ptr) {
+        cosim_diverged(cpuno, "next pc", fast->pc_next.ptr, reference->pc_next.ptr);
+        return false;
+    }
+
+    for (unsigned int i = 1; i < R4K_REG_COUNT; i++) {
+        if (fast->regs[i].val != reference->regs[i].val) {
+            cosim_diverged(cpuno, r4k_regname[i], fast->regs[i].val,
+                    reference->regs[i].val);
+            return false;
+        }
+    }
+
+    if (fast->loreg.val != reference->loreg.val) {
+        cosim_diverged(cpuno, "lo", fast->loreg.val, reference->loreg.val);
+        return false;
+    }
+
+    if (fast->hireg.val != reference->hireg.val) {
+        cosim_diverged(cpuno, "hi", fast->hireg.val, reference->hireg.val);
+        return false;
+    }
+
+    if (fast->branch != reference->branch) {
+        cosim_diverged(cpuno, "branch state", fast->branch, reference->branch);
+        return false;
+    }
+
+    if (fast->stdby != reference->stdby) {
+        cosim_diverged(cpuno, "standby", fast->stdby, reference->stdby);
+        return false;
+    }
+
+    if (fast->excaddr.ptr != reference->excaddr.ptr) {
+        cosim_diverged(cpuno, "exception address", fast->excaddr.ptr,
+                reference->excaddr.ptr);
+        return false;
+    }
+
+    if ((fast->llbit != reference->llbit)
+            || (fast->lladdr != reference->lladdr)) {
+        cosim_diverged(cpuno, "LL address", fast->llbit ? fast->lladdr : 0,
+                reference->llbit ? reference->lladdr : 0);
+        return false;
+    }
+
+    for (unsigned int i = 0; i < R4K_REG_COUNT; i++) {
+        if ((i != cp0_Random) && (fast->cp0[i].val != reference->cp0[i].val)) {
+            snprintf(name, sizeof(name), "cp0 %s", r4k_cp0name[i]);
+            cosim_diverged(cpuno, name, fast->cp0[i].val, reference->cp0[i].val);
+            return false;
+        }
+    }
+
+    if (fast->random_base != reference->random_base) {
+        cosim_diverged(cpuno, "cp0 Random", fast->random_base,
+                reference->random_base);
+        return false;
+    }
+
+    for (unsigned int i = 0; i < R4K_REG_COUNT; i++) {
+        if (fast->fpregs[i] != reference->fpregs[i]) {
+            snprintf(name, sizeof(name), "fpr%u", i);
+            cosim_diverged(cpuno, name, fast->fpregs[i], reference->fpregs[i]);
+            return false;
+        }
+    }
+
+    for (unsigned int i = 0; i < reference->tlb_entries; i++) {
+        if (!tlb_entry_same(&fast->tlb[i], &reference->tlb[i])) {
+            snprintf(name, sizeof(name), "TLB entry %u (VPN2)", i);
+            cosim_diverged(cpuno, name, fast->tlb[i].vpn2, reference->tlb[i].vpn2);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/** Execute a step by the fast engine and check it by the interpreter
+ *
+ * The interpreter executes as many instructions as the block and
+ * the instruction finishing the step, a deliverable interrupt is
+ * taken only after the last one. The block statistics are those
+ * of the fast run.
+ *
+ */
+static void r4k_cosim_step(r4k_cpu_t *cpu)
+{
+    static r4k_cpu_t before;
+    static r4k_cpu_t fast;
+
+    unsigned int cpuno = cpu->procno;
+    uint64_t recorded = flight_rings[cpuno].recorded;
+    uint64_t blocks = cpu->blocks;
+    uint64_t block_instrs = cpu->block_instrs;
+
+    memcpy(&before, cpu, sizeof(r4k_cpu_t));
+
+    cosim_begin();
+    cpu_step(cpu, true, true);
+
+    /* Without a block the step has been interpreted already */
+    if (cpu->blocks == blocks) {
+        cosim_cancel();
+        return;
+    }
+
+    /* Kept before the rollback touches the memory */
+    memcpy(&fast, cpu, sizeof(r4k_cpu_t));
+
+    if (!cosim_rollback()) {
+        return;
+    }
+
+    memcpy(cpu, &before, sizeof(r4k_cpu_t));
+    flight_rings[cpuno].recorded = recorded;
+
+    /* The stores of the fast run may have broken the tracked address */
+    if (cpu->llbit) {
+        sc_register(cpuno, cpu->lladdr);
+    }
+
+    uint64_t count = fast.block_instrs - block_instrs + 1;
+
+    for (uint64_t i = 0; i < count; i++) {
+        ptr36_t phys;
+        uint32_t instr = 0;
+
+        if (r4k_convert_addr(cpu, cpu->pc, &phys, false, false) == r4k_excNone) {
+            frame_t *frame = physmem_find_frame(phys);
+            if (frame != NULL) {
+                instr = physmem_frame_read32(frame, phys, false);
+            }
+        }
+
+        cosim_record(cpuno, TRACE_ARCH_R4K, cpu->pc.ptr, instr);
+        cpu_step(cpu, false, i + 1 == count);
+    }
+
+    if (r4k_cosim_compare(&fast, cpu)) {
+        cosim_check_memory(cpuno);
+    }
+
+    cosim_finish();
+
+    cpu->blocks = fast.blocks;
+    cpu->block_instrs = fast.block_instrs;
+    cpu->jit_blocks = fast.jit_blocks;
+}
@@ -15,16 +15,30 @@
 #include <string.h>
 
 #include "../../../assert.h"
+#include "../../../checkpoint.h"
 #include "../../../debug/breakpoint.h"
+#include "../../../debug/cachesim.h"
+#include "../../../debug/callstack.h"
+#include "../../../debug/catchpoint.h"
+#include "../../../debug/coverage.h"
 #include "../../../debug/debug.h"
+#include "../../../debug/flight.h"
+#include "../../../debug/memtrace.h"
 #include "../../../debug/gdb.h"
+#include "../../../debug/trace.h"
+#include "../../../debug/tracefilter.h"
 #include "../../../endian.h"
 #include "../../../env.h"
 #include "../../../fault.h"
+#include "../../../hypercall.h"
 #include "../../../input.h"
 #include "../../../main.h"
+#include "../../../parallel.h"
 #include "../../../physmem.h"
+#include "../../../profile.h"
+#include "../../../roi.h"
 #include "../../../text.h"
+#include "../../../usermode.h"
 #include "../../../utils.h"
 #include "../../device.h"
 #include "cpu.h"
@@ -262,6 +276,24 @@ typedef enum {
     AM_WRITE
 } acc_mode_t;
 
+static_assert(AM_WRITE + 1 == R4K_UTLB_COUNT, "every access mode needs its own last translation");
+
+/** Status bits which select the address space of a translation */
+#define UTLB_STATUS_MASK \
+    (cp0_status_exl_mask | cp0_status_erl_mask | cp0_status_ksu_mask \
+            | cp0_status_ux_mask | cp0_status_sx_mask | cp0_status_kx_mask \
+            | cp0_status_ts_mask)
+
+/** Status bits which select the kernel 32-bit address space */
+#define KSEG_STATUS_MASK \
+    (cp0_status_exl_mask | cp0_status_erl_mask | cp0_status_ksu_mask \
+            | cp0_status_ux_mask | cp0_status_sx_mask | cp0_status_kx_mask)
+
+/** kseg0 and kseg1 together */
+#define KSEG01_MASK UINT32_C(0xc0000000)
+#define KSEG01_BITS UINT32_C(0x80000000)
+#define KSEG01_PHYS_MASK UINT32_C(0x1fffffff)
+
 /** Partial memory access shift tables
  *
  */
@@ -299,6 +331,198 @@ static shift_tab_t shift_tab_right_store[] = {
     { UINT32_C(0x00ffffff), 24 }
 };
 
+/** Test whether the TLB entry maps the address in the given address space
+ *
+ */
+static inline bool tlb_entry_match(tlb_entry_t *entry, ptr64_t virt,
+        unsigned int asid)
+{
+    return ((virt.lo & entry->mask) == entry->vpn2)
+            && ((entry->global) || (entry->asid == asid));
+}
+
+/** Tell whether the TLB entry maps a single pair of 4 KiB pages */
+static inline bool tlb_entry_small(tlb_entry_t *entry)
+{
+    return entry->mask == (uint32_t) cp0_entryhi_vpn2_mask;
+}
+
+/** Bucket of the TLB miss filter for a page pair */
+static inline unsigned int tlb_bucket(uint32_t vpn2)
+{
+    return (vpn2 ^ (vpn2 >> 8)) & (R4K_TLB_BUCKETS - 1);
+}
+
+/** Add or remove a TLB entry in the TLB miss filter
+ *
+ */
+static void tlb_filter_update(r4k_cpu_t *cpu, tlb_entry_t *entry, bool add)
+{
+    if (tlb_entry_small(entry)) {
+        uint16_t *bucket = &cpu->tlb_buckets[tlb_bucket(entry->vpn2 >> 13)];
+        *bucket = add ? *bucket + 1 : *bucket - 1;
+    } else {
+        cpu->tlb_large = add ? cpu->tlb_large + 1 : cpu->tlb_large - 1;
+    }
+}
+
+/** Vector of TLB tags */
+typedef uint32_t tlb_tag_vec_t
+        __attribute__((vector_size(R4K_TLB_TAG_LANES * sizeof(uint32_t))));
+
+/** Compute the tag of a TLB entry
+ *
+ * The VPN2 of the entry fills the upper bits of the tag and its ASID
+ * the low 8 bits (below the 8 KiB page pair), a global entry leaves
+ * the ASID out of the mask. The entries beyond the configured number
+ * never match.
+ *
+ */
+static void tlb_tag_set(r4k_cpu_t *cpu, unsigned int index)
+{
+    if (index >= cpu->tlb_entries) {
+        cpu->tlb_tags[index] = 1;
+        cpu->tlb_tag_masks[index] = 0;
+        return;
+    }
+
+    tlb_entry_t *entry = &cpu->tlb[index];
+
+    if (entry->global) {
+        cpu->tlb_tags[index] = entry->vpn2;
+        cpu->tlb_tag_masks[index] = entry->mask;
+    } else {
+        cpu->tlb_tags[index] = entry->vpn2 | entry->asid;
+        cpu->tlb_tag_masks[index] = entry->mask | cp0_entryhi_asid_mask;
+    }
+}
+
+/** Find the first TLB entry matching the VPN2 and the ASID
+ *
+ * The tags are compared R4K_TLB_TAG_LANES at a time by the vector
+ * instructions of the host (or by scalar code where there are none),
+ * which keeps the fully associative search of all the entries.
+ *
+ * @param vpn2 Address with the bits below the page pair cleared.
+ *
+ * @return Index of the entry or -1 if there is none.
+ *
+ */
+static int tlb_tag_find(r4k_cpu_t *cpu, uint32_t vpn2, unsigned int asid)
+{
+    tlb_tag_vec_t key = ((tlb_tag_vec_t) { 0 }) + (vpn2 | asid);
+
+    for (unsigned int i = 0; i < cpu->tlb_entries; i += R4K_TLB_TAG_LANES) {
+        tlb_tag_vec_t tags = *((tlb_tag_vec_t *) &cpu->tlb_tags[i]);
+        tlb_tag_vec_t masks = *((tlb_tag_vec_t *) &cpu->tlb_tag_masks[i]);
+        tlb_tag_vec_t hits = (tlb_tag_vec_t) ((key & masks) == tags);
+
+        uint64_t any[R4K_TLB_TAG_LANES / 2];
+        memcpy(any, &hits, sizeof(any));
+
+        uint64_t found = 0;
+        for (unsigned int j = 0; j < R4K_TLB_TAG_LANES / 2; j++) {
+            found |= any[j];
+        }
+
+        if (found != 0) {
+            for (unsigned int j = 0; j < R4K_TLB_TAG_LANES; j++) {
+                if (hits[j] != 0) {
+                    return i + j;
+                }
+            }
+        }
+    }
+
+    return -1;
+}
+
+/** Compute the TLB miss filter and the tags from the TLB entries
+ *
+ */
+static void tlb_filter_rebuild(r4k_cpu_t *cpu)
+{
+    memset(cpu->tlb_buckets, 0, sizeof(cpu->tlb_buckets));
+    cpu->tlb_large = 0;
+
+    for (unsigned int i = 0; i < cpu->tlb_entries; i++) {
+        tlb_filter_update(cpu, &cpu->tlb[i], true);
+    }
+
+    for (unsigned int i = 0; i < TLB_ENTRIES_MAX; i++) {
+        tlb_tag_set(cpu, i);
+    }
+}
+
+/** Find the victim TLB entry mapping the address
+ *
+ * Entries with both pages invalid are the removed ones.
+ *
+ */
+static tlb_entry_t *tlb_victim_find(r4k_cpu_t *cpu, ptr64_t virt,
+        unsigned int asid)
+{
+    for (unsigned int i = 0; i < cpu->tlb_victim_count; i++) {
+        tlb_entry_t *entry = &cpu->tlb_victim[i];
+
+        if (((entry->pg[0].valid) || (entry->pg[1].valid))
+                && (tlb_entry_match(entry, virt, asid))) {
+            cpu->tlb_victim_hits++;
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/** Find the TLB entry mapping the address
+ *
+ * The entry found last for the page pair and ASID is looked up
+ * in a hashed cache first. The cached index is verified against
+ * the entry itself, so rewriting TLB entries or changing the ASID
+ * needs no invalidation. Only when the verification fails are the
+ * tags of all the entries compared (see tlb_tag_find()).
+ *
+ * Most of the TLB refills are detected without the search. Unless
+ * there are entries of larger pages, the filter counts the entries
+ * in each bucket of page pairs, an empty bucket means a miss.
+ *
+ * @return Matching entry or NULL if there is none.
+ *
+ */
+static tlb_entry_t *tlb_find(r4k_cpu_t *cpu, ptr64_t virt)
+{
+    unsigned int asid = cp0_entryhi_asid(cpu);
+    uint32_t vpn2 = virt.lo >> 13;
+    r4k_tlb_lookup_t *slot = &cpu->tlb_lookup[(vpn2 ^ (vpn2 >> 8) ^ asid)
+            & (R4K_TLB_LOOKUP_SIZE - 1)];
+
+    if ((slot->valid) && (slot->vpn2 == vpn2) && (slot->asid == asid)) {
+        tlb_entry_t *entry = &cpu->tlb[slot->index];
+
+        if (tlb_entry_match(entry, virt, asid)) {
+            return entry;
+        }
+    }
+
+    if ((cpu->tlb_large == 0) && (cpu->tlb_buckets[tlb_bucket(vpn2)] == 0)) {
+        return (cpu->tlb_victim_count > 0) ? tlb_victim_find(cpu, virt, asid) : NULL;
+    }
+
+    int index = tlb_tag_find(cpu, virt.lo & (uint32_t) cp0_entryhi_vpn2_mask, asid);
+
+    if (index >= 0) {
+        slot->valid = true;
+        slot->vpn2 = vpn2;
+        slot->asid = asid;
+        slot->index = index;
+
+        return &cpu->tlb[index];
+    }
+
+    return (cpu->tlb_victim_count > 0) ? tlb_victim_find(cpu, virt, asid) : NULL;
+}
+
 /** Address traslation through the TLB table
  *
  * See tlb_look_t definition
@@ -314,45 +538,31 @@ static tlb_look_t tlb_look(r4k_cpu_t *cpu, ptr64_t virt, ptr36_t *phys, bool wr)
         return TLBL_OK;
     }
 
-    unsigned int hint = cpu->tlb_hint;
-    unsigned int i;
-
     /* Look for the TBL hit */
-    for (i = 0; i < TLB_ENTRIES; i++) {
-        tlb_entry_t *entry = &cpu->tlb[(i + hint) % TLB_ENTRIES];
-
-        /* TLB hit? */
-        if ((virt.lo & entry->mask) == entry->vpn2) {
-            /* Test ASID */
-            if ((!entry->global) && (entry->asid != cp0_entryhi_asid(cpu))) {
-                continue;
-            }
-
-            /* Calculate subpage */
-            ptr36_t smask = (ptr36_t) (entry->mask >> 1) | TLB_PHYSMASK;
-            unsigned int subpage = ((virt.lo & entry->mask) < (virt.lo & smask)) ? 1 : 0;
-
-            /* Test valid & dirty */
-            if (!entry->pg[subpage].valid) {
-                return TLBL_INVALID;
-            }
+    tlb_entry_t *entry = tlb_find(cpu, virt);
 
-            if ((wr) && (!entry->pg[subpage].dirty)) {
-                return TLBL_MODIFIED;
-            }
+    if (entry == NULL) {
+        return TLBL_REFILL;
+    }
 
-            /* Make address */
-            ptr36_t amask = virt.lo & (~smask);
-            *phys = amask | (entry->pg[subpage].pfn & smask);
+    /* Calculate subpage */
+    ptr36_t smask = (ptr36_t) (entry->mask >> 1) | TLB_PHYSMASK;
+    unsigned int subpage = ((virt.lo & entry->mask) < (virt.lo & smask)) ? 1 : 0;
 
-            /* Update optimization hint */
-            cpu->tlb_hint = i;
+    /* Test valid & dirty */
+    if (!entry->pg[subpage].valid) {
+        return TLBL_INVALID;
+    }
 
-            return TLBL_OK;
-        }
+    if ((wr) && (!entry->pg[subpage].dirty)) {
+        return TLBL_MODIFIED;
     }
 
-    return TLBL_REFILL;
+    /* Make address */
+    ptr36_t amask = virt.lo & (~smask);
+    *phys = amask | (entry->pg[subpage].pfn & smask);
+
+    return TLBL_OK;
 }
 
 /** Fill up cp0 registers with specified address
@@ -364,13 +574,15 @@ static void fill_tlb_error(r4k_cpu_t *cpu, ptr64_t addr)
 
     cp0_badvaddr(cpu).val = addr.ptr;
 
-    cp0_context(cpu).val &= cp0_context_ptebase_mask;
-    cp0_context(cpu).val |= (addr.ptr >> cp0_context_addr_shift)
-            & ~cp0_context_res1_mask;
+    /* VPN2 of both layouts starts at bit 4, the region is bit 31 of XContext */
+    uint64_t badvpn2 = addr.ptr >> cp0_context_addr_shift;
+
+    cp0_context(cpu).val = (cp0_context(cpu).val & cp0_context_ptebase_mask)
+            | (badvpn2 & cp0_context_badvpn2_mask);
 
-    cp0_xcontext(cpu).val &= cp0_xcontext_ptebase_mask;
-    cp0_xcontext(cpu).val |= (addr.ptr >> cp0_xcontext_addr_shift)
-            & ~cp0_xcontext_res1_mask;
+    cp0_xcontext(cpu).val = (cp0_xcontext(cpu).val & cp0_xcontext_ptebase_mask)
+            | ((addr.ptr >> (62 - cp0_xcontext_r_shift)) & cp0_xcontext_r_mask)
+            | (badvpn2 & cp0_xcontext_badvpn2_mask);
 
     cp0_entryhi(cpu).val &= cp0_entryhi_asid_mask;
     cp0_entryhi(cpu).val |= addr.ptr & cp0_entryhi_vpn2_mask;
@@ -542,6 +754,8 @@ static r4k_exc_t convert_addr_kernel32(r4k_cpu_t *cpu, ptr64_t virt, ptr36_t *ph
             return tlb_hit32(cpu, virt, phys, wr, noisy);
         }
 
+        /* Unmapped while handling an error */
+        *phys = virt.lo;
         return r4k_excNone;
     }
 
@@ -673,6 +887,192 @@ r4k_exc_t r4k_convert_addr(r4k_cpu_t *cpu, ptr64_t virt, ptr36_t *phys, bool wri
     }
 }
 
+/** Forget the last translations and the fetch cache
+ *
+ * Needs to be done whenever the TLB contents change. Changes
+ * of the address space (Status and ASID) are detected by the
+ * lookup itself.
+ *
+ */
+static void utlb_flush(r4k_cpu_t *cpu)
+{
+    memset(cpu->utlb, 0, sizeof(cpu->utlb));
+    memset(cpu->fetch_cache, 0, sizeof(cpu->fetch_cache));
+}
+
+/** Forget the fetch translations a TLB entry might have made
+ *
+ * Called for the entry replaced and the entry written by TLBWI
+ * and TLBWR, the fetch cache keeps the translations of the other
+ * entries.
+ *
+ */
+static void fetch_cache_drop(r4k_cpu_t *cpu, tlb_entry_t *entry)
+{
+    for (unsigned int i = 0; i < R4K_FETCH_CACHE_SIZE; i++) {
+        r4k_utlb_entry_t *slot = &cpu->fetch_cache[i];
+        ptr64_t virt = { .ptr = slot->vpage << FRAME_WIDTH };
+
+        if ((slot->valid) && (tlb_entry_match(entry, virt, slot->asid))) {
+            slot->valid = false;
+        }
+    }
+}
+
+/** Test whether a remembered translation applies to a page
+ *
+ */
+static inline bool utlb_entry_match(const r4k_utlb_entry_t *entry,
+        uint64_t vpage, uint32_t status, unsigned int asid)
+{
+    return (entry->valid) && (entry->vpage == vpage)
+            && (entry->status == status) && (entry->asid == asid)
+            && (entry->layout == physmem_layout);
+}
+
+/** Update the state computed from the Status bits selecting the address space
+ *
+ * The state is only recomputed when the bits change.
+ *
+ */
+static inline void status_modes_update(r4k_cpu_t *cpu)
+{
+    uint32_t status = cp0_status(cpu).val & KSEG_STATUS_MASK;
+
+    if ((!cpu->kseg_valid) || (cpu->kseg_status != status)) {
+        cpu->kseg_valid = true;
+        cpu->kseg_status = status;
+        cpu->kseg_direct = (CPU_KERNEL_MODE(cpu)) && (!CPU_64BIT_MODE(cpu));
+
+        if (CPU_64BIT_MODE(cpu)) {
+            cpu->mode = R4K_MODE_64;
+        } else if (CPU_64BIT_INSTRUCTION(cpu)) {
+            cpu->mode = R4K_MODE_32_KERNEL;
+        } else {
+            cpu->mode = R4K_MODE_32;
+        }
+    }
+}
+
+/** Get the operation mode selecting the variants of the decoded instructions
+ *
+ */
+static inline r4k_mode_t decode_mode(r4k_cpu_t *cpu)
+{
+    status_modes_update(cpu);
+    return cpu->mode;
+}
+
+/** The conversion of kseg0 and kseg1 addresses
+ *
+ * Both segments map the virtual address to the physical one with
+ * a single mask in the 32-bit kernel mode. Whether the processor
+ * is in that mode is only recomputed when the Status bits selecting
+ * the address space change.
+ *
+ * @return False if the address needs the full conversion.
+ *
+ */
+static inline bool kseg_convert_addr(r4k_cpu_t *cpu, ptr64_t virt,
+        ptr36_t *phys, frame_t **frame)
+{
+    if ((virt.lo & KSEG01_MASK) != KSEG01_BITS) {
+        return false;
+    }
+
+    status_modes_update(cpu);
+
+    if (!cpu->kseg_direct) {
+        return false;
+    }
+
+    *phys = virt.lo & KSEG01_PHYS_MASK;
+    *frame = physmem_find_frame(*phys);
+    return true;
+}
+
+/** The conversion of virtual addresses through the last translation
+ *
+ * Sequential code and stack accesses mostly stay within a page,
+ * so the last successful translation of each access mode is
+ * remembered and reused while the address space stays the same.
+ * Only noisy translations are remembered, the other ones might
+ * not reflect the state seen by the processor.
+ *
+ * The frame holding the physical address is returned as well
+ * (NULL outside of memory), so that the access itself can skip
+ * the frame table lookup.
+ *
+ * The fetches missing the last translation try the fetch cache
+ * of the recent pages of all address spaces, so that the code
+ * of the processes switched to (by EntryHi) is reached without
+ * the TLB lookup. The cache is only flushed with the TLB changes.
+ *
+ */
+static r4k_exc_t utlb_convert_addr(r4k_cpu_t *cpu, acc_mode_t mode,
+        ptr64_t virt, ptr36_t *phys, frame_t **frame, bool noisy)
+{
+    if (kseg_convert_addr(cpu, virt, phys, frame)) {
+        return r4k_excNone;
+    }
+
+    r4k_utlb_entry_t *last = &cpu->utlb[mode];
+    uint64_t vpage = virt.ptr >> FRAME_WIDTH;
+    uint32_t status = cp0_status(cpu).val & UTLB_STATUS_MASK;
+    unsigned int asid = cp0_entryhi_asid(cpu);
+
+    if (utlb_entry_match(last, vpage, status, asid)) {
+        *phys = last->ppage | (virt.ptr & FRAME_MASK);
+        *frame = last->frame;
+        return r4k_excNone;
+    }
+
+    r4k_utlb_entry_t *slot = NULL;
+
+    if (mode == AM_FETCH) {
+        slot = &cpu->fetch_cache[(vpage ^ asid) & (R4K_FETCH_CACHE_SIZE - 1)];
+
+        if (utlb_entry_match(slot, vpage, status, asid)) {
+            cpu->fetch_cache_hits++;
+            *phys = slot->ppage | (virt.ptr & FRAME_MASK);
+            *frame = slot->frame;
+
+            if (noisy) {
+                *last = *slot;
+            }
+
+            return r4k_excNone;
+        }
+    }
+
+    profile_region_enter(PROFILE_TRANSLATE);
+    r4k_exc_t res = r4k_convert_addr(cpu, virt, phys, mode == AM_WRITE, noisy);
+
+    if (res != r4k_excNone) {
+        profile_region_leave();
+        return res;
+    }
+
+    *frame = physmem_find_frame(*phys);
+    profile_region_leave();
+
+    if (noisy) {
+        last->valid = true;
+        last->vpage = vpage;
+        last->ppage = ALIGN_DOWN(*phys, FRAME_SIZE);
+        last->status = status;
+        last->asid = asid;
+        last->frame = *frame;
+        last->layout = physmem_layout;
+
+        if (slot != NULL) {
+            *slot = *last;
+        }
+    }
+
+    return res;
+}
+
 /** Test for correct alignment (16 bits)
  *
  * Fill BadVAddr if the alignment is not correct.
@@ -734,16 +1134,17 @@ static r4k_exc_t align_test64(r4k_cpu_t *cpu, ptr64_t addr, bool noisy)
  * @param mode  Memory access mode
  * @param virt  Virtual memory address
  * @param phys  Physical memory address
+ * @param frame Frame holding the physical address (NULL outside of memory)
  * @param noisy Generate exception in case of invalid operation
  *
  */
 static r4k_exc_t access_mem(r4k_cpu_t *cpu, acc_mode_t mode, ptr64_t virt,
-        ptr36_t *phys, bool noisy)
+        ptr36_t *phys, frame_t **frame, bool noisy)
 {
     ASSERT(cpu != NULL);
     ASSERT(phys != NULL);
 
-    r4k_exc_t res = r4k_convert_addr(cpu, virt, phys, mode == AM_WRITE, noisy);
+    r4k_exc_t res = utlb_convert_addr(cpu, mode, virt, phys, frame, noisy);
 
     /* Check for watched address */
     if (((cp0_watchlo_r(cpu)) && (mode == AM_READ))
@@ -780,7 +1181,8 @@ static r4k_exc_t cpu_read_mem8(r4k_cpu_t *cpu, ptr64_t addr, uint8_t *val, bool
     ASSERT(val != NULL);
 
     ptr36_t phys;
-    r4k_exc_t res = access_mem(cpu, AM_READ, addr, &phys, noisy);
+    frame_t *frame;
+    r4k_exc_t res = access_mem(cpu, AM_READ, addr, &phys, &frame, noisy);
     switch (res) {
     case r4k_excNone:
         break;
@@ -794,7 +1196,11 @@ static r4k_exc_t cpu_read_mem8(r4k_cpu_t *cpu, ptr64_t addr, uint8_t *val, bool
         ASSERT(false);
     }
 
-    *val = physmem_read8(cpu->procno, phys, true);
+    if (noisy) {
+        memtrace_access(cpu->procno, addr.ptr, phys, 1, MEMTRACE_READ);
+    }
+
+    *val = physmem_cached_read8(cpu->procno, frame, phys);
     return res;
 }
 
@@ -819,7 +1225,8 @@ static r4k_exc_t cpu_read_mem16(r4k_cpu_t *cpu, ptr64_t addr, uint16_t *val, boo
     }
 
     ptr36_t phys;
-    res = access_mem(cpu, AM_READ, addr, &phys, noisy);
+    frame_t *frame;
+    res = access_mem(cpu, AM_READ, addr, &phys, &frame, noisy);
     switch (res) {
     case r4k_excNone:
         break;
@@ -833,7 +1240,11 @@ static r4k_exc_t cpu_read_mem16(r4k_cpu_t *cpu, ptr64_t addr, uint16_t *val, boo
         ASSERT(false);
     }
 
-    *val = physmem_read16(cpu->procno, phys, true);
+    if (noisy) {
+        memtrace_access(cpu->procno, addr.ptr, phys, 2, MEMTRACE_READ);
+    }
+
+    *val = physmem_cached_read16(cpu->procno, frame, phys);
     return res;
 }
 
@@ -858,7 +1269,8 @@ r4k_exc_t r4k_read_mem32(r4k_cpu_t *cpu, ptr64_t addr, uint32_t *val, bool noisy
     }
 
     ptr36_t phys;
-    res = access_mem(cpu, AM_READ, addr, &phys, noisy);
+    frame_t *frame;
+    res = access_mem(cpu, AM_READ, addr, &phys, &frame, noisy);
     switch (res) {
     case r4k_excNone:
         break;
@@ -872,7 +1284,11 @@ r4k_exc_t r4k_read_mem32(r4k_cpu_t *cpu, ptr64_t addr, uint32_t *val, bool noisy
         ASSERT(false);
     }
 
-    *val = physmem_read32(cpu->procno, phys, true);
+    if (noisy) {
+        memtrace_access(cpu->procno, addr.ptr, phys, 4, MEMTRACE_READ);
+    }
+
+    *val = physmem_cached_read32(cpu->procno, frame, phys);
     return res;
 }
 
@@ -897,7 +1313,8 @@ static r4k_exc_t cpu_read_mem64(r4k_cpu_t *cpu, ptr64_t addr, uint64_t *val, boo
     }
 
     ptr36_t phys;
-    res = access_mem(cpu, AM_READ, addr, &phys, noisy);
+    frame_t *frame;
+    res = access_mem(cpu, AM_READ, addr, &phys, &frame, noisy);
     switch (res) {
     case r4k_excNone:
         break;
@@ -911,7 +1328,11 @@ static r4k_exc_t cpu_read_mem64(r4k_cpu_t *cpu, ptr64_t addr, uint64_t *val, boo
         ASSERT(false);
     }
 
-    *val = physmem_read64(cpu->procno, phys, true);
+    if (noisy) {
+        memtrace_access(cpu->procno, addr.ptr, phys, 8, MEMTRACE_READ);
+    }
+
+    *val = physmem_cached_read64(cpu->procno, frame, phys);
     return res;
 }
 
@@ -923,7 +1344,8 @@ static r4k_exc_t cpu_write_mem8(r4k_cpu_t *cpu, ptr64_t addr, uint8_t value, boo
     ASSERT(cpu != NULL);
 
     ptr36_t phys;
-    r4k_exc_t res = access_mem(cpu, AM_WRITE, addr, &phys, noisy);
+    frame_t *frame;
+    r4k_exc_t res = access_mem(cpu, AM_WRITE, addr, &phys, &frame, noisy);
     switch (res) {
     case r4k_excNone:
         break;
@@ -939,7 +1361,11 @@ static r4k_exc_t cpu_write_mem8(r4k_cpu_t *cpu, ptr64_t addr, uint8_t value, boo
         ASSERT(false);
     }
 
-    physmem_write8(cpu->procno, phys, value, true);
+    if (noisy) {
+        memtrace_access(cpu->procno, addr.ptr, phys, 1, MEMTRACE_WRITE);
+    }
+
+    physmem_cached_write8(cpu->procno, frame, phys, value);
     return res;
 }
 
@@ -962,7 +1388,8 @@ static r4k_exc_t cpu_write_mem16(r4k_cpu_t *cpu, ptr64_t addr, uint16_t value,
     }
 
     ptr36_t phys;
-    res = access_mem(cpu, AM_WRITE, addr, &phys, noisy);
+    frame_t *frame;
+    res = access_mem(cpu, AM_WRITE, addr, &phys, &frame, noisy);
     switch (res) {
     case r4k_excNone:
         break;
@@ -978,7 +1405,11 @@ static r4k_exc_t cpu_write_mem16(r4k_cpu_t *cpu, ptr64_t addr, uint16_t value,
         ASSERT(false);
     }
 
-    physmem_write16(cpu->procno, phys, value, true);
+    if (noisy) {
+        memtrace_access(cpu->procno, addr.ptr, phys, 2, MEMTRACE_WRITE);
+    }
+
+    physmem_cached_write16(cpu->procno, frame, phys, value);
     return res;
 }
 
@@ -1001,7 +1432,8 @@ static r4k_exc_t cpu_write_mem32(r4k_cpu_t *cpu, ptr64_t addr, uint32_t value,
     }
 
     ptr36_t phys;
-    res = access_mem(cpu, AM_WRITE, addr, &phys, noisy);
+    frame_t *frame;
+    res = access_mem(cpu, AM_WRITE, addr, &phys, &frame, noisy);
     switch (res) {
     case r4k_excNone:
         break;
@@ -1017,7 +1449,11 @@ static r4k_exc_t cpu_write_mem32(r4k_cpu_t *cpu, ptr64_t addr, uint32_t value,
         ASSERT(false);
     }
 
-    physmem_write32(cpu->procno, phys, value, true);
+    if (noisy) {
+        memtrace_access(cpu->procno, addr.ptr, phys, 4, MEMTRACE_WRITE);
+    }
+
+    physmem_cached_write32(cpu->procno, frame, phys, value);
     return res;
 }
 
@@ -1040,7 +1476,8 @@ static r4k_exc_t cpu_write_mem64(r4k_cpu_t *cpu, ptr64_t addr, uint64_t value,
     }
 
     ptr36_t phys;
-    res = access_mem(cpu, AM_WRITE, addr, &phys, noisy);
+    frame_t *frame;
+    res = access_mem(cpu, AM_WRITE, addr, &phys, &frame, noisy);
     switch (res) {
     case r4k_excNone:
         break;
@@ -1056,10 +1493,58 @@ static r4k_exc_t cpu_write_mem64(r4k_cpu_t *cpu, ptr64_t addr, uint64_t value,
         ASSERT(false);
     }
 
-    physmem_write64(cpu->procno, phys, value, true);
+    if (noisy) {
+        memtrace_access(cpu->procno, addr.ptr, phys, 8, MEMTRACE_WRITE);
+    }
+
+    physmem_cached_write64(cpu->procno, frame, phys, value);
     return res;
 }
 
+/** Forget all entries of the victim TLB
+ *
+ */
+static void tlb_victim_flush(r4k_cpu_t *cpu)
+{
+    memset(cpu->tlb_victim, 0, cpu->tlb_victim_count * sizeof(tlb_entry_t));
+    cpu->tlb_victim_next = 0;
+}
+
+/** Keep a replaced TLB entry in the victim TLB
+ *
+ * The oldest victim is replaced.
+ *
+ */
+static void tlb_victim_push(r4k_cpu_t *cpu, tlb_entry_t *entry)
+{
+    if ((!entry->pg[0].valid) && (!entry->pg[1].valid)) {
+        return;
+    }
+
+    cpu->tlb_victim[cpu->tlb_victim_next] = *entry;
+    cpu->tlb_victim_next = (cpu->tlb_victim_next + 1) % cpu->tlb_victim_count;
+}
+
+/** Remove the victims overlapping a new TLB entry
+ *
+ * The new entry takes precedence, so that the guest can replace
+ * the mapping.
+ *
+ */
+static void tlb_victim_remove(r4k_cpu_t *cpu, tlb_entry_t *entry)
+{
+    for (unsigned int i = 0; i < cpu->tlb_victim_count; i++) {
+        tlb_entry_t *victim = &cpu->tlb_victim[i];
+
+        if ((((victim->vpn2 ^ entry->vpn2) & victim->mask & entry->mask) == 0)
+                && ((victim->global) || (entry->global)
+                        || (victim->asid == entry->asid))) {
+            victim->pg[0].valid = false;
+            victim->pg[1].valid = false;
+        }
+    }
+}
+
 /** Probe TLB entry
  *
  */
@@ -1071,22 +1556,20 @@ static r4k_exc_t TLBP(r4k_cpu_t *cpu)
         cp0_index(cpu).val = 1 << cp0_index_p_shift;
         uint32_t xvpn2 = cp0_entryhi(cpu).val & cp0_entryhi_vpn2_mask;
         uint32_t xasid = cp0_entryhi(cpu).val & cp0_entryhi_asid_mask;
-        unsigned int i;
 
-        for (i = 0; i < TLB_ENTRIES; i++) {
-            /*
-             * Mask the VPN2 value from EntryHi with the PageMask
-             * value from the TLB before comparing with the VPN2
-             * value from the TLB. This does not respect the official
-             * R4000 documentation, but it is compliant with the
-             * behaviour of other MIPS CPUs and it is actually
-             * necessary for proper support for multiple page
-             * sizes.
-             */
-            if ((cpu->tlb[i].vpn2 == (xvpn2 & cpu->tlb[i].mask)) && ((cpu->tlb[i].global) || (cpu->tlb[i].asid == xasid))) {
-                cp0_index(cpu).val = i;
-                break;
-            }
+        /*
+         * Mask the VPN2 value from EntryHi with the PageMask
+         * value from the TLB before comparing with the VPN2
+         * value from the TLB. This does not respect the official
+         * R4000 documentation, but it is compliant with the
+         * behaviour of other MIPS CPUs and it is actually
+         * necessary for proper support for multiple page
+         * sizes.
+         */
+        int i = tlb_tag_find(cpu, xvpn2, xasid);
+
+        if (i >= 0) {
+            cp0_index(cpu).val = i;
         }
 
         return r4k_excNone;
@@ -1104,9 +1587,9 @@ static r4k_exc_t TLBR(r4k_cpu_t *cpu)
     ASSERT(cpu != NULL);
 
     if (CP0_USABLE(cpu)) {
-        unsigned int i = cp0_index_index(cpu);
+        unsigned int i = cp0_index(cpu).val & cpu->tlb_index_mask;
 
-        if (i > 47) {
+        if (i >= cpu->tlb_entries) {
             alert("R4000: Invalid value in Index (TLBR)");
             cp0_pagemask(cpu).val = 0;
             cp0_entryhi(cpu).val = 0;
@@ -1148,9 +1631,14 @@ static r4k_exc_t TLBW(r4k_cpu_t *cpu, bool random)
 
     if (CP0_USABLE(cpu)) {
 
-        unsigned int index = random ? cp0_random_random(cpu) : cp0_index_index(cpu);
+        if (random) {
+            r4k_sync_random(cpu);
+        }
+
+        unsigned int index = (random ? cp0_random(cpu).val : cp0_index(cpu).val)
+                & cpu->tlb_index_mask;
 
-        if (index > 47) {
+        if (index >= cpu->tlb_entries) {
             /*
              * Undefined behavior, doing nothing complies.
              * Random is read-only, its index should be always fine.
@@ -1160,6 +1648,30 @@ static r4k_exc_t TLBW(r4k_cpu_t *cpu, bool random)
             /* Fill TLB */
             tlb_entry_t *entry = &cpu->tlb[index];
 
+            tlb_filter_update(cpu, entry, false);
+            fetch_cache_drop(cpu, entry);
+
+            /*
+             * The victim TLB keeps the entries replaced by TLBWR,
+             * the way refill handlers replace them. TLBWI is used
+             * for flushing the entries, so it flushes the victim
+             * TLB as well.
+             */
+            if (cpu->tlb_victim_count > 0) {
+                if (random) {
+                    tlb_victim_push(cpu, entry);
+                } else {
+                    tlb_victim_flush(cpu);
+                }
+            }
+
+            if (trace_events) {
+                trace_event(cpu->procno, TRACE_ARCH_R4K, TRACE_EVENT_TLB_WRITE,
+                        index, cp0_entryhi(cpu).val);
+                trace_event_arg(cp0_entrylo0(cpu).val);
+                trace_event_arg(cp0_entrylo1(cpu).val);
+            }
+
             entry->mask = cp0_entryhi_vpn2_mask & ~cp0_pagemask(cpu).val;
             entry->vpn2 = cp0_entryhi(cpu).val & entry->mask;
             entry->global = cp0_entrylo0_g(cpu) & cp0_entrylo1_g(cpu);
@@ -1174,6 +1686,33 @@ static r4k_exc_t TLBW(r4k_cpu_t *cpu, bool random)
             entry->pg[1].cohh = cp0_entrylo1_c(cpu);
             entry->pg[1].dirty = cp0_entrylo1_d(cpu);
             entry->pg[1].valid = cp0_entrylo1_v(cpu);
+
+            tlb_filter_update(cpu, entry, true);
+            tlb_tag_set(cpu, index);
+
+            if (cpu->tlb_victim_count > 0) {
+                tlb_victim_remove(cpu, entry);
+            }
+
+            /* The access retried after a refill finds the entry at once */
+            if (tlb_entry_small(entry)) {
+                uint32_t vpn2 = entry->vpn2 >> 13;
+                r4k_tlb_lookup_t *slot = &cpu->tlb_lookup[(vpn2 ^ (vpn2 >> 8)
+                        ^ entry->asid) & (R4K_TLB_LOOKUP_SIZE - 1)];
+
+                slot->valid = true;
+                slot->vpn2 = vpn2;
+                slot->asid = entry->asid;
+                slot->index = index;
+            }
+
+            /* The victim TLB drops its oldest entries without notice */
+            if (cpu->tlb_victim_count > 0) {
+                utlb_flush(cpu);
+            } else {
+                fetch_cache_drop(cpu, entry);
+                memset(cpu->utlb, 0, sizeof(cpu->utlb));
+            }
         }
 
         return r4k_excNone;
@@ -1362,12 +1901,56 @@ static void disassemble_rd(r4k_instr_t instr, string_t *mnemonics,
  *
  */
 
-#include "instr/_reserved.c"
+/** Variants of an instruction depending on the addressing mode
+ *
+ * The instruction is implemented by instr_<name>_in() comparing
+ * either the whole registers (wide) or their low 32 bits. The
+ * decoded pages hold the variant of the processor mode (see
+ * mode_variant()), the general implementation checks the mode.
+ *
+ */
+#define MODE_VARIANTS(name) \
+    static r4k_exc_t instr_##name##32(r4k_cpu_t *cpu, r4k_instr_t instr) \
+    { \
+        return instr_##name##_in(cpu, instr, false); \
+    } \
+\
+    static r4k_exc_t instr_##name##64(r4k_cpu_t *cpu, r4k_instr_t instr) \
+    { \
+        return instr_##name##_in(cpu, instr, true); \
+    } \
+\
+    static r4k_exc_t instr_##name(r4k_cpu_t *cpu, r4k_instr_t instr) \
+    { \
+        return instr_##name##_in(cpu, instr, CPU_64BIT_MODE(cpu)); \
+    }
+
+/** General implementation of a 64-bit instruction
+ *
+ * The instruction is implemented by instr_<name>64(), which the
+ * decoded pages hold unless the 64-bit instructions are reserved
+ * in the processor mode (see mode_variant()).
+ *
+ */
+#define INSTRUCTION_VARIANTS(name) \
+    static r4k_exc_t instr_##name(r4k_cpu_t *cpu, r4k_instr_t instr) \
+    { \
+        if (CPU_64BIT_INSTRUCTION(cpu)) { \
+            return instr_##name##64(cpu, instr); \
+        } \
+\
+        return r4k_excRI; \
+    }
+
+#include "instr/_reserved.c"
 #include "instr/_warning.c"
 #include "instr/_xcrd.c"
+#include "instr/_xhc.c"
 #include "instr/_xhlt.c"
 #include "instr/_xint.c"
 #include "instr/_xrd.c"
+#include "instr/_xroib.c"
+#include "instr/_xroie.c"
 #include "instr/_xtr0.c"
 #include "instr/_xtrc.c"
 #include "instr/_xval.c"
@@ -1520,1091 +2103,114 @@ static void disassemble_rd(r4k_instr_t instr, string_t *mnemonics,
 #include "instr/xor.c"
 #include "instr/xori.c"
 
-/** Instruction decoding tables
- *
- */
-
-static r4k_instr_fnc_t opcode_map[64] = {
-    /* 0 */
-    instr__reserved, /* r4k_opcSPECIAL */
-    instr__reserved, /* r4k_opcREGIMM */
-    instr_j,
-    instr_jal,
-    instr_beq,
-    instr_bne,
-    instr_blez,
-    instr_bgtz,
-
-    /* 8 */
-    instr_addi,
-    instr_addiu,
-    instr_slti,
-    instr_sltiu,
-    instr_andi,
-    instr_ori,
-    instr_xori,
-    instr_lui,
-
-    /* 16 */
-    instr__reserved, /* r4k_opcCOP0 */
-    instr__reserved, /* r4k_opcCOP1 */
-    instr__reserved, /* r4k_opcCOP2 */
-    instr__reserved, /* unused */
-    instr_beql,
-    instr_bnel,
-    instr_blezl,
-    instr_bgtzl,
-
-    /* 24 */
-    instr_daddi,
-    instr_daddiu,
-    instr_ldl,
-    instr_ldr,
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-
-    /* 32 */
-    instr_lb,
-    instr_lh,
-    instr_lwl,
-    instr_lw,
-    instr_lbu,
-    instr_lhu,
-    instr_lwr,
-    instr_lwu,
-
-    /* 40 */
-    instr_sb,
-    instr_sh,
-    instr_swl,
-    instr_sw,
-    instr_sdl,
-    instr_sdr,
-    instr_swr,
-    instr_cache,
-
-    /* 48 */
-    instr_ll,
-    instr_lwc1,
-    instr_lwc2,
-    instr__reserved, /* unused */
-    instr_lld,
-    instr_ldc1,
-    instr_ldc2,
-    instr_ld,
-
-    instr_sc,
-    instr_swc1,
-    instr_swc2,
-    instr__reserved, /* unused */
-    instr_scd,
-    instr_sdc1,
-    instr_sdc2,
-    instr_sd
-};
-
-static r4k_instr_fnc_t func_map[64] = {
-    instr_sll,
-    instr__reserved, /* unused */
-    instr_srl,
-    instr_sra,
-    instr_sllv,
-    instr__reserved, /* unused */
-    instr_srlv,
-    instr_srav,
-
-    instr_jr,
-    instr_jalr,
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr_syscall,
-    instr_break,
-    instr__xcrd, /* unused */
-    instr_sync,
-
-    instr_mfhi,
-    instr_mthi,
-    instr_mflo,
-    instr_mtlo,
-    instr_dsllv,
-    instr__reserved, /* unused */
-    instr_dsrlv,
-    instr_dsrav,
-
-    instr_mult,
-    instr_multu,
-    instr_div,
-    instr_divu,
-    instr_dmult,
-    instr_dmultu,
-    instr_ddiv,
-    instr_ddivu,
-
-    instr_add,
-    instr_addu,
-    instr_sub,
-    instr_subu,
-    instr_and,
-    instr_or,
-    instr_xor,
-    instr_nor,
-
-    instr__xhlt,
-    instr__xint,
-    instr_slt,
-    instr_sltu,
-    instr_dadd,
-    instr_daddu,
-    instr_dsub,
-    instr_dsubu,
-
-    instr_tge,
-    instr_tgeu,
-    instr_tlt,
-    instr_tltu,
-    instr_teq,
-    instr__xval,
-    instr_tne,
-    instr__xrd,
-
-    instr_dsll,
-    instr__xtrc,
-    instr_dsrl,
-    instr_dsra,
-    instr_dsll32,
-    instr__xtr0,
-    instr_dsrl32,
-    instr_dsra32
-};
-
-static r4k_instr_fnc_t rt_map[32] = {
-    instr_bltz,
-    instr_bgez,
-    instr_bltzl,
-    instr_bgezl,
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-
-    instr_tgei,
-    instr_tgeiu,
-    instr_tlti,
-    instr_tltiu,
-    instr_teqi,
-    instr__reserved, /* unused */
-    instr_tnei,
-    instr__reserved, /* unused */
-
-    instr_bltzal,
-    instr_bgezal,
-    instr_bltzall,
-    instr_bgezall,
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved /* unused */
-};
-
-static r4k_instr_fnc_t cop0_rs_map[32] = {
-    instr_mfc0,
-    instr_dmfc0,
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr_mtc0,
-    instr_dmtc0,
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-
-    instr__reserved, /* cop0rsBC */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-
-    instr__reserved, /* cop0rsCO */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved /* unused */
-};
-
-static r4k_instr_fnc_t cop1_rs_map[32] = {
-    instr_mfc1,
-    instr_dmfc1,
-    instr_cfc1,
-    instr__reserved, /* unused */
-    instr_mtc1,
-    instr_dmtc1,
-    instr_ctc1,
-    instr__reserved, /* unused */
-
-    instr__reserved, /* cop1rsBC */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved /* unused */
-};
-
-static r4k_instr_fnc_t cop2_rs_map[32] = {
-    instr_mfc2,
-    instr__reserved, /* unused */
-    instr_cfc2,
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr_ctc2,
-    instr__reserved, /* unused */
-
-    instr__reserved, /* cop2rsBC */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved /* unused */
-};
-
-static r4k_instr_fnc_t cop0_rt_map[32] = {
-    instr_bc0f,
-    instr_bc0t,
-    instr_bc0fl,
-    instr_bc0tl,
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved /* unused */
-};
-
-static r4k_instr_fnc_t cop1_rt_map[32] = {
-    instr_bc1f,
-    instr_bc1t,
-    instr_bc1fl,
-    instr_bc1tl,
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved /* unused */
-};
-
-static r4k_instr_fnc_t cop2_rt_map[32] = {
-    instr_bc2f,
-    instr_bc2t,
-    instr_bc2fl,
-    instr_bc2tl,
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved, /* unused */
-    instr__reserved /* unused */
-};
-
-static r4k_instr_fnc_t cop0_func_map[64] = {
-    instr__warning, /* unused */
-    instr_tlbr,
-    instr_tlbwi,
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr_tlbwr,
-    instr__warning, /* unused */
-
-    instr_tlbp,
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-
-    instr__reserved, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-
-    instr_eret,
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning, /* unused */
-    instr__warning /* unused */
-};
-
-static mnemonics_fnc_t mnemonics_opcode_map[64] = {
-    /* 0 */
-    mnemonics__reserved, /* r4k_opcSPECIAL */
-    mnemonics__reserved, /* r4k_opcREGIMM */
-    mnemonics_j,
-    mnemonics_jal,
-    mnemonics_beq,
-    mnemonics_bne,
-    mnemonics_blez,
-    mnemonics_bgtz,
-
-    /* 8 */
-    mnemonics_addi,
-    mnemonics_addiu,
-    mnemonics_slti,
-    mnemonics_sltiu,
-    mnemonics_andi,
-    mnemonics_ori,
-    mnemonics_xori,
-    mnemonics_lui,
-
-    /* 16 */
-    mnemonics__reserved, /* r4k_opcCOP0 */
-    mnemonics__reserved, /* r4k_opcCOP1 */
-    mnemonics__reserved, /* r4k_opcCOP2 */
-    mnemonics__reserved, /* unused */
-    mnemonics_beql,
-    mnemonics_bnel,
-    mnemonics_blezl,
-    mnemonics_bgtzl,
-
-    /* 24 */
-    mnemonics_daddi,
-    mnemonics_daddiu,
-    mnemonics_ldl,
-    mnemonics_ldr,
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    /* 32 */
-    mnemonics_lb,
-    mnemonics_lh,
-    mnemonics_lwl,
-    mnemonics_lw,
-    mnemonics_lbu,
-    mnemonics_lhu,
-    mnemonics_lwr,
-    mnemonics_lwu,
-
-    /* 40 */
-    mnemonics_sb,
-    mnemonics_sh,
-    mnemonics_swl,
-    mnemonics_sw,
-    mnemonics_sdl,
-    mnemonics_sdr,
-    mnemonics_swr,
-    mnemonics_cache,
-
-    /* 48 */
-    mnemonics_ll,
-    mnemonics_lwc1,
-    mnemonics_lwc2,
-    mnemonics__reserved, /* unused */
-    mnemonics_lld,
-    mnemonics_ldc1,
-    mnemonics_ldc2,
-    mnemonics_ld,
-
-    mnemonics_sc,
-    mnemonics_swc1,
-    mnemonics_swc2,
-    mnemonics__reserved, /* unused */
-    mnemonics_scd,
-    mnemonics_sdc1,
-    mnemonics_sdc2,
-    mnemonics_sd
-};
-
-static mnemonics_fnc_t mnemonics_func_map[64] = {
-    mnemonics_sll,
-    mnemonics__reserved, /* unused */
-    mnemonics_srl,
-    mnemonics_sra,
-    mnemonics_sllv,
-    mnemonics__reserved, /* unused */
-    mnemonics_srlv,
-    mnemonics_srav,
-
-    mnemonics_jr,
-    mnemonics_jalr,
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics_syscall,
-    mnemonics_break,
-    mnemonics__xcrd,
-    mnemonics_sync,
-
-    mnemonics_mfhi,
-    mnemonics_mthi,
-    mnemonics_mflo,
-    mnemonics_mtlo,
-    mnemonics_dsllv,
-    mnemonics__reserved, /* unused */
-    mnemonics_dsrlv,
-    mnemonics_dsrav,
-
-    mnemonics_mult,
-    mnemonics_multu,
-    mnemonics_div,
-    mnemonics_divu,
-    mnemonics_dmult,
-    mnemonics_dmultu,
-    mnemonics_ddiv,
-    mnemonics_ddivu,
-
-    mnemonics_add,
-    mnemonics_addu,
-    mnemonics_sub,
-    mnemonics_subu,
-    mnemonics_and,
-    mnemonics_or,
-    mnemonics_xor,
-    mnemonics_nor,
-
-    mnemonics__xhlt,
-    mnemonics__xint,
-    mnemonics_slt,
-    mnemonics_sltu,
-    mnemonics_dadd,
-    mnemonics_daddu,
-    mnemonics_dsub,
-    mnemonics_dsubu,
-
-    mnemonics_tge,
-    mnemonics_tgeu,
-    mnemonics_tlt,
-    mnemonics_tltu,
-    mnemonics_teq,
-    mnemonics__xval,
-    mnemonics_tne,
-    mnemonics__xrd,
-
-    mnemonics_dsll,
-    mnemonics__xtrc,
-    mnemonics_dsrl,
-    mnemonics_dsra,
-    mnemonics_dsll32,
-    mnemonics__xtr0,
-    mnemonics_dsrl32,
-    mnemonics_dsra32
-};
-
-static mnemonics_fnc_t mnemonics_rt_map[32] = {
-    mnemonics_bltz,
-    mnemonics_bgez,
-    mnemonics_bltzl,
-    mnemonics_bgezl,
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics_tgei,
-    mnemonics_tgeiu,
-    mnemonics_tlti,
-    mnemonics_tltiu,
-    mnemonics_teqi,
-    mnemonics__reserved, /* unused */
-    mnemonics_tnei,
-    mnemonics__reserved, /* unused */
-
-    mnemonics_bltzal,
-    mnemonics_bgezal,
-    mnemonics_bltzall,
-    mnemonics_bgezall,
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved /* unused */
-};
-
-static mnemonics_fnc_t mnemonics_cop0_rs_map[32] = {
-    mnemonics_mfc0,
-    mnemonics_dmfc0,
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics_mtc0,
-    mnemonics_dmtc0,
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* cop0rsBC */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* cop0rsCO */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved /* unused */
-};
-
-static mnemonics_fnc_t mnemonics_cop1_rs_map[32] = {
-    mnemonics_mfc1,
-    mnemonics_dmfc1,
-    mnemonics_cfc1,
-    mnemonics__reserved, /* unused */
-    mnemonics_mtc1,
-    mnemonics_dmtc1,
-    mnemonics_ctc1,
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* cop1rsBC */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved /* unused */
-};
-
-static mnemonics_fnc_t mnemonics_cop2_rs_map[32] = {
-    mnemonics_mfc2,
-    mnemonics__reserved, /* unused */
-    mnemonics_cfc2,
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics_ctc2,
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* cop2rsBC */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved /* unused */
-};
-
-static mnemonics_fnc_t mnemonics_cop0_rt_map[32] = {
-    mnemonics_bc0f,
-    mnemonics_bc0t,
-    mnemonics_bc0fl,
-    mnemonics_bc0tl,
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved /* unused */
-};
-
-static mnemonics_fnc_t mnemonics_cop1_rt_map[32] = {
-    mnemonics_bc1f,
-    mnemonics_bc1t,
-    mnemonics_bc1fl,
-    mnemonics_bc1tl,
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved /* unused */
-};
-
-static mnemonics_fnc_t mnemonics_cop2_rt_map[32] = {
-    mnemonics_bc2f,
-    mnemonics_bc2t,
-    mnemonics_bc2fl,
-    mnemonics_bc2tl,
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved /* unused */
+/** Decoding tables of the instructions (see isa.def) */
+typedef enum {
+    r4k_table_opcode,
+    r4k_table_func,
+    r4k_table_rt,
+    r4k_table_cop0_rs,
+    r4k_table_cop0_rt,
+    r4k_table_cop0_func,
+    r4k_table_cop1_rs,
+    r4k_table_cop1_rt,
+    r4k_table_cop2_rs,
+    r4k_table_cop2_rt,
+    R4K_TABLE_COUNT
+} r4k_table_t;
+
+/** Entries of each decoding table */
+#define R4K_TABLE_SIZE 64
+
+/** Instruction implementations generated from the instruction set
+ *
+ * The missing instructions are NULL (see decode()).
+ *
+ */
+static r4k_instr_fnc_t instr_table[R4K_TABLE_COUNT][R4K_TABLE_SIZE] = {
+#define R4K_INSTR(table, index, name) [r4k_table_##table][index] = instr_##name,
+#include "isa.def"
 };
 
-static mnemonics_fnc_t mnemonics_cop0_func_map[64] = {
-    mnemonics__reserved, /* unused */
-    mnemonics_tlbr,
-    mnemonics_tlbwi,
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics_tlbwr,
-    mnemonics__reserved, /* unused */
-
-    mnemonics_tlbp,
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics_eret,
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved, /* unused */
-    mnemonics__reserved /* unused */
+/** Instruction mnemonics generated from the instruction set
+ *
+ * The missing instructions are NULL (see decode_mnemonics()).
+ *
+ */
+static mnemonics_fnc_t mnemonics_table[R4K_TABLE_COUNT][R4K_TABLE_SIZE] = {
+#define R4K_INSTR(table, index, name) [r4k_table_##table][index] = mnemonics_##name,
+#include "isa.def"
 };
 
-/** Decode MIPS R4000 instruction mnemonics
+/** Find the decoding table entry of an instruction
  *
- * @return Instruction mnemonics function.
+ * The table is chosen by the opcode field (and by the rs field
+ * of the coprocessor instructions).
+ *
+ * @param index Index of the entry in the table.
+ *
+ * @return Decoding table of the instruction.
  *
  */
-mnemonics_fnc_t decode_mnemonics(r4k_instr_t instr)
+static r4k_table_t decode_table(r4k_instr_t instr, unsigned int *index)
 {
-    mnemonics_fnc_t fnc;
-
-    /*
-     * Basic opcode decoding based
-     * on the opcode field.
-     */
     switch (instr.r.opcode) {
     case r4k_opcSPECIAL:
-        /*
-         * SPECIAL opcode decoding based
-         * on the func field.
-         */
-        fnc = mnemonics_func_map[instr.r.func];
-        break;
+        *index = instr.r.func;
+        return r4k_table_func;
     case r4k_opcREGIMM:
-        /*
-         * REGIMM opcode decoding based
-         * on the rt field.
-         */
-        fnc = mnemonics_rt_map[instr.r.rt];
-        break;
+        *index = instr.r.rt;
+        return r4k_table_rt;
     case r4k_opcCOP0:
-        /*
-         * COP0 opcode decoding based
-         * on the rs field.
-         */
-        switch (instr.r.rs) {
+        switch (instr.cop.rs) {
         case cop0rsBC:
-            /*
-             * COP0/BC opcode decoding
-             * based on the rt field.
-             */
-            fnc = mnemonics_cop0_rt_map[instr.r.rt];
-            break;
+            *index = instr.cop.rt;
+            return r4k_table_cop0_rt;
         case cop0rsCO:
-            /*
-             * COP0/CO opcode decoding
-             * based on the 8-bit func field.
-             */
-            fnc = mnemonics_cop0_func_map[instr.cop.func];
-            break;
+            /* The 8-bit func field, the functions above 63 are not used */
+            *index = instr.cop.func;
+            return r4k_table_cop0_func;
         default:
-            fnc = mnemonics_cop0_rs_map[instr.r.rs];
+            *index = instr.cop.rs;
+            return r4k_table_cop0_rs;
         }
-        break;
     case r4k_opcCOP1:
-        /*
-         * COP1 opcode decoding based
-         * on the rs field.
-         */
-        switch (instr.r.rs) {
-        case cop1rsBC:
-            /*
-             * COP1/BC opcode decoding
-             * based on the rt field.
-             */
-            fnc = mnemonics_cop1_rt_map[instr.r.rt];
-            break;
-        default:
-            fnc = mnemonics_cop1_rs_map[instr.r.rs];
+        if (instr.cop.rs == cop1rsBC) {
+            *index = instr.cop.rt;
+            return r4k_table_cop1_rt;
         }
-        break;
+
+        *index = instr.cop.rs;
+        return r4k_table_cop1_rs;
     case r4k_opcCOP2:
-        /*
-         * COP2 opcode decoding based
-         * on the rs field.
-         */
-        switch (instr.r.rs) {
-        case cop2rsBC:
-            /*
-             * COP2/BC opcode decoding
-             * based on the rt field.
-             */
-            fnc = mnemonics_cop2_rt_map[instr.r.rt];
-            break;
-        default:
-            fnc = mnemonics_cop2_rs_map[instr.r.rs];
+        if (instr.cop.rs == cop2rsBC) {
+            *index = instr.cop.rt;
+            return r4k_table_cop2_rt;
         }
-        break;
+
+        *index = instr.cop.rs;
+        return r4k_table_cop2_rs;
     default:
-        fnc = mnemonics_opcode_map[instr.r.opcode];
+        *index = instr.r.opcode;
+        return r4k_table_opcode;
     }
+}
 
-    return fnc;
+/** Decode MIPS R4000 instruction mnemonics
+ *
+ * @return Instruction mnemonics function.
+ *
+ */
+mnemonics_fnc_t decode_mnemonics(r4k_instr_t instr)
+{
+    unsigned int index;
+    r4k_table_t table = decode_table(instr, &index);
+
+    mnemonics_fnc_t fnc = NULL;
+    if (index < R4K_TABLE_SIZE) {
+        fnc = mnemonics_table[table][index];
+    }
+
+    return (fnc != NULL) ? fnc : mnemonics__reserved;
 }
 
 /** Initial state */
@@ -2615,7 +2221,6 @@ mnemonics_fnc_t decode_mnemonics(r4k_instr_t instr)
 #define HARD_RESET_WATCHLO 0
 #define HARD_RESET_WATCHHI 0
 #define HARD_RESET_CONFIG 0
-#define HARD_RESET_RANDOM 47
 #define HARD_RESET_WIRED 0
 
 /** Exception handling */
@@ -2625,6 +2230,8 @@ mnemonics_fnc_t decode_mnemonics(r4k_instr_t instr)
 #define EXCEPTION_NORMAL_RESET_ADDRESS HARD_RESET_START_ADDRESS
 #define EXCEPTION_OFFSET UINT64_C(0x0180)
 
+static void cache_item_register(void);
+
 /** Initialize simulation environment
  *
  */
@@ -2643,7 +2250,6 @@ void r4k_init(r4k_cpu_t *cpu, unsigned int procno)
 
     /* Inicialize cp0 registers */
     cp0_config(cpu).val = HARD_RESET_CONFIG;
-    cp0_random(cpu).val = HARD_RESET_RANDOM;
     cp0_wired(cpu).val = HARD_RESET_WIRED;
     cp0_prid(cpu).val = HARD_RESET_PROC_ID;
 
@@ -2654,8 +2260,9 @@ void r4k_init(r4k_cpu_t *cpu, unsigned int procno)
     cp0_watchlo(cpu).val = HARD_RESET_WATCHLO;
     cp0_watchhi(cpu).val = HARD_RESET_WATCHHI;
 
-    /* Breakpoints */
-    list_init(&cpu->bps);
+    r4k_set_tlb_entries(cpu, TLB_ENTRIES);
+    r4k_update_interrupt(cpu);
+    cache_item_register();
 }
 
 /** Set the PC register
@@ -2726,6 +2333,7 @@ void r4k_interrupt_up(r4k_cpu_t *cpu, unsigned int no)
 
     cp0_cause(cpu).val |= 1 << (cp0_cause_ip0_shift + no);
     cpu->intr[no]++;
+    r4k_update_interrupt(cpu);
 }
 
 /* Deassert the specified interrupt
@@ -2737,239 +2345,728 @@ void r4k_interrupt_down(r4k_cpu_t *cpu, unsigned int no)
     ASSERT(no < INTR_COUNT);
 
     cp0_cause(cpu).val &= ~(1 << (cp0_cause_ip0_shift + no));
+    r4k_update_interrupt(cpu);
 }
 
-/** Decode MIPS R4000 instruction
+/** Recompute whether an interrupt is to be taken
  *
- * @return Instruction implementation.
+ * Has to follow every change of the Status register and of the
+ * interrupt pending bits of the Cause register, so the test after
+ * each instruction is just a flag.
  *
  */
-static r4k_instr_fnc_t decode(r4k_instr_t instr)
+void r4k_update_interrupt(r4k_cpu_t *cpu)
 {
-    r4k_instr_fnc_t fnc;
+    ASSERT(cpu != NULL);
 
-    /*
-     * Basic opcode decoding based
-     * on the opcode field.
-     */
-    switch (instr.r.opcode) {
-    case r4k_opcSPECIAL:
-        /*
-         * SPECIAL opcode decoding based
-         * on the func field.
-         */
-        fnc = func_map[instr.r.func];
-        if (instr.r.func == 0x21) {
-            ASSERT(fnc == instr_addu);
-        }
-        break;
-    case r4k_opcREGIMM:
-        /*
-         * REGIMM opcode decoding based
-         * on the rt field.
-         */
-        fnc = rt_map[instr.r.rt];
-        break;
-    case r4k_opcCOP0:
-        /*
-         * COP0 opcode decoding based
-         * on the rs field.
-         */
-        // should be based on COP format
-        switch (instr.cop.rs) {
-        case cop0rsBC:
-            /*
-             * COP0/BC opcode decoding
-             * based on the rt field.
-             */
-            fnc = cop0_rt_map[instr.cop.rt];
-            break;
-        case cop0rsCO:
-            /*
-             * COP0/CO opcode decoding
-             * based on the 8-bit func field.
-             */
-            fnc = cop0_func_map[instr.cop.func];
-            break;
-        default:
-            fnc = cop0_rs_map[instr.cop.rs];
-        }
-        break;
-    case r4k_opcCOP1:
-        /*
-         * COP1 opcode decoding based
-         * on the rs field.
-         */
-        switch (instr.cop.rs) {
-        case cop1rsBC:
-            /*
-             * COP1/BC opcode decoding
-             * based on the rt field.
-             */
-            fnc = cop1_rt_map[instr.cop.rt];
-            break;
-        default:
-            fnc = cop1_rs_map[instr.cop.rs];
-        }
-        break;
-    case r4k_opcCOP2:
-        /*
-         * COP2 opcode decoding based
-         * on the rs field.
-         */
-        switch (instr.cop.rs) {
-        case cop2rsBC:
-            /*
-             * COP2/BC opcode decoding
-             * based on the rt field.
-             */
-            fnc = cop2_rt_map[instr.cop.rt];
-            break;
-        default:
-            fnc = cop2_rs_map[instr.cop.rs];
-        }
-        break;
-    default:
-        fnc = opcode_map[instr.r.opcode];
-    }
+    cpu->intr_deliverable = (!cp0_status_exl(cpu)) && (!cp0_status_erl(cpu))
+            && (cp0_status_ie(cpu))
+            && ((cp0_cause(cpu).val & cp0_status(cpu).val & cp0_cause_ip_mask) != 0);
 
-    return fnc;
+    intr_latency_update(&cpu->intr_latency,
+            (cp0_cause(cpu).val & cp0_cause_ip_mask) >> cp0_cause_ip0_shift);
 }
 
-typedef struct {
-    item_t item;
-    ptr36_t addr;
-    r4k_instr_fnc_t instrs[FRAME_SIZE / sizeof(r4k_instr_t)];
-} cache_item_t;
-
-#define PHYS2CACHEINSTR(phys) (((phys) & FRAME_MASK) / sizeof(r4k_instr_t))
-
-static void cache_item_init(cache_item_t *cache_item)
+/** Write the Count register
+ *
+ * Random keeps counting down as it is derived from Count.
+ *
+ */
+void r4k_set_count(r4k_cpu_t *cpu, uint32_t value)
 {
-    item_init(&cache_item->item);
-    cache_item->addr = 0;
-    // Skip instrs init
-}
-
-list_t r4k_instruction_cache = LIST_INITIALIZER;
+    ASSERT(cpu != NULL);
 
-static bool cache_hit(ptr36_t phys, cache_item_t **cache_item)
-{
-    ptr36_t target_page = ALIGN_DOWN(phys, FRAME_SIZE);
-    cache_item_t *c;
-    for_each(r4k_instruction_cache, c, cache_item_t)
-    {
-        if (c->addr == target_page) {
-            *cache_item = c;
-            return true;
-        }
-    }
-    return false;
+    cpu->random_base += value - cp0_count(cpu).val;
+    cp0_count(cpu).val = value;
 }
 
-static void cache_item_page_decode(r4k_cpu_t *cpu, cache_item_t *cache_item)
+/** Write the Wired register
+ *
+ * Random starts over from the last entry.
+ *
+ */
+void r4k_set_wired(r4k_cpu_t *cpu, uint32_t value)
 {
-    for (size_t i = 0; i < FRAME_SIZE / sizeof(r4k_instr_t); ++i) {
-        ptr36_t addr = cache_item->addr + (i * sizeof(r4k_instr_t));
-        r4k_instr_t instr_data = (r4k_instr_t) physmem_read32(cpu->procno, addr, false);
-        cache_item->instrs[i] = decode(instr_data);
-    }
+    ASSERT(cpu != NULL);
+
+    cp0_wired(cpu).val = value;
+    cp0_random(cpu).val = cpu->tlb_entries - 1;
+    cpu->random_base = cp0_count(cpu).val;
 }
 
-static void update_cache_item(r4k_cpu_t *cpu, cache_item_t *cache_item)
+/** Update the Random register before it is read
+ *
+ * Random decrements each cycle from the last entry (47) down to
+ * the value of Wired and wraps around. Instead of doing so each
+ * cycle, it is computed from the cycles Count advanced since Random
+ * was at the last entry.
+ *
+ */
+void r4k_sync_random(r4k_cpu_t *cpu)
 {
-    frame_t *frame = physmem_find_frame(cache_item->addr);
-    ASSERT(frame != NULL);
+    ASSERT(cpu != NULL);
 
-    if (frame->valid) {
+    uint64_t last = cpu->tlb_entries - 1;
+    uint64_t wired = cp0_wired(cpu).val;
+
+    if (wired > last) {
+        cp0_random(cpu).val = last;
         return;
     }
 
-    cache_item_page_decode(cpu, cache_item);
-
-    frame->valid = true;
-    return;
+    uint64_t cycles = cp0_count(cpu).val - cpu->random_base;
+    cp0_random(cpu).val = last - cycles % (last + 1 - wired);
 }
 
-static cache_item_t *cache_try_add(r4k_cpu_t *cpu, ptr36_t phys)
+/** Decode MIPS R4000 instruction
+ *
+ * @return Instruction implementation.
+ *
+ */
+static r4k_instr_fnc_t decode(r4k_instr_t instr)
 {
-    frame_t *frame = physmem_find_frame(phys);
-    if (frame == NULL) {
-        return NULL;
+    unsigned int index;
+    r4k_table_t table = decode_table(instr, &index);
+
+    r4k_instr_fnc_t fnc = NULL;
+    if (index < R4K_TABLE_SIZE) {
+        fnc = instr_table[table][index];
     }
 
-    cache_item_t *cache_item = safe_malloc(sizeof(cache_item_t));
+    if (fnc == NULL) {
+        fnc = (table == r4k_table_cop0_func) ? instr__warning : instr__reserved;
+    }
 
-    cache_item_init(cache_item);
-    cache_item->addr = ALIGN_DOWN(phys, FRAME_SIZE);
+    return fnc;
+}
 
-    list_push(&r4k_instruction_cache, &cache_item->item);
+/** Instruction implementations with variants for the operation modes */
+typedef struct {
+    r4k_instr_fnc_t general;
+    r4k_instr_fnc_t variant[R4K_MODE_COUNT];
+} mode_variant_t;
+
+#define MODE_ROW(name) \
+    { instr_##name, { instr_##name##32, instr_##name##32, instr_##name##64 } }
+
+#define INSTRUCTION_ROW(name) \
+    { instr_##name, { instr__reserved, instr_##name##64, instr_##name##64 } }
+
+static const mode_variant_t mode_variants[] = {
+    MODE_ROW(beq),
+    MODE_ROW(beql),
+    MODE_ROW(bgez),
+    MODE_ROW(bgezal),
+    MODE_ROW(bgezall),
+    MODE_ROW(bgezl),
+    MODE_ROW(bgtz),
+    MODE_ROW(bgtzl),
+    MODE_ROW(blez),
+    MODE_ROW(blezl),
+    MODE_ROW(bltz),
+    MODE_ROW(bltzal),
+    MODE_ROW(bltzall),
+    MODE_ROW(bltzl),
+    MODE_ROW(bne),
+    MODE_ROW(bnel),
+    MODE_ROW(slt),
+    MODE_ROW(slti),
+    MODE_ROW(sltiu),
+    MODE_ROW(sltu),
+    MODE_ROW(teq),
+    MODE_ROW(teqi),
+    MODE_ROW(tge),
+    MODE_ROW(tgei),
+    MODE_ROW(tgeiu),
+    MODE_ROW(tgeu),
+    MODE_ROW(tlt),
+    MODE_ROW(tlti),
+    MODE_ROW(tltiu),
+    MODE_ROW(tltu),
+    MODE_ROW(tne),
+    MODE_ROW(tnei),
+    INSTRUCTION_ROW(dadd),
+    INSTRUCTION_ROW(daddi),
+    INSTRUCTION_ROW(daddiu),
+    INSTRUCTION_ROW(daddu),
+    INSTRUCTION_ROW(ddiv),
+    INSTRUCTION_ROW(ddivu),
+    INSTRUCTION_ROW(dmult),
+    INSTRUCTION_ROW(dmultu),
+    INSTRUCTION_ROW(dsll),
+    INSTRUCTION_ROW(dsll32),
+    INSTRUCTION_ROW(dsllv),
+    INSTRUCTION_ROW(dsra),
+    INSTRUCTION_ROW(dsra32),
+    INSTRUCTION_ROW(dsrav),
+    INSTRUCTION_ROW(dsrl),
+    INSTRUCTION_ROW(dsrl32),
+    INSTRUCTION_ROW(dsrlv),
+    INSTRUCTION_ROW(dsub),
+    INSTRUCTION_ROW(dsubu),
+    INSTRUCTION_ROW(ld),
+    INSTRUCTION_ROW(lld),
+    INSTRUCTION_ROW(lwu),
+    INSTRUCTION_ROW(scd),
+    INSTRUCTION_ROW(sd),
+};
 
-    cache_item_page_decode(cpu, cache_item);
+/** Get the variant of an instruction implementation for an operation mode
+ *
+ * The variants do not check the mode, so they are looked up for
+ * the mode of the fetching processor (see mode_handlers). The
+ * decoder itself (used by the disassembler and mixstat) returns
+ * the general implementations.
+ *
+ * @param fnc General implementation returned by the decoder.
+ *
+ * @return The variant to be executed (fnc if there is none).
+ *
+ */
+static r4k_instr_fnc_t mode_variant(r4k_instr_fnc_t fnc, r4k_mode_t mode)
+{
+    for (size_t i = 0; i < sizeof(mode_variants) / sizeof(mode_variants[0]); i++) {
+        if (mode_variants[i].general == fnc) {
+            return mode_variants[i].variant[mode];
+        }
+    }
 
-    frame->valid = true;
-    return cache_item;
+    return fnc;
 }
 
-static r4k_instr_fnc_t fetch_instr(r4k_cpu_t *cpu, ptr36_t phys)
+/** Get the call or return variant of a jump (see callstack.c)
+ *
+ * The linking jumps and branches are the calls, the jumps to
+ * the return address register are the returns. The variants
+ * call the general implementations (checking the mode).
+ *
+ * @param fnc General implementation returned by the decoder.
+ *
+ * @return The variant to be executed (fnc if there is none).
+ *
+ */
+static r4k_instr_fnc_t callstack_variant(r4k_instr_fnc_t fnc, r4k_instr_t instr)
 {
-    cache_item_t *cache_item = NULL;
-
-    if (cache_hit(phys, &cache_item)) {
-        ASSERT(cache_item != NULL);
-        update_cache_item(cpu, cache_item);
+    if (fnc == instr_bgezal) {
+        return instr_bgezal_call;
+    }
 
-        // Move item to front of list on hit
-        if (r4k_instruction_cache.head != &cache_item->item) {
-            list_remove(&r4k_instruction_cache, &cache_item->item);
-            list_push(&r4k_instruction_cache, &cache_item->item);
-        }
+    if (fnc == instr_bltzal) {
+        return instr_bltzal_call;
+    }
 
-        return cache_item->instrs[PHYS2CACHEINSTR(phys)];
+    if (fnc == instr_jal) {
+        return instr_jal_call;
     }
 
-    cache_item = cache_try_add(cpu, phys);
+    if (fnc == instr_jalr) {
+        return instr_jalr_call;
+    }
 
-    if (cache_item != NULL) {
-        return cache_item->instrs[PHYS2CACHEINSTR(phys)];
+    if ((fnc == instr_jr) && (instr.r.rs == 31)) {
+        return instr_jr_return;
     }
 
-    alert("Trying to fetch instructions from outside of physical memory");
-    return NULL;
+    return fnc;
 }
 
-/** Change the processor state according to the exception type
+/** Decoded instruction
+ *
+ * The implementation is referred to by its index (see
+ * decode_handler_index()), so that the decoded instructions
+ * of a page take 8 KiB. The index is that of the implementation
+ * common to all the operation modes, the variant of the mode is
+ * found by the index (see mode_handlers), so the processors
+ * fetching from a page in different modes share the page
+ * without decoding it again.
  *
  */
-static void handle_exception(r4k_cpu_t *cpu, r4k_exc_t res)
-{
-    ASSERT(cpu != NULL);
+typedef struct {
+    r4k_instr_t instr;
+    uint16_t handler; /**< Index of the implementation (0 until decoded) */
+    uint16_t run; /**< Length of the straight-line run starting here */
+} cache_instr_t;
 
-    bool tlb_refill = false;
+static_assert(sizeof(cache_instr_t) == 8, "cache_instr_t is not compact");
 
-    /* Convert TLB Refill exceptions */
-    if ((res == r4k_excTLBLR) || (res == r4k_excTLBSR)) {
-        tlb_refill = true;
-        if (res == r4k_excTLBLR) {
-            res = r4k_excTLBL;
-        } else {
-            res = r4k_excTLBS;
-        }
-    }
+typedef struct {
+    decoded_page_t header;
+    cache_instr_t instrs[FRAME_SIZE / sizeof(r4k_instr_t)];
 
-    ASSERT(res <= r4k_excVCED);
+    /** Executions of the block starting at each instruction until translated */
+    uint16_t heat[FRAME_SIZE / sizeof(r4k_instr_t)];
+} cache_item_t;
 
-    /* The standby mode is cancelled by the exception */
-    if (cpu->stdby) {
-        r4k_set_pc(cpu, cpu->pc_next);
-    }
+/** Implementations executed in each operation mode
+ *
+ * Indexed by the index of the implementation common to the modes,
+ * filled in once the implementation is first fetched in the mode.
+ *
+ */
+static r4k_instr_fnc_t mode_handlers[R4K_MODE_COUNT][DECODE_HANDLERS];
 
-    cpu->stdby = false;
+#define PHYS2CACHEINSTR(phys) (((phys) & FRAME_MASK) / sizeof(r4k_instr_t))
 
-    /* User info and register fill */
-    if (machine_trace) {
-        if (tlb_refill) {
-            alert("cpu%u raised TLB refill exception %u: %s", cpu->procno,
+/** Tell whether the instruction can be executed as a part of a block
+ *
+ * Such instructions do not change the control flow, the branch
+ * state, coprocessor 0 or the simulation state.
+ *
+ */
+static bool is_straight_line(r4k_instr_t instr)
+{
+    switch (instr.r.opcode) {
+    case r4k_opcSPECIAL:
+        switch (instr.r.func) {
+        case funcSLL:
+        case funcSRL:
+        case funcSRA:
+        case funcSLLV:
+        case funcSRLV:
+        case funcSRAV:
+        case funcMFHI:
+        case funcMTHI:
+        case funcMFLO:
+        case funcMTLO:
+        case funcDSLLV:
+        case funcDSRLV:
+        case funcDSRAV:
+        case funcMULT:
+        case funcMULTU:
+        case funcDIV:
+        case funcDIVU:
+        case funcDMULT:
+        case funcDMULTU:
+        case funcDDIV:
+        case funcDDIVU:
+        case funcADD:
+        case funcADDU:
+        case funcSUB:
+        case funcSUBU:
+        case funcAND:
+        case funcOR:
+        case funcXOR:
+        case funcNOR:
+        case funcSLT:
+        case funcSLTU:
+        case funcDADD:
+        case funcDADDU:
+        case funcDSUB:
+        case funcDSUBu:
+        case funcDSLL:
+        case funcDSRL:
+        case funcDSRA:
+        case funcSLL32:
+        case funcDSRL32:
+        case funcDSRA32:
+            return true;
+        default:
+            return false;
+        }
+    case r4k_opcADDI:
+    case r4k_opcADDIU:
+    case r4k_opcSLTI:
+    case r4k_opcSLTIU:
+    case r4k_opcANDI:
+    case r4k_opcORI:
+    case r4k_opcXORi:
+    case opcLUI:
+    case r4k_opcDADDI:
+    case r4k_opcDADDIU:
+    case r4k_opcLDL:
+    case r4k_opcLDR:
+    case r4k_opcLB:
+    case r4k_opcLH:
+    case r4k_opcLWL:
+    case r4k_opcLW:
+    case r4k_opcLBU:
+    case r4k_opcLHU:
+    case r4k_opcLWR:
+    case r4k_opcLWU:
+    case r4k_opcSB:
+    case r4k_opcSH:
+    case r4k_opcSWL:
+    case r4k_opcSW:
+    case r4k_opcSDL:
+    case r4k_opcSDR:
+    case r4k_opcSWR:
+    case r4k_opcLD:
+    case r4k_opcSD:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/** Mask of all general registers (see written_regs()) */
+#define WRITTEN_ANY UINT32_MAX
+
+/** Get the general registers written by an instruction
+ *
+ * Known from the instruction word alone, used to report only the
+ * registers the instruction may have changed (see trace_execution()).
+ *
+ * @return Bitmap of the registers (register 0 included if written
+ *         to), WRITTEN_ANY for the instructions not classified.
+ *
+ */
+static uint32_t written_regs(r4k_instr_t instr)
+{
+    switch (instr.r.opcode) {
+    case r4k_opcSPECIAL:
+        switch (instr.r.func) {
+        case funcJR:
+        case funcSYSCALL:
+        case funcBREAK:
+        case funcSYNC:
+        case funcMTHI:
+        case funcMTLO:
+        case funcMULT:
+        case funcMULTU:
+        case funcDIV:
+        case funcDIVU:
+        case funcDMULT:
+        case funcDMULTU:
+        case funcDDIV:
+        case funcDDIVU:
+        case funcTGE:
+        case funcTGEU:
+        case funcTLT:
+        case funcTLTU:
+        case funcTEQ:
+        case funcTNE:
+            return 0;
+        case func_XINT:
+            return WRITTEN_ANY;
+        default:
+            return 1U << instr.r.rd;
+        }
+    case r4k_opcREGIMM:
+        switch (instr.r.rt) {
+        case rtBLTZAL:
+        case rtBGEZAL:
+        case rtBLTZALL:
+        case rtBGEZALL:
+            return 1U << 31;
+        default:
+            return 0;
+        }
+    case r4k_opcJAL:
+        return 1U << 31;
+    case r4k_opcJ:
+    case r4k_opcBEQ:
+    case r4k_opcBNE:
+    case r4k_opcBLEZ:
+    case r4k_opcBGTZ:
+    case r4k_opcBEQL:
+    case r4k_opcBNEL:
+    case r4k_opcBLEZL:
+    case r4k_opcBGTZL:
+    case r4k_opcSB:
+    case r4k_opcSH:
+    case r4k_opcSWL:
+    case r4k_opcSW:
+    case r4k_opcSDL:
+    case r4k_opcSDR:
+    case r4k_opcSWR:
+    case r4k_opcSD:
+    case r4k_opcCACHE:
+    case r4k_opcLWC1:
+    case r4k_opcLDC1:
+    case r4k_opcSWC1:
+    case r4k_opcSDC1:
+        return 0;
+    case r4k_opcADDI:
+    case r4k_opcADDIU:
+    case r4k_opcSLTI:
+    case r4k_opcSLTIU:
+    case r4k_opcANDI:
+    case r4k_opcORI:
+    case r4k_opcXORi:
+    case opcLUI:
+    case r4k_opcDADDI:
+    case r4k_opcDADDIU:
+    case r4k_opcLDL:
+    case r4k_opcLDR:
+    case r4k_opcLB:
+    case r4k_opcLH:
+    case r4k_opcLWL:
+    case r4k_opcLW:
+    case r4k_opcLBU:
+    case r4k_opcLHU:
+    case r4k_opcLWR:
+    case r4k_opcLWU:
+    case r4k_opcLD:
+    case r4k_opcLL:
+    case r4k_opcSC:
+    case r4k_opcSCD:
+        return 1U << instr.i.rt;
+    case r4k_opcCOP0:
+        switch (instr.cop.rs) {
+        case cop0rsMFC0:
+        case cop0rsDMFC0:
+            return 1U << instr.cop.rt;
+        case cop0rsMTC0:
+        case cop0rsDMTC0:
+            return 0;
+        default:
+            return WRITTEN_ANY;
+        }
+    default:
+        return WRITTEN_ANY;
+    }
+}
+
+/** Count the execution into the instruction mix and execute the instruction
+ *
+ * Stored in the decoded pages in place of the instruction
+ * implementations while the mixstat variable is set.
+ *
+ */
+static r4k_exc_t mixstat_instr(r4k_cpu_t *cpu, r4k_instr_t instr)
+{
+    r4k_instr_fnc_t fnc = decode(instr);
+    mixstat_count(&cpu->mix, (mixstat_handler_t) fnc, instr.val);
+
+    if (callstack_enabled) {
+        fnc = callstack_variant(fnc, instr);
+    }
+
+    return fnc(cpu, instr);
+}
+
+/** Get the function executing the instruction in all the operation modes
+ *
+ * The calls and the returns are executed by their variants keeping
+ * the shadow call stacks while the callstacks variable is set. The
+ * variants of the modes are looked up afterwards (see lazy_decode()).
+ *
+ */
+static r4k_instr_fnc_t dispatch_decode(r4k_instr_t instr)
+{
+    if (mixstat_enabled) {
+        return mixstat_instr;
+    }
+
+    r4k_instr_fnc_t fnc = decode(instr);
+
+    if (callstack_enabled) {
+        return callstack_variant(fnc, instr);
+    }
+
+    return fnc;
+}
+
+/** Get the index of the implementation of a decoded instruction
+ *
+ * The instruction is decoded on its first fetch.
+ *
+ */
+static inline uint16_t lazy_decode_index(cache_instr_t *cache_instr)
+{
+    /* Decoded by any of the processors running in parallel */
+    uint16_t handler = __atomic_load_n(&cache_instr->handler, __ATOMIC_ACQUIRE);
+
+    if (handler == 0) {
+        handler = decode_handler_index(DECODE_R4K,
+                (decode_handler_t) dispatch_decode(cache_instr->instr));
+        __atomic_store_n(&cache_instr->handler, handler, __ATOMIC_RELEASE);
+    }
+
+    return handler;
+}
+
+/** Get the implementation of a decoded instruction
+ *
+ * The instruction is decoded on its first fetch, the variant of
+ * the mode is looked up on the first fetch of the implementation
+ * in the mode.
+ *
+ * @param mode Operation mode of the fetching processor.
+ *
+ */
+static inline r4k_instr_fnc_t lazy_decode(cache_instr_t *cache_instr,
+        r4k_mode_t mode)
+{
+    uint16_t handler = lazy_decode_index(cache_instr);
+    r4k_instr_fnc_t fnc = __atomic_load_n(&mode_handlers[mode][handler],
+            __ATOMIC_RELAXED);
+
+    if (fnc == NULL) {
+        fnc = mode_variant((r4k_instr_fnc_t) decode_handler(DECODE_R4K, handler), mode);
+        __atomic_store_n(&mode_handlers[mode][handler], fnc, __ATOMIC_RELAXED);
+    }
+
+    return fnc;
+}
+
+/** Decode the written chunks of the page of a frame
+ *
+ * The instruction words of the chunks are read directly from the
+ * frame, the instructions are decoded only once fetched.
+ *
+ * @param chunks Bitmap of the chunks (see decode_cache_written()).
+ *
+ */
+static void cache_item_page_decode(decoded_page_t *page, frame_t *frame,
+        uint64_t chunks)
+{
+    cache_item_t *cache_item = (cache_item_t *) page;
+    const uint32_t *words = (const uint32_t *) frame->data;
+    size_t per_chunk = DECODE_CHUNK_SIZE / sizeof(r4k_instr_t);
+
+    for (uint64_t todo = chunks; todo != 0; todo &= todo - 1) {
+        size_t first = __builtin_ctzll(todo) * per_chunk;
+
+        for (size_t i = first; i < first + per_chunk; ++i) {
+            cache_item->instrs[i].instr.val = convert_uint32_t_endian(words[i]);
+            cache_item->instrs[i].handler = 0;
+            cache_item->heat[i] = 0;
+        }
+    }
+
+    /*
+     * Compute the straight-line runs backwards from the end of the
+     * last written chunk, the last instruction of the page is never
+     * part of a run. Below the written chunks, the runs are computed
+     * only until one of them stays the same.
+     */
+    size_t last = FRAME_SIZE / sizeof(r4k_instr_t) - 1;
+    size_t low = __builtin_ctzll(chunks) * per_chunk;
+    size_t high = (64 - __builtin_clzll(chunks)) * per_chunk - 1;
+
+    for (size_t i = high + 1; i-- > 0;) {
+        uint16_t run = 0;
+
+        if ((i < last) && (is_straight_line(cache_item->instrs[i].instr))) {
+            run = cache_item->instrs[i + 1].run + 1;
+        }
+
+        if ((i < low) && (cache_item->instrs[i].run == run)) {
+            /* The blocks starting below still reach the written chunks */
+            for (size_t j = i + 1; (j-- > 0) && (cache_item->instrs[j].run > 0);) {
+                cache_item->heat[j] = 0;
+            }
+            break;
+        }
+
+        cache_item->instrs[i].run = run;
+        cache_item->heat[i] = 0;
+    }
+}
+
+/** Decode a whole page with the implementations of all its instructions
+ *
+ * Used to pre-decode the loaded images (see decode_cache_predecode()),
+ * possibly by several host threads at once.
+ *
+ */
+static void cache_item_page_predecode(decoded_page_t *page, frame_t *frame,
+        uint64_t chunks)
+{
+    cache_item_t *cache_item = (cache_item_t *) page;
+
+    cache_item_page_decode(page, frame, chunks);
+
+    for (size_t i = 0; i < FRAME_SIZE / sizeof(r4k_instr_t); ++i) {
+        lazy_decode_index(&cache_item->instrs[i]);
+    }
+}
+
+static void cache_item_page_restore(decoded_page_t *page);
+
+/** Register the eager decoder of the pages (see decode_cache_register()) */
+static void cache_item_register(void)
+{
+    decode_cache_register(DECODE_R4K, sizeof(cache_item_t),
+            cache_item_page_predecode, cache_item_page_restore);
+}
+
+/** Get the up-to-date decoded page of a frame
+ *
+ * The instruction variants of the operation mode of the processor
+ * are taken from the page by decode_mode(), the page is shared by
+ * the processors in all the modes.
+ *
+ */
+static cache_item_t *fetch_page(r4k_cpu_t *cpu, frame_t *frame, ptr36_t phys)
+{
+    cache_item_t *cache_item = (cache_item_t *) frame->decoded[DECODE_R4K];
+
+    if (cache_item == NULL) {
+        cpu->decode_stats.misses++;
+        profile_region_enter(PROFILE_DECODE);
+        cache_item = (cache_item_t *) decode_cache_alloc(DECODE_R4K, frame,
+                sizeof(cache_item_t), cache_item_page_decode);
+        profile_region_leave();
+    } else if (cache_item->header.generation != frame->generation) {
+        cpu->decode_stats.redecodes++;
+        profile_region_enter(PROFILE_DECODE);
+        cache_item = (cache_item_t *) decode_cache_renew(&cache_item->header,
+                cache_item_page_decode);
+        profile_region_leave();
+        decode_cache_touch(&cache_item->header);
+    } else {
+        cpu->decode_stats.hits++;
+        decode_cache_touch(&cache_item->header);
+    }
+
+    return cache_item;
+}
+
+/** Fetch a decoded instruction
+ *
+ * The instruction word is stored next to the decoded
+ * instruction and returned through instr. The frame holding
+ * the address is looked up by the caller (NULL outside of memory).
+ *
+ */
+static r4k_instr_fnc_t fetch_instr(r4k_cpu_t *cpu, frame_t *frame, ptr36_t phys,
+        r4k_instr_t *instr)
+{
+    if (frame == NULL) {
+        alert("Trying to fetch instructions from outside of physical memory");
+        return NULL;
+    }
+
+    cache_item_t *cache_item = fetch_page(cpu, frame, phys);
+    cache_instr_t *cache_instr = &cache_item->instrs[PHYS2CACHEINSTR(phys)];
+    *instr = cache_instr->instr;
+    return lazy_decode(cache_instr, decode_mode(cpu));
+}
+
+/** Change the processor state according to the exception type
+ *
+ */
+static void handle_exception(r4k_cpu_t *cpu, r4k_exc_t res)
+{
+    ASSERT(cpu != NULL);
+
+    bool tlb_refill = false;
+
+    /* Convert TLB Refill exceptions */
+    if ((res == r4k_excTLBLR) || (res == r4k_excTLBSR)) {
+        tlb_refill = true;
+        if (res == r4k_excTLBLR) {
+            res = r4k_excTLBL;
+        } else {
+            res = r4k_excTLBS;
+        }
+    }
+
+    ASSERT(res <= r4k_excVCED);
+
+    /* The standby mode is cancelled by the exception */
+    if (cpu->stdby) {
+        r4k_set_pc(cpu, cpu->pc_next);
+    }
+
+    cpu->stdby = false;
+
+    /* User info and register fill */
+    if (machine_trace) {
+        if (tlb_refill) {
+            alert("cpu%u raised TLB refill exception %u: %s", cpu->procno,
                     res, txt_exc[res]);
         } else {
             alert("cpu%u raised exception %u: %s", cpu->procno,
@@ -2977,62 +3074,584 @@ static void handle_exception(r4k_cpu_t *cpu, r4k_exc_t res)
         }
     }
 
-    cp0_cause(cpu).val &= ~cp0_cause_exccode_mask;
-    cp0_cause(cpu).val |= res << cp0_cause_exccode_shift;
+    /* All the pending enabled interrupts are taken */
+    if (res == r4k_excInt) {
+        uint32_t taken = (cp0_cause(cpu).val & cp0_status(cpu).val & cp0_cause_ip_mask)
+                >> cp0_cause_ip0_shift;
+
+        for (; taken != 0; taken &= taken - 1) {
+            intr_latency_take(&cpu->intr_latency, __builtin_ctz(taken));
+
+            if (catchpoint_armed(cpu->procno, CATCH_INTERRUPT)) {
+                catchpoint_trap(cpu->procno, true, __builtin_ctz(taken));
+            }
+
+            if (trace_events) {
+                trace_event(cpu->procno, TRACE_ARCH_R4K, TRACE_EVENT_INTERRUPT,
+                        __builtin_ctz(taken), cpu->excaddr.ptr);
+            }
+        }
+    } else {
+        if (catchpoint_armed(cpu->procno, CATCH_EXCEPTION)) {
+            catchpoint_trap(cpu->procno, false, res);
+        }
+
+        if (trace_events) {
+            trace_event(cpu->procno, TRACE_ARCH_R4K, TRACE_EVENT_EXCEPTION,
+                    res, cpu->excaddr.ptr);
+
+            /* The address exceptions set BadVAddr */
+            if ((res >= r4k_excMod) && (res <= r4k_excAdES)) {
+                trace_event_arg(cp0_badvaddr(cpu).val);
+            }
+        }
+
+        if (usermode_enabled) {
+            usermode_fault(res, cpu->excaddr.ptr);
+        }
+    }
+
+    cp0_cause(cpu).val &= ~cp0_cause_exccode_mask;
+    cp0_cause(cpu).val |= res << cp0_cause_exccode_shift;
+
+    /* Exception branch control */
+    cp0_cause(cpu).val &= ~cp0_cause_bd_mask;
+    if (cpu->branch == BRANCH_PASSED) {
+        cp0_cause(cpu).val |= cp0_cause_bd_mask;
+    }
+
+    if (!cp0_status_exl(cpu)) {
+        cp0_epc(cpu).val = cpu->excaddr.ptr;
+        if ((res == r4k_excInt) && (cpu->branch != BRANCH_COND)) {
+            cp0_epc(cpu).val = cpu->pc.ptr;
+        }
+    }
+
+    ptr64_t exc_pc;
+    /* Exception vector base address */
+    if (cp0_status_bev(cpu)) {
+        /* Boot time */
+        if (res != r4k_excReset) {
+            exc_pc.ptr = EXCEPTION_BOOT_BASE_ADDRESS;
+        } else {
+            exc_pc.ptr = EXCEPTION_BOOT_RESET_ADDRESS;
+        }
+    } else {
+        /* Normal time */
+        if (res != r4k_excReset) {
+            exc_pc.ptr = EXCEPTION_NORMAL_BASE_ADDRESS;
+        } else {
+            exc_pc.ptr = EXCEPTION_NORMAL_RESET_ADDRESS;
+        }
+    }
+
+    /* Exception vector offsets */
+    if ((cp0_status_exl(cpu)) || (!tlb_refill)) {
+        exc_pc.ptr += EXCEPTION_OFFSET;
+    }
+
+    r4k_set_pc(cpu, exc_pc);
+
+    /* Switch to kernel mode */
+    cp0_status(cpu).val |= cp0_status_exl_mask;
+    r4k_update_interrupt(cpu);
+
+    if (catchpoint_armed(cpu->procno, CATCH_MODE)) {
+        catchpoint_mode(cpu->procno);
+    }
+}
+
+/** Per-cycle management of Count and the timer interrupt
+ *
+ * The Random register follows Count (see r4k_sync_random()).
+ *
+ */
+static void manage_count(r4k_cpu_t *cpu)
+{
+    /* Increase counter */
+    cp0_count(cpu).val++;
+
+    /*
+     * Timer control.
+     *
+     * N.B.: Count and Compare are truly 32 bit CP0
+     *       registers even in 64-bit mode.
+     */
+    if (cp0_count(cpu).lo == cp0_compare(cpu).lo) {
+        /* Generate interrupt request */
+        cp0_cause(cpu).val |= 1 << cp0_cause_ip7_shift;
+        r4k_update_interrupt(cpu);
+    }
+}
+
+/** Per-cycle management of counters and the branch state
+ *
+ */
+static void manage_cycle(r4k_cpu_t *cpu)
+{
+    manage_count(cpu);
+
+    /* Branch delay slot control */
+    if (cpu->branch > BRANCH_NONE) {
+        cpu->branch--;
+    }
+}
+
+/** CPU management
+ *
+ * @param interrupts Whether a deliverable interrupt is taken.
+ *
+ */
+static void manage(r4k_cpu_t *cpu, r4k_exc_t exc, ptr64_t old_pc,
+        bool interrupts)
+{
+    ASSERT(cpu != NULL);
+
+    /* Test for interrupt request */
+    if ((exc == r4k_excNone) && (interrupts) && (cpu->intr_deliverable)) {
+        exc = r4k_excInt;
+    }
+
+    /* Exception control */
+    if (exc != r4k_excNone) {
+        handle_exception(cpu, exc);
+    }
+
+    manage_cycle(cpu);
+}
+
+/** CPU cycle accounting after one instruction execution
+ *
+ */
+static void account(r4k_cpu_t *cpu)
+{
+    ASSERT(cpu != NULL);
+
+    if (cpu->stdby) {
+        cpu->w_cycles++;
+    } else {
+        if (CPU_KERNEL_MODE(cpu)) {
+            cpu->k_cycles++;
+        } else {
+            cpu->u_cycles++;
+        }
+    }
+}
+
+/** Tell how long the processor stands by without anything to notice
+ *
+ * Within the returned number of cycles no interrupt is taken and
+ * the Count register does not reach the Compare register, so only
+ * the counters change.
+ *
+ * @param cycles Number of cycles which can be skipped.
+ *
+ * @return False if the processor is not in the standby mode.
+ *
+ */
+bool r4k_standby(r4k_cpu_t *cpu, uint64_t *cycles)
+{
+    ASSERT(cpu != NULL);
+    ASSERT(cycles != NULL);
+
+    if (!cpu->stdby) {
+        return false;
+    }
+
+    *cycles = 0;
+    if ((cpu->branch != BRANCH_NONE) || (cpu->intr_deliverable)
+            || (cpu->timing.stall > 0)) {
+        return true;
+    }
+
+    /* The timer interrupt is requested in the cycle Count reaches Compare */
+    uint32_t change = cp0_compare(cpu).lo - cp0_count(cpu).lo;
+    *cycles = (change == 0) ? UINT32_MAX : change - 1;
+    return true;
+}
+
+/** Account the given number of standby cycles at once
+ *
+ * The processor ends up in the same state as if it was stepped,
+ * the number of cycles is limited by r4k_standby().
+ *
+ */
+void r4k_skip(r4k_cpu_t *cpu, uint64_t cycles)
+{
+    ASSERT(cpu != NULL);
+    ASSERT(cpu->stdby);
+
+    cp0_count(cpu).val += cycles;
+    cpu->w_cycles += cycles;
+}
+
+/** Read an instruction from a memory frame without side effects
+ *
+ * @return False if the address does not translate to a memory frame.
+ *
+ */
+static bool peek_instr(r4k_cpu_t *cpu, ptr64_t addr, uint32_t *instr)
+{
+    ptr36_t phys;
+
+    if (r4k_convert_addr(cpu, addr, &phys, false, false) != r4k_excNone) {
+        return false;
+    }
+
+    frame_t *frame = physmem_find_frame(phys);
+    if (frame == NULL) {
+        return false;
+    }
+
+    *instr = physmem_frame_read32(frame, phys, false);
+    return true;
+}
+
+/** Tell whether the processor loops forever
+ *
+ * The processor loops on a branch to itself (beq of a register with
+ * itself or j) followed by a nop in the branch delay slot, while no
+ * interrupt can be taken (the exception level, the error level, the
+ * interrupts disabled or all of them masked).
+ *
+ */
+bool r4k_deadloop(r4k_cpu_t *cpu)
+{
+    ASSERT(cpu != NULL);
+
+    if ((!cp0_status_exl(cpu)) && (!cp0_status_erl(cpu)) && (cp0_status_ie(cpu))
+            && ((cp0_status(cpu).val & cp0_cause_ip_mask) != 0)) {
+        return false;
+    }
+
+    /* The delay slot may be executed next */
+    ptr64_t addr = cpu->pc;
+    if (cpu->branch != BRANCH_NONE) {
+        addr.ptr -= 4;
+    }
+
+    uint32_t branch;
+    uint32_t slot;
+
+    if ((!peek_instr(cpu, addr, &branch)) || (!peek_instr(cpu, (ptr64_t) { .ptr = addr.ptr + 4 }, &slot))
+            || (slot != 0)) {
+        return false;
+    }
+
+    unsigned int opcode = branch >> 26;
+
+    /* beq rs, rs, . */
+    if ((opcode == 0x04) && (((branch >> 21) & 0x1f) == ((branch >> 16) & 0x1f))
+            && ((branch & 0xffff) == 0xffff)) {
+        return true;
+    }
+
+    /* j . */
+    uint64_t target = ((addr.ptr + 4) & ~UINT64_C(0x0fffffff)) | ((branch & 0x03ffffff) << 2);
+    return (opcode == 0x02) && (target == addr.ptr);
+}
+
+/** Per-cycle management of a finished block in the fast mode
+ *
+ * Count and the cycle counters are advanced at once, the machine
+ * cycles catch up after the processors are stepped. A timer
+ * interrupt requested by a cycle of the block is raised only
+ * after the block.
+ *
+ */
+static void manage_block(r4k_cpu_t *cpu, unsigned int count)
+{
+    /* Count reaches Compare in the given cycle of the block */
+    uint32_t change = cp0_compare(cpu).lo - cp0_count(cpu).lo;
+
+    cp0_count(cpu).val += count;
+
+    if ((change != 0) && (change <= count)) {
+        cp0_cause(cpu).val |= 1 << cp0_cause_ip7_shift;
+        r4k_update_interrupt(cpu);
+    }
+
+    if (CPU_KERNEL_MODE(cpu)) {
+        cpu->k_cycles += count;
+    } else {
+        cpu->u_cycles += count;
+    }
+
+    cpu->block_instrs += count;
+
+    /* The machine cycles catch up with the longest block of the cycle */
+    if ((!parallel_active) && (count > machine_fast_ahead)) {
+        machine_fast_ahead = count;
+    }
+}
+
+/** Maximal number of instructions of a block
+ *
+ * In the fast mode the blocks are used even if not configured.
+ *
+ */
+static unsigned int block_run_limit(r4k_cpu_t *cpu)
+{
+    if ((machine_fast) && (cpu->block_limit == 0)) {
+        return FRAME_SIZE / sizeof(r4k_instr_t);
+    }
+
+    return cpu->block_limit;
+}
+
+/** Address of PC as given to the trace filters
+ *
+ * The 32-bit addresses are matched without the sign extension,
+ * as the user enters them.
+ *
+ */
+static uint64_t trace_pc(r4k_cpu_t *cpu)
+{
+    return CPU_64BIT_MODE(cpu) ? cpu->pc.ptr : (uint32_t) cpu->pc.ptr;
+}
+
+/** Tell whether the instruction at PC is traced */
+static bool instr_traced(r4k_cpu_t *cpu)
+{
+    return (machine_trace)
+            && (trace_filter_hit(cpu->procno, trace_pc(cpu), CPU_USER_MODE(cpu),
+                    cp0_entryhi_asid(cpu)));
+}
+
+/** Tell whether the step may execute a block of instructions
+ *
+ * Blocks are not used on the traced pages, while the simulation
+ * is stepped or while the timing model is enabled, and never start
+ * in a branch delay slot. As a block never leaves the page, it is
+ * also not used on the pages with code breakpoints.
+ *
+ */
+static bool block_engine_active(r4k_cpu_t *cpu)
+{
+    unsigned int limit = block_run_limit(cpu);
+
+    return (limit > 0) && (cpu->branch == BRANCH_NONE)
+            && (!cpu->timing.enabled)
+            && ((!machine_trace)
+                    || (trace_page_quiet(cpu->procno, trace_pc(cpu),
+                            CPU_USER_MODE(cpu), cp0_entryhi_asid(cpu), limit)))
+            && (!machine_interactive) && (stepping == 0)
+            && (!breakpoint_code_page_set(cpu->procno, cpu->pc));
+}
+
+/** Finish an instruction of a block outside of the fast mode
+ *
+ */
+static void block_finish_instr(r4k_cpu_t *cpu)
+{
+    cpu->excaddr.ptr = cpu->pc.ptr;
+    cpu->regs[0].val = 0;
+    cpu->pc.ptr = cpu->pc_next.ptr;
+    cpu->pc_next.ptr += 4;
+
+    manage_cycle(cpu);
+    account(cpu);
+    cpu->block_instrs++;
+}
+
+#include "jit.c"
+#include "timing.c"
+
+/** Prepare a page restored from the decoded page file
+ *
+ * The blocks translated by the run which stored the page are
+ * translated on their first execution. They are not looked up,
+ * the translation kept at the place of the page may be of another
+ * page evicted before.
+ *
+ */
+static void cache_item_page_restore(decoded_page_t *page)
+{
+    cache_item_t *cache_item = (cache_item_t *) page;
+
+    for (size_t i = 0; i < FRAME_SIZE / sizeof(r4k_instr_t); ++i) {
+        if (cache_item->heat[i] == R4K_JIT_TRANSLATED) {
+            cache_item->heat[i] = R4K_JIT_TRANSLATED - 1;
+        }
+    }
+}
+
+/** Execute the straight-line run of instructions at PC
+ *
+ * The decoded instructions of the run are executed one after another
+ * directly from the decoded page. As the run contains no branches,
+ * jumps or coprocessor 0 instructions, the branch state stays
+ * BRANCH_NONE and the address translation of the page stays valid,
+ * so each instruction is finished (PC update, counters, random
+ * register, timer) without the general bookkeeping of execute().
+ *
+ * The run is cut short when an instruction raises an exception,
+ * makes an interrupt pending, writes to the page or stops the
+ * simulation. That instruction is then left to be finished
+ * by the step. In the fast mode the counters and the timer are
+ * managed once for the whole run (see manage_block()). Hot blocks
+ * are executed by their translated code (see the jit command).
+ *
+ * @param frame Frame holding PC (NULL outside of memory).
+ * @param phys  Physical address of PC, advanced past the finished
+ *              instructions.
+ * @param instr The instruction left to be finished by the step.
+ * @param exc   Exception raised by that instruction.
+ *
+ * @return True if the step is to be finished with instr and exc,
+ *         false if the instruction at the new PC is still to be
+ *         executed.
+ *
+ */
+static bool execute_block(r4k_cpu_t *cpu, frame_t *frame, ptr36_t *phys,
+        r4k_instr_t *instr, r4k_exc_t *exc)
+{
+    if (frame == NULL) {
+        return false;
+    }
 
-    /* Exception branch control */
-    cp0_cause(cpu).val &= ~cp0_cause_bd_mask;
-    if (cpu->branch == BRANCH_PASSED) {
-        cp0_cause(cpu).val |= cp0_cause_bd_mask;
+    cache_item_t *cache_item = fetch_page(cpu, frame, *phys);
+    cache_instr_t *cache_instr = &cache_item->instrs[PHYS2CACHEINSTR(*phys)];
+    r4k_mode_t mode = decode_mode(cpu);
+    unsigned int limit = block_run_limit(cpu);
+    unsigned int run = (cache_instr->run < limit) ? cache_instr->run : limit;
+    uint64_t generation = frame->generation;
+    bool fast = machine_fast;
+
+    if (run == 0) {
+        return false;
     }
 
-    if (!cp0_status_exl(cpu)) {
-        cp0_epc(cpu).val = cpu->excaddr.ptr;
-        if ((res == r4k_excInt) && (cpu->branch != BRANCH_COND)) {
-            cp0_epc(cpu).val = cpu->pc.ptr;
+    cpu->blocks++;
+
+    /* The run is recorded as a whole */
+    uint64_t pc = cpu->pc.ptr;
+    ptr36_t start = *phys;
+    uint32_t first = cache_instr->instr.val;
+
+    jit_code_t code = NULL;
+    if ((cpu->jit_threshold > 0) && (!parallel_active) && (!mixstat_enabled)) {
+        code = r4k_jit_code(cache_instr,
+                &cache_item->heat[PHYS2CACHEINSTR(*phys)], mode,
+                run, fast, cpu->jit_threshold);
+    }
+
+    if (code != NULL) {
+        unsigned int done = 0;
+        *exc = code(cpu, &frame->generation, &done);
+        cpu->jit_blocks++;
+
+        if (fast) {
+            manage_block(cpu, done);
+        }
+
+        flight_record(cpu->procno, TRACE_ARCH_R4K, pc, start, first,
+                (done < run) ? done + 1 : run);
+        cachesim_fetch(cpu->procno, start, (done < run) ? done + 1 : run);
+        memtrace_fetch(cpu->procno, pc, start, (done < run) ? done + 1 : run);
+        coverage_record(cpu->procno, pc, (done < run) ? done + 1 : run);
+
+        if (done < run) {
+            *instr = cache_instr[done].instr;
+            return true;
         }
+
+        *phys += run * sizeof(r4k_instr_t);
+        return false;
     }
 
-    ptr64_t exc_pc;
-    /* Exception vector base address */
-    if (cp0_status_bev(cpu)) {
-        /* Boot time */
-        if (res != r4k_excReset) {
-            exc_pc.ptr = EXCEPTION_BOOT_BASE_ADDRESS;
-        } else {
-            exc_pc.ptr = EXCEPTION_BOOT_RESET_ADDRESS;
+    for (unsigned int i = 0; i < run; i++, cache_instr++) {
+        *instr = cache_instr->instr;
+        *exc = lazy_decode(cache_instr, mode)(cpu, *instr);
+
+        if ((*exc != r4k_excNone) || (cpu->intr_deliverable)
+                || (frame->generation != generation)
+                || machine_stopping()) {
+            if (fast) {
+                manage_block(cpu, i);
+            }
+
+            flight_record(cpu->procno, TRACE_ARCH_R4K, pc, start, first, i + 1);
+            cachesim_fetch(cpu->procno, start, i + 1);
+            memtrace_fetch(cpu->procno, pc, start, i + 1);
+            coverage_record(cpu->procno, pc, i + 1);
+            return true;
         }
-    } else {
-        /* Normal time */
-        if (res != r4k_excReset) {
-            exc_pc.ptr = EXCEPTION_NORMAL_BASE_ADDRESS;
+
+        if (fast) {
+            cpu->excaddr.ptr = cpu->pc.ptr;
+            cpu->regs[0].val = 0;
+            cpu->pc.ptr = cpu->pc_next.ptr;
+            cpu->pc_next.ptr += 4;
         } else {
-            exc_pc.ptr = EXCEPTION_NORMAL_RESET_ADDRESS;
+            block_finish_instr(cpu);
         }
     }
 
-    /* Exception vector offsets */
-    if ((cp0_status_exl(cpu)) || (!tlb_refill)) {
-        exc_pc.ptr += EXCEPTION_OFFSET;
+    if (fast) {
+        manage_block(cpu, run);
     }
 
-    r4k_set_pc(cpu, exc_pc);
+    flight_record(cpu->procno, TRACE_ARCH_R4K, pc, start, first, run);
+    cachesim_fetch(cpu->procno, start, run);
+    memtrace_fetch(cpu->procno, pc, start, run);
+    coverage_record(cpu->procno, pc, run);
 
-    /* Switch to kernel mode */
-    cp0_status(cpu).val |= cp0_status_exl_mask;
+    *phys += run * sizeof(r4k_instr_t);
+    return false;
+}
+
+/** Write the executed instruction to the trace file
+ *
+ * The changed general registers follow the instruction
+ * if the register changes are reported.
+ *
+ * Right after another traced instruction only the registers
+ * written by the instruction are compared to their old values,
+ * otherwise (the first instruction traced after a pause) all
+ * registers are.
+ *
+ */
+static void trace_execution(r4k_cpu_t *cpu, r4k_instr_t instr)
+{
+    trace_instr(cpu->procno, TRACE_ARCH_R4K, cpu->pc.ptr, instr.val);
+
+    if (!iregch) {
+        return;
+    }
+
+    uint64_t cycles = cpu->k_cycles + cpu->u_cycles;
+    uint32_t written = (cycles == cpu->trace_cycles + 1)
+            ? written_regs(instr) : WRITTEN_ANY;
+
+    cpu->trace_cycles = cycles;
+
+    /* Register 0 is hardwired to zero */
+    for (written &= ~1U; written != 0; written &= written - 1) {
+        unsigned int i = __builtin_ctz(written);
+
+        if (cpu->regs[i].val != cpu->old_regs[i].val) {
+            trace_reg(cpu->procno, TRACE_ARCH_R4K, i, cpu->regs[i].val);
+            cpu->old_regs[i].val = cpu->regs[i].val;
+        }
+    }
 }
 
 /** Execute one CPU instruction
+ *
+ * @param blocks Whether a block may be executed (false when
+ *               checking the blocks).
  *
  */
-static r4k_exc_t execute(r4k_cpu_t *cpu)
+static r4k_exc_t execute(r4k_cpu_t *cpu, bool blocks)
 {
     ASSERT(cpu != NULL);
 
     /* Instruction fetch */
 
     ptr36_t phys;
-    r4k_exc_t res = r4k_convert_addr(cpu, cpu->pc, &phys, false, true);
+    frame_t *frame;
+    r4k_exc_t res = utlb_convert_addr(cpu, AM_FETCH, cpu->pc, &phys, &frame, true);
 
     switch (res) {
     case r4k_excNone:
@@ -3056,19 +3675,42 @@ static r4k_exc_t execute(r4k_cpu_t *cpu)
         ASSERT(false);
     }
 
-    r4k_instr_fnc_t fnc = fetch_instr(cpu, phys);
+    r4k_instr_t instr;
+    r4k_exc_t exc;
+    bool traced = instr_traced(cpu);
 
-    if (fnc == NULL) {
-        return r4k_excAdEL;
+    /* Blocks stop before the last instruction of the page, so the frame stays the same */
+    if ((!blocks) || (!block_engine_active(cpu))
+            || (!execute_block(cpu, frame, &phys, &instr, &exc))) {
+        r4k_instr_fnc_t fnc = fetch_instr(cpu, frame, phys, &instr);
+
+        if (fnc == NULL) {
+            return r4k_excAdEL;
+        }
+
+        flight_record(cpu->procno, TRACE_ARCH_R4K, cpu->pc.ptr, phys, instr.val, 1);
+        cachesim_fetch(cpu->procno, phys, 1);
+        memtrace_fetch(cpu->procno, cpu->pc.ptr, phys, 1);
+        coverage_record(cpu->procno, cpu->pc.ptr, 1);
+
+        /* Execute instruction */
+        exc = fnc(cpu, instr);
+
+        if (cpu->timing.enabled) {
+            timing_issue(cpu, instr, exc);
+        }
     }
 
-    r4k_instr_t instr = (r4k_instr_t) physmem_read32(cpu->procno, phys, false);
+    if (traced) {
+        profile_region_enter(PROFILE_TRACE);
 
-    /* Execute instruction */
-    r4k_exc_t exc = fnc(cpu, instr);
+        if (trace_active) {
+            trace_execution(cpu, instr);
+        } else {
+            r4k_idump(cpu, cpu->pc, instr, true);
+        }
 
-    if (machine_trace) {
-        r4k_idump(cpu, cpu->pc, instr, true);
+        profile_region_leave();
     }
 
     /* Branch test */
@@ -3100,109 +3742,251 @@ static r4k_exc_t execute(r4k_cpu_t *cpu)
     return exc;
 }
 
-/** CPU management
+/* Simulate one cycle of the processor
+ *
+ * @param blocks     Whether a block may be executed.
+ * @param interrupts Whether a deliverable interrupt is taken.
  *
  */
-static void manage(r4k_cpu_t *cpu, r4k_exc_t exc, ptr64_t old_pc)
+static inline void cpu_step(r4k_cpu_t *cpu, bool blocks, bool interrupts)
 {
-    ASSERT(cpu != NULL);
+    /* Instruction execute */
+    r4k_exc_t exc = r4k_excNone;
+    ptr64_t old_pc = cpu->pc;
 
-    /* Test for interrupt request */
-    if ((exc == r4k_excNone) && (!cp0_status_exl(cpu)) && (!cp0_status_erl(cpu)) && (cp0_status_ie(cpu)) && ((cp0_cause(cpu).val & cp0_status(cpu).val) & cp0_cause_ip_mask) != 0) {
-        exc = r4k_excInt;
+    /* The pipeline stalls after the last instruction (see timing.c) */
+    if (cpu->timing.stall > 0) {
+        timing_stall_cycle(cpu);
+        return;
     }
 
-    /* Exception control */
-    if (exc != r4k_excNone) {
-        handle_exception(cpu, exc);
+    if (!cpu->stdby) {
+        exc = execute(cpu, blocks);
     }
 
-    /* Increase counter */
-    cp0_count(cpu).val++;
+    /* Processor management */
+    manage(cpu, exc, old_pc, interrupts);
 
-    /* Decrease random register */
-    if (cp0_random(cpu).val-- == 0) {
-        cp0_random(cpu).val = 47;
-    }
+    /* Cycle accounting */
+    account(cpu);
+}
 
-    if (cp0_random(cpu).val < cp0_wired(cpu).val) {
-        cp0_random(cpu).val = 47;
-    }
+#include "cosim.c"
 
-    /*
-     * Timer control.
-     *
-     * N.B.: Count and Compare are truly 32 bit CP0
-     *       registers even in 64-bit mode.
-     */
-    if (cp0_count(cpu).lo == cp0_compare(cpu).lo) {
-        /* Generate interrupt request */
-        cp0_cause(cpu).val |= 1 << cp0_cause_ip7_shift;
+/* Simulate one cycle of the processor
+ *
+ */
+void r4k_step(r4k_cpu_t *cpu)
+{
+    ASSERT(cpu != NULL);
+
+    if ((cosim_enabled) && (!cpu->stdby) && (block_engine_active(cpu))) {
+        r4k_cosim_step(cpu);
+        return;
     }
 
-    /* Branch delay slot control */
-    if (cpu->branch > BRANCH_NONE) {
-        cpu->branch--;
+    cpu_step(cpu, true, true);
+}
+
+bool r4k_sc_access(r4k_cpu_t *cpu, ptr36_t addr, int size)
+{
+    // MIPS R4K SC fails on write to whole cache line
+    // (block transfers may write several lines at once)
+    bool hit = AREAS_OVERLAP(cpu->lladdr, 64, addr, size);
+    if (hit) {
+        cpu->llbit = false;
     }
+    return hit;
 }
 
-/** CPU cycle accounting after one instruction execution
+void r4k_done(r4k_cpu_t *cpu)
+{
+    // Clean whole cache
+    decode_cache_flush(DECODE_R4K);
+
+    safe_free(cpu->tlb_victim);
+}
+
+/** Set the number of TLB entries
+ *
+ * The R4000 has TLB_ENTRIES entries, other numbers are not
+ * architectural. Index, Random and Wired are widened to hold
+ * the indices of all entries. The entries are cleared and Random
+ * starts over from the last entry.
  *
  */
-static void account(r4k_cpu_t *cpu)
+void r4k_set_tlb_entries(r4k_cpu_t *cpu, unsigned int entries)
 {
     ASSERT(cpu != NULL);
+    ASSERT((entries > 0) && (entries <= TLB_ENTRIES_MAX));
 
-    if (cpu->stdby) {
-        cpu->w_cycles++;
-    } else {
-        if (CPU_KERNEL_MODE(cpu)) {
-            cpu->k_cycles++;
-        } else {
-            cpu->u_cycles++;
-        }
+    cpu->tlb_entries = entries;
+    cpu->tlb_index_mask = cp0_index_index_mask;
+
+    while (cpu->tlb_index_mask < entries - 1) {
+        cpu->tlb_index_mask = (cpu->tlb_index_mask << 1) | 1;
     }
+
+    memset(cpu->tlb, 0, sizeof(cpu->tlb));
+    memset(cpu->tlb_lookup, 0, sizeof(cpu->tlb_lookup));
+    tlb_filter_rebuild(cpu);
+    utlb_flush(cpu);
+
+    r4k_set_wired(cpu, cp0_wired(cpu).val);
 }
 
-/* Simulate one cycle of the processor
+/** Set the number of entries of the victim TLB
+ *
+ * The victim TLB is not architectural. The translations missing
+ * the TLB are looked up in the entries replaced by TLBWR before
+ * the TLB Refill exception is raised, so the guest sees a larger
+ * TLB. This isolates the overhead of the refill handlers in
+ * experiments. No entries disable the victim TLB.
  *
  */
-void r4k_step(r4k_cpu_t *cpu)
+void r4k_set_tlb_victim(r4k_cpu_t *cpu, unsigned int count)
 {
     ASSERT(cpu != NULL);
+    ASSERT(count <= R4K_TLB_VICTIM_MAX);
 
-    /* Instruction execute */
-    r4k_exc_t exc = r4k_excNone;
-    ptr64_t old_pc = cpu->pc;
+    safe_free(cpu->tlb_victim);
 
-    if (!cpu->stdby) {
-        exc = execute(cpu);
-    }
+    cpu->tlb_victim_count = count;
+    cpu->tlb_victim_next = 0;
 
-    /* Processor management */
-    manage(cpu, exc, old_pc);
+    if (count > 0) {
+        cpu->tlb_victim = safe_malloc(count * sizeof(tlb_entry_t));
+        tlb_victim_flush(cpu);
+    }
 
-    /* Cycle accounting */
-    account(cpu);
+    utlb_flush(cpu);
 }
 
-bool r4k_sc_access(r4k_cpu_t *cpu, ptr36_t addr, int size)
+/** Save the processor state into a checkpoint
+ *
+ * The caches of the translations are not saved, they are
+ * filled again after the restore.
+ *
+ */
+bool r4k_save(r4k_cpu_t *cpu, checkpoint_t *ckpt)
 {
-    // MIPS R4K SC fails on write to whole cache line
-    // We allow only aligned accesses so this works
-    bool hit = cpu->lladdr == ALIGN_DOWN(addr, 64);
-    if (hit) {
-        cpu->llbit = false;
-    }
-    return hit;
-}
+    ASSERT(cpu != NULL);
 
-void r4k_done(r4k_cpu_t *cpu)
+    r4k_sync_random(cpu);
+
+    return checkpoint_write_var(ckpt, cpu->stdby)
+            && checkpoint_write_var(ckpt, cpu->regs)
+            && checkpoint_write_var(ckpt, cpu->cp0)
+            && checkpoint_write_var(ckpt, cpu->fpregs)
+            && checkpoint_write_var(ckpt, cpu->loreg)
+            && checkpoint_write_var(ckpt, cpu->hireg)
+            && checkpoint_write_var(ckpt, cpu->pc)
+            && checkpoint_write_var(ckpt, cpu->pc_next)
+            && checkpoint_write_var(ckpt, cpu->tlb_entries)
+            && checkpoint_write(ckpt, cpu->tlb,
+                    cpu->tlb_entries * sizeof(tlb_entry_t))
+            && checkpoint_write_var(ckpt, cpu->old_regs)
+            && checkpoint_write_var(ckpt, cpu->old_cp0)
+            && checkpoint_write_var(ckpt, cpu->old_loreg)
+            && checkpoint_write_var(ckpt, cpu->old_hireg)
+            && checkpoint_write_var(ckpt, cpu->excaddr)
+            && checkpoint_write_var(ckpt, cpu->branch)
+            && checkpoint_write_var(ckpt, cpu->waddr)
+            && checkpoint_write_var(ckpt, cpu->wexcaddr)
+            && checkpoint_write_var(ckpt, cpu->wpending)
+            && checkpoint_write_var(ckpt, cpu->k_cycles)
+            && checkpoint_write_var(ckpt, cpu->u_cycles)
+            && checkpoint_write_var(ckpt, cpu->w_cycles)
+            && checkpoint_write_var(ckpt, cpu->tlb_refill)
+            && checkpoint_write_var(ckpt, cpu->tlb_invalid)
+            && checkpoint_write_var(ckpt, cpu->tlb_modified)
+            && checkpoint_write_var(ckpt, cpu->intr)
+            && checkpoint_write_var(ckpt, cpu->tlb_victim_count)
+            && checkpoint_write_var(ckpt, cpu->tlb_victim_next)
+            && checkpoint_write_var(ckpt, cpu->tlb_victim_hits)
+            && checkpoint_write(ckpt, cpu->tlb_victim,
+                    cpu->tlb_victim_count * sizeof(tlb_entry_t));
+}
+
+/** Load the processor state from a checkpoint
+ *
+ * An LL-SC reservation is not restored, so the next SC
+ * fails as if the reservation was broken.
+ *
+ */
+bool r4k_load(r4k_cpu_t *cpu, checkpoint_t *ckpt)
 {
-    // Clean whole cache
-    while (!is_empty(&r4k_instruction_cache)) {
-        cache_item_t *cache_item = (cache_item_t *) (r4k_instruction_cache.head);
-        list_remove(&r4k_instruction_cache, &cache_item->item);
-        safe_free(cache_item);
-    }
+    ASSERT(cpu != NULL);
+
+    bool ok = checkpoint_read_var(ckpt, cpu->stdby)
+            && checkpoint_read_var(ckpt, cpu->regs)
+            && checkpoint_read_var(ckpt, cpu->cp0)
+            && checkpoint_read_var(ckpt, cpu->fpregs)
+            && checkpoint_read_var(ckpt, cpu->loreg)
+            && checkpoint_read_var(ckpt, cpu->hireg)
+            && checkpoint_read_var(ckpt, cpu->pc)
+            && checkpoint_read_var(ckpt, cpu->pc_next);
+
+    /* The TLB is configured by the same command as saved */
+    unsigned int entries;
+
+    ok = ok && checkpoint_read_var(ckpt, entries);
+
+    if ((ok) && (entries != cpu->tlb_entries)) {
+        error("TLB of %u entries saved, %u configured",
+                entries, cpu->tlb_entries);
+        ok = false;
+    }
+
+    ok = ok && checkpoint_read(ckpt, cpu->tlb,
+                    cpu->tlb_entries * sizeof(tlb_entry_t))
+            && checkpoint_read_var(ckpt, cpu->old_regs)
+            && checkpoint_read_var(ckpt, cpu->old_cp0)
+            && checkpoint_read_var(ckpt, cpu->old_loreg)
+            && checkpoint_read_var(ckpt, cpu->old_hireg)
+            && checkpoint_read_var(ckpt, cpu->excaddr)
+            && checkpoint_read_var(ckpt, cpu->branch)
+            && checkpoint_read_var(ckpt, cpu->waddr)
+            && checkpoint_read_var(ckpt, cpu->wexcaddr)
+            && checkpoint_read_var(ckpt, cpu->wpending)
+            && checkpoint_read_var(ckpt, cpu->k_cycles)
+            && checkpoint_read_var(ckpt, cpu->u_cycles)
+            && checkpoint_read_var(ckpt, cpu->w_cycles)
+            && checkpoint_read_var(ckpt, cpu->tlb_refill)
+            && checkpoint_read_var(ckpt, cpu->tlb_invalid)
+            && checkpoint_read_var(ckpt, cpu->tlb_modified)
+            && checkpoint_read_var(ckpt, cpu->intr);
+
+    /* The victim TLB is configured by the same command as saved */
+    unsigned int victim_count;
+
+    ok = ok && checkpoint_read_var(ckpt, victim_count);
+
+    if ((ok) && (victim_count != cpu->tlb_victim_count)) {
+        error("Victim TLB of %u entries saved, %u configured",
+                victim_count, cpu->tlb_victim_count);
+        ok = false;
+    }
+
+    ok = ok && checkpoint_read_var(ckpt, cpu->tlb_victim_next)
+            && checkpoint_read_var(ckpt, cpu->tlb_victim_hits)
+            && checkpoint_read(ckpt, cpu->tlb_victim,
+                    cpu->tlb_victim_count * sizeof(tlb_entry_t));
+
+    cpu->llbit = false;
+    sc_unregister(cpu->procno);
+
+    memset(cpu->tlb_lookup, 0, sizeof(cpu->tlb_lookup));
+    tlb_filter_rebuild(cpu);
+    utlb_flush(cpu);
+    cpu->kseg_valid = false;
+
+    /* Random continues from the saved value */
+    cpu->random_base = cp0_count(cpu).val
+            - (cpu->tlb_entries - 1 - cp0_random(cpu).val);
+    intr_latency_sync(&cpu->intr_latency,
+            (cp0_cause(cpu).val & cp0_cause_ip_mask) >> cp0_cause_ip0_shift);
+    r4k_update_interrupt(cpu);
+
+    return ok;
 }
@@ -18,14 +18,18 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include "../../../debug/mixstat.h"
 #include "../../../list.h"
 #include "../../../physmem.h"
 #include "../../../utils.h"
+#include "../decode_cache.h"
+#include "../intr_latency.h"
 
 #define R4K_REG_COUNT 32
 #define R4K_REG_VARIANTS 3
 
 #define TLB_ENTRIES 48
+#define TLB_ENTRIES_MAX 1024
 #define INTR_COUNT 8
 #define TLB_PHYSMASK UINT64_C(0x780000000)
 
@@ -401,7 +405,7 @@ typedef enum {
 #define cp0_ecc_res(cpu) (((cpu)->cp0[cp0_ECC].val & cp0_ecc_res_mask) >> cp0_ecc_res_shift)
 
 #define cp0_xcontext_res1_mask UINT64_C(0x000000000000000f)
-#define cp0_xcontext_badvpn2_mask UINT64_C(0x000000007ffffff8)
+#define cp0_xcontext_badvpn2_mask UINT64_C(0x000000007ffffff0)
 #define cp0_xcontext_r_mask UINT64_C(0x0000000180000000)
 #define cp0_xcontext_ptebase_mask UINT64_C(0xfffffffe00000000)
 
@@ -501,6 +505,14 @@ typedef enum {
     BRANCH_COND = 2
 } branch_state_t;
 
+/** Operation modes selecting the variants of the decoded instructions */
+typedef enum {
+    R4K_MODE_32 = 0, /**< 32-bit addressing, 64-bit instructions reserved */
+    R4K_MODE_32_KERNEL = 1, /**< 32-bit addressing, 64-bit instructions allowed */
+    R4K_MODE_64 = 2, /**< 64-bit addressing and instructions */
+    R4K_MODE_COUNT = 3
+} r4k_mode_t;
+
 /** Instruction decoding structure */
 typedef union r4k_instr {
     uint32_t val;
@@ -571,42 +583,137 @@ typedef union r4k_instr {
 
 static_assert(sizeof(r4k_instr_t) == 4, "wrong r4k_instr_t size!");
 
+struct checkpoint;
 struct frame;
 struct r4k_cpu;
 
+/** Number of memory access modes keeping their own last translation
+ *
+ * Instruction fetches, data reads and data writes.
+ *
+ */
+#define R4K_UTLB_COUNT 3
+
+/** Last translation of one memory access mode */
+typedef struct {
+    bool valid;
+    uint64_t vpage; /**< Virtual page number */
+    ptr36_t ppage; /**< Physical address of the page */
+    uint32_t status; /**< Status bits selecting the address space */
+    unsigned int asid; /**< ASID of the translation */
+    struct frame *frame; /**< Frame holding the page (NULL outside of memory) */
+    unsigned int layout; /**< Value of physmem_layout when the frame was looked up */
+} r4k_utlb_entry_t;
+
+/** Number of slots of the fetch translation cache (power of two) */
+#define R4K_FETCH_CACHE_SIZE 64
+
+/** Number of slots of the TLB lookup cache (power of two) */
+#define R4K_TLB_LOOKUP_SIZE 256
+
+/** Number of buckets of the TLB miss filter (power of two, see tlb_find()) */
+#define R4K_TLB_BUCKETS 256
+
+/** Number of TLB tags compared at once (a 128-bit vector, see tlb_tag_find()) */
+#define R4K_TLB_TAG_LANES 4
+
+/** Maximal number of entries of the victim TLB */
+#define R4K_TLB_VICTIM_MAX 1024
+
+/** Slot of the TLB lookup cache
+ *
+ * Remembers which TLB entry mapped a pair of 4 KiB pages
+ * in an address space.
+ *
+ */
+typedef struct {
+    bool valid;
+    uint32_t vpn2; /**< Virtual address of the page pair (shifted >> 13) */
+    uint8_t asid; /**< ASID of the lookup */
+    uint16_t index; /**< Index of the TLB entry */
+} r4k_tlb_lookup_t;
+
 /** Instruction implementation */
 typedef r4k_exc_t (*r4k_instr_fnc_t)(struct r4k_cpu *, r4k_instr_t);
 
-/** Main processor structure */
-typedef struct r4k_cpu {
-    /* Basic run-time support */
-    unsigned int procno;
-    bool stdby;
+/* Scoreboard entries of the timing model (the general registers, HI and LO) */
+#define R4K_TIMING_HI R4K_REG_COUNT
+#define R4K_TIMING_LO (R4K_REG_COUNT + 1)
+#define R4K_TIMING_REGS (R4K_REG_COUNT + 2)
 
+/** Pipeline timing model (see timing.c)
+ *
+ * Disabled by default, every instruction then takes one cycle.
+ *
+ */
+typedef struct {
+    bool enabled;
+    unsigned int stall; /**< Stall cycles left after the last instruction */
+    uint64_t ready[R4K_TIMING_REGS]; /**< Cycle each result is available in */
+
+    /* Statistics */
+    uint64_t load_stalls; /**< Waiting for a loaded general register */
+    uint64_t mdu_stalls; /**< Waiting for HI, LO or the multiply/divide unit */
+    uint64_t branch_stalls; /**< Taken branches and jumps */
+} r4k_timing_t;
+
+/** Main processor structure
+ *
+ * The state used by every step of the interpreter (the general
+ * registers, PC, the branch state, the last translations and the
+ * cycle counters) comes first, so that it shares a few cache lines.
+ * The rest (the TLB, the floating point registers, the debugging
+ * snapshots and the statistics) starts on its own cache line.
+ *
+ */
+typedef struct r4k_cpu {
     /* Standard registers */
     reg64_t regs[R4K_REG_COUNT];
-    reg64_t cp0[R4K_REG_COUNT];
-    uint64_t fpregs[R4K_REG_COUNT];
-    reg64_t loreg;
-    reg64_t hireg;
 
     /* Program counter */
     ptr64_t pc;
     ptr64_t pc_next;
 
-    /* TLB structures */
-    tlb_entry_t tlb[TLB_ENTRIES];
-    unsigned int tlb_hint;
-
-    /* Old registers (for debug info) */
-    reg64_t old_regs[R4K_REG_COUNT];
-    reg64_t old_cp0[R4K_REG_COUNT];
-    reg64_t old_loreg;
-    reg64_t old_hireg;
-
     ptr64_t excaddr;
     branch_state_t branch;
 
+    /* An interrupt is pending, enabled and not masked by EXL or ERL
+       (see r4k_update_interrupt()) */
+    bool intr_deliverable;
+
+    /* Basic run-time support */
+    bool stdby;
+    unsigned int procno;
+
+    reg64_t loreg;
+    reg64_t hireg;
+
+    /* Cycle statistics (counted each step) */
+    uint64_t k_cycles;
+    uint64_t u_cycles;
+    uint64_t w_cycles;
+
+    /* Unmapped kernel segments (kseg0 and kseg1) and the operation mode */
+    bool kseg_valid; /**< The fields below are computed */
+    uint32_t kseg_status; /**< Status bits they were computed for */
+    bool kseg_direct; /**< kseg0 and kseg1 are accessible */
+    r4k_mode_t mode; /**< Mode of the decoded instructions */
+
+    /* Block execution (maximal number of instructions, 0 if disabled) */
+    unsigned int block_limit;
+
+    /* Block translation (executions before the translation, 0 if disabled) */
+    unsigned int jit_threshold;
+
+    uint64_t blocks;
+    uint64_t block_instrs;
+    uint64_t jit_blocks;
+
+    r4k_utlb_entry_t utlb[R4K_UTLB_COUNT];
+
+    /* Coprocessor 0 registers (Count and Compare change each step) */
+    reg64_t cp0[R4K_REG_COUNT];
+
     /* LL and SC track support */
     bool llbit; /**< Track the address flag */
     ptr36_t lladdr; /**< Physical tracked address */
@@ -616,18 +723,65 @@ typedef struct r4k_cpu {
     ptr64_t wexcaddr;
     bool wpending;
 
-    /* Statistics */
-    uint64_t k_cycles;
-    uint64_t u_cycles;
-    uint64_t w_cycles;
+    /* Value of Count when Random was at the last entry
+       (see r4k_sync_random()) */
+    uint64_t random_base;
+
+    /* TLB structures (TLB_ENTRIES unless configured otherwise,
+       see r4k_set_tlb_entries()) */
+    tlb_entry_t tlb[TLB_ENTRIES_MAX] __attribute__((aligned(CACHE_LINE_SIZE)));
+    unsigned int tlb_entries;
+    uint32_t tlb_index_mask; /**< Bits of Index, Random and Wired */
+
+    /* Tags of the TLB entries (VPN2 and ASID) and their masks
+       compared a vector at a time (see tlb_tag_set()) */
+    uint32_t tlb_tags[TLB_ENTRIES_MAX] __attribute__((aligned(CACHE_LINE_SIZE)));
+    uint32_t tlb_tag_masks[TLB_ENTRIES_MAX] __attribute__((aligned(CACHE_LINE_SIZE)));
+
+    r4k_tlb_lookup_t tlb_lookup[R4K_TLB_LOOKUP_SIZE];
+
+    /* Fetch translations of the recent address spaces
+       (see utlb_convert_addr()) */
+    r4k_utlb_entry_t fetch_cache[R4K_FETCH_CACHE_SIZE];
+
+    /* TLB miss filter, the entries of 4 KiB pages in each bucket
+       of VPN2 and the entries of the other page sizes */
+    uint16_t tlb_buckets[R4K_TLB_BUCKETS];
+    unsigned int tlb_large;
 
+    /* Non-architectural victim TLB of the entries replaced by TLBWR
+       (see r4k_set_tlb_victim(), no entries if disabled) */
+    tlb_entry_t *tlb_victim;
+    unsigned int tlb_victim_count;
+    unsigned int tlb_victim_next;
+
+    /* Optional stalls of the pipeline (see the timing command) */
+    r4k_timing_t timing;
+
+    uint64_t fpregs[R4K_REG_COUNT];
+
+    /* Old registers (for debug info, updated only while tracing) */
+    reg64_t old_regs[R4K_REG_COUNT];
+    reg64_t old_cp0[R4K_REG_COUNT];
+    reg64_t old_loreg;
+    reg64_t old_hireg;
+
+    /* Value of k_cycles + u_cycles at the last traced instruction */
+    uint64_t trace_cycles;
+
+    /* Statistics */
     uint64_t tlb_refill;
     uint64_t tlb_invalid;
     uint64_t tlb_modified;
+    uint64_t tlb_victim_hits;
+    uint64_t fetch_cache_hits;
     uint64_t intr[INTR_COUNT];
+    intr_latency_t intr_latency;
+
+    decode_stats_t decode_stats;
 
-    /* breakpoints */
-    list_t bps;
+    /* Executions of the instruction implementations (see mixstat) */
+    mixstat_t mix;
 } r4k_cpu_t;
 
 /** Opcode numbers
@@ -958,7 +1112,12 @@ extern mnemonics_fnc_t decode_mnemonics(r4k_instr_t);
 extern void r4k_init(r4k_cpu_t *cpu, unsigned int procno);
 extern void r4k_set_pc(r4k_cpu_t *cpu, ptr64_t value);
 extern void r4k_step(r4k_cpu_t *cpu);
+extern bool r4k_standby(r4k_cpu_t *cpu, uint64_t *cycles);
+extern void r4k_skip(r4k_cpu_t *cpu, uint64_t cycles);
+extern bool r4k_deadloop(r4k_cpu_t *cpu);
 extern void r4k_done(r4k_cpu_t *cpu);
+extern bool r4k_save(r4k_cpu_t *cpu, struct checkpoint *ckpt);
+extern bool r4k_load(r4k_cpu_t *cpu, struct checkpoint *ckpt);
 
 /** Addresing function */
 extern r4k_exc_t r4k_convert_addr(r4k_cpu_t *cpu, ptr64_t virt, ptr36_t *phys, bool write,
@@ -971,6 +1130,19 @@ extern r4k_exc_t r4k_read_mem32(r4k_cpu_t *cpu, ptr64_t addr, uint32_t *value,
 /** Interrupts */
 extern void r4k_interrupt_up(r4k_cpu_t *cpu, unsigned int no);
 extern void r4k_interrupt_down(r4k_cpu_t *cpu, unsigned int no);
+extern void r4k_update_interrupt(r4k_cpu_t *cpu);
+
+/** Count and Random registers */
+extern void r4k_set_count(r4k_cpu_t *cpu, uint32_t value);
+extern void r4k_set_wired(r4k_cpu_t *cpu, uint32_t value);
+extern void r4k_sync_random(r4k_cpu_t *cpu);
+
+/** TLB size and victim TLB */
+extern void r4k_set_tlb_entries(r4k_cpu_t *cpu, unsigned int entries);
+extern void r4k_set_tlb_victim(r4k_cpu_t *cpu, unsigned int count);
+
+/** Pipeline timing model */
+extern void r4k_set_timing(r4k_cpu_t *cpu, bool enabled);
 
 extern bool r4k_sc_access(r4k_cpu_t *cpu, ptr36_t addr, int size);
 
@@ -4,6 +4,7 @@
 #include <string.h>
 
 #include "../../../assert.h"
+#include "../../../debug/disasm.h"
 #include "../../../env.h"
 #include "../../../main.h"
 #include "../../../utils.h"
@@ -134,7 +135,7 @@ void r4k_tlb_dump(r4k_cpu_t *cpu)
            "  no    vpn      mask        g asid  v d   pfn     c  v d   pfn     c\n");
 
     unsigned int i;
-    for (i = 0; i < 48; i++) {
+    for (i = 0; i < cpu->tlb_entries; i++) {
         tlb_entry_t *e = &(cpu->tlb[i]);
 
         printf("  %02x  %08" PRIx32 " %08" PRIx32 ":%-4s %u  %02x   %u %u %09" PRIx64 " %1x  %u %u %09" PRIx64 " %1x\n",
@@ -157,6 +158,7 @@ static void r4k_cp0_dump_reg(r4k_cpu_t *cpu, unsigned int reg)
                 cp0_index_index(cpu), cp0_index_res(cpu), cp0_index_p(cpu));
         break;
     case cp0_Random:
+        r4k_sync_random(cpu);
         printf(s,
                 cp0_random(cpu), cp0_random_random(cpu), cp0_random_res(cpu));
         break;
@@ -300,16 +302,21 @@ void r4k_cp0_dump(r4k_cpu_t *cpu, unsigned int reg)
     r4k_cp0_dump_reg(cpu, reg);
 }
 
-static void idump_common(ptr64_t addr, r4k_instr_t instr, string_t *s_opc,
-        string_t *s_mnemonics, string_t *s_comments)
+/** Disassemble an instruction (see disasm_get()) */
+static void disassemble(uint64_t addr, uint32_t word, string_t *s_mnemonics,
+        string_t *s_comments)
 {
-    string_printf(s_opc, "%08" PRIx32, instr.val);
+    ptr64_t vaddr = { .ptr = addr };
+    r4k_instr_t instr = { .val = word };
 
     mnemonics_fnc_t fnc = decode_mnemonics(instr);
-    fnc(addr, instr, s_mnemonics, s_comments);
+    fnc(vaddr, instr, s_mnemonics, s_comments);
 }
 
 /** Dump instruction mnemonics
+ *
+ * The disassembled instruction is taken from the cache
+ * of the disassembled instructions.
  *
  * @param cpu     If not NULL, then the dump is processor-dependent
  *                (with processor number).
@@ -320,46 +327,27 @@ static void idump_common(ptr64_t addr, r4k_instr_t instr, string_t *s_opc,
  */
 void r4k_idump(r4k_cpu_t *cpu, ptr64_t addr, r4k_instr_t instr, bool modregs)
 {
-    string_t s_cpu;
-    string_t s_addr;
-    string_t s_opc;
-    string_t s_mnemonics;
-    string_t s_comments;
-
-    string_init(&s_cpu);
-    string_init(&s_addr);
-    string_init(&s_opc);
-    string_init(&s_mnemonics);
-    string_init(&s_comments);
-
-    if (cpu != NULL) {
-        string_printf(&s_cpu, "cpu%u", cpu->procno);
-    }
-
-    string_printf(&s_addr, "%#018" PRIx64, addr.ptr);
-    idump_common(addr, instr, &s_opc, &s_mnemonics, &s_comments);
+    const disasm_slot_t *slot = disasm_get(TRACE_ARCH_R4K, addr.ptr,
+            instr.val, disassemble);
+    disasm_line_t line = { .len = 0 };
 
     if (cpu != NULL) {
-        printf("%-5s ", s_cpu.str);
+        disasm_line_add(&line, "cpu%-2u ", cpu->procno);
     }
 
     if (iaddr) {
-        printf("%-18s ", s_addr.str);
+        disasm_line_add(&line, "%#018" PRIx64 " ", addr.ptr);
     }
 
     if (iopc) {
-        printf("%-8s ", s_opc.str);
+        disasm_line_add(&line, "%08" PRIx32 " ", instr.val);
     }
 
-    printf("%s\n", s_mnemonics.str);
+    disasm_line_add(&line, "%s", slot->mnemonics);
 
     // FIXME print comments
 
-    string_done(&s_cpu);
-    string_done(&s_addr);
-    string_done(&s_opc);
-    string_done(&s_mnemonics);
-    string_done(&s_comments);
+    disasm_line_print(&line);
 }
 
 /** Dump instruction mnemonics
@@ -370,42 +358,27 @@ void r4k_idump(r4k_cpu_t *cpu, ptr64_t addr, r4k_instr_t instr, bool modregs)
  */
 void r4k_idump_phys(ptr36_t addr, r4k_instr_t instr)
 {
-    string_t s_addr;
-    string_t s_iopc;
-    string_t s_mnemonics;
-    string_t s_comments;
+    const disasm_slot_t *slot = disasm_get(TRACE_ARCH_R4K, addr,
+            instr.val, disassemble);
+    disasm_line_t line = { .len = 0 };
 
-    string_init(&s_addr);
-    string_init(&s_iopc);
-    string_init(&s_mnemonics);
-    string_init(&s_comments);
+    disasm_line_add(&line, "  ");
 
     if (iaddr) {
-        string_printf(&s_addr, "%#011" PRIx64 "  ", addr);
+        disasm_line_add(&line, "%#011" PRIx64 "  ", addr);
     }
 
-    ptr64_t vaddr;
-    vaddr.ptr = addr;
-
-    idump_common(vaddr, instr, &s_iopc, &s_mnemonics, &s_comments);
-
-    if (!iopc) {
-        string_clear(&s_iopc);
+    if (iopc) {
+        disasm_line_add(&line, "%08" PRIx32 "  ", instr.val);
     }
 
-    const char *comment_sep = string_is_empty(&s_comments) ? "" : " # ";
-    const char *iopc_sep_after = iopc ? "  " : "";
+    disasm_line_add(&line, "  %-20s", slot->mnemonics);
 
-    printf("  %s%s  %s%-20s%s%s\n",
-            s_addr.str,
-            s_iopc.str, iopc_sep_after,
-            s_mnemonics.str,
-            comment_sep, s_comments.str);
+    if (slot->comments[0] != 0) {
+        disasm_line_add(&line, " # %s", slot->comments);
+    }
 
-    string_done(&s_addr);
-    string_done(&s_iopc);
-    string_done(&s_mnemonics);
-    string_done(&s_comments);
+    disasm_line_print(&line);
 }
 
 /** Write info about changed registers
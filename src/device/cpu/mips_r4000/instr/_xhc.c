@@ -0,0 +1,37 @@
+static r4k_exc_t instr__xhc(r4k_cpu_t *cpu, r4k_instr_t instr)
+{
+    if (!machine_specific_instructions) {
+        return instr__reserved(cpu, instr);
+    }
+
+    bool wide = (cpu->mode == R4K_MODE_64);
+    uint64_t args[HYPERCALL_ARGS];
+
+    /* Arguments in a0 to a3, the hypercall number in v0 */
+    for (unsigned int i = 0; i < HYPERCALL_ARGS; i++) {
+        args[i] = wide ? cpu->regs[4 + i].val : (uint32_t) cpu->regs[4 + i].val;
+    }
+
+    uint64_t no = wide ? cpu->regs[2].val : (uint32_t) cpu->regs[2].val;
+    uint64_t result = hypercall(no, args);
+
+    /* The upper half of the result goes to v1 in the 32-bit modes */
+    if (wide) {
+        cpu->regs[2].val = result;
+    } else {
+        cpu->regs[2].val = (int64_t) (int32_t) result;
+        cpu->regs[3].val = (int64_t) (int32_t) (result >> 32);
+    }
+
+    return r4k_excNone;
+}
+
+static void mnemonics__xhc(ptr64_t addr, r4k_instr_t instr,
+        string_t *mnemonics, string_t *comments)
+{
+    if (!machine_specific_instructions) {
+        return mnemonics__reserved(addr, instr, mnemonics, comments);
+    }
+
+    string_printf(mnemonics, "_xhc");
+}
@@ -4,7 +4,7 @@ static r4k_exc_t instr__xhlt(r4k_cpu_t *cpu, r4k_instr_t instr)
         return instr__reserved(cpu, instr);
     }
     alert("XHLT: Machine halt");
-    machine_halt = true;
+    __atomic_store_n(&machine_halt, true, __ATOMIC_RELEASE);
     return r4k_excNone;
 }
 
@@ -2,10 +2,10 @@ static r4k_exc_t instr__xint(r4k_cpu_t *cpu, r4k_instr_t instr)
 {
     if (input_is_terminal() || machine_allow_interactive_without_tty) {
         alert("XINT: Interactive mode");
-        machine_interactive = true;
+        __atomic_store_n(&machine_interactive, true, __ATOMIC_RELEASE);
     } else {
         alert("XINT: Machine halt when no tty available.");
-        machine_halt = true;
+        __atomic_store_n(&machine_halt, true, __ATOMIC_RELEASE);
     }
     return r4k_excNone;
 }
@@ -0,0 +1,21 @@
+static r4k_exc_t instr__xroie(r4k_cpu_t *cpu, r4k_instr_t instr)
+{
+    if (!machine_specific_instructions) {
+        return instr__reserved(cpu, instr);
+    }
+
+    alert("XROIE: Region of interest ends");
+
+    roi_end();
+    return r4k_excNone;
+}
+
+static void mnemonics__xroie(ptr64_t addr, r4k_instr_t instr,
+        string_t *mnemonics, string_t *comments)
+{
+    if (!machine_specific_instructions) {
+        return mnemonics__reserved(addr, instr, mnemonics, comments);
+    }
+
+    string_printf(mnemonics, "_xroie");
+}
@@ -1,8 +1,8 @@
-static r4k_exc_t instr_bgezal(r4k_cpu_t *cpu, r4k_instr_t instr)
+static inline r4k_exc_t instr_bgezal_in(r4k_cpu_t *cpu, r4k_instr_t instr, bool wide)
 {
     bool cond;
 
-    if (CPU_64BIT_MODE(cpu)) {
+    if (wide) {
         cond = ((cpu->regs[instr.i.rs].val & SBIT64) == 0);
     } else {
         cond = ((cpu->regs[instr.i.rs].lo & SBIT32) == 0);
@@ -19,6 +19,20 @@ static r4k_exc_t instr_bgezal(r4k_cpu_t *cpu, r4k_instr_t instr)
     return r4k_excNone;
 }
 
+MODE_VARIANTS(bgezal)
+
+/** BGEZAL keeping the taken call on the shadow call stack (see callstack.c) */
+static r4k_exc_t instr_bgezal_call(r4k_cpu_t *cpu, r4k_instr_t instr)
+{
+    r4k_exc_t res = instr_bgezal(cpu, instr);
+
+    if (res == r4k_excJump) {
+        callstack_call(cpu->procno, cpu->pc_next.ptr, cpu->pc.ptr + 8);
+    }
+
+    return res;
+}
+
 static void mnemonics_bgezal(ptr64_t addr, r4k_instr_t instr,
         string_t *mnemonics, string_t *comments)
 {
@@ -1,8 +1,8 @@
-static r4k_exc_t instr_bgezl(r4k_cpu_t *cpu, r4k_instr_t instr)
+static inline r4k_exc_t instr_bgezl_in(r4k_cpu_t *cpu, r4k_instr_t instr, bool wide)
 {
     bool cond;
 
-    if (CPU_64BIT_MODE(cpu)) {
+    if (wide) {
         cond = ((cpu->regs[instr.i.rs].val & SBIT64) == 0);
     } else {
         cond = ((cpu->regs[instr.i.rs].lo & SBIT32) == 0);
@@ -18,6 +18,8 @@ static r4k_exc_t instr_bgezl(r4k_cpu_t *cpu, r4k_instr_t instr)
     return r4k_excNone;
 }
 
+MODE_VARIANTS(bgezl)
+
 static void mnemonics_bgezl(ptr64_t addr, r4k_instr_t instr,
         string_t *mnemonics, string_t *comments)
 {
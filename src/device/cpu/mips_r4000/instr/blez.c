@@ -1,8 +1,8 @@
-static r4k_exc_t instr_blez(r4k_cpu_t *cpu, r4k_instr_t instr)
+static inline r4k_exc_t instr_blez_in(r4k_cpu_t *cpu, r4k_instr_t instr, bool wide)
 {
     bool cond;
 
-    if (CPU_64BIT_MODE(cpu)) {
+    if (wide) {
         cond = (((int64_t) cpu->regs[instr.i.rs].val) <= 0);
     } else {
         cond = (((int32_t) cpu->regs[instr.i.rs].lo) <= 0);
@@ -17,6 +17,8 @@ static r4k_exc_t instr_blez(r4k_cpu_t *cpu, r4k_instr_t instr)
     return r4k_excNone;
 }
 
+MODE_VARIANTS(blez)
+
 static void mnemonics_blez(ptr64_t addr, r4k_instr_t instr,
         string_t *mnemonics, string_t *comments)
 {
@@ -1,8 +1,8 @@
-static r4k_exc_t instr_bltzal(r4k_cpu_t *cpu, r4k_instr_t instr)
+static inline r4k_exc_t instr_bltzal_in(r4k_cpu_t *cpu, r4k_instr_t instr, bool wide)
 {
     bool cond;
 
-    if (CPU_64BIT_MODE(cpu)) {
+    if (wide) {
         cond = (((int64_t) cpu->regs[instr.i.rs].val) < 0);
     } else {
         cond = (((int32_t) cpu->regs[instr.i.rs].lo) < 0);
@@ -19,6 +19,20 @@ static r4k_exc_t instr_bltzal(r4k_cpu_t *cpu, r4k_instr_t instr)
     return r4k_excNone;
 }
 
+MODE_VARIANTS(bltzal)
+
+/** BLTZAL keeping the taken call on the shadow call stack (see callstack.c) */
+static r4k_exc_t instr_bltzal_call(r4k_cpu_t *cpu, r4k_instr_t instr)
+{
+    r4k_exc_t res = instr_bltzal(cpu, instr);
+
+    if (res == r4k_excJump) {
+        callstack_call(cpu->procno, cpu->pc_next.ptr, cpu->pc.ptr + 8);
+    }
+
+    return res;
+}
+
 static void mnemonics_bltzal(ptr64_t addr, r4k_instr_t instr,
         string_t *mnemonics, string_t *comments)
 {
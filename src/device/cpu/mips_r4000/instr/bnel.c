@@ -1,8 +1,8 @@
-static r4k_exc_t instr_bnel(r4k_cpu_t *cpu, r4k_instr_t instr)
+static inline r4k_exc_t instr_bnel_in(r4k_cpu_t *cpu, r4k_instr_t instr, bool wide)
 {
     bool cond;
 
-    if (CPU_64BIT_MODE(cpu)) {
+    if (wide) {
         cond = (cpu->regs[instr.i.rs].val != cpu->regs[instr.i.rt].val);
     } else {
         cond = (cpu->regs[instr.i.rs].lo != cpu->regs[instr.i.rt].lo);
@@ -18,6 +18,8 @@ static r4k_exc_t instr_bnel(r4k_cpu_t *cpu, r4k_instr_t instr)
     return r4k_excNone;
 }
 
+MODE_VARIANTS(bnel)
+
 static void mnemonics_bnel(ptr64_t addr, r4k_instr_t instr,
         string_t *mnemonics, string_t *comments)
 {
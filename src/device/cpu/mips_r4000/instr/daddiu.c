@@ -1,17 +1,15 @@
-static r4k_exc_t instr_daddiu(r4k_cpu_t *cpu, r4k_instr_t instr)
+static r4k_exc_t instr_daddiu64(r4k_cpu_t *cpu, r4k_instr_t instr)
 {
-    if (CPU_64BIT_INSTRUCTION(cpu)) {
-        uint64_t rs = cpu->regs[instr.i.rs].val;
-        uint64_t imm = sign_extend_16_64(instr.i.imm);
+    uint64_t rs = cpu->regs[instr.i.rs].val;
+    uint64_t imm = sign_extend_16_64(instr.i.imm);
 
-        cpu->regs[instr.i.rt].val = rs + imm;
-    } else {
-        return r4k_excRI;
-    }
+    cpu->regs[instr.i.rt].val = rs + imm;
 
     return r4k_excNone;
 }
 
+INSTRUCTION_VARIANTS(daddiu)
+
 static void mnemonics_daddiu(ptr64_t addr, r4k_instr_t instr,
         string_t *mnemonics, string_t *comments)
 {
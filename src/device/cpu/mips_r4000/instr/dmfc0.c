@@ -2,6 +2,10 @@ static r4k_exc_t instr_dmfc0(r4k_cpu_t *cpu, r4k_instr_t instr)
 {
     if (CPU_64BIT_INSTRUCTION(cpu)) {
         if (CP0_USABLE(cpu)) {
+            if (instr.r.rd == cp0_Random) {
+                r4k_sync_random(cpu);
+            }
+
             cpu->regs[instr.r.rt].val = cpu->cp0[instr.r.rd].val;
             return r4k_excNone;
         }
@@ -1,17 +1,15 @@
-static r4k_exc_t instr_dsllv(r4k_cpu_t *cpu, r4k_instr_t instr)
+static r4k_exc_t instr_dsllv64(r4k_cpu_t *cpu, r4k_instr_t instr)
 {
-    if (CPU_64BIT_INSTRUCTION(cpu)) {
-        uint64_t rs = cpu->regs[instr.r.rs].val;
-        uint64_t rt = cpu->regs[instr.r.rt].val;
+    uint64_t rs = cpu->regs[instr.r.rs].val;
+    uint64_t rt = cpu->regs[instr.r.rt].val;
 
-        cpu->regs[instr.r.rd].val = rt << (rs & UINT64_C(0x003f));
-    } else {
-        return r4k_excRI;
-    }
+    cpu->regs[instr.r.rd].val = rt << (rs & UINT64_C(0x003f));
 
     return r4k_excNone;
 }
 
+INSTRUCTION_VARIANTS(dsllv)
+
 static void mnemonics_dsllv(ptr64_t addr, r4k_instr_t instr,
         string_t *mnemonics, string_t *comments)
 {
@@ -1,15 +1,13 @@
-static r4k_exc_t instr_dsra(r4k_cpu_t *cpu, r4k_instr_t instr)
+static r4k_exc_t instr_dsra64(r4k_cpu_t *cpu, r4k_instr_t instr)
 {
-    if (CPU_64BIT_INSTRUCTION(cpu)) {
-        uint64_t rt = cpu->regs[instr.r.rt].val;
-        cpu->regs[instr.r.rd].val = (uint64_t) (((int64_t) rt) >> instr.r.sa);
-    } else {
-        return r4k_excRI;
-    }
+    uint64_t rt = cpu->regs[instr.r.rt].val;
+    cpu->regs[instr.r.rd].val = (uint64_t) (((int64_t) rt) >> instr.r.sa);
 
     return r4k_excNone;
 }
 
+INSTRUCTION_VARIANTS(dsra)
+
 static void mnemonics_dsra(ptr64_t addr, r4k_instr_t instr,
         string_t *mnemonics, string_t *comments)
 {
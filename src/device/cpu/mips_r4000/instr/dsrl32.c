@@ -1,15 +1,13 @@
-static r4k_exc_t instr_dsrl32(r4k_cpu_t *cpu, r4k_instr_t instr)
+static r4k_exc_t instr_dsrl3264(r4k_cpu_t *cpu, r4k_instr_t instr)
 {
-    if (CPU_64BIT_INSTRUCTION(cpu)) {
-        uint64_t rt = cpu->regs[instr.r.rt].val;
-        cpu->regs[instr.r.rd].val = rt >> (instr.r.sa + 32);
-    } else {
-        return r4k_excRI;
-    }
+    uint64_t rt = cpu->regs[instr.r.rt].val;
+    cpu->regs[instr.r.rd].val = rt >> (instr.r.sa + 32);
 
     return r4k_excNone;
 }
 
+INSTRUCTION_VARIANTS(dsrl32)
+
 static void mnemonics_dsrl32(ptr64_t addr, r4k_instr_t instr,
         string_t *mnemonics, string_t *comments)
 {
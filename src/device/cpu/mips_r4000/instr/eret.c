@@ -20,6 +20,12 @@ static r4k_exc_t instr_eret(r4k_cpu_t *cpu, r4k_instr_t instr)
             cp0_status(cpu).val &= ~cp0_status_exl_mask;
         }
 
+        r4k_update_interrupt(cpu);
+
+        if (catchpoint_armed(cpu->procno, CATCH_MODE)) {
+            catchpoint_mode(cpu->procno);
+        }
+
         return r4k_excNone;
     }
 
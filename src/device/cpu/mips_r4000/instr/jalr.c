@@ -6,6 +6,14 @@ static r4k_exc_t instr_jalr(r4k_cpu_t *cpu, r4k_instr_t instr)
     return r4k_excJump;
 }
 
+/** JALR keeping the call on the shadow call stack (see callstack.c) */
+static r4k_exc_t instr_jalr_call(r4k_cpu_t *cpu, r4k_instr_t instr)
+{
+    r4k_exc_t res = instr_jalr(cpu, instr);
+    callstack_call(cpu->procno, cpu->pc_next.ptr, cpu->pc.ptr + 8);
+    return res;
+}
+
 static void mnemonics_jalr(ptr64_t addr, r4k_instr_t instr,
         string_t *mnemonics, string_t *comments)
 {
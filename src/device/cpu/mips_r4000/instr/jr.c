@@ -5,6 +5,14 @@ static r4k_exc_t instr_jr(r4k_cpu_t *cpu, r4k_instr_t instr)
     return r4k_excJump;
 }
 
+/** JR ra popping the call from the shadow call stack (see callstack.c) */
+static r4k_exc_t instr_jr_return(r4k_cpu_t *cpu, r4k_instr_t instr)
+{
+    r4k_exc_t res = instr_jr(cpu, instr);
+    callstack_return(cpu->procno, cpu->pc_next.ptr);
+    return res;
+}
+
 static void mnemonics_jr(ptr64_t addr, r4k_instr_t instr,
         string_t *mnemonics, string_t *comments)
 {
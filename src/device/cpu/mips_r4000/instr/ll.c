@@ -18,7 +18,7 @@ static r4k_exc_t instr_ll(r4k_cpu_t *cpu, r4k_instr_t instr)
         r4k_convert_addr(cpu, addr, &phys, false, false);
 
         /* Register address for tracking. */
-        sc_register(cpu->procno);
+        sc_register(cpu->procno, phys);
         cpu->llbit = true;
         cpu->lladdr = phys;
     } else {
@@ -1,6 +1,10 @@
 static r4k_exc_t instr_mfc0(r4k_cpu_t *cpu, r4k_instr_t instr)
 {
     if (CP0_USABLE(cpu)) {
+        if (instr.r.rd == cp0_Random) {
+            r4k_sync_random(cpu);
+        }
+
         cpu->regs[instr.r.rt].val = sign_extend_32_64(cpu->cp0[instr.r.rd].lo);
         return r4k_excNone;
     }
@@ -6,7 +6,7 @@ static r4k_exc_t instr_mtc0(r4k_cpu_t *cpu, r4k_instr_t instr)
         switch (instr.r.rd) {
         /* 0 */
         case cp0_Index:
-            cp0_index(cpu).val = reg.val & UINT32_C(0x003f);
+            cp0_index(cpu).val = reg.val & cpu->tlb_index_mask;
             break;
         case cp0_Random:
             /* Ignored, read-only */
@@ -35,9 +35,8 @@ static r4k_exc_t instr_mtc0(r4k_cpu_t *cpu, r4k_instr_t instr)
             }
             break;
         case cp0_Wired:
-            cp0_random(cpu).val = 47;
-            cp0_wired(cpu).val = reg.val & UINT32_C(0x003f);
-            if (cp0_wired(cpu).val > 47) {
+            r4k_set_wired(cpu, reg.val & cpu->tlb_index_mask);
+            if (cp0_wired(cpu).val >= cpu->tlb_entries) {
                 alert("R4000: Invalid value for Wired (MTC0)");
             }
             break;
@@ -50,21 +49,30 @@ static r4k_exc_t instr_mtc0(r4k_cpu_t *cpu, r4k_instr_t instr)
             /* Ignored, read-only */
             break;
         case cp0_Count:
-            cp0_count(cpu).val = reg.lo;
+            r4k_set_count(cpu, reg.lo);
             break;
         case cp0_EntryHi:
+            /* The address space is switched by a new ASID */
+            if ((trace_events) && (((reg.val ^ cp0_entryhi(cpu).val) & cp0_entryhi_asid_mask) != 0)) {
+                trace_event(cpu->procno, TRACE_ARCH_R4K, TRACE_EVENT_SPACE,
+                        0, reg.val & UINT32_C(0xfffff0ff));
+            }
+
             cp0_entryhi(cpu).val = reg.val & UINT32_C(0xfffff0ff);
             break;
         case cp0_Compare:
             cp0_compare(cpu).val = reg.lo;
             cp0_cause(cpu).val &= ~(1 << cp0_cause_ip7_shift);
+            r4k_update_interrupt(cpu);
             break;
         case cp0_Status:
             cp0_status(cpu).val = reg.val & UINT32_C(0xff77ff1f);
+            r4k_update_interrupt(cpu);
             break;
         case cp0_Cause:
             cp0_cause(cpu).val &= ~(cp0_cause_ip0_mask | cp0_cause_ip1_mask);
             cp0_cause(cpu).val |= reg.val & (cp0_cause_ip0_mask | cp0_cause_ip1_mask);
+            r4k_update_interrupt(cpu);
             break;
         case cp0_EPC:
             cp0_epc(cpu).val = reg.val;
@@ -137,6 +145,14 @@ static r4k_exc_t instr_mtc0(r4k_cpu_t *cpu, r4k_instr_t instr)
             alert("R4000: Undefined CP0 register to set");
         }
 
+        if (catchpoint_armed(cpu->procno, CATCH_WRITE)) {
+            catchpoint_write(cpu->procno, instr.r.rd, cpu->cp0[instr.r.rd].val);
+        }
+
+        if ((instr.r.rd == cp0_Status) && (catchpoint_armed(cpu->procno, CATCH_MODE))) {
+            catchpoint_mode(cpu->procno);
+        }
+
         return r4k_excNone;
     }
 
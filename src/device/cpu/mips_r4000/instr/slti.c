@@ -1,6 +1,6 @@
-static r4k_exc_t instr_slti(r4k_cpu_t *cpu, r4k_instr_t instr)
+static inline r4k_exc_t instr_slti_in(r4k_cpu_t *cpu, r4k_instr_t instr, bool wide)
 {
-    if (CPU_64BIT_MODE(cpu)) {
+    if (wide) {
         uint64_t rs = cpu->regs[instr.i.rs].val;
         uint64_t imm = sign_extend_16_64(instr.i.imm);
 
@@ -15,6 +15,8 @@ static r4k_exc_t instr_slti(r4k_cpu_t *cpu, r4k_instr_t instr)
     return r4k_excNone;
 }
 
+MODE_VARIANTS(slti)
+
 static void mnemonics_slti(ptr64_t addr, r4k_instr_t instr,
         string_t *mnemonics, string_t *comments)
 {
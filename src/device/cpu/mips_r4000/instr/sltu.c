@@ -1,6 +1,6 @@
-static r4k_exc_t instr_sltu(r4k_cpu_t *cpu, r4k_instr_t instr)
+static inline r4k_exc_t instr_sltu_in(r4k_cpu_t *cpu, r4k_instr_t instr, bool wide)
 {
-    if (CPU_64BIT_MODE(cpu)) {
+    if (wide) {
         uint64_t rs = cpu->regs[instr.r.rs].val;
         uint64_t rt = cpu->regs[instr.r.rt].val;
 
@@ -15,6 +15,8 @@ static r4k_exc_t instr_sltu(r4k_cpu_t *cpu, r4k_instr_t instr)
     return r4k_excNone;
 }
 
+MODE_VARIANTS(sltu)
+
 static void mnemonics_sltu(ptr64_t addr, r4k_instr_t instr,
         string_t *mnemonics, string_t *comments)
 {
@@ -1,5 +1,35 @@
+/** System call of a user program served by the simulator
+ *
+ * The arguments are in a0 to a3 and on the stack, the number in v0.
+ * A failure is told by a3 with the positive error number in v0.
+ *
+ */
+static r4k_exc_t usermode_syscall_o32(r4k_cpu_t *cpu)
+{
+    uint64_t args[USERMODE_ARGS];
+    uint32_t sp = cpu->regs[29].val;
+
+    for (unsigned int i = 0; i < USERMODE_ARGS; i++) {
+        args[i] = (i < 4) ? (uint32_t) cpu->regs[4 + i].val
+                          : physmem_read32(cpu->procno, sp + 4 * i, true);
+    }
+
+    int64_t result = usermode_syscall(USERMODE_ABI_O32,
+            (uint32_t) cpu->regs[2].val, args);
+    bool failed = (result < 0) && (result >= -USERMODE_MAX_ERRNO);
+
+    cpu->regs[2].val = (int64_t) (int32_t) (failed ? -result : result);
+    cpu->regs[7].val = failed ? 1 : 0;
+
+    return r4k_excNone;
+}
+
 static r4k_exc_t instr_syscall(r4k_cpu_t *cpu, r4k_instr_t instr)
 {
+    if (usermode_enabled) {
+        return usermode_syscall_o32(cpu);
+    }
+
     return r4k_excSys;
 }
 
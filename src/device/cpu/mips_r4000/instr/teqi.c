@@ -1,8 +1,8 @@
-static r4k_exc_t instr_teqi(r4k_cpu_t *cpu, r4k_instr_t instr)
+static inline r4k_exc_t instr_teqi_in(r4k_cpu_t *cpu, r4k_instr_t instr, bool wide)
 {
     bool cond;
 
-    if (CPU_64BIT_MODE(cpu)) {
+    if (wide) {
         cond = (cpu->regs[instr.i.rs].val == sign_extend_16_64(instr.i.imm));
     } else {
         cond = (cpu->regs[instr.i.rs].lo == sign_extend_16_32(instr.i.imm));
@@ -15,6 +15,8 @@ static r4k_exc_t instr_teqi(r4k_cpu_t *cpu, r4k_instr_t instr)
     return r4k_excNone;
 }
 
+MODE_VARIANTS(teqi)
+
 static void mnemonics_teqi(ptr64_t addr, r4k_instr_t instr,
         string_t *mnemonics, string_t *comments)
 {
@@ -1,8 +1,8 @@
-static r4k_exc_t instr_tlt(r4k_cpu_t *cpu, r4k_instr_t instr)
+static inline r4k_exc_t instr_tlt_in(r4k_cpu_t *cpu, r4k_instr_t instr, bool wide)
 {
     bool cond;
 
-    if (CPU_64BIT_MODE(cpu)) {
+    if (wide) {
         cond = (((int64_t) cpu->regs[instr.r.rs].val) < ((int64_t) cpu->regs[instr.r.rt].val));
     } else {
         cond = (((int32_t) cpu->regs[instr.r.rs].lo) < ((int32_t) cpu->regs[instr.r.rt].lo));
@@ -15,6 +15,8 @@ static r4k_exc_t instr_tlt(r4k_cpu_t *cpu, r4k_instr_t instr)
     return r4k_excNone;
 }
 
+MODE_VARIANTS(tlt)
+
 static void mnemonics_tlt(ptr64_t addr, r4k_instr_t instr,
         string_t *mnemonics, string_t *comments)
 {
@@ -1,8 +1,8 @@
-static r4k_exc_t instr_tlti(r4k_cpu_t *cpu, r4k_instr_t instr)
+static inline r4k_exc_t instr_tlti_in(r4k_cpu_t *cpu, r4k_instr_t instr, bool wide)
 {
     bool cond;
 
-    if (CPU_64BIT_MODE(cpu)) {
+    if (wide) {
         cond = (((int64_t) cpu->regs[instr.r.rs].val) < ((int64_t) sign_extend_16_64(instr.i.imm)));
     } else {
         cond = (((int32_t) cpu->regs[instr.r.rs].lo) < ((int32_t) sign_extend_16_32(instr.i.imm)));
@@ -15,6 +15,8 @@ static r4k_exc_t instr_tlti(r4k_cpu_t *cpu, r4k_instr_t instr)
     return r4k_excNone;
 }
 
+MODE_VARIANTS(tlti)
+
 static void mnemonics_tlti(ptr64_t addr, r4k_instr_t instr,
         string_t *mnemonics, string_t *comments)
 {
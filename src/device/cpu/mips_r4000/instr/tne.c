@@ -1,8 +1,8 @@
-static r4k_exc_t instr_tne(r4k_cpu_t *cpu, r4k_instr_t instr)
+static inline r4k_exc_t instr_tne_in(r4k_cpu_t *cpu, r4k_instr_t instr, bool wide)
 {
     bool cond;
 
-    if (CPU_64BIT_MODE(cpu)) {
+    if (wide) {
         cond = (cpu->regs[instr.r.rs].val != cpu->regs[instr.r.rt].val);
     } else {
         cond = (cpu->regs[instr.r.rs].lo != cpu->regs[instr.r.rt].lo);
@@ -15,6 +15,8 @@ static r4k_exc_t instr_tne(r4k_cpu_t *cpu, r4k_instr_t instr)
     return r4k_excNone;
 }
 
+MODE_VARIANTS(tne)
+
 static void mnemonics_tne(ptr64_t addr, r4k_instr_t instr,
         string_t *mnemonics, string_t *comments)
 {
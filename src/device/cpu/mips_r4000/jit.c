@@ -0,0 +1,360 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Translation of R4000 blocks into x86-64 code
+ *
+ *  Included by the CPU implementation after the decoded pages and
+ *  the management of the blocks are defined.
+ *
+ *  A block is the straight-line run executed by execute_block(),
+ *  it contains no branches, so no delay slot is ever translated.
+ *  The simple integer instructions are translated into host
+ *  instructions working on the registers in r4k_cpu_t, every other
+ *  instruction is a call of its implementation. The block stops
+ *  as execute_block() does: on an exception, a pending interrupt,
+ *  a write to the frame of the block or when the simulation is to
+ *  stop. Outside of the fast mode each instruction is finished by
+ *  a call of block_finish_instr(), so Count, Random and the timer
+ *  interrupt follow every cycle.
+ *
+ */
+
+#include "../jit.h"
+
+/** Heat of a block which has been translated */
+#define R4K_JIT_TRANSLATED UINT16_MAX
+
+/** Shape of a translated block (see jit_lookup())
+ *
+ * The translations of the operation modes call different variants,
+ * so the mode is a part of the shape.
+ *
+ */
+#define R4K_JIT_SHAPE(length, mode, fast) \
+    (((length) * R4K_MODE_COUNT + (mode)) << 1 | (fast))
+
+#ifdef __x86_64__
+
+/** Maximal number of the instructions of a block */
+#define R4K_JIT_TRANSLATION_MAX (FRAME_SIZE / sizeof(r4k_instr_t))
+
+/** Number of the exits after a called instruction */
+#define R4K_JIT_CALL_EXITS 4
+
+/** Maximal size of the code of an instruction and of the block frame */
+#define R4K_JIT_INSTR_SIZE 192
+#define R4K_JIT_FRAME_SIZE 64
+
+#define R4K_JIT_REG(reg) (offsetof(r4k_cpu_t, regs) + (reg) * sizeof(reg64_t))
+#define R4K_JIT_PC offsetof(r4k_cpu_t, pc)
+#define R4K_JIT_PC_NEXT offsetof(r4k_cpu_t, pc_next)
+#define R4K_JIT_EXCADDR offsetof(r4k_cpu_t, excaddr)
+#define R4K_JIT_INTR offsetof(r4k_cpu_t, intr_deliverable)
+
+/** Exits of the block before an instruction is finished */
+typedef struct {
+    /** Jumps leaving the result of the instruction in eax */
+    uint8_t *result[R4K_JIT_CALL_EXITS];
+    unsigned int results;
+
+    /** Jump taken when an interrupt is pending */
+    uint8_t *interrupt;
+
+    /** Instructions finished before but not yet accounted to PC */
+    unsigned int pending;
+} r4k_jit_exit_t;
+
+/** Emit the update of PC by the instructions finished since the last update
+ *
+ * The exception address is the address of the last finished
+ * instruction, as if each instruction was finished on its own.
+ * Only rcx is used, the result of the last call stays in eax.
+ *
+ */
+static void r4k_jit_advance(jit_buffer_t *buf, unsigned int pending)
+{
+    if (pending == 0) {
+        return;
+    }
+
+    uint32_t step = pending * sizeof(r4k_instr_t);
+
+    /* mov rcx, [pc]; add rcx, imm32; mov [excaddr], rcx */
+    jit_emit_cpu(buf, true, 0x8b, 1, R4K_JIT_PC);
+    jit_emit8(buf, 0x48);
+    jit_emit8(buf, 0x81);
+    jit_emit8(buf, 0xc1);
+    jit_emit32(buf, step - sizeof(r4k_instr_t));
+    jit_emit_cpu(buf, true, 0x89, 1, R4K_JIT_EXCADDR);
+
+    /* add rcx, 4; mov [pc], rcx; add [pc_next], imm32 */
+    jit_emit8(buf, 0x48);
+    jit_emit8(buf, 0x83);
+    jit_emit8(buf, 0xc1);
+    jit_emit8(buf, sizeof(r4k_instr_t));
+    jit_emit_cpu(buf, true, 0x89, 1, R4K_JIT_PC);
+    jit_emit_cpu(buf, true, 0x81, 0, R4K_JIT_PC_NEXT);
+    jit_emit32(buf, step);
+}
+
+/** Emit the store of rax (or its sign-extended low half) into a register */
+static void r4k_jit_store(jit_buffer_t *buf, unsigned int reg, bool extend)
+{
+    if (extend) {
+        /* movsxd rax, eax */
+        jit_emit8(buf, 0x48);
+        jit_emit8(buf, 0x63);
+        jit_emit8(buf, 0xc0);
+    }
+
+    jit_emit_cpu(buf, true, 0x89, 0, R4K_JIT_REG(reg));
+}
+
+/** Emit an operation of rax with an immediate (op rax, imm32) */
+static void r4k_jit_imm(jit_buffer_t *buf, bool wide, uint8_t opcode, uint32_t imm)
+{
+    if (wide) {
+        jit_emit8(buf, 0x48);
+    }
+
+    jit_emit8(buf, opcode);
+    jit_emit32(buf, imm);
+}
+
+/** Emit the host instructions of a simple integer instruction
+ *
+ * The instructions are recognized by their implementations,
+ * so that they are translated exactly as they are decoded.
+ *
+ * @return False if the instruction has to be called.
+ *
+ */
+static bool r4k_jit_inline(jit_buffer_t *buf, r4k_instr_fnc_t fnc,
+        r4k_instr_t instr)
+{
+    unsigned int rs = instr.r.rs;
+    unsigned int rt = instr.r.rt;
+    unsigned int rd = instr.r.rd;
+    uint8_t opcode;
+
+    if (fnc == instr_lui) {
+        if (rt != 0) {
+            /* mov qword [rt], imm32 (sign-extended) */
+            jit_emit_cpu(buf, true, 0xc7, 0, R4K_JIT_REG(rt));
+            jit_emit32(buf, (uint32_t) instr.i.imm << 16);
+        }
+
+        return true;
+    }
+
+    if ((fnc == instr_addiu) || (fnc == instr_andi) || (fnc == instr_ori)
+            || (fnc == instr_xori)) {
+        if (rt == 0) {
+            return true;
+        }
+
+        if (fnc == instr_addiu) {
+            /* The sum of the low halves is sign-extended */
+            jit_emit_cpu(buf, false, 0x8b, 0, R4K_JIT_REG(rs));
+            r4k_jit_imm(buf, false, 0x05, sign_extend_16_32(instr.i.imm));
+            r4k_jit_store(buf, rt, true);
+            return true;
+        }
+
+        /* The immediate is zero-extended */
+        opcode = (fnc == instr_andi) ? 0x25 : ((fnc == instr_ori) ? 0x0d : 0x35);
+        jit_emit_cpu(buf, true, 0x8b, 0, R4K_JIT_REG(rs));
+        r4k_jit_imm(buf, true, opcode, instr.i.imm);
+        r4k_jit_store(buf, rt, false);
+        return true;
+    }
+
+    if ((fnc == instr_addu) || (fnc == instr_subu)) {
+        if (rd != 0) {
+            opcode = (fnc == instr_addu) ? 0x03 : 0x2b;
+            jit_emit_cpu(buf, false, 0x8b, 0, R4K_JIT_REG(rs));
+            jit_emit_cpu(buf, false, opcode, 0, R4K_JIT_REG(rt));
+            r4k_jit_store(buf, rd, true);
+        }
+
+        return true;
+    }
+
+    if ((fnc == instr_and) || (fnc == instr_or) || (fnc == instr_xor)
+            || (fnc == instr_nor)) {
+        if (rd != 0) {
+            opcode = (fnc == instr_and) ? 0x23 : ((fnc == instr_xor) ? 0x33 : 0x0b);
+            jit_emit_cpu(buf, true, 0x8b, 0, R4K_JIT_REG(rs));
+            jit_emit_cpu(buf, true, opcode, 0, R4K_JIT_REG(rt));
+
+            if (fnc == instr_nor) {
+                /* not rax */
+                jit_emit8(buf, 0x48);
+                jit_emit8(buf, 0xf7);
+                jit_emit8(buf, 0xd0);
+            }
+
+            r4k_jit_store(buf, rd, false);
+        }
+
+        return true;
+    }
+
+    if (fnc == instr_sll) {
+        if (rd != 0) {
+            /* mov eax, [rt]; shl eax, sa */
+            jit_emit_cpu(buf, false, 0x8b, 0, R4K_JIT_REG(rt));
+            jit_emit8(buf, 0xc1);
+            jit_emit8(buf, 0xe0);
+            jit_emit8(buf, instr.r.sa);
+            r4k_jit_store(buf, rd, true);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+/** Emit the call of the implementation of an instruction
+ *
+ * The exits leave the block as the interpreted block is left.
+ *
+ */
+static void r4k_jit_call(jit_buffer_t *buf, r4k_instr_fnc_t fnc,
+        r4k_instr_t instr, r4k_jit_exit_t *exit)
+{
+    jit_emit_call(buf, (jit_func_t) fnc, instr.val);
+
+    exit->result[0] = jit_emit_exit_unless_result(buf, r4k_excNone);
+    exit->result[1] = jit_emit_exit_if_written(buf);
+    exit->result[2] = jit_emit_exit_if_set(buf, &machine_halt);
+    exit->result[3] = jit_emit_exit_if_set(buf, &machine_interactive);
+    exit->results = R4K_JIT_CALL_EXITS;
+
+    /* The implementation may write r0 */
+    jit_emit_cpu(buf, true, 0xc7, 0, R4K_JIT_REG(0));
+    jit_emit32(buf, 0);
+}
+
+/** Translate a block of decoded instructions
+ *
+ * @param cache_instr First instruction of the block.
+ * @param mode        Operation mode of the processor.
+ * @param length      Number of the instructions of the block.
+ * @param fast        Whether the block is translated for the fast mode.
+ *
+ * @return The translated code or NULL if the block cannot be translated.
+ *
+ */
+static jit_code_t r4k_jit_translate(cache_instr_t *cache_instr,
+        r4k_mode_t mode, unsigned int length, bool fast)
+{
+    jit_buffer_t buf;
+
+    if (!jit_begin(&buf, R4K_JIT_FRAME_SIZE + length * R4K_JIT_INSTR_SIZE)) {
+        return NULL;
+    }
+
+    jit_emit_prologue(&buf);
+
+    r4k_jit_exit_t exits[R4K_JIT_TRANSLATION_MAX];
+    unsigned int pending = 0;
+
+    for (unsigned int i = 0; i < length; i++) {
+        r4k_instr_t instr = cache_instr[i].instr;
+        r4k_instr_fnc_t fnc = lazy_decode(&cache_instr[i], mode);
+        r4k_jit_exit_t *exit = &exits[i];
+
+        exit->results = 0;
+
+        if (!r4k_jit_inline(&buf, fnc, instr)) {
+            r4k_jit_advance(&buf, pending);
+            pending = 0;
+            r4k_jit_call(&buf, fnc, instr, exit);
+        }
+
+        exit->pending = pending;
+        exit->interrupt = jit_emit_exit_if_cpu_set(&buf, R4K_JIT_INTR);
+
+        if (fast) {
+            pending++;
+        } else {
+            jit_emit_call(&buf, (jit_func_t) block_finish_instr, 0);
+        }
+    }
+
+    r4k_jit_advance(&buf, pending);
+    jit_emit_done(&buf, length);
+    jit_emit_result(&buf, r4k_excNone);
+
+    uint8_t *epilogue = buf.pos;
+    jit_emit_epilogue(&buf);
+
+    /* The instruction is left to be finished by the step */
+    for (unsigned int i = 0; i < length; i++) {
+        r4k_jit_exit_t *exit = &exits[i];
+
+        jit_patch32(exit->interrupt, buf.pos);
+        jit_emit_result(&buf, r4k_excNone);
+
+        for (unsigned int e = 0; e < exit->results; e++) {
+            jit_patch32(exit->result[e], buf.pos);
+        }
+
+        r4k_jit_advance(&buf, exit->pending);
+        jit_emit_done(&buf, i);
+        jit_patch32(jit_emit_jump(&buf), epilogue);
+    }
+
+    return jit_commit(&buf, cache_instr, R4K_JIT_SHAPE(length, mode, fast));
+}
+
+#else /* __x86_64__ */
+
+static jit_code_t r4k_jit_translate(cache_instr_t *cache_instr,
+        r4k_mode_t mode, unsigned int length, bool fast)
+{
+    return NULL;
+}
+
+#endif /* __x86_64__ */
+
+/** Get the translated code of a hot block
+ *
+ * The executions of the block are counted in the heat of the
+ * decoded instruction starting the block until the translation
+ * threshold is reached. Rewriting the instructions of the block
+ * resets the count. A hot block is translated for each operation
+ * mode it is executed in, the modes share the heat.
+ *
+ * @param heat Heat of the first instruction of the block.
+ * @param mode Operation mode of the processor.
+ * @param fast Whether the block is executed in the fast mode.
+ *
+ * @return The translated code or NULL if the block is to be
+ *         interpreted.
+ *
+ */
+static jit_code_t r4k_jit_code(cache_instr_t *cache_instr, uint16_t *heat,
+        r4k_mode_t mode, unsigned int length, bool fast, unsigned int threshold)
+{
+    if (*heat == R4K_JIT_TRANSLATED) {
+        jit_code_t code = jit_lookup(cache_instr, R4K_JIT_SHAPE(length, mode, fast));
+
+        if (code != NULL) {
+            return code;
+        }
+    } else if (++*heat < threshold) {
+        return NULL;
+    }
+
+    jit_code_t code = r4k_jit_translate(cache_instr, mode, length, fast);
+    *heat = (code != NULL) ? R4K_JIT_TRANSLATED : 0;
+
+    return code;
+}
@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Pipeline timing model of the R4000
+ *
+ *  Included by the CPU implementation before the execution of an
+ *  instruction (execute()) is defined.
+ *
+ *  Without the model every instruction takes one cycle. With the
+ *  model enabled (see r4k_set_timing()) each executed instruction
+ *  is issued in the cycle its operands are ready in, the results
+ *  are ready after the latency of the instruction. The cycles the
+ *  instruction waits for its operands and the penalty of a taken
+ *  branch are spent as stall cycles after the instruction, in which
+ *  only Count and the cycle counters advance. The latencies follow
+ *  the R4000 pipeline with full bypassing:
+ *
+ *   - a loaded register is available two cycles after the next
+ *     instruction (the load delay),
+ *   - HI and LO are written by the multiply/divide unit 10 (MULT),
+ *     20 (DMULT), 69 (DIV) or 133 (DDIV) cycles after the issue,
+ *     the unit is not pipelined,
+ *   - a taken branch or jump stalls the fetch for two cycles
+ *     after its delay slot.
+ *
+ *  The caches, the TLB and the exceptions take no extra cycles.
+ *
+ */
+
+/** Scoreboard bit of a general register */
+#define TIMING_REG(reg) (UINT64_C(1) << (reg))
+
+/** Scoreboard bits of HI and LO */
+#define TIMING_HI (UINT64_C(1) << R4K_TIMING_HI)
+#define TIMING_LO (UINT64_C(1) << R4K_TIMING_LO)
+
+/** Cycles after the issue a loaded register is available in */
+#define TIMING_LOAD_LATENCY 3
+
+/** Stall cycles of a taken branch or jump */
+#define TIMING_BRANCH_PENALTY 2
+
+/** Get the scoreboard entries read by an instruction
+ *
+ * The multiply/divide instructions wait for the unit to finish
+ * the previous operation, i.e. they read HI and LO.
+ *
+ * @return Bitmap of the general registers, HI and LO.
+ *
+ */
+static uint64_t timing_sources(r4k_instr_t instr)
+{
+    switch (instr.r.opcode) {
+    case r4k_opcSPECIAL:
+        switch (instr.r.func) {
+        case funcSLL:
+        case funcSRL:
+        case funcSRA:
+        case funcDSLL:
+        case funcDSRL:
+        case funcDSRA:
+        case funcSLL32:
+        case funcDSRL32:
+        case funcDSRA32:
+            return TIMING_REG(instr.r.rt);
+        case funcJR:
+        case funcJALR:
+        case funcMTHI:
+        case funcMTLO:
+            return TIMING_REG(instr.r.rs);
+        case funcMFHI:
+            return TIMING_HI;
+        case funcMFLO:
+            return TIMING_LO;
+        case funcMULT:
+        case funcMULTU:
+        case funcDIV:
+        case funcDIVU:
+        case funcDMULT:
+        case funcDMULTU:
+        case funcDDIV:
+        case funcDDIVU:
+            return TIMING_REG(instr.r.rs) | TIMING_REG(instr.r.rt)
+                    | TIMING_HI | TIMING_LO;
+        case funcSYSCALL:
+        case funcBREAK:
+        case funcSYNC:
+        case func_XINT:
+            return 0;
+        default:
+            return TIMING_REG(instr.r.rs) | TIMING_REG(instr.r.rt);
+        }
+    case r4k_opcREGIMM:
+    case r4k_opcBLEZ:
+    case r4k_opcBGTZ:
+    case r4k_opcBLEZL:
+    case r4k_opcBGTZL:
+    case r4k_opcADDI:
+    case r4k_opcADDIU:
+    case r4k_opcSLTI:
+    case r4k_opcSLTIU:
+    case r4k_opcANDI:
+    case r4k_opcORI:
+    case r4k_opcXORi:
+    case r4k_opcDADDI:
+    case r4k_opcDADDIU:
+    case r4k_opcLB:
+    case r4k_opcLH:
+    case r4k_opcLW:
+    case r4k_opcLBU:
+    case r4k_opcLHU:
+    case r4k_opcLWU:
+    case r4k_opcLD:
+    case r4k_opcLL:
+    case r4k_opcCACHE:
+    case r4k_opcLWC1:
+    case r4k_opcLDC1:
+    case r4k_opcSWC1:
+    case r4k_opcSDC1:
+        return TIMING_REG(instr.i.rs);
+    case r4k_opcBEQ:
+    case r4k_opcBNE:
+    case r4k_opcBEQL:
+    case r4k_opcBNEL:
+    case r4k_opcLDL:
+    case r4k_opcLDR:
+    case r4k_opcLWL:
+    case r4k_opcLWR:
+    case r4k_opcSB:
+    case r4k_opcSH:
+    case r4k_opcSWL:
+    case r4k_opcSW:
+    case r4k_opcSDL:
+    case r4k_opcSDR:
+    case r4k_opcSWR:
+    case r4k_opcSD:
+    case r4k_opcSC:
+    case r4k_opcSCD:
+        return TIMING_REG(instr.i.rs) | TIMING_REG(instr.i.rt);
+    case r4k_opcCOP0:
+        switch (instr.cop.rs) {
+        case cop0rsMTC0:
+        case cop0rsDMTC0:
+            return TIMING_REG(instr.cop.rt);
+        default:
+            return 0;
+        }
+    default:
+        return 0;
+    }
+}
+
+/** Get the latency of the general register written by an instruction
+ *
+ * The results of the other instructions are bypassed to the next
+ * instruction.
+ *
+ */
+static unsigned int timing_latency(r4k_instr_t instr)
+{
+    switch (instr.r.opcode) {
+    case r4k_opcLDL:
+    case r4k_opcLDR:
+    case r4k_opcLB:
+    case r4k_opcLH:
+    case r4k_opcLWL:
+    case r4k_opcLW:
+    case r4k_opcLBU:
+    case r4k_opcLHU:
+    case r4k_opcLWR:
+    case r4k_opcLWU:
+    case r4k_opcLD:
+    case r4k_opcLL:
+        return TIMING_LOAD_LATENCY;
+    default:
+        return 1;
+    }
+}
+
+/** Get the latency of HI and LO written by an instruction
+ *
+ * @return 0 if the instruction does not use the multiply/divide unit.
+ *
+ */
+static unsigned int timing_mdu_latency(r4k_instr_t instr)
+{
+    if (instr.r.opcode != r4k_opcSPECIAL) {
+        return 0;
+    }
+
+    switch (instr.r.func) {
+    case funcMULT:
+    case funcMULTU:
+        return 10;
+    case funcDMULT:
+    case funcDMULTU:
+        return 20;
+    case funcDIV:
+    case funcDIVU:
+        return 69;
+    case funcDDIV:
+    case funcDDIVU:
+        return 133;
+    default:
+        return 0;
+    }
+}
+
+/** Charge the cycles of an executed instruction
+ *
+ * The instruction is issued when its operands are ready, the wait
+ * and the branch penalty are spent by the following steps (see
+ * timing_stall_cycle()).
+ *
+ * @param exc Result of the execution (the exceptions take no stalls).
+ *
+ */
+static void timing_issue(r4k_cpu_t *cpu, r4k_instr_t instr, r4k_exc_t exc)
+{
+    if ((exc != r4k_excNone) && (exc != r4k_excJump)) {
+        return;
+    }
+
+    r4k_timing_t *timing = &cpu->timing;
+    uint64_t cycle = cpu->k_cycles + cpu->u_cycles + cpu->w_cycles;
+    uint64_t issue = cycle;
+    bool mdu = false;
+
+    /* Register 0 is always ready */
+    for (uint64_t sources = timing_sources(instr) & ~UINT64_C(1);
+            sources != 0; sources &= sources - 1) {
+        unsigned int i = __builtin_ctzll(sources);
+
+        if (timing->ready[i] > issue) {
+            issue = timing->ready[i];
+            mdu = (i >= R4K_TIMING_HI);
+        }
+    }
+
+    unsigned int wait = issue - cycle;
+
+    if (mdu) {
+        timing->mdu_stalls += wait;
+    } else {
+        timing->load_stalls += wait;
+    }
+
+    /* The instructions not classified write no delayed results */
+    uint32_t written = written_regs(instr);
+    unsigned int latency = timing_latency(instr);
+
+    if ((written != WRITTEN_ANY) && (latency > 1)) {
+        for (; written != 0; written &= written - 1) {
+            timing->ready[__builtin_ctz(written)] = issue + latency;
+        }
+    }
+
+    unsigned int mdu_latency = timing_mdu_latency(instr);
+
+    if (mdu_latency > 0) {
+        timing->ready[R4K_TIMING_HI] = issue + mdu_latency;
+        timing->ready[R4K_TIMING_LO] = issue + mdu_latency;
+    }
+
+    timing->stall = wait;
+
+    if (exc == r4k_excJump) {
+        timing->stall += TIMING_BRANCH_PENALTY;
+        timing->branch_stalls += TIMING_BRANCH_PENALTY;
+    }
+}
+
+/** Spend a stall cycle of the last instruction
+ *
+ * Nothing is executed and no interrupt is taken, only Count and
+ * the cycle counters advance.
+ *
+ */
+static void timing_stall_cycle(r4k_cpu_t *cpu)
+{
+    cpu->timing.stall--;
+    manage_count(cpu);
+    account(cpu);
+}
+
+/** Enable or disable the pipeline timing model
+ *
+ * Blocks are not executed while the model is enabled, so that
+ * each instruction is charged.
+ *
+ */
+void r4k_set_timing(r4k_cpu_t *cpu, bool enabled)
+{
+    ASSERT(cpu != NULL);
+
+    cpu->timing.enabled = enabled;
+    cpu->timing.stall = 0;
+    memset(cpu->timing.ready, 0, sizeof(cpu->timing.ready));
+}
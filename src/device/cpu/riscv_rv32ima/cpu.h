@@ -17,25 +17,48 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "../../../debug/mixstat.h"
 #include "../../../main.h"
+#include "../../../utils.h"
+#include "../decode_cache.h"
 #include "../riscv_rv_ima/csr.h"
 #include "../riscv_rv_ima/types.h"
 #include "tlb.h"
 
 #define RV_REG_COUNT 32
 
-#define RV_INSTR_CACHE_SIZE 1024
-
+struct checkpoint;
 struct rv_tlb;
 
-/** Main processor structure */
+/** Last translation of one kind of access */
+typedef struct {
+    bool valid;
+    uint32_t vpage; /** Virtual page number */
+    ptr36_t ppage; /** Physical address of the page */
+    struct frame *frame; /** Frame holding the page (NULL outside of memory) */
+    unsigned int layout; /** Value of physmem_layout when the frame was looked up */
+} rv32_utlb_entry_t;
+
+/** Slot of the fetch translation cache (see rv_translate()) */
+typedef struct {
+    uint32_t context; /** satp MODE and ASID with the privilege mode (0 if invalid) */
+    uint32_t vpage; /** Virtual page number */
+    ptr36_t ppage; /** Physical address of the page */
+    struct frame *frame; /** Frame holding the page (NULL outside of memory) */
+    unsigned int layout; /** Value of physmem_layout when the frame was looked up */
+} rv32_fetch_cache_entry_t;
+
+/**
+ * @brief Main processor structure
+ *
+ * The state used by every step of the interpreter comes first, so that
+ * it shares a few cache lines. The TLB, the page walk cache and the
+ * statistics start on their own cache line.
+ */
 typedef struct rv32_cpu {
     /** Non privileged registers */
     uint32_t regs[RV_REG_COUNT];
 
-    /** Control and status registers */
-    rv_csr_t csr;
-
     /** Program counter */
     uint32_t pc;
 
@@ -47,28 +70,97 @@ typedef struct rv32_cpu {
     /** Current privilege mode */
     rv_priv_mode_t priv_mode;
 
+    /** Tells if the processor is executing or waiting */
+    bool stdby;
+
     // LR and SC
     bool reserved_valid; /** Is the current LR reservation valid */
+    bool reserved_by_value; /** Is the reservation checked by value instead of tracked */
     ptr36_t reserved_addr; /** physical address of the last LR */
+    uint64_t reserved_value; /** value loaded by the last LR */
+    bool spinning; /** Is the hart spinning on the reservation (see rv_spin_detect) */
+    uint32_t spin_pc; /** Address of the LR the hart spins on */
 
-    /** Tells if the processor is executing or waiting */
-    bool stdby;
+    /** Maximal number of instructions executed as a block (0 disables blocks) */
+    unsigned int block_limit;
+
+    /** Executions of a block before it is translated (0 disables translation) */
+    unsigned int jit_threshold;
+
+    /** Block execution statistics */
+    uint64_t blocks;
+    uint64_t block_instrs;
+
+    /** Instruction pairs executed at once by the blocks (see fusion.c) */
+    uint64_t fused_pairs;
+
+    /** Branches and jumps continuing a block on the same page */
+    uint64_t block_chains;
+
+    /** Executions of the translated blocks */
+    uint64_t jit_blocks;
+
+    /** Cycles in each privilege mode (indexed by the mode) and in the standby */
+    uint64_t mode_cycles[4];
+    uint64_t wait_cycles;
+
+    /** Last translation of each kind of access, bypassing both the TLB and the frame table */
+    rv32_utlb_entry_t utlb[rv_utlb_count];
+
+    /** Control and status registers (the counters change each step) */
+    rv_csr_t csr;
 
     /** Translation Lookaside Buffer used for caching translated addresses */
-    rv32_tlb_t tlb;
+    rv32_tlb_t tlb __attribute__((aligned(CACHE_LINE_SIZE)));
+
+    /** Non-leaf PTEs of the recent page walks */
+    rv32_walk_cache_t walk_cache;
+
+    /** Fetch translations of the recent address spaces and privilege modes */
+    rv32_fetch_cache_entry_t fetch_cache[RV_FETCH_CACHE_SIZE];
+
+    /** Page walk statistics (noisy walks only) */
+    uint64_t walks;
+    uint64_t walk_reads; /** PTEs read by the walks */
+    uint64_t walk_cache_hits; /** Walks started below the root table */
+    uint64_t ad_updates; /** PTEs written to set the A or D bit */
+    uint64_t fetch_cache_hits; /** Fetches translated by the fetch cache */
+
+    /** Instruction fetches failing (see the fetchalerts variable) */
+    uint64_t fetch_faults; /** Fetches raising an exception */
+    uint64_t fetch_outside; /** Fetches outside of the physical memory */
+
+    /** Latencies of the interrupts */
+    intr_latency_t intr_latency;
+
+    /** Statistics of the decoded instruction pages */
+    decode_stats_t decode_stats;
+
+    /** Executions of the instruction implementations (see mixstat) */
+    mixstat_t mix;
 
 } rv32_cpu_t;
 
 /** Basic CPU routines */
 extern void rv32_cpu_init(rv32_cpu_t *cpu, unsigned int procno);
 extern void rv32_cpu_done(rv32_cpu_t *cpu);
+extern bool rv32_cpu_save(rv32_cpu_t *cpu, struct checkpoint *ckpt);
+extern bool rv32_cpu_load(rv32_cpu_t *cpu, struct checkpoint *ckpt);
 extern void rv32_cpu_set_pc(rv32_cpu_t *cpu, uint32_t value);
 extern void rv32_cpu_step(rv32_cpu_t *cpu);
+extern bool rv32_cpu_standby(rv32_cpu_t *cpu, uint64_t *cycles);
+extern void rv32_cpu_skip(rv32_cpu_t *cpu, uint64_t cycles);
+extern bool rv32_cpu_deadloop(rv32_cpu_t *cpu);
+extern bool rv32_cpu_standby_host(rv32_cpu_t *cpu, uint64_t *wait);
 
 /** Interrupts */
 extern void rv32_interrupt_up(rv32_cpu_t *cpu, unsigned int no);
 extern void rv32_interrupt_down(rv32_cpu_t *cpu, unsigned int no);
 
+/** Timer */
+extern void rv32_set_mtime(rv32_cpu_t *cpu, uint64_t value);
+extern void rv32_set_mtimecmp(rv32_cpu_t *cpu, uint64_t value);
+
 /** Memory operations */
 extern rv_exc_t rv32_convert_addr(rv32_cpu_t *cpu, virt_t virt, ptr36_t *phys, bool wr, bool fetch, bool noisy);
 extern bool rv32_sc_access(rv32_cpu_t *cpu, ptr36_t phys, int size);
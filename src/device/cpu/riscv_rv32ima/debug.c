@@ -13,6 +13,7 @@
 #include <string.h>
 
 #include "../../../assert.h"
+#include "../../../debug/disasm.h"
 #include "../../../env.h"
 #include "../../../fault.h"
 #include "../../../physmem.h"
@@ -402,6 +403,7 @@ bool rv32_debug_change_regnames(rv_regname_type_t type)
     }
     curr_regname_type = (rv_regname_type_t) type;
     rv_regnames = rv_reg_name_table[curr_regname_type];
+    disasm_flush();
     return true;
 }
 
@@ -432,65 +434,46 @@ void rv32_reg_dump(rv32_cpu_t *cpu)
             "Privilege mode", priv_mode);
 }
 
-static void idump_common(uint32_t addr, rv_instr_t instr, string_t *s_opc,
-        string_t *s_mnemonics, string_t *s_comments)
+/**
+ * @brief Disassemble an instruction (see disasm_get())
+ */
+static void disassemble(uint64_t addr, uint32_t word, string_t *s_mnemonics,
+        string_t *s_comments)
 {
-
-    string_printf(s_opc, "%08x", instr.val);
+    rv_instr_t instr = { .val = word };
 
     rv_mnemonics_func_t mnem_func = rv_decode_mnemonics(instr);
 
-    mnem_func(addr, instr, s_mnemonics, s_comments);
+    mnem_func((uint32_t) addr, instr, s_mnemonics, s_comments);
 }
 
 /**
  * @brief Dump the given instruction as if it lied the given address in the context of the given CPU
+ *
+ * The disassembled instruction is taken from the cache of the disassembled instructions.
  */
 void rv32_idump(rv32_cpu_t *cpu, uint32_t addr, rv_instr_t instr)
 {
-    string_t s_cpu;
-    string_t s_addr;
-    string_t s_opc;
-    string_t s_mnemonics;
-    string_t s_comments;
-
-    string_init(&s_cpu);
-    string_init(&s_addr);
-    string_init(&s_opc);
-    string_init(&s_mnemonics);
-    string_init(&s_comments);
+    const disasm_slot_t *slot = disasm_get(TRACE_ARCH_RV32, addr, instr.val, disassemble);
+    disasm_line_t line = { .len = 0 };
 
     if (cpu != NULL) {
-        string_printf(&s_cpu, "cpu%u", cpu->csr.mhartid);
-    }
-
-    string_printf(&s_addr, "0x%08x", addr);
-
-    idump_common(addr, instr, &s_opc, &s_mnemonics, &s_comments);
-
-    if (cpu != NULL) {
-        printf("%-5s ", s_cpu.str);
+        disasm_line_add(&line, "cpu%-2u ", cpu->csr.mhartid);
     }
     if (iaddr) {
-        printf("%-10s ", s_addr.str);
+        disasm_line_add(&line, "0x%08x ", addr);
     }
     if (iopc) {
-        printf("%-8s ", s_opc.str);
+        disasm_line_add(&line, "%08x ", instr.val);
     }
 
-    printf("%-24s", s_mnemonics.str);
+    disasm_line_add(&line, "%-24s", slot->mnemonics);
 
-    if (icmt && s_comments.size > 0 && s_comments.str[0] != 0) {
-        printf("    [ %s ]", s_comments.str);
+    if (icmt && slot->comments[0] != 0) {
+        disasm_line_add(&line, "    [ %s ]", slot->comments);
     }
 
-    printf("\n");
-
-    string_done(&s_cpu);
-    string_done(&s_addr);
-    string_done(&s_opc);
-    string_done(&s_mnemonics);
-    string_done(&s_comments);
+    disasm_line_print(&line);
 }
 
 /**
@@ -834,7 +817,7 @@ extern bool rv32_translate_dump(rv32_cpu_t *cpu, uint32_t addr)
     sv32_pte_t pte;
     bool megapage;
 
-    if (rv32_tlb_get_mapping(&cpu->tlb, asid, addr, &pte, &megapage, false)) {
+    if (rv32_tlb_get_mapping(&cpu->tlb, asid, addr, &pte, &megapage, NULL, NULL, false)) {
         printf("TLB Hit!\n");
 
         if (!is_pte_valid(pte)) {
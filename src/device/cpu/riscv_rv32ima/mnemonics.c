@@ -23,138 +23,25 @@
 /** types */
 #include "../riscv_rv_ima/types.h"
 
-/** First memory helpers */
+/** First memory helpers (checked by PMP) */
+#include "../riscv_rv_ima/pmp.c"
 #include "../riscv_rv_ima/memory.c"
 /** Then instructions */
 #include "instr.c"
 
-extern rv_mnemonics_func_t rv_decode_mnemonics(rv_instr_t instr)
-{
-    // is this dirty?
-    rv_instr_func_t instr_func = rv32_instr_decode(instr);
-
-    // very dirty indeed, but only one decode is needed
-
-#define IF_SAME_DECODE(expected_instr) \
-    if (instr_func == rv_##expected_instr##_instr) \
-    return rv_##expected_instr##_mnemonics
-
-    IF_SAME_DECODE(lui);
-    IF_SAME_DECODE(auipc);
-
-    IF_SAME_DECODE(jal);
-    IF_SAME_DECODE(jalr);
-    IF_SAME_DECODE(beq);
-    IF_SAME_DECODE(bne);
-    IF_SAME_DECODE(blt);
-    IF_SAME_DECODE(bge);
-    IF_SAME_DECODE(bltu);
-    IF_SAME_DECODE(bgeu);
-
-    IF_SAME_DECODE(lb);
-    IF_SAME_DECODE(lh);
-    IF_SAME_DECODE(lw);
-    IF_SAME_DECODE(lbu);
-    IF_SAME_DECODE(lhu);
-
-    IF_SAME_DECODE(sb);
-    IF_SAME_DECODE(sh);
-    IF_SAME_DECODE(sw);
-
-    IF_SAME_DECODE(addi);
-    IF_SAME_DECODE(slti);
-    IF_SAME_DECODE(sltiu);
-    IF_SAME_DECODE(xori);
-    IF_SAME_DECODE(ori);
-    IF_SAME_DECODE(andi);
-    IF_SAME_DECODE(slli);
-    IF_SAME_DECODE(srli);
-    IF_SAME_DECODE(srai);
-
-    IF_SAME_DECODE(add);
-    IF_SAME_DECODE(sub);
-    IF_SAME_DECODE(sll);
-    IF_SAME_DECODE(slt);
-    IF_SAME_DECODE(sltu);
-    IF_SAME_DECODE(xor);
-    IF_SAME_DECODE(or);
-    IF_SAME_DECODE(and);
-    IF_SAME_DECODE(srl);
-    IF_SAME_DECODE(sra);
-
-    IF_SAME_DECODE(fence);
-
-    // SYSTEM
-
-    if (instr_func == _rv32_sfence_instr) {
-        return rv_sfence_mnemonics;
-    }
-
-    if (instr_func == rv_break_instr) {
-        return rv_ebreak_mnemonics;
-    }
-
-    if (instr_func == rv_halt_instr) {
-        return rv_ehalt_mnemonics;
-    }
-
-    if (instr_func == rv32_dump_instr) {
-        return rv_edump_mnemonics;
-    }
-
-    if (instr_func == rv_trace_set_instr) {
-        return rv_trace_set_mnemonics;
-    }
-
-    if (instr_func == rv_trace_reset_instr) {
-        return rv_trace_reset_mnemonics;
-    }
-
-    if (instr_func == _rv32_csr_rd_instr) {
-        return rv_csr_rd_mnemonics;
-    }
+/** Disassemblers of the instruction set entries (see isa.c) */
+static const rv_mnemonics_func_t rv_isa_mnemonics[] = {
+#define RV_INSTR(execute, mnemonics, encoding, flags) rv_##mnemonics##_mnemonics,
+#include "../riscv_rv_ima/isa.def"
+};
 
-    if (instr_func == rv_call_instr) {
-        return rv_ecall_mnemonics;
-    }
+static_assert(sizeof(rv_isa_mnemonics) / sizeof(rv_isa_mnemonics[0]) == RV_ISA_COUNT,
+        "Disassemblers do not match the instruction set");
 
-    IF_SAME_DECODE(sret);
-    IF_SAME_DECODE(mret);
-    IF_SAME_DECODE(wfi);
-
-    IF_SAME_DECODE(csrrw);
-    IF_SAME_DECODE(csrrs);
-    IF_SAME_DECODE(csrrc);
-    IF_SAME_DECODE(csrrwi);
-    IF_SAME_DECODE(csrrsi);
-    IF_SAME_DECODE(csrrci);
-
-    // M-extension
-
-    IF_SAME_DECODE(mul);
-    IF_SAME_DECODE(mulh);
-    IF_SAME_DECODE(mulhsu);
-    IF_SAME_DECODE(mulhu);
-    IF_SAME_DECODE(div);
-    IF_SAME_DECODE(divu);
-    IF_SAME_DECODE(rem);
-    IF_SAME_DECODE(remu);
-
-    // A-extension
-
-    IF_SAME_DECODE(lr);
-    IF_SAME_DECODE(sc);
-    IF_SAME_DECODE(amoswap_w);
-    IF_SAME_DECODE(amoadd_w);
-    IF_SAME_DECODE(amoxor_w);
-    IF_SAME_DECODE(amoor_w);
-    IF_SAME_DECODE(amoand_w);
-    IF_SAME_DECODE(amomin_w);
-    IF_SAME_DECODE(amomax_w);
-    IF_SAME_DECODE(amominu_w);
-    IF_SAME_DECODE(amomaxu_w);
-
-    return undefined_mnemonics;
+extern rv_mnemonics_func_t rv_decode_mnemonics(rv_instr_t instr)
+{
+    int entry = rv_isa_find(instr);
+    return (entry < 0) ? undefined_mnemonics : rv_isa_mnemonics[entry];
 }
 
 /***********
@@ -595,6 +482,18 @@ void rv_csr_rd_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics,
 {
     string_printf(s_mnemonics, "ecsrd %s", rv_regnames[instr.i.rd]);
 }
+void rv_roi_begin_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "eroib");
+}
+void rv_roi_end_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "eroie");
+}
+void rv_hypercall_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "ehcall");
+}
 
 extern void rv_sret_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
 {
@@ -735,12 +634,12 @@ extern void rv_remu_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemo
 }
 
 // A extension
-extern void rv_lr_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+extern void rv_lr_w_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
 {
     string_printf(s_mnemonics, "lr");
     string_printf(s_mnemonics, " %s, (%s)", rv_regnames[instr.r.rd], rv_regnames[instr.r.rs1]);
 }
-extern void rv_sc_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+extern void rv_sc_w_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
 {
     string_printf(s_mnemonics, "sc");
     amo_instr_mnemonics(instr, s_mnemonics);
@@ -2,265 +2,413 @@
 #include <string.h>
 
 #include "../../../assert.h"
+#include "../../../physmem.h"
 #include "../../../utils.h"
 #include "tlb.h"
 
 typedef struct rv32_tlb_entry {
-    item_t item; // Item to be used in LRU or free-list
     sv32_pte_t pte;
     uint32_t vpn;
     unsigned asid;
+    bool valid;
     bool global;
+    uint32_t epoch; // Flush generations when the entry was added
+    uint32_t asid_epoch;
     bool megapage;
+    bool referenced; // Clock bit used for approximate LRU replacement
+    ptr36_t pte_addr; // Physical address of the leaf PTE
+    uint8_t allowed; // Accesses allowed without a page walk
+    uint32_t generation; // Context generation of the allowed accesses
 } rv32_tlb_entry_t;
 
-/** Caches a mapping into the TLB */
-extern void rv32_tlb_add_mapping(rv32_tlb_t *tlb, unsigned asid, uint32_t virt, sv32_pte_t pte, bool megapage, bool global)
+/** Returns the virtual page number of the address for the given page size */
+static inline uint32_t virt_vpn(uint32_t virt, bool megapage)
 {
+    return virt >> (megapage ? RV_MEGAPAGESIZE : RV_PAGESIZE);
+}
 
-    rv32_tlb_entry_t *entry = NULL;
+/** Returns the first entry of the set caching the given virtual page
+ *
+ * Pages and megapages are hashed into the same sets by their own page
+ * numbers, so a lookup probes one set per page size.
+ */
+static inline rv32_tlb_entry_t *tlb_set(rv32_tlb_t *tlb, uint32_t vpn, bool megapage)
+{
+    uint32_t hash = vpn ^ (vpn >> 8) ^ (megapage ? 0x5A5 : 0);
+    return &tlb->entries[(hash & (tlb->sets - 1)) * tlb->ways];
+}
+
+/** Computes the accesses a mapping allows in the current context
+ *
+ * Only the accesses that neither fault nor need the A and D bits
+ * of the PTE updated are allowed, the others take the page walk.
+ */
+static unsigned entry_allowed(rv32_tlb_t *tlb, sv32_pte_t pte, bool megapage)
+{
+    if (!is_pte_valid(pte) || !pte.a) {
+        return 0;
+    }
 
-    if (!is_empty(&tlb->free_list)) {
-        // If there are some unused entries, use them first
+    // Misaligned megapage
+    if (megapage && (pte_ppn0(pte) != 0)) {
+        return 0;
+    }
 
-        item_t *popped_free_item = tlb->free_list.head;
-        list_remove(&tlb->free_list, popped_free_item);
-        // Safe cast because the item is the first field
-        entry = (rv32_tlb_entry_t *) popped_free_item;
-    } else {
-        // If all entries are used, reuse the Least Recently Used entry from the used list
+    unsigned allowed = 0;
 
-        item_t *popped_reused_item = tlb->lru_list.tail;
-        list_remove(&tlb->lru_list, popped_reused_item);
-        // Safe cast because the item is the first field
-        entry = (rv32_tlb_entry_t *) popped_reused_item;
+    if (pte.r || (tlb->mxr && pte.x)) {
+        allowed |= RV_TLB_ALLOW_READ;
     }
 
-    ASSERT(entry != NULL);
+    if (pte.w && pte.d) {
+        allowed |= RV_TLB_ALLOW_WRITE;
+    }
 
-    entry->pte = pte;
-    entry->megapage = megapage;
-    entry->vpn = virt >> (megapage ? RV_MEGAPAGESIZE : RV_PAGESIZE);
-    entry->asid = asid;
-    entry->global = global;
+    if (pte.x) {
+        allowed |= RV_TLB_ALLOW_EXEC;
+    }
 
-    // Push to front of LRU list
-    list_push(&tlb->lru_list, &entry->item);
+    if (tlb->user != (bool) pte.u) {
+        // User pages in S-mode only with SUM and never executable
+        allowed = (pte.u && tlb->sum) ? (allowed & ~RV_TLB_ALLOW_EXEC) : 0;
+    }
+
+    return allowed;
 }
 
-static void move_lru_entry_to_front(rv32_tlb_t *tlb, rv32_tlb_entry_t *entry)
+/** Returns the flush generation of the ASID */
+static inline uint32_t *asid_epoch(rv32_tlb_t *tlb, unsigned asid)
 {
+    return &tlb->asid_epochs[asid & (RV_TLB_ASID_EPOCHS - 1)];
+}
 
-    // Fast path exit
-    if (tlb->lru_list.head == &entry->item) {
-        return;
+/** Returns whether the entry has not been invalidated (or flushed since added) */
+static inline bool entry_live(rv32_tlb_t *tlb, rv32_tlb_entry_t *entry)
+{
+    return entry->valid
+            && (entry->epoch == tlb->epoch)
+            && (entry->global || (entry->asid_epoch == *asid_epoch(tlb, entry->asid)));
+}
+
+/** Returns whether the entry maps the page in the given address space */
+static inline bool entry_matches(rv32_tlb_t *tlb, rv32_tlb_entry_t *entry, unsigned asid, uint32_t vpn, bool megapage)
+{
+    return (entry->megapage == megapage)
+            && (entry->vpn == vpn)
+            && (entry->global || entry->asid == asid)
+            && entry_live(tlb, entry);
+}
+
+/** Caches a mapping into the TLB */
+extern void rv32_tlb_add_mapping(rv32_tlb_t *tlb, unsigned asid, uint32_t virt, sv32_pte_t pte, bool megapage, bool global, ptr36_t pte_addr)
+{
+    uint32_t vpn = virt_vpn(virt, megapage);
+    rv32_tlb_entry_t *set = tlb_set(tlb, vpn, megapage);
+    size_t set_index = (set - tlb->entries) / tlb->ways;
+
+    rv32_tlb_entry_t *entry = NULL;
+
+    // If there are some unused entries in the set, use them first
+    for (size_t way = 0; way < tlb->ways; ++way) {
+        if (!entry_live(tlb, &set[way])) {
+            entry = &set[way];
+            break;
+        }
     }
 
-    ASSERT(entry->item.list == &tlb->lru_list);
+    // Otherwise evict the first entry not referenced since the clock hand passed it
+    while (entry == NULL) {
+        rv32_tlb_entry_t *candidate = &set[tlb->hands[set_index]];
+        tlb->hands[set_index] = (tlb->hands[set_index] + 1) % tlb->ways;
 
-    // Move entry to the front of the list by first removing it and then pushing it to the front
-    list_remove(&tlb->lru_list, &entry->item);
-    list_push(&tlb->lru_list, &entry->item);
+        if (candidate->referenced) {
+            candidate->referenced = false;
+        } else {
+            entry = candidate;
+            tlb->evictions++;
+        }
+    }
+
+    entry->pte = pte;
+    entry->megapage = megapage;
+    entry->vpn = vpn;
+    entry->asid = asid;
+    entry->global = global;
+    entry->valid = true;
+    entry->epoch = tlb->epoch;
+    entry->asid_epoch = *asid_epoch(tlb, asid);
+    entry->referenced = true;
+    entry->pte_addr = pte_addr;
+    entry->allowed = entry_allowed(tlb, pte, megapage);
+    entry->generation = tlb->generation;
 }
 
-/** Returns whether the given TLB entry holds a mapping of the specified virtual address */
-static bool entry_maps_virt(rv32_tlb_entry_t *entry, uint32_t virt)
+/** Finds the entry mapping the given address in the given page size */
+static rv32_tlb_entry_t *find_entry(rv32_tlb_t *tlb, unsigned asid, uint32_t virt, bool megapage)
 {
-    uint32_t vpn = virt >> RV_PAGESIZE;
-    uint32_t mvpn = virt >> RV_MEGAPAGESIZE;
-    return entry->vpn == (entry->megapage ? mvpn : vpn);
+    uint32_t vpn = virt_vpn(virt, megapage);
+    rv32_tlb_entry_t *set = tlb_set(tlb, vpn, megapage);
+
+    for (size_t way = 0; way < tlb->ways; ++way) {
+        if (entry_matches(tlb, &set[way], asid, vpn, megapage)) {
+            return &set[way];
+        }
+    }
+
+    return NULL;
 }
 
 /** Retrieves a cached mapping
  * gives priority to megapage mappings
  */
-extern bool rv32_tlb_get_mapping(rv32_tlb_t *tlb, unsigned asid, uint32_t virt, sv32_pte_t *pte, bool *megapage, bool noisy)
+extern bool rv32_tlb_get_mapping(rv32_tlb_t *tlb, unsigned asid, uint32_t virt, sv32_pte_t *pte, bool *megapage, ptr36_t *pte_addr, unsigned *allowed, bool noisy)
 {
+    rv32_tlb_entry_t *entry = find_entry(tlb, asid, virt, true);
 
-    rv32_tlb_entry_t *entry;
-
-    for_each(tlb->lru_list, entry, rv32_tlb_entry_t)
-    {
+    if (entry == NULL) {
+        entry = find_entry(tlb, asid, virt, false);
+    }
 
-        // Skip non-global mappings with wrong asid
-        if (!entry->global && entry->asid != asid) {
-            continue;
+    if (entry == NULL) {
+        if (noisy) {
+            tlb->misses++;
         }
 
-        if (entry_maps_virt(entry, virt)) {
+        return false;
+    }
 
-            if (noisy) {
-                // Ensure LRU behavior, by moving the entry to the front of the LRU list on access
-                move_lru_entry_to_front(tlb, entry);
-            }
+    if (noisy) {
+        tlb->hits++;
 
-            *pte = entry->pte;
-            *megapage = entry->megapage;
+        // Keep the entry from being replaced soon
+        entry->referenced = true;
+    }
+
+    *pte = entry->pte;
+    *megapage = entry->megapage;
 
-            return true;
+    if (pte_addr != NULL) {
+        *pte_addr = entry->pte_addr;
+    }
+
+    if (allowed != NULL) {
+        if (entry->generation != tlb->generation) {
+            entry->allowed = entry_allowed(tlb, entry->pte, entry->megapage);
+            entry->generation = tlb->generation;
         }
+
+        *allowed = entry->allowed;
     }
 
-    return false;
+    return true;
 }
 
-static void invalidate_tlb_entry(rv32_tlb_t *tlb, rv32_tlb_entry_t *entry)
+extern void rv32_tlb_update_mapping(rv32_tlb_t *tlb, unsigned asid, uint32_t virt, sv32_pte_t pte)
 {
-    ASSERT(entry->item.list == &tlb->lru_list);
+    rv32_tlb_entry_t *entry = find_entry(tlb, asid, virt, true);
 
-    list_remove(&tlb->lru_list, &entry->item);
-    list_push(&tlb->free_list, &entry->item);
-}
+    if (entry == NULL) {
+        entry = find_entry(tlb, asid, virt, false);
+    }
 
-static bool is_entry_valid(rv32_tlb_t *tlb, rv32_tlb_entry_t *entry)
-{
-    return entry->item.list == &tlb->lru_list;
+    if (entry != NULL) {
+        entry->pte = pte;
+        entry->allowed = entry_allowed(tlb, pte, entry->megapage);
+        entry->generation = tlb->generation;
+    }
 }
 
 extern void rv32_tlb_remove_mapping(rv32_tlb_t *tlb, unsigned asid, uint32_t virt)
 {
+    rv32_tlb_entry_t *entry = find_entry(tlb, asid, virt, true);
 
-    rv32_tlb_entry_t *entry;
+    if (entry == NULL) {
+        entry = find_entry(tlb, asid, virt, false);
+    }
 
-    for_each(tlb->lru_list, entry, rv32_tlb_entry_t)
-    {
+    if (entry != NULL) {
+        entry->valid = false;
+    }
+}
 
-        // Skip non-global mappings with wrong asid
-        if (!entry->global && entry->asid != asid) {
-            continue;
-        }
+extern void rv32_tlb_set_context(rv32_tlb_t *tlb, bool user, bool sum, bool mxr)
+{
+    tlb->context_changed = false;
+
+    if ((tlb->user == user) && (tlb->sum == sum) && (tlb->mxr == mxr)) {
+        return;
+    }
 
-        if (entry_maps_virt(entry, virt)) {
-            invalidate_tlb_entry(tlb, entry);
-            return;
+    tlb->user = user;
+    tlb->sum = sum;
+    tlb->mxr = mxr;
+    tlb->generation++;
+
+    // A wrapped generation could match the stale entries
+    if (tlb->generation == 0) {
+        for (size_t i = 0; i < tlb->size; ++i) {
+            rv32_tlb_entry_t *entry = &tlb->entries[i];
+            entry->allowed = entry_allowed(tlb, entry->pte, entry->megapage);
         }
     }
 }
 
 /** TLB flushes */
 
+/** Invalidates the entries right away */
+static void invalidate_all(rv32_tlb_t *tlb)
+{
+    for (size_t i = 0; i < tlb->size; ++i) {
+        tlb->entries[i].valid = false;
+    }
+}
+
 // Invalidates all entries
 extern void rv32_tlb_flush(rv32_tlb_t *tlb)
 {
-    for (size_t i = 0; i < tlb->size; ++i) {
-        if (is_entry_valid(tlb, &tlb->entries[i])) {
-            invalidate_tlb_entry(tlb, &tlb->entries[i]);
-        }
+    tlb->flushes++;
+    tlb->epoch++;
+
+    // A wrapped generation could revive the entries flushed long ago
+    if (tlb->epoch == 0) {
+        invalidate_all(tlb);
     }
 }
 
 // Invalidates all entries of the given asid
 extern void rv32_tlb_flush_by_asid(rv32_tlb_t *tlb, unsigned asid)
 {
-    for (size_t i = 0; i < tlb->size; ++i) {
+    tlb->asid_flushes++;
 
-        if (!is_entry_valid(tlb, &tlb->entries[i])) {
-            continue;
-        }
+    // The other ASIDs sharing the generation are flushed as well
+    uint32_t *epoch = asid_epoch(tlb, asid);
+    (*epoch)++;
 
-        if (tlb->entries[i].global) {
-            continue;
-        }
-        if (tlb->entries[i].asid == asid) {
-            invalidate_tlb_entry(tlb, &tlb->entries[i]);
-        }
+    if (*epoch == 0) {
+        invalidate_all(tlb);
     }
 }
 
-// Invalidates all entries that map the given virtual address
-extern void rv32_tlb_flush_by_addr(rv32_tlb_t *tlb, uint32_t virt)
+/** Invalidates the entries of the set caching the address that pass the ASID filter */
+static void flush_set(rv32_tlb_t *tlb, uint32_t virt, bool megapage, bool any_asid, unsigned asid)
 {
-    uint32_t vpn = virt >> RV_PAGESIZE;
-    uint32_t mvpn = virt >> RV_MEGAPAGESIZE;
+    uint32_t vpn = virt_vpn(virt, megapage);
+    rv32_tlb_entry_t *set = tlb_set(tlb, vpn, megapage);
 
-    for (size_t i = 0; i < tlb->size; ++i) {
+    for (size_t way = 0; way < tlb->ways; ++way) {
+        rv32_tlb_entry_t *entry = &set[way];
 
-        if (!is_entry_valid(tlb, &tlb->entries[i])) {
+        if (!entry_live(tlb, entry) || (entry->megapage != megapage) || (entry->vpn != vpn)) {
             continue;
         }
 
-        if (tlb->entries[i].megapage) {
-            if (tlb->entries[i].vpn == mvpn) {
-                invalidate_tlb_entry(tlb, &tlb->entries[i]);
-            }
-        } else {
-            if (tlb->entries[i].vpn == vpn) {
-                invalidate_tlb_entry(tlb, &tlb->entries[i]);
-            }
+        if (!any_asid && (entry->global || entry->asid != asid)) {
+            continue;
         }
+
+        entry->valid = false;
     }
 }
 
-// Invalidates all entries that map the given address and are of the given asid
-extern void rv32_tlb_flush_by_asid_and_addr(rv32_tlb_t *tlb, unsigned asid, uint32_t virt)
+// Invalidates all entries that map the given virtual address
+extern void rv32_tlb_flush_by_addr(rv32_tlb_t *tlb, uint32_t virt)
 {
-    uint32_t vpn = virt >> RV_PAGESIZE;
-    uint32_t mvpn = virt >> RV_MEGAPAGESIZE;
-
-    for (size_t i = 0; i < tlb->size; ++i) {
-
-        if (!is_entry_valid(tlb, &tlb->entries[i])) {
-            continue;
-        }
+    tlb->addr_flushes++;
 
-        if (tlb->entries[i].global) {
-            continue;
-        }
+    flush_set(tlb, virt, false, true, 0);
+    flush_set(tlb, virt, true, true, 0);
+}
 
-        if (tlb->entries[i].asid != asid) {
-            continue;
-        }
+// Invalidates all entries that map the given address and are of the given asid
+extern void rv32_tlb_flush_by_asid_and_addr(rv32_tlb_t *tlb, unsigned asid, uint32_t virt)
+{
+    tlb->asid_addr_flushes++;
 
-        if (tlb->entries[i].megapage) {
-            if (tlb->entries[i].vpn == mvpn) {
-                invalidate_tlb_entry(tlb, &tlb->entries[i]);
-            }
-        } else {
-            if (tlb->entries[i].vpn == vpn) {
-                invalidate_tlb_entry(tlb, &tlb->entries[i]);
-            }
-        }
-    }
+    flush_set(tlb, virt, false, false, asid);
+    flush_set(tlb, virt, true, false, asid);
 }
 
-/** Initializes the TLB data structure */
+/** Initializes the TLB data structure
+ *
+ * The entries are organized into a power of two number of sets of about
+ * RV_TLB_WAYS entries each, the size is rounded down to a multiple
+ * of the number of sets.
+ */
 extern void rv32_tlb_init(rv32_tlb_t *tlb, size_t size)
 {
     ASSERT(size != 0);
 
-    tlb->entries = safe_malloc(size * sizeof(rv32_tlb_entry_t));
-    tlb->size = size;
-    list_init(&tlb->lru_list);
-    list_init(&tlb->free_list);
+    size_t sets = 1;
+    while (sets * 2 * RV_TLB_WAYS <= size) {
+        sets *= 2;
+    }
 
-    memset(tlb->entries, 0, size * sizeof(rv32_tlb_entry_t));
+    tlb->sets = sets;
+    tlb->ways = size / sets;
+    tlb->size = tlb->sets * tlb->ways;
 
-    for (size_t i = 0; i < size; ++i) {
-        list_append(&tlb->free_list, &tlb->entries[i].item);
-    }
+    tlb->hits = 0;
+    tlb->misses = 0;
+    tlb->evictions = 0;
+    tlb->flushes = 0;
+    tlb->asid_flushes = 0;
+    tlb->addr_flushes = 0;
+    tlb->asid_addr_flushes = 0;
+
+    tlb->generation = 0;
+    tlb->context_changed = true;
+    tlb->user = false;
+    tlb->sum = false;
+    tlb->mxr = false;
+
+    tlb->epoch = 0;
+    memset(tlb->asid_epochs, 0, sizeof(tlb->asid_epochs));
+
+    tlb->entries = safe_malloc(tlb->size * sizeof(rv32_tlb_entry_t));
+    tlb->hands = safe_malloc(tlb->sets * sizeof(unsigned));
+
+    memset(tlb->entries, 0, tlb->size * sizeof(rv32_tlb_entry_t));
+    memset(tlb->hands, 0, tlb->sets * sizeof(unsigned));
 }
 
 /** Cleans up the TLB structure */
 extern void rv32_tlb_done(rv32_tlb_t *tlb)
 {
     safe_free(tlb->entries);
+    safe_free(tlb->hands);
 }
 
 extern bool rv32_tlb_resize(rv32_tlb_t *tlb, size_t size)
 {
-    safe_free(tlb->entries);
-    tlb->entries = safe_malloc(size * sizeof(rv32_tlb_entry_t));
-    tlb->size = size;
-    list_init(&tlb->lru_list);
-    list_init(&tlb->free_list);
+    rv32_tlb_done(tlb);
+    rv32_tlb_init(tlb, size);
 
-    memset(tlb->entries, 0, size * sizeof(rv32_tlb_entry_t));
+    return true;
+}
 
-    for (size_t i = 0; i < size; ++i) {
-        list_append(&tlb->free_list, &tlb->entries[i].item);
+/** Copies the entries and the clock hands of the TLB
+ *
+ * The copy is reallocated when its size differs, it has to be
+ * zero-initialized before the first copy.
+ */
+extern void rv32_tlb_copy(rv32_tlb_t *copy, const rv32_tlb_t *tlb)
+{
+    if ((copy->size != tlb->size) || (copy->sets != tlb->sets)) {
+        safe_free(copy->entries);
+        safe_free(copy->hands);
+        copy->entries = safe_malloc(tlb->size * sizeof(rv32_tlb_entry_t));
+        copy->hands = safe_malloc(tlb->sets * sizeof(unsigned));
     }
 
-    return true;
+    rv32_tlb_entry_t *entries = copy->entries;
+    unsigned *hands = copy->hands;
+
+    *copy = *tlb;
+    copy->entries = entries;
+    copy->hands = hands;
+
+    memcpy(copy->entries, tlb->entries, tlb->size * sizeof(rv32_tlb_entry_t));
+    memcpy(copy->hands, tlb->hands, tlb->sets * sizeof(unsigned));
 }
 
 static inline void dump_tlb_entry(rv32_tlb_entry_t entry, string_t *text)
@@ -278,23 +426,21 @@ extern void rv32_tlb_dump(rv32_tlb_t *tlb)
     string_t s_text;
     string_init(&s_text);
 
-    printf("TLB    size: %ld entries\n", tlb->size);
+    printf("TLB    size: %zu entries (%zu sets of %zu)\n", tlb->size, tlb->sets, tlb->ways);
     printf("%8s: %10s => %-11s [ %s ]\n", "index", "virt", "phys", "info");
 
     bool printed = false;
 
-    rv32_tlb_entry_t *entry;
-    size_t i = 0;
+    for (size_t i = 0; i < tlb->size; ++i) {
+        if (!entry_live(tlb, &tlb->entries[i])) {
+            continue;
+        }
 
-    for_each(tlb->lru_list, entry, rv32_tlb_entry_t)
-    {
         printed = true;
 
         string_clear(&s_text);
-        dump_tlb_entry(*entry, &s_text);
-        printf("%8ld: %s\n", i, s_text.str);
-
-        ++i;
+        dump_tlb_entry(tlb->entries[i], &s_text);
+        printf("%8zu: %s\n", i, s_text.str);
     }
 
     if (!printed) {
@@ -303,3 +449,61 @@ extern void rv32_tlb_dump(rv32_tlb_t *tlb)
 
     string_done(&s_text);
 }
+
+/** Page walk cache */
+
+/** Returns the walk cache entry which might hold the PTE translating the address */
+static inline rv32_walk_entry_t *walk_cache_slot(rv32_walk_cache_t *cache, uint32_t vpn)
+{
+    return &cache->entries[vpn & (RV_WALK_CACHE_SIZE - 1)];
+}
+
+/** Finds the cached root table PTE translating the given address
+ *
+ * The frame of the second level table is looked up again if the
+ * physical memory layout has changed since the PTE was cached.
+ */
+extern rv32_walk_entry_t *rv32_walk_cache_find(rv32_walk_cache_t *cache, unsigned asid, uint32_t virt)
+{
+    uint32_t vpn = virt >> RV_MEGAPAGESIZE;
+    rv32_walk_entry_t *entry = walk_cache_slot(cache, vpn);
+
+    if (!entry->valid || (entry->vpn != vpn) || (!entry->global && entry->asid != asid)) {
+        return NULL;
+    }
+
+    if (entry->layout != physmem_layout) {
+        entry->frame = physmem_find_frame(entry->table);
+        entry->layout = physmem_layout;
+    }
+
+    return entry;
+}
+
+/** Caches a non-leaf root table PTE, replacing the previous one in its slot */
+extern rv32_walk_entry_t *rv32_walk_cache_add(rv32_walk_cache_t *cache, unsigned asid, uint32_t virt, ptr36_t table, bool global)
+{
+    uint32_t vpn = virt >> RV_MEGAPAGESIZE;
+    rv32_walk_entry_t *entry = walk_cache_slot(cache, vpn);
+
+    entry->valid = true;
+    entry->global = global;
+    entry->asid = asid;
+    entry->vpn = vpn;
+    entry->table = table;
+    entry->frame = physmem_find_frame(table);
+    entry->layout = physmem_layout;
+
+    return entry;
+}
+
+/** Invalidates the cached PTE translating the given address in any address space */
+extern void rv32_walk_cache_flush_by_addr(rv32_walk_cache_t *cache, uint32_t virt)
+{
+    uint32_t vpn = virt >> RV_MEGAPAGESIZE;
+    rv32_walk_entry_t *entry = walk_cache_slot(cache, vpn);
+
+    if (entry->vpn == vpn) {
+        entry->valid = false;
+    }
+}
@@ -16,26 +16,78 @@
 
 #define XLEN 32
 
-#include "../../../list.h"
 #include "../../../main.h"
 #include "virt_mem.h"
 
 struct rv32_tlb_entry;
 
+/** Number of ASID flush generations (power of two, ASIDs share them modulo the number) */
+#define RV_TLB_ASID_EPOCHS 64
+
+/** Set-associative TLB
+ *
+ * Entries are hashed into sets by their virtual page number and
+ * replaced using a clock (second chance) approximation of LRU.
+ */
 typedef struct rv32_tlb {
     struct rv32_tlb_entry *entries;
-    size_t size;
-    list_t lru_list;
-    list_t free_list;
+    size_t size; // Number of entries (sets * ways)
+    size_t sets; // Number of sets (power of two)
+    size_t ways; // Number of entries in a set
+    unsigned *hands; // Clock hand of each set
+
+    // Statistics, restarted when the TLB is resized
+    uint64_t hits; // Noisy lookups finding a mapping
+    uint64_t misses; // Noisy lookups finding no mapping
+    uint64_t evictions; // Valid entries replaced by a new mapping
+    uint64_t flushes; // Full flushes
+    uint64_t asid_flushes;
+    uint64_t addr_flushes;
+    uint64_t asid_addr_flushes;
+
+    // Access context the allowed accesses of the entries are computed for
+    uint32_t generation; // Changed whenever the context changes
+    bool context_changed; // The context has to be taken from the processor
+    bool user; // Effective privilege mode is U (S otherwise)
+    bool sum; // Supervisor access to user pages
+    bool mxr; // Reads from executable pages
+
+    // Generations of the flushes, an entry is valid only while they stay
+    // as they were when it was added (invalid entries are reused lazily)
+    uint32_t epoch; // Bumped by the full flushes
+    uint32_t asid_epochs[RV_TLB_ASID_EPOCHS]; // Bumped by the flushes of the ASIDs hashed to them
 } rv32_tlb_t;
 
 #define DEFAULT_RV_TLB_SIZE 48
 
+/** Preferred number of entries in a TLB set */
+#define RV_TLB_WAYS 4
+
+/** Accesses allowed by a cached mapping without a page walk */
+#define RV_TLB_ALLOW_READ 1
+#define RV_TLB_ALLOW_WRITE 2
+#define RV_TLB_ALLOW_EXEC 4
+
 /** Caches a mapping into the TLB */
-extern void rv32_tlb_add_mapping(rv32_tlb_t *tlb, unsigned asid, uint32_t virt, sv32_pte_t pte, bool megapage, bool global);
+extern void rv32_tlb_add_mapping(rv32_tlb_t *tlb, unsigned asid, uint32_t virt, sv32_pte_t pte, bool megapage, bool global, ptr36_t pte_addr);
+
+/** Retrieves a cached mapping, giving priority to megapage mappings
+ *
+ * The address of the leaf PTE and the accesses allowed by the mapping
+ * in the current context are stored into pte_addr and allowed (if not
+ * NULL).
+ */
+extern bool rv32_tlb_get_mapping(rv32_tlb_t *tlb, unsigned asid, uint32_t virt, sv32_pte_t *pte, bool *megapage, ptr36_t *pte_addr, unsigned *allowed, bool noisy);
 
-/** Retrieves a cached mapping, giving priority to megapage mappings */
-extern bool rv32_tlb_get_mapping(rv32_tlb_t *tlb, unsigned asid, uint32_t virt, sv32_pte_t *pte, bool *megapage, bool noisy);
+/** Replaces the PTE of a cached mapping (after its A and D bits are set) */
+extern void rv32_tlb_update_mapping(rv32_tlb_t *tlb, unsigned asid, uint32_t virt, sv32_pte_t pte);
+
+/** Sets the access context of the allowed accesses
+ *
+ * The allowed accesses of the entries are recomputed lazily once the
+ * context differs.
+ */
+extern void rv32_tlb_set_context(rv32_tlb_t *tlb, bool user, bool sum, bool mxr);
 
 /** Removes the first mapping that matches the given address and is global or has the right ASID */
 extern void rv32_tlb_remove_mapping(rv32_tlb_t *tlb, unsigned asid, uint32_t virt);
@@ -56,6 +108,40 @@ extern void rv32_tlb_done(rv32_tlb_t *tlb);
  */
 extern bool rv32_tlb_resize(rv32_tlb_t *tlb, size_t size);
 
+/** Copies the TLB into another one (keeping its own allocation) */
+extern void rv32_tlb_copy(rv32_tlb_t *copy, const rv32_tlb_t *tlb);
+
 extern void rv32_tlb_dump(rv32_tlb_t *tlb);
 
+/** Number of non-leaf PTEs held by the page walk cache (power of two) */
+#define RV_WALK_CACHE_SIZE 16
+
+struct frame;
+
+/** Cached non-leaf PTE of the root page table */
+typedef struct {
+    bool valid;
+    bool global;
+    unsigned asid;
+    uint32_t vpn; /** VPN[1] of the addresses translated through the PTE */
+    ptr36_t table; /** Physical address of the second level page table */
+    struct frame *frame; /** Frame holding the table (NULL outside of memory) */
+    unsigned int layout; /** Value of physmem_layout when the frame was looked up */
+} rv32_walk_entry_t;
+
+/** Page walk cache
+ *
+ * Direct mapped cache of the non-leaf PTEs, which lets a TLB refill
+ * read only the leaf PTE. Like the TLB, it has to be flushed by
+ * SFENCE.VMA after the page tables change, and additionally whenever
+ * satp changes, because the entries do not remember the root table.
+ */
+typedef struct {
+    rv32_walk_entry_t entries[RV_WALK_CACHE_SIZE];
+} rv32_walk_cache_t;
+
+extern rv32_walk_entry_t *rv32_walk_cache_find(rv32_walk_cache_t *cache, unsigned asid, uint32_t virt);
+extern rv32_walk_entry_t *rv32_walk_cache_add(rv32_walk_cache_t *cache, unsigned asid, uint32_t virt, ptr36_t table, bool global);
+extern void rv32_walk_cache_flush_by_addr(rv32_walk_cache_t *cache, uint32_t virt);
+
 #endif // RISCV_RV32IMA_TLB_H_
@@ -10,15 +10,29 @@
  *
  */
 
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "../../../assert.h"
+#include "../../../checkpoint.h"
+#include "../../../debug/breakpoint.h"
+#include "../../../debug/cachesim.h"
+#include "../../../debug/catchpoint.h"
+#include "../../../debug/coverage.h"
+#include "../../../debug/flight.h"
+#include "../../../debug/memtrace.h"
+#include "../../../debug/trace.h"
+#include "../../../debug/tracefilter.h"
+#include "../../../env.h"
 #include "../../../list.h"
 #include "../../../main.h"
 #include "../../../physmem.h"
+#include "../../../profile.h"
+#include "../../../replay.h"
+#include "../../../usermode.h"
 #include "../../../utils.h"
 #include "cpu.h"
 #include "csr.h"
@@ -32,44 +46,34 @@
 /// Caching of decoded instructions
 
 /**
- * @brief Item of a list of pages of cached instructions
+ * @brief A decoded instruction together with its instruction word
+ *
+ * The implementation is referred to by its index (see decode_handler_index()),
+ * so that the decoded instructions of a page take 8 KiB.
  */
 typedef struct {
-    item_t item; // The list item
-    ptr36_t addr; // The base address of the page
-    rv_instr_func_t instrs[FRAME_SIZE / sizeof(rv_instr_t)]; // Decoded instructions (represented as function pointers)
-} cache_item_t;
+    rv_instr_t data; // Raw instruction word passed to the implementation
+    uint16_t handler; // Index of the instruction implementation (0 until decoded, see lazy_decode)
+    uint16_t run : 11; // Length of the straight-line run starting here (see execute_block)
+    uint16_t fused : 5; // Kind of the pair fused with the next instruction (see rv_fusion_kind)
+} cache_instr_t;
 
-#define PHYS2CACHEINSTR(phys) (((phys) & FRAME_MASK) / sizeof(rv_instr_t))
+/**
+ * @brief A page of decoded instructions attached to a physical frame
+ */
+typedef struct {
+    decoded_page_t header; // Frame, generation and pool bookkeeping
+    cache_instr_t instrs[FRAME_SIZE / sizeof(rv_instr_t)]; // Decoded instructions
+    uint16_t heat[FRAME_SIZE / sizeof(rv_instr_t)]; // Executions of the block starting at each instruction until translated (see rv_jit_code)
+} cache_item_t;
 
-static void cache_item_init(cache_item_t *cache_item)
-{
-    item_init(&cache_item->item);
-    cache_item->addr = 0;
-    // Skip instrs init
-}
+static_assert((FRAME_SIZE / sizeof(rv_instr_t)) < (1 << 11), "run does not fit cache_instr_t");
+static_assert(sizeof(cache_instr_t) == 8, "cache_instr_t is not compact");
 
-list_t rv64_instruction_cache = LIST_INITIALIZER;
+static void cache_item_page_predecode(decoded_page_t *page, frame_t *frame, uint64_t chunks);
+static void cache_item_page_restore(decoded_page_t *page);
 
-/**
- * @brief Looks into cache for the instruction on the given physical address
- * @par phys The physical address to check
- * @par cache_item A pointer to a found cache_item_t will be stored here on success
- * @returns Whether the address is in the cache
- */
-static bool cache_hit(ptr36_t phys, cache_item_t **cache_item)
-{
-    ptr36_t target_page = ALIGN_DOWN(phys, FRAME_SIZE);
-    cache_item_t *c;
-    for_each(rv64_instruction_cache, c, cache_item_t)
-    {
-        if (c->addr == target_page) {
-            *cache_item = c;
-            return true;
-        }
-    }
-    return false;
-}
+#define PHYS2CACHEINSTR(phys) (((phys) & FRAME_MASK) / sizeof(rv_instr_t))
 
 static void init_regs(rv64_cpu_t *cpu)
 {
@@ -97,6 +101,8 @@ void rv64_cpu_init(rv64_cpu_t *cpu, unsigned int procno)
     rv64_tlb_init(&cpu->tlb, DEFAULT_RV64_TLB_SIZE);
 
     cpu->priv_mode = rv_mmode;
+    decode_cache_register(DECODE_RV64, sizeof(cache_item_t), cache_item_page_predecode,
+            cache_item_page_restore);
 }
 
 /**
@@ -104,16 +110,61 @@ void rv64_cpu_init(rv64_cpu_t *cpu, unsigned int procno)
  */
 void rv64_cpu_done(rv64_cpu_t *cpu)
 {
-    // Clean whole cache for simplicity whenever any cpu is done
-    while (!is_empty(&rv64_instruction_cache)) {
-        cache_item_t *cache_item = (cache_item_t *) (rv64_instruction_cache.head);
-        list_remove(&rv64_instruction_cache, &cache_item->item);
-        safe_free(cache_item);
-    }
-
     rv64_tlb_done(&cpu->tlb);
 }
 
+/**
+ * @brief Save the CPU state into a checkpoint
+ *
+ * The TLB and the last translations only cache the page tables in memory, they are not saved.
+ */
+bool rv64_cpu_save(rv64_cpu_t *cpu, checkpoint_t *ckpt)
+{
+    ASSERT(cpu != NULL);
+
+    return checkpoint_write_var(ckpt, cpu->regs)
+            && checkpoint_write_var(ckpt, cpu->csr)
+            && checkpoint_write_var(ckpt, cpu->pc)
+            && checkpoint_write_var(ckpt, cpu->pc_next)
+            && checkpoint_write_var(ckpt, cpu->priv_mode)
+            && checkpoint_write_var(ckpt, cpu->stdby);
+}
+
+/**
+ * @brief Load the CPU state from a checkpoint
+ *
+ * An LR reservation is not restored, so the next SC fails as if the reservation was broken.
+ */
+bool rv64_cpu_load(rv64_cpu_t *cpu, checkpoint_t *ckpt)
+{
+    ASSERT(cpu != NULL);
+
+    // The replay source is not a part of the state
+    unsigned int mtime_replay = cpu->csr.mtime_replay;
+
+    bool ok = checkpoint_read_var(ckpt, cpu->regs)
+            && checkpoint_read_var(ckpt, cpu->csr)
+            && checkpoint_read_var(ckpt, cpu->pc)
+            && checkpoint_read_var(ckpt, cpu->pc_next)
+            && checkpoint_read_var(ckpt, cpu->priv_mode)
+            && checkpoint_read_var(ckpt, cpu->stdby);
+
+    cpu->reserved_valid = false;
+    sc_unregister(cpu->csr.mhartid);
+
+    rv64_tlb_flush(&cpu->tlb);
+    rv_walk_cache_flush(cpu);
+    rv_utlb_flush(cpu);
+    rv_fetch_cache_flush(cpu);
+    intr_latency_sync(&cpu->intr_latency, rv_csr_effective_mip(cpu));
+
+    // The host clock continues from the saved mtime
+    cpu->csr.mtime_replay = mtime_replay;
+    cpu->csr.last_tick_time = replay_value(mtime_replay, current_timestamp());
+
+    return ok;
+}
+
 // static_assert((sizeof(sv32_pte_t) == 4), "wrong size of sv32_pte_t");
 
 /**
@@ -200,7 +251,11 @@ ptr55_t sv39_make_phys_from_ppn(virt_t virt, sv39_pte_t pte, sv39_page_type_t pa
     // return pte_ppn2 | pte_ppn1 | phys_ppn0 | page_offset;
 }
 
+/** Physical memory protection checks */
+#include "../riscv_rv_ima/pmp.c"
+
 #define page_fault_exception (fetch ? rv_exc_instruction_page_fault : (wr ? rv_exc_store_amo_page_fault : rv_exc_load_page_fault))
+#define access_fault_exception (fetch ? rv_exc_instruction_access_fault : (wr ? rv_exc_store_amo_access_fault : rv_exc_load_access_fault))
 
 static inline bool rv64_pte_access_dirty_update_needed(sv39_pte_t pte, bool wr)
 {
@@ -208,92 +263,149 @@ static inline bool rv64_pte_access_dirty_update_needed(sv39_pte_t pte, bool wr)
 }
 
 /**
- * @brief Tranlates the virtual address to physical by Sv39 memory translation algorithm, modifying the pagetable by doing so (setting the Accessed and Dirty bits and populating the TLB)
+ * @brief Sets the A (and D) bits of a leaf PTE cached by the TLB in place
+ *
+ * The PTE is read again and written only if it still maps the page the same
+ * way (another hart may have set its A and D bits meanwhile), otherwise the
+ * page has to be walked again.
  *
+ * @return false if the PTE in the memory has changed, the updated PTE is stored into pte otherwise
  */
-static rv_exc_t rv64_pagewalk(rv64_cpu_t *cpu, uint64_t virt, ptr55_t *phys, bool wr, bool fetch, bool noisy)
+static bool rv64_update_pte_ad(rv64_cpu_t *cpu, ptr55_t pte_addr, sv39_pte_t *pte, bool wr)
 {
-    uint64_t vpn0 = (virt & 0x0000001FF000ULL) >> 12; // Bits 12-20
-    uint64_t vpn1 = (virt & 0x00003FE00000ULL) >> 21; // Bits 21-29
-    uint64_t vpn2 = (virt & 0x007FC0000000ULL) >> 30; // Bits 30-38
-    uint64_t ppn = rv_csr_satp_ppn(cpu);
+    sv39_pte_t ad = { 0 };
+    ad.a = 1;
+    ad.d = 1;
+
+    // The walk raises the access fault
+    if (!rv_pmp_allows(cpu, pte_addr, RV64_PTESIZE, rv_csr_pmpcfg_w_mask, rv_smode)) {
+        return false;
+    }
 
-    ptr55_t a = ((ptr55_t) ppn) << RV64_PAGESIZE;
-    ptr55_t pte_addr = a + vpn2 * RV64_PTESIZE;
+    uint64_t ad_mask = sv39_uint_from_pte(ad);
+    uint64_t current = physmem_read64(cpu->csr.mhartid, pte_addr, true);
 
-    // PMP or PMA check goes here if implemented
-    uint64_t pte_val = physmem_read64(cpu->csr.mhartid, pte_addr, noisy);
+    if ((current & ~ad_mask) != (sv39_uint_from_pte(*pte) & ~ad_mask)) {
+        return false;
+    }
 
-    sv39_pte_t pte = sv39_pte_from_uint(pte_val);
+    sv39_pte_t updated = sv39_pte_from_uint(current);
+    updated.a = 1;
+    updated.d |= wr ? 1 : 0;
 
-    if (!sv39_is_pte_valid(pte)) {
-        return page_fault_exception;
+    physmem_write64(cpu->csr.mhartid, pte_addr, sv39_uint_from_pte(updated), true);
+    cpu->ad_updates++;
+
+    *pte = updated;
+    return true;
+}
+
+/**
+ * @brief Reads a PTE, directly from the host memory if the frame holding the page table allows that
+ */
+static inline uint64_t rv64_read_pte(rv64_cpu_t *cpu, frame_t *frame, ptr55_t pte_addr, bool noisy)
+{
+    if ((frame != NULL) && ((frame->direct & FRAME_DIRECT_READ) != 0)) {
+        return convert_uint64_t_endian(*((uint64_t *) (frame->data + (pte_addr & FRAME_MASK))));
     }
 
-    sv39_page_type_t page_type;
+    return physmem_read64(cpu->csr.mhartid, pte_addr, noisy);
+}
+
+/**
+ * @brief Tranlates the virtual address to physical by Sv39 memory translation algorithm, modifying the pagetable by doing so (setting the Accessed and Dirty bits and populating the TLB)
+ *
+ * The walk starts below the deepest non-leaf PTE found in the page walk
+ * cache, which usually leaves just the leaf PTE to be read.
+ */
+static rv_exc_t rv64_pagewalk(rv64_cpu_t *cpu, uint64_t virt, ptr55_t *phys, bool wr, bool fetch, bool noisy)
+{
+    uint64_t vpn[3] = {
+        (virt & 0x0000001FF000ULL) >> 12, // Bits 12-20
+        (virt & 0x00003FE00000ULL) >> 21, // Bits 21-29
+        (virt & 0x007FC0000000ULL) >> 30 // Bits 30-38
+    };
+    unsigned asid = rv_csr_satp_asid(cpu);
+
+    ptr55_t a = ((ptr55_t) rv_csr_satp_ppn(cpu)) << RV64_PAGESIZE;
+    frame_t *frame = NULL;
     bool is_global = false;
+    int level = 2;
 
-    if (sv39_is_pte_leaf(pte)) {
-        // First level
-        // Gigapage
+    rv64_walk_entry_t *entry = rv64_walk_cache_find(&cpu->walk_cache, rv64_walk_middle, asid, virt);
 
-        // Misaligned gigapage, both PPN0 and PPN1 must be zero
-        if (sv39_pte_ppn0(pte) != 0 || sv39_pte_ppn1(pte) != 0) {
-            return page_fault_exception;
+    if (entry != NULL) {
+        level = 0;
+    } else {
+        entry = rv64_walk_cache_find(&cpu->walk_cache, rv64_walk_root, asid, virt);
+        level = (entry != NULL) ? 1 : 2;
+    }
+
+    if (noisy) {
+        cpu->walks++;
+
+        if (entry != NULL) {
+            cpu->walk_cache_hits++;
         }
+    }
 
-        page_type = gigapage;
-        is_global = pte.g;
-    } else {
-        // Second level
-        // Non leaf PTE, make second translation step
+    if (entry != NULL) {
+        a = entry->table;
+        frame = entry->frame;
+        is_global = entry->global;
+    }
 
-        // PMP or PMA check goes here if implemented
-        a = sv39_pte_ppn_phys(pte);
-        pte_addr = a + vpn1 * RV64_PTESIZE;
+    ptr55_t pte_addr;
+    sv39_pte_t pte;
 
-        // Global non-leaf PTE implies that the translation is global
-        is_global = pte.g;
+    while (true) {
+        pte_addr = a + vpn[level] * RV64_PTESIZE;
 
-        pte_val = physmem_read64(cpu->csr.mhartid, pte_addr, noisy);
-        pte = sv39_pte_from_uint(pte_val);
+        // The page tables are accessed in S-mode
+        if (!rv_pmp_allows(cpu, pte_addr, RV64_PTESIZE, rv_csr_pmpcfg_r_mask, rv_smode)) {
+            return access_fault_exception;
+        }
+
+        pte = sv39_pte_from_uint(rv64_read_pte(cpu, frame, pte_addr, noisy));
+
+        if (noisy) {
+            cpu->walk_reads++;
+        }
 
         if (!sv39_is_pte_valid(pte)) {
             return page_fault_exception;
         }
 
-        if (sv39_is_pte_leaf(pte)) {
-            // This is a megapage
-
-            if (sv39_pte_ppn0(pte) != 0) {
-                return page_fault_exception;
-            }
-
-            page_type = megapage;
-            is_global |= pte.g;
-        } else {
-            // Third level
+        // Global non-leaf PTE implies that the translation is global
+        is_global |= pte.g;
 
-            is_global |= pte.g;
+        if (sv39_is_pte_leaf(pte)) {
+            break;
+        }
 
-            a = sv39_pte_ppn_phys(pte);
-            pte_addr = a + vpn0 * RV64_PTESIZE;
+        // Non-leaf page on last level means bad ):
+        if (level == 0) {
+            return page_fault_exception;
+        }
 
-            pte_val = physmem_read64(cpu->csr.mhartid, pte_addr, noisy);
-            pte = sv39_pte_from_uint(pte_val);
+        // Non leaf PTE, make next translation step
+        a = sv39_pte_ppn_phys(pte);
+        frame = NULL;
+        level--;
 
-            if (!sv39_is_pte_valid(pte)) {
-                return page_fault_exception;
-            }
+        if (noisy) {
+            rv64_walk_level_t cached = (level == 1) ? rv64_walk_root : rv64_walk_middle;
+            entry = rv64_walk_cache_add(&cpu->walk_cache, cached, asid, virt, a, is_global);
+            frame = entry->frame;
+        }
+    }
 
-            // Non-leaf page on last level means bad ):
-            if (!sv39_is_pte_leaf(pte)) {
-                return page_fault_exception;
-            }
+    sv39_page_type_t page_type = (level == 2) ? gigapage : ((level == 1) ? megapage : page);
 
-            page_type = page;
-            is_global |= pte.g;
-        }
+    // Misaligned gigapage (both PPN0 and PPN1 must be zero) or megapage
+    if ((page_type == gigapage && (sv39_pte_ppn0(pte) != 0 || sv39_pte_ppn1(pte) != 0))
+            || (page_type == megapage && sv39_pte_ppn0(pte) != 0)) {
+        return page_fault_exception;
     }
 
     if (!rv64_is_access_allowed(cpu, pte, wr, fetch)) {
@@ -306,17 +418,25 @@ static rv_exc_t rv64_pagewalk(rv64_cpu_t *cpu, uint64_t virt, ptr55_t *phys, boo
         pte.a = 1;
         pte.d |= wr ? 1 : 0;
 
-        pte_val = sv39_uint_from_pte(pte);
+        uint64_t pte_val = sv39_uint_from_pte(pte);
 
         if (noisy) {
+            if (!rv_pmp_allows(cpu, pte_addr, RV64_PTESIZE, rv_csr_pmpcfg_w_mask, rv_smode)) {
+                return access_fault_exception;
+            }
+
             physmem_write64(cpu->csr.mhartid, pte_addr, pte_val, true);
+            cpu->ad_updates++;
         }
     }
 
     *phys = sv39_make_phys_from_ppn(virt, pte, page_type);
 
-    // Add the leaf PTE of the translation to the TLB
-    rv64_tlb_add_mapping(&cpu->tlb, rv_csr_satp_asid(cpu), virt, pte, page_type, is_global);
+    // Add the leaf PTE of the translation to the TLB, a quiet walk
+    // leaves it alone (its A and D bits have not been written)
+    if (noisy) {
+        rv64_tlb_add_mapping(&cpu->tlb, asid, virt, pte, page_type, is_global, pte_addr);
+    }
 
     return rv_exc_none;
 }
@@ -349,12 +469,26 @@ static rv_exc_t rv_convert_addr(rv_cpu_t *cpu, virt_t virt, ptr36_t *phys, bool
         return rv_exc_none;
     }
 
+    if (cpu->tlb.context_changed) {
+        rv64_tlb_set_context(&cpu->tlb, sv39_effective_priv(cpu) == rv_umode,
+                rv_csr_sstatus_sum(cpu), rv_csr_sstatus_mxr(cpu));
+    }
+
     unsigned asid = rv_csr_satp_asid(cpu);
     sv39_pte_t pte;
     sv39_page_type_t page_type;
+    ptr55_t pte_addr;
+    unsigned access = fetch ? RV64_TLB_ALLOW_EXEC : (wr ? RV64_TLB_ALLOW_WRITE : RV64_TLB_ALLOW_READ);
+    unsigned allowed;
 
     // First try the TLB
-    if (rv64_tlb_get_mapping(&cpu->tlb, asid, virt, &pte, &page_type, true)) {
+    if (rv64_tlb_get_mapping(&cpu->tlb, asid, virt, &pte, &page_type, &pte_addr, &allowed, noisy)) {
+        // The access needs neither a fault nor an update of the A and D bits
+        if ((allowed & access) != 0) {
+            *phys = sv39_make_phys_from_ppn(virt, pte, page_type);
+            return rv_exc_none;
+        }
+
         if (!sv39_is_pte_valid(pte)) {
             return page_fault_exception;
         }
@@ -370,16 +504,24 @@ static rv_exc_t rv_convert_addr(rv_cpu_t *cpu, virt_t virt, ptr36_t *phys, bool
         }
 
         // If the A and D bits of the PTE do not need to be updated, we can use the cached result
-        if (!rv64_pte_access_dirty_update_needed(pte, wr)) {
+        // (a quiet translation would not update them anyway)
+        if (!rv64_pte_access_dirty_update_needed(pte, wr) || !noisy) {
+            *phys = sv39_make_phys_from_ppn(virt, pte, page_type);
+            return rv_exc_none;
+        }
+
+        // Otherwise update them in place, unless the PTE has changed under the TLB
+        if (rv64_update_pte_ad(cpu, pte_addr, &pte, wr)) {
+            rv64_tlb_update_mapping(&cpu->tlb, asid, virt, pte);
             *phys = sv39_make_phys_from_ppn(virt, pte, page_type);
             return rv_exc_none;
-        } else {
-            // Flush stale entry from cache
-            rv64_tlb_remove_mapping(&cpu->tlb, asid, virt);
         }
+
+        // Flush stale entry from cache
+        rv64_tlb_remove_mapping(&cpu->tlb, asid, virt);
     }
 
-    // If the TLB lookup failed or if the AD bits need to be updated, perform the full pagewalk
+    // If the TLB lookup failed or if the PTE has changed, perform the full pagewalk
     return rv64_pagewalk(cpu, virt, phys, wr, fetch, noisy);
 }
 
@@ -394,90 +536,231 @@ rv_exc_t rv64_convert_addr(rv64_cpu_t *cpu, virt_t virt, ptr36_t *phys, bool wr,
 #include "instr.c"
 
 /**
- * @brief Fills the cache_item instrs field with decoded data based on the addr field
+ * @brief Tells whether the instruction can be executed as a part of a block
+ *
+ * Such instructions do not change the control flow,
+ * the privilege mode, the CSRs or the address translation.
  */
-static void cache_item_page_decode(rv64_cpu_t *cpu, cache_item_t *cache_item)
+static bool is_straight_line(rv_instr_t instr)
 {
-    for (size_t i = 0; i < FRAME_SIZE / sizeof(rv_instr_t); ++i) {
-        ptr36_t addr = cache_item->addr + (i * sizeof(rv_instr_t));
-        rv_instr_t instr_data = (rv_instr_t) physmem_read32(cpu->csr.mhartid, addr, false);
-        cache_item->instrs[i] = rv64_instr_decode(instr_data);
+    switch (instr.r.opcode) {
+    case rv_opcLOAD:
+    case rv_opcOP_IMM:
+    case rv_opcAUIPC:
+    case rv_opcSTORE:
+    case rv_opcAMO:
+    case rv_opcOP:
+    case rv_opcLUI:
+    case rv_opcOP_32:
+    case rv_opcOP_IMM_32:
+        return true;
+    default:
+        return false;
     }
 }
 
 /**
- * @brief Updates the cache item to represent the data in memory
+ * @brief Counts the execution into the instruction mix and executes the instruction
+ *
+ * Stored in the decoded pages in place of the instruction
+ * implementations while the mixstat variable is set.
  */
-static void update_cache_item(rv64_cpu_t *cpu, cache_item_t *cache_item)
+static rv_exc_t mixstat_instr(rv_cpu_t *cpu, rv_instr_t instr)
 {
-    frame_t *frame = physmem_find_frame(cache_item->addr);
-    ASSERT(frame != NULL);
+    rv_instr_func_t func = rv64_instr_decode(instr);
+    mixstat_count(&cpu->mix, (mixstat_handler_t) func, instr.val);
 
-    if (frame->valid) {
-        return;
+    if (callstack_enabled) {
+        func = rv_instr_callstack(func, instr);
+    }
+
+    return func(cpu, instr);
+}
+
+/**
+ * @brief Returns the function executing the instruction (a specialized variant if there is one)
+ *
+ * The calls and the returns are executed by their variants keeping
+ * the shadow call stacks while the callstacks variable is set.
+ */
+static rv_instr_func_t dispatch_decode(rv_instr_t instr)
+{
+    if (mixstat_enabled) {
+        return mixstat_instr;
     }
 
-    cache_item_page_decode(cpu, cache_item);
+    rv_instr_func_t func = rv_instr_specialize(rv64_instr_decode(instr), instr);
+    return callstack_enabled ? rv_instr_callstack(func, instr) : func;
+}
+
+/**
+ * @brief Returns the implementation of a decoded instruction, decoding it on its first fetch
+ */
+static inline rv_instr_func_t lazy_decode(cache_instr_t *instr)
+{
+    // Decoded by any of the processors running in parallel
+    uint16_t handler = __atomic_load_n(&instr->handler, __ATOMIC_ACQUIRE);
+
+    if (handler == 0) {
+        handler = decode_handler_index(DECODE_RV64, (decode_handler_t) dispatch_decode(instr->data));
+        __atomic_store_n(&instr->handler, handler, __ATOMIC_RELEASE);
+    }
 
-    frame->valid = true;
-    return;
+    return (rv_instr_func_t) decode_handler(DECODE_RV64, handler);
 }
 
+#include "../riscv_rv_ima/fusion.c"
+#include "../riscv_rv_ima/jit.c"
+
 /**
- * @brief Tries to add a new entry to the cache based on the given address
+ * @brief Fills the cache_item instrs field with the instructions of the written chunks of the frame
  *
- * @return cache_item_t* the added intem or NULL, if the address does not lead to valid memory area
+ * The instruction words of the chunks (see decode_cache_written()) are read
+ * directly from the frame, the instructions are decoded only once fetched.
  */
-static cache_item_t *cache_try_add(rv64_cpu_t *cpu, ptr36_t phys)
+static void cache_item_page_decode(decoded_page_t *page, frame_t *frame, uint64_t chunks)
 {
-    frame_t *frame = physmem_find_frame(phys);
-    if (frame == NULL) {
-        return NULL;
+    cache_item_t *cache_item = (cache_item_t *) page;
+    const uint32_t *words = (const uint32_t *) frame->data;
+    size_t per_chunk = DECODE_CHUNK_SIZE / sizeof(rv_instr_t);
+
+    for (uint64_t todo = chunks; todo != 0; todo &= todo - 1) {
+        size_t first = __builtin_ctzll(todo) * per_chunk;
+
+        for (size_t i = first; i < first + per_chunk; ++i) {
+            cache_item->instrs[i].data.val = convert_uint32_t_endian(words[i]);
+            cache_item->instrs[i].handler = 0;
+            cache_item->heat[i] = 0;
+        }
     }
 
-    cache_item_t *cache_item = safe_malloc(sizeof(cache_item_t));
+    // Compute the straight-line runs backwards from the end of the last
+    // written chunk, the last instruction of the page is never part of a run.
+    // Below the written chunks, the runs are computed only until one of them
+    // stays the same.
+    size_t last = FRAME_SIZE / sizeof(rv_instr_t) - 1;
+    size_t low = __builtin_ctzll(chunks) * per_chunk;
+    size_t high = (64 - __builtin_clzll(chunks)) * per_chunk - 1;
 
-    cache_item_init(cache_item);
-    cache_item->addr = ALIGN_DOWN(phys, FRAME_SIZE);
+    for (size_t i = high + 1; i-- > 0;) {
+        uint16_t run = 0;
 
-    list_push(&rv64_instruction_cache, &cache_item->item);
+        if ((i < last) && (is_straight_line(cache_item->instrs[i].data))) {
+            run = cache_item->instrs[i + 1].run + 1;
+        }
 
-    cache_item_page_decode(cpu, cache_item);
+        // The pair may end in the written chunks even when the run stays the same
+        cache_item->instrs[i].fused = (i < last)
+                ? rv_fusion_kind(cache_item->instrs[i].data, cache_item->instrs[i + 1].data)
+                : rv_fused_none;
 
-    frame->valid = true;
-    return cache_item;
+        if ((i < low) && (cache_item->instrs[i].run == run)) {
+            // The blocks starting below still reach the written chunks
+            for (size_t j = i + 1; (j-- > 0) && (cache_item->instrs[j].run > 0);) {
+                cache_item->heat[j] = 0;
+            }
+            break;
+        }
+
+        cache_item->instrs[i].run = run;
+        cache_item->heat[i] = 0;
+    }
 }
 
 /**
- * @brief Fethes a decoded instruction from memory
+ * @brief Decodes a whole page together with the implementations of all its instructions
+ *
+ * Used to pre-decode the loaded images (see decode_cache_predecode()),
+ * possibly by several host threads at once.
+ */
+static void cache_item_page_predecode(decoded_page_t *page, frame_t *frame, uint64_t chunks)
+{
+    cache_item_t *cache_item = (cache_item_t *) page;
+
+    cache_item_page_decode(page, frame, chunks);
+
+    for (size_t i = 0; i < FRAME_SIZE / sizeof(rv_instr_t); ++i) {
+        lazy_decode(&cache_item->instrs[i]);
+    }
+}
+
+/**
+ * @brief Prepares a page restored from the decoded page file
  *
- * Consults the cache first and updates the cache on misses or on invalid memory
+ * The blocks translated by the run which stored the page are translated
+ * on their first execution. They are not looked up, the translation kept
+ * at the place of the page may be of another page evicted before.
  */
-static rv_instr_func_t fetch_instr(rv64_cpu_t *cpu, ptr36_t phys)
+static void cache_item_page_restore(decoded_page_t *page)
 {
-    cache_item_t *cache_item = NULL;
+    cache_item_t *cache_item = (cache_item_t *) page;
+
+    for (size_t i = 0; i < FRAME_SIZE / sizeof(rv_instr_t); ++i) {
+        if (cache_item->heat[i] == RV_JIT_TRANSLATED) {
+            cache_item->heat[i] = RV_JIT_TRANSLATED - 1;
+        }
+    }
+}
 
-    if (cache_hit(phys, &cache_item)) {
-        ASSERT(cache_item != NULL);
-        update_cache_item(cpu, cache_item);
+/**
+ * @brief Returns the up-to-date decoded page of the frame
+ *
+ * The decoded page is reached directly from the frame found by the
+ * frame table walk. A page is decoded again when its frame has been
+ * written to since the last decode (see decode_cache_renew()).
+ */
+static cache_item_t *fetch_page(rv64_cpu_t *cpu, frame_t *frame, ptr36_t phys)
+{
+    cache_item_t *cache_item = (cache_item_t *) frame->decoded[DECODE_RV64];
+
+    if (cache_item == NULL) {
+        cpu->decode_stats.misses++;
+        profile_region_enter(PROFILE_DECODE);
+        cache_item = (cache_item_t *) decode_cache_alloc(DECODE_RV64, frame, sizeof(cache_item_t),
+                cache_item_page_decode);
+        profile_region_leave();
+    } else if (cache_item->header.generation != frame->generation) {
+        cpu->decode_stats.redecodes++;
+        profile_region_enter(PROFILE_DECODE);
+        cache_item = (cache_item_t *) decode_cache_renew(&cache_item->header, cache_item_page_decode);
+        profile_region_leave();
+        decode_cache_touch(&cache_item->header);
+    } else {
+        cpu->decode_stats.hits++;
+        decode_cache_touch(&cache_item->header);
+    }
 
-        // Move item to front of list on hit
+    return cache_item;
+}
 
-        if (rv64_instruction_cache.head != &cache_item->item) {
-            list_remove(&rv64_instruction_cache, &cache_item->item);
-            list_push(&rv64_instruction_cache, &cache_item->item);
+/**
+ * @brief Fethes a decoded instruction from memory
+ *
+ * The instruction word is stored next to the decoded instruction,
+ * so it is returned through instr_data without reading the memory again.
+ * The frame holding the address is looked up by the caller (NULL outside of memory).
+ */
+static rv_instr_func_t fetch_instr(rv64_cpu_t *cpu, frame_t *frame, ptr36_t phys, rv_instr_t *instr_data)
+{
+    if (frame == NULL) {
+        if (++cpu->fetch_outside <= cpu_fetch_alerts) {
+            alert("Trying to fetch instructions from outside of physical memory");
         }
 
-        return cache_item->instrs[PHYS2CACHEINSTR(phys)];
+        *instr_data = (rv_instr_t) physmem_read32(cpu->csr.mhartid, phys, true);
+        return dispatch_decode(*instr_data);
     }
 
-    cache_item = cache_try_add(cpu, phys);
+    cache_item_t *cache_item = fetch_page(cpu, frame, phys);
 
-    if (cache_item != NULL) {
-        return cache_item->instrs[PHYS2CACHEINSTR(phys)];
+    // The fetch is still subject to memory read breakpoints
+    if (frame->watchpoints > 0) {
+        physmem_read32(cpu->csr.mhartid, phys, true);
     }
-    alert("Trying to fetch instructions from outside of physical memory");
-    return rv64_instr_decode((rv_instr_t) physmem_read32(cpu->csr.mhartid, phys, true));
+
+    cache_instr_t *instr = &cache_item->instrs[PHYS2CACHEINSTR(phys)];
+    *instr_data = instr->data;
+    return lazy_decode(instr);
 }
 
 /**
@@ -499,6 +782,22 @@ void rv64_cpu_set_pc(rv64_cpu_t *cpu, uint64_t value)
     cpu->pc_next = value + 4;
 }
 
+/**
+ * @brief Records a trap as a system event (see the events variable)
+ */
+static void trace_trap(rv_cpu_t *cpu, rv_exc_t ex)
+{
+    bool is_interrupt = ex & RV_INTERRUPT_EXC_BITS;
+
+    trace_event(cpu->csr.mhartid, TRACE_ARCH_RV64,
+            is_interrupt ? TRACE_EVENT_INTERRUPT : TRACE_EVENT_EXCEPTION,
+            ex & ~RV_INTERRUPT_EXC_BITS, is_interrupt ? cpu->pc_next : cpu->pc);
+
+    if (!is_interrupt) {
+        trace_event_arg(cpu->csr.tval_next);
+    }
+}
+
 /**
  * @brief Trap to M mode
  *
@@ -511,31 +810,43 @@ static void m_trap(rv64_cpu_t *cpu, rv_exc_t ex)
     bool is_interrupt = ex & RV_INTERRUPT_EXC_BITS;
     cpu->stdby = false;
 
+    if (is_interrupt) {
+        intr_latency_take(&cpu->intr_latency, ex & ~RV_INTERRUPT_EXC_BITS);
+    }
+
+    if (catchpoint_armed(cpu->csr.mhartid, is_interrupt ? CATCH_INTERRUPT : CATCH_EXCEPTION)) {
+        catchpoint_trap(cpu->csr.mhartid, is_interrupt, ex & ~RV_INTERRUPT_EXC_BITS);
+    }
+
+    if (trace_events) {
+        trace_trap(cpu, ex);
+    }
+
+    if ((usermode_enabled) && (!is_interrupt)) {
+        usermode_fault(ex, cpu->pc);
+    }
+
     cpu->csr.mepc = is_interrupt ? cpu->pc_next : cpu->pc;
     cpu->csr.mcause = ex;
     cpu->csr.mtval = cpu->csr.tval_next;
 
-    // MPIE = MIE
-    {
-        bool mie_set = rv_csr_mstatus_mie(cpu);
+    // MPIE = MIE, MIE = 0, MPP = cpu->priv_mode, all in one update
+    uint64_t mstatus = cpu->csr.mstatus
+            & ~(uint64_t) (rv_csr_mstatus_mpie_mask | rv_csr_mstatus_mie_mask | rv_csr_mstatus_mpp_mask);
 
-        if (mie_set) {
-            cpu->csr.mstatus |= rv_csr_mstatus_mpie_mask;
-        } else {
-            cpu->csr.mstatus &= ~rv_csr_mstatus_mpie_mask;
-        }
-    }
-    // MIE = 0
-    {
-        cpu->csr.mstatus &= ~rv_csr_mstatus_mie_mask;
-    }
-    // MPP = cpu->priv_mode
-    {
-        cpu->csr.mstatus &= ~rv_csr_mstatus_mpp_mask;
-        cpu->csr.mstatus |= ((uint64_t) cpu->priv_mode << rv_csr_mstatus_mpp_pos) & rv_csr_mstatus_mpp_mask;
+    if (rv_csr_mstatus_mie(cpu)) {
+        mstatus |= rv_csr_mstatus_mpie_mask;
     }
 
+    cpu->csr.mstatus = mstatus
+            | (((uint64_t) cpu->priv_mode << rv_csr_mstatus_mpp_pos) & rv_csr_mstatus_mpp_mask);
+
     cpu->priv_mode = rv_mmode;
+    rv_utlb_flush(cpu);
+
+    if (catchpoint_armed(cpu->csr.mhartid, CATCH_MODE)) {
+        catchpoint_mode(cpu->csr.mhartid);
+    }
 
     int mode = cpu->csr.mtvec & rv_csr_mtvec_mode_mask;
     uint64_t base = cpu->csr.mtvec & ~rv_csr_mtvec_mode_mask;
@@ -565,31 +876,39 @@ static void s_trap(rv64_cpu_t *cpu, rv_exc_t ex)
     bool is_interrupt = ex & RV_INTERRUPT_EXC_BITS;
     cpu->stdby = false;
 
+    if (is_interrupt) {
+        intr_latency_take(&cpu->intr_latency, ex & ~RV_INTERRUPT_EXC_BITS);
+    }
+
+    if (catchpoint_armed(cpu->csr.mhartid, is_interrupt ? CATCH_INTERRUPT : CATCH_EXCEPTION)) {
+        catchpoint_trap(cpu->csr.mhartid, is_interrupt, ex & ~RV_INTERRUPT_EXC_BITS);
+    }
+
+    if (trace_events) {
+        trace_trap(cpu, ex);
+    }
+
     cpu->csr.sepc = is_interrupt ? cpu->pc_next : cpu->pc;
     cpu->csr.scause = ex;
     cpu->csr.stval = cpu->csr.tval_next;
 
-    // SPIE = SIE
-    {
-        bool sie_set = rv_csr_sstatus_sie(cpu);
+    // SPIE = SIE, SIE = 0, SPP = cpu->priv_mode, all in one update
+    uint64_t mstatus = cpu->csr.mstatus
+            & ~(uint64_t) (rv_csr_sstatus_spie_mask | rv_csr_sstatus_sie_mask | rv_csr_sstatus_spp_mask);
 
-        if (sie_set) {
-            cpu->csr.mstatus |= rv_csr_sstatus_spie_mask;
-        } else {
-            cpu->csr.mstatus &= ~rv_csr_sstatus_spie_mask;
-        }
-    }
-    // SIE = 0
-    {
-        cpu->csr.mstatus &= ~rv_csr_sstatus_sie_mask;
-    }
-    // SPP = cpu->priv_mode
-    {
-        cpu->csr.mstatus &= ~rv_csr_sstatus_spp_mask;
-        cpu->csr.mstatus |= ((uint64_t) cpu->priv_mode << rv_csr_sstatus_spp_pos) & rv_csr_sstatus_spp_mask;
+    if (rv_csr_sstatus_sie(cpu)) {
+        mstatus |= rv_csr_sstatus_spie_mask;
     }
 
+    cpu->csr.mstatus = mstatus
+            | (((uint64_t) cpu->priv_mode << rv_csr_sstatus_spp_pos) & rv_csr_sstatus_spp_mask);
+
     cpu->priv_mode = rv_smode;
+    rv_utlb_flush(cpu);
+
+    if (catchpoint_armed(cpu->csr.mhartid, CATCH_MODE)) {
+        catchpoint_mode(cpu->csr.mhartid);
+    }
 
     int mode = cpu->csr.stvec & rv_csr_mtvec_mode_mask;
     virt_t base = cpu->csr.stvec & ~rv_csr_mtvec_mode_mask;
@@ -632,17 +951,14 @@ static void handle_exception(rv64_cpu_t *cpu, rv_exc_t ex)
  */
 static void try_handle_interrupt(rv64_cpu_t *cpu)
 {
-    // Effective mip includes the external SEIP
-    // Full explanation RISC-V Privileged spec section 3.1.9 Machine Interrupt Registers (mip and mie)
-    uint64_t mip = cpu->csr.mip
-            | (cpu->csr.external_SEIP ? rv_csr_sei_mask : 0)
-            | (cpu->csr.external_STIP ? rv_csr_sti_mask : 0);
-
-    // no interrupt pending
-    if (mip == 0) {
+    // Nothing to do unless an enabled interrupt is pending,
+    // the privilege mode and the delegation are checked below
+    if (!cpu->csr.interrupts_pending) {
         return;
     }
 
+    uint64_t mip = rv_csr_effective_mip(cpu);
+
 // PRIORITY: MEI, MSI, MTI, SEI, SSI, STI
 #define trap_if_set(cpu, mask, interrupt, trap_func) \
     if (mask & RV_EXCEPTION_MASK(interrupt)) { \
@@ -696,52 +1012,34 @@ static void try_handle_interrupt(rv64_cpu_t *cpu)
 #undef trap_if_set
 }
 
+static_assert((hpm_u_cycles == rv_umode + 1) && (hpm_s_cycles == rv_smode + 1) && (hpm_m_cycles == rv_mmode + 1),
+        "HPM cycle events do not follow the privilege modes");
+
 /**
- * @brief Increases the HPM counters based in the event specifying CSRs
+ * @brief Increases the HPM counters attached to the current events
+ *
+ * Only the counters listed in the per-event bitmaps are touched,
+ * so nothing is done unless some HPM event is configured. The cycles
+ * of the privilege modes and of the standby are counted always.
  *
  * @param cpu The cpu on which these counters are
- * @param i The index of the HPM in range [0..29)
+ * @param count The number of cycles to account
  */
-static void account_hmp(rv64_cpu_t *cpu, int i)
+static void account_hpm(rv64_cpu_t *cpu, uint64_t count)
 {
-    ASSERT((i >= 0 && i < 29));
+    uint32_t counters = cpu->csr.hpm_event_counters[cpu->priv_mode + 1];
 
-    uint64_t mask = (1 << (i + 3));
-    bool inhibited = cpu->csr.mcountinhibit & mask;
-
-    if (inhibited) {
-        return;
+    if (cpu->stdby) {
+        counters |= cpu->csr.hpm_event_counters[hpm_w_cycles];
+        cpu->wait_cycles += count;
+    } else {
+        cpu->mode_cycles[cpu->priv_mode] += count;
     }
 
-    rv_csr_hpm_event_t event = cpu->csr.hpmevents[i];
-
-    switch (event) {
-    case (hpm_u_cycles): {
-        if (cpu->priv_mode == rv_umode) {
-            cpu->csr.hpmcounters[i]++;
-        }
-        break;
-    }
-    case (hpm_s_cycles): {
-        if (cpu->priv_mode == rv_smode) {
-            cpu->csr.hpmcounters[i]++;
-        }
-        break;
-    }
-    case (hpm_m_cycles): {
-        if (cpu->priv_mode == rv_mmode) {
-            cpu->csr.hpmcounters[i]++;
+    for (int i = 0; counters != 0; ++i, counters >>= 1) {
+        if (counters & 1) {
+            cpu->csr.hpmcounters[i] += count;
         }
-        break;
-    }
-    case (hpm_w_cycles): {
-        if (cpu->stdby) {
-            cpu->csr.hpmcounters[i]++;
-        }
-        break;
-    }
-    default:
-        break;
     }
 }
 
@@ -752,9 +1050,45 @@ static void account_hmp(rv64_cpu_t *cpu, int i)
 static void manage_timer_interrupts(rv64_cpu_t *cpu)
 {
     // raise or clear scyclecmp ESTIP
-    cpu->csr.external_STIP = cpu->csr.cycle >= cpu->csr.scyclecmp;
+    bool stip = cpu->csr.cycle >= cpu->csr.scyclecmp;
+
+    if (stip != cpu->csr.external_STIP) {
+        cpu->csr.external_STIP = stip;
+        rv_csr_update_interrupts_pending(cpu);
+    }
+
+    // mtimecmp MTIP changes only at the mtime ticks (see advance_mtime)
+}
+
+/**
+ * @brief Advance mtime by the given number of cycles
+ *
+ * The host clock is only sampled once every mtime_period cycles,
+ * the virtual clock advances by one every mtime_period cycles.
+ * MTIP is updated at these ticks only, so the cycles in between
+ * do not compare mtime with mtimecmp (the writes of mtime and
+ * mtimecmp update MTIP themselves).
+ */
+static void advance_mtime(rv64_cpu_t *cpu, unsigned int cycles)
+{
+    rv_csr_t *csr = &cpu->csr;
+
+    if (csr->mtime_countdown > cycles) {
+        csr->mtime_countdown -= cycles;
+        return;
+    }
+
+    unsigned int overrun = cycles - csr->mtime_countdown;
+    csr->mtime_countdown = csr->mtime_period - (overrun % csr->mtime_period);
+
+    if (csr->mtime_source == rv_mtime_virtual) {
+        csr->mtime += 1 + (overrun / csr->mtime_period);
+    } else {
+        uint64_t current_tick_time = replay_value(csr->mtime_replay, current_timestamp());
+        csr->mtime += (current_tick_time - csr->last_tick_time);
+        csr->last_tick_time = current_tick_time;
+    }
 
-    // raise or clear mtimecmp MTIP
     handle_mtip(cpu);
 }
 
@@ -768,47 +1102,355 @@ static void account(rv64_cpu_t *cpu, bool instruction_retired)
     }
 
     // mtime cannot be inhibited
-    uint64_t current_tick_time = current_timestamp();
-    cpu->csr.mtime += (current_tick_time - cpu->csr.last_tick_time);
-    cpu->csr.last_tick_time = current_tick_time;
+    advance_mtime(cpu, 1);
 
     if (!(cpu->csr.mcountinhibit & 0b100) && instruction_retired) {
         cpu->csr.instret++;
     }
 
-    for (int i = 0; i < 29; ++i) {
-        account_hmp(cpu, i);
-    }
+    account_hpm(cpu, 1);
 
     manage_timer_interrupts(cpu);
 }
 
 /**
- * @brief Execute the instruction that PC is pointing to and handle interrupts or exceptions
+ * @brief Increase the counter CSRs for instructions retired within a block
+ *
+ * Unlike account(), the timer interrupts are left
+ * to the account() call that finishes the step.
  */
-static rv_exc_t execute(rv64_cpu_t *cpu)
+static void account_block(rv64_cpu_t *cpu, unsigned int count)
 {
-    ptr36_t phys;
-    rv_exc_t ex = rv_convert_addr(cpu, cpu->pc, &phys, false, true, true);
+    if (!(cpu->csr.mcountinhibit & 0b001)) {
+        cpu->csr.cycle += count;
+    }
+
+    if (!(cpu->csr.mcountinhibit & 0b100)) {
+        cpu->csr.instret += count;
+    }
+
+    advance_mtime(cpu, count);
+
+    account_hpm(cpu, count);
+
+    cpu->block_instrs += count;
+
+    // The machine cycles catch up with the longest block of the cycle
+    if (machine_fast && !parallel_active && (count > machine_fast_ahead)) {
+        machine_fast_ahead = count;
+    }
+}
+
+/**
+ * @brief Maximal number of instructions of a block
+ *
+ * In the fast mode the blocks are used even if not configured.
+ */
+static unsigned int block_run_limit(rv64_cpu_t *cpu)
+{
+    if (machine_fast && (cpu->block_limit == 0)) {
+        return FRAME_SIZE / sizeof(rv_instr_t);
+    }
+
+    return cpu->block_limit;
+}
+
+/**
+ * @brief Tells whether the instruction that PC is pointing to is traced
+ */
+static bool instr_traced(rv64_cpu_t *cpu)
+{
+    return machine_trace
+            && trace_filter_hit(cpu->csr.mhartid, cpu->pc, cpu->priv_mode == rv_umode,
+                    rv_csr_satp_asid(cpu));
+}
+
+/**
+ * @brief Tells whether the step may execute a block of instructions
+ *
+ * Blocks are not used on traced pages or while the simulation is stepped,
+ * so that the debugging sees every instruction. As a block never
+ * leaves the page, it is also not used on pages with code breakpoints
+ * or while the PMP permissions change within a page (each fetch has to
+ * be checked then).
+ */
+static bool block_engine_active(rv64_cpu_t *cpu)
+{
+    ptr64_t pc;
+    pc.ptr = cpu->pc;
+
+    unsigned int limit = block_run_limit(cpu);
+
+    return (limit > 0)
+            && (!machine_trace
+                    || trace_page_quiet(cpu->csr.mhartid, cpu->pc, cpu->priv_mode == rv_umode,
+                            rv_csr_satp_asid(cpu), limit))
+            && !machine_interactive && (stepping == 0)
+            && !breakpoint_code_page_set(cpu->csr.mhartid, pc)
+            && !cpu->csr.pmp_fine;
+}
+
+/**
+ * @brief Tells whether a block may continue through the instruction to its target
+ *
+ * Branches and jumps change nothing but PC and the link register.
+ */
+static bool is_chainable(rv_instr_t instr)
+{
+    switch (instr.r.opcode) {
+    case rv_opcBRANCH:
+    case rv_opcJAL:
+    case rv_opcJALR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Executes a straight-line run of a block
+ *
+ * Hot runs are executed by their translated code (see the jit command).
+ * A run cut short by the block limit is interpreted, so that the run
+ * keeps a single translation (of its whole length). The translated run
+ * closed by a branch back to its start repeats itself, the passes before
+ * the last one are counted as the runs chained by execute_block().
+ *
+ * @param heat Executions of the run until translated (see rv_jit_code)
+ * @param room Most instructions the block may still execute
+ * @param done Number of the instructions finished, including the repeated passes
+ * @param ex Exception raised by the instruction following the finished ones
+ * @return false if the run was cut short
+ */
+static bool execute_run(rv64_cpu_t *cpu, frame_t *frame, cache_instr_t *instr, uint16_t *heat,
+        unsigned int run, unsigned int room, uint64_t generation, unsigned int *done, rv_exc_t *ex)
+{
+    cpu->blocks++;
+
+    jit_code_t code = NULL;
+    if ((cpu->jit_threshold > 0) && (run == instr->run) && !parallel_active && !mixstat_enabled) {
+        code = rv_jit_code(instr, heat, run, cpu->jit_threshold);
+    }
+
+    if (code != NULL) {
+        *done = room;
+        *ex = code(cpu, &frame->generation, done);
+        cpu->jit_blocks++;
+
+        unsigned int passes = *done / (run + 1);
+        cpu->blocks += passes;
+        cpu->block_chains += passes;
+
+        if (*ex == rv_exc_illegal_instruction) {
+            cpu->csr.tval_next = instr[*done % (run + 1)].data.val;
+        }
+
+        return (*done % (run + 1)) == run;
+    }
+
+    for (unsigned int i = 0; i < run; ++i, ++instr) {
+        if ((instr->fused != rv_fused_none) && (i + 1 < run)) {
+            rv_fused_execute(cpu, instr);
+            cpu->fused_pairs++;
+            cpu->pc += 2 * sizeof(rv_instr_t);
+            cpu->pc_next = cpu->pc + 4;
+            ++i;
+            ++instr;
+            continue;
+        }
+
+        *ex = lazy_decode(instr)(cpu, instr->data);
+
+        if (*ex == rv_exc_illegal_instruction) {
+            cpu->csr.tval_next = instr->data.val;
+        }
+
+        if ((*ex != rv_exc_none) || (frame->generation != generation) || machine_stopping()) {
+            *done = i;
+            return false;
+        }
+
+        cpu->pc = cpu->pc_next;
+        cpu->pc_next = cpu->pc + 4;
+        cpu->regs[0] = 0;
+        cpu->csr.tval_next = 0;
+    }
+
+    *done = run;
+    return true;
+}
+
+/**
+ * @brief Executes the straight-line runs of instructions at PC
+ *
+ * Each instruction is executed exactly as by its own step, except that
+ * interrupts are checked only once the block ends. A run ends before
+ * a branch, jump or system instruction or before the last instruction
+ * of the page. A branch or jump whose target is on the same page chains
+ * the block to the run at the target, found in the same decoded page
+ * without any translation or lookup. The block ends before any other
+ * instruction ending a run, after the block limit is reached, or after
+ * a branch leaving the page, which is left to be finished by the step.
+ * The block is cut short when an instruction raises an exception, writes
+ * to the page or stops the simulation; that instruction is then left
+ * to be finished by the step.
+ *
+ * @param frame Frame holding PC (NULL outside of memory)
+ * @param phys Physical address of PC, advanced past the executed instructions
+ * @param ex Exception raised by the instruction left to finish the step
+ * @return true if the step is to be finished with the result in ex,
+ *         false if the instruction at the new PC is still to be executed
+ */
+static bool execute_block(rv64_cpu_t *cpu, frame_t *frame, ptr36_t *phys, rv_exc_t *ex)
+{
+    // Memory breakpoints need to see every fetch
+    if ((frame == NULL) || (frame->watchpoints > 0)) {
+        return false;
+    }
+
+    cache_item_t *cache_item = fetch_page(cpu, frame, *phys);
+    unsigned int limit = block_run_limit(cpu);
+    uint64_t generation = frame->generation;
+    unsigned int total = 0;
+
+    while (total < limit) {
+        cache_instr_t *instr = &cache_item->instrs[PHYS2CACHEINSTR(*phys)];
+        unsigned int run = (instr->run < limit - total) ? instr->run : limit - total;
+
+        if (run > 0) {
+            uint64_t pc = cpu->pc;
+            unsigned int done;
+            uint16_t *heat = &cache_item->heat[PHYS2CACHEINSTR(*phys)];
+            bool finished = execute_run(cpu, frame, instr, heat, run, limit - total, generation,
+                    &done, ex);
+            total += done;
+
+            flight_record(cpu->csr.mhartid, TRACE_ARCH_RV64, pc, *phys, instr->data.val,
+                    finished ? done : done + 1);
+            cachesim_fetch(cpu->csr.mhartid, *phys, finished ? done : done + 1);
+            memtrace_fetch(cpu->csr.mhartid, pc, *phys, finished ? done : done + 1);
+            coverage_record(cpu->csr.mhartid, pc, finished ? done : done + 1);
+
+            if (!finished) {
+                account_block(cpu, total);
+                return true;
+            }
+
+            *phys += run * sizeof(rv_instr_t);
+            instr += run;
+        }
+
+        if ((total == limit) || !is_chainable(instr->data)) {
+            break;
+        }
+
+        flight_record(cpu->csr.mhartid, TRACE_ARCH_RV64, cpu->pc, *phys, instr->data.val, 1);
+        cachesim_fetch(cpu->csr.mhartid, *phys, 1);
+        memtrace_fetch(cpu->csr.mhartid, cpu->pc, *phys, 1);
+        coverage_record(cpu->csr.mhartid, cpu->pc, 1);
+        *ex = lazy_decode(instr)(cpu, instr->data);
+
+        if (*ex == rv_exc_illegal_instruction) {
+            cpu->csr.tval_next = instr->data.val;
+        }
+
+        // The target on another page needs a translation
+        if ((*ex != rv_exc_none) || machine_stopping()
+                || (((cpu->pc ^ cpu->pc_next) >> FRAME_WIDTH) != 0)) {
+            account_block(cpu, total);
+            return true;
+        }
+
+        cpu->pc = cpu->pc_next;
+        cpu->pc_next = cpu->pc + 4;
+        cpu->regs[0] = 0;
+        cpu->csr.tval_next = 0;
+        cpu->block_chains++;
+        total++;
+
+        *phys = (*phys & ~((ptr36_t) FRAME_MASK)) | (cpu->pc & FRAME_MASK);
+    }
+
+    account_block(cpu, total);
+    return false;
+}
+
+/**
+ * @brief Write the executed instruction and the changed general registers to the trace file
+ */
+static void trace_execution(rv64_cpu_t *cpu, rv_instr_t instr, const uint64_t *old_regs)
+{
+    trace_instr(cpu->csr.mhartid, TRACE_ARCH_RV64, cpu->pc, instr.val);
+
+    if (!iregch) {
+        return;
+    }
+
+    for (unsigned int i = 1; i < RV64_REG_COUNT; i++) {
+        if (cpu->regs[i] != old_regs[i]) {
+            trace_reg(cpu->csr.mhartid, TRACE_ARCH_RV64, i, cpu->regs[i]);
+        }
+    }
+}
+
+/**
+ * @brief Execute the instruction that PC is pointing to and handle interrupts or exceptions
+ *
+ * @param blocks Whether a block may be executed (false when checking the blocks)
+ */
+static rv_exc_t execute(rv64_cpu_t *cpu, bool blocks)
+{
+    ptr36_t phys;
+    frame_t *frame;
+    rv_exc_t ex = rv_translate(cpu, cpu->pc, 4, &phys, &frame, false, true, true);
 
     if (ex != rv_exc_none) {
-        alert("Fetching from unconvertable address!");
+        // Common with demand paging, so only counted
+        if (++cpu->fetch_faults <= cpu_fetch_alerts) {
+            alert("Fetching from unconvertable address!");
+        }
+
         // if (machine_trace) {
         //     rv64_idump(cpu, cpu->pc, (rv_instr_t) 0U);
         // }
         return ex;
     }
 
-    rv_instr_func_t instr_func = fetch_instr(cpu, phys);
-    rv_instr_t instr_data = (rv_instr_t) physmem_read32(cpu->csr.mhartid, phys, true);
+    bool traced = instr_traced(cpu);
+
+    // Blocks stay on the page they start on, so the frame stays the same
+    if (blocks && block_engine_active(cpu) && execute_block(cpu, frame, &phys, &ex)) {
+        return ex;
+    }
+
+    rv_instr_t instr_data;
+    rv_instr_func_t instr_func = fetch_instr(cpu, frame, phys, &instr_data);
 
     // if (machine_trace) {
     //     rv64_idump(cpu, cpu->pc, instr_data);
     // }
 
+    bool trace = traced && trace_active;
+    uint64_t old_regs[RV64_REG_COUNT];
+
+    if (trace) {
+        memcpy(old_regs, cpu->regs, sizeof(old_regs));
+    }
+
+    flight_record(cpu->csr.mhartid, TRACE_ARCH_RV64, cpu->pc, phys, instr_data.val, 1);
+    cachesim_fetch(cpu->csr.mhartid, phys, 1);
+    memtrace_fetch(cpu->csr.mhartid, cpu->pc, phys, 1);
+    coverage_record(cpu->csr.mhartid, cpu->pc, 1);
+
     // TODO: Fix this ugly hack
     ex = instr_func((void *) cpu, instr_data);
 
+    if (trace) {
+        profile_region_enter(PROFILE_TRACE);
+        trace_execution(cpu, instr_data, old_regs);
+        profile_region_leave();
+    }
+
     if (ex == rv_exc_illegal_instruction) {
         cpu->csr.tval_next = instr_data.val;
     }
@@ -818,22 +1460,23 @@ static rv_exc_t execute(rv64_cpu_t *cpu)
 
 /**
  * @brief Simulate one step of the CPU
+ *
+ * @param blocks Whether a block may be executed
+ * @param interrupts Whether the pending interrupts are taken
  */
-void rv64_cpu_step(rv64_cpu_t *cpu)
+static ALWAYS_INLINE void cpu_step(rv64_cpu_t *cpu, bool blocks, bool interrupts)
 {
-    ASSERT(cpu != NULL);
-
     rv_exc_t ex = rv_exc_none;
     bool instruction_retired = false;
 
     if (!cpu->stdby) {
-        ex = execute(cpu);
+        ex = execute(cpu, blocks);
         instruction_retired = (ex == rv_exc_none);
     }
 
     if (ex != rv_exc_none) {
         handle_exception(cpu, ex);
-    } else {
+    } else if (interrupts) {
         // If any interrupts are pending, handle them
         try_handle_interrupt(cpu);
     }
@@ -850,6 +1493,229 @@ void rv64_cpu_step(rv64_cpu_t *cpu)
     cpu->csr.tval_next = 0;
 }
 
+#include "../riscv_rv_ima/cosim.c"
+
+/**
+ * @brief Simulate one step of the CPU
+ */
+void rv64_cpu_step(rv64_cpu_t *cpu)
+{
+    ASSERT(cpu != NULL);
+
+    if (cosim_enabled && !cpu->stdby && block_engine_active(cpu)) {
+        rv_cosim_step(cpu);
+        return;
+    }
+
+    cpu_step(cpu, true, true);
+}
+
+/**
+ * @brief Tells whether the hart still spins on its reservation
+ *
+ * The spinning ends once the hart leaves the loop (e.g. by a trap),
+ * the reserved word is written to or the harts run in parallel,
+ * where the reservations are checked by value. The hart running
+ * blocks retires more than an instruction per cycle, its spinning
+ * is not skipped.
+ */
+static bool spin_continues(rv64_cpu_t *cpu)
+{
+    if (cpu->spinning
+            && (((cpu->pc != cpu->spin_pc) && (cpu->pc != cpu->spin_pc + 4))
+                    || !cpu->reserved_valid || parallel_active
+                    || (block_run_limit(cpu) > 0))) {
+        cpu->spinning = false;
+    }
+
+    return cpu->spinning;
+}
+
+/**
+ * @brief Tells how long the CPU is going to stand by without anything to notice
+ *
+ * The counters of a standing-by CPU change, but nothing else happens
+ * until an interrupt is taken. Within the returned number of cycles
+ * no enabled interrupt is pending and the timer interrupt requests
+ * keep their state, so the cycles can be accounted at once.
+ * A hart spinning on its reservation stands by as well, until
+ * the reserved word is written to.
+ *
+ * @param cycles Number of cycles which can be skipped
+ * @return false if the CPU is not standing by
+ */
+bool rv64_cpu_standby(rv64_cpu_t *cpu, uint64_t *cycles)
+{
+    ASSERT(cpu != NULL);
+    ASSERT(cycles != NULL);
+
+    if (!cpu->stdby && !spin_continues(cpu)) {
+        return false;
+    }
+
+    rv_csr_t *csr = &cpu->csr;
+
+    // Whether the interrupt is taken or not is left to the step
+    *cycles = 0;
+    if (csr->interrupts_pending) {
+        return true;
+    }
+
+    // advance_mtime() takes an unsigned int
+    uint64_t limit = UINT_MAX;
+
+    // scyclecmp STIP changes when the cycle reaches scyclecmp or wraps around
+    if (!(csr->mcountinhibit & 0b001)) {
+        uint64_t cycle = csr->cycle;
+
+        if ((cycle >= csr->scyclecmp) != csr->external_STIP) {
+            return true;
+        }
+
+        uint64_t change = csr->external_STIP ? -cycle : csr->scyclecmp - cycle;
+        if ((change != 0) && (change - 1 < limit)) {
+            limit = change - 1;
+        }
+    }
+
+    // mtimecmp MTIP is raised at the mtime tick reaching mtimecmp
+    bool mtip = (csr->mip & rv_csr_mti_mask) != 0;
+    if ((csr->mtime >= csr->mtimecmp) != mtip) {
+        return true;
+    }
+
+    if (!mtip) {
+        uint64_t change = csr->mtime_countdown;
+
+        // The host clock may reach mtimecmp at any sample
+        if (csr->mtime_source == rv_mtime_virtual) {
+            uint64_t ticks = csr->mtimecmp - csr->mtime;
+
+            if ((change <= limit) && (ticks - 1 <= (limit - change) / csr->mtime_period)) {
+                change += (ticks - 1) * csr->mtime_period;
+            } else {
+                change = limit + 1;
+            }
+        }
+
+        if (change - 1 < limit) {
+            limit = change - 1;
+        }
+    }
+
+    *cycles = limit;
+    return true;
+}
+
+/**
+ * @brief Tells how long the CPU is going to stand by in host time
+ *
+ * Only the host clock source of mtime depends on the host time.
+ * The standby ending with an enabled timer interrupt driven by
+ * the cycles cannot be waited for by the host.
+ *
+ * @param wait Milliseconds until mtime may reach mtimecmp
+ *             (UINT64_MAX if no enabled timer interrupt is ahead)
+ * @return false if the standby may end without the host
+ */
+bool rv64_cpu_standby_host(rv64_cpu_t *cpu, uint64_t *wait)
+{
+    ASSERT(cpu != NULL);
+    ASSERT(wait != NULL);
+
+    rv_csr_t *csr = &cpu->csr;
+    *wait = UINT64_MAX;
+
+    if ((csr->mie & rv_csr_sti_mask) && !(csr->mcountinhibit & 0b001)) {
+        return false;
+    }
+
+    if (!(csr->mie & rv_csr_mti_mask) || (csr->mtime >= csr->mtimecmp)) {
+        return true;
+    }
+
+    if (csr->mtime_source == rv_mtime_virtual) {
+        return false;
+    }
+
+    uint64_t now = csr->mtime + (current_timestamp() - csr->last_tick_time);
+    *wait = (now < csr->mtimecmp) ? csr->mtimecmp - now : 0;
+    return true;
+}
+
+/**
+ * @brief Account the given number of standby cycles at once
+ *
+ * The CPU ends up in the same state as if it was stepped,
+ * the number of cycles is limited by rv64_cpu_standby().
+ * The cycles of a spinning hart retire the instructions
+ * of the loop, its PC stays in the loop.
+ */
+void rv64_cpu_skip(rv64_cpu_t *cpu, uint64_t cycles)
+{
+    ASSERT(cpu != NULL);
+    ASSERT(cpu->stdby || cpu->spinning);
+    ASSERT(cycles <= UINT_MAX);
+
+    if (!(cpu->csr.mcountinhibit & 0b001)) {
+        cpu->csr.cycle += cycles;
+    }
+
+    if (cpu->spinning) {
+        if (!(cpu->csr.mcountinhibit & 0b100)) {
+            cpu->csr.instret += cycles;
+        }
+
+        /* The loop has two instructions */
+        if ((cycles & 1) != 0) {
+            cpu->pc = (cpu->pc == cpu->spin_pc) ? cpu->spin_pc + 4 : cpu->spin_pc;
+            cpu->pc_next = cpu->pc + 4;
+        }
+    }
+
+    advance_mtime(cpu, cycles);
+
+    account_hpm(cpu, cycles);
+
+    manage_timer_interrupts(cpu);
+}
+
+/**
+ * @brief Tells whether the CPU loops forever
+ *
+ * The CPU loops on an instruction jumping to itself (see
+ * rv_instr_self_loop()) or stands by, while no interrupt can be taken,
+ * i.e. all interrupts are disabled in mie or the CPU runs in M-mode
+ * with mstatus.MIE clear (the S-mode interrupts are not taken in M-mode).
+ * The standby needs mie clear, the pending interrupts enabled in mie
+ * end it even if they are not taken.
+ */
+bool rv64_cpu_deadloop(rv64_cpu_t *cpu)
+{
+    ASSERT(cpu != NULL);
+
+    if (cpu->stdby) {
+        return cpu->csr.mie == 0;
+    }
+
+    if ((cpu->csr.mie != 0) && ((cpu->priv_mode != rv_mmode) || rv_csr_mstatus_mie(cpu))) {
+        return false;
+    }
+
+    ptr36_t phys;
+    if (rv64_convert_addr(cpu, cpu->pc, &phys, false, true, false) != rv_exc_none) {
+        return false;
+    }
+
+    frame_t *frame = physmem_find_frame(phys);
+    if (frame == NULL) {
+        return false;
+    }
+
+    rv_instr_t instr = { .val = physmem_frame_read32(frame, phys, false) };
+    return rv_instr_self_loop(instr);
+}
+
 /**
  * @brief Notify the CPU that an adress has been writen ti
  *
@@ -882,6 +1748,7 @@ void rv64_interrupt_up(rv64_cpu_t *cpu, unsigned int no)
     // Full explanation RISC-V Privileged spec section 3.1.9 Machine Interrupt Registers (mip and mie)
     if (no == RV_INTERRUPT_NO(rv_exc_supervisor_external_interrupt)) {
         cpu->csr.external_SEIP = true;
+        rv_csr_update_interrupts_pending(cpu);
         return;
     }
 
@@ -893,6 +1760,7 @@ void rv64_interrupt_up(rv64_cpu_t *cpu, unsigned int no)
     uint64_t mask = RV_EXCEPTION_MASK(no);
 
     cpu->csr.mip |= mask;
+    rv_csr_update_interrupts_pending(cpu);
 }
 
 /**
@@ -911,6 +1779,7 @@ void rv64_interrupt_down(rv64_cpu_t *cpu, unsigned int no)
     // Full explanation RISC-V Privileged spec section 3.1.9 Machine Interrupt Registers (mip and mie)
     if (no == RV_INTERRUPT_NO(rv_exc_supervisor_external_interrupt)) {
         cpu->csr.external_SEIP = false;
+        rv_csr_update_interrupts_pending(cpu);
         return;
     }
 
@@ -922,4 +1791,27 @@ void rv64_interrupt_down(rv64_cpu_t *cpu, unsigned int no)
     uint64_t mask = RV_EXCEPTION_MASK(no);
 
     cpu->csr.mip &= ~mask;
+    rv_csr_update_interrupts_pending(cpu);
+}
+
+/**
+ * @brief Sets mtime and updates the timer interrupt accordingly
+ */
+void rv64_set_mtime(rv64_cpu_t *cpu, uint64_t value)
+{
+    ASSERT(cpu != NULL);
+
+    cpu->csr.mtime = value;
+    handle_mtip(cpu);
+}
+
+/**
+ * @brief Sets mtimecmp and updates the timer interrupt accordingly
+ */
+void rv64_set_mtimecmp(rv64_cpu_t *cpu, uint64_t value)
+{
+    ASSERT(cpu != NULL);
+
+    cpu->csr.mtimecmp = value;
+    handle_mtip(cpu);
 }
@@ -61,4 +61,19 @@ extern void rv64_csr_set_asid_len(rv_cpu_t *cpu, unsigned asid_len)
     cpu->csr.satp &= ~zeroing_asid_mask;
 
     rv64_tlb_flush(&cpu->tlb);
+    rv_walk_cache_flush(cpu);
+    rv_utlb_flush(cpu);
+    rv_fetch_cache_flush(cpu);
+}
+
+extern void rv64_csr_set_pmp_entries(rv_cpu_t *cpu, unsigned entries)
+{
+    ASSERT(entries <= RV_PMP_ENTRIES);
+
+    cpu->csr.pmp_entries = entries;
+
+    memset(cpu->csr.pmpcfgs, 0, sizeof(cpu->csr.pmpcfgs));
+    memset(cpu->csr.pmpaddrs, 0, sizeof(cpu->csr.pmpaddrs));
+
+    rv_pmp_update(cpu);
 }
@@ -36,4 +36,9 @@ extern enum rv_exc rv64_csr_rc(rv_cpu_t *cpu, csr_num_t csr, uint64_t value, uin
  */
 extern void rv64_csr_set_asid_len(rv_cpu_t *cpu, unsigned asid_active_bits);
 
+/** Change the number of implemented PMP entries (0, 16 or 64)
+ *  The entries are cleared, no entry makes the PMP CSRs illegal
+ */
+extern void rv64_csr_set_pmp_entries(rv_cpu_t *cpu, unsigned entries);
+
 #endif
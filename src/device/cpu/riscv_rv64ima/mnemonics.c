@@ -20,141 +20,25 @@
 #include "debug.h"
 #include "mnemonics.h"
 
-/** First memory helpers */
+/** First memory helpers (checked by PMP) */
+#include "../riscv_rv_ima/pmp.c"
 #include "../riscv_rv_ima/memory.c"
 /** Then instructions */
 #include "instr.c"
 
-extern rv_mnemonics_func_t rv64_decode_mnemonics(rv_instr_t instr)
-{
-    // is this dirty?
-    rv_instr_func_t instr_func = rv64_instr_decode(instr);
-
-    // very dirty indeed, but only one decode is needed
-
-#define IF_SAME_DECODE(expected_instr) \
-    if (instr_func == rv_##expected_instr##_instr) \
-    return rv64_##expected_instr##_mnemonics
-
-    IF_SAME_DECODE(lui);
-    IF_SAME_DECODE(auipc);
-
-    IF_SAME_DECODE(jal);
-    IF_SAME_DECODE(jalr);
-    IF_SAME_DECODE(beq);
-    IF_SAME_DECODE(bne);
-    IF_SAME_DECODE(blt);
-    IF_SAME_DECODE(bge);
-    IF_SAME_DECODE(bltu);
-    IF_SAME_DECODE(bgeu);
-
-    IF_SAME_DECODE(lb);
-    IF_SAME_DECODE(lh);
-    IF_SAME_DECODE(lw);
-    IF_SAME_DECODE(lbu);
-    IF_SAME_DECODE(lhu);
-
-    IF_SAME_DECODE(sb);
-    IF_SAME_DECODE(sh);
-    IF_SAME_DECODE(sw);
-
-    IF_SAME_DECODE(addi);
-    IF_SAME_DECODE(slti);
-    IF_SAME_DECODE(sltiu);
-    IF_SAME_DECODE(xori);
-    IF_SAME_DECODE(ori);
-    IF_SAME_DECODE(andi);
-    IF_SAME_DECODE(slli);
-    IF_SAME_DECODE(srli);
-    IF_SAME_DECODE(srai);
-
-    IF_SAME_DECODE(add);
-    IF_SAME_DECODE(sub);
-    IF_SAME_DECODE(sll);
-    IF_SAME_DECODE(slt);
-    IF_SAME_DECODE(sltu);
-    IF_SAME_DECODE(xor);
-    IF_SAME_DECODE(or);
-    IF_SAME_DECODE(and);
-    IF_SAME_DECODE(srl);
-    IF_SAME_DECODE(sra);
-
-    IF_SAME_DECODE(fence);
-
-    // SYSTEM
-
-    if (instr_func == _rv64_sfence_instr) {
-        return rv64_sfence_mnemonics;
-    }
-
-    if (instr_func == rv_break_instr) {
-        return rv64_ebreak_mnemonics;
-    }
-
-    if (instr_func == rv_halt_instr) {
-        return rv64_ehalt_mnemonics;
-    }
-
-    if (instr_func == rv64_dump_instr) {
-        return rv64_edump_mnemonics;
-    }
-
-    if (instr_func == rv_trace_set_instr) {
-        return rv64_trace_set_mnemonics;
-    }
-
-    if (instr_func == rv_trace_reset_instr) {
-        return rv64_trace_reset_mnemonics;
-    }
-
-    if (instr_func == _rv64_csr_rd_instr) {
-        return rv64_csr_rd_mnemonics;
-    }
+/** Disassemblers of the instruction set entries (see isa.c) */
+static const rv_mnemonics_func_t rv_isa_mnemonics[] = {
+#define RV_INSTR(execute, mnemonics, encoding, flags) rv64_##mnemonics##_mnemonics,
+#include "../riscv_rv_ima/isa.def"
+};
 
-    if (instr_func == rv_call_instr) {
-        return rv64_ecall_mnemonics;
-    }
+static_assert(sizeof(rv_isa_mnemonics) / sizeof(rv_isa_mnemonics[0]) == RV_ISA_COUNT,
+        "Disassemblers do not match the instruction set");
 
-    IF_SAME_DECODE(sret);
-    IF_SAME_DECODE(mret);
-    IF_SAME_DECODE(wfi);
-    // IF_SAME_DECODE(sfence);
-
-    IF_SAME_DECODE(csrrw);
-    IF_SAME_DECODE(csrrs);
-    IF_SAME_DECODE(csrrc);
-    IF_SAME_DECODE(csrrwi);
-    IF_SAME_DECODE(csrrsi);
-    IF_SAME_DECODE(csrrci);
-
-    // M-extension
-
-    IF_SAME_DECODE(mul);
-    IF_SAME_DECODE(mulh);
-    IF_SAME_DECODE(mulhsu);
-    IF_SAME_DECODE(mulhu);
-    IF_SAME_DECODE(div);
-    IF_SAME_DECODE(divu);
-    IF_SAME_DECODE(rem);
-    IF_SAME_DECODE(remu);
-
-    // A-extension
-
-    // IF_SAME_DECODE(lr_w);
-    // IF_SAME_DECODE(lr_d);
-    // IF_SAME_DECODE(sc_w);
-    // IF_SAME_DECODE(sc_d);
-    // IF_SAME_DECODE(amoswap);
-    // IF_SAME_DECODE(amoadd);
-    // IF_SAME_DECODE(amoxor);
-    // IF_SAME_DECODE(amoor);
-    // IF_SAME_DECODE(amoand);
-    // IF_SAME_DECODE(amomin);
-    // IF_SAME_DECODE(amomax);
-    // IF_SAME_DECODE(amominu);
-    // IF_SAME_DECODE(amomaxu);
-
-    return rv64_undefined_mnemonics;
+extern rv_mnemonics_func_t rv64_decode_mnemonics(rv_instr_t instr)
+{
+    int entry = rv_isa_find(instr);
+    return (entry < 0) ? rv64_undefined_mnemonics : rv_isa_mnemonics[entry];
 }
 
 /***********
@@ -595,6 +479,18 @@ void rv64_csr_rd_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonic
 {
     string_printf(s_mnemonics, "ecsrd %s", rv64_regnames[instr.i.rd]);
 }
+void rv64_roi_begin_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "eroib");
+}
+void rv64_roi_end_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "eroie");
+}
+void rv64_hypercall_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "ehcall");
+}
 
 extern void rv64_sret_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
 {
@@ -734,70 +630,232 @@ extern void rv64_remu_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mne
     string_printf(s_comments, " (unsigned)");
 }
 
+// RV64I
+extern void rv64_lwu_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "lwu");
+    load_instr_mnemonics(instr, s_mnemonics);
+}
+extern void rv64_ld_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "ld");
+    load_instr_mnemonics(instr, s_mnemonics);
+}
+extern void rv64_sd_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "sd");
+    store_instr_mnemonics(instr, s_mnemonics);
+}
+extern void rv64_addiw_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "addiw");
+    i_instr_mnemonics(instr, s_mnemonics);
+    i_instr_comment_binop(instr, s_comments, "+");
+    string_printf(s_comments, " (32 bits)");
+}
+extern void rv64_slliw_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "slliw");
+    imm_shift_mnemonics(instr, s_mnemonics);
+    imm_shift_comments(instr, s_comments, "<<");
+    string_printf(s_comments, " (32 bits)");
+}
+extern void rv64_srliw_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "srliw");
+    imm_shift_mnemonics(instr, s_mnemonics);
+    imm_shift_comments(instr, s_comments, ">>");
+    string_printf(s_comments, " (logical, 32 bits)");
+}
+extern void rv64_sraiw_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "sraiw");
+    imm_shift_mnemonics(instr, s_mnemonics);
+    imm_shift_comments(instr, s_comments, ">>");
+    string_printf(s_comments, " (arithmetical, 32 bits)");
+}
+extern void rv64_addw_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "addw");
+    r_instr_mnemonics(instr, s_mnemonics);
+    r_instr_comment_binop(instr, s_comments, "+");
+    string_printf(s_comments, " (32 bits)");
+}
+extern void rv64_subw_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "subw");
+    r_instr_mnemonics(instr, s_mnemonics);
+    r_instr_comment_binop(instr, s_comments, "-");
+    string_printf(s_comments, " (32 bits)");
+}
+extern void rv64_sllw_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "sllw");
+    r_instr_mnemonics(instr, s_mnemonics);
+    r_instr_comment_binop(instr, s_comments, "<<");
+    string_printf(s_comments, " (32 bits)");
+}
+extern void rv64_srlw_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "srlw");
+    r_instr_mnemonics(instr, s_mnemonics);
+    r_instr_comment_binop(instr, s_comments, ">>");
+    string_printf(s_comments, " (logical, 32 bits)");
+}
+extern void rv64_sraw_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "sraw");
+    r_instr_mnemonics(instr, s_mnemonics);
+    r_instr_comment_binop(instr, s_comments, ">>");
+    string_printf(s_comments, " (arithmetical, 32 bits)");
+}
+
+// RV64M
+extern void rv64_mulw_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "mulw");
+    r_instr_mnemonics(instr, s_mnemonics);
+    r_instr_comment_binop(instr, s_comments, "*");
+    string_printf(s_comments, " (low 32 bits)");
+}
+extern void rv64_divw_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "divw");
+    r_instr_mnemonics(instr, s_mnemonics);
+    r_instr_comment_binop(instr, s_comments, "/");
+    string_printf(s_comments, " (signed, 32 bits)");
+}
+extern void rv64_divuw_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "divuw");
+    r_instr_mnemonics(instr, s_mnemonics);
+    r_instr_comment_binop(instr, s_comments, "/");
+    string_printf(s_comments, " (unsigned, 32 bits)");
+}
+extern void rv64_remw_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "remw");
+    r_instr_mnemonics(instr, s_mnemonics);
+    r_instr_comment_binop(instr, s_comments, "%");
+    string_printf(s_comments, " (signed, 32 bits)");
+}
+extern void rv64_remuw_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "remuw");
+    r_instr_mnemonics(instr, s_mnemonics);
+    r_instr_comment_binop(instr, s_comments, "%");
+    string_printf(s_comments, " (unsigned, 32 bits)");
+}
+
 // A extension
 extern void rv64_lr_w_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
 {
-    string_printf(s_mnemonics, "lr");
+    string_printf(s_mnemonics, "lr.w");
     string_printf(s_mnemonics, " %s, (%s)", rv64_regnames[instr.r.rd], rv64_regnames[instr.r.rs1]);
 }
+extern void rv64_sc_w_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "sc.w");
+    amo_instr_mnemonics(instr, s_mnemonics);
+}
 extern void rv64_lr_d_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
 {
-    string_printf(s_mnemonics, "lr");
+    string_printf(s_mnemonics, "lr.d");
     string_printf(s_mnemonics, " %s, (%s)", rv64_regnames[instr.r.rd], rv64_regnames[instr.r.rs1]);
 }
-extern void rv64_sc_w_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+extern void rv64_sc_d_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
 {
-    string_printf(s_mnemonics, "sc");
+    string_printf(s_mnemonics, "sc.d");
     amo_instr_mnemonics(instr, s_mnemonics);
 }
-extern void rv64_sc_d_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+extern void rv64_amoswap_w_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "amoswap.w");
+    amo_instr_mnemonics(instr, s_mnemonics);
+}
+extern void rv64_amoadd_w_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "amoadd.w");
+    amo_instr_mnemonics(instr, s_mnemonics);
+}
+extern void rv64_amoxor_w_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "amoxor.w");
+    amo_instr_mnemonics(instr, s_mnemonics);
+}
+extern void rv64_amoand_w_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "amoand.w");
+    amo_instr_mnemonics(instr, s_mnemonics);
+}
+extern void rv64_amoor_w_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "amoor.w");
+    amo_instr_mnemonics(instr, s_mnemonics);
+}
+extern void rv64_amomin_w_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "amomin.w");
+    amo_instr_mnemonics(instr, s_mnemonics);
+}
+extern void rv64_amomax_w_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "amomax.w");
+    amo_instr_mnemonics(instr, s_mnemonics);
+}
+extern void rv64_amominu_w_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+{
+    string_printf(s_mnemonics, "amominu.w");
+    amo_instr_mnemonics(instr, s_mnemonics);
+}
+extern void rv64_amomaxu_w_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
 {
-    string_printf(s_mnemonics, "sc");
+    string_printf(s_mnemonics, "amomaxu.w");
     amo_instr_mnemonics(instr, s_mnemonics);
 }
-extern void rv64_amoswap_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+extern void rv64_amoswap_d_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
 {
-    string_printf(s_mnemonics, "amoswap");
+    string_printf(s_mnemonics, "amoswap.d");
     amo_instr_mnemonics(instr, s_mnemonics);
 }
-extern void rv64_amoadd_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+extern void rv64_amoadd_d_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
 {
-    string_printf(s_mnemonics, "amoadd");
+    string_printf(s_mnemonics, "amoadd.d");
     amo_instr_mnemonics(instr, s_mnemonics);
 }
-extern void rv64_amoxor_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+extern void rv64_amoxor_d_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
 {
-    string_printf(s_mnemonics, "amoxor");
+    string_printf(s_mnemonics, "amoxor.d");
     amo_instr_mnemonics(instr, s_mnemonics);
 }
-extern void rv64_amoand_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+extern void rv64_amoand_d_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
 {
-    string_printf(s_mnemonics, "amoand");
+    string_printf(s_mnemonics, "amoand.d");
     amo_instr_mnemonics(instr, s_mnemonics);
 }
-extern void rv64_amoor_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+extern void rv64_amoor_d_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
 {
-    string_printf(s_mnemonics, "amoor");
+    string_printf(s_mnemonics, "amoor.d");
     amo_instr_mnemonics(instr, s_mnemonics);
 }
-extern void rv64_amomin_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+extern void rv64_amomin_d_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
 {
-    string_printf(s_mnemonics, "amomin");
+    string_printf(s_mnemonics, "amomin.d");
     amo_instr_mnemonics(instr, s_mnemonics);
 }
-extern void rv64_amomax_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+extern void rv64_amomax_d_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
 {
-    string_printf(s_mnemonics, "amomax");
+    string_printf(s_mnemonics, "amomax.d");
     amo_instr_mnemonics(instr, s_mnemonics);
 }
-extern void rv64_amominu_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+extern void rv64_amominu_d_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
 {
-    string_printf(s_mnemonics, "amominu");
+    string_printf(s_mnemonics, "amominu.d");
     amo_instr_mnemonics(instr, s_mnemonics);
 }
-extern void rv64_amomaxu_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
+extern void rv64_amomaxu_d_mnemonics(uint32_t addr, rv_instr_t instr, string_t *s_mnemonics, string_t *s_comments)
 {
-    string_printf(s_mnemonics, "amomaxu");
+    string_printf(s_mnemonics, "amomaxu.d");
     amo_instr_mnemonics(instr, s_mnemonics);
 }
 
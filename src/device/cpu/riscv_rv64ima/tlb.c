@@ -2,304 +2,421 @@
 #include <string.h>
 
 #include "../../../assert.h"
+#include "../../../physmem.h"
 #include "../../../utils.h"
 #include "tlb.h"
 #include "virt_mem.h"
 
 typedef struct rv64_tlb_entry {
-    item_t item; // Item to be used in LRU or free-list
     sv39_pte_t pte;
     uint64_t vpn;
     unsigned asid;
+    bool valid;
     bool global;
+    uint32_t epoch; // Flush generations when the entry was added
+    uint32_t asid_epoch;
     sv39_page_type_t page_type;
+    bool referenced; // Clock bit used for approximate LRU replacement
+    ptr55_t pte_addr; // Physical address of the leaf PTE
+    uint8_t allowed; // Accesses allowed without a page walk
+    uint32_t generation; // Context generation of the allowed accesses
 } rv64_tlb_entry_t;
 
-/** Caches a mapping into the TLB */
-extern void rv64_tlb_add_mapping(rv64_tlb_t *tlb, unsigned asid, uint64_t virt, sv39_pte_t pte, sv39_page_type_t page_type, bool global)
+/** Page sizes in the order in which they are looked up */
+static const sv39_page_type_t lookup_order[] = { gigapage, megapage, page };
+
+/** Returns the virtual page number of the address for the given page size */
+static inline uint64_t virt_vpn(uint64_t virt, sv39_page_type_t page_type)
 {
-    rv64_tlb_entry_t *entry = NULL;
+    switch (page_type) {
+    case megapage:
+        return virt >> RV64_MEGAPAGESIZE;
+    case gigapage:
+        return virt >> RV64_GIGAPAGESIZE;
+    default:
+        return virt >> RV64_PAGESIZE;
+    }
+}
+
+/** Returns the first entry of the set caching the given virtual page
+ *
+ * All page sizes are hashed into the same sets by their own page
+ * numbers, so a lookup probes one set per page size.
+ */
+static inline rv64_tlb_entry_t *tlb_set(rv64_tlb_t *tlb, uint64_t vpn, sv39_page_type_t page_type)
+{
+    uint64_t hash = vpn ^ (vpn >> 9) ^ (vpn >> 18) ^ ((uint64_t) page_type * 0x5A5);
+    return &tlb->entries[(hash & (tlb->sets - 1)) * tlb->ways];
+}
 
-    if (!is_empty(&tlb->free_list)) {
-        // If there are some unused entries, use them first
-
-        item_t *popped_free_item = tlb->free_list.head;
-        list_remove(&tlb->free_list, popped_free_item);
-        // Safe cast because the item is the first field
-        entry = (rv64_tlb_entry_t *) popped_free_item;
-    } else {
-        // If all entries are used, reuse the Least Recently Used entry from the used list
-        item_t *popped_reused_item = tlb->lru_list.tail;
-        list_remove(&tlb->lru_list, popped_reused_item);
-        // Safe cast because the item is the first field
-        entry = (rv64_tlb_entry_t *) popped_reused_item;
+/** Computes the accesses a mapping allows in the current context
+ *
+ * Only the accesses that neither fault nor need the A and D bits
+ * of the PTE updated are allowed, the others take the page walk.
+ */
+static unsigned entry_allowed(rv64_tlb_t *tlb, sv39_pte_t pte, sv39_page_type_t page_type)
+{
+    if (!sv39_is_pte_valid(pte) || !pte.a) {
+        return 0;
     }
 
-    ASSERT(entry != NULL);
+    // Misaligned megapage or gigapage
+    if (((page_type == megapage) && (sv39_pte_ppn0(pte) != 0))
+            || ((page_type == gigapage) && ((sv39_pte_ppn0(pte) != 0) || (sv39_pte_ppn1(pte) != 0)))) {
+        return 0;
+    }
 
-    uint64_t vpn;
+    unsigned allowed = 0;
 
-    switch (page_type) {
-    case page:
-        vpn = virt >> RV64_PAGESIZE;
-        break;
-    case megapage:
-        vpn = virt >> RV64_MEGAPAGESIZE;
-        break;
-    case gigapage:
-        vpn = virt >> RV64_GIGAPAGESIZE;
-        break;
-    default:
-        return;
+    if (pte.r || (tlb->mxr && pte.x)) {
+        allowed |= RV64_TLB_ALLOW_READ;
     }
 
-    entry->pte = pte;
-    entry->page_type = page_type;
-    entry->vpn = vpn;
-    entry->asid = asid;
-    entry->global = global;
+    if (pte.w && pte.d) {
+        allowed |= RV64_TLB_ALLOW_WRITE;
+    }
+
+    if (pte.x) {
+        allowed |= RV64_TLB_ALLOW_EXEC;
+    }
+
+    if (tlb->user != (bool) pte.u) {
+        // User pages in S-mode only with SUM and never executable
+        allowed = (pte.u && tlb->sum) ? (allowed & ~RV64_TLB_ALLOW_EXEC) : 0;
+    }
 
-    // Push to front of LRU list
-    list_push(&tlb->lru_list, &entry->item);
+    return allowed;
 }
 
-static void move_lru_entry_to_front(rv64_tlb_t *tlb, rv64_tlb_entry_t *entry)
+/** Returns the flush generation of the ASID */
+static inline uint32_t *asid_epoch(rv64_tlb_t *tlb, unsigned asid)
 {
-    // Fast path exit
-    if (tlb->lru_list.head == &entry->item) {
+    return &tlb->asid_epochs[asid & (RV64_TLB_ASID_EPOCHS - 1)];
+}
+
+/** Returns whether the entry has not been invalidated (or flushed since added) */
+static inline bool entry_live(rv64_tlb_t *tlb, rv64_tlb_entry_t *entry)
+{
+    return entry->valid
+            && (entry->epoch == tlb->epoch)
+            && (entry->global || (entry->asid_epoch == *asid_epoch(tlb, entry->asid)));
+}
+
+/** Returns whether the entry maps the page in the given address space */
+static inline bool entry_matches(rv64_tlb_t *tlb, rv64_tlb_entry_t *entry, unsigned asid, uint64_t vpn, sv39_page_type_t page_type)
+{
+    return (entry->page_type == page_type)
+            && (entry->vpn == vpn)
+            && (entry->global || entry->asid == asid)
+            && entry_live(tlb, entry);
+}
+
+/** Caches a mapping into the TLB */
+extern void rv64_tlb_add_mapping(rv64_tlb_t *tlb, unsigned asid, uint64_t virt, sv39_pte_t pte, sv39_page_type_t page_type, bool global, ptr55_t pte_addr)
+{
+    if ((page_type != page) && (page_type != megapage) && (page_type != gigapage)) {
         return;
     }
 
-    ASSERT(entry->item.list == &tlb->lru_list);
+    uint64_t vpn = virt_vpn(virt, page_type);
+    rv64_tlb_entry_t *set = tlb_set(tlb, vpn, page_type);
+    size_t set_index = (set - tlb->entries) / tlb->ways;
+
+    rv64_tlb_entry_t *entry = NULL;
+
+    // If there are some unused entries in the set, use them first
+    for (size_t way = 0; way < tlb->ways; ++way) {
+        if (!entry_live(tlb, &set[way])) {
+            entry = &set[way];
+            break;
+        }
+    }
+
+    // Otherwise evict the first entry not referenced since the clock hand passed it
+    while (entry == NULL) {
+        rv64_tlb_entry_t *candidate = &set[tlb->hands[set_index]];
+        tlb->hands[set_index] = (tlb->hands[set_index] + 1) % tlb->ways;
+
+        if (candidate->referenced) {
+            candidate->referenced = false;
+        } else {
+            entry = candidate;
+            tlb->evictions++;
+        }
+    }
 
-    // Move entry to the front of the list by first removing it and then pushing it to the front
-    list_remove(&tlb->lru_list, &entry->item);
-    list_push(&tlb->lru_list, &entry->item);
+    entry->pte = pte;
+    entry->page_type = page_type;
+    entry->vpn = vpn;
+    entry->asid = asid;
+    entry->global = global;
+    entry->valid = true;
+    entry->epoch = tlb->epoch;
+    entry->asid_epoch = *asid_epoch(tlb, asid);
+    entry->referenced = true;
+    entry->pte_addr = pte_addr;
+    entry->allowed = entry_allowed(tlb, pte, page_type);
+    entry->generation = tlb->generation;
 }
 
-/** Returns whether the given TLB entry holds a mapping of the specified virtual address */
-static bool entry_maps_virt(rv64_tlb_entry_t *entry, uint64_t virt)
+/** Finds the entry mapping the given address, trying the largest pages first */
+static rv64_tlb_entry_t *find_entry(rv64_tlb_t *tlb, unsigned asid, uint64_t virt)
 {
-    uint64_t vpn;
-
-    switch (entry->page_type) {
-    case page:
-        vpn = virt >> RV64_PAGESIZE;
-        break;
-    case megapage:
-        vpn = virt >> RV64_MEGAPAGESIZE;
-        break;
-    case gigapage:
-        vpn = virt >> RV64_GIGAPAGESIZE;
-        break;
-    default:
-        return false;
+    for (size_t i = 0; i < sizeof(lookup_order) / sizeof(lookup_order[0]); ++i) {
+        sv39_page_type_t page_type = lookup_order[i];
+        uint64_t vpn = virt_vpn(virt, page_type);
+        rv64_tlb_entry_t *set = tlb_set(tlb, vpn, page_type);
+
+        for (size_t way = 0; way < tlb->ways; ++way) {
+            if (entry_matches(tlb, &set[way], asid, vpn, page_type)) {
+                return &set[way];
+            }
+        }
     }
 
-    return entry->vpn == vpn;
+    return NULL;
 }
 
 /** Retrieves a cached mapping
- * gives priority to megapage mappings
+ * gives priority to larger page mappings
  */
-extern bool rv64_tlb_get_mapping(rv64_tlb_t *tlb, unsigned asid, uint64_t virt, sv39_pte_t *pte, sv39_page_type_t *page_type, bool noisy)
+extern bool rv64_tlb_get_mapping(rv64_tlb_t *tlb, unsigned asid, uint64_t virt, sv39_pte_t *pte, sv39_page_type_t *page_type, ptr55_t *pte_addr, unsigned *allowed, bool noisy)
 {
-    rv64_tlb_entry_t *entry;
+    rv64_tlb_entry_t *entry = find_entry(tlb, asid, virt);
 
-    for_each(tlb->lru_list, entry, rv64_tlb_entry_t)
-    {
-        // Skip non-global mappings with wrong asid
-        if (!entry->global && entry->asid != asid) {
-            continue;
+    if (entry == NULL) {
+        if (noisy) {
+            tlb->misses++;
         }
 
-        if (entry_maps_virt(entry, virt)) {
-            if (noisy) {
-                // Ensure LRU behavior, by moving the entry to the front of the LRU list on access
-                move_lru_entry_to_front(tlb, entry);
-            }
+        return false;
+    }
+
+    if (noisy) {
+        tlb->hits++;
 
-            *pte = entry->pte;
-            *page_type = entry->page_type;
+        // Keep the entry from being replaced soon
+        entry->referenced = true;
+    }
+
+    *pte = entry->pte;
+    *page_type = entry->page_type;
+
+    if (pte_addr != NULL) {
+        *pte_addr = entry->pte_addr;
+    }
 
-            return true;
+    if (allowed != NULL) {
+        if (entry->generation != tlb->generation) {
+            entry->allowed = entry_allowed(tlb, entry->pte, entry->page_type);
+            entry->generation = tlb->generation;
         }
+
+        *allowed = entry->allowed;
     }
 
-    return false;
+    return true;
 }
 
-static void invalidate_tlb_entry(rv64_tlb_t *tlb, rv64_tlb_entry_t *entry)
+extern void rv64_tlb_update_mapping(rv64_tlb_t *tlb, unsigned asid, uint64_t virt, sv39_pte_t pte)
 {
-    ASSERT(entry->item.list == &tlb->lru_list);
+    rv64_tlb_entry_t *entry = find_entry(tlb, asid, virt);
 
-    list_remove(&tlb->lru_list, &entry->item);
-    list_push(&tlb->free_list, &entry->item);
+    if (entry != NULL) {
+        entry->pte = pte;
+        entry->allowed = entry_allowed(tlb, pte, entry->page_type);
+        entry->generation = tlb->generation;
+    }
 }
 
-static bool is_entry_valid(rv64_tlb_t *tlb, rv64_tlb_entry_t *entry)
+extern void rv64_tlb_remove_mapping(rv64_tlb_t *tlb, unsigned asid, uint64_t virt)
 {
-    return entry->item.list == &tlb->lru_list;
+    rv64_tlb_entry_t *entry = find_entry(tlb, asid, virt);
+
+    if (entry != NULL) {
+        entry->valid = false;
+    }
 }
 
-extern void rv64_tlb_remove_mapping(rv64_tlb_t *tlb, unsigned asid, uint64_t virt)
+extern void rv64_tlb_set_context(rv64_tlb_t *tlb, bool user, bool sum, bool mxr)
 {
-    rv64_tlb_entry_t *entry;
+    tlb->context_changed = false;
 
-    for_each(tlb->lru_list, entry, rv64_tlb_entry_t)
-    {
-        // Skip non-global mappings with wrong asid
-        if (!entry->global && entry->asid != asid) {
-            continue;
-        }
+    if ((tlb->user == user) && (tlb->sum == sum) && (tlb->mxr == mxr)) {
+        return;
+    }
 
-        if (entry_maps_virt(entry, virt)) {
-            invalidate_tlb_entry(tlb, entry);
-            return;
+    tlb->user = user;
+    tlb->sum = sum;
+    tlb->mxr = mxr;
+    tlb->generation++;
+
+    // A wrapped generation could match the stale entries
+    if (tlb->generation == 0) {
+        for (size_t i = 0; i < tlb->size; ++i) {
+            rv64_tlb_entry_t *entry = &tlb->entries[i];
+            entry->allowed = entry_allowed(tlb, entry->pte, entry->page_type);
         }
     }
 }
 
 /** TLB flushes */
 
+/** Invalidates the entries right away */
+static void invalidate_all(rv64_tlb_t *tlb)
+{
+    for (size_t i = 0; i < tlb->size; ++i) {
+        tlb->entries[i].valid = false;
+    }
+}
+
 // Invalidates all entries
 extern void rv64_tlb_flush(rv64_tlb_t *tlb)
 {
-    for (size_t i = 0; i < tlb->size; ++i) {
-        if (is_entry_valid(tlb, &tlb->entries[i])) {
-            invalidate_tlb_entry(tlb, &tlb->entries[i]);
-        }
+    tlb->flushes++;
+    tlb->epoch++;
+
+    // A wrapped generation could revive the entries flushed long ago
+    if (tlb->epoch == 0) {
+        invalidate_all(tlb);
     }
 }
 
 // Invalidates all entries of the given asid
 extern void rv64_tlb_flush_by_asid(rv64_tlb_t *tlb, unsigned asid)
 {
-    for (size_t i = 0; i < tlb->size; ++i) {
+    tlb->asid_flushes++;
 
-        if (!is_entry_valid(tlb, &tlb->entries[i])) {
-            continue;
-        }
+    // The other ASIDs sharing the generation are flushed as well
+    uint32_t *epoch = asid_epoch(tlb, asid);
+    (*epoch)++;
 
-        if (tlb->entries[i].global) {
-            continue;
-        }
-        if (tlb->entries[i].asid == asid) {
-            invalidate_tlb_entry(tlb, &tlb->entries[i]);
-        }
+    if (*epoch == 0) {
+        invalidate_all(tlb);
     }
 }
 
-// Invalidates all entries that map the given virtual address
-extern void rv64_tlb_flush_by_addr(rv64_tlb_t *tlb, uint64_t virt)
+/** Invalidates the entries mapping the address that pass the ASID filter */
+static void flush_sets(rv64_tlb_t *tlb, uint64_t virt, bool any_asid, unsigned asid)
 {
-    uint64_t page_vpn = virt >> RV64_PAGESIZE;
-    uint64_t mega_vpn = virt >> RV64_MEGAPAGESIZE;
-    uint64_t giga_vpn = virt >> RV64_GIGAPAGESIZE;
+    for (size_t i = 0; i < sizeof(lookup_order) / sizeof(lookup_order[0]); ++i) {
+        sv39_page_type_t page_type = lookup_order[i];
+        uint64_t vpn = virt_vpn(virt, page_type);
+        rv64_tlb_entry_t *set = tlb_set(tlb, vpn, page_type);
 
-    for (size_t i = 0; i < tlb->size; ++i) {
-        if (!is_entry_valid(tlb, &tlb->entries[i])) {
-            continue;
-        }
+        for (size_t way = 0; way < tlb->ways; ++way) {
+            rv64_tlb_entry_t *entry = &set[way];
 
-        switch (tlb->entries[i].page_type) {
-        case page:
-            if (tlb->entries[i].vpn == page_vpn) {
-                invalidate_tlb_entry(tlb, &tlb->entries[i]);
-            }
-            break;
-        case megapage:
-            if (tlb->entries[i].vpn == mega_vpn) {
-                invalidate_tlb_entry(tlb, &tlb->entries[i]);
+            if (!entry_live(tlb, entry) || (entry->page_type != page_type) || (entry->vpn != vpn)) {
+                continue;
             }
-            break;
-        case gigapage:
-            if (tlb->entries[i].vpn == giga_vpn) {
-                invalidate_tlb_entry(tlb, &tlb->entries[i]);
+
+            if (!any_asid && (entry->global || entry->asid != asid)) {
+                continue;
             }
-            break;
+
+            entry->valid = false;
         }
     }
 }
 
-// Invalidates all entries that map the given address and are of the given asid
-extern void rv64_tlb_flush_by_asid_and_addr(rv64_tlb_t *tlb, unsigned asid, uint64_t virt)
+// Invalidates all entries that map the given virtual address
+extern void rv64_tlb_flush_by_addr(rv64_tlb_t *tlb, uint64_t virt)
 {
-    uint64_t page_vpn = virt >> RV64_PAGESIZE;
-    uint64_t mega_vpn = virt >> RV64_MEGAPAGESIZE;
-    uint64_t giga_vpn = virt >> RV64_GIGAPAGESIZE;
-
-    for (size_t i = 0; i < tlb->size; ++i) {
-        if (!is_entry_valid(tlb, &tlb->entries[i])) {
-            continue;
-        }
+    tlb->addr_flushes++;
 
-        if (tlb->entries[i].global) {
-            continue;
-        }
+    flush_sets(tlb, virt, true, 0);
+}
 
-        if (tlb->entries[i].asid != asid) {
-            continue;
-        }
+// Invalidates all entries that map the given address and are of the given asid
+extern void rv64_tlb_flush_by_asid_and_addr(rv64_tlb_t *tlb, unsigned asid, uint64_t virt)
+{
+    tlb->asid_addr_flushes++;
 
-        switch (tlb->entries[i].page_type) {
-        case page:
-            if (tlb->entries[i].vpn == page_vpn) {
-                invalidate_tlb_entry(tlb, &tlb->entries[i]);
-            }
-            break;
-        case megapage:
-            if (tlb->entries[i].vpn == mega_vpn) {
-                invalidate_tlb_entry(tlb, &tlb->entries[i]);
-            }
-            break;
-        case gigapage:
-            if (tlb->entries[i].vpn == giga_vpn) {
-                invalidate_tlb_entry(tlb, &tlb->entries[i]);
-            }
-            break;
-        }
-    }
+    flush_sets(tlb, virt, false, asid);
 }
 
-/** Initializes the TLB data structure */
+/** Initializes the TLB data structure
+ *
+ * The entries are organized into a power of two number of sets of about
+ * RV64_TLB_WAYS entries each, the size is rounded down to a multiple
+ * of the number of sets.
+ */
 extern void rv64_tlb_init(rv64_tlb_t *tlb, size_t size)
 {
     ASSERT(size != 0);
 
-    tlb->entries = safe_malloc(size * sizeof(rv64_tlb_entry_t));
-    tlb->size = size;
-    list_init(&tlb->lru_list);
-    list_init(&tlb->free_list);
+    size_t sets = 1;
+    while (sets * 2 * RV64_TLB_WAYS <= size) {
+        sets *= 2;
+    }
 
-    memset(tlb->entries, 0, size * sizeof(rv64_tlb_entry_t));
+    tlb->sets = sets;
+    tlb->ways = size / sets;
+    tlb->size = tlb->sets * tlb->ways;
 
-    for (size_t i = 0; i < size; ++i) {
-        list_append(&tlb->free_list, &tlb->entries[i].item);
-    }
+    tlb->hits = 0;
+    tlb->misses = 0;
+    tlb->evictions = 0;
+    tlb->flushes = 0;
+    tlb->asid_flushes = 0;
+    tlb->addr_flushes = 0;
+    tlb->asid_addr_flushes = 0;
+
+    tlb->generation = 0;
+    tlb->context_changed = true;
+    tlb->user = false;
+    tlb->sum = false;
+    tlb->mxr = false;
+
+    tlb->epoch = 0;
+    memset(tlb->asid_epochs, 0, sizeof(tlb->asid_epochs));
+
+    tlb->entries = safe_malloc(tlb->size * sizeof(rv64_tlb_entry_t));
+    tlb->hands = safe_malloc(tlb->sets * sizeof(unsigned));
+
+    memset(tlb->entries, 0, tlb->size * sizeof(rv64_tlb_entry_t));
+    memset(tlb->hands, 0, tlb->sets * sizeof(unsigned));
 }
 
 /** Cleans up the TLB structure */
 extern void rv64_tlb_done(rv64_tlb_t *tlb)
 {
     safe_free(tlb->entries);
+    safe_free(tlb->hands);
 }
 
 extern bool rv64_tlb_resize(rv64_tlb_t *tlb, size_t size)
 {
-    safe_free(tlb->entries);
-    tlb->entries = safe_malloc(size * sizeof(rv64_tlb_entry_t));
-    tlb->size = size;
-    list_init(&tlb->lru_list);
-    list_init(&tlb->free_list);
+    rv64_tlb_done(tlb);
+    rv64_tlb_init(tlb, size);
 
-    memset(tlb->entries, 0, size * sizeof(rv64_tlb_entry_t));
+    return true;
+}
 
-    for (size_t i = 0; i < size; ++i) {
-        list_append(&tlb->free_list, &tlb->entries[i].item);
+/** Copies the entries and the clock hands of the TLB
+ *
+ * The copy is reallocated when its size differs, it has to be
+ * zero-initialized before the first copy.
+ */
+extern void rv64_tlb_copy(rv64_tlb_t *copy, const rv64_tlb_t *tlb)
+{
+    if ((copy->size != tlb->size) || (copy->sets != tlb->sets)) {
+        safe_free(copy->entries);
+        safe_free(copy->hands);
+        copy->entries = safe_malloc(tlb->size * sizeof(rv64_tlb_entry_t));
+        copy->hands = safe_malloc(tlb->sets * sizeof(unsigned));
     }
 
-    return true;
+    rv64_tlb_entry_t *entries = copy->entries;
+    unsigned *hands = copy->hands;
+
+    *copy = *tlb;
+    copy->entries = entries;
+    copy->hands = hands;
+
+    memcpy(copy->entries, tlb->entries, tlb->size * sizeof(rv64_tlb_entry_t));
+    memcpy(copy->hands, tlb->hands, tlb->sets * sizeof(unsigned));
 }
 
 static inline void dump_tlb_entry(rv64_tlb_entry_t entry, string_t *text)
@@ -333,23 +450,21 @@ extern void rv64_tlb_dump(rv64_tlb_t *tlb)
     string_t s_text;
     string_init(&s_text);
 
-    printf("TLB    size: %ld entries\n", tlb->size);
+    printf("TLB    size: %zu entries (%zu sets of %zu)\n", tlb->size, tlb->sets, tlb->ways);
     printf("%8s: %10s => %-11s [ %s ]\n", "index", "virt", "phys", "info");
 
     bool printed = false;
 
-    rv64_tlb_entry_t *entry;
-    size_t i = 0;
+    for (size_t i = 0; i < tlb->size; ++i) {
+        if (!entry_live(tlb, &tlb->entries[i])) {
+            continue;
+        }
 
-    for_each(tlb->lru_list, entry, rv64_tlb_entry_t)
-    {
         printed = true;
 
         string_clear(&s_text);
-        dump_tlb_entry(*entry, &s_text);
-        printf("%8ld: %s\n", i, s_text.str);
-
-        ++i;
+        dump_tlb_entry(tlb->entries[i], &s_text);
+        printf("%8zu: %s\n", i, s_text.str);
     }
 
     if (!printed) {
@@ -358,3 +473,71 @@ extern void rv64_tlb_dump(rv64_tlb_t *tlb)
 
     string_done(&s_text);
 }
+
+/** Page walk cache */
+
+/** Returns the VPN bits translated by the non-leaf PTEs of the given level */
+static inline uint64_t walk_vpn(uint64_t virt, rv64_walk_level_t level)
+{
+    uint64_t vpn = (virt & 0x007FFFFFFFFFULL) >> RV64_MEGAPAGESIZE;
+    return (level == rv64_walk_root) ? (vpn >> 9) : vpn;
+}
+
+/** Returns the walk cache entry which might hold the PTE of the given level */
+static inline rv64_walk_entry_t *walk_cache_slot(rv64_walk_cache_t *cache, rv64_walk_level_t level, uint64_t vpn)
+{
+    ASSERT(level < rv64_walk_count);
+    return &cache->entries[level][vpn & (RV64_WALK_CACHE_SIZE - 1)];
+}
+
+/** Finds the cached non-leaf PTE of the given level translating the address
+ *
+ * The frame of the next level table is looked up again if the
+ * physical memory layout has changed since the PTE was cached.
+ */
+extern rv64_walk_entry_t *rv64_walk_cache_find(rv64_walk_cache_t *cache, rv64_walk_level_t level, unsigned asid, uint64_t virt)
+{
+    uint64_t vpn = walk_vpn(virt, level);
+    rv64_walk_entry_t *entry = walk_cache_slot(cache, level, vpn);
+
+    if (!entry->valid || (entry->vpn != vpn) || (!entry->global && entry->asid != asid)) {
+        return NULL;
+    }
+
+    if (entry->layout != physmem_layout) {
+        entry->frame = physmem_find_frame(entry->table);
+        entry->layout = physmem_layout;
+    }
+
+    return entry;
+}
+
+/** Caches a non-leaf PTE of the given level, replacing the previous one in its slot */
+extern rv64_walk_entry_t *rv64_walk_cache_add(rv64_walk_cache_t *cache, rv64_walk_level_t level, unsigned asid, uint64_t virt, ptr55_t table, bool global)
+{
+    uint64_t vpn = walk_vpn(virt, level);
+    rv64_walk_entry_t *entry = walk_cache_slot(cache, level, vpn);
+
+    entry->valid = true;
+    entry->global = global;
+    entry->asid = asid;
+    entry->vpn = vpn;
+    entry->table = table;
+    entry->frame = physmem_find_frame(table);
+    entry->layout = physmem_layout;
+
+    return entry;
+}
+
+/** Invalidates the cached PTEs translating the given address in any address space */
+extern void rv64_walk_cache_flush_by_addr(rv64_walk_cache_t *cache, uint64_t virt)
+{
+    for (rv64_walk_level_t level = rv64_walk_root; level < rv64_walk_count; level++) {
+        uint64_t vpn = walk_vpn(virt, level);
+        rv64_walk_entry_t *entry = walk_cache_slot(cache, level, vpn);
+
+        if (entry->vpn == vpn) {
+            entry->valid = false;
+        }
+    }
+}
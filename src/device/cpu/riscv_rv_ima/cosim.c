@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Lockstep differential checking of the RISC-V blocks
+ *
+ *  Included by the CPU implementations of both RV32 and RV64 after
+ *  the step (cpu_step()) is defined. The step executing a block is
+ *  repeated by the interpreter and both are compared (see cosim.c
+ *  of the debugging features).
+ *
+ */
+
+#include "../../../debug/cosim.h"
+
+#if XLEN == 64
+#define RV_COSIM_ARCH TRACE_ARCH_RV64
+#define rv_cosim_tlb_t rv64_tlb_t
+#define rv_cosim_tlb_copy rv64_tlb_copy
+#else
+#define RV_COSIM_ARCH TRACE_ARCH_RV32
+#define rv_cosim_tlb_t rv32_tlb_t
+#define rv_cosim_tlb_copy rv32_tlb_copy
+#endif
+
+/** Architectural CSR compared after the step */
+typedef struct {
+    const char *name;
+    size_t offset;
+    size_t size;
+} rv_cosim_csr_t;
+
+#define RV_COSIM_CSR(csr) \
+    { #csr, offsetof(rv_csr_t, csr), sizeof(((rv_csr_t *) NULL)->csr) }
+
+static const rv_cosim_csr_t rv_cosim_csrs[] = {
+    RV_COSIM_CSR(cycle),
+    RV_COSIM_CSR(instret),
+    RV_COSIM_CSR(mstatus),
+    RV_COSIM_CSR(mtvec),
+    RV_COSIM_CSR(medeleg),
+    RV_COSIM_CSR(mideleg),
+    RV_COSIM_CSR(mip),
+    RV_COSIM_CSR(mie),
+    RV_COSIM_CSR(mscratch),
+    RV_COSIM_CSR(mepc),
+    RV_COSIM_CSR(mcause),
+    RV_COSIM_CSR(mtval),
+    RV_COSIM_CSR(mcounteren),
+    RV_COSIM_CSR(mcountinhibit),
+    RV_COSIM_CSR(menvcfg),
+    RV_COSIM_CSR(stvec),
+    RV_COSIM_CSR(scounteren),
+    RV_COSIM_CSR(sscratch),
+    RV_COSIM_CSR(sepc),
+    RV_COSIM_CSR(scause),
+    RV_COSIM_CSR(stval),
+    RV_COSIM_CSR(senvcfg),
+    RV_COSIM_CSR(satp),
+    RV_COSIM_CSR(scyclecmp),
+};
+
+/**
+ * @brief Reads a CSR compared after the step
+ */
+static uint64_t rv_cosim_csr_value(const rv_csr_t *csr, const rv_cosim_csr_t *item)
+{
+    const uint8_t *field = (const uint8_t *) csr + item->offset;
+
+    if (item->size == sizeof(uint32_t)) {
+        uint32_t value;
+        memcpy(&value, field, sizeof(value));
+        return value;
+    }
+
+    uint64_t value;
+    memcpy(&value, field, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Compares the architectural state after the fast run and after the interpretation
+ *
+ * @return false if the state diverges (the first divergence is reported)
+ */
+static bool rv_cosim_compare(const rv_cpu_t *fast, const rv_cpu_t *reference)
+{
+    unsigned int cpuno = reference->csr.mhartid;
+    char name[24];
+
+    if (fast->pc != reference->pc) {
+        cosim_diverged(cpuno, "pc", fast->pc, reference->pc);
+        return false;
+    }
+
+    for (unsigned int i = 1; i < sizeof(fast->regs) / sizeof(fast->regs[0]); i++) {
+        if (fast->regs[i] != reference->regs[i]) {
+            snprintf(name, sizeof(name), "x%u", i);
+            cosim_diverged(cpuno, name, fast->regs[i], reference->regs[i]);
+            return false;
+        }
+    }
+
+    if (fast->priv_mode != reference->priv_mode) {
+        cosim_diverged(cpuno, "privilege mode", fast->priv_mode, reference->priv_mode);
+        return false;
+    }
+
+    if (fast->stdby != reference->stdby) {
+        cosim_diverged(cpuno, "standby", fast->stdby, reference->stdby);
+        return false;
+    }
+
+    if (fast->reserved_valid != reference->reserved_valid) {
+        cosim_diverged(cpuno, "reservation", fast->reserved_valid, reference->reserved_valid);
+        return false;
+    }
+
+    for (size_t i = 0; i < sizeof(rv_cosim_csrs) / sizeof(rv_cosim_csrs[0]); i++) {
+        uint64_t fast_value = rv_cosim_csr_value(&fast->csr, &rv_cosim_csrs[i]);
+        uint64_t reference_value = rv_cosim_csr_value(&reference->csr, &rv_cosim_csrs[i]);
+
+        if (fast_value != reference_value) {
+            cosim_diverged(cpuno, rv_cosim_csrs[i].name, fast_value, reference_value);
+            return false;
+        }
+    }
+
+    for (unsigned int i = 0; i < 29; i++) {
+        if (fast->csr.hpmcounters[i] != reference->csr.hpmcounters[i]) {
+            snprintf(name, sizeof(name), "mhpmcounter%u", i + 3);
+            cosim_diverged(cpuno, name, fast->csr.hpmcounters[i], reference->csr.hpmcounters[i]);
+            return false;
+        }
+    }
+
+    // The host clock is sampled at different host times
+    if ((reference->csr.mtime_source == rv_mtime_virtual)
+            && (fast->csr.mtime != reference->csr.mtime)) {
+        cosim_diverged(cpuno, "mtime", fast->csr.mtime, reference->csr.mtime);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Executes a step by the fast engine and checks it by the interpreter
+ *
+ * The interpreter executes as many instructions as the block and the
+ * instruction finishing the step, the interrupts are taken only after
+ * the last one. The block statistics are those of the fast run.
+ * The TLB is kept outside of the processor structure and has to be
+ * restored separately, otherwise the interpreter would miss the page
+ * walks (and the updates of the A and D bits) of the fast run.
+ */
+static void rv_cosim_step(rv_cpu_t *cpu)
+{
+    static rv_cpu_t before;
+    static rv_cpu_t fast;
+    static rv_cosim_tlb_t tlb;
+
+    unsigned int cpuno = cpu->csr.mhartid;
+    uint64_t recorded = flight_rings[cpuno].recorded;
+    uint64_t blocks = cpu->blocks;
+    uint64_t block_instrs = cpu->block_instrs;
+
+    memcpy(&before, cpu, sizeof(rv_cpu_t));
+    rv_cosim_tlb_copy(&tlb, &cpu->tlb);
+
+    cosim_begin();
+    cpu_step(cpu, true, true);
+
+    // Without a block the step has been interpreted already
+    if (cpu->blocks == blocks) {
+        cosim_cancel();
+        return;
+    }
+
+    // Kept before the rollback touches the memory
+    memcpy(&fast, cpu, sizeof(rv_cpu_t));
+
+    if (!cosim_rollback()) {
+        return;
+    }
+
+    memcpy(cpu, &before, sizeof(rv_cpu_t));
+    cpu->tlb.entries = fast.tlb.entries;
+    cpu->tlb.hands = fast.tlb.hands;
+    rv_cosim_tlb_copy(&cpu->tlb, &tlb);
+    flight_rings[cpuno].recorded = recorded;
+
+    // The stores of the fast run may have broken the tracked reservation
+    if (cpu->reserved_valid && !cpu->reserved_by_value) {
+        sc_register(cpuno, cpu->reserved_addr);
+    }
+
+    uint64_t count = fast.block_instrs - block_instrs + 1;
+
+    for (uint64_t i = 0; i < count; i++) {
+        ptr36_t phys;
+        uint32_t instr = 0;
+
+        if (rv_convert_addr(cpu, cpu->pc, &phys, false, true, false) == rv_exc_none) {
+            frame_t *frame = physmem_find_frame(phys);
+            if (frame != NULL) {
+                instr = physmem_frame_read32(frame, phys, false);
+            }
+        }
+
+        cosim_record(cpuno, RV_COSIM_ARCH, cpu->pc, instr);
+        cpu_step(cpu, false, i + 1 == count);
+    }
+
+    if (rv_cosim_compare(&fast, cpu)) {
+        cosim_check_memory(cpuno);
+    }
+
+    cosim_finish();
+
+    cpu->blocks = fast.blocks;
+    cpu->block_instrs = fast.block_instrs;
+    cpu->fused_pairs = fast.fused_pairs;
+    cpu->block_chains = fast.block_chains;
+    cpu->jit_blocks = fast.jit_blocks;
+}
@@ -12,6 +12,13 @@
 
 #pragma GCC diagnostic ignored "-Wunused-function"
 
+#include <stdio.h>
+#include <string.h>
+
+#include "../../../debug/catchpoint.h"
+#include "../../../debug/trace.h"
+#include "../../../physmem.h"
+#include "../../../replay.h"
 #include "../../../utils.h"
 #include "csr.h"
 #include "exception.h"
@@ -35,8 +42,18 @@ static void rv_init_csr(rv_csr_t *csr, unsigned int procno)
     csr->mimpid = RV_IMPLEMENTATION_ID;
     csr->mhartid = procno;
 
-    csr->mtime = current_timestamp();
+    char name[16];
+    snprintf(name, sizeof(name), "hart%u", procno);
+    csr->mtime_replay = replay_source(name);
+
+    csr->mtime = replay_value(csr->mtime_replay, current_timestamp());
     csr->last_tick_time = csr->mtime;
+    csr->mtime_source = rv_mtime_host;
+    csr->mtime_period = RV_MTIME_HOST_PERIOD;
+
+    // MTIP is updated at the mtime ticks only, the first cycle
+    // samples the clock so that it is raised right away (mtimecmp is 0)
+    csr->mtime_countdown = 1;
 
     csr->asid_len = rv_asid_len;
 }
@@ -99,6 +116,19 @@ static rv_exc_t invalid_write(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
     return rv_exc_illegal_instruction;
 }
 
+/** Operations of the registers defined only for the other XLEN */
+static rv_exc_t unavailable_read(rv_cpu_t *cpu, csr_num_t csr, uxlen_t *target)
+{
+    die(ERR_INTERN, "Register %#x not available here (XLEN is " STRINGIFY(XLEN) ").", csr);
+    return rv_exc_illegal_instruction;
+}
+
+static rv_exc_t unavailable_write(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
+{
+    die(ERR_INTERN, "Register %#x not available here (XLEN is " STRINGIFY(XLEN) ").", csr);
+    return rv_exc_illegal_instruction;
+}
+
 #define is_counter_enabled_m(cpu, counter) (cpu->csr.mcounteren & (1 << counter))
 #define is_counter_enabled_s(cpu, counter) (cpu->csr.scounteren & (1 << counter))
 #define is_high_counter(csr) (csr & 0x080)
@@ -191,6 +221,7 @@ static rv_exc_t counter_write(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
     case (csr_mcycle): {
         cpu->csr.cycle = (cpu->csr.cycle & mask) | val;
         cpu->csr.external_STIP = ((uxlen_t) cpu->csr.cycle) >= cpu->csr.scyclecmp;
+        rv_csr_update_interrupts_pending(cpu);
         break;
     }
     case (csr_minstret): {
@@ -231,6 +262,7 @@ static rv_exc_t counter_set(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
     case (csr_mcycle): {
         cpu->csr.cycle |= val;
         cpu->csr.external_STIP = ((uxlen_t) cpu->csr.cycle) >= cpu->csr.scyclecmp;
+        rv_csr_update_interrupts_pending(cpu);
         break;
     }
     case (csr_minstret): {
@@ -269,6 +301,7 @@ static rv_exc_t counter_clear(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
     case (csr_mcycle): {
         cpu->csr.cycle &= ~val;
         cpu->csr.external_STIP = (cpu->csr.cycle) >= cpu->csr.scyclecmp;
+        rv_csr_update_interrupts_pending(cpu);
         break;
     }
     case (csr_minstret): {
@@ -286,6 +319,26 @@ static rv_exc_t counter_clear(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 
 #define mcountinhibit_mask (~UINT32_C(0b10))
 
+/**
+ * @brief Rebuild the bitmaps of HPM counters attached to each event
+ *
+ * Called whenever an event selector or mcountinhibit changes, so that
+ * the per-cycle accounting only touches counters which actually count.
+ */
+static void hpm_update_event_counters(rv_cpu_t *cpu)
+{
+    memset(cpu->csr.hpm_event_counters, 0, sizeof(cpu->csr.hpm_event_counters));
+
+    for (int i = 0; i < 29; ++i) {
+        uxlen_t event = cpu->csr.hpmevents[i];
+        bool inhibited = cpu->csr.mcountinhibit & (UINT32_C(1) << (i + 3));
+
+        if ((event != hpm_no_event) && (event < hpm_event_count) && !inhibited) {
+            cpu->csr.hpm_event_counters[event] |= UINT32_C(1) << i;
+        }
+    }
+}
+
 static rv_exc_t mcountinhibit_read(rv_cpu_t *cpu, csr_num_t csr, uxlen_t *target)
 {
     minimal_privilege(rv_mmode, cpu);
@@ -297,6 +350,7 @@ static rv_exc_t mcountinhibit_write(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 {
     minimal_privilege(rv_mmode, cpu);
     cpu->csr.mcountinhibit = value & mcountinhibit_mask;
+    hpm_update_event_counters(cpu);
     return rv_exc_none;
 }
 
@@ -304,6 +358,7 @@ static rv_exc_t mcountinhibit_set(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 {
     minimal_privilege(rv_mmode, cpu);
     cpu->csr.mcountinhibit |= value & mcountinhibit_mask;
+    hpm_update_event_counters(cpu);
     return rv_exc_none;
 }
 
@@ -311,6 +366,7 @@ static rv_exc_t mcountinhibit_clear(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 {
     minimal_privilege(rv_mmode, cpu);
     cpu->csr.mcountinhibit &= ~(value & mcountinhibit_mask);
+    hpm_update_event_counters(cpu);
     return rv_exc_none;
 }
 
@@ -330,6 +386,7 @@ static rv_exc_t mhpmevent_write(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
     if (value < hpm_event_count) {
         cpu->csr.hpmevents[event] = value;
     }
+    hpm_update_event_counters(cpu);
     return rv_exc_none;
 }
 
@@ -343,6 +400,7 @@ static rv_exc_t mhpmevent_set(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
     if (val < hpm_event_count) {
         cpu->csr.hpmevents[event] = val;
     }
+    hpm_update_event_counters(cpu);
     return rv_exc_none;
 }
 
@@ -357,47 +415,237 @@ static rv_exc_t mhpmevent_clear(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
         cpu->csr.hpmevents[event] = val;
     }
 
+    hpm_update_event_counters(cpu);
     return rv_exc_none;
 }
 
+/**
+ * @brief Compiles the active PMP entries into the address ranges checked by the accesses
+ *
+ * Called whenever a PMP CSR changes. The translations cached by the
+ * processor are forgotten, they are checked again by the next accesses.
+ */
+static void rv_pmp_update(rv_cpu_t *cpu)
+{
+    rv_csr_t *csr = &cpu->csr;
+
+    csr->pmp_region_count = 0;
+    csr->pmp_fine = false;
+
+    for (unsigned int i = 0; i < csr->pmp_entries; i++) {
+        uint8_t cfg = csr->pmpcfgs[i];
+        uint64_t addr = csr->pmpaddrs[i];
+        uint64_t base;
+        uint64_t end;
+
+        switch (rv_csr_pmpcfg_a(cfg)) {
+        case rv_csr_pmpcfg_a_tor:
+            base = (i == 0) ? 0 : ((uint64_t) csr->pmpaddrs[i - 1] << 2);
+            end = addr << 2;
+            break;
+        case rv_csr_pmpcfg_a_na4:
+            base = addr << 2;
+            end = base + 4;
+            break;
+        case rv_csr_pmpcfg_a_napot: {
+            // The trailing ones encode the size, at least 8 bytes
+            unsigned int ones = __builtin_ctzll(~addr);
+            base = ((addr >> ones) << ones) << 2;
+            end = base + (UINT64_C(8) << ones);
+            break;
+        }
+        default:
+            continue;
+        }
+
+        // Empty ranges match nothing
+        if (base >= end) {
+            continue;
+        }
+
+        rv_pmp_region_t *region = &csr->pmp_regions[csr->pmp_region_count++];
+        region->base = base;
+        region->end = end;
+        region->perm = cfg & rv_csr_pmpcfg_rwx_mask;
+        region->locked = (cfg & rv_csr_pmpcfg_l_mask) != 0;
+
+        if (!IS_ALIGNED(base, FRAME_SIZE) || !IS_ALIGNED(end, FRAME_SIZE)) {
+            csr->pmp_fine = true;
+        }
+    }
+
+    rv_utlb_flush(cpu);
+    rv_fetch_cache_flush(cpu);
+}
+
+/** Tells whether the pmpaddr of an entry is locked */
+static bool pmpaddr_locked(rv_cpu_t *cpu, unsigned int entry)
+{
+    if ((cpu->csr.pmpcfgs[entry] & rv_csr_pmpcfg_l_mask) != 0) {
+        return true;
+    }
+
+    // A locked TOR entry locks the bottom of its range as well
+    if (entry + 1 < cpu->csr.pmp_entries) {
+        uint8_t next = cpu->csr.pmpcfgs[entry + 1];
+        return ((next & rv_csr_pmpcfg_l_mask) != 0)
+                && (rv_csr_pmpcfg_a(next) == rv_csr_pmpcfg_a_tor);
+    }
+
+    return false;
+}
+
+/**
+ * @brief Gets the first PMP entry configured by a pmpcfg register
+ *
+ * On RV64 only the even registers exist, each of them configures 8 entries.
+ *
+ * @return false if the register does not exist
+ */
+static bool pmpcfg_first_entry(rv_cpu_t *cpu, csr_num_t csr, unsigned int *entry)
+{
+    unsigned int index = csr - csr_pmpcfg0;
+
+    if ((cpu->csr.pmp_entries == 0) || (index % (rv_csr_pmpcfg_fields / 4) != 0)) {
+        return false;
+    }
+
+    *entry = index * 4;
+    return true;
+}
+
 static rv_exc_t pmpcfg_read(rv_cpu_t *cpu, csr_num_t csr, uxlen_t *target)
 {
-    return rv_exc_illegal_instruction;
+    unsigned int entry;
+
+    if (!pmpcfg_first_entry(cpu, csr, &entry)) {
+        return rv_exc_illegal_instruction;
+    }
+
+    minimal_privilege(rv_mmode, cpu);
+
+    uxlen_t value = 0;
+
+    for (unsigned int i = 0; i < rv_csr_pmpcfg_fields; i++) {
+        value |= (uxlen_t) cpu->csr.pmpcfgs[entry + i] << (i * 8);
+    }
+
+    *target = value;
+    return rv_exc_none;
 }
 
 static rv_exc_t pmpcfg_write(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 {
-    return rv_exc_illegal_instruction;
+    unsigned int entry;
+
+    if (!pmpcfg_first_entry(cpu, csr, &entry)) {
+        return rv_exc_illegal_instruction;
+    }
+
+    minimal_privilege(rv_mmode, cpu);
+
+    for (unsigned int i = 0; i < rv_csr_pmpcfg_fields; i++) {
+        unsigned int index = entry + i;
+        uint8_t cfg = (value >> (i * 8)) & 0xFF;
+
+        // Unimplemented and locked entries are read-only
+        if ((index >= cpu->csr.pmp_entries)
+                || ((cpu->csr.pmpcfgs[index] & rv_csr_pmpcfg_l_mask) != 0)) {
+            continue;
+        }
+
+        // The bits 5 and 6 are reserved, W without R is reserved as well
+        cfg &= rv_csr_pmpcfg_rwx_mask | rv_csr_pmpcfg_a_mask | rv_csr_pmpcfg_l_mask;
+
+        if ((cfg & rv_csr_pmpcfg_r_mask) == 0) {
+            cfg &= ~rv_csr_pmpcfg_w_mask;
+        }
+
+        cpu->csr.pmpcfgs[index] = cfg;
+    }
+
+    rv_pmp_update(cpu);
+    return rv_exc_none;
 }
 
 static rv_exc_t pmpcfg_set(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 {
-    return rv_exc_illegal_instruction;
+    uxlen_t current;
+    rv_exc_t ex = pmpcfg_read(cpu, csr, &current);
+
+    if (ex != rv_exc_none) {
+        return ex;
+    }
+
+    return pmpcfg_write(cpu, csr, current | value);
 }
 
 static rv_exc_t pmpcfg_clear(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 {
-    return rv_exc_illegal_instruction;
+    uxlen_t current;
+    rv_exc_t ex = pmpcfg_read(cpu, csr, &current);
+
+    if (ex != rv_exc_none) {
+        return ex;
+    }
+
+    return pmpcfg_write(cpu, csr, current & ~value);
 }
 
 static rv_exc_t pmpaddr_read(rv_cpu_t *cpu, csr_num_t csr, uxlen_t *target)
 {
-    return rv_exc_illegal_instruction;
+    if (cpu->csr.pmp_entries == 0) {
+        return rv_exc_illegal_instruction;
+    }
+
+    minimal_privilege(rv_mmode, cpu);
+
+    unsigned int entry = csr - csr_pmpaddr0;
+    *target = (entry < cpu->csr.pmp_entries) ? cpu->csr.pmpaddrs[entry] : 0;
+    return rv_exc_none;
 }
 
 static rv_exc_t pmpaddr_write(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 {
-    return rv_exc_illegal_instruction;
+    if (cpu->csr.pmp_entries == 0) {
+        return rv_exc_illegal_instruction;
+    }
+
+    minimal_privilege(rv_mmode, cpu);
+
+    unsigned int entry = csr - csr_pmpaddr0;
+
+    if ((entry >= cpu->csr.pmp_entries) || pmpaddr_locked(cpu, entry)) {
+        return rv_exc_none;
+    }
+
+    cpu->csr.pmpaddrs[entry] = value & rv_csr_pmpaddr_mask;
+    rv_pmp_update(cpu);
+    return rv_exc_none;
 }
 
 static rv_exc_t pmpaddr_set(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 {
-    return rv_exc_illegal_instruction;
+    uxlen_t current;
+    rv_exc_t ex = pmpaddr_read(cpu, csr, &current);
+
+    if (ex != rv_exc_none) {
+        return ex;
+    }
+
+    return pmpaddr_write(cpu, csr, current | value);
 }
 
 static rv_exc_t pmpaddr_clear(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 {
-    return rv_exc_illegal_instruction;
+    uxlen_t current;
+    rv_exc_t ex = pmpaddr_read(cpu, csr, &current);
+
+    if (ex != rv_exc_none) {
+        return ex;
+    }
+
+    return pmpaddr_write(cpu, csr, current & ~value);
 }
 
 static rv_exc_t sstatus_read(rv_cpu_t *cpu, csr_num_t csr, uxlen_t *target)
@@ -414,6 +662,7 @@ static rv_exc_t sstatus_write(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
     // Masked write of low 32 bits
     // TODO: Reconsider this masking
     cpu->csr.mstatus = (cpu->csr.mstatus & 0xFFFFFFFF00000000) | (value & rv_csr_sstatus_mask);
+    rv_utlb_flush(cpu);
     return rv_exc_none;
 }
 
@@ -422,6 +671,7 @@ static rv_exc_t sstatus_set(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
     minimal_privilege(rv_smode, cpu);
     // Masked write
     cpu->csr.mstatus |= (value & rv_csr_sstatus_mask);
+    rv_utlb_flush(cpu);
     return rv_exc_none;
 }
 
@@ -430,6 +680,7 @@ static rv_exc_t sstatus_clear(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
     minimal_privilege(rv_smode, cpu);
     // Masked write
     cpu->csr.mstatus &= ~(value & rv_csr_sstatus_mask);
+    rv_utlb_flush(cpu);
     return rv_exc_none;
 }
 
@@ -447,6 +698,7 @@ static rv_exc_t sie_write(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
     // write only to si bits, preserve rest
     cpu->csr.mie &= ~rv_csr_si_mask;
     cpu->csr.mie |= value & rv_csr_si_mask;
+    rv_csr_update_interrupts_pending(cpu);
     return rv_exc_none;
 }
 
@@ -454,6 +706,7 @@ static rv_exc_t sie_set(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 {
     minimal_privilege(rv_smode, cpu);
     cpu->csr.mie |= value & rv_csr_si_mask;
+    rv_csr_update_interrupts_pending(cpu);
     return rv_exc_none;
 }
 
@@ -461,6 +714,7 @@ static rv_exc_t sie_clear(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 {
     minimal_privilege(rv_smode, cpu);
     cpu->csr.mie &= ~(value & rv_csr_si_mask);
+    rv_csr_update_interrupts_pending(cpu);
     return rv_exc_none;
 }
 
@@ -483,6 +737,7 @@ static rv_exc_t sip_write(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
     // only ssip is writable
     cpu->csr.mip &= ~rv_csr_ssi_mask;
     cpu->csr.mip |= value & rv_csr_ssi_mask;
+    rv_csr_update_interrupts_pending(cpu);
     return rv_exc_none;
 }
 
@@ -490,6 +745,7 @@ static rv_exc_t sip_set(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 {
     minimal_privilege(rv_smode, cpu);
     cpu->csr.mip |= value & rv_csr_ssi_mask;
+    rv_csr_update_interrupts_pending(cpu);
     return rv_exc_none;
 }
 
@@ -497,6 +753,7 @@ static rv_exc_t sip_clear(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 {
     minimal_privilege(rv_smode, cpu);
     cpu->csr.mip &= ~(value & rv_csr_ssi_mask);
+    rv_csr_update_interrupts_pending(cpu);
     return rv_exc_none;
 }
 
@@ -656,6 +913,15 @@ static rv_exc_t scause_clear(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 
 default_csr_functions(stval, rv_smode)
 
+/** Record a switch of the address space as a system event (see the events variable) */
+static void satp_trace(rv_cpu_t *cpu)
+{
+    if (trace_events) {
+        trace_event(cpu->csr.mhartid, (XLEN == 32) ? TRACE_ARCH_RV32 : TRACE_ARCH_RV64,
+                TRACE_EVENT_SPACE, 0, cpu->csr.satp);
+    }
+}
+
         static rv_exc_t satp_read(rv_cpu_t *cpu, csr_num_t csr, uxlen_t *target)
 {
     minimal_privilege(rv_smode, cpu);
@@ -686,6 +952,9 @@ static rv_exc_t satp_write(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
         cpu->csr.satp = 0;
     }
 
+    satp_trace(cpu);
+    rv_utlb_flush(cpu);
+    rv_walk_cache_flush(cpu);
     return rv_exc_none;
 }
 
@@ -708,6 +977,9 @@ static rv_exc_t satp_set(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
         cpu->csr.satp = 0;
     }
 
+    satp_trace(cpu);
+    rv_utlb_flush(cpu);
+    rv_walk_cache_flush(cpu);
     return rv_exc_none;
 }
 
@@ -730,6 +1002,9 @@ static rv_exc_t satp_clear(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
         cpu->csr.satp = 0;
     }
 
+    satp_trace(cpu);
+    rv_utlb_flush(cpu);
+    rv_walk_cache_flush(cpu);
     return rv_exc_none;
 }
 
@@ -749,6 +1024,7 @@ static rv_exc_t scyclecmp_write(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
     minimal_privilege(rv_smode, cpu);
     cpu->csr.scyclecmp = value;
     cpu->csr.external_STIP = ((uxlen_t) cpu->csr.cycle) >= cpu->csr.scyclecmp;
+    rv_csr_update_interrupts_pending(cpu);
     return rv_exc_none;
 }
 static rv_exc_t scyclecmp_set(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
@@ -756,6 +1032,7 @@ static rv_exc_t scyclecmp_set(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
     minimal_privilege(rv_smode, cpu);
     cpu->csr.scyclecmp |= value;
     cpu->csr.external_STIP = ((uxlen_t) cpu->csr.cycle) >= cpu->csr.scyclecmp;
+    rv_csr_update_interrupts_pending(cpu);
     return rv_exc_none;
 }
 static rv_exc_t scyclecmp_clear(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
@@ -763,6 +1040,7 @@ static rv_exc_t scyclecmp_clear(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
     minimal_privilege(rv_smode, cpu);
     cpu->csr.scyclecmp &= ~value;
     cpu->csr.external_STIP = ((uxlen_t) cpu->csr.cycle) >= cpu->csr.scyclecmp;
+    rv_csr_update_interrupts_pending(cpu);
     return rv_exc_none;
 }
 
@@ -823,6 +1101,7 @@ static rv_exc_t mstatus_write(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
     }
 
     cpu->csr.mstatus = (cpu->csr.mstatus & 0xFFFFFFFF00000000) | val;
+    rv_utlb_flush(cpu);
     return rv_exc_none;
 }
 
@@ -841,6 +1120,7 @@ static rv_exc_t mstatus_set(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 
     cpu->csr.mstatus |= value;
 
+    rv_utlb_flush(cpu);
     return rv_exc_none;
 }
 
@@ -858,6 +1138,7 @@ static rv_exc_t mstatus_clear(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
     }
 
     cpu->csr.mstatus &= ~value;
+    rv_utlb_flush(cpu);
     return rv_exc_none;
 }
 
@@ -987,6 +1268,7 @@ static rv_exc_t mie_write(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 {
     minimal_privilege(rv_mmode, cpu);
     cpu->csr.mie = value & rv_csr_mi_mask;
+    rv_csr_update_interrupts_pending(cpu);
     return rv_exc_none;
 }
 
@@ -994,6 +1276,7 @@ static rv_exc_t mie_set(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 {
     minimal_privilege(rv_mmode, cpu);
     cpu->csr.mie |= value & rv_csr_mi_mask;
+    rv_csr_update_interrupts_pending(cpu);
     return rv_exc_none;
 }
 
@@ -1001,6 +1284,7 @@ static rv_exc_t mie_clear(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 {
     minimal_privilege(rv_mmode, cpu);
     cpu->csr.mie &= ~(value & rv_csr_mi_mask);
+    rv_csr_update_interrupts_pending(cpu);
     return rv_exc_none;
 }
 
@@ -1024,6 +1308,7 @@ static rv_exc_t mip_write(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
     minimal_privilege(rv_mmode, cpu);
 
     cpu->csr.mip = value & mip_mask;
+    rv_csr_update_interrupts_pending(cpu);
     return rv_exc_none;
 }
 
@@ -1031,6 +1316,7 @@ static rv_exc_t mip_set(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 {
     minimal_privilege(rv_mmode, cpu);
     cpu->csr.mip |= value & mip_mask;
+    rv_csr_update_interrupts_pending(cpu);
     return rv_exc_none;
 }
 
@@ -1038,6 +1324,7 @@ static rv_exc_t mip_clear(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value)
 {
     minimal_privilege(rv_mmode, cpu);
     cpu->csr.mip &= ~(value & mip_mask);
+    rv_csr_update_interrupts_pending(cpu);
     return rv_exc_none;
 }
 
@@ -1470,9 +1757,12 @@ static csr_ops_t get_csr_ops(csr_num_t csr)
         break; \
     }
 
-#define unreachable_case(csr, reason) \
+#define unreachable_case(csr) \
     case csr_##csr: { \
-        die(ERR_INTERN, "Register " #csr " not available here" reason "."); \
+        ops.read = unavailable_read; \
+        ops.write = unavailable_write; \
+        ops.set = unavailable_write; \
+        ops.clear = unavailable_write; \
         break; \
     }
 
@@ -1780,7 +2070,7 @@ static csr_ops_t get_csr_ops(csr_num_t csr)
     #if XLEN == 32
     default_case(mstatush)
     #else
-    unreachable_case(mstatush, " (XLEN is " STRINGIFY(XLEN) ")")
+    unreachable_case(mstatush)
     #endif
 
 
@@ -1820,9 +2110,46 @@ static csr_ops_t get_csr_ops(csr_num_t csr)
     return ops;
 
 #undef default_case
+#undef unreachable_case
 #undef read_only_case
 }
 
+/** Number of the CSR numbers (12 bits) */
+#define RV_CSR_COUNT 0x1000
+
+/** CSR operations indexed by the CSR number */
+static csr_ops_t csr_ops_table[RV_CSR_COUNT];
+
+/**
+ * @brief Fills the CSR operations table before the simulation starts
+ *
+ * The CSR instructions then reach the operations by a single
+ * table lookup instead of going through the switch above.
+ */
+__attribute__((constructor)) static void csr_ops_table_init(void)
+{
+    for (unsigned int csr = 0; csr < RV_CSR_COUNT; csr++) {
+        csr_ops_table[csr] = get_csr_ops((csr_num_t) csr);
+    }
+}
+
+/** Retrieves the CSR ops for the given csr from the table */
+static inline const csr_ops_t *csr_ops(csr_num_t csr)
+{
+    ASSERT((unsigned int) csr < RV_CSR_COUNT);
+    return &csr_ops_table[csr];
+}
+
+/**
+ * @brief Reports a CSR write to the catchpoints
+ */
+static void rv_csr_caught(rv_cpu_t *cpu, csr_num_t csr)
+{
+    uxlen_t value = 0;
+    csr_ops(csr)->read(cpu, csr, &value);
+    catchpoint_write(cpu->csr.mhartid, csr, value);
+}
+
 /**
  * @brief Reads the old value from the CSR, then writes the specified value
  *
@@ -1835,16 +2162,20 @@ static csr_ops_t get_csr_ops(csr_num_t csr)
  */
 static rv_exc_t rv_csr_rw(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value, uxlen_t *read_target, bool read)
 {
-    csr_ops_t ops = get_csr_ops(csr);
+    const csr_ops_t *ops = csr_ops(csr);
     rv_exc_t ex = rv_exc_none;
     uxlen_t temp_read_target = 0;
 
     if (read) {
-        ex = ops.read(cpu, csr, &temp_read_target);
+        ex = ops->read(cpu, csr, &temp_read_target);
     }
 
     if (ex == rv_exc_none) {
-        ex = ops.write(cpu, csr, value);
+        ex = ops->write(cpu, csr, value);
+    }
+
+    if ((ex == rv_exc_none) && (catchpoint_armed(cpu->csr.mhartid, CATCH_WRITE))) {
+        rv_csr_caught(cpu, csr);
     }
 
     if (ex == rv_exc_none) {
@@ -1866,14 +2197,18 @@ static rv_exc_t rv_csr_rw(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value, uxlen_t *
  */
 static rv_exc_t rv_csr_rs(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value, uxlen_t *read_target, bool write)
 {
-    csr_ops_t ops = get_csr_ops(csr);
+    const csr_ops_t *ops = csr_ops(csr);
 
     uxlen_t temp_read_target = 0;
 
-    rv_exc_t ex = ops.read(cpu, csr, &temp_read_target);
+    rv_exc_t ex = ops->read(cpu, csr, &temp_read_target);
 
     if (ex == rv_exc_none && write) {
-        ex = ops.set(cpu, csr, value);
+        ex = ops->set(cpu, csr, value);
+
+        if ((ex == rv_exc_none) && (catchpoint_armed(cpu->csr.mhartid, CATCH_WRITE))) {
+            rv_csr_caught(cpu, csr);
+        }
     }
 
     if (ex == rv_exc_none) {
@@ -1896,12 +2231,16 @@ static rv_exc_t rv_csr_rs(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value, uxlen_t *
 static rv_exc_t rv_csr_rc(rv_cpu_t *cpu, csr_num_t csr, uxlen_t value, uxlen_t *read_target, bool write)
 {
 
-    csr_ops_t ops = get_csr_ops(csr);
+    const csr_ops_t *ops = csr_ops(csr);
     uxlen_t temp_read_target = 0;
-    rv_exc_t ex = ops.read(cpu, csr, &temp_read_target);
+    rv_exc_t ex = ops->read(cpu, csr, &temp_read_target);
 
     if (ex == rv_exc_none && write) {
-        ex = ops.clear(cpu, csr, value);
+        ex = ops->clear(cpu, csr, value);
+
+        if ((ex == rv_exc_none) && (catchpoint_armed(cpu->csr.mhartid, CATCH_WRITE))) {
+            rv_csr_caught(cpu, csr);
+        }
     }
 
     if (ex == rv_exc_none) {
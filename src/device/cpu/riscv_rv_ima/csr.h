@@ -16,6 +16,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "../intr_latency.h"
 #include "exception.h"
 #include "types.h"
 
@@ -383,15 +384,42 @@ typedef enum {
 /**
  * Structure holding CSR data
  */
+/** Source of the mtime register */
+typedef enum {
+    /** Host clock in milliseconds, sampled every mtime_period cycles */
+    rv_mtime_host,
+    /** Deterministic clock ticking once every mtime_period cycles */
+    rv_mtime_virtual,
+} rv_mtime_source_t;
+
+/** Default number of cycles between samples of the host clock */
+#define RV_MTIME_HOST_PERIOD 1024
+
+/** Default number of cycles per tick of the virtual clock */
+#define RV_MTIME_VIRTUAL_PERIOD 1000
+
+/** Number of the PMP entries defined by the architecture */
+#define RV_PMP_ENTRIES 64
+
+/** Address range of an active PMP entry (see rv_pmp_update()) */
+typedef struct {
+    /* First byte of the range */
+    uint64_t base;
+    /* First byte after the range */
+    uint64_t end;
+    /* Permission bits (R, W, X) of the pmpcfg field */
+    uint8_t perm;
+    /* Whether the entry applies to M-mode as well */
+    bool locked;
+} rv_pmp_region_t;
+
 typedef struct {
     /* Counters/Timers */
     uint64_t cycle;
     uint64_t instret;
 
-    uint64_t hpmcounters[29];
-
-    /* Event selectors */
-    uxlen_t hpmevents[29];
+    /* Bitmaps of the counters counting each event (inhibited ones excluded) */
+    uint32_t hpm_event_counters[hpm_event_count];
 
     /* Machine-level registers */
 
@@ -427,10 +455,6 @@ typedef struct {
     /* debug/trace */
     uxlen_t mcontext;
 
-    /* physical memory protection */
-    uint8_t pmpcfgs[64];
-    uxlen_t pmpaddrs[64];
-
     /* Supervisor level registers*/
 
     // sstatus shared witm m-mode
@@ -463,11 +487,19 @@ typedef struct {
     // Full explanation RISC-V Privileged spec section 3.1.9 Machine Interrupt Registers (mip and mie)
     bool external_SEIP;
 
-    // Value of memory-mapped register mtime
+    // Value of mtime (memory-mapped by the dclint device)
     uint64_t mtime;
     // The timestamp of the last clock cycle
     uint64_t last_tick_time;
-    // Value of memory-mapped register mtimecmp
+    // Source of the host clock samples in the replay log (see replay.h)
+    unsigned int mtime_replay;
+    // Source of mtime
+    rv_mtime_source_t mtime_source;
+    // Cycles between host clock samples resp. per virtual clock tick
+    unsigned int mtime_period;
+    // Cycles left until the next mtime update
+    unsigned int mtime_countdown;
+    // Value of mtimecmp (memory-mapped by the dclint device)
     uint64_t mtimecmp;
 
     // Supervisor cycle compare used for STI
@@ -475,14 +507,39 @@ typedef struct {
     uxlen_t scyclecmp;
     bool external_STIP;
 
+    // Whether any interrupt is both pending (in the effective mip) and enabled in mie,
+    // kept by rv_csr_update_interrupts_pending() so that the interrupt check is cheap
+    bool interrupts_pending;
+
     // Number of bits used in the ASID field of SATP CSR - Should be between 0 and 9.
     unsigned asid_len;
 
+    /* Rarely accessed registers (kept apart from the ones used by each step) */
+
+    /* Counters/Timers */
+    uint64_t hpmcounters[29];
+
+    /* Event selectors */
+    uxlen_t hpmevents[29];
+
+    /* physical memory protection */
+    uint8_t pmpcfgs[RV_PMP_ENTRIES];
+    uxlen_t pmpaddrs[RV_PMP_ENTRIES];
+
+    // Number of implemented PMP entries (0, 16 or 64), the PMP CSRs are
+    // illegal without any
+    unsigned pmp_entries;
+    // Ranges of the active entries in the order of priority, compiled
+    // whenever the PMP CSRs change
+    rv_pmp_region_t pmp_regions[RV_PMP_ENTRIES];
+    unsigned pmp_region_count;
+    // Whether a range boundary lies inside a frame, so that the permissions
+    // are not uniform within the frames and each access has to be checked
+    bool pmp_fine;
+
 } rv_csr_t;
 
 #define RV_START_ADDRESS XLEN_C(0xF0000000)
-#define RV_MTIME_ADDRESS XLEN_C(0xFF000000)
-#define RV_MTIMECMP_ADDRESS XLEN_C(0xFF000008)
 
 #define RV_A_EXTENSION_BITS XLEN_C(1 << 0)
 #define RV_C_EXTENSION_BITS XLEN_C(1 << 2)
@@ -570,6 +627,22 @@ typedef struct {
 #define rv_csr_si_mask (rv_csr_sei_mask | rv_csr_sti_mask | rv_csr_ssi_mask)
 #define rv_csr_mi_mask (rv_csr_si_mask | rv_csr_mei_mask | rv_csr_mti_mask | rv_csr_msi_mask)
 
+// Effective mip includes the external SEIP and STIP
+// Full explanation RISC-V Privileged spec section 3.1.9 Machine Interrupt Registers (mip and mie)
+#define rv_csr_effective_mip(cpu) \
+    ((cpu)->csr.mip \
+            | ((cpu)->csr.external_SEIP ? rv_csr_sei_mask : 0) \
+            | ((cpu)->csr.external_STIP ? rv_csr_sti_mask : 0))
+
+// Has to follow every change of mip, mie, external_SEIP and external_STIP,
+// the interrupt lines going up are stamped for the latency histograms
+#define rv_csr_update_interrupts_pending(cpu) \
+    do { \
+        uint32_t mip_ = rv_csr_effective_mip(cpu); \
+        intr_latency_update(&(cpu)->intr_latency, mip_); \
+        (cpu)->csr.interrupts_pending = (mip_ & (cpu)->csr.mie) != 0; \
+    } while (0)
+
 #define rv_csr_mtvec_mode_mask XLEN_C(0b11)
 #define rv_csr_mtvec_mode_direct XLEN_C(0)
 #define rv_csr_mtvec_mode_vectored XLEN_C(1)
@@ -584,6 +657,9 @@ typedef struct {
 #define rv_csr_satp_asid(cpu) (((cpu)->csr.satp & rv_csr_asid_mask) >> 22)
 #define rv_asid_len 9
 
+#define rv_csr_pmpaddr_mask 0xFFFFFFFF
+#define rv_csr_pmpcfg_fields 4
+
 #elif XLEN == 64
 
 #define rv_csr_satp_mode_mask (UINT64_C(8) << 60)
@@ -594,6 +670,9 @@ typedef struct {
 #define rv_csr_satp_asid(cpu) (((cpu)->csr.satp & rv_csr_asid_mask) >> rv_csr_satp_asid_offset)
 #define rv_asid_len 16
 
+#define rv_csr_pmpaddr_mask 0x3FFFFFFFFFFFFF
+#define rv_csr_pmpcfg_fields 8
+
 #else
 
 #error "XLEN must be either 32 or 64"
@@ -611,6 +690,23 @@ typedef struct {
 
 #define rv_asid_mask ((1 << rv_asid_len) - 1)
 
+/* Fields of a PMP entry configuration (a byte of pmpcfg) */
+#define rv_csr_pmpcfg_r_mask 0x01
+#define rv_csr_pmpcfg_w_mask 0x02
+#define rv_csr_pmpcfg_x_mask 0x04
+#define rv_csr_pmpcfg_rwx_mask 0x07
+#define rv_csr_pmpcfg_a_mask 0x18
+#define rv_csr_pmpcfg_a_pos 3
+#define rv_csr_pmpcfg_l_mask 0x80
+
+/* Address matching modes of a PMP entry (the A field) */
+#define rv_csr_pmpcfg_a_off 0
+#define rv_csr_pmpcfg_a_tor 1
+#define rv_csr_pmpcfg_a_na4 2
+#define rv_csr_pmpcfg_a_napot 3
+
+#define rv_csr_pmpcfg_a(cfg) (((cfg) & rv_csr_pmpcfg_a_mask) >> rv_csr_pmpcfg_a_pos)
+
 #define rv_csr_is_read_only(csr) (((csr) >> 30) == 0b11)
 
 #endif // RISCV_RV_CSR_H_
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Fusion of RISC-V instruction pairs
+ *
+ *  Included by the CPU implementations of both RV32 and RV64 after the
+ *  decoded pages (cache_instr_t) are defined.
+ *
+ *  The pairs building a constant or an address in a register (LUI or
+ *  AUIPC followed by an ADDI of the same register) are recognized when
+ *  a page is decoded. Within a block the pair is executed at once, with
+ *  the same result as the two instructions. The pairs cannot raise an
+ *  exception, so a block leaves a pair only when its limit falls between
+ *  the two instructions; the pair is then executed one by one. A block
+ *  starting at the second instruction (e.g. a branch target) executes
+ *  the instruction as usual.
+ *
+ */
+
+/** @brief Kinds of the fused instruction pairs */
+typedef enum {
+    rv_fused_none = 0,
+    rv_fused_lui_addi, // lui rd, hi; addi rd, rd, lo
+    rv_fused_lui_addiw, // lui rd, hi; addiw rd, rd, lo (RV64)
+    rv_fused_auipc_addi, // auipc rd, hi; addi rd, rd, lo
+} rv_fused_t;
+
+/**
+ * @brief Tells which kind of pair an instruction forms with the next one
+ *
+ * No pairs are fused while the instruction mix is counted,
+ * so that every instruction is counted.
+ */
+static rv_fused_t rv_fusion_kind(rv_instr_t first, rv_instr_t second)
+{
+    if (mixstat_enabled || (first.u.rd == 0) || (second.i.rd != first.u.rd)
+            || (second.i.rs1 != first.u.rd)) {
+        return rv_fused_none;
+    }
+
+    bool addi = (second.i.opcode == rv_opcOP_IMM) && (second.i.funct3 == rv_func_ADDI);
+    bool addiw = (XLEN == 64) && (second.i.opcode == rv_opcOP_IMM_32) && (second.i.funct3 == rv_func_ADDI);
+
+    switch (first.u.opcode) {
+    case rv_opcLUI:
+        if (addi) {
+            return rv_fused_lui_addi;
+        }
+        return addiw ? rv_fused_lui_addiw : rv_fused_none;
+    case rv_opcAUIPC:
+        return addi ? rv_fused_auipc_addi : rv_fused_none;
+    default:
+        return rv_fused_none;
+    }
+}
+
+/**
+ * @brief Executes a fused pair of instructions
+ *
+ * PC stays at the first instruction of the pair.
+ */
+static void rv_fused_execute(rv_cpu_t *cpu, const cache_instr_t *instr)
+{
+    rv_instr_t first = instr[0].data;
+    rv_instr_t second = instr[1].data;
+
+    uxlen_t hi = (uxlen_t) sign_extend_32_to_xlen(first.u.imm << 12, XLEN);
+    uxlen_t lo = (uxlen_t) (xlen_t) second.i.imm;
+
+    switch ((rv_fused_t) instr->fused) {
+    case rv_fused_lui_addi:
+        cpu->regs[first.u.rd] = hi + lo;
+        break;
+    case rv_fused_lui_addiw:
+        cpu->regs[first.u.rd] = (uxlen_t) (xlen_t) (int32_t) (uint32_t) (hi + lo);
+        break;
+    case rv_fused_auipc_addi:
+        cpu->regs[first.u.rd] = cpu->pc + hi + lo;
+        break;
+    default:
+        ASSERT(false);
+    }
+}
@@ -14,6 +14,7 @@
 #define RISCV_RV_INSTR_H_
 
 #include <assert.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "../../../utils.h"
@@ -200,6 +201,9 @@ typedef enum {
     rv_privETRACES = 0b100011000010,
     rv_privETRACER = 0b100011000011,
     rv_privECSRD = 0b100011000100,
+    rv_privEROIB = 0b100011000101,
+    rv_privEROIE = 0b100011000110,
+    rv_privEHCALL = 0b100011000111,
     rv_privSRET = 0b000100000010,
     rv_privMRET = 0b001100000010,
     rv_privWFI = 0b000100000101
@@ -231,4 +235,24 @@ typedef enum {
 
 typedef enum rv_exc (*rv_instr_func_t)(rv_cpu_t *, rv_instr_t);
 
+/** Tell whether the instruction jumps to itself whatever the registers
+ *
+ * Such are the jal with a zero offset (e.g. `j .`) and the beq, bge
+ * and bgeu comparing a register with itself with a zero offset.
+ *
+ */
+static inline bool rv_instr_self_loop(rv_instr_t instr)
+{
+    switch (instr.r.opcode) {
+    case rv_opcJAL:
+        return (instr.val & 0xFFFFF000) == 0;
+    case rv_opcBRANCH:
+        return ((instr.val & 0xFE000F80) == 0) && (instr.r.rs1 == instr.r.rs2)
+                && ((instr.r.funct3 == rv_func_BEQ) || (instr.r.funct3 == rv_func_BGE)
+                        || (instr.r.funct3 == rv_func_BGEU));
+    default:
+        return false;
+    }
+}
+
 #endif // RISCV_RV_INSTR_H_
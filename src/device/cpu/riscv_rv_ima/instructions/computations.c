@@ -15,6 +15,9 @@
 #include <stdint.h>
 
 #include "../../../../assert.h"
+#include "../../../../debug/memtrace.h"
+#include "../../../../endian.h"
+#include "../../../../parallel.h"
 #include "../../../../utils.h"
 #include "../exception.h"
 #include "../instr.h"
@@ -28,6 +31,7 @@ rv_exc_t rv_write_mem16(rv_cpu_t *cpu, virt_t virt, uint16_t value, bool noisy);
 rv_exc_t rv_write_mem32(rv_cpu_t *cpu, virt_t virt, uint32_t value, bool noisy);
 rv_exc_t rv_write_mem64(rv_cpu_t *cpu, virt_t virt, uint64_t value, bool noisy);
 rv_exc_t rv_convert_addr(rv_cpu_t *cpu, virt_t virt, ptr36_t *phys, bool wr, bool fetch, bool noisy);
+rv_exc_t rv_atomic_translate(rv_cpu_t *cpu, virt_t virt, int size, ptr36_t *phys, frame_t **frame, void **host);
 
 /******
  * OP *
@@ -722,33 +726,212 @@ static rv_exc_t rv_remuw_instr(rv_cpu_t *cpu, rv_instr_t instr)
 
 /* A extension atomic operations */
 
-#define throw_ex(cpu, virt, ex) \
-    { \
-        cpu->csr.tval_next = virt; \
-        return ex; \
+/** Operations of the AMO instructions */
+typedef enum {
+    rv_amo_swap,
+    rv_amo_add,
+    rv_amo_xor,
+    rv_amo_and,
+    rv_amo_or,
+    rv_amo_min,
+    rv_amo_max,
+    rv_amo_minu,
+    rv_amo_maxu
+} rv_amo_op_t;
+
+/** Computes the new memory value of a 32-bit AMO */
+static uint32_t rv_amo_apply32(rv_amo_op_t op, uint32_t mem, uint32_t operand)
+{
+    switch (op) {
+    case rv_amo_swap:
+        return operand;
+    case rv_amo_add:
+        return mem + operand;
+    case rv_amo_xor:
+        return mem ^ operand;
+    case rv_amo_and:
+        return mem & operand;
+    case rv_amo_or:
+        return mem | operand;
+    case rv_amo_min:
+        return ((int32_t) operand < (int32_t) mem) ? operand : mem;
+    case rv_amo_max:
+        return ((int32_t) operand > (int32_t) mem) ? operand : mem;
+    case rv_amo_minu:
+        return (operand < mem) ? operand : mem;
+    case rv_amo_maxu:
+        return (operand > mem) ? operand : mem;
+    }
+
+    ASSERT(false);
+    return mem;
+}
+
+/** Computes the new memory value of a 64-bit AMO */
+static uint64_t rv_amo_apply64(rv_amo_op_t op, uint64_t mem, uint64_t operand)
+{
+    switch (op) {
+    case rv_amo_swap:
+        return operand;
+    case rv_amo_add:
+        return mem + operand;
+    case rv_amo_xor:
+        return mem ^ operand;
+    case rv_amo_and:
+        return mem & operand;
+    case rv_amo_or:
+        return mem | operand;
+    case rv_amo_min:
+        return ((int64_t) operand < (int64_t) mem) ? operand : mem;
+    case rv_amo_max:
+        return ((int64_t) operand > (int64_t) mem) ? operand : mem;
+    case rv_amo_minu:
+        return (operand < mem) ? operand : mem;
+    case rv_amo_maxu:
+        return (operand > mem) ? operand : mem;
     }
 
-#define throw_if_wrong_privilege(cpu, virt) \
-    { \
-        ptr36_t _; \
-        rv_exc_t ex; \
-        ex = rv_convert_addr(cpu, virt, &_, true, false, true); \
-        if (ex != rv_exc_none) { \
-            throw_ex(cpu, virt, ex); \
-        } \
+    ASSERT(false);
+    return mem;
+}
+
+/**
+ * @brief Performs a 32-bit AMO
+ *
+ * The address is translated (and checked for the privileges and the
+ * alignment) only once for both the read and the write. The operation
+ * is carried out by the host atomics on the memory backing the address,
+ * so processors simulated on other threads observe it as a single access.
+ * Addresses which need the memory access functions (devices, watched or
+ * decoded frames, memory mapped registers) are read and written through
+ * the translated frame inside a shared section instead.
+ *
+ * @param val The original memory value
+ * @return The exception code
+ */
+static rv_exc_t rv_amo32(rv_cpu_t *cpu, uxlen_t virt, rv_amo_op_t op, uint32_t operand, uint32_t *val)
+{
+    ptr36_t phys;
+    frame_t *frame;
+    void *host;
+    rv_exc_t ex = rv_atomic_translate(cpu, virt, 4, &phys, &frame, &host);
+
+    if (ex != rv_exc_none) {
+        return ex;
     }
-#define throw_if_misaligned_word(cpu, virt) \
-    { \
-        if (!IS_ALIGNED(virt, 4)) { \
-            throw_ex(cpu, virt, rv_exc_store_amo_address_misaligned); \
-        } \
+
+    if (host == NULL) {
+        machine_lock();
+        memtrace_access(cpu->csr.mhartid, virt, phys, 4, MEMTRACE_READ);
+        *val = physmem_cached_read32(cpu->csr.mhartid, frame, phys);
+
+        memtrace_access(cpu->csr.mhartid, virt, phys, 4, MEMTRACE_WRITE);
+        physmem_cached_write32(cpu->csr.mhartid, frame, phys, rv_amo_apply32(op, *val, operand));
+        machine_unlock();
+
+        return rv_exc_none;
     }
-#define throw_if_misaligned_dword(cpu, virt) \
-    { \
-        if (!IS_ALIGNED(virt, 8)) { \
-            throw_ex(cpu, virt, rv_exc_store_amo_address_misaligned); \
-        } \
+
+    uint32_t *word = (uint32_t *) host;
+
+#ifndef WORDS_BIGENDIAN
+    switch (op) {
+    case rv_amo_swap:
+        *val = __atomic_exchange_n(word, operand, __ATOMIC_SEQ_CST);
+        return rv_exc_none;
+    case rv_amo_add:
+        *val = __atomic_fetch_add(word, operand, __ATOMIC_SEQ_CST);
+        return rv_exc_none;
+    case rv_amo_xor:
+        *val = __atomic_fetch_xor(word, operand, __ATOMIC_SEQ_CST);
+        return rv_exc_none;
+    case rv_amo_and:
+        *val = __atomic_fetch_and(word, operand, __ATOMIC_SEQ_CST);
+        return rv_exc_none;
+    case rv_amo_or:
+        *val = __atomic_fetch_or(word, operand, __ATOMIC_SEQ_CST);
+        return rv_exc_none;
+    default:
+        break;
+    }
+#endif
+
+    uint32_t old = __atomic_load_n(word, __ATOMIC_RELAXED);
+
+    do {
+        *val = convert_uint32_t_endian(old);
+    } while (!__atomic_compare_exchange_n(word, &old,
+            convert_uint32_t_endian(rv_amo_apply32(op, *val, operand)),
+            false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+    return rv_exc_none;
+}
+
+/**
+ * @brief Performs a 64-bit AMO
+ *
+ * @see rv_amo32
+ *
+ * @param val The original memory value
+ * @return The exception code
+ */
+static rv_exc_t rv_amo64(rv_cpu_t *cpu, uxlen_t virt, rv_amo_op_t op, uint64_t operand, uint64_t *val)
+{
+    ptr36_t phys;
+    frame_t *frame;
+    void *host;
+    rv_exc_t ex = rv_atomic_translate(cpu, virt, 8, &phys, &frame, &host);
+
+    if (ex != rv_exc_none) {
+        return ex;
+    }
+
+    if (host == NULL) {
+        machine_lock();
+        memtrace_access(cpu->csr.mhartid, virt, phys, 8, MEMTRACE_READ);
+        *val = physmem_cached_read64(cpu->csr.mhartid, frame, phys);
+
+        memtrace_access(cpu->csr.mhartid, virt, phys, 8, MEMTRACE_WRITE);
+        physmem_cached_write64(cpu->csr.mhartid, frame, phys, rv_amo_apply64(op, *val, operand));
+        machine_unlock();
+
+        return rv_exc_none;
+    }
+
+    uint64_t *word = (uint64_t *) host;
+
+#ifndef WORDS_BIGENDIAN
+    switch (op) {
+    case rv_amo_swap:
+        *val = __atomic_exchange_n(word, operand, __ATOMIC_SEQ_CST);
+        return rv_exc_none;
+    case rv_amo_add:
+        *val = __atomic_fetch_add(word, operand, __ATOMIC_SEQ_CST);
+        return rv_exc_none;
+    case rv_amo_xor:
+        *val = __atomic_fetch_xor(word, operand, __ATOMIC_SEQ_CST);
+        return rv_exc_none;
+    case rv_amo_and:
+        *val = __atomic_fetch_and(word, operand, __ATOMIC_SEQ_CST);
+        return rv_exc_none;
+    case rv_amo_or:
+        *val = __atomic_fetch_or(word, operand, __ATOMIC_SEQ_CST);
+        return rv_exc_none;
+    default:
+        break;
     }
+#endif
+
+    uint64_t old = __atomic_load_n(word, __ATOMIC_RELAXED);
+
+    do {
+        *val = convert_uint64_t_endian(old);
+    } while (!__atomic_compare_exchange_n(word, &old,
+            convert_uint64_t_endian(rv_amo_apply64(op, *val, operand)),
+            false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+    return rv_exc_none;
+}
 
 static rv_exc_t rv_amoswap_w_instr(rv_cpu_t *cpu, rv_instr_t instr)
 {
@@ -757,18 +940,12 @@ static rv_exc_t rv_amoswap_w_instr(rv_cpu_t *cpu, rv_instr_t instr)
 
     uxlen_t virt = cpu->regs[instr.r.rs1];
 
-    // Check write privileges first
-    throw_if_wrong_privilege(cpu, virt);
-    // Then alignment
-    throw_if_misaligned_word(cpu, virt);
-
     uint32_t val;
+    rv_exc_t ex = rv_amo32(cpu, virt, rv_amo_swap, (uint32_t) cpu->regs[instr.r.rs2], &val);
 
-    rv_exc_t ex = rv_read_mem32(cpu, virt, &val, false, true);
-    ASSERT(ex == rv_exc_none);
-
-    ex = rv_write_mem32(cpu, virt, (uint32_t) cpu->regs[instr.r.rs2], true);
-    ASSERT(ex == rv_exc_none);
+    if (ex != rv_exc_none) {
+        return ex;
+    }
 
     cpu->regs[instr.r.rd] = sign_extend_32_to_xlen(val, XLEN);
     return rv_exc_none;
@@ -782,16 +959,12 @@ static rv_exc_t rv_amoswap_d_instr(rv_cpu_t *cpu, rv_instr_t instr)
 
     uxlen_t virt = cpu->regs[instr.r.rs1];
 
-    throw_if_wrong_privilege(cpu, virt);
-    throw_if_misaligned_dword(cpu, virt);
-
     uint64_t val;
+    rv_exc_t ex = rv_amo64(cpu, virt, rv_amo_swap, cpu->regs[instr.r.rs2], &val);
 
-    rv_exc_t ex = rv_read_mem64(cpu, virt, &val, false, true);
-    ASSERT(ex == rv_exc_none);
-
-    ex = rv_write_mem64(cpu, virt, cpu->regs[instr.r.rs2], true);
-    ASSERT(ex == rv_exc_none);
+    if (ex != rv_exc_none) {
+        return ex;
+    }
 
     cpu->regs[instr.r.rd] = val;
     return rv_exc_none;
@@ -799,107 +972,94 @@ static rv_exc_t rv_amoswap_d_instr(rv_cpu_t *cpu, rv_instr_t instr)
 
 static rv_exc_t rv_amoadd_w_instr(rv_cpu_t *cpu, rv_instr_t instr)
 {
-    uxlen_t virt = cpu->regs[instr.r.rs1];
+    ASSERT(cpu != NULL);
+    ASSERT(instr.r.opcode == rv_opcAMO);
 
-    throw_if_wrong_privilege(cpu, virt);
-    throw_if_misaligned_word(cpu, virt);
+    uxlen_t virt = cpu->regs[instr.r.rs1];
 
     uint32_t val;
-    // load from mem
-    rv_exc_t ex = rv_read_mem32(cpu, virt, &val, false, true);
-    ASSERT(ex == rv_exc_none);
+    rv_exc_t ex = rv_amo32(cpu, virt, rv_amo_add, (uint32_t) cpu->regs[instr.r.rs2], &val);
 
-    // save loaded value to rd
-    cpu->regs[instr.r.rd] = sign_extend_32_to_xlen(val, XLEN);
-    // add with rs2
-    val += (uint32_t) cpu->regs[instr.r.rs2];
+    if (ex != rv_exc_none) {
+        return ex;
+    }
 
-    //  write to mem
-    ex = rv_write_mem32(cpu, virt, val, true);
-    ASSERT(ex == rv_exc_none);
-    return ex;
+    cpu->regs[instr.r.rd] = sign_extend_32_to_xlen(val, XLEN);
+    return rv_exc_none;
 }
 
 /** RV64 ONLY */
 static rv_exc_t rv_amoadd_d_instr(rv_cpu_t *cpu, rv_instr_t instr)
 {
-    uxlen_t virt = cpu->regs[instr.r.rs1];
+    ASSERT(cpu != NULL);
+    ASSERT(instr.r.opcode == rv_opcAMO);
 
-    throw_if_wrong_privilege(cpu, virt);
-    throw_if_misaligned_dword(cpu, virt);
+    uxlen_t virt = cpu->regs[instr.r.rs1];
 
     uint64_t val;
-    // load from mem
-    rv_exc_t ex = rv_read_mem64(cpu, virt, &val, false, true);
-    ASSERT(ex == rv_exc_none);
+    rv_exc_t ex = rv_amo64(cpu, virt, rv_amo_add, cpu->regs[instr.r.rs2], &val);
 
-    // save loaded value to rd
-    cpu->regs[instr.r.rd] = val;
-    // add with rs2
-    val += cpu->regs[instr.r.rs2];
+    if (ex != rv_exc_none) {
+        return ex;
+    }
 
-    //  write to mem
-    ex = rv_write_mem64(cpu, virt, val, true);
-    ASSERT(ex == rv_exc_none);
-    return ex;
+    cpu->regs[instr.r.rd] = val;
+    return rv_exc_none;
 }
 
 static rv_exc_t rv_amoxor_w_instr(rv_cpu_t *cpu, rv_instr_t instr)
 {
-    uxlen_t virt = cpu->regs[instr.r.rs1];
+    ASSERT(cpu != NULL);
+    ASSERT(instr.r.opcode == rv_opcAMO);
 
-    throw_if_wrong_privilege(cpu, virt);
-    throw_if_misaligned_word(cpu, virt);
+    uxlen_t virt = cpu->regs[instr.r.rs1];
 
     uint32_t val;
-    rv_exc_t ex = rv_read_mem32(cpu, virt, &val, false, true);
-    ASSERT(ex == rv_exc_none);
+    rv_exc_t ex = rv_amo32(cpu, virt, rv_amo_xor, (uint32_t) cpu->regs[instr.r.rs2], &val);
 
-    cpu->regs[instr.r.rd] = sign_extend_32_to_xlen(val, XLEN);
-    val ^= (uint32_t) cpu->regs[instr.r.rs2];
-    ex = rv_write_mem32(cpu, virt, val, true);
+    if (ex != rv_exc_none) {
+        return ex;
+    }
 
-    ASSERT(ex == rv_exc_none);
-    return ex;
+    cpu->regs[instr.r.rd] = sign_extend_32_to_xlen(val, XLEN);
+    return rv_exc_none;
 }
 
 /** RV64 ONLY */
 static rv_exc_t rv_amoxor_d_instr(rv_cpu_t *cpu, rv_instr_t instr)
 {
-    uxlen_t virt = cpu->regs[instr.r.rs1];
+    ASSERT(cpu != NULL);
+    ASSERT(instr.r.opcode == rv_opcAMO);
 
-    throw_if_wrong_privilege(cpu, virt);
-    throw_if_misaligned_dword(cpu, virt);
+    uxlen_t virt = cpu->regs[instr.r.rs1];
 
     uint64_t val;
-    rv_exc_t ex = rv_read_mem64(cpu, virt, &val, false, true);
-    ASSERT(ex == rv_exc_none);
+    rv_exc_t ex = rv_amo64(cpu, virt, rv_amo_xor, cpu->regs[instr.r.rs2], &val);
 
-    cpu->regs[instr.r.rd] = val;
-    val ^= cpu->regs[instr.r.rs2];
-    ex = rv_write_mem64(cpu, virt, val, true);
+    if (ex != rv_exc_none) {
+        return ex;
+    }
 
-    ASSERT(ex == rv_exc_none);
-    return ex;
+    cpu->regs[instr.r.rd] = val;
+    return rv_exc_none;
 }
 
 static rv_exc_t rv_amoand_w_instr(rv_cpu_t *cpu, rv_instr_t instr)
 {
-    uxlen_t virt = cpu->regs[instr.r.rs1];
+    ASSERT(cpu != NULL);
+    ASSERT(instr.r.opcode == rv_opcAMO);
 
-    throw_if_wrong_privilege(cpu, virt);
-    throw_if_misaligned_word(cpu, virt);
+    uxlen_t virt = cpu->regs[instr.r.rs1];
 
     uint32_t val;
-    rv_exc_t ex = rv_read_mem32(cpu, virt, &val, false, true);
-    ASSERT(ex == rv_exc_none);
+    rv_exc_t ex = rv_amo32(cpu, virt, rv_amo_and, (uint32_t) cpu->regs[instr.r.rs2], &val);
 
-    cpu->regs[instr.r.rd] = sign_extend_32_to_xlen(val, XLEN);
-    val &= (uint32_t) cpu->regs[instr.r.rs2];
+    if (ex != rv_exc_none) {
+        return ex;
+    }
 
-    ex = rv_write_mem32(cpu, virt, val, true);
-    ASSERT(ex == rv_exc_none);
-    return ex;
+    cpu->regs[instr.r.rd] = sign_extend_32_to_xlen(val, XLEN);
+    return rv_exc_none;
 }
 
 /** RV64 ONLY */
@@ -910,41 +1070,33 @@ static rv_exc_t rv_amoand_d_instr(rv_cpu_t *cpu, rv_instr_t instr)
 
     uxlen_t virt = cpu->regs[instr.r.rs1];
 
-    throw_if_wrong_privilege(cpu, virt);
-    throw_if_misaligned_dword(cpu, virt);
-
     uint64_t val;
+    rv_exc_t ex = rv_amo64(cpu, virt, rv_amo_and, cpu->regs[instr.r.rs2], &val);
 
-    rv_exc_t ex = rv_read_mem64(cpu, virt, &val, false, true);
-    ASSERT(ex == rv_exc_none);
+    if (ex != rv_exc_none) {
+        return ex;
+    }
 
     cpu->regs[instr.r.rd] = val;
-
-    val &= cpu->regs[instr.r.rs2];
-
-    ex = rv_write_mem64(cpu, virt, val, true);
-    ASSERT(ex == rv_exc_none);
-
-    return ex;
+    return rv_exc_none;
 }
 
 static rv_exc_t rv_amoor_w_instr(rv_cpu_t *cpu, rv_instr_t instr)
 {
-    uxlen_t virt = cpu->regs[instr.r.rs1];
+    ASSERT(cpu != NULL);
+    ASSERT(instr.r.opcode == rv_opcAMO);
 
-    throw_if_wrong_privilege(cpu, virt);
-    throw_if_misaligned_word(cpu, virt);
+    uxlen_t virt = cpu->regs[instr.r.rs1];
 
     uint32_t val;
-    rv_exc_t ex = rv_read_mem32(cpu, virt, &val, false, true);
-    ASSERT(ex == rv_exc_none);
+    rv_exc_t ex = rv_amo32(cpu, virt, rv_amo_or, (uint32_t) cpu->regs[instr.r.rs2], &val);
 
-    cpu->regs[instr.r.rd] = sign_extend_32_to_xlen(val, XLEN);
-    val |= (uint32_t) cpu->regs[instr.r.rs2];
+    if (ex != rv_exc_none) {
+        return ex;
+    }
 
-    ex = rv_write_mem32(cpu, virt, val, true);
-    ASSERT(ex == rv_exc_none);
-    return ex;
+    cpu->regs[instr.r.rd] = sign_extend_32_to_xlen(val, XLEN);
+    return rv_exc_none;
 }
 
 /** RV64 ONLY */
@@ -955,42 +1107,33 @@ static rv_exc_t rv_amoor_d_instr(rv_cpu_t *cpu, rv_instr_t instr)
 
     uxlen_t virt = cpu->regs[instr.r.rs1];
 
-    throw_if_wrong_privilege(cpu, virt);
-    throw_if_misaligned_dword(cpu, virt);
-
     uint64_t val;
+    rv_exc_t ex = rv_amo64(cpu, virt, rv_amo_or, cpu->regs[instr.r.rs2], &val);
 
-    rv_exc_t ex = rv_read_mem64(cpu, virt, &val, false, true);
-    ASSERT(ex == rv_exc_none);
+    if (ex != rv_exc_none) {
+        return ex;
+    }
 
     cpu->regs[instr.r.rd] = val;
-
-    val |= cpu->regs[instr.r.rs2];
-
-    ex = rv_write_mem64(cpu, virt, val, true);
-    ASSERT(ex == rv_exc_none);
-
-    return ex;
+    return rv_exc_none;
 }
 
 static rv_exc_t rv_amomin_w_instr(rv_cpu_t *cpu, rv_instr_t instr)
 {
+    ASSERT(cpu != NULL);
+    ASSERT(instr.r.opcode == rv_opcAMO);
+
     uxlen_t virt = cpu->regs[instr.r.rs1];
 
-    throw_if_wrong_privilege(cpu, virt);
-    throw_if_misaligned_word(cpu, virt);
+    uint32_t val;
+    rv_exc_t ex = rv_amo32(cpu, virt, rv_amo_min, (uint32_t) cpu->regs[instr.r.rs2], &val);
 
-    int32_t val;
-    rv_exc_t ex = rv_read_mem32(cpu, virt, (uint32_t *) &val, false, true);
-    ASSERT(ex == rv_exc_none);
+    if (ex != rv_exc_none) {
+        return ex;
+    }
 
     cpu->regs[instr.r.rd] = sign_extend_32_to_xlen(val, XLEN);
-    int32_t rs2 = (int32_t) cpu->regs[instr.r.rs2];
-    val = rs2 < val ? rs2 : val;
-
-    ex = rv_write_mem32(cpu, virt, (uint32_t) val, true);
-    ASSERT(ex == rv_exc_none);
-    return ex;
+    return rv_exc_none;
 }
 
 /** RV64 ONLY */
@@ -1001,81 +1144,70 @@ static rv_exc_t rv_amomin_d_instr(rv_cpu_t *cpu, rv_instr_t instr)
 
     uxlen_t virt = cpu->regs[instr.r.rs1];
 
-    throw_if_wrong_privilege(cpu, virt);
-    throw_if_misaligned_dword(cpu, virt);
+    uint64_t val;
+    rv_exc_t ex = rv_amo64(cpu, virt, rv_amo_min, cpu->regs[instr.r.rs2], &val);
 
-    int64_t val;
-    rv_exc_t ex = rv_read_mem64(cpu, virt, (uint64_t *) &val, false, true);
-    ASSERT(ex == rv_exc_none);
+    if (ex != rv_exc_none) {
+        return ex;
+    }
 
     cpu->regs[instr.r.rd] = val;
-    int64_t rs2 = (int64_t) cpu->regs[instr.r.rs2];
-    val = rs2 < val ? rs2 : val;
-
-    ex = rv_write_mem64(cpu, virt, (uint64_t) val, true);
-    ASSERT(ex == rv_exc_none);
-    return ex;
+    return rv_exc_none;
 }
 
 static rv_exc_t rv_amomax_w_instr(rv_cpu_t *cpu, rv_instr_t instr)
 {
+    ASSERT(cpu != NULL);
+    ASSERT(instr.r.opcode == rv_opcAMO);
+
     uxlen_t virt = cpu->regs[instr.r.rs1];
 
-    throw_if_wrong_privilege(cpu, virt);
-    throw_if_misaligned_word(cpu, virt);
+    uint32_t val;
+    rv_exc_t ex = rv_amo32(cpu, virt, rv_amo_max, (uint32_t) cpu->regs[instr.r.rs2], &val);
 
-    int32_t val;
-    rv_exc_t ex = rv_read_mem32(cpu, virt, (uint32_t *) &val, false, true);
-    ASSERT(ex == rv_exc_none);
+    if (ex != rv_exc_none) {
+        return ex;
+    }
 
     cpu->regs[instr.r.rd] = sign_extend_32_to_xlen(val, XLEN);
-    int32_t rs2 = (int32_t) cpu->regs[instr.r.rs2];
-    val = rs2 > val ? rs2 : val;
-
-    ex = rv_write_mem32(cpu, virt, (uint32_t) val, true);
-    ASSERT(ex == rv_exc_none);
-    return ex;
+    return rv_exc_none;
 }
 
 /** RV64 ONLY */
 static rv_exc_t rv_amomax_d_instr(rv_cpu_t *cpu, rv_instr_t instr)
 {
+    ASSERT(cpu != NULL);
+    ASSERT(instr.r.opcode == rv_opcAMO);
+
     uxlen_t virt = cpu->regs[instr.r.rs1];
 
-    throw_if_wrong_privilege(cpu, virt);
-    throw_if_misaligned_dword(cpu, virt);
+    uint64_t val;
+    rv_exc_t ex = rv_amo64(cpu, virt, rv_amo_max, cpu->regs[instr.r.rs2], &val);
 
-    int64_t val;
-    rv_exc_t ex = rv_read_mem64(cpu, virt, (uint64_t *) &val, false, true);
-    ASSERT(ex == rv_exc_none);
+    if (ex != rv_exc_none) {
+        return ex;
+    }
 
     cpu->regs[instr.r.rd] = val;
-    int64_t rs2 = (int64_t) cpu->regs[instr.r.rs2];
-    val = rs2 > val ? rs2 : val;
-
-    ex = rv_write_mem64(cpu, virt, (uint64_t) val, true);
-    ASSERT(ex == rv_exc_none);
-    return ex;
+    return rv_exc_none;
 }
 
 static rv_exc_t rv_amominu_w_instr(rv_cpu_t *cpu, rv_instr_t instr)
 {
-    uxlen_t virt = cpu->regs[instr.r.rs1];
+    ASSERT(cpu != NULL);
+    ASSERT(instr.r.opcode == rv_opcAMO);
 
-    throw_if_wrong_privilege(cpu, virt);
-    throw_if_misaligned_word(cpu, virt);
+    uxlen_t virt = cpu->regs[instr.r.rs1];
 
     uint32_t val;
-    rv_exc_t ex = rv_read_mem32(cpu, virt, &val, false, true);
-    ASSERT(ex == rv_exc_none);
+    rv_exc_t ex = rv_amo32(cpu, virt, rv_amo_minu, (uint32_t) cpu->regs[instr.r.rs2], &val);
 
-    cpu->regs[instr.r.rd] = zero_extend_32_to_xlen(val, XLEN);
-    uint32_t rs2 = (uint32_t) cpu->regs[instr.r.rs2];
-    val = rs2 < val ? rs2 : val;
+    if (ex != rv_exc_none) {
+        return ex;
+    }
 
-    ex = rv_write_mem32(cpu, virt, val, true);
-    ASSERT(ex == rv_exc_none);
-    return ex;
+    cpu->regs[instr.r.rd] = zero_extend_32_to_xlen(val, XLEN);
+    return rv_exc_none;
 }
 
 /** RV64 ONLY */
@@ -1086,40 +1218,33 @@ static rv_exc_t rv_amominu_d_instr(rv_cpu_t *cpu, rv_instr_t instr)
 
     uxlen_t virt = cpu->regs[instr.r.rs1];
 
-    throw_if_wrong_privilege(cpu, virt);
-    throw_if_misaligned_dword(cpu, virt);
-
     uint64_t val;
-    rv_exc_t ex = rv_read_mem64(cpu, virt, &val, false, true);
-    ASSERT(ex == rv_exc_none);
+    rv_exc_t ex = rv_amo64(cpu, virt, rv_amo_minu, cpu->regs[instr.r.rs2], &val);
 
-    cpu->regs[instr.r.rd] = val;
-    uint64_t rs2 = cpu->regs[instr.r.rs2];
-    val = rs2 < val ? rs2 : val;
+    if (ex != rv_exc_none) {
+        return ex;
+    }
 
-    ex = rv_write_mem64(cpu, virt, val, true);
-    ASSERT(ex == rv_exc_none);
-    return ex;
+    cpu->regs[instr.r.rd] = val;
+    return rv_exc_none;
 }
 
 static rv_exc_t rv_amomaxu_w_instr(rv_cpu_t *cpu, rv_instr_t instr)
 {
-    uxlen_t virt = cpu->regs[instr.r.rs1];
+    ASSERT(cpu != NULL);
+    ASSERT(instr.r.opcode == rv_opcAMO);
 
-    throw_if_wrong_privilege(cpu, virt);
-    throw_if_misaligned_word(cpu, virt);
+    uxlen_t virt = cpu->regs[instr.r.rs1];
 
     uint32_t val;
-    rv_exc_t ex = rv_read_mem32(cpu, virt, &val, false, true);
-    ASSERT(ex == rv_exc_none);
+    rv_exc_t ex = rv_amo32(cpu, virt, rv_amo_maxu, (uint32_t) cpu->regs[instr.r.rs2], &val);
 
-    cpu->regs[instr.r.rd] = zero_extend_32_to_xlen(val, XLEN);
-    uint32_t rs2 = (uint32_t) cpu->regs[instr.r.rs2];
-    val = rs2 > val ? rs2 : val;
+    if (ex != rv_exc_none) {
+        return ex;
+    }
 
-    ex = rv_write_mem32(cpu, virt, val, true);
-    ASSERT(ex == rv_exc_none);
-    return ex;
+    cpu->regs[instr.r.rd] = zero_extend_32_to_xlen(val, XLEN);
+    return rv_exc_none;
 }
 
 /** RV64 ONLY */
@@ -1130,18 +1255,13 @@ static rv_exc_t rv_amomaxu_d_instr(rv_cpu_t *cpu, rv_instr_t instr)
 
     uxlen_t virt = cpu->regs[instr.r.rs1];
 
-    throw_if_wrong_privilege(cpu, virt);
-    throw_if_misaligned_dword(cpu, virt);
-
     uint64_t val;
-    rv_exc_t ex = rv_read_mem64(cpu, virt, &val, false, true);
-    ASSERT(ex == rv_exc_none);
+    rv_exc_t ex = rv_amo64(cpu, virt, rv_amo_maxu, cpu->regs[instr.r.rs2], &val);
 
-    cpu->regs[instr.r.rd] = val;
-    uint64_t rs2 = cpu->regs[instr.r.rs2];
-    val = rs2 > val ? rs2 : val;
+    if (ex != rv_exc_none) {
+        return ex;
+    }
 
-    ex = rv_write_mem64(cpu, virt, val, true);
-    ASSERT(ex == rv_exc_none);
-    return ex;
+    cpu->regs[instr.r.rd] = val;
+    return rv_exc_none;
 }
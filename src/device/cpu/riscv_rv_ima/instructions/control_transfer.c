@@ -15,6 +15,7 @@
 #include <stdint.h>
 
 #include "../../../../assert.h"
+#include "../../../../debug/callstack.h"
 #include "../../../../utils.h"
 #include "../exception.h"
 #include "../instr.h"
@@ -70,6 +71,73 @@ static rv_exc_t rv_jalr_instr(rv_cpu_t *cpu, rv_instr_t instr)
     return rv_exc_none;
 }
 
+/** @brief Link registers of the calls and the returns (ra and t0) */
+#define RV_IS_LINK(reg) (((reg) == 1) || ((reg) == 5))
+
+/** @brief jal linking ra or t0, a call kept on the shadow call stack */
+static rv_exc_t rv_jal_call_instr(rv_cpu_t *cpu, rv_instr_t instr)
+{
+    rv_exc_t ex = rv_jal_instr(cpu, instr);
+
+    if (ex == rv_exc_none) {
+        callstack_call(cpu->csr.mhartid, cpu->pc_next, cpu->pc + 4);
+    }
+
+    return ex;
+}
+
+/** @brief jalr linking ra or t0, a call kept on the shadow call stack */
+static rv_exc_t rv_jalr_call_instr(rv_cpu_t *cpu, rv_instr_t instr)
+{
+    rv_exc_t ex = rv_jalr_instr(cpu, instr);
+
+    if (ex == rv_exc_none) {
+        callstack_call(cpu->csr.mhartid, cpu->pc_next, cpu->pc + 4);
+    }
+
+    return ex;
+}
+
+/** @brief jalr x0, 0(ra or t0), a return popped from the shadow call stack */
+static rv_exc_t rv_jalr_return_instr(rv_cpu_t *cpu, rv_instr_t instr)
+{
+    rv_exc_t ex = rv_jalr_instr(cpu, instr);
+
+    if (ex == rv_exc_none) {
+        callstack_return(cpu->csr.mhartid, cpu->pc_next);
+    }
+
+    return ex;
+}
+
+/**
+ * @brief Returns the call or return variant of a jump (see callstack.c)
+ *
+ * The calls and the returns are recognized by the link registers
+ * as hinted by the specification (the return address stack hints).
+ *
+ * @param func Implementation to be executed otherwise
+ * @return The variant to be executed (func if there is none)
+ */
+static rv_instr_func_t rv_instr_callstack(rv_instr_func_t func, rv_instr_t instr)
+{
+    if (func == rv_jal_instr) {
+        return RV_IS_LINK(instr.j.rd) ? rv_jal_call_instr : func;
+    }
+
+    if (func == rv_jalr_instr) {
+        if (RV_IS_LINK(instr.i.rd)) {
+            return rv_jalr_call_instr;
+        }
+
+        if ((instr.i.rd == 0) && RV_IS_LINK(instr.i.rs1)) {
+            return rv_jalr_return_instr;
+        }
+    }
+
+    return func;
+}
+
 static rv_exc_t rv_beq_instr(rv_cpu_t *cpu, rv_instr_t instr)
 {
     ASSERT(cpu != NULL);
@@ -15,7 +15,10 @@
 #include <stdint.h>
 
 #include "../../../../assert.h"
+#include "../../../../debug/memtrace.h"
+#include "../../../../endian.h"
 #include "../../../../fault.h"
+#include "../../../../parallel.h"
 #include "../../../../physmem.h"
 #include "../../../../utils.h"
 #include "../csr.h"
@@ -31,6 +34,8 @@ rv_exc_t rv_write_mem16(rv_cpu_t *cpu, virt_t virt, uint16_t value, bool noisy);
 rv_exc_t rv_write_mem32(rv_cpu_t *cpu, virt_t virt, uint32_t value, bool noisy);
 rv_exc_t rv_write_mem64(rv_cpu_t *cpu, virt_t virt, uint64_t value, bool noisy);
 rv_exc_t rv_convert_addr(rv_cpu_t *cpu, virt_t virt, ptr36_t *phys, bool wr, bool fetch, bool noisy);
+rv_exc_t rv_translate(rv_cpu_t *cpu, virt_t virt, unsigned int size, ptr36_t *phys, frame_t **frame, bool wr, bool fetch, bool noisy);
+rv_exc_t rv_atomic_translate(rv_cpu_t *cpu, virt_t virt, int size, ptr36_t *phys, frame_t **frame, void **host);
 
 static ALWAYS_INLINE rv_read_xlen_t rv_read_xlen()
 {
@@ -268,6 +273,185 @@ static rv_exc_t rv_fence_instr(rv_cpu_t *cpu, rv_instr_t instr)
 
 /* A extension LR and SC */
 
+/**
+ * @brief Cancels the LR reservation of the hart
+ */
+static void rv_reservation_cancel(rv_cpu_t *cpu)
+{
+    sc_unregister(cpu->csr.mhartid);
+    cpu->reserved_valid = false;
+}
+
+/**
+ * @brief Makes a new LR reservation
+ *
+ * The serial simulation tracks the reserved address, so that any store
+ * to it breaks the reservation. Registering a reservation forces all
+ * stores into the frame through the memory access functions, which
+ * would serialize the processors running in parallel. There the loaded
+ * value is remembered instead and the SC succeeds only if the memory
+ * still holds it.
+ *
+ * @param cpu The cpu making the reservation
+ * @param phys The physical address of the LR
+ * @param value The value loaded by the LR
+ */
+static void rv_reservation_set(rv_cpu_t *cpu, ptr36_t phys, uint64_t value)
+{
+    if (parallel_active) {
+        sc_unregister(cpu->csr.mhartid);
+    } else {
+        sc_register(cpu->csr.mhartid, phys);
+    }
+
+    cpu->reserved_valid = true;
+    cpu->reserved_addr = phys;
+    cpu->reserved_value = value;
+    cpu->reserved_by_value = parallel_active;
+}
+
+/**
+ * @brief Tells whether the SC checks the reservation by value
+ *
+ * Tracked reservations made before the processors started running in
+ * parallel are checked by value as well, since a store by another
+ * processor may break them at any time.
+ */
+static bool rv_reservation_by_value(rv_cpu_t *cpu)
+{
+    return cpu->reserved_by_value || parallel_active;
+}
+
+/**
+ * @brief Performs a 32-bit SC of a reservation checked by value
+ *
+ * The address has been translated by the SC already (see
+ * rv_atomic_translate), the frame and the host memory are reused.
+ *
+ * @return Whether the memory still held the reserved value and
+ *         the store was made
+ */
+static bool rv_sc_by_value32(rv_cpu_t *cpu, uxlen_t virt, ptr36_t phys, frame_t *frame, void *host, uint32_t value)
+{
+    uint32_t expected = (uint32_t) cpu->reserved_value;
+
+    if (host != NULL) {
+        uint32_t old = convert_uint32_t_endian(expected);
+        return __atomic_compare_exchange_n((uint32_t *) host, &old, convert_uint32_t_endian(value),
+                false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    }
+
+    machine_lock();
+
+    bool hit = (physmem_cached_read32(cpu->csr.mhartid, frame, phys) == expected);
+
+    if (hit) {
+        memtrace_access(cpu->csr.mhartid, virt, phys, 4, MEMTRACE_WRITE);
+        physmem_cached_write32(cpu->csr.mhartid, frame, phys, value);
+    }
+
+    machine_unlock();
+    return hit;
+}
+
+/**
+ * @brief Performs a 64-bit SC of a reservation checked by value
+ *
+ * @see rv_sc_by_value32
+ */
+static bool rv_sc_by_value64(rv_cpu_t *cpu, uxlen_t virt, ptr36_t phys, frame_t *frame, void *host, uint64_t value)
+{
+    uint64_t expected = cpu->reserved_value;
+
+    if (host != NULL) {
+        uint64_t old = convert_uint64_t_endian(expected);
+        return __atomic_compare_exchange_n((uint64_t *) host, &old, convert_uint64_t_endian(value),
+                false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    }
+
+    machine_lock();
+
+    bool hit = (physmem_cached_read64(cpu->csr.mhartid, frame, phys) == expected);
+
+    if (hit) {
+        memtrace_access(cpu->csr.mhartid, virt, phys, 8, MEMTRACE_WRITE);
+        physmem_cached_write64(cpu->csr.mhartid, frame, phys, value);
+    }
+
+    machine_unlock();
+    return hit;
+}
+
+/**
+ * @brief Tells whether a branch is taken with the current registers
+ */
+static bool rv_branch_taken(rv_cpu_t *cpu, rv_instr_t instr)
+{
+    uxlen_t lhs = cpu->regs[instr.b.rs1];
+    uxlen_t rhs = cpu->regs[instr.b.rs2];
+
+    switch (instr.b.funct3) {
+    case rv_func_BEQ:
+        return lhs == rhs;
+    case rv_func_BNE:
+        return lhs != rhs;
+    case rv_func_BLT:
+        return (xlen_t) lhs < (xlen_t) rhs;
+    case rv_func_BGE:
+        return (xlen_t) lhs >= (xlen_t) rhs;
+    case rv_func_BLTU:
+        return lhs < rhs;
+    case rv_func_BGEU:
+        return lhs >= rhs;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Notices the hart spinning on the reservation just made
+ *
+ * An LR followed by a branch back to it, which is taken with the value
+ * loaded, loads the same value again and again until the reserved word
+ * is written to (e.g. a hart waiting for a lock held by another hart).
+ * The hart then stands by instead of executing the loop, until the
+ * store breaking the reservation or an interrupt wakes it up (see the
+ * standby of the processor). The standby cycles retire the instructions
+ * of the loop, so the counters are the same as if it was executed.
+ *
+ * Only the tracked reservations of the serial simulation are watched.
+ */
+static void rv_spin_detect(rv_cpu_t *cpu, rv_instr_t instr)
+{
+    cpu->spinning = false;
+
+    // The address register must survive the load
+    if (rv_reservation_by_value(cpu) || (instr.r.rd == instr.r.rs1)) {
+        return;
+    }
+
+    ptr36_t phys;
+    if (rv_convert_addr(cpu, cpu->pc + 4, &phys, false, true, false) != rv_exc_none) {
+        return;
+    }
+
+    frame_t *frame = physmem_find_frame(phys);
+    if (frame == NULL) {
+        return;
+    }
+
+    rv_instr_t next = { .val = physmem_frame_read32(frame, phys, false) };
+
+    if ((next.b.opcode != rv_opcBRANCH) || (RV_B_IMM(next) != (uxlen_t) -4)
+            || !rv_branch_taken(cpu, next)) {
+        return;
+    }
+
+    cpu->spinning = true;
+    cpu->spin_pc = cpu->pc;
+    cpu_standby_entered = true;
+}
+
 static rv_exc_t rv_lr_w_instr(rv_cpu_t *cpu, rv_instr_t instr)
 {
     ASSERT(cpu != NULL);
@@ -281,8 +465,7 @@ static rv_exc_t rv_lr_w_instr(rv_cpu_t *cpu, rv_instr_t instr)
 
     if (ex != rv_exc_none) {
         // if read failed, cancel all previous reservations
-        sc_unregister(cpu->csr.mhartid);
-        cpu->reserved_valid = false;
+        rv_reservation_cancel(cpu);
         return ex;
     }
 
@@ -290,26 +473,23 @@ static rv_exc_t rv_lr_w_instr(rv_cpu_t *cpu, rv_instr_t instr)
     // Bit if we would choose to allow missaligned accesses in the future,
     // this would break, so this is here just for safety
     if (!IS_ALIGNED(virt, 4)) {
-        sc_unregister(cpu->csr.mhartid);
-        cpu->reserved_valid = false;
+        rv_reservation_cancel(cpu);
         return rv_exc_load_address_misaligned;
     }
 
     // store the read value
     cpu->regs[instr.r.rd] = zero_extend_32_to_xlen(val, XLEN);
 
-    // we track physical addresses, so convert
-    // this should not fail
+    // we track physical addresses, the translation of the read
+    // has just been remembered, so this hits it and does not fail
 
     ptr36_t phys;
-    ex = rv_convert_addr(cpu, virt, &phys, false, false, false);
+    frame_t *frame;
+    ex = rv_translate(cpu, virt, 4, &phys, &frame, false, false, false);
     ASSERT(ex == rv_exc_none);
 
-    // register address for tracking
-
-    sc_register(cpu->csr.mhartid);
-    cpu->reserved_valid = true;
-    cpu->reserved_addr = phys;
+    rv_reservation_set(cpu, phys, val);
+    rv_spin_detect(cpu, instr);
 
     return rv_exc_none;
 }
@@ -322,6 +502,8 @@ static rv_exc_t rv_sc_w_instr(rv_cpu_t *cpu, rv_instr_t instr)
     // convert addr and check if the target is tracked
     uxlen_t virt = cpu->regs[instr.r.rs1];
     ptr36_t phys;
+    frame_t *frame;
+    void *host;
 
     if (cpu->reserved_valid == false) {
         // reservation is not valid
@@ -330,21 +512,17 @@ static rv_exc_t rv_sc_w_instr(rv_cpu_t *cpu, rv_instr_t instr)
     }
 
     // SC always invalidates reservation by this hart
-    cpu->reserved_valid = false;
-    sc_unregister(cpu->csr.mhartid);
+    bool by_value = rv_reservation_by_value(cpu);
+    rv_reservation_cancel(cpu);
 
-    rv_exc_t ex = rv_convert_addr(cpu, virt, &phys, true, false, true);
+    // translated once for the reservation check and the store
+    rv_exc_t ex = rv_atomic_translate(cpu, virt, 4, &phys, &frame, &host);
 
     if (ex != rv_exc_none) {
         cpu->regs[instr.r.rd] = 1;
         return ex;
     }
 
-    if (!IS_ALIGNED(virt, 4)) {
-        cpu->regs[instr.r.rd] = 1;
-        return rv_exc_store_amo_address_misaligned;
-    }
-
     if (phys != cpu->reserved_addr) {
         alert("RV32IMA: LR/SC addresses do not match");
         cpu->regs[instr.r.rd] = 1;
@@ -357,14 +535,15 @@ static rv_exc_t rv_sc_w_instr(rv_cpu_t *cpu, rv_instr_t instr)
     // and risc-v allows only aligned accesses (without Zam extension) and only 32-bit atomics are supported here
     // this should be fine
 
-    ex = rv_write_mem32(cpu, virt, (uint32_t) cpu->regs[instr.r.rs2], true);
-
-    if (ex != rv_exc_none) {
-        alert("RV32IMA: SC write failed after successful address translation");
-        cpu->regs[instr.r.rd] = 1;
-        return ex;
+    if (by_value) {
+        bool hit = rv_sc_by_value32(cpu, virt, phys, frame, host, (uint32_t) cpu->regs[instr.r.rs2]);
+        cpu->regs[instr.r.rd] = hit ? 0 : 1;
+        return rv_exc_none;
     }
 
+    memtrace_access(cpu->csr.mhartid, virt, phys, 4, MEMTRACE_WRITE);
+    physmem_cached_write32(cpu->csr.mhartid, frame, phys, (uint32_t) cpu->regs[instr.r.rs2]);
+
     cpu->regs[instr.r.rd] = 0;
     return rv_exc_none;
 }
@@ -388,27 +567,26 @@ static rv_exc_t rv_lr_instr(rv_cpu_t *cpu, rv_instr_t instr)
 
     if (ex != rv_exc_none) {
         // if read failed, cancel all previous reservations
-        sc_unregister(cpu->csr.mhartid);
-        cpu->reserved_valid = false;
+        rv_reservation_cancel(cpu);
         return ex;
     }
 
     if (!IS_ALIGNED(virt, alignment_by_XLEN)) {
-        sc_unregister(cpu->csr.mhartid);
-        cpu->reserved_valid = false;
+        rv_reservation_cancel(cpu);
         return rv_exc_load_address_misaligned;
     }
 
     // store the read value
     cpu->regs[instr.r.rd] = val;
 
+    // Hits the translation remembered by the read
     ptr36_t phys;
-    ex = rv_convert_addr(cpu, virt, &phys, false, false, false);
+    frame_t *frame;
+    ex = rv_translate(cpu, virt, sizeof(uxlen_t), &phys, &frame, false, false, false);
     ASSERT(ex == rv_exc_none);
 
-    sc_register(cpu->csr.mhartid);
-    cpu->reserved_valid = true;
-    cpu->reserved_addr = phys;
+    rv_reservation_set(cpu, phys, val);
+    rv_spin_detect(cpu, instr);
 
     return rv_exc_none;
 }
@@ -427,6 +605,8 @@ static rv_exc_t rv_sc_instr(rv_cpu_t *cpu, rv_instr_t instr)
     // Get virtual address from rs1
     uxlen_t virt = cpu->regs[instr.r.rs1];
     ptr36_t phys;
+    frame_t *frame;
+    void *host;
 
     if (cpu->reserved_valid == false) {
         // reservation is not valid, return failure
@@ -435,22 +615,18 @@ static rv_exc_t rv_sc_instr(rv_cpu_t *cpu, rv_instr_t instr)
     }
 
     // SC always invalidates reservation by this hart
-    cpu->reserved_valid = false;
-    sc_unregister(cpu->csr.mhartid);
+    bool by_value = rv_reservation_by_value(cpu);
+    rv_reservation_cancel(cpu);
 
-    rv_exc_t ex = rv_convert_addr(cpu, virt, &phys, true, false, true);
+    // Translated once for the reservation check and the store,
+    // the doubleword must be aligned to 8 bytes in RV64
+    rv_exc_t ex = rv_atomic_translate(cpu, virt, 8, &phys, &frame, &host);
 
     if (ex != rv_exc_none) {
         cpu->regs[instr.r.rd] = 1;
         return ex;
     }
 
-    // Check alignment - doubleword must be aligned to 8 bytes in RV64
-    if (!IS_ALIGNED(virt, 8)) {
-        cpu->regs[instr.r.rd] = 1;
-        return rv_exc_store_amo_address_misaligned;
-    }
-
     // Check if this is the same address that was reserved
     if (phys != cpu->reserved_addr) {
         alert("RV64IMA: LR/SC addresses do not match");
@@ -458,14 +634,15 @@ static rv_exc_t rv_sc_instr(rv_cpu_t *cpu, rv_instr_t instr)
         return rv_exc_none;
     }
 
-    ex = rv_write_mem64(cpu, virt, cpu->regs[instr.r.rs2], true);
-
-    if (ex != rv_exc_none) {
-        alert("RV64IMA: SC write failed after successful address translation");
-        cpu->regs[instr.r.rd] = 1;
-        return ex;
+    if (by_value) {
+        bool hit = rv_sc_by_value64(cpu, virt, phys, frame, host, cpu->regs[instr.r.rs2]);
+        cpu->regs[instr.r.rd] = hit ? 0 : 1;
+        return rv_exc_none;
     }
 
+    memtrace_access(cpu->csr.mhartid, virt, phys, 8, MEMTRACE_WRITE);
+    physmem_cached_write64(cpu->csr.mhartid, frame, phys, cpu->regs[instr.r.rs2]);
+
     // Success: store 0 to rd
     cpu->regs[instr.r.rd] = 0;
     return rv_exc_none;
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Specialized variants of RISC-V instructions
+ *
+ *  The decoded pages hold these in place of the general implementations
+ *  where the operands make the general work unnecessary. The decoder
+ *  itself (used by the disassembler and mixstat) keeps returning
+ *  the general implementations.
+ *
+ */
+
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+#include <stdint.h>
+
+#include "../../../../assert.h"
+#include "../exception.h"
+#include "../instr.h"
+
+/** @brief Computation writing x0, no effect (including the canonical nop) */
+static rv_exc_t rv_nop_instr(rv_cpu_t *cpu, rv_instr_t instr)
+{
+    ASSERT(cpu != NULL);
+    ASSERT(instr.i.rd == 0);
+
+    return rv_exc_none;
+}
+
+/** @brief addi rd, x0, imm */
+static rv_exc_t rv_li_instr(rv_cpu_t *cpu, rv_instr_t instr)
+{
+    ASSERT(cpu != NULL);
+    ASSERT(instr.i.opcode == rv_opcOP_IMM);
+    ASSERT(instr.i.rs1 == 0);
+
+    cpu->regs[instr.i.rd] = (xlen_t) ((int32_t) (instr.i.imm << 20) >> 20);
+
+    return rv_exc_none;
+}
+
+/** @brief addi rd, rs1, 0 */
+static rv_exc_t rv_mv_instr(rv_cpu_t *cpu, rv_instr_t instr)
+{
+    ASSERT(cpu != NULL);
+    ASSERT(instr.i.opcode == rv_opcOP_IMM);
+    ASSERT(instr.i.imm == 0);
+
+    cpu->regs[instr.i.rd] = cpu->regs[instr.i.rs1];
+
+    return rv_exc_none;
+}
+
+/**
+ * @brief Returns the specialized variant of a decoded instruction
+ *
+ * @param func General implementation returned by the decoder
+ * @return The variant to be executed (func if there is none)
+ */
+static rv_instr_func_t rv_instr_specialize(rv_instr_func_t func, rv_instr_t instr)
+{
+    if (func == rv_illegal_instr) {
+        return func;
+    }
+
+    // Computations have no other effect than writing rd
+    switch (instr.r.opcode) {
+    case rv_opcOP:
+    case rv_opcOP_32:
+    case rv_opcOP_IMM:
+    case rv_opcOP_IMM_32:
+    case rv_opcLUI:
+    case rv_opcAUIPC:
+        if (instr.r.rd == 0) {
+            return rv_nop_instr;
+        }
+        break;
+    default:
+        return func;
+    }
+
+    if (func == rv_addi_instr) {
+        if (instr.i.rs1 == 0) {
+            return rv_li_instr;
+        }
+        if (instr.i.imm == 0) {
+            return rv_mv_instr;
+        }
+    }
+
+    return func;
+}
@@ -15,8 +15,13 @@
 #include <stdint.h>
 
 #include "../../../../assert.h"
+#include "../../../../debug/catchpoint.h"
 #include "../../../../fault.h"
+#include "../../../../hypercall.h"
 #include "../../../../input.h"
+#include "../../../../roi.h"
+#include "../../../../usermode.h"
+#include "../../general_cpu.h"
 #include "../csr.h"
 #include "../exception.h"
 #include "../instr.h"
@@ -38,10 +43,10 @@ static rv_exc_t rv_break_instr(rv_cpu_t *cpu, rv_instr_t instr)
 
     if (input_is_terminal() || machine_allow_interactive_without_tty) {
         alert("EBREAK: breakpoint reached, entering interactive mode");
-        machine_interactive = true;
+        __atomic_store_n(&machine_interactive, true, __ATOMIC_RELEASE);
     } else {
         alert("EBREAK: Machine halt when no tty available.");
-        machine_halt = true;
+        __atomic_store_n(&machine_halt, true, __ATOMIC_RELEASE);
     }
 
     return rv_exc_none;
@@ -54,7 +59,7 @@ static rv_exc_t rv_halt_instr(rv_cpu_t *cpu, rv_instr_t instr)
 
     alert("EHALT: Machine halt");
 
-    machine_halt = true;
+    __atomic_store_n(&machine_halt, true, __ATOMIC_RELEASE);
     return rv_exc_none;
 }
 
@@ -76,8 +81,71 @@ static rv_exc_t rv_trace_reset_instr(rv_cpu_t *cpu, rv_instr_t instr)
     return rv_exc_none;
 }
 
+static rv_exc_t rv_roi_begin_instr(rv_cpu_t *cpu, rv_instr_t instr)
+{
+    ASSERT(cpu != NULL);
+    ASSERT(instr.i.opcode == rv_opcSYSTEM);
+    alert("EROIB: Region of interest begins");
+    roi_begin();
+    return rv_exc_none;
+}
+
+static rv_exc_t rv_roi_end_instr(rv_cpu_t *cpu, rv_instr_t instr)
+{
+    ASSERT(cpu != NULL);
+    ASSERT(instr.i.opcode == rv_opcSYSTEM);
+    alert("EROIE: Region of interest ends");
+    roi_end();
+    return rv_exc_none;
+}
+
+/** Registers of the hypercall arguments (a0 to a3) and number (a7) */
+#define RV_HYPERCALL_ARG_REG 10
+#define RV_HYPERCALL_NO_REG 17
+
+static rv_exc_t rv_hypercall_instr(rv_cpu_t *cpu, rv_instr_t instr)
+{
+    ASSERT(cpu != NULL);
+    ASSERT(instr.i.opcode == rv_opcSYSTEM);
+
+    uint64_t args[HYPERCALL_ARGS];
+    for (unsigned int i = 0; i < HYPERCALL_ARGS; i++) {
+        args[i] = (uxlen_t) cpu->regs[RV_HYPERCALL_ARG_REG + i];
+    }
+
+    uint64_t result = hypercall((uxlen_t) cpu->regs[RV_HYPERCALL_NO_REG], args);
+
+    /* The upper half of the result goes to a1 on RV32 */
+    cpu->regs[RV_HYPERCALL_ARG_REG] = (uxlen_t) result;
+    if (XLEN == 32) {
+        cpu->regs[RV_HYPERCALL_ARG_REG + 1] = (uxlen_t) (result >> 16 >> 16);
+    }
+
+    return rv_exc_none;
+}
+
+/** System call of a user program served by the simulator (a0 to a5, a7) */
+static rv_exc_t rv_usermode_call(rv_cpu_t *cpu)
+{
+    uint64_t args[USERMODE_ARGS];
+    for (unsigned int i = 0; i < USERMODE_ARGS; i++) {
+        args[i] = (uxlen_t) cpu->regs[RV_HYPERCALL_ARG_REG + i];
+    }
+
+    int64_t result = usermode_syscall(
+            (XLEN == 64) ? USERMODE_ABI_RV64 : USERMODE_ABI_RV32,
+            (uxlen_t) cpu->regs[RV_HYPERCALL_NO_REG], args);
+
+    cpu->regs[RV_HYPERCALL_ARG_REG] = (uxlen_t) result;
+    return rv_exc_none;
+}
+
 static rv_exc_t rv_call_instr(rv_cpu_t *cpu, rv_instr_t instr)
 {
+    if (usermode_enabled) {
+        return rv_usermode_call(cpu);
+    }
+
     switch (cpu->priv_mode) {
     case rv_umode:
         return rv_exc_umode_environment_call;
@@ -128,6 +196,12 @@ static rv_exc_t rv_sret_instr(rv_cpu_t *cpu, rv_instr_t instr)
         cpu->csr.mstatus &= ~rv_csr_mstatus_mprv_mask;
     }
 
+    rv_utlb_flush(cpu);
+
+    if (catchpoint_armed(cpu->csr.mhartid, CATCH_MODE)) {
+        catchpoint_mode(cpu->csr.mhartid);
+    }
+
     cpu->pc_next = cpu->csr.sepc;
     return rv_exc_none;
 }
@@ -168,6 +242,12 @@ static rv_exc_t rv_mret_instr(rv_cpu_t *cpu, rv_instr_t instr)
         }
     }
 
+    rv_utlb_flush(cpu);
+
+    if (catchpoint_armed(cpu->csr.mhartid, CATCH_MODE)) {
+        catchpoint_mode(cpu->csr.mhartid);
+    }
+
     cpu->pc_next = cpu->csr.mepc;
     return rv_exc_none;
 }
@@ -184,6 +264,7 @@ static rv_exc_t rv_wfi_instr(rv_cpu_t *cpu, rv_instr_t instr)
     }
 
     cpu->stdby = true;
+    cpu_standby_entered = true;
     return rv_exc_none;
 }
 
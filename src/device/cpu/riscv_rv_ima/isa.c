@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  RISC-V table-driven instruction decoding
+ *
+ *  The decoder is generated from the instruction set description
+ *  (isa.def). The entries are indexed by the major opcode and funct3
+ *  of their encodings, so that an instruction is decoded by a lookup
+ *  of its bucket and a mask comparison with the few entries in it.
+ *
+ *  Included by the instr.c of the processors after the instruction
+ *  implementations.
+ *
+ */
+
+/** Flags of the instruction set entries */
+#define RV_ISA_MACHINE_SPECIFIC 0x01 /**< Only with machine_specific_instructions */
+
+/** Encodings of the instruction set entries (the mask and the match) */
+#define RV_ENC(mask, match) (uint32_t) (mask), (uint32_t) (match)
+#define RV_ENC_OPCODE(opc) RV_ENC(0x0000007F, (opc))
+#define RV_ENC_FUNCT3(opc, f3) \
+    RV_ENC(0x0000707F, ((uint32_t) (f3) << 12) | (opc))
+#define RV_ENC_FUNCT7(opc, f3, f7) \
+    RV_ENC(0xFE00707F, ((uint32_t) (f7) << 25) | ((uint32_t) (f3) << 12) | (opc))
+/** OP encodings by their funct7 and funct3 joined (see RV_R_FUNCT()) */
+#define RV_ENC_FUNCT(opc, funct) \
+    RV_ENC_FUNCT7((opc), (funct) & 0x7, (funct) >> 3)
+/** Shifts by an immediate, the amount has 6 bits in RV64 */
+#if XLEN == 64
+#define RV_ENC_SHIFT(opc, f3, f7) \
+    RV_ENC(0xFC00707F, ((uint32_t) (f7) << 25) | ((uint32_t) (f3) << 12) | (opc))
+#else
+#define RV_ENC_SHIFT(opc, f3, f7) RV_ENC_FUNCT7((opc), (f3), (f7))
+#endif
+#define RV_ENC_AMO(width, funct) \
+    RV_ENC(0xF800707F, ((uint32_t) (funct) << 27) | ((uint32_t) (width) << 12) | rv_opcAMO)
+#define RV_ENC_LR(width) \
+    RV_ENC(0xF9F0707F, ((uint32_t) rv_funcLR << 27) | ((uint32_t) (width) << 12) | rv_opcAMO)
+/** PRIV instructions by the whole immediate (rs1 and rd are ignored) */
+#define RV_ENC_PRIV(imm) \
+    RV_ENC(0xFFF0707F, ((uint32_t) (imm) << 20) | ((uint32_t) rv_funcPRIV << 12) | rv_opcSYSTEM)
+
+/** Entry of the instruction set */
+typedef struct {
+    uint32_t mask;
+    uint32_t match;
+    unsigned int flags;
+    rv_instr_func_t func;
+} rv_isa_entry_t;
+
+/** Instruction set of the processor */
+static const rv_isa_entry_t rv_isa[] = {
+#define RV_INSTR(execute, mnemonics, encoding, flags) \
+    { encoding, flags, rv_##execute##_instr },
+#include "isa.def"
+};
+
+#define RV_ISA_COUNT (sizeof(rv_isa) / sizeof(rv_isa[0]))
+
+/** Buckets by the major opcode (without the low two bits) and funct3 */
+#define RV_ISA_BUCKETS (32 * 8)
+
+static_assert(RV_ISA_COUNT <= UINT8_MAX, "ISA entries do not fit the bucket index");
+
+/** Bucket of an instruction word */
+#define RV_ISA_BUCKET(val) ((((val) >> 2) & 0x1F) << 3 | (((val) >> 12) & 0x7))
+
+/** First entry of each bucket in rv_isa_order (and the end of the last one) */
+static uint16_t rv_isa_first[RV_ISA_BUCKETS + 1];
+
+/** Entries of the buckets (an entry ignoring funct3 is in 8 of them) */
+static uint8_t rv_isa_order[RV_ISA_COUNT * 8];
+
+/** Tell whether an entry can match the instructions of a bucket */
+static bool rv_isa_in_bucket(const rv_isa_entry_t *entry, unsigned int bucket)
+{
+    uint32_t val = ((bucket >> 3) << 2) | ((bucket & 0x7) << 12);
+    uint32_t mask = entry->mask & 0x707C;
+
+    return (val & mask) == (entry->match & mask);
+}
+
+/**
+ * @brief Fills the bucket index of the instruction set before the simulation starts
+ */
+__attribute__((constructor)) static void rv_isa_init(void)
+{
+    unsigned int count = 0;
+
+    for (unsigned int bucket = 0; bucket < RV_ISA_BUCKETS; bucket++) {
+        rv_isa_first[bucket] = count;
+
+        for (unsigned int i = 0; i < RV_ISA_COUNT; i++) {
+            if (rv_isa_in_bucket(&rv_isa[i], bucket)) {
+                ASSERT(count < RV_ISA_COUNT * 8);
+                rv_isa_order[count++] = i;
+            }
+        }
+    }
+
+    rv_isa_first[RV_ISA_BUCKETS] = count;
+}
+
+/**
+ * @brief Finds the entry of the instruction set encoding the instruction
+ *
+ * @return Index of the entry in rv_isa, -1 for an illegal instruction.
+ */
+static int rv_isa_find(rv_instr_t instr)
+{
+    unsigned int bucket = RV_ISA_BUCKET(instr.val);
+
+    for (unsigned int i = rv_isa_first[bucket]; i < rv_isa_first[bucket + 1]; i++) {
+        const rv_isa_entry_t *entry = &rv_isa[rv_isa_order[i]];
+
+        if ((instr.val & entry->mask) != entry->match) {
+            continue;
+        }
+
+        if (((entry->flags & RV_ISA_MACHINE_SPECIFIC) != 0) && !machine_specific_instructions) {
+            return -1;
+        }
+
+        return rv_isa_order[i];
+    }
+
+    return -1;
+}
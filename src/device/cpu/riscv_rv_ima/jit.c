@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Translation of RISC-V blocks into x86-64 code
+ *
+ *  Included by the CPU implementations of both RV32 and RV64 after the
+ *  decoded pages (cache_instr_t and lazy_decode()) are defined.
+ *
+ *  A block is the straight-line run executed by execute_block(). The
+ *  simple integer instructions are translated into host instructions
+ *  working on the registers in rv_cpu_t, every other instruction is
+ *  a call of its implementation. After a call the block stops as
+ *  execute_block() does: on an exception, on a write to the frame of
+ *  the block or when the simulation is to stop.
+ *
+ *  A run closed by a branch back to its start repeats itself while
+ *  the branch is taken, as the chained runs of execute_block() do,
+ *  without returning to the block in between.
+ *
+ */
+
+#include "../jit.h"
+
+/** Heat of a block which has been translated */
+#define RV_JIT_TRANSLATED UINT16_MAX
+
+/** Shape of a translated block (see jit_lookup()) */
+#define RV_JIT_SHAPE(length, repeat) (((length) << 1) | (repeat))
+
+#ifdef __x86_64__
+
+/** Maximal number of the instructions of a block */
+#define RV_JIT_TRANSLATION_MAX (FRAME_SIZE / sizeof(rv_instr_t))
+
+/** Number of the exits after a called instruction (see rv_jit_call()) */
+#define RV_JIT_CALL_EXITS 4
+
+/** Maximal size of the code of an instruction and of the block frame */
+#define RV_JIT_INSTR_SIZE 160
+#define RV_JIT_FRAME_SIZE 256
+
+/** Tells whether the operations on XLEN-bit values are 64-bit (REX.W) */
+#define RV_JIT_WIDE (XLEN == 64)
+
+#define RV_JIT_REG(reg) (offsetof(rv_cpu_t, regs) + (reg) * sizeof(uxlen_t))
+#define RV_JIT_PC offsetof(rv_cpu_t, pc)
+#define RV_JIT_PC_NEXT offsetof(rv_cpu_t, pc_next)
+#define RV_JIT_TVAL_NEXT offsetof(rv_cpu_t, csr.tval_next)
+
+/** @brief Emits mov [rbx + offset], imm32 (sign-extended for RV64) */
+static void rv_jit_store_imm(jit_buffer_t *buf, size_t offset, uint32_t imm)
+{
+    jit_emit_cpu(buf, RV_JIT_WIDE, 0xc7, 0, offset);
+    jit_emit32(buf, imm);
+}
+
+/** @brief Emits the update of PC by the instructions translated since the last update */
+static void rv_jit_advance(jit_buffer_t *buf, unsigned int *pending)
+{
+    if (*pending > 0) {
+        // add [pc], imm32; add [pc_next], imm32
+        jit_emit_cpu(buf, RV_JIT_WIDE, 0x81, 0, RV_JIT_PC);
+        jit_emit32(buf, *pending * sizeof(rv_instr_t));
+        jit_emit_cpu(buf, RV_JIT_WIDE, 0x81, 0, RV_JIT_PC_NEXT);
+        jit_emit32(buf, *pending * sizeof(rv_instr_t));
+        *pending = 0;
+    }
+}
+
+/**
+ * @brief Emits the host instructions of a simple integer instruction
+ *
+ * @return false if the instruction has to be called
+ */
+static bool rv_jit_inline(jit_buffer_t *buf, rv_instr_t instr)
+{
+    uint8_t imm_op;
+    uint8_t reg_op;
+
+    switch (instr.r.opcode) {
+    case rv_opcLUI:
+        if (instr.u.rd != 0) {
+            rv_jit_store_imm(buf, RV_JIT_REG(instr.u.rd), (uint32_t) instr.u.imm << 12);
+        }
+        return true;
+    case rv_opcOP_IMM:
+        switch (instr.i.funct3) {
+        case rv_func_ADDI:
+            imm_op = 0x05;
+            break;
+        case rv_func_XORI:
+            imm_op = 0x35;
+            break;
+        case rv_func_ORI:
+            imm_op = 0x0d;
+            break;
+        case rv_func_ANDI:
+            imm_op = 0x25;
+            break;
+        default:
+            return false;
+        }
+
+        if (instr.i.rd != 0) {
+            // mov eax, rs1; op eax, imm32; mov rd, eax
+            jit_emit_cpu(buf, RV_JIT_WIDE, 0x8b, 0, RV_JIT_REG(instr.i.rs1));
+            if (RV_JIT_WIDE) {
+                jit_emit8(buf, 0x48);
+            }
+            jit_emit8(buf, imm_op);
+            jit_emit32(buf, (uint32_t) (int32_t) instr.i.imm);
+            jit_emit_cpu(buf, RV_JIT_WIDE, 0x89, 0, RV_JIT_REG(instr.i.rd));
+        }
+        return true;
+    case rv_opcOP:
+        switch ((instr.r.funct7 << 3) | instr.r.funct3) {
+        case rv_func_ADD:
+            reg_op = 0x03;
+            break;
+        case rv_func_SUB:
+            reg_op = 0x2b;
+            break;
+        case rv_func_XOR:
+            reg_op = 0x33;
+            break;
+        case rv_func_OR:
+            reg_op = 0x0b;
+            break;
+        case rv_func_AND:
+            reg_op = 0x23;
+            break;
+        default:
+            return false;
+        }
+
+        if (instr.r.rd != 0) {
+            // mov eax, rs1; op eax, rs2; mov rd, eax
+            jit_emit_cpu(buf, RV_JIT_WIDE, 0x8b, 0, RV_JIT_REG(instr.r.rs1));
+            jit_emit_cpu(buf, RV_JIT_WIDE, reg_op, 0, RV_JIT_REG(instr.r.rs2));
+            jit_emit_cpu(buf, RV_JIT_WIDE, 0x89, 0, RV_JIT_REG(instr.r.rd));
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Emits the call of the implementation of an instruction
+ *
+ * The block is left after the instruction as the interpreted block
+ * is left, the exits are patched in by the caller.
+ *
+ * @param exits The jumps to the exit of the block
+ */
+static void rv_jit_call(jit_buffer_t *buf, rv_instr_func_t func, rv_instr_t instr, uint8_t **exits)
+{
+    jit_emit_call(buf, (jit_func_t) func, instr.val);
+
+    exits[0] = jit_emit_exit_unless_result(buf, rv_exc_none);
+    exits[1] = jit_emit_exit_if_written(buf);
+    exits[2] = jit_emit_exit_if_set(buf, &machine_halt);
+    exits[3] = jit_emit_exit_if_set(buf, &machine_interactive);
+
+    // The implementation may write x0 or the next trap value
+    rv_jit_store_imm(buf, RV_JIT_REG(0), 0);
+    rv_jit_store_imm(buf, RV_JIT_TVAL_NEXT, 0);
+}
+
+/** Condition codes (of jcc rel32) of the branches by funct3 */
+static const uint8_t rv_jit_branch_cc[8] = {
+    [rv_func_BEQ] = 0x84,
+    [rv_func_BNE] = 0x85,
+    [rv_func_BLT] = 0x8c,
+    [rv_func_BGE] = 0x8d,
+    [rv_func_BLTU] = 0x82,
+    [rv_func_BGEU] = 0x83,
+};
+
+/**
+ * @brief Emits the comparison of a branch
+ *
+ * @return Position of the displacement of the jump taken with the branch
+ */
+static uint8_t *rv_jit_branch(jit_buffer_t *buf, rv_instr_t instr)
+{
+    // mov eax, rs1; cmp eax, rs2; jcc rel32
+    jit_emit_cpu(buf, RV_JIT_WIDE, 0x8b, 0, RV_JIT_REG(instr.b.rs1));
+    jit_emit_cpu(buf, RV_JIT_WIDE, 0x3b, 0, RV_JIT_REG(instr.b.rs2));
+    jit_emit8(buf, 0x0f);
+    jit_emit8(buf, rv_jit_branch_cc[instr.b.funct3]);
+
+    uint8_t *patch = buf->pos;
+    jit_emit32(buf, 0);
+    return patch;
+}
+
+/**
+ * @brief Translates a block of decoded instructions
+ *
+ * @param instr First instruction of the block
+ * @param length Number of the instructions of the block
+ * @param repeat Whether the block repeats itself while the branch following it is taken
+ * @return The translated code or NULL if the block cannot be translated
+ */
+static jit_code_t rv_jit_translate(cache_instr_t *instr, unsigned int length, bool repeat)
+{
+    jit_buffer_t buf;
+
+    if (!jit_begin(&buf, RV_JIT_FRAME_SIZE + length * RV_JIT_INSTR_SIZE)) {
+        return NULL;
+    }
+
+    jit_emit_prologue(&buf);
+    uint8_t *start = buf.pos;
+
+    // Jumps to the exit of each called instruction (patched at the end)
+    uint8_t *exits[RV_JIT_TRANSLATION_MAX][RV_JIT_CALL_EXITS];
+    unsigned int called[RV_JIT_TRANSLATION_MAX];
+    unsigned int call_count = 0;
+    unsigned int pending = 0;
+
+    for (unsigned int i = 0; i < length; i++) {
+        rv_instr_t data = instr[i].data;
+
+        if (rv_jit_inline(&buf, data)) {
+            pending++;
+            continue;
+        }
+
+        rv_jit_advance(&buf, &pending);
+        rv_jit_call(&buf, lazy_decode(&instr[i]), data, exits[call_count]);
+        called[call_count++] = i;
+        pending++;
+    }
+
+    rv_jit_advance(&buf, &pending);
+
+    uint8_t *taken = NULL;
+    if (repeat) {
+        taken = rv_jit_branch(&buf, instr[length].data);
+    }
+
+    jit_emit_done(&buf, length);
+    jit_emit_result(&buf, rv_exc_none);
+
+    uint8_t *epilogue = buf.pos;
+    jit_emit_epilogue(&buf);
+
+    if (repeat) {
+        // The branch is left to the block unless another pass fits
+        uint8_t *stops[3];
+
+        jit_patch32(taken, buf.pos);
+        stops[0] = jit_emit_exit_unless_room(&buf, 2 * length + 1);
+        stops[1] = jit_emit_exit_if_set(&buf, &machine_halt);
+        stops[2] = jit_emit_exit_if_set(&buf, &machine_interactive);
+
+        jit_emit_repeat(&buf, length + 1);
+        jit_emit_cpu(&buf, RV_JIT_WIDE, 0x81, 0, RV_JIT_PC);
+        jit_emit32(&buf, (uint32_t) -(length * sizeof(rv_instr_t)));
+        jit_emit_cpu(&buf, RV_JIT_WIDE, 0x81, 0, RV_JIT_PC_NEXT);
+        jit_emit32(&buf, (uint32_t) -(length * sizeof(rv_instr_t)));
+        jit_patch32(jit_emit_jump(&buf), start);
+
+        for (unsigned int s = 0; s < 3; s++) {
+            jit_patch32(stops[s], buf.pos);
+        }
+
+        jit_emit_done(&buf, length);
+        jit_emit_result(&buf, rv_exc_none);
+        jit_patch32(jit_emit_jump(&buf), epilogue);
+    }
+
+    // The called instruction is left to be finished by the step
+    for (unsigned int c = 0; c < call_count; c++) {
+        for (unsigned int e = 0; e < RV_JIT_CALL_EXITS; e++) {
+            jit_patch32(exits[c][e], buf.pos);
+        }
+
+        jit_emit_done(&buf, called[c]);
+        jit_patch32(jit_emit_jump(&buf), epilogue);
+    }
+
+    return jit_commit(&buf, instr, RV_JIT_SHAPE(length, repeat));
+}
+
+#else /* __x86_64__ */
+
+static jit_code_t rv_jit_translate(cache_instr_t *instr, unsigned int length, bool repeat)
+{
+    return NULL;
+}
+
+#endif /* __x86_64__ */
+
+/**
+ * @brief Tells whether a block repeats itself (see rv_jit_translate)
+ *
+ * The block has to be closed by a branch back to its start. The passes
+ * are not recorded one by one, so the blocks do not repeat themselves
+ * while the fetches are recorded, simulated in the caches or covered.
+ */
+static bool rv_jit_repeats(cache_instr_t *instr, unsigned int length)
+{
+    rv_instr_t next = instr[length].data;
+
+    return (next.b.opcode == rv_opcBRANCH)
+            && (RV_B_IMM(next) == (uxlen_t) -(length * sizeof(rv_instr_t)))
+            && (flight_size == 0) && !cachesim_enabled && !memtrace_active
+            && !coverage_enabled && (coverage_edges == NULL);
+}
+
+/**
+ * @brief Returns the translated code of a hot block
+ *
+ * The executions of the block are counted in the heat of the decoded
+ * instruction starting the block until the translation threshold is
+ * reached. Rewriting the instructions of the block resets the count.
+ *
+ * @param heat Heat of the first instruction of the block
+ * @return The translated code or NULL if the block is to be interpreted
+ */
+static jit_code_t rv_jit_code(cache_instr_t *instr, uint16_t *heat, unsigned int length, unsigned int threshold)
+{
+    bool repeat = rv_jit_repeats(instr, length);
+
+    if (*heat == RV_JIT_TRANSLATED) {
+        jit_code_t code = jit_lookup(instr, RV_JIT_SHAPE(length, repeat));
+
+        if (code != NULL) {
+            return code;
+        }
+    } else if (++*heat < threshold) {
+        return NULL;
+    }
+
+    jit_code_t code = rv_jit_translate(instr, length, repeat);
+    *heat = (code != NULL) ? RV_JIT_TRANSLATED : 0;
+
+    return code;
+}
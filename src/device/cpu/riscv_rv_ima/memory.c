@@ -15,7 +15,9 @@
 #include <stdbool.h>
 
 #include "../../../assert.h"
+#include "../../../debug/memtrace.h"
 #include "../../../physmem.h"
+#include "../../../profile.h"
 #include "../../../utils.h"
 #include "csr.h"
 #include "exception.h"
@@ -23,87 +25,34 @@
 
 #if XLEN == 64
 #define rv_convert_addr rv64_convert_addr
+#define rv_utlb_entry_t rv64_utlb_entry_t
+#define rv_fetch_cache_entry_t rv64_fetch_cache_entry_t
 #elif XLEN == 32
 #define rv_convert_addr rv32_convert_addr
+#define rv_utlb_entry_t rv32_utlb_entry_t
+#define rv_fetch_cache_entry_t rv32_fetch_cache_entry_t
 #endif
 
 #define read_address_misaligned_exception (fetch ? rv_exc_instruction_address_misaligned : rv_exc_load_address_misaligned)
 
-#define try_read_memory_mapped_regs_body(cpu, virt, value, width, type) \
-    if (!IS_ALIGNED(virt, width / 8)) \
-        return false; \
-    if (((cpu)->priv_mode < rv_mmode) || rv_csr_mstatus_mprv(cpu)) \
-        return false; \
-    int offset = (virt & 0x7) * 8; \
-    if (ALIGN_DOWN(virt, 8) == RV_MTIME_ADDRESS) { \
-        *value = (type) EXTRACT_BITS(cpu->csr.mtime, offset, offset + (width) / 8); \
-        return true; \
-    } \
-    if (ALIGN_DOWN(virt, 8) == RV_MTIMECMP_ADDRESS) { \
-        *value = (type) EXTRACT_BITS(cpu->csr.mtimecmp, offset, offset + (width) / 8); \
-        return true; \
-    } \
-    return false;
-
-/** @brief Reads from memory mapped registers if there are any located on the given address */
-static bool try_read_memory_mapped_regs_64(rv_cpu_t *cpu, virt_t virt, uint64_t *value)
-{
-    try_read_memory_mapped_regs_body(cpu, virt, value, 64, uint64_t)
-}
-
-/** @brief Reads from memory mapped registers if there are any located on the given address */
-static bool try_read_memory_mapped_regs_32(rv_cpu_t *cpu, virt_t virt, uint32_t *value)
-{
-    try_read_memory_mapped_regs_body(cpu, virt, value, 32, uint32_t)
-}
-
-/** @brief Reads from memory mapped registers if there are any located on the given address */
-static bool try_read_memory_mapped_regs_16(rv_cpu_t *cpu, virt_t virt, uint16_t *value)
-{
-    try_read_memory_mapped_regs_body(cpu, virt, value, 16, uint16_t)
-}
-
-/** @brief Reads from memory mapped registers if there are any located on the given address */
-static bool try_read_memory_mapped_regs_8(rv_cpu_t *cpu, virt_t virt, uint8_t *value)
+static void handle_mtip(rv_cpu_t *cpu)
 {
-    try_read_memory_mapped_regs_body(cpu, virt, value, 8, uint8_t)
-}
+    bool mtip = cpu->csr.mtime >= cpu->csr.mtimecmp;
 
-#undef try_read_memory_mapped_regs_body
+    // Called every cycle, mostly without any change
+    if (mtip == ((cpu->csr.mip & rv_csr_mti_mask) != 0)) {
+        return;
+    }
 
-static void handle_mtip(rv_cpu_t *cpu)
-{
-    if (cpu->csr.mtime >= cpu->csr.mtimecmp) {
+    if (mtip) {
         // Set MTIP
         cpu->csr.mip |= rv_csr_mti_mask;
     } else {
         // Clear MTIP
         cpu->csr.mip &= ~rv_csr_mti_mask;
     }
-}
-
-/** @brief Writes to memory mapped registers if there are any located on the given address */
-static bool try_write_memory_mapped_regs(rv_cpu_t *cpu, uint64_t virt, uint64_t value, int width)
-{
-    if (!IS_ALIGNED(virt, width / 8)) {
-        return false;
-    }
 
-    if ((cpu->priv_mode < rv_mmode) || rv_csr_mstatus_mprv(cpu)) {
-        return false;
-    }
-    int offset = (virt & 0x7) * 8;
-    if (ALIGN_DOWN(virt, 8) == RV_MTIME_ADDRESS) {
-        cpu->csr.mtime = WRITE_BITS(cpu->csr.mtime, value, offset, offset + width);
-        handle_mtip(cpu);
-        return true;
-    }
-    if (ALIGN_DOWN(virt, 8) == RV_MTIMECMP_ADDRESS) {
-        cpu->csr.mtimecmp = WRITE_BITS(cpu->csr.mtimecmp, value, offset, offset + width);
-        handle_mtip(cpu);
-        return true;
-    }
-    return false;
+    rv_csr_update_interrupts_pending(cpu);
 }
 
 #define throw_ex(cpu, virt, ex, noisy) \
@@ -114,6 +63,108 @@ static bool try_write_memory_mapped_regs(rv_cpu_t *cpu, uint64_t virt, uint64_t
         return (ex); \
     }
 
+/**
+ * @brief Returns the slot of the fetch cache for a page of the current address space
+ *
+ * The slots are tagged by the MODE and ASID fields of satp and by the
+ * privilege mode, which select the translation of the fetches. Since
+ * satp writes do not invalidate the translations of the other ASIDs,
+ * neither the context switches nor the traps forget the slots.
+ *
+ * @param context The tag of the current address space (returned)
+ */
+static rv_fetch_cache_entry_t *rv_fetch_cache_slot(rv_cpu_t *cpu, virt_t vpage, uxlen_t *context)
+{
+    uxlen_t asid = (cpu->csr.satp >> rv_csr_satp_asid_offset) & rv_asid_mask;
+
+    *context = (cpu->csr.satp & ~(uxlen_t) rv_csr_satp_ppn_mask) | (cpu->priv_mode << 1) | 1;
+    return &cpu->fetch_cache[(vpage ^ asid) & (RV_FETCH_CACHE_SIZE - 1)];
+}
+
+/**
+ * @brief Translates a virtual address, trying the last translation of the same kind first
+ *
+ * The frame holding the physical address is returned as well (NULL outside
+ * of memory), so that repeated accesses to a page skip both the translation
+ * and the frame table lookup. Only noisy translations are remembered, since
+ * only those update the A and D bits the fast path relies on.
+ *
+ * The fetches missing the last translation try the fetch cache of the recent
+ * address spaces before the TLB, so that the code of the processes switched
+ * to is reached without the translation and the frame table lookup.
+ *
+ * The accesses are checked against PMP when translated. The translation is
+ * not remembered if the PMP permissions change within the frames, as the
+ * fast path does not check them.
+ */
+static rv_exc_t rv_translate(rv_cpu_t *cpu, virt_t virt, unsigned int size, ptr36_t *phys, frame_t **frame, bool wr, bool fetch, bool noisy)
+{
+    rv_utlb_entry_t *last = &cpu->utlb[wr ? rv_utlb_write : (fetch ? rv_utlb_fetch : rv_utlb_read)];
+    virt_t vpage = virt >> FRAME_WIDTH;
+
+    if (last->valid && (last->vpage == vpage) && (last->layout == physmem_layout)) {
+        *phys = last->ppage | (virt & FRAME_MASK);
+        *frame = last->frame;
+        return rv_exc_none;
+    }
+
+    rv_fetch_cache_entry_t *slot = NULL;
+    uxlen_t context = 0;
+
+    if (fetch) {
+        slot = rv_fetch_cache_slot(cpu, vpage, &context);
+
+        if ((slot->context == context) && (slot->vpage == vpage) && (slot->layout == physmem_layout)) {
+            cpu->fetch_cache_hits++;
+            *phys = slot->ppage | (virt & FRAME_MASK);
+            *frame = slot->frame;
+
+            if (noisy) {
+                last->valid = true;
+                last->vpage = vpage;
+                last->ppage = slot->ppage;
+                last->frame = slot->frame;
+                last->layout = slot->layout;
+            }
+
+            return rv_exc_none;
+        }
+    }
+
+    profile_region_enter(PROFILE_TRANSLATE);
+    rv_exc_t ex = rv_convert_addr(cpu, virt, phys, wr, fetch, noisy);
+
+    if (ex == rv_exc_none) {
+        ex = rv_pmp_check(cpu, *phys, size, wr, fetch);
+    }
+
+    if (ex != rv_exc_none) {
+        profile_region_leave();
+        return ex;
+    }
+
+    *frame = physmem_find_frame(*phys);
+    profile_region_leave();
+
+    if (noisy && !cpu->csr.pmp_fine) {
+        last->valid = true;
+        last->vpage = vpage;
+        last->ppage = ALIGN_DOWN(*phys, FRAME_SIZE);
+        last->frame = *frame;
+        last->layout = physmem_layout;
+
+        if (slot != NULL) {
+            slot->context = context;
+            slot->vpage = vpage;
+            slot->ppage = last->ppage;
+            slot->frame = *frame;
+            slot->layout = physmem_layout;
+        }
+    }
+
+    return rv_exc_none;
+}
+
 /**
  * @brief Reads 64 bits from virtual memory
  *
@@ -129,12 +180,9 @@ static rv_exc_t rv_read_mem64(rv_cpu_t *cpu, virt_t virt, uint64_t *value, bool
     ASSERT(cpu != NULL);
     ASSERT(value != NULL);
 
-    if (try_read_memory_mapped_regs_64(cpu, virt, value)) {
-        return rv_exc_none;
-    }
-
     ptr36_t phys;
-    rv_exc_t ex = rv_convert_addr(cpu, virt, &phys, false, fetch, noisy);
+    frame_t *frame;
+    rv_exc_t ex = rv_translate(cpu, virt, 8, &phys, &frame, false, fetch, noisy);
 
     // Address translation exceptions have priority to alignment exceptions
 
@@ -146,7 +194,11 @@ static rv_exc_t rv_read_mem64(rv_cpu_t *cpu, virt_t virt, uint64_t *value, bool
         throw_ex(cpu, virt, read_address_misaligned_exception, noisy);
     }
 
-    *value = physmem_read64(cpu->csr.mhartid, phys, true);
+    if (noisy && !fetch) {
+        memtrace_access(cpu->csr.mhartid, virt, phys, 8, MEMTRACE_READ);
+    }
+
+    *value = physmem_cached_read64(cpu->csr.mhartid, frame, phys);
     return rv_exc_none;
 }
 
@@ -165,12 +217,9 @@ static rv_exc_t rv_read_mem32(rv_cpu_t *cpu, virt_t virt, uint32_t *value, bool
     ASSERT(cpu != NULL);
     ASSERT(value != NULL);
 
-    if (try_read_memory_mapped_regs_32(cpu, virt, value)) {
-        return rv_exc_none;
-    }
-
     ptr36_t phys;
-    rv_exc_t ex = rv_convert_addr(cpu, virt, &phys, false, fetch, noisy);
+    frame_t *frame;
+    rv_exc_t ex = rv_translate(cpu, virt, 4, &phys, &frame, false, fetch, noisy);
 
     // Address translation exceptions have priority to alignment exceptions
 
@@ -182,7 +231,11 @@ static rv_exc_t rv_read_mem32(rv_cpu_t *cpu, virt_t virt, uint32_t *value, bool
         throw_ex(cpu, virt, read_address_misaligned_exception, noisy);
     }
 
-    *value = physmem_read32(cpu->csr.mhartid, phys, true);
+    if (noisy && !fetch) {
+        memtrace_access(cpu->csr.mhartid, virt, phys, 4, MEMTRACE_READ);
+    }
+
+    *value = physmem_cached_read32(cpu->csr.mhartid, frame, phys);
     return rv_exc_none;
 }
 
@@ -201,12 +254,9 @@ static rv_exc_t rv_read_mem16(rv_cpu_t *cpu, virt_t virt, uint16_t *value, bool
     ASSERT(cpu != NULL);
     ASSERT(value != NULL);
 
-    if (try_read_memory_mapped_regs_16(cpu, virt, value)) {
-        return rv_exc_none;
-    }
-
     ptr36_t phys;
-    rv_exc_t ex = rv_convert_addr(cpu, virt, &phys, false, fetch, noisy);
+    frame_t *frame;
+    rv_exc_t ex = rv_translate(cpu, virt, 2, &phys, &frame, false, fetch, noisy);
 
     if (ex != rv_exc_none) {
         throw_ex(cpu, virt, ex, noisy);
@@ -216,7 +266,11 @@ static rv_exc_t rv_read_mem16(rv_cpu_t *cpu, virt_t virt, uint16_t *value, bool
         throw_ex(cpu, virt, read_address_misaligned_exception, noisy);
     }
 
-    *value = physmem_read16(cpu->csr.mhartid, phys, true);
+    if (noisy && !fetch) {
+        memtrace_access(cpu->csr.mhartid, virt, phys, 2, MEMTRACE_READ);
+    }
+
+    *value = physmem_cached_read16(cpu->csr.mhartid, frame, phys);
     return rv_exc_none;
 }
 
@@ -235,18 +289,19 @@ static rv_exc_t rv_read_mem8(rv_cpu_t *cpu, virt_t virt, uint8_t *value, bool no
     ASSERT(cpu != NULL);
     ASSERT(value != NULL);
 
-    if (try_read_memory_mapped_regs_8(cpu, virt, value)) {
-        return rv_exc_none;
-    }
-
     ptr36_t phys;
-    rv_exc_t ex = rv_convert_addr(cpu, virt, &phys, false, false, noisy);
+    frame_t *frame;
+    rv_exc_t ex = rv_translate(cpu, virt, 1, &phys, &frame, false, false, noisy);
 
     if (ex != rv_exc_none) {
         throw_ex(cpu, virt, ex, noisy);
     }
 
-    *value = physmem_read8(cpu->csr.mhartid, phys, true);
+    if (noisy) {
+        memtrace_access(cpu->csr.mhartid, virt, phys, 1, MEMTRACE_READ);
+    }
+
+    *value = physmem_cached_read8(cpu->csr.mhartid, frame, phys);
     return rv_exc_none;
 }
 
@@ -263,18 +318,19 @@ static rv_exc_t rv_write_mem8(rv_cpu_t *cpu, virt_t virt, uint8_t value, bool no
 {
     ASSERT(cpu != NULL);
 
-    if (try_write_memory_mapped_regs(cpu, virt, value, 8)) {
-        return rv_exc_none;
-    }
-
     ptr36_t phys;
-    rv_exc_t ex = rv_convert_addr(cpu, virt, &phys, true, false, noisy);
+    frame_t *frame;
+    rv_exc_t ex = rv_translate(cpu, virt, 1, &phys, &frame, true, false, noisy);
 
     if (ex != rv_exc_none) {
         throw_ex(cpu, virt, ex, noisy);
     }
 
-    if (physmem_write8(cpu->csr.mhartid, phys, value, true)) {
+    if (noisy) {
+        memtrace_access(cpu->csr.mhartid, virt, phys, 1, MEMTRACE_WRITE);
+    }
+
+    if (physmem_cached_write8(cpu->csr.mhartid, frame, phys, value)) {
         return rv_exc_none;
     }
 
@@ -296,12 +352,9 @@ static rv_exc_t rv_write_mem16(rv_cpu_t *cpu, virt_t virt, uint16_t value, bool
 {
     ASSERT(cpu != NULL);
 
-    if (try_write_memory_mapped_regs(cpu, virt, value, 16)) {
-        return rv_exc_none;
-    }
-
     ptr36_t phys;
-    rv_exc_t ex = rv_convert_addr(cpu, virt, &phys, true, false, noisy);
+    frame_t *frame;
+    rv_exc_t ex = rv_translate(cpu, virt, 2, &phys, &frame, true, false, noisy);
 
     // address translation exceptions have priority to alignment exceptions
     if (ex != rv_exc_none) {
@@ -312,7 +365,11 @@ static rv_exc_t rv_write_mem16(rv_cpu_t *cpu, virt_t virt, uint16_t value, bool
         throw_ex(cpu, virt, rv_exc_store_amo_address_misaligned, noisy);
     }
 
-    if (physmem_write16(cpu->csr.mhartid, phys, value, true)) {
+    if (noisy) {
+        memtrace_access(cpu->csr.mhartid, virt, phys, 2, MEMTRACE_WRITE);
+    }
+
+    if (physmem_cached_write16(cpu->csr.mhartid, frame, phys, value)) {
         return rv_exc_none;
     }
 
@@ -334,12 +391,9 @@ static rv_exc_t rv_write_mem32(rv_cpu_t *cpu, virt_t virt, uint32_t value, bool
 {
     ASSERT(cpu != NULL);
 
-    if (try_write_memory_mapped_regs(cpu, virt, value, 32)) {
-        return rv_exc_none;
-    }
-
     ptr36_t phys;
-    rv_exc_t ex = rv_convert_addr(cpu, virt, &phys, true, false, noisy);
+    frame_t *frame;
+    rv_exc_t ex = rv_translate(cpu, virt, 4, &phys, &frame, true, false, noisy);
 
     if (ex != rv_exc_none) {
         throw_ex(cpu, virt, ex, noisy);
@@ -349,7 +403,11 @@ static rv_exc_t rv_write_mem32(rv_cpu_t *cpu, virt_t virt, uint32_t value, bool
         throw_ex(cpu, virt, rv_exc_store_amo_address_misaligned, noisy);
     }
 
-    if (physmem_write32(cpu->csr.mhartid, phys, value, true)) {
+    if (noisy) {
+        memtrace_access(cpu->csr.mhartid, virt, phys, 4, MEMTRACE_WRITE);
+    }
+
+    if (physmem_cached_write32(cpu->csr.mhartid, frame, phys, value)) {
         return rv_exc_none;
     }
 
@@ -371,12 +429,9 @@ static rv_exc_t rv_write_mem64(rv_cpu_t *cpu, virt_t virt, uint64_t value, bool
 {
     ASSERT(cpu != NULL);
 
-    if (try_write_memory_mapped_regs(cpu, virt, value, 64)) {
-        return rv_exc_none;
-    }
-
     ptr36_t phys;
-    rv_exc_t ex = rv_convert_addr(cpu, virt, &phys, true, false, noisy);
+    frame_t *frame;
+    rv_exc_t ex = rv_translate(cpu, virt, 8, &phys, &frame, true, false, noisy);
 
     if (ex != rv_exc_none) {
         throw_ex(cpu, virt, ex, noisy);
@@ -386,7 +441,11 @@ static rv_exc_t rv_write_mem64(rv_cpu_t *cpu, virt_t virt, uint64_t value, bool
         throw_ex(cpu, virt, rv_exc_store_amo_address_misaligned, noisy);
     }
 
-    if (physmem_write64(cpu->csr.mhartid, phys, value, true)) {
+    if (noisy) {
+        memtrace_access(cpu->csr.mhartid, virt, phys, 8, MEMTRACE_WRITE);
+    }
+
+    if (physmem_cached_write64(cpu->csr.mhartid, frame, phys, value)) {
         return rv_exc_none;
     }
 
@@ -395,6 +454,50 @@ static rv_exc_t rv_write_mem64(rv_cpu_t *cpu, virt_t virt, uint64_t value, bool
     return rv_exc_none;
 }
 
+/**
+ * @brief Translates the address of an atomic access once for all its parts
+ *
+ * The address is translated with the write intent (an AMO or an SC needs
+ * the write privileges even to read) and checked for the alignment, the
+ * read and the write of the access then reuse the physical address and
+ * the frame. The atomic instructions operate on the host memory directly
+ * when a store to the address has no side effects besides the store
+ * itself, i.e. the address is not a memory mapped register and the frame
+ * allows direct writes (and the memory accesses are not traced).
+ *
+ * @param cpu The cpu which makes the access
+ * @param virt The virtual address of the access
+ * @param size The size of the access (4 or 8 bytes)
+ * @param phys The physical address of the access
+ * @param frame The frame holding the physical address (NULL outside of memory)
+ * @param host Set to the host memory backing the address, or to NULL if
+ *        the access has to go through the memory access functions
+ * @return rv_exc_t The exception code
+ */
+static rv_exc_t rv_atomic_translate(rv_cpu_t *cpu, virt_t virt, int size,
+        ptr36_t *phys, frame_t **frame, void **host)
+{
+    ASSERT(cpu != NULL);
+
+    *host = NULL;
+
+    rv_exc_t ex = rv_translate(cpu, virt, size, phys, frame, true, false, true);
+
+    if (ex != rv_exc_none) {
+        throw_ex(cpu, virt, ex, true);
+    }
+
+    if (!IS_ALIGNED(virt, size)) {
+        throw_ex(cpu, virt, rv_exc_store_amo_address_misaligned, true);
+    }
+
+    if ((*frame != NULL) && ((*frame)->direct & FRAME_DIRECT_WRITE) && (!memtrace_active)) {
+        *host = (*frame)->data + (*phys & FRAME_MASK);
+    }
+
+    return rv_exc_none;
+}
+
 static bool rv_sc_access(rv_cpu_t *cpu, ptr36_t phys, int size)
 {
     ASSERT(cpu != NULL);
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  RISC-V physical memory protection
+ *
+ *  Included by the CPU implementations before the page walk is
+ *  defined.
+ *
+ *  The PMP CSRs are compiled into address ranges whenever they
+ *  change (see rv_pmp_update()). The accesses are checked when
+ *  they are translated, the translations cached by the processor
+ *  (the last translation of each kind) are checked already. As
+ *  long as the ranges are aligned to frames, the permissions are
+ *  the same in the whole frame, so that the cached translations
+ *  need no further checks. Ranges with finer boundaries make every
+ *  access check the ranges.
+ *
+ */
+
+/**
+ * @brief Tells whether PMP allows an access
+ *
+ * The entry with the lowest number matching any byte of the access
+ * decides, it has to match all the bytes of the access. M-mode accesses
+ * are checked by the locked entries only. If no entry matches, only
+ * M-mode accesses succeed (unless no entry is implemented).
+ *
+ * @param perm The permission bits (R, W, X) the access needs
+ * @param priv The privilege mode of the access
+ */
+static bool rv_pmp_allows(rv_cpu_t *cpu, uint64_t phys, unsigned int size, uint8_t perm, rv_priv_mode_t priv)
+{
+    const rv_csr_t *csr = &cpu->csr;
+    uint64_t end = phys + size;
+
+    for (unsigned int i = 0; i < csr->pmp_region_count; i++) {
+        const rv_pmp_region_t *region = &csr->pmp_regions[i];
+
+        if ((phys >= region->end) || (end <= region->base)) {
+            continue;
+        }
+
+        // Partially matching accesses fail
+        if ((phys < region->base) || (end > region->end)) {
+            return false;
+        }
+
+        if ((priv == rv_mmode) && !region->locked) {
+            return true;
+        }
+
+        return (region->perm & perm) == perm;
+    }
+
+    return (priv == rv_mmode) || (csr->pmp_entries == 0);
+}
+
+/**
+ * @brief Checks a translated access against PMP
+ *
+ * The data accesses are made in the effective privilege mode (see MPRV).
+ *
+ * @return The access fault of the access if PMP denies it
+ */
+static rv_exc_t rv_pmp_check(rv_cpu_t *cpu, ptr36_t phys, unsigned int size, bool wr, bool fetch)
+{
+    if (cpu->csr.pmp_entries == 0) {
+        return rv_exc_none;
+    }
+
+    if (fetch) {
+        return rv_pmp_allows(cpu, phys, size, rv_csr_pmpcfg_x_mask, cpu->priv_mode)
+                ? rv_exc_none
+                : rv_exc_instruction_access_fault;
+    }
+
+    rv_priv_mode_t priv = rv_csr_mstatus_mprv(cpu) ? rv_csr_mstatus_mpp(cpu) : cpu->priv_mode;
+
+    if (wr) {
+        return rv_pmp_allows(cpu, phys, size, rv_csr_pmpcfg_w_mask, priv)
+                ? rv_exc_none
+                : rv_exc_store_amo_access_fault;
+    }
+
+    return rv_pmp_allows(cpu, phys, size, rv_csr_pmpcfg_r_mask, priv)
+            ? rv_exc_none
+            : rv_exc_load_access_fault;
+}
@@ -15,6 +15,7 @@
 #define RISCV_RV_COMMON_TYPES_H_
 
 #include <stdint.h>
+#include <string.h>
 
 #include "exception.h"
 
@@ -46,6 +47,43 @@ struct rv32_cpu;
 typedef struct rv32_cpu rv_cpu_t;
 #endif
 
+/** Kinds of accesses which keep their own last translation */
+typedef enum {
+    rv_utlb_fetch,
+    rv_utlb_read,
+    rv_utlb_write,
+    rv_utlb_count
+} rv_utlb_kind_t;
+
+/** Forgets the last translations cached by the processor
+ *
+ * Needs to be done whenever the translation context (satp, mstatus,
+ * privilege mode) changes or when TLB entries are flushed. The TLB
+ * takes its access context again before the next translation.
+ */
+#define rv_utlb_flush(cpu) \
+    do { \
+        memset((cpu)->utlb, 0, sizeof((cpu)->utlb)); \
+        (cpu)->tlb.context_changed = true; \
+    } while (0)
+
+/** Number of slots of the fetch translation cache (power of two) */
+#define RV_FETCH_CACHE_SIZE 64
+
+/** Forgets the fetch translations cached by the processor
+ *
+ * The translations are tagged by the address space and the privilege
+ * mode, so only the changes of the translations themselves (SFENCE.VMA,
+ * TLB flushes, PMP changes) need to forget them.
+ */
+#define rv_fetch_cache_flush(cpu) memset((cpu)->fetch_cache, 0, sizeof((cpu)->fetch_cache))
+
+/** Forgets the non-leaf PTEs cached by the processor
+ *
+ * Needs to be done whenever satp changes or all the TLB entries are flushed.
+ */
+#define rv_walk_cache_flush(cpu) memset(&(cpu)->walk_cache, 0, sizeof((cpu)->walk_cache))
+
 #if XLEN == 64
 #define XLEN_MIN INT64_MIN
 #define XLEN_UMAX UINT64_MAX
@@ -0,0 +1,440 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Core-local interruptor
+ *
+ *  Maps the timer registers of the RISC-V processors (mtime and mtimecmp)
+ *  and their machine software interrupts (msip). The mtime register is
+ *  shared by all processors, each processor has its own mtimecmp and msip
+ *  register selected by its number. The first two registers stay at the
+ *  addresses of the former built-in mtime and mtimecmp registers when the
+ *  device is mapped at 0xFF000000.
+ *
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../assert.h"
+#include "../checkpoint.h"
+#include "../fault.h"
+#include "../main.h"
+#include "../utils.h"
+#include "cpu/general_cpu.h"
+#include "dclint.h"
+#include "device.h"
+
+/** \{ \name Registers */
+#define REGISTER_MTIME 0 /**< Shared time (64 bits) */
+#define REGISTER_MTIMECMP 8 /**< Time compare of processor 0 (64 bits each) */
+#define REGISTER_MSIP 0x1000 /**< Software interrupt of processor 0 (32 bits each) */
+#define REGISTER_LIMIT (REGISTER_MSIP + 4 * MAX_CPUS) /**< Register block size */
+/* \} */
+
+/** Machine software interrupt of RISC-V */
+#define INTERRUPT_MSI 3
+
+/** Dclint instance data structure */
+typedef struct {
+    ptr36_t addr; /**< Register block address */
+    bool msip[MAX_CPUS]; /**< Software interrupts raised */
+
+    uint64_t accesses; /**< Total number of register accesses */
+} dclint_data_t;
+
+/** Read the shared time
+ *
+ * All processors keep the same time, the one accessing the register
+ * is asked first.
+ *
+ */
+static uint64_t dclint_mtime(unsigned int procno)
+{
+    uint64_t val = 0;
+    general_cpu_t *cpu = get_cpu(procno);
+
+    if ((cpu != NULL) && (cpu_timer_read(cpu, cpu_timer_time, &val))) {
+        return val;
+    }
+
+    for (unsigned int i = 0; i < get_cpu_count(); i++) {
+        if (cpu_timer_read(get_cpu_by_index(i), cpu_timer_time, &val)) {
+            return val;
+        }
+    }
+
+    return 0;
+}
+
+/** Write the shared time into all processors */
+static void dclint_mtime_write(uint64_t val)
+{
+    for (unsigned int i = 0; i < get_cpu_count(); i++) {
+        cpu_timer_write(get_cpu_by_index(i), cpu_timer_time, val);
+    }
+}
+
+/** Read the time compare of a processor (0 without the processor) */
+static uint64_t dclint_mtimecmp(unsigned int no)
+{
+    uint64_t val = 0;
+    general_cpu_t *cpu = get_cpu(no);
+
+    if (cpu != NULL) {
+        cpu_timer_read(cpu, cpu_timer_compare, &val);
+    }
+
+    return val;
+}
+
+/** Write the time compare of a processor (ignored without the processor) */
+static void dclint_mtimecmp_write(unsigned int no, uint64_t val)
+{
+    general_cpu_t *cpu = get_cpu(no);
+
+    if (cpu != NULL) {
+        cpu_timer_write(cpu, cpu_timer_compare, val);
+    }
+}
+
+/** Raise or clear the software interrupt of a processor */
+static void dclint_msip_write(dclint_data_t *data, unsigned int no, bool msip)
+{
+    general_cpu_t *cpu = get_cpu(no);
+
+    if ((cpu == NULL) || (data->msip[no] == msip)) {
+        return;
+    }
+
+    data->msip[no] = msip;
+
+    if (msip) {
+        cpu_interrupt_up(cpu, INTERRUPT_MSI);
+    } else {
+        cpu_interrupt_down(cpu, INTERRUPT_MSI);
+    }
+}
+
+/** Init command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool dclint_init(token_t *parm, device_t *dev)
+{
+    parm_next(&parm);
+    uint64_t _addr = parm_uint(parm);
+
+    if (!phys_range(_addr)) {
+        error("Physical memory address out of range");
+        return false;
+    }
+
+    if (!phys_range(_addr + (uint64_t) REGISTER_LIMIT)) {
+        error("Invalid address, registers would exceed the physical "
+              "memory range");
+        return false;
+    }
+
+    ptr36_t addr = _addr;
+
+    if (!ptr36_dword_aligned(addr)) {
+        error("Physical memory address must be 8-byte aligned");
+        return false;
+    }
+
+    /* Initialization */
+    dclint_data_t *data = safe_malloc_t(dclint_data_t);
+    dev->data = data;
+
+    data->addr = addr;
+    memset(data->msip, 0, sizeof(data->msip));
+    data->accesses = 0;
+
+    dev_map(dev, addr, REGISTER_LIMIT);
+
+    return true;
+}
+
+/** Info command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True (always successful)
+ *
+ */
+static bool dclint_info(token_t *parm, device_t *dev)
+{
+    dclint_data_t *data = (dclint_data_t *) dev->data;
+
+    printf("[address ] [mtime             ]\n");
+    printf("%#11" PRIx64 " %20" PRIu64 "\n", data->addr, dclint_mtime(0));
+
+    return true;
+}
+
+/** Stat command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True (always successful)
+ *
+ */
+static bool dclint_stat(token_t *parm, device_t *dev)
+{
+    dclint_data_t *data = (dclint_data_t *) dev->data;
+
+    printf("[access count]\n");
+    printf("%" PRIu64 "\n", data->accesses);
+
+    return true;
+}
+
+/** Dispose dclint
+ *
+ * @param dev Device pointer
+ *
+ */
+static void dclint_done(device_t *dev)
+{
+    safe_free(dev->data);
+}
+
+/** Read command implementation (32 bits)
+ *
+ * The 64-bit registers are read by their halves.
+ *
+ * @param dev  Device pointer
+ * @param addr Address of the read operation
+ * @param val  Read (returned) value
+ *
+ */
+static void dclint_read32(unsigned int procno, device_t *dev, ptr36_t addr, uint32_t *val)
+{
+    ASSERT(dev != NULL);
+    ASSERT(val != NULL);
+
+    dclint_data_t *data = (dclint_data_t *) dev->data;
+    ptr36_t offset = addr - data->addr;
+
+    if ((offset & 3) != 0) {
+        return;
+    }
+
+    data->accesses++;
+
+    if (offset >= REGISTER_MSIP) {
+        *val = data->msip[(offset - REGISTER_MSIP) / 4];
+        return;
+    }
+
+    uint64_t reg;
+
+    if (offset < REGISTER_MTIMECMP) {
+        reg = dclint_mtime(procno);
+    } else if (offset < REGISTER_MTIMECMP + 8 * MAX_CPUS) {
+        reg = dclint_mtimecmp((offset - REGISTER_MTIMECMP) / 8);
+    } else {
+        return;
+    }
+
+    *val = (uint32_t) (reg >> ((offset & 4) * 8));
+}
+
+/** Read command implementation (64 bits)
+ *
+ * @param dev  Device pointer
+ * @param addr Address of the read operation
+ * @param val  Read (returned) value
+ *
+ */
+static void dclint_read64(unsigned int procno, device_t *dev, ptr36_t addr, uint64_t *val)
+{
+    ASSERT(dev != NULL);
+    ASSERT(val != NULL);
+
+    dclint_data_t *data = (dclint_data_t *) dev->data;
+    ptr36_t offset = addr - data->addr;
+
+    if (((offset & 7) != 0) || (offset >= REGISTER_MTIMECMP + 8 * MAX_CPUS)) {
+        return;
+    }
+
+    data->accesses++;
+
+    if (offset == REGISTER_MTIME) {
+        *val = dclint_mtime(procno);
+    } else {
+        *val = dclint_mtimecmp((offset - REGISTER_MTIMECMP) / 8);
+    }
+}
+
+/** Write command implementation (32 bits)
+ *
+ * The 64-bit registers are written by their halves.
+ *
+ * @param dev  Device pointer
+ * @param addr Address of the write operation
+ * @param val  Value to write
+ *
+ */
+static void dclint_write32(unsigned int procno, device_t *dev, ptr36_t addr, uint32_t val)
+{
+    ASSERT(dev != NULL);
+
+    dclint_data_t *data = (dclint_data_t *) dev->data;
+    ptr36_t offset = addr - data->addr;
+
+    if ((offset & 3) != 0) {
+        return;
+    }
+
+    data->accesses++;
+
+    if (offset >= REGISTER_MSIP) {
+        dclint_msip_write(data, (offset - REGISTER_MSIP) / 4, (val & 1) != 0);
+        return;
+    }
+
+    unsigned int shift = (offset & 4) * 8;
+    uint64_t mask = ((uint64_t) UINT32_MAX) << shift;
+
+    if (offset < REGISTER_MTIMECMP) {
+        uint64_t reg = dclint_mtime(procno);
+        dclint_mtime_write((reg & ~mask) | ((uint64_t) val << shift));
+    } else if (offset < REGISTER_MTIMECMP + 8 * MAX_CPUS) {
+        unsigned int no = (offset - REGISTER_MTIMECMP) / 8;
+        uint64_t reg = dclint_mtimecmp(no);
+        dclint_mtimecmp_write(no, (reg & ~mask) | ((uint64_t) val << shift));
+    }
+}
+
+/** Write command implementation (64 bits)
+ *
+ * @param dev  Device pointer
+ * @param addr Address of the write operation
+ * @param val  Value to write
+ *
+ */
+static void dclint_write64(unsigned int procno, device_t *dev, ptr36_t addr, uint64_t val)
+{
+    ASSERT(dev != NULL);
+
+    dclint_data_t *data = (dclint_data_t *) dev->data;
+    ptr36_t offset = addr - data->addr;
+
+    if (((offset & 7) != 0) || (offset >= REGISTER_MTIMECMP + 8 * MAX_CPUS)) {
+        return;
+    }
+
+    data->accesses++;
+
+    if (offset == REGISTER_MTIME) {
+        dclint_mtime_write(val);
+    } else {
+        dclint_mtimecmp_write((offset - REGISTER_MTIMECMP) / 8, val);
+    }
+}
+
+/** Save the software interrupts into a checkpoint
+ *
+ * The timer registers are saved by the processors.
+ *
+ * @param dev  Device instance pointer
+ * @param ckpt Checkpoint being written
+ *
+ * @return True if successful
+ *
+ */
+static bool dclint_save(device_t *dev, checkpoint_t *ckpt)
+{
+    dclint_data_t *data = (dclint_data_t *) dev->data;
+
+    return checkpoint_write_var(ckpt, data->accesses)
+            && checkpoint_write_var(ckpt, data->msip);
+}
+
+/** Load the software interrupts from a checkpoint
+ *
+ * @param dev  Device instance pointer
+ * @param ckpt Checkpoint being read
+ *
+ * @return True if successful
+ *
+ */
+static bool dclint_load(device_t *dev, checkpoint_t *ckpt)
+{
+    dclint_data_t *data = (dclint_data_t *) dev->data;
+
+    return checkpoint_read_var(ckpt, data->accesses)
+            && checkpoint_read_var(ckpt, data->msip);
+}
+
+static cmd_t dclint_cmds[] = {
+    { "init",
+            (fcmd_t) dclint_init,
+            DEFAULT,
+            DEFAULT,
+            "Initialization",
+            "Initialization",
+            REQ STR "name/interruptor name" NEXT
+                    REQ INT "addr/register block address" END },
+    { "help",
+            (fcmd_t) dev_generic_help,
+            DEFAULT,
+            DEFAULT,
+            "Display help",
+            "Display help",
+            OPT STR "cmd/command name" END },
+    { "info",
+            (fcmd_t) dclint_info,
+            DEFAULT,
+            DEFAULT,
+            "Display device configuration",
+            "Display device configuration",
+            NOCMD },
+    { "stat",
+            (fcmd_t) dclint_stat,
+            DEFAULT,
+            DEFAULT,
+            "Display device statistics",
+            "Display device statistics",
+            NOCMD },
+    LAST_CMD
+};
+
+/** Dclint object structure */
+device_type_t dclint = {
+    /* The time follows the mtime source of the processors */
+    .nondet = false,
+
+    /* Type name and description */
+    .name = "dclint",
+    .brief = "Core-local interruptor",
+    .full = "The core-local interruptor maps the mtime register shared "
+            "by the RISC-V processors, their mtimecmp registers and "
+            "their machine software interrupt registers.",
+
+    /* Functions */
+    .done = dclint_done,
+    .read32 = dclint_read32,
+    .read64 = dclint_read64,
+    .write32 = dclint_write32,
+    .write64 = dclint_write64,
+    .save = dclint_save,
+    .load = dclint_load,
+
+    /* Commands */
+    .cmds = dclint_cmds
+};
@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Core-local interruptor
+ *
+ */
+
+#ifndef DCLINT_H_
+#define DCLINT_H_
+
+#include "device.h"
+
+extern device_type_t dclint;
+
+#endif
@@ -5,7 +5,10 @@
  * Distributed under the terms of GPL.
  *
  *
- *  Time device
+ *  Cycle counter device
+ *
+ *  The counter is not stepped, it is derived from the machine cycle
+ *  counter on read, so it stays correct when cycles are skipped.
  *
  */
 
@@ -15,7 +18,9 @@
 #include <time.h>
 
 #include "../assert.h"
+#include "../checkpoint.h"
 #include "../fault.h"
+#include "../main.h"
 #include "../utils.h"
 #include "dcycle.h"
 #include "device.h"
@@ -28,9 +33,21 @@
 /** Instance data structure */
 typedef struct {
     ptr36_t addr;
-    uint64_t cycle;
+    /** Machine cycle at which the device was added */
+    uint64_t start;
 } dcycle_data_t;
 
+/** Number of machine cycles since the device was added
+ *
+ * The counter is derived from the global cycle counter, so the device
+ * does not need to be stepped.
+ *
+ */
+static uint64_t dcycle_cycles(dcycle_data_t *data)
+{
+    return steps - data->start;
+}
+
 /** Init command implementation
  *
  * @param parm Command-line parameters
@@ -67,7 +84,9 @@ static bool dcycle_init(token_t *parm, device_t *dev)
     dev->data = data;
 
     data->addr = addr;
-    data->cycle = 0;
+    data->start = steps;
+
+    dev_map(dev, addr, REGISTER_LIMIT);
 
     return true;
 }
@@ -103,7 +122,7 @@ static bool dcycle_stat(token_t *parm, device_t *dev)
     dcycle_data_t *data = (dcycle_data_t *) dev->data;
 
     printf("[cycle              ]\n");
-    printf("%20" PRIu64 "\n", data->cycle);
+    printf("%20" PRIu64 "\n", dcycle_cycles(data));
 
     return true;
 }
@@ -134,10 +153,10 @@ static void dcycle_read32(unsigned int procno, device_t *dev, ptr36_t addr, uint
 
     switch (addr - data->addr) {
     case REGISTER_CYCLE_LO:
-        *val = (uint32_t) data->cycle;
+        *val = (uint32_t) dcycle_cycles(data);
         break;
     case REGISTER_CYCLE_HI:
-        *val = (uint32_t) (data->cycle >> 32);
+        *val = (uint32_t) (dcycle_cycles(data) >> 32);
         break;
     }
 }
@@ -158,20 +177,30 @@ static void dcycle_read64(unsigned int procno, device_t *dev, ptr36_t addr, uint
 
     switch (addr - data->addr) {
     case REGISTER_CYCLE_LO:
-        *val = data->cycle;
+        *val = dcycle_cycles(data);
         break;
     }
 }
 
-/** Cycle device implementation
+/** Save the device state into a checkpoint
+ *
+ * The machine cycle counter is restored together with the start,
+ * so the counter reads the same after the restore.
  *
  */
-static void dcycle_step(device_t *dev)
+static bool dcycle_save(device_t *dev, checkpoint_t *ckpt)
 {
-    ASSERT(dev != NULL);
+    dcycle_data_t *data = (dcycle_data_t *) dev->data;
+
+    return checkpoint_write_var(ckpt, data->start);
+}
 
+/** Load the device state from a checkpoint */
+static bool dcycle_load(device_t *dev, checkpoint_t *ckpt)
+{
     dcycle_data_t *data = (dcycle_data_t *) dev->data;
-    data->cycle++;
+
+    return checkpoint_read_var(ckpt, data->start);
 }
 
 static cmd_t dcycle_cmds[] = {
@@ -220,8 +249,11 @@ device_type_t dcycle = {
     .done = dcycle_done,
     .read32 = dcycle_read32,
     .read64 = dcycle_read64,
-    .step = dcycle_step,
 
     /* Commands */
-    .cmds = dcycle_cmds
+    .cmds = dcycle_cmds,
+
+    /* Checkpoints */
+    .save = dcycle_save,
+    .load = dcycle_load
 };
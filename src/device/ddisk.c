@@ -11,6 +11,7 @@
 
 #include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -18,13 +19,18 @@
 #include <sys/types.h>
 
 #include "../arch/mmap.h"
+#include "../assert.h"
+#include "../checkpoint.h"
+#include "../debug/statsrv.h"
 #include "../fault.h"
 #include "../main.h"
 #include "../physmem.h"
+#include "../replay.h"
 #include "../text.h"
 #include "../utils.h"
 #include "cpu/general_cpu.h"
 #include "ddisk.h"
+#include "dplic.h"
 
 /** Actions the disk is performing */
 enum action_e {
@@ -43,6 +49,10 @@ enum action_e {
 #define REGISTER_SECNO_HI 20 /**< Reserved for future extension */
 #define REGISTER_SIZE_HI 24 /**< Disk size in bytes (bits 32 .. 63) */
 #define REGISTER_LIMIT 28 /**< Size of register block */
+#define REGISTER_COUNT 28 /**< Number of sectors or descriptors (extended) */
+#define REGISTER_DESC_LO 32 /**< Descriptor list address (bits 0 .. 31, extended) */
+#define REGISTER_DESC_HI 36 /**< Descriptor list address (bits 32 .. 35, extended) */
+#define REGISTER_EXT_LIMIT 40 /**< Size of extended register block */
 /* \} */
 
 /** \{ \name Status flags */
@@ -55,36 +65,99 @@ enum action_e {
 #define COMMAND_READ 0x01 /**< Read */
 #define COMMAND_WRITE 0x02 /**< Write */
 #define COMMAND_INT_ACK 0x04 /**< Interrupt acknowledge */
-#define COMMAND_MASK 0x07 /**< Command mask */
+#define COMMAND_SG 0x08 /**< Use the descriptor list (extended) */
+#define COMMAND_MASK 0x0f /**< Command mask */
+/* \} */
+
+/** Words in a sector */
+#define SECTOR_WORDS 128
+
+/** Size of an extent of a memory disk
+ *
+ * The loaded image is read and the changes are saved by extents.
+ */
+#define EXTENT_SIZE (64 * 1024)
+
+/** \{ \name Extent flags */
+#define EXTENT_PENDING 0x01 /**< To be read from the loaded image */
+#define EXTENT_DIRTY 0x02 /**< Changed since the last load or save */
+/* \} */
+
+/** Default latency of a fast sector transfer (in cycles)
+ *
+ * Completes a sector in the same time as the word by word transfer.
+ */
+#define DEFAULT_FAST_LATENCY SECTOR_WORDS
+
+/** Cycles between the checks of a transfer waiting for the host I/O */
+#define HOST_IO_POLL 16
+
+/** Step of the pages touched by the host I/O of a file-mapped disk */
+#define HOST_IO_PAGE 4096
+
+/** \{ \name Scatter-gather descriptor (32 bit words) */
+#define DESC_ADDR_LO 0 /**< Memory address (bits 0 .. 31) */
+#define DESC_ADDR_HI 1 /**< Memory address (bits 32 .. 35) */
+#define DESC_SECNO 2 /**< First sector number */
+#define DESC_COUNT 3 /**< Number of sectors */
+#define DESC_WORDS 4 /**< Size of a descriptor */
 /* \} */
 
 /** Disk types */
 enum disk_type_e {
     DISKT_NONE, /**< Uninitialized */
     DISKT_MEM, /**< Memory-only disk */
-    DISKT_FMAP /**< File-mapped */
+    DISKT_FMAP, /**< File-mapped */
+    DISKT_FMAP_COW /**< File-mapped copy-on-write */
 };
 
 /** Disk instance data structure */
 typedef struct {
     uint32_t *img; /**< Disk image memory */
 
+    /* Extents of a memory disk (see ddisk_touch(), NULL for file-mapped disks) */
+    uint8_t *extents; /**< Extent flags */
+    FILE *image; /**< Loaded image the pending extents are read from */
+    uint64_t image_size; /**< Size of the loaded image */
+    char *sync_path; /**< File the clean extents match (last load or save) */
+
     /* Configuration */
     unsigned int intno; /**< Interrupt number */
+    device_t *plic; /**< Interrupt controller the interrupt is routed to */
+    unsigned int plic_source; /**< Source number within the controller */
     enum disk_type_e disk_type; /**< Disk type: none, memory, file-mapped */
     ptr36_t addr; /**< Disk memory location */
     uint64_t size; /**< Disk size */
+    bool fast; /**< Transfer whole sectors at once */
+    uint64_t latency; /**< Cycles taken by a fast sector transfer */
+    bool extended; /**< Extended registers are mapped */
+
+    /* Host I/O of the current run done in the background (see ddisk_io_submit()) */
+    pthread_t io_thread; /**< Worker thread (started by the first run) */
+    bool io_worker; /**< Worker thread started */
+    pthread_mutex_t io_mutex; /**< Guards io_busy and io_quit */
+    pthread_cond_t io_cond; /**< Signals a submitted or finished run */
+    bool io_busy; /**< The worker is reading the run */
+    bool io_quit; /**< The worker should terminate */
+    uint64_t io_offset; /**< Start of the run */
+    uint64_t io_len; /**< Length of the run */
+    uint64_t io_fetched; /**< Extents read by the worker (not counted yet) */
 
     /* Registers */
     ptr36_t disk_ptr; /**< Current DMA pointer */
     uint32_t disk_secno; /**< Active sector to read/write */
     uint32_t disk_status; /**< Disk status register */
     uint32_t disk_command; /**< Disk command register */
+    uint32_t disk_count; /**< Sector/descriptor count register */
+    ptr36_t disk_desc; /**< Descriptor list address register */
 
     /* Current action variables */
     enum action_e action; /**< Action type */
     size_t secno; /**< Sector number */
     size_t cnt; /**< Word counter */
+    size_t sectors; /**< Sectors left in the current run */
+    ptr36_t desc_ptr; /**< Next descriptor */
+    size_t descs; /**< Descriptors left */
     bool ig; /**< Interrupt pending flag */
 
     /* Statistics */
@@ -92,8 +165,363 @@ typedef struct {
     uint64_t cmds_read; /**< Number of read commands */
     uint64_t cmds_write; /**< Number of write commands */
     uint64_t cmds_error; /**< Number of illegal commands */
+    uint64_t extents_read; /**< Extents read from the loaded image */
+    uint64_t extents_written; /**< Extents written by save */
+    uint64_t io_runs; /**< Runs read by the worker */
+    uint64_t io_delays; /**< Transfers postponed by the host I/O */
+    unsigned int io_replay; /**< Source of the postponements in the replay log */
 } disk_data_s;
 
+/** Number of the extents of a disk
+ *
+ * @param size Disk size
+ *
+ */
+static size_t ddisk_extent_count(uint64_t size)
+{
+    return (size + EXTENT_SIZE - 1) / EXTENT_SIZE;
+}
+
+/** Size of an extent (the last one can be shorter)
+ *
+ * @param data   Disk instance data structure
+ * @param extent Extent number
+ *
+ */
+static size_t ddisk_extent_size(disk_data_s *data, size_t extent)
+{
+    uint64_t offset = (uint64_t) extent * EXTENT_SIZE;
+    return (data->size - offset < EXTENT_SIZE) ? data->size - offset : EXTENT_SIZE;
+}
+
+/** Close the loaded image
+ *
+ * The pending extents have to be read or overwritten first.
+ *
+ * @param data Disk instance data structure
+ *
+ */
+static void ddisk_image_close(disk_data_s *data)
+{
+    if (data->image != NULL) {
+        safe_fclose(data->image, data->sync_path);
+        data->image = NULL;
+    }
+
+    data->image_size = 0;
+}
+
+/** Read a pending extent from the loaded image
+ *
+ * Only the part covered by the image is read, the rest
+ * of the extent keeps its content. The file offset is not
+ * used, so processes forked by the batch mode can share
+ * the image.
+ *
+ * @param data   Disk instance data structure
+ * @param extent Extent number
+ *
+ */
+static void ddisk_extent_fetch(disk_data_s *data, size_t extent)
+{
+    uint64_t offset = (uint64_t) extent * EXTENT_SIZE;
+    size_t len = (data->image_size - offset < EXTENT_SIZE)
+            ? data->image_size - offset
+            : EXTENT_SIZE;
+    uint8_t *dst = ((uint8_t *) data->img) + offset;
+
+#ifdef __WIN32__
+    bool ok = (fseek(data->image, offset, SEEK_SET) == 0)
+            && (fread(dst, 1, len, data->image) == len);
+#else
+    bool ok = pread(fileno(data->image), dst, len, offset) == (ssize_t) len;
+#endif
+
+    if (!ok) {
+        io_error(data->sync_path);
+        error("%s", txt_file_read_err);
+    }
+
+    data->extents[extent] &= ~EXTENT_PENDING;
+    data->extents_read++;
+}
+
+/** Test whether a run needs any host I/O
+ *
+ * Memory disks read only their pending extents, file-mapped
+ * disks may fault any page of the run in.
+ *
+ * @param data   Disk instance data structure
+ * @param offset Start of the run
+ * @param len    Length of the run (non-zero)
+ *
+ */
+static bool ddisk_io_needed(disk_data_s *data, uint64_t offset, uint64_t len)
+{
+    if (data->extents == NULL) {
+        return true;
+    }
+
+#ifdef __WIN32__
+    /* The image is read by its file offset */
+    return false;
+#else
+    size_t last = (offset + len - 1) / EXTENT_SIZE;
+
+    for (size_t extent = offset / EXTENT_SIZE; extent <= last; extent++) {
+        if ((data->extents[extent] & EXTENT_PENDING) != 0) {
+            return true;
+        }
+    }
+
+    return false;
+#endif
+}
+
+/** Read the submitted run into the host memory
+ *
+ * Runs in the worker thread. The pending extents of a memory
+ * disk are read from the loaded image, the pages of a file-mapped
+ * disk are faulted in. The extents which fail to read stay pending,
+ * so the error is reported by the simulation once they are accessed.
+ *
+ * @param data Disk instance data structure
+ *
+ */
+static void ddisk_io_run(disk_data_s *data)
+{
+    uint64_t end = data->io_offset + data->io_len;
+
+    if (data->extents == NULL) {
+        volatile uint8_t *img = (volatile uint8_t *) data->img;
+        uint8_t sum = 0;
+
+        for (uint64_t offset = ALIGN_DOWN(data->io_offset, HOST_IO_PAGE);
+                offset < end; offset += HOST_IO_PAGE) {
+            sum += img[offset];
+        }
+
+        (void) sum;
+        return;
+    }
+
+#ifndef __WIN32__
+    size_t last = (end - 1) / EXTENT_SIZE;
+
+    for (size_t extent = data->io_offset / EXTENT_SIZE; extent <= last;
+            extent++) {
+        if ((data->extents[extent] & EXTENT_PENDING) == 0) {
+            continue;
+        }
+
+        uint64_t offset = (uint64_t) extent * EXTENT_SIZE;
+        size_t len = (data->image_size - offset < EXTENT_SIZE)
+                ? data->image_size - offset
+                : EXTENT_SIZE;
+        uint8_t *dst = ((uint8_t *) data->img) + offset;
+
+        if (pread(fileno(data->image), dst, len, offset) == (ssize_t) len) {
+            data->extents[extent] &= ~EXTENT_PENDING;
+            data->io_fetched++;
+        }
+    }
+#endif
+}
+
+/** Worker thread of the host I/O
+ *
+ * @param arg Disk instance data structure
+ *
+ */
+static void *ddisk_io_worker(void *arg)
+{
+    disk_data_s *data = (disk_data_s *) arg;
+
+    pthread_mutex_lock(&data->io_mutex);
+
+    while (true) {
+        while ((!data->io_busy) && (!data->io_quit)) {
+            pthread_cond_wait(&data->io_cond, &data->io_mutex);
+        }
+
+        if (data->io_quit) {
+            break;
+        }
+
+        pthread_mutex_unlock(&data->io_mutex);
+        ddisk_io_run(data);
+        pthread_mutex_lock(&data->io_mutex);
+
+        data->io_busy = false;
+        pthread_cond_broadcast(&data->io_cond);
+    }
+
+    pthread_mutex_unlock(&data->io_mutex);
+    return NULL;
+}
+
+/** Test whether the worker has finished the submitted run
+ *
+ * @param data Disk instance data structure
+ *
+ */
+static bool ddisk_io_done(disk_data_s *data)
+{
+    if (!data->io_worker) {
+        return true;
+    }
+
+    pthread_mutex_lock(&data->io_mutex);
+    bool busy = data->io_busy;
+    pthread_mutex_unlock(&data->io_mutex);
+
+    return !busy;
+}
+
+/** Wait for the worker to finish the submitted run
+ *
+ * The disk image (and its extent flags) is shared with the worker
+ * while a run is being read, so everything accessing the image
+ * has to wait first.
+ *
+ * @param data Disk instance data structure
+ *
+ */
+static void ddisk_io_wait(disk_data_s *data)
+{
+    if (!data->io_worker) {
+        return;
+    }
+
+    pthread_mutex_lock(&data->io_mutex);
+
+    while (data->io_busy) {
+        pthread_cond_wait(&data->io_cond, &data->io_mutex);
+    }
+
+    pthread_mutex_unlock(&data->io_mutex);
+
+    data->extents_read += data->io_fetched;
+    data->io_fetched = 0;
+}
+
+/** Submit the host I/O of a run to the worker
+ *
+ * The run is read while the machine keeps running, so a page cache
+ * miss on the host does not stop the simulation. If the worker
+ * cannot be started, the run is read once it is transferred.
+ *
+ * @param data   Disk instance data structure
+ * @param offset Start of the run
+ * @param len    Length of the run (non-zero)
+ *
+ */
+static void ddisk_io_submit(disk_data_s *data, uint64_t offset, uint64_t len)
+{
+    ddisk_io_wait(data);
+
+    if (!ddisk_io_needed(data, offset, len)) {
+        return;
+    }
+
+    if (!data->io_worker) {
+        data->io_quit = false;
+        data->io_busy = false;
+
+        if (pthread_create(&data->io_thread, NULL, ddisk_io_worker, data) != 0) {
+            return;
+        }
+
+        data->io_worker = true;
+    }
+
+    data->io_offset = offset;
+    data->io_len = len;
+    data->io_runs++;
+
+    pthread_mutex_lock(&data->io_mutex);
+    data->io_busy = true;
+    pthread_cond_broadcast(&data->io_cond);
+    pthread_mutex_unlock(&data->io_mutex);
+}
+
+/** Terminate the worker thread
+ *
+ * @param data Disk instance data structure
+ *
+ */
+static void ddisk_io_stop(disk_data_s *data)
+{
+    if (!data->io_worker) {
+        return;
+    }
+
+    pthread_mutex_lock(&data->io_mutex);
+    data->io_quit = true;
+    pthread_cond_broadcast(&data->io_cond);
+    pthread_mutex_unlock(&data->io_mutex);
+
+    pthread_join(data->io_thread, NULL);
+    data->io_worker = false;
+
+    data->extents_read += data->io_fetched;
+    data->io_fetched = 0;
+}
+
+/** Prepare a part of a memory disk for an access
+ *
+ * The pending extents of the part are read from the loaded image,
+ * written extents are marked dirty for the next save. Does nothing
+ * for file-mapped disks.
+ *
+ * @param data   Disk instance data structure
+ * @param offset Start of the part
+ * @param len    Length of the part (non-zero)
+ * @param write  The part is going to be written
+ *
+ */
+static void ddisk_touch(disk_data_s *data, uint64_t offset, uint64_t len,
+        bool write)
+{
+    ddisk_io_wait(data);
+
+    if (data->extents == NULL) {
+        return;
+    }
+
+    size_t last = (offset + len - 1) / EXTENT_SIZE;
+
+    for (size_t extent = offset / EXTENT_SIZE; extent <= last; extent++) {
+        if ((data->extents[extent] & EXTENT_PENDING) != 0) {
+            ddisk_extent_fetch(data, extent);
+        }
+
+        if (write) {
+            data->extents[extent] |= EXTENT_DIRTY;
+        }
+    }
+}
+
+/** Mark the whole memory disk as overwritten
+ *
+ * Nothing is read from the loaded image any more
+ * and the next save writes the whole disk.
+ *
+ * @param data Disk instance data structure
+ *
+ */
+static void ddisk_overwritten(disk_data_s *data)
+{
+    ddisk_io_wait(data);
+
+    if (data->extents == NULL) {
+        return;
+    }
+
+    ddisk_image_close(data);
+    memset(data->extents, EXTENT_DIRTY, ddisk_extent_count(data->size));
+}
+
 /** Clean up old configuration
  *
  * @param data Disk instance data structure
@@ -105,19 +533,25 @@ static void ddisk_clean_up(disk_data_s *data)
     data->action = ACTION_NONE;
     data->disk_ptr = 0;
     data->cnt = 0;
+    ddisk_io_wait(data);
 
     /* Do the clean up */
     switch (data->disk_type) {
     case DISKT_NONE:
         break;
     case DISKT_MEM:
+        ddisk_image_close(data);
         safe_free(data->img);
+        safe_free(data->extents);
         break;
     case DISKT_FMAP:
+    case DISKT_FMAP_COW:
         try_munmap(data->img, data->size);
         break;
     }
 
+    safe_free(data->sync_path);
+
     data->size = 0;
     data->disk_type = DISKT_NONE;
 }
@@ -166,20 +600,51 @@ static bool ddisk_init(token_t *parm, device_t *dev)
     /* Basic structure inicialization */
     data->addr = addr;
     data->intno = _intno;
+    data->plic = NULL;
+    data->plic_source = 0;
     data->size = 0;
     data->disk_ptr = 0;
     data->disk_secno = 0;
     data->disk_status = 0;
     data->disk_command = 0;
+    data->disk_count = 0;
+    data->disk_desc = 0;
     data->img = (uint32_t *) MAP_FAILED;
+    data->extents = NULL;
+    data->image = NULL;
+    data->image_size = 0;
+    data->sync_path = NULL;
     data->action = ACTION_NONE;
     data->secno = 0;
     data->cnt = 0;
+    data->sectors = 0;
+    data->desc_ptr = 0;
+    data->descs = 0;
     data->ig = false;
     data->intrcount = 0;
     data->cmds_read = 0;
     data->cmds_write = 0;
+    data->cmds_error = 0;
+    data->extents_read = 0;
+    data->extents_written = 0;
     data->disk_type = DISKT_NONE;
+    data->fast = false;
+    data->latency = DEFAULT_FAST_LATENCY;
+    data->extended = false;
+    data->io_worker = false;
+    data->io_busy = false;
+    data->io_quit = false;
+    data->io_offset = 0;
+    data->io_len = 0;
+    data->io_fetched = 0;
+    data->io_runs = 0;
+    data->io_delays = 0;
+    data->io_replay = replay_source(dev->name);
+
+    pthread_mutex_init(&data->io_mutex, NULL);
+    pthread_cond_init(&data->io_cond, NULL);
+
+    dev_map(dev, addr, REGISTER_LIMIT);
 
     return true;
 }
@@ -208,6 +673,9 @@ static bool ddisk_info(token_t *parm, device_t *dev)
     case DISKT_FMAP:
         stype = "fmap";
         break;
+    case DISKT_FMAP_COW:
+        stype = "cow";
+        break;
     default:
         stype = "*";
     }
@@ -240,6 +708,12 @@ static bool ddisk_stat(token_t *parm, device_t *dev)
             data->intrcount, data->cmds_read + data->cmds_write + data->cmds_error);
     printf("%20" PRIu64 "%20" PRIu64 " %20" PRIu64 "\n",
             data->cmds_read, data->cmds_write, data->cmds_error);
+    printf("[extents read      ] [extents written   ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 "\n",
+            data->extents_read, data->extents_written);
+    printf("[host I/O runs     ] [host I/O delays   ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 "\n",
+            data->io_runs, data->io_delays);
 
     return true;
 }
@@ -278,8 +752,9 @@ static bool ddisk_generic(token_t *parm, device_t *dev)
        and break the current action */
     ddisk_clean_up(data);
 
-    data->img = (uint32_t *) safe_malloc(host_size);
-    memset(data->img, 0, host_size);
+    /* The untouched parts of the disk take no host memory */
+    data->img = (uint32_t *) safe_calloc(host_size);
+    data->extents = (uint8_t *) safe_calloc(ddisk_extent_count(size));
     data->size = size;
     data->disk_type = DISKT_MEM;
 
@@ -289,6 +764,8 @@ static bool ddisk_generic(token_t *parm, device_t *dev)
 /** Fmap command implementation
  *
  * Map the disk to a file. The allocated memory block is disposed.
+ * In the copy-on-write mode the writes are kept in private copies
+ * of the touched pages and the file is not modified.
  *
  * @param parm Command-line parameters
  * @param dev  Device instance structure
@@ -299,9 +776,21 @@ static bool ddisk_generic(token_t *parm, device_t *dev)
 static bool ddisk_fmap(token_t *parm, device_t *dev)
 {
     disk_data_s *data = (disk_data_s *) dev->data;
-    const char *const path = parm_str(parm);
+    const char *const path = parm_str_next(&parm);
+    bool cow = false;
+
+    if (parm_type(parm) != tt_end) {
+        const char *const mode = parm_str(parm);
+
+        if (strcmp(mode, "cow") != 0) {
+            error("Unknown mapping mode <%s> (use cow)", mode);
+            return false;
+        }
+
+        cow = true;
+    }
 
-    FILE *file = try_fopen(path, "rb+");
+    FILE *file = try_fopen(path, cow ? "rb" : "rb+");
     if (file == NULL) {
         return false;
     }
@@ -352,7 +841,8 @@ static bool ddisk_fmap(token_t *parm, device_t *dev)
         return false;
     }
 
-    void *ptr = mmap(0, fsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    void *ptr = mmap(0, fsize, PROT_READ | PROT_WRITE,
+            cow ? MAP_PRIVATE : MAP_SHARED, fd, 0);
 
     if (ptr == MAP_FAILED) {
         io_error(path);
@@ -367,7 +857,7 @@ static bool ddisk_fmap(token_t *parm, device_t *dev)
     /* Upgrade structures and reset the device */
     ddisk_clean_up(data);
     data->size = size;
-    data->disk_type = DISKT_FMAP;
+    data->disk_type = cow ? DISKT_FMAP_COW : DISKT_FMAP;
     data->img = (uint32_t *) ptr;
 
     return true;
@@ -416,13 +906,96 @@ static bool ddisk_fill(token_t *parm, device_t *dev)
         return false;
     }
 
+    ddisk_overwritten(data);
     memset(data->img, c, data->size);
     return true;
 }
 
+/** Make a file the loaded image of a memory disk
+ *
+ * The extents covered by the file become pending, the others are
+ * read from the previous image first. The extents the file does not
+ * cover completely are dirty (the file lacks a part of them).
+ *
+ * @param data  Disk instance data structure
+ * @param file  Opened image (kept open)
+ * @param fsize Size of the image
+ * @param path  Path of the image
+ *
+ */
+static void ddisk_load_extents(disk_data_s *data, FILE *file, size_t fsize,
+        const char *path)
+{
+    uint64_t covered = ALIGN_DOWN((uint64_t) fsize, EXTENT_SIZE);
+
+    if (covered < data->size) {
+        ddisk_touch(data, covered, data->size - covered, false);
+    }
+
+    ddisk_image_close(data);
+
+    safe_free(data->sync_path);
+
+    data->image = file;
+    data->image_size = fsize;
+    data->sync_path = safe_strdup(path);
+
+    size_t count = ddisk_extent_count(data->size);
+
+    for (size_t extent = 0; extent < count; extent++) {
+        uint64_t offset = (uint64_t) extent * EXTENT_SIZE;
+        uint64_t end = offset + ddisk_extent_size(data, extent);
+
+        data->extents[extent] = (offset < fsize) ? EXTENT_PENDING : 0;
+
+        if (end > fsize) {
+            data->extents[extent] |= EXTENT_DIRTY;
+        }
+    }
+}
+
+/** Load a gzip-compressed file to the disk image
+ *
+ * The file is decompressed straight into the disk image. The
+ * extents of a memory disk are read from the previous image first
+ * and the whole disk is dirty (there is no image to sync with).
+ *
+ * @param data Disk instance data structure
+ * @param path Path of the file
+ *
+ * @return True if successful
+ *
+ */
+static bool ddisk_load_gzip(disk_data_s *data, const char *path)
+{
+    if (data->extents != NULL) {
+        ddisk_touch(data, 0, data->size, true);
+        ddisk_image_close(data);
+    } else {
+        ddisk_io_wait(data);
+    }
+
+    size_t len;
+    if (!try_gzload(path, data->img, data->size, &len,
+                "File size exceeds disk size")) {
+        return false;
+    }
+
+    if (len == 0) {
+        error("Empty file");
+        return false;
+    }
+
+    return true;
+}
+
 /** Load command implementation
  *
  * Load the content of the file "filename" to the disk image.
+ * Files compressed by gzip are decompressed.
+ *
+ * The file is read into memory disks by extents on their first
+ * access, so it has to stay the same while the disk uses it.
  *
  * @param parm Command-line parameters
  * @param dev  Device instance structure
@@ -446,6 +1019,11 @@ static bool ddisk_load(token_t *parm, device_t *dev)
         return false;
     }
 
+    if (fgzipped(file)) {
+        safe_fclose(file, path);
+        return ddisk_load_gzip(data, path);
+    }
+
     /* File size test */
     if (!try_fseek(file, 0, SEEK_END, path)) {
         return false;
@@ -472,7 +1050,13 @@ static bool ddisk_load(token_t *parm, device_t *dev)
         return false;
     }
 
+    if (data->extents != NULL) {
+        ddisk_load_extents(data, file, fsize, path);
+        return true;
+    }
+
     /* Read the file directly */
+    ddisk_io_wait(data);
     size_t rd = fread(data->img, 1, fsize, file);
     if (rd != fsize) {
         io_error(path);
@@ -486,44 +1070,149 @@ static bool ddisk_load(token_t *parm, device_t *dev)
     return true;
 }
 
-/** Save command implementation
+/** Write the extents of a memory disk into a file
  *
- * Save the disk content to the file specified.
- *
- * @param parm Command-line parameters
- * @param dev  Device instance structure
+ * @param data  Disk instance data structure
+ * @param file  Opened file
+ * @param path  Path of the file
+ * @param dirty Write only the dirty extents (the file holds the rest),
+ *              otherwise the whole image is in memory
  *
  * @return True if successful
  *
  */
-static bool ddisk_save(token_t *parm, device_t *dev)
+static bool ddisk_save_extents(disk_data_s *data, FILE *file,
+        const char *path, bool dirty)
 {
-    disk_data_s *data = (disk_data_s *) dev->data;
-    const char *const path = parm_str(parm);
+    size_t count = ddisk_extent_count(data->size);
 
-    if (data->disk_type == DISKT_NONE) {
-        error("Disk not established");
-        return false;
-    }
+    if (!dirty) {
+        /* A new file, the blocks of zeros are left as holes */
+        if (!fwrite_sparse(file, data->img, data->size)) {
+            io_error(path);
+            error("%s", txt_file_write_err);
+            return false;
+        }
 
-    size_t host_size = (size_t) data->size;
+        for (size_t extent = 0; extent < count; extent++) {
+            data->extents[extent] &= ~EXTENT_DIRTY;
+        }
 
-    if (host_size != data->size) {
-        error("Incompatible host and guest disk sizes");
-        return false;
+        data->extents_written += count;
+        return true;
     }
 
-    /* Create file */
-    FILE *file = try_fopen(path, "wb");
-    if (file == NULL) {
-        io_error(path);
-        error("%s", txt_file_create_err);
-        return false;
+    for (size_t extent = 0; extent < count; extent++) {
+        if ((data->extents[extent] & EXTENT_DIRTY) == 0) {
+            continue;
+        }
+
+        uint64_t offset = (uint64_t) extent * EXTENT_SIZE;
+        size_t len = ddisk_extent_size(data, extent);
+
+        ddisk_touch(data, offset, len, false);
+
+        if ((!try_fseek(file, offset, SEEK_SET, path))
+                || (fwrite(((uint8_t *) data->img) + offset, 1, len, file) != len)) {
+            io_error(path);
+            error("%s", txt_file_write_err);
+            return false;
+        }
+
+        data->extents[extent] &= ~EXTENT_DIRTY;
+        data->extents_written++;
+    }
+
+    return true;
+}
+
+/** Save a memory disk
+ *
+ * @param data Disk instance data structure
+ * @param path Path of the file
+ *
+ * @return True if successful
+ *
+ */
+static bool ddisk_save_memory(disk_data_s *data, const char *path)
+{
+    bool same = (data->sync_path != NULL) && (strcmp(data->sync_path, path) == 0);
+    FILE *file = same ? fopen(path, "rb+") : NULL;
+
+    if (file == NULL) {
+        /* The file may be the loaded image, so the image is read first */
+        ddisk_touch(data, 0, data->size, false);
+        ddisk_image_close(data);
+
+        file = try_fopen(path, "wb");
+        if (file == NULL) {
+            io_error(path);
+            error("%s", txt_file_create_err);
+            return false;
+        }
+
+        same = false;
+    }
+
+    bool ok = ddisk_save_extents(data, file, path, same);
+    safe_fclose(file, path);
+
+    if (!ok) {
+        return false;
+    }
+
+    safe_free(data->sync_path);
+
+    data->sync_path = safe_strdup(path);
+    return true;
+}
+
+/** Save command implementation
+ *
+ * Save the disk content to the file specified.
+ *
+ * Memory disks saved into the file they were last loaded from or
+ * saved into write only the extents changed since then, the blocks
+ * of zeros of a new file are left as holes.
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool ddisk_save(token_t *parm, device_t *dev)
+{
+    disk_data_s *data = (disk_data_s *) dev->data;
+    const char *const path = parm_str(parm);
+
+    if (data->disk_type == DISKT_NONE) {
+        error("Disk not established");
+        return false;
+    }
+
+    size_t host_size = (size_t) data->size;
+
+    if (host_size != data->size) {
+        error("Incompatible host and guest disk sizes");
+        return false;
+    }
+
+    if (data->extents != NULL) {
+        return ddisk_save_memory(data, path);
+    }
+
+    /* Create file */
+    FILE *file = try_fopen(path, "wb");
+    if (file == NULL) {
+        io_error(path);
+        error("%s", txt_file_create_err);
+        return false;
     }
 
     /* Write data */
-    size_t wr = fwrite(data->img, 1, host_size, file);
-    if (wr != host_size) {
+    ddisk_io_wait(data);
+    if (!fwrite_sparse(file, data->img, host_size)) {
         io_error(path);
         error("%s", txt_file_write_err);
         safe_fclose(file, path);
@@ -535,6 +1224,152 @@ static bool ddisk_save(token_t *parm, device_t *dev)
     return true;
 }
 
+/** Timing command implementation
+ *
+ * Print or set the timing model of the transfers.
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool ddisk_timing(token_t *parm, device_t *dev)
+{
+    disk_data_s *data = (disk_data_s *) dev->data;
+
+    if (parm_type(parm) == tt_end) {
+        if (data->fast) {
+            printf("Transfer timing: fast, one sector per %" PRIu64 " cycles\n",
+                    data->latency);
+        } else {
+            printf("Transfer timing: word, one word per cycle\n");
+        }
+
+        return true;
+    }
+
+    const char *const model = parm_str_next(&parm);
+
+    if (strcmp(model, "word") == 0) {
+        if (parm_type(parm) != tt_end) {
+            error("Word timing has no latency");
+            return false;
+        }
+
+        data->fast = false;
+        return true;
+    }
+
+    if (strcmp(model, "fast") != 0) {
+        error("Unknown timing model <%s> (use word or fast)", model);
+        return false;
+    }
+
+    uint64_t latency = DEFAULT_FAST_LATENCY;
+
+    if (parm_type(parm) != tt_end) {
+        latency = parm_uint(parm);
+    }
+
+    data->fast = true;
+    data->latency = latency;
+    return true;
+}
+
+/** Extended command implementation
+ *
+ * Print or set whether the extended registers (sector count
+ * and scatter-gather descriptor list) are mapped after
+ * the basic register block.
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool ddisk_extended(token_t *parm, device_t *dev)
+{
+    disk_data_s *data = (disk_data_s *) dev->data;
+
+    if (parm_type(parm) == tt_end) {
+        printf("Extended registers: %s\n",
+                data->extended ? "enabled" : "disabled");
+        return true;
+    }
+
+    const char *const state = parm_str(parm);
+    bool extended;
+
+    if (strcmp(state, "on") == 0) {
+        extended = true;
+    } else if (strcmp(state, "off") == 0) {
+        extended = false;
+    } else {
+        error("Unknown state <%s> (use on or off)", state);
+        return false;
+    }
+
+    if ((extended) && (!phys_range(data->addr + (uint64_t) REGISTER_EXT_LIMIT))) {
+        error("Invalid address, registers would exceed the physical "
+              "memory range");
+        return false;
+    }
+
+    data->extended = extended;
+    data->disk_count = 0;
+    data->disk_desc = 0;
+
+    dev_unmap(dev);
+    dev_map(dev, data->addr, extended ? REGISTER_EXT_LIMIT : REGISTER_LIMIT);
+
+    return true;
+}
+
+/** Route command implementation
+ *
+ * Print or set the interrupt controller the disk interrupt is routed
+ * to. A raised interrupt moves to the new route.
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool ddisk_route(token_t *parm, device_t *dev)
+{
+    disk_data_s *data = (disk_data_s *) dev->data;
+
+    if (parm_type(parm) == tt_end) {
+        if (data->plic == NULL) {
+            printf("Interrupt: %u\n", data->intno);
+        } else {
+            printf("Interrupt: source %u of %s\n", data->plic_source,
+                    data->plic->name);
+        }
+        return true;
+    }
+
+    device_t *plic;
+    unsigned int source;
+
+    if (!plic_route(parm, &plic, &source)) {
+        return false;
+    }
+
+    if (data->ig) {
+        plic_interrupt_down(data->plic, data->plic_source, data->intno);
+        plic_interrupt_up(plic, source, data->intno);
+    }
+
+    data->plic = plic;
+    data->plic_source = source;
+
+    return true;
+}
+
 /** Dispose disk
  *
  * @param dev Device pointer
@@ -545,6 +1380,9 @@ static void ddisk_done(device_t *dev)
     disk_data_s *data = (disk_data_s *) dev->data;
 
     ddisk_clean_up(data);
+    ddisk_io_stop(data);
+    pthread_cond_destroy(&data->io_cond);
+    pthread_mutex_destroy(&data->io_mutex);
     safe_free(dev->data);
 }
 
@@ -588,6 +1426,322 @@ static void ddisk_read32(unsigned int procno, device_t *dev, ptr36_t addr,
     case REGISTER_SIZE_HI:
         *val = (uint32_t) (data->size >> 32);
         break;
+    case REGISTER_COUNT:
+        *val = data->disk_count;
+        break;
+    case REGISTER_DESC_LO:
+        *val = (uint32_t) (data->disk_desc & UINT32_C(0xffffffff));
+        break;
+    case REGISTER_DESC_HI:
+        *val = (uint32_t) (data->disk_desc >> 32);
+        break;
+    }
+}
+
+/** Finish the current action and raise the interrupt
+ *
+ * @param data Disk instance data structure
+ *
+ */
+static void ddisk_finish(disk_data_s *data)
+{
+    data->action = ACTION_NONE;
+    data->disk_status = STATUS_INT;
+    plic_interrupt_up(data->plic, data->plic_source, data->intno);
+    data->ig = true;
+    data->intrcount++;
+}
+
+/** Raise the error interrupt of a failed command
+ *
+ * @param data Disk instance data structure
+ *
+ */
+static void ddisk_error(disk_data_s *data)
+{
+    data->disk_status = STATUS_INT | STATUS_ERROR;
+    plic_interrupt_up(data->plic, data->plic_source, data->intno);
+    data->ig = true;
+    data->intrcount++;
+    data->cmds_error++;
+}
+
+/** Test whether a run of sectors lies within the disk
+ *
+ * @param data    Disk instance data structure
+ * @param secno   First sector of the run
+ * @param sectors Number of sectors of the run
+ *
+ */
+static bool ddisk_run_valid(disk_data_s *data, uint64_t secno, uint64_t sectors)
+{
+    return (sectors > 0) && ((secno + sectors) * 512 <= data->size);
+}
+
+/** Submit the host I/O of the current run
+ *
+ * @param data Disk instance data structure
+ *
+ */
+static void ddisk_run_submit(disk_data_s *data)
+{
+    ddisk_io_submit(data, data->secno * SECTOR_WORDS * sizeof(uint32_t),
+            data->sectors * SECTOR_WORDS * sizeof(uint32_t));
+}
+
+/** Test whether the host I/O of the current run allows a transfer
+ *
+ * In the non-deterministic mode a transfer whose sectors are still
+ * being read by the worker is postponed, so the completion depends
+ * on the later of the modelled latency and the host I/O. Otherwise
+ * the simulation waits for the worker to keep the timing reproducible.
+ * The replay postpones exactly the transfers postponed by the record.
+ *
+ * @param dev   Device pointer
+ * @param event Transfer event rescheduled if postponed
+ *
+ * @return False if the transfer has been postponed
+ *
+ */
+static bool ddisk_io_ready(device_t *dev, dev_event_fnc_t event)
+{
+    disk_data_s *data = (disk_data_s *) dev->data;
+
+    if ((machine_nondet)
+            && (replay_event(data->io_replay, !ddisk_io_done(data)))) {
+        data->io_delays++;
+        dev_schedule(dev, HOST_IO_POLL, event);
+        return false;
+    }
+
+    ddisk_io_wait(data);
+    return true;
+}
+
+/** Start the run of the next scatter-gather descriptor
+ *
+ * @param data Disk instance data structure
+ *
+ * @return False if the descriptor is invalid
+ *
+ */
+static bool ddisk_next_descriptor(disk_data_s *data)
+{
+    uint32_t desc[DESC_WORDS];
+
+    physmem_read_block32(-1 /*NULL*/, data->desc_ptr, desc, DESC_WORDS, true);
+    data->desc_ptr += sizeof(desc);
+    data->descs--;
+
+    if (!ddisk_run_valid(data, desc[DESC_SECNO], desc[DESC_COUNT])) {
+        return false;
+    }
+
+    data->disk_ptr = ((ptr36_t) desc[DESC_ADDR_HI] << 32) | desc[DESC_ADDR_LO];
+    data->secno = desc[DESC_SECNO];
+    data->sectors = desc[DESC_COUNT];
+    data->cnt = 0;
+
+    return true;
+}
+
+/** Advance the current action past a transferred sector
+ *
+ * The interrupt is raised once the whole batch (all sectors
+ * of all descriptors) is transferred.
+ *
+ * @param data Disk instance data structure
+ *
+ * @return True if there is another sector to transfer
+ *
+ */
+static bool ddisk_next_sector(disk_data_s *data)
+{
+    data->sectors--;
+
+    if (data->sectors > 0) {
+        data->secno++;
+        data->cnt = 0;
+        return true;
+    }
+
+    if (data->descs > 0) {
+        if (ddisk_next_descriptor(data)) {
+            ddisk_run_submit(data);
+            return true;
+        }
+
+        data->action = ACTION_NONE;
+        ddisk_error(data);
+        return false;
+    }
+
+    ddisk_finish(data);
+    return false;
+}
+
+/** Transfer one word of the current action
+ *
+ * Runs as a device event once per machine cycle
+ * while a read or write is in progress.
+ *
+ * @param dev Device pointer
+ *
+ */
+static void ddisk_transfer(device_t *dev)
+{
+    disk_data_s *data = (disk_data_s *) dev->data;
+    size_t pos;
+
+    // TODO: generate SC checks on changed mem registers?
+
+    if ((data->cnt == 0) && (data->action != ACTION_NONE)) {
+        if (!ddisk_io_ready(dev, ddisk_transfer)) {
+            return;
+        }
+
+        ddisk_touch(data, data->secno * SECTOR_WORDS * sizeof(uint32_t),
+                SECTOR_WORDS * sizeof(uint32_t), data->action == ACTION_WRITE);
+    }
+
+    /* Reading */
+    switch (data->action) {
+    case ACTION_READ:
+        pos = data->secno * SECTOR_WORDS + data->cnt;
+        physmem_write32(-1 /*NULL*/, data->disk_ptr, data->img[pos], true);
+
+        /* Next word */
+        data->disk_ptr += 4;
+        data->cnt++;
+        break;
+    case ACTION_WRITE:
+        pos = data->secno * SECTOR_WORDS + data->cnt;
+        data->img[pos] = physmem_read32(-1 /*NULL*/, data->disk_ptr, true);
+
+        /* Next word */
+        data->disk_ptr += 4;
+        data->cnt++;
+        break;
+    default:
+        /* No further processing */
+        return;
+    }
+
+    if ((data->cnt < SECTOR_WORDS) || (ddisk_next_sector(data))) {
+        dev_schedule(dev, 1, ddisk_transfer);
+    }
+}
+
+/** Transfer the whole sector of the current action
+ *
+ * Runs as a device event once the latency of a fast transfer
+ * elapses. The memory is accessed as a block, so breakpoints,
+ * reservations and decoded code are checked once per frame.
+ *
+ * @param dev Device pointer
+ *
+ */
+static void ddisk_transfer_sector(device_t *dev)
+{
+    disk_data_s *data = (disk_data_s *) dev->data;
+    uint32_t *sector = data->img + data->secno * SECTOR_WORDS;
+
+    if (data->action != ACTION_NONE) {
+        if (!ddisk_io_ready(dev, ddisk_transfer_sector)) {
+            return;
+        }
+
+        ddisk_touch(data, data->secno * SECTOR_WORDS * sizeof(uint32_t),
+                SECTOR_WORDS * sizeof(uint32_t), data->action == ACTION_WRITE);
+    }
+
+    switch (data->action) {
+    case ACTION_READ:
+        physmem_write_block32(-1 /*NULL*/, data->disk_ptr, sector,
+                SECTOR_WORDS, true);
+        break;
+    case ACTION_WRITE:
+        physmem_read_block32(-1 /*NULL*/, data->disk_ptr, sector,
+                SECTOR_WORDS, true);
+        break;
+    default:
+        /* No further processing */
+        return;
+    }
+
+    data->disk_ptr += SECTOR_WORDS * sizeof(uint32_t);
+    data->cnt = SECTOR_WORDS;
+
+    if (ddisk_next_sector(data)) {
+        dev_schedule(dev, data->latency, ddisk_transfer_sector);
+    }
+}
+
+/** Transfer sectors between the disk and the memory at once
+ *
+ * Used by the disk hypercalls, the sectors are moved without
+ * any timing, registers or interrupt of the disk.
+ *
+ * @param dev   Disk device
+ * @param secno First sector
+ * @param count Number of sectors
+ * @param addr  Physical address of the memory buffer
+ * @param write Write the sectors (read otherwise)
+ *
+ * @return False if the disk has no storage or the sectors are
+ *         out of its range
+ *
+ */
+bool ddisk_transfer_block(device_t *dev, uint64_t secno, uint64_t count,
+        ptr36_t addr, bool write)
+{
+    ASSERT(dev != NULL);
+    ASSERT(dev->type == &ddisk);
+
+    disk_data_s *data = (disk_data_s *) dev->data;
+    uint64_t sectors = data->size / (SECTOR_WORDS * sizeof(uint32_t));
+
+    if ((data->img == NULL) || (secno > sectors) || (count > sectors - secno)) {
+        return false;
+    }
+
+    if (count == 0) {
+        return true;
+    }
+
+    uint64_t offset = secno * SECTOR_WORDS * sizeof(uint32_t);
+    uint64_t len = count * SECTOR_WORDS * sizeof(uint32_t);
+    uint32_t *sectors_img = data->img + secno * SECTOR_WORDS;
+
+    ddisk_touch(data, offset, len, write);
+
+    if (write) {
+        physmem_read_block32(-1 /*NULL*/, addr, sectors_img,
+                count * SECTOR_WORDS, true);
+    } else {
+        physmem_write_block32(-1 /*NULL*/, addr, sectors_img,
+                count * SECTOR_WORDS, true);
+    }
+
+    return true;
+}
+
+/** Start the transfer of the current action
+ *
+ * @param dev Device pointer
+ *
+ */
+static void ddisk_start(device_t *dev)
+{
+    disk_data_s *data = (disk_data_s *) dev->data;
+
+    dev_cancel(dev);
+    ddisk_run_submit(data);
+
+    if (data->fast) {
+        dev_schedule(dev, data->latency, ddisk_transfer_sector);
+    } else {
+        dev_schedule(dev, 0, ddisk_transfer);
     }
 }
 
@@ -623,6 +1777,17 @@ static void ddisk_write32(unsigned int procno, device_t *dev, ptr36_t addr,
     case REGISTER_SECNO:
         data->disk_secno = val;
         break;
+    case REGISTER_COUNT:
+        data->disk_count = val;
+        break;
+    case REGISTER_DESC_LO:
+        data->disk_desc &= ~((ptr36_t) UINT32_C(0xffffffff));
+        data->disk_desc |= val;
+        break;
+    case REGISTER_DESC_HI:
+        data->disk_desc &= (ptr36_t) UINT32_C(0xffffffff);
+        data->disk_desc |= ((ptr36_t) val) << 32;
+        break;
     case REGISTER_COMMAND:
         /* Remove unused bits */
         data->disk_command = val & COMMAND_MASK;
@@ -631,105 +1796,203 @@ static void ddisk_write32(unsigned int procno, device_t *dev, ptr36_t addr,
         if (data->disk_command & COMMAND_INT_ACK) {
             data->disk_status &= ~STATUS_INT;
             data->ig = false;
-            cpu_interrupt_down(NULL, data->intno);
+            plic_interrupt_down(data->plic, data->plic_source, data->intno);
         }
 
         /* Check general errors */
         if ((data->disk_command & COMMAND_READ) && (data->disk_command & COMMAND_WRITE)) {
             /* Simultaneous read/write command */
-            data->disk_status = STATUS_INT | STATUS_ERROR;
-            cpu_interrupt_up(NULL, data->intno);
-            data->ig = true;
-            data->intrcount++;
-            data->cmds_error++;
+            ddisk_error(data);
             return;
         }
 
         if ((data->disk_command & (COMMAND_READ | COMMAND_WRITE)) && (data->action != ACTION_NONE)) {
             /* Command in progress */
-            data->disk_status = STATUS_INT | STATUS_ERROR;
-            cpu_interrupt_up(NULL, data->intno);
-            data->ig = true;
-            data->intrcount++;
-            data->cmds_error++;
+            ddisk_error(data);
             return;
         }
 
+        bool transfer = (data->disk_command & (COMMAND_READ | COMMAND_WRITE)) != 0;
+        bool sg = (data->extended) && (transfer) && (data->disk_command & COMMAND_SG);
+
         /* Check bound */
-        if (((uint64_t) data->disk_secno + 1) * 512 > data->size) {
-            /* Generate interrupt to indicate error */
-            data->disk_status = STATUS_INT | STATUS_ERROR;
-            cpu_interrupt_up(NULL, data->intno);
-            data->ig = true;
-            data->intrcount++;
-            data->cmds_error++;
-            return;
+        if (sg) {
+            /* The descriptors replace the address and sector registers */
+            data->desc_ptr = data->disk_desc;
+            data->descs = data->disk_count;
+
+            if ((data->descs == 0) || (!ddisk_next_descriptor(data))) {
+                /* Generate interrupt to indicate error */
+                ddisk_error(data);
+                return;
+            }
+        } else {
+            uint64_t sectors = ((data->extended) && (data->disk_count > 1))
+                    ? data->disk_count
+                    : 1;
+
+            if (!ddisk_run_valid(data, data->disk_secno, sectors)) {
+                /* Generate interrupt to indicate error */
+                ddisk_error(data);
+                return;
+            }
+
+            data->cnt = 0;
+            data->secno = data->disk_secno;
+            data->sectors = sectors;
+            data->descs = 0;
         }
 
         /* Read command */
         if (data->disk_command & COMMAND_READ) {
             /* Reading in progress */
             data->action = ACTION_READ;
-            data->cnt = 0;
-            data->secno = data->disk_secno;
             data->cmds_read++;
+            ddisk_start(dev);
         }
 
         /* Write command */
         if (data->disk_command & COMMAND_WRITE) {
             /* Writing in progress */
             data->action = ACTION_WRITE;
-            data->cnt = 0;
-            data->secno = data->disk_secno;
             data->cmds_write++;
+            ddisk_start(dev);
         }
 
         break;
     }
 }
 
-/** Disk implementation
+/** Save the disk state into a checkpoint
  *
- * @param dev Device pointer
+ * The configuration is kept, only the registers, the current action,
+ * the statistics and the touched sectors of the image are saved.
  *
  */
-static void ddisk_step(device_t *dev)
+static bool ddisk_checkpoint_save(device_t *dev, checkpoint_t *ckpt)
 {
     disk_data_s *data = (disk_data_s *) dev->data;
-    size_t pos;
+    uint64_t secno = data->secno;
+    uint64_t cnt = data->cnt;
+    uint64_t sectors = data->sectors;
+    uint64_t descs = data->descs;
 
-    // TODO: generate SC checks on changed mem registers?
+    if (data->disk_type != DISKT_NONE) {
+        ddisk_touch(data, 0, data->size, false);
+    }
 
-    /* Reading */
-    switch (data->action) {
-    case ACTION_READ:
-        pos = data->secno * 128 + data->cnt;
-        physmem_write32(-1 /*NULL*/, data->disk_ptr, data->img[pos], true);
+    return checkpoint_write_var(ckpt, data->size)
+            && checkpoint_write_var(ckpt, data->disk_ptr)
+            && checkpoint_write_var(ckpt, data->disk_secno)
+            && checkpoint_write_var(ckpt, data->disk_status)
+            && checkpoint_write_var(ckpt, data->disk_command)
+            && checkpoint_write_var(ckpt, data->disk_count)
+            && checkpoint_write_var(ckpt, data->disk_desc)
+            && checkpoint_write_var(ckpt, data->action)
+            && checkpoint_write_uint64(ckpt, secno)
+            && checkpoint_write_uint64(ckpt, cnt)
+            && checkpoint_write_uint64(ckpt, sectors)
+            && checkpoint_write_var(ckpt, data->desc_ptr)
+            && checkpoint_write_uint64(ckpt, descs)
+            && checkpoint_write_var(ckpt, data->ig)
+            && checkpoint_write_var(ckpt, data->intrcount)
+            && checkpoint_write_var(ckpt, data->cmds_read)
+            && checkpoint_write_var(ckpt, data->cmds_write)
+            && checkpoint_write_var(ckpt, data->cmds_error)
+            && ((data->disk_type == DISKT_NONE)
+                    || checkpoint_write_pages(ckpt, (uint8_t *) data->img, data->size));
+}
 
-        /* Next word */
-        data->disk_ptr += 4;
-        data->cnt++;
-        break;
-    case ACTION_WRITE:
-        pos = data->secno * 128 + data->cnt;
-        data->img[pos] = physmem_read32(-1 /*NULL*/, data->disk_ptr, true);
+/** Prepare the disk state to be saved by a forked process
+ *
+ * The pending extents are read now, so that the forked process does
+ * not need the I/O worker. A disk mapped to a file without the
+ * copy-on-write is shared with the file and cannot be saved so.
+ *
+ */
+static bool ddisk_prefork(device_t *dev)
+{
+    disk_data_s *data = (disk_data_s *) dev->data;
 
-        /* Next word */
-        data->disk_ptr += 4;
-        data->cnt++;
-        break;
-    default:
-        /* No further processing */
-        return;
+    if (data->disk_type == DISKT_FMAP) {
+        return false;
     }
 
-    if (data->cnt == 128) {
-        data->action = ACTION_NONE;
-        data->disk_status = STATUS_INT;
-        cpu_interrupt_up(NULL, data->intno);
-        data->ig = true;
-        data->intrcount++;
+    if (data->disk_type != DISKT_NONE) {
+        ddisk_touch(data, 0, data->size, false);
     }
+
+    return true;
+}
+
+/** Load the disk state from a checkpoint
+ *
+ */
+static bool ddisk_checkpoint_load(device_t *dev, checkpoint_t *ckpt)
+{
+    disk_data_s *data = (disk_data_s *) dev->data;
+    uint64_t size;
+    uint64_t secno;
+    uint64_t cnt;
+    uint64_t sectors;
+    uint64_t descs;
+
+    if ((!checkpoint_read_uint64(ckpt, &size)) || (size != data->size)) {
+        return false;
+    }
+
+    if (!checkpoint_read_var(ckpt, data->disk_ptr)
+            || !checkpoint_read_var(ckpt, data->disk_secno)
+            || !checkpoint_read_var(ckpt, data->disk_status)
+            || !checkpoint_read_var(ckpt, data->disk_command)
+            || !checkpoint_read_var(ckpt, data->disk_count)
+            || !checkpoint_read_var(ckpt, data->disk_desc)
+            || !checkpoint_read_var(ckpt, data->action)
+            || !checkpoint_read_uint64(ckpt, &secno)
+            || !checkpoint_read_uint64(ckpt, &cnt)
+            || !checkpoint_read_uint64(ckpt, &sectors)
+            || !checkpoint_read_var(ckpt, data->desc_ptr)
+            || !checkpoint_read_uint64(ckpt, &descs)
+            || !checkpoint_read_var(ckpt, data->ig)
+            || !checkpoint_read_var(ckpt, data->intrcount)
+            || !checkpoint_read_var(ckpt, data->cmds_read)
+            || !checkpoint_read_var(ckpt, data->cmds_write)
+            || !checkpoint_read_var(ckpt, data->cmds_error)) {
+        return false;
+    }
+
+    data->secno = secno;
+    data->cnt = cnt;
+    data->sectors = sectors;
+    data->descs = descs;
+
+    if (data->disk_type == DISKT_NONE) {
+        return true;
+    }
+
+    ddisk_overwritten(data);
+    memset(data->img, 0, data->size);
+    return checkpoint_read_pages(ckpt, (uint8_t *) data->img, data->size);
+}
+
+/** Events scheduled by the disk */
+static const dev_event_fnc_t ddisk_events[] = {
+    ddisk_transfer,
+    ddisk_transfer_sector,
+    NULL
+};
+
+/** Export the disk counters to the statistics endpoint
+ *
+ */
+static void ddisk_stats(device_t *dev, statsrv_t *stats)
+{
+    disk_data_s *data = (disk_data_s *) dev->data;
+
+    statsrv_counter(stats, "disk_interrupts_total", "Interrupts of the disk",
+            data->intrcount);
+    statsrv_counter(stats, "disk_commands_total", "Commands of the disk",
+            data->cmds_read + data->cmds_write + data->cmds_error);
 }
 
 cmd_t ddisk_cmds[] = {
@@ -775,8 +2038,9 @@ cmd_t ddisk_cmds[] = {
             DEFAULT,
             DEFAULT,
             "Map the memory as the file specified",
-            "Map the memory as the file specified",
-            REQ STR "fname/file name" END },
+            "Map the memory as the file specified. With the cow mode the writes are kept private and the file is not modified.",
+            REQ STR "fname/file name" NEXT
+                    OPT STR "mode/cow" END },
     { "fill",
             (fcmd_t) ddisk_fill,
             DEFAULT,
@@ -789,15 +2053,38 @@ cmd_t ddisk_cmds[] = {
             DEFAULT,
             DEFAULT,
             "Load the memory image from the file specified",
-            "Load the memory image from the file specified",
+            "Load the memory image from the file specified. A generic disk reads the file by extents on their first access.",
             REQ STR "fname/file name" END },
     { "save",
             (fcmd_t) ddisk_save,
             DEFAULT,
             DEFAULT,
             "Save the memory image into the file specified",
-            "Save the memory image into the file specified",
+            "Save the memory image into the file specified. A generic disk saved into the file it was last loaded from or saved to writes only the changed extents.",
             REQ STR "fname/file name" END },
+    { "extended",
+            (fcmd_t) ddisk_extended,
+            DEFAULT,
+            DEFAULT,
+            "Print or set the extended registers",
+            "Without arguments prints whether the extended registers are mapped. The extended registers add a sector count and a scatter-gather descriptor list so that a single command transfers several sectors with one completion interrupt.",
+            OPT STR "state/on or off" END },
+    { "route",
+            (fcmd_t) ddisk_route,
+            DEFAULT,
+            DEFAULT,
+            "Print or set the interrupt routing",
+            "Without arguments prints where the disk interrupt goes. With the name of a dplic device and a source number the interrupt is asserted as the source of the interrupt controller instead of the interrupt number of the first processor.",
+            OPT STR "plic/interrupt controller name" NEXT
+                    OPT INT "source/source number" END },
+    { "timing",
+            (fcmd_t) ddisk_timing,
+            DEFAULT,
+            DEFAULT,
+            "Print or set the transfer timing",
+            "Without arguments prints the transfer timing. The word timing moves one word per cycle, the fast timing moves the whole sector once the latency (in cycles) elapses.",
+            OPT STR "model/word or fast" NEXT
+                    OPT INT "latency/cycles per sector" END },
     LAST_CMD
 };
 
@@ -813,10 +2100,16 @@ device_type_t ddisk = {
 
     /* Functions */
     .done = ddisk_done,
-    .step = ddisk_step,
     .read32 = ddisk_read32,
     .write32 = ddisk_write32,
 
     /* Commands */
-    .cmds = ddisk_cmds
+    .cmds = ddisk_cmds,
+
+    /* Checkpoints */
+    .save = ddisk_checkpoint_save,
+    .load = ddisk_checkpoint_load,
+    .prefork = ddisk_prefork,
+    .events = ddisk_events,
+    .stats = ddisk_stats
 };
@@ -16,4 +16,7 @@
 
 extern device_type_t ddisk;
 
+extern bool ddisk_transfer_block(device_t *dev, uint64_t secno,
+        uint64_t count, ptr36_t addr, bool write);
+
 #endif
@@ -0,0 +1,637 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Memory-to-memory DMA engine device
+ *
+ *  The engine copies a block of the physical memory or fills it with
+ *  a repeated word, so that the guests do not spend the simulated and
+ *  the host time by loops of loads and stores. The transfer is a block
+ *  transfer of the physical memory (see physmem_write_block8()), the
+ *  reservations are broken and the decoded instructions invalidated once
+ *  per frame. The transfer completes after a latency modelled by a setup
+ *  time and a bandwidth, the completion is a device event (see
+ *  dev_schedule()) which moves the bytes and asserts the interrupt.
+ *
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../assert.h"
+#include "../checkpoint.h"
+#include "../debug/statsrv.h"
+#include "../endian.h"
+#include "../fault.h"
+#include "../main.h"
+#include "../physmem.h"
+#include "../text.h"
+#include "../utils.h"
+#include "ddma.h"
+#include "device.h"
+#include "dplic.h"
+
+/** \{ \name Register offsets */
+#define REGISTER_SRC_LO 0 /**< Source address (bits 0 .. 31) */
+#define REGISTER_SRC_HI 4 /**< Source address (bits 32 .. 35) */
+#define REGISTER_DST_LO 8 /**< Destination address (bits 0 .. 31) */
+#define REGISTER_DST_HI 12 /**< Destination address (bits 32 .. 35) */
+#define REGISTER_LENGTH 16 /**< Number of bytes */
+#define REGISTER_VALUE 20 /**< Word the fill repeats */
+#define REGISTER_STATUS 24 /**< Status */
+#define REGISTER_COMMAND 24 /**< Command */
+#define REGISTER_LIMIT 28 /**< Size of register block */
+/* \} */
+
+/** \{ \name Status flags */
+#define STATUS_BUSY 0x01 /**< Transfer in progress */
+#define STATUS_INT 0x04 /**< Interrupt pending */
+#define STATUS_ERROR 0x08 /**< Transfer error */
+/* \} */
+
+/** \{ \name Command flags */
+#define COMMAND_COPY 0x01 /**< Copy the source to the destination */
+#define COMMAND_FILL 0x02 /**< Fill the destination with the value */
+#define COMMAND_INT_ACK 0x04 /**< Interrupt acknowledge */
+/* \} */
+
+/** Default setup time of a transfer (in cycles) */
+#define DEFAULT_SETUP 16
+
+/** Default bandwidth (in bytes per cycle) */
+#define DEFAULT_BANDWIDTH 8
+
+/** Bytes moved through the host buffer at once (a multiple of 4) */
+#define DMA_CHUNK (64 * 1024)
+
+typedef struct {
+    ptr36_t addr; /**< Register address */
+    unsigned int intno; /**< Interrupt number */
+    device_t *plic; /**< Interrupt controller the interrupt is routed to */
+    unsigned int plic_source; /**< Source number within the controller */
+
+    uint64_t setup; /**< Cycles of a transfer before the first byte */
+    uint64_t bandwidth; /**< Bytes transferred per cycle */
+
+    ptr36_t src; /**< Source address register */
+    ptr36_t dst; /**< Destination address register */
+    uint32_t length; /**< Length register */
+    uint32_t value; /**< Fill value register */
+    uint32_t command; /**< Command of the transfer in progress */
+    bool busy; /**< Transfer in progress */
+    bool error; /**< The last transfer failed */
+    bool ig; /**< Interrupt pending flag */
+
+    uint64_t copies; /**< Number of the copies completed */
+    uint64_t fills; /**< Number of the fills completed */
+    uint64_t bytes; /**< Bytes transferred */
+    uint64_t errors; /**< Number of the failed commands */
+} dma_data_t;
+
+/** Check that a block lies in memory
+ *
+ * @param write The block has to be writable as well.
+ *
+ */
+static bool dma_block_valid(ptr36_t addr, uint64_t length, bool write)
+{
+    if ((length > 0) && (!phys_range(addr + length - 1))) {
+        return false;
+    }
+
+    uint64_t done = 0;
+
+    while (done < length) {
+        frame_t *frame = physmem_find_frame(addr + done);
+
+        if ((frame == NULL) || ((write) && (!frame->area->writable))) {
+            return false;
+        }
+
+        done += FRAME_SIZE - ((addr + done) & FRAME_MASK);
+    }
+
+    return true;
+}
+
+/** Copy the source block to the destination block
+ *
+ * Overlapping blocks are copied as by memmove().
+ *
+ */
+static void dma_copy(dma_data_t *data, uint8_t *buffer)
+{
+    bool backward = (data->dst > data->src) && (data->dst - data->src < data->length);
+    uint64_t done = 0;
+
+    while (done < data->length) {
+        uint64_t chunk = MIN(DMA_CHUNK, data->length - done);
+        uint64_t offset = backward ? data->length - done - chunk : done;
+
+        physmem_read_block8(-1 /*NULL*/, data->src + offset, buffer, chunk, true);
+        physmem_write_block8(-1 /*NULL*/, data->dst + offset, buffer, chunk, true);
+
+        done += chunk;
+    }
+}
+
+/** Fill the destination block with the value
+ *
+ * The bytes are those of the value stored by the processors
+ * at the aligned words.
+ *
+ */
+static void dma_fill(dma_data_t *data, uint8_t *buffer)
+{
+    uint32_t word = convert_uint32_t_endian(data->value);
+    const uint8_t *pattern = (const uint8_t *) &word;
+
+    for (size_t i = 0; i < DMA_CHUNK; i++) {
+        buffer[i] = pattern[(data->dst + i) & 3];
+    }
+
+    uint64_t done = 0;
+
+    while (done < data->length) {
+        uint64_t chunk = MIN(DMA_CHUNK, data->length - done);
+
+        physmem_write_block8(-1 /*NULL*/, data->dst + done, buffer, chunk, true);
+        done += chunk;
+    }
+}
+
+/** Complete the transfer in progress
+ *
+ * The bytes are moved and the interrupt is asserted.
+ *
+ */
+static void dma_complete(device_t *dev)
+{
+    dma_data_t *data = (dma_data_t *) dev->data;
+
+    ASSERT(data->busy);
+
+    uint8_t *buffer = (uint8_t *) safe_malloc(DMA_CHUNK);
+
+    if (data->command & COMMAND_COPY) {
+        dma_copy(data, buffer);
+        data->copies++;
+    } else {
+        dma_fill(data, buffer);
+        data->fills++;
+    }
+
+    safe_free(buffer);
+
+    data->bytes += data->length;
+    data->busy = false;
+
+    if (!data->ig) {
+        data->ig = true;
+        plic_interrupt_up(data->plic, data->plic_source, data->intno);
+    }
+}
+
+/** Start a transfer
+ *
+ * A command while a transfer is in progress and a command of blocks
+ * outside of the memory (or of an unwritable destination) fail, the
+ * interrupt is asserted at once then.
+ *
+ */
+static void dma_start(device_t *dev, uint32_t command)
+{
+    dma_data_t *data = (dma_data_t *) dev->data;
+
+    bool copy = (command & COMMAND_COPY) != 0;
+    bool valid = (!data->busy) && (copy != ((command & COMMAND_FILL) != 0))
+            && ((!copy) || (dma_block_valid(data->src, data->length, false)))
+            && (dma_block_valid(data->dst, data->length, true));
+
+    if (!valid) {
+        data->error = true;
+        data->errors++;
+
+        if (!data->ig) {
+            data->ig = true;
+            plic_interrupt_up(data->plic, data->plic_source, data->intno);
+        }
+
+        return;
+    }
+
+    data->command = command & (COMMAND_COPY | COMMAND_FILL);
+    data->busy = true;
+    data->error = false;
+
+    uint64_t cycles = data->setup
+            + (data->length + data->bandwidth - 1) / data->bandwidth;
+    dev_schedule(dev, cycles, dma_complete);
+}
+
+/** Init command implementation
+ *
+ */
+static bool ddma_init(token_t *parm, device_t *dev)
+{
+    parm_next(&parm);
+    uint64_t _addr = parm_uint_next(&parm);
+    uint64_t _intno = parm_uint_next(&parm);
+
+    if (!phys_range(_addr)) {
+        error("Physical memory address out of range");
+        return false;
+    }
+
+    if (!phys_range(_addr + (uint64_t) REGISTER_LIMIT)) {
+        error("Invalid address, registers would exceed the physical "
+              "memory range");
+        return false;
+    }
+
+    ptr36_t addr = _addr;
+
+    if (!ptr36_dword_aligned(addr)) {
+        error("Physical memory address must be 8-byte aligned");
+        return false;
+    }
+
+    if (_intno > MAX_INTRS) {
+        error("%s", txt_intnum_range);
+        return false;
+    }
+
+    dma_data_t *data = safe_malloc_t(dma_data_t);
+    dev->data = data;
+
+    data->addr = addr;
+    data->intno = _intno;
+    data->plic = NULL;
+    data->plic_source = 0;
+    data->setup = DEFAULT_SETUP;
+    data->bandwidth = DEFAULT_BANDWIDTH;
+    data->src = 0;
+    data->dst = 0;
+    data->length = 0;
+    data->value = 0;
+    data->command = 0;
+    data->busy = false;
+    data->error = false;
+    data->ig = false;
+    data->copies = 0;
+    data->fills = 0;
+    data->bytes = 0;
+    data->errors = 0;
+
+    dev_map(dev, addr, REGISTER_LIMIT);
+
+    return true;
+}
+
+/** Info command implementation
+ *
+ */
+static bool ddma_info(token_t *parm, device_t *dev)
+{
+    dma_data_t *data = (dma_data_t *) dev->data;
+
+    printf("[address ] [int] [setup   ] [bandwidth] [state   ] [ig]\n");
+    printf("%#11" PRIx64 " %-5u %-10" PRIu64 " %-11" PRIu64 " %-10s %u\n",
+            data->addr, data->intno, data->setup, data->bandwidth,
+            data->busy ? ((data->command & COMMAND_COPY) ? "copying" : "filling")
+                    : (data->error ? "error" : "idle"),
+            data->ig);
+
+    return true;
+}
+
+/** Stat command implementation
+ *
+ */
+static bool ddma_stat(token_t *parm, device_t *dev)
+{
+    dma_data_t *data = (dma_data_t *) dev->data;
+
+    printf("[copies            ] [fills             ] [bytes             ] [errors            ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n",
+            data->copies, data->fills, data->bytes, data->errors);
+
+    return true;
+}
+
+/** Latency command implementation
+ *
+ * Print or set the setup time and the bandwidth of the transfers.
+ * The transfer in progress keeps its latency.
+ *
+ */
+static bool ddma_latency(token_t *parm, device_t *dev)
+{
+    dma_data_t *data = (dma_data_t *) dev->data;
+
+    if (parm_type(parm) == tt_end) {
+        printf("Latency: %" PRIu64 " cycles and 1 cycle per %" PRIu64 " bytes\n",
+                data->setup, data->bandwidth);
+        return true;
+    }
+
+    uint64_t setup = parm_uint_next(&parm);
+    uint64_t bandwidth = data->bandwidth;
+
+    if (parm_type(parm) != tt_end) {
+        bandwidth = parm_uint(parm);
+
+        if (bandwidth == 0) {
+            error("Bandwidth must be at least one byte per cycle");
+            return false;
+        }
+    }
+
+    data->setup = setup;
+    data->bandwidth = bandwidth;
+
+    return true;
+}
+
+/** Route command implementation
+ *
+ * Print or set the interrupt controller the completion interrupt
+ * is routed to. A raised interrupt moves to the new route.
+ *
+ */
+static bool ddma_route(token_t *parm, device_t *dev)
+{
+    dma_data_t *data = (dma_data_t *) dev->data;
+
+    if (parm_type(parm) == tt_end) {
+        if (data->plic == NULL) {
+            printf("Interrupt: %u\n", data->intno);
+        } else {
+            printf("Interrupt: source %u of %s\n", data->plic_source,
+                    data->plic->name);
+        }
+        return true;
+    }
+
+    device_t *plic;
+    unsigned int source;
+
+    if (!plic_route(parm, &plic, &source)) {
+        return false;
+    }
+
+    if (data->ig) {
+        plic_interrupt_down(data->plic, data->plic_source, data->intno);
+        plic_interrupt_up(plic, source, data->intno);
+    }
+
+    data->plic = plic;
+    data->plic_source = source;
+
+    return true;
+}
+
+/** Clean up the device
+ *
+ */
+static void dma_done(device_t *dev)
+{
+    safe_free(dev->data);
+}
+
+static void dma_read32(unsigned int procno, device_t *dev, ptr36_t addr, uint32_t *val)
+{
+    ASSERT(dev != NULL);
+    ASSERT(val != NULL);
+
+    dma_data_t *data = (dma_data_t *) dev->data;
+
+    switch (addr - data->addr) {
+    case REGISTER_SRC_LO:
+        *val = (uint32_t) data->src;
+        break;
+    case REGISTER_SRC_HI:
+        *val = (uint32_t) (data->src >> 32);
+        break;
+    case REGISTER_DST_LO:
+        *val = (uint32_t) data->dst;
+        break;
+    case REGISTER_DST_HI:
+        *val = (uint32_t) (data->dst >> 32);
+        break;
+    case REGISTER_LENGTH:
+        *val = data->length;
+        break;
+    case REGISTER_VALUE:
+        *val = data->value;
+        break;
+    case REGISTER_STATUS:
+        *val = (data->busy ? STATUS_BUSY : 0) | (data->ig ? STATUS_INT : 0)
+                | (data->error ? STATUS_ERROR : 0);
+        break;
+    }
+}
+
+/** Write a register
+ *
+ * The transfer registers are not changed while a transfer
+ * is in progress.
+ *
+ */
+static void dma_write32(unsigned int procno, device_t *dev, ptr36_t addr, uint32_t val)
+{
+    ASSERT(dev != NULL);
+
+    dma_data_t *data = (dma_data_t *) dev->data;
+    unsigned int offset = addr - data->addr;
+
+    if ((data->busy) && (offset != REGISTER_COMMAND)) {
+        return;
+    }
+
+    switch (offset) {
+    case REGISTER_SRC_LO:
+        data->src = (data->src & ~((ptr36_t) UINT32_MAX)) | val;
+        break;
+    case REGISTER_SRC_HI:
+        data->src = (data->src & UINT32_MAX) | ((ptr36_t) val << 32);
+        break;
+    case REGISTER_DST_LO:
+        data->dst = (data->dst & ~((ptr36_t) UINT32_MAX)) | val;
+        break;
+    case REGISTER_DST_HI:
+        data->dst = (data->dst & UINT32_MAX) | ((ptr36_t) val << 32);
+        break;
+    case REGISTER_LENGTH:
+        data->length = val;
+        break;
+    case REGISTER_VALUE:
+        data->value = val;
+        break;
+    case REGISTER_COMMAND:
+        if ((val & COMMAND_INT_ACK) && (data->ig)) {
+            data->ig = false;
+            plic_interrupt_down(data->plic, data->plic_source, data->intno);
+        }
+
+        if (val & (COMMAND_COPY | COMMAND_FILL)) {
+            dma_start(dev, val);
+        }
+        break;
+    }
+}
+
+/** Save the engine state into a checkpoint
+ *
+ * The pending completion is saved with the device events.
+ *
+ */
+static bool dma_save(device_t *dev, checkpoint_t *ckpt)
+{
+    dma_data_t *data = (dma_data_t *) dev->data;
+
+    return checkpoint_write_var(ckpt, data->setup)
+            && checkpoint_write_var(ckpt, data->bandwidth)
+            && checkpoint_write_var(ckpt, data->src)
+            && checkpoint_write_var(ckpt, data->dst)
+            && checkpoint_write_var(ckpt, data->length)
+            && checkpoint_write_var(ckpt, data->value)
+            && checkpoint_write_var(ckpt, data->command)
+            && checkpoint_write_var(ckpt, data->busy)
+            && checkpoint_write_var(ckpt, data->error)
+            && checkpoint_write_var(ckpt, data->ig)
+            && checkpoint_write_var(ckpt, data->copies)
+            && checkpoint_write_var(ckpt, data->fills)
+            && checkpoint_write_var(ckpt, data->bytes)
+            && checkpoint_write_var(ckpt, data->errors);
+}
+
+/** Load the engine state from a checkpoint
+ *
+ */
+static bool dma_load(device_t *dev, checkpoint_t *ckpt)
+{
+    dma_data_t *data = (dma_data_t *) dev->data;
+
+    return checkpoint_read_var(ckpt, data->setup)
+            && checkpoint_read_var(ckpt, data->bandwidth)
+            && checkpoint_read_var(ckpt, data->src)
+            && checkpoint_read_var(ckpt, data->dst)
+            && checkpoint_read_var(ckpt, data->length)
+            && checkpoint_read_var(ckpt, data->value)
+            && checkpoint_read_var(ckpt, data->command)
+            && checkpoint_read_var(ckpt, data->busy)
+            && checkpoint_read_var(ckpt, data->error)
+            && checkpoint_read_var(ckpt, data->ig)
+            && checkpoint_read_var(ckpt, data->copies)
+            && checkpoint_read_var(ckpt, data->fills)
+            && checkpoint_read_var(ckpt, data->bytes)
+            && checkpoint_read_var(ckpt, data->errors);
+}
+
+/** Events scheduled by the engine */
+static const dev_event_fnc_t dma_events[] = {
+    dma_complete,
+    NULL
+};
+
+/** Export the engine counters to the statistics endpoint
+ *
+ */
+static void dma_stats(device_t *dev, statsrv_t *stats)
+{
+    dma_data_t *data = (dma_data_t *) dev->data;
+
+    statsrv_counter(stats, "dma_transfers_total", "DMA transfers completed",
+            data->copies + data->fills);
+    statsrv_counter(stats, "dma_bytes_total", "Bytes transferred by DMA",
+            data->bytes);
+    statsrv_counter(stats, "dma_errors_total", "DMA commands failed",
+            data->errors);
+}
+
+/*
+ * Device commands
+ */
+
+static cmd_t dma_cmds[] = {
+    { "init",
+            (fcmd_t) ddma_init,
+            DEFAULT,
+            DEFAULT,
+            "Initialization",
+            "Initialization",
+            REQ STR "name/DMA engine name" NEXT
+                    REQ INT "addr/register address" NEXT
+                            REQ INT "intno/interrupt number" END },
+    { "help",
+            (fcmd_t) dev_generic_help,
+            DEFAULT,
+            DEFAULT,
+            "Display this help text",
+            "Display this help text",
+            OPT STR "cmd/command name" END },
+    { "info",
+            (fcmd_t) ddma_info,
+            DEFAULT,
+            DEFAULT,
+            "Display DMA engine state and configuration",
+            "Display DMA engine state and configuration",
+            NOCMD },
+    { "stat",
+            (fcmd_t) ddma_stat,
+            DEFAULT,
+            DEFAULT,
+            "Display DMA engine statistics",
+            "Display DMA engine statistics",
+            NOCMD },
+    { "latency",
+            (fcmd_t) ddma_latency,
+            DEFAULT,
+            DEFAULT,
+            "Print or set the latency of the transfers",
+            "Without arguments prints the setup time of a transfer in cycles (16 by default) and the bytes transferred per cycle afterwards (8 by default).",
+            OPT INT "setup/cycles before the first byte" NEXT
+                    OPT INT "bandwidth/bytes per cycle" END },
+    { "route",
+            (fcmd_t) ddma_route,
+            DEFAULT,
+            DEFAULT,
+            "Print or set the interrupt routing",
+            "Without arguments prints where the completion interrupt goes. With the name of a dplic device and a source number the interrupt is asserted as the source of the interrupt controller instead of the interrupt number of the first processor.",
+            OPT STR "plic/interrupt controller name" NEXT
+                    OPT INT "source/source number" END },
+    LAST_CMD
+};
+
+device_type_t ddma = {
+    /* DMA engine is simulated deterministically */
+    .nondet = false,
+
+    /* Type name and description */
+    .name = "ddma",
+    .brief = "Memory-to-memory DMA engine",
+    .full = "DMA engine copies a block of the physical memory or fills it "
+            "with a repeated word and asserts an interrupt once the "
+            "transfer completes after a modelled latency. The interrupt "
+            "is deasserted by the acknowledge command.",
+
+    /* Functions */
+    .done = dma_done,
+    .read32 = dma_read32,
+    .write32 = dma_write32,
+
+    /* Commands */
+    .cmds = dma_cmds,
+
+    /* Checkpoints */
+    .save = dma_save,
+    .load = dma_load,
+    .events = dma_events,
+    .stats = dma_stats
+};
@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Memory-to-memory DMA engine device
+ *
+ */
+
+#ifndef DDMA_H_
+#define DDMA_H_
+
+#include "device.h"
+
+extern device_type_t ddma;
+
+#endif
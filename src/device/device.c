@@ -19,20 +19,34 @@
 #include <sys/time.h>
 
 #include "../assert.h"
+#include "../checkpoint.h"
+#include "../debug/mixstat.h"
+#include "../debug/trace.h"
 #include "../env.h"
 #include "../fault.h"
 #include "../main.h"
+#include "../parallel.h"
+#include "../profile.h"
 #include "../utils.h"
+#include "dclint.h"
 #include "dcycle.h"
 #include "ddisk.h"
+#include "ddma.h"
 #include "device.h"
+#include "dext.h"
+#include "dfb.h"
 #include "dkeyboard.h"
 #include "dlcd.h"
 #include "dnomem.h"
 #include "dorder.h"
+#include "dplic.h"
 #include "dprinter.h"
 #include "dr4kcpu.h"
 #include "dtime.h"
+#include "dtimer.h"
+#include "dvirtblk.h"
+#include "dvirtcon.h"
+#include "dvirtnet.h"
 #include "mem.h"
 
 /** This is necessary evil... */
@@ -41,14 +55,19 @@
 #include "drv64cpu.h"
 #undef XLEN
 
-/** Count of device types */
-#define DEVICE_TYPE_COUNT 13
+#include "cpu/isa.h"
 
-/* Implemented peripheral list */
-const device_type_t *device_types[DEVICE_TYPE_COUNT] = {
+/* Implemented peripheral list (the processors supported by the build) */
+const device_type_t *device_types[] = {
+#if ISA_R4K
     &dr4kcpu,
+#endif
+#if ISA_RV32
     &drvcpu,
+#endif
+#if ISA_RV64
     &drv64cpu,
+#endif
     &dcycle,
     &drwm,
     &drom,
@@ -58,12 +77,128 @@ const device_type_t *device_types[DEVICE_TYPE_COUNT] = {
     &dnomem,
     &ddisk,
     &dtime,
-    &dlcd
+    &dtimer,
+    &ddma,
+    &dfb,
+    &dlcd,
+    &dclint,
+    &dplic,
+    &dvirtblk,
+    &dvirtcon,
+    &dvirtnet,
+    &dext
 };
 
+/** Count of device types */
+#define DEVICE_TYPE_COUNT (sizeof(device_types) / sizeof(device_types[0]))
+
 /* List of all devices */
 list_t device_list = LIST_INITIALIZER;
 
+/** Instruction set of a stepped processor */
+typedef enum {
+    step_isa_r4k,
+    step_isa_rv32,
+    step_isa_rv64
+} step_isa_t;
+
+/** Processor stepped directly by the function of its instruction set */
+typedef struct {
+    step_isa_t isa;
+    general_cpu_t *cpu;
+} step_cpu_t;
+
+/** Number of devices in the list */
+static size_t device_count = 0;
+
+/** Hash table of the device names
+ *
+ * The buckets are chained through the name_next field of the
+ * devices. The table is doubled whenever there are as many devices
+ * as buckets, so a command finds its device in constant time even
+ * in the configurations with thousands of devices.
+ *
+ */
+static device_t **name_buckets = NULL;
+static size_t name_bucket_count = 0;
+
+/** Instruction set of a stepped processor
+ *
+ * Constant in the builds supporting a single instruction set, so
+ * the processors are stepped without testing it.
+ *
+ */
+static inline step_isa_t dev_step_isa(const step_cpu_t *step)
+{
+#if ISA_SINGLE
+    return ISA_R4K ? step_isa_r4k : (ISA_RV32 ? step_isa_rv32 : step_isa_rv64);
+#else
+    return step->isa;
+#endif
+}
+
+/** Devices with a step (resp. step4k) function in the list order
+ *
+ * The arrays have room for step_capacity devices.
+ *
+ */
+static size_t step_capacity = 0;
+static device_t **step_devices = NULL;
+static size_t step_count = 0;
+static step_cpu_t *step_cpus = NULL;
+static size_t step_cpu_count = 0;
+
+/** Processors not parked (indices of step_cpus in the same order)
+ *
+ * A processor standing by is parked, i.e. left out of the step loop
+ * until it may notice anything (see dev_park_cpus()).
+ *
+ */
+static size_t *step_awake = NULL;
+static size_t step_awake_count = 0;
+
+/** Position of the step loop in step_awake and the cycle it runs in */
+static size_t step_awake_pos = 0;
+static uint64_t step_awake_cycle = UINT64_MAX;
+
+/** Parking of the processors standing by */
+static bool step_parking = false;
+static size_t parked_count = 0;
+
+/** Earliest cycle a parked processor has to be stepped in */
+static uint64_t parked_next = UINT64_MAX;
+static device_t **periph_devices = NULL;
+static size_t periph_count = 0;
+static device_t **step4k_devices = NULL;
+static size_t step4k_count = 0;
+
+/** Scheduled device event */
+typedef struct {
+    uint64_t cycle; /**< Machine cycle to run the event in */
+    uint64_t seq; /**< Order of events scheduled for the same cycle */
+    device_t *dev;
+    dev_event_fnc_t fnc;
+} dev_event_t;
+
+/** Binary heap of scheduled device events ordered by cycle and seq */
+static dev_event_t *events = NULL;
+static size_t event_count = 0;
+static size_t event_capacity = 0;
+static uint64_t event_seq = 0;
+
+/** Register window of a device */
+typedef struct {
+    ptr36_t start; /**< First address of the window */
+    ptr36_t end; /**< First address past the window */
+    ptr36_t reach; /**< Maximal end of this and all preceding windows */
+    device_t *dev;
+} dev_window_t;
+
+/** Device register windows sorted by the start address */
+static dev_window_t *windows = NULL;
+static size_t window_count = 0;
+static size_t window_capacity = 0;
+
 /** Search for device type and allocates device structure
  *
  * @param type_string Exact name of device type.
@@ -107,6 +242,9 @@ device_t *alloc_device(const char *type_string, const char *device_name)
     dev->type = device_type;
     dev->name = safe_strdup(device_name);
     dev->data = NULL;
+    dev->mmio_read_bytes = 0;
+    dev->mmio_write_bytes = 0;
+    dev->name_next = NULL;
     item_init(&dev->item);
 
     return dev;
@@ -114,6 +252,9 @@ device_t *alloc_device(const char *type_string, const char *device_name)
 
 void free_device(device_t *dev)
 {
+    dev_cancel(dev);
+    dev_unmap(dev);
+
     /* Clean-up only if possible and if the device was initialized. */
     if (dev->type->done && dev->data) {
         dev->type->done(dev);
@@ -122,9 +263,209 @@ void free_device(device_t *dev)
     safe_free(dev);
 }
 
+static bool dev_match_to_filter(device_t *device, device_filter_t filter);
+
+/** Instruction set of a processor device type
+ *
+ * Only the processor types supported by the build are compared.
+ *
+ * @return True if the type is a processor, the instruction set is
+ *         returned through isa then.
+ *
+ */
+static bool dev_processor_type(const device_type_t *type, step_isa_t *isa)
+{
+#if ISA_R4K
+    if (type == &dr4kcpu) {
+        *isa = step_isa_r4k;
+        return true;
+    }
+#endif
+#if ISA_RV32
+    if (type == &drvcpu) {
+        *isa = step_isa_rv32;
+        return true;
+    }
+#endif
+#if ISA_RV64
+    if (type == &drv64cpu) {
+        *isa = step_isa_rv64;
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+/** FNV-1a hash of a device name */
+static size_t dev_name_hash(const char *name)
+{
+    uint32_t hash = UINT32_C(2166136261);
+
+    for (; *name != 0; name++) {
+        hash ^= (unsigned char) *name;
+        hash *= UINT32_C(16777619);
+    }
+
+    return hash;
+}
+
+/** Return the bucket of the name hash table holding the name */
+static device_t **dev_name_bucket(const char *name)
+{
+    return &name_buckets[dev_name_hash(name) & (name_bucket_count - 1)];
+}
+
+/** Add a device into the name hash table
+ *
+ * The table is rehashed into twice as many buckets when full.
+ *
+ */
+static void dev_name_insert(device_t *dev)
+{
+    if (device_count >= name_bucket_count) {
+        device_t **old_buckets = name_buckets;
+        size_t old_count = name_bucket_count;
+
+        name_bucket_count = (old_count == 0) ? 64 : 2 * old_count;
+        name_buckets = safe_malloc(name_bucket_count * sizeof(device_t *));
+        memset(name_buckets, 0, name_bucket_count * sizeof(device_t *));
+
+        for (size_t i = 0; i < old_count; i++) {
+            device_t *chained = old_buckets[i];
+
+            while (chained != NULL) {
+                device_t *next = chained->name_next;
+                device_t **bucket = dev_name_bucket(chained->name);
+
+                chained->name_next = *bucket;
+                *bucket = chained;
+                chained = next;
+            }
+        }
+
+        safe_free(old_buckets);
+    }
+
+    device_t **bucket = dev_name_bucket(dev->name);
+    dev->name_next = *bucket;
+    *bucket = dev;
+}
+
+/** Remove a device from the name hash table */
+static void dev_name_remove(device_t *dev)
+{
+    device_t **link = dev_name_bucket(dev->name);
+
+    while (*link != dev) {
+        ASSERT(*link != NULL);
+        link = &(*link)->name_next;
+    }
+
+    *link = dev->name_next;
+    dev->name_next = NULL;
+}
+
+/** Resize an array of the stepped devices */
+static void *dev_step_array_resize(void *array, size_t size)
+{
+    void *resized = realloc(array, size);
+
+    if (resized == NULL) {
+        die(ERR_MEM, "Not enough memory");
+    }
+
+    return resized;
+}
+
+/** Make room for all devices in the arrays of stepped devices
+ *
+ * The capacity is doubled, so adding a device costs a constant
+ * time on average.
+ *
+ */
+static void dev_reserve_step_arrays(void)
+{
+    if (device_count <= step_capacity) {
+        return;
+    }
+
+    step_capacity = MAX(device_count, 2 * step_capacity);
+
+    step_devices = dev_step_array_resize(step_devices,
+            step_capacity * sizeof(device_t *));
+    step_cpus = dev_step_array_resize(step_cpus,
+            step_capacity * sizeof(step_cpu_t));
+    step_awake = dev_step_array_resize(step_awake,
+            step_capacity * sizeof(size_t));
+    periph_devices = dev_step_array_resize(periph_devices,
+            step_capacity * sizeof(device_t *));
+    step4k_devices = dev_step_array_resize(step4k_devices,
+            step_capacity * sizeof(device_t *));
+}
+
+/** Append a device to the arrays of devices which are stepped */
+static void dev_append_step_arrays(device_t *dev)
+{
+    if (dev->type->step != NULL) {
+        step_devices[step_count++] = dev;
+
+        step_isa_t isa;
+
+        if (!dev_processor_type(dev->type, &isa)) {
+            periph_devices[periph_count++] = dev;
+        } else {
+            step_awake[step_awake_count++] = step_cpu_count;
+            step_cpu_t *step_cpu = &step_cpus[step_cpu_count++];
+
+            step_cpu->cpu = (general_cpu_t *) dev->data;
+            step_cpu->isa = isa;
+        }
+    }
+
+    if (dev->type->step4k != NULL) {
+        step4k_devices[step4k_count++] = dev;
+    }
+}
+
+/** Rebuild the arrays of devices which are stepped
+ *
+ * Called whenever a device is removed so that the simulation
+ * loop does not need to filter the list. An added device is
+ * just appended (see add_device()).
+ *
+ */
+static void dev_update_step_arrays(void)
+{
+    parallel_devices_changed();
+
+    /* Devices only change while no processor is parked */
+    ASSERT(parked_count == 0);
+
+    step_count = 0;
+    step_cpu_count = 0;
+    step_awake_count = 0;
+    periph_count = 0;
+    step4k_count = 0;
+
+    dev_reserve_step_arrays();
+
+    device_t *dev;
+    for_each(device_list, dev, device_t)
+    {
+        dev_append_step_arrays(dev);
+    }
+}
+
 void add_device(device_t *dev)
 {
     list_append(&device_list, &dev->item);
+    dev_name_insert(dev);
+    device_count++;
+
+    parallel_devices_changed();
+    dev_reserve_step_arrays();
+    dev_append_step_arrays(dev);
 }
 
 /** Test device according to the given filter condition.
@@ -147,9 +488,15 @@ static bool dev_match_to_filter(device_t *device, device_filter_t filter)
     case DEVICE_FILTER_STEP4K:
         return device->type->step4k != NULL;
     case DEVICE_FILTER_MEMORY:
-        return (strcmp(device->type->name, "rom") == 0) || (strcmp(device->type->name, "rwm") == 0);
-    case DEVICE_FILTER_R4K_PROCESSOR:
-        return (strcmp(device->type->name, "dr4kcpu") == 0);
+        return (device->type == &drom) || (device->type == &drwm);
+    case DEVICE_FILTER_R4K_PROCESSOR: {
+        step_isa_t isa;
+        return (dev_processor_type(device->type, &isa)) && (isa == step_isa_r4k);
+    }
+    case DEVICE_FILTER_PROCESSOR: {
+        step_isa_t isa;
+        return dev_processor_type(device->type, &isa);
+    }
     default:
         die(ERR_INTERN, "Unexpected device filter");
     }
@@ -295,12 +642,16 @@ size_t dev_count_by_partial_name(const char *name_prefix,
  */
 device_t *dev_by_name(const char *searched_name)
 {
-    device_t *device = NULL;
+    ASSERT(searched_name != NULL);
 
-    while (dev_next(&device, DEVICE_FILTER_ALL)) {
-        if (!strcmp(searched_name, device->name)) {
-            break;
-        }
+    if (name_bucket_count == 0) {
+        return NULL;
+    }
+
+    device_t *device = *dev_name_bucket(searched_name);
+
+    while ((device != NULL) && (strcmp(searched_name, device->name) != 0)) {
+        device = device->name_next;
     }
 
     return device;
@@ -314,6 +665,1031 @@ device_t *dev_by_name(const char *searched_name)
 void dev_remove(device_t *device)
 {
     list_remove(&device_list, &device->item);
+    dev_name_remove(device);
+    device_count--;
+
+    dev_update_step_arrays();
+}
+
+/** Remove and free all devices of the machine
+ *
+ */
+void dev_remove_all(void)
+{
+    while (device_list.head != NULL) {
+        device_t *dev = (device_t *) device_list.head;
+
+        list_remove(&device_list, &dev->item);
+        dev_name_remove(dev);
+        device_count--;
+
+        free_device(dev);
+    }
+
+    dev_update_step_arrays();
+}
+
+/** Step a processor by a direct call of the step of its instruction set */
+static inline void dev_step_cpu(const step_cpu_t *step)
+{
+    general_cpu_t *cpu = step->cpu;
+
+    cpu_deliver_interrupts(cpu);
+
+    switch (dev_step_isa(step)) {
+    case step_isa_r4k:
+        r4k_step((r4k_cpu_t *) cpu->data);
+        break;
+    case step_isa_rv32:
+        rv32_cpu_step((rv32_cpu_t *) cpu->data);
+        break;
+    case step_isa_rv64:
+        rv64_cpu_step((rv64_cpu_t *) cpu->data);
+        break;
+    }
+}
+
+/** Check whether a processor stands by after its step */
+static inline bool dev_step_standby(const step_cpu_t *step)
+{
+    void *data = step->cpu->data;
+
+    switch (dev_step_isa(step)) {
+    case step_isa_r4k:
+        return ((r4k_cpu_t *) data)->stdby;
+    case step_isa_rv32:
+        return ((rv32_cpu_t *) data)->stdby || ((rv32_cpu_t *) data)->spinning;
+    case step_isa_rv64:
+        return ((rv64_cpu_t *) data)->stdby || ((rv64_cpu_t *) data)->spinning;
+    }
+
+    return false;
+}
+
+/** Park the processor just stepped by the step loop
+ *
+ * The processor is parked only if it is going to stand by without
+ * noticing anything for at least one cycle, i.e. until it would take
+ * an interrupt or its timer would change the interrupt requests.
+ *
+ * @return True if the processor was parked.
+ *
+ */
+static bool dev_park_stepped(void)
+{
+    general_cpu_t *cpu = step_cpus[step_awake[step_awake_pos]].cpu;
+    uint64_t cycles;
+
+    if ((cpu->type->standby == NULL) || (cpu->posted != 0)
+            || (!cpu->type->standby(cpu->data, &cycles)) || (cycles == 0)) {
+        return false;
+    }
+
+    /* Stepped in this cycle, standing by from the next one */
+    cpu->parked = true;
+    cpu->parked_since = steps + 1;
+    cpu->parked_until = steps + 1 + cycles;
+    parked_count++;
+
+    if (cpu->parked_until < parked_next) {
+        parked_next = cpu->parked_until;
+    }
+
+    step_awake_count--;
+    memmove(&step_awake[step_awake_pos], &step_awake[step_awake_pos + 1],
+            (step_awake_count - step_awake_pos) * sizeof(size_t));
+
+    return true;
+}
+
+/** Put a parked processor back into the step loop
+ *
+ * The skipped standby cycles are accounted by the processor. If the
+ * processor is unparked in the middle of the step loop (e.g. by an
+ * interrupt raised by another processor), it is stepped in the current
+ * cycle only if it follows the processor being stepped, as if it had
+ * never been parked.
+ *
+ */
+void dev_unpark_cpu(general_cpu_t *cpu)
+{
+    ASSERT(cpu->parked);
+
+    size_t index = 0;
+    while (step_cpus[index].cpu != cpu) {
+        index++;
+    }
+
+    size_t pos = 0;
+    while ((pos < step_awake_count) && (step_awake[pos] < index)) {
+        pos++;
+    }
+
+    /* Whether the step loop has already passed the processor in this cycle */
+    bool passed = (step_awake_cycle == steps) && (pos <= step_awake_pos);
+    uint64_t cycles = steps - cpu->parked_since + (passed ? 1 : 0);
+
+    if (cycles > 0) {
+        cpu->type->skip(cpu->data, cycles);
+    }
+
+    cpu->parked = false;
+    parked_count--;
+
+    memmove(&step_awake[pos + 1], &step_awake[pos],
+            (step_awake_count - pos) * sizeof(size_t));
+    step_awake[pos] = index;
+    step_awake_count++;
+
+    if (passed) {
+        step_awake_pos++;
+    }
+}
+
+/** Unpark the processors which have to be stepped in the current cycle
+ *
+ * @param all Unpark all processors.
+ *
+ */
+static void dev_unpark_due(bool all)
+{
+    parked_next = UINT64_MAX;
+
+    for (size_t i = 0; (i < step_cpu_count) && (parked_count > 0); i++) {
+        general_cpu_t *cpu = step_cpus[i].cpu;
+
+        if (!cpu->parked) {
+            continue;
+        }
+
+        if ((all) || (cpu->parked_until <= steps)) {
+            dev_unpark_cpu(cpu);
+        } else if (cpu->parked_until < parked_next) {
+            parked_next = cpu->parked_until;
+        }
+    }
+}
+
+/** Enable or disable the parking of the processors standing by
+ *
+ * While enabled, dev_step_all() leaves the processors standing by
+ * out of the step loop, so that the simulation cost follows the
+ * number of busy processors. The skipped cycles are accounted once
+ * the processor may notice something, it gets an interrupt or its
+ * timer is accessed. The processors are unparked when disabled,
+ * so nothing outside of the fast simulation loop sees them parked.
+ *
+ */
+void dev_park_cpus(bool enable)
+{
+    step_parking = enable;
+
+    if ((!enable) && (parked_count > 0)) {
+        dev_unpark_due(true);
+    }
+}
+
+/** Execute the step function of all devices
+ *
+ * The processors are stepped first, each by a direct call of the
+ * step of its instruction set, then the other devices follow.
+ *
+ */
+void dev_step_all(void)
+{
+    if (steps >= parked_next) {
+        dev_unpark_due(false);
+    }
+
+    step_awake_cycle = steps;
+
+    for (step_awake_pos = 0; step_awake_pos < step_awake_count;) {
+        const step_cpu_t *step = &step_cpus[step_awake[step_awake_pos]];
+
+        dev_step_cpu(step);
+
+        if ((!step_parking) || (!dev_step_standby(step)) || (!dev_park_stepped())) {
+            step_awake_pos++;
+        }
+    }
+
+    for (size_t i = 0; i < periph_count; i++) {
+        periph_devices[i]->type->step(periph_devices[i]);
+    }
+}
+
+/** Execute the step function of all devices in a sampled cycle
+ *
+ * The host time of the processors and of the other devices
+ * is accounted separately.
+ *
+ */
+void dev_step_all_profiled(void)
+{
+    if (parked_count > 0) {
+        dev_unpark_due(true);
+    }
+
+    /* The other devices follow the processors in the same order */
+    size_t periph = 0;
+
+    for (size_t i = 0; i < step_count; i++) {
+        device_t *dev = step_devices[i];
+        bool processor = (periph == periph_count) || (periph_devices[periph] != dev);
+
+        if (!processor) {
+            periph++;
+        }
+
+        profile_enter(processor ? PROFILE_EXECUTE : PROFILE_DEVICES);
+        dev->type->step(dev);
+        profile_leave();
+    }
+}
+
+/** Execute the processors one after another for a number of cycles each
+ *
+ * Used by the interleaved simulation, the other devices have to catch
+ * up afterwards. A halt or a break into the interactive mode shortens
+ * the run of the processors which follow to the cycle it happened in.
+ * The blocks of the fast mode a processor runs in its cycles add up,
+ * the longest sum is left in machine_fast_ahead.
+ *
+ * @param cycles Cycles each processor runs.
+ *
+ * @return Number of cycles run by the last processor.
+ *
+ */
+uint64_t dev_step_cpus(uint64_t cycles)
+{
+    uint64_t limit = cycles;
+    uint64_t ahead = 0;
+
+    for (size_t i = 0; i < step_cpu_count; i++) {
+        uint64_t cpu_ahead = 0;
+
+        for (uint64_t n = 0; n < limit; n++) {
+            bool stopped = machine_stopping();
+
+            machine_fast_ahead = 0;
+            dev_step_cpu(&step_cpus[i]);
+            cpu_ahead += machine_fast_ahead;
+
+            if ((!stopped) && (machine_stopping())) {
+                limit = n + 1;
+            }
+        }
+
+        ahead = MAX(ahead, cpu_ahead);
+    }
+
+    machine_fast_ahead = ahead;
+    return limit;
+}
+
+/** Execute the step function of all devices except processors
+ *
+ * Used by the parallel simulation, where the processors
+ * are stepped by their own threads.
+ *
+ */
+void dev_step_peripherals(void)
+{
+    for (size_t i = 0; i < periph_count; i++) {
+        periph_devices[i]->type->step(periph_devices[i]);
+    }
+}
+
+/** Execute the step4k function of all devices
+ *
+ */
+void dev_step4k_all(void)
+{
+    for (size_t i = 0; i < step4k_count; i++) {
+        step4k_devices[i]->type->step4k(step4k_devices[i]);
+    }
+}
+
+static bool event_before(const dev_event_t *a, const dev_event_t *b)
+{
+    if (a->cycle != b->cycle) {
+        return a->cycle < b->cycle;
+    }
+
+    return a->seq < b->seq;
+}
+
+static void event_swap(size_t i, size_t j)
+{
+    dev_event_t tmp = events[i];
+    events[i] = events[j];
+    events[j] = tmp;
+}
+
+static void event_sift_up(size_t i)
+{
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+
+        if (!event_before(&events[i], &events[parent])) {
+            break;
+        }
+
+        event_swap(i, parent);
+        i = parent;
+    }
+}
+
+static void event_sift_down(size_t i)
+{
+    while (true) {
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        size_t first = i;
+
+        if ((left < event_count) && event_before(&events[left], &events[first])) {
+            first = left;
+        }
+
+        if ((right < event_count) && event_before(&events[right], &events[first])) {
+            first = right;
+        }
+
+        if (first == i) {
+            break;
+        }
+
+        event_swap(i, first);
+        i = first;
+    }
+}
+
+/** Insert an event into the heap
+ *
+ */
+static void event_insert(device_t *dev, uint64_t cycle, uint64_t seq,
+        dev_event_fnc_t fnc)
+{
+    if (event_count == event_capacity) {
+        event_capacity = (event_capacity == 0) ? 16 : 2 * event_capacity;
+        events = (dev_event_t *) realloc(events,
+                event_capacity * sizeof(dev_event_t));
+
+        if (events == NULL) {
+            die(ERR_MEM, "Not enough memory");
+        }
+    }
+
+    dev_event_t *event = &events[event_count];
+    event->cycle = cycle;
+    event->seq = seq;
+    event->dev = dev;
+    event->fnc = fnc;
+
+    event_sift_up(event_count++);
+}
+
+/** Schedule a device event
+ *
+ * Devices which only need to act at known future cycles use events
+ * instead of a step function, so they do not cost anything in the
+ * cycles in between.
+ *
+ * @param dev   Device the event belongs to.
+ * @param delay Number of machine cycles to wait. The event runs after
+ *              the device steps of the machine cycle, so an event with
+ *              zero delay runs at the end of the current cycle.
+ * @param fnc   Event handler.
+ *
+ */
+void dev_schedule(device_t *dev, uint64_t delay, dev_event_fnc_t fnc)
+{
+    ASSERT(dev != NULL);
+    ASSERT(fnc != NULL);
+
+    event_insert(dev, steps + delay, event_seq++, fnc);
+}
+
+/** Cancel all scheduled events of a device
+ *
+ */
+void dev_cancel(device_t *dev)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < event_count; i++) {
+        if (events[i].dev != dev) {
+            events[count++] = events[i];
+        }
+    }
+
+    if (count == event_count) {
+        return;
+    }
+
+    event_count = count;
+
+    for (size_t i = event_count / 2; i-- > 0;) {
+        event_sift_down(i);
+    }
+}
+
+/** Run the device events scheduled for the current machine cycle
+ *
+ */
+void dev_run_events(void)
+{
+    while ((event_count > 0) && (events[0].cycle <= steps)) {
+        dev_event_t event = events[0];
+
+        events[0] = events[--event_count];
+        event_sift_down(0);
+
+        event.fnc(event.dev);
+    }
+}
+
+/** Number of machine cycles the devices other than processors stay quiet
+ *
+ * Within the returned number of cycles no device is stepped and no
+ * event runs, so the cycles can be skipped if the processors stand by.
+ * The step4k functions poll the input, so the cycles are skipped only
+ * up to the next multiple of 4096.
+ *
+ */
+uint64_t dev_quiet_cycles(void)
+{
+    if (periph_count > 0) {
+        return 0;
+    }
+
+    uint64_t cycles = UINT64_MAX;
+
+    if (event_count > 0) {
+        cycles = (events[0].cycle > steps) ? events[0].cycle - steps : 0;
+    }
+
+    if (step4k_count > 0) {
+        uint64_t step4k = 4095 - (steps % 4096);
+
+        if (step4k < cycles) {
+            cycles = step4k;
+        }
+    }
+
+    return cycles;
+}
+
+/** Check whether some device is going to act on its own
+ *
+ * The devices without a step function and without scheduled events
+ * only act when accessed or when polling the input.
+ *
+ */
+bool dev_events_pending(void)
+{
+    return (periph_count > 0) || (event_count > 0);
+}
+
+/** Find the index of an event handler in the table of the device type
+ *
+ * @return True if the handler was found.
+ *
+ */
+static bool event_index(const device_t *dev, dev_event_fnc_t fnc, uint64_t *index)
+{
+    const dev_event_fnc_t *handlers = dev->type->events;
+
+    if (handlers == NULL) {
+        return false;
+    }
+
+    for (uint64_t i = 0; handlers[i] != NULL; i++) {
+        if (handlers[i] == fnc) {
+            *index = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/** Save the scheduled device events into a checkpoint
+ *
+ * The handlers are identified by their index in the table
+ * of the device type.
+ *
+ */
+bool dev_save_events(checkpoint_t *ckpt)
+{
+    ASSERT(ckpt != NULL);
+
+    for (size_t i = 0; i < event_count; i++) {
+        uint64_t index;
+
+        if (!event_index(events[i].dev, events[i].fnc, &index)) {
+            error("Device %s has a pending event which cannot be saved",
+                    events[i].dev->name);
+            return false;
+        }
+    }
+
+    if (!checkpoint_write_uint64(ckpt, event_count)
+            || !checkpoint_write_uint64(ckpt, event_seq)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < event_count; i++) {
+        uint64_t index = 0;
+        event_index(events[i].dev, events[i].fnc, &index);
+
+        if (!checkpoint_write_str(ckpt, events[i].dev->name)
+                || !checkpoint_write_uint64(ckpt, index)
+                || !checkpoint_write_uint64(ckpt, events[i].cycle)
+                || !checkpoint_write_uint64(ckpt, events[i].seq)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/** Replace the scheduled device events by the events of a checkpoint
+ *
+ */
+bool dev_load_events(checkpoint_t *ckpt)
+{
+    ASSERT(ckpt != NULL);
+
+    uint64_t count;
+    uint64_t seq;
+
+    if (!checkpoint_read_uint64(ckpt, &count)
+            || !checkpoint_read_uint64(ckpt, &seq)) {
+        return false;
+    }
+
+    event_count = 0;
+
+    for (uint64_t i = 0; i < count; i++) {
+        char *name = checkpoint_read_str(ckpt);
+        uint64_t index;
+        uint64_t cycle;
+        uint64_t seq_saved;
+
+        if (name == NULL) {
+            return false;
+        }
+
+        device_t *dev = dev_by_name(name);
+        safe_free(name);
+
+        if (!checkpoint_read_uint64(ckpt, &index)
+                || !checkpoint_read_uint64(ckpt, &cycle)
+                || !checkpoint_read_uint64(ckpt, &seq_saved)) {
+            return false;
+        }
+
+        uint64_t handlers = 0;
+        if ((dev != NULL) && (dev->type->events != NULL)) {
+            while (dev->type->events[handlers] != NULL) {
+                handlers++;
+            }
+        }
+
+        if (index >= handlers) {
+            error("Checkpoint event does not belong to a configured device");
+            return false;
+        }
+
+        event_insert(dev, cycle, seq_saved, dev->type->events[index]);
+    }
+
+    event_seq = seq;
+    return true;
+}
+
+/** Recompute the reach of the register windows
+ *
+ */
+static void window_update_reach(void)
+{
+    ptr36_t reach = 0;
+
+    for (size_t i = 0; i < window_count; i++) {
+        if (windows[i].end > reach) {
+            reach = windows[i].end;
+        }
+
+        windows[i].reach = reach;
+    }
+}
+
+/** Map a register window of a device
+ *
+ * Memory accesses which miss the physical memory are dispatched only
+ * to devices whose register window contains the accessed address.
+ *
+ * @param dev  Device owning the window.
+ * @param addr First physical address of the window.
+ * @param size Size of the window in bytes.
+ *
+ */
+void dev_map(device_t *dev, ptr36_t addr, uint64_t size)
+{
+    ASSERT(dev != NULL);
+
+    if (size == 0) {
+        return;
+    }
+
+    if (window_count == window_capacity) {
+        window_capacity = (window_capacity == 0) ? 16 : 2 * window_capacity;
+        windows = (dev_window_t *) realloc(windows,
+                window_capacity * sizeof(dev_window_t));
+
+        if (windows == NULL) {
+            die(ERR_MEM, "Not enough memory");
+        }
+    }
+
+    size_t pos = window_count;
+    while ((pos > 0) && (windows[pos - 1].start > addr)) {
+        windows[pos] = windows[pos - 1];
+        pos--;
+    }
+
+    windows[pos].start = addr;
+    windows[pos].end = addr + size;
+    windows[pos].dev = dev;
+    window_count++;
+
+    window_update_reach();
+}
+
+/** Unmap all register windows of a device
+ *
+ */
+void dev_unmap(device_t *dev)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < window_count; i++) {
+        if (windows[i].dev != dev) {
+            windows[count++] = windows[i];
+        }
+    }
+
+    window_count = count;
+    window_update_reach();
+}
+
+/** Find the last register window starting at or below an address
+ *
+ * @return Index past the last window with start <= addr.
+ *
+ */
+static size_t window_bound(ptr36_t addr)
+{
+    size_t lo = 0;
+    size_t hi = window_count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (windows[mid].start <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/** Iterate over devices whose register window contains an address
+ *
+ * Overlapping windows are visited in the order of decreasing start
+ * address. The iteration stops as soon as no preceding window can
+ * reach the address.
+ *
+ */
+#define for_each_window(addr, window) \
+    for (size_t _i = window_bound(addr); \
+            (_i > 0) && (windows[_i - 1].reach > (addr)); _i--) \
+        if ((window = &windows[_i - 1])->end > (addr))
+
+/** Device memory read (8 bits)
+ *
+ * Devices without a 8-bit handler are read by their 32-bit
+ * handler, the value is truncated.
+ *
+ * @see dev_read32
+ *
+ */
+void dev_read8(unsigned int procno, ptr36_t addr, uint8_t *val)
+{
+    dev_window_t *window;
+
+    machine_lock();
+    profile_region_enter(PROFILE_MMIO);
+
+    for_each_window(addr, window)
+    {
+        const device_type_t *type = window->dev->type;
+
+        if (type->read8) {
+            type->read8(procno, window->dev, addr, val);
+        } else if (type->read32) {
+            uint32_t word = *val;
+            type->read32(procno, window->dev, addr, &word);
+            *val = (uint8_t) word;
+        } else {
+            continue;
+        }
+
+        if (mixstat_enabled) {
+            window->dev->mmio_read_bytes += sizeof(*val);
+        }
+
+        if (trace_events) {
+            trace_mmio(procno, false, addr, sizeof(*val), *val);
+        }
+    }
+
+    profile_region_leave();
+    machine_unlock();
+}
+
+/** Device memory read (16 bits)
+ *
+ * Devices without a 16-bit handler are read by their 32-bit
+ * handler, the value is truncated.
+ *
+ * @see dev_read32
+ *
+ */
+void dev_read16(unsigned int procno, ptr36_t addr, uint16_t *val)
+{
+    dev_window_t *window;
+
+    machine_lock();
+    profile_region_enter(PROFILE_MMIO);
+
+    for_each_window(addr, window)
+    {
+        const device_type_t *type = window->dev->type;
+
+        if (type->read16) {
+            type->read16(procno, window->dev, addr, val);
+        } else if (type->read32) {
+            uint32_t word = *val;
+            type->read32(procno, window->dev, addr, &word);
+            *val = (uint16_t) word;
+        } else {
+            continue;
+        }
+
+        if (mixstat_enabled) {
+            window->dev->mmio_read_bytes += sizeof(*val);
+        }
+
+        if (trace_events) {
+            trace_mmio(procno, false, addr, sizeof(*val), *val);
+        }
+    }
+
+    profile_region_leave();
+    machine_unlock();
+}
+
+/** Device memory read (32 bits)
+ *
+ * @param procno Processor performing the access.
+ * @param addr   Physical address.
+ * @param val    Value read by the devices, left untouched when
+ *               no device manages the address.
+ *
+ */
+void dev_read32(unsigned int procno, ptr36_t addr, uint32_t *val)
+{
+    dev_window_t *window;
+
+    machine_lock();
+    profile_region_enter(PROFILE_MMIO);
+
+    for_each_window(addr, window)
+    {
+        if (window->dev->type->read32) {
+            window->dev->type->read32(procno, window->dev, addr, val);
+
+            if (mixstat_enabled) {
+                window->dev->mmio_read_bytes += sizeof(*val);
+            }
+
+            if (trace_events) {
+                trace_mmio(procno, false, addr, sizeof(*val), *val);
+            }
+        }
+    }
+
+    profile_region_leave();
+    machine_unlock();
+}
+
+/** Device memory read (64 bits)
+ *
+ * @see dev_read32
+ *
+ */
+void dev_read64(unsigned int procno, ptr36_t addr, uint64_t *val)
+{
+    dev_window_t *window;
+
+    machine_lock();
+    profile_region_enter(PROFILE_MMIO);
+
+    for_each_window(addr, window)
+    {
+        if (window->dev->type->read64) {
+            window->dev->type->read64(procno, window->dev, addr, val);
+
+            if (mixstat_enabled) {
+                window->dev->mmio_read_bytes += sizeof(*val);
+            }
+
+            if (trace_events) {
+                trace_mmio(procno, false, addr, sizeof(*val), *val);
+            }
+        }
+    }
+
+    profile_region_leave();
+    machine_unlock();
+}
+
+/** Device memory write (8 bits)
+ *
+ * Devices without a 8-bit handler get the value
+ * by their 32-bit handler.
+ *
+ * @see dev_write32
+ *
+ */
+bool dev_write8(unsigned int procno, ptr36_t addr, uint8_t val)
+{
+    bool written = false;
+    dev_window_t *window;
+
+    machine_lock();
+    profile_region_enter(PROFILE_MMIO);
+
+    for_each_window(addr, window)
+    {
+        const device_type_t *type = window->dev->type;
+
+        if (type->write8) {
+            type->write8(procno, window->dev, addr, val);
+        } else if (type->write32) {
+            type->write32(procno, window->dev, addr, val);
+        } else {
+            continue;
+        }
+
+        written = true;
+
+        if (mixstat_enabled) {
+            window->dev->mmio_write_bytes += sizeof(val);
+        }
+
+        if (trace_events) {
+            trace_mmio(procno, true, addr, sizeof(val), val);
+        }
+    }
+
+    profile_region_leave();
+    machine_unlock();
+
+    return written;
+}
+
+/** Device memory write (16 bits)
+ *
+ * Devices without a 16-bit handler get the value
+ * by their 32-bit handler.
+ *
+ * @see dev_write32
+ *
+ */
+bool dev_write16(unsigned int procno, ptr36_t addr, uint16_t val)
+{
+    bool written = false;
+    dev_window_t *window;
+
+    machine_lock();
+    profile_region_enter(PROFILE_MMIO);
+
+    for_each_window(addr, window)
+    {
+        const device_type_t *type = window->dev->type;
+
+        if (type->write16) {
+            type->write16(procno, window->dev, addr, val);
+        } else if (type->write32) {
+            type->write32(procno, window->dev, addr, val);
+        } else {
+            continue;
+        }
+
+        written = true;
+
+        if (mixstat_enabled) {
+            window->dev->mmio_write_bytes += sizeof(val);
+        }
+
+        if (trace_events) {
+            trace_mmio(procno, true, addr, sizeof(val), val);
+        }
+    }
+
+    profile_region_leave();
+    machine_unlock();
+
+    return written;
+}
+
+/** Device memory write (32 bits)
+ *
+ * @param procno Processor performing the access.
+ * @param addr   Physical address.
+ * @param val    Value to write.
+ *
+ * @return True if a device managing the address accepted the write.
+ *
+ */
+bool dev_write32(unsigned int procno, ptr36_t addr, uint32_t val)
+{
+    bool written = false;
+    dev_window_t *window;
+
+    machine_lock();
+    profile_region_enter(PROFILE_MMIO);
+
+    for_each_window(addr, window)
+    {
+        if (window->dev->type->write32) {
+            window->dev->type->write32(procno, window->dev, addr, val);
+            written = true;
+
+            if (mixstat_enabled) {
+                window->dev->mmio_write_bytes += sizeof(val);
+            }
+
+            if (trace_events) {
+                trace_mmio(procno, true, addr, sizeof(val), val);
+            }
+        }
+    }
+
+    profile_region_leave();
+    machine_unlock();
+
+    return written;
+}
+
+/** Device memory write (64 bits)
+ *
+ * @see dev_write32
+ *
+ */
+bool dev_write64(unsigned int procno, ptr36_t addr, uint64_t val)
+{
+    bool written = false;
+    dev_window_t *window;
+
+    machine_lock();
+    profile_region_enter(PROFILE_MMIO);
+
+    for_each_window(addr, window)
+    {
+        if (window->dev->type->write64) {
+            window->dev->type->write64(procno, window->dev, addr, val);
+            written = true;
+
+            if (mixstat_enabled) {
+                window->dev->mmio_write_bytes += sizeof(val);
+            }
+
+            if (trace_events) {
+                trace_mmio(procno, true, addr, sizeof(val), val);
+            }
+        }
+    }
+
+    profile_region_leave();
+    machine_unlock();
+
+    return written;
 }
 
 /** Generic help generation
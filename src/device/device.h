@@ -18,6 +18,15 @@
 #include "../parser.h"
 
 struct device;
+struct checkpoint;
+struct statsrv;
+
+/** Device event handler
+ *
+ * @see dev_schedule
+ *
+ */
+typedef void (*dev_event_fnc_t)(struct device *dev);
 
 /** Structure describing device methods.
  *
@@ -39,13 +48,29 @@ typedef struct {
     /** Called every 4096th machine cycle. */
     void (*step4k)(struct device *dev);
 
-    /** Device memory read */
+    /** Device memory read
+     *
+     * The 8-bit and 16-bit handlers are optional, without them
+     * the 32-bit handler is called and its value truncated.
+     */
+    void (*read8)(unsigned int procno, struct device *dev, ptr36_t addr,
+            uint8_t *val);
+    void (*read16)(unsigned int procno, struct device *dev, ptr36_t addr,
+            uint16_t *val);
     void (*read32)(unsigned int procno, struct device *dev, ptr36_t addr,
             uint32_t *val);
     void (*read64)(unsigned int procno, struct device *dev, ptr36_t addr,
             uint64_t *val);
 
-    /** Device memory write */
+    /** Device memory write
+     *
+     * The 8-bit and 16-bit handlers are optional, without them
+     * the value is passed to the 32-bit handler.
+     */
+    void (*write8)(unsigned int procno, struct device *dev, ptr36_t addr,
+            uint8_t val);
+    void (*write16)(unsigned int procno, struct device *dev, ptr36_t addr,
+            uint16_t val);
     void (*write32)(unsigned int procno, struct device *dev, ptr36_t addr,
             uint32_t val);
     void (*write64)(unsigned int procno, struct device *dev, ptr36_t addr,
@@ -58,6 +83,28 @@ typedef struct {
      * @see device_cmd_struct
      */
     const cmd_t *const cmds;
+
+    /** Save the device state into a checkpoint. */
+    bool (*save)(struct device *dev, struct checkpoint *ckpt);
+
+    /** Load the device state from a checkpoint. */
+    bool (*load)(struct device *dev, struct checkpoint *ckpt);
+
+    /**
+     * Prepare the device state to be saved by a forked process,
+     * false if the state can change under it (e.g. a shared file
+     * mapping).
+     */
+    bool (*prefork)(struct device *dev);
+
+    /**
+     * Event handlers the device schedules, terminated by NULL.
+     * Pending events are saved into checkpoints by their index.
+     */
+    const dev_event_fnc_t *events;
+
+    /** Export the device counters to the statistics endpoint. */
+    void (*stats)(struct device *dev, struct statsrv *stats);
 } device_type_t;
 
 /** Structure describing a device instance.
@@ -71,6 +118,12 @@ typedef struct device {
                      Must be unique. */
     void *data; /**< Device specific pointer where
                      internal data are stored. */
+
+    uint64_t mmio_read_bytes; /**< Register bytes read (see mixstat) */
+    uint64_t mmio_write_bytes; /**< Register bytes written (see mixstat) */
+
+    struct device *name_next; /**< Next device in the same bucket
+                                   of the name hash table. */
 } device_t;
 
 typedef enum {
@@ -79,6 +132,7 @@ typedef enum {
     DEVICE_FILTER_STEP4K,
     DEVICE_FILTER_MEMORY,
     DEVICE_FILTER_R4K_PROCESSOR,
+    DEVICE_FILTER_PROCESSOR,
 } device_filter_t;
 
 /**
@@ -98,6 +152,7 @@ extern device_t *alloc_device(const char *type_string,
 extern void free_device(device_t *dev);
 extern void add_device(device_t *dev);
 extern void dev_remove(device_t *dev);
+extern void dev_remove_all(void);
 
 extern device_t *dev_by_name(const char *name);
 extern const char *dev_type_by_partial_name(const char *prefix_name,
@@ -109,6 +164,37 @@ extern size_t dev_count_by_partial_name(const char *prefix_name,
 
 extern bool dev_next(device_t **dev, device_filter_t filter);
 
+/*
+ * Device scheduling
+ */
+extern void dev_step_all(void);
+extern void dev_step_all_profiled(void);
+extern void dev_step_peripherals(void);
+extern uint64_t dev_step_cpus(uint64_t cycles);
+extern void dev_park_cpus(bool enable);
+extern void dev_step4k_all(void);
+extern void dev_schedule(device_t *dev, uint64_t delay, dev_event_fnc_t fnc);
+extern void dev_cancel(device_t *dev);
+extern void dev_run_events(void);
+extern uint64_t dev_quiet_cycles(void);
+extern bool dev_events_pending(void);
+extern bool dev_save_events(struct checkpoint *ckpt);
+extern bool dev_load_events(struct checkpoint *ckpt);
+
+/*
+ * Device register windows
+ */
+extern void dev_map(device_t *dev, ptr36_t addr, uint64_t size);
+extern void dev_unmap(device_t *dev);
+extern void dev_read8(unsigned int procno, ptr36_t addr, uint8_t *val);
+extern void dev_read16(unsigned int procno, ptr36_t addr, uint16_t *val);
+extern void dev_read32(unsigned int procno, ptr36_t addr, uint32_t *val);
+extern void dev_read64(unsigned int procno, ptr36_t addr, uint64_t *val);
+extern bool dev_write8(unsigned int procno, ptr36_t addr, uint8_t val);
+extern bool dev_write16(unsigned int procno, ptr36_t addr, uint16_t val);
+extern bool dev_write32(unsigned int procno, ptr36_t addr, uint32_t val);
+extern bool dev_write64(unsigned int procno, ptr36_t addr, uint64_t val);
+
 /*
  * General utilities
  */
@@ -0,0 +1,596 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  External device
+ *
+ *  The registers of the device are simulated by another process (e.g.
+ *  an RTL model) attached to a POSIX shared memory object with a ring
+ *  of requests and a ring of responses (see dext.h). The register
+ *  writes are posted, they are published to the device in batches
+ *  together with the next read, the next tick or once the ring fills
+ *  up. The reads wait for their values. Every quantum of cycles the
+ *  device is told the cycles elapsed and the simulation waits until
+ *  it catches up, so the device lags behind by a quantum at most and
+ *  its interrupt changes take effect at the ticks (and the reads).
+ *  No system call is made unless the device stays behind for long.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../../config.h"
+#include "../assert.h"
+#include "../debug/statsrv.h"
+#include "../fault.h"
+#include "../main.h"
+#include "../text.h"
+#include "../utils.h"
+#include "device.h"
+#include "dext.h"
+#include "dplic.h"
+
+/** Default cycles between the ticks */
+#define DEFAULT_QUANTUM 1000
+
+/** Seconds the device may stay silent before it is detached */
+#define DEXT_TIMEOUT 10
+
+/** Spins between the checks of the timeout */
+#define DEXT_SPINS 1024
+
+typedef struct {
+    ptr36_t addr; /**< Register window address */
+    uint64_t size; /**< Register window size */
+    unsigned int intno; /**< Interrupt number */
+    uint64_t quantum; /**< Cycles between the ticks (0 for none) */
+
+    char *shm_name; /**< Shared memory object name */
+    dext_shm_t *shm; /**< Shared memory object */
+    uint32_t head; /**< Requests produced (published or not) */
+    uint32_t tail; /**< Requests known to be consumed */
+    bool connected; /**< False once the device stopped responding */
+    bool ig; /**< Interrupt pending flag */
+
+    uint64_t writes; /**< Posted writes */
+    uint64_t reads; /**< Reads */
+    uint64_t ticks; /**< Ticks */
+    uint64_t intrcount; /**< Interrupts asserted */
+    uint64_t batches; /**< Publications of the requests */
+    uint64_t stalls; /**< Waits for the device longer than the spins */
+} dext_data_t;
+
+/** Monotonic host time in seconds */
+static time_t dext_clock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+/** Wait for the device a while
+ *
+ * The caller spins, after every DEXT_SPINS spins the host processor
+ * is yielded. A device silent for DEXT_TIMEOUT seconds is detached.
+ *
+ * @param spins Spins of the wait so far.
+ * @param since Host time the wait started yielding (0 if not yet).
+ *
+ * @return False if the device has been detached.
+ *
+ */
+static bool dext_stall(device_t *dev, unsigned int *spins, time_t *since)
+{
+    dext_data_t *data = (dext_data_t *) dev->data;
+
+    if (++*spins % DEXT_SPINS != 0) {
+        return true;
+    }
+
+    if (*since == 0) {
+        *since = dext_clock();
+        data->stalls++;
+    } else if (dext_clock() - *since >= DEXT_TIMEOUT) {
+        alert("Device %s does not respond, detached", dev->name);
+        data->connected = false;
+        return false;
+    }
+
+    sched_yield();
+    return true;
+}
+
+/** Publish the requests produced */
+static void dext_flush(dext_data_t *data)
+{
+    dext_ring_t *ring = &data->shm->request;
+
+    if (ring->head != data->head) {
+        __atomic_store_n(&ring->head, data->head, __ATOMIC_RELEASE);
+        data->batches++;
+    }
+}
+
+/** Produce a request
+ *
+ * A full ring is published and the device is waited for.
+ *
+ * @return False if the device is detached.
+ *
+ */
+static bool dext_push(device_t *dev, dext_msg_type_t type, uint32_t size,
+        uint64_t offset, uint64_t value)
+{
+    dext_data_t *data = (dext_data_t *) dev->data;
+    dext_ring_t *ring = &data->shm->request;
+    unsigned int spins = 0;
+    time_t since = 0;
+
+    if (!data->connected) {
+        return false;
+    }
+
+    while (data->head - data->tail == DEXT_RING_SLOTS) {
+        dext_flush(data);
+        data->tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+        if ((data->head - data->tail == DEXT_RING_SLOTS)
+                && (!dext_stall(dev, &spins, &since))) {
+            return false;
+        }
+    }
+
+    dext_msg_t *msg = &ring->slots[data->head % DEXT_RING_SLOTS];
+    msg->type = type;
+    msg->size = size;
+    msg->offset = offset;
+    msg->value = value;
+    msg->cycle = steps;
+
+    data->head++;
+    return true;
+}
+
+/** Change the level of the interrupt */
+static void dext_interrupt(dext_data_t *data, bool level)
+{
+    if (level == data->ig) {
+        return;
+    }
+
+    data->ig = level;
+
+    if (level) {
+        data->intrcount++;
+        plic_interrupt_up(NULL, 0, data->intno);
+    } else {
+        plic_interrupt_down(NULL, 0, data->intno);
+    }
+}
+
+/** Publish the requests and wait for a response
+ *
+ * The interrupt changes received meanwhile take effect.
+ *
+ * @param type  Type of the response waited for.
+ * @param value Value of the response.
+ *
+ * @return False if the device is detached.
+ *
+ */
+static bool dext_receive(device_t *dev, dext_msg_type_t type, uint64_t *value)
+{
+    dext_data_t *data = (dext_data_t *) dev->data;
+    dext_ring_t *ring = &data->shm->response;
+    unsigned int spins = 0;
+    time_t since = 0;
+
+    dext_flush(data);
+
+    while (data->connected) {
+        uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint32_t tail = ring->tail;
+
+        if (head == tail) {
+            dext_stall(dev, &spins, &since);
+            continue;
+        }
+
+        dext_msg_t msg = ring->slots[tail % DEXT_RING_SLOTS];
+        __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+        if (msg.type == DEXT_IRQ) {
+            dext_interrupt(data, msg.value != 0);
+        } else if (msg.type == type) {
+            *value = msg.value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void dext_tick(device_t *dev);
+
+/** Schedule the next tick (none without the quantum) */
+static void dext_schedule(device_t *dev)
+{
+    dext_data_t *data = (dext_data_t *) dev->data;
+
+    dev_cancel(dev);
+
+    if ((data->quantum > 0) && (data->connected)) {
+        dev_schedule(dev, data->quantum, dext_tick);
+    }
+}
+
+/** Tick of the device
+ *
+ * Tells the device a quantum of cycles has elapsed and waits until
+ * it catches up.
+ *
+ */
+static void dext_tick(device_t *dev)
+{
+    dext_data_t *data = (dext_data_t *) dev->data;
+    uint64_t cycles;
+
+    data->ticks++;
+
+    if (dext_push(dev, DEXT_TICK, 0, 0, data->quantum)
+            && dext_receive(dev, DEXT_TICK, &cycles)) {
+        dext_schedule(dev);
+    }
+}
+
+/** Read a register
+ *
+ * A detached device reads as zeros.
+ *
+ */
+static uint64_t dext_read(device_t *dev, ptr36_t addr, uint32_t size)
+{
+    dext_data_t *data = (dext_data_t *) dev->data;
+    uint64_t value = 0;
+
+    data->reads++;
+
+    if (!dext_push(dev, DEXT_READ, size, addr - data->addr, 0)
+            || !dext_receive(dev, DEXT_DATA, &value)) {
+        return 0;
+    }
+
+    return value;
+}
+
+/** Post a register write */
+static void dext_write(device_t *dev, ptr36_t addr, uint32_t size, uint64_t value)
+{
+    dext_data_t *data = (dext_data_t *) dev->data;
+
+    data->writes++;
+    dext_push(dev, DEXT_WRITE, size, addr - data->addr, value);
+}
+
+/** Init command implementation
+ *
+ * Creates the shared memory object the device is attached to.
+ *
+ */
+static bool dext_init(token_t *parm, device_t *dev)
+{
+    parm_next(&parm);
+    uint64_t _addr = parm_uint_next(&parm);
+    uint64_t _size = parm_uint_next(&parm);
+    uint64_t _intno = parm_uint_next(&parm);
+    const char *const name = parm_str(parm);
+
+    if (!phys_range(_addr)) {
+        error("Physical memory address out of range");
+        return false;
+    }
+
+    if ((_size == 0) || (!phys_range(_addr + _size))) {
+        error("Invalid size, registers would exceed the physical "
+              "memory range");
+        return false;
+    }
+
+    if (!ptr36_dword_aligned(_addr)) {
+        error("Physical memory address must be 8-byte aligned");
+        return false;
+    }
+
+    if (_intno > MAX_INTRS) {
+        error("%s", txt_intnum_range);
+        return false;
+    }
+
+    if ((name[0] != '/') || (name[1] == 0) || (strchr(name + 1, '/') != NULL)) {
+        error("Shared memory object name has to start with a slash and "
+              "contain no other slash");
+        return false;
+    }
+
+#ifdef HAVE_SHM_OPEN
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        io_error(name);
+        return false;
+    }
+
+    if ((ftruncate(fd, 0) != 0) || (ftruncate(fd, sizeof(dext_shm_t)) != 0)) {
+        io_error(name);
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+
+    void *ptr = mmap(NULL, sizeof(dext_shm_t), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (ptr == MAP_FAILED) {
+        io_error(name);
+        shm_unlink(name);
+        return false;
+    }
+
+    dext_data_t *data = safe_malloc_t(dext_data_t);
+    dev->data = data;
+
+    data->addr = _addr;
+    data->size = _size;
+    data->intno = _intno;
+    data->quantum = DEFAULT_QUANTUM;
+    data->shm_name = safe_strdup(name);
+    data->shm = (dext_shm_t *) ptr;
+    data->head = 0;
+    data->tail = 0;
+    data->connected = true;
+    data->ig = false;
+    data->writes = 0;
+    data->reads = 0;
+    data->ticks = 0;
+    data->intrcount = 0;
+    data->batches = 0;
+    data->stalls = 0;
+
+    data->shm->version = DEXT_VERSION;
+    data->shm->slots = DEXT_RING_SLOTS;
+    data->shm->window = _size;
+    __atomic_store_n(&data->shm->magic, DEXT_MAGIC, __ATOMIC_RELEASE);
+
+    dev_map(dev, data->addr, data->size);
+    dext_schedule(dev);
+
+    return true;
+#else
+    error("Shared memory is not supported on this host");
+    return false;
+#endif
+}
+
+/** Info command implementation
+ *
+ */
+static bool dext_info(token_t *parm, device_t *dev)
+{
+    dext_data_t *data = (dext_data_t *) dev->data;
+    char *size = uint64_human_readable(data->size);
+
+    printf("[address ] [size    ] [int] [quantum ] [ig] [state   ]\n");
+    printf("%#11" PRIx64 " %-10s %-5u %-10" PRIu64 " %-4u %s\n",
+            data->addr, size, data->intno, data->quantum, data->ig,
+            !data->connected ? "detached"
+                    : (data->shm->attached ? "attached" : "waiting"));
+    printf("Shared memory object %s\n", data->shm_name);
+
+    safe_free(size);
+    return true;
+}
+
+/** Stat command implementation
+ *
+ */
+static bool dext_stat(token_t *parm, device_t *dev)
+{
+    dext_data_t *data = (dext_data_t *) dev->data;
+
+    printf("[writes            ] [reads             ] [ticks             ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n",
+            data->writes, data->reads, data->ticks);
+    printf("[interrupt count   ] [batches           ] [stalls            ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n",
+            data->intrcount, data->batches, data->stalls);
+
+    return true;
+}
+
+/** Quantum command implementation
+ *
+ * Print or set the number of cycles between the ticks. The next tick
+ * comes a new quantum after the command.
+ *
+ */
+static bool dext_quantum(token_t *parm, device_t *dev)
+{
+    dext_data_t *data = (dext_data_t *) dev->data;
+
+    if (parm_type(parm) == tt_end) {
+        printf("Quantum: %" PRIu64 " cycles\n", data->quantum);
+        return true;
+    }
+
+    data->quantum = parm_uint(parm);
+    dext_schedule(dev);
+
+    return true;
+}
+
+/** Clean up the device
+ *
+ * The device is told the simulator has detached and the shared memory
+ * object is removed.
+ *
+ */
+static void dext_done(device_t *dev)
+{
+    dext_data_t *data = (dext_data_t *) dev->data;
+
+    if (dext_push(dev, DEXT_STOP, 0, 0, 0)) {
+        dext_flush(data);
+    }
+
+    munmap(data->shm, sizeof(dext_shm_t));
+#ifdef HAVE_SHM_OPEN
+    shm_unlink(data->shm_name);
+#endif
+
+    safe_free(data->shm_name);
+    safe_free(dev->data);
+}
+
+static void dext_read8(unsigned int procno, device_t *dev, ptr36_t addr, uint8_t *val)
+{
+    *val = (uint8_t) dext_read(dev, addr, sizeof(*val));
+}
+
+static void dext_read16(unsigned int procno, device_t *dev, ptr36_t addr, uint16_t *val)
+{
+    *val = (uint16_t) dext_read(dev, addr, sizeof(*val));
+}
+
+static void dext_read32(unsigned int procno, device_t *dev, ptr36_t addr, uint32_t *val)
+{
+    *val = (uint32_t) dext_read(dev, addr, sizeof(*val));
+}
+
+static void dext_read64(unsigned int procno, device_t *dev, ptr36_t addr, uint64_t *val)
+{
+    *val = dext_read(dev, addr, sizeof(*val));
+}
+
+static void dext_write8(unsigned int procno, device_t *dev, ptr36_t addr, uint8_t val)
+{
+    dext_write(dev, addr, sizeof(val), val);
+}
+
+static void dext_write16(unsigned int procno, device_t *dev, ptr36_t addr, uint16_t val)
+{
+    dext_write(dev, addr, sizeof(val), val);
+}
+
+static void dext_write32(unsigned int procno, device_t *dev, ptr36_t addr, uint32_t val)
+{
+    dext_write(dev, addr, sizeof(val), val);
+}
+
+static void dext_write64(unsigned int procno, device_t *dev, ptr36_t addr, uint64_t val)
+{
+    dext_write(dev, addr, sizeof(val), val);
+}
+
+/** Export the device counters to the statistics endpoint
+ *
+ */
+static void dext_stats(device_t *dev, statsrv_t *stats)
+{
+    dext_data_t *data = (dext_data_t *) dev->data;
+
+    statsrv_counter(stats, "dext_reads_total", "External device reads",
+            data->reads);
+    statsrv_counter(stats, "dext_writes_total", "External device writes",
+            data->writes);
+    statsrv_counter(stats, "dext_stalls_total",
+            "Waits for the external device longer than the spins",
+            data->stalls);
+}
+
+/*
+ * Device commands
+ */
+
+static cmd_t dext_cmds[] = {
+    { "init",
+            (fcmd_t) dext_init,
+            DEFAULT,
+            DEFAULT,
+            "Initialization",
+            "Initialization",
+            REQ STR "name/device name" NEXT
+                    REQ INT "addr/register address" NEXT
+                            REQ INT "size/register window size" NEXT
+                                    REQ INT "intno/interrupt number" NEXT
+                                            REQ STR "shm/shared memory object name" END },
+    { "help",
+            (fcmd_t) dev_generic_help,
+            DEFAULT,
+            DEFAULT,
+            "Display this help text",
+            "Display this help text",
+            OPT STR "cmd/command name" END },
+    { "info",
+            (fcmd_t) dext_info,
+            DEFAULT,
+            DEFAULT,
+            "Display device state and configuration",
+            "Display device state and configuration",
+            NOCMD },
+    { "stat",
+            (fcmd_t) dext_stat,
+            DEFAULT,
+            DEFAULT,
+            "Display device statistics",
+            "Display device statistics",
+            NOCMD },
+    { "quantum",
+            (fcmd_t) dext_quantum,
+            DEFAULT,
+            DEFAULT,
+            "Print or set the cycles between the ticks",
+            "Without arguments prints the number of cycles the device is told about at once (1000 by default). The device lags behind by a quantum at most, zero stops the ticks.",
+            OPT INT "cycles/cycles between the ticks" END },
+    LAST_CMD
+};
+
+device_type_t dext = {
+    /* The device is simulated by another process */
+    .nondet = true,
+
+    /* Type name and description */
+    .name = "dext",
+    .brief = "External device",
+    .full = "Device whose registers, interrupt and time are simulated "
+            "by another process attached to a shared memory object. "
+            "The register writes are posted, the reads wait for the "
+            "values and the device is ticked every quantum of cycles.",
+
+    /* Functions */
+    .done = dext_done,
+    .read8 = dext_read8,
+    .read16 = dext_read16,
+    .read32 = dext_read32,
+    .read64 = dext_read64,
+    .write8 = dext_write8,
+    .write16 = dext_write16,
+    .write32 = dext_write32,
+    .write64 = dext_write64,
+
+    /* Commands */
+    .cmds = dext_cmds,
+    .stats = dext_stats
+};
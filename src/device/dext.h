@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  External device
+ *
+ *  The layout of the shared memory object is the protocol between
+ *  the simulator and the process simulating the device.
+ *
+ */
+
+#ifndef DEXT_H_
+#define DEXT_H_
+
+#include <stdint.h>
+
+#include "device.h"
+
+/** Magic number of the shared memory object ("DEXT") */
+#define DEXT_MAGIC UINT32_C(0x54584544)
+
+/** Version of the protocol */
+#define DEXT_VERSION 1
+
+/** Messages of a ring (a power of two) */
+#define DEXT_RING_SLOTS 256
+
+/** Types of the messages */
+typedef enum {
+    DEXT_WRITE = 1, /**< Posted register write (simulator to device) */
+    DEXT_READ = 2, /**< Register read, answered by DEXT_DATA */
+    DEXT_TICK = 3, /**< Cycles elapsed, answered by DEXT_TICK */
+    DEXT_DATA = 4, /**< Value of the register read (device to simulator) */
+    DEXT_IRQ = 5, /**< Level of the interrupt (device to simulator) */
+    DEXT_STOP = 6 /**< The simulator has detached */
+} dext_msg_type_t;
+
+/** Message */
+typedef struct {
+    uint32_t type; /**< Message type (dext_msg_type_t) */
+    uint32_t size; /**< Bytes of the register access */
+    uint64_t offset; /**< Register offset within the window */
+    uint64_t value; /**< Value written or read, cycles or interrupt level */
+    uint64_t cycle; /**< Machine cycle of the message */
+} dext_msg_t;
+
+/** Single producer, single consumer ring of messages
+ *
+ * The producer fills the slots and then publishes them all by a store
+ * of the head, the consumer frees them by a store of the tail. Both
+ * counters run freely, the slot of a message is its counter modulo
+ * the number of slots.
+ *
+ */
+typedef struct {
+    uint32_t head; /**< Messages produced */
+    uint8_t head_pad[60];
+    uint32_t tail; /**< Messages consumed */
+    uint8_t tail_pad[60];
+    dext_msg_t slots[DEXT_RING_SLOTS];
+} dext_ring_t;
+
+/** Shared memory object of an external device
+ *
+ * The simulator creates the object and stores the magic number last.
+ * The device sets the attached flag once it serves the requests.
+ *
+ */
+typedef struct {
+    uint32_t magic; /**< DEXT_MAGIC once the object is ready */
+    uint32_t version; /**< DEXT_VERSION */
+    uint32_t slots; /**< DEXT_RING_SLOTS */
+    uint32_t attached; /**< Nonzero once the device is attached */
+    uint64_t window; /**< Size of the register window */
+    uint8_t pad[40];
+    dext_ring_t request; /**< Messages to the device */
+    dext_ring_t response; /**< Messages to the simulator */
+} dext_shm_t;
+
+extern device_type_t dext;
+
+#endif
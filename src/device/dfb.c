@@ -0,0 +1,909 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Linear framebuffer device
+ *
+ *  The pixels are 32-bit words (0x00RRGGBB) in a block of a generic
+ *  memory area, so that the guests draw by plain stores into memory.
+ *  The device only publishes the picture: the area tracks the frames
+ *  written to (see physmem_track_writes()), which costs one slow store
+ *  into each frame per refresh, and a refresh turns the runs of the
+ *  written frames into rectangles of the picture. The rectangles go
+ *  into a stream file (a pipe read by a viewer) and the whole picture
+ *  into PNG images, only when something has changed.
+ *
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../assert.h"
+#include "../checkpoint.h"
+#include "../debug/statsrv.h"
+#include "../endian.h"
+#include "../fault.h"
+#include "../main.h"
+#include "../physmem.h"
+#include "../text.h"
+#include "../utils.h"
+#include "device.h"
+#include "dfb.h"
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+/** \{ \name Register offsets */
+#define REGISTER_WIDTH 0 /**< Width in pixels (read only) */
+#define REGISTER_HEIGHT 4 /**< Height in pixels (read only) */
+#define REGISTER_STRIDE 8 /**< Bytes per line (read only) */
+#define REGISTER_CONTROL 12 /**< Control bits */
+#define REGISTER_FRAMES 16 /**< Published pictures (read) */
+#define REGISTER_FLUSH 16 /**< Refresh now (write) */
+#define REGISTER_LIMIT 20 /**< Size of register block */
+/* \} */
+
+/** \{ \name Control flags */
+#define CONTROL_ENABLE 0x01 /**< Publish the picture */
+/* \} */
+
+/** Largest width and height of the picture */
+#define MAX_SIZE 4096
+
+/** Default refresh period (in cycles) */
+#define DEFAULT_REFRESH 16666
+
+/** Bytes per pixel */
+#define PIXEL_SIZE 4
+
+/** Suffix of the picture file names (dash, 20 digits of the frame and ".png") */
+#define PNG_SUFFIX_SIZE (1 + 20 + 4)
+
+/** Magic number at the start of the stream */
+#define STREAM_MAGIC 0x4246534d /* "MSFB" */
+
+/** Rectangle of the picture */
+typedef struct {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+} fb_rect_t;
+
+typedef struct {
+    ptr36_t addr; /**< Register address */
+    ptr36_t vram; /**< Address of the pixels */
+    uint32_t width; /**< Width in pixels */
+    uint32_t height; /**< Height in pixels */
+    uint32_t stride; /**< Bytes per line */
+    physmem_area_t *area; /**< Memory area of the pixels */
+
+    uint32_t control; /**< Control register */
+    uint64_t refresh; /**< Refresh period (in cycles) */
+    bool full; /**< The next refresh publishes the whole picture */
+
+    fb_rect_t *rects; /**< Rectangles of a refresh */
+    size_t rect_limit; /**< Size of the rectangle array */
+
+    FILE *stream; /**< Stream of the rectangles (NULL if none) */
+    char *stream_fname; /**< Name of the stream file */
+    char *png_prefix; /**< Prefix of the PNG images (NULL if none) */
+
+    uint64_t frames; /**< Pictures published */
+    uint64_t rect_count; /**< Rectangles published */
+    uint64_t bytes; /**< Bytes of the pixels published */
+} fb_data_t;
+
+/** Size of the pixel block in bytes */
+static inline len36_t fb_size(fb_data_t *data)
+{
+    return (len36_t) data->stride * data->height;
+}
+
+/** Find the frames of the pixels within the memory area
+ *
+ * @param first First frame (relative to the area start, returned).
+ * @param count Number of frames (returned).
+ *
+ * @return False if the area does not contain the pixels (any more).
+ *
+ */
+static bool fb_frames(fb_data_t *data, pfn_t *first, pfn_t *count)
+{
+    physmem_area_t *area = data->area;
+
+    if ((area->frames == NULL) || (area->written == NULL)) {
+        return false;
+    }
+
+    ptr36_t start = FRAME2ADDR(area->start);
+    ptr36_t end = data->vram + fb_size(data);
+
+    if ((data->vram < start) || (end > start + FRAMES2SIZE(area->count))) {
+        return false;
+    }
+
+    *first = ADDR2FRAME(data->vram - start);
+    *count = ADDR2FRAME(ALIGN_UP(end - start, FRAME_SIZE)) - *first;
+    return true;
+}
+
+/** Read a pixel of the picture
+ *
+ */
+static inline uint32_t fb_pixel(fb_data_t *data, uint32_t x, uint32_t y)
+{
+    physmem_area_t *area = data->area;
+    ptr36_t offset = data->vram - FRAME2ADDR(area->start)
+            + (ptr36_t) y * data->stride + (ptr36_t) x * PIXEL_SIZE;
+
+    uint32_t pixel;
+    memcpy(&pixel, area->data + offset, sizeof(pixel));
+    return convert_uint32_t_endian(pixel) & 0x00ffffff;
+}
+
+/** Store a word in the little-endian byte order
+ *
+ */
+static inline void fb_put32le(uint8_t *buf, uint32_t val)
+{
+    buf[0] = val;
+    buf[1] = val >> 8;
+    buf[2] = val >> 16;
+    buf[3] = val >> 24;
+}
+
+/** Store a word in the big-endian byte order
+ *
+ */
+static inline void fb_put32be(uint8_t *buf, uint32_t val)
+{
+    buf[0] = val >> 24;
+    buf[1] = val >> 16;
+    buf[2] = val >> 8;
+    buf[3] = val;
+}
+
+/** Close the stream
+ *
+ */
+static void fb_stream_close(fb_data_t *data)
+{
+    if (data->stream != NULL) {
+        safe_fclose(data->stream, data->stream_fname);
+        safe_free(data->stream_fname);
+        data->stream = NULL;
+    }
+}
+
+/** Write the rectangles into the stream
+ *
+ * Each rectangle is a header of five little-endian words (the number
+ * of the picture, x, y, width and height) followed by the pixels
+ * of the rectangle line by line, one little-endian word each.
+ * The stream is closed if it cannot be written to.
+ *
+ */
+static void fb_stream_write(fb_data_t *data, size_t count)
+{
+    uint8_t *line = (uint8_t *) safe_malloc(data->width * PIXEL_SIZE);
+    bool ok = true;
+
+    for (size_t i = 0; (ok) && (i < count); i++) {
+        fb_rect_t *rect = &data->rects[i];
+        uint8_t header[5 * sizeof(uint32_t)];
+
+        fb_put32le(header, data->frames);
+        fb_put32le(header + 4, rect->x);
+        fb_put32le(header + 8, rect->y);
+        fb_put32le(header + 12, rect->width);
+        fb_put32le(header + 16, rect->height);
+        ok = fwrite(header, sizeof(header), 1, data->stream) == 1;
+
+        for (uint32_t y = rect->y; (ok) && (y < rect->y + rect->height); y++) {
+            for (uint32_t x = 0; x < rect->width; x++) {
+                fb_put32le(line + x * PIXEL_SIZE, fb_pixel(data, rect->x + x, y));
+            }
+
+            ok = fwrite(line, rect->width * PIXEL_SIZE, 1, data->stream) == 1;
+        }
+    }
+
+    safe_free(line);
+
+    if ((ok) && (fflush(data->stream) == 0)) {
+        return;
+    }
+
+    io_error(data->stream_fname);
+    fb_stream_close(data);
+}
+
+#ifdef HAVE_LIBZ
+
+/** Write a PNG chunk
+ *
+ */
+static bool fb_png_chunk(FILE *file, const char *type, const uint8_t *payload,
+        size_t size)
+{
+    uint8_t buf[4];
+    uLong crc = crc32(0, (const Bytef *) type, 4);
+
+    if (size > 0) {
+        crc = crc32(crc, payload, size);
+    }
+
+    fb_put32be(buf, size);
+    bool ok = (fwrite(buf, sizeof(buf), 1, file) == 1)
+            && (fwrite(type, 4, 1, file) == 1)
+            && ((size == 0) || (fwrite(payload, size, 1, file) == 1));
+
+    fb_put32be(buf, crc);
+    return (ok) && (fwrite(buf, sizeof(buf), 1, file) == 1);
+}
+
+/** Write the whole picture into a PNG image
+ *
+ * The image is named by the prefix and the number of the picture.
+ *
+ */
+static void fb_png_write(fb_data_t *data)
+{
+    static const uint8_t signature[] = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+    };
+
+    size_t line = 1 + data->width * 3;
+    size_t raw_size = line * data->height;
+    uint8_t *raw = (uint8_t *) safe_malloc(raw_size);
+
+    for (uint32_t y = 0; y < data->height; y++) {
+        uint8_t *ptr = raw + y * line;
+
+        /* No filter */
+        *ptr++ = 0;
+
+        for (uint32_t x = 0; x < data->width; x++) {
+            uint32_t pixel = fb_pixel(data, x, y);
+            *ptr++ = pixel >> 16;
+            *ptr++ = pixel >> 8;
+            *ptr++ = pixel;
+        }
+    }
+
+    uLongf zsize = compressBound(raw_size);
+    uint8_t *zdata = (uint8_t *) safe_malloc(zsize);
+    int rc = compress2(zdata, &zsize, raw, raw_size, Z_BEST_SPEED);
+    safe_free(raw);
+
+    if (rc != Z_OK) {
+        safe_free(zdata);
+        error("Compressing the picture failed");
+        return;
+    }
+
+    /* 8-bit RGB, no interlace */
+    uint8_t ihdr[13];
+    fb_put32be(ihdr, data->width);
+    fb_put32be(ihdr + 4, data->height);
+    ihdr[8] = 8;
+    ihdr[9] = 2;
+    ihdr[10] = 0;
+    ihdr[11] = 0;
+    ihdr[12] = 0;
+
+    size_t fname_size = strlen(data->png_prefix) + PNG_SUFFIX_SIZE + 1;
+    char *fname = safe_malloc(fname_size);
+    snprintf(fname, fname_size, "%s-%06" PRIu64 ".png", data->png_prefix, data->frames);
+
+    FILE *file = try_fopen(fname, "wb");
+
+    if (file != NULL) {
+        bool ok = (fwrite(signature, sizeof(signature), 1, file) == 1)
+                && (fb_png_chunk(file, "IHDR", ihdr, sizeof(ihdr)))
+                && (fb_png_chunk(file, "IDAT", zdata, zsize))
+                && (fb_png_chunk(file, "IEND", NULL, 0));
+
+        if (!ok) {
+            io_error(fname);
+        }
+
+        safe_fclose(file, fname);
+    }
+
+    safe_free(fname);
+    safe_free(zdata);
+}
+
+#endif /* HAVE_LIBZ */
+
+/** Add the bytes of the pixel block to the rectangles
+ *
+ * The bytes within a single line give the rectangle of the pixels
+ * they cover, the bytes over several lines give whole lines. The
+ * rectangle is merged with the previous one if their lines touch.
+ *
+ * @param offset First byte (relative to the pixel block).
+ * @param size   Number of the bytes.
+ *
+ */
+static void fb_rect_add(fb_data_t *data, size_t *count, len36_t offset,
+        len36_t size)
+{
+    uint32_t y0 = offset / data->stride;
+    uint32_t y1 = (offset + size - 1) / data->stride;
+
+    fb_rect_t rect = {
+        .x = 0,
+        .y = y0,
+        .width = data->width,
+        .height = y1 - y0 + 1
+    };
+
+    if (y0 == y1) {
+        uint32_t x0 = (offset % data->stride) / PIXEL_SIZE;
+        uint32_t x1 = ((offset + size - 1) % data->stride) / PIXEL_SIZE + 1;
+
+        if (x0 >= data->width) {
+            return;
+        }
+
+        rect.x = x0;
+        rect.width = MIN(x1, data->width) - x0;
+    }
+
+    if (*count > 0) {
+        fb_rect_t *prev = &data->rects[*count - 1];
+
+        if (rect.y <= prev->y + prev->height) {
+            uint32_t x0 = MIN(prev->x, rect.x);
+            uint32_t x1 = MAX(prev->x + prev->width, rect.x + rect.width);
+
+            prev->height = rect.y + rect.height - prev->y;
+            prev->x = x0;
+            prev->width = x1 - x0;
+            return;
+        }
+    }
+
+    ASSERT(*count < data->rect_limit);
+    data->rects[(*count)++] = rect;
+}
+
+/** Publish the changes of the picture
+ *
+ * The runs of the frames written to since the last refresh (all the
+ * frames after a change of the outputs) give the rectangles which
+ * are published. Nothing is published if nothing has changed.
+ *
+ */
+static void fb_refresh(fb_data_t *data)
+{
+    pfn_t first;
+    pfn_t count;
+
+    if (!fb_frames(data, &first, &count)) {
+        return;
+    }
+
+    ptr36_t base = data->vram - FRAME2ADDR(data->area->start);
+    len36_t size = fb_size(data);
+    size_t rects = 0;
+    pfn_t pfn = first;
+
+    while (pfn < first + count) {
+        if ((!data->full) && (!data->area->written[pfn])) {
+            pfn++;
+            continue;
+        }
+
+        pfn_t run = pfn;
+        while ((pfn < first + count)
+                && ((data->full) || (data->area->written[pfn]))) {
+            pfn++;
+        }
+
+        /* The run clipped to the pixel block */
+        ptr36_t from = MAX(FRAMES2SIZE(run), base);
+        ptr36_t to = MIN(FRAMES2SIZE(pfn), base + size);
+
+        fb_rect_add(data, &rects, from - base, to - from);
+    }
+
+    physmem_written_clear(data->area, first, count);
+    data->full = false;
+
+    if (rects == 0) {
+        return;
+    }
+
+    if (data->stream != NULL) {
+        fb_stream_write(data, rects);
+    }
+
+#ifdef HAVE_LIBZ
+    if (data->png_prefix != NULL) {
+        fb_png_write(data);
+    }
+#endif
+
+    for (size_t i = 0; i < rects; i++) {
+        data->bytes += (uint64_t) data->rects[i].width * data->rects[i].height
+                * PIXEL_SIZE;
+    }
+
+    data->rect_count += rects;
+    data->frames++;
+}
+
+/** Periodic refresh
+ *
+ */
+static void fb_refresh_event(device_t *dev)
+{
+    fb_data_t *data = (fb_data_t *) dev->data;
+
+    fb_refresh(data);
+    dev_schedule(dev, data->refresh, fb_refresh_event);
+}
+
+/** Start or stop the periodic refresh by the control register
+ *
+ * An enabled framebuffer publishes the whole picture first.
+ *
+ */
+static void fb_start(device_t *dev)
+{
+    fb_data_t *data = (fb_data_t *) dev->data;
+
+    dev_cancel(dev);
+
+    if (data->control & CONTROL_ENABLE) {
+        data->full = true;
+        dev_schedule(dev, data->refresh, fb_refresh_event);
+    }
+}
+
+/** Init command implementation
+ *
+ * The pixels have to lie in a writable generic memory area
+ * which is not tracked by another framebuffer.
+ *
+ */
+static bool dfb_init(token_t *parm, device_t *dev)
+{
+    parm_next(&parm);
+    uint64_t _addr = parm_uint_next(&parm);
+    uint64_t _vram = parm_uint_next(&parm);
+    uint64_t _width = parm_uint_next(&parm);
+    uint64_t _height = parm_uint_next(&parm);
+
+    if (!phys_range(_addr)) {
+        error("Physical memory address out of range");
+        return false;
+    }
+
+    if (!phys_range(_addr + (uint64_t) REGISTER_LIMIT)) {
+        error("Invalid address, registers would exceed the physical "
+              "memory range");
+        return false;
+    }
+
+    ptr36_t addr = _addr;
+
+    if (!ptr36_dword_aligned(addr)) {
+        error("Physical memory address must be 8-byte aligned");
+        return false;
+    }
+
+    if ((_width == 0) || (_width > MAX_SIZE) || (_height == 0)
+            || (_height > MAX_SIZE)) {
+        error("Picture size out of range 1..%u", MAX_SIZE);
+        return false;
+    }
+
+    uint64_t size = _width * _height * PIXEL_SIZE;
+
+    if ((!phys_range(_vram)) || (!phys_range(_vram + size - 1))) {
+        error("Pixels would exceed the physical memory range");
+        return false;
+    }
+
+    ptr36_t vram = _vram;
+
+    if ((vram & 3) != 0) {
+        error("Pixel address must be 4-byte aligned");
+        return false;
+    }
+
+    frame_t *frame = physmem_find_frame(vram);
+    physmem_area_t *area = (frame != NULL) ? frame->area : NULL;
+
+    if ((area == NULL) || (area->type != MEMT_MEM) || (!area->writable)
+            || (vram + size > FRAME2ADDR(area->start + area->count))) {
+        error("Pixels have to lie in a generic read/write memory");
+        return false;
+    }
+
+    if (area->track_writes) {
+        error("Memory already used by another framebuffer");
+        return false;
+    }
+
+    fb_data_t *data = safe_malloc_t(fb_data_t);
+    dev->data = data;
+
+    data->addr = addr;
+    data->vram = vram;
+    data->width = _width;
+    data->height = _height;
+    data->stride = _width * PIXEL_SIZE;
+    data->area = area;
+    data->control = 0;
+    data->refresh = DEFAULT_REFRESH;
+    data->full = true;
+    data->rect_limit = SIZE2FRAMES(size) + 1;
+    data->rects = (fb_rect_t *) safe_malloc(data->rect_limit * sizeof(fb_rect_t));
+    data->stream = NULL;
+    data->stream_fname = NULL;
+    data->png_prefix = NULL;
+    data->frames = 0;
+    data->rect_count = 0;
+    data->bytes = 0;
+
+    physmem_track_writes(area, true);
+    dev_map(dev, addr, REGISTER_LIMIT);
+
+    return true;
+}
+
+/** Info command implementation
+ *
+ */
+static bool dfb_info(token_t *parm, device_t *dev)
+{
+    fb_data_t *data = (fb_data_t *) dev->data;
+
+    printf("[address ] [pixels  ] [size    ] [refresh ] [state  ]\n");
+    printf("%#11" PRIx64 " %#11" PRIx64 " %4ux%-5u %-10" PRIu64 " %s\n",
+            data->addr, data->vram, data->width, data->height,
+            data->refresh,
+            (data->control & CONTROL_ENABLE) ? "enabled" : "disabled");
+
+    if (data->stream != NULL) {
+        printf("Stream: %s\n", data->stream_fname);
+    }
+
+    if (data->png_prefix != NULL) {
+        printf("Images: %s-NNNNNN.png\n", data->png_prefix);
+    }
+
+    return true;
+}
+
+/** Stat command implementation
+ *
+ */
+static bool dfb_stat(token_t *parm, device_t *dev)
+{
+    fb_data_t *data = (fb_data_t *) dev->data;
+
+    printf("[pictures          ] [rectangles        ] [bytes             ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n",
+            data->frames, data->rect_count, data->bytes);
+
+    return true;
+}
+
+/** Refresh command implementation
+ *
+ * Print or set the refresh period. The refresh already
+ * scheduled keeps its time.
+ *
+ */
+static bool dfb_refresh(token_t *parm, device_t *dev)
+{
+    fb_data_t *data = (fb_data_t *) dev->data;
+
+    if (parm_type(parm) == tt_end) {
+        printf("Refresh: %" PRIu64 " cycles\n", data->refresh);
+        return true;
+    }
+
+    uint64_t refresh = parm_uint(parm);
+
+    if (refresh == 0) {
+        error("Refresh period must be at least one cycle");
+        return false;
+    }
+
+    data->refresh = refresh;
+
+    return true;
+}
+
+/** Stream command implementation
+ *
+ * The stream starts with three little-endian words (the magic number,
+ * the width and the height), the whole picture is published next.
+ *
+ */
+static bool dfb_stream(token_t *parm, device_t *dev)
+{
+    fb_data_t *data = (fb_data_t *) dev->data;
+    const char *fname = parm_str(parm);
+
+    FILE *file = try_fopen(fname, "wb");
+    if (file == NULL) {
+        return false;
+    }
+
+    uint8_t header[3 * sizeof(uint32_t)];
+    fb_put32le(header, STREAM_MAGIC);
+    fb_put32le(header + 4, data->width);
+    fb_put32le(header + 8, data->height);
+
+    if (fwrite(header, sizeof(header), 1, file) != 1) {
+        io_error(fname);
+        safe_fclose(file, fname);
+        return false;
+    }
+
+    fb_stream_close(data);
+
+    data->stream = file;
+    data->stream_fname = safe_strdup(fname);
+    data->full = true;
+
+    return true;
+}
+
+/** Png command implementation
+ *
+ */
+static bool dfb_png(token_t *parm, device_t *dev)
+{
+#ifdef HAVE_LIBZ
+    fb_data_t *data = (fb_data_t *) dev->data;
+
+    safe_free(data->png_prefix);
+    data->png_prefix = safe_strdup(parm_str(parm));
+    data->full = true;
+
+    return true;
+#else
+    error("PNG images are not supported (compiled without zlib)");
+    return false;
+#endif
+}
+
+/** Close command implementation
+ *
+ */
+static bool dfb_close(token_t *parm, device_t *dev)
+{
+    fb_data_t *data = (fb_data_t *) dev->data;
+
+    fb_stream_close(data);
+    safe_free(data->png_prefix);
+
+    return true;
+}
+
+/** Clean up the device
+ *
+ */
+static void fb_done(device_t *dev)
+{
+    fb_data_t *data = (fb_data_t *) dev->data;
+
+    fb_stream_close(data);
+    safe_free(data->png_prefix);
+    safe_free(data->rects);
+    safe_free(dev->data);
+}
+
+static void fb_read32(unsigned int procno, device_t *dev, ptr36_t addr, uint32_t *val)
+{
+    ASSERT(dev != NULL);
+    ASSERT(val != NULL);
+
+    fb_data_t *data = (fb_data_t *) dev->data;
+
+    switch (addr - data->addr) {
+    case REGISTER_WIDTH:
+        *val = data->width;
+        break;
+    case REGISTER_HEIGHT:
+        *val = data->height;
+        break;
+    case REGISTER_STRIDE:
+        *val = data->stride;
+        break;
+    case REGISTER_CONTROL:
+        *val = data->control;
+        break;
+    case REGISTER_FRAMES:
+        *val = (uint32_t) data->frames;
+        break;
+    }
+}
+
+static void fb_write32(unsigned int procno, device_t *dev, ptr36_t addr, uint32_t val)
+{
+    ASSERT(dev != NULL);
+
+    fb_data_t *data = (fb_data_t *) dev->data;
+
+    switch (addr - data->addr) {
+    case REGISTER_CONTROL:
+        data->control = val & CONTROL_ENABLE;
+        fb_start(dev);
+        break;
+    case REGISTER_FLUSH:
+        if (data->control & CONTROL_ENABLE) {
+            fb_refresh(data);
+        }
+        break;
+    }
+}
+
+/** Save the framebuffer state into a checkpoint
+ *
+ * The outputs are not saved, the next refresh is saved
+ * with the device events.
+ *
+ */
+static bool fb_save(device_t *dev, checkpoint_t *ckpt)
+{
+    fb_data_t *data = (fb_data_t *) dev->data;
+
+    return checkpoint_write_var(ckpt, data->control)
+            && checkpoint_write_var(ckpt, data->refresh)
+            && checkpoint_write_var(ckpt, data->frames)
+            && checkpoint_write_var(ckpt, data->rect_count)
+            && checkpoint_write_var(ckpt, data->bytes);
+}
+
+/** Load the framebuffer state from a checkpoint
+ *
+ * The written frames are not known, the whole picture
+ * is published by the next refresh.
+ *
+ */
+static bool fb_load(device_t *dev, checkpoint_t *ckpt)
+{
+    fb_data_t *data = (fb_data_t *) dev->data;
+
+    data->full = true;
+
+    return checkpoint_read_var(ckpt, data->control)
+            && checkpoint_read_var(ckpt, data->refresh)
+            && checkpoint_read_var(ckpt, data->frames)
+            && checkpoint_read_var(ckpt, data->rect_count)
+            && checkpoint_read_var(ckpt, data->bytes);
+}
+
+/** Events scheduled by the framebuffer */
+static const dev_event_fnc_t fb_events[] = {
+    fb_refresh_event,
+    NULL
+};
+
+/** Export the framebuffer counters to the statistics endpoint
+ *
+ */
+static void fb_stats(device_t *dev, statsrv_t *stats)
+{
+    fb_data_t *data = (fb_data_t *) dev->data;
+
+    statsrv_counter(stats, "fb_pictures_total", "Framebuffer pictures published",
+            data->frames);
+    statsrv_counter(stats, "fb_rectangles_total",
+            "Framebuffer rectangles published", data->rect_count);
+    statsrv_counter(stats, "fb_bytes_total", "Framebuffer pixel bytes published",
+            data->bytes);
+}
+
+/*
+ * Device commands
+ */
+
+static cmd_t fb_cmds[] = {
+    { "init",
+            (fcmd_t) dfb_init,
+            DEFAULT,
+            DEFAULT,
+            "Initialization",
+            "Initialization",
+            REQ STR "name/framebuffer name" NEXT
+                    REQ INT "addr/register address" NEXT
+                            REQ INT "pixels/address of the pixels" NEXT
+                                    REQ INT "width/width in pixels" NEXT
+                                            REQ INT "height/height in pixels" END },
+    { "help",
+            (fcmd_t) dev_generic_help,
+            DEFAULT,
+            DEFAULT,
+            "Display this help text",
+            "Display this help text",
+            OPT STR "cmd/command name" END },
+    { "info",
+            (fcmd_t) dfb_info,
+            DEFAULT,
+            DEFAULT,
+            "Display framebuffer state and configuration",
+            "Display framebuffer state and configuration",
+            NOCMD },
+    { "stat",
+            (fcmd_t) dfb_stat,
+            DEFAULT,
+            DEFAULT,
+            "Display framebuffer statistics",
+            "Display framebuffer statistics",
+            NOCMD },
+    { "refresh",
+            (fcmd_t) dfb_refresh,
+            DEFAULT,
+            DEFAULT,
+            "Print or set the refresh period",
+            "Without arguments prints the period of the refresh in cycles (16666 by default).",
+            OPT INT "cycles/refresh period" END },
+    { "stream",
+            (fcmd_t) dfb_stream,
+            DEFAULT,
+            DEFAULT,
+            "Publish the changed rectangles into a file",
+            "The file (or a named pipe read by a viewer) receives a header of three little-endian words (magic number 0x4246534d, width and height) and then the changed rectangles, each as five little-endian words (picture number, x, y, width and height) followed by the 0x00RRGGBB pixels of the rectangle.",
+            REQ STR "fname/stream file name" END },
+    { "png",
+            (fcmd_t) dfb_png,
+            DEFAULT,
+            DEFAULT,
+            "Publish the changed pictures as PNG images",
+            "Each changed picture is written into the image named by the prefix and the picture number (prefix-000000.png etc.).",
+            REQ STR "prefix/image name prefix" END },
+    { "close",
+            (fcmd_t) dfb_close,
+            DEFAULT,
+            DEFAULT,
+            "Stop publishing the picture",
+            "Close the stream and stop writing the images.",
+            NOCMD },
+    LAST_CMD
+};
+
+device_type_t dfb = {
+    /* Framebuffer is simulated deterministically */
+    .nondet = false,
+
+    /* Type name and description */
+    .name = "dfb",
+    .brief = "Linear framebuffer",
+    .full = "Framebuffer publishes the picture drawn by stores into "
+            "a block of a generic memory. Only the rectangles changed "
+            "since the last refresh are published, periodically "
+            "or when requested by the guest.",
+
+    /* Functions */
+    .done = fb_done,
+    .read32 = fb_read32,
+    .write32 = fb_write32,
+
+    /* Commands */
+    .cmds = fb_cmds,
+
+    /* Checkpoints */
+    .save = fb_save,
+    .load = fb_load,
+    .events = fb_events,
+    .stats = fb_stats
+};
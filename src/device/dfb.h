@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Linear framebuffer device
+ *
+ */
+
+#ifndef DFB_H_
+#define DFB_H_
+
+#include "device.h"
+
+extern device_type_t dfb;
+
+#endif
@@ -16,15 +16,17 @@
 #include <unistd.h>
 #include <sys/time.h>
 
-#include "../arch/stdin.h"
 #include "../assert.h"
+#include "../checkpoint.h"
 #include "../env.h"
 #include "../fault.h"
+#include "../replay.h"
 #include "../text.h"
 #include "../utils.h"
 #include "cpu/general_cpu.h"
 #include "device.h"
 #include "dkeyboard.h"
+#include "dplic.h"
 
 /* Register offsets */
 #define REGISTER_CHAR 0
@@ -33,9 +35,15 @@
 typedef struct {
     ptr36_t addr; /* Register address */
     unsigned int intno; /* Interrupt number */
+    device_t *plic; /* Interrupt controller the interrupt is routed to */
+    unsigned int plic_source; /* Source number within the controller */
     char incomming; /* Character buffer */
 
     bool ig; /* Interrupt pending flag */
+    string_t script; /* Scripted key presses */
+    size_t script_pos; /* Next scripted key press */
+    unsigned int replay; /* Source of the keys in the replay log */
+
     uint64_t intrcount; /* Number of interrupts asserted */
     uint64_t keycount; /* Number of keys acquired */
     uint64_t overrun; /* Number of overwritten characters in the buffer. */
@@ -57,7 +65,7 @@ static void gen_key(device_t *dev, char c)
     if (!data->ig) {
         data->ig = true;
         data->intrcount++;
-        cpu_interrupt_up(NULL, data->intno);
+        plic_interrupt_up(data->plic, data->plic_source, data->intno);
     } else {
         /* Increase the number of overrun characters */
         data->overrun++;
@@ -103,11 +111,19 @@ static bool dkeyboard_init(token_t *parm, device_t *dev)
     /* Initialization */
     data->addr = addr;
     data->intno = _intno;
+    data->plic = NULL;
+    data->plic_source = 0;
+    data->incomming = 0;
     data->ig = false;
+    string_init(&data->script);
+    data->script_pos = 0;
+    data->replay = replay_source(dev->name);
     data->intrcount = 0;
     data->keycount = 0;
     data->overrun = 0;
 
+    dev_map(dev, addr, REGISTER_LIMIT);
+
     return true;
 }
 
@@ -181,11 +197,91 @@ static bool dkeyboard_gen(token_t *parm, device_t *dev)
     return true;
 }
 
+/** Generate the next scripted key press
+ *
+ * The key is only generated once the previous one has been read,
+ * so no scripted key press is lost.
+ *
+ */
+static void keyboard_script_next(device_t *dev)
+{
+    keyboard_data_s *data = (keyboard_data_s *) dev->data;
+
+    if ((!data->ig) && (data->script_pos < data->script.pos)) {
+        gen_key(dev, data->script.str[data->script_pos]);
+        data->script_pos++;
+    }
+}
+
+/** Script command implementation
+ *
+ * The contents of the file are queued as key presses, which are
+ * delivered as fast as the system reads them.
+ *
+ */
+static bool dkeyboard_script(token_t *parm, device_t *dev)
+{
+    keyboard_data_s *data = (keyboard_data_s *) dev->data;
+    const char *path = parm_str(parm);
+
+    FILE *file = try_fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+
+    string_fread(&data->script, file);
+    safe_fclose(file, path);
+
+    keyboard_script_next(dev);
+    return true;
+}
+
+/** Route command implementation
+ *
+ * Print or set the interrupt controller the keyboard interrupt is routed
+ * to. A raised interrupt moves to the new route.
+ *
+ */
+static bool dkeyboard_route(token_t *parm, device_t *dev)
+{
+    keyboard_data_s *data = (keyboard_data_s *) dev->data;
+
+    if (parm_type(parm) == tt_end) {
+        if (data->plic == NULL) {
+            printf("Interrupt: %u\n", data->intno);
+        } else {
+            printf("Interrupt: source %u of %s\n", data->plic_source,
+                    data->plic->name);
+        }
+        return true;
+    }
+
+    device_t *plic;
+    unsigned int source;
+
+    if (!plic_route(parm, &plic, &source)) {
+        return false;
+    }
+
+    if (data->ig) {
+        plic_interrupt_down(data->plic, data->plic_source, data->intno);
+        plic_interrupt_up(plic, source, data->intno);
+    }
+
+    data->plic = plic;
+    data->plic_source = source;
+
+    return true;
+}
+
 /** Clean up the device
  *
  */
 static void keyboard_done(device_t *dev)
 {
+    keyboard_data_s *data = (keyboard_data_s *) dev->data;
+
+    string_done(&data->script);
     safe_free(dev->data);
 }
 
@@ -202,24 +298,86 @@ static void keyboard_read32(unsigned int procno, device_t *dev, ptr36_t addr, ui
         data->incomming = 0;
         if (data->ig) {
             data->ig = false;
-            cpu_interrupt_down(NULL, data->intno);
+            plic_interrupt_down(data->plic, data->plic_source, data->intno);
+
+            /* The next scripted key follows at the end of the cycle */
+            if (data->script_pos < data->script.pos) {
+                dev_schedule(dev, 0, keyboard_script_next);
+            }
         }
         break;
     }
 }
 
 /** Keyboard implementation
+ *
+ * The standard input is read by a thread (see stdin_poll()), so a poll
+ * without pending input costs no system call. The replay takes the keys
+ * from the replay log instead. A key is taken from the
+ * input only after the previous one has been read by the system.
  *
  */
 static void keyboard_step4k(device_t *dev)
 {
+    keyboard_data_s *data = (keyboard_data_s *) dev->data;
     char c;
 
-    if (stdin_poll(&c)) {
+    if ((!data->ig) && (data->script_pos == data->script.pos)
+            && (replay_stdin_poll(data->replay, &c))) {
         gen_key(dev, c);
     }
 }
 
+/** Save the keyboard state into a checkpoint
+ *
+ * The script itself is a part of the configuration,
+ * only the position in the script is saved.
+ *
+ */
+static bool keyboard_save(device_t *dev, checkpoint_t *ckpt)
+{
+    keyboard_data_s *data = (keyboard_data_s *) dev->data;
+    uint64_t script_pos = data->script_pos;
+
+    return checkpoint_write_var(ckpt, data->incomming)
+            && checkpoint_write_var(ckpt, data->ig)
+            && checkpoint_write_uint64(ckpt, script_pos)
+            && checkpoint_write_var(ckpt, data->intrcount)
+            && checkpoint_write_var(ckpt, data->keycount)
+            && checkpoint_write_var(ckpt, data->overrun);
+}
+
+/** Load the keyboard state from a checkpoint
+ *
+ */
+static bool keyboard_load(device_t *dev, checkpoint_t *ckpt)
+{
+    keyboard_data_s *data = (keyboard_data_s *) dev->data;
+    uint64_t script_pos;
+
+    if (!checkpoint_read_var(ckpt, data->incomming)
+            || !checkpoint_read_var(ckpt, data->ig)
+            || !checkpoint_read_uint64(ckpt, &script_pos)
+            || !checkpoint_read_var(ckpt, data->intrcount)
+            || !checkpoint_read_var(ckpt, data->keycount)
+            || !checkpoint_read_var(ckpt, data->overrun)) {
+        return false;
+    }
+
+    if (script_pos > data->script.pos) {
+        return false;
+    }
+
+    data->script_pos = script_pos;
+    return true;
+}
+
+/** Events scheduled by the keyboard */
+static const dev_event_fnc_t keyboard_events[] = {
+    keyboard_script_next,
+    NULL
+};
+
 /*
  * Device commands
  */
@@ -262,6 +420,21 @@ cmd_t keyboard_cmds[] = {
             "Generate a key press with specified code",
             "Generate a key press with specified code",
             REQ VAR "key code" END },
+    { "script",
+            (fcmd_t) dkeyboard_script,
+            DEFAULT,
+            DEFAULT,
+            "Queue key presses from the specified file",
+            "Queue the contents of the specified file as key presses. The next key is pressed as soon as the previous one is read, the standard input is read once the script is over.",
+            REQ STR "filename/input file name" END },
+    { "route",
+            (fcmd_t) dkeyboard_route,
+            DEFAULT,
+            DEFAULT,
+            "Print or set the interrupt routing",
+            "Without arguments prints where the keyboard interrupt goes. With the name of a dplic device and a source number the interrupt is asserted as the source of the interrupt controller instead of the interrupt number of the first processor.",
+            OPT STR "plic/interrupt controller name" NEXT
+                    OPT INT "source/source number" END },
     LAST_CMD
 };
 
@@ -281,5 +454,10 @@ device_type_t dkeyboard = {
     .read32 = keyboard_read32,
 
     /* Commands */
-    .cmds = keyboard_cmds
+    .cmds = keyboard_cmds,
+
+    /* Checkpoints */
+    .save = keyboard_save,
+    .load = keyboard_load,
+    .events = keyboard_events
 };
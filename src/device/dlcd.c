@@ -7,6 +7,11 @@
  *
  *  HD44780U LCD module device
  *
+ *  Written characters only mark the display cells dirty, the display
+ *  is repainted by a device event at most once per refresh period.
+ *  On a terminal only the dirty cells are repainted in place, otherwise
+ *  (or when the output is headless) the whole display is printed.
+ *
  */
 
 #include <inttypes.h>
@@ -15,9 +20,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "../assert.h"
+#include "../checkpoint.h"
 #include "../fault.h"
+#include "../output.h"
 #include "../parser.h"
 #include "../text.h"
 #include "../utils.h"
@@ -31,6 +39,9 @@
 #define LCD_MAX_DDRAM_SIZE 80 /* Maximum DDRAM characters supported by HD44780 */
 #define LCD_MAX_ROWS 4 /* Maximum rows supported */
 #define LCD_MAX_COLS 40 /* Maximum columns per row supported */
+#define LCD_MAX_CELLS (LCD_MAX_ROWS * LCD_MAX_COLS)
+
+#define DEFAULT_REFRESH 10000 /**< Default refresh period in cycles */
 
 static uint8_t row_addr_map[LCD_MAX_ROWS] = {
     0x00, 0x40, 0x14, 0x54
@@ -60,9 +71,19 @@ typedef struct {
 
     uint8_t *buffer;
 
+    bool dirty[LCD_MAX_CELLS]; /**< Cells changed since the last repaint */
+    bool repaint; /**< Repaint scheduled (some cells are dirty) */
+
+    uint64_t refresh; /**< Refresh period in cycles */
+    bool headless; /**< Print only the final display at exit */
+    bool drawn; /**< Display drawn on the terminal (to be updated in place) */
+    uint64_t epoch; /**< Output epoch after the last repaint */
+
     uint64_t addr; /**< Register address */
 } lcd_data_t;
 
+static void lcd_repaint(device_t *dev);
+
 static bool dlcd_init(token_t *parm, device_t *dev)
 {
     parm_next(&parm);
@@ -108,19 +129,21 @@ static bool dlcd_init(token_t *parm, device_t *dev)
     data->buffer = safe_malloc(sizeof(uint8_t) * rows * cols);
     memset(data->buffer, 0, rows * cols);
 
-    data->addr = addr;
+    memset(data->dirty, 0, sizeof(data->dirty));
+    data->repaint = false;
+    data->refresh = DEFAULT_REFRESH;
+    data->headless = false;
+    data->drawn = false;
+    data->epoch = 0;
 
-    return true;
-}
+    data->addr = addr;
 
-static void lcd_done(device_t *dev)
-{
-    lcd_data_t *data = (lcd_data_t *) dev->data;
+    dev_map(dev, addr, REGISTER_LIMIT);
 
-    safe_free(data->buffer);
-    safe_free(data);
+    return true;
 }
 
+/** Print the whole display */
 static void lcd_print(lcd_data_t *data)
 {
     printf("┌");
@@ -150,8 +173,103 @@ static void lcd_print(lcd_data_t *data)
     }
 
     printf("┘\n");
+}
+
+/** Repaint the dirty cells on the terminal in place
+ *
+ * The cursor is expected just below the display drawn before,
+ * each run of dirty cells of a row is written at once.
+ *
+ */
+static void lcd_print_dirty(lcd_data_t *data)
+{
+    for (int row = 0; row < data->rows; row++) {
+        /* Lines between the cursor and the row */
+        int up = data->rows + 1 - row;
+        int col = 0;
+
+        while (col < data->cols) {
+            if (!data->dirty[row * data->cols + col]) {
+                col++;
+                continue;
+            }
+
+            printf("\033[%dA\033[%dG", up, col + 2);
+
+            for (; (col < data->cols) && (data->dirty[row * data->cols + col]); col++) {
+                char c = data->buffer[row * data->cols + col];
+                printf("%c", (c == 0) ? ' ' : c);
+            }
+
+            printf("\033[%dB\r", up);
+        }
+    }
+}
+
+/** Repaint the display with the cells changed since the last repaint
+ *
+ * Runs as a device event once per refresh period while some
+ * cells are dirty. The display is updated in place only if
+ * nothing else has been printed since the last repaint
+ * (see output_epoch), otherwise it is drawn again.
+ *
+ * @param dev Device pointer
+ *
+ */
+static void lcd_repaint(device_t *dev)
+{
+    lcd_data_t *data = (lcd_data_t *) dev->data;
+
+    /* Keep the order with the buffered output of other devices */
+    output_flush_all();
+
+    if ((data->drawn) && (output_epoch == data->epoch + 1)) {
+        lcd_print_dirty(data);
+    } else {
+        lcd_print(data);
+        data->drawn = isatty(fileno(stdout));
+    }
 
     fflush(stdout);
+    data->epoch = output_epoch;
+
+    memset(data->dirty, 0, sizeof(data->dirty));
+    data->repaint = false;
+}
+
+/** Mark a cell dirty and schedule the repaint of the display */
+static void lcd_mark(device_t *dev, int cell)
+{
+    lcd_data_t *data = (lcd_data_t *) dev->data;
+
+    data->dirty[cell] = true;
+
+    if ((!data->repaint) && (!data->headless)) {
+        data->repaint = true;
+        dev_schedule(dev, data->refresh, lcd_repaint);
+    }
+}
+
+/** Done
+ *
+ * The last changes are repainted, the headless
+ * display is printed as it was left.
+ *
+ */
+static void lcd_done(device_t *dev)
+{
+    lcd_data_t *data = (lcd_data_t *) dev->data;
+
+    if (data->headless) {
+        output_flush_all();
+        lcd_print(data);
+        fflush(stdout);
+    } else if (data->repaint) {
+        lcd_repaint(dev);
+    }
+
+    safe_free(data->buffer);
+    safe_free(data);
 }
 
 static bool ddram_addr_to_position(lcd_data_t *data, uint8_t addr, int *row, int *col)
@@ -190,7 +308,6 @@ static void lcd_write32(unsigned int procno, device_t *dev, ptr36_t addr, uint32
     ASSERT(dev != NULL);
 
     lcd_data_t *data = (lcd_data_t *) dev->data;
-    bool display_updated = false;
 
     switch (addr - data->addr) {
     case REGISTER_DATA:
@@ -214,9 +331,14 @@ static void lcd_write32(unsigned int procno, device_t *dev, ptr36_t addr, uint32
                     // RW = 0 => write operation
 
                     if (data->current_col < data->cols) {
-                        data->buffer[data->current_row * data->cols + data->current_col] = data->reg.parts.data;
+                        int cell = data->current_row * data->cols + data->current_col;
+
+                        if (data->buffer[cell] != data->reg.parts.data) {
+                            data->buffer[cell] = data->reg.parts.data;
+                            lcd_mark(dev, cell);
+                        }
+
                         data->current_col++;
-                        display_updated = true;
 
                         // automatically wrap to next line if needed
                         if (data->current_col >= data->cols) {
@@ -231,11 +353,15 @@ static void lcd_write32(unsigned int procno, device_t *dev, ptr36_t addr, uint32
                     // RW = 0 => write operation
                     switch (data->reg.parts.data) {
                     case 0x01: /* clear display */
-                        memset(data->buffer, 0, data->rows * data->cols);
+                        for (int cell = 0; cell < data->rows * data->cols; cell++) {
+                            if (data->buffer[cell] != 0) {
+                                data->buffer[cell] = 0;
+                                lcd_mark(dev, cell);
+                            }
+                        }
 
                         data->current_row = 0;
                         data->current_col = 0;
-                        display_updated = true;
 
                         break;
 
@@ -256,10 +382,6 @@ static void lcd_write32(unsigned int procno, device_t *dev, ptr36_t addr, uint32
                     }
                 }
             }
-
-            if (display_updated) {
-                lcd_print(data);
-            }
         }
         break;
 
@@ -280,6 +402,109 @@ static bool dlcd_info(token_t *parm, device_t *dev)
     return true;
 }
 
+static bool lcd_save(device_t *dev, checkpoint_t *ckpt)
+{
+    lcd_data_t *data = (lcd_data_t *) dev->data;
+
+    return checkpoint_write_var(ckpt, data->rows)
+            && checkpoint_write_var(ckpt, data->cols)
+            && checkpoint_write_var(ckpt, data->current_row)
+            && checkpoint_write_var(ckpt, data->current_col)
+            && checkpoint_write_var(ckpt, data->reg)
+            && checkpoint_write_var(ckpt, data->reg_prev)
+            && checkpoint_write(ckpt, data->buffer, data->rows * data->cols)
+            && checkpoint_write_var(ckpt, data->dirty)
+            && checkpoint_write_var(ckpt, data->repaint);
+}
+
+static bool lcd_load(device_t *dev, checkpoint_t *ckpt)
+{
+    lcd_data_t *data = (lcd_data_t *) dev->data;
+    int rows;
+    int cols;
+
+    if (!checkpoint_read_var(ckpt, rows) || !checkpoint_read_var(ckpt, cols)
+            || (rows != data->rows) || (cols != data->cols)) {
+        return false;
+    }
+
+    return checkpoint_read_var(ckpt, data->current_row)
+            && checkpoint_read_var(ckpt, data->current_col)
+            && checkpoint_read_var(ckpt, data->reg)
+            && checkpoint_read_var(ckpt, data->reg_prev)
+            && checkpoint_read(ckpt, data->buffer, data->rows * data->cols)
+            && checkpoint_read_var(ckpt, data->dirty)
+            && checkpoint_read_var(ckpt, data->repaint);
+}
+
+/** Output command implementation
+ *
+ * Print or set how the display is printed.
+ *
+ */
+static bool dlcd_output(token_t *parm, device_t *dev)
+{
+    lcd_data_t *data = (lcd_data_t *) dev->data;
+
+    if (parm_type(parm) == tt_end) {
+        if (data->headless) {
+            printf("Output: headless, the display is printed at exit\n");
+        } else {
+            printf("Output: terminal, repainted every %" PRIu64 " cycles\n",
+                    data->refresh);
+        }
+
+        return true;
+    }
+
+    const char *const mode = parm_str_next(&parm);
+
+    if (strcmp(mode, "headless") == 0) {
+        if (parm_type(parm) != tt_end) {
+            error("Headless output has no refresh period");
+            return false;
+        }
+
+        data->headless = true;
+        return true;
+    }
+
+    if (strcmp(mode, "terminal") != 0) {
+        error("Unknown output mode <%s> (use terminal or headless)", mode);
+        return false;
+    }
+
+    uint64_t refresh = DEFAULT_REFRESH;
+
+    if (parm_type(parm) != tt_end) {
+        refresh = parm_uint(parm);
+    }
+
+    if (refresh == 0) {
+        error("Refresh period has to be at least one cycle");
+        return false;
+    }
+
+    data->headless = false;
+    data->refresh = refresh;
+    return true;
+}
+
+/** Dump command implementation
+ *
+ */
+static bool dlcd_dump(token_t *parm, device_t *dev)
+{
+    lcd_print((lcd_data_t *) dev->data);
+    return true;
+}
+
+/** Events scheduled by the display */
+static const dev_event_fnc_t lcd_events[] = {
+    lcd_repaint,
+    NULL
+};
+
 static cmd_t lcd_cmds[] = {
     { "init",
             (fcmd_t) dlcd_init,
@@ -305,6 +530,21 @@ static cmd_t lcd_cmds[] = {
             "Display LCD state and configuration",
             "Display LCD state and configuration",
             NOCMD },
+    { "output",
+            (fcmd_t) dlcd_output,
+            DEFAULT,
+            DEFAULT,
+            "Configure the display output",
+            "Without arguments prints the display output setting. Otherwise the display is either repainted on the terminal at most once per the refresh period (in cycles), or left headless and printed only at exit.",
+            OPT STR "mode/terminal or headless" NEXT
+                    OPT INT "cycles/refresh period" END },
+    { "dump",
+            (fcmd_t) dlcd_dump,
+            DEFAULT,
+            DEFAULT,
+            "Print the display",
+            "Print the display",
+            NOCMD },
     LAST_CMD
 };
 
@@ -319,5 +559,9 @@ device_type_t dlcd = {
     .done = lcd_done,
     .write32 = lcd_write32,
 
-    .cmds = lcd_cmds
+    .cmds = lcd_cmds,
+
+    .save = lcd_save,
+    .load = lcd_load,
+    .events = lcd_events
 };
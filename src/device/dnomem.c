@@ -8,6 +8,10 @@
  * Debug no-memory device. Writing to this area causes simulator to enter
  * interactive mode.
  *
+ * The offending accesses are counted per address and operation. In the
+ * warn mode only the first few of them can be alerted, the rest is
+ * summed up periodically and when the device is removed.
+ *
  */
 
 #include <inttypes.h>
@@ -15,11 +19,27 @@
 #include <string.h>
 
 #include "../assert.h"
+#include "../main.h"
+#include "../debug/flight.h"
 #include "../fault.h"
 #include "../utils.h"
 #include "cpu/general_cpu.h"
 #include "dnomem.h"
 
+/** Initial number of the slots of the access table (a power of 2) */
+#define DNOMEM_INITIAL_SLOTS 64
+
+/** Default number of machine cycles between the summaries */
+#define DNOMEM_REPORT_PERIOD 1000000
+
+/** Offending accesses to an address */
+typedef struct {
+    ptr36_t addr;
+    bool write;
+    uint64_t count; /**< Zero if the slot is free */
+    uint64_t reported; /**< Accesses alerted or summed up so far */
+} dnomem_access_t;
+
 /** Access handling. */
 typedef struct {
     const char *name;
@@ -36,8 +56,159 @@ typedef struct {
     bool register_dump;
     /** No-memory behavior on access. */
     dnomem_access_mode_t *mode;
+    /** Accesses alerted per address and operation (0 for all). */
+    unsigned int limit;
+    /** Machine cycles between the summaries (0 for the final one only). */
+    uint64_t period;
+    /** Machine cycle of the next summary. */
+    uint64_t next_report;
+    /** Number of the accesses not reported yet. */
+    uint64_t pending;
+    /** Offending accesses (open addressing hash table). */
+    dnomem_access_t *slots;
+    size_t slot_count;
+    size_t used_count;
 } dnomem_data_s;
 
+static inline const char *dnomem_operation(bool write)
+{
+    return write ? "WRITE" : "READ";
+}
+
+static size_t dnomem_hash(const dnomem_data_s *data, ptr36_t addr, bool write)
+{
+    uint64_t key = (addr << 1) | (write ? 1 : 0);
+
+    /* Fibonacci hashing */
+    return (size_t) ((key * UINT64_C(0x9e3779b97f4a7c15)) >> 32) & (data->slot_count - 1);
+}
+
+/** Find the slot of an access (or the free slot for it) */
+static dnomem_access_t *dnomem_slot(dnomem_data_s *data, ptr36_t addr,
+        bool write)
+{
+    size_t i = dnomem_hash(data, addr, write);
+
+    while (true) {
+        dnomem_access_t *access = &data->slots[i];
+
+        if ((access->count == 0)
+                || ((access->addr == addr) && (access->write == write))) {
+            return access;
+        }
+
+        i = (i + 1) & (data->slot_count - 1);
+    }
+}
+
+/** Double the number of the slots of the access table */
+static void dnomem_grow(dnomem_data_s *data)
+{
+    dnomem_access_t *old = data->slots;
+    size_t old_count = data->slot_count;
+
+    data->slot_count = (old_count == 0) ? DNOMEM_INITIAL_SLOTS : 2 * old_count;
+    data->slots = (dnomem_access_t *) safe_malloc(data->slot_count * sizeof(dnomem_access_t));
+    memset(data->slots, 0, data->slot_count * sizeof(dnomem_access_t));
+
+    for (size_t i = 0; i < old_count; i++) {
+        if (old[i].count != 0) {
+            *dnomem_slot(data, old[i].addr, old[i].write) = old[i];
+        }
+    }
+
+    safe_free(old);
+}
+
+/** Count an offending access */
+static dnomem_access_t *dnomem_count(dnomem_data_s *data, ptr36_t addr,
+        bool write)
+{
+    /* Keep at least a quarter of the slots free */
+    if (4 * (data->used_count + 1) > 3 * data->slot_count) {
+        dnomem_grow(data);
+    }
+
+    dnomem_access_t *access = dnomem_slot(data, addr, write);
+
+    if (access->count == 0) {
+        access->addr = addr;
+        access->write = write;
+        access->reported = 0;
+        data->used_count++;
+    }
+
+    access->count++;
+    return access;
+}
+
+/** Order of the accesses in the summaries */
+static int dnomem_access_compare(const void *a, const void *b)
+{
+    const dnomem_access_t *aa = *(const dnomem_access_t *const *) a;
+    const dnomem_access_t *ab = *(const dnomem_access_t *const *) b;
+
+    if (aa->addr != ab->addr) {
+        return (aa->addr < ab->addr) ? -1 : 1;
+    }
+
+    return (int) aa->write - (int) ab->write;
+}
+
+/** Collect the accesses in the order of the addresses
+ *
+ * @param pending Collect only the accesses not reported yet.
+ *
+ * @return Array of the accesses (to be freed by the caller).
+ *
+ */
+static dnomem_access_t **dnomem_sorted(dnomem_data_s *data, bool pending,
+        size_t *count)
+{
+    dnomem_access_t **accesses = (dnomem_access_t **)
+            safe_malloc((data->used_count + 1) * sizeof(dnomem_access_t *));
+    *count = 0;
+
+    for (size_t i = 0; i < data->slot_count; i++) {
+        dnomem_access_t *access = &data->slots[i];
+
+        if ((access->count != 0)
+                && ((!pending) || (access->count > access->reported))) {
+            accesses[(*count)++] = access;
+        }
+    }
+
+    qsort(accesses, *count, sizeof(dnomem_access_t *), dnomem_access_compare);
+    return accesses;
+}
+
+/** Sum up the accesses not alerted since the last summary */
+static void dnomem_report(device_t *dev)
+{
+    dnomem_data_s *data = (dnomem_data_s *) dev->data;
+
+    if (data->pending == 0) {
+        return;
+    }
+
+    size_t count;
+    dnomem_access_t **accesses = dnomem_sorted(data, true, &count);
+
+    for (size_t i = 0; i < count; i++) {
+        dnomem_access_t *access = accesses[i];
+
+        alert("Ignored %" PRIu64 " more %s (at %#011" PRIx64 ", %#" PRIx64
+              " inside %s), %" PRIu64 " in total.",
+                access->count - access->reported,
+                dnomem_operation(access->write), access->addr,
+                access->addr - data->addr, dev->name, access->count);
+        access->reported = access->count;
+    }
+
+    safe_free(accesses);
+    data->pending = 0;
+}
+
 static void dnomem_access32_warn(const char *operation_name, device_t *dev, ptr36_t addr, ptr36_t offset)
 {
     alert("Ignoring %s (at %#011" PRIx64 ", %#" PRIx64 " inside %s).", operation_name, addr, offset, dev->name);
@@ -47,14 +218,15 @@ static void dnomem_access32_break(const char *operation_name, device_t *dev, ptr
 {
     alert("Entering interactive mode because of invalid %s (at %#011" PRIx64 ", %#" PRIx64 " inside %s).",
             operation_name, addr, offset, dev->name);
-    machine_interactive = true;
+    __atomic_store_n(&machine_interactive, true, __ATOMIC_RELEASE);
 }
 
 static void dnomem_access32_halt(const char *operation_name, device_t *dev, ptr36_t addr, ptr36_t offset)
 {
     alert("Halting after forbidden %s (at %#011" PRIx64 ", %#" PRIx64 " inside %s).",
             operation_name, addr, offset, dev->name);
-    machine_halt = true;
+    flight_requested = true;
+    __atomic_store_n(&machine_halt, true, __ATOMIC_RELEASE);
 }
 
 static dnomem_access_mode_t access_mode_warn = {
@@ -109,6 +281,15 @@ static bool dnomem_init(token_t *parm, device_t *dev)
     data->size = size;
     data->mode = &access_mode_warn;
     data->register_dump = false;
+    data->limit = 0;
+    data->period = DNOMEM_REPORT_PERIOD;
+    data->next_report = 0;
+    data->pending = 0;
+    data->slots = NULL;
+    data->slot_count = 0;
+    data->used_count = 0;
+
+    dev_map(dev, start_addr, size);
 
     return true;
 }
@@ -163,6 +344,76 @@ static bool dnomem_setrd(token_t *parm, device_t *dev)
     return true;
 }
 
+/** limit command implementation.
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ */
+static bool dnomem_setlimit(token_t *parm, device_t *dev)
+{
+    dnomem_data_s *data = (dnomem_data_s *) dev->data;
+    uint64_t limit = parm_uint(parm);
+
+    if (limit > UINT32_MAX) {
+        error("Limit out of range");
+        return false;
+    }
+
+    data->limit = limit;
+    return true;
+}
+
+/** report command implementation.
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ */
+static bool dnomem_setreport(token_t *parm, device_t *dev)
+{
+    dnomem_data_s *data = (dnomem_data_s *) dev->data;
+
+    data->period = parm_uint(parm);
+    data->next_report = steps + data->period;
+
+    return true;
+}
+
+/** Stat command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True (always successful)
+ *
+ */
+static bool dnomem_stat(token_t *parm, device_t *dev)
+{
+    dnomem_data_s *data = (dnomem_data_s *) dev->data;
+
+    if (data->used_count == 0) {
+        printf("No accesses\n");
+        return true;
+    }
+
+    size_t count;
+    dnomem_access_t **accesses = dnomem_sorted(data, false, &count);
+
+    printf("[address  ] [offset   ] [operation] [count             ]\n");
+
+    for (size_t i = 0; i < count; i++) {
+        printf("%#011" PRIx64 " %#011" PRIx64 " %-11s %" PRIu64 "\n",
+                accesses[i]->addr, accesses[i]->addr - data->addr,
+                dnomem_operation(accesses[i]->write), accesses[i]->count);
+    }
+
+    safe_free(accesses);
+    return true;
+}
+
 /** Info command implementation
  *
  * @param parm Command-line parameters
@@ -175,24 +426,31 @@ static bool dnomem_info(token_t *parm, device_t *dev)
 {
     dnomem_data_s *data = (dnomem_data_s *) dev->data;
 
-    printf("[address  ] [size     ] [mode  ] [regdump]\n"
-           "%#011" PRIx64 " %#011" PRIx64 " %-8s %s\n",
-            data->addr, data->size, data->mode->name, data->register_dump ? "yes" : "no");
+    printf("[address  ] [size     ] [mode  ] [regdump] [limit] [report   ]\n"
+           "%#011" PRIx64 " %#011" PRIx64 " %-8s %-9s %-7u %" PRIu64 "\n",
+            data->addr, data->size, data->mode->name, data->register_dump ? "yes" : "no",
+            data->limit, data->period);
 
     return true;
 }
 
-/** Dispose disk
+/** Dispose the device
+ *
+ * The accesses not alerted are summed up.
  *
  * @param dev Device pointer
  *
  */
 static void dnomem_done(device_t *dev)
 {
+    dnomem_data_s *data = (dnomem_data_s *) dev->data;
+
+    dnomem_report(dev);
+    safe_free(data->slots);
     safe_free(dev->data);
 }
 
-static void dnomem_access32(const char *operation_name, unsigned int procno, device_t *dev, ptr36_t addr)
+static void dnomem_access32(bool write, unsigned int procno, device_t *dev, ptr36_t addr)
 {
     dnomem_data_s *data = (dnomem_data_s *) dev->data;
     ptr36_t offset = addr - data->addr;
@@ -200,12 +458,32 @@ static void dnomem_access32(const char *operation_name, unsigned int procno, dev
         return;
     }
 
+    dnomem_access_t *access = dnomem_count(data, addr, write);
+
+    /* Only count the accesses over the limit */
+    if ((data->mode == &access_mode_warn) && (data->limit > 0)
+            && (access->count > data->limit)) {
+        if (data->pending == 0) {
+            data->next_report = steps + data->period;
+        }
+
+        data->pending++;
+
+        if ((data->period > 0) && (steps >= data->next_report)) {
+            dnomem_report(dev);
+        }
+
+        return;
+    }
+
+    access->reported = access->count;
+
     if (data->register_dump) {
         general_cpu_t *causing_cpu = get_cpu(procno);
         ASSERT((causing_cpu != NULL) && "CPU that causes illegal access to dnomem not found");
         cpu_reg_dump(causing_cpu);
     }
-    data->mode->access32(operation_name, dev, addr, offset);
+    data->mode->access32(dnomem_operation(write), dev, addr, offset);
 }
 
 /** Read command implementation
@@ -218,7 +496,7 @@ static void dnomem_access32(const char *operation_name, unsigned int procno, dev
 static void dnomem_read32(unsigned int procno, device_t *dev, ptr36_t addr,
         uint32_t *val)
 {
-    dnomem_access32("READ", procno, dev, addr);
+    dnomem_access32(false, procno, dev, addr);
 }
 
 /** Write command implementation
@@ -231,7 +509,7 @@ static void dnomem_read32(unsigned int procno, device_t *dev, ptr36_t addr,
 static void dnomem_write32(unsigned int procno, device_t *dev, ptr36_t addr,
         uint32_t val)
 {
-    dnomem_access32("WRITE", procno, dev, addr);
+    dnomem_access32(true, procno, dev, addr);
 }
 
 cmd_t dnomem_cmds[] = {
@@ -258,6 +536,27 @@ cmd_t dnomem_cmds[] = {
             "Whether to dump registers on access",
             "Whether to dump registers on access",
             REQ STR "rd/Dump registers on access (yes, no)" END },
+    { "limit",
+            (fcmd_t) dnomem_setlimit,
+            DEFAULT,
+            DEFAULT,
+            "Alert only the first accesses",
+            "Alert only the first accesses per address and operation in the warn mode",
+            REQ INT "limit/Number of accesses alerted (0 for all)" END },
+    { "report",
+            (fcmd_t) dnomem_setreport,
+            DEFAULT,
+            DEFAULT,
+            "Set the period of the summaries",
+            "Set the period of the summaries of the accesses not alerted",
+            REQ INT "cycles/Machine cycles between the summaries (0 for the final one only)" END },
+    { "stat",
+            (fcmd_t) dnomem_stat,
+            DEFAULT,
+            DEFAULT,
+            "Print the access counts",
+            "Print the number of accesses per address and operation",
+            NOCMD },
     { "help",
             (fcmd_t) dev_generic_help,
             DEFAULT,
@@ -14,6 +14,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../checkpoint.h"
+#include "../debug/statsrv.h"
 #include "../fault.h"
 #include "../parser.h"
 #include "../text.h"
@@ -27,30 +29,98 @@
 #define REGISTER_INT_PEND 0 /**< Interrupts pending */
 #define REGISTER_INT_DOWN 4 /**< Deassert interrupts */
 #define REGISTER_LIMIT 8 /**< Register block size */
+#define REGISTER_BANK 8 /**< Bank of the processor masks (banked) */
+#define REGISTER_BANKED_LIMIT 12 /**< Size of banked register block */
+#define REGISTER_BROADCAST 12 /**< Assert interrupts on all processors */
+#define REGISTER_ALL_BUT_SELF 16 /**< Assert interrupts on the others */
+#define REGISTER_BROADCAST_LIMIT 20 /**< Size of broadcast register block */
 /* \} */
 
+/** Processors addressed by a mask */
+#define BANK_CPUS 32
+
+/** Number of the banks of processor masks */
+#define BANKS ((MAX_CPUS + BANK_CPUS - 1) / BANK_CPUS)
+
 /** Dorder instance data structure */
 typedef struct {
     ptr36_t addr; /**< Dorder address */
     unsigned int intno; /**< Interrupt number */
+    bool banked; /**< Bank register is mapped */
+    bool broadcast; /**< Broadcast registers are mapped */
+
+    /** Bank selected by each processor
+     *
+     * The masks written by a processor address the processors
+     * bank * BANK_CPUS to bank * BANK_CPUS + 31.
+     *
+     */
+    uint8_t bank[MAX_CPUS];
+
+    /** Interrupts asserted and not acknowledged yet (bank masks) */
+    uint32_t pending[BANKS];
 
     uint64_t cmds; /**< Total number of commands */
+    uint64_t raised[MAX_CPUS]; /**< Interrupts asserted on each processor */
+    uint64_t coalesced[MAX_CPUS]; /**< Requests on pending interrupts */
 } dorder_data_s;
 
+/** Assert the interrupt on a processor
+ *
+ * A request on an interrupt which is still pending (i.e. not
+ * acknowledged by the interrupt down register) is coalesced
+ * with it, the processor is not touched.
+ *
+ * @param data Instance data structure
+ * @param no   Processor number
+ *
+ */
+static void sync_up_cpu(dorder_data_s *data, unsigned int no)
+{
+    uint32_t *pending = &data->pending[no / BANK_CPUS];
+    uint32_t bit = UINT32_C(1) << (no % BANK_CPUS);
+
+    if ((*pending & bit) != 0) {
+        data->coalesced[no]++;
+        return;
+    }
+
+    *pending |= bit;
+    data->raised[no]++;
+    cpu_interrupt_up(get_cpu(no), data->intno);
+}
+
 /** Write to the synchronisation register - generate interrupts.
  *
  * @param data Instance data structure
+ * @param bank Bank of processors addressed by the mask
  * @param val  Value (mask) which identifies processors
  *
  */
-static void sync_up_write(dorder_data_s *data, uint32_t val)
+static void sync_up_write(dorder_data_s *data, unsigned int bank, uint32_t val)
 {
-    unsigned int i;
     data->cmds++;
 
-    for (i = 0; i < 32; i++, val >>= 1) {
-        if (val & 1) {
-            cpu_interrupt_up(get_cpu(i), data->intno);
+    for (; val != 0; val &= val - 1) {
+        sync_up_cpu(data, bank * BANK_CPUS + __builtin_ctz(val));
+    }
+}
+
+/** Write to the broadcast registers - generate interrupts.
+ *
+ * @param data Instance data structure
+ * @param self Processor left out (MAX_CPUS for none)
+ *
+ */
+static void sync_broadcast_write(dorder_data_s *data, unsigned int self)
+{
+    data->cmds++;
+
+    for (unsigned int i = 0; i < get_cpu_count(); i++) {
+        unsigned int no = get_cpu_by_index(i)->cpuno;
+
+        if (no != self) {
+            sync_up_cpu(data, no);
         }
     }
 }
@@ -58,18 +128,18 @@ static void sync_up_write(dorder_data_s *data, uint32_t val)
 /** Write to the interrupt-down register - disable pending interrupts.
  *
  * @param data Instance data structure
+ * @param bank Bank of processors addressed by the mask
  * @param val  Value (mask) which identifies processors
  *
  */
-static void sync_down_write(dorder_data_s *data, uint32_t val)
+static void sync_down_write(dorder_data_s *data, unsigned int bank, uint32_t val)
 {
-    unsigned int i;
     data->cmds++;
+    data->pending[bank] &= ~val;
 
-    for (i = 0; i < 32; i++, val >>= 1) {
-        if (val & 1) {
-            cpu_interrupt_down(get_cpu(i), data->intno);
-        }
+    for (; val != 0; val &= val - 1) {
+        cpu_interrupt_down(get_cpu(bank * BANK_CPUS + __builtin_ctz(val)),
+                data->intno);
     }
 }
 
@@ -117,7 +187,15 @@ static bool dorder_init(token_t *parm, device_t *dev)
     /* Initialize */
     data->addr = addr;
     data->intno = _intno;
+    data->banked = false;
+    data->broadcast = false;
+    memset(data->bank, 0, sizeof(data->bank));
+    memset(data->pending, 0, sizeof(data->pending));
     data->cmds = 0;
+    memset(data->raised, 0, sizeof(data->raised));
+    memset(data->coalesced, 0, sizeof(data->coalesced));
+
+    dev_map(dev, addr, REGISTER_LIMIT);
 
     return true;
 }
@@ -133,13 +211,16 @@ static bool dorder_info(token_t *parm, device_t *dev)
 {
     dorder_data_s *data = (dorder_data_s *) dev->data;
 
-    printf("[address ] [int]\n");
-    printf("%#11" PRIx64 " %-5u\n", data->addr, data->intno);
+    printf("[address ] [int] [banked] [broadcast]\n");
+    printf("%#11" PRIx64 " %-5u %-8s %s\n", data->addr, data->intno,
+            data->banked ? "yes" : "no", data->broadcast ? "yes" : "no");
 
     return true;
 }
 
 /** Stat comamnd implementation
+ *
+ * The processors which have been sent no interrupt are left out.
  *
  * @param parm Command-line parameters
  * @param dev  Device instance structure
@@ -154,6 +235,52 @@ static bool dorder_stat(token_t *parm, device_t *dev)
     printf("[command count]\n");
     printf("%" PRIu64 "\n", data->cmds);
 
+    bool header = false;
+
+    for (unsigned int i = 0; i < MAX_CPUS; i++) {
+        if ((data->raised[i] == 0) && (data->coalesced[i] == 0)) {
+            continue;
+        }
+
+        if (!header) {
+            printf("[cpu] [raised    ] [coalesced ] [pending]\n");
+            header = true;
+        }
+
+        bool pending = (data->pending[i / BANK_CPUS]
+                               & (UINT32_C(1) << (i % BANK_CPUS)))
+                != 0;
+
+        printf("%-5u %-12" PRIu64 " %-12" PRIu64 " %s\n", i,
+                data->raised[i], data->coalesced[i], pending ? "yes" : "no");
+    }
+
+    return true;
+}
+
+/** Read the optional bank of the synchup and synchdown commands
+ *
+ * @param parm Parameter following the mask
+ * @param bank Bank read (0 if not given)
+ *
+ * @return True if the bank is valid
+ *
+ */
+static bool dorder_parm_bank(token_t *parm, unsigned int *bank)
+{
+    *bank = 0;
+
+    if (parm_type(parm) == tt_end) {
+        return true;
+    }
+
+    uint64_t val = parm_uint(parm);
+    if (val >= BANKS) {
+        error("Bank out of range (0..%u)", BANKS - 1);
+        return false;
+    }
+
+    *bank = val;
     return true;
 }
 
@@ -162,12 +289,19 @@ static bool dorder_stat(token_t *parm, device_t *dev)
  * @param parm Command-line parameters
  * @param dev  Device instance structure
  *
- * @return True (always successful)
+ * @return True if successful
  *
  */
 static bool dorder_synchup(token_t *parm, device_t *dev)
 {
-    sync_up_write((dorder_data_s *) dev->data, parm_uint(parm));
+    uint32_t mask = parm_uint_next(&parm);
+    unsigned int bank;
+
+    if (!dorder_parm_bank(parm, &bank)) {
+        return false;
+    }
+
+    sync_up_write((dorder_data_s *) dev->data, bank, mask);
     return true;
 }
 
@@ -176,15 +310,146 @@ static bool dorder_synchup(token_t *parm, device_t *dev)
  * @param parm Command-line parameters
  * @param dev  Device instance structure
  *
- * @return True (always successful)
+ * @return True if successful
  *
  */
 static bool dorder_synchdown(token_t *parm, device_t *dev)
 {
-    sync_down_write((dorder_data_s *) dev->data, parm_uint(parm));
+    uint32_t mask = parm_uint_next(&parm);
+    unsigned int bank;
+
+    if (!dorder_parm_bank(parm, &bank)) {
+        return false;
+    }
+
+    sync_down_write((dorder_data_s *) dev->data, bank, mask);
     return true;
 }
 
+/** Map the register block
+ *
+ * The bank register follows the basic registers, the broadcast
+ * registers follow the bank register (which reads 0 and ignores
+ * the writes unless it is enabled).
+ *
+ * @param dev       Device instance structure
+ * @param banked    Bank register is enabled
+ * @param broadcast Broadcast registers are enabled
+ *
+ * @return True if successful
+ *
+ */
+static bool dorder_map(device_t *dev, bool banked, bool broadcast)
+{
+    dorder_data_s *data = (dorder_data_s *) dev->data;
+    uint64_t limit = broadcast ? REGISTER_BROADCAST_LIMIT
+            : banked           ? REGISTER_BANKED_LIMIT
+                               : REGISTER_LIMIT;
+
+    if (!phys_range(data->addr + limit)) {
+        error("Invalid address, registers would exceed the physical "
+              "memory range");
+        return false;
+    }
+
+    data->banked = banked;
+    data->broadcast = broadcast;
+
+    dev_unmap(dev);
+    dev_map(dev, data->addr, limit);
+
+    return true;
+}
+
+/** Parse the on/off state of a register
+ *
+ * @param parm  Command-line parameters
+ * @param state Parsed state
+ *
+ * @return True if the state is valid
+ *
+ */
+static bool dorder_parm_state(token_t *parm, bool *state)
+{
+    const char *const str = parm_str(parm);
+
+    if (strcmp(str, "on") == 0) {
+        *state = true;
+    } else if (strcmp(str, "off") == 0) {
+        *state = false;
+    } else {
+        error("Unknown state <%s> (use on or off)", str);
+        return false;
+    }
+
+    return true;
+}
+
+/** Banked command implementation
+ *
+ * Print or set whether the bank register, which lets the processors
+ * address all MAX_CPUS processors by the 32-bit masks, is mapped
+ * after the basic register block.
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool dorder_banked(token_t *parm, device_t *dev)
+{
+    dorder_data_s *data = (dorder_data_s *) dev->data;
+
+    if (parm_type(parm) == tt_end) {
+        printf("Bank register: %s\n", data->banked ? "enabled" : "disabled");
+        return true;
+    }
+
+    bool banked;
+
+    if (!dorder_parm_state(parm, &banked)) {
+        return false;
+    }
+
+    if (!dorder_map(dev, banked, data->broadcast)) {
+        return false;
+    }
+
+    memset(data->bank, 0, sizeof(data->bank));
+    return true;
+}
+
+/** Broadcast command implementation
+ *
+ * Print or set whether the broadcast and all-but-self registers are
+ * mapped after the bank register.
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool dorder_broadcast(token_t *parm, device_t *dev)
+{
+    dorder_data_s *data = (dorder_data_s *) dev->data;
+
+    if (parm_type(parm) == tt_end) {
+        printf("Broadcast registers: %s\n",
+                data->broadcast ? "enabled" : "disabled");
+        return true;
+    }
+
+    bool broadcast;
+
+    if (!dorder_parm_state(parm, &broadcast)) {
+        return false;
+    }
+
+    return dorder_map(dev, data->banked, broadcast);
+}
+
 /** Clean up the device
  *
  * @param dev Device instance pointer
@@ -213,6 +478,13 @@ static void dorder_read32(unsigned int procno, device_t *dev, ptr36_t addr, uint
     case REGISTER_INT_DOWN:
         *val = 0;
         break;
+    case REGISTER_BANK:
+        *val = data->banked ? data->bank[procno] : 0;
+        break;
+    case REGISTER_BROADCAST:
+    case REGISTER_ALL_BUT_SELF:
+        *val = 0;
+        break;
     }
 }
 
@@ -229,15 +501,85 @@ static void dorder_write32(unsigned int procno, device_t *dev, ptr36_t addr, uin
 
     switch (addr - data->addr) {
     case REGISTER_INT_UP:
-        sync_up_write(data, val);
+        sync_up_write(data, data->bank[procno], val);
         break;
     case REGISTER_INT_DOWN:
-        sync_down_write(data, val);
+        sync_down_write(data, data->bank[procno], val);
+        break;
+    case REGISTER_BANK:
+        /* Banks beyond the processors are ignored */
+        if ((data->banked) && (val < BANKS)) {
+            data->bank[procno] = val;
+        }
+        break;
+    case REGISTER_BROADCAST:
+        sync_broadcast_write(data, MAX_CPUS);
+        break;
+    case REGISTER_ALL_BUT_SELF:
+        sync_broadcast_write(data, procno);
         break;
     }
 }
 
+/** Save the state and the statistics into a checkpoint
+ *
+ * @param dev  Device instance pointer
+ * @param ckpt Checkpoint being written
+ *
+ * @return True if successful
+ *
+ */
+static bool dorder_save(device_t *dev, checkpoint_t *ckpt)
+{
+    dorder_data_s *data = (dorder_data_s *) dev->data;
+
+    return checkpoint_write_var(ckpt, data->cmds)
+            && checkpoint_write_var(ckpt, data->bank)
+            && checkpoint_write_var(ckpt, data->pending)
+            && checkpoint_write_var(ckpt, data->raised)
+            && checkpoint_write_var(ckpt, data->coalesced);
+}
+
+/** Load the state and the statistics from a checkpoint
+ *
+ * @param dev  Device instance pointer
+ * @param ckpt Checkpoint being read
+ *
+ * @return True if successful
+ *
+ */
+static bool dorder_load(device_t *dev, checkpoint_t *ckpt)
+{
+    dorder_data_s *data = (dorder_data_s *) dev->data;
+
+    return checkpoint_read_var(ckpt, data->cmds)
+            && checkpoint_read_var(ckpt, data->bank)
+            && checkpoint_read_var(ckpt, data->pending)
+            && checkpoint_read_var(ckpt, data->raised)
+            && checkpoint_read_var(ckpt, data->coalesced);
+}
+
 /** Dorder command-line commands and parameters */
+/** Export the dorder counters to the statistics endpoint
+ *
+ */
+static void dorder_stats(device_t *dev, statsrv_t *stats)
+{
+    dorder_data_s *data = (dorder_data_s *) dev->data;
+
+    statsrv_counter(stats, "order_commands_total",
+            "Interprocessor interrupt commands", data->cmds);
+
+    uint64_t coalesced = 0;
+
+    for (unsigned int i = 0; i < MAX_CPUS; i++) {
+        coalesced += data->coalesced[i];
+    }
+
+    statsrv_counter(stats, "order_coalesced_total",
+            "Interprocessor interrupts coalesced with pending ones", coalesced);
+}
+
 cmd_t dorder_cmds[] = {
     { "init",
             (fcmd_t) dorder_init,
@@ -275,16 +617,37 @@ cmd_t dorder_cmds[] = {
             DEFAULT,
             "Write to the synchronization register",
             "Write the synchronization register - enables interrupt pending "
-            "on processors with nonzero bits in the mask",
-            REQ INT "mask" END },
+            "on processors with nonzero bits in the mask (of the given bank "
+            "of 32 processors)",
+            REQ INT "mask" NEXT
+                    OPT INT "bank" END },
     { "synchdown",
             (fcmd_t) dorder_synchdown,
             DEFAULT,
             DEFAULT,
             "Write to the synchronization register",
             "Write the synchronization register - disables interrupt pending "
-            "on processors with nonzero bits in the mask",
-            REQ INT "mask" END },
+            "on processors with nonzero bits in the mask (of the given bank "
+            "of 32 processors)",
+            REQ INT "mask" NEXT
+                    OPT INT "bank" END },
+    { "banked",
+            (fcmd_t) dorder_banked,
+            DEFAULT,
+            DEFAULT,
+            "Map the bank register",
+            "Print or set (on or off) whether the bank register selecting "
+            "the processors addressed by the masks is mapped",
+            OPT STR "state/on or off" END },
+    { "broadcast",
+            (fcmd_t) dorder_broadcast,
+            DEFAULT,
+            DEFAULT,
+            "Map the broadcast registers",
+            "Print or set (on or off) whether the registers asserting "
+            "the interrupt on all processors and on all but the writing "
+            "processor are mapped",
+            OPT STR "state/on or off" END },
     LAST_CMD
 };
 
@@ -306,5 +669,12 @@ device_type_t dorder = {
     .write32 = dorder_write32,
 
     /* Commands */
-    .cmds = dorder_cmds
+    .cmds = dorder_cmds,
+
+    /* Checkpoints */
+    .save = dorder_save,
+    .load = dorder_load,
+
+    /* Statistics */
+    .stats = dorder_stats
 };
@@ -0,0 +1,751 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Platform-level interrupt controller
+ *
+ *  Collects the interrupts of the devices routed to it (sources) and
+ *  distributes them to the processors (contexts, one per processor
+ *  number). Every source has a priority, every context enables its
+ *  sources and ignores the priorities up to its threshold. A context
+ *  claims the pending source of the highest priority, which stays
+ *  masked until the context completes it. The register layout follows
+ *  the RISC-V PLIC.
+ *
+ *  The pending sources are kept in a bitmap per priority, so the source
+ *  claimed by a context is found by two bit scans (the highest priority
+ *  with a pending source enabled by the context and the lowest such
+ *  source within the priority) instead of walking all the sources.
+ *
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../assert.h"
+#include "../checkpoint.h"
+#include "../fault.h"
+#include "../main.h"
+#include "../parser.h"
+#include "../text.h"
+#include "../utils.h"
+#include "cpu/general_cpu.h"
+#include "device.h"
+#include "dplic.h"
+
+/** Number of sources (source 0 means no interrupt) */
+#define SOURCES 64
+
+/** Number of priorities (priority 0 never interrupts) */
+#define PRIORITIES 8
+
+/** \{ \name Registers */
+#define REGISTER_PRIORITY 0 /**< Priority of source 0 (32 bits each) */
+#define REGISTER_PENDING 0x1000 /**< Pending sources (bitmap, read-only) */
+#define REGISTER_ENABLE 0x2000 /**< Enabled sources of context 0 (bitmap) */
+#define REGISTER_ENABLE_STRIDE 0x80 /**< Distance of the context bitmaps */
+#define REGISTER_CONTEXT 0x200000 /**< Threshold of context 0 */
+#define REGISTER_CONTEXT_STRIDE 0x1000 /**< Distance of the context registers */
+#define REGISTER_THRESHOLD 0 /**< Threshold within the context registers */
+#define REGISTER_CLAIM 4 /**< Claim/complete within the context registers */
+#define REGISTER_LIMIT (REGISTER_CONTEXT + REGISTER_CONTEXT_STRIDE * MAX_CPUS) /**< Register block size */
+/* \} */
+
+/** Bit of a source in a bitmap */
+#define SOURCE_BIT(source) (((uint64_t) 1) << (source))
+
+/** Dplic instance data structure */
+typedef struct {
+    ptr36_t addr; /**< Register block address */
+    unsigned int intno; /**< Interrupt number of the processors */
+
+    uint32_t priority[SOURCES]; /**< Priorities of the sources */
+    uint64_t asserted; /**< Sources asserted by their devices */
+    uint64_t pending; /**< Sources waiting to be claimed */
+    uint64_t claimed; /**< Sources claimed and not completed */
+
+    /** Pending sources of each priority */
+    uint64_t pending_at[PRIORITIES];
+
+    /** Priorities with a pending source (bitmap) */
+    uint32_t pending_priorities;
+
+    uint64_t enable[MAX_CPUS]; /**< Sources enabled by the contexts */
+    uint32_t threshold[MAX_CPUS]; /**< Thresholds of the contexts */
+    bool raised[MAX_CPUS]; /**< Interrupts raised on the processors */
+
+    uint64_t intrcount; /**< Number of interrupts asserted */
+    uint64_t claims; /**< Number of sources claimed */
+} plic_data_t;
+
+/** Source of the highest priority a context would claim
+ *
+ * @param data Instance data structure
+ * @param ctx  Context (processor number)
+ *
+ * @return Source number or 0 if there is none
+ *
+ */
+static unsigned int plic_best(plic_data_t *data, unsigned int ctx)
+{
+    /* Only the priorities above the threshold */
+    uint32_t priorities = data->pending_priorities
+            & ~((2U << data->threshold[ctx]) - 1);
+
+    while (priorities != 0) {
+        unsigned int priority = 31 - __builtin_clz(priorities);
+        uint64_t sources = data->pending_at[priority] & data->enable[ctx];
+
+        if (sources != 0) {
+            return __builtin_ctzll(sources);
+        }
+
+        priorities &= ~(1U << priority);
+    }
+
+    return 0;
+}
+
+/** Raise or clear the interrupt of a context
+ *
+ * @param data Instance data structure
+ * @param ctx  Context (processor number)
+ *
+ */
+static void plic_update_context(plic_data_t *data, unsigned int ctx)
+{
+    bool raise = (plic_best(data, ctx) != 0);
+
+    if (raise == data->raised[ctx]) {
+        return;
+    }
+
+    general_cpu_t *cpu = get_cpu(ctx);
+    if (cpu == NULL) {
+        return;
+    }
+
+    data->raised[ctx] = raise;
+
+    if (raise) {
+        cpu_interrupt_up(cpu, data->intno);
+    } else {
+        cpu_interrupt_down(cpu, data->intno);
+    }
+}
+
+/** Update the contexts enabling a source
+ *
+ * @param data   Instance data structure
+ * @param source Source whose state has changed
+ *
+ */
+static void plic_update_source(plic_data_t *data, unsigned int source)
+{
+    for (unsigned int i = 0; i < get_cpu_count(); i++) {
+        unsigned int ctx = get_cpu_by_index(i)->cpuno;
+
+        if ((data->enable[ctx] & SOURCE_BIT(source)) != 0) {
+            plic_update_context(data, ctx);
+        }
+    }
+}
+
+/** Link or unlink a pending source in the bitmap of its priority
+ *
+ * @param data    Instance data structure
+ * @param source  Source number
+ * @param pending Link (true) or unlink (false) the source
+ *
+ */
+static void plic_link(plic_data_t *data, unsigned int source, bool pending)
+{
+    uint64_t bit = SOURCE_BIT(source);
+    uint32_t priority = data->priority[source];
+
+    if (priority == 0) {
+        return;
+    }
+
+    if (pending) {
+        data->pending_at[priority] |= bit;
+        data->pending_priorities |= 1U << priority;
+    } else {
+        data->pending_at[priority] &= ~bit;
+        if (data->pending_at[priority] == 0) {
+            data->pending_priorities &= ~(1U << priority);
+        }
+    }
+}
+
+/** Set or clear the pending state of a source
+ *
+ * @param data    Instance data structure
+ * @param source  Source number
+ * @param pending New pending state
+ *
+ */
+static void plic_set_pending(plic_data_t *data, unsigned int source,
+        bool pending)
+{
+    uint64_t bit = SOURCE_BIT(source);
+
+    if (((data->pending & bit) != 0) == pending) {
+        return;
+    }
+
+    if (pending) {
+        data->pending |= bit;
+    } else {
+        data->pending &= ~bit;
+    }
+
+    plic_link(data, source, pending);
+    plic_update_source(data, source);
+}
+
+/** Change the priority of a source
+ *
+ * @param data     Instance data structure
+ * @param source   Source number
+ * @param priority New priority
+ *
+ */
+static void plic_set_priority(plic_data_t *data, unsigned int source,
+        uint32_t priority)
+{
+    if ((data->pending & SOURCE_BIT(source)) == 0) {
+        data->priority[source] = priority;
+        return;
+    }
+
+    /* Move the pending source to its new priority */
+    plic_link(data, source, false);
+    data->priority[source] = priority;
+    plic_link(data, source, true);
+
+    plic_update_source(data, source);
+}
+
+/** Claim the source of the highest priority by a context
+ *
+ * @param data Instance data structure
+ * @param ctx  Context (processor number)
+ *
+ * @return Claimed source or 0 if there is none
+ *
+ */
+static unsigned int plic_claim(plic_data_t *data, unsigned int ctx)
+{
+    unsigned int source = plic_best(data, ctx);
+
+    if (source != 0) {
+        data->claims++;
+        data->claimed |= SOURCE_BIT(source);
+        plic_set_pending(data, source, false);
+    }
+
+    return source;
+}
+
+/** Complete a claimed source
+ *
+ * A source still asserted by its device is pending again.
+ *
+ * @param data   Instance data structure
+ * @param source Completed source
+ *
+ */
+static void plic_complete(plic_data_t *data, unsigned int source)
+{
+    if ((source == 0) || (source >= SOURCES)) {
+        return;
+    }
+
+    data->claimed &= ~SOURCE_BIT(source);
+
+    if ((data->asserted & SOURCE_BIT(source)) != 0) {
+        plic_set_pending(data, source, true);
+    }
+}
+
+/** Assert a source
+ *
+ * @param data   Instance data structure
+ * @param source Source number
+ *
+ */
+static void plic_source_up(plic_data_t *data, unsigned int source)
+{
+    data->intrcount++;
+    data->asserted |= SOURCE_BIT(source);
+
+    if ((data->claimed & SOURCE_BIT(source)) == 0) {
+        plic_set_pending(data, source, true);
+    }
+}
+
+/** Deassert a source
+ *
+ * @param data   Instance data structure
+ * @param source Source number
+ *
+ */
+static void plic_source_down(plic_data_t *data, unsigned int source)
+{
+    data->asserted &= ~SOURCE_BIT(source);
+    plic_set_pending(data, source, false);
+}
+
+/** Parse the routing of a device interrupt
+ *
+ * Reads the name of a dplic device and a source number.
+ *
+ * @param parm   Command-line parameters
+ * @param plic   Dplic device (returned)
+ * @param source Source number (returned)
+ *
+ * @return True if the parameters are valid
+ *
+ */
+bool plic_route(token_t *parm, device_t **plic, unsigned int *source)
+{
+    const char *const name = parm_str_next(&parm);
+
+    device_t *dev = dev_by_name(name);
+    if ((dev == NULL) || (dev->type != &dplic)) {
+        error("Unknown interrupt controller <%s>", name);
+        return false;
+    }
+
+    if (parm_type(parm) != tt_uint) {
+        error("Source number expected");
+        return false;
+    }
+
+    uint64_t _source = parm_uint(parm);
+    if ((_source == 0) || (_source >= SOURCES)) {
+        error("Source number out of range 1..%u", SOURCES - 1);
+        return false;
+    }
+
+    *plic = dev;
+    *source = _source;
+    return true;
+}
+
+/** Assert the interrupt of a device
+ *
+ * @param plic   Dplic device the interrupt is routed to
+ *               (NULL for the processor interrupt)
+ * @param source Source number within the dplic
+ * @param intno  Interrupt number of the fallback processor
+ *               (used without the dplic)
+ *
+ */
+void plic_interrupt_up(device_t *plic, unsigned int source, unsigned int intno)
+{
+    if (plic == NULL) {
+        cpu_interrupt_up(NULL, intno);
+    } else {
+        plic_source_up((plic_data_t *) plic->data, source);
+    }
+}
+
+/** Deassert the interrupt of a device
+ *
+ * @see plic_interrupt_up
+ *
+ */
+void plic_interrupt_down(device_t *plic, unsigned int source, unsigned int intno)
+{
+    if (plic == NULL) {
+        cpu_interrupt_down(NULL, intno);
+    } else {
+        plic_source_down((plic_data_t *) plic->data, source);
+    }
+}
+
+/** Read a source number command parameter
+ *
+ * @param parm   Command-line parameters
+ * @param source Source number (returned)
+ *
+ * @return True if the source is valid
+ *
+ */
+static bool dplic_parm_source(token_t *parm, unsigned int *source)
+{
+    uint64_t val = parm_uint(parm);
+
+    if ((val == 0) || (val >= SOURCES)) {
+        error("Source number out of range 1..%u", SOURCES - 1);
+        return false;
+    }
+
+    *source = val;
+    return true;
+}
+
+/** Init command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool dplic_init(token_t *parm, device_t *dev)
+{
+    parm_next(&parm);
+    uint64_t _addr = parm_uint_next(&parm);
+    uint64_t _intno = parm_uint_next(&parm);
+
+    if (!phys_range(_addr)) {
+        error("Physical memory address out of range");
+        return false;
+    }
+
+    if (!phys_range(_addr + (uint64_t) REGISTER_LIMIT)) {
+        error("Invalid address, registers would exceed the physical "
+              "memory range");
+        return false;
+    }
+
+    ptr36_t addr = _addr;
+
+    if (!ptr36_dword_aligned(addr)) {
+        error("Physical memory address must be 8-byte aligned");
+        return false;
+    }
+
+    if (_intno > MAX_INTRS) {
+        error("%s", txt_intnum_range);
+        return false;
+    }
+
+    /* Initialization */
+    plic_data_t *data = safe_malloc_t(plic_data_t);
+    memset(data, 0, sizeof(plic_data_t));
+    dev->data = data;
+
+    data->addr = addr;
+    data->intno = _intno;
+
+    dev_map(dev, addr, REGISTER_LIMIT);
+
+    return true;
+}
+
+/** Info command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True (always successful)
+ *
+ */
+static bool dplic_info(token_t *parm, device_t *dev)
+{
+    plic_data_t *data = (plic_data_t *) dev->data;
+
+    printf("[address ] [int] [pending         ] [claimed         ]\n");
+    printf("%#11" PRIx64 " %-5u %016" PRIx64 "   %016" PRIx64 "\n",
+            data->addr, data->intno, data->pending, data->claimed);
+
+    return true;
+}
+
+/** Stat command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True (always successful)
+ *
+ */
+static bool dplic_stat(token_t *parm, device_t *dev)
+{
+    plic_data_t *data = (plic_data_t *) dev->data;
+
+    printf("[interrupt count] [claim count]\n");
+    printf("%-17" PRIu64 " %" PRIu64 "\n", data->intrcount, data->claims);
+
+    return true;
+}
+
+/** Up command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool dplic_up(token_t *parm, device_t *dev)
+{
+    unsigned int source;
+
+    if (!dplic_parm_source(parm, &source)) {
+        return false;
+    }
+
+    plic_source_up((plic_data_t *) dev->data, source);
+    return true;
+}
+
+/** Down command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool dplic_down(token_t *parm, device_t *dev)
+{
+    unsigned int source;
+
+    if (!dplic_parm_source(parm, &source)) {
+        return false;
+    }
+
+    plic_source_down((plic_data_t *) dev->data, source);
+    return true;
+}
+
+/** Dispose dplic
+ *
+ * @param dev Device pointer
+ *
+ */
+static void dplic_done(device_t *dev)
+{
+    safe_free(dev->data);
+}
+
+/** Read command implementation
+ *
+ * @param dev  Device pointer
+ * @param addr Address of the read operation
+ * @param val  Read (returned) value
+ *
+ */
+static void dplic_read32(unsigned int procno, device_t *dev, ptr36_t addr, uint32_t *val)
+{
+    ASSERT(dev != NULL);
+    ASSERT(val != NULL);
+
+    plic_data_t *data = (plic_data_t *) dev->data;
+    ptr36_t offset = addr - data->addr;
+
+    if ((offset & 3) != 0) {
+        return;
+    }
+
+    *val = 0;
+
+    if (offset < REGISTER_PENDING) {
+        unsigned int source = (offset - REGISTER_PRIORITY) / 4;
+        if (source < SOURCES) {
+            *val = data->priority[source];
+        }
+    } else if (offset < REGISTER_ENABLE) {
+        unsigned int word = (offset - REGISTER_PENDING) / 4;
+        if (word < SOURCES / 32) {
+            *val = (uint32_t) (data->pending >> (word * 32));
+        }
+    } else if (offset < REGISTER_CONTEXT) {
+        unsigned int ctx = (offset - REGISTER_ENABLE) / REGISTER_ENABLE_STRIDE;
+        unsigned int word = (offset - REGISTER_ENABLE) % REGISTER_ENABLE_STRIDE / 4;
+        if ((ctx < MAX_CPUS) && (word < SOURCES / 32)) {
+            *val = (uint32_t) (data->enable[ctx] >> (word * 32));
+        }
+    } else {
+        unsigned int ctx = (offset - REGISTER_CONTEXT) / REGISTER_CONTEXT_STRIDE;
+
+        switch ((offset - REGISTER_CONTEXT) % REGISTER_CONTEXT_STRIDE) {
+        case REGISTER_THRESHOLD:
+            *val = data->threshold[ctx];
+            break;
+        case REGISTER_CLAIM:
+            *val = plic_claim(data, ctx);
+            break;
+        }
+    }
+}
+
+/** Write command implementation
+ *
+ * @param dev  Device pointer
+ * @param addr Address of the write operation
+ * @param val  Value to write
+ *
+ */
+static void dplic_write32(unsigned int procno, device_t *dev, ptr36_t addr, uint32_t val)
+{
+    ASSERT(dev != NULL);
+
+    plic_data_t *data = (plic_data_t *) dev->data;
+    ptr36_t offset = addr - data->addr;
+
+    if ((offset & 3) != 0) {
+        return;
+    }
+
+    if (offset < REGISTER_PENDING) {
+        unsigned int source = (offset - REGISTER_PRIORITY) / 4;
+        if ((source != 0) && (source < SOURCES)) {
+            plic_set_priority(data, source, val % PRIORITIES);
+        }
+    } else if (offset < REGISTER_ENABLE) {
+        /* Pending sources are read-only */
+    } else if (offset < REGISTER_CONTEXT) {
+        unsigned int ctx = (offset - REGISTER_ENABLE) / REGISTER_ENABLE_STRIDE;
+        unsigned int word = (offset - REGISTER_ENABLE) % REGISTER_ENABLE_STRIDE / 4;
+        if ((ctx < MAX_CPUS) && (word < SOURCES / 32)) {
+            uint64_t mask = ((uint64_t) UINT32_MAX) << (word * 32);
+            uint64_t bits = ((uint64_t) val) << (word * 32);
+
+            /* Source 0 does not exist */
+            data->enable[ctx] = ((data->enable[ctx] & ~mask) | bits) & ~SOURCE_BIT(0);
+            plic_update_context(data, ctx);
+        }
+    } else {
+        unsigned int ctx = (offset - REGISTER_CONTEXT) / REGISTER_CONTEXT_STRIDE;
+
+        switch ((offset - REGISTER_CONTEXT) % REGISTER_CONTEXT_STRIDE) {
+        case REGISTER_THRESHOLD:
+            data->threshold[ctx] = val % PRIORITIES;
+            plic_update_context(data, ctx);
+            break;
+        case REGISTER_CLAIM:
+            plic_complete(data, val);
+            break;
+        }
+    }
+}
+
+/** Save the controller state into a checkpoint
+ *
+ * @param dev  Device instance pointer
+ * @param ckpt Checkpoint being written
+ *
+ * @return True if successful
+ *
+ */
+static bool dplic_save(device_t *dev, checkpoint_t *ckpt)
+{
+    plic_data_t *data = (plic_data_t *) dev->data;
+
+    return checkpoint_write_var(ckpt, data->priority)
+            && checkpoint_write_var(ckpt, data->asserted)
+            && checkpoint_write_var(ckpt, data->pending)
+            && checkpoint_write_var(ckpt, data->claimed)
+            && checkpoint_write_var(ckpt, data->pending_at)
+            && checkpoint_write_var(ckpt, data->pending_priorities)
+            && checkpoint_write_var(ckpt, data->enable)
+            && checkpoint_write_var(ckpt, data->threshold)
+            && checkpoint_write_var(ckpt, data->raised)
+            && checkpoint_write_var(ckpt, data->intrcount)
+            && checkpoint_write_var(ckpt, data->claims);
+}
+
+/** Load the controller state from a checkpoint
+ *
+ * @param dev  Device instance pointer
+ * @param ckpt Checkpoint being read
+ *
+ * @return True if successful
+ *
+ */
+static bool dplic_load(device_t *dev, checkpoint_t *ckpt)
+{
+    plic_data_t *data = (plic_data_t *) dev->data;
+
+    return checkpoint_read_var(ckpt, data->priority)
+            && checkpoint_read_var(ckpt, data->asserted)
+            && checkpoint_read_var(ckpt, data->pending)
+            && checkpoint_read_var(ckpt, data->claimed)
+            && checkpoint_read_var(ckpt, data->pending_at)
+            && checkpoint_read_var(ckpt, data->pending_priorities)
+            && checkpoint_read_var(ckpt, data->enable)
+            && checkpoint_read_var(ckpt, data->threshold)
+            && checkpoint_read_var(ckpt, data->raised)
+            && checkpoint_read_var(ckpt, data->intrcount)
+            && checkpoint_read_var(ckpt, data->claims);
+}
+
+static cmd_t dplic_cmds[] = {
+    { "init",
+            (fcmd_t) dplic_init,
+            DEFAULT,
+            DEFAULT,
+            "Initialization",
+            "Initialization",
+            REQ STR "name/controller name" NEXT
+                    REQ INT "addr/register block address" NEXT
+                            REQ INT "intno/interrupt number of the processors" END },
+    { "help",
+            (fcmd_t) dev_generic_help,
+            DEFAULT,
+            DEFAULT,
+            "Display help",
+            "Display help",
+            OPT STR "cmd/command name" END },
+    { "info",
+            (fcmd_t) dplic_info,
+            DEFAULT,
+            DEFAULT,
+            "Display device configuration",
+            "Display device configuration",
+            NOCMD },
+    { "stat",
+            (fcmd_t) dplic_stat,
+            DEFAULT,
+            DEFAULT,
+            "Display device statistics",
+            "Display device statistics",
+            NOCMD },
+    { "up",
+            (fcmd_t) dplic_up,
+            DEFAULT,
+            DEFAULT,
+            "Assert a source",
+            "Assert a source",
+            REQ INT "source/source number" END },
+    { "down",
+            (fcmd_t) dplic_down,
+            DEFAULT,
+            DEFAULT,
+            "Deassert a source",
+            "Deassert a source",
+            REQ INT "source/source number" END },
+    LAST_CMD
+};
+
+/** Dplic object structure */
+device_type_t dplic = {
+    /* Type name and description */
+    .name = "dplic",
+    .brief = "Platform-level interrupt controller",
+    .full = "The platform-level interrupt controller distributes "
+            "the interrupts of the devices routed to it among "
+            "the processors by the priorities of the sources and "
+            "the enabled sources and thresholds of the processors.",
+
+    /* Functions */
+    .done = dplic_done,
+    .read32 = dplic_read32,
+    .write32 = dplic_write32,
+    .save = dplic_save,
+    .load = dplic_load,
+
+    /* Commands */
+    .cmds = dplic_cmds
+};
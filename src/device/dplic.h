@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Platform-level interrupt controller
+ *
+ */
+
+#ifndef DPLIC_H_
+#define DPLIC_H_
+
+#include "../parser.h"
+#include "device.h"
+
+extern device_type_t dplic;
+
+extern bool plic_route(token_t *parm, device_t **plic, unsigned int *source);
+extern void plic_interrupt_up(device_t *plic, unsigned int source,
+        unsigned int intno);
+extern void plic_interrupt_down(device_t *plic, unsigned int source,
+        unsigned int intno);
+
+#endif
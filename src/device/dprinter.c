@@ -16,7 +16,11 @@
 #include <string.h>
 
 #include "../assert.h"
+#include "../checkpoint.h"
+#include "../debug/statsrv.h"
 #include "../fault.h"
+#include "../main.h"
+#include "../output.h"
 #include "../parser.h"
 #include "../text.h"
 #include "../utils.h"
@@ -27,13 +31,24 @@
 #define REGISTER_CHAR 0 /**< Output character */
 #define REGISTER_LIMIT 4 /**< Size of the register block */
 
+/** Default number of cycles the output stays buffered */
+#define DEFAULT_FLUSH_DELAY 100000
+
 typedef struct {
     ptr36_t addr; /**< Printer register address */
 
     FILE *file; /**< Output file */
     char *fname; /**< Output file name */
+    output_t output; /**< Buffered output to the file */
+
+    uint64_t flush_delay; /**< Cycles until an incomplete line is flushed */
+    bool flush_scheduled; /**< The flush event is pending */
 
     uint64_t count; /**< Number of printed characters */
+
+    FILE *expect; /**< Expected output file (NULL if not compared) */
+    char *expect_fname; /**< Expected output file name */
+    uint64_t expect_offset; /**< Characters matching the expected output */
 } printer_data_t;
 
 /** Init command implementation
@@ -70,7 +85,15 @@ static bool dprinter_init(token_t *parm, device_t *dev)
     data->addr = addr;
     data->file = stdout;
     data->fname = NULL;
+    data->flush_delay = DEFAULT_FLUSH_DELAY;
+    data->flush_scheduled = false;
     data->count = 0;
+    data->expect = NULL;
+    data->expect_fname = NULL;
+    data->expect_offset = 0;
+    output_init(&data->output, stdout);
+
+    dev_map(dev, addr, REGISTER_LIMIT);
 
     return true;
 }
@@ -89,6 +112,8 @@ static bool dprinter_redir(token_t *parm, device_t *dev)
         return false;
     }
 
+    output_set_file(&data->output, file);
+
     /* Close old output file */
     if (data->file != stdout) {
         safe_fclose(data->file, data->fname);
@@ -108,6 +133,8 @@ static bool dprinter_stdout(token_t *parm, device_t *dev)
 {
     printer_data_t *data = (printer_data_t *) dev->data;
 
+    output_set_file(&data->output, stdout);
+
     /* Close old ouput file if it is not stdout already */
     if (data->file != stdout) {
         safe_fclose(data->file, data->fname);
@@ -118,6 +145,40 @@ static bool dprinter_stdout(token_t *parm, device_t *dev)
     return true;
 }
 
+/** Stop comparing the output with the expected output */
+static void printer_expect_close(printer_data_t *data)
+{
+    if (data->expect != NULL) {
+        safe_fclose(data->expect, data->expect_fname);
+        safe_free(data->expect_fname);
+        data->expect = NULL;
+    }
+}
+
+/** Expect command implementation
+ *
+ * The characters printed from now on are compared with the contents
+ * of the file as they are written.
+ *
+ */
+static bool dprinter_expect(token_t *parm, device_t *dev)
+{
+    printer_data_t *data = (printer_data_t *) dev->data;
+    char *fname = parm_str(parm);
+
+    FILE *file = try_fopen(fname, "rb");
+    if (!file) {
+        return false;
+    }
+
+    printer_expect_close(data);
+
+    data->expect = file;
+    data->expect_fname = safe_strdup(fname);
+    data->expect_offset = 0;
+    return true;
+}
+
 /** Info command implementation
  *
  */
@@ -144,13 +205,158 @@ static bool dprinter_stat(token_t *parm, device_t *dev)
     return true;
 }
 
+/** Buffer command implementation
+ *
+ * Print or set whether the characters are written out immediately
+ * or buffered until a line is complete (or the given number of
+ * cycles elapses). The buffered lines may be written out by the
+ * I/O thread as well.
+ *
+ */
+static bool dprinter_buffer(token_t *parm, device_t *dev)
+{
+    printer_data_t *data = (printer_data_t *) dev->data;
+
+    if (parm_type(parm) == tt_end) {
+        if (data->output.sync) {
+            printf("Output: synchronous\n");
+        } else {
+            printf("Output: buffered, flushed within %" PRIu64 " cycles%s\n",
+                    data->flush_delay,
+                    data->output.threaded ? ", written by the I/O thread" : "");
+        }
+
+        return true;
+    }
+
+    const char *const mode = parm_str_next(&parm);
+
+    if (strcmp(mode, "sync") == 0) {
+        if (parm_type(parm) != tt_end) {
+            error("Synchronous output has no delay");
+            return false;
+        }
+
+        output_set_threaded(&data->output, false);
+        data->output.sync = true;
+        return true;
+    }
+
+    bool threaded = (strcmp(mode, "thread") == 0);
+
+    if ((!threaded) && (strcmp(mode, "buffered") != 0)) {
+        error("Unknown output mode <%s> (use sync, buffered or thread)", mode);
+        return false;
+    }
+
+    uint64_t delay = DEFAULT_FLUSH_DELAY;
+
+    if (parm_type(parm) != tt_end) {
+        delay = parm_uint(parm);
+    }
+
+    if (delay == 0) {
+        error("Flush delay must be at least one cycle");
+        return false;
+    }
+
+    output_set_threaded(&data->output, threaded);
+    data->output.sync = false;
+    data->flush_delay = delay;
+    return true;
+}
+
+/** Write out an incomplete line once the flush delay elapses
+ *
+ */
+static void printer_flush_event(device_t *dev)
+{
+    printer_data_t *data = (printer_data_t *) dev->data;
+
+    data->flush_scheduled = false;
+    output_flush(&data->output);
+}
+
+/** Report the output differing from the expected output
+ *
+ * The machine halts and the simulator exits with ERR_MISMATCH,
+ * the output is not compared any further.
+ *
+ */
+static void printer_mismatch(device_t *dev)
+{
+    printer_data_t *data = (printer_data_t *) dev->data;
+
+    alert("Printer %s: output differs from %s at offset %" PRIu64,
+            dev->name, data->expect_fname, data->expect_offset);
+
+    __atomic_store_n(&machine_halt, true, __ATOMIC_RELEASE);
+    machine_exit_status = ERR_MISMATCH;
+    printer_expect_close(data);
+}
+
+/** Compare characters put into the output with the expected output */
+static void printer_expect_chars(device_t *dev, const char *buf, size_t len)
+{
+    printer_data_t *data = (printer_data_t *) dev->data;
+
+    for (size_t i = 0; i < len; i++) {
+        int c = fgetc(data->expect);
+
+        if ((c == EOF) || (c != (unsigned char) buf[i])) {
+            printer_mismatch(dev);
+            return;
+        }
+
+        data->expect_offset++;
+    }
+}
+
+/** Account characters put into the output
+ *
+ * @param dev Printer device
+ * @param buf Characters
+ * @param len Number of characters
+ *
+ */
+static void printer_written(device_t *dev, const char *buf, size_t len)
+{
+    printer_data_t *data = (printer_data_t *) dev->data;
+
+    if (data->expect != NULL) {
+        printer_expect_chars(dev, buf, len);
+    }
+
+    /* The trace output must not overtake the printed characters */
+    if (machine_trace) {
+        output_settle(&data->output);
+    }
+
+    if ((data->output.len > 0) && (!data->flush_scheduled)) {
+        dev_schedule(dev, data->flush_delay, printer_flush_event);
+        data->flush_scheduled = true;
+    }
+
+    data->count += len;
+}
+
 /** Clean up the device
+ *
+ * The output missing at the end of the expected output
+ * is reported as well.
  *
  */
 static void printer_done(device_t *dev)
 {
     printer_data_t *data = (printer_data_t *) dev->data;
 
+    if ((data->expect != NULL) && (fgetc(data->expect) != EOF)) {
+        printer_mismatch(dev);
+    }
+
+    printer_expect_close(data);
+    output_done(&data->output);
+
     /* Close output file if it is not stdout */
     if (data->file != stdout) {
         safe_fclose(data->file, data->fname);
@@ -169,23 +375,87 @@ static void printer_write32(unsigned int procno, device_t *dev, ptr36_t addr, ui
 
     printer_data_t *data = (printer_data_t *) dev->data;
 
+    char c = (char) val;
+
     switch (addr - data->addr) {
     case REGISTER_CHAR:
-        fprintf(data->file, "%c", (char) val);
-        /* Write to console is flushed immediately */
-        /* This makes debugging somewhat easier */
-        if (data->file == stdout) {
-            fflush(data->file);
-        }
-        data->count++;
+        output_putc(&data->output, c);
+        printer_written(dev, &c, 1);
         break;
     }
 }
 
+/** Print a block of characters at once
+ *
+ * Used by the console hypercall, the characters are printed
+ * as if written to the character register one by one.
+ *
+ * @param dev Printer device
+ * @param buf Characters to print
+ * @param len Number of characters
+ *
+ */
+void dprinter_write(device_t *dev, const char *buf, size_t len)
+{
+    ASSERT(dev != NULL);
+    ASSERT(dev->type == &dprinter);
+
+    printer_data_t *data = (printer_data_t *) dev->data;
+
+    for (size_t i = 0; i < len; i++) {
+        output_putc(&data->output, buf[i]);
+    }
+
+    printer_written(dev, buf, len);
+}
+
+/** Save the printer state into a checkpoint
+ *
+ * The output has been flushed before the checkpoint is saved.
+ *
+ */
+static bool printer_save(device_t *dev, checkpoint_t *ckpt)
+{
+    printer_data_t *data = (printer_data_t *) dev->data;
+
+    return checkpoint_write_var(ckpt, data->flush_scheduled)
+            && checkpoint_write_var(ckpt, data->count);
+}
+
+/** Load the printer state from a checkpoint
+ *
+ */
+static bool printer_load(device_t *dev, checkpoint_t *ckpt)
+{
+    printer_data_t *data = (printer_data_t *) dev->data;
+
+    output_flush(&data->output);
+
+    return checkpoint_read_var(ckpt, data->flush_scheduled)
+            && checkpoint_read_var(ckpt, data->count);
+}
+
+/** Events scheduled by the printer */
+static const dev_event_fnc_t printer_events[] = {
+    printer_flush_event,
+    NULL
+};
+
 /*
  * Device commands
  */
 
+/** Export the printer counters to the statistics endpoint
+ *
+ */
+static void printer_stats(device_t *dev, statsrv_t *stats)
+{
+    printer_data_t *data = (printer_data_t *) dev->data;
+
+    statsrv_counter(stats, "printer_chars_total", "Printed characters",
+            data->count);
+}
+
 static cmd_t printer_cmds[] = {
     { "init",
             (fcmd_t) dprinter_init,
@@ -230,6 +500,21 @@ static cmd_t printer_cmds[] = {
             "Redirect output to the standard output",
             "Redirect output to the standard output",
             NOCMD },
+    { "expect",
+            (fcmd_t) dprinter_expect,
+            DEFAULT,
+            DEFAULT,
+            "Compare the output with the specified file",
+            "Compares the characters printed from now on with the contents of the file as they are printed. On the first difference (or at the end of the simulation if the output is shorter) the machine halts and the simulator exits with the status 7.",
+            REQ STR "filename/expected output file name" END },
+    { "buffer",
+            (fcmd_t) dprinter_buffer,
+            DEFAULT,
+            DEFAULT,
+            "Print or set the output buffering",
+            "Without arguments prints the output buffering. The sync mode writes every character immediately, the buffered mode writes complete lines and flushes an incomplete line after the delay (in cycles). The thread mode buffers the output as the buffered mode, but the lines are written out by a separate I/O thread, so the simulation does not wait for the output file or the terminal.",
+            OPT STR "mode/sync, buffered or thread" NEXT
+                    OPT INT "delay/cycles until flush" END },
     LAST_CMD
 };
 
@@ -249,5 +534,11 @@ device_type_t dprinter = {
     .write32 = printer_write32,
 
     /* Commands */
-    .cmds = printer_cmds
+    .cmds = printer_cmds,
+
+    /* Checkpoints */
+    .save = printer_save,
+    .load = printer_load,
+    .events = printer_events,
+    .stats = printer_stats
 };
@@ -12,8 +12,12 @@
 #ifndef DPRINTER_H_
 #define DPRINTER_H_
 
+#include <stddef.h>
+
 #include "device.h"
 
 extern device_type_t dprinter;
 
+extern void dprinter_write(device_t *dev, const char *buf, size_t len);
+
 #endif
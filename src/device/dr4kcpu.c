@@ -14,12 +14,19 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../checkpoint.h"
 #include "../debug/breakpoint.h"
+#include "../debug/cachesim.h"
+#include "../debug/catchpoint.h"
 #include "../debug/debug.h"
+#include "../debug/statsrv.h"
 #include "../fault.h"
 #include "../main.h"
+#include "../parallel.h"
 #include "../utils.h"
+#include "cpu/decode_cache.h"
 #include "cpu/general_cpu.h"
+#include "cpu/jit.h"
 #include "cpu/mips_r4000/cpu.h"
 #include "cpu/mips_r4000/debug.h"
 #include "device.h"
@@ -30,14 +37,151 @@ static bool r4k_cpu_convert_addr(r4k_cpu_t *cpu, ptr64_t virt, ptr36_t *phys, bo
     return r4k_convert_addr(cpu, virt, phys, write, false) == r4k_excNone;
 }
 
+static ptr64_t r4k_cpu_get_pc(r4k_cpu_t *cpu)
+{
+    return cpu->pc;
+}
+
+static void r4k_cpu_insert_breakpoint(r4k_cpu_t *cpu, ptr64_t addr, breakpoint_kind_t kind)
+{
+    breakpoint_code_insert(cpu->procno, addr, kind);
+}
+
+static void r4k_cpu_remove_breakpoint(r4k_cpu_t *cpu, ptr64_t addr, breakpoint_kind_t kind)
+{
+    breakpoint_code_remove(cpu->procno, addr, (breakpoint_filter_t) kind);
+}
+
+/** Cycles out of the standby are the executed instructions */
+static uint64_t r4k_cpu_instructions(r4k_cpu_t *cpu)
+{
+    return cpu->k_cycles + cpu->u_cycles;
+}
+
+/** Kernel mode is also entered by an exception or an error */
+static cpu_mode_t r4k_cpu_mode(r4k_cpu_t *cpu)
+{
+    if ((cp0_status_exl(cpu)) || (cp0_status_erl(cpu))) {
+        return cpu_mode_kernel;
+    }
+
+    switch (cp0_status_ksu(cpu)) {
+    case 1:
+        return cpu_mode_supervisor;
+    case 2:
+        return cpu_mode_user;
+    default:
+        return cpu_mode_kernel;
+    }
+}
+
+/** \{ \name Registers of the debugger following the general registers */
+#define R4K_GDB_STATUS 32
+#define R4K_GDB_LO 33
+#define R4K_GDB_HI 34
+#define R4K_GDB_BADVADDR 35
+#define R4K_GDB_CAUSE 36
+#define R4K_GDB_PC 37
+#define R4K_GDB_COUNT 38
+/* \} */
+
+/** Registers in the default layout of the MIPS debugger */
+static const cpu_regs_t r4k_cpu_regs = {
+    .arch = NULL,
+    .feature = NULL,
+    .names = NULL,
+    .count = R4K_GDB_COUNT,
+    .width = sizeof(uint64_t),
+    .pc = R4K_GDB_PC,
+    .kseg = true
+};
+
+static bool r4k_cpu_reg_read(r4k_cpu_t *cpu, unsigned int reg, uint64_t *val)
+{
+    switch (reg) {
+    case R4K_GDB_STATUS:
+        *val = cpu->cp0[cp0_Status].val;
+        break;
+    case R4K_GDB_LO:
+        *val = cpu->loreg.val;
+        break;
+    case R4K_GDB_HI:
+        *val = cpu->hireg.val;
+        break;
+    case R4K_GDB_BADVADDR:
+        *val = cpu->cp0[cp0_BadVAddr].val;
+        break;
+    case R4K_GDB_CAUSE:
+        *val = cpu->cp0[cp0_Cause].val;
+        break;
+    case R4K_GDB_PC:
+        *val = cpu->pc.ptr;
+        break;
+    default:
+        *val = cpu->regs[reg].val;
+        break;
+    }
+
+    return true;
+}
+
+/** The program counter is moved only if changed, not to leave a delay slot */
+static bool r4k_cpu_reg_write(r4k_cpu_t *cpu, unsigned int reg, uint64_t val)
+{
+    switch (reg) {
+    case 0:
+        break;
+    case R4K_GDB_STATUS:
+        cpu->cp0[cp0_Status].val = val;
+        r4k_update_interrupt(cpu);
+        break;
+    case R4K_GDB_LO:
+        cpu->loreg.val = val;
+        break;
+    case R4K_GDB_HI:
+        cpu->hireg.val = val;
+        break;
+    case R4K_GDB_BADVADDR:
+        cpu->cp0[cp0_BadVAddr].val = val;
+        break;
+    case R4K_GDB_CAUSE:
+        cpu->cp0[cp0_Cause].val = val;
+        r4k_update_interrupt(cpu);
+        break;
+    case R4K_GDB_PC:
+        if (val != cpu->pc.ptr) {
+            ptr64_t pc;
+            pc.ptr = val;
+            r4k_set_pc(cpu, pc);
+        }
+        break;
+    default:
+        cpu->regs[reg].val = val;
+        break;
+    }
+
+    return true;
+}
+
 static const cpu_ops_t r4k_cpu = {
     .interrupt_up = (interrupt_func_t) r4k_interrupt_up,
     .interrupt_down = (interrupt_func_t) r4k_interrupt_down,
+    .insert_breakpoint = (insert_breakpoint_func_t) r4k_cpu_insert_breakpoint,
+    .remove_breakpoint = (remove_breakpoint_func_t) r4k_cpu_remove_breakpoint,
 
     .convert_addr = (convert_addr_func_t) r4k_cpu_convert_addr,
     .reg_dump = (reg_dump_func_t) r4k_reg_dump,
     .set_pc = (set_pc_func_t) r4k_set_pc,
-    .sc_access = (sc_access_func_t) r4k_sc_access
+    .get_pc = (get_pc_func_t) r4k_cpu_get_pc,
+    .sc_access = (sc_access_func_t) r4k_sc_access,
+    .standby = (standby_func_t) r4k_standby,
+    .skip = (skip_func_t) r4k_skip,
+    .deadloop = (deadloop_func_t) r4k_deadloop,
+    .instructions = (instructions_func_t) r4k_cpu_instructions,
+    .mode = (mode_func_t) r4k_cpu_mode,
+    .regs = &r4k_cpu_regs,
+    .reg_read = (reg_read_func_t) r4k_cpu_reg_read,
+    .reg_write = (reg_write_func_t) r4k_cpu_reg_write
 };
 
 /** Initialization
@@ -52,8 +196,25 @@ static bool dr4kcpu_init(token_t *parm, device_t *dev)
         return false;
     }
 
-    r4k_cpu_t *cpu = safe_malloc_t(r4k_cpu_t);
+    parm_next(&parm);
+    uint64_t entries = TLB_ENTRIES;
+
+    if (parm->ttype != tt_end) {
+        entries = parm_uint(parm);
+
+        if ((entries == 0) || (entries > TLB_ENTRIES_MAX)) {
+            error("Number of TLB entries out of range (1 to %u)",
+                    TLB_ENTRIES_MAX);
+            return false;
+        }
+    }
+
+    r4k_cpu_t *cpu = safe_malloc_aligned_t(r4k_cpu_t);
     r4k_init(cpu, id);
+
+    if (entries != TLB_ENTRIES) {
+        r4k_set_tlb_entries(cpu, entries);
+    }
     general_cpu_t *gen_cpu = safe_malloc_t(general_cpu_t);
     gen_cpu->cpuno = id;
     gen_cpu->data = cpu;
@@ -71,10 +232,41 @@ static bool dr4kcpu_init(token_t *parm, device_t *dev)
  */
 static bool dr4kcpu_info(token_t *parm, device_t *dev)
 {
-    printf("R4000\n");
+    r4k_cpu_t *cpu = get_r4k(dev);
+
+    if (cpu->tlb_entries == TLB_ENTRIES) {
+        printf("R4000\n");
+    } else {
+        printf("R4000 with %u TLB entries (not architectural)\n",
+                cpu->tlb_entries);
+    }
+
     return true;
 }
 
+/** Write the mnemonic of an instruction
+ *
+ * The instructions with a pseudo-instruction form (nop,
+ * li) are named by the instruction itself.
+ *
+ */
+static void instr_name(uint32_t word, string_t *name)
+{
+    r4k_instr_t instr = { .val = word };
+    ptr64_t addr = { .ptr = 0 };
+    string_t comments;
+
+    if ((instr.r.opcode == r4k_opcSPECIAL) && (instr.r.func == funcSLL)) {
+        instr.r.rd = 1;
+    } else if (instr.i.opcode == r4k_opcADDIU) {
+        instr.i.rs = 1;
+    }
+
+    string_init(&comments);
+    decode_mnemonics(instr)(addr, instr, name, &comments);
+    string_done(&comments);
+}
+
 /** Stat command implementation
  *
  */
@@ -100,9 +292,49 @@ static bool dr4kcpu_stat(token_t *parm, device_t *dev)
             cpu->intr[2], cpu->intr[3], cpu->intr[4]);
 
     printf("[Interrupt 5       ] [Interrupt 6       ] [Interrupt 7       ]\n");
-    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n",
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n\n",
             cpu->intr[5], cpu->intr[6], cpu->intr[7]);
 
+    intr_latency_print(&cpu->intr_latency);
+    cachesim_print(cpu->procno);
+
+    printf("[Victim TLB hits   ] [Fetch cache hits  ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 "\n\n", cpu->tlb_victim_hits,
+            cpu->fetch_cache_hits);
+
+    if (cpu->timing.enabled) {
+        printf("[Load stalls       ] [Mul/div stalls    ] [Branch stalls     ]\n");
+        printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n\n",
+                cpu->timing.load_stalls, cpu->timing.mdu_stalls,
+                cpu->timing.branch_stalls);
+    }
+
+    printf("[Decode cache hits ] [Decode cache miss ] [Page redecodes    ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n\n",
+            cpu->decode_stats.hits, cpu->decode_stats.misses,
+            cpu->decode_stats.redecodes);
+
+    decode_pool_t *pool = &decode_pools[DECODE_R4K];
+
+    printf("[Cached pages      ] [Evictions         ] [Replacement       ]\n");
+    printf("%20zu %20" PRIu64 " %20s\n\n",
+            pool->count, pool->evictions, decode_policy_name(pool->policy));
+
+    printf("[Cache memory (KiB)] [Page capacity     ] [Restored pages    ]\n");
+    printf("%20zu %20zu %20" PRIu64 "\n\n",
+            decode_cache_memory(DECODE_R4K) / 1024, pool->capacity,
+            pool->restored);
+
+    printf("[Blocks executed   ] [Block instructions]\n");
+    printf("%20" PRIu64 " %20" PRIu64 "\n\n",
+            cpu->blocks, cpu->block_instrs);
+
+    printf("[Translated blocks ] [Translations      ] [JIT flushes       ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n",
+            cpu->jit_blocks, jit_stats.translations, jit_stats.flushes);
+
+    mixstat_print(&cpu->mix, instr_name);
+
     return true;
 }
 
@@ -282,11 +514,8 @@ static bool dr4kcpu_break(token_t *parm, device_t *dev)
     // when the emulated CPU is 32bit.
     addr.ptr = UINT64_C(0xffffffff00000000) | _addr;
 
-    breakpoint_t *bp = breakpoint_init(addr,
-            BREAKPOINT_KIND_SIMULATOR);
-    list_append(&cpu->bps, &bp->item);
-
-    return true;
+    const char *cond = (parm->ttype == tt_end) ? NULL : parm_str(parm);
+    return breakpoint_code_set(cpu->procno, addr, cond);
 }
 
 /** Bd command implementation
@@ -295,74 +524,323 @@ static bool dr4kcpu_break(token_t *parm, device_t *dev)
 static bool dr4kcpu_bd(token_t *parm, device_t *dev)
 {
     r4k_cpu_t *cpu = get_r4k(dev);
-    breakpoint_t *bp;
 
-    printf("[address ] [hits              ] [kind    ]\n");
+    breakpoint_code_print_list(cpu->procno);
+    return true;
+}
 
-    for_each(cpu->bps, bp, breakpoint_t)
-    {
-        const char *kind = (bp->kind == BREAKPOINT_KIND_SIMULATOR)
-                ? "Simulator"
-                : "Debugger";
+/** Br command implementation
+ *
+ */
+static bool dr4kcpu_br(token_t *parm, device_t *dev)
+{
+    r4k_cpu_t *cpu = get_r4k(dev);
+    uint64_t _addr = ALIGN_DOWN(parm_uint_next(&parm), 4);
 
-        printf("%#018" PRIx64 " %20" PRIu64 " %s\n",
-                bp->pc.ptr, bp->hits, kind);
+    if (!virt_range(_addr)) {
+        error("Virtual address out of range");
+        return false;
+    }
+
+    ptr64_t addr;
+    // Extend the address the same way as the break command does.
+    addr.ptr = UINT64_C(0xffffffff00000000) | _addr;
+
+    if (!breakpoint_code_remove(cpu->procno, addr, BREAKPOINT_FILTER_ANY)) {
+        error("Unknown breakpoint");
+        return false;
     }
 
     return true;
 }
 
-/** Br command implementation
+/** Catch command implementation
  *
  */
-static bool dr4kcpu_br(token_t *parm, device_t *dev)
+static bool dr4kcpu_catch(token_t *parm, device_t *dev)
 {
     r4k_cpu_t *cpu = get_r4k(dev);
-    uint64_t addr = ALIGN_DOWN(parm_uint_next(&parm), 4);
 
-    if (!virt_range(addr)) {
-        error("Virtual address out of range");
+    return catchpoint_cmd(parm, cpu->procno, r4k_cp0_name[2], R4K_REG_COUNT);
+}
+
+/** Icache command implementation
+ *
+ */
+static bool dr4kcpu_icache(token_t *parm, device_t *dev)
+{
+    decode_pool_t *pool = &decode_pools[DECODE_R4K];
+
+    if (parm->ttype == tt_end) {
+        printf("Decode cache: %zu of %zu pages, %s replacement\n",
+                pool->count, pool->capacity, decode_policy_name(pool->policy));
+        return true;
+    }
+
+    uint64_t size = parm_uint_next(&parm);
+    decode_policy_t policy = pool->policy;
+
+    if (parm->ttype != tt_end) {
+        const char *name = parm_str_next(&parm);
+
+        if (!decode_policy_from_name(name, &policy)) {
+            error("Unknown replacement policy <%s> (use lru or fifo)", name);
+            return false;
+        }
+    }
+
+    if ((size == 0) || (size > SIZE_MAX)) {
+        error("Invalid decode cache size");
         return false;
     }
 
-    bool fnd = false;
-    breakpoint_t *bp;
-    for_each(cpu->bps, bp, breakpoint_t)
-    {
-        if (bp->pc.ptr == addr) {
-            list_remove(&cpu->bps, &bp->item);
-            safe_free(bp);
-            fnd = true;
-            break;
+    decode_cache_configure(DECODE_R4K, size, policy);
+    return true;
+}
+
+/** Block command implementation
+ *
+ */
+static bool dr4kcpu_block(token_t *parm, device_t *dev)
+{
+    r4k_cpu_t *cpu = get_r4k(dev);
+
+    if (parm->ttype == tt_end) {
+        if (cpu->block_limit == 0) {
+            printf("Block execution: disabled\n");
+        } else {
+            printf("Block execution: up to %u instructions\n",
+                    cpu->block_limit);
         }
+
+        return true;
     }
 
-    if (!fnd) {
-        error("Unknown breakpoint");
+    uint64_t limit = parm_uint_next(&parm);
+
+    if (limit > FRAME_SIZE / sizeof(r4k_instr_t)) {
+        error("Block limit out of range (0 to %zu)",
+                FRAME_SIZE / sizeof(r4k_instr_t));
+        return false;
+    }
+
+    cpu->block_limit = limit;
+    return true;
+}
+
+/** Jit command implementation
+ *
+ */
+static bool dr4kcpu_jit(token_t *parm, device_t *dev)
+{
+    r4k_cpu_t *cpu = get_r4k(dev);
+
+    if (parm->ttype == tt_end) {
+        if (cpu->jit_threshold == 0) {
+            printf("Block translation: disabled\n");
+        } else {
+            printf("Block translation: after %u executions\n",
+                    cpu->jit_threshold);
+        }
+
+        return true;
+    }
+
+    uint64_t threshold = parm_uint_next(&parm);
+
+    if (threshold > JIT_THRESHOLD_MAX) {
+        error("Translation threshold out of range (0 to %u)",
+                JIT_THRESHOLD_MAX);
+        return false;
+    }
+
+    if ((threshold > 0) && (!jit_supported())) {
+        alert("Block translation is not supported on this host, blocks stay interpreted");
+        return true;
+    }
+
+    cpu->jit_threshold = threshold;
+    return true;
+}
+
+/** Victim command implementation
+ *
+ */
+static bool dr4kcpu_victim(token_t *parm, device_t *dev)
+{
+    r4k_cpu_t *cpu = get_r4k(dev);
+
+    if (parm->ttype == tt_end) {
+        if (cpu->tlb_victim_count == 0) {
+            printf("Victim TLB: disabled\n");
+        } else {
+            printf("Victim TLB: %u entries (not architectural)\n",
+                    cpu->tlb_victim_count);
+        }
+
+        return true;
+    }
+
+    uint64_t count = parm_uint_next(&parm);
+
+    if (count > R4K_TLB_VICTIM_MAX) {
+        error("Victim TLB size out of range (0 to %u)", R4K_TLB_VICTIM_MAX);
         return false;
     }
 
+    r4k_set_tlb_victim(cpu, count);
     return true;
 }
 
+/** Timing command implementation
+ *
+ */
+static bool dr4kcpu_timing(token_t *parm, device_t *dev)
+{
+    r4k_cpu_t *cpu = get_r4k(dev);
+
+    if (parm->ttype == tt_end) {
+        printf("Pipeline timing: %s\n",
+                cpu->timing.enabled ? "enabled" : "disabled");
+        return true;
+    }
+
+    const char *const state = parm_str(parm);
+
+    if (strcmp(state, "on") == 0) {
+        r4k_set_timing(cpu, true);
+    } else if (strcmp(state, "off") == 0) {
+        r4k_set_timing(cpu, false);
+    } else {
+        error("Unknown state <%s> (use on or off)", state);
+        return false;
+    }
+
+    return true;
+}
+
+/** Cache command implementation
+ *
+ */
+static bool dr4kcpu_cache(token_t *parm, device_t *dev)
+{
+    r4k_cpu_t *cpu = get_r4k(dev);
+    unsigned int cpuno = cpu->procno;
+
+    if (parm->ttype == tt_end) {
+        cachesim_print_config(cpuno);
+        return true;
+    }
+
+    const char *name = parm_str_next(&parm);
+    cachesim_level_no_t level;
+
+    if (!cachesim_level_from_name(name, &level)) {
+        error("Unknown cache level <%s> (use l1i, l1d or l2)", name);
+        return false;
+    }
+
+    if (parm->ttype == tt_end) {
+        error("Missing cache size");
+        return false;
+    }
+
+    uint64_t size = parm_uint_next(&parm);
+    uint64_t ways = 1;
+    uint64_t line = CACHESIM_DEFAULT_LINE;
+
+    if (parm->ttype != tt_end) {
+        ways = parm_uint_next(&parm);
+    }
+
+    if (parm->ttype != tt_end) {
+        line = parm_uint_next(&parm);
+    }
+
+    return cachesim_configure(cpuno, level, size, ways, line);
+}
+
+/** Pin command implementation
+ *
+ * Pins the processor to a host core during the parallel simulation.
+ *
+ */
+static bool dr4kcpu_pin(token_t *parm, device_t *dev)
+{
+    return parallel_pin_cmd((general_cpu_t *) dev->data, parm);
+}
+
 /** Done
  *
  */
 static void dr4kcpu_done(device_t *dev)
 {
-    r4k_done(get_r4k(dev));
-    safe_free(((general_cpu_t *) dev->data)->data);
+    r4k_cpu_t *cpu = get_r4k(dev);
+
+    r4k_done(cpu);
+    breakpoint_code_remove_filtered(cpu->procno, BREAKPOINT_FILTER_ANY);
+    cachesim_done(cpu->procno);
+    remove_cpu((general_cpu_t *) dev->data);
+    safe_free_aligned(((general_cpu_t *) dev->data)->data);
     safe_free(dev->data);
 }
 
+/** Save the processor state into a checkpoint
+ *
+ */
+static bool dr4kcpu_save(device_t *dev, checkpoint_t *ckpt)
+{
+    return r4k_save(get_r4k(dev), ckpt);
+}
+
+/** Load the processor state from a checkpoint
+ *
+ */
+static bool dr4kcpu_load(device_t *dev, checkpoint_t *ckpt)
+{
+    ((general_cpu_t *) dev->data)->posted = 0;
+    return r4k_load(get_r4k(dev), ckpt);
+}
+
 /** Execute one processor step
  *
  */
 static void dr4kcpu_step(device_t *dev)
 {
+    cpu_deliver_interrupts((general_cpu_t *) dev->data);
     r4k_step(get_r4k(dev));
 }
 
+/** Export the processor counters to the statistics endpoint
+ *
+ */
+static void dr4kcpu_stats(device_t *dev, statsrv_t *stats)
+{
+    r4k_cpu_t *cpu = get_r4k(dev);
+
+    statsrv_counter(stats, "cpu_instructions_total", "Instructions executed",
+            r4k_cpu_instructions(cpu));
+    statsrv_counter(stats, "cpu_kernel_cycles_total", "Cycles in the kernel mode",
+            cpu->k_cycles);
+    statsrv_counter(stats, "cpu_user_cycles_total", "Cycles in the user mode",
+            cpu->u_cycles);
+    statsrv_counter(stats, "cpu_wait_cycles_total", "Cycles in the standby mode",
+            cpu->w_cycles);
+    statsrv_counter(stats, "cpu_tlb_refills_total", "TLB Refill exceptions",
+            cpu->tlb_refill);
+    statsrv_counter(stats, "cpu_tlb_invalid_total", "TLB Invalid exceptions",
+            cpu->tlb_invalid);
+    statsrv_counter(stats, "cpu_tlb_modified_total", "TLB Modified exceptions",
+            cpu->tlb_modified);
+    statsrv_counter(stats, "cpu_fetch_cache_hits_total",
+            "Fetches translated by the fetch cache", cpu->fetch_cache_hits);
+    statsrv_counter(stats, "cpu_decode_hits_total", "Decode cache hits",
+            cpu->decode_stats.hits);
+    statsrv_counter(stats, "cpu_decode_misses_total", "Decode cache misses",
+            cpu->decode_stats.misses);
+    intr_latency_stats(&cpu->intr_latency, stats);
+}
+
 cmd_t dr4kcpu_cmds[] = {
     { "init",
             (fcmd_t) dr4kcpu_init,
@@ -370,7 +848,8 @@ cmd_t dr4kcpu_cmds[] = {
             DEFAULT,
             "Initialization",
             "Initialization",
-            REQ STR "pname/processor name" END },
+            REQ STR "pname/processor name" NEXT
+                    OPT INT "entries/number of TLB entries (48 unless experimenting)" END },
     { "help",
             (fcmd_t) dev_generic_help,
             DEFAULT,
@@ -441,8 +920,9 @@ cmd_t dr4kcpu_cmds[] = {
             DEFAULT,
             DEFAULT,
             "Add code breakpoint",
-            "Add code breakpoint",
-            REQ INT "addr/address" END },
+            "Add code breakpoint, which stops only if the condition holds",
+            REQ INT "addr/address" NEXT
+                    OPT STR "cond/condition" END },
     { "bd",
             (fcmd_t) dr4kcpu_bd,
             DEFAULT,
@@ -457,6 +937,68 @@ cmd_t dr4kcpu_cmds[] = {
             "Remove code breakpoint",
             "Remove code breakpoint",
             REQ INT "addr/address" END },
+    { "catch",
+            (fcmd_t) dr4kcpu_catch,
+            DEFAULT,
+            DEFAULT,
+            "Stop or log on exceptions, register writes or mode changes",
+            "Without arguments list the catchpoints, otherwise catch an exception code, an interrupt number, a write to a CP0 register or a change of the privilege mode",
+            OPT STR "event/exception, interrupt, write, mode or clear" NEXT
+                    OPT VAR "what/code, number, register or mode" NEXT
+                    OPT STR "action/stop or log" END },
+    { "icache",
+            (fcmd_t) dr4kcpu_icache,
+            DEFAULT,
+            DEFAULT,
+            "Configure the decoded instruction cache",
+            "Without arguments prints the decoded instruction cache configuration. Otherwise limits the number of decoded pages, optionally changing the replacement policy (lru or fifo). The cache is shared by all processors and is flushed in the process.",
+            OPT INT "pages/number of decoded pages" NEXT
+                    OPT STR "policy/lru or fifo" END },
+    { "block",
+            (fcmd_t) dr4kcpu_block,
+            DEFAULT,
+            DEFAULT,
+            "Configure block execution",
+            "Without arguments prints the block execution setting. Otherwise sets the maximal number of straight-line instructions executed in one step, 0 disables block execution.",
+            OPT INT "limit/maximal number of instructions per block" END },
+    { "jit",
+            (fcmd_t) dr4kcpu_jit,
+            DEFAULT,
+            DEFAULT,
+            "Configure block translation",
+            "Without arguments prints the block translation setting. Otherwise sets the number of executions of a block after which the block is translated into host code (only on x86-64 hosts), 0 disables the translation. The blocks are translated only while block execution is enabled.",
+            OPT INT "threshold/executions before the translation" END },
+    { "cache",
+            (fcmd_t) dr4kcpu_cache,
+            DEFAULT,
+            DEFAULT,
+            "Configure the cache model",
+            "Without arguments prints the modeled cache levels. Otherwise sets the size, associativity (1 by default) and line size (64 bytes by default) of a level of the cache model of the processor, the size 0 removes the level. The hits and misses of the levels are printed by stat.",
+            OPT STR "level/l1i, l1d or l2" NEXT
+                    OPT INT "size/size in bytes" NEXT
+                    OPT INT "ways/associativity" NEXT
+                    OPT INT "line/line size in bytes" END },
+    { "pin",
+            (fcmd_t) dr4kcpu_pin,
+            DEFAULT,
+            DEFAULT,
+            "Pin to a host core",
+            "Without arguments prints the host core of the processor. Otherwise pins the thread simulating the processor in parallel to a host core (only on Linux hosts), none allows all cores again.",
+            OPT VAR "core/host core number or none" END },
+    { "victim",
+            (fcmd_t) dr4kcpu_victim,
+            DEFAULT,
+            DEFAULT,
+            "Configure the victim TLB",
+            "Without arguments prints the victim TLB setting. Otherwise sets the number of entries of a non-architectural victim TLB keeping the entries replaced by TLBWR, which are used instead of raising the TLB Refill exception. 0 disables the victim TLB.",
+            OPT INT "entries/number of victim TLB entries" END },
+    { "timing",
+            (fcmd_t) dr4kcpu_timing,
+            DEFAULT,
+            DEFAULT,
+            "Configure the pipeline timing model",
+            "Without arguments prints the pipeline timing setting. Otherwise enables or disables the model charging the load delays, the multiply and divide latencies and the taken branches as stall cycles counted by Count and the cycle statistics. Blocks are not executed while the model is enabled.",
+            OPT STR "state/on or off" END },
     LAST_CMD
 };
 
@@ -478,5 +1020,12 @@ device_type_t dr4kcpu = {
     .step = dr4kcpu_step,
 
     /* Commands */
-    .cmds = dr4kcpu_cmds
+    .cmds = dr4kcpu_cmds,
+
+    /* Checkpoints */
+    .save = dr4kcpu_save,
+    .load = dr4kcpu_load,
+
+    /* Statistics */
+    .stats = dr4kcpu_stats
 };
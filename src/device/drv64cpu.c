@@ -13,18 +13,28 @@
  */
 
 #include <inttypes.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "../assert.h"
+#include "../checkpoint.h"
+#include "../debug/breakpoint.h"
+#include "../debug/cachesim.h"
+#include "../debug/catchpoint.h"
+#include "../debug/statsrv.h"
 #include "../fault.h"
 #include "../main.h"
+#include "../parallel.h"
+#include "../replay.h"
 #include "../utils.h"
 #include "cpu/general_cpu.h"
+#include "cpu/jit.h"
 #include "cpu/riscv_rv64ima/cpu.h"
 #include "cpu/riscv_rv64ima/csr.h"
 #include "cpu/riscv_rv64ima/debug.h"
+#include "cpu/riscv_rv64ima/mnemonics.h"
 #include "drv64cpu.h"
 
 static bool rv64_convert_add_wrapper(void *cpu, ptr64_t virt, ptr36_t *phys, bool write)
@@ -39,15 +49,128 @@ static void rv64_set_pc_wrapper(void *cpu, ptr64_t addr)
     rv64_cpu_set_pc((rv64_cpu_t *) cpu, addr.ptr);
 }
 
+static ptr64_t rv64_get_pc_wrapper(void *cpu)
+{
+    ptr64_t pc;
+    pc.ptr = ((rv64_cpu_t *) cpu)->pc;
+    return pc;
+}
+
+static void rv64_insert_breakpoint_wrapper(void *cpu, ptr64_t addr, breakpoint_kind_t kind)
+{
+    // use all 64 bits from addr
+    ptr64_t pc;
+    pc.ptr = addr.ptr;
+    breakpoint_code_insert(((rv64_cpu_t *) cpu)->csr.mhartid, pc, kind);
+}
+
+static void rv64_remove_breakpoint_wrapper(void *cpu, ptr64_t addr, breakpoint_kind_t kind)
+{
+    // use all 64 bits from addr
+    ptr64_t pc;
+    pc.ptr = addr.ptr;
+    breakpoint_code_remove(((rv64_cpu_t *) cpu)->csr.mhartid, pc, (breakpoint_filter_t) kind);
+}
+
+static uint64_t rv64_instructions_wrapper(void *cpu)
+{
+    return ((rv64_cpu_t *) cpu)->csr.instret;
+}
+
+static cpu_mode_t rv64_mode_wrapper(void *cpu)
+{
+    switch (((rv64_cpu_t *) cpu)->priv_mode) {
+    case rv_umode:
+        return cpu_mode_user;
+    case rv_smode:
+        return cpu_mode_supervisor;
+    default:
+        return cpu_mode_machine;
+    }
+}
+
+static uint64_t rv64_timer_read_wrapper(void *cpu, cpu_timer_t reg)
+{
+    rv_csr_t *csr = &((rv64_cpu_t *) cpu)->csr;
+    return (reg == cpu_timer_time) ? csr->mtime : csr->mtimecmp;
+}
+
+static void rv64_timer_write_wrapper(void *cpu, cpu_timer_t reg, uint64_t value)
+{
+    if (reg == cpu_timer_time) {
+        rv64_set_mtime((rv64_cpu_t *) cpu, value);
+    } else {
+        rv64_set_mtimecmp((rv64_cpu_t *) cpu, value);
+    }
+}
+
+/** Names of the registers known to the RISC-V debugger */
+static const char *const rv64_gdb_names[] = {
+    "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+    "fp", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+    "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+    "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6",
+    "pc"
+};
+
+/** Registers of the debugger, the general registers and the program counter */
+static const cpu_regs_t rv64_cpu_regs = {
+    .arch = "riscv:rv64",
+    .feature = "org.gnu.gdb.riscv.cpu",
+    .names = rv64_gdb_names,
+    .count = 33,
+    .width = sizeof(uint64_t),
+    .pc = 32,
+    .kseg = false
+};
+
+static bool rv64_reg_read_wrapper(void *cpu, unsigned int reg, uint64_t *val)
+{
+    rv64_cpu_t *rv = (rv64_cpu_t *) cpu;
+    *val = (reg == rv64_cpu_regs.pc) ? rv->pc : rv->regs[reg];
+    return true;
+}
+
+static bool rv64_reg_write_wrapper(void *cpu, unsigned int reg, uint64_t val)
+{
+    rv64_cpu_t *rv = (rv64_cpu_t *) cpu;
+
+    if (reg == rv64_cpu_regs.pc) {
+        /* Keep the next instruction if the debugger writes the same value */
+        if ((uint64_t) val != rv->pc) {
+            rv64_cpu_set_pc(rv, (uint64_t) val);
+        }
+    } else if (reg != 0) {
+        rv->regs[reg] = (uint64_t) val;
+    }
+
+    return true;
+}
+
 static const cpu_ops_t rv_cpu = {
     .interrupt_up = (interrupt_func_t) rv64_interrupt_up,
     .interrupt_down = (interrupt_func_t) rv64_interrupt_down,
+    .insert_breakpoint = (insert_breakpoint_func_t) rv64_insert_breakpoint_wrapper,
+    .remove_breakpoint = (remove_breakpoint_func_t) rv64_remove_breakpoint_wrapper,
 
     .convert_addr = (convert_addr_func_t) rv64_convert_add_wrapper,
     .reg_dump = (reg_dump_func_t) rv64_reg_dump,
 
     .set_pc = (set_pc_func_t) rv64_set_pc_wrapper,
-    .sc_access = (sc_access_func_t) rv64_sc_access
+    .get_pc = (get_pc_func_t) rv64_get_pc_wrapper,
+    .sc_access = (sc_access_func_t) rv64_sc_access,
+
+    .standby = (standby_func_t) rv64_cpu_standby,
+    .skip = (skip_func_t) rv64_cpu_skip,
+    .deadloop = (deadloop_func_t) rv64_cpu_deadloop,
+    .standby_host = (standby_host_func_t) rv64_cpu_standby_host,
+    .instructions = (instructions_func_t) rv64_instructions_wrapper,
+    .mode = (mode_func_t) rv64_mode_wrapper,
+    .timer_read = (timer_read_func_t) rv64_timer_read_wrapper,
+    .timer_write = (timer_write_func_t) rv64_timer_write_wrapper,
+    .regs = &rv64_cpu_regs,
+    .reg_read = (reg_read_func_t) rv64_reg_read_wrapper,
+    .reg_write = (reg_write_func_t) rv64_reg_write_wrapper
 };
 
 /**
@@ -62,7 +185,7 @@ static bool drv64cpu_init(token_t *parm, device_t *dev)
         return false;
     }
 
-    rv64_cpu_t *cpu = safe_malloc_t(rv64_cpu_t);
+    rv64_cpu_t *cpu = safe_malloc_aligned_t(rv64_cpu_t);
     rv64_cpu_init(cpu, id);
     general_cpu_t *gen_cpu = safe_malloc_t(general_cpu_t);
     gen_cpu->cpuno = id;
@@ -229,6 +352,298 @@ static bool drv64cpu_sptd(token_t *parm, device_t *dev)
     return rv64_pagetable_dump_from_phys(get_rv64(dev), root_phys, true);
 }
 
+/**
+ * Writes the mnemonic of the instruction into name
+ */
+static void instr_name(uint32_t word, string_t *name)
+{
+    rv_instr_t instr = { .val = word };
+    string_t comments;
+
+    string_init(&comments);
+    rv64_decode_mnemonics(instr)(0, instr, name, &comments);
+    string_done(&comments);
+}
+
+/**
+ * STAT command implementation
+ */
+static bool drv64cpu_stat(token_t *parm, device_t *dev)
+{
+    ASSERT(dev != NULL);
+
+    decode_stats_t *stats = &get_rv64(dev)->decode_stats;
+    decode_pool_t *pool = &decode_pools[DECODE_RV64];
+
+    printf("[Decode cache hits ] [Decode cache miss ] [Page redecodes    ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n\n",
+            stats->hits, stats->misses, stats->redecodes);
+
+    printf("[Cached pages      ] [Evictions         ] [Replacement       ]\n");
+    printf("%20zu %20" PRIu64 " %20s\n\n",
+            pool->count, pool->evictions, decode_policy_name(pool->policy));
+
+    printf("[Cache memory (KiB)] [Page capacity     ] [Restored pages    ]\n");
+    printf("%20zu %20zu %20" PRIu64 "\n\n",
+            decode_cache_memory(DECODE_RV64) / 1024, pool->capacity,
+            pool->restored);
+
+    rv64_tlb_t *tlb = &get_rv64(dev)->tlb;
+    uint64_t lookups = tlb->hits + tlb->misses;
+    double miss_rate = (lookups == 0) ? 0.0 : 100.0 * tlb->misses / lookups;
+
+    printf("[TLB hits          ] [TLB misses        ] [TLB miss rate (%%) ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20.2f\n\n",
+            tlb->hits, tlb->misses, miss_rate);
+
+    printf("[TLB entries       ] [TLB evictions     ] [Full TLB flushes  ]\n");
+    printf("%20zu %20" PRIu64 " %20" PRIu64 "\n\n",
+            tlb->size, tlb->evictions, tlb->flushes);
+
+    printf("[ASID flushes      ] [Address flushes   ] [ASID+addr flushes ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n\n",
+            tlb->asid_flushes, tlb->addr_flushes, tlb->asid_addr_flushes);
+
+    printf("[Page walks        ] [PTEs read         ] [Walk cache hits   ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n\n",
+            get_rv64(dev)->walks, get_rv64(dev)->walk_reads, get_rv64(dev)->walk_cache_hits);
+
+    printf("[A/D bit updates   ] [Fetch faults      ] [Fetches off memory]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n\n",
+            get_rv64(dev)->ad_updates, get_rv64(dev)->fetch_faults, get_rv64(dev)->fetch_outside);
+
+    printf("[Fetch cache hits  ]\n");
+    printf("%20" PRIu64 "\n\n", get_rv64(dev)->fetch_cache_hits);
+
+    intr_latency_print(&get_rv64(dev)->intr_latency);
+    cachesim_print(get_rv64(dev)->csr.mhartid);
+
+    printf("[Blocks executed   ] [Block instructions] [Fused pairs       ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n\n",
+            get_rv64(dev)->blocks, get_rv64(dev)->block_instrs, get_rv64(dev)->fused_pairs);
+
+    printf("[Block chains      ]\n");
+    printf("%20" PRIu64 "\n\n", get_rv64(dev)->block_chains);
+
+    printf("[Translated blocks ] [Translations      ] [JIT flushes       ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n",
+            get_rv64(dev)->jit_blocks, jit_stats.translations, jit_stats.flushes);
+
+    mixstat_print(&get_rv64(dev)->mix, instr_name);
+
+    return true;
+}
+
+/**
+ * ICACHE command implementation
+ */
+static bool drv64cpu_icache(token_t *parm, device_t *dev)
+{
+    ASSERT(dev != NULL);
+
+    decode_pool_t *pool = &decode_pools[DECODE_RV64];
+
+    if (parm->ttype == tt_end) {
+        printf("Decode cache: %zu of %zu pages, %s replacement\n",
+                pool->count, pool->capacity, decode_policy_name(pool->policy));
+        return true;
+    }
+
+    uint64_t size = parm_uint_next(&parm);
+    decode_policy_t policy = pool->policy;
+
+    if (parm->ttype != tt_end) {
+        const char *name = parm_str_next(&parm);
+
+        if (!decode_policy_from_name(name, &policy)) {
+            error("Unknown replacement policy <%s> (use lru or fifo)", name);
+            return false;
+        }
+    }
+
+    if ((size == 0) || (size > SIZE_MAX)) {
+        error("Invalid decode cache size");
+        return false;
+    }
+
+    decode_cache_configure(DECODE_RV64, size, policy);
+    return true;
+}
+
+/**
+ * BREAK command implementation
+ */
+static bool drv64cpu_break(token_t *parm, device_t *dev)
+{
+    ASSERT(dev != NULL);
+
+    ptr64_t addr;
+    addr.ptr = ALIGN_DOWN(parm_uint_next(&parm), 4);
+
+    const char *cond = (parm_type(parm) == tt_end) ? NULL : parm_str(parm);
+    return breakpoint_code_set(get_rv64(dev)->csr.mhartid, addr, cond);
+}
+
+/**
+ * BD command implementation
+ */
+static bool drv64cpu_bd(token_t *parm, device_t *dev)
+{
+    ASSERT(dev != NULL);
+
+    breakpoint_code_print_list(get_rv64(dev)->csr.mhartid);
+    return true;
+}
+
+/**
+ * BR command implementation
+ */
+static bool drv64cpu_br(token_t *parm, device_t *dev)
+{
+    ASSERT(dev != NULL);
+
+    ptr64_t addr;
+    addr.ptr = ALIGN_DOWN(parm_uint_next(&parm), 4);
+
+    if (!breakpoint_code_remove(get_rv64(dev)->csr.mhartid, addr, BREAKPOINT_FILTER_ANY)) {
+        error("Unknown breakpoint");
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * CATCH command implementation
+ */
+static bool drv64cpu_catch(token_t *parm, device_t *dev)
+{
+    ASSERT(dev != NULL);
+
+    return catchpoint_cmd(parm, get_rv64(dev)->csr.mhartid, rv64_csrnames, 0x1000);
+}
+
+/**
+ * BLOCK command implementation
+ */
+static bool drv64cpu_block(token_t *parm, device_t *dev)
+{
+    ASSERT(dev != NULL);
+
+    if (parm->ttype == tt_end) {
+        unsigned int limit = get_rv64(dev)->block_limit;
+
+        if (limit == 0) {
+            printf("Block execution: disabled\n");
+        } else {
+            printf("Block execution: up to %u instructions\n", limit);
+        }
+
+        return true;
+    }
+
+    uint64_t limit = parm_uint_next(&parm);
+
+    if (limit > FRAME_SIZE / sizeof(uint32_t)) {
+        error("Block limit out of range (0 to %zu)", FRAME_SIZE / sizeof(uint32_t));
+        return false;
+    }
+
+    get_rv64(dev)->block_limit = limit;
+    return true;
+}
+
+/**
+ * JIT command implementation
+ */
+static bool drv64cpu_jit(token_t *parm, device_t *dev)
+{
+    ASSERT(dev != NULL);
+
+    if (parm->ttype == tt_end) {
+        unsigned int threshold = get_rv64(dev)->jit_threshold;
+
+        if (threshold == 0) {
+            printf("Block translation: disabled\n");
+        } else {
+            printf("Block translation: after %u executions\n", threshold);
+        }
+
+        return true;
+    }
+
+    uint64_t threshold = parm_uint_next(&parm);
+
+    if (threshold > JIT_THRESHOLD_MAX) {
+        error("Translation threshold out of range (0 to %u)", JIT_THRESHOLD_MAX);
+        return false;
+    }
+
+    if ((threshold > 0) && !jit_supported()) {
+        alert("Block translation is not supported on this host, blocks stay interpreted");
+        return true;
+    }
+
+    get_rv64(dev)->jit_threshold = threshold;
+    return true;
+}
+
+/**
+ * MTIME command implementation
+ */
+static bool drv64cpu_mtime(token_t *parm, device_t *dev)
+{
+    ASSERT(dev != NULL);
+
+    rv_csr_t *csr = &get_rv64(dev)->csr;
+
+    if (parm->ttype == tt_end) {
+        if (csr->mtime_source == rv_mtime_virtual) {
+            printf("mtime: virtual clock, one tick per %u cycles\n",
+                    csr->mtime_period);
+        } else {
+            printf("mtime: host clock, sampled every %u cycles\n",
+                    csr->mtime_period);
+        }
+
+        return true;
+    }
+
+    const char *name = parm_str_next(&parm);
+    rv_mtime_source_t source;
+    uint64_t period;
+
+    if (strcmp(name, "host") == 0) {
+        source = rv_mtime_host;
+        period = RV_MTIME_HOST_PERIOD;
+    } else if (strcmp(name, "virtual") == 0) {
+        source = rv_mtime_virtual;
+        period = RV_MTIME_VIRTUAL_PERIOD;
+    } else {
+        error("Unknown mtime source <%s> (use host or virtual)", name);
+        return false;
+    }
+
+    if (parm->ttype != tt_end) {
+        period = parm_uint_next(&parm);
+    }
+
+    if ((period == 0) || (period > UINT_MAX)) {
+        error("Invalid mtime period");
+        return false;
+    }
+
+    if ((source == rv_mtime_host) && (csr->mtime_source != rv_mtime_host)) {
+        // Continue from the current value instead of jumping
+        csr->last_tick_time = replay_value(csr->mtime_replay, current_timestamp());
+    }
+
+    csr->mtime_source = source;
+    csr->mtime_period = period;
+    csr->mtime_countdown = period;
+    return true;
+}
+
 /**
  * TLBD command implementation
  */
@@ -255,6 +670,9 @@ static bool drv64cpu_tlb_resize(token_t *parm, device_t *dev)
 
     rv64_tlb_t *tlb = &get_rv64(dev)->tlb;
 
+    rv_utlb_flush(get_rv64(dev));
+    rv_fetch_cache_flush(get_rv64(dev));
+
     return rv64_tlb_resize(tlb, new_tlb_size);
 }
 
@@ -265,6 +683,8 @@ static bool drv64cpu_tlb_flush(token_t *parm, device_t *dev)
     rv64_tlb_t *tlb = &get_rv64(dev)->tlb;
 
     rv64_tlb_flush(tlb);
+    rv_utlb_flush(get_rv64(dev));
+    rv_fetch_cache_flush(get_rv64(dev));
 
     return true;
 }
@@ -288,27 +708,162 @@ static bool drv64cpu_set_asid_len(token_t *parm, device_t *dev)
     return true;
 }
 
+/**
+ * PMP command implementation
+ */
+static bool drv64cpu_pmp(token_t *parm, device_t *dev)
+{
+    ASSERT(dev != NULL);
+
+    if (parm->ttype == tt_end) {
+        unsigned int entries = get_rv64(dev)->csr.pmp_entries;
+
+        if (entries == 0) {
+            printf("PMP: 0 entries (disabled)\n");
+        } else {
+            printf("PMP: %u entries\n", entries);
+        }
+
+        return true;
+    }
+
+    uint64_t entries = parm_uint_next(&parm);
+
+    if ((entries != 0) && (entries != 16) && (entries != RV_PMP_ENTRIES)) {
+        error("Number of PMP entries must be 0, 16 or 64");
+        return false;
+    }
+
+    rv64_csr_set_pmp_entries(get_rv64(dev), entries);
+    return true;
+}
+
+/**
+ * CACHE command implementation
+ */
+static bool drv64cpu_cache(token_t *parm, device_t *dev)
+{
+    ASSERT(dev != NULL);
+
+    unsigned int cpuno = get_rv64(dev)->csr.mhartid;
+
+    if (parm->ttype == tt_end) {
+        cachesim_print_config(cpuno);
+        return true;
+    }
+
+    const char *name = parm_str_next(&parm);
+    cachesim_level_no_t level;
+
+    if (!cachesim_level_from_name(name, &level)) {
+        error("Unknown cache level <%s> (use l1i, l1d or l2)", name);
+        return false;
+    }
+
+    if (parm->ttype == tt_end) {
+        error("Missing cache size");
+        return false;
+    }
+
+    uint64_t size = parm_uint_next(&parm);
+    uint64_t ways = 1;
+    uint64_t line = CACHESIM_DEFAULT_LINE;
+
+    if (parm->ttype != tt_end) {
+        ways = parm_uint_next(&parm);
+    }
+
+    if (parm->ttype != tt_end) {
+        line = parm_uint_next(&parm);
+    }
+
+    return cachesim_configure(cpuno, level, size, ways, line);
+}
+
+/** Pin command implementation
+ *
+ * Pins the processor to a host core during the parallel simulation.
+ *
+ */
+static bool drv64cpu_pin(token_t *parm, device_t *dev)
+{
+    ASSERT(dev != NULL);
+
+    return parallel_pin_cmd((general_cpu_t *) dev->data, parm);
+}
+
 /**
  * Done device operation
  */
 static void drv64cpu_done(device_t *dev)
 {
     rv64_cpu_done(get_rv64(dev));
-    safe_free(((general_cpu_t *) dev->data)->data);
+    breakpoint_code_remove_filtered(get_rv64(dev)->csr.mhartid, BREAKPOINT_FILTER_ANY);
+    cachesim_done(get_rv64(dev)->csr.mhartid);
+    remove_cpu((general_cpu_t *) dev->data);
+    safe_free_aligned(((general_cpu_t *) dev->data)->data);
     safe_free(dev->data)
 }
 
+/**
+ * Save the processor state into a checkpoint
+ */
+static bool drv64cpu_save(device_t *dev, checkpoint_t *ckpt)
+{
+    return rv64_cpu_save(get_rv64(dev), ckpt);
+}
+
+/**
+ * Load the processor state from a checkpoint
+ */
+static bool drv64cpu_load(device_t *dev, checkpoint_t *ckpt)
+{
+    ((general_cpu_t *) dev->data)->posted = 0;
+    return rv64_cpu_load(get_rv64(dev), ckpt);
+}
+
 /**
  * Step device operation
  */
 static void drv64cpu_step(device_t *dev)
 {
+    cpu_deliver_interrupts((general_cpu_t *) dev->data);
     rv64_cpu_step(get_rv64(dev));
 }
 
 /**
  * Device commands specification
  */
+/** Export the processor counters to the statistics endpoint
+ *
+ */
+static void drv64cpu_stats(device_t *dev, statsrv_t *stats)
+{
+    rv64_cpu_t *cpu = get_rv64(dev);
+
+    statsrv_counter(stats, "cpu_instructions_total", "Instructions executed",
+            cpu->csr.instret);
+    statsrv_counter(stats, "cpu_cycles_total", "Cycles of the processor",
+            cpu->csr.cycle);
+    statsrv_counter(stats, "cpu_machine_cycles_total", "Cycles in the machine mode",
+            cpu->mode_cycles[rv_mmode]);
+    statsrv_counter(stats, "cpu_supervisor_cycles_total", "Cycles in the supervisor mode",
+            cpu->mode_cycles[rv_smode]);
+    statsrv_counter(stats, "cpu_user_cycles_total", "Cycles in the user mode",
+            cpu->mode_cycles[rv_umode]);
+    statsrv_counter(stats, "cpu_wait_cycles_total", "Cycles in the standby mode",
+            cpu->wait_cycles);
+    statsrv_counter(stats, "cpu_tlb_hits_total", "TLB hits", cpu->tlb.hits);
+    statsrv_counter(stats, "cpu_tlb_misses_total", "TLB misses", cpu->tlb.misses);
+    statsrv_counter(stats, "cpu_fetch_cache_hits_total", "Fetches translated by the fetch cache",
+            cpu->fetch_cache_hits);
+    statsrv_counter(stats, "cpu_decode_hits_total", "Decode cache hits",
+            cpu->decode_stats.hits);
+    statsrv_counter(stats, "cpu_decode_misses_total", "Decode cache misses",
+            cpu->decode_stats.misses);
+    intr_latency_stats(&cpu->intr_latency, stats);
+}
+
 cmd_t drv64cpu_cmds[] = {
     { "init",
             (fcmd_t) drv64cpu_init,
@@ -375,6 +930,13 @@ cmd_t drv64cpu_cmds[] = {
             "Prints out all valid PTEs in the pagetable with its root on the specified physical address. Adding the `verbose` parameter prints out all nonzero PTEs.",
             REQ INT "phys/physical address of the root pagetable" NEXT
                     OPT STR "verbose" END },
+    { "stat",
+            (fcmd_t) drv64cpu_stat,
+            DEFAULT,
+            DEFAULT,
+            "Display processor statistics",
+            "Display decoded instruction cache, TLB, page walk, block execution and translation statistics",
+            NOCMD },
     { "tlbd",
             (fcmd_t) drv64cpu_tlb_dump,
             DEFAULT,
@@ -396,13 +958,99 @@ cmd_t drv64cpu_cmds[] = {
             "Flushes the TLB",
             "Removes all entries from the TLB.",
             NOCMD },
+    { "icache",
+            (fcmd_t) drv64cpu_icache,
+            DEFAULT,
+            DEFAULT,
+            "Configure the decoded instruction cache",
+            "Without arguments prints the decoded instruction cache configuration. Otherwise limits the number of decoded pages, optionally changing the replacement policy (lru or fifo). The cache is shared by all processors of the same type and is flushed in the process.",
+            OPT INT "pages/number of decoded pages" NEXT
+                    OPT STR "policy/lru or fifo" END },
+    { "break",
+            (fcmd_t) drv64cpu_break,
+            DEFAULT,
+            DEFAULT,
+            "Add code breakpoint",
+            "Add code breakpoint, which stops only if the condition holds",
+            REQ INT "addr/address" NEXT
+                    OPT STR "cond/condition" END },
+    { "bd",
+            (fcmd_t) drv64cpu_bd,
+            DEFAULT,
+            DEFAULT,
+            "Dump code breakpoints",
+            "Dump code breakpoints",
+            NOCMD },
+    { "br",
+            (fcmd_t) drv64cpu_br,
+            DEFAULT,
+            DEFAULT,
+            "Remove code breakpoint",
+            "Remove code breakpoint",
+            REQ INT "addr/address" END },
+    { "catch",
+            (fcmd_t) drv64cpu_catch,
+            DEFAULT,
+            DEFAULT,
+            "Stop or log on exceptions, register writes or mode changes",
+            "Without arguments list the catchpoints, otherwise catch an exception code, an interrupt number, a write to a CSR or a change of the privilege mode",
+            OPT STR "event/exception, interrupt, write, mode or clear" NEXT
+                    OPT VAR "what/code, number, register or mode" NEXT
+                    OPT STR "action/stop or log" END },
+    { "block",
+            (fcmd_t) drv64cpu_block,
+            DEFAULT,
+            DEFAULT,
+            "Configure block execution",
+            "Without arguments prints the block execution setting. Otherwise sets the maximal number of straight-line instructions executed in one step, 0 disables block execution.",
+            OPT INT "limit/maximal number of instructions per block" END },
+    { "jit",
+            (fcmd_t) drv64cpu_jit,
+            DEFAULT,
+            DEFAULT,
+            "Configure block translation",
+            "Without arguments prints the block translation setting. Otherwise sets the number of executions of a block after which the block is translated into host code (only on x86-64 hosts), 0 disables the translation. The blocks are translated only while block execution is enabled.",
+            OPT INT "threshold/executions before the translation" END },
+    { "cache",
+            (fcmd_t) drv64cpu_cache,
+            DEFAULT,
+            DEFAULT,
+            "Configure the cache model",
+            "Without arguments prints the modeled cache levels. Otherwise sets the size, associativity (1 by default) and line size (64 bytes by default) of a level of the cache model of the processor, the size 0 removes the level. The hits and misses of the levels are printed by stat.",
+            OPT STR "level/l1i, l1d or l2" NEXT
+                    OPT INT "size/size in bytes" NEXT
+                    OPT INT "ways/associativity" NEXT
+                    OPT INT "line/line size in bytes" END },
+    { "pin",
+            (fcmd_t) drv64cpu_pin,
+            DEFAULT,
+            DEFAULT,
+            "Pin to a host core",
+            "Without arguments prints the host core of the processor. Otherwise pins the thread simulating the processor in parallel to a host core (only on Linux hosts), none allows all cores again.",
+            OPT VAR "core/host core number or none" END },
+    { "mtime",
+            (fcmd_t) drv64cpu_mtime,
+            DEFAULT,
+            DEFAULT,
+            "Configure the mtime source",
+            "Without arguments prints the mtime source. Otherwise selects the host clock (in milliseconds, sampled every given number of cycles) or a deterministic virtual clock (ticking once every given number of cycles).",
+            OPT STR "source/host or virtual" NEXT
+                    OPT INT "period/number of cycles" END },
+    { "pmp",
+            (fcmd_t) drv64cpu_pmp,
+            DEFAULT,
+            DEFAULT,
+            "Configure physical memory protection",
+            "Without arguments prints the number of implemented PMP entries. Otherwise sets the number of entries (0, 16 or 64) and clears them. Without any entry the PMP CSRs are illegal and all accesses are allowed, otherwise the S-mode and U-mode accesses matching no entry fail.",
+            OPT INT "entries/number of PMP entries" END },
     { "asidlen",
             (fcmd_t) drv64cpu_set_asid_len,
             DEFAULT,
             DEFAULT,
             "Changes the bit-length of ASIDs",
             "Changes the number of usable bits in the ASID field of the SATP CSR, zeroes-out any deactivated bits and flushes the TLB.",
-            REQ INT "ASID length" END }
+            REQ INT "ASID length" END },
+    LAST_CMD
 };
 
 /**
@@ -420,5 +1068,12 @@ device_type_t drv64cpu = {
     .done = drv64cpu_done,
     .step = drv64cpu_step,
 
-    .cmds = drv64cpu_cmds
+    .cmds = drv64cpu_cmds,
+
+    /* Checkpoints */
+    .save = drv64cpu_save,
+    .load = drv64cpu_load,
+
+    /* Statistics */
+    .stats = drv64cpu_stats
 };
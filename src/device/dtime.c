@@ -7,6 +7,13 @@
  *
  *  Time device
  *
+ *  The time is either read from the host clock on every read, sampled
+ *  from the host clock once per a number of machine cycles, or derived
+ *  from the machine cycle counter at a configured frequency. The last
+ *  one is deterministic, the defaults follow the host and the virtual
+ *  source of the RISC-V mtime register (one sample per 1024 cycles,
+ *  one millisecond per 1000 cycles).
+ *
  */
 
 #include <inttypes.h>
@@ -18,6 +25,8 @@
 
 #include "../assert.h"
 #include "../fault.h"
+#include "../main.h"
+#include "../replay.h"
 #include "../utils.h"
 #include "device.h"
 #include "dtime.h"
@@ -29,11 +38,75 @@
 #define REGISTER_USEC 4
 #define REGISTER_LIMIT 8
 
+/** Default number of cycles between the samples of the cached host clock */
+#define DEFAULT_CACHED_PERIOD 1024
+
+/** Default frequency of the virtual clock (in Hz) */
+#define DEFAULT_VIRTUAL_FREQUENCY 1000000
+
+/** Maximal frequency of the virtual clock (keeps the arithmetic in range) */
+#define MAX_VIRTUAL_FREQUENCY UINT64_C(1000000000000)
+
+#define USECS_PER_SEC 1000000
+
+/** Source of the time */
+typedef enum {
+    dtime_host, /**< Host clock read on every read */
+    dtime_cached, /**< Host clock sampled once per period */
+    dtime_virtual /**< Machine cycle counter at the frequency */
+} dtime_source_t;
+
 /** Dtime instance data structure */
 typedef struct {
     ptr36_t addr; /**< Memory location */
+
+    dtime_source_t source;
+    uint64_t period; /**< Cycles between the samples of the cached clock */
+    uint64_t frequency; /**< Cycles per second of the virtual clock */
+
+    struct timeval sample; /**< Last sample of the cached clock */
+    uint64_t sample_cycle; /**< Machine cycle of the last sample */
+    bool sampled;
+
+    unsigned int replay; /**< Source of the host clock in the replay log */
 } dtime_data_t;
 
+/** Read the host clock (taken from the log by the replay) */
+static void dtime_host_clock(dtime_data_t *data, struct timeval *timeval)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    uint64_t usecs = replay_value(data->replay,
+            ((uint64_t) now.tv_sec) * USECS_PER_SEC + now.tv_usec);
+
+    timeval->tv_sec = usecs / USECS_PER_SEC;
+    timeval->tv_usec = usecs % USECS_PER_SEC;
+}
+
+/** Get the current time of the device */
+static void dtime_get(dtime_data_t *data, struct timeval *timeval)
+{
+    switch (data->source) {
+    case dtime_host:
+        dtime_host_clock(data, timeval);
+        break;
+    case dtime_cached:
+        if ((!data->sampled) || (steps - data->sample_cycle >= data->period)) {
+            dtime_host_clock(data, &data->sample);
+            data->sample_cycle = steps;
+            data->sampled = true;
+        }
+
+        *timeval = data->sample;
+        break;
+    case dtime_virtual:
+        timeval->tv_sec = steps / data->frequency;
+        timeval->tv_usec = (steps % data->frequency) * USECS_PER_SEC / data->frequency;
+        break;
+    }
+}
+
 /** Init command implementation
  *
  * @param parm Command-line parameters
@@ -71,6 +144,15 @@ static bool dtime_init(token_t *parm, device_t *dev)
 
     data->addr = addr;
 
+    /* The host clock makes the simulation non-deterministic */
+    data->source = machine_nondet ? dtime_host : dtime_virtual;
+    data->period = DEFAULT_CACHED_PERIOD;
+    data->frequency = DEFAULT_VIRTUAL_FREQUENCY;
+    data->sampled = false;
+    data->replay = replay_source(dev->name);
+
+    dev_map(dev, addr, REGISTER_LIMIT);
+
     return true;
 }
 
@@ -86,9 +168,101 @@ static bool dtime_info(token_t *parm, device_t *dev)
 {
     dtime_data_t *data = (dtime_data_t *) dev->data;
 
-    printf("[address ]\n");
-    printf("%#11" PRIx64 "\n", data->addr);
+    printf("[address ] [source ]\n");
+    printf("%#11" PRIx64 " %-9s\n", data->addr,
+            data->source == dtime_host ? "host"
+                    : (data->source == dtime_cached ? "cached" : "virtual"));
+
+    return true;
+}
+
+/** Source command implementation
+ *
+ * Print or set the source of the time.
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool dtime_source(token_t *parm, device_t *dev)
+{
+    dtime_data_t *data = (dtime_data_t *) dev->data;
+
+    if (parm_type(parm) == tt_end) {
+        switch (data->source) {
+        case dtime_host:
+            printf("Time source: host clock\n");
+            break;
+        case dtime_cached:
+            printf("Time source: host clock, sampled every %" PRIu64 " cycles\n",
+                    data->period);
+            break;
+        case dtime_virtual:
+            printf("Time source: virtual clock, %" PRIu64 " cycles per second\n",
+                    data->frequency);
+            break;
+        }
+
+        return true;
+    }
+
+    const char *const name = parm_str_next(&parm);
+
+    if (strcmp(name, "virtual") == 0) {
+        uint64_t frequency = DEFAULT_VIRTUAL_FREQUENCY;
+
+        if (parm_type(parm) != tt_end) {
+            frequency = parm_uint(parm);
+        }
+
+        if ((frequency == 0) || (frequency > MAX_VIRTUAL_FREQUENCY)) {
+            error("Virtual clock frequency out of range (1 to %" PRIu64 " Hz)",
+                    MAX_VIRTUAL_FREQUENCY);
+            return false;
+        }
+
+        data->source = dtime_virtual;
+        data->frequency = frequency;
+        return true;
+    }
+
+    if ((strcmp(name, "host") != 0) && (strcmp(name, "cached") != 0)) {
+        error("Unknown time source <%s> (use host, cached or virtual)", name);
+        return false;
+    }
+
+    if (!machine_nondet) {
+        error("The host clock results in non-deterministic behaviour "
+              "(use the command-line option -n to enable it)");
+        return false;
+    }
+
+    if (strcmp(name, "host") == 0) {
+        if (parm_type(parm) != tt_end) {
+            error("Host clock has no period");
+            return false;
+        }
+
+        data->source = dtime_host;
+        return true;
+    }
 
+    uint64_t period = DEFAULT_CACHED_PERIOD;
+
+    if (parm_type(parm) != tt_end) {
+        period = parm_uint(parm);
+    }
+
+    if (period == 0) {
+        error("Sampling period has to be at least one cycle");
+        return false;
+    }
+
+    data->source = dtime_cached;
+    data->period = period;
+    data->sampled = false;
     return true;
 }
 
@@ -118,7 +292,7 @@ static void dtime_done(device_t *dev)
 
 /** Read command implementation (32 bits)
  *
- * Read host time via gettimeofday().
+ * Read the time of the configured source.
  *
  * @param dev  Device pointer
  * @param addr Address of the read operation
@@ -137,11 +311,11 @@ static void dtime_read32(unsigned int procno, device_t *dev, ptr36_t addr, uint3
 
     switch (addr - data->addr) {
     case REGISTER_SEC:
-        gettimeofday(&timeval, NULL);
+        dtime_get(data, &timeval);
         *val = (uint32_t) timeval.tv_sec;
         break;
     case REGISTER_USEC:
-        gettimeofday(&timeval, NULL);
+        dtime_get(data, &timeval);
         *val = (uint32_t) timeval.tv_usec;
         break;
     }
@@ -149,7 +323,7 @@ static void dtime_read32(unsigned int procno, device_t *dev, ptr36_t addr, uint3
 
 /** Read command implementation (64 bits)
  *
- * Read host time via gettimeofday().
+ * Read the time of the configured source.
  *
  * @param dev  Device pointer
  * @param addr Address of the read operation
@@ -165,14 +339,13 @@ static void dtime_read64(unsigned int procno, device_t *dev, ptr36_t addr, uint6
 
     /* Get actual time */
     struct timeval timeval;
-    uint32_t sec = (uint32_t) timeval.tv_sec;
-    uint32_t usec = (uint32_t) timeval.tv_usec;
 
     /* Pack the values in little-endian fashion */
     switch (addr - data->addr) {
     case REGISTER_SEC:
-        gettimeofday(&timeval, NULL);
-        *val = ((uint64_t) sec) | ((uint64_t) usec << 32);
+        dtime_get(data, &timeval);
+        *val = ((uint64_t) (uint32_t) timeval.tv_sec)
+                | ((uint64_t) (uint32_t) timeval.tv_usec << 32);
         break;
     }
 }
@@ -207,13 +380,21 @@ static cmd_t dtime_cmds[] = {
             "Display device statictics",
             "display device statictics",
             NOCMD },
+    { "source",
+            (fcmd_t) dtime_source,
+            DEFAULT,
+            DEFAULT,
+            "Print or set the source of the time",
+            "Without arguments prints the source of the time. The host clock is read on every read, the cached host clock is sampled once per the period (in cycles), the virtual clock is derived from the machine cycles at the frequency (in Hz). The host clocks need non-determinism enabled.",
+            OPT STR "source/host, cached or virtual" NEXT
+                    OPT INT "value/period or frequency" END },
     LAST_CMD
 };
 
 /** Dtime object structure */
 device_type_t dtime = {
-    /* Real-time device induces non-determinism */
-    .nondet = true,
+    /* Only the host clock induces non-determinism (see dtime_source()) */
+    .nondet = false,
 
     /* Type name and description */
     .name = "dtime",
@@ -0,0 +1,496 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Programmable interval timer device
+ *
+ *  The timer asserts its interrupt once the programmed period elapses,
+ *  either once or periodically. The expirations are device events (see
+ *  dev_schedule()), so the timer costs nothing in the cycles in between
+ *  and the machine can skip them while the processors stand by. The
+ *  period is given in machine cycles or in microseconds of the virtual
+ *  clock (one microsecond per cycle by default, as the virtual clock
+ *  of dtime).
+ *
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "../assert.h"
+#include "../checkpoint.h"
+#include "../debug/statsrv.h"
+#include "../fault.h"
+#include "../main.h"
+#include "../text.h"
+#include "../utils.h"
+#include "device.h"
+#include "dplic.h"
+#include "dtimer.h"
+
+/** Registers */
+#define REGISTER_PERIOD 0 /**< Period (in cycles or microseconds) */
+#define REGISTER_CONTROL 4 /**< Control bits */
+#define REGISTER_STATUS 8 /**< Expirations (read), acknowledge (write) */
+#define REGISTER_REMAINING 12 /**< Cycles until the expiration */
+#define REGISTER_LIMIT 16
+
+/** Control bits */
+#define CONTROL_ENABLE 0x1 /**< The timer runs */
+#define CONTROL_PERIODIC 0x2 /**< The timer restarts after the expiration */
+#define CONTROL_USECS 0x4 /**< The period is in microseconds */
+#define CONTROL_MASK (CONTROL_ENABLE | CONTROL_PERIODIC | CONTROL_USECS)
+
+/** Default frequency of the virtual clock (in Hz) */
+#define DEFAULT_FREQUENCY 1000000
+
+/** Maximal frequency of the virtual clock (keeps the arithmetic in range) */
+#define MAX_FREQUENCY UINT64_C(1000000000000)
+
+#define USECS_PER_SEC 1000000
+
+typedef struct {
+    ptr36_t addr; /**< Register address */
+    unsigned int intno; /**< Interrupt number */
+    device_t *plic; /**< Interrupt controller the interrupt is routed to */
+    unsigned int plic_source; /**< Source number within the controller */
+
+    uint64_t frequency; /**< Cycles per second of the virtual clock */
+
+    uint32_t period; /**< Period register */
+    uint32_t control; /**< Control register */
+    uint32_t status; /**< Expirations since the acknowledgement */
+    uint64_t deadline; /**< Machine cycle of the next expiration */
+    bool ig; /**< Interrupt pending flag */
+
+    uint64_t expirations; /**< Number of expirations */
+    uint64_t intrcount; /**< Number of interrupts asserted */
+    uint64_t overrun; /**< Expirations while the interrupt was pending */
+} timer_data_t;
+
+/** Length of the programmed period in machine cycles
+ *
+ * A period shorter than a cycle lasts a cycle.
+ *
+ */
+static uint64_t timer_period_cycles(const timer_data_t *data)
+{
+    uint64_t cycles = data->period;
+
+    if (data->control & CONTROL_USECS) {
+        cycles = (data->period / USECS_PER_SEC) * data->frequency
+                + (data->period % USECS_PER_SEC) * data->frequency / USECS_PER_SEC;
+    }
+
+    return (cycles == 0) ? 1 : cycles;
+}
+
+static void timer_expire(device_t *dev);
+
+/** Start counting the period from the current cycle
+ *
+ * A previous countdown is dropped. The timer with zero period
+ * does not run.
+ *
+ */
+static void timer_start(device_t *dev)
+{
+    timer_data_t *data = (timer_data_t *) dev->data;
+
+    dev_cancel(dev);
+
+    if (data->period == 0) {
+        data->control &= ~CONTROL_ENABLE;
+    }
+
+    if (data->control & CONTROL_ENABLE) {
+        uint64_t cycles = timer_period_cycles(data);
+
+        data->deadline = steps + cycles;
+        dev_schedule(dev, cycles, timer_expire);
+    }
+}
+
+/** Expiration of the period
+ *
+ * The interrupt is asserted unless it is still pending. The periodic
+ * timer keeps the phase of its expirations, a new period applies from
+ * the next expiration.
+ *
+ */
+static void timer_expire(device_t *dev)
+{
+    timer_data_t *data = (timer_data_t *) dev->data;
+
+    data->expirations++;
+
+    if (data->status < UINT32_MAX) {
+        data->status++;
+    }
+
+    if (!data->ig) {
+        data->ig = true;
+        data->intrcount++;
+        plic_interrupt_up(data->plic, data->plic_source, data->intno);
+    } else {
+        data->overrun++;
+    }
+
+    if ((!(data->control & CONTROL_PERIODIC)) || (data->period == 0)) {
+        data->control &= ~CONTROL_ENABLE;
+        return;
+    }
+
+    data->deadline += timer_period_cycles(data);
+    dev_schedule(dev, (data->deadline > steps) ? data->deadline - steps : 0,
+            timer_expire);
+}
+
+/** Init command implementation
+ *
+ */
+static bool dtimer_init(token_t *parm, device_t *dev)
+{
+    parm_next(&parm);
+    uint64_t _addr = parm_uint_next(&parm);
+    uint64_t _intno = parm_uint_next(&parm);
+
+    if (!phys_range(_addr)) {
+        error("Physical memory address out of range");
+        return false;
+    }
+
+    if (!phys_range(_addr + (uint64_t) REGISTER_LIMIT)) {
+        error("Invalid address, registers would exceed the physical "
+              "memory range");
+        return false;
+    }
+
+    ptr36_t addr = _addr;
+
+    if (!ptr36_dword_aligned(addr)) {
+        error("Physical memory address must be 8-byte aligned");
+        return false;
+    }
+
+    if (_intno > MAX_INTRS) {
+        error("%s", txt_intnum_range);
+        return false;
+    }
+
+    timer_data_t *data = safe_malloc_t(timer_data_t);
+    dev->data = data;
+
+    data->addr = addr;
+    data->intno = _intno;
+    data->plic = NULL;
+    data->plic_source = 0;
+    data->frequency = DEFAULT_FREQUENCY;
+    data->period = 0;
+    data->control = 0;
+    data->status = 0;
+    data->deadline = 0;
+    data->ig = false;
+    data->expirations = 0;
+    data->intrcount = 0;
+    data->overrun = 0;
+
+    dev_map(dev, addr, REGISTER_LIMIT);
+
+    return true;
+}
+
+/** Info command implementation
+ *
+ */
+static bool dtimer_info(token_t *parm, device_t *dev)
+{
+    timer_data_t *data = (timer_data_t *) dev->data;
+
+    printf("[address ] [int] [period  ] [mode    ] [ig]\n");
+    printf("%#11" PRIx64 " %-5u %-10" PRIu32 " %-10s %u\n",
+            data->addr, data->intno, data->period,
+            (!(data->control & CONTROL_ENABLE)) ? "stopped"
+                    : ((data->control & CONTROL_PERIODIC) ? "periodic" : "one-shot"),
+            data->ig);
+
+    return true;
+}
+
+/** Stat command implementation
+ *
+ */
+static bool dtimer_stat(token_t *parm, device_t *dev)
+{
+    timer_data_t *data = (timer_data_t *) dev->data;
+
+    printf("[expirations       ] [interrupt count   ] [overrun           ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n",
+            data->expirations, data->intrcount, data->overrun);
+
+    return true;
+}
+
+/** Frequency command implementation
+ *
+ * Print or set the number of cycles per second of the virtual clock
+ * the microsecond periods are measured by. A running timer keeps its
+ * current deadline.
+ *
+ */
+static bool dtimer_frequency(token_t *parm, device_t *dev)
+{
+    timer_data_t *data = (timer_data_t *) dev->data;
+
+    if (parm_type(parm) == tt_end) {
+        printf("Frequency: %" PRIu64 " cycles per second\n", data->frequency);
+        return true;
+    }
+
+    uint64_t frequency = parm_uint(parm);
+
+    if ((frequency == 0) || (frequency > MAX_FREQUENCY)) {
+        error("Frequency out of range (1 to %" PRIu64 " Hz)", MAX_FREQUENCY);
+        return false;
+    }
+
+    data->frequency = frequency;
+    return true;
+}
+
+/** Route command implementation
+ *
+ * Print or set the interrupt controller the timer interrupt is routed
+ * to. A raised interrupt moves to the new route.
+ *
+ */
+static bool dtimer_route(token_t *parm, device_t *dev)
+{
+    timer_data_t *data = (timer_data_t *) dev->data;
+
+    if (parm_type(parm) == tt_end) {
+        if (data->plic == NULL) {
+            printf("Interrupt: %u\n", data->intno);
+        } else {
+            printf("Interrupt: source %u of %s\n", data->plic_source,
+                    data->plic->name);
+        }
+        return true;
+    }
+
+    device_t *plic;
+    unsigned int source;
+
+    if (!plic_route(parm, &plic, &source)) {
+        return false;
+    }
+
+    if (data->ig) {
+        plic_interrupt_down(data->plic, data->plic_source, data->intno);
+        plic_interrupt_up(plic, source, data->intno);
+    }
+
+    data->plic = plic;
+    data->plic_source = source;
+
+    return true;
+}
+
+/** Clean up the device
+ *
+ */
+static void timer_done(device_t *dev)
+{
+    safe_free(dev->data);
+}
+
+static void timer_read32(unsigned int procno, device_t *dev, ptr36_t addr, uint32_t *val)
+{
+    ASSERT(dev != NULL);
+    ASSERT(val != NULL);
+
+    timer_data_t *data = (timer_data_t *) dev->data;
+
+    switch (addr - data->addr) {
+    case REGISTER_PERIOD:
+        *val = data->period;
+        break;
+    case REGISTER_CONTROL:
+        *val = data->control;
+        break;
+    case REGISTER_STATUS:
+        *val = data->status;
+        break;
+    case REGISTER_REMAINING:
+        if ((data->control & CONTROL_ENABLE) && (data->deadline > steps)) {
+            uint64_t remaining = data->deadline - steps;
+            *val = (remaining > UINT32_MAX) ? UINT32_MAX : (uint32_t) remaining;
+        } else {
+            *val = 0;
+        }
+        break;
+    }
+}
+
+static void timer_write32(unsigned int procno, device_t *dev, ptr36_t addr, uint32_t val)
+{
+    ASSERT(dev != NULL);
+
+    timer_data_t *data = (timer_data_t *) dev->data;
+
+    switch (addr - data->addr) {
+    case REGISTER_PERIOD:
+        data->period = val;
+        break;
+    case REGISTER_CONTROL:
+        data->control = val & CONTROL_MASK;
+        timer_start(dev);
+        break;
+    case REGISTER_STATUS:
+        data->status = 0;
+        if (data->ig) {
+            data->ig = false;
+            plic_interrupt_down(data->plic, data->plic_source, data->intno);
+        }
+        break;
+    }
+}
+
+/** Save the timer state into a checkpoint
+ *
+ * The pending expiration is saved with the device events.
+ *
+ */
+static bool timer_save(device_t *dev, checkpoint_t *ckpt)
+{
+    timer_data_t *data = (timer_data_t *) dev->data;
+
+    return checkpoint_write_var(ckpt, data->period)
+            && checkpoint_write_var(ckpt, data->control)
+            && checkpoint_write_var(ckpt, data->status)
+            && checkpoint_write_var(ckpt, data->deadline)
+            && checkpoint_write_var(ckpt, data->ig)
+            && checkpoint_write_var(ckpt, data->expirations)
+            && checkpoint_write_var(ckpt, data->intrcount)
+            && checkpoint_write_var(ckpt, data->overrun);
+}
+
+/** Load the timer state from a checkpoint
+ *
+ */
+static bool timer_load(device_t *dev, checkpoint_t *ckpt)
+{
+    timer_data_t *data = (timer_data_t *) dev->data;
+
+    return checkpoint_read_var(ckpt, data->period)
+            && checkpoint_read_var(ckpt, data->control)
+            && checkpoint_read_var(ckpt, data->status)
+            && checkpoint_read_var(ckpt, data->deadline)
+            && checkpoint_read_var(ckpt, data->ig)
+            && checkpoint_read_var(ckpt, data->expirations)
+            && checkpoint_read_var(ckpt, data->intrcount)
+            && checkpoint_read_var(ckpt, data->overrun);
+}
+
+/** Events scheduled by the timer */
+static const dev_event_fnc_t timer_events[] = {
+    timer_expire,
+    NULL
+};
+
+/** Export the timer counters to the statistics endpoint
+ *
+ */
+static void timer_stats(device_t *dev, statsrv_t *stats)
+{
+    timer_data_t *data = (timer_data_t *) dev->data;
+
+    statsrv_counter(stats, "timer_expirations_total", "Timer expirations",
+            data->expirations);
+    statsrv_counter(stats, "timer_overruns_total",
+            "Timer expirations while the interrupt was pending",
+            data->overrun);
+}
+
+/*
+ * Device commands
+ */
+
+static cmd_t timer_cmds[] = {
+    { "init",
+            (fcmd_t) dtimer_init,
+            DEFAULT,
+            DEFAULT,
+            "Initialization",
+            "Initialization",
+            REQ STR "name/timer name" NEXT
+                    REQ INT "addr/register address" NEXT
+                            REQ INT "intno/interrupt number" END },
+    { "help",
+            (fcmd_t) dev_generic_help,
+            DEFAULT,
+            DEFAULT,
+            "Display this help text",
+            "Display this help text",
+            OPT STR "cmd/command name" END },
+    { "info",
+            (fcmd_t) dtimer_info,
+            DEFAULT,
+            DEFAULT,
+            "Display timer state and configuration",
+            "Display timer state and configuration",
+            NOCMD },
+    { "stat",
+            (fcmd_t) dtimer_stat,
+            DEFAULT,
+            DEFAULT,
+            "Display timer statistics",
+            "Display timer statistics",
+            NOCMD },
+    { "frequency",
+            (fcmd_t) dtimer_frequency,
+            DEFAULT,
+            DEFAULT,
+            "Print or set the frequency of the virtual clock",
+            "Without arguments prints the number of cycles per second the periods in microseconds are measured by (1000000 by default, one microsecond per cycle).",
+            OPT INT "frequency/cycles per second" END },
+    { "route",
+            (fcmd_t) dtimer_route,
+            DEFAULT,
+            DEFAULT,
+            "Print or set the interrupt routing",
+            "Without arguments prints where the timer interrupt goes. With the name of a dplic device and a source number the interrupt is asserted as the source of the interrupt controller instead of the interrupt number of the first processor.",
+            OPT STR "plic/interrupt controller name" NEXT
+                    OPT INT "source/source number" END },
+    LAST_CMD
+};
+
+device_type_t dtimer = {
+    /* Timer is simulated deterministically */
+    .nondet = false,
+
+    /* Type name and description */
+    .name = "dtimer",
+    .brief = "Interval timer",
+    .full = "Timer asserts an interrupt once a programmed number of cycles "
+            "or microseconds elapses, either once or periodically. The "
+            "interrupt is deasserted by a write to the status register.",
+
+    /* Functions */
+    .done = timer_done,
+    .read32 = timer_read32,
+    .write32 = timer_write32,
+
+    /* Commands */
+    .cmds = timer_cmds,
+
+    /* Checkpoints */
+    .save = timer_save,
+    .load = timer_load,
+    .events = timer_events,
+    .stats = timer_stats
+};
@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Programmable interval timer device
+ *
+ */
+
+#ifndef DTIMER_H_
+#define DTIMER_H_
+
+#include "device.h"
+
+extern device_type_t dtimer;
+
+#endif
@@ -0,0 +1,706 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Virtio block device
+ *
+ *  A block device with the virtio-mmio register interface (version 2)
+ *  and a single split virtqueue in the guest memory. The requests made
+ *  available by the driver are processed together when the driver
+ *  writes the queue notify register. The sectors are transferred by
+ *  host I/O calls directly from and into the memory frames and the
+ *  whole batch is completed by a single interrupt.
+ *
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "../assert.h"
+#include "../checkpoint.h"
+#include "../fault.h"
+#include "../main.h"
+#include "../physmem.h"
+#include "../text.h"
+#include "../utils.h"
+#include "dvirtblk.h"
+#include "virtio.h"
+
+/** Size of register block (including the capacity) */
+#define REGISTER_LIMIT (VIRTIO_CONFIG + 8)
+
+/** Virtio device type */
+#define VIRTIO_DEVICE_BLOCK 2
+
+/** \{ \name Features */
+#define FEATURE_RO (UINT64_C(1) << 5) /**< Read-only disk */
+#define FEATURE_FLUSH (UINT64_C(1) << 9) /**< Flush command */
+/* \} */
+
+/** \{ \name Request types */
+#define REQUEST_IN 0 /**< Read sectors */
+#define REQUEST_OUT 1 /**< Write sectors */
+#define REQUEST_FLUSH 4 /**< Flush written sectors */
+#define REQUEST_GET_ID 8 /**< Device identification */
+/* \} */
+
+/** \{ \name Request status */
+#define REQUEST_OK 0
+#define REQUEST_IOERR 1
+#define REQUEST_UNSUPP 2
+/* \} */
+
+/** Size of the request header */
+#define HEADER_SIZE 16
+
+/** Sector size */
+#define SECTOR_SIZE 512
+
+/** Length of the device identification */
+#define ID_SIZE 20
+
+/** Dvirtblk instance data structure */
+typedef struct {
+    virtio_t virtio; /**< Virtio transport */
+
+    int fd; /**< Disk image (-1 for none) */
+    char *path; /**< Path of the disk image */
+    uint64_t capacity; /**< Disk size in sectors */
+    bool readonly; /**< Disk opened read-only */
+
+    uint64_t requests; /**< Number of processed requests */
+    uint64_t errors; /**< Number of failed requests */
+    uint64_t bytes_read; /**< Number of bytes read from the disk */
+    uint64_t bytes_written; /**< Number of bytes written to the disk */
+} virtblk_data_t;
+
+/** Move the collected parts from or into the disk image
+ *
+ * @param data   Dvirtblk instance data structure
+ * @param iov    Collected memory parts (emptied)
+ * @param offset Position in the disk image
+ * @param output True to write the parts into the disk image
+ *
+ * @return True if all bytes were moved
+ *
+ */
+static bool virtblk_io(virtblk_data_t *data, virtio_iov_t *iov,
+        uint64_t offset, bool output)
+{
+    size_t len = iov->len;
+
+    if (virtio_iov_transfer(iov, data->fd, offset, output) != (ssize_t) len) {
+        io_error(data->path);
+        return false;
+    }
+
+    if (output) {
+        data->bytes_written += len;
+    } else {
+        data->bytes_read += len;
+    }
+
+    return true;
+}
+
+/** Transfer the sectors of a data descriptor
+ *
+ * The memory frames of the descriptor are collected and moved
+ * by batches of host I/O calls.
+ *
+ * @param data   Dvirtblk instance data structure
+ * @param iov    Memory parts not moved yet
+ * @param offset Position in the disk image of the first collected part
+ *               (updated)
+ * @param addr   Descriptor buffer address
+ * @param len    Descriptor buffer length
+ * @param read   True to read the disk (write into the memory)
+ *
+ * @return True if successful
+ *
+ */
+static bool virtblk_transfer(virtblk_data_t *data, virtio_iov_t *iov,
+        uint64_t *offset, ptr36_t addr, uint32_t len, bool read)
+{
+    while (len > 0) {
+        len36_t chunk = virtio_iov_add(iov, addr, len, read);
+
+        if (chunk == 0) {
+            return false;
+        }
+
+        if (iov->count == VIRTIO_IOV_BATCH) {
+            uint64_t start = *offset;
+            *offset += iov->len;
+
+            if (!virtblk_io(data, iov, start, !read)) {
+                return false;
+            }
+        }
+
+        addr += chunk;
+        len -= chunk;
+    }
+
+    return true;
+}
+
+/** Process a request
+ *
+ * @param data  Dvirtblk instance data structure
+ * @param head  Index of the first descriptor of the request
+ * @param used  Number of bytes written into the memory (returned)
+ *
+ * @return False if the descriptor chain is malformed
+ *
+ */
+static bool virtblk_request(virtblk_data_t *data, uint16_t head,
+        uint32_t *used)
+{
+    uint8_t status = REQUEST_OK;
+    uint32_t type = 0;
+    uint64_t sector = 0;
+    uint64_t offset = 0;
+    ptr36_t status_addr = 0;
+    bool terminated = false;
+    virtio_iov_t iov = { .count = 0, .len = 0 };
+    uint16_t idx = head;
+
+    *used = 0;
+
+    for (unsigned int n = 0; n < data->virtio.queues[0].num; n++) {
+        virtq_desc_t desc;
+
+        if (!virtq_desc(&data->virtio, 0, idx, &desc)) {
+            return false;
+        }
+
+        uint64_t addr = desc.addr;
+        uint32_t len = desc.len;
+        bool last = (desc.flags & VIRTQ_DESC_NEXT) == 0;
+        bool write = (desc.flags & VIRTQ_DESC_WRITE) != 0;
+
+        if (n == 0) {
+            /* Request header */
+            if ((len < HEADER_SIZE) || (write) || (last)) {
+                return false;
+            }
+
+            type = physmem_read32(-1 /*NULL*/, addr, true);
+            sector = physmem_read64(-1 /*NULL*/, addr + 8, true);
+            offset = sector * SECTOR_SIZE;
+        } else if (last) {
+            /* Status byte at the end of the last descriptor */
+            if ((len == 0) || (!write)) {
+                return false;
+            }
+
+            if (len > 1) {
+                len--;
+                status_addr = addr + len;
+            } else {
+                status_addr = addr;
+                len = 0;
+            }
+        }
+
+        if ((n > 0) && (len > 0) && (status == REQUEST_OK)) {
+            /* Request data */
+            switch (type) {
+            case REQUEST_IN:
+            case REQUEST_OUT:
+                if ((write) != (type == REQUEST_IN)) {
+                    return false;
+                }
+
+                if ((type == REQUEST_OUT) && (data->readonly)) {
+                    status = REQUEST_IOERR;
+                    break;
+                }
+
+                if ((len % SECTOR_SIZE != 0)
+                        || (sector > data->capacity)
+                        || ((offset + iov.len + len) / SECTOR_SIZE
+                                > data->capacity)) {
+                    status = REQUEST_IOERR;
+                    break;
+                }
+
+                if (!virtblk_transfer(data, &iov, &offset, addr, len,
+                            type == REQUEST_IN)) {
+                    status = REQUEST_IOERR;
+                    break;
+                }
+
+                if (type == REQUEST_IN) {
+                    *used += len;
+                }
+                break;
+            case REQUEST_GET_ID:
+                if (!write) {
+                    return false;
+                } else {
+                    char id[ID_SIZE];
+                    uint32_t size = (len < ID_SIZE) ? len : ID_SIZE;
+
+                    memset(id, 0, sizeof(id));
+                    strncpy(id, "msim-dvirtblk", sizeof(id));
+                    physmem_write_block8(-1 /*NULL*/, addr,
+                            (const uint8_t *) id, size, true);
+                    *used += size;
+                }
+                break;
+            case REQUEST_FLUSH:
+                break;
+            default:
+                status = REQUEST_UNSUPP;
+            }
+        }
+
+        if (last) {
+            terminated = true;
+            break;
+        }
+
+        idx = desc.next;
+    }
+
+    if (!terminated) {
+        /* No terminating descriptor within the queue size */
+        return false;
+    }
+
+    if (status == REQUEST_OK) {
+        switch (type) {
+        case REQUEST_IN:
+        case REQUEST_OUT:
+            if (!virtblk_io(data, &iov, offset, type == REQUEST_OUT)) {
+                status = REQUEST_IOERR;
+            }
+            break;
+        case REQUEST_FLUSH:
+            if ((!data->readonly) && (fsync(data->fd) != 0)) {
+                io_error(data->path);
+                status = REQUEST_IOERR;
+            }
+            break;
+        }
+    }
+
+    if (status != REQUEST_OK) {
+        data->errors++;
+    }
+
+    physmem_write8(-1 /*NULL*/, status_addr, status, true);
+    *used += 1;
+
+    return true;
+}
+
+/** Process the available requests
+ *
+ * All requests made available since the last notification are
+ * processed and put into the used ring. A single interrupt
+ * announces the whole batch.
+ *
+ * @param virtio Virtio transport of the device
+ * @param queue  Notified queue
+ *
+ */
+static void virtblk_notify(virtio_t *virtio, unsigned int queue)
+{
+    virtblk_data_t *data = (virtblk_data_t *) virtio->dev->data;
+    uint16_t head;
+
+    if ((data->fd == -1) || (!virtq_usable(virtio, queue))) {
+        return;
+    }
+
+    while (virtq_pop(virtio, queue, &head)) {
+        uint32_t len;
+
+        if (!virtblk_request(data, head, &len)) {
+            virtio_needs_reset(virtio);
+            break;
+        }
+
+        virtq_push(virtio, queue, head, len);
+        data->requests++;
+    }
+
+    virtq_publish(virtio, queue);
+}
+
+/** Close the disk image */
+static void virtblk_close(virtblk_data_t *data)
+{
+    if (data->fd != -1) {
+        close(data->fd);
+        data->fd = -1;
+    }
+
+    safe_free(data->path);
+    data->capacity = 0;
+    data->readonly = false;
+}
+
+/** Init command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool virtblk_init(token_t *parm, device_t *dev)
+{
+    parm_next(&parm);
+    uint64_t _addr = parm_uint_next(&parm);
+    uint64_t _intno = parm_uint_next(&parm);
+
+    if (!phys_range(_addr)) {
+        error("Physical memory address out of range");
+        return false;
+    }
+
+    if (!phys_range(_addr + (uint64_t) REGISTER_LIMIT)) {
+        error("Invalid address, registers would exceed the physical "
+              "memory range");
+        return false;
+    }
+
+    ptr36_t addr = _addr;
+
+    if (!ptr36_dword_aligned(addr)) {
+        error("Physical memory address must be 8-byte aligned");
+        return false;
+    }
+
+    if (_intno > MAX_INTRS) {
+        error("%s", txt_intnum_range);
+        return false;
+    }
+
+    /* Initialization */
+    virtblk_data_t *data = safe_malloc_t(virtblk_data_t);
+    dev->data = data;
+
+    virtio_init(&data->virtio, dev, addr, _intno, VIRTIO_DEVICE_BLOCK,
+            FEATURE_FLUSH, 1);
+    data->virtio.notify = virtblk_notify;
+    data->fd = -1;
+    data->path = NULL;
+    data->capacity = 0;
+    data->readonly = false;
+    data->requests = 0;
+    data->errors = 0;
+    data->bytes_read = 0;
+    data->bytes_written = 0;
+
+    dev_map(dev, addr, REGISTER_LIMIT);
+
+    return true;
+}
+
+/** File command implementation
+ *
+ * Open the disk image. The disk size is the file size rounded down
+ * to whole sectors.
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool virtblk_file(token_t *parm, device_t *dev)
+{
+    virtblk_data_t *data = (virtblk_data_t *) dev->data;
+    const char *const path = parm_str_next(&parm);
+    bool readonly = false;
+
+    if (parm_type(parm) != tt_end) {
+        const char *const mode = parm_str(parm);
+
+        if (strcmp(mode, "ro") != 0) {
+            error("Unknown access mode <%s> (use ro)", mode);
+            return false;
+        }
+
+        readonly = true;
+    }
+
+    int fd = open(path, readonly ? O_RDONLY : O_RDWR);
+    if (fd == -1) {
+        io_error(path);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        io_error(path);
+        close(fd);
+        return false;
+    }
+
+    uint64_t capacity = (uint64_t) st.st_size / SECTOR_SIZE;
+    if (capacity == 0) {
+        error("File is too small; at least one sector (512 B) should be present");
+        close(fd);
+        return false;
+    }
+
+    virtblk_close(data);
+    data->fd = fd;
+    data->path = safe_strdup(path);
+    data->capacity = capacity;
+    data->readonly = readonly;
+    data->virtio.features = FEATURE_FLUSH | (readonly ? FEATURE_RO : 0);
+
+    /* The driver rereads the configuration */
+    if (virtio_driver_ok(&data->virtio)) {
+        virtio_interrupt_up(&data->virtio, VIRTIO_INTERRUPT_CONFIG);
+    }
+
+    return true;
+}
+
+/** Route command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool virtblk_route(token_t *parm, device_t *dev)
+{
+    virtblk_data_t *data = (virtblk_data_t *) dev->data;
+    return virtio_route(parm, &data->virtio);
+}
+
+/** Info command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True (always successful)
+ *
+ */
+static bool virtblk_info(token_t *parm, device_t *dev)
+{
+    virtblk_data_t *data = (virtblk_data_t *) dev->data;
+    char *size = uint64_human_readable(data->capacity * SECTOR_SIZE);
+
+    printf("[address  ] [int] [size      ] [queue] [status] [file]\n"
+           "%#011" PRIx64 " %-5u %12s %7u %#8x %s%s\n",
+            data->virtio.addr, data->virtio.intno, size,
+            data->virtio.queues[0].num, data->virtio.status,
+            (data->path != NULL) ? data->path : "none",
+            data->readonly ? " (ro)" : "");
+
+    safe_free(size);
+    return true;
+}
+
+/** Stat command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True (always successful)
+ *
+ */
+static bool virtblk_stat(token_t *parm, device_t *dev)
+{
+    virtblk_data_t *data = (virtblk_data_t *) dev->data;
+
+    printf("[notifies          ] [requests          ] [errors            ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n",
+            data->virtio.notifies, data->requests, data->errors);
+    printf("[interrupts        ] [bytes read        ] [bytes written     ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n",
+            data->virtio.intrcount, data->bytes_read, data->bytes_written);
+
+    return true;
+}
+
+/** Dispose dvirtblk
+ *
+ * @param dev Device pointer
+ *
+ */
+static void virtblk_done(device_t *dev)
+{
+    virtblk_data_t *data = (virtblk_data_t *) dev->data;
+
+    virtblk_close(data);
+    safe_free(dev->data);
+}
+
+/** Read command implementation
+ *
+ * The capacity may be read by narrower accesses.
+ *
+ * @param dev  Device pointer
+ * @param addr Address of the read operation
+ * @param val  Read (returned) value
+ *
+ */
+static void virtblk_read32(unsigned int procno, device_t *dev, ptr36_t addr,
+        uint32_t *val)
+{
+    ASSERT(dev != NULL);
+    ASSERT(val != NULL);
+
+    virtblk_data_t *data = (virtblk_data_t *) dev->data;
+    ptr36_t offset = addr - data->virtio.addr;
+
+    if (offset < VIRTIO_CONFIG) {
+        if ((offset & 3) == 0) {
+            virtio_read32(&data->virtio, offset, val);
+        }
+        return;
+    }
+
+    unsigned int shift = (offset - VIRTIO_CONFIG) * 8;
+    *val = (shift < 64) ? (uint32_t) (data->capacity >> shift) : 0;
+}
+
+/** Write command implementation
+ *
+ * @param dev  Device pointer
+ * @param addr Address of the write operation
+ * @param val  Value to write
+ *
+ */
+static void virtblk_write32(unsigned int procno, device_t *dev, ptr36_t addr,
+        uint32_t val)
+{
+    ASSERT(dev != NULL);
+
+    virtblk_data_t *data = (virtblk_data_t *) dev->data;
+    virtio_write32(&data->virtio, addr - data->virtio.addr, val);
+}
+
+/** Save the device state into a checkpoint
+ *
+ * The disk image is not saved, it stays in its file.
+ *
+ * @param dev  Device instance pointer
+ * @param ckpt Checkpoint being written
+ *
+ * @return True if successful
+ *
+ */
+static bool virtblk_save(device_t *dev, checkpoint_t *ckpt)
+{
+    virtblk_data_t *data = (virtblk_data_t *) dev->data;
+
+    return virtio_save(&data->virtio, ckpt)
+            && checkpoint_write_var(ckpt, data->requests)
+            && checkpoint_write_var(ckpt, data->errors)
+            && checkpoint_write_var(ckpt, data->bytes_read)
+            && checkpoint_write_var(ckpt, data->bytes_written);
+}
+
+/** Load the device state from a checkpoint
+ *
+ * @param dev  Device instance pointer
+ * @param ckpt Checkpoint being read
+ *
+ * @return True if successful
+ *
+ */
+static bool virtblk_load(device_t *dev, checkpoint_t *ckpt)
+{
+    virtblk_data_t *data = (virtblk_data_t *) dev->data;
+
+    return virtio_load(&data->virtio, ckpt)
+            && checkpoint_read_var(ckpt, data->requests)
+            && checkpoint_read_var(ckpt, data->errors)
+            && checkpoint_read_var(ckpt, data->bytes_read)
+            && checkpoint_read_var(ckpt, data->bytes_written);
+}
+
+static cmd_t virtblk_cmds[] = {
+    { "init",
+            (fcmd_t) virtblk_init,
+            DEFAULT,
+            DEFAULT,
+            "Initialization",
+            "Initialization",
+            REQ STR "name/disk name" NEXT
+                    REQ INT "addr/register block address" NEXT
+                            REQ INT "intno/interrupt number within 0..6" END },
+    { "help",
+            (fcmd_t) dev_generic_help,
+            DEFAULT,
+            DEFAULT,
+            "Display help",
+            "Display help",
+            OPT STR "cmd/command name" END },
+    { "info",
+            (fcmd_t) virtblk_info,
+            DEFAULT,
+            DEFAULT,
+            "Configuration information",
+            "Configuration information",
+            NOCMD },
+    { "stat",
+            (fcmd_t) virtblk_stat,
+            DEFAULT,
+            DEFAULT,
+            "Statistics",
+            "Statistics",
+            NOCMD },
+    { "file",
+            (fcmd_t) virtblk_file,
+            DEFAULT,
+            DEFAULT,
+            "Use the file specified as the disk image",
+            "Use the file specified as the disk image. The sectors are read and written by host I/O calls directly from and into the guest memory. With the ro mode the disk is read-only.",
+            REQ STR "fname/file name" NEXT
+                    OPT STR "mode/ro" END },
+    { "route",
+            (fcmd_t) virtblk_route,
+            DEFAULT,
+            DEFAULT,
+            "Print or set the interrupt routing",
+            "Without arguments prints where the disk interrupt goes. With the name of a dplic device and a source number the interrupt is asserted as the source of the interrupt controller instead of the interrupt number of the first processor.",
+            OPT STR "plic/interrupt controller name" NEXT
+                    OPT INT "source/source number" END },
+    LAST_CMD
+};
+
+/** Dvirtblk object structure */
+device_type_t dvirtblk = {
+    /* The requests are completed within the notification */
+    .nondet = false,
+
+    /* Type name and description */
+    .name = "dvirtblk",
+    .brief = "Virtio block device",
+    .full = "Block device with the virtio-mmio interface and a single "
+            "split virtqueue. The requests are processed in batches "
+            "when the driver notifies the queue.",
+
+    /* Functions */
+    .done = virtblk_done,
+    .read32 = virtblk_read32,
+    .write32 = virtblk_write32,
+    .save = virtblk_save,
+    .load = virtblk_load,
+
+    /* Commands */
+    .cmds = virtblk_cmds
+};
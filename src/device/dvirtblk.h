@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Virtio block device
+ *
+ */
+
+#ifndef DVIRTBLK_H_
+#define DVIRTBLK_H_
+
+#include "device.h"
+
+extern device_type_t dvirtblk;
+
+#endif
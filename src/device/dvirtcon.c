@@ -0,0 +1,741 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Virtio console
+ *
+ *  A console with the virtio-mmio register interface. The driver posts
+ *  buffers of output into the transmit queue and empty buffers into
+ *  the receive queue. All output buffers of a notification are written
+ *  by a single host call directly from the memory frames, the input
+ *  fills the posted buffers in batches and each batch is announced
+ *  by a single interrupt.
+ *
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../assert.h"
+#include "../checkpoint.h"
+#include "../fault.h"
+#include "../main.h"
+#include "../replay.h"
+#include "../text.h"
+#include "../utils.h"
+#include "dvirtcon.h"
+#include "virtio.h"
+
+/** \{ \name Configuration registers */
+#define REGISTER_COLS_ROWS (VIRTIO_CONFIG + 0) /**< Console size (unknown) */
+#define REGISTER_MAX_NR_PORTS (VIRTIO_CONFIG + 4) /**< Number of ports */
+#define REGISTER_EMERG_WR (VIRTIO_CONFIG + 8) /**< Emergency write */
+#define REGISTER_LIMIT (VIRTIO_CONFIG + 12) /**< Size of register block */
+/* \} */
+
+/** Virtio device type */
+#define VIRTIO_DEVICE_CONSOLE 3
+
+/** Emergency write feature */
+#define FEATURE_EMERG_WRITE (UINT64_C(1) << 2)
+
+/** \{ \name Queues */
+#define QUEUE_RECEIVE 0
+#define QUEUE_TRANSMIT 1
+#define QUEUE_COUNT 2
+/* \} */
+
+/** Size of the buffer of the standard input */
+#define INPUT_SIZE 256
+
+/** Dvirtcon instance data structure */
+typedef struct {
+    virtio_t virtio; /**< Virtio transport */
+
+    FILE *file; /**< Output file */
+    char *fname; /**< Output file name */
+
+    int input; /**< Input file (-1 for the standard input) */
+    char *input_name; /**< Input file name */
+    char pending[INPUT_SIZE]; /**< Standard input not received yet */
+    size_t pending_len; /**< Number of pending characters */
+    unsigned int replay; /**< Source of the input in the replay log */
+
+    uint64_t bytes_out; /**< Number of characters written */
+    uint64_t bytes_in; /**< Number of characters received */
+    uint64_t writes; /**< Number of host write calls */
+    uint64_t buffers; /**< Number of input buffers filled */
+} virtcon_data_t;
+
+/** Write a batch of output
+ *
+ * @param data Dvirtcon instance data structure
+ * @param iov  Collected memory parts (emptied)
+ *
+ */
+static void virtcon_flush(virtcon_data_t *data, virtio_iov_t *iov)
+{
+    if (iov->count == 0) {
+        return;
+    }
+
+    /* Keep the order with the buffered output of the file */
+    fflush(data->file);
+
+    size_t len = iov->len;
+    if (virtio_iov_transfer(iov, fileno(data->file), -1, true)
+            != (ssize_t) len) {
+        io_error(data->fname);
+    }
+
+    data->bytes_out += len;
+    data->writes++;
+}
+
+/** Write the output buffers of the transmit queue
+ *
+ * @param data Dvirtcon instance data structure
+ *
+ */
+static void virtcon_transmit(virtcon_data_t *data)
+{
+    virtio_t *virtio = &data->virtio;
+    virtio_iov_t iov = { .count = 0, .len = 0 };
+    uint16_t head;
+
+    while (virtq_pop(virtio, QUEUE_TRANSMIT, &head)) {
+        uint16_t idx = head;
+
+        for (unsigned int n = 0; n < virtio->queues[QUEUE_TRANSMIT].num; n++) {
+            virtq_desc_t desc;
+
+            if (!virtq_desc(virtio, QUEUE_TRANSMIT, idx, &desc)) {
+                virtio_needs_reset(virtio);
+                virtcon_flush(data, &iov);
+                return;
+            }
+
+            ptr36_t addr = desc.addr;
+            len36_t len = desc.len;
+
+            while (len > 0) {
+                len36_t chunk = virtio_iov_add(&iov, addr, len, false);
+
+                if (chunk == 0) {
+                    /* Not in memory, the rest is skipped */
+                    break;
+                }
+
+                if (iov.count == VIRTIO_IOV_BATCH) {
+                    virtcon_flush(data, &iov);
+                }
+
+                addr += chunk;
+                len -= chunk;
+            }
+
+            if ((desc.flags & VIRTQ_DESC_NEXT) == 0) {
+                break;
+            }
+
+            idx = desc.next;
+        }
+
+        virtq_push(virtio, QUEUE_TRANSMIT, head, 0);
+    }
+
+    virtcon_flush(data, &iov);
+    virtq_publish(virtio, QUEUE_TRANSMIT);
+}
+
+/** Read the standard input into the pending characters
+ *
+ * The standard input is read only by a non-deterministic simulation
+ * (command-line option -n).
+ *
+ */
+static void virtcon_poll(virtcon_data_t *data)
+{
+    if (!machine_nondet) {
+        return;
+    }
+
+    while ((data->pending_len < INPUT_SIZE)
+            && (replay_stdin_poll(data->replay,
+                    &data->pending[data->pending_len]))) {
+        data->pending_len++;
+    }
+}
+
+/** Fill a receive buffer with the input
+ *
+ * The input file is read by a single host call directly into
+ * the memory frames of the buffer.
+ *
+ * @param data Dvirtcon instance data structure
+ * @param iov  Memory parts of the buffer (emptied)
+ *
+ * @return Number of characters received
+ *
+ */
+static size_t virtcon_fill(virtcon_data_t *data, virtio_iov_t *iov)
+{
+    if (data->input != -1) {
+        ssize_t done = virtio_iov_transfer(iov, data->input, -1, false);
+
+        if (done > 0) {
+            return done;
+        }
+
+        /* The standard input follows the end of the file */
+        if (done < 0) {
+            io_error(data->input_name);
+        }
+
+        close(data->input);
+        data->input = -1;
+        safe_free(data->input_name);
+        return 0;
+    }
+
+    size_t done = 0;
+
+    for (unsigned int i = 0; i < iov->count; i++) {
+        size_t len = iov->iov[i].iov_len;
+
+        if (len > data->pending_len - done) {
+            len = data->pending_len - done;
+        }
+
+        memcpy(iov->iov[i].iov_base, data->pending + done, len);
+        done += len;
+    }
+
+    memmove(data->pending, data->pending + done, data->pending_len - done);
+    data->pending_len -= done;
+
+    iov->count = 0;
+    iov->len = 0;
+    return done;
+}
+
+/** Fill the buffers of the receive queue with the input
+ *
+ * @param data Dvirtcon instance data structure
+ *
+ */
+static void virtcon_receive(virtcon_data_t *data)
+{
+    virtio_t *virtio = &data->virtio;
+    uint16_t head;
+
+    if (data->input == -1) {
+        virtcon_poll(data);
+    }
+
+    while ((data->input != -1) || (data->pending_len > 0)) {
+        if (!virtq_pop(virtio, QUEUE_RECEIVE, &head)) {
+            break;
+        }
+
+        virtio_iov_t iov = { .count = 0, .len = 0 };
+        uint16_t idx = head;
+
+        for (unsigned int n = 0; n < virtio->queues[QUEUE_RECEIVE].num; n++) {
+            virtq_desc_t desc;
+
+            if (!virtq_desc(virtio, QUEUE_RECEIVE, idx, &desc)) {
+                virtio_needs_reset(virtio);
+                return;
+            }
+
+            ptr36_t addr = desc.addr;
+            len36_t len = desc.len;
+
+            while ((len > 0) && (iov.count < VIRTIO_IOV_BATCH)) {
+                len36_t chunk = virtio_iov_add(&iov, addr, len, true);
+
+                if (chunk == 0) {
+                    break;
+                }
+
+                addr += chunk;
+                len -= chunk;
+            }
+
+            if (((desc.flags & VIRTQ_DESC_NEXT) == 0)
+                    || (iov.count == VIRTIO_IOV_BATCH)) {
+                break;
+            }
+
+            idx = desc.next;
+        }
+
+        if (iov.count == 0) {
+            /* No writable memory, the buffer is returned empty */
+            virtq_push(virtio, QUEUE_RECEIVE, head, 0);
+            continue;
+        }
+
+        size_t done = virtcon_fill(data, &iov);
+
+        if (done == 0) {
+            /* Nothing to receive, the buffer stays available */
+            virtq_unpop(virtio, QUEUE_RECEIVE);
+
+            if (data->input == -1) {
+                virtcon_poll(data);
+            }
+            continue;
+        }
+
+        virtq_push(virtio, QUEUE_RECEIVE, head, done);
+        data->bytes_in += done;
+        data->buffers++;
+    }
+
+    virtq_publish(virtio, QUEUE_RECEIVE);
+}
+
+/** Process a notified queue
+ *
+ * @param virtio Virtio transport of the device
+ * @param queue  Notified queue
+ *
+ */
+static void virtcon_notify(virtio_t *virtio, unsigned int queue)
+{
+    virtcon_data_t *data = (virtcon_data_t *) virtio->dev->data;
+
+    if (!virtq_usable(virtio, queue)) {
+        return;
+    }
+
+    if (queue == QUEUE_TRANSMIT) {
+        virtcon_transmit(data);
+    } else {
+        virtcon_receive(data);
+    }
+}
+
+/** Init command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool virtcon_init(token_t *parm, device_t *dev)
+{
+    parm_next(&parm);
+    uint64_t _addr = parm_uint_next(&parm);
+    uint64_t _intno = parm_uint_next(&parm);
+
+    if (!phys_range(_addr)) {
+        error("Physical memory address out of range");
+        return false;
+    }
+
+    if (!phys_range(_addr + (uint64_t) REGISTER_LIMIT)) {
+        error("Invalid address, registers would exceed the physical "
+              "memory range");
+        return false;
+    }
+
+    ptr36_t addr = _addr;
+
+    if (!ptr36_dword_aligned(addr)) {
+        error("Physical memory address must be 8-byte aligned");
+        return false;
+    }
+
+    if (_intno > MAX_INTRS) {
+        error("%s", txt_intnum_range);
+        return false;
+    }
+
+    /* Initialization */
+    virtcon_data_t *data = safe_malloc_t(virtcon_data_t);
+    dev->data = data;
+
+    virtio_init(&data->virtio, dev, addr, _intno, VIRTIO_DEVICE_CONSOLE,
+            FEATURE_EMERG_WRITE, QUEUE_COUNT);
+    data->virtio.notify = virtcon_notify;
+    data->file = stdout;
+    data->fname = NULL;
+    data->input = -1;
+    data->input_name = NULL;
+    data->pending_len = 0;
+    data->replay = replay_source(dev->name);
+    data->bytes_out = 0;
+    data->bytes_in = 0;
+    data->writes = 0;
+    data->buffers = 0;
+
+    dev_map(dev, addr, REGISTER_LIMIT);
+
+    return true;
+}
+
+/** Close the output file if it is not the standard output */
+static void virtcon_close(virtcon_data_t *data)
+{
+    if (data->file != stdout) {
+        safe_fclose(data->file, data->fname);
+        safe_free(data->fname);
+        data->file = stdout;
+    }
+}
+
+/** Redir command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool virtcon_redir(token_t *parm, device_t *dev)
+{
+    virtcon_data_t *data = (virtcon_data_t *) dev->data;
+    const char *const fname = parm_str(parm);
+
+    FILE *file = try_fopen(fname, "w");
+    if (file == NULL) {
+        return false;
+    }
+
+    virtcon_close(data);
+    data->file = file;
+    data->fname = safe_strdup(fname);
+
+    return true;
+}
+
+/** Stdout command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True (always successful)
+ *
+ */
+static bool virtcon_stdout(token_t *parm, device_t *dev)
+{
+    virtcon_data_t *data = (virtcon_data_t *) dev->data;
+
+    virtcon_close(data);
+    return true;
+}
+
+/** Input command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool virtcon_input(token_t *parm, device_t *dev)
+{
+    virtcon_data_t *data = (virtcon_data_t *) dev->data;
+    const char *const fname = parm_str(parm);
+
+    int fd = open(fname, O_RDONLY);
+    if (fd == -1) {
+        io_error(fname);
+        return false;
+    }
+
+    if (data->input != -1) {
+        close(data->input);
+        safe_free(data->input_name);
+    }
+
+    data->input = fd;
+    data->input_name = safe_strdup(fname);
+
+    return true;
+}
+
+/** Route command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool virtcon_route(token_t *parm, device_t *dev)
+{
+    virtcon_data_t *data = (virtcon_data_t *) dev->data;
+    return virtio_route(parm, &data->virtio);
+}
+
+/** Info command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True (always successful)
+ *
+ */
+static bool virtcon_info(token_t *parm, device_t *dev)
+{
+    virtcon_data_t *data = (virtcon_data_t *) dev->data;
+
+    printf("[address  ] [int] [status] [output] [input]\n"
+           "%#011" PRIx64 " %-5u %#8x %s %s\n",
+            data->virtio.addr, data->virtio.intno, data->virtio.status,
+            (data->fname != NULL) ? data->fname : "stdout",
+            (data->input_name != NULL) ? data->input_name : "stdin");
+
+    return true;
+}
+
+/** Stat command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True (always successful)
+ *
+ */
+static bool virtcon_stat(token_t *parm, device_t *dev)
+{
+    virtcon_data_t *data = (virtcon_data_t *) dev->data;
+
+    printf("[notifies          ] [interrupts        ] [host writes       ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n",
+            data->virtio.notifies, data->virtio.intrcount, data->writes);
+    printf("[bytes out         ] [bytes in          ] [input buffers     ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n",
+            data->bytes_out, data->bytes_in, data->buffers);
+
+    return true;
+}
+
+/** Dispose dvirtcon
+ *
+ * @param dev Device pointer
+ *
+ */
+static void virtcon_done(device_t *dev)
+{
+    virtcon_data_t *data = (virtcon_data_t *) dev->data;
+
+    virtcon_close(data);
+
+    if (data->input != -1) {
+        close(data->input);
+        safe_free(data->input_name);
+    }
+
+    safe_free(dev->data);
+}
+
+/** Deliver the standard input
+ *
+ * The input file is delivered whenever the driver posts buffers,
+ * the standard input is looked at every 4096 cycles.
+ *
+ */
+static void virtcon_step4k(device_t *dev)
+{
+    virtcon_data_t *data = (virtcon_data_t *) dev->data;
+
+    if (virtq_usable(&data->virtio, QUEUE_RECEIVE)) {
+        virtcon_receive(data);
+    }
+}
+
+/** Read command implementation
+ *
+ * @param dev  Device pointer
+ * @param addr Address of the read operation
+ * @param val  Read (returned) value
+ *
+ */
+static void virtcon_read32(unsigned int procno, device_t *dev, ptr36_t addr,
+        uint32_t *val)
+{
+    ASSERT(dev != NULL);
+    ASSERT(val != NULL);
+
+    virtcon_data_t *data = (virtcon_data_t *) dev->data;
+    ptr36_t offset = addr - data->virtio.addr;
+
+    if ((offset & 3) != 0) {
+        return;
+    }
+
+    if (!virtio_read32(&data->virtio, offset, val)) {
+        /* Single port of unknown size */
+        *val = (offset == REGISTER_MAX_NR_PORTS) ? 1 : 0;
+    }
+}
+
+/** Write command implementation
+ *
+ * A write into the emergency write register prints the character
+ * at once, even before the driver is ready.
+ *
+ * @param dev  Device pointer
+ * @param addr Address of the write operation
+ * @param val  Value to write
+ *
+ */
+static void virtcon_write32(unsigned int procno, device_t *dev, ptr36_t addr,
+        uint32_t val)
+{
+    ASSERT(dev != NULL);
+
+    virtcon_data_t *data = (virtcon_data_t *) dev->data;
+    ptr36_t offset = addr - data->virtio.addr;
+
+    if (offset == REGISTER_EMERG_WR) {
+        fputc((char) val, data->file);
+        fflush(data->file);
+        data->bytes_out++;
+        data->writes++;
+        return;
+    }
+
+    virtio_write32(&data->virtio, offset, val);
+}
+
+/** Save the device state into a checkpoint
+ *
+ * The input file position is not saved.
+ *
+ * @param dev  Device instance pointer
+ * @param ckpt Checkpoint being written
+ *
+ * @return True if successful
+ *
+ */
+static bool virtcon_save(device_t *dev, checkpoint_t *ckpt)
+{
+    virtcon_data_t *data = (virtcon_data_t *) dev->data;
+
+    return virtio_save(&data->virtio, ckpt)
+            && checkpoint_write_var(ckpt, data->bytes_out)
+            && checkpoint_write_var(ckpt, data->bytes_in)
+            && checkpoint_write_var(ckpt, data->writes)
+            && checkpoint_write_var(ckpt, data->buffers);
+}
+
+/** Load the device state from a checkpoint
+ *
+ * @param dev  Device instance pointer
+ * @param ckpt Checkpoint being read
+ *
+ * @return True if successful
+ *
+ */
+static bool virtcon_load(device_t *dev, checkpoint_t *ckpt)
+{
+    virtcon_data_t *data = (virtcon_data_t *) dev->data;
+
+    return virtio_load(&data->virtio, ckpt)
+            && checkpoint_read_var(ckpt, data->bytes_out)
+            && checkpoint_read_var(ckpt, data->bytes_in)
+            && checkpoint_read_var(ckpt, data->writes)
+            && checkpoint_read_var(ckpt, data->buffers);
+}
+
+static cmd_t virtcon_cmds[] = {
+    { "init",
+            (fcmd_t) virtcon_init,
+            DEFAULT,
+            DEFAULT,
+            "Initialization",
+            "Initialization",
+            REQ STR "name/console name" NEXT
+                    REQ INT "addr/register block address" NEXT
+                            REQ INT "intno/interrupt number within 0..6" END },
+    { "help",
+            (fcmd_t) dev_generic_help,
+            DEFAULT,
+            DEFAULT,
+            "Display help",
+            "Display help",
+            OPT STR "cmd/command name" END },
+    { "info",
+            (fcmd_t) virtcon_info,
+            DEFAULT,
+            DEFAULT,
+            "Configuration information",
+            "Configuration information",
+            NOCMD },
+    { "stat",
+            (fcmd_t) virtcon_stat,
+            DEFAULT,
+            DEFAULT,
+            "Statistics",
+            "Statistics",
+            NOCMD },
+    { "redir",
+            (fcmd_t) virtcon_redir,
+            DEFAULT,
+            DEFAULT,
+            "Redirect output to the specified file",
+            "Redirect output to the specified file",
+            REQ STR "filename/output file name" END },
+    { "stdout",
+            (fcmd_t) virtcon_stdout,
+            DEFAULT,
+            DEFAULT,
+            "Redirect output to the standard output",
+            "Redirect output to the standard output",
+            NOCMD },
+    { "input",
+            (fcmd_t) virtcon_input,
+            DEFAULT,
+            DEFAULT,
+            "Read input from the specified file",
+            "Read input from the specified file. The file is read directly into the buffers posted by the driver, the standard input (with -n) is read once the file is over.",
+            REQ STR "filename/input file name" END },
+    { "route",
+            (fcmd_t) virtcon_route,
+            DEFAULT,
+            DEFAULT,
+            "Print or set the interrupt routing",
+            "Without arguments prints where the console interrupt goes. With the name of a dplic device and a source number the interrupt is asserted as the source of the interrupt controller instead of the interrupt number of the first processor.",
+            OPT STR "plic/interrupt controller name" NEXT
+                    OPT INT "source/source number" END },
+    LAST_CMD
+};
+
+/** Dvirtcon object structure */
+device_type_t dvirtcon = {
+    /* The standard input is read only with -n */
+    .nondet = false,
+
+    /* Type name and description */
+    .name = "dvirtcon",
+    .brief = "Virtio console",
+    .full = "Console with the virtio-mmio interface. The output buffers "
+            "of a notification are written at once, the input fills "
+            "the posted buffers in batches.",
+
+    /* Functions */
+    .done = virtcon_done,
+    .step4k = virtcon_step4k,
+    .read32 = virtcon_read32,
+    .write32 = virtcon_write32,
+    .save = virtcon_save,
+    .load = virtcon_load,
+
+    /* Commands */
+    .cmds = virtcon_cmds
+};
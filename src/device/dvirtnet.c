@@ -0,0 +1,1326 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Virtio network device
+ *
+ *  A network card with the virtio-mmio register interface. The driver
+ *  posts the frames to send into the transmit queue and empty buffers
+ *  into the receive queue. No packet is moved by a register access:
+ *  a notification only marks the transmit queue, the queues are
+ *  processed by a tick every few cycles, which sends all the frames
+ *  posted since by a single sendmmsg() call, receives a batch of
+ *  frames by a single recvmmsg() call and announces both by a single
+ *  interrupt (i.e. the interrupts are coalesced by the ticks). The
+ *  frames are moved directly from and into the memory frames.
+ *
+ *  The frames go to a TAP interface of the host or into UDP datagrams
+ *  of a virtual switch of simulators: each simulator sends the frames
+ *  of its guest to its peers, a frame addressed to a station learnt
+ *  from the received frames goes only to the peer the station is
+ *  behind.
+ *
+ */
+
+/* sendmmsg() and recvmmsg() */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../../config.h"
+#include "../arch/network.h"
+#include "../assert.h"
+#include "../checkpoint.h"
+#include "../debug/statsrv.h"
+#include "../fault.h"
+#include "../main.h"
+#include "../text.h"
+#include "../utils.h"
+#include "dvirtnet.h"
+#include "virtio.h"
+
+#ifndef __WIN32__
+#include <netdb.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#endif
+
+#ifdef HAVE_LINUX_IF_TUN_H
+#include <linux/if_tun.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#endif
+
+/** \{ \name Configuration registers */
+#define REGISTER_MAC_LO (VIRTIO_CONFIG + 0) /**< MAC address (bytes 0 .. 3) */
+#define REGISTER_MAC_HI (VIRTIO_CONFIG + 4) /**< MAC address (bytes 4 .. 5) */
+#define REGISTER_LIMIT (VIRTIO_CONFIG + 8) /**< Size of register block */
+/* \} */
+
+/** Virtio device type */
+#define VIRTIO_DEVICE_NET 1
+
+/** MAC address feature */
+#define FEATURE_MAC (UINT64_C(1) << 5)
+
+/** \{ \name Queues */
+#define QUEUE_RECEIVE 0
+#define QUEUE_TRANSMIT 1
+#define QUEUE_COUNT 2
+/* \} */
+
+/** Size of the header preceding the frames (virtio 1.0) */
+#define NET_HDR_SIZE 12
+
+/** Offset of the number of buffers in the header */
+#define NET_HDR_NUM_BUFFERS 10
+
+/** Size of an Ethernet address */
+#define MAC_SIZE 6
+
+/** Size of the Ethernet header (addresses and type) */
+#define ETH_HDR_SIZE 14
+
+/** Frames moved by a single host call */
+#define NET_BATCH 32
+
+/** Maximal number of the peers of the virtual switch */
+#define NET_PEERS 8
+
+/** Number of the stations learnt */
+#define NET_STATIONS 64
+
+/** Default cycles between the ticks */
+#define DEFAULT_COALESCE 1000
+
+/** Backend of the network device */
+typedef enum {
+    NET_NONE,
+    NET_UDP,
+    NET_TAP
+} net_backend_t;
+
+/** Station learnt from a received frame */
+typedef struct {
+    uint8_t mac[MAC_SIZE]; /**< Address of the station */
+    unsigned int peer; /**< Peer the station is behind */
+} net_station_t;
+
+/** Dvirtnet instance data structure */
+typedef struct {
+    virtio_t virtio; /**< Virtio transport */
+    uint8_t mac[MAC_SIZE]; /**< MAC address */
+    uint64_t coalesce; /**< Cycles between the ticks */
+    bool tx_pending; /**< Transmit queue notified since the last tick */
+
+    net_backend_t backend; /**< Backend */
+    int fd; /**< Socket or TAP interface (-1 for none) */
+    char *tap_name; /**< Name of the TAP interface */
+    unsigned int port; /**< Local UDP port */
+
+#ifndef __WIN32__
+    struct sockaddr_in peers[NET_PEERS]; /**< Peers of the switch */
+#endif
+    unsigned int peer_count; /**< Number of the peers */
+    net_station_t stations[NET_STATIONS]; /**< Stations learnt */
+    unsigned int station_count; /**< Number of the stations learnt */
+    unsigned int station_next; /**< Station replaced next */
+
+    virtio_iov_t iovs[NET_BATCH]; /**< Frames of a batch */
+    uint16_t heads[NET_BATCH]; /**< Requests of the frames of a batch */
+
+    uint64_t tx_frames; /**< Frames sent */
+    uint64_t tx_bytes; /**< Bytes sent */
+    uint64_t tx_dropped; /**< Frames not sent */
+    uint64_t rx_frames; /**< Frames received */
+    uint64_t rx_bytes; /**< Bytes received */
+    uint64_t host_calls; /**< Host calls sending or receiving frames */
+} virtnet_data_t;
+
+/** Collect the memory parts of the buffers of a request
+ *
+ * The parts not fitting into the batch of parts are left out.
+ *
+ * @param data  Dvirtnet instance data structure
+ * @param queue Queue of the request
+ * @param head  First descriptor of the request
+ * @param iov   Memory parts (returned)
+ * @param write True to collect the buffers written by the device
+ *
+ * @return False if a descriptor is invalid
+ *
+ */
+static bool virtnet_collect(virtnet_data_t *data, unsigned int queue,
+        uint16_t head, virtio_iov_t *iov, bool write)
+{
+    virtio_t *virtio = &data->virtio;
+    uint16_t idx = head;
+
+    iov->count = 0;
+    iov->len = 0;
+
+    for (unsigned int n = 0; n < virtio->queues[queue].num; n++) {
+        virtq_desc_t desc;
+
+        if (!virtq_desc(virtio, queue, idx, &desc)) {
+            return false;
+        }
+
+        ptr36_t addr = desc.addr;
+        len36_t len = desc.len;
+
+        while ((len > 0) && (iov->count < VIRTIO_IOV_BATCH)) {
+            len36_t chunk = virtio_iov_add(iov, addr, len, write);
+
+            if (chunk == 0) {
+                break;
+            }
+
+            addr += chunk;
+            len -= chunk;
+        }
+
+        if (((desc.flags & VIRTQ_DESC_NEXT) == 0)
+                || (iov->count == VIRTIO_IOV_BATCH)) {
+            break;
+        }
+
+        idx = desc.next;
+    }
+
+    return true;
+}
+
+/** Move bytes between the memory parts and a host buffer
+ *
+ * @param iov    Memory parts
+ * @param offset Offset of the bytes within the parts
+ * @param buf    Host buffer
+ * @param len    Number of the bytes (all within the parts)
+ * @param put    True to copy the host buffer into the parts
+ *
+ */
+static void virtnet_iov_copy(virtio_iov_t *iov, size_t offset, void *buf,
+        size_t len, bool put)
+{
+    uint8_t *ptr = (uint8_t *) buf;
+
+    for (unsigned int i = 0; (i < iov->count) && (len > 0); i++) {
+        size_t part = iov->iov[i].iov_len;
+
+        if (offset >= part) {
+            offset -= part;
+            continue;
+        }
+
+        size_t chunk = MIN(part - offset, len);
+        uint8_t *base = (uint8_t *) iov->iov[i].iov_base + offset;
+
+        if (put) {
+            memcpy(base, ptr, chunk);
+        } else {
+            memcpy(ptr, base, chunk);
+        }
+
+        ptr += chunk;
+        len -= chunk;
+        offset = 0;
+    }
+}
+
+/** Drop the first bytes of the memory parts
+ *
+ * @param iov Memory parts (at least len bytes)
+ * @param len Number of the bytes
+ *
+ */
+static void virtnet_iov_skip(virtio_iov_t *iov, size_t len)
+{
+    unsigned int first = 0;
+
+    iov->len -= len;
+
+    while (len > 0) {
+        size_t part = iov->iov[first].iov_len;
+
+        if (len < part) {
+            iov->iov[first].iov_base = (uint8_t *) iov->iov[first].iov_base + len;
+            iov->iov[first].iov_len -= len;
+            break;
+        }
+
+        len -= part;
+        first++;
+    }
+
+    iov->count -= first;
+    memmove(&iov->iov[0], &iov->iov[first], iov->count * sizeof(iov->iov[0]));
+}
+
+#ifndef __WIN32__
+
+/** Find the peer of the switch by its address
+ *
+ * @return Peer index or NET_PEERS if the address is not a peer
+ *
+ */
+static unsigned int virtnet_peer_find(virtnet_data_t *data,
+        const struct sockaddr_in *addr)
+{
+    for (unsigned int i = 0; i < data->peer_count; i++) {
+        if ((data->peers[i].sin_addr.s_addr == addr->sin_addr.s_addr)
+                && (data->peers[i].sin_port == addr->sin_port)) {
+            return i;
+        }
+    }
+
+    return NET_PEERS;
+}
+
+#endif
+
+/** Learn the peer the sender of a received frame is behind
+ *
+ */
+static void virtnet_learn(virtnet_data_t *data, const uint8_t *mac,
+        unsigned int peer)
+{
+    /* Group addresses are not stations */
+    if ((peer == NET_PEERS) || (mac[0] & 1)) {
+        return;
+    }
+
+    for (unsigned int i = 0; i < data->station_count; i++) {
+        if (memcmp(data->stations[i].mac, mac, MAC_SIZE) == 0) {
+            data->stations[i].peer = peer;
+            return;
+        }
+    }
+
+    unsigned int i = data->station_count;
+
+    if (i < NET_STATIONS) {
+        data->station_count++;
+    } else {
+        i = data->station_next;
+        data->station_next = (i + 1) % NET_STATIONS;
+    }
+
+    memcpy(data->stations[i].mac, mac, MAC_SIZE);
+    data->stations[i].peer = peer;
+}
+
+/** Find the peer a frame has to be sent to
+ *
+ * @return Peer index or NET_PEERS if the frame goes to all peers
+ *
+ */
+static unsigned int virtnet_route_frame(virtnet_data_t *data,
+        const uint8_t *mac)
+{
+    if ((mac[0] & 1) == 0) {
+        for (unsigned int i = 0; i < data->station_count; i++) {
+            if (memcmp(data->stations[i].mac, mac, MAC_SIZE) == 0) {
+                return data->stations[i].peer;
+            }
+        }
+    }
+
+    return NET_PEERS;
+}
+
+/** Send a batch of frames
+ *
+ * The frames go into the datagrams to the peers by a single call,
+ * or into the TAP interface one by one. The frames which cannot be
+ * sent at once are dropped, as by a congested link.
+ *
+ * @param data  Dvirtnet instance data structure
+ * @param count Number of the frames in the batch
+ *
+ */
+static void virtnet_send(virtnet_data_t *data, unsigned int count)
+{
+    unsigned int sent = 0;
+
+#ifndef __WIN32__
+    if (data->backend == NET_UDP) {
+        struct mmsghdr msgs[NET_BATCH * NET_PEERS];
+        unsigned int n = 0;
+
+        memset(msgs, 0, sizeof(msgs));
+
+        for (unsigned int i = 0; i < count; i++) {
+            uint8_t dst[MAC_SIZE];
+            virtnet_iov_copy(&data->iovs[i], 0, dst, MAC_SIZE, false);
+
+            unsigned int peer = virtnet_route_frame(data, dst);
+            unsigned int first = (peer == NET_PEERS) ? 0 : peer;
+            unsigned int last = (peer == NET_PEERS) ? data->peer_count : peer + 1;
+
+            for (unsigned int p = first; p < last; p++) {
+                msgs[n].msg_hdr.msg_name = &data->peers[p];
+                msgs[n].msg_hdr.msg_namelen = sizeof(data->peers[p]);
+                msgs[n].msg_hdr.msg_iov = data->iovs[i].iov;
+                msgs[n].msg_hdr.msg_iovlen = data->iovs[i].count;
+                n++;
+            }
+        }
+
+        unsigned int done = 0;
+
+        while (done < n) {
+#ifdef HAVE_SENDMMSG
+            int rc = sendmmsg(data->fd, msgs + done, n - done, 0);
+#else
+            int rc = (sendmsg(data->fd, &msgs[done].msg_hdr, 0) < 0) ? -1 : 1;
+#endif
+            data->host_calls++;
+
+            if (rc <= 0) {
+                break;
+            }
+
+            done += rc;
+        }
+
+        /* A frame counts as sent when it reaches all its peers */
+        sent = ((n > 0) && (done == n)) ? count : 0;
+    }
+#endif
+
+#ifdef HAVE_LINUX_IF_TUN_H
+    if (data->backend == NET_TAP) {
+        for (unsigned int i = 0; i < count; i++) {
+            ssize_t rc = writev(data->fd, data->iovs[i].iov,
+                    data->iovs[i].count);
+            data->host_calls++;
+
+            if (rc < 0) {
+                break;
+            }
+
+            sent++;
+        }
+    }
+#endif
+
+    for (unsigned int i = 0; i < count; i++) {
+        if (i < sent) {
+            data->tx_frames++;
+            data->tx_bytes += data->iovs[i].len;
+        } else {
+            data->tx_dropped++;
+        }
+    }
+}
+
+/** Send the frames of the transmit queue
+ *
+ * @param data Dvirtnet instance data structure
+ *
+ */
+static void virtnet_transmit(virtnet_data_t *data)
+{
+    virtio_t *virtio = &data->virtio;
+    unsigned int count;
+
+    do {
+        unsigned int frames = 0;
+        count = 0;
+
+        while ((count < NET_BATCH)
+                && (virtq_pop(virtio, QUEUE_TRANSMIT, &data->heads[count]))) {
+            virtio_iov_t *iov = &data->iovs[frames];
+
+            if (!virtnet_collect(data, QUEUE_TRANSMIT, data->heads[count], iov,
+                        false)) {
+                virtio_needs_reset(virtio);
+                return;
+            }
+
+            count++;
+
+            /* Frames without the Ethernet header are dropped */
+            if (iov->len < NET_HDR_SIZE + ETH_HDR_SIZE) {
+                data->tx_dropped++;
+                continue;
+            }
+
+            virtnet_iov_skip(iov, NET_HDR_SIZE);
+            frames++;
+        }
+
+        if (frames > 0) {
+            virtnet_send(data, frames);
+        }
+
+        for (unsigned int i = 0; i < count; i++) {
+            virtq_push(virtio, QUEUE_TRANSMIT, data->heads[i], 0);
+        }
+    } while (count == NET_BATCH);
+
+    virtq_publish(virtio, QUEUE_TRANSMIT);
+}
+
+/** Test whether a frame is waiting to be received
+ *
+ */
+static bool virtnet_readable(virtnet_data_t *data)
+{
+#ifndef __WIN32__
+    if (data->fd != -1) {
+        struct pollfd pfd = { .fd = data->fd, .events = POLLIN };
+        return poll(&pfd, 1, 0) > 0;
+    }
+#endif
+
+    return false;
+}
+
+/** Receive a batch of frames
+ *
+ * The datagrams are received by a single call, the TAP interface
+ * is read frame by frame.
+ *
+ * @param data  Dvirtnet instance data structure
+ * @param count Number of the buffers in the batch
+ * @param lens  Lengths of the received frames (returned)
+ *
+ * @return Number of the frames received
+ *
+ */
+static unsigned int virtnet_recv(virtnet_data_t *data, unsigned int count,
+        size_t *lens)
+{
+    unsigned int received = 0;
+
+#ifndef __WIN32__
+    if (data->backend == NET_UDP) {
+        struct mmsghdr msgs[NET_BATCH];
+        struct sockaddr_in addrs[NET_BATCH];
+
+        memset(msgs, 0, sizeof(msgs));
+
+        for (unsigned int i = 0; i < count; i++) {
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+            msgs[i].msg_hdr.msg_iov = data->iovs[i].iov;
+            msgs[i].msg_hdr.msg_iovlen = data->iovs[i].count;
+        }
+
+#ifdef HAVE_SENDMMSG
+        int rc = recvmmsg(data->fd, msgs, count, MSG_DONTWAIT, NULL);
+#else
+        ssize_t len = recvmsg(data->fd, &msgs[0].msg_hdr, MSG_DONTWAIT);
+        msgs[0].msg_len = len;
+        int rc = (len < 0) ? -1 : 1;
+#endif
+        data->host_calls++;
+
+        for (int i = 0; i < rc; i++) {
+            uint8_t src[MAC_SIZE];
+
+            lens[i] = msgs[i].msg_len;
+
+            if (lens[i] >= ETH_HDR_SIZE) {
+                virtnet_iov_copy(&data->iovs[i], MAC_SIZE, src, MAC_SIZE, false);
+                virtnet_learn(data, src, virtnet_peer_find(data, &addrs[i]));
+            }
+        }
+
+        received = (rc > 0) ? rc : 0;
+    }
+#endif
+
+#ifdef HAVE_LINUX_IF_TUN_H
+    if (data->backend == NET_TAP) {
+        while (received < count) {
+            ssize_t rc = readv(data->fd, data->iovs[received].iov,
+                    data->iovs[received].count);
+            data->host_calls++;
+
+            if (rc <= 0) {
+                break;
+            }
+
+            lens[received++] = rc;
+        }
+    }
+#endif
+
+    return received;
+}
+
+/** Fill the buffers of the receive queue with the received frames
+ *
+ * The buffers are collected only when a frame is waiting.
+ *
+ * @param data Dvirtnet instance data structure
+ *
+ */
+static void virtnet_receive(virtnet_data_t *data)
+{
+    virtio_t *virtio = &data->virtio;
+    uint8_t hdr[NET_HDR_SIZE];
+
+    memset(hdr, 0, sizeof(hdr));
+    hdr[NET_HDR_NUM_BUFFERS] = 1;
+
+    while (virtnet_readable(data)) {
+        unsigned int count = 0;
+
+        while ((count < NET_BATCH)
+                && (virtq_pop(virtio, QUEUE_RECEIVE, &data->heads[count]))) {
+            virtio_iov_t *iov = &data->iovs[count];
+
+            if (!virtnet_collect(data, QUEUE_RECEIVE, data->heads[count], iov,
+                        true)) {
+                virtio_needs_reset(virtio);
+                return;
+            }
+
+            /* Too small buffers are returned empty */
+            if (iov->len < NET_HDR_SIZE + ETH_HDR_SIZE) {
+                virtq_push(virtio, QUEUE_RECEIVE, data->heads[count], 0);
+                continue;
+            }
+
+            virtnet_iov_copy(iov, 0, hdr, NET_HDR_SIZE, true);
+            virtnet_iov_skip(iov, NET_HDR_SIZE);
+            count++;
+        }
+
+        if (count == 0) {
+            break;
+        }
+
+        size_t lens[NET_BATCH];
+        unsigned int received = virtnet_recv(data, count, lens);
+
+        for (unsigned int i = 0; i < received; i++) {
+            virtq_push(virtio, QUEUE_RECEIVE, data->heads[i],
+                    NET_HDR_SIZE + lens[i]);
+            data->rx_frames++;
+            data->rx_bytes += lens[i];
+        }
+
+        /* The buffers not filled stay available */
+        for (unsigned int i = received; i < count; i++) {
+            virtq_unpop(virtio, QUEUE_RECEIVE);
+        }
+
+        if (received < count) {
+            break;
+        }
+    }
+
+    virtq_publish(virtio, QUEUE_RECEIVE);
+}
+
+/** Tick of the device
+ *
+ * Processes both queues, the frames sent and received
+ * since the last tick are announced by a single interrupt.
+ *
+ */
+static void virtnet_tick(device_t *dev)
+{
+    virtnet_data_t *data = (virtnet_data_t *) dev->data;
+    virtio_t *virtio = &data->virtio;
+
+    if ((data->tx_pending) && (virtq_usable(virtio, QUEUE_TRANSMIT))) {
+        data->tx_pending = false;
+        virtnet_transmit(data);
+    }
+
+    if (virtq_usable(virtio, QUEUE_RECEIVE)) {
+        virtnet_receive(data);
+    }
+
+    dev_schedule(dev, data->coalesce, virtnet_tick);
+}
+
+/** Process a notified queue
+ *
+ * The transmit queue is processed by the next tick.
+ *
+ * @param virtio Virtio transport of the device
+ * @param queue  Notified queue
+ *
+ */
+static void virtnet_notify(virtio_t *virtio, unsigned int queue)
+{
+    virtnet_data_t *data = (virtnet_data_t *) virtio->dev->data;
+
+    if (queue == QUEUE_TRANSMIT) {
+        data->tx_pending = true;
+    }
+}
+
+/** Close the backend
+ *
+ */
+static void virtnet_detach(virtnet_data_t *data)
+{
+    if (data->fd != -1) {
+        close(data->fd);
+        data->fd = -1;
+    }
+
+    safe_free(data->tap_name);
+    data->backend = NET_NONE;
+    data->port = 0;
+    data->peer_count = 0;
+    data->station_count = 0;
+    data->station_next = 0;
+}
+
+/** Init command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool virtnet_init(token_t *parm, device_t *dev)
+{
+    parm_next(&parm);
+    uint64_t _addr = parm_uint_next(&parm);
+    uint64_t _intno = parm_uint_next(&parm);
+
+    if (!phys_range(_addr)) {
+        error("Physical memory address out of range");
+        return false;
+    }
+
+    if (!phys_range(_addr + (uint64_t) REGISTER_LIMIT)) {
+        error("Invalid address, registers would exceed the physical "
+              "memory range");
+        return false;
+    }
+
+    ptr36_t addr = _addr;
+
+    if (!ptr36_dword_aligned(addr)) {
+        error("Physical memory address must be 8-byte aligned");
+        return false;
+    }
+
+    if (_intno > MAX_INTRS) {
+        error("%s", txt_intnum_range);
+        return false;
+    }
+
+    /* Initialization */
+    virtnet_data_t *data = safe_malloc_t(virtnet_data_t);
+    dev->data = data;
+
+    virtio_init(&data->virtio, dev, addr, _intno, VIRTIO_DEVICE_NET,
+            FEATURE_MAC, QUEUE_COUNT);
+    data->virtio.notify = virtnet_notify;
+
+    /* Locally administered address */
+    static const uint8_t mac[MAC_SIZE] = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 };
+    memcpy(data->mac, mac, MAC_SIZE);
+
+    data->coalesce = DEFAULT_COALESCE;
+    data->tx_pending = false;
+    data->backend = NET_NONE;
+    data->fd = -1;
+    data->tap_name = NULL;
+    data->port = 0;
+    data->peer_count = 0;
+    data->station_count = 0;
+    data->station_next = 0;
+    data->tx_frames = 0;
+    data->tx_bytes = 0;
+    data->tx_dropped = 0;
+    data->rx_frames = 0;
+    data->rx_bytes = 0;
+    data->host_calls = 0;
+
+    dev_map(dev, addr, REGISTER_LIMIT);
+    dev_schedule(dev, data->coalesce, virtnet_tick);
+
+    return true;
+}
+
+/** Mac command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool virtnet_mac(token_t *parm, device_t *dev)
+{
+    virtnet_data_t *data = (virtnet_data_t *) dev->data;
+
+    if (parm_type(parm) == tt_end) {
+        printf("MAC address: %02x:%02x:%02x:%02x:%02x:%02x\n",
+                data->mac[0], data->mac[1], data->mac[2],
+                data->mac[3], data->mac[4], data->mac[5]);
+        return true;
+    }
+
+    const char *const str = parm_str(parm);
+    unsigned int bytes[MAC_SIZE];
+    char end;
+
+    if ((sscanf(str, "%2x:%2x:%2x:%2x:%2x:%2x%c", &bytes[0], &bytes[1],
+                 &bytes[2], &bytes[3], &bytes[4], &bytes[5], &end) != MAC_SIZE)
+            || (bytes[0] & 1)) {
+        error("Invalid MAC address (xx:xx:xx:xx:xx:xx of a station expected)");
+        return false;
+    }
+
+    for (unsigned int i = 0; i < MAC_SIZE; i++) {
+        data->mac[i] = bytes[i];
+    }
+
+    return true;
+}
+
+/** Coalesce command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool virtnet_coalesce(token_t *parm, device_t *dev)
+{
+    virtnet_data_t *data = (virtnet_data_t *) dev->data;
+
+    if (parm_type(parm) == tt_end) {
+        printf("Tick: %" PRIu64 " cycles\n", data->coalesce);
+        return true;
+    }
+
+    uint64_t coalesce = parm_uint(parm);
+
+    if (coalesce == 0) {
+        error("Tick must be at least one cycle");
+        return false;
+    }
+
+    data->coalesce = coalesce;
+
+    return true;
+}
+
+/** Udp command implementation
+ *
+ * Binds a non-blocking UDP socket to the local port (any port
+ * for zero), the peers of the switch are added by the peer command.
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool virtnet_udp(token_t *parm, device_t *dev)
+{
+#ifndef __WIN32__
+    virtnet_data_t *data = (virtnet_data_t *) dev->data;
+    uint64_t port = parm_uint(parm);
+
+    if (port > UINT16_MAX) {
+        error("Port number out of range");
+        return false;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd == -1) {
+        io_error("socket");
+        return false;
+    }
+
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if ((bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1)
+            || (getsockname(fd, (struct sockaddr *) &addr, &addr_len) == -1)
+            || (fcntl(fd, F_SETFL, O_NONBLOCK) == -1)) {
+        io_error("socket");
+        close(fd);
+        return false;
+    }
+
+    virtnet_detach(data);
+    data->backend = NET_UDP;
+    data->fd = fd;
+    data->port = ntohs(addr.sin_port);
+
+    return true;
+#else
+    error("UDP switch is not supported on this host");
+    return false;
+#endif
+}
+
+/** Peer command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool virtnet_peer(token_t *parm, device_t *dev)
+{
+#ifndef __WIN32__
+    virtnet_data_t *data = (virtnet_data_t *) dev->data;
+    const char *const host = parm_str_next(&parm);
+    uint64_t port = parm_uint(parm);
+
+    if (data->backend != NET_UDP) {
+        error("UDP switch not set up (use the udp command first)");
+        return false;
+    }
+
+    if ((port == 0) || (port > UINT16_MAX)) {
+        error("Port number out of range");
+        return false;
+    }
+
+    if (data->peer_count == NET_PEERS) {
+        error("Too many peers (at most %u)", NET_PEERS);
+        return false;
+    }
+
+    struct addrinfo hints;
+    struct addrinfo *res;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    int rc = getaddrinfo(host, NULL, &hints, &res);
+    if (rc != 0) {
+        error("Unknown host %s: %s", host, gai_strerror(rc));
+        return false;
+    }
+
+    struct sockaddr_in *peer = &data->peers[data->peer_count++];
+
+    memcpy(peer, res->ai_addr, sizeof(*peer));
+    peer->sin_port = htons(port);
+    freeaddrinfo(res);
+
+    return true;
+#else
+    error("UDP switch is not supported on this host");
+    return false;
+#endif
+}
+
+/** Tap command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool virtnet_tap(token_t *parm, device_t *dev)
+{
+#ifdef HAVE_LINUX_IF_TUN_H
+    virtnet_data_t *data = (virtnet_data_t *) dev->data;
+    const char *const name = parm_str(parm);
+
+    if (strlen(name) >= IFNAMSIZ) {
+        error("Interface name too long");
+        return false;
+    }
+
+    int fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
+    if (fd == -1) {
+        io_error("/dev/net/tun");
+        return false;
+    }
+
+    struct ifreq ifr;
+
+    memset(&ifr, 0, sizeof(ifr));
+    ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+    strcpy(ifr.ifr_name, name);
+
+    if (ioctl(fd, TUNSETIFF, &ifr) == -1) {
+        io_error(name);
+        close(fd);
+        return false;
+    }
+
+    virtnet_detach(data);
+    data->backend = NET_TAP;
+    data->fd = fd;
+    data->tap_name = safe_strdup(name);
+
+    return true;
+#else
+    error("TAP interfaces are not supported on this host");
+    return false;
+#endif
+}
+
+/** Detach command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True (always successful)
+ *
+ */
+static bool virtnet_detach_cmd(token_t *parm, device_t *dev)
+{
+    virtnet_data_t *data = (virtnet_data_t *) dev->data;
+
+    virtnet_detach(data);
+    return true;
+}
+
+/** Route command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True if successful
+ *
+ */
+static bool virtnet_route(token_t *parm, device_t *dev)
+{
+    virtnet_data_t *data = (virtnet_data_t *) dev->data;
+    return virtio_route(parm, &data->virtio);
+}
+
+/** Info command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True (always successful)
+ *
+ */
+static bool virtnet_info(token_t *parm, device_t *dev)
+{
+    virtnet_data_t *data = (virtnet_data_t *) dev->data;
+
+    printf("[address  ] [int] [status] [MAC address    ] [tick    ] [backend]\n"
+           "%#011" PRIx64 " %-5u %#8x %02x:%02x:%02x:%02x:%02x:%02x %-10" PRIu64 " ",
+            data->virtio.addr, data->virtio.intno, data->virtio.status,
+            data->mac[0], data->mac[1], data->mac[2],
+            data->mac[3], data->mac[4], data->mac[5], data->coalesce);
+
+    switch (data->backend) {
+    case NET_NONE:
+        printf("none\n");
+        break;
+    case NET_UDP:
+        printf("udp port %u, %u peers\n", data->port, data->peer_count);
+        break;
+    case NET_TAP:
+        printf("tap %s\n", data->tap_name);
+        break;
+    }
+
+    return true;
+}
+
+/** Stat command implementation
+ *
+ * @param parm Command-line parameters
+ * @param dev  Device instance structure
+ *
+ * @return True (always successful)
+ *
+ */
+static bool virtnet_stat(token_t *parm, device_t *dev)
+{
+    virtnet_data_t *data = (virtnet_data_t *) dev->data;
+
+    printf("[notifies          ] [interrupts        ] [host calls        ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n",
+            data->virtio.notifies, data->virtio.intrcount, data->host_calls);
+    printf("[frames out        ] [bytes out         ] [frames dropped    ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 " %20" PRIu64 "\n",
+            data->tx_frames, data->tx_bytes, data->tx_dropped);
+    printf("[frames in         ] [bytes in          ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 "\n",
+            data->rx_frames, data->rx_bytes);
+
+    return true;
+}
+
+/** Dispose dvirtnet
+ *
+ * @param dev Device pointer
+ *
+ */
+static void virtnet_done(device_t *dev)
+{
+    virtnet_data_t *data = (virtnet_data_t *) dev->data;
+
+    virtnet_detach(data);
+    safe_free(dev->data);
+}
+
+/** Read command implementation
+ *
+ * @param dev  Device pointer
+ * @param addr Address of the read operation
+ * @param val  Read (returned) value
+ *
+ */
+static void virtnet_read32(unsigned int procno, device_t *dev, ptr36_t addr,
+        uint32_t *val)
+{
+    ASSERT(dev != NULL);
+    ASSERT(val != NULL);
+
+    virtnet_data_t *data = (virtnet_data_t *) dev->data;
+    ptr36_t offset = addr - data->virtio.addr;
+
+    if ((offset & 3) != 0) {
+        return;
+    }
+
+    if (virtio_read32(&data->virtio, offset, val)) {
+        return;
+    }
+
+    switch (offset) {
+    case REGISTER_MAC_LO:
+        *val = data->mac[0] | (data->mac[1] << 8) | (data->mac[2] << 16)
+                | ((uint32_t) data->mac[3] << 24);
+        break;
+    case REGISTER_MAC_HI:
+        *val = data->mac[4] | (data->mac[5] << 8);
+        break;
+    default:
+        *val = 0;
+        break;
+    }
+}
+
+/** Write command implementation
+ *
+ * @param dev  Device pointer
+ * @param addr Address of the write operation
+ * @param val  Value to write
+ *
+ */
+static void virtnet_write32(unsigned int procno, device_t *dev, ptr36_t addr,
+        uint32_t val)
+{
+    ASSERT(dev != NULL);
+
+    virtnet_data_t *data = (virtnet_data_t *) dev->data;
+    virtio_write32(&data->virtio, addr - data->virtio.addr, val);
+}
+
+/** Save the device state into a checkpoint
+ *
+ * The backend and the stations learnt are not saved,
+ * the next tick is saved with the device events.
+ *
+ * @param dev  Device instance pointer
+ * @param ckpt Checkpoint being written
+ *
+ * @return True if successful
+ *
+ */
+static bool virtnet_save(device_t *dev, checkpoint_t *ckpt)
+{
+    virtnet_data_t *data = (virtnet_data_t *) dev->data;
+
+    return virtio_save(&data->virtio, ckpt)
+            && checkpoint_write_var(ckpt, data->mac)
+            && checkpoint_write_var(ckpt, data->coalesce)
+            && checkpoint_write_var(ckpt, data->tx_pending)
+            && checkpoint_write_var(ckpt, data->tx_frames)
+            && checkpoint_write_var(ckpt, data->tx_bytes)
+            && checkpoint_write_var(ckpt, data->tx_dropped)
+            && checkpoint_write_var(ckpt, data->rx_frames)
+            && checkpoint_write_var(ckpt, data->rx_bytes)
+            && checkpoint_write_var(ckpt, data->host_calls);
+}
+
+/** Load the device state from a checkpoint
+ *
+ * @param dev  Device instance pointer
+ * @param ckpt Checkpoint being read
+ *
+ * @return True if successful
+ *
+ */
+static bool virtnet_load(device_t *dev, checkpoint_t *ckpt)
+{
+    virtnet_data_t *data = (virtnet_data_t *) dev->data;
+
+    return virtio_load(&data->virtio, ckpt)
+            && checkpoint_read_var(ckpt, data->mac)
+            && checkpoint_read_var(ckpt, data->coalesce)
+            && checkpoint_read_var(ckpt, data->tx_pending)
+            && checkpoint_read_var(ckpt, data->tx_frames)
+            && checkpoint_read_var(ckpt, data->tx_bytes)
+            && checkpoint_read_var(ckpt, data->tx_dropped)
+            && checkpoint_read_var(ckpt, data->rx_frames)
+            && checkpoint_read_var(ckpt, data->rx_bytes)
+            && checkpoint_read_var(ckpt, data->host_calls);
+}
+
+/** Events scheduled by the device */
+static const dev_event_fnc_t virtnet_events[] = {
+    virtnet_tick,
+    NULL
+};
+
+/** Export the device counters to the statistics endpoint
+ *
+ */
+static void virtnet_stats(device_t *dev, statsrv_t *stats)
+{
+    virtnet_data_t *data = (virtnet_data_t *) dev->data;
+
+    statsrv_counter(stats, "net_tx_frames_total", "Network frames sent",
+            data->tx_frames);
+    statsrv_counter(stats, "net_tx_dropped_total", "Network frames dropped",
+            data->tx_dropped);
+    statsrv_counter(stats, "net_rx_frames_total", "Network frames received",
+            data->rx_frames);
+    statsrv_counter(stats, "net_host_calls_total",
+            "Host calls moving network frames", data->host_calls);
+}
+
+static cmd_t virtnet_cmds[] = {
+    { "init",
+            (fcmd_t) virtnet_init,
+            DEFAULT,
+            DEFAULT,
+            "Initialization",
+            "Initialization",
+            REQ STR "name/network device name" NEXT
+                    REQ INT "addr/register block address" NEXT
+                            REQ INT "intno/interrupt number within 0..6" END },
+    { "help",
+            (fcmd_t) dev_generic_help,
+            DEFAULT,
+            DEFAULT,
+            "Display help",
+            "Display help",
+            OPT STR "cmd/command name" END },
+    { "info",
+            (fcmd_t) virtnet_info,
+            DEFAULT,
+            DEFAULT,
+            "Configuration information",
+            "Configuration information",
+            NOCMD },
+    { "stat",
+            (fcmd_t) virtnet_stat,
+            DEFAULT,
+            DEFAULT,
+            "Statistics",
+            "Statistics",
+            NOCMD },
+    { "mac",
+            (fcmd_t) virtnet_mac,
+            DEFAULT,
+            DEFAULT,
+            "Print or set the MAC address",
+            "Without arguments prints the MAC address of the device (52:54:00:12:34:56 by default).",
+            OPT STR "mac/MAC address" END },
+    { "coalesce",
+            (fcmd_t) virtnet_coalesce,
+            DEFAULT,
+            DEFAULT,
+            "Print or set the cycles between the ticks",
+            "Without arguments prints the cycles between the ticks which move the frames (1000 by default). The frames of a tick are announced by a single interrupt.",
+            OPT INT "cycles/cycles between the ticks" END },
+    { "udp",
+            (fcmd_t) virtnet_udp,
+            DEFAULT,
+            DEFAULT,
+            "Connect to a UDP switch",
+            "Send and receive the frames as UDP datagrams from the local port (any port for 0). The frames go to the peers added by the peer command.",
+            REQ INT "port/local UDP port" END },
+    { "peer",
+            (fcmd_t) virtnet_peer,
+            DEFAULT,
+            DEFAULT,
+            "Add a peer of the UDP switch",
+            "Add a simulator (or another UDP endpoint) the frames are sent to. A frame addressed to a station learnt from the received frames goes only to its peer.",
+            REQ STR "host/peer host" NEXT
+                    REQ INT "port/peer UDP port" END },
+    { "tap",
+            (fcmd_t) virtnet_tap,
+            DEFAULT,
+            DEFAULT,
+            "Connect to a TAP interface",
+            "Send and receive the frames by a TAP interface of the host (Linux only).",
+            REQ STR "name/interface name" END },
+    { "detach",
+            (fcmd_t) virtnet_detach_cmd,
+            DEFAULT,
+            DEFAULT,
+            "Disconnect the backend",
+            "Disconnect the backend, the frames sent are dropped.",
+            NOCMD },
+    { "route",
+            (fcmd_t) virtnet_route,
+            DEFAULT,
+            DEFAULT,
+            "Print or set the interrupt routing",
+            "Without arguments prints where the device interrupt goes. With the name of a dplic device and a source number the interrupt is asserted as the source of the interrupt controller instead of the interrupt number of the first processor.",
+            OPT STR "plic/interrupt controller name" NEXT
+                    OPT INT "source/source number" END },
+    LAST_CMD
+};
+
+/** Dvirtnet object structure */
+device_type_t dvirtnet = {
+    /* The frames arrive from outside */
+    .nondet = true,
+
+    /* Type name and description */
+    .name = "dvirtnet",
+    .brief = "Virtio network device",
+    .full = "Network device with the virtio-mmio interface. The frames "
+            "are moved in batches by the ticks of the device into a TAP "
+            "interface or a UDP switch of simulators.",
+
+    /* Functions */
+    .done = virtnet_done,
+    .read32 = virtnet_read32,
+    .write32 = virtnet_write32,
+
+    /* Commands */
+    .cmds = virtnet_cmds,
+
+    /* Checkpoints */
+    .save = virtnet_save,
+    .load = virtnet_load,
+    .events = virtnet_events,
+    .stats = virtnet_stats
+};
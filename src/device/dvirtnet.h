@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Virtio network device
+ *
+ */
+
+#ifndef DVIRTNET_H_
+#define DVIRTNET_H_
+
+#include "device.h"
+
+extern device_type_t dvirtnet;
+
+#endif
@@ -13,6 +13,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,15 +21,39 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include "../../config.h"
 #include "../arch/mmap.h"
+#include "../assert.h"
+#include "../checkpoint.h"
 #include "../fault.h"
 #include "../parser.h"
 #include "../physmem.h"
 #include "../text.h"
 #include "../utils.h"
+#include "cpu/decode_cache.h"
 #include "device.h"
 #include "mem.h"
 
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+/** Areas at least this large are hinted to be backed by host huge pages */
+#define HUGE_PAGE_HINT_SIZE (UINT64_C(2) << 20)
+
+/** Size of the file repeatedly mapped over a memory area filled with a value */
+#define FILL_PATTERN_SIZE (UINT64_C(2) << 20)
+
+/** Bytes of a memory area initialized by a host thread at once */
+#define INIT_SPLIT_SIZE (UINT64_C(64) << 20)
+
+/** Suffix of the shared memory object describing a shared area */
+#define SHM_SIDECAR_SUFFIX ".map"
+
 /*
  * String constants
  */
@@ -36,24 +61,411 @@
 const char *txt_mem_type[] = {
     "none",
     "mem",
-    "fmap"
+    "fmap",
+    "cow"
 };
 
+/** Memory range filled by the host threads */
+typedef struct {
+    uint8_t *ptr;
+    uint8_t value;
+} mem_set_job_t;
+
+static void mem_set_range(void *arg, size_t first, size_t last)
+{
+    mem_set_job_t *job = (mem_set_job_t *) arg;
+
+    memset(job->ptr + first, job->value, last - first);
+}
+
+/** Fill a memory range with a value on the host threads
+ *
+ * Large ranges are split among the host threads, so that touching
+ * the host pages of huge areas scales with the host cores. The pages
+ * follow the host placement of the area, which is set before the
+ * first touch (see mem_place_backing()).
+ *
+ */
+static void mem_set_split(uint8_t *ptr, uint8_t value, size_t size)
+{
+    mem_set_job_t job = {
+        .ptr = ptr,
+        .value = value
+    };
+
+    split_run(size, INIT_SPLIT_SIZE, mem_set_range, &job);
+}
+
+/** Allocate zeroed backing storage for a generic memory area
+ *
+ * Host pages are only committed when the guest first touches them,
+ * so configured memory that is never used costs no host memory.
+ *
+ * @return Pointer to the storage or NULL on failure.
+ *
+ */
+static uint8_t *mem_alloc_backing(size_t size)
+{
+#ifdef MAP_ANONYMOUS
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (ptr == MAP_FAILED) {
+        io_error(NULL);
+        return NULL;
+    }
+
+#ifdef MADV_HUGEPAGE
+    if (size >= HUGE_PAGE_HINT_SIZE) {
+        /* Only a hint, failure is harmless */
+        (void) madvise(ptr, size, MADV_HUGEPAGE);
+    }
+#endif
+
+    return (uint8_t *) ptr;
+#else
+    uint8_t *ptr = safe_malloc(size);
+    mem_set_split(ptr, 0, size);
+    return ptr;
+#endif
+}
+
+/** Release the backing storage of a generic memory area
+ *
+ */
+static void mem_free_backing(uint8_t *ptr, size_t size)
+{
+#ifdef MAP_ANONYMOUS
+    try_munmap(ptr, size);
+#else
+    safe_free(ptr);
+#endif
+}
+
+/** Size of the host pages */
+static uintptr_t host_page_size(void)
+{
+#ifdef _SC_PAGESIZE
+    long size = sysconf(_SC_PAGESIZE);
+
+    if (size > 0) {
+        return (uintptr_t) size;
+    }
+#endif
+
+    return FRAME_SIZE;
+}
+
+/** Apply the host placement of a memory area to a range of its storage
+ *
+ * The range starts on a host page boundary. Only a hint once the area
+ * is set up, the placement is checked by the numa command.
+ *
+ * @param move Move the pages already touched as well.
+ *
+ */
+static bool mem_place_backing(const physmem_area_t *area, void *ptr,
+        size_t size, bool move)
+{
+    if (area->placement == HOST_MEM_LOCAL) {
+        return true;
+    }
+
+    return host_mem_place(ptr, size, area->placement, area->node, move);
+}
+
+/** Reset the backing storage of a generic memory area to zeros
+ *
+ * Whole anonymous pages are replaced by fresh ones instead of being
+ * overwritten, they read as zeros when touched again. This also drops
+ * the pages mapped from a file by mem_map_segment(). The fresh pages
+ * keep the host placement of the area. The whole pages of a shared
+ * area are freed in the shared memory object instead.
+ *
+ */
+static void mem_zero_backing(const physmem_area_t *area, uint8_t *ptr, size_t size)
+{
+#if defined(MAP_ANONYMOUS) && defined(MAP_FIXED)
+    uintptr_t page = host_page_size();
+    uintptr_t first = ALIGN_UP((uintptr_t) ptr, page);
+    uintptr_t last = ALIGN_DOWN((uintptr_t) ptr + size, page);
+
+#ifdef MADV_REMOVE
+    if ((area->shm_name != NULL) && (first < last)
+            && (madvise((void *) first, last - first, MADV_REMOVE) == 0)) {
+        memset(ptr, 0, first - (uintptr_t) ptr);
+        memset((uint8_t *) last, 0, (uintptr_t) ptr + size - last);
+        return;
+    }
+#endif
+
+    if ((area->shm_name == NULL) && (first < last) && (mmap((void *) first, last - first,
+                                   PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+                                   -1, 0)
+                                  != MAP_FAILED)) {
+#ifdef MADV_HUGEPAGE
+        if (last - first >= HUGE_PAGE_HINT_SIZE) {
+            /* Only a hint, failure is harmless */
+            (void) madvise((void *) first, last - first, MADV_HUGEPAGE);
+        }
+#endif
+
+        mem_place_backing(area, (void *) first, last - first, false);
+        memset(ptr, 0, first - (uintptr_t) ptr);
+        memset((uint8_t *) last, 0, (uintptr_t) ptr + size - last);
+        return;
+    }
+#endif
+
+    mem_set_split(ptr, 0, size);
+}
+
+/** Fill the backing storage of a generic memory area with a value
+ *
+ * Whole host pages are replaced by private mappings of a temporary
+ * file holding the value, so all the filled pages share the page
+ * cache of the file until the guest writes to them and only the
+ * pages written to take private host memory (as the zeroed pages
+ * of mem_zero_backing() do). A shared area is simply overwritten.
+ *
+ */
+static void mem_fill_backing(const physmem_area_t *area, uint8_t *ptr,
+        size_t size, uint8_t value)
+{
+#if defined(MAP_ANONYMOUS) && defined(MAP_FIXED)
+    uintptr_t page = host_page_size();
+    uintptr_t first = ALIGN_UP((uintptr_t) ptr, page);
+    uintptr_t last = ALIGN_DOWN((uintptr_t) ptr + size, page);
+    size_t pattern_size = (size_t) ALIGN_UP(FILL_PATTERN_SIZE, page);
+
+    FILE *pattern = (((area->shm_name == NULL) && (first < last)) ? tmpfile() : NULL);
+
+    if (pattern != NULL) {
+        uint8_t *buf = safe_malloc(pattern_size);
+        memset(buf, value, pattern_size);
+
+        bool ok = (fwrite(buf, 1, pattern_size, pattern) == pattern_size)
+                && (fflush(pattern) == 0);
+        safe_free(buf);
+
+        for (uintptr_t pos = first; (ok) && (pos < last); pos += pattern_size) {
+            size_t len = ((last - pos) < pattern_size) ? last - pos : pattern_size;
+
+            ok = (mmap((void *) pos, len, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_NORESERVE | MAP_FIXED,
+                          fileno(pattern), 0)
+                    != MAP_FAILED);
+        }
+
+        /* The mappings keep the file */
+        fclose(pattern);
+
+        if (ok) {
+            mem_place_backing(area, (void *) first, last - first, false);
+            memset(ptr, value, first - (uintptr_t) ptr);
+            memset((uint8_t *) last, value, (uintptr_t) ptr + size - last);
+            return;
+        }
+    }
+#endif
+
+    mem_set_split(ptr, value, size);
+}
+
+/** Map a segment of a file into a generic memory area
+ *
+ * The whole host pages of the segment are mapped privately from the file
+ * (if the file offset and the address agree on the position within the
+ * host page), so only the pages touched by the guest are read and the
+ * guest writes never reach the file. The segments of a shared area and
+ * the partial pages are copied from the file contents and the part of
+ * the segment not present in the file (e.g. .bss) is zeroed as by
+ * mem_zero_backing().
+ *
+ * @param area   Generic memory area containing the segment.
+ * @param addr   Physical address of the segment.
+ * @param fd     Descriptor of the file.
+ * @param image  File contents (mapped read-only).
+ * @param offset Offset of the segment in the file.
+ * @param filesz Size of the segment in the file.
+ * @param memsz  Size of the segment in the memory.
+ * @param path   File name for the error messages.
+ *
+ * @return True if successful.
+ *
+ */
+bool mem_map_segment(physmem_area_t *area, ptr36_t addr, int fd,
+        const uint8_t *image, uint64_t offset, size_t filesz, size_t memsz,
+        const char *path)
+{
+    ASSERT(area != NULL);
+    ASSERT(area->type == MEMT_MEM);
+    ASSERT(filesz <= memsz);
+    ASSERT(addr >= FRAME2ADDR(area->start));
+    ASSERT(addr + memsz <= FRAME2ADDR(area->start + area->count));
+
+    uint8_t *dst = area->data + (addr - FRAME2ADDR(area->start));
+    size_t copied = 0;
+
+#if defined(MAP_ANONYMOUS) && defined(MAP_FIXED)
+    uintptr_t page = host_page_size();
+    uintptr_t first = ALIGN_UP((uintptr_t) dst, page);
+    uintptr_t last = ALIGN_DOWN((uintptr_t) dst + filesz, page);
+
+    if ((area->shm_name == NULL) && (first < last)
+            && (((uintptr_t) dst - offset) % page == 0)) {
+        size_t head = first - (uintptr_t) dst;
+        void *ptr = mmap((void *) first, last - first, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_FIXED, fd, offset + head);
+
+        if (ptr == MAP_FAILED) {
+            io_error(path);
+            error("%s", txt_file_map_fail);
+            return false;
+        }
+
+        mem_place_backing(area, ptr, last - first, false);
+        memcpy(dst, image + offset, head);
+        copied = last - (uintptr_t) dst;
+    }
+#endif
+
+    memcpy(dst + copied, image + offset + copied, filesz - copied);
+    mem_zero_backing(area, dst + filesz, memsz - filesz);
+
+    physmem_area_modified(area);
+    return true;
+}
+
+/** Discard a range of a generic memory area
+ *
+ * The guest does not need the contents of the range any more, its host
+ * pages are returned to the host and the range reads as zeros (as after
+ * mem_zero_backing()). The decoded instructions of the range are dropped
+ * and the reservations inside it are broken as by a write.
+ *
+ * @param area Generic memory area containing the range.
+ * @param addr Physical address of the range (frame aligned).
+ * @param size Size of the range (frame aligned).
+ *
+ */
+void mem_discard(physmem_area_t *area, ptr36_t addr, len36_t size)
+{
+    ASSERT(area != NULL);
+    ASSERT(area->type == MEMT_MEM);
+    ASSERT(addr >= FRAME2ADDR(area->start));
+    ASSERT(addr + size <= FRAME2ADDR(area->start + area->count));
+
+    physmem_range_modified(addr, size);
+    mem_zero_backing(area, area->data + (addr - FRAME2ADDR(area->start)), size);
+}
+
+#ifdef HAVE_SHM_OPEN
+
+/** Name of the shared memory object describing a shared area */
+static char *mem_shm_sidecar(const char *name)
+{
+    string_t sidecar;
+    string_init(&sidecar);
+    string_printf(&sidecar, "%s%s", name, SHM_SIDECAR_SUFFIX);
+
+    char *result = safe_strdup(sidecar.str);
+    string_done(&sidecar);
+
+    return result;
+}
+
+/** Describe a shared area for the external tools
+ *
+ * The description is a text shared memory object named as the area
+ * with the .map suffix, it tells the physical addresses of the area
+ * (e.g. /dev/shm/NAME.map on Linux).
+ *
+ */
+static bool mem_shm_describe(const physmem_area_t *area, const device_t *dev)
+{
+    char *sidecar = mem_shm_sidecar(area->shm_name);
+    int fd = shm_open(sidecar, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0) {
+        io_error(sidecar);
+        safe_free(sidecar);
+        return false;
+    }
+
+    string_t text;
+    string_init(&text);
+    string_printf(&text,
+            "object %s\n"
+            "device %s\n"
+            "start 0x%09" PRIx64 "\n"
+            "size %" PRIu64 "\n"
+            "writable %s\n"
+            "pid %ld\n",
+            area->shm_name, dev->name, FRAME2ADDR(area->start),
+            (uint64_t) FRAMES2SIZE(area->count),
+            area->writable ? "yes" : "no", (long) getpid());
+
+    bool ok = (write(fd, text.str, text.pos) == (ssize_t) text.pos);
+    close(fd);
+
+    if (!ok) {
+        io_error(sidecar);
+    }
+
+    string_done(&text);
+    safe_free(sidecar);
+    return ok;
+}
+
+/** Remove the shared memory object of an area and its description
+ *
+ * The external tools which have mapped the area keep their mappings.
+ *
+ */
+static void mem_shm_unlink(const char *name)
+{
+    char *sidecar = mem_shm_sidecar(name);
+    shm_unlink(name);
+    shm_unlink(sidecar);
+    safe_free(sidecar);
+}
+
+#else
+
+static void mem_shm_unlink(const char *name)
+{
+}
+
+#endif
+
 /** Cleanup the memory
  *
  */
 static void physmem_cleanup(physmem_area_t *area)
 {
+    physmem_reset_drop(area);
+
     switch (area->type) {
     case MEMT_NONE:
         /* Nothing to do */
         break;
     case MEMT_MEM:
         physmem_unwire(area);
-        safe_free(area->data);
+
+        if (area->shm_name != NULL) {
+            try_munmap(area->data, FRAMES2SIZE(area->count));
+            mem_shm_unlink(area->shm_name);
+            safe_free(area->shm_name);
+        } else {
+            mem_free_backing(area->data, FRAMES2SIZE(area->count));
+        }
+
         // safe_free(area->trans);
         break;
     case MEMT_FMAP:
+    case MEMT_FMAP_COW:
         physmem_unwire(area);
         try_munmap(area->data, FRAMES2SIZE(area->count));
         // safe_free(area->trans);
@@ -94,10 +506,20 @@ static bool mem_init(token_t *parm, device_t *dev)
     physmem_area_t *area = safe_malloc_t(physmem_area_t);
 
     area->type = MEMT_NONE;
-    area->writable = (strcmp(dev->type->name, "rwm") == 0);
+    area->writable = (dev->type == &drwm);
     area->start = ADDR2FRAME(start);
     area->count = 0;
     area->data = NULL;
+    area->frames = NULL;
+    area->read_bytes = 0;
+    area->write_bytes = 0;
+    area->placement = HOST_MEM_LOCAL;
+    area->node = 0;
+    area->shm_name = NULL;
+    area->reset_tracked = false;
+    area->reset_copies = NULL;
+    area->track_writes = false;
+    area->written = NULL;
     // area->trans = NULL;
 
     dev->data = area;
@@ -118,14 +540,118 @@ static bool mem_info(token_t *parm, device_t *dev)
             FRAME2ADDR(area->start), size,
             txt_mem_type[area->type]);
 
+    if (area->shm_name != NULL) {
+        printf("Shared memory object %s\n", area->shm_name);
+    }
+
     safe_free(size);
 
     return true;
 }
 
+/** Stat command implementation
+ *
+ * The accessed bytes are counted only while the mixstat
+ * variable is set.
+ *
+ */
+static bool mem_stat(token_t *parm, device_t *dev)
+{
+    physmem_area_t *area = (physmem_area_t *) dev->data;
+
+    printf("[Bytes read        ] [Bytes written     ]\n");
+    printf("%20" PRIu64 " %20" PRIu64 "\n",
+            area->read_bytes, area->write_bytes);
+
+    return true;
+}
+
+#ifndef __WIN32__
+
+/** File read into a memory block by the host threads */
+typedef struct {
+    int fd;
+    uint8_t *data;
+    int err; /**< Error of a failed read (0 if all succeeded) */
+} mem_read_job_t;
+
+static void mem_read_range(void *arg, size_t first, size_t last)
+{
+    mem_read_job_t *job = (mem_read_job_t *) arg;
+
+    while (first < last) {
+        ssize_t rd = pread(job->fd, job->data + first, last - first, first);
+
+        if (rd <= 0) {
+            __atomic_store_n(&job->err, (rd < 0) ? errno : EIO, __ATOMIC_RELAXED);
+            return;
+        }
+
+        first += rd;
+    }
+}
+
+#endif
+
+/** Read a file to the memory block
+ *
+ * Large files are read by the ranges on the host threads, so that
+ * touching the host pages of huge areas scales with the host cores.
+ *
+ * @return True if the whole file has been read (errno set otherwise).
+ *
+ */
+static bool mem_read_split(FILE *file, uint8_t *data, size_t size)
+{
+#ifdef __WIN32__
+    return fread(data, 1, size, file) == size;
+#else
+    mem_read_job_t job = {
+        .fd = fileno(file),
+        .data = data,
+        .err = 0
+    };
+
+    split_run(size, INIT_SPLIT_SIZE, mem_read_range, &job);
+
+    if (job.err != 0) {
+        errno = job.err;
+        return false;
+    }
+
+    return true;
+#endif
+}
+
+/** Load a gzip-compressed file to the memory block
+ *
+ * The file is decompressed straight into the memory block.
+ *
+ */
+static bool mem_load_gzip(physmem_area_t *area, const char *path)
+{
+    size_t len;
+    bool ok = try_gzload(path, area->data, FRAMES2SIZE(area->count), &len,
+            "File size exceeds memory area size");
+    physmem_area_modified(area);
+
+    if (!ok) {
+        return false;
+    }
+
+    if (len == 0) {
+        error("Empty file");
+        return false;
+    }
+
+    decode_cache_predecode(FRAME2ADDR(area->start), len);
+    return true;
+}
+
 /** Load command implementation
  *
  * Load the contents of the file specified to the memory block.
+ * Files compressed by gzip are decompressed.
  *
  */
 static bool mem_load(token_t *parm, device_t *dev)
@@ -148,6 +674,11 @@ static bool mem_load(token_t *parm, device_t *dev)
         return false;
     }
 
+    if (fgzipped(file)) {
+        safe_fclose(file, path);
+        return mem_load_gzip(area, path);
+    }
+
     /* File size test */
     if (!try_fseek(file, 0, SEEK_END, path)) {
         return false;
@@ -174,9 +705,10 @@ static bool mem_load(token_t *parm, device_t *dev)
         return false;
     }
 
-    // FIXME: invalidate binary translation
-    size_t rd = fread(area->data, 1, fsize, file);
-    if (rd != fsize) {
+    bool ok = mem_read_split(file, area->data, fsize);
+    physmem_area_modified(area);
+
+    if (!ok) {
         io_error(path);
         safe_fclose(file, path);
         error("%s", txt_file_read_err);
@@ -184,6 +716,7 @@ static bool mem_load(token_t *parm, device_t *dev)
     }
 
     safe_fclose(file, path);
+    decode_cache_predecode(FRAME2ADDR(area->start), fsize);
     return true;
 }
 
@@ -225,29 +758,50 @@ static bool mem_fill(token_t *parm, device_t *dev)
         return false;
     }
 
-    // FIXME: invalidate binary translation
-    memset(area->data, c, FRAMES2SIZE(area->count));
+    if ((c == 0) && (area->type == MEMT_MEM)) {
+        mem_zero_backing(area, area->data, FRAMES2SIZE(area->count));
+    } else if (area->type == MEMT_MEM) {
+        mem_fill_backing(area, area->data, FRAMES2SIZE(area->count), (uint8_t) c);
+    } else {
+        mem_set_split(area->data, (uint8_t) c, FRAMES2SIZE(area->count));
+    }
+
+    physmem_area_modified(area);
     return true;
 }
 
 /** Fmap command implementation
  *
- * Map memory to a file.
+ * Map memory to a file. In the copy-on-write mode the guest writes
+ * go to private copies of the touched pages and the file is never
+ * modified, so several instances can share the same image.
  *
  */
 static bool mem_fmap(token_t *parm, device_t *dev)
 {
     physmem_area_t *area = (physmem_area_t *) dev->data;
-    const char *const path = parm_str(parm);
+    const char *const path = parm_str_next(&parm);
+    bool cow = false;
     FILE *file;
 
+    if (parm_type(parm) != tt_end) {
+        const char *const mode = parm_str(parm);
+
+        if (strcmp(mode, "cow") != 0) {
+            error("Unknown mapping mode <%s> (use cow)", mode);
+            return false;
+        }
+
+        cow = true;
+    }
+
     if (area->type != MEMT_NONE) {
         error("Physical memory area already established");
         return false;
     }
 
     /* Open the file */
-    if (area->writable) {
+    if ((area->writable) && (!cow)) {
         file = try_fopen(path, "rb+");
     } else {
         file = try_fopen(path, "rb");
@@ -310,7 +864,9 @@ static bool mem_fmap(token_t *parm, device_t *dev)
     void *ptr;
 
     /* File mapping */
-    if (area->writable) {
+    if (cow) {
+        ptr = mmap(0, fsize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    } else if (area->writable) {
         ptr = mmap(0, fsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
     } else {
         ptr = mmap(0, fsize, PROT_READ, MAP_SHARED, fd, 0);
@@ -327,7 +883,7 @@ static bool mem_fmap(token_t *parm, device_t *dev)
     safe_fclose(file, path);
 
     /* Update structures */
-    area->type = MEMT_FMAP;
+    area->type = cow ? MEMT_FMAP_COW : MEMT_FMAP;
     area->count = SIZE2FRAMES(size);
     area->data = (uint8_t *) ptr;
     // area->trans = safe_malloc(sizeof(r4k_instr_fnc_t) * SIZE2INSTRS(size));
@@ -336,16 +892,16 @@ static bool mem_fmap(token_t *parm, device_t *dev)
     return true;
 }
 
-/** Generic command implementation
+/** Check the size of a generic memory area being established
  *
- * Generic command makes memory device a standard memory.
+ * @param host_size Size of the host storage.
+ *
+ * @return True if the size is valid.
  *
  */
-static bool mem_generic(token_t *parm, device_t *dev)
+static bool mem_generic_size(const physmem_area_t *area, uint64_t _size,
+        size_t *host_size)
 {
-    physmem_area_t *area = (physmem_area_t *) dev->data;
-    uint64_t _size = parm_uint(parm);
-
     if (area->type != MEMT_NONE) {
         error("Physical memory area already established");
         return false;
@@ -375,27 +931,195 @@ static bool mem_generic(token_t *parm, device_t *dev)
         return false;
     }
 
-    size_t host_size = (size_t) size;
+    *host_size = (size_t) size;
 
-    if (host_size != size) {
+    if (*host_size != size) {
         error("Incompatible host and guest address space sizes");
         return false;
     }
 
+    return true;
+}
+
+/** Generic command implementation
+ *
+ * Generic command makes memory device a standard memory.
+ *
+ */
+static bool mem_generic(token_t *parm, device_t *dev)
+{
+    physmem_area_t *area = (physmem_area_t *) dev->data;
+    size_t host_size;
+
+    if (!mem_generic_size(area, parm_uint(parm), &host_size)) {
+        return false;
+    }
+
+    uint8_t *data = mem_alloc_backing(host_size);
+    if (data == NULL) {
+        error("Unable to allocate physical memory area");
+        return false;
+    }
+
+    if (!mem_place_backing(area, data, host_size, false)) {
+        alert("Unable to place the memory on the host nodes: %s", strerror(errno));
+    }
+
     area->type = MEMT_MEM;
-    area->count = SIZE2FRAMES(size);
-    area->data = safe_malloc(host_size);
-    // Set whole memory to 0
-    memset(area->data, 0, host_size);
+    area->count = SIZE2FRAMES(host_size);
+    area->data = data;
     // area->trans = safe_malloc(sizeof(r4k_instr_fnc_t) * SIZE2INSTRS(host_size));
     physmem_wire(area);
 
     return true;
 }
 
+/** Shared command implementation
+ *
+ * Makes the memory device a generic memory backed by a POSIX shared
+ * memory object, so that the external tools can map the memory
+ * (read-only) and inspect it while the simulation runs. An object of
+ * the same name left behind is emptied. The object and its
+ * description are removed with the memory.
+ *
+ */
+static bool mem_shared(token_t *parm, device_t *dev)
+{
+    physmem_area_t *area = (physmem_area_t *) dev->data;
+    const char *const name = parm_str_next(&parm);
+    size_t host_size;
+
+    if (!mem_generic_size(area, parm_uint(parm), &host_size)) {
+        return false;
+    }
+
+    if ((name[0] != '/') || (name[1] == 0) || (strchr(name + 1, '/') != NULL)) {
+        error("Shared memory object name has to start with a slash and "
+              "contain no other slash");
+        return false;
+    }
+
+#ifdef HAVE_SHM_OPEN
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        io_error(name);
+        return false;
+    }
+
+    if ((ftruncate(fd, 0) != 0) || (ftruncate(fd, host_size) != 0)) {
+        io_error(name);
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+
+    void *ptr = mmap(NULL, host_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (ptr == MAP_FAILED) {
+        io_error(name);
+        shm_unlink(name);
+        error("Unable to allocate physical memory area");
+        return false;
+    }
+
+    if (!mem_place_backing(area, ptr, host_size, false)) {
+        alert("Unable to place the memory on the host nodes: %s", strerror(errno));
+    }
+
+    area->type = MEMT_MEM;
+    area->count = SIZE2FRAMES(host_size);
+    area->data = (uint8_t *) ptr;
+    area->shm_name = safe_strdup(name);
+
+    if (!mem_shm_describe(area, dev)) {
+        alert("Unable to describe the shared memory %s", name);
+    }
+
+    physmem_wire(area);
+    return true;
+#else
+    error("Shared memory is not supported on this host");
+    return false;
+#endif
+}
+
+/** Names of the host placements */
+static const char *const mem_placement_names[] = {
+    "local",
+    "node",
+    "interleave"
+};
+
+/** Numa command implementation
+ *
+ * Places the host pages of a generic memory on the host NUMA nodes,
+ * the pages already touched are moved. The placement given before
+ * the memory type is applied once the memory is generic.
+ *
+ */
+static bool mem_numa(token_t *parm, device_t *dev)
+{
+    physmem_area_t *area = (physmem_area_t *) dev->data;
+
+    if (parm_type(parm) == tt_end) {
+        if (area->placement == HOST_MEM_BIND) {
+            printf("Host placement: node %u\n", area->node);
+        } else {
+            printf("Host placement: %s\n", mem_placement_names[area->placement]);
+        }
+
+        return true;
+    }
+
+    if ((area->type != MEMT_NONE) && (area->type != MEMT_MEM)) {
+        error("Only the generic memory can be placed");
+        return false;
+    }
+
+    const char *name = parm_str_next(&parm);
+    host_mem_policy_t placement;
+    unsigned int node = 0;
+
+    if (strcmp(name, "local") == 0) {
+        placement = HOST_MEM_LOCAL;
+    } else if (strcmp(name, "interleave") == 0) {
+        placement = HOST_MEM_INTERLEAVE;
+    } else if (strcmp(name, "node") == 0) {
+        if (parm_type(parm) != tt_uint) {
+            error("Missing host node number");
+            return false;
+        }
+
+        uint64_t _node = parm_uint(parm);
+
+        if ((_node > UINT_MAX) || (!host_node_allowed((unsigned int) _node))) {
+            error("Host node %" PRIu64 " not available", _node);
+            return false;
+        }
+
+        placement = HOST_MEM_BIND;
+        node = (unsigned int) _node;
+    } else {
+        error("Unknown placement <%s> (use local, node or interleave)", name);
+        return false;
+    }
+
+    if ((area->type == MEMT_MEM)
+            && (!host_mem_place(area->data, FRAMES2SIZE(area->count), placement, node, true))) {
+        error("Unable to place the memory on the host nodes: %s", strerror(errno));
+        return false;
+    }
+
+    area->placement = placement;
+    area->node = node;
+    return true;
+}
+
 /** Save command implementation
  *
- * Save the content of the memory to the file specified.
+ * Save the content of the memory to the file specified. The blocks
+ * of zeros are left as holes of a sparse file.
  *
  */
 static bool mem_save(token_t *parm, device_t *dev)
@@ -422,8 +1146,7 @@ static bool mem_save(token_t *parm, device_t *dev)
         return false;
     }
 
-    size_t wr = fwrite(area->data, 1, host_size, file);
-    if (wr != host_size) {
+    if (!fwrite_sparse(file, area->data, host_size)) {
         io_error(path);
         safe_fclose(file, path);
         error("%s", txt_file_write_err);
@@ -434,6 +1157,107 @@ static bool mem_save(token_t *parm, device_t *dev)
     return true;
 }
 
+/** Save the memory contents into a checkpoint
+ *
+ * The contents of read-only memories are given by the configuration,
+ * so only their size is stored. An incremental checkpoint stores
+ * only the frames written to since the last checkpoint. The reset
+ * point stores no contents at all, the frames written to afterwards
+ * are saved by the physical memory (see physmem_reset_mark).
+ *
+ */
+static bool mem_checkpoint_save(device_t *dev, checkpoint_t *ckpt)
+{
+    physmem_area_t *area = (physmem_area_t *) dev->data;
+
+    if (!checkpoint_write_uint64(ckpt, area->count)) {
+        return false;
+    }
+
+    if ((area->type == MEMT_NONE) || (!area->writable)) {
+        return true;
+    }
+
+    if (ckpt->reset) {
+        physmem_reset_mark(area);
+        return true;
+    }
+
+    bool ok;
+    if (ckpt->incremental) {
+        ok = checkpoint_write_frames(ckpt, area);
+    } else {
+        ok = checkpoint_write_pages(ckpt, area->data, FRAMES2SIZE(area->count));
+    }
+
+    if (ok) {
+        physmem_area_clean(area);
+    }
+
+    return ok;
+}
+
+/** Load the memory contents from a checkpoint
+ *
+ * The frames are wired again, so the decoded instructions and
+ * the cached translations of the old contents are dropped. The frames
+ * of an incremental checkpoint are read over the contents restored
+ * from its base. A reset copies back only the frames written to
+ * since the reset point, the other frames keep their decodes.
+ *
+ */
+static bool mem_checkpoint_load(device_t *dev, checkpoint_t *ckpt)
+{
+    physmem_area_t *area = (physmem_area_t *) dev->data;
+    uint64_t count;
+
+    if ((!checkpoint_read_uint64(ckpt, &count)) || (count != area->count)) {
+        return false;
+    }
+
+    if ((area->type == MEMT_NONE) || (!area->writable)) {
+        return true;
+    }
+
+    if (ckpt->reset) {
+        physmem_reset_restore(area);
+        return true;
+    }
+
+    size_t size = FRAMES2SIZE(area->count);
+
+    physmem_unwire(area);
+
+    if (!ckpt->incremental) {
+        if (area->type == MEMT_MEM) {
+            mem_zero_backing(area, area->data, size);
+        } else {
+            mem_set_split(area->data, 0, size);
+        }
+    }
+
+    bool ok = checkpoint_read_pages(ckpt, area->data, size);
+
+    physmem_wire(area);
+    physmem_area_clean(area);
+    return ok;
+}
+
+/** Prepare the memory contents to be saved by a forked process
+ *
+ * A writable memory mapped to a file (or to a shared memory object)
+ * is shared with the file, so its contents would change under the
+ * forked process.
+ *
+ */
+static bool mem_prefork(device_t *dev)
+{
+    physmem_area_t *area = (physmem_area_t *) dev->data;
+
+    return ((area->type != MEMT_FMAP) && (area->shm_name == NULL))
+            || (!area->writable);
+}
+
 /** Dispose memory device - structures, memory blocks, unmap, etc.
  *
  */
@@ -470,6 +1294,13 @@ cmd_t dmem_cmds[] = {
             "Configuration information",
             "Configuration information",
             NOCMD },
+    { "stat",
+            (fcmd_t) mem_stat,
+            DEFAULT,
+            DEFAULT,
+            "Statistics",
+            "Bytes read and written by the processors",
+            NOCMD },
     { "generic",
             (fcmd_t) mem_generic,
             DEFAULT,
@@ -482,8 +1313,17 @@ cmd_t dmem_cmds[] = {
             DEFAULT,
             DEFAULT,
             "Map the memory into the file.",
-            "Map the memory into the file.",
-            REQ STR "File name" END },
+            "Map the memory into the file. With the cow mode the writes are kept private and the file is not modified.",
+            REQ STR "File name" NEXT
+                    OPT STR "mode/cow" END },
+    { "shared",
+            (fcmd_t) mem_shared,
+            DEFAULT,
+            DEFAULT,
+            "Generic memory shared with other processes",
+            "Generic memory backed by a POSIX shared memory object, which other processes can map to inspect the memory while the simulation runs. The object NAME.map describes the physical addresses of the memory. Both objects are removed with the memory.",
+            REQ STR "name/shared memory object name" NEXT
+                    REQ INT "size" END },
     { "fill",
             (fcmd_t) mem_fill,
             DEFAULT,
@@ -498,6 +1338,14 @@ cmd_t dmem_cmds[] = {
             "Load the file into the memory",
             "Load the file into the memory",
             REQ STR "File name" END },
+    { "numa",
+            (fcmd_t) mem_numa,
+            DEFAULT,
+            DEFAULT,
+            "Place the memory on the host NUMA nodes",
+            "Without arguments prints the placement of the host pages of the memory. Otherwise the pages of a generic memory are taken from the node of the host core touching them first (local, the default), from a single host node or interleaved over all host nodes (only on Linux hosts). The pages already touched are moved.",
+            OPT STR "placement/local, node or interleave" NEXT
+                    OPT INT "node/host node number" END },
     { "save",
             (fcmd_t) mem_save,
             DEFAULT,
@@ -521,7 +1369,12 @@ device_type_t drom = {
     .done = mem_done,
 
     /* Commands */
-    .cmds = dmem_cmds
+    .cmds = dmem_cmds,
+
+    /* Checkpoints */
+    .save = mem_checkpoint_save,
+    .load = mem_checkpoint_load,
+    .prefork = mem_prefork
 };
 
 device_type_t drwm = {
@@ -537,5 +1390,10 @@ device_type_t drwm = {
     .done = mem_done,
 
     /* Commands */
-    .cmds = dmem_cmds
+    .cmds = dmem_cmds,
+
+    /* Checkpoints */
+    .save = mem_checkpoint_save,
+    .load = mem_checkpoint_load,
+    .prefork = mem_prefork
 };
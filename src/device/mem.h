@@ -12,9 +12,19 @@
 #ifndef MEM_H_
 #define MEM_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../main.h"
+#include "../physmem.h"
 #include "device.h"
 
 extern device_type_t drom;
 extern device_type_t drwm;
 
+extern bool mem_map_segment(physmem_area_t *area, ptr36_t addr, int fd,
+        const uint8_t *image, uint64_t offset, size_t filesz, size_t memsz,
+        const char *path);
+extern void mem_discard(physmem_area_t *area, ptr36_t addr, len36_t size);
+
 #endif
@@ -0,0 +1,703 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Virtio-mmio transport of the virtio devices
+ *
+ *  The register interface (version 2) and the split virtqueues
+ *  shared by the virtio devices. A device keeps the virtio_t
+ *  structure in its instance data, passes the register accesses
+ *  below the configuration space to it and processes the queues
+ *  when notified.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "../assert.h"
+#include "../physmem.h"
+#include "../utils.h"
+#include "dplic.h"
+#include "virtio.h"
+
+/** \{ \name Registers */
+#define REGISTER_MAGIC 0x000 /**< Magic value "virt" */
+#define REGISTER_VERSION 0x004 /**< Interface version */
+#define REGISTER_DEVICE_ID 0x008 /**< Device type */
+#define REGISTER_VENDOR_ID 0x00c /**< Vendor */
+#define REGISTER_DEVICE_FEATURES 0x010 /**< Device features (32 bits selected) */
+#define REGISTER_DEVICE_FEATURES_SEL 0x014 /**< Device features selection */
+#define REGISTER_DRIVER_FEATURES 0x020 /**< Driver features (32 bits selected) */
+#define REGISTER_DRIVER_FEATURES_SEL 0x024 /**< Driver features selection */
+#define REGISTER_QUEUE_SEL 0x030 /**< Queue selection */
+#define REGISTER_QUEUE_NUM_MAX 0x034 /**< Maximal queue size */
+#define REGISTER_QUEUE_NUM 0x038 /**< Queue size */
+#define REGISTER_QUEUE_READY 0x044 /**< Queue ready */
+#define REGISTER_QUEUE_NOTIFY 0x050 /**< Queue notification */
+#define REGISTER_INTERRUPT_STATUS 0x060 /**< Interrupt status */
+#define REGISTER_INTERRUPT_ACK 0x064 /**< Interrupt acknowledge */
+#define REGISTER_STATUS 0x070 /**< Device status */
+#define REGISTER_QUEUE_DESC 0x080 /**< Descriptor table address (64 bits) */
+#define REGISTER_QUEUE_AVAIL 0x090 /**< Available ring address (64 bits) */
+#define REGISTER_QUEUE_USED 0x0a0 /**< Used ring address (64 bits) */
+#define REGISTER_CONFIG_GENERATION 0x0fc /**< Configuration generation */
+/* \} */
+
+/** \{ \name Identification */
+#define VIRTIO_MAGIC 0x74726976 /**< "virt" */
+#define VIRTIO_VERSION 2
+#define VIRTIO_VENDOR 0x4d49534d /**< "MSIM" */
+/* \} */
+
+/** Virtio 1.0 interface feature */
+#define FEATURE_VERSION_1 (UINT64_C(1) << 32)
+
+/** \{ \name Device status */
+#define STATUS_FEATURES_OK 0x08 /**< Features negotiated */
+#define STATUS_DRIVER_OK 0x04 /**< Driver ready */
+#define STATUS_NEEDS_RESET 0x40 /**< Device error */
+/* \} */
+
+/** Available ring flag suppressing the interrupt */
+#define AVAIL_NO_INTERRUPT 0x01
+
+/** Size of a descriptor in the descriptor table */
+#define DESC_SIZE 16
+
+/** Initialize the transport of a device
+ *
+ * @param virtio      Transport state
+ * @param dev         Device instance
+ * @param addr        Register block address
+ * @param intno       Interrupt number
+ * @param device_id   Virtio device type
+ * @param features    Device-specific features offered
+ * @param queue_count Number of queues (at most VIRTIO_QUEUES)
+ *
+ */
+void virtio_init(virtio_t *virtio, device_t *dev, ptr36_t addr,
+        unsigned int intno, uint32_t device_id, uint64_t features,
+        unsigned int queue_count)
+{
+    ASSERT(queue_count <= VIRTIO_QUEUES);
+
+    virtio->dev = dev;
+    virtio->addr = addr;
+    virtio->intno = intno;
+    virtio->plic = NULL;
+    virtio->plic_source = 0;
+    virtio->device_id = device_id;
+    virtio->features = features;
+    virtio->queue_count = queue_count;
+    virtio->notify = NULL;
+    virtio->interrupt_status = 0;
+    virtio->notifies = 0;
+    virtio->intrcount = 0;
+
+    virtio_reset(virtio);
+}
+
+/** Reset the device to its initial state
+ *
+ * @param virtio Transport state
+ *
+ */
+void virtio_reset(virtio_t *virtio)
+{
+    virtio_interrupt_down(virtio, UINT32_MAX);
+
+    virtio->device_features_sel = 0;
+    virtio->driver_features_sel = 0;
+    virtio->driver_features = 0;
+    virtio->queue_sel = 0;
+    virtio->status = 0;
+
+    for (unsigned int i = 0; i < VIRTIO_QUEUES; i++) {
+        virtq_t *queue = &virtio->queues[i];
+
+        queue->num = 0;
+        queue->ready = false;
+        queue->desc = 0;
+        queue->avail = 0;
+        queue->used = 0;
+        queue->last_avail = 0;
+        queue->used_idx = 0;
+        queue->pushed = 0;
+    }
+}
+
+/** Test whether the driver is ready and the device works */
+bool virtio_driver_ok(virtio_t *virtio)
+{
+    return ((virtio->status & STATUS_DRIVER_OK) != 0)
+            && ((virtio->status & STATUS_NEEDS_RESET) == 0);
+}
+
+/** Assert the interrupt (or the source of the interrupt controller)
+ *
+ * @param virtio Transport state
+ * @param cause  VIRTIO_INTERRUPT_* causes
+ *
+ */
+void virtio_interrupt_up(virtio_t *virtio, uint32_t cause)
+{
+    if (virtio->interrupt_status == 0) {
+        plic_interrupt_up(virtio->plic, virtio->plic_source, virtio->intno);
+        virtio->intrcount++;
+    }
+
+    virtio->interrupt_status |= cause;
+}
+
+/** Deassert the interrupt once all its causes are acknowledged
+ *
+ * @param virtio Transport state
+ * @param cause  VIRTIO_INTERRUPT_* causes
+ *
+ */
+void virtio_interrupt_down(virtio_t *virtio, uint32_t cause)
+{
+    if (virtio->interrupt_status == 0) {
+        return;
+    }
+
+    virtio->interrupt_status &= ~cause;
+
+    if (virtio->interrupt_status == 0) {
+        plic_interrupt_down(virtio->plic, virtio->plic_source, virtio->intno);
+    }
+}
+
+/** Report an unrecoverable error of the driver
+ *
+ * Stops processing of the queues until the driver resets the device.
+ *
+ * @param virtio Transport state
+ *
+ */
+void virtio_needs_reset(virtio_t *virtio)
+{
+    virtio->status |= STATUS_NEEDS_RESET;
+    virtio_interrupt_up(virtio, VIRTIO_INTERRUPT_CONFIG);
+}
+
+/** Features offered by the device (including the transport ones) */
+static uint64_t virtio_features(virtio_t *virtio)
+{
+    return virtio->features | FEATURE_VERSION_1;
+}
+
+/** Test whether a part of the guest memory is addressable */
+static bool virtio_range(uint64_t addr, uint64_t len)
+{
+    return (phys_range(addr)) && (addr + len >= addr)
+            && (phys_range(addr + len));
+}
+
+/** Read a register
+ *
+ * @param virtio Transport state
+ * @param offset Register offset
+ * @param val    Register value (returned)
+ *
+ * @return False for the device-specific configuration space
+ *
+ */
+bool virtio_read32(virtio_t *virtio, ptr36_t offset, uint32_t *val)
+{
+    if (offset >= VIRTIO_CONFIG) {
+        return false;
+    }
+
+    bool queue = virtio->queue_sel < virtio->queue_count;
+
+    switch (offset) {
+    case REGISTER_MAGIC:
+        *val = VIRTIO_MAGIC;
+        break;
+    case REGISTER_VERSION:
+        *val = VIRTIO_VERSION;
+        break;
+    case REGISTER_DEVICE_ID:
+        *val = virtio->device_id;
+        break;
+    case REGISTER_VENDOR_ID:
+        *val = VIRTIO_VENDOR;
+        break;
+    case REGISTER_DEVICE_FEATURES:
+        *val = (virtio->device_features_sel > 1) ? 0
+                : (uint32_t) (virtio_features(virtio)
+                        >> (32 * virtio->device_features_sel));
+        break;
+    case REGISTER_QUEUE_NUM_MAX:
+        *val = queue ? VIRTIO_QUEUE_NUM_MAX : 0;
+        break;
+    case REGISTER_QUEUE_READY:
+        *val = queue ? virtio->queues[virtio->queue_sel].ready : 0;
+        break;
+    case REGISTER_INTERRUPT_STATUS:
+        *val = virtio->interrupt_status;
+        break;
+    case REGISTER_STATUS:
+        *val = virtio->status;
+        break;
+    default:
+        *val = 0;
+    }
+
+    return true;
+}
+
+/** Write a half of a 64-bit register */
+static void virtio_write_half(uint64_t *reg, ptr36_t offset, uint32_t val)
+{
+    unsigned int shift = (offset & 4) * 8;
+    uint64_t mask = ((uint64_t) UINT32_MAX) << shift;
+
+    *reg = (*reg & ~mask) | ((uint64_t) val << shift);
+}
+
+/** Write the device status
+ *
+ * Writing zero resets the device. The features are accepted only
+ * if the driver supports the version 1 interface and does not ask
+ * for features the device does not offer.
+ *
+ */
+static void virtio_status_write(virtio_t *virtio, uint32_t val)
+{
+    if (val == 0) {
+        virtio_reset(virtio);
+        return;
+    }
+
+    if (((val & STATUS_FEATURES_OK) != 0)
+            && ((virtio->status & STATUS_FEATURES_OK) == 0)) {
+        uint64_t features = virtio->driver_features;
+
+        if (((features & FEATURE_VERSION_1) == 0)
+                || ((features & ~virtio_features(virtio)) != 0)) {
+            val &= ~STATUS_FEATURES_OK;
+        }
+    }
+
+    virtio->status = (val & 0xff) | (virtio->status & STATUS_NEEDS_RESET);
+}
+
+/** Write a register
+ *
+ * The writes into the configuration space are ignored.
+ *
+ * @param virtio Transport state
+ * @param offset Register offset
+ * @param val    Value to write
+ *
+ */
+void virtio_write32(virtio_t *virtio, ptr36_t offset, uint32_t val)
+{
+    virtq_t *queue = NULL;
+
+    /* Queue parameters are changed only before the queue is ready */
+    if ((virtio->queue_sel < virtio->queue_count)
+            && (!virtio->queues[virtio->queue_sel].ready)) {
+        queue = &virtio->queues[virtio->queue_sel];
+    }
+
+    switch (offset) {
+    case REGISTER_DEVICE_FEATURES_SEL:
+        virtio->device_features_sel = val;
+        break;
+    case REGISTER_DRIVER_FEATURES:
+        if (virtio->driver_features_sel <= 1) {
+            virtio_write_half(&virtio->driver_features,
+                    4 * virtio->driver_features_sel, val);
+        }
+        break;
+    case REGISTER_DRIVER_FEATURES_SEL:
+        virtio->driver_features_sel = val;
+        break;
+    case REGISTER_QUEUE_SEL:
+        virtio->queue_sel = val;
+        break;
+    case REGISTER_QUEUE_NUM:
+        if ((queue != NULL) && (val > 0) && (val <= VIRTIO_QUEUE_NUM_MAX)
+                && ((val & (val - 1)) == 0)) {
+            queue->num = val;
+        }
+        break;
+    case REGISTER_QUEUE_READY:
+        if (virtio->queue_sel < virtio->queue_count) {
+            virtq_t *sel = &virtio->queues[virtio->queue_sel];
+            sel->ready = ((val & 1) != 0) && (sel->num > 0);
+        }
+        break;
+    case REGISTER_QUEUE_NOTIFY:
+        virtio->notifies++;
+        if ((val < virtio->queue_count) && (virtio->notify != NULL)) {
+            virtio->notify(virtio, val);
+        }
+        break;
+    case REGISTER_INTERRUPT_ACK:
+        virtio_interrupt_down(virtio, val);
+        break;
+    case REGISTER_STATUS:
+        virtio_status_write(virtio, val);
+        break;
+    case REGISTER_QUEUE_DESC:
+    case REGISTER_QUEUE_DESC + 4:
+        if (queue != NULL) {
+            virtio_write_half(&queue->desc, offset, val);
+        }
+        break;
+    case REGISTER_QUEUE_AVAIL:
+    case REGISTER_QUEUE_AVAIL + 4:
+        if (queue != NULL) {
+            virtio_write_half(&queue->avail, offset, val);
+        }
+        break;
+    case REGISTER_QUEUE_USED:
+    case REGISTER_QUEUE_USED + 4:
+        if (queue != NULL) {
+            virtio_write_half(&queue->used, offset, val);
+        }
+        break;
+    }
+}
+
+/** Route command implementation
+ *
+ * @param parm   Command-line parameters
+ * @param virtio Transport state
+ *
+ * @return True if successful
+ *
+ */
+bool virtio_route(token_t *parm, virtio_t *virtio)
+{
+    if (parm_type(parm) == tt_end) {
+        if (virtio->plic == NULL) {
+            printf("Interrupt: %u\n", virtio->intno);
+        } else {
+            printf("Interrupt: source %u of %s\n", virtio->plic_source,
+                    virtio->plic->name);
+        }
+        return true;
+    }
+
+    device_t *plic;
+    unsigned int source;
+
+    if (!plic_route(parm, &plic, &source)) {
+        return false;
+    }
+
+    if (virtio->interrupt_status != 0) {
+        plic_interrupt_down(virtio->plic, virtio->plic_source, virtio->intno);
+        plic_interrupt_up(plic, source, virtio->intno);
+    }
+
+    virtio->plic = plic;
+    virtio->plic_source = source;
+
+    return true;
+}
+
+/** Save the transport state into a checkpoint
+ *
+ * @param virtio Transport state
+ * @param ckpt   Checkpoint being written
+ *
+ * @return True if successful
+ *
+ */
+bool virtio_save(virtio_t *virtio, checkpoint_t *ckpt)
+{
+    bool ok = checkpoint_write_var(ckpt, virtio->device_features_sel)
+            && checkpoint_write_var(ckpt, virtio->driver_features_sel)
+            && checkpoint_write_var(ckpt, virtio->driver_features)
+            && checkpoint_write_var(ckpt, virtio->queue_sel)
+            && checkpoint_write_var(ckpt, virtio->interrupt_status)
+            && checkpoint_write_var(ckpt, virtio->status)
+            && checkpoint_write_var(ckpt, virtio->notifies)
+            && checkpoint_write_var(ckpt, virtio->intrcount);
+
+    for (unsigned int i = 0; (ok) && (i < virtio->queue_count); i++) {
+        virtq_t *queue = &virtio->queues[i];
+
+        ok = checkpoint_write_var(ckpt, queue->num)
+                && checkpoint_write_var(ckpt, queue->ready)
+                && checkpoint_write_var(ckpt, queue->desc)
+                && checkpoint_write_var(ckpt, queue->avail)
+                && checkpoint_write_var(ckpt, queue->used)
+                && checkpoint_write_var(ckpt, queue->last_avail)
+                && checkpoint_write_var(ckpt, queue->used_idx);
+    }
+
+    return ok;
+}
+
+/** Load the transport state from a checkpoint
+ *
+ * @param virtio Transport state
+ * @param ckpt   Checkpoint being read
+ *
+ * @return True if successful
+ *
+ */
+bool virtio_load(virtio_t *virtio, checkpoint_t *ckpt)
+{
+    bool ok = checkpoint_read_var(ckpt, virtio->device_features_sel)
+            && checkpoint_read_var(ckpt, virtio->driver_features_sel)
+            && checkpoint_read_var(ckpt, virtio->driver_features)
+            && checkpoint_read_var(ckpt, virtio->queue_sel)
+            && checkpoint_read_var(ckpt, virtio->interrupt_status)
+            && checkpoint_read_var(ckpt, virtio->status)
+            && checkpoint_read_var(ckpt, virtio->notifies)
+            && checkpoint_read_var(ckpt, virtio->intrcount);
+
+    for (unsigned int i = 0; (ok) && (i < virtio->queue_count); i++) {
+        virtq_t *queue = &virtio->queues[i];
+
+        ok = checkpoint_read_var(ckpt, queue->num)
+                && checkpoint_read_var(ckpt, queue->ready)
+                && checkpoint_read_var(ckpt, queue->desc)
+                && checkpoint_read_var(ckpt, queue->avail)
+                && checkpoint_read_var(ckpt, queue->used)
+                && checkpoint_read_var(ckpt, queue->last_avail)
+                && checkpoint_read_var(ckpt, queue->used_idx);
+        queue->pushed = 0;
+    }
+
+    return ok;
+}
+
+/** Test whether a queue can be processed
+ *
+ * A queue set up outside of the memory makes the device
+ * need a reset.
+ *
+ * @param virtio Transport state
+ * @param queue  Queue number
+ *
+ * @return True if the driver is ready and the queue is set up
+ *
+ */
+bool virtq_usable(virtio_t *virtio, unsigned int queue)
+{
+    virtq_t *q = &virtio->queues[queue];
+
+    if ((!virtio_driver_ok(virtio)) || (!q->ready)) {
+        return false;
+    }
+
+    if ((!virtio_range(q->desc, (uint64_t) q->num * DESC_SIZE))
+            || (!virtio_range(q->avail, 4 + 2 * q->num))
+            || (!virtio_range(q->used, 4 + 8 * q->num))) {
+        virtio_needs_reset(virtio);
+        return false;
+    }
+
+    return true;
+}
+
+/** Take the next request made available by the driver
+ *
+ * @param virtio Transport state
+ * @param queue  Queue number (usable)
+ * @param head   Index of the first descriptor of the request (returned)
+ *
+ * @return False if no request is available
+ *
+ */
+bool virtq_pop(virtio_t *virtio, unsigned int queue, uint16_t *head)
+{
+    virtq_t *q = &virtio->queues[queue];
+    uint16_t avail_idx = physmem_read16(-1 /*NULL*/, q->avail + 2, true);
+
+    if (q->last_avail == avail_idx) {
+        return false;
+    }
+
+    *head = physmem_read16(-1 /*NULL*/,
+            q->avail + 4 + 2 * (q->last_avail % q->num), true);
+    q->last_avail++;
+
+    return true;
+}
+
+/** Leave the last taken request available
+ *
+ * Used when the device has nothing to put into the request yet.
+ *
+ * @param virtio Transport state
+ * @param queue  Queue number (usable)
+ *
+ */
+void virtq_unpop(virtio_t *virtio, unsigned int queue)
+{
+    virtio->queues[queue].last_avail--;
+}
+
+/** Read a descriptor
+ *
+ * @param virtio Transport state
+ * @param queue  Queue number (usable)
+ * @param idx    Descriptor index
+ * @param desc   Descriptor (returned)
+ *
+ * @return False if the descriptor is outside of the table or
+ *         its buffer is outside of the memory
+ *
+ */
+bool virtq_desc(virtio_t *virtio, unsigned int queue, uint16_t idx,
+        virtq_desc_t *desc)
+{
+    virtq_t *q = &virtio->queues[queue];
+
+    if (idx >= q->num) {
+        return false;
+    }
+
+    ptr36_t addr = q->desc + (ptr36_t) idx * DESC_SIZE;
+    desc->addr = physmem_read64(-1 /*NULL*/, addr, true);
+    desc->len = physmem_read32(-1 /*NULL*/, addr + 8, true);
+    desc->flags = physmem_read16(-1 /*NULL*/, addr + 12, true);
+    desc->next = physmem_read16(-1 /*NULL*/, addr + 14, true);
+
+    return virtio_range(desc->addr, desc->len);
+}
+
+/** Return a processed request to the driver
+ *
+ * The used ring index is updated by virtq_publish().
+ *
+ * @param virtio Transport state
+ * @param queue  Queue number (usable)
+ * @param head   Index of the first descriptor of the request
+ * @param len    Number of bytes written into the request buffers
+ *
+ */
+void virtq_push(virtio_t *virtio, unsigned int queue, uint16_t head,
+        uint32_t len)
+{
+    virtq_t *q = &virtio->queues[queue];
+    ptr36_t elem = q->used + 4 + 8 * (q->used_idx % q->num);
+
+    physmem_write32(-1 /*NULL*/, elem, head, true);
+    physmem_write32(-1 /*NULL*/, elem + 4, len, true);
+
+    q->used_idx++;
+    q->pushed++;
+}
+
+/** Publish the returned requests to the driver
+ *
+ * A single interrupt announces all requests returned since
+ * the last publication (unless the driver suppresses it).
+ *
+ * @param virtio Transport state
+ * @param queue  Queue number (usable)
+ *
+ */
+void virtq_publish(virtio_t *virtio, unsigned int queue)
+{
+    virtq_t *q = &virtio->queues[queue];
+
+    if (q->pushed == 0) {
+        return;
+    }
+
+    q->pushed = 0;
+    physmem_write16(-1 /*NULL*/, q->used + 2, q->used_idx, true);
+
+    uint16_t flags = physmem_read16(-1 /*NULL*/, q->avail, true);
+    if ((flags & AVAIL_NO_INTERRUPT) == 0) {
+        virtio_interrupt_up(virtio, VIRTIO_INTERRUPT_USED);
+    }
+}
+
+/** Collect a memory part of a buffer
+ *
+ * The part ends at the end of the frame holding the first byte,
+ * its memory is accessed directly by the host I/O call.
+ *
+ * @param iov   Collected parts (not full)
+ * @param addr  Buffer address
+ * @param len   Buffer length
+ * @param write True if the buffer is going to be written
+ *
+ * @return Number of bytes of the part, zero if the buffer is not
+ *         in (writable) memory
+ *
+ */
+len36_t virtio_iov_add(virtio_iov_t *iov, ptr36_t addr, len36_t len,
+        bool write)
+{
+    ASSERT(iov->count < VIRTIO_IOV_BATCH);
+
+    uint8_t *ptr;
+    len36_t chunk = physmem_block_direct(addr, len, write, &ptr);
+
+    if (chunk > 0) {
+        iov->iov[iov->count].iov_base = ptr;
+        iov->iov[iov->count].iov_len = chunk;
+        iov->count++;
+        iov->len += chunk;
+    }
+
+    return chunk;
+}
+
+/** Move the collected parts by a single host I/O call
+ *
+ * @param iov    Collected parts (emptied)
+ * @param fd     Host file
+ * @param offset Position in the file (negative for the current one)
+ * @param output True to write the parts into the file
+ *
+ * @return Number of bytes moved, negative on error
+ *
+ */
+ssize_t virtio_iov_transfer(virtio_iov_t *iov, int fd, int64_t offset,
+        bool output)
+{
+    ssize_t done = 0;
+
+    if (iov->count > 0) {
+#ifndef __WIN32__
+        if (offset < 0) {
+            done = output ? writev(fd, iov->iov, iov->count)
+                    : readv(fd, iov->iov, iov->count);
+        } else {
+            done = output ? pwritev(fd, iov->iov, iov->count, offset)
+                    : preadv(fd, iov->iov, iov->count, offset);
+        }
+#else
+        if ((offset >= 0) && (lseek(fd, offset, SEEK_SET) != offset)) {
+            done = -1;
+        }
+
+        for (unsigned int i = 0; (done >= 0) && (i < iov->count); i++) {
+            size_t len = iov->iov[i].iov_len;
+            ssize_t part = output ? write(fd, iov->iov[i].iov_base, len)
+                    : read(fd, iov->iov[i].iov_base, len);
+
+            done = (part < 0) ? part : done + part;
+
+            if ((size_t) part < len) {
+                break;
+            }
+        }
+#endif
+    }
+
+    iov->count = 0;
+    iov->len = 0;
+    return done;
+}
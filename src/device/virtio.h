@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Virtio-mmio transport of the virtio devices
+ *
+ */
+
+#ifndef VIRTIO_H_
+#define VIRTIO_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifndef __WIN32__
+#include <sys/uio.h>
+#endif
+
+#include "../checkpoint.h"
+#include "../parser.h"
+#include "device.h"
+
+/** Offset of the device-specific configuration */
+#define VIRTIO_CONFIG 0x100
+
+/** Maximal number of queues of a device */
+#define VIRTIO_QUEUES 2
+
+/** Maximal queue size */
+#define VIRTIO_QUEUE_NUM_MAX 256
+
+/** \{ \name Interrupt causes */
+#define VIRTIO_INTERRUPT_USED 0x01 /**< Used ring updated */
+#define VIRTIO_INTERRUPT_CONFIG 0x02 /**< Configuration (or status) changed */
+/* \} */
+
+/** \{ \name Descriptor flags */
+#define VIRTQ_DESC_NEXT 0x01 /**< Chained */
+#define VIRTQ_DESC_WRITE 0x02 /**< Written by the device */
+/* \} */
+
+/** Number of memory parts moved by a single host I/O call */
+#define VIRTIO_IOV_BATCH 64
+
+/** Memory parts of the buffers moved by a host I/O call */
+typedef struct {
+#ifndef __WIN32__
+    struct iovec iov[VIRTIO_IOV_BATCH];
+#else
+    struct {
+        void *iov_base;
+        size_t iov_len;
+    } iov[VIRTIO_IOV_BATCH];
+#endif
+    unsigned int count; /**< Parts collected */
+    size_t len; /**< Bytes of the collected parts */
+} virtio_iov_t;
+
+/** Split virtqueue */
+typedef struct {
+    uint32_t num; /**< Queue size */
+    bool ready; /**< Queue ready */
+    uint64_t desc; /**< Descriptor table address */
+    uint64_t avail; /**< Available ring address */
+    uint64_t used; /**< Used ring address */
+    uint16_t last_avail; /**< Next available ring entry to process */
+    uint16_t used_idx; /**< Next used ring entry to fill */
+    unsigned int pushed; /**< Used entries not published yet */
+} virtq_t;
+
+/** Descriptor of a virtqueue buffer */
+typedef struct {
+    uint64_t addr; /**< Buffer address */
+    uint32_t len; /**< Buffer length */
+    uint16_t flags; /**< VIRTQ_DESC_* */
+    uint16_t next; /**< Next descriptor of the chain */
+} virtq_desc_t;
+
+/** Virtio device state common to all device types */
+typedef struct virtio {
+    device_t *dev; /**< Device instance */
+    ptr36_t addr; /**< Register block address */
+    unsigned int intno; /**< Interrupt number */
+    device_t *plic; /**< Interrupt controller (NULL for none) */
+    unsigned int plic_source; /**< Source of the interrupt controller */
+
+    uint32_t device_id; /**< Device type */
+    uint64_t features; /**< Device-specific features offered */
+    unsigned int queue_count; /**< Number of queues */
+
+    /** Notification of a queue by the driver */
+    void (*notify)(struct virtio *virtio, unsigned int queue);
+
+    uint32_t device_features_sel; /**< Device features selection */
+    uint32_t driver_features_sel; /**< Driver features selection */
+    uint64_t driver_features; /**< Features accepted by the driver */
+    uint32_t queue_sel; /**< Queue selection */
+    virtq_t queues[VIRTIO_QUEUES]; /**< Queues */
+    uint32_t interrupt_status; /**< Interrupt status */
+    uint32_t status; /**< Device status */
+
+    uint64_t notifies; /**< Number of queue notifications */
+    uint64_t intrcount; /**< Number of interrupts */
+} virtio_t;
+
+extern void virtio_init(virtio_t *virtio, device_t *dev, ptr36_t addr,
+        unsigned int intno, uint32_t device_id, uint64_t features,
+        unsigned int queue_count);
+extern void virtio_reset(virtio_t *virtio);
+extern bool virtio_driver_ok(virtio_t *virtio);
+extern void virtio_needs_reset(virtio_t *virtio);
+extern void virtio_interrupt_up(virtio_t *virtio, uint32_t cause);
+extern void virtio_interrupt_down(virtio_t *virtio, uint32_t cause);
+
+extern bool virtio_read32(virtio_t *virtio, ptr36_t offset, uint32_t *val);
+extern void virtio_write32(virtio_t *virtio, ptr36_t offset, uint32_t val);
+
+extern bool virtio_route(token_t *parm, virtio_t *virtio);
+extern bool virtio_save(virtio_t *virtio, checkpoint_t *ckpt);
+extern bool virtio_load(virtio_t *virtio, checkpoint_t *ckpt);
+
+extern bool virtq_usable(virtio_t *virtio, unsigned int queue);
+extern bool virtq_pop(virtio_t *virtio, unsigned int queue, uint16_t *head);
+extern void virtq_unpop(virtio_t *virtio, unsigned int queue);
+extern bool virtq_desc(virtio_t *virtio, unsigned int queue, uint16_t idx,
+        virtq_desc_t *desc);
+extern void virtq_push(virtio_t *virtio, unsigned int queue, uint16_t head,
+        uint32_t len);
+extern void virtq_publish(virtio_t *virtio, unsigned int queue);
+
+extern len36_t virtio_iov_add(virtio_iov_t *iov, ptr36_t addr, len36_t len,
+        bool write);
+extern ssize_t virtio_iov_transfer(virtio_iov_t *iov, int fd, int64_t offset,
+        bool output);
+
+#endif
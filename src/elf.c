@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  ELF files of the guest programs
+ *
+ *  The loadable segments of an executable are mapped into the generic
+ *  memory areas at their physical addresses without reading the file
+ *  (see mem_map_segment()), so loading a large kernel costs the same
+ *  as loading a small one. The processors start at the entry point
+ *  and the symbols are kept for the profiler and the debugger.
+ *
+ */
+
+#include "elf.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arch/mmap.h"
+#include "assert.h"
+#include "debug/symtab.h"
+#include "device/cpu/decode_cache.h"
+#include "device/cpu/general_cpu.h"
+#include "device/device.h"
+#include "device/mem.h"
+#include "fault.h"
+#include "main.h"
+#include "physmem.h"
+#include "text.h"
+#include "utils.h"
+
+/** Loadable segment of an executable */
+typedef struct {
+    physmem_area_t *area;
+    ptr36_t addr;
+    uint64_t offset;
+    uint64_t filesz;
+    uint64_t memsz;
+    bool exec; /**< The segment holds code */
+} elf_segment_t;
+
+/** Check the identification of an ELF file
+ *
+ * Set the class and the byte order of the file.
+ *
+ * @return True if the file starts with a valid ELF header.
+ *
+ */
+bool elf_identify(elf_file_t *elf)
+{
+    ASSERT(elf != NULL);
+
+    if ((elf->size < 52) || (memcmp(elf->data, "\177ELF", 4) != 0)
+            || ((elf->data[4] != ELF_CLASS32) && (elf->data[4] != ELF_CLASS64))
+            || ((elf->data[5] != ELF_DATA_LSB) && (elf->data[5] != ELF_DATA_MSB))) {
+        return false;
+    }
+
+    elf->is64 = (elf->data[4] == ELF_CLASS64);
+    elf->msb = (elf->data[5] == ELF_DATA_MSB);
+
+    if ((elf->is64) && (elf->size < 64)) {
+        return false;
+    }
+
+    return true;
+}
+
+/** Find the generic memory area holding a segment
+ *
+ * @return The area or NULL (with an error printed).
+ *
+ */
+static physmem_area_t *elf_find_area(ptr36_t addr, uint64_t size)
+{
+    device_t *dev = NULL;
+
+    while (dev_next(&dev, DEVICE_FILTER_MEMORY)) {
+        physmem_area_t *area = (physmem_area_t *) dev->data;
+        ptr36_t start = FRAME2ADDR(area->start);
+        len36_t len = FRAMES2SIZE(area->count);
+
+        if ((area->type == MEMT_NONE) || (addr < start) || (addr - start >= len)) {
+            continue;
+        }
+
+        if (size > len - (addr - start)) {
+            error("Segment at %#011" PRIx64 " exceeds the memory area %s",
+                    addr, dev->name);
+            return NULL;
+        }
+
+        if (area->type != MEMT_MEM) {
+            error("Segment at %#011" PRIx64 " falls into the memory area %s "
+                  "mapped to a file",
+                    addr, dev->name);
+            return NULL;
+        }
+
+        return area;
+    }
+
+    error("Segment at %#011" PRIx64 " is not within any memory area", addr);
+    return NULL;
+}
+
+/** Read the loadable segments of an executable
+ *
+ * @param segments Array for the segments (one per program header).
+ * @param count    Number of the segments read.
+ *
+ * @return True if all the segments fit into generic memory areas.
+ *
+ */
+static bool elf_read_segments(const elf_file_t *elf, elf_segment_t *segments,
+        size_t *count, const char *path)
+{
+    bool mips32 = (!elf->is64) && (elf_get(elf, 18, 2) == ELF_MACHINE_MIPS);
+
+    uint64_t phoff = elf_get(elf, elf->is64 ? 32 : 28, elf->is64 ? 8 : 4);
+    size_t phentsize = elf_get(elf, elf->is64 ? 54 : 42, 2);
+    size_t phnum = elf_get(elf, elf->is64 ? 56 : 44, 2);
+
+    if ((phentsize < (elf->is64 ? 56 : 32))
+            || (!elf_contains(elf, phoff, (uint64_t) phentsize * phnum))) {
+        error("%s is not a valid ELF file", path);
+        return false;
+    }
+
+    *count = 0;
+
+    for (size_t i = 0; i < phnum; i++) {
+        size_t phdr = phoff + i * phentsize;
+
+        if (elf_get(elf, phdr, 4) != ELF_SEGMENT_LOAD) {
+            continue;
+        }
+
+        elf_segment_t *segment = &segments[*count];
+        uint64_t addr;
+
+        if (elf->is64) {
+            segment->exec = (elf_get(elf, phdr + 4, 4) & ELF_SEGMENT_EXEC) != 0;
+            segment->offset = elf_get(elf, phdr + 8, 8);
+            addr = elf_get(elf, phdr + 24, 8);
+            segment->filesz = elf_get(elf, phdr + 32, 8);
+            segment->memsz = elf_get(elf, phdr + 40, 8);
+        } else {
+            segment->offset = elf_get(elf, phdr + 4, 4);
+            addr = elf_get(elf, phdr + 12, 4);
+            segment->filesz = elf_get(elf, phdr + 16, 4);
+            segment->memsz = elf_get(elf, phdr + 20, 4);
+            segment->exec = (elf_get(elf, phdr + 24, 4) & ELF_SEGMENT_EXEC) != 0;
+        }
+
+        if (segment->memsz == 0) {
+            continue;
+        }
+
+        if ((segment->filesz > segment->memsz)
+                || (!elf_contains(elf, segment->offset, segment->filesz))) {
+            error("%s is not a valid ELF file", path);
+            return false;
+        }
+
+        /* MIPS linkers mostly give the kseg0 or kseg1 addresses */
+        if ((mips32) && (addr >= UINT64_C(0x80000000))
+                && (addr < UINT64_C(0xc0000000))) {
+            addr &= UINT64_C(0x1fffffff);
+        }
+
+        if ((!phys_range(addr)) || (!phys_range(addr + segment->memsz - 1))) {
+            error("Segment at %#" PRIx64 " out of physical memory range", addr);
+            return false;
+        }
+
+        segment->addr = addr;
+        segment->area = elf_find_area(segment->addr, segment->memsz);
+
+        if (segment->area == NULL) {
+            return false;
+        }
+
+        (*count)++;
+    }
+
+    return true;
+}
+
+/** Find the layout of a loaded executable
+ *
+ * The program headers are found in the segment mapping their
+ * part of the file.
+ *
+ */
+static void elf_read_image(const elf_file_t *elf, const elf_segment_t *segments,
+        size_t count, uint64_t entry, elf_image_t *image)
+{
+    uint64_t phoff = elf_get(elf, elf->is64 ? 32 : 28, elf->is64 ? 8 : 4);
+
+    image->entry = entry;
+    image->phdr = 0;
+    image->phent = elf_get(elf, elf->is64 ? 54 : 42, 2);
+    image->phnum = elf_get(elf, elf->is64 ? 56 : 44, 2);
+    image->end = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const elf_segment_t *segment = &segments[i];
+
+        if ((phoff >= segment->offset)
+                && (phoff - segment->offset < segment->filesz)) {
+            image->phdr = segment->addr + (phoff - segment->offset);
+        }
+
+        image->end = MAX(image->end, segment->addr + segment->memsz);
+    }
+}
+
+/** Load an executable
+ *
+ * Map the loadable segments into the memory, set the program
+ * counters of all processors to the entry point and add the
+ * symbols of the file to the symbol table.
+ *
+ * @param layout Layout of the executable (returned, can be NULL).
+ *
+ * @return True if successful.
+ *
+ */
+bool elf_load(const char *path, elf_image_t *layout)
+{
+    ASSERT(path != NULL);
+
+    FILE *file = try_fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    if (!try_fseek(file, 0, SEEK_END, path)) {
+        return false;
+    }
+
+    size_t size;
+    if (!try_ftell(file, path, &size)) {
+        return false;
+    }
+
+    if (size == 0) {
+        error("Empty file");
+        safe_fclose(file, path);
+        return false;
+    }
+
+    int fd = fileno(file);
+    if (fd == -1) {
+        io_error(path);
+        safe_fclose(file, path);
+        return false;
+    }
+
+    void *image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (image == MAP_FAILED) {
+        io_error(path);
+        error("%s", txt_file_map_fail);
+        safe_fclose(file, path);
+        return false;
+    }
+
+    elf_file_t elf = {
+        .data = (const uint8_t *) image,
+        .size = size
+    };
+
+    bool ok = elf_identify(&elf);
+    elf_segment_t *segments = NULL;
+    size_t count = 0;
+
+    if (!ok) {
+        error("%s is not a valid ELF file", path);
+    } else {
+        size_t phnum = elf_get(&elf, elf.is64 ? 56 : 44, 2);
+        segments = safe_malloc(MAX(phnum, 1) * sizeof(elf_segment_t));
+        ok = elf_read_segments(&elf, segments, &count, path);
+    }
+
+    /* Nothing is changed unless all the segments fit */
+    for (size_t i = 0; (ok) && (i < count); i++) {
+        ok = mem_map_segment(segments[i].area, segments[i].addr, fd,
+                elf.data, segments[i].offset, segments[i].filesz,
+                segments[i].memsz, path);
+    }
+
+    /* Only the code of the executable is pre-decoded */
+    for (size_t i = 0; (ok) && (i < count); i++) {
+        if (segments[i].exec) {
+            decode_cache_predecode(segments[i].addr, segments[i].filesz);
+        }
+    }
+
+    if (ok) {
+        ok = symtab_read(elf.data, elf.size, path);
+    }
+
+    if (ok) {
+        uint64_t entry = elf_get(&elf, 24, elf.is64 ? 8 : 4);
+
+        /* Like the program counter of R4000 */
+        if ((!elf.is64) && (elf_get(&elf, 18, 2) == ELF_MACHINE_MIPS)) {
+            entry = (uint64_t) (int64_t) (int32_t) entry;
+        }
+
+        ptr64_t pc = { .ptr = entry };
+
+        for (unsigned int i = 0; i < get_cpu_count(); i++) {
+            cpu_set_pc(get_cpu_by_index(i), pc);
+        }
+
+        if (layout != NULL) {
+            elf_read_image(&elf, segments, count, entry, layout);
+        }
+    }
+
+    safe_free(segments);
+    try_munmap(image, size);
+    safe_fclose(file, path);
+
+    return ok;
+}
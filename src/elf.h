@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  ELF files of the guest programs
+ *
+ */
+
+#ifndef ELF_H_
+#define ELF_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Constants of the ELF format */
+#define ELF_CLASS32 1
+#define ELF_CLASS64 2
+#define ELF_DATA_LSB 1
+#define ELF_DATA_MSB 2
+#define ELF_MACHINE_MIPS 8
+#define ELF_SEGMENT_LOAD 1
+#define ELF_SEGMENT_EXEC 1
+#define ELF_SECTION_SYMTAB 2
+#define ELF_SECTION_UNDEF 0
+#define ELF_SECTION_ABS 0xfff1
+#define ELF_SYMBOL_NOTYPE 0
+#define ELF_SYMBOL_FUNC 2
+#define ELF_BIND_LOCAL 0
+
+/** ELF file read (or mapped) into the memory */
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    bool is64;
+    bool msb;
+} elf_file_t;
+
+/** Read a field of the file in its byte order */
+static inline uint64_t elf_get(const elf_file_t *elf, size_t offset, size_t width)
+{
+    uint64_t val = 0;
+
+    for (size_t i = 0; i < width; i++) {
+        size_t byte = elf->msb ? i : width - 1 - i;
+        val = (val << 8) | elf->data[offset + byte];
+    }
+
+    return val;
+}
+
+/** Tell whether a part of the file is within the file */
+static inline bool elf_contains(const elf_file_t *elf, uint64_t offset, uint64_t size)
+{
+    return (offset <= elf->size) && (size <= elf->size - offset);
+}
+
+/** Layout of a loaded executable */
+typedef struct {
+    uint64_t entry; /**< Entry point */
+    uint64_t phdr; /**< Address of the program headers (0 if not loaded) */
+    unsigned int phent; /**< Size of a program header */
+    unsigned int phnum; /**< Number of the program headers */
+    uint64_t end; /**< End of the loadable segments */
+} elf_image_t;
+
+extern bool elf_identify(elf_file_t *elf);
+extern bool elf_load(const char *path, elf_image_t *layout);
+
+#endif
@@ -13,21 +13,23 @@
 #define ENDIAN_H_
 
 #include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
 
 #include "../config.h"
 
+/*
+ * The simulated processors are little-endian, so the conversion is
+ * needed only on big-endian hosts (decided by configure). On the others
+ * the conversions vanish and the accesses are plain loads and stores.
+ */
+
 #ifdef WORDS_BIGENDIAN
 
 #define convert_uint8_t_endian(val) (val)
-
-#define convert_uint16_t_endian(val) \
-    ((((val) << 8) & UINT16_C(0xff00)) | (((val) >> 8) & UINT16_C(0x00ff)))
-
-#define convert_uint32_t_endian(val) \
-    ((((val) & UINT32_C(0x000000ff)) << 24) | (((val) & UINT32_C(0x0000ff00)) << 8) | (((val) & UINT32_C(0x00ff0000)) >> 8) | (((val) & UINT32_C(0xff000000)) >> 24))
-
-#define convert_uint64_t_endian(val) \
-    ((((val) & UINT64_C(0x00000000000000ff)) << 56) | (((val) & UINT64_C(0x000000000000ff00)) << 40) | (((val) & UINT64_C(0x0000000000ff0000)) << 24) | (((val) & UINT64_C(0x00000000ff000000)) << 8) | (((val) & UINT64_C(0x000000ff00000000)) >> 8) | (((val) & UINT64_C(0x000000ff00000000)) >> 24) | (((val) & UINT64_C(0x00ff000000000000)) >> 40) | (((val) & UINT64_C(0xff00000000000000)) >> 56))
+#define convert_uint16_t_endian(val) __builtin_bswap16(val)
+#define convert_uint32_t_endian(val) __builtin_bswap32(val)
+#define convert_uint64_t_endian(val) __builtin_bswap64(val)
 
 #else /* WORDS_BIGENDIAN */
 
@@ -38,4 +40,22 @@
 
 #endif /* WORDS_BIGENDIAN */
 
+/** Convert a block of 32-bit words
+ *
+ * A copy on little-endian hosts, a loop the compiler can vectorize
+ * on the others.
+ *
+ */
+static inline void convert_uint32_t_endian_block(uint32_t *dst,
+        const uint32_t *src, size_t count)
+{
+#ifdef WORDS_BIGENDIAN
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = convert_uint32_t_endian(src[i]);
+    }
+#else
+    memcpy(dst, src, count * sizeof(uint32_t));
+#endif
+}
+
 #endif
@@ -14,12 +14,31 @@
 #include <string.h>
 
 #include "assert.h"
+#include "debug/callstack.h"
+#include "debug/cosim.h"
+#include "debug/coverage.h"
+#include "debug/disasm.h"
+#include "debug/flight.h"
+#include "debug/mixstat.h"
+#include "debug/pcprofile.h"
+#include "debug/reverse.h"
+#include "debug/trace.h"
+#include "device/cpu/decode_cache.h"
+#include "device/cpu/general_cpu.h"
 #include "device/cpu/mips_r4000/cpu.h"
 #include "device/cpu/mips_r4000/debug.h"
 #include "device/cpu/riscv_rv32ima/debug.h"
+#undef XLEN
+#include "device/cpu/riscv_rv64ima/debug.h"
+#undef XLEN
+#include "device/cpu/isa.h"
 #include "env.h"
 #include "fault.h"
+#include "hostperf.h"
+#include "pace.h"
+#include "parallel.h"
 #include "parser.h"
+#include "profile.h"
 #include "utils.h"
 
 /*
@@ -129,7 +148,31 @@ static bool change_ireg(unsigned int i)
     }
 
     r4k_ireg = i;
+#if ISA_R4K
     r4k_regname = r4k_reg_name[i];
+#endif
+    disasm_flush();
+
+    return true;
+}
+
+/** Change the names of the RISC-V registers
+ *
+ * @return true if successful
+ *
+ */
+static bool change_rv_ireg(unsigned int i)
+{
+#if ISA_RV32
+    if (!rv32_debug_change_regnames((rv_regname_type_t) i)) {
+        return false;
+    }
+#endif
+#if ISA_RV64
+    if (!rv64_debug_change_regnames((rv64_regname_type_t) i)) {
+        return false;
+    }
+#endif
 
     return true;
 }
@@ -144,6 +187,150 @@ const env_t global_env[] = {
             vt_uint,
             NULL,
             NULL },
+    { "parallel",
+            "Cycles the processors run in parallel",
+            "Number of machine cycles the processors run on host "
+            "threads (at most one per host core) before the processors "
+            "and the other devices are synchronized again. Value 0 "
+            "(default) simulates all processors on a single thread one "
+            "instruction after another and keeps the simulation deterministic. The parallel "
+            "simulation is suspended while there are breakpoints, "
+            "tracing or a debugger session.",
+            vt_uint,
+            &parallel_quantum,
+            NULL },
+    { "relaxed",
+            "Run the parallel processors without waiting for each other",
+            "With the parallel variable set, every processor runs on "
+            "its own host thread without waiting for the others at the "
+            "end of the quantum and the main thread steps the other "
+            "devices meanwhile. A processor only waits once it gets a "
+            "quantum ahead of the devices. The processors meet each "
+            "other only through the atomic memory operations and the "
+            "device accesses, so the simulation is neither deterministic "
+            "nor are the cycles of the processors kept equal.",
+            vt_bool,
+            &parallel_relaxed,
+            NULL },
+    { "quantum",
+            "Cycles each processor runs before the next one",
+            "Number of machine cycles each processor runs in a row "
+            "when the processors are simulated on a single thread. "
+            "The other devices and the scheduled device events catch "
+            "up afterwards. Value 1 (default) runs one instruction of "
+            "each processor per machine cycle. The simulation stays "
+            "deterministic, but the order of the processors and of "
+            "the other devices is kept only at the quantum boundaries. "
+            "The quantum is suspended while there are "
+            "breakpoints, tracing, stepping or a debugger session.",
+            vt_uint,
+            &machine_quantum,
+            NULL },
+    { "idleskip",
+            "Skip the cycles in which all processors stand by",
+            "When all processors wait for an interrupt (e.g. after the "
+            "RISC-V wfi instruction), the cycles up to the next timer "
+            "interrupt or device event are accounted at once instead of "
+            "being simulated one by one. A single processor standing by "
+            "is not stepped either until it gets an interrupt or its "
+            "timer changes. The cycle counters end up the same either "
+            "way. The skipping is suspended while there are breakpoints, "
+            "tracing, stepping or a debugger session.",
+            vt_bool,
+            &machine_skip_standby,
+            NULL },
+    { "idlesleep",
+            "Let the host sleep while all processors wait for input",
+            "When the skipped cycles end only by a key press or by the "
+            "host clock (i.e. the keyboard or the host mtime source of "
+            "RISC-V), the host sleeps until the input or the time comes "
+            "instead of polling. The sleep delays the machine cycles "
+            "with respect to the host time, so it is disabled by "
+            "default. It requires the idleskip variable.",
+            vt_bool,
+            &machine_sleep_standby,
+            NULL },
+    { "pace",
+            "Run the machine cycles at the given frequency",
+            "Number of machine cycles per second of the host time the "
+            "machine runs at (e.g. 50000000 for 50 MHz) instead of as "
+            "fast as possible. Every millisecond of the simulated time "
+            "the cycles are compared with the host clock and the host "
+            "sleeps once the simulation is at least 2 ms ahead. A "
+            "simulation behind by more than 100 ms (e.g. stopped in "
+            "the interactive mode) starts over from the current cycle. "
+            "The accuracy is printed by the stat command. Value 0 "
+            "(default) disables the pacing.",
+            vt_uint,
+            &pace_frequency,
+            pace_set_frequency },
+    { "loophalt",
+            "Halt when all processors loop forever",
+            "Every 4096 machine cycles the processors are checked for "
+            "jumping to themselves (e.g. `j .' or `b .' followed by a nop) "
+            "or standing by while no interrupt can be taken. The machine "
+            "is halted once all of them do, since only an interrupt could "
+            "get them out. Useful for the test programs which end by such "
+            "a loop. Disabled by default.",
+            vt_bool,
+            &machine_loop_halt,
+            NULL },
+    { "fast",
+            "Fast functional simulation",
+            "The processors execute the straight-line runs of "
+            "instructions as blocks (see the block command of the "
+            "processors) even where the block execution is not "
+            "configured. The R4000 counters and timer are updated "
+            "once per block, so a timer interrupt may be taken up to "
+            "a block later and the cycle statistics are approximate. "
+            "Unsetting the variable (e.g. at a breakpoint marking the "
+            "interesting part of a workload) returns to the accurate "
+            "simulation with the architectural state kept.",
+            vt_bool,
+            &machine_fast,
+            NULL },
+    { "predecode",
+            "Decode the loaded code before the simulation",
+            "The images loaded by the load command of the generic "
+            "memories and the executable segments of the ELF files "
+            "loaded by the elf command are decoded for the instruction "
+            "sets of the processors added before, using the host threads "
+            "(at most one per host core). The first fetches from the "
+            "code then find the decoded instructions in the decoded "
+            "instruction cache instead of decoding the pages one by "
+            "one. Only the free capacity of the cache (see the icache "
+            "command of the processors) is filled. Disabled by default.",
+            vt_bool,
+            &decode_predecode,
+            NULL },
+    { "profile",
+            "Sample the host time every N machine cycles",
+            "Every N-th machine cycle is sampled and its host time is "
+            "accounted to the parts of the simulator (instruction "
+            "execution, address translation, instruction decoding, "
+            "devices, device registers, breakpoints and trace output). "
+            "The profile estimated from the samples is printed by the "
+            "stat command. Value 0 (default) disables the profiling. "
+            "Setting the variable starts a new profile. The cycles run "
+            "in parallel and the skipped cycles are not sampled.",
+            vt_uint,
+            &profile_period,
+            profile_set_period },
+    { "hostperf",
+            "Sample the host counters every N host events",
+            "The host cycles, cache misses and branch misses of the "
+            "simulation thread are sampled every N-th event by "
+            "perf_event_open() and each sample is attributed to the "
+            "guest page executed by the processors. The pages costing "
+            "the host most are printed by the stat command. Value 0 "
+            "(default) disables the sampling. Setting the variable "
+            "starts a new table. The counters missing on the host are "
+            "left out (the host cycles are replaced by the task clock "
+            "in nanoseconds), the cycles run in parallel are not "
+            "attributed.",
+            vt_uint,
+            &hostperf_period,
+            hostperf_set_period },
     { "disassembling",
             "Disassembling features",
             NULL,
@@ -197,7 +384,7 @@ const env_t global_env[] = {
             "Mode 1 (ABI): zero, sp, a0, s5, etc.\n",
             vt_uint,
             &__rv_ireg_mock, // unused
-            rv32_debug_change_regnames },
+            change_rv_ireg },
     { "debugging",
             "Debugging features",
             NULL,
@@ -210,6 +397,116 @@ const env_t global_env[] = {
             vt_bool,
             &machine_trace,
             NULL },
+    { "fetchalerts",
+            "Report the first N failing instruction fetches",
+            "The RISC-V processors count the instruction fetches which "
+            "raise an exception (e.g. the instruction page faults of "
+            "a demand paging kernel) and the fetches from outside of the "
+            "physical memory, the counters are printed by the stat "
+            "command of the processors. Only the first N of them are "
+            "reported by each processor. Value 0 (default) reports "
+            "none.",
+            vt_uint,
+            &cpu_fetch_alerts,
+            NULL },
+    { "pcprofile",
+            "Sample the program counters every N machine cycles",
+            "Every N-th machine cycle the program counter and the "
+            "privilege mode of each processor are counted. The profile "
+            "is written by the pcprofile dump command and at the exit "
+            "(see the --pcprofile option), symbolized by the ELF files "
+            "given by the --symbols option. Value 0 (default) disables "
+            "the sampling. Setting the variable starts a new profile. "
+            "The cycles run in parallel are not sampled.",
+            vt_uint,
+            &pcprofile_period,
+            pcprofile_set_period },
+    { "callstacks",
+            "Keep the call stacks for the pcprofile samples",
+            "Each processor keeps a shadow call stack, pushed by the "
+            "jumps linking the return address register (jal and jalr "
+            "linking ra or t0, JAL, JALR, BGEZAL and BLTZAL) and popped "
+            "by the jumps to it (ret, JR ra). The stacks are sampled by "
+            "the pcprofile variable into the folded stacks. The other "
+            "instructions are not slowed down.",
+            vt_bool,
+            &callstack_enabled,
+            callstack_set },
+    { "coverage",
+            "Record the executed instructions",
+            "Set a bit for each executed instruction in a bitmap of its "
+            "virtual page. The coverage is written by the coverage dump "
+            "command and at the exit (see the --coverage option) as the "
+            "ranges of the executed instructions symbolized by the ELF "
+            "files given by the --symbols option, or in the drcov format. "
+            "Disabling the variable keeps the coverage collected so far.",
+            vt_bool,
+            &coverage_enabled,
+            NULL },
+    { "mixstat",
+            "Count the instruction mix and the memory accesses",
+            "Count the executions of each instruction implementation per "
+            "processor and the bytes read and written by the processors per "
+            "memory area and device. The counters are printed by the stat "
+            "command. Neither the instruction execution nor the memory "
+            "accesses are slowed down while the variable is not set.",
+            vt_bool,
+            &mixstat_enabled,
+            mixstat_set },
+    { "events",
+            "Record the system events",
+            "Record the exceptions and the interrupts taken (with the "
+            "cause, EPC and tval or BadVAddr), the interrupt lines raised "
+            "and cancelled, the TLB flushes and writes (SFENCE.VMA, TLBWI, "
+            "TLBWR), the address space switches (writes of satp, new ASID "
+            "in EntryHi) and the device register accesses. The events are "
+            "written into the trace file given by the --trace-file option, "
+            "printed as they happen if there is none. The instructions "
+            "are traced only in the trace mode.",
+            vt_bool,
+            &trace_events,
+            NULL },
+    { "flight",
+            "Record the last N instructions of each processor",
+            "Each processor keeps the last N executed instructions "
+            "(a straight-line run of instructions executed as a block "
+            "takes a single entry). The instructions are disassembled "
+            "when dnomem halts the machine, when the simulation is "
+            "broken by the user and by the flight command. Value 0 "
+            "(default) disables the recording, the value is rounded up "
+            "to a power of two.",
+            vt_uint,
+            &flight_size,
+            flight_set_size },
+    { "snapshots",
+            "Snapshot the machine every N cycles to run backwards",
+            "Every N-th machine cycle the machine state is saved into "
+            "a temporary snapshot, so that the back command and the "
+            "reverse step and reverse continue of the debugger can go "
+            "back by restoring an earlier snapshot and simulating again "
+            "up to the target cycle. Value 0 (default) disables the "
+            "snapshots and drops the ones taken. The cycles are not run "
+            "in parallel while the variable is set.",
+            vt_uint,
+            &reverse_interval,
+            reverse_set_interval },
+    { "cosim",
+            "Check the blocks against the interpreter",
+            "Each step in which a processor executes a block (see the "
+            "block and jit commands of the processors and the fast "
+            "variable) is executed again by the interpreter, one "
+            "instruction after another, from the state before the "
+            "step. The general registers, PC, the CSRs (resp. the "
+            "coprocessor 0 registers and the TLB) and the memory "
+            "written by the step have to end up the same. The first "
+            "divergence is reported with the disassembly of the "
+            "interpreted instructions and the simulation enters the "
+            "interactive mode. The steps accessing a device are not "
+            "checked. The cycles are not run in parallel while the "
+            "variable is set.",
+            vt_bool,
+            &cosim_enabled,
+            cosim_set },
     LAST_ENV
 };
 
@@ -17,8 +17,11 @@
 #include <unistd.h>
 
 #include "../config.h"
+#include "debug/memtrace.h"
+#include "debug/trace.h"
 #include "fault.h"
 #include "input.h"
+#include "output.h"
 #include "utils.h"
 
 /** Script name */
@@ -55,6 +58,7 @@ static void tty_ctrl(FILE *tty, unsigned int mode)
 
 static void mverror(unsigned int color, const char *fmt, va_list va)
 {
+    output_flush_all();
     fflush(stdout);
     tty_ctrl(stderr, CMD_RESET);
     tty_ctrl(stderr, CMD_BOLD);
@@ -175,6 +179,10 @@ void die(int status, const char *fmt, ...)
 
     string_done(&out);
 
+    /* Keep the trace leading to the fault */
+    trace_close();
+    memtrace_close();
+
     input_back();
     if (status == ERR_INTERN) {
         abort();
@@ -20,6 +20,9 @@
 #define ERR_INIT 3 /**< Initial script fails */
 #define ERR_PARM 4 /**< Invalid parameter */
 #define ERR_INTERN 5 /**< Internal error */
+#define ERR_BATCH 6 /**< Some batch test cases have failed */
+#define ERR_MISMATCH 7 /**< Output differs from the expected output */
+#define ERR_EXCEPTION 8 /**< User program terminated by an exception */
 
 /** Print error message to stderr */
 extern void error(const char *fmt, ...)
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Persistent fuzzing of the guest
+ *
+ *  A fuzzer linked with the simulator library (see msim_fuzz_start()
+ *  and msim_fuzz_run()) boots the guest once, up to the start marker
+ *  hypercall, and sets the reset point there. Each input is then run
+ *  from the reset point: the input hypercall copies the input into
+ *  the guest buffer and the run ends at the end marker hypercall,
+ *  at the halt of the machine or after the given number of cycles.
+ *  Returning to the reset point copies back only the memory frames
+ *  written by the input, the decoded instructions of the other frames
+ *  are kept.
+ *
+ *  Without a fuzzer, the markers do nothing and the input is empty,
+ *  so the guest runs as a single iteration.
+ *
+ */
+
+#include "fuzz.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "assert.h"
+#include "hypercall.h"
+#include "main.h"
+#include "physmem.h"
+#include "utils.h"
+
+fuzz_state_t fuzz_state = FUZZ_OFF;
+uint64_t fuzz_status = 0;
+
+/** Input of the current run (owned by the fuzzer) */
+static const uint8_t *fuzz_data = NULL;
+static size_t fuzz_size = 0;
+
+/** Run the machine up to the start marker
+ *
+ * The run stops after the marker instruction.
+ *
+ */
+void fuzz_boot(void)
+{
+    fuzz_state = FUZZ_BOOT;
+}
+
+/** Run an input from the reset point
+ *
+ * @param data Bytes of the input, kept by the caller during the run.
+ * @param size Number of the bytes.
+ *
+ */
+void fuzz_run(const uint8_t *data, size_t size)
+{
+    ASSERT((data != NULL) || (size == 0));
+
+    fuzz_data = data;
+    fuzz_size = size;
+    fuzz_status = 0;
+    fuzz_state = FUZZ_RUN;
+}
+
+/** Detach the fuzzer, the markers do nothing afterwards */
+void fuzz_stop(void)
+{
+    fuzz_data = NULL;
+    fuzz_size = 0;
+    fuzz_state = FUZZ_OFF;
+}
+
+/** Start marker hypercall
+ *
+ * Ends the boot of the fuzzer after the instruction.
+ *
+ * @return 0
+ *
+ */
+uint64_t fuzz_start_marker(void)
+{
+    if (fuzz_state == FUZZ_BOOT) {
+        fuzz_state = FUZZ_READY;
+        machine_interactive = true;
+    }
+
+    return 0;
+}
+
+/** Input hypercall
+ *
+ * Copies the current input into the guest memory, the bytes beyond
+ * the capacity of the buffer are cut off.
+ *
+ * @param addr     Physical address of the buffer.
+ * @param capacity Size of the buffer.
+ *
+ * @return Number of the bytes copied or HYPERCALL_ERROR if the buffer
+ *         does not lie in writable memory.
+ *
+ */
+uint64_t fuzz_input(ptr36_t addr, uint64_t capacity)
+{
+    if (fuzz_state != FUZZ_RUN) {
+        return 0;
+    }
+
+    uint64_t size = MIN(fuzz_size, capacity);
+
+    if (!physmem_write_block8(-1 /*NULL*/, addr, fuzz_data, size, true)) {
+        return HYPERCALL_ERROR;
+    }
+
+    return size;
+}
+
+/** End marker hypercall
+ *
+ * Ends the run of the input after the instruction.
+ *
+ * @param status Zero if the input has passed, a guest specific
+ *               code of the failure otherwise.
+ *
+ * @return 0
+ *
+ */
+uint64_t fuzz_end_marker(uint64_t status)
+{
+    if (fuzz_state == FUZZ_RUN) {
+        fuzz_status = status;
+        fuzz_state = FUZZ_ENDED;
+        machine_interactive = true;
+    }
+
+    return 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Persistent fuzzing of the guest
+ *
+ */
+
+#ifndef FUZZ_H_
+#define FUZZ_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "main.h"
+
+/** Stages of the fuzzing */
+typedef enum {
+    FUZZ_OFF, /**< No fuzzer attached, the markers do nothing */
+    FUZZ_BOOT, /**< Running up to the start marker */
+    FUZZ_READY, /**< Stopped after the start marker */
+    FUZZ_RUN, /**< Running an input */
+    FUZZ_ENDED /**< Stopped at the end marker */
+} fuzz_state_t;
+
+extern fuzz_state_t fuzz_state;
+
+/** Status given by the guest to the end marker */
+extern uint64_t fuzz_status;
+
+extern void fuzz_boot(void);
+extern void fuzz_run(const uint8_t *data, size_t size);
+extern void fuzz_stop(void);
+
+extern uint64_t fuzz_start_marker(void);
+extern uint64_t fuzz_input(ptr36_t addr, uint64_t capacity);
+extern uint64_t fuzz_end_marker(uint64_t status);
+
+#endif
@@ -0,0 +1,447 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Host performance counters by guest pages
+ *
+ *  The host cycles, cache misses and branch misses of the simulation
+ *  thread are counted by perf_event_open(). Every hostperf_period-th
+ *  event of a counter overflows it, the overflow signal is delivered
+ *  to the simulation thread and the handler counts the sample on the
+ *  guest page the processors execute. The table of the pages is
+ *  allocated beforehand and never grows, the samples of the pages
+ *  which do not fit are dropped (and counted).
+ *
+ *  Only the serial simulation loop is attributed. The samples taken
+ *  elsewhere (the interactive mode, the configuration, the processors
+ *  running in parallel) are counted as outside. With several processors,
+ *  a sample is counted on the page of each of them.
+ *
+ *  The counters missing on the host (e.g. in a virtual machine without
+ *  a virtual PMU) are left out, the host cycles are replaced by the
+ *  task clock (nanoseconds of the thread) then.
+ *
+ */
+
+/* F_SETSIG and F_SETOWN_EX */
+#define _GNU_SOURCE
+
+#include "hostperf.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../config.h"
+#include "assert.h"
+#include "device/cpu/general_cpu.h"
+#include "fault.h"
+#include "utils.h"
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/** Number of the counters */
+#define HOSTPERF_COUNTERS 3
+
+/** Slots of the page table (a power of 2) */
+#define HOSTPERF_SLOTS 4096
+
+/** Slots tried before the sample is dropped */
+#define HOSTPERF_PROBES 32
+
+/** Size of the attributed guest pages */
+#define HOSTPERF_PAGE_BITS 12
+
+/** Pages printed by the stat command */
+#define HOSTPERF_PRINTED 20
+
+/** Signal of the counter overflows */
+#define HOSTPERF_SIGNAL SIGPROF
+
+unsigned int hostperf_period = 0;
+volatile sig_atomic_t hostperf_running = false;
+
+/** Samples of a guest page */
+typedef struct {
+    uint64_t page;
+    unsigned int cpuno;
+    bool used;
+    uint64_t counts[HOSTPERF_COUNTERS];
+} hostperf_entry_t;
+
+/** Table of the sampled pages (open addressing hash table) */
+static hostperf_entry_t *slots = NULL;
+
+/** Names of the counters (NULL if not available) */
+static const char *names[HOSTPERF_COUNTERS];
+
+/** Counter file descriptors (-1 if not open) */
+static int fds[HOSTPERF_COUNTERS] = { -1, -1, -1 };
+
+/** Samples attributed to the pages */
+static uint64_t samples[HOSTPERF_COUNTERS];
+
+/** Samples taken outside of the simulation loop */
+static uint64_t outside[HOSTPERF_COUNTERS];
+
+/** Samples of the pages which did not fit into the table */
+static uint64_t dropped[HOSTPERF_COUNTERS];
+
+static size_t hostperf_hash(uint64_t page, unsigned int cpuno)
+{
+    uint64_t key = page ^ ((uint64_t) cpuno << 56);
+
+    /* Fibonacci hashing */
+    return (size_t) ((key * UINT64_C(0x9e3779b97f4a7c15)) >> 32) & (HOSTPERF_SLOTS - 1);
+}
+
+/** Find the slot of a page (NULL if the table is too full)
+ *
+ * Called by the signal handler, so nothing is allocated.
+ *
+ */
+static hostperf_entry_t *hostperf_slot(uint64_t page, unsigned int cpuno)
+{
+    size_t i = hostperf_hash(page, cpuno);
+
+    for (unsigned int probe = 0; probe < HOSTPERF_PROBES; probe++) {
+        hostperf_entry_t *entry = &slots[i];
+
+        if (!entry->used) {
+            entry->page = page;
+            entry->cpuno = cpuno;
+            entry->used = true;
+            return entry;
+        }
+
+        if ((entry->page == page) && (entry->cpuno == cpuno)) {
+            return entry;
+        }
+
+        i = (i + 1) & (HOSTPERF_SLOTS - 1);
+    }
+
+    return NULL;
+}
+
+/** Count a sample of a counter on the pages of the processors */
+static void hostperf_sample(unsigned int counter)
+{
+    unsigned int count = get_cpu_count();
+
+    if ((!hostperf_running) || (count == 0)) {
+        outside[counter]++;
+        return;
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+        general_cpu_t *cpu = get_cpu_by_index(i);
+        uint64_t page = cpu_get_pc(cpu).ptr >> HOSTPERF_PAGE_BITS;
+        hostperf_entry_t *entry = hostperf_slot(page, cpu->cpuno);
+
+        if (entry != NULL) {
+            entry->counts[counter]++;
+        } else {
+            dropped[counter]++;
+        }
+    }
+
+    samples[counter]++;
+}
+
+/** Forget the samples collected so far */
+static void hostperf_reset(void)
+{
+    if (slots != NULL) {
+        memset(slots, 0, HOSTPERF_SLOTS * sizeof(hostperf_entry_t));
+    }
+
+    memset(samples, 0, sizeof(samples));
+    memset(outside, 0, sizeof(outside));
+    memset(dropped, 0, sizeof(dropped));
+}
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+
+/** Handle the overflow of a counter
+ *
+ * The overflow disables the counter, it is enabled again
+ * for the next one.
+ *
+ */
+static void hostperf_signal(int sig, siginfo_t *info, void *context)
+{
+    int saved_errno = errno;
+
+    for (unsigned int i = 0; i < HOSTPERF_COUNTERS; i++) {
+        if ((fds[i] >= 0) && (fds[i] == info->si_fd)) {
+            hostperf_sample(i);
+            ioctl(fds[i], PERF_EVENT_IOC_REFRESH, 1);
+            break;
+        }
+    }
+
+    errno = saved_errno;
+}
+
+/** Open a counter of the calling thread
+ *
+ * @return File descriptor of the counter, -1 if not available.
+ *
+ */
+static int hostperf_open(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.sample_period = hostperf_period;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    int fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1,
+            PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    /* The overflow signals go to the simulation thread */
+    struct f_owner_ex owner = {
+        .type = F_OWNER_TID,
+        .pid = (pid_t) syscall(SYS_gettid)
+    };
+
+    if ((fcntl(fd, F_SETFL, O_ASYNC) != 0)
+            || (fcntl(fd, F_SETSIG, HOSTPERF_SIGNAL) != 0)
+            || (fcntl(fd, F_SETOWN_EX, &owner) != 0)) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/** Open the counters and start counting
+ *
+ * @return True if at least one counter is available.
+ *
+ */
+static bool hostperf_start(void)
+{
+    static bool handler_installed = false;
+
+    if (!handler_installed) {
+        struct sigaction act;
+
+        memset(&act, 0, sizeof(act));
+        act.sa_sigaction = hostperf_signal;
+        act.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&act.sa_mask);
+        sigaction(HOSTPERF_SIGNAL, &act, NULL);
+
+        handler_installed = true;
+    }
+
+    fds[0] = hostperf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    names[0] = "cycles";
+
+    if (fds[0] < 0) {
+        fds[0] = hostperf_open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+        names[0] = "task-clock";
+    }
+
+    fds[1] = hostperf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    names[1] = "cache-misses";
+
+    fds[2] = hostperf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    names[2] = "branch-misses";
+
+    bool any = false;
+
+    for (unsigned int i = 0; i < HOSTPERF_COUNTERS; i++) {
+        if (fds[i] < 0) {
+            alert("Host counter %s not available", names[i]);
+            names[i] = NULL;
+            continue;
+        }
+
+        ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fds[i], PERF_EVENT_IOC_REFRESH, 1);
+        any = true;
+    }
+
+    return any;
+}
+
+/** Stop counting and close the counters */
+static void hostperf_stop(void)
+{
+    for (unsigned int i = 0; i < HOSTPERF_COUNTERS; i++) {
+        int fd = fds[i];
+
+        if (fd >= 0) {
+            fds[i] = -1;
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            close(fd);
+        }
+    }
+}
+
+#else
+
+static bool hostperf_start(void)
+{
+    alert("Host performance counters are not supported on this host");
+    return false;
+}
+
+static void hostperf_stop(void)
+{
+}
+
+#endif
+
+/** Change the hostperf variable
+ *
+ * The samples collected so far are forgotten.
+ *
+ * @param period Number of host events between the samples
+ *               (0 disables the sampling).
+ *
+ * @return True if the sampling is as requested.
+ *
+ */
+bool hostperf_set_period(unsigned int period)
+{
+    hostperf_stop();
+    hostperf_reset();
+    hostperf_period = period;
+
+    if (period == 0) {
+        return true;
+    }
+
+    if (slots == NULL) {
+        slots = (hostperf_entry_t *)
+                safe_malloc(HOSTPERF_SLOTS * sizeof(hostperf_entry_t));
+        hostperf_reset();
+    }
+
+    if (!hostperf_start()) {
+        hostperf_stop();
+        hostperf_period = 0;
+        return false;
+    }
+
+    return true;
+}
+
+/** Order of the pages by the samples of the first counter (most first) */
+static int entry_compare(const void *a, const void *b)
+{
+    const hostperf_entry_t *ea = (const hostperf_entry_t *) a;
+    const hostperf_entry_t *eb = (const hostperf_entry_t *) b;
+
+    for (unsigned int i = 0; i < HOSTPERF_COUNTERS; i++) {
+        if (ea->counts[i] != eb->counts[i]) {
+            return (ea->counts[i] > eb->counts[i]) ? -1 : 1;
+        }
+    }
+
+    if (ea->page != eb->page) {
+        return (ea->page < eb->page) ? -1 : 1;
+    }
+
+    return (ea->cpuno < eb->cpuno) ? -1 : (ea->cpuno > eb->cpuno);
+}
+
+static double hostperf_share(uint64_t count, uint64_t total)
+{
+    return (total > 0) ? 100.0 * count / total : 0;
+}
+
+/** Print the host cost table of the guest pages */
+void hostperf_print(void)
+{
+    if (hostperf_period == 0) {
+        return;
+    }
+
+    printf("Host counters by guest page (1 of %u events sampled):\n",
+            hostperf_period);
+    printf("  %-14s %10s %10s %10s\n", "counter", "samples", "outside", "dropped");
+
+    for (unsigned int i = 0; i < HOSTPERF_COUNTERS; i++) {
+        if (names[i] != NULL) {
+            printf("  %-14s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+                    names[i], samples[i], outside[i], dropped[i]);
+        }
+    }
+
+    /* Sort a copy of the used slots */
+    hostperf_entry_t *entries = (hostperf_entry_t *)
+            safe_malloc(HOSTPERF_SLOTS * sizeof(hostperf_entry_t));
+    size_t count = 0;
+
+    for (size_t i = 0; i < HOSTPERF_SLOTS; i++) {
+        if (slots[i].used) {
+            entries[count++] = slots[i];
+        }
+    }
+
+    qsort(entries, count, sizeof(hostperf_entry_t), entry_compare);
+
+    printf("  %4s  %-18s", "cpu", "page");
+    for (unsigned int i = 0; i < HOSTPERF_COUNTERS; i++) {
+        if (names[i] != NULL) {
+            printf(" %14s %7s", names[i], "share");
+        }
+    }
+    printf("\n");
+
+    for (size_t i = 0; (i < count) && (i < HOSTPERF_PRINTED); i++) {
+        printf("  %4u  %#018" PRIx64, entries[i].cpuno,
+                entries[i].page << HOSTPERF_PAGE_BITS);
+
+        for (unsigned int j = 0; j < HOSTPERF_COUNTERS; j++) {
+            if (names[j] != NULL) {
+                printf(" %14" PRIu64 " %6.2f%%", entries[i].counts[j],
+                        hostperf_share(entries[i].counts[j], samples[j]));
+            }
+        }
+
+        printf("\n");
+    }
+
+    if (count > HOSTPERF_PRINTED) {
+        printf("  (%zu more pages)\n", count - HOSTPERF_PRINTED);
+    }
+
+    safe_free(entries);
+}
+
+/** Stop the sampling and release the table */
+void hostperf_done(void)
+{
+    hostperf_stop();
+    hostperf_period = 0;
+    hostperf_running = false;
+    safe_free(slots);
+}
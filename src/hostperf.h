@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Host performance counters by guest pages
+ *
+ */
+
+#ifndef HOSTPERF_H_
+#define HOSTPERF_H_
+
+#include <signal.h>
+#include <stdbool.h>
+
+/** Number of host events between the samples (0 = no sampling) */
+extern unsigned int hostperf_period;
+
+/** True while the simulation loop runs (the samples are attributed) */
+extern volatile sig_atomic_t hostperf_running;
+
+extern bool hostperf_set_period(unsigned int period);
+extern void hostperf_print(void);
+extern void hostperf_done(void);
+
+#endif
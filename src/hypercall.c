@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Paravirtual hypercalls of the guest
+ *
+ *  The guest asks the simulator to do a whole operation by a special
+ *  instruction (DHC on R4000, EHCALL on RISC-V) instead of emulating
+ *  thousands of accesses to the device registers: print a buffer by
+ *  a printer, move sectors between a disk and the memory, read the
+ *  time, or mark the iterations of a fuzzer (see fuzz.c). The buffers
+ *  are given by their physical addresses, the devices by their order
+ *  among the devices of their type.
+ *
+ */
+
+#include "hypercall.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "device/ddisk.h"
+#include "device/device.h"
+#include "device/dprinter.h"
+#include "device/mem.h"
+#include "fuzz.h"
+#include "main.h"
+#include "parallel.h"
+#include "physmem.h"
+#include "replay.h"
+#include "utils.h"
+
+/** Size of the chunks of the printed buffers */
+#define CONSOLE_CHUNK 4096
+
+/** Device of a type by its order
+ *
+ * @param type  Device type
+ * @param index Order of the device among the devices of the type
+ *
+ * @return Device or NULL if there are fewer devices
+ *
+ */
+static device_t *hypercall_device(const device_type_t *type, uint64_t index)
+{
+    device_t *dev = NULL;
+
+    while (dev_next(&dev, DEVICE_FILTER_ALL)) {
+        if (dev->type == type) {
+            if (index == 0) {
+                return dev;
+            }
+
+            index--;
+        }
+    }
+
+    return NULL;
+}
+
+/** Print a buffer by a printer
+ *
+ * @param index Order of the printer
+ * @param addr  Physical address of the buffer
+ * @param len   Length of the buffer
+ *
+ * @return Number of printed characters
+ *
+ */
+static uint64_t hypercall_console_write(uint64_t index, ptr36_t addr, uint64_t len)
+{
+    device_t *dev = hypercall_device(&dprinter, index);
+    if (dev == NULL) {
+        return HYPERCALL_ERROR;
+    }
+
+    char buf[CONSOLE_CHUNK];
+    uint64_t done = 0;
+
+    while (done < len) {
+        size_t chunk = (len - done < CONSOLE_CHUNK) ? len - done : CONSOLE_CHUNK;
+
+        physmem_read_block8(-1 /*NULL*/, addr + done, (uint8_t *) buf, chunk, true);
+        dprinter_write(dev, buf, chunk);
+        done += chunk;
+    }
+
+    return done;
+}
+
+/** Move sectors between a disk and the memory
+ *
+ * @param index Order of the disk
+ * @param secno First sector
+ * @param count Number of sectors
+ * @param addr  Physical address of the buffer
+ * @param write Write the sectors (read otherwise)
+ *
+ * @return 0 or HYPERCALL_ERROR
+ *
+ */
+static uint64_t hypercall_disk(uint64_t index, uint64_t secno, uint64_t count,
+        ptr36_t addr, bool write)
+{
+    device_t *dev = hypercall_device(&ddisk, index);
+
+    if ((dev == NULL) || (!ddisk_transfer_block(dev, secno, count, addr, write))) {
+        return HYPERCALL_ERROR;
+    }
+
+    return 0;
+}
+
+/** Monotonic time in microseconds
+ *
+ * Derived from the machine cycle counter (one microsecond per cycle)
+ * unless the simulation is non-deterministic, which reads the host
+ * clock.
+ *
+ */
+static uint64_t hypercall_time(void)
+{
+    if (!machine_nondet) {
+        return steps;
+    }
+
+    static unsigned int replay = UINT_MAX;
+    if (replay == UINT_MAX) {
+        replay = replay_source("hypercall");
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return replay_value(replay, ((uint64_t) ts.tv_sec) * 1000000 + ts.tv_nsec / 1000);
+}
+
+/** Return free memory of the guest to the host
+ *
+ * The frames of the range have to lie in writable generic memory,
+ * nothing is discarded otherwise. The range reads as zeros afterwards.
+ *
+ * @param addr Physical address of the range (frame aligned)
+ * @param len  Length of the range (frame aligned)
+ *
+ * @return 0 or HYPERCALL_ERROR
+ *
+ */
+static uint64_t hypercall_free_pages(ptr36_t addr, uint64_t len)
+{
+    if ((!ptr36_frame_aligned(addr)) || (!ptr36_frame_aligned(len))
+            || (!phys_range(addr)) || (!phys_range(addr + len))
+            || (addr + len < addr)) {
+        return HYPERCALL_ERROR;
+    }
+
+    ptr36_t end = addr + len;
+
+    for (ptr36_t page = addr; page < end; page += FRAME_SIZE) {
+        frame_t *frame = physmem_find_frame(page);
+
+        if ((frame == NULL) || (frame->area->type != MEMT_MEM)
+                || (!frame->area->writable)) {
+            return HYPERCALL_ERROR;
+        }
+    }
+
+    /* The range is discarded by the parts lying in the areas */
+    while (addr < end) {
+        physmem_area_t *area = physmem_find_frame(addr)->area;
+        ptr36_t area_end = FRAME2ADDR(area->start + area->count);
+        ptr36_t part_end = (end < area_end) ? end : area_end;
+
+        mem_discard(area, addr, part_end - addr);
+        addr = part_end;
+    }
+
+    return 0;
+}
+
+/** Execute a hypercall
+ *
+ * @param no   Hypercall number
+ * @param args Arguments of the hypercall
+ *
+ * @return Result of the hypercall, HYPERCALL_ERROR if it has failed
+ *         or is not known
+ *
+ */
+uint64_t hypercall(uint64_t no, const uint64_t args[HYPERCALL_ARGS])
+{
+    uint64_t result;
+
+    /* The devices are shared with the other processors */
+    machine_lock();
+
+    switch (no) {
+    case HYPERCALL_CONSOLE_WRITE:
+        result = hypercall_console_write(args[0], args[1], args[2]);
+        break;
+    case HYPERCALL_DISK_READ:
+        result = hypercall_disk(args[0], args[1], args[2], args[3], false);
+        break;
+    case HYPERCALL_DISK_WRITE:
+        result = hypercall_disk(args[0], args[1], args[2], args[3], true);
+        break;
+    case HYPERCALL_TIME:
+        result = hypercall_time();
+        break;
+    case HYPERCALL_FREE_PAGES:
+        result = hypercall_free_pages(args[0], args[1]);
+        break;
+    case HYPERCALL_FUZZ_START:
+        result = fuzz_start_marker();
+        break;
+    case HYPERCALL_FUZZ_INPUT:
+        result = fuzz_input(args[0], args[1]);
+        break;
+    case HYPERCALL_FUZZ_END:
+        result = fuzz_end_marker(args[0]);
+        break;
+    default:
+        result = HYPERCALL_ERROR;
+    }
+
+    machine_unlock();
+    return result;
+}
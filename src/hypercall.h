@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Paravirtual hypercalls of the guest
+ *
+ */
+
+#ifndef HYPERCALL_H_
+#define HYPERCALL_H_
+
+#include <stdint.h>
+
+/** Hypercall numbers */
+typedef enum {
+    HYPERCALL_CONSOLE_WRITE = 1, /**< Print a buffer by a printer */
+    HYPERCALL_DISK_READ = 2, /**< Read sectors of a disk into memory */
+    HYPERCALL_DISK_WRITE = 3, /**< Write sectors of a disk from memory */
+    HYPERCALL_TIME = 4, /**< Monotonic time in microseconds */
+    HYPERCALL_FREE_PAGES = 5, /**< Return free memory to the host */
+    HYPERCALL_FUZZ_START = 6, /**< Point the fuzzer returns to */
+    HYPERCALL_FUZZ_INPUT = 7, /**< Copy the fuzzer input into memory */
+    HYPERCALL_FUZZ_END = 8 /**< End of the fuzzer iteration */
+} hypercall_no_t;
+
+/** Number of hypercall arguments */
+#define HYPERCALL_ARGS 4
+
+/** Result of a failed hypercall */
+#define HYPERCALL_ERROR UINT64_MAX
+
+extern uint64_t hypercall(uint64_t no, const uint64_t args[HYPERCALL_ARGS]);
+
+#endif
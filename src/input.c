@@ -18,11 +18,14 @@
 
 #include "../config.h"
 #include "arch/console.h"
+#include "arch/stdin.h"
 #include "assert.h"
 #include "cmd.h"
+#include "debug/flight.h"
 #include "fault.h"
 #include "input.h"
 #include "main.h"
+#include "output.h"
 #include "parser.h"
 #include "utils.h"
 
@@ -142,8 +145,20 @@ void input_back(void)
  */
 void interactive_control(void)
 {
+    output_flush_all();
+
+    /* Show what has led to the user break */
+    if ((flight_requested) && (machine_newline)) {
+        printf("\n");
+        machine_newline = false;
+    }
+
+    flight_dump_requested();
     machine_break = false;
 
+    /* The commands are read from the input of the keyboard */
+    stdin_pause();
+
     if (machine_newline) {
         printf("\n");
         machine_newline = false;
@@ -174,6 +189,8 @@ void interactive_control(void)
 
         free(cmdline);
     }
+
+    stdin_resume();
 }
 
 /**
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Host I/O thread of the devices
+ *
+ *  The devices configured to do so hand their host writes over to
+ *  a thread of their own, so that the latency of the host files and
+ *  of the terminal stays off the simulation thread. The writes are
+ *  queued in a single-producer single-consumer ring, the producer
+ *  is the simulation (the devices are accessed under the machine
+ *  lock while the processors run in parallel) and the consumer is
+ *  the I/O thread. The thread is started by the first write and
+ *  sleeps while the ring is empty.
+ *
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "assert.h"
+#include "iothread.h"
+
+/** Write queued for the I/O thread */
+typedef struct {
+    FILE *file;
+    size_t len;
+    char data[IOTHREAD_CHUNK];
+} iothread_slot_t;
+
+static iothread_slot_t iothread_slots[IOTHREAD_SLOTS];
+
+/** Number of the writes queued (advanced by the producer only) */
+static uint64_t iothread_head = 0;
+
+/** Number of the writes done (advanced by the I/O thread only) */
+static uint64_t iothread_tail = 0;
+
+/** The I/O thread waits for a write */
+static bool iothread_sleeping = false;
+
+static bool iothread_started = false;
+
+/** The I/O thread could not be started, the writes are done directly */
+static bool iothread_failed = false;
+
+/** Guard of the sleeping of both sides */
+static pthread_mutex_t iothread_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Signaled when a write is queued */
+static pthread_cond_t iothread_queued = PTHREAD_COND_INITIALIZER;
+
+/** Signaled when a write is done */
+static pthread_cond_t iothread_written = PTHREAD_COND_INITIALIZER;
+
+/** Body of the I/O thread
+ *
+ * Each write is flushed right away, the output reaches
+ * the host file as soon as the thread gets to it.
+ *
+ */
+static void *iothread_main(void *arg)
+{
+    uint64_t tail = 0;
+
+    while (true) {
+        if (__atomic_load_n(&iothread_head, __ATOMIC_SEQ_CST) == tail) {
+            pthread_mutex_lock(&iothread_mutex);
+            __atomic_store_n(&iothread_sleeping, true, __ATOMIC_SEQ_CST);
+
+            while (__atomic_load_n(&iothread_head, __ATOMIC_SEQ_CST) == tail) {
+                pthread_cond_wait(&iothread_queued, &iothread_mutex);
+            }
+
+            __atomic_store_n(&iothread_sleeping, false, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&iothread_mutex);
+        }
+
+        iothread_slot_t *slot = &iothread_slots[tail % IOTHREAD_SLOTS];
+        fwrite(slot->data, 1, slot->len, slot->file);
+        fflush(slot->file);
+
+        pthread_mutex_lock(&iothread_mutex);
+        __atomic_store_n(&iothread_tail, ++tail, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&iothread_written);
+        pthread_mutex_unlock(&iothread_mutex);
+    }
+
+    return NULL;
+}
+
+/** Start the I/O thread unless running already
+ *
+ * @return False if the thread cannot be started.
+ *
+ */
+static bool iothread_start(void)
+{
+    if (iothread_started) {
+        return true;
+    }
+
+    if (iothread_failed) {
+        return false;
+    }
+
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, iothread_main, NULL) != 0) {
+        iothread_failed = true;
+        return false;
+    }
+
+    pthread_detach(thread);
+    iothread_started = true;
+    return true;
+}
+
+/** Wait until the I/O thread has done the writes up to a number
+ *
+ */
+static void iothread_wait(uint64_t count)
+{
+    if (__atomic_load_n(&iothread_tail, __ATOMIC_ACQUIRE) >= count) {
+        return;
+    }
+
+    pthread_mutex_lock(&iothread_mutex);
+
+    while (__atomic_load_n(&iothread_tail, __ATOMIC_ACQUIRE) < count) {
+        pthread_cond_wait(&iothread_written, &iothread_mutex);
+    }
+
+    pthread_mutex_unlock(&iothread_mutex);
+}
+
+/** Queue a write for the I/O thread
+ *
+ * The bytes are copied, the simulation only waits when the ring is
+ * full. The file is written directly if the thread cannot be started.
+ *
+ * @param file Target file.
+ * @param buf  Bytes to write.
+ * @param len  Number of the bytes (at most IOTHREAD_CHUNK).
+ *
+ */
+void iothread_write(FILE *file, const char *buf, size_t len)
+{
+    ASSERT(file != NULL);
+    ASSERT(len <= IOTHREAD_CHUNK);
+
+    if (!iothread_start()) {
+        fwrite(buf, 1, len, file);
+        fflush(file);
+        return;
+    }
+
+    uint64_t head = iothread_head;
+
+    if (head >= IOTHREAD_SLOTS) {
+        iothread_wait(head - IOTHREAD_SLOTS + 1);
+    }
+
+    iothread_slot_t *slot = &iothread_slots[head % IOTHREAD_SLOTS];
+    slot->file = file;
+    slot->len = len;
+    memcpy(slot->data, buf, len);
+
+    __atomic_store_n(&iothread_head, head + 1, __ATOMIC_SEQ_CST);
+
+    /* Either the thread sees the write or it is woken up */
+    if (__atomic_load_n(&iothread_sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&iothread_mutex);
+        pthread_cond_signal(&iothread_queued);
+        pthread_mutex_unlock(&iothread_mutex);
+    }
+}
+
+/** Wait until the I/O thread has done all the queued writes
+ *
+ * Called before the target files are closed and before the simulator
+ * prints anything itself, so that the order of the output is kept.
+ *
+ */
+void iothread_drain(void)
+{
+    iothread_wait(iothread_head);
+}
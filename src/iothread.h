@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Host I/O thread of the devices
+ *
+ */
+
+#ifndef IOTHREAD_H_
+#define IOTHREAD_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "output.h"
+
+/** Number of the writes queued for the I/O thread at most */
+#define IOTHREAD_SLOTS 16
+
+/** Number of bytes of a single queued write at most */
+#define IOTHREAD_CHUNK OUTPUT_BUFFER_SIZE
+
+extern void iothread_write(FILE *file, const char *buf, size_t len);
+extern void iothread_drain(void);
+
+#endif
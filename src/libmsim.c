@@ -0,0 +1,521 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Embeddable simulator library
+ *
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "assert.h"
+#include "checkpoint.h"
+#include "cmd.h"
+#include "debug/breakpoint.h"
+#include "debug/coverage.h"
+#include "debug/statsrv.h"
+#include "device/cpu/general_cpu.h"
+#include "device/device.h"
+#include "device/cpu/mips_r4000/debug.h"
+#include "fault.h"
+#include "fuzz.h"
+#include "libmsim.h"
+#include "machine.h"
+#include "main.h"
+#include "output.h"
+#include "physmem.h"
+
+/** This is necessary evil... */
+#include "device/cpu/riscv_rv32ima/debug.h"
+#undef XLEN
+#include "device/cpu/riscv_rv64ima/debug.h"
+#undef XLEN
+
+#include "device/cpu/isa.h"
+
+struct msim_machine {
+    /** The machine was created and not destroyed yet */
+    bool alive;
+};
+
+/** The only machine of the process */
+static msim_machine_t machine_instance = { .alive = false };
+
+/** Create an empty machine
+ *
+ * @return The machine or NULL if another machine exists.
+ *
+ */
+msim_machine_t *msim_machine_create(void)
+{
+    if (machine_instance.alive) {
+        return NULL;
+    }
+
+#if ISA_R4K
+    r4k_debug_init();
+#endif
+#if ISA_RV32
+    rv32_debug_init();
+#endif
+#if ISA_RV64
+    rv64_debug_init();
+#endif
+
+    machine_instance.alive = true;
+    return &machine_instance;
+}
+
+/** Destroy a machine and free all its devices
+ *
+ */
+void msim_machine_destroy(msim_machine_t *machine)
+{
+    ASSERT(machine == &machine_instance);
+    ASSERT(machine->alive);
+
+    output_flush_all();
+    fuzz_stop();
+    coverage_set_edges(NULL, 0);
+    machine_done();
+
+    machine->alive = false;
+}
+
+/** Add the devices and run the commands of a configuration file
+ *
+ * The errors are printed as by the simulator binary. The commands
+ * before the erroneous line stay in effect.
+ *
+ * @return False if the file cannot be read or contains an error.
+ *
+ */
+bool msim_load_config(msim_machine_t *machine, const char *fname)
+{
+    ASSERT(machine == &machine_instance);
+    ASSERT(machine->alive);
+
+    return script_load(fname);
+}
+
+/** Run the machine
+ *
+ * The run ends after the given number of cycles, when the machine
+ * halts or when it stops at a breakpoint (or on any other request
+ * of the interactive mode, which is not entered).
+ *
+ * @return Number of cycles simulated.
+ *
+ */
+uint64_t msim_run(msim_machine_t *machine, uint64_t cycles)
+{
+    ASSERT(machine == &machine_instance);
+    ASSERT(machine->alive);
+
+    return machine_run_cycles(cycles);
+}
+
+/** Return the machine to its reset point
+ *
+ * The reset point is set by the `reset point' command, typically
+ * at the end of the configuration. The halted machine runs again.
+ *
+ * @return False if there is no reset point.
+ *
+ */
+bool msim_reset(msim_machine_t *machine)
+{
+    ASSERT(machine == &machine_instance);
+    ASSERT(machine->alive);
+
+    if (!checkpoint_reset()) {
+        return false;
+    }
+
+    machine_halt = false;
+    return true;
+}
+
+/** Check whether the machine halted */
+bool msim_halted(const msim_machine_t *machine)
+{
+    ASSERT(machine == &machine_instance);
+
+    return machine_halt;
+}
+
+/** Number of cycles the machine has simulated */
+uint64_t msim_cycles(const msim_machine_t *machine)
+{
+    ASSERT(machine == &machine_instance);
+
+    return steps;
+}
+
+/** Read the physical memory of the machine
+ *
+ * The memory is read as by a device, the bytes outside of
+ * the memory read as by the processors.
+ *
+ * @param addr Physical address of the first byte.
+ * @param buf  Buffer receiving the bytes.
+ * @param size Number of bytes to read.
+ *
+ */
+void msim_read_mem(msim_machine_t *machine, uint64_t addr,
+        void *buf, size_t size)
+{
+    ASSERT(machine == &machine_instance);
+    ASSERT(machine->alive);
+    ASSERT(buf != NULL);
+
+    physmem_read_block8(-1 /*NULL*/, addr, (uint8_t *) buf, size, false);
+}
+
+/** Write the physical memory of the machine
+ *
+ * The memory is written as by a device, so the decoded instructions
+ * of the bytes written are dropped and the writes are undone by
+ * a return to the reset point.
+ *
+ * @param addr Physical address of the first byte.
+ * @param buf  Bytes to write.
+ * @param size Number of bytes to write.
+ *
+ * @return False if some of the bytes are not in writable memory.
+ *
+ */
+bool msim_write_mem(msim_machine_t *machine, uint64_t addr,
+        const void *buf, size_t size)
+{
+    ASSERT(machine == &machine_instance);
+    ASSERT(machine->alive);
+    ASSERT(buf != NULL);
+
+    return physmem_write_block8(-1 /*NULL*/, addr, (const uint8_t *) buf,
+            size, false);
+}
+
+/** Describe a memory area of the machine
+ *
+ * The contents are the memory of the machine itself, so they can be
+ * read without copying (e.g. by the Python bindings). They must not
+ * be written, use msim_write_mem() instead. The description is valid
+ * until the next configuration or the destruction of the machine.
+ *
+ * @param index Index of the memory area (in the order of the devices).
+ *
+ * @return False if there is no such area.
+ *
+ */
+bool msim_mem_area(msim_machine_t *machine, size_t index, msim_mem_area_t *area)
+{
+    ASSERT(machine == &machine_instance);
+    ASSERT(machine->alive);
+    ASSERT(area != NULL);
+
+    device_t *dev = NULL;
+
+    while (dev_next(&dev, DEVICE_FILTER_MEMORY)) {
+        physmem_area_t *mem = (physmem_area_t *) dev->data;
+
+        if ((mem->type == MEMT_NONE) || (mem->count == 0)) {
+            continue;
+        }
+
+        if (index-- > 0) {
+            continue;
+        }
+
+        area->name = dev->name;
+        area->addr = FRAME2ADDR(mem->start);
+        area->size = FRAMES2SIZE(mem->count);
+        area->data = mem->data;
+        area->writable = mem->writable;
+        return true;
+    }
+
+    return false;
+}
+
+/** Registers of a processor (NULL if there is no such processor) */
+static const cpu_regs_t *msim_cpu_regs(unsigned int cpuno)
+{
+    general_cpu_t *cpu = get_cpu(cpuno);
+
+    return (cpu != NULL) ? cpu_regs(cpu) : NULL;
+}
+
+/** Number of the registers of a processor
+ *
+ * The registers are numbered as by the debugger (see gdb.c).
+ *
+ * @return Zero if there is no such processor.
+ *
+ */
+unsigned int msim_reg_count(msim_machine_t *machine, unsigned int cpuno)
+{
+    ASSERT(machine == &machine_instance);
+    ASSERT(machine->alive);
+
+    const cpu_regs_t *regs = msim_cpu_regs(cpuno);
+
+    return (regs != NULL) ? regs->count : 0;
+}
+
+/** Name of a register of a processor
+ *
+ * @return NULL if the register has no name (the registers of R4000
+ *         are known by their numbers only).
+ *
+ */
+const char *msim_reg_name(msim_machine_t *machine, unsigned int cpuno,
+        unsigned int reg)
+{
+    ASSERT(machine == &machine_instance);
+    ASSERT(machine->alive);
+
+    const cpu_regs_t *regs = msim_cpu_regs(cpuno);
+
+    if ((regs == NULL) || (regs->names == NULL) || (reg >= regs->count)) {
+        return NULL;
+    }
+
+    return regs->names[reg];
+}
+
+/** Read a register of a processor
+ *
+ * @return False if there is no such processor or register.
+ *
+ */
+bool msim_read_reg(msim_machine_t *machine, unsigned int cpuno,
+        unsigned int reg, uint64_t *value)
+{
+    ASSERT(machine == &machine_instance);
+    ASSERT(machine->alive);
+    ASSERT(value != NULL);
+
+    general_cpu_t *cpu = get_cpu(cpuno);
+
+    return (cpu != NULL) && cpu_reg_read(cpu, reg, value);
+}
+
+/** Write a register of a processor
+ *
+ * @return False if there is no such processor or register.
+ *
+ */
+bool msim_write_reg(msim_machine_t *machine, unsigned int cpuno,
+        unsigned int reg, uint64_t value)
+{
+    ASSERT(machine == &machine_instance);
+    ASSERT(machine->alive);
+
+    general_cpu_t *cpu = get_cpu(cpuno);
+
+    return (cpu != NULL) && cpu_reg_write(cpu, reg, value);
+}
+
+/** Read the address of the next instruction of a processor
+ *
+ * @return False if there is no such processor.
+ *
+ */
+bool msim_read_pc(msim_machine_t *machine, unsigned int cpuno, uint64_t *pc)
+{
+    ASSERT(machine == &machine_instance);
+    ASSERT(machine->alive);
+    ASSERT(pc != NULL);
+
+    general_cpu_t *cpu = get_cpu(cpuno);
+
+    if (cpu == NULL) {
+        return false;
+    }
+
+    *pc = cpu_get_pc(cpu).ptr;
+    return true;
+}
+
+/** Set a code breakpoint
+ *
+ * The run stops before the processor executes the instruction
+ * at the virtual address, the next run steps over it.
+ *
+ * @return False if there is no such processor.
+ *
+ */
+bool msim_break_insert(msim_machine_t *machine, unsigned int cpuno,
+        uint64_t addr)
+{
+    ASSERT(machine == &machine_instance);
+    ASSERT(machine->alive);
+
+    general_cpu_t *cpu = get_cpu(cpuno);
+    ptr64_t pc = { .ptr = addr };
+
+    if (cpu == NULL) {
+        return false;
+    }
+
+    if (breakpoint_code_find(cpuno, pc, BREAKPOINT_FILTER_SIMULATOR) == NULL) {
+        cpu_insert_breakpoint(cpu, pc, BREAKPOINT_KIND_SIMULATOR);
+    }
+
+    return true;
+}
+
+/** Remove a code breakpoint
+ *
+ * @return False if there is no such breakpoint.
+ *
+ */
+bool msim_break_remove(msim_machine_t *machine, unsigned int cpuno,
+        uint64_t addr)
+{
+    ASSERT(machine == &machine_instance);
+    ASSERT(machine->alive);
+
+    ptr64_t pc = { .ptr = addr };
+
+    return (get_cpu(cpuno) != NULL)
+            && breakpoint_code_remove(cpuno, pc, BREAKPOINT_FILTER_SIMULATOR);
+}
+
+/** Statistics visitor of msim_stats() */
+typedef struct {
+    msim_stat_fnc_t fnc;
+    void *arg;
+} msim_stats_visit_t;
+
+static void msim_stats_visit(void *arg, const char *device, const char *name,
+        const char *labels, bool counter, uint64_t count, double value)
+{
+    msim_stats_visit_t *visit = (msim_stats_visit_t *) arg;
+    msim_stat_t stat = {
+        .device = device,
+        .name = name,
+        .labels = labels,
+        .counter = counter,
+        .count = count,
+        .value = value
+    };
+
+    visit->fnc(&stat, visit->arg);
+}
+
+/** Pass the statistics of the machine and of its devices to a visitor
+ *
+ * The statistics are those of the statistics endpoint (see statsrv.c).
+ * The strings of a statistic are valid during the call only.
+ *
+ */
+void msim_stats(msim_machine_t *machine, msim_stat_fnc_t fnc, void *arg)
+{
+    ASSERT(machine == &machine_instance);
+    ASSERT(machine->alive);
+    ASSERT(fnc != NULL);
+
+    msim_stats_visit_t visit = { .fnc = fnc, .arg = arg };
+    statsrv_visit(msim_stats_visit, &visit);
+}
+
+/** Boot the machine for fuzzing
+ *
+ * The machine runs until the guest executes the start marker
+ * hypercall, the state after the marker is the reset point
+ * every input starts from.
+ *
+ * @param cycles Most cycles to run.
+ *
+ * @return False if the start marker has not been reached (the machine
+ *         halted or the cycles ran out) or the reset point cannot
+ *         be set.
+ *
+ */
+bool msim_fuzz_start(msim_machine_t *machine, uint64_t cycles)
+{
+    ASSERT(machine == &machine_instance);
+    ASSERT(machine->alive);
+
+    fuzz_boot();
+    machine_run_cycles(cycles);
+
+    if ((fuzz_state != FUZZ_READY) || (!checkpoint_reset_mark())) {
+        fuzz_stop();
+        return false;
+    }
+
+    return true;
+}
+
+/** Count the edges of the guest code in a coverage map
+ *
+ * The edges between the executed blocks are hashed into the counters
+ * as by AFL, so the map can be the shared memory of AFL or the extra
+ * counters of libFuzzer.
+ *
+ * @param map  Counters (NULL stops counting).
+ * @param size Number of the counters (a power of 2).
+ *
+ */
+void msim_fuzz_map(msim_machine_t *machine, uint8_t *map, size_t size)
+{
+    ASSERT(machine == &machine_instance);
+    ASSERT(machine->alive);
+
+    coverage_set_edges(map, size);
+}
+
+/** Run a fuzzer input
+ *
+ * The machine returns to the reset point set by msim_fuzz_start(),
+ * the input hypercall of the guest copies the input into its memory
+ * and the run ends at the end marker hypercall, at the halt of the
+ * machine or after the cycles.
+ *
+ * @param data   Bytes of the input.
+ * @param size   Number of the bytes.
+ * @param cycles Most cycles to run.
+ *
+ * @return Outcome of the input.
+ *
+ */
+msim_fuzz_result_t msim_fuzz_run(msim_machine_t *machine,
+        const uint8_t *data, size_t size, uint64_t cycles)
+{
+    ASSERT(machine == &machine_instance);
+    ASSERT(machine->alive);
+    ASSERT((fuzz_state == FUZZ_READY) || (fuzz_state == FUZZ_ENDED)
+            || (fuzz_state == FUZZ_RUN));
+
+    if (!checkpoint_reset()) {
+        die(ERR_IO, "Unable to return to the fuzzing reset point");
+    }
+
+    machine_halt = false;
+    coverage_edges_restart();
+    fuzz_run(data, size);
+
+    machine_run_cycles(cycles);
+
+    if (fuzz_state == FUZZ_ENDED) {
+        return (fuzz_status == 0) ? MSIM_FUZZ_PASS : MSIM_FUZZ_FAIL;
+    }
+
+    return machine_halt ? MSIM_FUZZ_HALT : MSIM_FUZZ_TIMEOUT;
+}
+
+/** Status given by the guest to the end marker of the last input */
+uint64_t msim_fuzz_status(const msim_machine_t *machine)
+{
+    ASSERT(machine == &machine_instance);
+
+    return fuzz_status;
+}
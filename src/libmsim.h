@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Embeddable simulator library
+ *
+ *  A program linked with libmsim.a configures a machine from
+ *  a configuration file, runs it for a given number of cycles
+ *  and reads its memory, registers and statistics, without starting
+ *  a simulator process for every simulation. A fuzzer runs its inputs
+ *  from a snapshot taken at a marker of the guest (see fuzz.c).
+ *
+ *  The state of the simulator is global to the process, so there
+ *  is at most one machine at a time and it has to be used by one
+ *  thread only. A destroyed machine leaves no devices behind and
+ *  the next machine starts from the cycle zero (the variables set
+ *  by the configuration files keep their values). Fatal errors
+ *  (e.g. a failed allocation) still terminate the process.
+ *
+ */
+
+#ifndef LIBMSIM_H_
+#define LIBMSIM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Simulated machine */
+typedef struct msim_machine msim_machine_t;
+
+/** Outcome of a fuzzer input */
+typedef enum {
+    MSIM_FUZZ_PASS, /**< End marker reached with status 0 */
+    MSIM_FUZZ_FAIL, /**< End marker reached with another status */
+    MSIM_FUZZ_HALT, /**< The machine halted */
+    MSIM_FUZZ_TIMEOUT /**< The cycles ran out (or the run stopped) */
+} msim_fuzz_result_t;
+
+/** Memory area of the machine (see msim_mem_area()) */
+typedef struct {
+    const char *name; /**< Name of the memory device */
+    uint64_t addr; /**< Physical address */
+    uint64_t size; /**< Size in bytes */
+    const uint8_t *data; /**< Contents (valid until the area changes) */
+    bool writable; /**< Writable by the guest */
+} msim_mem_area_t;
+
+/** Statistic of the machine or of a device (see msim_stats()) */
+typedef struct {
+    const char *device; /**< Name of the device (NULL for the machine) */
+    const char *name; /**< Name of the metric */
+    const char *labels; /**< Further labels (empty for none) */
+    bool counter; /**< Counter (a gauge otherwise) */
+    uint64_t count; /**< Value of a counter */
+    double value; /**< Value of a gauge */
+} msim_stat_t;
+
+/** Visitor of the statistics */
+typedef void (*msim_stat_fnc_t)(const msim_stat_t *stat, void *arg);
+
+extern msim_machine_t *msim_machine_create(void);
+extern void msim_machine_destroy(msim_machine_t *machine);
+
+extern bool msim_load_config(msim_machine_t *machine, const char *fname);
+extern uint64_t msim_run(msim_machine_t *machine, uint64_t cycles);
+extern bool msim_reset(msim_machine_t *machine);
+extern bool msim_halted(const msim_machine_t *machine);
+extern uint64_t msim_cycles(const msim_machine_t *machine);
+
+extern void msim_read_mem(msim_machine_t *machine, uint64_t addr,
+        void *buf, size_t size);
+extern bool msim_write_mem(msim_machine_t *machine, uint64_t addr,
+        const void *buf, size_t size);
+extern bool msim_mem_area(msim_machine_t *machine, size_t index,
+        msim_mem_area_t *area);
+
+extern unsigned int msim_reg_count(msim_machine_t *machine, unsigned int cpuno);
+extern const char *msim_reg_name(msim_machine_t *machine, unsigned int cpuno,
+        unsigned int reg);
+extern bool msim_read_reg(msim_machine_t *machine, unsigned int cpuno,
+        unsigned int reg, uint64_t *value);
+extern bool msim_write_reg(msim_machine_t *machine, unsigned int cpuno,
+        unsigned int reg, uint64_t value);
+extern bool msim_read_pc(msim_machine_t *machine, unsigned int cpuno,
+        uint64_t *pc);
+
+extern bool msim_break_insert(msim_machine_t *machine, unsigned int cpuno,
+        uint64_t addr);
+extern bool msim_break_remove(msim_machine_t *machine, unsigned int cpuno,
+        uint64_t addr);
+
+extern void msim_stats(msim_machine_t *machine, msim_stat_fnc_t fnc, void *arg);
+
+extern bool msim_fuzz_start(msim_machine_t *machine, uint64_t cycles);
+extern void msim_fuzz_map(msim_machine_t *machine, uint8_t *map, size_t size);
+extern msim_fuzz_result_t msim_fuzz_run(msim_machine_t *machine,
+        const uint8_t *data, size_t size, uint64_t cycles);
+extern uint64_t msim_fuzz_status(const msim_machine_t *machine);
+
+#endif
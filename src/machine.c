@@ -0,0 +1,710 @@
+/*
+ * Copyright (c) 2003-2008 Viliam Holub
+ * Copyright (c) 2008-2011 Martin Decky
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Simulated machine
+ *
+ *  The state of the machine and its main loop, shared by the
+ *  simulator binary and the embeddable library.
+ *
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arch/stdin.h"
+#include "checkpoint.h"
+#include "debug/breakpoint.h"
+#include "debug/coverage.h"
+#include "debug/cosim.h"
+#include "debug/flight.h"
+#include "debug/gdb.h"
+#include "debug/memtrace.h"
+#include "debug/pcprofile.h"
+#include "debug/reverse.h"
+#include "debug/statsrv.h"
+#include "debug/trace.h"
+#include "device/cpu/decode_store.h"
+#include "device/cpu/general_cpu.h"
+#include "device/device.h"
+#include "fault.h"
+#include "hostperf.h"
+#include "input.h"
+#include "machine.h"
+#include "main.h"
+#include "output.h"
+#include "pace.h"
+#include "parallel.h"
+#include "profile.h"
+#include "replay.h"
+
+/** Configuration file name */
+char *config_file = NULL;
+
+/** Enable remote GDB debugging globally */
+bool remote_gdb = false;
+
+/** TCP port for GDB listening socket */
+unsigned int remote_gdb_port = 0;
+
+/** Remote GDB conection indication */
+bool remote_gdb_conn = false;
+
+/** Ready for remote GDB command */
+bool remote_gdb_listen = false;
+
+/** Remote GDB stepping */
+bool remote_gdb_step = false;
+
+/** Enable non-deterministic behaviour */
+bool machine_nondet = false;
+
+/** Trace instructions */
+bool machine_trace = false;
+
+/** Halt the simulation */
+bool machine_halt = false;
+
+/** Exit status of the simulator (kept when the machine is removed) */
+int machine_exit_status = ERR_OK;
+
+/** Break the simulation */
+bool machine_break = false;
+
+/** Interactive mode */
+bool machine_interactive = false;
+
+/** Print newline on entering interactive mode */
+bool machine_newline = false;
+
+/** Undefined instruction silent exception */
+bool machine_undefined = false;
+
+/** Allow MSIM-specific instructions. */
+bool machine_specific_instructions = true;
+
+/** Allow XINT even when terminal is not available. */
+bool machine_allow_interactive_without_tty = false;
+
+/** Skip the cycles in which all processors stand by */
+bool machine_skip_standby = true;
+
+/** Sleep while all processors wait for the host */
+bool machine_sleep_standby = false;
+
+/** Fast functional simulation with approximate statistics */
+bool machine_fast = false;
+
+/** Machine cycles the blocks of the fast mode ran ahead of the current one */
+uint64_t machine_fast_ahead = 0;
+
+/** Number of cycles each processor runs before the next one (1 = exact) */
+unsigned int machine_quantum = 1;
+
+/** Halt when all processors loop forever without taking interrupts */
+bool machine_loop_halt = false;
+
+/** Most machine cycles resp. instructions to simulate (0 = unlimited) */
+uint64_t machine_max_cycles = 0;
+uint64_t machine_max_instret = 0;
+
+/**
+ * Number of steps to run before switching
+ * to interactive mode. Zero means infinite.
+ */
+uint64_t stepping = 0;
+
+/** Total number of machine steps completed */
+uint64_t steps = 0;
+
+
+/** The last bounded run stopped at a code breakpoint */
+static bool breakpoint_stopped = false;
+
+/** Cycles between the checks of the processors looping forever */
+#define LOOP_CHECK_PERIOD 4096
+
+/** Next machine cycle to check the limits of the simulation in */
+static uint64_t limits_next = 0;
+
+/** Try to startup remote GDB communication.
+ *
+ * @return True if the connection was opened.
+ *
+ */
+static bool gdb_startup(void)
+{
+    if (get_cpu(0) == NULL) {
+        error("Cannot debug without any processor");
+        return false;
+    }
+
+    remote_gdb_conn = gdb_remote_init();
+
+    if (!remote_gdb_conn) {
+        return false;
+    }
+
+    /*
+     * In case of succesfull opening the debugging session will start
+     * in stopped state and in case of unsuccesfull opening the
+     * connection will not be initialized again.
+     */
+    remote_gdb_listen = remote_gdb_conn;
+    remote_gdb = remote_gdb_conn;
+
+    return true;
+}
+
+/** Let the other devices and the scheduled events catch up with the processors
+ *
+ * The relaxed processors keep running meanwhile, so each cycle
+ * of the devices is a section shared with the processors.
+ *
+ * @param cycles Machine cycles run by the processors.
+ *
+ */
+static void machine_catch_up(uint64_t cycles)
+{
+    for (uint64_t i = 0; i < cycles; i++) {
+        machine_lock();
+        dev_step_peripherals();
+        dev_run_events();
+        steps++;
+
+        if ((steps % 4096) == 0) {
+            dev_step4k_all();
+        }
+
+        machine_unlock();
+    }
+}
+
+/** Let the machine time follow the blocks of the fast mode
+ *
+ * A block runs in a single step of its processor, so the other devices
+ * and the scheduled events catch up with the longest block afterwards,
+ * as if each instruction took a cycle.
+ *
+ */
+static void machine_fast_catch_up(void)
+{
+    if (machine_fast_ahead > 0) {
+        uint64_t cycles = machine_fast_ahead;
+        machine_fast_ahead = 0;
+        machine_catch_up(cycles);
+    }
+}
+
+/** Run a sampled machine cycle
+ *
+ * @see machine_step
+ *
+ */
+static void machine_step_profiled(void)
+{
+    dev_step_all_profiled();
+
+    profile_region_enter(PROFILE_DEVICES);
+    dev_run_events();
+    steps++;
+
+    if ((steps % 4096) == 0) {
+        dev_step4k_all();
+    }
+
+    profile_region_leave();
+}
+
+/** Run 4096 machine cycles
+ *
+ */
+static void machine_step(void)
+{
+    /* Sample the program counters if profiling */
+    if (steps >= pcprofile_next) {
+        pcprofile_sample();
+    }
+
+    /* Sample the host time of the cycle if profiling */
+    if (steps >= profile_next) {
+        profile_sample_begin();
+
+        if (profile_sampling) {
+            machine_step_profiled();
+            machine_fast_catch_up();
+            return;
+        }
+    }
+
+    /* Execute device cycles */
+    dev_step_all();
+
+    /* Execute device events scheduled for this cycle */
+    dev_run_events();
+
+    /* Increase machine cycle counter */
+    steps++;
+
+    /* Every 4096th cycle execute
+       the step4k device functions */
+    if ((steps % 4096) == 0) {
+        dev_step4k_all();
+    }
+
+    machine_fast_catch_up();
+}
+
+/** Run a quantum of machine cycles with the processors in parallel
+ *
+ * The other devices and the scheduled events catch up with the
+ * processors afterwards, cycle by cycle.
+ *
+ */
+static void machine_step_parallel(void)
+{
+    machine_catch_up(parallel_step());
+}
+
+/** Check whether the processors can be interleaved by quanta
+ *
+ * The same conditions as for the parallel simulation apply,
+ * everything observing the single cycles needs them in order.
+ *
+ */
+static bool machine_interleave_possible(void)
+{
+    return (machine_quantum > 1) && (!machine_interactive) && (!machine_trace)
+            && (!remote_gdb) && (stepping == 0) && (replay_mode == REPLAY_OFF)
+            && (reverse_interval == 0) && (!cosim_enabled)
+            && (!breakpoint_any_set());
+}
+
+/** Run a quantum of machine cycles with the processors interleaved
+ *
+ * Each processor runs the whole quantum before the next one starts,
+ * keeping its code and data in the host caches. The other devices
+ * and the scheduled events catch up with the processors afterwards,
+ * cycle by cycle.
+ *
+ */
+static void machine_step_interleaved(void)
+{
+    machine_catch_up(dev_step_cpus(machine_quantum));
+    machine_fast_catch_up();
+}
+
+/** Longest sleep of the host (in milliseconds) between the input polls
+ *
+ * Limits the reaction to the events which do not wake the sleep
+ * (e.g. the user break).
+ *
+ */
+#define STANDBY_SLEEP_LIMIT 10
+
+/** Sleep while nothing but the host can end the standby of the processors
+ *
+ * The host sleeps until a key is read, until the host clock may reach
+ * the time a processor waits for or for STANDBY_SLEEP_LIMIT, whichever
+ * comes first. Nothing happens if a device or a timer driven by the
+ * machine cycles is going to end the standby, nor in the replay and
+ * in the re-execution, which take the host inputs from the log resp.
+ * from the kept inputs.
+ *
+ */
+static void machine_sleep_standby_host(void)
+{
+    uint64_t wait;
+
+    if ((replay_mode == REPLAY_PLAY) || (replay_rerun()) || (dev_events_pending())
+            || (!cpu_standby_host_all(&wait))) {
+        return;
+    }
+
+    stdin_wait((wait < STANDBY_SLEEP_LIMIT) ? wait : STANDBY_SLEEP_LIMIT);
+}
+
+/** Skip the cycles in which all processors stand by
+ *
+ * The cycles are skipped until the first processor event (an interrupt
+ * or a change of a timer interrupt request) or the first device event,
+ * whichever comes first. The counters end up the same as if the cycles
+ * were simulated one by one.
+ *
+ * @param limit Most cycles to skip.
+ *
+ * @return True if some cycles were skipped.
+ *
+ */
+static bool machine_skip_standby_cycles(uint64_t limit)
+{
+    uint64_t cycles;
+
+    if (!cpu_standby_all(&cycles)) {
+        /* Only a processor entering the standby mode can change this */
+        cpu_standby_entered = false;
+        return false;
+    }
+
+    uint64_t quiet = dev_quiet_cycles();
+    if (quiet < cycles) {
+        cycles = quiet;
+    }
+
+    if (limit < cycles) {
+        cycles = limit;
+    }
+
+    if (cycles == 0) {
+        return false;
+    }
+
+    if (machine_sleep_standby) {
+        machine_sleep_standby_host();
+    }
+
+    pcprofile_skip(cycles);
+    cpu_skip_all(cycles);
+    steps += cycles;
+
+    return true;
+}
+
+/** Halt the machine once a limit of the simulation is reached
+ *
+ * The budgets of the machine cycles and of the instructions executed
+ * by all processors are checked, as are the processors looping forever
+ * if the loophalt variable is set. Computes the next cycle to check in:
+ * the instruction budget is checked again once the processors could
+ * have used it up executing an instruction per cycle each, the loops
+ * every LOOP_CHECK_PERIOD cycles.
+ *
+ */
+static void machine_check_limits(void)
+{
+    limits_next = UINT64_MAX;
+
+    if (machine_max_cycles > 0) {
+        if (steps >= machine_max_cycles) {
+            alert("Cycle limit reached (%" PRIu64 "), halting", machine_max_cycles);
+            machine_halt = true;
+            return;
+        }
+
+        limits_next = machine_max_cycles;
+    }
+
+    if (machine_max_instret > 0) {
+        uint64_t instructions = cpu_instructions_all();
+
+        if (instructions >= machine_max_instret) {
+            alert("Instruction limit reached (%" PRIu64 "), halting", machine_max_instret);
+            machine_halt = true;
+            return;
+        }
+
+        uint64_t cpus = MAX(get_cpu_count(), 1);
+        uint64_t cycles = MAX((machine_max_instret - instructions) / cpus, 1);
+
+        limits_next = MIN(limits_next, steps + cycles);
+    }
+
+    if (machine_loop_halt) {
+        if (cpu_deadloop_all()) {
+            alert("All processors loop forever with interrupts disabled, halting");
+            machine_halt = true;
+            return;
+        }
+
+        limits_next = MIN(limits_next, steps + LOOP_CHECK_PERIOD);
+    }
+}
+
+/** Check whether machine_run() has to handle anything before the next cycle
+ *
+ * The halt, the interactive mode (also entered by the user break),
+ * the remote GDB session, the end of stepping, the code breakpoints,
+ * the snapshots of the reverse execution, the polls of the statistics
+ * endpoint, the pacing and the limits of the simulation are handled
+ * by the main loop.
+ *
+ */
+static inline bool machine_attention(void)
+{
+    return (machine_stopping()) || (remote_gdb_listen)
+            || (stepping == 1) || (steps >= reverse_next)
+            || (steps >= statsrv_next) || (steps >= limits_next)
+            || (steps >= pace_next) || (breakpoint_code_pending());
+}
+
+/** Run machine cycles until the main loop needs attention
+ *
+ * The conditions which cannot change while the simulation runs
+ * (i.e. outside of the interactive mode and of the debugger sessions)
+ * are evaluated only once.
+ *
+ */
+static void machine_run_fast(void)
+{
+    if ((remote_gdb) && (!remote_gdb_conn)) {
+        return;
+    }
+
+    bool parallel = parallel_possible();
+    bool interleave = (!parallel) && (machine_interleave_possible());
+    bool skip = (machine_skip_standby) && (!machine_trace) && (!remote_gdb)
+            && (stepping == 0) && (!breakpoint_any_set())
+            && ((!parallel) || (!parallel_relaxed));
+    breakpoint_code_prepare();
+
+    /* The processors standing by are parked only within this loop */
+    dev_park_cpus((skip) && (!parallel) && (!interleave));
+
+    /* The host counter samples are attributed only within this loop */
+    hostperf_running = !parallel;
+
+    while (!machine_attention()) {
+        if (stepping > 0) {
+            stepping--;
+        }
+
+        if ((skip) && (cpu_standby_entered)) {
+            /* The skipped cycles are not sampled */
+            profile_sample_end();
+
+            /* The limits are checked in the exact cycle, the pacing sleeps */
+            if (machine_skip_standby_cycles(MIN(limits_next, pace_next) - steps)) {
+                continue;
+            }
+        }
+
+        if (parallel) {
+            machine_step_parallel();
+        } else if (interleave) {
+            machine_step_interleaved();
+        } else {
+            machine_step();
+        }
+    }
+
+    hostperf_running = false;
+    dev_park_cpus(false);
+}
+
+/** Main simulator loop
+ *
+ * Runs until the machine halts, handling the interactive mode
+ * and the remote GDB session.
+ *
+ */
+void machine_run(void)
+{
+    while (!machine_halt) {
+        /* Snapshot for the reverse execution */
+        if (steps >= reverse_next) {
+            reverse_snapshot();
+        }
+
+        /* Requests for the statistics */
+        if (steps >= statsrv_next) {
+            statsrv_poll();
+        }
+
+        /* Real-time pacing */
+        if (steps >= pace_next) {
+            pace_check();
+        }
+
+        /*
+         * Check for code breakpoints. Interactive
+         * or gdb flags will be set if a breakpoint
+         * is hit.
+         */
+        breakpoint_check_for_code_breakpoints();
+
+        /*
+         * If the remote GDB debugging is allowed and the
+         * connection has not been opened yet, then wait
+         * for the connection from the remote GDB.
+         */
+
+        if ((remote_gdb) && (!remote_gdb_conn)) {
+            machine_interactive = !gdb_startup();
+        }
+
+        /*
+         * If the simulation was stopped due to the remote
+         * GDB debugging session, then read a command from
+         * the remote GDB. The read is blocking.
+         */
+        if ((remote_gdb) && (remote_gdb_conn) && (remote_gdb_listen)) {
+            remote_gdb_listen = false;
+            output_flush_all();
+            gdb_session();
+        }
+
+        /* Stepping check */
+        if (stepping > 0) {
+            stepping--;
+
+            if (stepping == 0) {
+                machine_interactive = true;
+            }
+        }
+
+        /* Interactive mode control */
+        if (machine_interactive) {
+            interactive_control();
+        }
+
+        /* Budgets and loops (the variables may have changed) */
+        machine_check_limits();
+
+        /*
+         * Continue with the simulation
+         */
+        if (!machine_halt) {
+            if (parallel_possible()) {
+                machine_step_parallel();
+            } else if (machine_interleave_possible()) {
+                machine_step_interleaved();
+            } else {
+                machine_step();
+            }
+
+            machine_run_fast();
+            machine_catch_up(parallel_pause());
+            profile_sample_end();
+        }
+    }
+
+    /* Show what has led to a fault halt */
+    flight_dump_requested();
+}
+
+/** Re-execute the machine cycles up to the given cycle
+ *
+ * Used by the reverse execution after a snapshot is restored. The
+ * breakpoints hit only report the hit to the reverse execution and
+ * the interactive mode is not entered. The standby cycles are skipped
+ * as by the main loop, but never beyond the given cycle.
+ *
+ * @param target Machine cycle to stop at.
+ *
+ */
+void machine_rerun(uint64_t target)
+{
+    bool interactive = machine_interactive;
+    bool skip = (machine_skip_standby) && (!breakpoint_any_set());
+
+    while ((!machine_halt) && (steps < target)) {
+        breakpoint_check_for_code_breakpoints();
+
+        if ((skip) && (cpu_standby_entered)
+                && (machine_skip_standby_cycles(target - steps))) {
+            continue;
+        }
+
+        machine_step();
+    }
+
+    machine_interactive = interactive;
+}
+
+/** Run a bounded number of machine cycles
+ *
+ * The machine runs without the interactive mode until the given number
+ * of cycles is simulated, the machine halts (also on a limit of the
+ * simulation) or a breakpoint (or any other request of the interactive
+ * mode) stops it. The next run steps
+ * over the breakpoint the machine stopped at. The standby cycles
+ * are not skipped and the processors run serially, so that the run
+ * ends exactly after the requested cycles.
+ *
+ * @param cycles Number of cycles to run.
+ *
+ * @return Number of cycles simulated.
+ *
+ */
+uint64_t machine_run_cycles(uint64_t cycles)
+{
+    uint64_t start = steps;
+    machine_interactive = false;
+
+    while ((!machine_halt) && (!machine_interactive)
+            && (steps - start < cycles)) {
+        if (breakpoint_stopped) {
+            /* Step over the breakpoint the previous run stopped at */
+            breakpoint_stopped = false;
+            machine_step();
+            continue;
+        }
+
+        if (breakpoint_check_for_code_breakpoints()) {
+            breakpoint_stopped = true;
+            break;
+        }
+
+        machine_check_limits();
+
+        if (machine_halt) {
+            break;
+        }
+
+        if (steps >= pace_next) {
+            pace_check();
+        }
+
+        /* The fast loop stops once the stepping reaches one */
+        stepping = cycles - (steps - start) + 1;
+        machine_run_fast();
+        profile_sample_end();
+    }
+
+    stepping = 0;
+    output_flush_all();
+
+    return steps - start;
+}
+
+/** Remove the machine
+ *
+ * All devices are freed and the machine counters are cleared,
+ * so another machine can be configured afterwards.
+ *
+ */
+void machine_done(void)
+{
+    parallel_done();
+    stdin_done();
+    trace_close();
+    memtrace_close();
+    replay_close();
+    reverse_done();
+    flight_done();
+    statsrv_done();
+    cosim_done();
+    coverage_done();
+    pcprofile_done();
+    hostperf_done();
+    checkpoint_wait();
+    decode_store_close();
+
+    physmem_breakpoint_remove_filtered(BREAKPOINT_FILTER_ANY);
+    dev_remove_all();
+    input_end();
+
+    steps = 0;
+    stepping = 0;
+    machine_halt = false;
+    machine_break = false;
+    machine_interactive = false;
+    breakpoint_stopped = false;
+    pace_done();
+}
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2003-2008 Viliam Holub
+ * Copyright (c) 2008-2011 Martin Decky
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Simulated machine
+ *
+ */
+
+#ifndef MACHINE_H_
+#define MACHINE_H_
+
+#include <stdint.h>
+
+extern void machine_run(void);
+extern uint64_t machine_run_cycles(uint64_t cycles);
+extern void machine_rerun(uint64_t target);
+extern void machine_done(void);
+
+#endif
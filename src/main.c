@@ -16,24 +16,39 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "arch/signal.h"
 #include "assert.h"
+#include "batch.h"
+#include "checkpoint.h"
 #include "cmd.h"
-#include "debug/breakpoint.h"
-#include "debug/gdb.h"
+#include "debug/cosim.h"
+#include "debug/coverage.h"
+#include "debug/memtrace.h"
+#include "debug/pcprofile.h"
+#include "debug/report.h"
+#include "debug/statsrv.h"
+#include "debug/symtab.h"
+#include "debug/trace.h"
+#include "device/cpu/decode_store.h"
 #include "device/cpu/general_cpu.h"
 #include "device/cpu/mips_r4000/cpu.h"
 #include "device/cpu/mips_r4000/debug.h"
-#include "device/device.h"
 #include "device/dr4kcpu.h"
 #include "endian.h"
 #include "env.h"
 #include "fault.h"
 #include "input.h"
+#include "machine.h"
+#include "mdesc.h"
+#include "output.h"
+#include "pace.h"
 #include "parser.h"
+#include "replay.h"
 #include "text.h"
+#include "usermode.h"
 #include "utils.h"
 
 /** This is necessary evil... */
@@ -44,62 +59,31 @@
 #include "device/cpu/riscv_rv64ima/debug.h"
 #undef XLEN
 
-/** Configuration file name */
-char *config_file = NULL;
+#include "device/cpu/isa.h"
 
-/** Enable remote GDB debugging globally */
-bool remote_gdb = false;
+/** Print the simulation statistics at the end */
+static bool machine_stats = false;
 
-/** TCP port for GDB listening socket */
-unsigned int remote_gdb_port = 0;
+/** Host time (in seconds) spent by the simulation */
+static double simulation_time = 0;
 
-/** Remote GDB conection indication */
-bool remote_gdb_conn = false;
+/** Batch file of test cases (NULL if not in the batch mode) */
+static char *batch_file = NULL;
 
-/** Ready for remote GDB command */
-bool remote_gdb_listen = false;
+/** Number of batch test cases run at the same time (0 for one per host CPU) */
+static unsigned int batch_jobs = 0;
 
-/** Remote GDB stepping */
-bool remote_gdb_step = false;
+/** Configuration files of the machines run at the same time */
+static char **machine_configs = NULL;
 
-/** Enable non-deterministic behaviour */
-bool machine_nondet = false;
+/** Number of the machines run at the same time (0 if not in that mode) */
+static size_t machine_count = 0;
 
-/** Trace instructions */
-bool machine_trace = false;
+/** UNIX socket of the server of jobs (NULL if not serving) */
+static char *serve_socket = NULL;
 
-/** Halt the simulation */
-bool machine_halt = false;
-
-/** Break the simulation */
-bool machine_break = false;
-
-/** Interactive mode */
-bool machine_interactive = false;
-
-/** Print newline on entering interactive mode */
-bool machine_newline = false;
-
-/** Undefined instruction silent exception */
-bool machine_undefined = false;
-
-/** Allow MSIM-specific instructions. */
-bool machine_specific_instructions = true;
-
-/** Allow XINT even when terminal is not available. */
-bool machine_allow_interactive_without_tty = false;
-
-/**
- * Number of steps to run before switching
- * to interactive mode. Zero means infinite.
- */
-uint64_t stepping = 0;
-
-/** SC-LL tracking */
-list_t sc_list;
-
-/** Total number of machine steps completed */
-static uint64_t steps = 0;
+/** Machine description compiled from the configuration (NULL if none) */
+static char *compile_output = NULL;
 
 /** Command line options */
 static struct option long_options[] = {
@@ -139,6 +123,90 @@ static struct option long_options[] = {
             no_argument,
             0,
             'X' },
+    { "trace-file",
+            required_argument,
+            0,
+            'T' },
+    { "trace-decode",
+            required_argument,
+            0,
+            'D' },
+    { "memtrace",
+            required_argument,
+            0,
+            'A' },
+    { "memtrace-decode",
+            required_argument,
+            0,
+            'Z' },
+    { "stats",
+            no_argument,
+            0,
+            'S' },
+    { "batch",
+            required_argument,
+            0,
+            'b' },
+    { "jobs",
+            required_argument,
+            0,
+            'j' },
+    { "symbols",
+            required_argument,
+            0,
+            'Y' },
+    { "pcprofile",
+            required_argument,
+            0,
+            'P' },
+    { "coverage",
+            required_argument,
+            0,
+            'O' },
+    { "record",
+            required_argument,
+            0,
+            'R' },
+    { "replay",
+            required_argument,
+            0,
+            'L' },
+    { "stats-socket",
+            required_argument,
+            0,
+            'E' },
+    { "report",
+            required_argument,
+            0,
+            'J' },
+    { "cosim",
+            no_argument,
+            0,
+            'C' },
+    { "max-cycles",
+            required_argument,
+            0,
+            'M' },
+    { "max-instret",
+            required_argument,
+            0,
+            'N' },
+    { "serve",
+            required_argument,
+            0,
+            'W' },
+    { "compile-config",
+            required_argument,
+            0,
+            'K' },
+    { "user",
+            no_argument,
+            0,
+            'U' },
+    { "decode-cache",
+            required_argument,
+            0,
+            'Q' },
     { NULL, 0, NULL, 0 }
 };
 
@@ -162,6 +230,35 @@ static void setup_remote_gdb(const char *opt)
     remote_gdb_port = port_no;
 }
 
+static void setup_batch_jobs(const char *opt)
+{
+    ASSERT(opt != NULL);
+
+    char *endp;
+    long int jobs = strtol(opt, &endp, 0);
+
+    if ((*endp != 0) || (jobs < 1) || (jobs > 1024)) {
+        die(ERR_PARM, "Invalid number of jobs");
+    }
+
+    batch_jobs = jobs;
+}
+
+static void setup_limit(const char *opt, uint64_t *limit)
+{
+    ASSERT(opt != NULL);
+    ASSERT(limit != NULL);
+
+    char *endp;
+    unsigned long long int count = strtoull(opt, &endp, 0);
+
+    if ((*endp != 0) || (count == 0) || (opt[0] == '-')) {
+        die(ERR_PARM, "Invalid limit");
+    }
+
+    *limit = count;
+}
+
 static bool parse_cmdline(int argc, char *args[])
 {
     opterr = 0;
@@ -169,7 +266,7 @@ static bool parse_cmdline(int argc, char *args[])
     while (true) {
         int option_index = 0;
 
-        int c = getopt_long(argc, args, "tVic:hg:nXI",
+        int c = getopt_long(argc, args, "tVic:hg:nXIj:",
                 long_options, &option_index);
 
         if (c == -1) {
@@ -208,6 +305,99 @@ static bool parse_cmdline(int argc, char *args[])
         case 'X':
             machine_specific_instructions = false;
             break;
+        case 'T':
+            if (!trace_open(optarg)) {
+                die(ERR_IO, "Unable to open the trace file");
+            }
+            break;
+        case 'D':
+            if (!trace_decode(optarg)) {
+                die(ERR_IO, "Unable to decode the trace file");
+            }
+            return false;
+        case 'A':
+            if (!memtrace_open(optarg)) {
+                die(ERR_IO, "Unable to open the memory access trace");
+            }
+            break;
+        case 'Z':
+            if (!memtrace_decode(optarg)) {
+                die(ERR_IO, "Unable to decode the memory access trace");
+            }
+            return false;
+        case 'S':
+            machine_stats = true;
+            break;
+        case 'b':
+            if (batch_file) {
+                safe_free(batch_file);
+            }
+            batch_file = safe_strdup(optarg);
+            break;
+        case 'j':
+            setup_batch_jobs(optarg);
+            break;
+        case 'Y':
+            if (!symtab_load(optarg)) {
+                die(ERR_IO, "Unable to load the symbols");
+            }
+            break;
+        case 'P':
+            pcprofile_set_output(optarg);
+            if (pcprofile_period == 0) {
+                pcprofile_set_period(PCPROFILE_DEFAULT_PERIOD);
+            }
+            break;
+        case 'O':
+            coverage_set_output(optarg);
+            coverage_enabled = true;
+            break;
+        case 'R':
+        case 'L':
+            /* The recorded inputs are the non-deterministic ones */
+            if (!replay_open(optarg, (c == 'R') ? REPLAY_RECORD : REPLAY_PLAY)) {
+                die(ERR_IO, "Unable to open the replay log");
+            }
+            machine_nondet = true;
+            break;
+        case 'E':
+            if (!statsrv_open(optarg)) {
+                die(ERR_IO, "Unable to open the statistics socket");
+            }
+            break;
+        case 'J':
+            report_set_output(optarg);
+            break;
+        case 'C':
+            cosim_set(true);
+            break;
+        case 'M':
+            setup_limit(optarg, &machine_max_cycles);
+            break;
+        case 'N':
+            setup_limit(optarg, &machine_max_instret);
+            break;
+        case 'W':
+            if (serve_socket) {
+                safe_free(serve_socket);
+            }
+            serve_socket = safe_strdup(optarg);
+            break;
+        case 'K':
+            if (compile_output) {
+                safe_free(compile_output);
+            }
+            compile_output = safe_strdup(optarg);
+            break;
+        case 'U':
+            usermode_enabled = true;
+            break;
+        case 'Q':
+            if (decode_store_dir) {
+                safe_free(decode_store_dir);
+            }
+            decode_store_dir = safe_strdup(optarg);
+            break;
         case '?':
             die(ERR_PARM, "Unknown parameter or argument required");
             break;
@@ -217,139 +407,235 @@ static bool parse_cmdline(int argc, char *args[])
     }
 
     if (optind < argc) {
-        die(ERR_PARM, "Unexpected arguments");
+        machine_configs = args + optind;
+        machine_count = argc - optind;
     }
 
     return true;
 }
 
-/** Try to startup remote GDB communication.
+
+/** Host time in seconds */
+static double host_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Run the simulation and measure its host time */
+static void simulate(void)
+{
+    double start = host_time();
+    machine_run();
+    simulation_time = host_time() - start;
+}
+
+/** Print the simulation statistics in a machine-readable form
  *
- * @return True if the connection was opened.
+ * The speed is given in simulated instructions (and cycles) per
+ * second of the host time spent by the simulation.
  *
  */
-static bool gdb_startup(void)
+static void print_stats(void)
+{
+    uint64_t instructions = cpu_instructions_all();
+    double seconds = (simulation_time > 0) ? simulation_time : 1e-9;
+
+    printf("Statistics: cycles=%" PRIu64 " instructions=%" PRIu64
+            " seconds=%.6f mips=%.3f cycles_per_second=%.0f"
+            " ns_per_instruction=%.3f\n",
+            steps, instructions, simulation_time,
+            instructions / seconds / 1e6, steps / seconds,
+            (instructions > 0) ? simulation_time * 1e9 / instructions : 0);
+}
+
+static void finish(void)
 {
-    if (get_cpu(0) == NULL) {
-        error("Cannot debug without any processor");
-        return false;
+    input_back();
+    output_flush_all();
+    if (steps > 0) {
+        printf("\nCycles: %" PRIu64 "\n", steps);
     }
 
-    remote_gdb_conn = gdb_remote_init();
+    if (machine_stats) {
+        print_stats();
+        pace_print();
+    }
 
-    if (!remote_gdb_conn) {
-        return false;
+    cosim_print();
+    report_write();
+    machine_done();
+}
+
+/** Simulate a batch test case or one of the machines
+ *
+ * Run by the forked child (in the directory of the test case),
+ * the machine configured by the shared prefix is extended by
+ * the configuration file of the test case or of the machine.
+ *
+ * @return Exit status of the simulation.
+ *
+ */
+static int batch_simulate(const char *config)
+{
+    config_file = (char *) config;
+    script();
+
+    if (machine_interactive) {
+        die(ERR_INIT, "Forked machines cannot enter the interactive mode");
     }
 
-    /*
-     * In case of succesfull opening the debugging session will start
-     * in stopped state and in case of unsuccesfull opening the
-     * connection will not be initialized again.
-     */
-    remote_gdb_listen = remote_gdb_conn;
-    remote_gdb = remote_gdb_conn;
+    simulate();
+    finish();
 
-    return true;
+    return machine_exit_status;
 }
 
-/** Run 4096 machine cycles
+/** Run the test cases of the batch file or the machines
+ *
+ * The configuration file given on the command line (if any) is the
+ * shared prefix of the machines of all test cases (or of all machines
+ * given by their configuration files).
  *
  */
-static void machine_step(void)
+static int batch_main(void)
 {
-    /* Execute device cycles */
-    device_t *dev = NULL;
-    while (dev_next(&dev, DEVICE_FILTER_STEP)) {
-        dev->type->step(dev);
+    if (config_file != NULL) {
+        script();
     }
 
-    /* Increase machine cycle counter */
-    steps++;
+    if ((machine_interactive) || (remote_gdb)) {
+        die(ERR_PARM, "The batch mode cannot be interactive");
+    }
 
-    /* Every 4096th cycle execute
-       the step4k device functions */
-    if ((steps % 4096) == 0) {
-        dev = NULL;
-        while (dev_next(&dev, DEVICE_FILTER_STEP4K)) {
-            dev->type->step4k(dev);
-        }
+    if (replay_mode != REPLAY_OFF) {
+        die(ERR_PARM, "The batch mode cannot record or replay the inputs");
     }
+
+    bool ok = (batch_file != NULL)
+            ? batch_run(batch_file, batch_jobs, batch_simulate)
+            : batch_run_machines(machine_configs, machine_count,
+                    batch_jobs, batch_simulate);
+
+    input_back();
+    machine_done();
+
+    return ok ? ERR_OK : ERR_BATCH;
 }
 
-/** Main simulator loop
+/** Simulate a job received by the server
+ *
+ * Run by the forked child, the machine configured before the server
+ * started is extended by the configuration of the job. The limits
+ * of the cycles and of the instructions count from that machine.
+ *
+ * @return Exit status of the simulation.
  *
  */
-static void machine_run(void)
+static int serve_simulate(FILE *job)
 {
-    while (!machine_halt) {
-        /*
-         * Check for code breakpoints. Interactive
-         * or gdb flags will be set if a breakpoint
-         * is hit.
-         */
-        breakpoint_check_for_code_breakpoints();
-
-        /*
-         * If the remote GDB debugging is allowed and the
-         * connection has not been opened yet, then wait
-         * for the connection from the remote GDB.
-         */
-
-        if ((remote_gdb) && (!remote_gdb_conn)) {
-            machine_interactive = !gdb_startup();
-        }
+    if (machine_max_cycles > 0) {
+        machine_max_cycles += steps;
+    }
 
-        /*
-         * If the simulation was stopped due to the remote
-         * GDB debugging session, then read a command from
-         * the remote GDB. The read is blocking.
-         */
-        if ((remote_gdb) && (remote_gdb_conn) && (remote_gdb_listen)) {
-            remote_gdb_listen = false;
-            gdb_session();
-        }
+    if (machine_max_instret > 0) {
+        machine_max_instret += cpu_instructions_all();
+    }
 
-        /* Stepping check */
-        if (stepping > 0) {
-            stepping--;
+    script_stream(job, "job");
 
-            if (stepping == 0) {
-                machine_interactive = true;
-            }
-        }
+    if (machine_interactive) {
+        die(ERR_INIT, "Served jobs cannot enter the interactive mode");
+    }
 
-        /* Interactive mode control */
-        if (machine_interactive) {
-            interactive_control();
-        }
+    simulate();
+    finish();
 
-        /*
-         * Continue with the simulation
-         */
-        if (!machine_halt) {
-            machine_step();
-        }
+    return machine_exit_status;
+}
+
+/** Serve the jobs received over a UNIX socket
+ *
+ * The configuration file sets up the machine the jobs start from,
+ * typically by restoring a checkpoint of a booted system.
+ *
+ */
+static int serve_main(void)
+{
+    script();
+
+    if ((machine_interactive) || (remote_gdb)) {
+        die(ERR_PARM, "The server cannot be interactive");
     }
+
+    if (replay_mode != REPLAY_OFF) {
+        die(ERR_PARM, "The server cannot record or replay the inputs");
+    }
+
+    /* The jobs are the only children of the server */
+    checkpoint_wait();
+
+    bool ok = batch_serve(serve_socket, batch_jobs, serve_simulate);
+
+    input_back();
+    machine_done();
+
+    return ok ? ERR_OK : ERR_IO;
 }
 
-static void cleanup()
+/** Compile the configuration file into a machine description
+ *
+ * The configuration is run to find the files read by its commands,
+ * the simulation is not started.
+ *
+ */
+static int compile_main(void)
 {
-    /* Execute device cycles */
-    device_t *dev = NULL;
-    device_t *next_dev = NULL;
+    if ((machine_interactive) || (remote_gdb)) {
+        die(ERR_PARM, "The configuration cannot be compiled in the interactive mode");
+    }
+
+    mdesc_record_start();
+    script();
 
-    dev_next(&next_dev, DEVICE_FILTER_ALL);
-    dev = next_dev;
+    if (machine_interactive) {
+        die(ERR_INIT, "No configuration file to compile");
+    }
+
+    bool ok = mdesc_write(compile_output, config_file);
+
+    input_back();
+    machine_done();
+
+    return ok ? ERR_OK : ERR_IO;
+}
+
+/** Run a user program with the emulated system calls
+ *
+ * The machine is set up for the program given by the arguments,
+ * the configuration file is only read if given (e.g. to trace
+ * or to debug the program).
+ *
+ */
+static int usermode_main(void)
+{
+    if (machine_count == 0) {
+        die(ERR_PARM, "No program to run");
+    }
 
-    while (dev_next(&next_dev, DEVICE_FILTER_ALL)) {
-        free_device(dev);
-        dev = next_dev;
-    };
+    if (!usermode_load(machine_configs, machine_count)) {
+        die(ERR_INIT, "Unable to load the program");
+    }
 
-    if (dev != NULL) {
-        free_device(dev);
+    if (config_file != NULL) {
+        script();
     }
-    input_end();
+
+    simulate();
+    finish();
+
+    return machine_exit_status;
 }
 
 int main(int argc, char *args[])
@@ -358,9 +644,15 @@ int main(int argc, char *args[])
      * Initialization
      */
 
+#if ISA_R4K
     r4k_debug_init();
+#endif
+#if ISA_RV32
     rv32_debug_init();
+#endif
+#if ISA_RV64
     rv64_debug_init();
+#endif
 
     input_init();
     input_shadow();
@@ -374,6 +666,40 @@ int main(int argc, char *args[])
         return 0;
     }
 
+    if (((batch_file != NULL) || (serve_socket != NULL)) && (machine_count > 0)) {
+        die(ERR_PARM, "Unexpected arguments");
+    }
+
+    if ((batch_file != NULL) && (serve_socket != NULL)) {
+        die(ERR_PARM, "The batch mode cannot serve jobs");
+    }
+
+    if ((compile_output != NULL) && ((batch_file != NULL)
+                || (serve_socket != NULL) || (machine_count > 0))) {
+        die(ERR_PARM, "Only a single configuration can be compiled");
+    }
+
+    if ((usermode_enabled) && ((batch_file != NULL)
+                || (serve_socket != NULL) || (compile_output != NULL))) {
+        die(ERR_PARM, "The user mode runs a single program");
+    }
+
+    if (usermode_enabled) {
+        return usermode_main();
+    }
+
+    if (compile_output != NULL) {
+        return compile_main();
+    }
+
+    if (serve_socket != NULL) {
+        return serve_main();
+    }
+
+    if ((batch_file != NULL) || (machine_count > 0)) {
+        return batch_main();
+    }
+
     script();
 
     if (machine_interactive) {
@@ -384,17 +710,12 @@ int main(int argc, char *args[])
     /*
      * Main simulation loop
      */
-    machine_run();
+    simulate();
 
     /*
      * Finalization
      */
-    input_back();
-    if (steps > 0) {
-        printf("\nCycles: %" PRIu64 "\n", steps);
-    }
-
-    cleanup();
+    finish();
 
-    return 0;
+    return machine_exit_status;
 }
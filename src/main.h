@@ -15,11 +15,11 @@
 #include "../config.h"
 #include "list.h"
 
-#define MAX_CPUS 32
+#define MAX_CPUS 256
 #define MAX_INTRS 11
 
 /** Physical frame number type */
-typedef uint32_t pfn_t;
+typedef uint64_t pfn_t;
 
 /** Address and length types */
 typedef uint64_t len36_t;
@@ -71,12 +71,34 @@ extern bool remote_gdb_step;
 extern bool machine_nondet;
 extern bool machine_trace;
 extern bool machine_halt;
+extern int machine_exit_status;
 extern bool machine_break;
 extern bool machine_interactive;
 extern bool machine_newline;
 extern bool machine_undefined;
 extern bool machine_specific_instructions;
 extern bool machine_allow_interactive_without_tty;
+extern bool machine_skip_standby;
+extern bool machine_sleep_standby;
+extern bool machine_fast;
+extern uint64_t machine_fast_ahead;
+extern unsigned int machine_quantum;
+extern bool machine_loop_halt;
+extern uint64_t machine_max_cycles;
+extern uint64_t machine_max_instret;
 extern uint64_t stepping;
+extern uint64_t steps;
+
+/** Check whether the machine halts or enters the interactive mode
+ *
+ * The processors running in parallel set the flags on their own
+ * threads (with __ATOMIC_RELEASE), so they are read atomically.
+ *
+ */
+static inline bool machine_stopping(void)
+{
+    return (__atomic_load_n(&machine_halt, __ATOMIC_ACQUIRE))
+            || (__atomic_load_n(&machine_interactive, __ATOMIC_ACQUIRE));
+}
 
 #endif
@@ -0,0 +1,452 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Precompiled machine descriptions
+ *
+ *  A machine description is compiled from a configuration file by
+ *  running it (see the --compile-config option). It holds the commands
+ *  of the configuration already parsed and the files read while they
+ *  ran (the configuration file itself, the memory images, the ELF
+ *  executables, ...) with their sizes and hashes. A description given
+ *  instead of the configuration file is mapped into the memory and its
+ *  commands are run without parsing the lines. Once any of the files
+ *  changes, the description is stale and the configuration file is
+ *  interpreted instead.
+ *
+ *  The description stores the values in the host representation,
+ *  so it is specific to the MSIM build and host which compiled it.
+ *
+ */
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../config.h"
+#include "arch/mmap.h"
+#include "assert.h"
+#include "cmd.h"
+#include "fault.h"
+#include "main.h"
+#include "mdesc.h"
+#include "parser.h"
+#include "utils.h"
+
+/** FNV-1a hash of the files */
+#define MDESC_HASH_BASIS UINT64_C(0xcbf29ce484222325)
+#define MDESC_HASH_PRIME UINT64_C(0x100000001b3)
+
+/** Size of the chunks the files are hashed by */
+#define MDESC_HASH_CHUNK 65536
+
+bool mdesc_recording = false;
+
+/** Commands of the configuration packed so far */
+static string_t recorded_commands;
+static uint64_t recorded_count = 0;
+
+/** Files read by the commands (without duplicates) */
+static char **recorded_inputs = NULL;
+static size_t recorded_input_count = 0;
+
+/** Reader of the mapped machine description */
+typedef struct {
+    const uint8_t *pos;
+    const uint8_t *end;
+} mdesc_reader_t;
+
+/** Start to record the configuration being run
+ *
+ */
+void mdesc_record_start(void)
+{
+    string_init(&recorded_commands);
+    recorded_count = 0;
+    mdesc_recording = true;
+}
+
+/** Record a command of the configuration
+ *
+ * Called before the command runs, as the commands may change
+ * their parameters.
+ *
+ * @param lineno Line of the command in the configuration file.
+ * @param parm   Parsed parameters of the line.
+ *
+ */
+void mdesc_record(size_t lineno, token_t *parm)
+{
+    ASSERT(mdesc_recording);
+    ASSERT(parm != NULL);
+
+    /* Empty lines and comments */
+    if (parm_type(parm) == tt_end) {
+        return;
+    }
+
+    uint64_t line = lineno;
+    for (size_t i = 0; i < sizeof(line); i++) {
+        string_push(&recorded_commands, ((const char *) &line)[i]);
+    }
+
+    parm_pack(parm, &recorded_commands);
+    recorded_count++;
+}
+
+/** Record a file read by a command of the configuration
+ *
+ */
+void mdesc_input(const char *path)
+{
+    ASSERT(path != NULL);
+
+    for (size_t i = 0; i < recorded_input_count; i++) {
+        if (strcmp(recorded_inputs[i], path) == 0) {
+            return;
+        }
+    }
+
+    recorded_inputs = (char **) realloc(recorded_inputs,
+            (recorded_input_count + 1) * sizeof(char *));
+    if (recorded_inputs == NULL) {
+        die(ERR_MEM, "Not enough memory");
+    }
+
+    recorded_inputs[recorded_input_count] = safe_strdup(path);
+    recorded_input_count++;
+}
+
+/** Find the size and the hash of a file
+ *
+ * @return False if the file cannot be read.
+ *
+ */
+static bool mdesc_hash_file(const char *path, uint64_t *size, uint64_t *hash)
+{
+    /* Not try_fopen(), the file is not read by a command */
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    uint8_t *buf = (uint8_t *) safe_malloc(MDESC_HASH_CHUNK);
+
+    *size = 0;
+    *hash = MDESC_HASH_BASIS;
+
+    size_t len;
+    while ((len = fread(buf, 1, MDESC_HASH_CHUNK, file)) > 0) {
+        for (size_t i = 0; i < len; i++) {
+            *hash = (*hash ^ buf[i]) * MDESC_HASH_PRIME;
+        }
+
+        *size += len;
+    }
+
+    bool ok = (ferror(file) == 0);
+
+    safe_free(buf);
+    fclose(file);
+    return ok;
+}
+
+/** Write a string as its length and characters */
+static bool mdesc_write_str(FILE *file, const char *str)
+{
+    uint64_t len = strlen(str);
+
+    return (fwrite(&len, sizeof(len), 1, file) == 1)
+            && (fwrite(str, 1, len, file) == len);
+}
+
+/** Write the recorded configuration as a machine description
+ *
+ * The recording ends.
+ *
+ * @param path   Name of the machine description file.
+ * @param source Name of the configuration file compiled.
+ *
+ * @return True if successful.
+ *
+ */
+bool mdesc_write(const char *path, const char *source)
+{
+    ASSERT(mdesc_recording);
+    ASSERT(path != NULL);
+    ASSERT(source != NULL);
+
+    mdesc_recording = false;
+
+    FILE *file = try_fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+
+    uint32_t version = MDESC_VERSION;
+    uint64_t input_count = recorded_input_count + 1;
+
+    bool ok = (fwrite(MDESC_MAGIC, 1, strlen(MDESC_MAGIC), file) == strlen(MDESC_MAGIC))
+            && (fwrite(&version, sizeof(version), 1, file) == 1)
+            && mdesc_write_str(file, PACKAGE_VERSION)
+            && mdesc_write_str(file, source)
+            && (fwrite(&input_count, sizeof(input_count), 1, file) == 1);
+
+    /* The configuration file is the first file */
+    for (size_t i = 0; (ok) && (i < input_count); i++) {
+        const char *input = (i == 0) ? source : recorded_inputs[i - 1];
+        uint64_t size;
+        uint64_t hash;
+
+        if (!mdesc_hash_file(input, &size, &hash)) {
+            io_error(input);
+            ok = false;
+            break;
+        }
+
+        ok = mdesc_write_str(file, input)
+                && (fwrite(&size, sizeof(size), 1, file) == 1)
+                && (fwrite(&hash, sizeof(hash), 1, file) == 1);
+    }
+
+    ok = ok && (fwrite(&recorded_count, sizeof(recorded_count), 1, file) == 1)
+            && (fwrite(recorded_commands.str, 1, recorded_commands.pos, file)
+                    == recorded_commands.pos);
+
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+
+    if (!ok) {
+        error("Unable to write the machine description %s", path);
+    }
+
+    for (size_t i = 0; i < recorded_input_count; i++) {
+        safe_free(recorded_inputs[i]);
+    }
+
+    safe_free(recorded_inputs);
+    recorded_input_count = 0;
+    string_done(&recorded_commands);
+
+    return ok;
+}
+
+/** Read a value of the machine description
+ *
+ * @return False if the description ends before the value.
+ *
+ */
+static bool mdesc_read(mdesc_reader_t *reader, void *val, size_t size)
+{
+    if ((size_t) (reader->end - reader->pos) < size) {
+        return false;
+    }
+
+    memcpy(val, reader->pos, size);
+    reader->pos += size;
+    return true;
+}
+
+/** Read a string of the machine description
+ *
+ * @return The string (to be freed) or NULL if the description ends.
+ *
+ */
+static char *mdesc_read_str(mdesc_reader_t *reader)
+{
+    uint64_t len;
+
+    if ((!mdesc_read(reader, &len, sizeof(len)))
+            || (len > (uint64_t) (reader->end - reader->pos))) {
+        return NULL;
+    }
+
+    char *str = (char *) safe_malloc(len + 1);
+    memcpy(str, reader->pos, len);
+    str[len] = 0;
+    reader->pos += len;
+
+    return str;
+}
+
+/** Check the files of the machine description
+ *
+ * @param fresh Set to false if any of the files has changed.
+ *
+ * @return False if the description is corrupted.
+ *
+ */
+static bool mdesc_check_inputs(mdesc_reader_t *reader, bool *fresh)
+{
+    uint64_t count;
+
+    if (!mdesc_read(reader, &count, sizeof(count))) {
+        return false;
+    }
+
+    *fresh = true;
+
+    for (uint64_t i = 0; i < count; i++) {
+        char *input = mdesc_read_str(reader);
+        uint64_t size;
+        uint64_t hash;
+
+        if ((input == NULL) || (!mdesc_read(reader, &size, sizeof(size)))
+                || (!mdesc_read(reader, &hash, sizeof(hash)))) {
+            safe_free(input);
+            return false;
+        }
+
+        if (*fresh) {
+            uint64_t cur_size;
+            uint64_t cur_hash;
+
+            *fresh = mdesc_hash_file(input, &cur_size, &cur_hash)
+                    && (cur_size == size) && (cur_hash == hash);
+        }
+
+        safe_free(input);
+    }
+
+    return true;
+}
+
+/** Run the commands of the machine description
+ *
+ * The errors are reported with the lines of the configuration file,
+ * an error is fatal as with script().
+ *
+ * @return False if the description is corrupted.
+ *
+ */
+static bool mdesc_run_commands(mdesc_reader_t *reader, const char *source)
+{
+    uint64_t count;
+
+    if (!mdesc_read(reader, &count, sizeof(count))) {
+        return false;
+    }
+
+    set_script(source);
+
+    for (uint64_t i = 0; (i < count) && (!machine_halt); i++) {
+        uint64_t lineno;
+
+        if (!mdesc_read(reader, &lineno, sizeof(lineno))) {
+            return false;
+        }
+
+        token_t *parm = parm_unpack(&reader->pos, reader->end);
+
+        if (parm == NULL) {
+            return false;
+        }
+
+        set_lineno(lineno);
+        bool ok = interpret_parm(parm);
+        parm_delete(parm);
+
+        if (!ok) {
+            die(ERR_INIT, "Error in configuration file");
+        }
+    }
+
+    unset_script();
+    return true;
+}
+
+/** Run a machine description given instead of the configuration file
+ *
+ * @param path   Name of the configuration file given.
+ * @param source Set to the name of the configuration file to interpret
+ *               instead of a stale description (NULL otherwise).
+ *
+ * @return True if the file is a machine description and its commands
+ *         have been run.
+ *
+ */
+bool mdesc_run(const char *path, char **source)
+{
+    ASSERT(path != NULL);
+    ASSERT(source != NULL);
+
+    *source = NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || (!S_ISREG(st.st_mode))
+            || ((size_t) st.st_size < strlen(MDESC_MAGIC))) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    if (memcmp(map, MDESC_MAGIC, strlen(MDESC_MAGIC)) != 0) {
+        munmap(map, size);
+        return false;
+    }
+
+    mdesc_reader_t reader = {
+        .pos = (const uint8_t *) map + strlen(MDESC_MAGIC),
+        .end = (const uint8_t *) map + size
+    };
+
+    uint32_t version = 0;
+    char *package_version = NULL;
+    char *config = NULL;
+
+    bool ok = mdesc_read(&reader, &version, sizeof(version))
+            && ((package_version = mdesc_read_str(&reader)) != NULL);
+
+    if ((ok) && ((version != MDESC_VERSION)
+                        || (strcmp(package_version, PACKAGE_VERSION) != 0))) {
+        safe_free(package_version);
+        munmap(map, size);
+        die(ERR_INIT, "%s is not a machine description of this MSIM version",
+                path);
+    }
+
+    safe_free(package_version);
+
+    bool fresh = false;
+    ok = ok && ((config = mdesc_read_str(&reader)) != NULL)
+            && mdesc_check_inputs(&reader, &fresh);
+
+    if ((ok) && (!fresh)) {
+        alert("Machine description %s is stale, interpreting %s",
+                path, config);
+        *source = config;
+        munmap(map, size);
+        return false;
+    }
+
+    ok = ok && mdesc_run_commands(&reader, config);
+
+    safe_free(config);
+    munmap(map, size);
+
+    if (!ok) {
+        die(ERR_INIT, "Machine description %s is corrupted", path);
+    }
+
+    return true;
+}
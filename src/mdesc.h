@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Precompiled machine descriptions
+ *
+ */
+
+#ifndef MDESC_H_
+#define MDESC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "parser.h"
+
+/** Identification of the machine description file */
+#define MDESC_MAGIC "MSIMDESC"
+#define MDESC_VERSION 1
+
+/** The configuration being run is compiled into a machine description */
+extern bool mdesc_recording;
+
+extern void mdesc_record_start(void);
+extern void mdesc_record(size_t lineno, token_t *parm);
+extern void mdesc_input(const char *path);
+extern bool mdesc_write(const char *path, const char *source);
+extern bool mdesc_run(const char *path, char **source);
+
+#endif
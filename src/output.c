@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Buffered output of the devices
+ *
+ *  Devices writing characters to the console or to a file (such as
+ *  the printer) would otherwise issue a formatted write and a flush
+ *  for every character.
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "assert.h"
+#include "iothread.h"
+#include "list.h"
+#include "output.h"
+#include "parallel.h"
+
+/** All initialized outputs */
+static list_t outputs = LIST_INITIALIZER;
+
+/** Changes whenever the standard output might have been written to
+ *
+ * Advanced by the writes of the outputs to the standard output and
+ * by output_flush_all(), which precedes the messages and the prompts
+ * of the simulator.
+ *
+ */
+uint64_t output_epoch = 0;
+
+/** Drop the characters written to the outputs
+ *
+ * Set while the reverse execution re-executes the cycles,
+ * whose output has been written already.
+ *
+ */
+bool output_muted = false;
+
+/** Initialize an output
+ *
+ * @param output Output structure.
+ * @param file   Target file.
+ *
+ */
+void output_init(output_t *output, FILE *file)
+{
+    ASSERT(output != NULL);
+    ASSERT(file != NULL);
+
+    item_init(&output->item);
+    output->file = file;
+    output->sync = false;
+    output->threaded = false;
+    output->len = 0;
+
+    list_append(&outputs, &output->item);
+}
+
+/** Write out the characters and wait for the I/O thread
+ *
+ * Used before the target file is closed or replaced and before
+ * other output which must not overtake the characters.
+ *
+ */
+void output_settle(output_t *output)
+{
+    ASSERT(output != NULL);
+
+    output_flush(output);
+
+    if (output->threaded) {
+        iothread_drain();
+    }
+}
+
+/** Flush and dispose an output
+ *
+ * The target file is not closed.
+ *
+ */
+void output_done(output_t *output)
+{
+    ASSERT(output != NULL);
+
+    output_settle(output);
+    list_remove(&outputs, &output->item);
+}
+
+/** Change the target file of an output
+ *
+ * The characters buffered so far are written to the old file.
+ *
+ */
+void output_set_file(output_t *output, FILE *file)
+{
+    ASSERT(output != NULL);
+    ASSERT(file != NULL);
+
+    output_settle(output);
+    output->file = file;
+}
+
+/** Hand the writes of an output over to the I/O thread (or take them back)
+ *
+ */
+void output_set_threaded(output_t *output, bool threaded)
+{
+    ASSERT(output != NULL);
+
+    output_settle(output);
+    output->threaded = threaded;
+}
+
+/** Write the buffered characters to the target file
+ *
+ * The console output is flushed immediately,
+ * this makes debugging somewhat easier. The writes
+ * of the threaded outputs are only queued.
+ *
+ */
+void output_flush(output_t *output)
+{
+    ASSERT(output != NULL);
+
+    if ((output->threaded) && (output->len > 0)) {
+        iothread_write(output->file, output->buffer, output->len);
+        output->len = 0;
+
+        if (output->file == stdout) {
+            output_epoch++;
+        }
+
+        return;
+    }
+
+    if (output->len > 0) {
+        fwrite(output->buffer, 1, output->len, output->file);
+        output->len = 0;
+
+        if (output->file == stdout) {
+            output_epoch++;
+        }
+    }
+
+    if (output->file == stdout) {
+        fflush(output->file);
+    }
+}
+
+/** Flush all outputs
+ *
+ * Called before the simulator prints a message or waits for a command,
+ * the writes queued for the I/O thread are waited for as well.
+ *
+ */
+void output_flush_all(void)
+{
+    machine_lock();
+
+    output_epoch++;
+
+    bool threaded = false;
+    output_t *output = NULL;
+    for_each(outputs, output, output_t)
+    {
+        if (output->len > 0) {
+            output_flush(output);
+        }
+
+        threaded = threaded || output->threaded;
+    }
+
+    if (threaded) {
+        iothread_drain();
+    }
+
+    machine_unlock();
+}
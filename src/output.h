@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Buffered output of the devices
+ *
+ */
+
+#ifndef OUTPUT_H_
+#define OUTPUT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "list.h"
+
+/** Number of characters an output buffers at most */
+#define OUTPUT_BUFFER_SIZE 4096
+
+/** Buffered output stream
+ *
+ * The characters are collected and written out by a single write
+ * once a line is complete or the buffer is full. All outputs are
+ * flushed before the simulator prints anything itself, so the device
+ * output and the simulator messages keep their order.
+ *
+ */
+typedef struct {
+    item_t item;
+
+    FILE *file; /**< Target file */
+    bool sync; /**< Write every character immediately */
+    bool threaded; /**< The writes are done by the I/O thread (see iothread.c) */
+
+    size_t len; /**< Number of buffered characters */
+    char buffer[OUTPUT_BUFFER_SIZE];
+} output_t;
+
+extern uint64_t output_epoch;
+extern bool output_muted;
+
+extern void output_init(output_t *output, FILE *file);
+extern void output_done(output_t *output);
+extern void output_set_file(output_t *output, FILE *file);
+extern void output_set_threaded(output_t *output, bool threaded);
+extern void output_flush(output_t *output);
+extern void output_settle(output_t *output);
+extern void output_flush_all(void);
+
+/** Write a character to an output
+ *
+ * The buffer is flushed after a newline, when it is full
+ * or after every character of a synchronous output. Nothing
+ * is written while the output is muted.
+ *
+ */
+static inline void output_putc(output_t *output, char c)
+{
+    if (output_muted) {
+        return;
+    }
+
+    output->buffer[output->len] = c;
+    output->len++;
+
+    if ((output->sync) || (c == '\n') || (output->len == OUTPUT_BUFFER_SIZE)) {
+        output_flush(output);
+    }
+}
+
+#endif
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Real-time pacing of the simulation
+ *
+ *  With the pace variable set, the machine runs at the given frequency
+ *  of the machine cycles instead of as fast as possible. Once per
+ *  quantum (a millisecond of the simulated time) the machine cycles
+ *  are compared with the host monotonic time and the host sleeps
+ *  once the simulation gets ahead by at least PACE_SLEEP_MIN, so the
+ *  sleeps come in coarse batches rather than after every quantum.
+ *  A simulation falling behind by more than PACE_RESYNC (e.g. stopped
+ *  in the interactive mode) starts over from the current cycle
+ *  instead of running fast to catch up.
+ *
+ */
+
+#include "pace.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "main.h"
+#include "utils.h"
+
+/** Comparisons with the host time per simulated second */
+#define PACE_CHECKS 1000
+
+/** Shortest sleep of the host (in nanoseconds) */
+#define PACE_SLEEP_MIN UINT64_C(2000000)
+
+/** Lag after which the pacing starts over (in nanoseconds) */
+#define PACE_RESYNC UINT64_C(100000000)
+
+unsigned int pace_frequency = 0;
+uint64_t pace_next = UINT64_MAX;
+
+/** The pacing has started (the base is set) */
+static bool pace_started = false;
+
+/** Host time and machine cycle the pacing counts from */
+static uint64_t base_time;
+static uint64_t base_steps;
+
+/** Host time and machine cycle the pacing started at (for the report) */
+static uint64_t start_time;
+static uint64_t start_steps;
+
+/** Accuracy of the pacing */
+static uint64_t sleeps = 0;
+static uint64_t slept_time = 0;
+static uint64_t max_lag = 0;
+static uint64_t resyncs = 0;
+
+/** Host monotonic time in nanoseconds */
+static uint64_t pace_host_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Set the frequency of the machine cycles
+ *
+ * The pacing and its report start over.
+ *
+ * @param frequency Machine cycles per host second (0 disables the pacing).
+ *
+ */
+bool pace_set_frequency(unsigned int frequency)
+{
+    pace_frequency = frequency;
+    pace_started = false;
+    sleeps = 0;
+    slept_time = 0;
+    max_lag = 0;
+    resyncs = 0;
+
+    /* The first comparison sets the base */
+    pace_next = (frequency > 0) ? steps : UINT64_MAX;
+    return true;
+}
+
+/** Compare the machine cycles with the host time
+ *
+ * Called by the main loop when the cycle counter reaches pace_next.
+ * The host sleeps until the time of the current cycle if the
+ * simulation is ahead enough.
+ *
+ */
+void pace_check(void)
+{
+    if (pace_frequency == 0) {
+        pace_next = UINT64_MAX;
+        return;
+    }
+
+    uint64_t now = pace_host_time();
+    pace_next = steps + MAX(pace_frequency / PACE_CHECKS, 1);
+
+    /* The cycle counter goes back when a checkpoint is restored */
+    if ((!pace_started) || (steps < base_steps)) {
+        if ((!pace_started) || (steps < start_steps)) {
+            start_time = now;
+            start_steps = steps;
+        }
+
+        pace_started = true;
+        base_time = now;
+        base_steps = steps;
+        return;
+    }
+
+    /* Host time the current cycle is due at */
+    uint64_t due = base_time
+            + (uint64_t) ((double) (steps - base_steps) * 1e9 / pace_frequency);
+
+    if (due > now) {
+        uint64_t ahead = due - now;
+
+        if (ahead >= PACE_SLEEP_MIN) {
+            struct timespec ts = {
+                .tv_sec = ahead / 1000000000,
+                .tv_nsec = ahead % 1000000000
+            };
+
+            nanosleep(&ts, NULL);
+            sleeps++;
+            slept_time += ahead;
+        }
+
+        return;
+    }
+
+    uint64_t lag = now - due;
+    max_lag = MAX(max_lag, lag);
+
+    if (lag > PACE_RESYNC) {
+        base_time = now;
+        base_steps = steps;
+        resyncs++;
+    }
+}
+
+/** Print the accuracy of the pacing
+ *
+ * Nothing is printed unless the simulation is paced.
+ *
+ */
+void pace_print(void)
+{
+    if ((pace_frequency == 0) || (!pace_started)) {
+        return;
+    }
+
+    uint64_t elapsed = pace_host_time() - start_time;
+    double achieved = (elapsed > 0) ? (steps - start_steps) * 1e9 / elapsed : 0;
+
+    printf("Pacing: %u Hz requested, %.0f Hz achieved (%.2f%%)\n",
+            pace_frequency, achieved, 100.0 * achieved / pace_frequency);
+    printf("  %" PRIu64 " host sleeps (%.3f s), largest lag %.3f ms, "
+            "%" PRIu64 " resynchronizations\n",
+            sleeps, slept_time / 1e9, max_lag / 1e6, resyncs);
+}
+
+/** Stop the pacing of the removed machine
+ *
+ * The frequency is kept for the next machine.
+ *
+ */
+void pace_done(void)
+{
+    pace_set_frequency(pace_frequency);
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Real-time pacing of the simulation
+ *
+ */
+
+#ifndef PACE_H_
+#define PACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Machine cycles per host second (0 = as fast as possible) */
+extern unsigned int pace_frequency;
+
+/** Next machine cycle to compare with the host time in */
+extern uint64_t pace_next;
+
+extern bool pace_set_frequency(unsigned int frequency);
+extern void pace_check(void);
+extern void pace_print(void);
+extern void pace_done(void);
+
+#endif
@@ -0,0 +1,753 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Parallel simulation of processors
+ *
+ *  The processors run on host threads for a quantum of machine
+ *  cycles, the main thread simulates some of the processors itself.
+ *  The remaining devices and the scheduled events are
+ *  stepped by the main thread after all processors have finished
+ *  the quantum, so the processors only meet each other and the
+ *  devices through the sections guarded by machine_lock().
+ *
+ *  The serial simulation (quantum 0) remains the default, since the
+ *  interleaving of the processors inside a quantum depends on the
+ *  host scheduling.
+ *
+ *  There are no more threads than host cores, the threads take the
+ *  processors of a quantum one by one until none is left, so a few
+ *  threads share many processors, mostly standing by (a shared counter
+ *  instead of per-thread queues with stealing, a quantum is long). A processor
+ *  standing by is not stepped, the cycles until its timer changes the
+ *  interrupt requests are skipped at once up to the end of the quantum
+ *  (the interrupts posted by the other processors are taken in the next
+ *  one). The pinned processors keep a thread of their own.
+ *
+ *  In the relaxed mode all processors run on their own threads and
+ *  do not wait for each other at the end of a quantum. The main thread
+ *  steps the other devices meanwhile, a quantum behind the slowest
+ *  processor, and a processor waits only once it gets a quantum ahead
+ *  of the devices. The processors stop where they are whenever the main
+ *  loop needs attention, so the cycles of the processors differ.
+ *
+ *  A processor may be pinned to a host core, its thread (or the main
+ *  thread for the first processor) then runs only there. The decoded
+ *  pages and the translated blocks of a processor are touched first by
+ *  its own thread, so their host pages mostly come from the NUMA node
+ *  of the core.
+ *
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "arch/affinity.h"
+#include "assert.h"
+#include "debug/breakpoint.h"
+#include "debug/cosim.h"
+#include "debug/reverse.h"
+#include "debug/trace.h"
+#include "device/cpu/decode_cache.h"
+#include "device/cpu/general_cpu.h"
+#include "device/cpu/isa.h"
+#include "device/device.h"
+#include "fault.h"
+#include "main.h"
+#include "parallel.h"
+#include "parser.h"
+#include "replay.h"
+
+unsigned int parallel_quantum = 0;
+bool parallel_relaxed = false;
+bool parallel_active = false;
+
+/** Processor simulated by a thread */
+typedef struct {
+    pthread_t thread;
+    device_t *dev;
+    uint64_t round; /**< Last quantum started by the thread */
+    uint64_t cycles; /**< Cycles run in the last quantum (in the run if relaxed) */
+} worker_t;
+
+/** Workers of all processors
+ *
+ * The first one is run by the main thread unless the processors are relaxed.
+ *
+ */
+static worker_t workers[MAX_CPUS];
+static size_t worker_count = 0;
+
+/** First worker run by its own thread */
+static size_t worker_first = 1;
+
+/** Threads running the workers (including the main thread) */
+static size_t pool_threads = 0;
+
+/** The threads take the processors of a quantum one by one */
+static bool pool_shared = false;
+
+/** Next processor of the quantum to be taken by a thread */
+static size_t pool_next = 0;
+
+/** False if the processors have changed since the workers were started */
+static bool workers_valid = false;
+
+/** Host core the main thread is pinned to (-1 = any) */
+static int main_core = -1;
+
+/** Lock of the sections shared by the processors */
+static pthread_mutex_t machine_mutex;
+static bool machine_mutex_ready = false;
+
+/** Synchronization of the quanta */
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_finish = PTHREAD_COND_INITIALIZER;
+static uint64_t pool_round = 0;
+static uint64_t pool_limit = 0;
+static size_t pool_running = 0;
+static bool pool_quit = false;
+
+/** Progress of the relaxed processors
+ *
+ * The processors run up to the target, the main thread waits for the
+ * slowest one to reach the goal and the devices are stepped up to the
+ * base. The target is lowered by a processor stopping the machine.
+ *
+ */
+static bool pool_relaxed = false;
+static bool relaxed_running = false;
+static uint64_t relaxed_base = 0;
+static uint64_t relaxed_goal = 0;
+static uint64_t relaxed_target = 0;
+
+/** Longest wait of the main thread for the relaxed processors (in ns) */
+#define RELAXED_WAIT 1000000
+
+void parallel_lock(void)
+{
+    pthread_mutex_lock(&machine_mutex);
+}
+
+void parallel_unlock(void)
+{
+    pthread_mutex_unlock(&machine_mutex);
+}
+
+/** Execute one step of the processor of a worker */
+static inline void worker_step(worker_t *worker)
+{
+#if ISA_SINGLE
+    isa_step((general_cpu_t *) worker->dev->data);
+#else
+    worker->dev->type->step(worker->dev);
+#endif
+}
+
+/** Skip the standby cycles of the processor of a worker
+ *
+ * The processor is not stepped while it stands by without noticing
+ * anything, i.e. until it would take an interrupt or its timer would
+ * change the interrupt requests (as the parked processors of the serial
+ * simulation). The interrupts posted meanwhile are taken afterwards.
+ *
+ * @param limit Most cycles to skip.
+ *
+ * @return Number of the skipped cycles.
+ *
+ */
+static uint64_t worker_skip(worker_t *worker, uint64_t limit)
+{
+    general_cpu_t *cpu = (general_cpu_t *) worker->dev->data;
+    uint64_t cycles;
+
+    if ((!machine_skip_standby) || (cpu->type->standby == NULL)
+            || (__atomic_load_n(&cpu->posted, __ATOMIC_RELAXED) != 0)
+            || (!cpu->type->standby(cpu->data, &cycles)) || (cycles == 0)) {
+        return 0;
+    }
+
+    if (cycles > limit) {
+        cycles = limit;
+    }
+
+    cpu->type->skip(cpu->data, cycles);
+    return cycles;
+}
+
+/** Run the processor of the worker until the end of the quantum
+ *
+ * A processor which halts the machine or enters the interactive
+ * mode lowers the end of the quantum to the cycle it happened in,
+ * so the processors which are behind catch up with it. The processors
+ * already past that cycle only notice the lowered limit before their
+ * next step and stop where they are, so they overshoot the halt
+ * (the devices then catch up with the fastest processor).
+ *
+ */
+static void worker_run(worker_t *worker)
+{
+    uint64_t cycles = 0;
+    uint64_t limit;
+
+    while (cycles < (limit = __atomic_load_n(&pool_limit, __ATOMIC_ACQUIRE))) {
+        uint64_t skipped = worker_skip(worker, limit - cycles);
+
+        if (skipped > 0) {
+            cycles += skipped;
+            continue;
+        }
+
+        bool stopped = machine_stopping();
+
+        worker_step(worker);
+
+        if ((!stopped) && (machine_stopping())) {
+            pthread_mutex_lock(&pool_mutex);
+            if (cycles + 1 < pool_limit) {
+                __atomic_store_n(&pool_limit, cycles + 1, __ATOMIC_RELEASE);
+            }
+            pthread_mutex_unlock(&pool_mutex);
+        }
+
+        cycles++;
+    }
+
+    worker->cycles = cycles;
+}
+
+/** Run the processors of the quantum on the calling thread
+ *
+ * Each thread runs its own processor, unless the processors are
+ * shared. Then the threads take the processors one by one until none
+ * is left, so the threads done with the processors standing by or
+ * halted take over the rest.
+ *
+ */
+static void pool_run(worker_t *own)
+{
+    if (!pool_shared) {
+        worker_run(own);
+        return;
+    }
+
+    while (true) {
+        size_t i = __atomic_fetch_add(&pool_next, 1, __ATOMIC_RELAXED);
+
+        if (i >= worker_count) {
+            break;
+        }
+
+        worker_run(&workers[i]);
+    }
+}
+
+/** Pin the calling thread to the host core of the processor of a worker
+ *
+ * The threads inherit the cores of the main thread, so the threads
+ * of the processors not pinned are explicitly allowed all cores.
+ *
+ */
+static void worker_pin(worker_t *worker)
+{
+    general_cpu_t *cpu = (general_cpu_t *) worker->dev->data;
+
+    if (!host_pin_thread(cpu->host_core)) {
+        alert("Unable to pin processor %u to host core %d: %s",
+                cpu->cpuno, cpu->host_core, strerror(errno));
+    }
+}
+
+/** Run the processor of the worker up to the target of the relaxed mode
+ *
+ * The slowest processor reaching the goal wakes the main thread.
+ * A processor which halts the machine or enters the interactive mode
+ * lowers the target, the other processors catch up with it or stop.
+ *
+ */
+static void worker_run_relaxed(worker_t *worker)
+{
+    uint64_t cycles = worker->cycles;
+    uint64_t target;
+
+    while (cycles < (target = __atomic_load_n(&relaxed_target, __ATOMIC_ACQUIRE))) {
+        uint64_t goal = __atomic_load_n(&relaxed_goal, __ATOMIC_RELAXED);
+        uint64_t skipped = worker_skip(worker, target - cycles);
+        bool stopping = false;
+
+        if (skipped == 0) {
+            bool stopped = machine_stopping();
+
+            worker_step(worker);
+            skipped = 1;
+            stopping = (!stopped) && (machine_stopping());
+        }
+
+        bool reached = (cycles < goal) && (cycles + skipped >= goal);
+
+        cycles += skipped;
+        __atomic_store_n(&worker->cycles, cycles, __ATOMIC_RELEASE);
+
+        if ((stopping) || (reached)) {
+            pthread_mutex_lock(&pool_mutex);
+            if ((stopping) && (cycles < relaxed_target)) {
+                __atomic_store_n(&relaxed_target, cycles, __ATOMIC_RELEASE);
+            }
+            pthread_cond_signal(&pool_finish);
+            pthread_mutex_unlock(&pool_mutex);
+        }
+    }
+}
+
+/** Thread of a relaxed processor
+ *
+ * Runs whenever the target is ahead of the processor, the running
+ * threads are counted so that the main thread can wait for all
+ * processors to stop.
+ *
+ */
+static void *worker_thread_relaxed(void *arg)
+{
+    worker_t *worker = (worker_t *) arg;
+
+    worker_pin(worker);
+    pthread_mutex_lock(&pool_mutex);
+
+    while (true) {
+        while ((!pool_quit) && (worker->cycles >= relaxed_target)) {
+            pthread_cond_wait(&pool_start, &pool_mutex);
+        }
+
+        if (pool_quit) {
+            break;
+        }
+
+        pool_running++;
+        pthread_mutex_unlock(&pool_mutex);
+
+        worker_run_relaxed(worker);
+
+        pthread_mutex_lock(&pool_mutex);
+        pool_running--;
+        pthread_cond_signal(&pool_finish);
+    }
+
+    pthread_mutex_unlock(&pool_mutex);
+    return NULL;
+}
+
+static void *worker_thread(void *arg)
+{
+    worker_t *worker = (worker_t *) arg;
+
+    worker_pin(worker);
+    pthread_mutex_lock(&pool_mutex);
+
+    while (true) {
+        while ((!pool_quit) && (worker->round == pool_round)) {
+            pthread_cond_wait(&pool_start, &pool_mutex);
+        }
+
+        if (pool_quit) {
+            break;
+        }
+
+        worker->round = pool_round;
+        pthread_mutex_unlock(&pool_mutex);
+
+        pool_run(worker);
+
+        pthread_mutex_lock(&pool_mutex);
+        pool_running--;
+        if (pool_running == 0) {
+            pthread_cond_signal(&pool_finish);
+        }
+    }
+
+    pthread_mutex_unlock(&pool_mutex);
+    return NULL;
+}
+
+/** Terminate all worker threads */
+static void pool_stop(void)
+{
+    pthread_mutex_lock(&pool_mutex);
+    pool_quit = true;
+    pthread_cond_broadcast(&pool_start);
+    pthread_mutex_unlock(&pool_mutex);
+
+    for (size_t i = worker_first; i < pool_threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    pool_quit = false;
+    worker_count = 0;
+    pool_threads = 0;
+
+    if (main_core >= 0) {
+        host_pin_thread(-1);
+        main_core = -1;
+    }
+}
+
+/** Start the threads running the processors
+ *
+ * The relaxed and the pinned processors get a thread each, otherwise
+ * there are as many threads as host cores (at most one per processor).
+ * No threads are started if there are not enough processors. If the
+ * threads cannot be created, the parallel simulation is disabled.
+ *
+ */
+static void pool_start_workers(void)
+{
+    if (!machine_mutex_ready) {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(&machine_mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+        machine_mutex_ready = true;
+    }
+
+    device_t *dev = NULL;
+    size_t count = 0;
+    bool pinned = false;
+
+    while ((count < MAX_CPUS) && (dev_next(&dev, DEVICE_FILTER_PROCESSOR))) {
+        workers[count].dev = dev;
+        workers[count].round = pool_round;
+        workers[count].cycles = 0;
+        pinned = (pinned) || (((general_cpu_t *) dev->data)->host_core >= 0);
+        count++;
+    }
+
+    worker_count = count;
+    pool_relaxed = parallel_relaxed;
+    pool_shared = (!pool_relaxed) && (!pinned);
+    worker_first = (pool_relaxed) ? 0 : 1;
+    pool_threads = count;
+
+    if ((pool_shared) && (host_core_count() < count)) {
+        pool_threads = host_core_count();
+    }
+
+    if (count < 2) {
+        /* A single processor is simulated serially */
+        worker_first = count;
+        pool_threads = count;
+        return;
+    }
+
+    relaxed_base = 0;
+    relaxed_goal = 0;
+    relaxed_target = 0;
+
+    for (size_t i = worker_first; i < pool_threads; i++) {
+        worker_t *worker = &workers[i];
+        void *(*thread)(void *) = (pool_relaxed) ? worker_thread_relaxed : worker_thread;
+
+        if (pthread_create(&worker->thread, NULL, thread, worker) != 0) {
+            alert("Unable to create processor thread, simulating serially");
+            pool_threads = i;
+            pool_stop();
+            parallel_quantum = 0;
+            return;
+        }
+    }
+
+    if (pool_relaxed) {
+        return;
+    }
+
+    /* The main thread simulates the first processor */
+    main_core = ((general_cpu_t *) workers[0].dev->data)->host_core;
+    if (main_core >= 0) {
+        worker_pin(&workers[0]);
+    }
+}
+
+/** Check whether the next cycles can be simulated in parallel
+ *
+ * The parallel simulation is used only if enabled and if nothing
+ * needs to observe the machine cycle by cycle, i.e. there are no
+ * breakpoints, no tracing (of the events), no stepping, no debugger, no record
+ * or replay of the non-deterministic inputs, no snapshots of
+ * the reverse execution and no checking of the blocks.
+ *
+ */
+bool parallel_possible(void)
+{
+    if ((parallel_quantum == 0) || (machine_interactive) || (machine_trace)
+            || (trace_events) || (remote_gdb) || (stepping > 0) || (replay_mode != REPLAY_OFF)
+            || (reverse_interval > 0) || (cosim_enabled)) {
+        return false;
+    }
+
+    if ((!workers_valid) || (pool_relaxed != parallel_relaxed)) {
+        parallel_pause();
+        pool_stop();
+        pool_start_workers();
+        workers_valid = true;
+    }
+
+    return (worker_count > 1) && (!breakpoint_any_set());
+}
+
+/** Restart the workers before the next quantum
+ *
+ * Called whenever a device is added or removed.
+ *
+ */
+void parallel_devices_changed(void)
+{
+    workers_valid = false;
+}
+
+/** Pin command implementation shared by the processors
+ *
+ * Without arguments prints the host core of the processor, otherwise
+ * pins the processor to a host core (none allows all cores again).
+ * The workers are restarted to take the change.
+ *
+ */
+bool parallel_pin_cmd(general_cpu_t *cpu, token_t *parm)
+{
+    ASSERT(cpu != NULL);
+
+    switch (parm_type(parm)) {
+    case tt_end:
+        if (cpu->host_core < 0) {
+            printf("Host core: any\n");
+        } else {
+            printf("Host core: %d\n", cpu->host_core);
+        }
+
+        return true;
+    case tt_str:
+        if (strcmp(parm_str(parm), "none") != 0) {
+            error("Host core number or none expected");
+            return false;
+        }
+
+        cpu->host_core = -1;
+        break;
+    case tt_uint:
+        if (parm_uint(parm) >= host_core_count()) {
+            error("Host core out of range (0 to %u)", host_core_count() - 1);
+            return false;
+        }
+
+        cpu->host_core = (int) parm_uint(parm);
+        break;
+    default:
+        intr_error("Unexpected parameter type");
+        return false;
+    }
+
+    workers_valid = false;
+    return true;
+}
+
+/** Slowest of the relaxed processors */
+static uint64_t relaxed_slowest(void)
+{
+    uint64_t cycles = UINT64_MAX;
+
+    for (size_t i = 0; i < worker_count; i++) {
+        uint64_t worker = __atomic_load_n(&workers[i].cycles, __ATOMIC_ACQUIRE);
+
+        if (worker < cycles) {
+            cycles = worker;
+        }
+    }
+
+    return cycles;
+}
+
+/** Stop the relaxed processors where they are
+ *
+ * Called with the pool mutex held.
+ *
+ */
+static void relaxed_stop(void)
+{
+    __atomic_store_n(&relaxed_target, 0, __ATOMIC_RELEASE);
+
+    while (pool_running > 0) {
+        pthread_cond_wait(&pool_finish, &pool_mutex);
+    }
+}
+
+/** Let the relaxed processors run for another quantum
+ *
+ * The processors are allowed a quantum ahead of the goal and the
+ * main thread waits (with a timeout, the processors signal the goal
+ * without a barrier) until the slowest one reaches the goal or the
+ * lowered target. Decoded pages over the pool capacity stop all
+ * processors to be dropped.
+ *
+ * @return Number of cycles the devices are to be stepped
+ *         to catch up with the slowest processor.
+ *
+ */
+static uint64_t parallel_step_relaxed(void)
+{
+    pthread_mutex_lock(&pool_mutex);
+
+    if (!relaxed_running) {
+        parallel_active = true;
+        relaxed_running = true;
+    }
+
+    uint64_t target = __atomic_load_n(&relaxed_target, __ATOMIC_ACQUIRE);
+
+    if ((target >= relaxed_goal) && (!machine_stopping())) {
+        /* Not lowered by a processor stopping the machine */
+        __atomic_store_n(&relaxed_goal, relaxed_base + parallel_quantum, __ATOMIC_RELAXED);
+        __atomic_store_n(&relaxed_target, relaxed_goal + parallel_quantum, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&pool_start);
+    }
+
+    uint64_t end = relaxed_goal;
+
+    while (true) {
+        target = __atomic_load_n(&relaxed_target, __ATOMIC_ACQUIRE);
+        end = (target < relaxed_goal) ? target : relaxed_goal;
+
+        if ((end <= relaxed_base) || (relaxed_slowest() >= end)) {
+            break;
+        }
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += RELAXED_WAIT;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        pthread_cond_timedwait(&pool_finish, &pool_mutex, &deadline);
+    }
+
+    if (decode_cache_over()) {
+        relaxed_stop();
+        decode_cache_trim();
+        __atomic_store_n(&relaxed_target, relaxed_goal + parallel_quantum, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&pool_start);
+    }
+
+    pthread_mutex_unlock(&pool_mutex);
+
+    uint64_t cycles = (end > relaxed_base) ? end - relaxed_base : 0;
+    relaxed_base += cycles;
+    return cycles;
+}
+
+/** Stop the relaxed processors before the main loop takes over
+ *
+ * The processors are stopped where they are and the counts of their
+ * cycles start again from zero.
+ *
+ * @return Number of cycles the devices are to be stepped to catch up
+ *         with the fastest processor.
+ *
+ */
+uint64_t parallel_pause(void)
+{
+    if (!relaxed_running) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&pool_mutex);
+    relaxed_stop();
+
+    uint64_t fastest = relaxed_base;
+
+    for (size_t i = 0; i < worker_count; i++) {
+        if (workers[i].cycles > fastest) {
+            fastest = workers[i].cycles;
+        }
+
+        workers[i].cycles = 0;
+    }
+
+    uint64_t cycles = fastest - relaxed_base;
+
+    relaxed_base = 0;
+    relaxed_goal = 0;
+    relaxed_running = false;
+    parallel_active = false;
+    pthread_mutex_unlock(&pool_mutex);
+
+    decode_cache_trim();
+    cpu_deliver_all();
+
+    return cycles;
+}
+
+/** Run all processors in parallel for one quantum
+ *
+ * The decoded pages over the pool capacity are only dropped after
+ * the quantum, when no processor executes from them.
+ *
+ * @return Number of cycles the devices are to be stepped
+ *         to catch up with the processors.
+ *
+ */
+uint64_t parallel_step(void)
+{
+    ASSERT(worker_count > 1);
+
+    if (pool_relaxed) {
+        return parallel_step_relaxed();
+    }
+
+    pthread_mutex_lock(&pool_mutex);
+    parallel_active = true;
+    __atomic_store_n(&pool_limit, (uint64_t) parallel_quantum, __ATOMIC_RELEASE);
+    pool_running = pool_threads - 1;
+    pool_next = 0;
+    pool_round++;
+    pthread_cond_broadcast(&pool_start);
+    pthread_mutex_unlock(&pool_mutex);
+
+    pool_run(&workers[0]);
+
+    pthread_mutex_lock(&pool_mutex);
+    while (pool_running > 0) {
+        pthread_cond_wait(&pool_finish, &pool_mutex);
+    }
+    parallel_active = false;
+    pthread_mutex_unlock(&pool_mutex);
+
+    decode_cache_trim();
+    cpu_deliver_all();
+
+    uint64_t cycles = 0;
+    for (size_t i = 0; i < worker_count; i++) {
+        if (workers[i].cycles > cycles) {
+            cycles = workers[i].cycles;
+        }
+    }
+
+    return cycles;
+}
+
+/** Terminate the processor threads */
+void parallel_done(void)
+{
+    parallel_pause();
+
+    if (worker_count > 0) {
+        pool_stop();
+    }
+}
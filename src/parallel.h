@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Parallel simulation of processors
+ *
+ */
+
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "device/cpu/general_cpu.h"
+#include "parser.h"
+
+/** Number of cycles the processors run in parallel (0 = serial simulation) */
+extern unsigned int parallel_quantum;
+
+/** The processors do not wait for each other at the end of a quantum */
+extern bool parallel_relaxed;
+
+/** True while the processors run on their own threads */
+extern bool parallel_active;
+
+extern bool parallel_possible(void);
+extern uint64_t parallel_step(void);
+extern uint64_t parallel_pause(void);
+extern void parallel_devices_changed(void);
+extern void parallel_done(void);
+extern bool parallel_pin_cmd(general_cpu_t *cpu, token_t *parm);
+
+extern void parallel_lock(void);
+extern void parallel_unlock(void);
+
+/** Enter a section shared by all processors
+ *
+ * Serializes accesses to the simulator state shared by the processors
+ * (devices, LL-SC tracking, decoded pages) while they run on their own
+ * threads. Does nothing during the serial simulation. The sections
+ * may be nested.
+ *
+ */
+static inline void machine_lock(void)
+{
+    if (parallel_active) {
+        parallel_lock();
+    }
+}
+
+/** Leave a section shared by all processors */
+static inline void machine_unlock(void)
+{
+    if (parallel_active) {
+        parallel_unlock();
+    }
+}
+
+#endif
@@ -25,9 +25,24 @@ static const cmd_t *last_cmd;
 typedef struct {
     token_type_t ttype;
     uint64_t i;
-    string_t str;
+    const char *str; /**< Characters of a string within the line */
+    size_t len;
 } int_token_t;
 
+/** Parameters of a parsed line
+ *
+ * The list, the tokens and their strings are allocated by parm_parse()
+ * as one block, so parsing a line costs a single allocation. Tokens
+ * and strings inserted or replaced later are allocated separately and
+ * told apart by their addresses.
+ *
+ */
+typedef struct {
+    list_t list;
+    size_t size; /**< Size of the whole block */
+    token_t tokens[];
+} parm_block_t;
+
 const char *token_overview[] = {
     "end",
     "integer",
@@ -249,6 +264,8 @@ static void read_number(const char **str, int_token_t *token)
 }
 
 /** Read a string token
+ *
+ * The token refers to the characters of the string within the line.
  *
  */
 static void read_string(const char **str, int_token_t *token)
@@ -258,43 +275,45 @@ static void read_string(const char **str, int_token_t *token)
     ASSERT(token != NULL);
 
     const char *tmp = *str;
-    string_t out;
-    string_init(&out);
 
     if ((*tmp == '"') || (*tmp == '\'')) {
         char quote = *tmp;
         tmp++;
+        token->str = tmp;
 
-        /* Test for quote */
-        if (*tmp == quote) {
+        while ((*tmp) && (*tmp != quote) && (*tmp != '\n')) {
             tmp++;
-        } else {
-            while ((*tmp) && (*tmp != quote) && (*tmp != '\n')) {
-                string_push(&out, *tmp);
-                tmp++;
-            }
+        }
 
-            if (*tmp == '\n') {
-                token->ttype = tt_err_string_noend;
-                return;
-            }
+        if (*tmp == '\n') {
+            token->ttype = tt_err_string_noend;
+            return;
+        }
 
+        token->len = tmp - token->str;
+
+        /* Skip the closing quote (missing at the end of the line) */
+        if (*tmp == quote) {
             tmp++;
         }
     } else {
+        token->str = tmp;
+        token->len = 0;
+
         if (!alphanum(*tmp)) {
+            /* A separator reads as an empty string */
             tmp++;
         } else {
             while (alphanum(*tmp)) {
-                string_push(&out, *tmp);
                 tmp++;
             }
+
+            token->len = tmp - token->str;
         }
     }
 
     *str = tmp;
     token->ttype = tt_str;
-    token->str = out;
 }
 
 /** Read the next token
@@ -332,6 +351,9 @@ static void parse_token(const char **str, int_token_t *token)
 }
 
 /** Parse the input line and link all token into the parm list
+ *
+ * The line is read twice, first to count the tokens and the characters
+ * of their strings, then to fill them into a single block.
  *
  */
 token_t *parm_parse(const char *str)
@@ -339,18 +361,32 @@ token_t *parm_parse(const char *str)
     ASSERT(str != NULL);
 
     int_token_t int_token;
-    int_token.i = 0;
-    int_token.str.str = NULL;
-
-    list_t *pars = safe_malloc_t(list_t);
-    list_init(pars);
+    size_t count = 0;
+    size_t strings_size = 0;
+    const char *tmp = str;
 
     do {
-        /* Parse next token */
-        parse_token(&str, &int_token);
+        parse_token(&tmp, &int_token);
+        count++;
+
+        if (int_token.ttype == tt_str) {
+            strings_size += int_token.len + 1;
+        }
+    } while ((int_token.ttype != tt_end) && (int_token.ttype < tt_err));
+
+    size_t size = sizeof(parm_block_t) + count * sizeof(token_t) + strings_size;
+    parm_block_t *block = (parm_block_t *) safe_malloc(size);
+    char *strings = (char *) &block->tokens[count];
+
+    block->size = size;
+    list_init(&block->list);
 
-        /* Allocate a new node */
-        token_t *token = safe_malloc_t(token_t);
+    tmp = str;
+
+    for (size_t i = 0; i < count; i++) {
+        parse_token(&tmp, &int_token);
+
+        token_t *token = &block->tokens[i];
         item_init(&token->item);
 
         /* Copy parameters */
@@ -360,16 +396,183 @@ token_t *parm_parse(const char *str)
             token->tval.i = int_token.i;
             break;
         case tt_str:
-            token->tval.str = int_token.str.str;
+            memcpy(strings, int_token.str, int_token.len);
+            strings[int_token.len] = 0;
+            token->tval.str = strings;
+            strings += int_token.len + 1;
             break;
         default:
             break;
         }
 
-        list_append(pars, &token->item);
-    } while ((int_token.ttype != tt_end) && (int_token.ttype < tt_err));
+        list_append(&block->list, &token->item);
+    }
+
+    return block->tokens;
+}
+
+/** Append bytes to the packed parameters */
+static void pack_bytes(string_t *buf, const void *data, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        string_push(buf, ((const char *) data)[i]);
+    }
+}
+
+/** Pack the parameters of a line
+ *
+ * The packed form is the number of the tokens (including the end)
+ * followed by the tokens, each a type byte followed by its integer
+ * or by the length of its string and the characters, all in the host
+ * representation. It is read back by parm_unpack() without parsing
+ * the line again.
+ *
+ */
+void parm_pack(token_t *parm, string_t *buf)
+{
+    ASSERT(parm != NULL);
+    ASSERT(buf != NULL);
+
+    uint64_t count = 0;
+    for (token_t *token = parm; token != NULL; token = (token_t *) token->item.next) {
+        count++;
+    }
+
+    pack_bytes(buf, &count, sizeof(count));
+
+    for (token_t *token = parm; token != NULL; token = (token_t *) token->item.next) {
+        uint8_t type = token->ttype;
+        pack_bytes(buf, &type, sizeof(type));
 
-    return ((token_t *) pars->head);
+        if (token->ttype == tt_uint) {
+            pack_bytes(buf, &token->tval.i, sizeof(token->tval.i));
+        } else if (token->ttype == tt_str) {
+            uint64_t len = strlen(token->tval.str);
+            pack_bytes(buf, &len, sizeof(len));
+            pack_bytes(buf, token->tval.str, len);
+        }
+    }
+}
+
+/** Read a value of the packed parameters
+ *
+ * @return False if the packed data end before the value.
+ *
+ */
+static bool unpack_bytes(const uint8_t **data, const uint8_t *end,
+        void *val, size_t size)
+{
+    if ((size_t) (end - *data) < size) {
+        return false;
+    }
+
+    memcpy(val, *data, size);
+    *data += size;
+    return true;
+}
+
+/** Build the parameters of a line from their packed form
+ *
+ * The inverse of parm_pack(). The parameters are allocated as one block
+ * as by parm_parse(), so they are deleted by parm_delete().
+ *
+ * @param data Packed parameters, advanced past them.
+ * @param end  End of the packed data.
+ *
+ * @return Parameters or NULL if the packed form is corrupted.
+ *
+ */
+token_t *parm_unpack(const uint8_t **data, const uint8_t *end)
+{
+    ASSERT(data != NULL);
+
+    /* The sizes of the tokens are found first */
+    const uint8_t *pos = *data;
+    uint64_t count;
+    size_t strings_size = 0;
+
+    if ((!unpack_bytes(&pos, end, &count, sizeof(count)))
+            || (count == 0) || (count > (uint64_t) (end - pos))) {
+        return NULL;
+    }
+
+    for (uint64_t i = 0; i < count; i++) {
+        uint8_t type;
+        uint64_t val = 0;
+
+        if ((!unpack_bytes(&pos, end, &type, sizeof(type)))
+                || (type > tt_err_overflow)
+                || ((type != tt_uint) && (type != tt_str) && (i + 1 < count))
+                || ((type == tt_str) && (i + 1 == count))) {
+            return NULL;
+        }
+
+        if ((type == tt_uint) || (type == tt_str)) {
+            if (!unpack_bytes(&pos, end, &val, sizeof(val))) {
+                return NULL;
+            }
+        }
+
+        if (type == tt_str) {
+            if (val > (uint64_t) (end - pos)) {
+                return NULL;
+            }
+
+            pos += val;
+            strings_size += val + 1;
+        }
+    }
+
+    size_t size = sizeof(parm_block_t) + count * sizeof(token_t) + strings_size;
+    parm_block_t *block = (parm_block_t *) safe_malloc(size);
+    char *strings = (char *) &block->tokens[count];
+
+    block->size = size;
+    list_init(&block->list);
+
+    pos = *data + sizeof(count);
+
+    for (uint64_t i = 0; i < count; i++) {
+        token_t *token = &block->tokens[i];
+        item_init(&token->item);
+
+        uint8_t type = tt_end;
+        unpack_bytes(&pos, end, &type, sizeof(type));
+        token->ttype = (token_type_t) type;
+
+        if (type == tt_uint) {
+            unpack_bytes(&pos, end, &token->tval.i, sizeof(token->tval.i));
+        } else if (type == tt_str) {
+            uint64_t len = 0;
+            unpack_bytes(&pos, end, &len, sizeof(len));
+            unpack_bytes(&pos, end, strings, len);
+            strings[len] = 0;
+            token->tval.str = strings;
+            strings += len + 1;
+        }
+
+        list_append(&block->list, &token->item);
+    }
+
+    *data = pos;
+    return block->tokens;
+}
+
+/** Test whether the memory was allocated with the parameter block
+ *
+ * @param parm Any parameter of the list (or a standalone one).
+ * @param ptr  Token or string of the parameter list.
+ *
+ */
+static bool parm_in_block(const token_t *parm, const void *ptr)
+{
+    const parm_block_t *block = (const parm_block_t *) parm->item.list;
+
+    if (block == NULL) {
+        return false;
+    }
+
+    return ((uintptr_t) ptr - (uintptr_t) block) < block->size;
 }
 
 /** Delete the parameter list
@@ -382,22 +585,24 @@ void parm_delete(token_t *parm)
     ASSERT(parm != NULL);
     ASSERT(parm->item.list != NULL);
 
-    list_t *list = parm->item.list;
-    token_t *token = (token_t *) list->head;
+    parm_block_t *block = (parm_block_t *) parm->item.list;
+    token_t *token = (token_t *) block->list.head;
 
     while (token != NULL) {
-        if (token->ttype == tt_str) {
+        token_t *next = (token_t *) token->item.next;
+
+        if ((token->ttype == tt_str) && (!parm_in_block(token, token->tval.str))) {
             safe_free(token->tval.str);
         }
 
-        token_t *removed = token;
-        token = (token_t *) token->item.next;
+        if (!parm_in_block(token, token)) {
+            safe_free(token);
+        }
 
-        list_remove(list, &removed->item);
-        safe_free(removed);
+        token = next;
     }
 
-    safe_free(list);
+    safe_free(block);
 }
 
 /** Check for the end of the string
@@ -569,7 +774,7 @@ void parm_set_uint(token_t *parm, uint64_t val)
 {
     ASSERT(parm != NULL);
 
-    if (parm->ttype == tt_str) {
+    if ((parm->ttype == tt_str) && (!parm_in_block(parm, parm->tval.str))) {
         safe_free(parm->tval.str);
     }
 
@@ -585,7 +790,7 @@ void parm_set_str(token_t *parm, char *str)
     ASSERT(parm != NULL);
     ASSERT(str != NULL);
 
-    if (parm->ttype == tt_str) {
+    if ((parm->ttype == tt_str) && (!parm_in_block(parm, parm->tval.str))) {
         safe_free(parm->tval.str);
     }
 
@@ -17,6 +17,7 @@
 
 #include "list.h"
 #include "main.h"
+#include "utils.h"
 
 typedef enum {
     tt_end,
@@ -113,6 +114,8 @@ typedef struct cmd {
 } cmd_t;
 
 extern token_t *parm_parse(const char *str);
+extern void parm_pack(token_t *parm, string_t *buf);
+extern token_t *parm_unpack(const uint8_t **data, const uint8_t *end);
 extern void parm_delete(token_t *parm);
 
 extern void parm_check_end(token_t *parm, const char *str);
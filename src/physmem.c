@@ -15,11 +15,16 @@
 
 #include "assert.h"
 #include "debug/breakpoint.h"
+#include "debug/cosim.h"
+#include "debug/mixstat.h"
+#include "device/cpu/decode_cache.h"
 #include "device/cpu/general_cpu.h"
 #include "device/device.h"
 #include "endian.h"
 #include "list.h"
+#include "parallel.h"
 #include "physmem.h"
+#include "profile.h"
 #include "utils.h"
 
 /** Physical memory management
@@ -27,360 +32,558 @@
  */
 
 #define FTL2_WIDTH 12
-#define FTL1_WIDTH 12
-
 #define FTL2_COUNT (1 << FTL2_WIDTH)
-#define FTL1_COUNT (1 << FTL1_WIDTH)
-
 #define FTL2_SHIFT (FRAME_WIDTH)
+#define FTL2_MASK (FTL2_COUNT - 1)
+
+/** Shift of the region number covered by a radix leaf */
 #define FTL1_SHIFT (FRAME_WIDTH + FTL2_WIDTH)
 
-#define FTL2_MASK (FTL2_COUNT - 1)
-#define FTL1_MASK (FTL1_COUNT - 1)
-
-typedef frame_t *ftl1_t[FTL2_COUNT];
-typedef ftl1_t *ftl0_t[FTL1_COUNT];
-
-static ftl0_t ftl0 = {
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
-};
+typedef struct {
+    /* Frames of the region covered by the table */
+    frame_t *frames[FTL2_COUNT];
 
-void physmem_wire(physmem_area_t *area)
+    /* Number of frames in the table */
+    unsigned int used;
+
+    /* Region covered by the table (address >> FTL1_SHIFT) */
+    uint64_t region;
+} ftl1_t;
+
+/** Flat frame table
+ *
+ * Frames below FLAT_LIMIT are kept in a one-level table indexed
+ * by the frame number, so that the usual configurations with
+ * memory at low addresses are looked up by a range check and
+ * a single load. The table grows to cover the highest wired
+ * frame below the limit, frames above it are kept in the
+ * hashed radix table.
+ *
+ */
+#define FLAT_LIMIT (UINT64_C(1) << 32)
+#define FLAT_FRAMES ((pfn_t) ADDR2FRAME(FLAT_LIMIT))
+
+/** Frames of the wired areas set up by a host thread at once */
+#define WIRE_SPLIT_FRAMES 65536
+
+frame_t **physmem_flat_table = NULL;
+pfn_t physmem_flat_count = 0;
+
+/** Hashed radix table
+ *
+ * The radix leaves (ftl1_t) cover aligned regions of FTL2_COUNT
+ * frames. Instead of a radix top level, which would have to span
+ * the whole physical address space, the leaves are found by their
+ * region in an open addressing hash table (linear probing, at most
+ * half full). Sparse physical address spaces of PHYS_WIDTH bits
+ * thus cost memory only for the regions used and a lookup is
+ * a hash, usually a single probe and the load from the leaf.
+ *
+ */
+static ftl1_t **ftl_hash = NULL;
+static size_t ftl_hash_size = 0;
+static size_t ftl_hash_used = 0;
+
+/** Home slot of a region in the hashed radix table */
+static inline size_t ftl_hash_home(uint64_t region)
 {
-    ASSERT(area != NULL);
-    ASSERT(area->type != MEMT_NONE);
-    ASSERT(area->count > 0);
-    ASSERT(area->data != NULL);
-    // ASSERT(area->trans != NULL);
+    return ((region * UINT64_C(0x9e3779b97f4a7c15)) >> 32) & (ftl_hash_size - 1);
+}
 
-    pfn_t pfn;
-    for (pfn = 0; pfn < area->count; pfn++) {
-        ptr36_t addr = FRAME2ADDR(area->start + pfn);
+/** Find the radix leaf of a region
+ *
+ * @return The leaf or NULL if the region has no frames.
+ *
+ */
+static inline ftl1_t *ftl_find(uint64_t region)
+{
+    if (ftl_hash_used == 0) {
+        return NULL;
+    }
+
+    size_t mask = ftl_hash_size - 1;
+
+    for (size_t i = ftl_hash_home(region); ftl_hash[i] != NULL; i = (i + 1) & mask) {
+        if (ftl_hash[i]->region == region) {
+            return ftl_hash[i];
+        }
+    }
+
+    return NULL;
+}
+
+/** Put a radix leaf into the first free slot of its region */
+static void ftl_hash_put(ftl1_t *ftl1)
+{
+    size_t mask = ftl_hash_size - 1;
+    size_t i = ftl_hash_home(ftl1->region);
+
+    while (ftl_hash[i] != NULL) {
+        i = (i + 1) & mask;
+    }
+
+    ftl_hash[i] = ftl1;
+}
+
+/** Add a radix leaf to the hashed radix table
+ *
+ * The table is doubled (and rehashed) to stay at most half full.
+ *
+ */
+static void ftl_insert(ftl1_t *ftl1)
+{
+    if (2 * (ftl_hash_used + 1) > ftl_hash_size) {
+        ftl1_t **old = ftl_hash;
+        size_t old_size = ftl_hash_size;
+
+        ftl_hash_size = (old_size == 0) ? 16 : 2 * old_size;
+        ftl_hash = (ftl1_t **) safe_malloc(ftl_hash_size * sizeof(ftl1_t *));
+        memset(ftl_hash, 0, ftl_hash_size * sizeof(ftl1_t *));
 
-        /* 1st level frame table */
-        ftl1_t *ftl1 = ftl0[(addr >> FTL1_SHIFT) & FTL1_MASK];
-        if (ftl1 == NULL) {
-            /* Allocate new 2nd level frame table */
-            ftl1 = safe_malloc_t(ftl1_t);
-            memset(ftl1, 0, sizeof(ftl1_t));
-            ftl0[(addr >> FTL1_SHIFT) & FTL1_MASK] = ftl1;
+        for (size_t i = 0; i < old_size; i++) {
+            if (old[i] != NULL) {
+                ftl_hash_put(old[i]);
+            }
         }
 
-        /* 2nd level frame table */
-        frame_t *frame = (*ftl1)[(addr >> FTL2_SHIFT) & FTL2_MASK];
+        safe_free(old);
+    }
+
+    ftl_hash_put(ftl1);
+    ftl_hash_used++;
+}
+
+/** Remove a radix leaf from the hashed radix table
+ *
+ * The leaves following in the same cluster are shifted back
+ * to keep them reachable from their home slots (no tombstones).
+ *
+ */
+static void ftl_remove(ftl1_t *ftl1)
+{
+    size_t mask = ftl_hash_size - 1;
+    size_t i = ftl_hash_home(ftl1->region);
+
+    while (ftl_hash[i] != ftl1) {
+        ASSERT(ftl_hash[i] != NULL);
+        i = (i + 1) & mask;
+    }
+
+    ftl_hash[i] = NULL;
+    ftl_hash_used--;
+
+    for (size_t j = (i + 1) & mask; ftl_hash[j] != NULL; j = (j + 1) & mask) {
+        size_t home = ftl_hash_home(ftl_hash[j]->region);
+
+        /* The leaf stays if its home lies cyclically in (i, j] */
+        bool stays = (i <= j) ? ((i < home) && (home <= j))
+                              : ((i < home) || (home <= j));
+
+        if (!stays) {
+            ftl_hash[i] = ftl_hash[j];
+            ftl_hash[j] = NULL;
+            i = j;
+        }
+    }
+}
+
+/** Source of frame generation numbers
+ *
+ * A single counter is shared by all frames so that a frame which
+ * is unwired and wired again never reuses a generation number
+ * of its predecessor.
+ */
+static uint64_t frame_generation = 0;
+
+/** Save the contents of a frame at the reset point
+ *
+ * Called before the first write into the frame after the reset point.
+ *
+ */
+static void frame_reset_save(frame_t *frame)
+{
+    physmem_area_t *area = frame->area;
+    uint8_t *copy = (uint8_t *) safe_malloc(FRAME_SIZE);
+
+    memcpy(copy, frame->data, FRAME_SIZE);
+    area->reset_copies[frame - area->frames] = copy;
+    frame->reset_saved = true;
+}
+
+/** Mark the content of the frame as modified
+ *
+ * Invalidates the cached decodes of the written chunks of the frame.
+ * A clean frame does not allow direct writes, so the first write
+ * after a checkpoint always gets here and marks the frame dirty.
+ * Likewise the first write after the reset point saves the frame
+ * and the first write after physmem_written_clear() marks the frame
+ * written.
+ *
+ * @param addr Address of the written bytes (within the frame).
+ * @param size Number of the written bytes (FRAME_SIZE for all).
+ *
+ */
+static inline void frame_modified(frame_t *frame, ptr36_t addr, len36_t size)
+{
+    decode_cache_written(frame, addr & FRAME_MASK, size);
+    frame->generation = ++frame_generation;
+
+    if (!frame->reset_saved) {
+        frame_reset_save(frame);
+    }
+
+    if (!frame->dirty) {
+        frame->dirty = true;
+        physmem_frame_update(frame);
+    }
+
+    physmem_area_t *area = frame->area;
+
+    if ((area->written != NULL) && (!area->written[frame - area->frames])) {
+        area->written[frame - area->frames] = true;
+        physmem_frame_update(frame);
+    }
+}
+
+/** Take the current contents of the frame as its contents at the reset point
+ *
+ * Called after the frame data are replaced by a command (or a newly
+ * wired area), the reset does not undo the replacement.
+ *
+ */
+static void frame_reset_rebase(frame_t *frame)
+{
+    physmem_area_t *area = frame->area;
+
+    if (area->reset_copies != NULL) {
+        safe_free(area->reset_copies[frame - area->frames]);
+    }
+
+    frame->reset_saved = !area->reset_tracked;
+    physmem_frame_update(frame);
+}
+
+/** Version of the physical memory layout
+ *
+ * Changes whenever frames are wired or unwired, so that frame
+ * pointers cached along with address translations can be
+ * validated by a single comparison.
+ */
+unsigned int physmem_layout = 0;
+
+/** SC-LL tracking
+ *
+ * Each processor holds at most one reservation. Every frame counts
+ * the reservations inside it, so that writes to frames without
+ * reservations skip the tracking entirely. The processors holding
+ * a reservation are kept in a dense array, so a write into a frame
+ * with reservations only looks at the live reservations.
+ *
+ */
+
+/** Frame holding the reservation of each processor (NULL if none) */
+static frame_t *sc_frames[MAX_CPUS];
+
+/** Processors holding a reservation (in no particular order) */
+static unsigned int sc_live[MAX_CPUS];
+static unsigned int sc_live_count = 0;
+
+/** Position of each processor holding a reservation in sc_live */
+static unsigned int sc_live_index[MAX_CPUS];
+
+/** Register current processor in LL-SC tracking
+ *
+ * Any previous reservation of the processor is replaced. Reservations
+ * outside configured memory are not tracked since device writes never
+ * break them.
+ *
+ */
+void sc_register(unsigned int procno, ptr36_t addr)
+{
+    ASSERT(procno < MAX_CPUS);
+
+    machine_lock();
+    sc_unregister(procno);
+
+    frame_t *frame = physmem_find_frame(addr);
+    if (frame != NULL) {
+        sc_frames[procno] = frame;
+        sc_live_index[procno] = sc_live_count;
+        sc_live[sc_live_count++] = procno;
+        frame->sc_count++;
+        physmem_frame_update(frame);
+    }
+
+    machine_unlock();
+}
+
+/** Remove current processor from the LL-SC tracking
+ *
+ */
+void sc_unregister(unsigned int procno)
+{
+    ASSERT(procno < MAX_CPUS);
+
+    if (sc_frames[procno] == NULL) {
+        return;
+    }
+
+    machine_lock();
+
+    frame_t *frame = sc_frames[procno];
+    if (frame != NULL) {
+        /* Move the last live processor into the freed position */
+        unsigned int index = sc_live_index[procno];
+        unsigned int last = sc_live[--sc_live_count];
+        sc_live[index] = last;
+        sc_live_index[last] = index;
+
+        frame->sc_count--;
+        sc_frames[procno] = NULL;
+        physmem_frame_update(frame);
+    }
+
+    machine_unlock();
+}
+
+/** Drop all reservations inside a frame which is being removed
+ *
+ */
+static void sc_drop_frame(frame_t *frame)
+{
+    for (unsigned int i = sc_live_count; (i > 0) && (frame->sc_count != 0); i--) {
+        unsigned int procno = sc_live[i - 1];
+
+        if (sc_frames[procno] == frame) {
+            sc_unregister(procno);
+        }
+    }
+}
+
+/** Load Linked and Store Conditional control
+ *
+ * The live reservations are visited from the last one, so that
+ * the unregistered ones are replaced by the already visited ones.
+ *
+ * @param frame Frame being written to.
+ * @param addr  Address of the write.
+ * @param size  Width of the write.
+ *
+ */
+static inline void sc_control(frame_t *frame, ptr36_t addr, int size)
+{
+    if (frame->sc_count == 0) {
+        return;
+    }
+
+    unsigned int remaining = frame->sc_count;
+    for (unsigned int i = sc_live_count; (i > 0) && (remaining != 0); i--) {
+        unsigned int procno = sc_live[i - 1];
+        if (sc_frames[procno] != frame) {
+            continue;
+        }
+
+        remaining--;
+        if (cpu_sc_access(get_cpu(procno), addr, size)) {
+            sc_unregister(procno);
+        }
+    }
+}
+
+/** Make the flat frame table cover the given number of frames
+ *
+ */
+static void flat_grow(pfn_t count)
+{
+    ASSERT(count <= FLAT_FRAMES);
+
+    if (count <= physmem_flat_count) {
+        return;
+    }
+
+    frame_t **table = (frame_t **) safe_malloc(count * sizeof(frame_t *));
+    memset(table, 0, count * sizeof(frame_t *));
+
+    if (physmem_flat_table != NULL) {
+        memcpy(table, physmem_flat_table, physmem_flat_count * sizeof(frame_t *));
+        safe_free(physmem_flat_table);
+    }
+
+    physmem_flat_table = table;
+    physmem_flat_count = count;
+}
+
+/** Store a frame descriptor into the frame table
+ *
+ * @param addr  Physical address of the frame.
+ * @param frame Frame descriptor or NULL to remove the frame.
+ *
+ * The radix leaves are allocated when their first frame is stored
+ * and deallocated when their last frame is removed.
+ *
+ */
+static void frame_table_set(ptr36_t addr, frame_t *frame)
+{
+    if (addr < FLAT_LIMIT) {
+        ASSERT(ADDR2FRAME(addr) < physmem_flat_count);
+        physmem_flat_table[ADDR2FRAME(addr)] = frame;
+        return;
+    }
+
+    /* Radix leaf of the region */
+    uint64_t region = addr >> FTL1_SHIFT;
+    ftl1_t *ftl1 = ftl_find(region);
+    if (ftl1 == NULL) {
         if (frame == NULL) {
-            /* Allocate new frame descriptor */
-            frame = safe_malloc_t(frame_t);
-            memset(frame, 0, sizeof(frame_t));
-            (*ftl1)[(addr >> FTL2_SHIFT) & FTL2_MASK] = frame;
+            return;
         }
 
+        /* Allocate new radix leaf */
+        ftl1 = safe_malloc_t(ftl1_t);
+        memset(ftl1, 0, sizeof(ftl1_t));
+        ftl1->region = region;
+        ftl_insert(ftl1);
+    }
+
+    frame_t **entry = &ftl1->frames[(addr >> FTL2_SHIFT) & FTL2_MASK];
+
+    if ((*entry == NULL) && (frame != NULL)) {
+        ftl1->used++;
+    } else if ((*entry != NULL) && (frame == NULL)) {
+        ftl1->used--;
+    }
+
+    *entry = frame;
+
+    /* Deallocate the leaf if it contains only NULL entries */
+    if (ftl1->used == 0) {
+        ftl_remove(ftl1);
+        safe_free(ftl1);
+    }
+}
+
+/** Set up the frame descriptors of a range of a wired area
+ *
+ * Run by the host threads for the large areas (see physmem_wire()),
+ * so only the descriptors of the range and their entries of the flat
+ * table are touched. The result is the same as of frame_modified()
+ * and frame_reset_rebase() on each fresh frame: the generations
+ * follow the frame numbers after frame_generation, the wired contents
+ * are new, i.e. written.
+ *
+ */
+static void physmem_wire_range(void *arg, size_t first, size_t last)
+{
+    physmem_area_t *area = (physmem_area_t *) arg;
+
+    memset(&area->frames[first], 0, (last - first) * sizeof(frame_t));
+
+    if (area->written != NULL) {
+        memset(&area->written[first], true, (last - first) * sizeof(bool));
+    }
+
+    for (pfn_t pfn = first; pfn < last; pfn++) {
+        ptr36_t addr = FRAME2ADDR(area->start + pfn);
+
         /* Frame descriptor */
+        frame_t *frame = &area->frames[pfn];
         frame->area = area;
         frame->data = area->data + FRAMES2SIZE(pfn);
         // frame->trans = area->trans + SIZE2INSTRS(FRAMES2SIZE(pfn));
-        frame->valid = false;
+        frame->watchpoints = physmem_breakpoint_count(addr, FRAME_SIZE);
+        frame->generation = frame_generation + pfn + 1;
+        frame->dirty = true;
+        frame->reset_saved = !area->reset_tracked;
+        physmem_frame_update(frame);
+
+        if (addr < FLAT_LIMIT) {
+            physmem_flat_table[ADDR2FRAME(addr)] = frame;
+        }
     }
 }
 
-void physmem_unwire(physmem_area_t *area)
+/** Wire an area into the frame table
+ *
+ * The frame descriptors of large areas are set up by the host threads
+ * in ranges of WIRE_SPLIT_FRAMES frames. The descriptors are touched
+ * first by the threads, the flat table entries of the frames above
+ * FLAT_LIMIT (the radix leaves) are stored by the calling thread.
+ *
+ */
+void physmem_wire(physmem_area_t *area)
 {
     ASSERT(area != NULL);
     ASSERT(area->type != MEMT_NONE);
     ASSERT(area->count > 0);
     ASSERT(area->data != NULL);
+    ASSERT(area->frames == NULL);
+    // ASSERT(area->trans != NULL);
 
-    uint32_t pfn;
-    for (pfn = 0; pfn < area->count; pfn++) {
-        ptr36_t addr = FRAME2ADDR(area->start + pfn);
+    physmem_layout++;
 
-        /* 1st level frame table */
-        ftl1_t *ftl1 = ftl0[(addr >> FTL1_SHIFT) & FTL1_MASK];
-        ASSERT(ftl1 != NULL);
+    /* All frame descriptors of the area are allocated at once */
+    area->frames = (frame_t *) safe_malloc(area->count * sizeof(frame_t));
 
-        /* 2nd level frame table */
-        frame_t **frame_ref = &((*ftl1)[(addr >> FTL2_SHIFT) & FTL2_MASK]);
-        ASSERT(*frame_ref != NULL);
+    if (area->track_writes) {
+        area->written = (bool *) safe_malloc(area->count * sizeof(bool));
+    }
 
-        /* Remove frame */
-        safe_free(*frame_ref);
+    /* Frames below the limit go to the flat table */
+    pfn_t end = area->start + area->count;
+    flat_grow((end < FLAT_FRAMES) ? end : FLAT_FRAMES);
 
-        /* Deallocate ftl1 if it contains only NULL entries*/
-        bool ftl1_empty = true;
+    split_run(area->count, WIRE_SPLIT_FRAMES, physmem_wire_range, area);
+    frame_generation += area->count;
 
-        for (size_t i = 0; i < sizeof(*ftl1) / sizeof(frame_t *); ++i) {
-            if ((*ftl1)[i] != NULL) {
-                ftl1_empty = false;
-                break;
-            }
-        }
+    pfn_t pfn = (area->start < FLAT_FRAMES) ? FLAT_FRAMES - area->start : 0;
+    for (; pfn < area->count; pfn++) {
+        frame_table_set(FRAME2ADDR(area->start + pfn), &area->frames[pfn]);
+    }
+}
+
+void physmem_unwire(physmem_area_t *area)
+{
+    ASSERT(area != NULL);
+    ASSERT(area->type != MEMT_NONE);
+    ASSERT(area->count > 0);
+    ASSERT(area->data != NULL);
+    ASSERT(area->frames != NULL);
+
+    physmem_layout++;
+
+    pfn_t pfn;
+    for (pfn = 0; pfn < area->count; pfn++) {
+        ptr36_t addr = FRAME2ADDR(area->start + pfn);
+        frame_t *frame = &area->frames[pfn];
+
+        /* Remove frame */
+        decode_cache_drop_frame(frame);
+        sc_drop_frame(frame);
 
-        if (ftl1_empty) {
-            safe_free(ftl1);
+        /* The frame might have been shadowed by an overlapping area */
+        if (physmem_find_frame(addr) == frame) {
+            frame_table_set(addr, NULL);
         }
     }
+
+    safe_free(area->frames);
+    safe_free(area->written);
 }
 
-frame_t *physmem_find_frame(ptr36_t addr)
+/** Find the frame outside of the flat frame table
+ *
+ * The slow path of physmem_find_frame().
+ *
+ */
+frame_t *physmem_find_frame_sparse(ptr36_t addr)
 {
-    ftl1_t *ftl1 = ftl0[(addr >> FTL1_SHIFT) & FTL1_MASK];
+    if (addr < FLAT_LIMIT) {
+        return NULL;
+    }
+
+    ftl1_t *ftl1 = ftl_find(addr >> FTL1_SHIFT);
     if (ftl1 != NULL) {
-        frame_t *frame = (*ftl1)[(addr >> FTL2_SHIFT) & FTL2_MASK];
+        frame_t *frame = ftl1->frames[(addr >> FTL2_SHIFT) & FTL2_MASK];
         if (frame != NULL) {
             return frame;
         }
@@ -389,99 +592,384 @@ frame_t *physmem_find_frame(ptr36_t addr)
     return NULL;
 }
 
-/** Find an activated memory breakpoint
+/** Recompute which accesses may use the frame data directly
  *
- * Find an activated memory breakpoint which would be hit for specified
- * memory address and access conditions.
+ * Needs to be called whenever the breakpoints, reservations
+ * or decoded pages of the frame change.
  *
- * @param addr         Address, where the breakpoint can be hit.
- * @param size         Size of the access operation.
- * @param access_flags Specifies the access condition, under the breakpoint
- *                     will be hit.
+ */
+void physmem_frame_update(frame_t *frame)
+{
+    unsigned int direct = 0;
+
+    if ((frame->watchpoints == 0) && (!mixstat_enabled)) {
+        direct |= FRAME_DIRECT_READ;
+
+        bool decoded = false;
+        for (unsigned int isa = 0; isa < DECODE_ISA_COUNT; isa++) {
+            decoded = decoded || (frame->decoded[isa] != NULL);
+        }
+
+        physmem_area_t *area = frame->area;
+        bool written = (area->written == NULL)
+                || (area->written[frame - area->frames]);
+
+        if ((area->writable) && (frame->sc_count == 0) && (!decoded)
+                && (frame->dirty) && (frame->reset_saved) && (written)
+                && (!cosim_enabled)) {
+            direct |= FRAME_DIRECT_WRITE;
+        }
+    }
+
+    frame->direct = direct;
+}
+
+/** Mark all frames of an area as modified
  *
- * @return Found breakpoint structure or NULL if there is not any.
+ * Needs to be called when the area data are changed
+ * without the physical memory access functions. The new
+ * data are kept by a reset to the reset point.
  *
  */
-static void physmem_breakpoint_find(ptr36_t addr, len36_t size,
-        access_t access_type)
+void physmem_area_modified(physmem_area_t *area)
 {
-    physmem_breakpoint_t *breakpoint;
+    ASSERT(area != NULL);
+
+    if (area->frames == NULL) {
+        return;
+    }
+
+    for (pfn_t pfn = 0; pfn < area->count; pfn++) {
+        frame_t *frame = &area->frames[pfn];
+        frame->reset_saved = true;
+        frame_modified(frame, 0, FRAME_SIZE);
+        frame_reset_rebase(frame);
+    }
+}
 
-    for_each(physmem_breakpoints, breakpoint, physmem_breakpoint_t)
-    {
-        if (breakpoint->addr + breakpoint->size < addr) {
+/** Mark the frames of a range as modified
+ *
+ * Needs to be called when the data of whole frames are changed
+ * without the physical memory access functions while the machine
+ * runs, the reservations inside the frames are broken as well.
+ *
+ * @param addr First address of the range (frame aligned).
+ * @param size Size of the range (frame aligned).
+ *
+ */
+void physmem_range_modified(ptr36_t addr, len36_t size)
+{
+    ASSERT(ptr36_frame_aligned(addr));
+    ASSERT(ptr36_frame_aligned(size));
+
+    machine_lock();
+
+    for (ptr36_t page = addr; page < addr + size; page += FRAME_SIZE) {
+        frame_t *frame = physmem_find_frame(page);
+        if (frame == NULL) {
             continue;
         }
 
-        if (breakpoint->addr > addr + size) {
+        sc_drop_frame(frame);
+        frame_modified(frame, 0, FRAME_SIZE);
+    }
+
+    machine_unlock();
+}
+
+/** Mark all frames of an area as clean
+ *
+ * Called when the area contents are stored in a checkpoint,
+ * the frames written to afterwards become dirty again.
+ *
+ */
+void physmem_area_clean(physmem_area_t *area)
+{
+    ASSERT(area != NULL);
+
+    if (area->frames == NULL) {
+        return;
+    }
+
+    for (pfn_t pfn = 0; pfn < area->count; pfn++) {
+        frame_t *frame = &area->frames[pfn];
+        frame->dirty = false;
+        physmem_frame_update(frame);
+    }
+}
+
+/** Recompute the direct accesses of all frames of an area
+ *
+ */
+void physmem_area_update(physmem_area_t *area)
+{
+    ASSERT(area != NULL);
+
+    if (area->frames == NULL) {
+        return;
+    }
+
+    for (pfn_t pfn = 0; pfn < area->count; pfn++) {
+        physmem_frame_update(&area->frames[pfn]);
+    }
+}
+
+/** Set the reset point of an area
+ *
+ * The current contents of a writable area are those the area returns
+ * to on a reset. The first write into each frame afterwards saves
+ * the frame, so that only the frames written to since are copied back
+ * by physmem_reset_restore() and the decoded instructions of the
+ * other frames are kept.
+ *
+ */
+void physmem_reset_mark(physmem_area_t *area)
+{
+    ASSERT(area != NULL);
+
+    physmem_reset_drop(area);
+
+    if ((!area->writable) || (area->frames == NULL)) {
+        return;
+    }
+
+    area->reset_copies = (uint8_t **) safe_malloc(area->count * sizeof(uint8_t *));
+    memset(area->reset_copies, 0, area->count * sizeof(uint8_t *));
+    area->reset_tracked = true;
+
+    for (pfn_t pfn = 0; pfn < area->count; pfn++) {
+        frame_t *frame = &area->frames[pfn];
+        frame->reset_saved = false;
+        physmem_frame_update(frame);
+    }
+}
+
+/** Return an area to its contents at the reset point
+ *
+ * The area stays at the reset point afterwards.
+ *
+ */
+void physmem_reset_restore(physmem_area_t *area)
+{
+    ASSERT(area != NULL);
+
+    if ((!area->reset_tracked) || (area->frames == NULL)) {
+        return;
+    }
+
+    for (pfn_t pfn = 0; pfn < area->count; pfn++) {
+        uint8_t *copy = area->reset_copies[pfn];
+        if (copy == NULL) {
             continue;
         }
 
-        if ((access_type & breakpoint->access_flags) != 0) {
-            physmem_breakpoint_hit(breakpoint, access_type);
-            break;
-        }
+        frame_t *frame = &area->frames[pfn];
+        sc_drop_frame(frame);
+        frame_modified(frame, 0, FRAME_SIZE);
+        memcpy(frame->data, copy, FRAME_SIZE);
+        frame_reset_rebase(frame);
     }
 }
 
-static uint8_t devmem_read8(unsigned int procno, ptr36_t addr)
+/** Drop the reset point of an area
+ *
+ */
+void physmem_reset_drop(physmem_area_t *area)
 {
-    uint32_t val = (uint32_t) DEFAULT_MEMORY_VALUE;
+    ASSERT(area != NULL);
 
-    /* List for each device */
-    device_t *dev = NULL;
-    while (dev_next(&dev, DEVICE_FILTER_ALL)) {
-        if (dev->type->read32) {
-            dev->type->read32(procno, dev, addr, &val);
+    if (area->reset_copies != NULL) {
+        for (pfn_t pfn = 0; pfn < area->count; pfn++) {
+            safe_free(area->reset_copies[pfn]);
         }
+
+        safe_free(area->reset_copies);
     }
 
-    return val;
+    area->reset_tracked = false;
+
+    if (area->frames == NULL) {
+        return;
+    }
+
+    for (pfn_t pfn = 0; pfn < area->count; pfn++) {
+        frame_t *frame = &area->frames[pfn];
+        frame->reset_saved = true;
+        physmem_frame_update(frame);
+    }
 }
 
-static uint16_t devmem_read16(unsigned int procno, ptr36_t addr)
+/** Start or stop tracking the writes into an area by frames
+ *
+ * The frames written to are marked in the written array of the area
+ * (all of them when the area is wired). A frame not marked written does
+ * not allow direct writes, so tracking costs a single slow write into
+ * each frame after physmem_written_clear().
+ *
+ */
+void physmem_track_writes(physmem_area_t *area, bool track)
 {
-    uint32_t val = (uint32_t) DEFAULT_MEMORY_VALUE;
+    ASSERT(area != NULL);
 
-    /* List for each device */
-    device_t *dev = NULL;
-    while (dev_next(&dev, DEVICE_FILTER_ALL)) {
-        if (dev->type->read32) {
-            dev->type->read32(procno, dev, addr, &val);
-        }
+    area->track_writes = track;
+
+    if (area->frames == NULL) {
+        return;
     }
 
-    return val;
+    if ((track) && (area->written == NULL)) {
+        area->written = (bool *) safe_malloc(area->count * sizeof(bool));
+        memset(area->written, true, area->count * sizeof(bool));
+    }
+
+    if (!track) {
+        safe_free(area->written);
+        physmem_area_update(area);
+    }
 }
 
-static uint32_t devmem_read32(unsigned int procno, ptr36_t addr)
+/** Clear the written marks of frames of an area
+ *
+ * @param first First frame (relative to the area start).
+ * @param count Number of frames.
+ *
+ */
+void physmem_written_clear(physmem_area_t *area, pfn_t first, pfn_t count)
 {
-    uint32_t val = (uint32_t) DEFAULT_MEMORY_VALUE;
+    ASSERT(area != NULL);
 
-    /* List for each device */
-    device_t *dev = NULL;
-    while (dev_next(&dev, DEVICE_FILTER_ALL)) {
-        if (dev->type->read32) {
-            dev->type->read32(procno, dev, addr, &val);
+    if (area->written == NULL) {
+        return;
+    }
+
+    ASSERT(first + count <= area->count);
+
+    for (pfn_t pfn = first; pfn < first + count; pfn++) {
+        if (area->written[pfn]) {
+            area->written[pfn] = false;
+            physmem_frame_update(&area->frames[pfn]);
+        }
+    }
+}
+
+/** Update the watchpoint counters of the frames in an area
+ *
+ * @param addr  First address of the watched area.
+ * @param size  Size of the watched area.
+ * @param watch True if a watchpoint covering the area is being added,
+ *              false if it is being removed.
+ *
+ */
+void physmem_watch(ptr36_t addr, len36_t size, bool watch)
+{
+    ptr36_t end = addr + size;
+
+    for (ptr36_t page = ALIGN_DOWN(addr, FRAME_SIZE); page < end;
+            page += FRAME_SIZE) {
+        frame_t *frame = physmem_find_frame(page);
+        if (frame == NULL) {
+            continue;
         }
+
+        if (watch) {
+            frame->watchpoints++;
+        } else {
+            ASSERT(frame->watchpoints > 0);
+            frame->watchpoints--;
+        }
+
+        physmem_frame_update(frame);
+    }
+}
+
+/** Check a memory access against the memory breakpoints
+ *
+ * Only called for frames with a watchpoint, all other accesses
+ * skip the breakpoint check entirely.
+ *
+ * @param addr        Address of the access.
+ * @param size        Size of the access operation.
+ * @param access_type Type of the access operation.
+ *
+ */
+static void physmem_breakpoint_check(ptr36_t addr, len36_t size,
+        access_t access_type)
+{
+    profile_region_enter(PROFILE_BREAKPOINTS);
+
+    physmem_breakpoint_t *breakpoint = physmem_breakpoint_find(addr, size,
+            access_type);
+
+    if (breakpoint != NULL) {
+        physmem_breakpoint_hit(breakpoint, addr, access_type);
     }
 
+    profile_region_leave();
+}
+
+static uint8_t devmem_read8(unsigned int procno, ptr36_t addr)
+{
+    cosim_device_access();
+
+    uint8_t val = (uint8_t) DEFAULT_MEMORY_VALUE;
+    dev_read8(procno, addr, &val);
+    return val;
+}
+
+static uint16_t devmem_read16(unsigned int procno, ptr36_t addr)
+{
+    cosim_device_access();
+
+    uint16_t val = (uint16_t) DEFAULT_MEMORY_VALUE;
+    dev_read16(procno, addr, &val);
+    return val;
+}
+
+static uint32_t devmem_read32(unsigned int procno, ptr36_t addr)
+{
+    cosim_device_access();
+
+    uint32_t val = (uint32_t) DEFAULT_MEMORY_VALUE;
+    dev_read32(procno, addr, &val);
     return val;
 }
 
 static uint64_t devmem_read64(unsigned int procno, ptr36_t addr)
 {
+    cosim_device_access();
+
     uint64_t val = (uint64_t) DEFAULT_MEMORY_VALUE;
+    dev_read64(procno, addr, &val);
+    return val;
+}
 
-    /* List for each device */
-    device_t *dev = NULL;
-    while (dev_next(&dev, DEVICE_FILTER_ALL)) {
-        if (dev->type->read64) {
-            dev->type->read64(procno, dev, addr, &val);
-        }
+/** Memory frame read (8 bits)
+ *
+ * Read 8 bits from a memory frame the caller has already looked up,
+ * e.g. through a cached address translation.
+ *
+ * @param frame     Frame containing the address.
+ * @param addr      Address of memory to be read.
+ * @param protected If true the memory breakpoints check is performed.
+ *
+ * @return Value in specified piece of memory.
+ *
+ */
+uint8_t physmem_frame_read8(frame_t *frame, ptr36_t addr, bool protected)
+{
+    /* Check for memory read breakpoints */
+    if ((protected) && (frame->watchpoints > 0)) {
+        physmem_breakpoint_check(addr, 1, ACCESS_READ);
     }
 
-    return val;
+    if ((protected) && (mixstat_enabled)) {
+        mixstat_count_bytes(&frame->area->read_bytes, 1);
+    }
+
+    ASSERT(frame->data);
+    uint8_t *data = frame->data + (addr & FRAME_MASK);
+
+    return convert_uint8_t_endian(*data);
 }
 
 /** Physical memory read (8 bits)
@@ -511,15 +999,36 @@ uint8_t physmem_read8(unsigned int procno, ptr36_t addr, bool protected)
         return devmem_read8(procno, addr);
     }
 
+    return physmem_frame_read8(frame, addr, protected);
+}
+
+/** Memory frame read (16 bits)
+ *
+ * Read 16 bits from a memory frame the caller has already looked up,
+ * e.g. through a cached address translation.
+ *
+ * @param frame     Frame containing the address.
+ * @param addr      Address of memory to be read.
+ * @param protected If true the memory breakpoints check is performed.
+ *
+ * @return Value in specified piece of memory.
+ *
+ */
+uint16_t physmem_frame_read16(frame_t *frame, ptr36_t addr, bool protected)
+{
     /* Check for memory read breakpoints */
-    if (protected) {
-        physmem_breakpoint_find(addr, 1, ACCESS_READ);
+    if ((protected) && (frame->watchpoints > 0)) {
+        physmem_breakpoint_check(addr, 2, ACCESS_READ);
+    }
+
+    if ((protected) && (mixstat_enabled)) {
+        mixstat_count_bytes(&frame->area->read_bytes, 2);
     }
 
     ASSERT(frame->data);
-    uint8_t *data = frame->data + (addr & FRAME_MASK);
+    uint16_t *data = (uint16_t *) (frame->data + (addr & FRAME_MASK));
 
-    return convert_uint8_t_endian(*data);
+    return convert_uint16_t_endian(*data);
 }
 
 /** Physical memory read (16 bits)
@@ -549,15 +1058,36 @@ uint16_t physmem_read16(unsigned int procno, ptr36_t addr, bool protected)
         return devmem_read16(procno, addr);
     }
 
+    return physmem_frame_read16(frame, addr, protected);
+}
+
+/** Memory frame read (32 bits)
+ *
+ * Read 32 bits from a memory frame the caller has already looked up,
+ * e.g. through a cached address translation.
+ *
+ * @param frame     Frame containing the address.
+ * @param addr      Address of memory to be read.
+ * @param protected If true the memory breakpoints check is performed.
+ *
+ * @return Value in specified piece of memory.
+ *
+ */
+uint32_t physmem_frame_read32(frame_t *frame, ptr36_t addr, bool protected)
+{
     /* Check for memory read breakpoints */
-    if (protected) {
-        physmem_breakpoint_find(addr, 2, ACCESS_READ);
+    if ((protected) && (frame->watchpoints > 0)) {
+        physmem_breakpoint_check(addr, 4, ACCESS_READ);
+    }
+
+    if ((protected) && (mixstat_enabled)) {
+        mixstat_count_bytes(&frame->area->read_bytes, 4);
     }
 
     ASSERT(frame->data);
-    uint16_t *data = (uint16_t *) (frame->data + (addr & FRAME_MASK));
+    uint32_t *data = (uint32_t *) (frame->data + (addr & FRAME_MASK));
 
-    return convert_uint16_t_endian(*data);
+    return convert_uint32_t_endian(*data);
 }
 
 /** Physical memory read (32 bits)
@@ -587,15 +1117,36 @@ uint32_t physmem_read32(unsigned int procno, ptr36_t addr, bool protected)
         return devmem_read32(procno, addr);
     }
 
+    return physmem_frame_read32(frame, addr, protected);
+}
+
+/** Memory frame read (64 bits)
+ *
+ * Read 64 bits from a memory frame the caller has already looked up,
+ * e.g. through a cached address translation.
+ *
+ * @param frame     Frame containing the address.
+ * @param addr      Address of memory to be read.
+ * @param protected If true the memory breakpoints check is performed.
+ *
+ * @return Value in specified piece of memory.
+ *
+ */
+uint64_t physmem_frame_read64(frame_t *frame, ptr36_t addr, bool protected)
+{
     /* Check for memory read breakpoints */
-    if (protected) {
-        physmem_breakpoint_find(addr, 4, ACCESS_READ);
+    if ((protected) && (frame->watchpoints > 0)) {
+        physmem_breakpoint_check(addr, 8, ACCESS_READ);
+    }
+
+    if ((protected) && (mixstat_enabled)) {
+        mixstat_count_bytes(&frame->area->read_bytes, 8);
     }
 
     ASSERT(frame->data);
-    uint32_t *data = (uint32_t *) (frame->data + (addr & FRAME_MASK));
+    uint64_t *data = (uint64_t *) (frame->data + (addr & FRAME_MASK));
 
-    return convert_uint32_t_endian(*data);
+    return convert_uint64_t_endian(*data);
 }
 
 /** Physical memory read (64 bits)
@@ -625,149 +1176,104 @@ uint64_t physmem_read64(unsigned int procno, ptr36_t addr, bool protected)
         return devmem_read64(procno, addr);
     }
 
-    /* Check for memory read breakpoints */
-    if (protected) {
-        physmem_breakpoint_find(addr, 8, ACCESS_READ);
-    }
-
-    ASSERT(frame->data);
-    uint64_t *data = (uint64_t *) (frame->data + (addr & FRAME_MASK));
-
-    return convert_uint64_t_endian(*data);
+    return physmem_frame_read64(frame, addr, protected);
 }
 
 static bool devmem_write8(unsigned int procno, ptr36_t addr, uint8_t val)
 {
-    bool written = false;
-
-    /* List for each device */
-    device_t *dev = NULL;
-    while (dev_next(&dev, DEVICE_FILTER_ALL)) {
-        if (dev->type->write32) {
-            dev->type->write32(procno, dev, addr, val);
-            written = true;
-        }
-    }
-
-    return written;
+    cosim_device_access();
+    return dev_write8(procno, addr, val);
 }
 
 static bool devmem_write16(unsigned int procno, ptr36_t addr, uint16_t val)
 {
-    bool written = false;
-
-    /* List for each device */
-    device_t *dev = NULL;
-    while (dev_next(&dev, DEVICE_FILTER_ALL)) {
-        if (dev->type->write32) {
-            dev->type->write32(procno, dev, addr, val);
-            written = true;
-        }
-    }
-
-    return written;
+    cosim_device_access();
+    return dev_write16(procno, addr, val);
 }
 
 static bool devmem_write32(unsigned int procno, ptr36_t addr, uint32_t val)
 {
-    bool written = false;
-
-    /* List for each device */
-    device_t *dev = NULL;
-    while (dev_next(&dev, DEVICE_FILTER_ALL)) {
-        if (dev->type->write32) {
-            dev->type->write32(procno, dev, addr, val);
-            written = true;
-        }
-    }
-
-    return written;
+    cosim_device_access();
+    return dev_write32(procno, addr, val);
 }
 
 static bool devmem_write64(unsigned int procno, ptr36_t addr, uint64_t val)
 {
-    bool written = false;
-
-    /* List for each device */
-    device_t *dev = NULL;
-    while (dev_next(&dev, DEVICE_FILTER_ALL)) {
-        if (dev->type->write64) {
-            dev->type->write64(procno, dev, addr, val);
-            written = true;
-        }
-    }
-
-    return written;
+    cosim_device_access();
+    return dev_write64(procno, addr, val);
 }
 
-/** SC-LL tracking
+/** Memory frame write (8 bits)
  *
- */
-
-typedef struct {
-    item_t item;
-    unsigned int procno;
-} sc_item_t;
-
-static list_t sc_list = LIST_INITIALIZER;
-
-/** Register current processor in LL-SC tracking list
+ * Write 8 bits of data to a memory frame the caller has already
+ * looked up, e.g. through a cached address translation.
+ *
+ * @param frame     Frame containing the address.
+ * @param addr      Address of the memory.
+ * @param val       Data to be written.
+ * @param protected False to allow writing to ROM memory and ignore
+ *                  the memory breakpoints check.
+ *
+ * @return False if the memory is ROM with protected parameter set to true.
  *
  */
-void sc_register(unsigned int procno)
+bool physmem_frame_write8(frame_t *frame, ptr36_t addr, uint8_t val, bool protected)
 {
-    /* Ignore if already registered. */
-    sc_item_t *sc_item;
+    ASSERT(frame->area);
+    ASSERT(frame->data);
 
-    for_each(sc_list, sc_item, sc_item_t)
-    {
-        if (sc_item->procno == procno) {
-            return;
-        }
+    /* Writting to ROM? */
+    if ((!frame->area->writable) && (protected)) {
+        return false;
     }
 
-    sc_item = safe_malloc_t(sc_item_t);
-    item_init(&sc_item->item);
-    sc_item->procno = procno;
-    list_append(&sc_list, &sc_item->item);
-}
+    machine_lock();
 
-/** Remove current processor from the LL-SC tracking list
- *
- */
-void sc_unregister(unsigned int procno)
-{
-    sc_item_t *sc_item;
+    sc_control(frame, addr, 1);
 
-    for_each(sc_list, sc_item, sc_item_t)
-    {
-        if (sc_item->procno == procno) {
-            list_remove(&sc_list, &sc_item->item);
-            safe_free(sc_item);
-            break;
-        }
+    /* Check for memory write breakpoints */
+    if ((protected) && (frame->watchpoints > 0)) {
+        physmem_breakpoint_check(addr, 1, ACCESS_WRITE);
     }
+
+    if ((protected) && (mixstat_enabled)) {
+        mixstat_count_bytes(&frame->area->write_bytes, 1);
+    }
+
+    if (cosim_journaling) {
+        cosim_journal(frame, addr, 1);
+    }
+
+    /* Invalidate binary translation */
+    frame_modified(frame, addr, 1);
+
+    uint8_t *data = frame->data + (addr & FRAME_MASK);
+    *data = convert_uint8_t_endian(val);
+
+    machine_unlock();
+
+    return true;
 }
 
-/** Load Linked and Store Conditional control
+/** Restore a byte of a frame undoing a store
+ *
+ * Unlike a store, the restore does not break the LL-SC reservations
+ * of the processors, does not hit the write breakpoints and is not
+ * counted nor journaled. Only the decoded instructions of the byte
+ * are invalidated.
  *
  */
-static void sc_control(ptr36_t addr, int size)
+void physmem_frame_restore8(frame_t *frame, ptr36_t addr, uint8_t val)
 {
-    sc_item_t *sc_item = (sc_item_t *) sc_list.head;
+    ASSERT(frame->area);
+    ASSERT(frame->data);
 
-    while (sc_item != NULL) {
+    machine_lock();
 
-        if (cpu_sc_access(get_cpu(sc_item->procno), addr, size)) {
-            sc_item_t *tmp = sc_item;
-            sc_item = (sc_item_t *) sc_item->item.next;
+    frame_modified(frame, addr, 1);
+    frame->data[addr & FRAME_MASK] = val;
 
-            list_remove(&sc_list, &tmp->item);
-            safe_free(tmp);
-        } else {
-            sc_item = (sc_item_t *) sc_item->item.next;
-        }
-    }
+    machine_unlock();
 }
 
 /** Physical memory write (8 bits)
@@ -796,6 +1302,25 @@ bool physmem_write8(unsigned int procno, ptr36_t addr, uint8_t val, bool protect
         return devmem_write8(procno, addr, val);
     }
 
+    return physmem_frame_write8(frame, addr, val, protected);
+}
+
+/** Memory frame write (16 bits)
+ *
+ * Write 16 bits of data to a memory frame the caller has already
+ * looked up, e.g. through a cached address translation.
+ *
+ * @param frame     Frame containing the address.
+ * @param addr      Address of the memory.
+ * @param val       Data to be written.
+ * @param protected False to allow writing to ROM memory and ignore
+ *                  the memory breakpoints check.
+ *
+ * @return False if the memory is ROM with protected parameter set to true.
+ *
+ */
+bool physmem_frame_write16(frame_t *frame, ptr36_t addr, uint16_t val, bool protected)
+{
     ASSERT(frame->area);
     ASSERT(frame->data);
 
@@ -804,18 +1329,30 @@ bool physmem_write8(unsigned int procno, ptr36_t addr, uint8_t val, bool protect
         return false;
     }
 
-    sc_control(addr, 1);
+    machine_lock();
+
+    sc_control(frame, addr, 2);
 
     /* Check for memory write breakpoints */
-    if (protected) {
-        physmem_breakpoint_find(addr, 1, ACCESS_WRITE);
+    if ((protected) && (frame->watchpoints > 0)) {
+        physmem_breakpoint_check(addr, 2, ACCESS_WRITE);
+    }
+
+    if ((protected) && (mixstat_enabled)) {
+        mixstat_count_bytes(&frame->area->write_bytes, 2);
+    }
+
+    if (cosim_journaling) {
+        cosim_journal(frame, addr, 2);
     }
 
     /* Invalidate binary translation */
-    frame->valid = false;
+    frame_modified(frame, addr, 2);
 
-    uint8_t *data = frame->data + (addr & FRAME_MASK);
-    *data = convert_uint8_t_endian(val);
+    uint16_t *data = (uint16_t *) (frame->data + (addr & FRAME_MASK));
+    *data = convert_uint16_t_endian(val);
+
+    machine_unlock();
 
     return true;
 }
@@ -846,6 +1383,25 @@ bool physmem_write16(unsigned int procno, ptr36_t addr, uint16_t val, bool prote
         return devmem_write16(procno, addr, val);
     }
 
+    return physmem_frame_write16(frame, addr, val, protected);
+}
+
+/** Memory frame write (32 bits)
+ *
+ * Write 32 bits of data to a memory frame the caller has already
+ * looked up, e.g. through a cached address translation.
+ *
+ * @param frame     Frame containing the address.
+ * @param addr      Address of the memory.
+ * @param val       Data to be written.
+ * @param protected False to allow writing to ROM memory and ignore
+ *                  the memory breakpoints check.
+ *
+ * @return False if the memory is ROM with protected parameter set to true.
+ *
+ */
+bool physmem_frame_write32(frame_t *frame, ptr36_t addr, uint32_t val, bool protected)
+{
     ASSERT(frame->area);
     ASSERT(frame->data);
 
@@ -854,18 +1410,30 @@ bool physmem_write16(unsigned int procno, ptr36_t addr, uint16_t val, bool prote
         return false;
     }
 
-    sc_control(addr, 2);
+    machine_lock();
+
+    sc_control(frame, addr, 4);
 
     /* Check for memory write breakpoints */
-    if (protected) {
-        physmem_breakpoint_find(addr, 2, ACCESS_WRITE);
+    if ((protected) && (frame->watchpoints > 0)) {
+        physmem_breakpoint_check(addr, 4, ACCESS_WRITE);
+    }
+
+    if ((protected) && (mixstat_enabled)) {
+        mixstat_count_bytes(&frame->area->write_bytes, 4);
+    }
+
+    if (cosim_journaling) {
+        cosim_journal(frame, addr, 4);
     }
 
     /* Invalidate binary translation */
-    frame->valid = false;
+    frame_modified(frame, addr, 4);
 
-    uint16_t *data = (uint16_t *) (frame->data + (addr & FRAME_MASK));
-    *data = convert_uint16_t_endian(val);
+    uint32_t *data = (uint32_t *) (frame->data + (addr & FRAME_MASK));
+    *data = convert_uint32_t_endian(val);
+
+    machine_unlock();
 
     return true;
 }
@@ -896,6 +1464,25 @@ bool physmem_write32(unsigned int procno, ptr36_t addr, uint32_t val, bool prote
         return devmem_write32(procno, addr, val);
     }
 
+    return physmem_frame_write32(frame, addr, val, protected);
+}
+
+/** Memory frame write (64 bits)
+ *
+ * Write 64 bits of data to a memory frame the caller has already
+ * looked up, e.g. through a cached address translation.
+ *
+ * @param frame     Frame containing the address.
+ * @param addr      Address of the memory.
+ * @param val       Data to be written.
+ * @param protected False to allow writing to ROM memory and ignore
+ *                  the memory breakpoints check.
+ *
+ * @return False if the memory is ROM with protected parameter set to true.
+ *
+ */
+bool physmem_frame_write64(frame_t *frame, ptr36_t addr, uint64_t val, bool protected)
+{
     ASSERT(frame->area);
     ASSERT(frame->data);
 
@@ -904,18 +1491,30 @@ bool physmem_write32(unsigned int procno, ptr36_t addr, uint32_t val, bool prote
         return false;
     }
 
-    sc_control(addr, 4);
+    machine_lock();
+
+    sc_control(frame, addr, 8);
 
     /* Check for memory write breakpoints */
-    if (protected) {
-        physmem_breakpoint_find(addr, 4, ACCESS_WRITE);
+    if ((protected) && (frame->watchpoints > 0)) {
+        physmem_breakpoint_check(addr, 8, ACCESS_WRITE);
+    }
+
+    if ((protected) && (mixstat_enabled)) {
+        mixstat_count_bytes(&frame->area->write_bytes, 8);
+    }
+
+    if (cosim_journaling) {
+        cosim_journal(frame, addr, 8);
     }
 
     /* Invalidate binary translation */
-    frame->valid = false;
+    frame_modified(frame, addr, 8);
 
-    uint32_t *data = (uint32_t *) (frame->data + (addr & FRAME_MASK));
-    *data = convert_uint32_t_endian(val);
+    uint64_t *data = (uint64_t *) (frame->data + (addr & FRAME_MASK));
+    *data = convert_uint64_t_endian(val);
+
+    machine_unlock();
 
     return true;
 }
@@ -946,26 +1545,271 @@ bool physmem_write64(unsigned int procno, ptr36_t addr, uint64_t val, bool prote
         return devmem_write64(procno, addr, val);
     }
 
-    ASSERT(frame->area);
-    ASSERT(frame->data);
+    return physmem_frame_write64(frame, addr, val, protected);
+}
 
-    /* Writting to ROM? */
-    if ((!frame->area->writable) && (protected)) {
-        return false;
+/** Number of words of a block transfer which fit into the frame
+ *
+ */
+static size_t block_chunk(ptr36_t addr, size_t count)
+{
+    size_t room = (FRAME_SIZE - (addr & FRAME_MASK)) / sizeof(uint32_t);
+    return (count < room) ? count : room;
+}
+
+/** Physical memory block read (32 bit words)
+ *
+ * Read a block of words as a sequence of physmem_read32() calls would,
+ * but look up each frame, check breakpoints and the memory only once
+ * per frame. Words of unaligned blocks and of addresses outside of
+ * memory are read one by one.
+ *
+ * @param procno    Id of processor (or device) which wants to read.
+ * @param addr      Address of the first word.
+ * @param dst       Buffer receiving the words.
+ * @param count     Number of words to read.
+ * @param protected If true the memory breakpoints check is performed.
+ *
+ */
+void physmem_read_block32(unsigned int procno, ptr36_t addr, uint32_t *dst,
+        size_t count, bool protected)
+{
+    while (count > 0) {
+        frame_t *frame = physmem_find_frame(addr);
+
+        if ((frame == NULL) || ((addr & 3) != 0)) {
+            *dst = physmem_read32(procno, addr, protected);
+            addr += sizeof(uint32_t);
+            dst++;
+            count--;
+            continue;
+        }
+
+        size_t chunk = block_chunk(addr, count);
+        len36_t size = chunk * sizeof(uint32_t);
+
+        if ((protected) && (frame->watchpoints > 0)) {
+            physmem_breakpoint_check(addr, size, ACCESS_READ);
+        }
+
+        const uint32_t *src = (const uint32_t *) (frame->data + (addr & FRAME_MASK));
+        convert_uint32_t_endian_block(dst, src, chunk);
+
+        addr += size;
+        dst += chunk;
+        count -= chunk;
     }
+}
 
-    sc_control(addr, 8);
+/** Physical memory block write (32 bit words)
+ *
+ * Write a block of words as a sequence of physmem_write32() calls would,
+ * but look up each frame, break reservations, check breakpoints and
+ * invalidate binary translation only once per frame. Words of unaligned
+ * blocks and of addresses outside of memory are written one by one.
+ *
+ * @param procno    Id of processor (or device) which wants to write.
+ * @param addr      Address of the first word.
+ * @param src       Words to write.
+ * @param count     Number of words to write.
+ * @param protected False to allow writing to ROM memory and ignore
+ *                  the memory breakpoints check.
+ *
+ */
+void physmem_write_block32(unsigned int procno, ptr36_t addr,
+        const uint32_t *src, size_t count, bool protected)
+{
+    while (count > 0) {
+        frame_t *frame = physmem_find_frame(addr);
+
+        if ((frame == NULL) || ((addr & 3) != 0)) {
+            physmem_write32(procno, addr, *src, protected);
+            addr += sizeof(uint32_t);
+            src++;
+            count--;
+            continue;
+        }
 
-    /* Check for memory write breakpoints */
-    if (protected) {
-        physmem_breakpoint_find(addr, 8, ACCESS_WRITE);
+        size_t chunk = block_chunk(addr, count);
+        len36_t size = chunk * sizeof(uint32_t);
+
+        /* Writes to ROM are dropped */
+        if ((frame->area->writable) || (!protected)) {
+            machine_lock();
+
+            sc_control(frame, addr, size);
+
+            if ((protected) && (frame->watchpoints > 0)) {
+                physmem_breakpoint_check(addr, size, ACCESS_WRITE);
+            }
+
+            frame_modified(frame, addr, size);
+
+            uint32_t *dst = (uint32_t *) (frame->data + (addr & FRAME_MASK));
+            convert_uint32_t_endian_block(dst, src, chunk);
+
+            machine_unlock();
+        }
+
+        addr += size;
+        src += chunk;
+        count -= chunk;
     }
+}
 
-    /* Invalidate binary translation */
-    frame->valid = false;
+/** Number of bytes of a block transfer which fit into the frame
+ *
+ */
+static len36_t block_chunk8(ptr36_t addr, len36_t count)
+{
+    len36_t room = FRAME_SIZE - (addr & FRAME_MASK);
+    return (count < room) ? count : room;
+}
 
-    uint64_t *data = (uint64_t *) (frame->data + (addr & FRAME_MASK));
-    *data = convert_uint64_t_endian(val);
+/** Physical memory block read (bytes)
+ *
+ * Read a block of bytes as a sequence of physmem_read8() calls would,
+ * but copy the memory contents frame by frame. Bytes of addresses
+ * outside of memory are read one by one.
+ *
+ * @param procno    Id of processor (or device) which wants to read.
+ * @param addr      Address of the first byte.
+ * @param dst       Buffer receiving the bytes.
+ * @param count     Number of bytes to read.
+ * @param protected If true the memory breakpoints check is performed.
+ *
+ */
+void physmem_read_block8(unsigned int procno, ptr36_t addr, uint8_t *dst,
+        len36_t count, bool protected)
+{
+    while (count > 0) {
+        frame_t *frame = physmem_find_frame(addr);
 
-    return true;
+        if (frame == NULL) {
+            *dst = physmem_read8(procno, addr, protected);
+            addr++;
+            dst++;
+            count--;
+            continue;
+        }
+
+        len36_t chunk = block_chunk8(addr, count);
+
+        if ((protected) && (frame->watchpoints > 0)) {
+            physmem_breakpoint_check(addr, chunk, ACCESS_READ);
+        }
+
+        memcpy(dst, frame->data + (addr & FRAME_MASK), chunk);
+
+        addr += chunk;
+        dst += chunk;
+        count -= chunk;
+    }
+}
+
+/** Direct access to the memory of a block transfer
+ *
+ * Provide the host memory of the frame holding the first byte of a
+ * block so that a device can move the bytes itself (e.g. by host I/O
+ * calls). Before a write, reservations are broken, breakpoints are
+ * checked and binary translation is invalidated as by
+ * physmem_write_block8().
+ *
+ * @param addr  Address of the first byte.
+ * @param count Number of bytes of the block.
+ * @param write True if the bytes are going to be written.
+ * @param ptr   Host address of the first byte (returned).
+ *
+ * @return Number of bytes accessible through the pointer (at most the
+ *         rest of the frame). Zero if the address is not in memory or
+ *         the memory is not writable.
+ *
+ */
+len36_t physmem_block_direct(ptr36_t addr, len36_t count, bool write,
+        uint8_t **ptr)
+{
+    frame_t *frame = physmem_find_frame(addr);
+
+    if ((frame == NULL) || ((write) && (!frame->area->writable))) {
+        return 0;
+    }
+
+    len36_t chunk = block_chunk8(addr, count);
+
+    machine_lock();
+
+    if (frame->watchpoints > 0) {
+        physmem_breakpoint_check(addr, chunk,
+                write ? ACCESS_WRITE : ACCESS_READ);
+    }
+
+    if (write) {
+        sc_control(frame, addr, chunk);
+        frame_modified(frame, addr, chunk);
+    }
+
+    machine_unlock();
+
+    *ptr = frame->data + (addr & FRAME_MASK);
+    return chunk;
+}
+
+/** Physical memory block write (bytes)
+ *
+ * Write a block of bytes as a sequence of physmem_write8() calls would,
+ * but break reservations, check breakpoints and invalidate binary
+ * translation only once per frame. Bytes of addresses outside of memory
+ * are written one by one.
+ *
+ * @param procno    Id of processor (or device) which wants to write.
+ * @param addr      Address of the first byte.
+ * @param src       Bytes to write.
+ * @param count     Number of bytes to write.
+ * @param protected False to allow writing to ROM memory and ignore
+ *                  the memory breakpoints check.
+ *
+ * @return False if any of the bytes could not be written.
+ *
+ */
+bool physmem_write_block8(unsigned int procno, ptr36_t addr,
+        const uint8_t *src, len36_t count, bool protected)
+{
+    bool written = true;
+
+    while (count > 0) {
+        frame_t *frame = physmem_find_frame(addr);
+
+        if (frame == NULL) {
+            written = physmem_write8(procno, addr, *src, protected) && written;
+            addr++;
+            src++;
+            count--;
+            continue;
+        }
+
+        len36_t chunk = block_chunk8(addr, count);
+
+        if ((frame->area->writable) || (!protected)) {
+            machine_lock();
+
+            sc_control(frame, addr, chunk);
+
+            if ((protected) && (frame->watchpoints > 0)) {
+                physmem_breakpoint_check(addr, chunk, ACCESS_WRITE);
+            }
+
+            frame_modified(frame, addr, chunk);
+            memcpy(frame->data + (addr & FRAME_MASK), src, chunk);
+
+            machine_unlock();
+        } else {
+            written = false;
+        }
+
+        addr += chunk;
+        src += chunk;
+        count -= chunk;
+    }
+
+    return written;
 }
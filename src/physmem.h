@@ -19,10 +19,16 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include "arch/affinity.h"
+#include "debug/cachesim.h"
+#include "endian.h"
 #include "list.h"
 #include "main.h"
 #include "utils.h"
 
+/** Width of the physical addresses (Sv39 physical addresses) */
+#define PHYS_WIDTH 56
+
 #define FRAME_WIDTH 12
 #define FRAME_SIZE (1 << FRAME_WIDTH)
 #define FRAME_MASK (FRAME_SIZE - 1)
@@ -44,9 +50,12 @@
 typedef enum {
     MEMT_NONE = 0, /**< Uninitialized */
     MEMT_MEM = 1, /**< Generic */
-    MEMT_FMAP = 2 /**< File mapped */
+    MEMT_FMAP = 2, /**< File mapped */
+    MEMT_FMAP_COW = 3 /**< File mapped copy-on-write */
 } physmem_type_t;
 
+struct frame;
+
 typedef struct {
     /* Memory area type */
     physmem_type_t type;
@@ -60,8 +69,60 @@ typedef struct {
 
     /* Memory content */
     uint8_t *data;
+
+    /* Frame descriptors (allocated while the area is wired) */
+    struct frame *frames;
+
+    /* Bytes accessed by the guest while collecting the statistics */
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+
+    /* Placement of the host pages of a generic area (and its node) */
+    host_mem_policy_t placement;
+    unsigned int node;
+
+    /* POSIX shared memory object backing a generic area (NULL if none) */
+    char *shm_name;
+
+    /* The area returns to its contents at the reset point */
+    bool reset_tracked;
+
+    /* Frames at the reset point (by frame, NULL if not written since) */
+    uint8_t **reset_copies;
+
+    /* The writes are tracked by frames (see physmem_track_writes()) */
+    bool track_writes;
+
+    /* Frames written since the last physmem_written_clear() (by frame,
+       allocated while the area is wired and the writes are tracked) */
+    bool *written;
 } physmem_area_t;
 
+/** Instruction sets which can attach decoded pages to a frame */
+typedef enum {
+    DECODE_R4K = 0,
+    DECODE_RV32 = 1,
+    DECODE_RV64 = 2,
+    DECODE_ISA_COUNT
+} decode_isa_t;
+
+/** Accesses which may bypass the physical memory access functions
+ *
+ * A frame allows direct reads if there are no memory breakpoints
+ * over it. Direct writes additionally need a writable frame without
+ * LL-SC reservations and without decoded instruction pages, which is
+ * already dirty since the last checkpoint, already saved since the
+ * reset point and already marked written (if its area tracks the
+ * writes), so that a write has no side effects besides the store
+ * itself. No direct accesses are allowed while the memory access
+ * statistics are collected.
+ *
+ */
+#define FRAME_DIRECT_READ 0x01
+#define FRAME_DIRECT_WRITE 0x02
+
+struct decoded_page;
+
 typedef struct frame {
     /* Physical memory area containing the frame */
     physmem_area_t *area;
@@ -69,15 +130,71 @@ typedef struct frame {
     /* Frame data (with displacement) */
     uint8_t *data;
 
-    /* Binary translation valid flag */
-    bool valid;
+    /* Decoded instruction pages (NULL if not decoded) */
+    struct decoded_page *decoded[DECODE_ISA_COUNT];
+
+    /* Write generation (changes whenever the frame is written to) */
+    uint64_t generation;
+
+    /* Written to since the last checkpoint */
+    bool dirty;
+
+    /* Contents at the reset point saved (or not needed) */
+    bool reset_saved;
+
+    /* Number of processors holding an LL-SC reservation in the frame */
+    unsigned int sc_count;
+
+    /* Number of memory breakpoints overlapping the frame */
+    unsigned int watchpoints;
+
+    /* Accesses allowed directly through the data pointer (FRAME_DIRECT_*) */
+    unsigned int direct;
 } frame_t;
 
 /** Physical memory management */
 extern void physmem_wire(physmem_area_t *area);
 extern void physmem_unwire(physmem_area_t *area);
 
-extern frame_t *physmem_find_frame(ptr36_t addr);
+extern frame_t *physmem_find_frame_sparse(ptr36_t addr);
+extern void physmem_frame_update(frame_t *frame);
+extern void physmem_watch(ptr36_t addr, len36_t size, bool watch);
+extern void physmem_area_modified(physmem_area_t *area);
+extern void physmem_range_modified(ptr36_t addr, len36_t size);
+extern void physmem_area_clean(physmem_area_t *area);
+extern void physmem_area_update(physmem_area_t *area);
+extern void physmem_reset_mark(physmem_area_t *area);
+extern void physmem_reset_restore(physmem_area_t *area);
+extern void physmem_reset_drop(physmem_area_t *area);
+extern void physmem_track_writes(physmem_area_t *area, bool track);
+extern void physmem_written_clear(physmem_area_t *area, pfn_t first, pfn_t count);
+
+/** Changes whenever frames are wired or unwired */
+extern unsigned int physmem_layout;
+
+/** Flat frame table of the frames at low addresses */
+extern frame_t **physmem_flat_table;
+extern pfn_t physmem_flat_count;
+
+/** Find the frame holding a physical address
+ *
+ * The frames at low addresses (where the memory of the usual
+ * configurations lies) are found inline by a range check and
+ * a single load, without a call.
+ *
+ * @return The frame or NULL outside of memory.
+ *
+ */
+static inline frame_t *physmem_find_frame(ptr36_t addr)
+{
+    pfn_t pfn = ADDR2FRAME(addr);
+
+    if (pfn < physmem_flat_count) {
+        return physmem_flat_table[pfn];
+    }
+
+    return physmem_find_frame_sparse(addr);
+}
 
 /** Physical memory access */
 extern uint8_t physmem_read8(unsigned int cpu, ptr36_t addr, bool protected);
@@ -94,8 +211,177 @@ extern bool physmem_write32(unsigned int cpu, ptr36_t addr, uint32_t val,
 extern bool physmem_write64(unsigned int cpu, ptr36_t addr, uint64_t val,
         bool protected);
 
+/** Access to an already looked up memory frame */
+extern uint8_t physmem_frame_read8(frame_t *frame, ptr36_t addr, bool protected);
+extern uint16_t physmem_frame_read16(frame_t *frame, ptr36_t addr, bool protected);
+extern uint32_t physmem_frame_read32(frame_t *frame, ptr36_t addr, bool protected);
+extern uint64_t physmem_frame_read64(frame_t *frame, ptr36_t addr, bool protected);
+
+extern bool physmem_frame_write8(frame_t *frame, ptr36_t addr, uint8_t val,
+        bool protected);
+extern bool physmem_frame_write16(frame_t *frame, ptr36_t addr, uint16_t val,
+        bool protected);
+extern bool physmem_frame_write32(frame_t *frame, ptr36_t addr, uint32_t val,
+        bool protected);
+extern bool physmem_frame_write64(frame_t *frame, ptr36_t addr, uint64_t val,
+        bool protected);
+extern void physmem_frame_restore8(frame_t *frame, ptr36_t addr, uint8_t val);
+
+/** Block transfers (e.g. DMA) */
+extern void physmem_read_block32(unsigned int procno, ptr36_t addr,
+        uint32_t *dst, size_t count, bool protected);
+extern void physmem_write_block32(unsigned int procno, ptr36_t addr,
+        const uint32_t *src, size_t count, bool protected);
+extern void physmem_read_block8(unsigned int procno, ptr36_t addr,
+        uint8_t *dst, len36_t count, bool protected);
+extern bool physmem_write_block8(unsigned int procno, ptr36_t addr,
+        const uint8_t *src, len36_t count, bool protected);
+extern len36_t physmem_block_direct(ptr36_t addr, len36_t count,
+        bool write, uint8_t **ptr);
+
+/** Access through a frame pointer cached by a processor
+ *
+ * The frame pointer is NULL for addresses outside of memory. Plain
+ * loads and stores are used while the frame allows them, the direct
+ * permissions are checked on every access as they change when
+ * breakpoints, reservations or decoded pages come and go. The accesses
+ * are the data accesses of the processor seen by the cache model.
+ *
+ */
+static inline uint8_t physmem_cached_read8(unsigned int procno, frame_t *frame,
+        ptr36_t addr)
+{
+    cachesim_data(procno, addr);
+
+    if (frame == NULL) {
+        return physmem_read8(procno, addr, true);
+    }
+
+    if ((frame->direct & FRAME_DIRECT_READ) == 0) {
+        return physmem_frame_read8(frame, addr, true);
+    }
+
+    return convert_uint8_t_endian(*(frame->data + (addr & FRAME_MASK)));
+}
+
+static inline uint16_t physmem_cached_read16(unsigned int procno, frame_t *frame,
+        ptr36_t addr)
+{
+    cachesim_data(procno, addr);
+
+    if (frame == NULL) {
+        return physmem_read16(procno, addr, true);
+    }
+
+    if ((frame->direct & FRAME_DIRECT_READ) == 0) {
+        return physmem_frame_read16(frame, addr, true);
+    }
+
+    return convert_uint16_t_endian(*((uint16_t *) (frame->data + (addr & FRAME_MASK))));
+}
+
+static inline uint32_t physmem_cached_read32(unsigned int procno, frame_t *frame,
+        ptr36_t addr)
+{
+    cachesim_data(procno, addr);
+
+    if (frame == NULL) {
+        return physmem_read32(procno, addr, true);
+    }
+
+    if ((frame->direct & FRAME_DIRECT_READ) == 0) {
+        return physmem_frame_read32(frame, addr, true);
+    }
+
+    return convert_uint32_t_endian(*((uint32_t *) (frame->data + (addr & FRAME_MASK))));
+}
+
+static inline uint64_t physmem_cached_read64(unsigned int procno, frame_t *frame,
+        ptr36_t addr)
+{
+    cachesim_data(procno, addr);
+
+    if (frame == NULL) {
+        return physmem_read64(procno, addr, true);
+    }
+
+    if ((frame->direct & FRAME_DIRECT_READ) == 0) {
+        return physmem_frame_read64(frame, addr, true);
+    }
+
+    return convert_uint64_t_endian(*((uint64_t *) (frame->data + (addr & FRAME_MASK))));
+}
+
+static inline bool physmem_cached_write8(unsigned int procno, frame_t *frame,
+        ptr36_t addr, uint8_t val)
+{
+    cachesim_data(procno, addr);
+
+    if (frame == NULL) {
+        return physmem_write8(procno, addr, val, true);
+    }
+
+    if ((frame->direct & FRAME_DIRECT_WRITE) == 0) {
+        return physmem_frame_write8(frame, addr, val, true);
+    }
+
+    *(frame->data + (addr & FRAME_MASK)) = convert_uint8_t_endian(val);
+    return true;
+}
+
+static inline bool physmem_cached_write16(unsigned int procno, frame_t *frame,
+        ptr36_t addr, uint16_t val)
+{
+    cachesim_data(procno, addr);
+
+    if (frame == NULL) {
+        return physmem_write16(procno, addr, val, true);
+    }
+
+    if ((frame->direct & FRAME_DIRECT_WRITE) == 0) {
+        return physmem_frame_write16(frame, addr, val, true);
+    }
+
+    *((uint16_t *) (frame->data + (addr & FRAME_MASK))) = convert_uint16_t_endian(val);
+    return true;
+}
+
+static inline bool physmem_cached_write32(unsigned int procno, frame_t *frame,
+        ptr36_t addr, uint32_t val)
+{
+    cachesim_data(procno, addr);
+
+    if (frame == NULL) {
+        return physmem_write32(procno, addr, val, true);
+    }
+
+    if ((frame->direct & FRAME_DIRECT_WRITE) == 0) {
+        return physmem_frame_write32(frame, addr, val, true);
+    }
+
+    *((uint32_t *) (frame->data + (addr & FRAME_MASK))) = convert_uint32_t_endian(val);
+    return true;
+}
+
+static inline bool physmem_cached_write64(unsigned int procno, frame_t *frame,
+        ptr36_t addr, uint64_t val)
+{
+    cachesim_data(procno, addr);
+
+    if (frame == NULL) {
+        return physmem_write64(procno, addr, val, true);
+    }
+
+    if ((frame->direct & FRAME_DIRECT_WRITE) == 0) {
+        return physmem_frame_write64(frame, addr, val, true);
+    }
+
+    *((uint64_t *) (frame->data + (addr & FRAME_MASK))) = convert_uint64_t_endian(val);
+    return true;
+}
+
 /** Store-conditional control */
-extern void sc_register(unsigned int procno);
+extern void sc_register(unsigned int procno, ptr36_t addr);
 extern void sc_unregister(unsigned int procno);
 
 #endif /* PHYSMEM_H_ */
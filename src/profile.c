@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Sampled profile of the host time
+ *
+ *  Every profile_period-th machine cycle is sampled: the host time of
+ *  the cycle (including the main loop up to the next cycle) is measured
+ *  and accounted to the parts of the simulator entered during the cycle. The other cycles only compare the cycle counter
+ *  with the cycle of the next sample, so the profiling costs nearly
+ *  nothing while it is disabled. The time spent in all cycles is
+ *  estimated by scaling the samples by the period.
+ *
+ *  The distance of the samples varies randomly around the period, so
+ *  that loops whose length divides the period are not always sampled
+ *  in the same instruction. The cost of reading the host clock is
+ *  measured when the profiling starts and subtracted from the samples.
+ *
+ *  Only the serial simulation is sampled, the cycles run by the
+ *  processors in parallel and the skipped standby cycles are not.
+ *
+ */
+
+#include "profile.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "assert.h"
+#include "main.h"
+
+/** Deepest nesting of the profiled regions */
+#define PROFILE_DEPTH 8
+
+unsigned int profile_period = 0;
+uint64_t profile_next = UINT64_MAX;
+bool profile_sampling = false;
+
+/** Names of the regions in the profile */
+static const char *const region_names[PROFILE_REGIONS] = {
+    [PROFILE_EXECUTE] = "execute",
+    [PROFILE_TRANSLATE] = "translation",
+    [PROFILE_DECODE] = "decode",
+    [PROFILE_DEVICES] = "devices",
+    [PROFILE_MMIO] = "mmio",
+    [PROFILE_BREAKPOINTS] = "breakpoints",
+    [PROFILE_TRACE] = "trace",
+    [PROFILE_OTHER] = "other"
+};
+
+/** Host time accounted to the regions (in nanoseconds) */
+static uint64_t region_time[PROFILE_REGIONS];
+
+/** Number of times the regions were entered in the samples */
+static uint64_t region_entries[PROFILE_REGIONS];
+
+/** Number of the samples taken */
+static uint64_t samples = 0;
+
+/** Machine cycle of the next sample while a sample is running */
+static uint64_t sample_cycle;
+
+/** Stack of the entered regions, the current one is on top */
+static profile_region_t stack[PROFILE_DEPTH];
+static unsigned int depth = 0;
+
+/** Host time the current region has been accounted up to
+ *
+ * Zero until the first region of the sample is entered, the time
+ * before is mostly spent by getting to the sampled code.
+ *
+ */
+static uint64_t last_time;
+
+/** Host time spent by reading the host clock (in nanoseconds) */
+static uint64_t clock_cost = 0;
+
+/** State of the generator of the sample distances */
+static uint64_t jitter_state = 1;
+
+/** Host time in nanoseconds */
+static uint64_t profile_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/** Measure the host time spent by reading the host clock
+ *
+ * The shortest of several back-to-back readings is taken.
+ *
+ */
+static void profile_calibrate(void)
+{
+    clock_cost = UINT64_MAX;
+
+    for (unsigned int i = 0; i < 64; i++) {
+        uint64_t start = profile_time();
+        uint64_t cost = profile_time() - start;
+
+        if (cost < clock_cost) {
+            clock_cost = cost;
+        }
+    }
+}
+
+/** Distance of the next sample (in machine cycles)
+ *
+ * Uniformly distributed between one half and three halves
+ * of the period, so that the mean distance is the period.
+ *
+ */
+static uint64_t profile_distance(void)
+{
+    /* Xorshift generator */
+    jitter_state ^= jitter_state << 13;
+    jitter_state ^= jitter_state >> 7;
+    jitter_state ^= jitter_state << 17;
+
+    uint64_t half = profile_period / 2;
+    return profile_period - half + (jitter_state % (2 * half + 1));
+}
+
+/** Account the time since the last change to the current region */
+static void profile_account(void)
+{
+    uint64_t now = profile_time();
+
+    if (last_time != 0) {
+        uint64_t elapsed = now - last_time;
+        region_time[stack[depth - 1]] += (elapsed > clock_cost) ? elapsed - clock_cost : 0;
+    }
+
+    last_time = now;
+}
+
+/** Forget the profile collected so far */
+static void profile_reset(void)
+{
+    memset(region_time, 0, sizeof(region_time));
+    memset(region_entries, 0, sizeof(region_entries));
+    samples = 0;
+}
+
+/** Change the profile variable
+ *
+ * The profile collected so far is forgotten.
+ *
+ * @param period Number of machine cycles between the samples
+ *               (0 disables the profiling).
+ *
+ * @return True (any period is valid).
+ *
+ */
+bool profile_set_period(unsigned int period)
+{
+    profile_sample_end();
+    profile_reset();
+    profile_period = period;
+    profile_next = UINT64_MAX;
+
+    if (period > 0) {
+        profile_calibrate();
+        profile_next = steps + profile_distance();
+    }
+
+    return true;
+}
+
+/** Start the sample of the current machine cycle
+ *
+ * Called by the main loop when the cycle counter reaches
+ * profile_next. While the sample runs, profile_next is the
+ * next cycle, so that the sample ends there.
+ *
+ */
+void profile_sample_begin(void)
+{
+    profile_sample_end();
+
+    if ((profile_period == 0) || (steps < profile_next)) {
+        return;
+    }
+
+    sample_cycle = steps + profile_distance();
+    profile_next = steps + 1;
+    profile_sampling = true;
+    samples++;
+    region_entries[PROFILE_OTHER]++;
+
+    depth = 1;
+    stack[0] = PROFILE_OTHER;
+    last_time = 0;
+}
+
+/** End the running sample (if any)
+ *
+ * Called by the main loop before the next machine cycle
+ * and whenever the simulation stops.
+ *
+ */
+void profile_sample_end(void)
+{
+    if (!profile_sampling) {
+        return;
+    }
+
+    ASSERT(depth == 1);
+
+    profile_account();
+    profile_sampling = false;
+    profile_next = sample_cycle;
+    depth = 0;
+}
+
+/** Enter a region of the running sample
+ *
+ * @see profile_region_enter
+ *
+ */
+void profile_enter(profile_region_t region)
+{
+    ASSERT(region < PROFILE_REGIONS);
+    ASSERT((depth > 0) && (depth < PROFILE_DEPTH));
+
+    profile_account();
+    region_entries[region]++;
+    stack[depth++] = region;
+}
+
+/** Leave the region of the running sample entered last
+ *
+ * @see profile_region_leave
+ *
+ */
+void profile_leave(void)
+{
+    ASSERT(depth > 1);
+
+    profile_account();
+    depth--;
+}
+
+/** Print the profile collected so far */
+void profile_print(void)
+{
+    if (profile_period == 0) {
+        return;
+    }
+
+    uint64_t total = 0;
+    for (unsigned int i = 0; i < PROFILE_REGIONS; i++) {
+        total += region_time[i];
+    }
+
+    printf("Host time profile (1 of %u cycles sampled, %" PRIu64 " samples):\n",
+            profile_period, samples);
+    printf("  %-12s %7s %12s %12s\n", "region", "share", "estimated s", "entries");
+
+    for (unsigned int i = 0; i < PROFILE_REGIONS; i++) {
+        double share = (total > 0) ? 100.0 * region_time[i] / total : 0;
+        double estimated = region_time[i] * (double) profile_period / 1e9;
+
+        printf("  %-12s %6.2f%% %12.6f %12" PRIu64 "\n", region_names[i],
+                share, estimated, region_entries[i]);
+    }
+}
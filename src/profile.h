@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Sampled profile of the host time
+ *
+ */
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Parts of the simulator the host time is accounted to */
+typedef enum {
+    PROFILE_EXECUTE, /**< Processor steps (without the parts below) */
+    PROFILE_TRANSLATE, /**< Address translations missing the last translation */
+    PROFILE_DECODE, /**< Decoding of pages missing the decoded instruction cache */
+    PROFILE_DEVICES, /**< Steps and events of the other devices */
+    PROFILE_MMIO, /**< Accesses to the device registers */
+    PROFILE_BREAKPOINTS, /**< Checks of the code and memory breakpoints */
+    PROFILE_TRACE, /**< Trace output */
+    PROFILE_OTHER, /**< Main loop of the simulator */
+    PROFILE_REGIONS
+} profile_region_t;
+
+/** Number of machine cycles between the samples (0 = no profiling) */
+extern unsigned int profile_period;
+
+/** Machine cycle of the next sample (UINT64_MAX if not profiling) */
+extern uint64_t profile_next;
+
+/** True while the current machine cycle is sampled */
+extern bool profile_sampling;
+
+extern bool profile_set_period(unsigned int period);
+extern void profile_sample_begin(void);
+extern void profile_sample_end(void);
+extern void profile_enter(profile_region_t region);
+extern void profile_leave(void);
+extern void profile_print(void);
+
+/** Account the host time to a part of the simulator
+ *
+ * Does nothing unless the current machine cycle is sampled.
+ * The regions may be nested, the time of a nested region is
+ * not accounted to the enclosing one.
+ *
+ */
+static inline void profile_region_enter(profile_region_t region)
+{
+    if (profile_sampling) {
+        profile_enter(region);
+    }
+}
+
+/** Leave the part of the simulator entered last */
+static inline void profile_region_leave(void)
+{
+    if (profile_sampling) {
+        profile_leave();
+    }
+}
+
+#endif
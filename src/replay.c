@@ -0,0 +1,673 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Record and replay of the non-deterministic inputs
+ *
+ *  The inputs which depend on the host (the keys read from the
+ *  standard input, the host clock samples and the completion of the
+ *  host I/O) are taken by the devices through this module. In the
+ *  record mode each input is appended to the log together with the
+ *  machine cycle and the input source (usually the device name).
+ *  In the replay mode the inputs are taken from the log instead of
+ *  the host, so the simulation repeats the recorded run exactly.
+ *
+ *  An entry of the log starts with a tag. Tag 0 introduces a new
+ *  source (a length byte and the name follow), any other tag is an
+ *  input of the source introduced as the tag-th one. The tag, the
+ *  machine cycle (relative to the previous input) and the value of
+ *  the input (relative to the previous input of the source, as a
+ *  signed difference with the sign in the lowest bit) follow as
+ *  variable-length integers (7 bits per byte, the least significant
+ *  first), so the samples of a clock take just a few bytes.
+ *
+ *  Once a position in the inputs is marked (by a snapshot of the
+ *  reverse execution), the inputs are also kept in the memory. After
+ *  the machine is rewound, the cycles up to the furthest cycle reached
+ *  so far (the horizon) are re-executed with the kept inputs.
+ *
+ */
+
+#include "replay.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arch/stdin.h"
+#include "assert.h"
+#include "endian.h"
+#include "fault.h"
+#include "main.h"
+#include "utils.h"
+
+/** Number of the sources allocated at once */
+#define SOURCE_GRANULARITY 16
+
+replay_mode_t replay_mode = REPLAY_OFF;
+
+/** Input kept for the re-execution */
+typedef struct {
+    uint64_t cycle;
+    uint64_t value;
+} history_t;
+
+/** Input source known to the simulation */
+typedef struct {
+    char *name;
+    uint64_t tag; /**< Tag of the source in the recorded log (0 for none) */
+    uint64_t value; /**< Previous input of the source in the log */
+
+    history_t *history; /**< Inputs kept for the re-execution */
+    size_t history_len; /**< Number of the kept inputs */
+    size_t history_size; /**< Number of the allocated inputs */
+    size_t history_pos; /**< Next kept input to re-execute */
+    uint64_t history_base; /**< Number of the inputs forgotten */
+} source_t;
+
+static source_t *sources = NULL;
+static unsigned int source_count = 0;
+
+/** Log file and its name */
+static FILE *replay_file = NULL;
+static char *replay_path = NULL;
+
+/** Number of the sources introduced in the log */
+static uint64_t log_count = 0;
+
+/** Known source of each source introduced in the replayed log */
+static unsigned int *log_sources = NULL;
+
+/** Machine cycle of the previous input of the log */
+static uint64_t log_cycle = 0;
+
+/** Inputs are kept since the first mark */
+static bool history_active = false;
+
+/** First machine cycle not re-executed */
+static uint64_t history_horizon = 0;
+
+/** Next input of the log to replay */
+static struct {
+    bool valid;
+    uint64_t cycle;
+    unsigned int source;
+    uint64_t value;
+} pending;
+
+/** Get the source of the inputs of the given name
+ *
+ * @return Number of the source, the same for all calls with the name.
+ *
+ */
+unsigned int replay_source(const char *name)
+{
+    ASSERT(name != NULL);
+
+    for (unsigned int i = 0; i < source_count; i++) {
+        if (strcmp(sources[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    if ((source_count % SOURCE_GRANULARITY) == 0) {
+        sources = (source_t *) realloc(sources,
+                (source_count + SOURCE_GRANULARITY) * sizeof(source_t));
+        if (sources == NULL) {
+            die(ERR_MEM, "Not enough memory");
+        }
+    }
+
+    memset(&sources[source_count], 0, sizeof(source_t));
+    sources[source_count].name = safe_strdup(name);
+
+    return source_count++;
+}
+
+static void put_varint(uint64_t val)
+{
+    while (val >= 0x80) {
+        fputc((int) ((val & 0x7f) | 0x80), replay_file);
+        val >>= 7;
+    }
+
+    fputc((int) val, replay_file);
+}
+
+static bool get_varint(uint64_t *val)
+{
+    *val = 0;
+
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+        int c = fgetc(replay_file);
+        if (c == EOF) {
+            return false;
+        }
+
+        *val |= ((uint64_t) (c & 0x7f)) << shift;
+        if ((c & 0x80) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/** Encode the difference of the values with the sign in the lowest bit */
+static uint64_t zigzag(uint64_t value, uint64_t prev)
+{
+    uint64_t diff = value - prev;
+    return (diff << 1) ^ ((diff & (UINT64_C(1) << 63)) ? UINT64_MAX : 0);
+}
+
+static uint64_t unzigzag(uint64_t code, uint64_t prev)
+{
+    uint64_t diff = (code >> 1) ^ ((code & 1) ? UINT64_MAX : 0);
+    return prev + diff;
+}
+
+static void replay_corrupted(void)
+{
+    die(ERR_IO, "Corrupted replay log %s", replay_path);
+}
+
+/** Read the next input of the log into pending */
+static void replay_next(void)
+{
+    while (true) {
+        uint64_t tag;
+        if (!get_varint(&tag)) {
+            if (!feof(replay_file)) {
+                replay_corrupted();
+            }
+
+            pending.valid = false;
+            return;
+        }
+
+        if (tag != 0) {
+            uint64_t delta = 0;
+            uint64_t code = 0;
+            if ((tag > log_count) || (!get_varint(&delta))
+                    || (!get_varint(&code))) {
+                replay_corrupted();
+            }
+
+            source_t *source = &sources[log_sources[tag - 1]];
+
+            log_cycle += delta;
+            source->value = unzigzag(code, source->value);
+
+            pending.valid = true;
+            pending.cycle = log_cycle;
+            pending.source = log_sources[tag - 1];
+            pending.value = source->value;
+            return;
+        }
+
+        int len = fgetc(replay_file);
+        char name[256];
+
+        if ((len == EOF)
+                || (fread(name, 1, len, replay_file) != (size_t) len)) {
+            replay_corrupted();
+        }
+
+        name[len] = 0;
+
+        if ((log_count % SOURCE_GRANULARITY) == 0) {
+            log_sources = (unsigned int *) realloc(log_sources,
+                    (log_count + SOURCE_GRANULARITY) * sizeof(unsigned int));
+            if (log_sources == NULL) {
+                die(ERR_MEM, "Not enough memory");
+            }
+        }
+
+        log_sources[log_count] = replay_source(name);
+        log_count++;
+    }
+}
+
+/** Open the replay log
+ *
+ * In the record mode the log is created (or truncated) and the header
+ * is written, in the replay mode the header and the first input are
+ * read. The inputs are taken from the host again after replay_close().
+ *
+ * @return True if successful.
+ *
+ */
+bool replay_open(const char *path, replay_mode_t mode)
+{
+    ASSERT(path != NULL);
+    ASSERT(mode != REPLAY_OFF);
+
+    replay_close();
+
+    replay_file = fopen(path, (mode == REPLAY_RECORD) ? "wb" : "rb");
+    if (replay_file == NULL) {
+        io_error(path);
+        return false;
+    }
+
+    replay_path = safe_strdup(path);
+
+    uint8_t header[REPLAY_HEADER_SIZE];
+    uint32_t version;
+
+    if (mode == REPLAY_RECORD) {
+        memset(header, 0, sizeof(header));
+        memcpy(header, REPLAY_MAGIC, sizeof(REPLAY_MAGIC));
+        version = convert_uint32_t_endian(REPLAY_VERSION);
+        memcpy(header + 8, &version, sizeof(version));
+
+        if (fwrite(header, sizeof(header), 1, replay_file) != 1) {
+            io_error(path);
+            replay_close();
+            return false;
+        }
+    } else {
+        if ((fread(header, sizeof(header), 1, replay_file) != 1)
+                || (memcmp(header, REPLAY_MAGIC, sizeof(REPLAY_MAGIC)) != 0)) {
+            error("%s is not a replay log", path);
+            replay_close();
+            return false;
+        }
+
+        memcpy(&version, header + 8, sizeof(version));
+        if (convert_uint32_t_endian(version) != REPLAY_VERSION) {
+            error("Unsupported version of the replay log %s", path);
+            replay_close();
+            return false;
+        }
+    }
+
+    log_count = 0;
+    log_cycle = 0;
+
+    for (unsigned int i = 0; i < source_count; i++) {
+        sources[i].tag = 0;
+        sources[i].value = 0;
+    }
+    replay_mode = mode;
+
+    if (mode == REPLAY_PLAY) {
+        replay_next();
+    }
+
+    return true;
+}
+
+/** Close the replay log
+ *
+ * The inputs left in the log by the replay are reported.
+ *
+ */
+void replay_close(void)
+{
+    if (replay_file == NULL) {
+        return;
+    }
+
+    if ((replay_mode == REPLAY_PLAY) && (pending.valid)) {
+        alert("Inputs of the replay log left from cycle %" PRIu64,
+                pending.cycle);
+    }
+
+    if ((replay_mode == REPLAY_RECORD)
+            && ((fflush(replay_file) != 0) || (ferror(replay_file)))) {
+        io_error(replay_path);
+    }
+
+    fclose(replay_file);
+    replay_file = NULL;
+    safe_free(replay_path);
+
+    pending.valid = false;
+    replay_mode = REPLAY_OFF;
+}
+
+/** Append an input of the current machine cycle to the log */
+void replay_record(unsigned int source, uint64_t value)
+{
+    ASSERT(replay_mode == REPLAY_RECORD);
+    ASSERT(source < source_count);
+
+    source_t *src = &sources[source];
+
+    if (src->tag == 0) {
+        size_t len = strlen(src->name);
+        if (len > UINT8_MAX) {
+            len = UINT8_MAX;
+        }
+
+        fputc(0, replay_file);
+        fputc((int) len, replay_file);
+        fwrite(src->name, 1, len, replay_file);
+
+        src->tag = ++log_count;
+    }
+
+    put_varint(src->tag);
+    put_varint(steps - log_cycle);
+    put_varint(zigzag(value, src->value));
+
+    log_cycle = steps;
+    src->value = value;
+}
+
+/** Take an input of the current machine cycle from the log
+ *
+ * @return True if the log contains the next input of the source
+ *         in the current machine cycle.
+ *
+ */
+bool replay_take(unsigned int source, uint64_t *value)
+{
+    ASSERT(replay_mode == REPLAY_PLAY);
+    ASSERT(value != NULL);
+
+    if ((!pending.valid) || (pending.cycle != steps)
+            || (pending.source != source)) {
+        if ((pending.valid) && (pending.cycle < steps)) {
+            die(ERR_IO, "Simulation diverged from the replay log in cycle %"
+                    PRIu64 " (input of %s expected)",
+                    pending.cycle, sources[pending.source].name);
+        }
+
+        return false;
+    }
+
+    *value = pending.value;
+    replay_next();
+    return true;
+}
+
+/** Keep an input taken from the host or from the log */
+static void history_append(unsigned int source, uint64_t value)
+{
+    if (!history_active) {
+        return;
+    }
+
+    source_t *src = &sources[source];
+
+    if (src->history_len == src->history_size) {
+        src->history_size = (src->history_size > 0)
+                ? 2 * src->history_size : SOURCE_GRANULARITY;
+        src->history = (history_t *) realloc(src->history,
+                src->history_size * sizeof(history_t));
+        if (src->history == NULL) {
+            die(ERR_MEM, "Not enough memory");
+        }
+    }
+
+    src->history[src->history_len].cycle = steps;
+    src->history[src->history_len].value = value;
+    src->history_len++;
+    src->history_pos = src->history_len;
+}
+
+/** Take the next kept event of the source up to the current cycle
+ *
+ * An event is taken even if it was kept in an earlier cycle, since
+ * the re-execution may skip the standby cycles in other chunks than
+ * the original execution.
+ *
+ */
+static bool history_event(unsigned int source, uint64_t *value)
+{
+    source_t *src = &sources[source];
+
+    if ((src->history_pos == src->history_len)
+            || (src->history[src->history_pos].cycle > steps)) {
+        return false;
+    }
+
+    *value = src->history[src->history_pos].value;
+    src->history_pos++;
+    return true;
+}
+
+/** Take the kept value of the source in the current cycle
+ *
+ * The latest value kept up to the current cycle is taken,
+ * the values of the earlier cycles are skipped.
+ *
+ */
+static uint64_t history_value(unsigned int source, uint64_t live)
+{
+    source_t *src = &sources[source];
+
+    while ((src->history_pos + 1 < src->history_len)
+            && (src->history[src->history_pos + 1].cycle <= steps)) {
+        src->history_pos++;
+    }
+
+    if ((src->history_pos < src->history_len)
+            && (src->history[src->history_pos].cycle <= steps)) {
+        src->history_pos++;
+    }
+
+    return (src->history_pos > 0)
+            ? src->history[src->history_pos - 1].value : live;
+}
+
+/** Check whether the current cycle is re-executed
+ *
+ * @return True if the inputs are taken from the kept ones.
+ *
+ */
+bool replay_rerun(void)
+{
+    return (steps < history_horizon);
+}
+
+/** Mark the current position in the inputs
+ *
+ * The inputs are kept in the memory since the first mark.
+ * The mark is disposed by replay_mark_done().
+ *
+ */
+void replay_mark(replay_mark_t *mark)
+{
+    ASSERT(mark != NULL);
+
+    history_active = true;
+
+    mark->count = source_count;
+    mark->pos = (uint64_t *) safe_malloc((source_count + 1) * sizeof(uint64_t));
+
+    for (unsigned int i = 0; i < source_count; i++) {
+        mark->pos[i] = sources[i].history_base + sources[i].history_pos;
+    }
+}
+
+void replay_mark_done(replay_mark_t *mark)
+{
+    ASSERT(mark != NULL);
+    safe_free(mark->pos);
+}
+
+/** Re-execute the inputs from a mark
+ *
+ * @param mark    Position of the machine state restored.
+ * @param horizon First cycle the inputs are taken from the host
+ *                (or the log) again.
+ *
+ */
+void replay_rewind(const replay_mark_t *mark, uint64_t horizon)
+{
+    ASSERT(mark != NULL);
+
+    history_horizon = horizon;
+
+    for (unsigned int i = 0; i < source_count; i++) {
+        source_t *src = &sources[i];
+        uint64_t pos = (i < mark->count) ? mark->pos[i] : 0;
+
+        src->history_pos = (pos > src->history_base)
+                ? pos - src->history_base : 0;
+
+        if (src->history_pos > src->history_len) {
+            src->history_pos = src->history_len;
+        }
+    }
+}
+
+/** Forget the inputs kept before a mark */
+void replay_forget(const replay_mark_t *mark)
+{
+    ASSERT(mark != NULL);
+
+    for (unsigned int i = 0; i < source_count; i++) {
+        source_t *src = &sources[i];
+        uint64_t pos = (i < mark->count) ? mark->pos[i] : 0;
+
+        if (pos <= src->history_base) {
+            continue;
+        }
+
+        size_t drop = pos - src->history_base;
+        if (drop > src->history_len) {
+            drop = src->history_len;
+        }
+
+        memmove(src->history, src->history + drop,
+                (src->history_len - drop) * sizeof(history_t));
+        src->history_len -= drop;
+        src->history_pos = (src->history_pos > drop)
+                ? src->history_pos - drop : 0;
+        src->history_base += drop;
+    }
+}
+
+/** Forget the inputs kept after the current position
+ *
+ * Used when the re-executed machine state is changed,
+ * the following cycles take their inputs from the host again.
+ *
+ */
+void replay_cut(void)
+{
+    history_horizon = 0;
+
+    for (unsigned int i = 0; i < source_count; i++) {
+        sources[i].history_len = sources[i].history_pos;
+    }
+}
+
+/** Take an input present in every cycle it is asked for (e.g. a clock)
+ *
+ * @param source Source of the input
+ * @param live   Value of the input taken from the host
+ *
+ * @return Value of the input.
+ *
+ */
+uint64_t replay_value(unsigned int source, uint64_t live)
+{
+    if (replay_rerun()) {
+        return history_value(source, live);
+    }
+
+    switch (replay_mode) {
+    case REPLAY_RECORD:
+        replay_record(source, live);
+        break;
+    case REPLAY_PLAY:
+        if (!replay_take(source, &live)) {
+            die(ERR_IO, "Simulation diverged from the replay log in cycle %"
+                    PRIu64 " (no input of %s)", steps, sources[source].name);
+        }
+        break;
+    default:
+        break;
+    }
+
+    history_append(source, live);
+    return live;
+}
+
+/** Take an input which may or may not happen (e.g. a host I/O delay)
+ *
+ * Only the events which have happened are logged.
+ *
+ * @param source Source of the event
+ * @param live   Whether the event has happened on the host
+ *
+ * @return True if the event has happened.
+ *
+ */
+bool replay_event(unsigned int source, bool live)
+{
+    uint64_t value;
+
+    if (replay_rerun()) {
+        return history_event(source, &value);
+    }
+
+    switch (replay_mode) {
+    case REPLAY_RECORD:
+        if (live) {
+            replay_record(source, 1);
+        }
+        break;
+    case REPLAY_PLAY:
+        live = replay_take(source, &value);
+        break;
+    default:
+        break;
+    }
+
+    if (live) {
+        history_append(source, 1);
+    }
+
+    return live;
+}
+
+/** Poll the standard input (see stdin_poll())
+ *
+ * The standard input is not read at all by the replay
+ * and by the re-execution.
+ *
+ */
+bool replay_stdin_poll(unsigned int source, char *key)
+{
+    uint64_t value;
+
+    if (replay_rerun()) {
+        if (!history_event(source, &value)) {
+            return false;
+        }
+
+        *key = (char) value;
+        return true;
+    }
+
+    if (replay_mode == REPLAY_PLAY) {
+        if (!replay_take(source, &value)) {
+            return false;
+        }
+
+        *key = (char) value;
+    } else {
+        if (!stdin_poll(key)) {
+            return false;
+        }
+
+        if (replay_mode == REPLAY_RECORD) {
+            replay_record(source, (uint8_t) *key);
+        }
+    }
+
+    history_append(source, (uint8_t) *key);
+    return true;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Record and replay of the non-deterministic inputs
+ *
+ */
+
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Identification of the replay log */
+#define REPLAY_MAGIC "MSIMRPL"
+#define REPLAY_VERSION 1
+
+/** Size of the replay log header */
+#define REPLAY_HEADER_SIZE 16
+
+/** Mode of the record and replay */
+typedef enum {
+    REPLAY_OFF = 0, /**< Inputs taken from the host */
+    REPLAY_RECORD = 1, /**< Inputs taken from the host and logged */
+    REPLAY_PLAY = 2 /**< Inputs taken from the log */
+} replay_mode_t;
+
+/** Position in the inputs kept for the re-execution */
+typedef struct {
+    unsigned int count; /**< Number of the sources */
+    uint64_t *pos; /**< Inputs of each source taken before */
+} replay_mark_t;
+
+extern replay_mode_t replay_mode;
+
+extern bool replay_open(const char *path, replay_mode_t mode);
+extern void replay_close(void);
+
+extern unsigned int replay_source(const char *name);
+extern void replay_record(unsigned int source, uint64_t value);
+extern bool replay_take(unsigned int source, uint64_t *value);
+
+extern uint64_t replay_value(unsigned int source, uint64_t live);
+extern bool replay_event(unsigned int source, bool live);
+extern bool replay_stdin_poll(unsigned int source, char *key);
+
+extern bool replay_rerun(void);
+extern void replay_mark(replay_mark_t *mark);
+extern void replay_mark_done(replay_mark_t *mark);
+extern void replay_rewind(const replay_mark_t *mark, uint64_t horizon);
+extern void replay_forget(const replay_mark_t *mark);
+extern void replay_cut(void);
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Region of interest of the guest
+ *
+ *  The guest marks the part of a workload to be measured by the
+ *  special instructions (DROIB and DROIE on R4000, EROIB and EROIE
+ *  on RISC-V). The region is simulated accurately even if the rest
+ *  of the simulation is fast (see the fast variable), the program
+ *  counter profile is restarted at its beginning and stopped at
+ *  its end, and the statistics of the region are printed at its end.
+ *
+ */
+
+#include "roi.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "debug/pcprofile.h"
+#include "device/cpu/general_cpu.h"
+#include "fault.h"
+#include "main.h"
+
+/** True between the beginning and the end of the region */
+static bool roi_active = false;
+
+/** Value of the fast variable before the region */
+static bool roi_fast;
+
+/** Counters at the beginning of the region */
+static uint64_t roi_steps;
+static uint64_t roi_instructions;
+static double roi_time;
+
+/** Host time in seconds */
+static double roi_host_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Begin the region of interest
+ *
+ * The simulation becomes accurate and the counters are taken
+ * as the start of the region. Beginning the region again
+ * restarts it.
+ *
+ */
+void roi_begin(void)
+{
+    if (!roi_active) {
+        roi_fast = machine_fast;
+        roi_active = true;
+    }
+
+    machine_fast = false;
+
+    roi_steps = steps;
+    roi_instructions = cpu_instructions_all();
+    roi_time = roi_host_time();
+
+    /* Only the region is profiled */
+    pcprofile_reset();
+    pcprofile_rebase();
+}
+
+/** End the region of interest
+ *
+ * The statistics of the region are printed in the form of the
+ * --stats option and the fast variable gets its value from
+ * before the region.
+ *
+ */
+void roi_end(void)
+{
+    if (!roi_active) {
+        alert("Not in a region of interest");
+        return;
+    }
+
+    uint64_t cycles = steps - roi_steps;
+    uint64_t instructions = cpu_instructions_all() - roi_instructions;
+    double time = roi_host_time() - roi_time;
+    double seconds = (time > 0) ? time : 1e-9;
+
+    printf("Region of interest: cycles=%" PRIu64 " instructions=%" PRIu64
+            " seconds=%.6f mips=%.3f cycles_per_second=%.0f"
+            " ns_per_instruction=%.3f\n",
+            cycles, instructions, time,
+            instructions / seconds / 1e6, cycles / seconds,
+            (instructions > 0) ? time * 1e9 / instructions : 0);
+
+    pcprofile_stop();
+    machine_fast = roi_fast;
+    roi_active = false;
+}
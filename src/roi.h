@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  Region of interest of the guest
+ *
+ */
+
+#ifndef ROI_H_
+#define ROI_H_
+
+extern void roi_begin(void);
+extern void roi_end(void);
+
+#endif
@@ -79,10 +79,37 @@ const char txt_version[] = "MSIM version " PACKAGE_VERSION "\nCopyright (c) 2000
 
 const char txt_help[] = "  -V, --version               display version info\n"
                         "  -c, --config=file_name      configuration file name\n"
+                        "      --compile-config=file_name\n"
+                        "                              compile the configuration into a machine description\n"
                         "  -i, --interactive           enter interactive mode\n"
                         "  -t, --trace                 enter trace mode\n"
+                        "      --trace-file=file_name  write the trace to a binary file\n"
+                        "      --trace-decode=file_name\n"
+                        "                              disassemble a binary trace file\n"
+                        "      --memtrace=file_name    write the memory accesses to a binary file\n"
+                        "      --memtrace-decode=file_name\n"
+                        "                              print a binary memory access trace\n"
+                        "      --stats                 print simulation statistics at the end\n"
+                        "      --stats-socket=port|path\n"
+                        "                              serve live statistics on a TCP port or a UNIX socket\n"
+                        "      --report=file_name      write a JSON report of the run at the end\n"
+                        "      --cosim                 check the blocks against the interpreter\n"
+                        "      --max-cycles=count      halt after the given number of machine cycles\n"
+                        "      --max-instret=count     halt after the given number of instructions\n"
+                        "      --batch=file_name       run the test cases of a batch file\n"
+                        "      --serve=path            serve jobs forked from the machine on a UNIX socket\n"
+                        "  -j, --jobs=count            number of batch test cases, machines or jobs run at once\n"
+                        "      --user                  run a user program given by the arguments\n"
+                        "      --decode-cache=dir      keep the decoded pages in the directory between runs\n"
+                        "      --symbols=file_name     load guest symbols from an ELF file\n"
+                        "      --pcprofile=file_name   write the sampled PC profile at the end\n"
+                        "      --coverage=file_name    write the guest code coverage at the end\n"
                         "  -g, --remote-gdb=port       enter gdb mode\n"
                         "  -n, --non-deterministic     enable non-deterministic behaviour\n"
-                        "  -X, --no-extra-instructions disable MSIM-specific instructions\n";
+                        "      --record=file_name      log the non-deterministic inputs (implies -n)\n"
+                        "      --replay=file_name      take the non-deterministic inputs from a log\n"
+                        "  -X, --no-extra-instructions disable MSIM-specific instructions\n"
+                        "  file_name...                run the machines of the configuration files\n"
+                        "  program [argument...]       run the user program (--user)\n";
 
 const char hexchar[] = "0123456789abcdef";
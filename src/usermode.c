@@ -0,0 +1,663 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  User-mode emulation of the system calls
+ *
+ *  A static executable runs without a kernel: the machine gets a
+ *  single processor of the architecture of the executable and a memory
+ *  at address 0 holding the program, its heap and its stack, and the
+ *  system calls (ECALL on RISC-V, SYSCALL on R4000) are served on the
+ *  host. The processor stays in its most privileged mode with the
+ *  addresses mapped one to one (RISC-V M mode, R4000 kernel mode
+ *  with Status.ERL, which leaves kuseg unmapped), so there are no
+ *  translations, interrupts or devices to simulate.
+ *
+ *  The stack is set up as by Linux (argc, argv, an empty environment
+ *  and the auxiliary vector), which is also what the newlib start-up
+ *  code expects. Only a few system calls are emulated: enough for
+ *  the programs computing and printing their results.
+ *
+ */
+
+#include "usermode.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "assert.h"
+#include "cmd.h"
+#include "device/cpu/general_cpu.h"
+#include "elf.h"
+#include "fault.h"
+#include "main.h"
+#include "physmem.h"
+#include "replay.h"
+#include "utils.h"
+
+/** Memory of the program (at address 0) */
+#define USERMODE_MEMORY UINT64_C(0x40000000)
+
+/** Stack at the end of the memory (mmap allocates below it) */
+#define USERMODE_STACK UINT64_C(0x800000)
+
+/** Page size told to the program */
+#define USERMODE_PAGE 4096
+
+/** ELF machine of RISC-V */
+#define ELF_MACHINE_RISCV 243
+
+/** ELF type of the static executables */
+#define ELF_TYPE_EXEC 2
+
+/** Entries of the auxiliary vector */
+#define AT_NULL 0
+#define AT_PHDR 3
+#define AT_PHENT 4
+#define AT_PHNUM 5
+#define AT_PAGESZ 6
+#define AT_ENTRY 9
+#define AT_RANDOM 25
+
+/** Number of the entries of the auxiliary vector (with AT_NULL) */
+#define USERMODE_AUXV 7
+
+/** Linux error numbers (common to all the ABIs) */
+#define USERMODE_EIO 5
+#define USERMODE_EBADF 9
+#define USERMODE_ENOMEM 12
+#define USERMODE_EFAULT 14
+#define USERMODE_ENODEV 19
+#define USERMODE_EINVAL 22
+
+/** Anonymous mapping flag of mmap */
+#define USERMODE_MAP_ANONYMOUS 0x20
+#define USERMODE_MAP_ANONYMOUS_MIPS 0x800
+
+/** Emulated system calls */
+typedef enum {
+    USERMODE_SYS_READ,
+    USERMODE_SYS_WRITE,
+    USERMODE_SYS_WRITEV,
+    USERMODE_SYS_CLOSE,
+    USERMODE_SYS_BRK,
+    USERMODE_SYS_MMAP,
+    USERMODE_SYS_MUNMAP,
+    USERMODE_SYS_EXIT,
+    USERMODE_SYS_CLOCK_GETTIME,
+    USERMODE_SYS_CLOCK_GETTIME64,
+    USERMODE_SYS_GETTIMEOFDAY,
+    USERMODE_SYS_UNKNOWN
+} usermode_sys_t;
+
+/** System call number of an ABI */
+typedef struct {
+    uint16_t no;
+    usermode_sys_t sys;
+} usermode_call_t;
+
+/** System calls of RISC-V (the generic Linux numbers, also used by newlib) */
+static const usermode_call_t usermode_calls_rv[] = {
+    { 57, USERMODE_SYS_CLOSE },
+    { 63, USERMODE_SYS_READ },
+    { 64, USERMODE_SYS_WRITE },
+    { 66, USERMODE_SYS_WRITEV },
+    { 93, USERMODE_SYS_EXIT },
+    { 94, USERMODE_SYS_EXIT }, /* exit_group */
+    { 113, USERMODE_SYS_CLOCK_GETTIME },
+    { 169, USERMODE_SYS_GETTIMEOFDAY },
+    { 214, USERMODE_SYS_BRK },
+    { 215, USERMODE_SYS_MUNMAP },
+    { 222, USERMODE_SYS_MMAP }, /* mmap2 on RV32 */
+    { 403, USERMODE_SYS_CLOCK_GETTIME64 },
+    { 0, USERMODE_SYS_UNKNOWN }
+};
+
+/** System calls of MIPS o32 */
+static const usermode_call_t usermode_calls_o32[] = {
+    { 4001, USERMODE_SYS_EXIT },
+    { 4003, USERMODE_SYS_READ },
+    { 4004, USERMODE_SYS_WRITE },
+    { 4006, USERMODE_SYS_CLOSE },
+    { 4045, USERMODE_SYS_BRK },
+    { 4078, USERMODE_SYS_GETTIMEOFDAY },
+    { 4090, USERMODE_SYS_MMAP },
+    { 4091, USERMODE_SYS_MUNMAP },
+    { 4146, USERMODE_SYS_WRITEV },
+    { 4210, USERMODE_SYS_MMAP }, /* mmap2 */
+    { 4246, USERMODE_SYS_EXIT }, /* exit_group */
+    { 4263, USERMODE_SYS_CLOCK_GETTIME },
+    { 4403, USERMODE_SYS_CLOCK_GETTIME64 },
+    { 0, USERMODE_SYS_UNKNOWN }
+};
+
+/** The machine runs a user program with emulated system calls */
+bool usermode_enabled = false;
+
+/** Width of the pointers of the program */
+static size_t usermode_width = 4;
+
+/** Start of the heap (end of the executable) */
+static uint64_t usermode_brk_start;
+
+/** Current end of the heap */
+static uint64_t usermode_brk;
+
+/** Largest end of the heap so far (the memory above is still zeroed) */
+static uint64_t usermode_brk_max;
+
+/** Lowest mapping of mmap (the mappings grow down from the stack) */
+static uint64_t usermode_mmap;
+
+/** Tell whether a buffer of the program lies within its memory */
+static bool usermode_range(uint64_t addr, uint64_t len)
+{
+    return (addr <= USERMODE_MEMORY) && (len <= USERMODE_MEMORY - addr);
+}
+
+/** Write a pointer-sized word of the program */
+static void usermode_put(uint64_t addr, uint64_t val)
+{
+    if (usermode_width == 8) {
+        physmem_write64(-1 /*NULL*/, addr, val, false);
+    } else {
+        physmem_write32(-1 /*NULL*/, addr, (uint32_t) val, false);
+    }
+}
+
+/** Read a pointer-sized word of the program */
+static uint64_t usermode_get(uint64_t addr)
+{
+    if (usermode_width == 8) {
+        return physmem_read64(-1 /*NULL*/, addr, false);
+    }
+
+    return physmem_read32(-1 /*NULL*/, addr, false);
+}
+
+/** Error number of ENOSYS (the only one differing among the ABIs) */
+static int64_t usermode_enosys(usermode_abi_t abi)
+{
+    return (abi == USERMODE_ABI_O32) ? 89 : 38;
+}
+
+/** Move a buffer of the program from or to a host file
+ *
+ * The bytes are moved directly between the memory and the host
+ * file, a frame at a time.
+ *
+ * @param fd    File descriptor of the program (only the standard ones)
+ * @param addr  Address of the buffer
+ * @param len   Length of the buffer
+ * @param out   Write the buffer (read it otherwise)
+ *
+ * @return Number of the bytes moved or a negated error number.
+ *
+ */
+static int64_t usermode_io(uint64_t fd, uint64_t addr, uint64_t len, bool out)
+{
+    if ((out) ? ((fd != STDOUT_FILENO) && (fd != STDERR_FILENO))
+                : (fd != STDIN_FILENO)) {
+        return -USERMODE_EBADF;
+    }
+
+    if (!usermode_range(addr, len)) {
+        return -USERMODE_EFAULT;
+    }
+
+    /* The output of the simulator goes before that of the program */
+    if (out) {
+        fflush(stdout);
+    }
+
+    uint64_t done = 0;
+
+    while (done < len) {
+        uint8_t *ptr;
+        len36_t chunk = physmem_block_direct(addr + done, len - done, !out, &ptr);
+
+        if (chunk == 0) {
+            return (done > 0) ? (int64_t) done : -USERMODE_EFAULT;
+        }
+
+        ssize_t moved = (out) ? write(fd, ptr, chunk)
+                                : read(fd, ptr, chunk);
+
+        if (moved < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return (done > 0) ? (int64_t) done : -USERMODE_EIO;
+        }
+
+        done += moved;
+
+        if ((size_t) moved < chunk) {
+            break;
+        }
+    }
+
+    return done;
+}
+
+/** Write the buffers of an I/O vector
+ *
+ * @return Number of the bytes written or a negated error number.
+ *
+ */
+static int64_t usermode_writev(uint64_t fd, uint64_t iov, uint64_t count)
+{
+    if ((count > 1024) || (!usermode_range(iov, count * 2 * usermode_width))) {
+        return -USERMODE_EINVAL;
+    }
+
+    int64_t total = 0;
+
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t entry = iov + i * 2 * usermode_width;
+        uint64_t len = usermode_get(entry + usermode_width);
+        int64_t res = usermode_io(fd, usermode_get(entry), len, true);
+
+        if (res < 0) {
+            return (total > 0) ? total : res;
+        }
+
+        total += res;
+
+        if ((uint64_t) res < len) {
+            break;
+        }
+    }
+
+    return total;
+}
+
+/** Move the end of the heap
+ *
+ * The heap grows up to the mappings of mmap. The memory given
+ * back to the heap after it has shrunk is zeroed again.
+ *
+ * @return New end of the heap (the current one if not moved).
+ *
+ */
+static uint64_t usermode_set_brk(uint64_t brk)
+{
+    if ((brk < usermode_brk_start) || (brk > usermode_mmap)) {
+        return usermode_brk;
+    }
+
+    static const uint8_t zeros[USERMODE_PAGE];
+    uint64_t end = MIN(brk, usermode_brk_max);
+
+    for (uint64_t addr = usermode_brk; addr < end; addr += USERMODE_PAGE) {
+        physmem_write_block8(-1 /*NULL*/, addr, zeros,
+                MIN(end - addr, USERMODE_PAGE), false);
+    }
+
+    usermode_brk = brk;
+    usermode_brk_max = MAX(usermode_brk_max, brk);
+    return usermode_brk;
+}
+
+/** Map anonymous memory
+ *
+ * The mappings are taken down from the stack and never reused,
+ * so they are zeroed and munmap has nothing to do. Files cannot
+ * be mapped.
+ *
+ * @return Address of the mapping or a negated error number.
+ *
+ */
+static int64_t usermode_map(usermode_abi_t abi, uint64_t len, uint64_t flags)
+{
+    uint64_t anonymous = (abi == USERMODE_ABI_O32)
+            ? USERMODE_MAP_ANONYMOUS_MIPS : USERMODE_MAP_ANONYMOUS;
+
+    if ((flags & anonymous) == 0) {
+        return -USERMODE_ENODEV;
+    }
+
+    if ((len == 0) || (len > USERMODE_MEMORY)) {
+        return -USERMODE_EINVAL;
+    }
+
+    len = ALIGN_UP(len, USERMODE_PAGE);
+
+    if (usermode_mmap - usermode_brk < len) {
+        return -USERMODE_ENOMEM;
+    }
+
+    usermode_mmap -= len;
+    return usermode_mmap;
+}
+
+/** Time of the program in nanoseconds
+ *
+ * Derived from the machine cycle counter (one microsecond per cycle)
+ * unless the simulation is non-deterministic, which reads the host
+ * clock.
+ *
+ * @param realtime Wall clock time (monotonic otherwise)
+ *
+ */
+static uint64_t usermode_time(bool realtime)
+{
+    if (!machine_nondet) {
+        return steps * 1000;
+    }
+
+    static unsigned int replay = UINT_MAX;
+    if (replay == UINT_MAX) {
+        replay = replay_source("usermode");
+    }
+
+    struct timespec ts;
+    clock_gettime(realtime ? CLOCK_REALTIME : CLOCK_MONOTONIC, &ts);
+    return replay_value(replay, ((uint64_t) ts.tv_sec) * 1000000000 + ts.tv_nsec);
+}
+
+/** Store the time as seconds and a fraction
+ *
+ * @param addr  Address of the structure
+ * @param width Width of its fields
+ * @param unit  Nanoseconds per unit of the fraction
+ *
+ */
+static int64_t usermode_put_time(uint64_t addr, size_t width, uint64_t unit,
+        bool realtime)
+{
+    if (!usermode_range(addr, 2 * width)) {
+        return -USERMODE_EFAULT;
+    }
+
+    uint64_t ns = usermode_time(realtime);
+    uint64_t sec = ns / 1000000000;
+    uint64_t frac = (ns % 1000000000) / unit;
+
+    if (width == 8) {
+        physmem_write64(-1 /*NULL*/, addr, sec, false);
+        physmem_write64(-1 /*NULL*/, addr + 8, frac, false);
+    } else {
+        physmem_write32(-1 /*NULL*/, addr, (uint32_t) sec, false);
+        physmem_write32(-1 /*NULL*/, addr + 4, (uint32_t) frac, false);
+    }
+
+    return 0;
+}
+
+/** Find an emulated system call by its number */
+static usermode_sys_t usermode_lookup(usermode_abi_t abi, uint64_t no)
+{
+    const usermode_call_t *call = (abi == USERMODE_ABI_O32)
+            ? usermode_calls_o32 : usermode_calls_rv;
+
+    for (; call->sys != USERMODE_SYS_UNKNOWN; call++) {
+        if (call->no == no) {
+            return call->sys;
+        }
+    }
+
+    return USERMODE_SYS_UNKNOWN;
+}
+
+/** Execute a system call of the program
+ *
+ * @param abi  System call convention of the program
+ * @param no   System call number
+ * @param args Arguments of the system call
+ *
+ * @return Result of the system call, a negated error number
+ *         if it has failed or is not emulated.
+ *
+ */
+int64_t usermode_syscall(usermode_abi_t abi, uint64_t no,
+        const uint64_t args[USERMODE_ARGS])
+{
+    /* The clock ids below 2 are CLOCK_REALTIME and CLOCK_MONOTONIC */
+    bool realtime = (args[0] == 0);
+
+    switch (usermode_lookup(abi, no)) {
+    case USERMODE_SYS_READ:
+        return usermode_io(args[0], args[1], args[2], false);
+    case USERMODE_SYS_WRITE:
+        return usermode_io(args[0], args[1], args[2], true);
+    case USERMODE_SYS_WRITEV:
+        return usermode_writev(args[0], args[1], args[2]);
+    case USERMODE_SYS_CLOSE:
+        /* The standard files are kept open for the simulator */
+        return (args[0] <= STDERR_FILENO) ? 0 : -USERMODE_EBADF;
+    case USERMODE_SYS_BRK:
+        return usermode_set_brk(args[0]);
+    case USERMODE_SYS_MMAP:
+        return usermode_map(abi, args[1], args[3]);
+    case USERMODE_SYS_MUNMAP:
+        return 0;
+    case USERMODE_SYS_EXIT:
+        machine_halt = true;
+        machine_exit_status = args[0] & 0xff;
+        return 0;
+    case USERMODE_SYS_CLOCK_GETTIME:
+        return usermode_put_time(args[1], usermode_width, 1, realtime);
+    case USERMODE_SYS_CLOCK_GETTIME64:
+        return usermode_put_time(args[1], 8, 1, realtime);
+    case USERMODE_SYS_GETTIMEOFDAY:
+        return (args[0] == 0) ? 0 : usermode_put_time(args[0], usermode_width, 1000, true);
+    default:
+        alert("Unsupported system call %" PRIu64, no);
+        return -usermode_enosys(abi);
+    }
+}
+
+/** Terminate the program on an exception
+ *
+ * There is no kernel to handle the exception, so the simulation
+ * halts as if the program was killed by a signal.
+ *
+ * @param code Exception code
+ * @param pc   Address of the instruction raising the exception
+ *
+ */
+void usermode_fault(unsigned int code, uint64_t pc)
+{
+    alert("Program terminated by exception %u at %#" PRIx64, code, pc);
+    machine_halt = true;
+    machine_exit_status = ERR_EXCEPTION;
+}
+
+/** Read the header of an executable
+ *
+ * @param abi Convention of the program (returned)
+ *
+ * @return Name of the processor device running the program,
+ *         NULL if the program cannot be run (with an error printed).
+ *
+ */
+static const char *usermode_identify(const char *path, usermode_abi_t *abi)
+{
+    FILE *file = try_fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    uint8_t header[64];
+    size_t size = fread(header, 1, sizeof(header), file);
+    safe_fclose(file, path);
+
+    elf_file_t elf = {
+        .data = header,
+        .size = size
+    };
+
+    if (!elf_identify(&elf)) {
+        error("%s is not a valid ELF file", path);
+        return NULL;
+    }
+
+    if (elf_get(&elf, 16, 2) != ELF_TYPE_EXEC) {
+        error("%s is not a static executable", path);
+        return NULL;
+    }
+
+    uint64_t machine = elf_get(&elf, 18, 2);
+
+    if ((machine == ELF_MACHINE_RISCV) && (!elf.msb)) {
+        *abi = elf.is64 ? USERMODE_ABI_RV64 : USERMODE_ABI_RV32;
+        return elf.is64 ? "drv64cpu" : "drvcpu";
+    }
+
+    if ((machine == ELF_MACHINE_MIPS) && (!elf.is64) && (!elf.msb)) {
+        *abi = USERMODE_ABI_O32;
+        return "dr4kcpu";
+    }
+
+    error("%s is not a little-endian RISC-V or 32-bit MIPS executable", path);
+    return NULL;
+}
+
+/** Copy a string to the top of the stack
+ *
+ * @param top Top of the stack (moved below the string)
+ *
+ * @return Address of the string.
+ *
+ */
+static uint64_t usermode_push_string(uint64_t *top, const char *str)
+{
+    size_t len = strlen(str) + 1;
+
+    *top -= len;
+    physmem_write_block8(-1 /*NULL*/, *top, (const uint8_t *) str, len, false);
+
+    return *top;
+}
+
+/** Set up the initial stack of the program
+ *
+ * From the stack pointer up: argc, the argument pointers, NULL,
+ * NULL (no environment) and the auxiliary vector, followed by the
+ * strings at the end of the memory.
+ *
+ * @return Stack pointer of the program.
+ *
+ */
+static uint64_t usermode_stack(char *const *argv, size_t argc,
+        const elf_image_t *image)
+{
+    uint64_t top = USERMODE_MEMORY;
+
+    /* The bytes of AT_RANDOM are fixed to keep the runs deterministic */
+    static const char random[16] = "msim user mode!";
+    top -= sizeof(random);
+    physmem_write_block8(-1 /*NULL*/, top, (const uint8_t *) random,
+            sizeof(random), false);
+    uint64_t random_addr = top;
+
+    uint64_t *strings = safe_malloc(MAX(argc, 1) * sizeof(uint64_t));
+    for (size_t i = 0; i < argc; i++) {
+        strings[i] = usermode_push_string(&top, argv[i]);
+    }
+
+    size_t words = 1 + (argc + 1) + 1 + 2 * USERMODE_AUXV;
+    uint64_t sp = ALIGN_DOWN(top - words * usermode_width, 16);
+    uint64_t addr = sp;
+
+    usermode_put(addr, argc);
+    addr += usermode_width;
+
+    for (size_t i = 0; i <= argc; i++) {
+        usermode_put(addr, (i < argc) ? strings[i] : 0);
+        addr += usermode_width;
+    }
+
+    usermode_put(addr, 0);
+    addr += usermode_width;
+
+    const uint64_t auxv[USERMODE_AUXV][2] = {
+        { AT_PHDR, image->phdr },
+        { AT_PHENT, image->phent },
+        { AT_PHNUM, image->phnum },
+        { AT_PAGESZ, USERMODE_PAGE },
+        { AT_ENTRY, image->entry },
+        { AT_RANDOM, random_addr },
+        { AT_NULL, 0 }
+    };
+
+    for (size_t i = 0; i < USERMODE_AUXV; i++) {
+        usermode_put(addr, auxv[i][0]);
+        usermode_put(addr + usermode_width, auxv[i][1]);
+        addr += 2 * usermode_width;
+    }
+
+    safe_free(strings);
+    return sp;
+}
+
+/** Set up the machine running a user program
+ *
+ * Add a processor of the architecture of the executable and the
+ * memory, load the executable and set up its stack.
+ *
+ * @param argv Path of the executable and its arguments
+ * @param argc Number of the arguments (with the path)
+ *
+ * @return True if successful.
+ *
+ */
+bool usermode_load(char *const *argv, size_t argc)
+{
+    ASSERT(argv != NULL);
+    ASSERT(argc > 0);
+
+    usermode_abi_t abi;
+    const char *cpu_type = usermode_identify(argv[0], &abi);
+    if (cpu_type == NULL) {
+        return false;
+    }
+
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "add %s cpu0", cpu_type);
+
+    if ((!interpret(cmd)) || (!interpret("add rwm mem 0"))) {
+        return false;
+    }
+
+    snprintf(cmd, sizeof(cmd), "mem generic %#" PRIx64, USERMODE_MEMORY);
+    if (!interpret(cmd)) {
+        return false;
+    }
+
+    elf_image_t image;
+    if (!elf_load(argv[0], &image)) {
+        return false;
+    }
+
+    if (image.end > USERMODE_MEMORY - USERMODE_STACK) {
+        error("%s does not leave room for the stack", argv[0]);
+        return false;
+    }
+
+    usermode_width = (abi == USERMODE_ABI_RV64) ? 8 : 4;
+    usermode_brk_start = ALIGN_UP(image.end, USERMODE_PAGE);
+    usermode_brk = usermode_brk_start;
+    usermode_brk_max = usermode_brk_start;
+    usermode_mmap = USERMODE_MEMORY - USERMODE_STACK;
+
+    uint64_t sp = usermode_stack(argv, argc, &image);
+
+    /* The stack pointer is x2 on RISC-V and $29 on MIPS */
+    unsigned int sp_reg = (abi == USERMODE_ABI_O32) ? 29 : 2;
+    cpu_reg_write(get_cpu_by_index(0), sp_reg, sp);
+
+    return true;
+}
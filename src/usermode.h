@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2025 Martin Rosenberg
+ * All rights reserved.
+ *
+ * Distributed under the terms of GPL.
+ *
+ *
+ *  User-mode emulation of the system calls
+ *
+ */
+
+#ifndef USERMODE_H_
+#define USERMODE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** System call conventions of the user programs */
+typedef enum {
+    USERMODE_ABI_RV32, /**< Linux (and newlib) on RV32 */
+    USERMODE_ABI_RV64, /**< Linux (and newlib) on RV64 */
+    USERMODE_ABI_O32 /**< Linux on 32-bit MIPS */
+} usermode_abi_t;
+
+/** Number of system call arguments */
+#define USERMODE_ARGS 6
+
+/** Largest error number returned (negated) by a system call */
+#define USERMODE_MAX_ERRNO 4095
+
+/** The machine runs a user program with emulated system calls */
+extern bool usermode_enabled;
+
+extern bool usermode_load(char *const *argv, size_t argc);
+extern int64_t usermode_syscall(usermode_abi_t abi, uint64_t no,
+        const uint64_t args[USERMODE_ARGS]);
+extern void usermode_fault(unsigned int code, uint64_t pc);
+
+#endif
@@ -10,6 +10,8 @@
  */
 
 #include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -23,10 +25,15 @@
 #include "assert.h"
 #include "fault.h"
 #include "main.h"
+#include "mdesc.h"
 #include "physmem.h"
 #include "text.h"
 #include "utils.h"
 
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
 #define STRING_GRANULARITY 128
 #define STRING_BUFFER 4096
 
@@ -190,6 +197,55 @@ void *safe_malloc(const size_t size)
     return ptr;
 }
 
+/** Safe allocation of zeroed memory
+ *
+ * Large blocks are left to the host to zero on the first touch,
+ * so the untouched parts take no memory.
+ *
+ */
+void *safe_calloc(const size_t size)
+{
+    ASSERT(size > 0);
+
+    void *ptr = calloc(1, size);
+    if (ptr == NULL) {
+        die(ERR_MEM, "Not enough memory");
+    }
+
+    return ptr;
+}
+
+/** Safe allocation of aligned memory
+ *
+ * The memory has to be freed by free_aligned(). The address
+ * of the underlying allocation is stored just below the
+ * returned block.
+ *
+ * @param alignment Alignment of the block (a power of two).
+ *
+ */
+void *safe_malloc_aligned(const size_t size, const size_t alignment)
+{
+    ASSERT(IS_POWER_OF_2(alignment));
+
+    size_t align = MAX(alignment, sizeof(void *));
+    uint8_t *base = safe_malloc(size + align + sizeof(void *));
+    uintptr_t addr = ALIGN_UP((uintptr_t) (base + sizeof(void *)), align);
+
+    ((void **) addr)[-1] = base;
+    return (void *) addr;
+}
+
+/** Free memory allocated by safe_malloc_aligned()
+ *
+ */
+void free_aligned(void *ptr)
+{
+    if (ptr != NULL) {
+        free(((void **) ptr)[-1]);
+    }
+}
+
 /** Make a copy of a string
  *
  */
@@ -248,6 +304,10 @@ FILE *try_fopen(const char *path, const char *mode)
         if (check_isdir(file)) {
             safe_fclose(file, path);
             file = NULL;
+        } else if ((mdesc_recording) && (mode[0] == 'r')
+                && (strchr(mode, '+') == NULL)) {
+            /* The files read by the configuration */
+            mdesc_input(path);
         }
     } else {
         io_error(path);
@@ -353,6 +413,171 @@ bool try_ftell(FILE *file, const char *path, size_t *pos)
     return true;
 }
 
+/** Size of the blocks of zeros left as holes by fwrite_sparse() */
+#define SPARSE_BLOCK_SIZE 4096
+
+/** Write data into a file leaving the blocks of zeros as holes
+ *
+ * The blocks of zeros are skipped by seeking over them, so the file
+ * systems supporting sparse files allocate no space for them. The
+ * file reads back the same as if all the data were written, so
+ * saving a mostly untouched memory (or disk) takes only the space
+ * and the time of the data written to.
+ *
+ * @param file File positioned where the data belong.
+ * @param data Data to write.
+ * @param size Number of bytes to write.
+ *
+ * @return true if successful (errno is set otherwise)
+ *
+ */
+bool fwrite_sparse(FILE *file, const void *data, size_t size)
+{
+    ASSERT(file != NULL);
+
+    static const uint8_t zeros[SPARSE_BLOCK_SIZE];
+    const uint8_t *ptr = (const uint8_t *) data;
+    size_t hole = 0;
+
+    while (size > 0) {
+        size_t len = (size < SPARSE_BLOCK_SIZE) ? size : SPARSE_BLOCK_SIZE;
+
+        if (memcmp(ptr, zeros, len) == 0) {
+            hole += len;
+        } else {
+            if ((hole > 0) && (fseek(file, (long) hole, SEEK_CUR) != 0)) {
+                return false;
+            }
+
+            if (fwrite(ptr, 1, len, file) != len) {
+                return false;
+            }
+
+            hole = 0;
+        }
+
+        ptr += len;
+        size -= len;
+    }
+
+    /* The last byte of a trailing hole sets the size of the file */
+    if (hole > 0) {
+        return (fseek(file, (long) hole - 1, SEEK_CUR) == 0)
+                && (fwrite(zeros, 1, 1, file) == 1);
+    }
+
+    return true;
+}
+
+/** Check whether an opened file is compressed by gzip
+ *
+ * The file is left at its beginning.
+ *
+ * @param file File opened for reading.
+ *
+ * @return true if the file starts with the gzip magic number
+ *
+ */
+bool fgzipped(FILE *file)
+{
+    ASSERT(file != NULL);
+
+    uint8_t magic[2];
+    bool gzip = (fread(magic, 1, sizeof(magic), file) == sizeof(magic))
+            && (magic[0] == 0x1f) && (magic[1] == 0x8b);
+
+    rewind(file);
+    return gzip;
+}
+
+/** Size of the buffer of the compressed data read by try_gzload() */
+#define GZLOAD_BUFFER_SIZE (1024 * 1024)
+
+/** Decompress a gzip file into memory
+ *
+ * The data are decompressed straight into the buffer, so no
+ * temporary file is needed. An error message is displayed when
+ * the file could not be read or decompressed or when it does not
+ * fit into the buffer (the buffer is overwritten in any case).
+ *
+ * @param path    Name of the file.
+ * @param buf     Buffer to decompress the data into.
+ * @param size    Size of the buffer.
+ * @param len     Returned size of the decompressed data.
+ * @param too_big Error message of the data not fitting into the buffer.
+ *
+ * @return true if successful
+ *
+ */
+bool try_gzload(const char *path, void *buf, size_t size, size_t *len,
+        const char *too_big)
+{
+    ASSERT(path != NULL);
+    ASSERT(buf != NULL);
+    ASSERT(len != NULL);
+
+#ifdef HAVE_LIBZ
+    gzFile gz = gzopen(path, "rb");
+    if (gz == NULL) {
+        io_error(path);
+        return false;
+    }
+
+    gzbuffer(gz, GZLOAD_BUFFER_SIZE);
+
+    uint8_t *ptr = (uint8_t *) buf;
+    size_t done = 0;
+    int rd = 0;
+
+    while (done < size) {
+        size_t chunk = size - done;
+        if (chunk > INT_MAX) {
+            chunk = INT_MAX;
+        }
+
+        rd = gzread(gz, ptr + done, (unsigned int) chunk);
+        if (rd <= 0) {
+            break;
+        }
+
+        done += (size_t) rd;
+    }
+
+    /* Anything left over does not fit */
+    uint8_t extra;
+    if ((rd >= 0) && (done == size)) {
+        rd = gzread(gz, &extra, 1);
+        if (rd > 0) {
+            error("%s", too_big);
+            gzclose(gz);
+            return false;
+        }
+    }
+
+    /* A truncated file is only reported by the state of the stream */
+    int errnum;
+    const char *msg = gzerror(gz, &errnum);
+
+    if ((rd < 0) || (errnum != Z_OK)) {
+        if (errnum == Z_ERRNO) {
+            io_error(path);
+        } else {
+            error("%s", msg);
+        }
+
+        gzclose(gz);
+        return false;
+    }
+
+    gzclose(gz);
+    *len = done;
+    return true;
+#else
+    error("%s: Compressed files are not supported (built without zlib)", path);
+    return false;
+#endif
+}
+
 void try_munmap(void *ptr, size_t size)
 {
     ASSERT(ptr != NULL);
@@ -362,6 +587,89 @@ void try_munmap(void *ptr, size_t size)
     }
 }
 
+/** Split job shared by the host threads */
+typedef struct {
+    size_t count; /**< Number of the items */
+    size_t grain; /**< Number of the items taken at once */
+    size_t next; /**< First item not taken yet */
+    split_func_t func;
+    void *arg;
+} split_job_t;
+
+/** Body of a split job thread
+ *
+ * The threads take the ranges of the items one by one.
+ *
+ */
+static void *split_thread(void *arg)
+{
+    split_job_t *job = (split_job_t *) arg;
+
+    while (true) {
+        size_t first = __atomic_fetch_add(&job->next, job->grain, __ATOMIC_RELAXED);
+
+        if (first >= job->count) {
+            return NULL;
+        }
+
+        job->func(job->arg, first, MIN(first + job->grain, job->count));
+    }
+}
+
+/** Split a job among the host threads
+ *
+ * The items are processed by the ranges of grain items, each range
+ * by a single thread. The calling thread works as well, the job is
+ * done by the calling thread alone if it fits a single range or no
+ * other thread can be started. The threads are gone on return.
+ *
+ * @param count Number of the items.
+ * @param grain Number of the items in a range (nonzero).
+ * @param func  Function processing a range.
+ * @param arg   Argument of the function.
+ *
+ */
+void split_run(size_t count, size_t grain, split_func_t func, void *arg)
+{
+    ASSERT(grain > 0);
+    ASSERT(func != NULL);
+
+    if (count <= grain) {
+        if (count > 0) {
+            func(arg, 0, count);
+        }
+
+        return;
+    }
+
+    split_job_t job = {
+        .count = count,
+        .grain = grain,
+        .next = 0,
+        .func = func,
+        .arg = arg
+    };
+
+    long int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t ranges = (count + grain - 1) / grain;
+    size_t threads = (cpus > 1) ? (size_t) cpus - 1 : 0;
+    threads = MIN(MIN(threads, ranges - 1), SPLIT_THREADS);
+
+    pthread_t ids[SPLIT_THREADS];
+    size_t started = 0;
+
+    while ((started < threads)
+            && (pthread_create(&ids[started], NULL, split_thread, &job) == 0)) {
+        started++;
+    }
+
+    split_thread(&job);
+
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(ids[i], NULL);
+    }
+}
+
 /** Convert 32 bit unsigned number to string with k, K, M or no suffix.
  *
  * The conversion applies the first of the following rules
@@ -425,7 +733,7 @@ bool virt_range(uint64_t addr)
 
 bool phys_range(uint64_t addr)
 {
-    return (addr <= UINT64_C(0xfffffffff));
+    return ((addr >> PHYS_WIDTH) == 0);
 }
 
 uint64_t current_timestamp(void)
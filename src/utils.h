@@ -21,6 +21,12 @@
 
 #include "main.h"
 
+/** Size of a host cache line (the alignment of the hot parts of structures) */
+#define CACHE_LINE_SIZE 64
+
+/** Maximal number of the host threads started by split_run() */
+#define SPLIT_THREADS 16
+
 #define STRINGIFY(a) STRINGIFY_(a)
 #define STRINGIFY_(a) #a
 
@@ -62,13 +68,30 @@
 #define safe_malloc_t(type) \
     ((type *) safe_malloc(sizeof(type)))
 
+#define safe_malloc_aligned_t(type) \
+    ((type *) safe_malloc_aligned(sizeof(type), __alignof__(type)))
+
+#define safe_free_aligned(ptr) \
+    { \
+        if (ptr != NULL) { \
+            free_aligned(ptr); \
+            ptr = NULL; \
+        } \
+    }
+
 typedef struct {
     char *str;
     size_t size;
     size_t pos;
 } string_t;
 
+/** Work on the items first to last - 1 of a split job (see split_run()) */
+typedef void (*split_func_t)(void *arg, size_t first, size_t last);
+
 extern void *safe_malloc(const size_t size);
+extern void *safe_calloc(const size_t size);
+extern void *safe_malloc_aligned(const size_t size, const size_t alignment);
+extern void free_aligned(void *ptr);
 extern char *safe_strdup(const char *str);
 
 extern void string_init(string_t *str);
@@ -96,8 +119,13 @@ extern bool check_isdir(FILE *file);
 extern bool try_fseek(FILE *file, size_t offset, int whence, const char *path);
 extern bool try_ftell(FILE *file, const char *path, size_t *pos);
 extern void safe_fclose(FILE *file, const char *path);
+extern bool fwrite_sparse(FILE *file, const void *data, size_t size);
+extern bool fgzipped(FILE *file);
+extern bool try_gzload(const char *path, void *buf, size_t size, size_t *len,
+        const char *too_big);
 
 extern void try_munmap(void *ptr, size_t size);
+extern void split_run(size_t count, size_t grain, split_func_t func, void *arg);
 
 extern uint64_t current_timestamp(void);
 
@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+
+import os
+import re
+import subprocess
+import sys
+
+# Workload directory and the configuration files of the architectures
+BENCHMARKS = [
+    ("mips32-alu", [("r4000", "msim.conf")]),
+    ("mips32-memstream", [("r4000", "msim.conf")]),
+    ("mips32-tlb", [("r4000", "msim.conf")]),
+    ("mips32-lrsc", [("r4000", "msim.conf")]),
+    ("mips32-mmio", [("r4000", "msim.conf")]),
+    ("mips32-ddisk", [("r4000", "msim.conf")]),
+    ("mips32-syscall", [("r4000", "msim.conf")]),
+    ("riscv-alu", [("rv32", "rv32.conf"), ("rv64", "rv64.conf")]),
+    ("riscv-memstream", [("rv32", "rv32.conf"), ("rv64", "rv64.conf")]),
+    ("riscv-tlb", [("rv32", "rv32.conf"), ("rv64", "rv64.conf")]),
+    ("riscv-lrsc", [("rv32", "rv32.conf"), ("rv64", "rv64.conf")]),
+    ("riscv-mmio", [("rv32", "rv32.conf"), ("rv64", "rv64.conf")]),
+    ("riscv-ddisk", [("rv32", "rv32.conf"), ("rv64", "rv64.conf")]),
+    ("riscv-syscall", [("rv32", "rv32.conf"), ("rv64", "rv64.conf")]),
+]
+
+MSIM_PATH = os.path.abspath("../../msim")
+
+FIELDS = ["cycles", "instructions", "seconds", "mips",
+          "cycles_per_second", "ns_per_instruction"]
+
+STATS_RE = re.compile(r"^Statistics: (.*)$", re.MULTILINE)
+
+def run(bench, conf):
+    res = subprocess.run([MSIM_PATH, "--stats", "-c", conf], cwd=bench,
+        stdin=subprocess.DEVNULL, capture_output=True, text=True, timeout=120)
+
+    match = STATS_RE.search(res.stdout)
+    if (res.returncode != 0) or (match is None):
+        sys.stderr.write(res.stdout + res.stderr)
+        return None
+
+    return dict(field.split("=") for field in match.group(1).split())
+
+def main():
+    # Optional names of the workloads to run (all by default)
+    selected = sys.argv[1:]
+    failed = 0
+
+    print(",".join(["name", "arch"] + FIELDS))
+
+    for bench, configs in BENCHMARKS:
+        if selected and (bench not in selected):
+            continue
+
+        for arch, conf in configs:
+            stats = run(bench, conf)
+            if stats is None:
+                print("Benchmark {b} ({a}) failed".format(b=bench, a=arch), file=sys.stderr)
+                failed += 1
+                continue
+
+            print(",".join([bench, arch] + [stats[f] for f in FIELDS]))
+
+    if failed > 0:
+        sys.exit(1)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+
+import os
+import re
+import subprocess
+import sys
+
+# Scripted workloads: the microbenchmark run by every processor
+# and the numbers of processors of the machine
+WORKLOADS = [
+    ("context-switch", "syscall", [1, 2, 4, 8]),
+    ("page-fault", "tlb", [1, 2, 4, 8]),
+    ("ping-pong", "lrsc", [1, 2, 4, 8]),
+    # A single disk controller, the processors would issue the same transfers
+    ("disk-stream", "ddisk", [1]),
+]
+
+# Workload directories of the architectures (see run_bench.py)
+ARCHES = [
+    ("r4000", "mips32-{w}", "msim.conf"),
+    ("rv32", "riscv-{w}", "rv32.conf"),
+    ("rv64", "riscv-{w}", "rv64.conf"),
+]
+
+# Commands of each processor (and the variables) of the engine modes
+MODES = [
+    ("interp", [], []),
+    ("block", ["{cpu} block 64"], []),
+    ("jit", ["{cpu} block 64", "{cpu} jit 16"], []),
+    ("parallel", ["{cpu} block 64"], ["set parallel = 10000"]),
+]
+
+# Machine cycles of each run (the workloads stop earlier when they finish)
+CYCLES = 2000000
+
+MSIM_PATH = os.path.abspath("../../msim")
+
+CONFIG = ".macro.conf"
+
+FIELDS = ["cycles", "instructions", "seconds", "mips"]
+
+CPU_RE = re.compile(r"^add (dr4kcpu|drvcpu|drv64cpu) \S+$")
+STATS_RE = re.compile(r"^Statistics: (.*)$", re.MULTILINE)
+VERSION_RE = re.compile(r"^MSIM version (\S+)$", re.MULTILINE)
+
+def version():
+    res = subprocess.run([MSIM_PATH, "--version"], capture_output=True, text=True)
+    match = VERSION_RE.search(res.stdout)
+    return match.group(1) if match else "unknown"
+
+def config(conf, cpus, mode):
+    """Machine of the workload with the processors of the mode."""
+
+    with open(conf) as f:
+        lines = f.read().splitlines()
+
+    kind = next(CPU_RE.match(l).group(1) for l in lines if CPU_RE.match(l))
+    _, commands, variables = mode
+
+    result = list(variables)
+    for i in range(cpus):
+        cpu = "cpu{i}".format(i=i)
+        result.append("add {k} {c}".format(k=kind, c=cpu))
+        result.extend(c.format(cpu=cpu) for c in commands)
+
+    result.extend(l for l in lines if not CPU_RE.match(l))
+    return "\n".join(result) + "\n"
+
+def run(bench, conf, cpus, mode):
+    with open(os.path.join(bench, CONFIG), "w") as f:
+        f.write(config(os.path.join(bench, conf), cpus, mode))
+
+    try:
+        res = subprocess.run([MSIM_PATH, "--stats", "--max-cycles={c}".format(c=CYCLES),
+            "-c", CONFIG], cwd=bench, stdin=subprocess.DEVNULL,
+            capture_output=True, text=True, timeout=300)
+    finally:
+        os.remove(os.path.join(bench, CONFIG))
+
+    match = STATS_RE.search(res.stdout)
+    if (res.returncode != 0) or (match is None):
+        sys.stderr.write(res.stdout + res.stderr)
+        return None
+
+    return dict(field.split("=") for field in match.group(1).split())
+
+def main():
+    # Optional names of the workloads to run (all by default)
+    selected = sys.argv[1:]
+    failed = 0
+
+    msim_version = version()
+    print(",".join(["version", "name", "arch", "mode", "cpus"] + FIELDS + ["efficiency"]))
+
+    for name, workload, counts in WORKLOADS:
+        if selected and (name not in selected):
+            continue
+
+        for arch, directory, conf in ARCHES:
+            bench = directory.format(w=workload)
+
+            for mode in MODES:
+                # Speed of a single processor the scaling is relative to
+                single = None
+
+                for cpus in counts:
+                    stats = run(bench, conf, cpus, mode)
+                    if stats is None:
+                        print("Benchmark {n} ({a}, {m}, {c} processors) failed".format(
+                            n=name, a=arch, m=mode[0], c=cpus), file=sys.stderr)
+                        failed += 1
+                        continue
+
+                    mips = float(stats["mips"])
+                    if cpus == 1:
+                        single = mips
+
+                    efficiency = ""
+                    if single:
+                        efficiency = "{e:.3f}".format(e=mips / (cpus * single))
+
+                    print(",".join([msim_version, name, arch, mode[0], str(cpus)]
+                        + [stats[f] for f in FIELDS] + [efficiency]), flush=True)
+
+    if failed > 0:
+        sys.exit(1)
+
+if __name__ == "__main__":
+    main()
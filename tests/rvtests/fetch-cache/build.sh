@@ -0,0 +1,6 @@
+#!/bin/bash
+for name in main code1 code2; do
+    riscv32-unknown-elf-gcc -msmall-data-limit=0 -mstrict-align -fno-pic -fno-builtin -ffreestanding -nostdlib -nostdinc -c -o $name.raw $name.S
+    riscv32-unknown-elf-objcopy -O binary $name.raw $name.bin
+done
+riscv32-unknown-elf-objdump -d -C -S main.raw > main.dis
@@ -1,9 +1,8 @@
 #!/usr/bin/env python3
 
-from distutils.log import error
+import filecmp
 import os
 import subprocess
-import filecmp
 
 TESTS = [
     "simple",
@@ -28,7 +27,14 @@ TESTS = [
     "external-SEIP",
     "m-mode-STIP",
     "mprv-fetch",
-    "tlb"
+    "pmp",
+    "tlb",
+    "fetch-cache",
+    "block",
+    "jit",
+    "fusion",
+    "wfi-timer",
+    "wfi-smp"
 ]
 
 MSIM_PATH = "../../msim"
@@ -37,6 +43,7 @@ DEFAULT_PWD = os.getcwd()
 
 OUTPUT_FILENAME = "out.txt"
 EXPECTED_FILENAME = "expected-output.txt"
+BATCH_FILENAME = "tests.batch"
 
 def run_test(test_folder):
     print("test: {t}".format(t=test_folder).ljust(45, ' '), end="")
@@ -61,9 +68,43 @@ def run_test(test_folder):
     os.chdir(DEFAULT_PWD)
     print("success")
 
+def batch_line(test_folder):
+    # Tests without the printer use register dumps instead,
+    # their standard output is compared then
+    with open(os.path.join(test_folder, "msim.conf")) as f:
+        if 'redir "{o}"'.format(o=OUTPUT_FILENAME) in f.read():
+            return "{t} {e} {o}\n".format(t=test_folder, e=EXPECTED_FILENAME, o=OUTPUT_FILENAME)
+
+    return "{t} {e}\n".format(t=test_folder, e=EXPECTED_FILENAME)
+
+def run_batch():
+    # All tests once more through the batch mode (msim --batch)
+    print("test: batch mode".ljust(45, ' '), end="")
+    with open(BATCH_FILENAME, 'w') as f:
+        for test in TESTS:
+            f.write(batch_line(test))
+
+    try:
+        res = subprocess.run([MSIM_PATH, "--batch=" + BATCH_FILENAME], capture_output=True, timeout=120, text=True)
+        assert res.returncode == 0, "Exit code {c}\n{o}".format(c=res.returncode, o=res.stdout)
+    except BaseException  as e:
+        print("failure! ({e})".format(e=e))
+        exit(-1)
+    finally:
+        os.remove(BATCH_FILENAME)
+
+    for test in TESTS:
+        output = os.path.join(test, OUTPUT_FILENAME)
+        if os.path.exists(output):
+            os.remove(output)
+
+    print("success")
+
 def main():
     for test in TESTS:
         run_test(test)
 
+    run_batch()
+
 if __name__ == "__main__":
     main()
@@ -185,4 +185,24 @@ PCUT_TEST(asid_len_probes)
     test_asid_len_probe(0);
 }
 
+PCUT_TEST(satp_write_forgets_last_translations)
+{
+    cpu0.utlb[rv_utlb_read].valid = true;
+    cpu0.utlb[rv_utlb_write].valid = true;
+
+    probe_asid_len();
+
+    PCUT_ASSERT_EQUALS(false, cpu0.utlb[rv_utlb_read].valid);
+    PCUT_ASSERT_EQUALS(false, cpu0.utlb[rv_utlb_write].valid);
+}
+
+PCUT_TEST(asid_len_change_forgets_last_translations)
+{
+    cpu0.utlb[rv_utlb_fetch].valid = true;
+
+    rv_csr_set_asid_len(&cpu0, 7);
+
+    PCUT_ASSERT_EQUALS(false, cpu0.utlb[rv_utlb_fetch].valid);
+}
+
 PCUT_EXPORT(asid_len);
@@ -0,0 +1,170 @@
+#include <stdint.h>
+#include <string.h>
+#include <pcut/pcut.h>
+
+#include "../../../src/device/cpu/general_cpu.h"
+#include "../../../src/parallel.h"
+#include "../../../src/physmem.h"
+#include "common.h"
+
+PCUT_INIT
+
+PCUT_TEST_SUITE(atomics);
+
+#define TEST_ADDR UINT64_C(0x10000)
+
+static uint8_t test_data[FRAME_SIZE];
+static physmem_area_t test_area;
+static frame_t *test_frame;
+static rv_cpu_t test_cpu;
+static rv_cpu_t other_cpu;
+
+static bool test_sc_access(void *data, ptr36_t addr, int size)
+{
+    return rv_sc_access((rv_cpu_t *) data, addr, size);
+}
+
+static const cpu_ops_t test_ops = {
+    .sc_access = test_sc_access
+};
+
+static general_cpu_t test_general_cpu = { .cpuno = 0, .type = &test_ops, .data = &test_cpu };
+static general_cpu_t other_general_cpu = { .cpuno = 1, .type = &test_ops, .data = &other_cpu };
+
+static rv_instr_t amo_instr(unsigned int rd, unsigned int rs2)
+{
+    rv_instr_t instr = { .r = {
+                                 .opcode = rv_opcAMO,
+                                 .funct3 = RV_AMO_32_WLEN,
+                                 .rd = rd,
+                                 .rs1 = 1,
+                                 .rs2 = rs2 } };
+    return instr;
+}
+
+PCUT_TEST_BEFORE
+{
+    memset(test_data, 0, sizeof(test_data));
+
+    test_area.type = MEMT_MEM;
+    test_area.writable = true;
+    test_area.start = ADDR2FRAME(TEST_ADDR);
+    test_area.count = 1;
+    test_area.data = test_data;
+    physmem_wire(&test_area);
+    test_frame = physmem_find_frame(TEST_ADDR);
+
+    rv_cpu_init(&test_cpu, 0);
+    rv_cpu_init(&other_cpu, 1);
+    test_cpu.regs[1] = TEST_ADDR;
+    other_cpu.regs[1] = TEST_ADDR;
+    add_cpu(&test_general_cpu);
+    add_cpu(&other_general_cpu);
+}
+
+PCUT_TEST_AFTER
+{
+    parallel_active = false;
+    sc_unregister(0);
+    sc_unregister(1);
+    remove_cpu(&test_general_cpu);
+    remove_cpu(&other_general_cpu);
+    physmem_unwire(&test_area);
+}
+
+PCUT_TEST(amoadd_updates_host_memory)
+{
+    physmem_write32(0, TEST_ADDR, 5, true);
+    test_cpu.regs[2] = 3;
+
+    rv_exc_t ex = rv_amoadd_w_instr(&test_cpu, amo_instr(3, 2));
+
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, ex);
+    PCUT_ASSERT_INT_EQUALS(5, test_cpu.regs[3]);
+    PCUT_ASSERT_INT_EQUALS(8, physmem_read32(0, TEST_ADDR, true));
+}
+
+PCUT_TEST(amo_uses_operand_before_writing_rd)
+{
+    physmem_write32(0, TEST_ADDR, 5, true);
+    test_cpu.regs[2] = 3;
+
+    rv_amoadd_w_instr(&test_cpu, amo_instr(2, 2));
+
+    PCUT_ASSERT_INT_EQUALS(5, test_cpu.regs[2]);
+    PCUT_ASSERT_INT_EQUALS(8, physmem_read32(0, TEST_ADDR, true));
+}
+
+PCUT_TEST(amomin_compares_signed_values)
+{
+    physmem_write32(0, TEST_ADDR, UINT32_C(0xffffffff), true);
+    test_cpu.regs[2] = 1;
+
+    rv_amomin_w_instr(&test_cpu, amo_instr(3, 2));
+
+    PCUT_ASSERT_TRUE(test_cpu.regs[3] == (uxlen_t) -1);
+    PCUT_ASSERT_INT_EQUALS(UINT32_C(0xffffffff), physmem_read32(0, TEST_ADDR, true));
+
+    rv_amominu_w_instr(&test_cpu, amo_instr(3, 2));
+
+    PCUT_ASSERT_INT_EQUALS(1, physmem_read32(0, TEST_ADDR, true));
+}
+
+PCUT_TEST(amo_breaks_tracked_reservation)
+{
+    rv_lr_w_instr(&other_cpu, amo_instr(3, 0));
+    PCUT_ASSERT_INT_EQUALS(FRAME_DIRECT_READ, test_frame->direct);
+
+    test_cpu.regs[2] = 7;
+    rv_amoswap_w_instr(&test_cpu, amo_instr(3, 2));
+
+    PCUT_ASSERT_INT_EQUALS(7, physmem_read32(0, TEST_ADDR, true));
+    PCUT_ASSERT_FALSE(other_cpu.reserved_valid);
+    PCUT_ASSERT_INT_EQUALS(FRAME_DIRECT_READ | FRAME_DIRECT_WRITE, test_frame->direct);
+}
+
+PCUT_TEST(serial_reservation_is_tracked)
+{
+    rv_lr_w_instr(&test_cpu, amo_instr(3, 0));
+
+    PCUT_ASSERT_TRUE(test_cpu.reserved_valid);
+    PCUT_ASSERT_FALSE(test_cpu.reserved_by_value);
+    PCUT_ASSERT_INT_EQUALS(FRAME_DIRECT_READ, test_frame->direct);
+
+    test_cpu.regs[2] = 9;
+    rv_sc_w_instr(&test_cpu, amo_instr(3, 2));
+
+    PCUT_ASSERT_INT_EQUALS(0, test_cpu.regs[3]);
+    PCUT_ASSERT_INT_EQUALS(9, physmem_read32(0, TEST_ADDR, true));
+}
+
+PCUT_TEST(parallel_reservation_keeps_direct_writes)
+{
+    parallel_active = true;
+    rv_lr_w_instr(&test_cpu, amo_instr(3, 0));
+
+    PCUT_ASSERT_TRUE(test_cpu.reserved_by_value);
+    PCUT_ASSERT_INT_EQUALS(FRAME_DIRECT_READ | FRAME_DIRECT_WRITE, test_frame->direct);
+
+    test_cpu.regs[2] = 9;
+    rv_sc_w_instr(&test_cpu, amo_instr(3, 2));
+
+    PCUT_ASSERT_INT_EQUALS(0, test_cpu.regs[3]);
+    PCUT_ASSERT_INT_EQUALS(9, physmem_read32(0, TEST_ADDR, true));
+}
+
+PCUT_TEST(parallel_sc_fails_after_value_changes)
+{
+    parallel_active = true;
+    rv_lr_w_instr(&test_cpu, amo_instr(3, 0));
+
+    physmem_cached_write32(1, test_frame, TEST_ADDR, 4);
+
+    test_cpu.regs[2] = 9;
+    rv_sc_w_instr(&test_cpu, amo_instr(3, 2));
+
+    PCUT_ASSERT_INT_EQUALS(1, test_cpu.regs[3]);
+    PCUT_ASSERT_INT_EQUALS(4, physmem_read32(0, TEST_ADDR, true));
+}
+
+PCUT_EXPORT(atomics);
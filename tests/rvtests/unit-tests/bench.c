@@ -0,0 +1,493 @@
+/*
+ * Microbenchmarks of the internal data structures
+ *
+ * Not a test (it is not linked into tests_32 and tests_64), run
+ * as src/Makefile rvbench. Each benchmark reports the host time
+ * of one operation and compares it with the baseline file.
+ *
+ * Usage: benchmarks [-w] [baseline]
+ *   -w  write the measured times into the baseline file
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../../src/device/cpu/decode_cache.h"
+#include "../../../src/device/cpu/general_cpu.h"
+#include "../../../src/device/cpu/riscv_rv32ima/cpu.h"
+#include "../../../src/device/cpu/riscv_rv32ima/tlb.h"
+#include "../../../src/device/device.h"
+#include "../../../src/physmem.h"
+
+#define BASELINE_FILE "bench.baseline"
+
+/** Times slower than the baseline reported as a regression */
+#define REGRESSION_RATIO 1.25
+
+/** Shortest measured run (in seconds) */
+#define MIN_RUN_TIME 0.05
+
+/** Number of the measured runs (the fastest one counts) */
+#define RUNS 3
+
+#define MAX_BENCHMARKS 32
+
+/** Pages of the memory the processor runs in */
+#define CODE_PAGES 64
+#define CODE_ADDR UINT64_C(0x100000)
+
+/** Pages of the decode cache in the cold fetch */
+#define COLD_CAPACITY 16
+
+#define HIGH_ADDR UINT64_C(0x400000000)
+
+#define DEVICES_MAX 256
+#define DEVICE_ADDR UINT64_C(0x10000000)
+
+/** Benchmark run for the given number of operations */
+typedef void (*bench_func_t)(uint64_t ops);
+
+typedef struct {
+    const char *name;
+    double ns; /**< Measured time of an operation */
+    double baseline; /**< Time in the baseline (0 if none) */
+} bench_result_t;
+
+static bench_result_t results[MAX_BENCHMARKS];
+static unsigned int result_count = 0;
+
+/** Keeps the results of the benchmarked calls alive */
+static volatile uint64_t sink;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Measure the host time of an operation
+ *
+ * The number of operations is doubled until a run takes
+ * MIN_RUN_TIME, the fastest of RUNS such runs counts.
+ *
+ */
+static void bench(const char *name, bench_func_t func)
+{
+    uint64_t ops = 1024;
+
+    while (true) {
+        double start = now();
+        func(ops);
+        if (now() - start >= MIN_RUN_TIME) {
+            break;
+        }
+
+        ops *= 2;
+    }
+
+    double best = 0;
+    for (unsigned int i = 0; i < RUNS; i++) {
+        double start = now();
+        func(ops);
+        double time = now() - start;
+
+        if ((i == 0) || (time < best)) {
+            best = time;
+        }
+    }
+
+    results[result_count].name = name;
+    results[result_count].ns = best * 1e9 / ops;
+    results[result_count].baseline = 0;
+    result_count++;
+}
+
+/*
+ * TLB lookups
+ */
+
+static rv32_tlb_t tlb;
+
+static void tlb_setup(void)
+{
+    rv32_tlb_init(&tlb, DEFAULT_RV_TLB_SIZE);
+
+    for (unsigned int i = 0; i < DEFAULT_RV_TLB_SIZE; i++) {
+        sv32_pte_t pte = { 0 };
+        pte.ppn = i;
+        pte.v = 1;
+        rv32_tlb_add_mapping(&tlb, 1, i << 12, pte, false, false, 0);
+    }
+}
+
+/** The same page all the time */
+static void bench_tlb_hit(uint64_t ops)
+{
+    sv32_pte_t pte;
+    bool megapage;
+
+    for (uint64_t i = 0; i < ops; i++) {
+        sink += rv32_tlb_get_mapping(&tlb, 1, 0x5000, &pte, &megapage, NULL, NULL, false);
+    }
+}
+
+/** All pages of the TLB in turn */
+static void bench_tlb_hit_spread(uint64_t ops)
+{
+    sv32_pte_t pte;
+    bool megapage;
+
+    for (uint64_t i = 0; i < ops; i++) {
+        uint32_t virt = (i % DEFAULT_RV_TLB_SIZE) << 12;
+        sink += rv32_tlb_get_mapping(&tlb, 1, virt, &pte, &megapage, NULL, NULL, false);
+    }
+}
+
+/** Pages not in the TLB */
+static void bench_tlb_miss(uint64_t ops)
+{
+    sv32_pte_t pte;
+    bool megapage;
+
+    for (uint64_t i = 0; i < ops; i++) {
+        uint32_t virt = (DEFAULT_RV_TLB_SIZE + (i % 1024)) << 12;
+        sink += rv32_tlb_get_mapping(&tlb, 1, virt, &pte, &megapage, NULL, NULL, false);
+    }
+}
+
+/*
+ * Frame lookups
+ */
+
+static uint8_t low_data[FRAME_SIZE];
+static uint8_t high_data[FRAME_SIZE];
+static physmem_area_t low_area;
+static physmem_area_t high_area;
+
+static void wire(physmem_area_t *area, ptr36_t addr, uint8_t *data,
+        size_t frames)
+{
+    area->type = MEMT_MEM;
+    area->writable = true;
+    area->start = ADDR2FRAME(addr);
+    area->count = frames;
+    area->data = data;
+
+    physmem_wire(area);
+}
+
+/** Frame below 4 GiB (in the flat table) */
+static void bench_find_frame_low(uint64_t ops)
+{
+    for (uint64_t i = 0; i < ops; i++) {
+        sink += (uintptr_t) physmem_find_frame(0x10000 + (i & 0xffc));
+    }
+}
+
+/** Frame above 4 GiB (in the radix table) */
+static void bench_find_frame_high(uint64_t ops)
+{
+    for (uint64_t i = 0; i < ops; i++) {
+        sink += (uintptr_t) physmem_find_frame(HIGH_ADDR + (i & 0xffc));
+    }
+}
+
+/*
+ * Instruction fetch
+ */
+
+static uint8_t code_data[CODE_PAGES * FRAME_SIZE];
+static physmem_area_t code_area;
+static rv32_cpu_t cpu;
+
+/** Encode jal x0, offset */
+static uint32_t jal_x0(int32_t offset)
+{
+    uint32_t imm = (uint32_t) offset;
+
+    return ((imm & 0x100000) << 11) | ((imm & 0x7fe) << 20)
+            | ((imm & 0x800) << 9) | (imm & 0xff000) | 0x6f;
+}
+
+static void write_instr(size_t offset, uint32_t instr)
+{
+    memcpy(code_data + offset, &instr, sizeof(instr));
+}
+
+/** Processor looping in a single instruction */
+static void bench_fetch_hot(uint64_t ops)
+{
+    rv32_cpu_set_pc(&cpu, CODE_ADDR);
+
+    for (uint64_t i = 0; i < ops; i++) {
+        rv32_cpu_step(&cpu);
+    }
+}
+
+/** Processor jumping across more pages than the decode cache holds */
+static void bench_fetch_cold(uint64_t ops)
+{
+    rv32_cpu_set_pc(&cpu, CODE_ADDR + FRAME_SIZE);
+
+    for (uint64_t i = 0; i < ops; i++) {
+        rv32_cpu_step(&cpu);
+    }
+}
+
+static void fetch_setup(void)
+{
+    /* The first page loops, the others jump to the next one */
+    write_instr(0, jal_x0(0));
+
+    for (size_t page = 1; page < CODE_PAGES - 1; page++) {
+        write_instr(page * FRAME_SIZE, jal_x0(FRAME_SIZE));
+    }
+
+    write_instr((CODE_PAGES - 1) * FRAME_SIZE, jal_x0(-(CODE_PAGES - 2) * FRAME_SIZE));
+
+    wire(&code_area, CODE_ADDR, code_data, CODE_PAGES);
+
+    rv32_cpu_init(&cpu, 0);
+    cpu.priv_mode = rv_mmode;
+    cpu.csr.mtimecmp = UINT64_MAX;
+    cpu.csr.scyclecmp = (uxlen_t) -1;
+}
+
+/*
+ * Store conditional control
+ */
+
+static uint8_t sc_data[FRAME_SIZE];
+static physmem_area_t sc_area;
+static rv32_cpu_t sc_cpus[MAX_CPUS];
+static general_cpu_t sc_general_cpus[MAX_CPUS];
+static unsigned int sc_count = 0;
+
+static bool sc_access(void *data, ptr36_t addr, int size)
+{
+    return rv32_sc_access((rv32_cpu_t *) data, addr, size);
+}
+
+static const cpu_ops_t sc_ops = {
+    .sc_access = sc_access
+};
+
+/** Keep reservations of the given number of processors in the frame
+ *
+ * The reservations are at addresses the writes do not touch.
+ *
+ */
+static void sc_reserve(unsigned int count)
+{
+    for (unsigned int i = 0; i < sc_count; i++) {
+        sc_unregister(i + 1);
+        remove_cpu(&sc_general_cpus[i]);
+        rv32_cpu_done(&sc_cpus[i]);
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+        rv32_cpu_init(&sc_cpus[i], i + 1);
+        sc_general_cpus[i].cpuno = i + 1;
+        sc_general_cpus[i].type = &sc_ops;
+        sc_general_cpus[i].data = &sc_cpus[i];
+        add_cpu(&sc_general_cpus[i]);
+
+        sc_cpus[i].reserved_valid = true;
+        sc_cpus[i].reserved_addr = 0x20000 + 8 + i * 8;
+        sc_register(i + 1, sc_cpus[i].reserved_addr);
+    }
+
+    sc_count = count;
+}
+
+static void bench_sc(uint64_t ops)
+{
+    for (uint64_t i = 0; i < ops; i++) {
+        physmem_write32(0, 0x20000, i, true);
+    }
+}
+
+/*
+ * Device register reads
+ */
+
+static void dummy_read32(unsigned int procno, device_t *dev, ptr36_t addr,
+        uint32_t *val)
+{
+    (void) procno;
+    (void) dev;
+
+    *val = addr;
+}
+
+static const device_type_t dummy_type = {
+    .name = "dummy",
+    .read32 = dummy_read32
+};
+
+static device_t devices[DEVICES_MAX];
+static unsigned int device_count = 0;
+
+/** Map the given number of devices (with a register each) */
+static void devices_map(unsigned int count)
+{
+    for (unsigned int i = device_count; i < count; i++) {
+        devices[i].type = &dummy_type;
+        devices[i].name = (char *) "dummy";
+        dev_map(&devices[i], DEVICE_ADDR + i * 16, 4);
+    }
+
+    device_count = count;
+}
+
+/** Read the register of the middle device */
+static void bench_devices(uint64_t ops)
+{
+    ptr36_t addr = DEVICE_ADDR + (device_count / 2) * 16;
+    uint32_t val;
+
+    for (uint64_t i = 0; i < ops; i++) {
+        dev_read32(0, addr, &val);
+        sink += val;
+    }
+}
+
+/*
+ * Baseline
+ */
+
+static void baseline_read(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char name[128];
+        double ns;
+
+        if ((line[0] == '#') || (sscanf(line, "%127s %lf", name, &ns) != 2)) {
+            continue;
+        }
+
+        for (unsigned int i = 0; i < result_count; i++) {
+            if (strcmp(results[i].name, name) == 0) {
+                results[i].baseline = ns;
+            }
+        }
+    }
+
+    fclose(file);
+}
+
+static bool baseline_write(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    fprintf(file, "# Host time of an operation in ns (written by bench -w)\n");
+
+    for (unsigned int i = 0; i < result_count; i++) {
+        fprintf(file, "%s %.2f\n", results[i].name, results[i].ns);
+    }
+
+    fclose(file);
+    return true;
+}
+
+/** Print the results
+ *
+ * @return Number of the regressions.
+ *
+ */
+static unsigned int report(void)
+{
+    unsigned int regressions = 0;
+
+    printf("%-24s %12s %12s %8s\n", "benchmark", "ns/op", "baseline", "change");
+
+    for (unsigned int i = 0; i < result_count; i++) {
+        const bench_result_t *result = &results[i];
+
+        printf("%-24s %12.2f", result->name, result->ns);
+
+        if (result->baseline <= 0) {
+            printf(" %12s\n", "-");
+            continue;
+        }
+
+        double ratio = result->ns / result->baseline;
+        printf(" %12.2f %+7.1f%%", result->baseline, (ratio - 1) * 100);
+
+        if (ratio > REGRESSION_RATIO) {
+            printf(" slower");
+            regressions++;
+        }
+
+        printf("\n");
+    }
+
+    return regressions;
+}
+
+int main(int argc, char *argv[])
+{
+    bool write = false;
+    const char *path = BASELINE_FILE;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-w") == 0) {
+            write = true;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    tlb_setup();
+    bench("tlb_hit", bench_tlb_hit);
+    bench("tlb_hit_spread", bench_tlb_hit_spread);
+    bench("tlb_miss", bench_tlb_miss);
+
+    wire(&low_area, 0x10000, low_data, 1);
+    wire(&high_area, HIGH_ADDR, high_data, 1);
+    bench("find_frame_low", bench_find_frame_low);
+    bench("find_frame_high", bench_find_frame_high);
+
+    fetch_setup();
+    bench("fetch_hot", bench_fetch_hot);
+    decode_cache_configure(DECODE_RV32, COLD_CAPACITY, decode_policy_lru);
+    bench("fetch_cold", bench_fetch_cold);
+
+    wire(&sc_area, 0x20000, sc_data, 1);
+    sc_reserve(1);
+    bench("sc_control_1", bench_sc);
+    sc_reserve(16);
+    bench("sc_control_16", bench_sc);
+    sc_reserve(128);
+    bench("sc_control_128", bench_sc);
+
+    devices_map(1);
+    bench("dev_read32_1", bench_devices);
+    devices_map(16);
+    bench("dev_read32_16", bench_devices);
+    devices_map(256);
+    bench("dev_read32_256", bench_devices);
+
+    if (write) {
+        return baseline_write(path) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    baseline_read(path);
+    return (report() > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,144 @@
+#include <stdint.h>
+#include <string.h>
+#include <pcut/pcut.h>
+
+#include "../../../src/debug/breakpoint.h"
+#include "../../../src/device/cpu/general_cpu.h"
+#include "../../../src/physmem.h"
+#include "common.h"
+
+PCUT_INIT
+
+PCUT_TEST_SUITE(code_breakpoints);
+
+#define TEST_ADDR UINT64_C(0x10000)
+
+/* addi x0, x0, 0 */
+#define NOP_INSTR UINT32_C(0x00000013)
+
+static uint8_t test_data[FRAME_SIZE];
+static physmem_area_t test_area;
+static rv_cpu_t test_cpu;
+
+static ptr64_t test_get_pc(void *data)
+{
+    ptr64_t pc;
+    pc.ptr = ((rv_cpu_t *) data)->pc;
+    return pc;
+}
+
+static const cpu_ops_t test_ops = {
+    .get_pc = test_get_pc
+};
+
+static general_cpu_t test_general_cpu = { .cpuno = 0, .type = &test_ops, .data = &test_cpu };
+
+static ptr64_t addr(uint64_t value)
+{
+    ptr64_t ptr;
+    ptr.ptr = value;
+    return ptr;
+}
+
+PCUT_TEST_BEFORE
+{
+    for (size_t i = 0; i < FRAME_SIZE; i += sizeof(uint32_t)) {
+        memcpy(&test_data[i], &(uint32_t) { NOP_INSTR }, sizeof(uint32_t));
+    }
+
+    test_area.type = MEMT_MEM;
+    test_area.writable = true;
+    test_area.start = ADDR2FRAME(TEST_ADDR);
+    test_area.count = 1;
+    test_area.data = test_data;
+    physmem_wire(&test_area);
+
+    rv_cpu_init(&test_cpu, 0);
+    rv_cpu_set_pc(&test_cpu, TEST_ADDR);
+    test_cpu.block_limit = 64;
+    add_cpu(&test_general_cpu);
+}
+
+PCUT_TEST_AFTER
+{
+    breakpoint_code_remove_filtered(0, BREAKPOINT_FILTER_ANY);
+    breakpoint_code_remove_filtered(1, BREAKPOINT_FILTER_ANY);
+    machine_interactive = false;
+    remove_cpu(&test_general_cpu);
+    physmem_unwire(&test_area);
+}
+
+PCUT_TEST(insert_is_idempotent)
+{
+    breakpoint_t *first = breakpoint_code_insert(0, addr(TEST_ADDR), BREAKPOINT_KIND_SIMULATOR);
+    breakpoint_t *second = breakpoint_code_insert(0, addr(TEST_ADDR), BREAKPOINT_KIND_SIMULATOR);
+
+    PCUT_ASSERT_TRUE(first == second);
+    PCUT_ASSERT_INT_EQUALS(1, code_breakpoint_count[0]);
+
+    breakpoint_code_insert(0, addr(TEST_ADDR), BREAKPOINT_KIND_DEBUGGER);
+    PCUT_ASSERT_INT_EQUALS(2, code_breakpoint_count[0]);
+}
+
+PCUT_TEST(lookup_distinguishes_processors_and_kinds)
+{
+    breakpoint_code_insert(1, addr(TEST_ADDR), BREAKPOINT_KIND_DEBUGGER);
+
+    PCUT_ASSERT_NULL(breakpoint_code_find(0, addr(TEST_ADDR), BREAKPOINT_FILTER_ANY));
+    PCUT_ASSERT_NULL(breakpoint_code_find(1, addr(TEST_ADDR), BREAKPOINT_FILTER_SIMULATOR));
+    PCUT_ASSERT_NOT_NULL(breakpoint_code_find(1, addr(TEST_ADDR), BREAKPOINT_FILTER_DEBUGGER));
+    PCUT_ASSERT_NULL(breakpoint_code_find(1, addr(TEST_ADDR + 4), BREAKPOINT_FILTER_ANY));
+}
+
+PCUT_TEST(page_lookup)
+{
+    breakpoint_code_insert(0, addr(TEST_ADDR + 0x100), BREAKPOINT_KIND_SIMULATOR);
+
+    PCUT_ASSERT_TRUE(breakpoint_code_page_set(0, addr(TEST_ADDR)));
+    PCUT_ASSERT_FALSE(breakpoint_code_page_set(0, addr(TEST_ADDR + FRAME_SIZE)));
+    PCUT_ASSERT_FALSE(breakpoint_code_page_set(1, addr(TEST_ADDR)));
+}
+
+PCUT_TEST(remove_by_kind)
+{
+    breakpoint_code_insert(0, addr(TEST_ADDR), BREAKPOINT_KIND_SIMULATOR);
+    breakpoint_code_insert(0, addr(TEST_ADDR + 4), BREAKPOINT_KIND_DEBUGGER);
+
+    PCUT_ASSERT_FALSE(breakpoint_code_remove(0, addr(TEST_ADDR), BREAKPOINT_FILTER_DEBUGGER));
+    PCUT_ASSERT_TRUE(breakpoint_code_remove(0, addr(TEST_ADDR), BREAKPOINT_FILTER_SIMULATOR));
+
+    breakpoint_code_remove_filtered(0, BREAKPOINT_FILTER_DEBUGGER);
+
+    PCUT_ASSERT_INT_EQUALS(0, code_breakpoint_count[0]);
+    PCUT_ASSERT_FALSE(breakpoint_any_set());
+}
+
+PCUT_TEST(breakpoint_is_hit_at_pc)
+{
+    breakpoint_t *breakpoint = breakpoint_code_insert(0, addr(TEST_ADDR + 4), BREAKPOINT_KIND_SIMULATOR);
+
+    PCUT_ASSERT_FALSE(breakpoint_check_for_code_breakpoints());
+
+    test_cpu.pc = TEST_ADDR + 4;
+    PCUT_ASSERT_TRUE(breakpoint_check_for_code_breakpoints());
+    PCUT_ASSERT_TRUE(machine_interactive);
+    PCUT_ASSERT_INT_EQUALS(1, breakpoint->hits);
+}
+
+PCUT_TEST(block_runs_on_pages_without_breakpoints)
+{
+    rv_cpu_step(&test_cpu);
+
+    PCUT_ASSERT_TRUE(test_cpu.pc > TEST_ADDR + 4);
+}
+
+PCUT_TEST(block_stops_on_pages_with_breakpoints)
+{
+    breakpoint_code_insert(0, addr(TEST_ADDR + 8), BREAKPOINT_KIND_SIMULATOR);
+
+    rv_cpu_step(&test_cpu);
+
+    PCUT_ASSERT_INT_EQUALS(TEST_ADDR + 4, test_cpu.pc);
+}
+
+PCUT_EXPORT(code_breakpoints);
@@ -6,17 +6,25 @@
 #define rv_cpu rv32_cpu
 #define rv_cpu_t rv32_cpu_t
 #define rv_cpu_init rv32_cpu_init
+#define rv_cpu_step rv32_cpu_step
+#define rv_cpu_set_pc rv32_cpu_set_pc
+#define rv_cpu_standby rv32_cpu_standby
+#define rv_cpu_skip rv32_cpu_skip
+#define rv_cpu_standby_host rv32_cpu_standby_host
+#define rv_interrupt_up rv32_interrupt_up
+#define rv_interrupt_down rv32_interrupt_down
+#define rv_set_mtimecmp rv32_set_mtimecmp
 #define rv_convert_addr rv32_convert_addr
 
 #define rv_instr_decode rv32_instr_decode
-#define rv_sfence_instr _rv32_sfence_instr
 
 #define rv_csr_set_asid_len rv32_csr_set_asid_len
 
 #include "../../../src/device/cpu/riscv_rv32ima/cpu.h"
 #include "../../../src/device/cpu/riscv_rv32ima/csr.h"
 
-// Memory helpers
+// Memory helpers (checked by PMP)
+#include "../../../src/device/cpu/riscv_rv_ima/pmp.c"
 #include "../../../src/device/cpu/riscv_rv_ima/memory.c"
 
 // Instruction implementations
@@ -28,17 +36,25 @@
 #define rv_cpu rv64_cpu
 #define rv_cpu_t rv64_cpu_t
 #define rv_cpu_init rv64_cpu_init
+#define rv_cpu_step rv64_cpu_step
+#define rv_cpu_set_pc rv64_cpu_set_pc
+#define rv_cpu_standby rv64_cpu_standby
+#define rv_cpu_skip rv64_cpu_skip
+#define rv_cpu_standby_host rv64_cpu_standby_host
+#define rv_interrupt_up rv64_interrupt_up
+#define rv_interrupt_down rv64_interrupt_down
+#define rv_set_mtimecmp rv64_set_mtimecmp
 #define rv_convert_addr rv64_convert_addr
 
 #define rv_instr_decode rv64_instr_decode
-#define rv_sfence_instr _rv64_sfence_instr
 
 #define rv_csr_set_asid_len rv64_csr_set_asid_len
 
 #include "../../../src/device/cpu/riscv_rv64ima/cpu.h"
 #include "../../../src/device/cpu/riscv_rv64ima/csr.h"
 
-// Memory helpers
+// Memory helpers (checked by PMP)
+#include "../../../src/device/cpu/riscv_rv_ima/pmp.c"
 #include "../../../src/device/cpu/riscv_rv_ima/memory.c"
 
 // Instruction implementations
@@ -0,0 +1,72 @@
+#include <stdint.h>
+#include <pcut/pcut.h>
+
+#include "common.h"
+
+PCUT_INIT
+
+PCUT_TEST_SUITE(csr_dispatch);
+
+static rv_cpu_t cpu0;
+
+/** Zero value is passed in x0, i.e. without any write by CSRRS and CSRRC */
+static rv_exc_t csr_instr(int funct3, csr_num_t csr, uxlen_t value)
+{
+    rv_instr_t instr = { .i = {
+                                 .opcode = rv_opcSYSTEM,
+                                 .funct3 = funct3,
+                                 .imm = csr,
+                                 .rs1 = (value != 0) ? 1 : 0,
+                                 .rd = 2 } };
+
+    cpu0.regs[1] = value;
+    cpu0.regs[instr.i.rd] = 0;
+
+    switch (funct3) {
+    case rv_funcCSRRW:
+        return rv_csrrw_instr(&cpu0, instr);
+    case rv_funcCSRRS:
+        return rv_csrrs_instr(&cpu0, instr);
+    default:
+        return rv_csrrc_instr(&cpu0, instr);
+    }
+}
+
+PCUT_TEST_BEFORE
+{
+    rv_cpu_init(&cpu0, 3);
+    cpu0.priv_mode = rv_mmode;
+}
+
+PCUT_TEST(write_set_clear_reach_the_register)
+{
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, csr_instr(rv_funcCSRRW, csr_sscratch, 0x30));
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, csr_instr(rv_funcCSRRS, csr_sscratch, 0x05));
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, csr_instr(rv_funcCSRRC, csr_sscratch, 0x10));
+
+    PCUT_ASSERT_INT_EQUALS(0x35, cpu0.regs[2]);
+    PCUT_ASSERT_INT_EQUALS(0x25, cpu0.csr.sscratch);
+}
+
+PCUT_TEST(read_only_register_rejects_writes)
+{
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, csr_instr(rv_funcCSRRS, csr_mhartid, 0));
+    PCUT_ASSERT_INT_EQUALS(3, cpu0.regs[2]);
+
+    PCUT_ASSERT_INT_EQUALS(rv_exc_illegal_instruction, csr_instr(rv_funcCSRRW, csr_mhartid, 1));
+}
+
+PCUT_TEST(unknown_register_is_illegal)
+{
+    PCUT_ASSERT_INT_EQUALS(rv_exc_illegal_instruction, csr_instr(rv_funcCSRRS, (csr_num_t) 0x7ff, 0));
+}
+
+PCUT_TEST(privilege_is_checked)
+{
+    cpu0.priv_mode = rv_umode;
+
+    PCUT_ASSERT_INT_EQUALS(rv_exc_illegal_instruction, csr_instr(rv_funcCSRRW, csr_sscratch, 1));
+    PCUT_ASSERT_INT_EQUALS(0, cpu0.csr.sscratch);
+}
+
+PCUT_EXPORT(csr_dispatch);
@@ -0,0 +1,67 @@
+#include <stdint.h>
+#include <pcut/pcut.h>
+
+#include "common.h"
+
+PCUT_INIT
+
+PCUT_TEST_SUITE(hpm_events);
+
+static rv_cpu_t cpu0;
+
+static rv_exc_t csr_write(csr_num_t csr, uxlen_t value)
+{
+    rv_instr_t instr = { .i = {
+                                 .opcode = rv_opcSYSTEM,
+                                 .funct3 = rv_funcCSRRW,
+                                 .imm = csr,
+                                 .rs1 = 1,
+                                 .rd = 2 } };
+
+    cpu0.regs[instr.i.rs1] = value;
+    return rv_csrrw_instr(&cpu0, instr);
+}
+
+PCUT_TEST_BEFORE
+{
+    rv_cpu_init(&cpu0, 0);
+    cpu0.priv_mode = rv_mmode;
+}
+
+PCUT_TEST(no_events_by_default)
+{
+    for (int event = 0; event < hpm_event_count; ++event) {
+        PCUT_ASSERT_INT_EQUALS(0, cpu0.csr.hpm_event_counters[event]);
+    }
+}
+
+PCUT_TEST(event_attaches_counter)
+{
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, csr_write(csr_mhpmevent4, hpm_m_cycles));
+
+    PCUT_ASSERT_INT_EQUALS(UINT32_C(1) << 1, cpu0.csr.hpm_event_counters[hpm_m_cycles]);
+    PCUT_ASSERT_INT_EQUALS(0, cpu0.csr.hpm_event_counters[hpm_u_cycles]);
+}
+
+PCUT_TEST(event_change_moves_counter)
+{
+    csr_write(csr_mhpmevent3, hpm_m_cycles);
+    csr_write(csr_mhpmevent3, hpm_w_cycles);
+
+    PCUT_ASSERT_INT_EQUALS(0, cpu0.csr.hpm_event_counters[hpm_m_cycles]);
+    PCUT_ASSERT_INT_EQUALS(UINT32_C(1), cpu0.csr.hpm_event_counters[hpm_w_cycles]);
+}
+
+PCUT_TEST(inhibited_counter_detaches)
+{
+    csr_write(csr_mhpmevent3, hpm_s_cycles);
+    csr_write(csr_mcountinhibit, UINT32_C(1) << 3);
+
+    PCUT_ASSERT_INT_EQUALS(0, cpu0.csr.hpm_event_counters[hpm_s_cycles]);
+
+    csr_write(csr_mcountinhibit, 0);
+
+    PCUT_ASSERT_INT_EQUALS(UINT32_C(1), cpu0.csr.hpm_event_counters[hpm_s_cycles]);
+}
+
+PCUT_EXPORT(hpm_events);
@@ -0,0 +1,127 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <pcut/pcut.h>
+
+#include "common.h"
+#include "../../../src/hypercall.h"
+#include "../../../src/main.h"
+#include "../../../src/physmem.h"
+
+PCUT_INIT
+
+PCUT_TEST_SUITE(hypercall);
+
+static rv_cpu_t cpu;
+static bool saved_specific;
+
+/* EHCALL */
+static const rv_instr_t ehcall = { .val = 0x8C700073 };
+
+PCUT_TEST_BEFORE
+{
+    rv_cpu_init(&cpu, 0);
+    saved_specific = machine_specific_instructions;
+    machine_specific_instructions = true;
+}
+
+PCUT_TEST_AFTER
+{
+    machine_specific_instructions = saved_specific;
+}
+
+PCUT_TEST(ehcall_decode)
+{
+    PCUT_ASSERT_EQUALS(rv_hypercall_instr, rv_instr_decode(ehcall));
+
+    machine_specific_instructions = false;
+    PCUT_ASSERT_EQUALS(rv_illegal_instr, rv_instr_decode(ehcall));
+}
+
+PCUT_TEST(ehcall_time)
+{
+    uint64_t saved_steps = steps;
+    steps = 0x123456789;
+
+    cpu.regs[17] = HYPERCALL_TIME;
+    rv_exc_t ex = rv_hypercall_instr(&cpu, ehcall);
+    steps = saved_steps;
+
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, ex);
+#if ARCH == 32
+    PCUT_ASSERT_INT_EQUALS(0x23456789, cpu.regs[10]);
+    PCUT_ASSERT_INT_EQUALS(0x1, cpu.regs[11]);
+#else
+    PCUT_ASSERT_TRUE(cpu.regs[10] == 0x123456789);
+#endif
+}
+
+PCUT_TEST(ehcall_unknown)
+{
+    cpu.regs[11] = 0;
+    cpu.regs[17] = 0;
+    rv_hypercall_instr(&cpu, ehcall);
+
+    PCUT_ASSERT_TRUE((uxlen_t) cpu.regs[10] == (uxlen_t) HYPERCALL_ERROR);
+#if ARCH == 32
+    PCUT_ASSERT_TRUE((uxlen_t) cpu.regs[11] == (uxlen_t) HYPERCALL_ERROR);
+#endif
+}
+
+PCUT_TEST(ehcall_missing_device)
+{
+    /* Disk read of a disk which does not exist */
+    cpu.regs[10] = 0;
+    cpu.regs[11] = 0;
+    cpu.regs[12] = 1;
+    cpu.regs[13] = 0;
+    cpu.regs[17] = HYPERCALL_DISK_READ;
+    rv_hypercall_instr(&cpu, ehcall);
+
+    PCUT_ASSERT_TRUE((uxlen_t) cpu.regs[10] == (uxlen_t) HYPERCALL_ERROR);
+}
+
+PCUT_TEST(ehcall_free_pages)
+{
+    physmem_area_t area = {
+        .type = MEMT_MEM,
+        .writable = true,
+        .start = ADDR2FRAME(0x10000),
+        .count = 2
+    };
+
+    area.data = mmap(NULL, FRAMES2SIZE(2), PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    PCUT_ASSERT_TRUE(area.data != MAP_FAILED);
+    physmem_wire(&area);
+
+    physmem_write32(0, 0x10010, 0xdeadbeef, true);
+    physmem_write32(0, 0x11010, 0xcafebabe, true);
+
+    /* Not frame aligned */
+    cpu.regs[10] = 0x10010;
+    cpu.regs[11] = FRAME_SIZE;
+    cpu.regs[17] = HYPERCALL_FREE_PAGES;
+    rv_hypercall_instr(&cpu, ehcall);
+    PCUT_ASSERT_TRUE((uxlen_t) cpu.regs[10] == (uxlen_t) HYPERCALL_ERROR);
+
+    /* Reaching outside of the memory */
+    cpu.regs[10] = 0x11000;
+    cpu.regs[11] = 2 * FRAME_SIZE;
+    rv_hypercall_instr(&cpu, ehcall);
+    PCUT_ASSERT_TRUE((uxlen_t) cpu.regs[10] == (uxlen_t) HYPERCALL_ERROR);
+    PCUT_ASSERT_INT_EQUALS(0xcafebabe, physmem_read32(0, 0x11010, true));
+
+    cpu.regs[10] = 0x10000;
+    cpu.regs[11] = FRAME_SIZE;
+    rv_hypercall_instr(&cpu, ehcall);
+    PCUT_ASSERT_INT_EQUALS(0, cpu.regs[10]);
+
+    PCUT_ASSERT_INT_EQUALS(0, physmem_read32(0, 0x10010, true));
+    PCUT_ASSERT_INT_EQUALS(0xcafebabe, physmem_read32(0, 0x11010, true));
+
+    physmem_unwire(&area);
+    munmap(area.data, FRAMES2SIZE(2));
+}
+
+PCUT_EXPORT(hypercall);
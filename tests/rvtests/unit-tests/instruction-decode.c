@@ -522,6 +522,50 @@ PCUT_TEST(srai_decode)
     PCUT_ASSERT_EQUALS(rv_srai_instr, rv_instr_decode(instr));
 }
 
+PCUT_TEST(sri_illegal_decode)
+{
+    rv_instr_t instr;
+    instr.val = 0;
+    instr.i.opcode = rv_opcOP_IMM;
+    instr.i.funct3 = rv_func_SRI;
+    // bit 31 is not a part of any right shift
+    instr.val |= 1u << 31;
+
+    PCUT_ASSERT_EQUALS(rv_illegal_instr, rv_instr_decode(instr));
+}
+
+/***********************
+ * SYSTEM instructions *
+ ***********************/
+
+PCUT_TEST(ecall_decode)
+{
+    rv_instr_t instr;
+    instr.i.opcode = rv_opcSYSTEM;
+    instr.i.funct3 = rv_funcPRIV;
+    instr.i.imm = rv_privECALL;
+
+    PCUT_ASSERT_EQUALS(rv_call_instr, rv_instr_decode(instr));
+}
+
+PCUT_TEST(machine_specific_decode)
+{
+    rv_instr_t instr;
+    instr.i.opcode = rv_opcSYSTEM;
+    instr.i.funct3 = rv_funcPRIV;
+    instr.i.imm = rv_privEHALT;
+
+    bool enabled = machine_specific_instructions;
+
+    machine_specific_instructions = true;
+    PCUT_ASSERT_EQUALS(rv_halt_instr, rv_instr_decode(instr));
+
+    machine_specific_instructions = false;
+    PCUT_ASSERT_EQUALS(rv_illegal_instr, rv_instr_decode(instr));
+
+    machine_specific_instructions = enabled;
+}
+
 /**********************
  * AUIPC instructions *
  **********************/
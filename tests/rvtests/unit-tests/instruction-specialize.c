@@ -0,0 +1,77 @@
+#include <stdint.h>
+#include <pcut/pcut.h>
+
+#include "common.h"
+
+PCUT_INIT
+
+PCUT_TEST_SUITE(instruction_specialization);
+
+static rv_cpu_t cpu0;
+
+PCUT_TEST_BEFORE
+{
+    rv_cpu_init(&cpu0, 0);
+}
+
+static rv_instr_func_t specialize(uint32_t word)
+{
+    rv_instr_t instr = { .val = word };
+    return rv_instr_specialize(rv_instr_decode(instr), instr);
+}
+
+PCUT_TEST(canonical_nop)
+{
+    // addi x0, x0, 0
+    PCUT_ASSERT_EQUALS(rv_nop_instr, specialize(0x00000013));
+}
+
+PCUT_TEST(computation_to_x0_is_nop)
+{
+    // lui x0, 0x12345
+    PCUT_ASSERT_EQUALS(rv_nop_instr, specialize(0x12345037));
+    // add x0, a0, a1
+    PCUT_ASSERT_EQUALS(rv_nop_instr, specialize(0x00b50033));
+    // mul x0, a0, a1
+    PCUT_ASSERT_EQUALS(rv_nop_instr, specialize(0x02b50033));
+}
+
+PCUT_TEST(load_to_x0_is_kept)
+{
+    // lw x0, 0(a0) may still fault
+    PCUT_ASSERT_EQUALS(rv_lw_instr, specialize(0x00052003));
+}
+
+PCUT_TEST(illegal_to_x0_is_kept)
+{
+    // OP with an unassigned funct7
+    PCUT_ASSERT_EQUALS(rv_illegal_instr, specialize(0x40b51033));
+}
+
+PCUT_TEST(li)
+{
+    rv_instr_t instr = { .val = 0x80000513 }; // addi a0, x0, -2048
+    cpu0.regs[10] = 5;
+
+    PCUT_ASSERT_EQUALS(rv_li_instr, specialize(instr.val));
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, rv_li_instr(&cpu0, instr));
+    PCUT_ASSERT_INT_EQUALS(-2048, (xlen_t) cpu0.regs[10]);
+}
+
+PCUT_TEST(mv)
+{
+    rv_instr_t instr = { .val = 0x00058513 }; // addi a0, a1, 0
+    cpu0.regs[11] = 0x1234;
+
+    PCUT_ASSERT_EQUALS(rv_mv_instr, specialize(instr.val));
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, rv_mv_instr(&cpu0, instr));
+    PCUT_ASSERT_INT_EQUALS(0x1234, cpu0.regs[10]);
+}
+
+PCUT_TEST(addi_is_kept)
+{
+    // addi a0, a1, 1
+    PCUT_ASSERT_EQUALS(rv_addi_instr, specialize(0x00158513));
+}
+
+PCUT_EXPORT(instruction_specialization);
@@ -0,0 +1,288 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pcut/pcut.h>
+
+#include "../../../src/libmsim.h"
+
+PCUT_INIT
+
+PCUT_TEST_SUITE(libmsim);
+
+#define LUI_X2_F0000000 0xf0000137
+#define ADDI_X1_42 0x02a00093
+#define SW_X1_256_X2 0x10112023
+#define JAL_X0_0 0x0000006f
+#define EHALT 0x8c000073
+#define EHCALL 0x8c700073
+#define LI_A7_6 0x00600893
+#define LI_A7_7 0x00700893
+#define LI_A7_8 0x00800893
+#define ADDI_A0_X2_256 0x10010513
+#define LI_A1_16 0x01000593
+#define LBU_A0_256_X2 0x10014503
+
+#define PROGRAM_TEMPLATE "/tmp/libmsim-program-XXXXXX"
+#define CONFIG_TEMPLATE "/tmp/libmsim-config-XXXXXX"
+
+static char program_file[] = PROGRAM_TEMPLATE;
+static char config_file[] = CONFIG_TEMPLATE;
+
+static msim_machine_t *machine;
+
+/** Write the program and a configuration running it on RV32 */
+static void write_machine(const uint32_t *program, size_t count)
+{
+    strcpy(program_file, PROGRAM_TEMPLATE);
+    strcpy(config_file, CONFIG_TEMPLATE);
+
+    int fd = mkstemp(program_file);
+    PCUT_ASSERT_TRUE(fd >= 0);
+    PCUT_ASSERT_INT_EQUALS(count * 4, write(fd, program, count * 4));
+    close(fd);
+
+    fd = mkstemp(config_file);
+    PCUT_ASSERT_TRUE(fd >= 0);
+
+    FILE *file = fdopen(fd, "w");
+    fprintf(file, "add rwm main 0xF0000000\n");
+    fprintf(file, "main generic 4K\n");
+    fprintf(file, "main load \"%s\"\n", program_file);
+    fprintf(file, "add drvcpu cpu0\n");
+    fclose(file);
+}
+
+PCUT_TEST_BEFORE
+{
+    machine = msim_machine_create();
+    PCUT_ASSERT_NOT_NULL(machine);
+}
+
+PCUT_TEST_AFTER
+{
+    msim_machine_destroy(machine);
+    unlink(program_file);
+    unlink(config_file);
+}
+
+PCUT_TEST(run_ends_after_the_cycles)
+{
+    uint32_t program[] = { LUI_X2_F0000000, ADDI_X1_42, SW_X1_256_X2, JAL_X0_0 };
+    write_machine(program, 4);
+    PCUT_ASSERT_TRUE(msim_load_config(machine, config_file));
+
+    PCUT_ASSERT_INT_EQUALS(10, msim_run(machine, 10));
+    PCUT_ASSERT_INT_EQUALS(5, msim_run(machine, 5));
+    PCUT_ASSERT_INT_EQUALS(15, msim_cycles(machine));
+    PCUT_ASSERT_FALSE(msim_halted(machine));
+
+    uint32_t value = 0;
+    msim_read_mem(machine, 0xf0000100, &value, sizeof(value));
+    PCUT_ASSERT_INT_EQUALS(42, value);
+}
+
+PCUT_TEST(halt_ends_the_run)
+{
+    uint32_t program[] = { ADDI_X1_42, EHALT, JAL_X0_0 };
+    write_machine(program, 3);
+    PCUT_ASSERT_TRUE(msim_load_config(machine, config_file));
+
+    uint64_t cycles = msim_run(machine, 1000);
+    PCUT_ASSERT_TRUE(cycles < 1000);
+    PCUT_ASSERT_TRUE(msim_halted(machine));
+    PCUT_ASSERT_INT_EQUALS(0, msim_run(machine, 1000));
+}
+
+PCUT_TEST(reset_returns_to_the_reset_point)
+{
+    uint32_t program[] = { LUI_X2_F0000000, ADDI_X1_42, SW_X1_256_X2, EHALT };
+    write_machine(program, 4);
+    PCUT_ASSERT_FALSE(msim_reset(machine));
+    PCUT_ASSERT_TRUE(msim_load_config(machine, config_file));
+
+    FILE *file = fopen(config_file, "w");
+    fprintf(file, "reset point\n");
+    fclose(file);
+    PCUT_ASSERT_TRUE(msim_load_config(machine, config_file));
+
+    for (unsigned int i = 0; i < 3; i++) {
+        uint32_t value = 0;
+        msim_read_mem(machine, 0xf0000100, &value, sizeof(value));
+        PCUT_ASSERT_INT_EQUALS(0, value);
+
+        msim_run(machine, 1000);
+        PCUT_ASSERT_TRUE(msim_halted(machine));
+        msim_read_mem(machine, 0xf0000100, &value, sizeof(value));
+        PCUT_ASSERT_INT_EQUALS(42, value);
+
+        PCUT_ASSERT_TRUE(msim_reset(machine));
+        PCUT_ASSERT_FALSE(msim_halted(machine));
+        PCUT_ASSERT_INT_EQUALS(0, msim_cycles(machine));
+    }
+}
+
+PCUT_TEST(machine_starts_from_scratch)
+{
+    /* Only one machine at a time */
+    PCUT_ASSERT_NULL(msim_machine_create());
+
+    uint32_t program[] = { LUI_X2_F0000000, ADDI_X1_42, SW_X1_256_X2, JAL_X0_0 };
+    write_machine(program, 4);
+    PCUT_ASSERT_TRUE(msim_load_config(machine, config_file));
+    msim_run(machine, 100);
+
+    msim_machine_destroy(machine);
+    machine = msim_machine_create();
+    PCUT_ASSERT_NOT_NULL(machine);
+    PCUT_ASSERT_INT_EQUALS(0, msim_cycles(machine));
+    PCUT_ASSERT_FALSE(msim_halted(machine));
+
+    /* The same device names can be used again */
+    PCUT_ASSERT_TRUE(msim_load_config(machine, config_file));
+    PCUT_ASSERT_INT_EQUALS(3, msim_run(machine, 3));
+
+    PCUT_ASSERT_FALSE(msim_load_config(machine, "/nonexistent/msim.conf"));
+}
+
+PCUT_TEST(memory_areas_are_the_memory_itself)
+{
+    uint32_t program[] = { LUI_X2_F0000000, ADDI_X1_42, SW_X1_256_X2, JAL_X0_0 };
+    write_machine(program, 4);
+    PCUT_ASSERT_TRUE(msim_load_config(machine, config_file));
+
+    msim_mem_area_t area;
+    PCUT_ASSERT_TRUE(msim_mem_area(machine, 0, &area));
+    PCUT_ASSERT_FALSE(msim_mem_area(machine, 1, &area));
+    PCUT_ASSERT_INT_EQUALS(0, strcmp("main", area.name));
+    PCUT_ASSERT_INT_EQUALS(0xf0000000, area.addr);
+    PCUT_ASSERT_INT_EQUALS(4096, area.size);
+    PCUT_ASSERT_TRUE(area.writable);
+    PCUT_ASSERT_INT_EQUALS(0, memcmp(area.data, program, sizeof(program)));
+
+    msim_run(machine, 100);
+    PCUT_ASSERT_INT_EQUALS(42, area.data[0x100]);
+
+    const uint8_t bytes[] = { 1, 2, 3 };
+    PCUT_ASSERT_TRUE(msim_write_mem(machine, 0xf0000200, bytes, sizeof(bytes)));
+    PCUT_ASSERT_INT_EQUALS(0, memcmp(area.data + 0x200, bytes, sizeof(bytes)));
+    PCUT_ASSERT_FALSE(msim_write_mem(machine, 0x1000, bytes, sizeof(bytes)));
+}
+
+PCUT_TEST(registers_are_numbered_as_by_the_debugger)
+{
+    uint32_t program[] = { LUI_X2_F0000000, ADDI_X1_42, JAL_X0_0 };
+    write_machine(program, 3);
+    PCUT_ASSERT_TRUE(msim_load_config(machine, config_file));
+    msim_run(machine, 2);
+
+    PCUT_ASSERT_INT_EQUALS(33, msim_reg_count(machine, 0));
+    PCUT_ASSERT_INT_EQUALS(0, msim_reg_count(machine, 1));
+    PCUT_ASSERT_INT_EQUALS(0, strcmp("ra", msim_reg_name(machine, 0, 1)));
+    PCUT_ASSERT_NULL(msim_reg_name(machine, 0, 33));
+
+    uint64_t value = 0;
+    PCUT_ASSERT_TRUE(msim_read_reg(machine, 0, 1, &value));
+    PCUT_ASSERT_INT_EQUALS(42, value);
+    PCUT_ASSERT_TRUE(msim_write_reg(machine, 0, 1, 7));
+    PCUT_ASSERT_TRUE(msim_read_reg(machine, 0, 1, &value));
+    PCUT_ASSERT_INT_EQUALS(7, value);
+    PCUT_ASSERT_FALSE(msim_read_reg(machine, 1, 1, &value));
+
+    PCUT_ASSERT_TRUE(msim_read_pc(machine, 0, &value));
+    PCUT_ASSERT_INT_EQUALS(0xf0000008, value);
+}
+
+PCUT_TEST(breakpoint_stops_the_run)
+{
+    uint32_t program[] = { LUI_X2_F0000000, ADDI_X1_42, SW_X1_256_X2, EHALT };
+    write_machine(program, 4);
+    PCUT_ASSERT_TRUE(msim_load_config(machine, config_file));
+    PCUT_ASSERT_TRUE(msim_break_insert(machine, 0, 0xf0000008));
+    PCUT_ASSERT_FALSE(msim_break_insert(machine, 1, 0xf0000008));
+
+    msim_run(machine, 1000);
+    PCUT_ASSERT_FALSE(msim_halted(machine));
+
+    uint64_t pc = 0;
+    PCUT_ASSERT_TRUE(msim_read_pc(machine, 0, &pc));
+    PCUT_ASSERT_INT_EQUALS(0xf0000008, pc);
+
+    PCUT_ASSERT_TRUE(msim_break_remove(machine, 0, 0xf0000008));
+    PCUT_ASSERT_FALSE(msim_break_remove(machine, 0, 0xf0000008));
+    msim_run(machine, 1000);
+    PCUT_ASSERT_TRUE(msim_halted(machine));
+}
+
+/** Find the machine cycles among the statistics */
+static void find_cycles(const msim_stat_t *stat, void *arg)
+{
+    if ((stat->device == NULL) && (strcmp(stat->name, "cycles_total") == 0)) {
+        *((uint64_t *) arg) = stat->count;
+    }
+}
+
+PCUT_TEST(statistics_are_visited)
+{
+    uint32_t program[] = { LUI_X2_F0000000, ADDI_X1_42, JAL_X0_0 };
+    write_machine(program, 3);
+    PCUT_ASSERT_TRUE(msim_load_config(machine, config_file));
+    msim_run(machine, 25);
+
+    uint64_t cycles = 0;
+    msim_stats(machine, find_cycles, &cycles);
+    PCUT_ASSERT_INT_EQUALS(25, cycles);
+}
+
+/* Start marker, input into 0xf0000100, end marker with its first byte */
+static const uint32_t fuzz_program[] = {
+    LUI_X2_F0000000, LI_A7_6, EHCALL,
+    LI_A7_7, ADDI_A0_X2_256, LI_A1_16, EHCALL,
+    LBU_A0_256_X2, LI_A7_8, EHCALL,
+    JAL_X0_0
+};
+
+PCUT_TEST(fuzz_runs_the_inputs_from_the_start_marker)
+{
+    write_machine(fuzz_program, sizeof(fuzz_program) / sizeof(uint32_t));
+    PCUT_ASSERT_TRUE(msim_load_config(machine, config_file));
+    PCUT_ASSERT_TRUE(msim_fuzz_start(machine, 1000));
+
+    uint64_t start = msim_cycles(machine);
+    uint8_t map[64] = { 0 };
+    msim_fuzz_map(machine, map, sizeof(map));
+
+    const uint8_t pass[] = { 0, 1, 2 };
+    PCUT_ASSERT_INT_EQUALS(MSIM_FUZZ_PASS, msim_fuzz_run(machine, pass, sizeof(pass), 1000));
+
+    unsigned int edges = 0;
+    for (size_t i = 0; i < sizeof(map); i++) {
+        edges += map[i];
+    }
+
+    PCUT_ASSERT_TRUE(edges > 0);
+
+    const uint8_t fail[] = { 7 };
+    PCUT_ASSERT_INT_EQUALS(MSIM_FUZZ_FAIL, msim_fuzz_run(machine, fail, sizeof(fail), 1000));
+    PCUT_ASSERT_INT_EQUALS(7, msim_fuzz_status(machine));
+
+    /* The buffer written by the previous input is reset */
+    PCUT_ASSERT_INT_EQUALS(MSIM_FUZZ_PASS, msim_fuzz_run(machine, NULL, 0, 1000));
+    PCUT_ASSERT_INT_EQUALS(0, msim_fuzz_status(machine));
+
+    PCUT_ASSERT_INT_EQUALS(MSIM_FUZZ_TIMEOUT, msim_fuzz_run(machine, fail, sizeof(fail), 2));
+    PCUT_ASSERT_INT_EQUALS(start + 2, msim_cycles(machine));
+}
+
+PCUT_TEST(fuzz_needs_the_start_marker)
+{
+    uint32_t program[] = { ADDI_X1_42, EHALT, JAL_X0_0 };
+    write_machine(program, 3);
+    PCUT_ASSERT_TRUE(msim_load_config(machine, config_file));
+
+    PCUT_ASSERT_FALSE(msim_fuzz_start(machine, 1000));
+    PCUT_ASSERT_TRUE(msim_halted(machine));
+}
+
+PCUT_EXPORT(libmsim);
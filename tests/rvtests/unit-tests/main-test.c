@@ -1,41 +1,23 @@
 #include <pcut/pcut.h>
 
-#include "../../../src/main.h"
-
-/*
- * MSIM main.cpp MOCK
- */
-
-/** Configuration file name */
-char *config_file = NULL;
-
-/** Remote GDB debugging */
-bool remote_gdb = false;
-unsigned int remote_gdb_port = 0;
-bool remote_gdb_conn = false;
-bool remote_gdb_listen = false;
-bool remote_gdb_step = false;
-
-/** General simulator behaviour */
-bool machine_nondet = false;
-
-// set to true for debugging
-bool machine_trace = false;
-bool machine_halt = false;
-bool machine_break = false;
-bool machine_interactive = false;
-bool machine_newline = false;
-bool machine_undefined = false;
-bool machine_specific_instructions = true;
-bool machine_allow_interactive_without_tty = false;
-uint64_t stepping = 0;
-
 PCUT_INIT
 
 PCUT_IMPORT(instruction_immediates);
 PCUT_IMPORT(instruction_decoding);
 PCUT_IMPORT(instruction_exceptions);
+PCUT_IMPORT(instruction_specialization);
 PCUT_IMPORT(tlb);
 PCUT_IMPORT(asid_len);
+PCUT_IMPORT(hpm_events);
+PCUT_IMPORT(physmem_direct);
+PCUT_IMPORT(posted_interrupts);
+PCUT_IMPORT(atomics);
+PCUT_IMPORT(code_breakpoints);
+PCUT_IMPORT(standby_skip);
+PCUT_IMPORT(csr_dispatch);
+PCUT_IMPORT(walk_cache);
+PCUT_IMPORT(trap_fast_path);
+PCUT_IMPORT(libmsim);
+PCUT_IMPORT(hypercall);
 
 PCUT_MAIN()
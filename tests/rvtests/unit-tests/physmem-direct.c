@@ -0,0 +1,212 @@
+#include <stdint.h>
+#include <string.h>
+#include <pcut/pcut.h>
+
+#include "../../../src/physmem.h"
+
+PCUT_INIT
+
+PCUT_TEST_SUITE(physmem_direct);
+
+#define TEST_ADDR UINT64_C(0x10000)
+
+static uint8_t test_data[FRAME_SIZE];
+static physmem_area_t test_area;
+
+static frame_t *wire_test_area_at(ptr36_t addr, bool writable)
+{
+    test_area.type = MEMT_MEM;
+    test_area.writable = writable;
+    test_area.start = ADDR2FRAME(addr);
+    test_area.count = 1;
+    test_area.data = test_data;
+
+    physmem_wire(&test_area);
+
+    return physmem_find_frame(addr);
+}
+
+static frame_t *wire_test_area(bool writable)
+{
+    return wire_test_area_at(TEST_ADDR, writable);
+}
+
+PCUT_TEST_AFTER
+{
+    physmem_unwire(&test_area);
+}
+
+PCUT_TEST(plain_ram_allows_direct_access)
+{
+    frame_t *frame = wire_test_area(true);
+
+    PCUT_ASSERT_NOT_NULL(frame);
+    PCUT_ASSERT_INT_EQUALS(FRAME_DIRECT_READ | FRAME_DIRECT_WRITE, frame->direct);
+
+    physmem_cached_write32(0, frame, TEST_ADDR + 8, UINT32_C(0xdeadbeef));
+
+    PCUT_ASSERT_INT_EQUALS(UINT32_C(0xdeadbeef), physmem_cached_read32(0, frame, TEST_ADDR + 8));
+    PCUT_ASSERT_INT_EQUALS(UINT32_C(0xdeadbeef), physmem_read32(0, TEST_ADDR + 8, true));
+}
+
+PCUT_TEST(rom_allows_direct_reads_only)
+{
+    frame_t *frame = wire_test_area(false);
+
+    PCUT_ASSERT_INT_EQUALS(FRAME_DIRECT_READ, frame->direct);
+    PCUT_ASSERT_FALSE(physmem_cached_write8(0, frame, TEST_ADDR, 1));
+}
+
+PCUT_TEST(reservation_disables_direct_writes)
+{
+    frame_t *frame = wire_test_area(true);
+
+    sc_register(0, TEST_ADDR + 16);
+    PCUT_ASSERT_INT_EQUALS(FRAME_DIRECT_READ, frame->direct);
+
+    sc_unregister(0);
+    PCUT_ASSERT_INT_EQUALS(FRAME_DIRECT_READ | FRAME_DIRECT_WRITE, frame->direct);
+}
+
+PCUT_TEST(watchpoint_disables_direct_access)
+{
+    frame_t *frame = wire_test_area(true);
+
+    physmem_watch(TEST_ADDR + 32, 4, true);
+    PCUT_ASSERT_INT_EQUALS(0, frame->direct);
+
+    physmem_watch(TEST_ADDR + 32, 4, false);
+    PCUT_ASSERT_INT_EQUALS(FRAME_DIRECT_READ | FRAME_DIRECT_WRITE, frame->direct);
+}
+
+PCUT_TEST(frames_are_found_on_both_sides_of_flat_table_limit)
+{
+    ptr36_t high_addr = UINT64_C(0x100000000) + TEST_ADDR;
+    frame_t *frame = wire_test_area_at(high_addr, true);
+
+    PCUT_ASSERT_NOT_NULL(frame);
+    PCUT_ASSERT_NULL(physmem_find_frame(TEST_ADDR));
+    PCUT_ASSERT_NULL(physmem_find_frame(high_addr + FRAME_SIZE));
+
+    physmem_cached_write16(0, frame, high_addr + 2, UINT16_C(0xbeef));
+    PCUT_ASSERT_INT_EQUALS(UINT16_C(0xbeef), physmem_read16(0, high_addr + 2, true));
+}
+
+PCUT_TEST(sparse_frames_above_36_bits_do_not_alias)
+{
+    static uint8_t sparse_data[64][FRAME_SIZE];
+    static physmem_area_t sparse_areas[64];
+
+    ptr36_t top_addr = (UINT64_C(1) << PHYS_WIDTH) - FRAME_SIZE;
+    frame_t *frame = wire_test_area_at(top_addr, true);
+
+    for (unsigned int i = 0; i < 64; i++) {
+        sparse_areas[i].type = MEMT_MEM;
+        sparse_areas[i].writable = true;
+        sparse_areas[i].start = ADDR2FRAME((UINT64_C(i + 1) << 36) + TEST_ADDR);
+        sparse_areas[i].count = 1;
+        sparse_areas[i].data = sparse_data[i];
+        physmem_wire(&sparse_areas[i]);
+    }
+
+    PCUT_ASSERT_TRUE(physmem_find_frame(top_addr) == frame);
+    PCUT_ASSERT_NULL(physmem_find_frame(TEST_ADDR));
+
+    /* Unwire every other area, the rest stays reachable */
+    for (unsigned int i = 0; i < 64; i += 2) {
+        physmem_unwire(&sparse_areas[i]);
+    }
+
+    for (unsigned int i = 0; i < 64; i++) {
+        frame_t *found = physmem_find_frame((UINT64_C(i + 1) << 36) + TEST_ADDR);
+
+        if (i % 2 == 0) {
+            PCUT_ASSERT_NULL(found);
+        } else {
+            PCUT_ASSERT_TRUE(found == &sparse_areas[i].frames[0]);
+        }
+    }
+
+    for (unsigned int i = 1; i < 64; i += 2) {
+        physmem_unwire(&sparse_areas[i]);
+    }
+
+    PCUT_ASSERT_TRUE(physmem_find_frame(top_addr) == frame);
+}
+
+PCUT_TEST(block_write_invalidates_decoded_code_once)
+{
+    frame_t *frame = wire_test_area(true);
+    uint32_t words[4] = { 1, 2, 3, 4 };
+    uint32_t back[4] = { 0 };
+
+    uint64_t generation = frame->generation;
+    physmem_write_block32(0, TEST_ADDR + 64, words, 4, true);
+
+    PCUT_ASSERT_TRUE(frame->generation != generation);
+    PCUT_ASSERT_INT_EQUALS(3, physmem_read32(0, TEST_ADDR + 72, true));
+
+    physmem_read_block32(0, TEST_ADDR + 64, back, 4, true);
+    for (size_t i = 0; i < 4; i++) {
+        PCUT_ASSERT_INT_EQUALS(words[i], back[i]);
+    }
+}
+
+PCUT_TEST(block_write_to_rom_is_dropped)
+{
+    wire_test_area(false);
+    uint32_t words[2] = { 0x55, 0x66 };
+
+    memset(test_data, 0, sizeof(test_data));
+    physmem_write_block32(0, TEST_ADDR, words, 2, true);
+
+    PCUT_ASSERT_INT_EQUALS(0, physmem_read32(0, TEST_ADDR, true));
+}
+
+PCUT_TEST(byte_block_reaches_past_memory)
+{
+    wire_test_area(true);
+    uint8_t bytes[6] = { 1, 2, 3, 4, 5, 6 };
+    uint8_t back[6] = { 0 };
+
+    PCUT_ASSERT_TRUE(physmem_write_block8(0, TEST_ADDR + FRAME_SIZE - 3, bytes, 3, true));
+    PCUT_ASSERT_INT_EQUALS(3, test_data[FRAME_SIZE - 1]);
+
+    /* The bytes past the area are not backed by any memory */
+    PCUT_ASSERT_FALSE(physmem_write_block8(0, TEST_ADDR + FRAME_SIZE - 3, bytes, 6, true));
+
+    physmem_read_block8(0, TEST_ADDR + FRAME_SIZE - 3, back, 6, true);
+    PCUT_ASSERT_INT_EQUALS(1, back[0]);
+    PCUT_ASSERT_INT_EQUALS(3, back[2]);
+    PCUT_ASSERT_INT_EQUALS(0xff, back[3]);
+}
+
+PCUT_TEST(byte_block_writes_rom_only_unprotected)
+{
+    wire_test_area(false);
+    uint8_t bytes[2] = { 0x12, 0x34 };
+
+    memset(test_data, 0, sizeof(test_data));
+    PCUT_ASSERT_FALSE(physmem_write_block8(0, TEST_ADDR + 4, bytes, 2, true));
+    PCUT_ASSERT_INT_EQUALS(0, test_data[4]);
+
+    PCUT_ASSERT_TRUE(physmem_write_block8(0, TEST_ADDR + 4, bytes, 2, false));
+    PCUT_ASSERT_INT_EQUALS(0x34, test_data[5]);
+}
+
+PCUT_TEST(first_write_after_clean_marks_frame_dirty)
+{
+    frame_t *frame = wire_test_area(true);
+    PCUT_ASSERT_TRUE(frame->dirty);
+
+    physmem_area_clean(&test_area);
+    PCUT_ASSERT_FALSE(frame->dirty);
+    PCUT_ASSERT_INT_EQUALS(FRAME_DIRECT_READ, frame->direct);
+
+    physmem_cached_write32(0, frame, TEST_ADDR + 8, 0x1234);
+    PCUT_ASSERT_TRUE(frame->dirty);
+    PCUT_ASSERT_INT_EQUALS(FRAME_DIRECT_READ | FRAME_DIRECT_WRITE, frame->direct);
+    PCUT_ASSERT_INT_EQUALS(0x1234, physmem_read32(0, TEST_ADDR + 8, true));
+}
+
+PCUT_EXPORT(physmem_direct);
@@ -0,0 +1,93 @@
+#include <stdint.h>
+#include <pcut/pcut.h>
+
+#include "../../../src/device/cpu/general_cpu.h"
+#include "../../../src/parallel.h"
+
+PCUT_INIT
+
+PCUT_TEST_SUITE(posted_interrupts);
+
+static uint32_t test_lines;
+
+static void test_interrupt_up(void *data, unsigned int no)
+{
+    test_lines |= UINT32_C(1) << no;
+}
+
+static void test_interrupt_down(void *data, unsigned int no)
+{
+    test_lines &= ~(UINT32_C(1) << no);
+}
+
+static const cpu_ops_t test_ops = {
+    .interrupt_up = test_interrupt_up,
+    .interrupt_down = test_interrupt_down
+};
+
+static general_cpu_t test_cpu;
+
+PCUT_TEST_BEFORE
+{
+    test_lines = 0;
+    test_cpu.cpuno = 3;
+    test_cpu.type = &test_ops;
+    test_cpu.data = NULL;
+    add_cpu(&test_cpu);
+}
+
+PCUT_TEST_AFTER
+{
+    parallel_active = false;
+    remove_cpu(&test_cpu);
+}
+
+PCUT_TEST(processors_are_found_by_number)
+{
+    PCUT_ASSERT_TRUE(get_cpu(3) == &test_cpu);
+    PCUT_ASSERT_TRUE(get_cpu(2) == NULL);
+    PCUT_ASSERT_TRUE(get_cpu(MAX_CPUS) == NULL);
+    PCUT_ASSERT_INT_EQUALS(0, get_free_cpuno());
+}
+
+PCUT_TEST(serial_interrupts_are_raised_directly)
+{
+    cpu_interrupt_up(get_cpu(3), 2);
+    PCUT_ASSERT_INT_EQUALS(0x4, test_lines);
+
+    cpu_interrupt_down(get_cpu(3), 2);
+    PCUT_ASSERT_INT_EQUALS(0, test_lines);
+}
+
+PCUT_TEST(parallel_interrupts_wait_for_delivery)
+{
+    parallel_active = true;
+
+    cpu_interrupt_up(get_cpu(3), 2);
+    cpu_interrupt_up(get_cpu(3), 7);
+    PCUT_ASSERT_INT_EQUALS(0, test_lines);
+
+    cpu_deliver_interrupts(&test_cpu);
+    PCUT_ASSERT_INT_EQUALS(0x84, test_lines);
+
+    /* Nothing is delivered twice */
+    test_lines = 0;
+    cpu_deliver_interrupts(&test_cpu);
+    PCUT_ASSERT_INT_EQUALS(0, test_lines);
+}
+
+PCUT_TEST(last_posted_request_wins)
+{
+    test_lines = 0x4;
+    parallel_active = true;
+
+    cpu_interrupt_up(get_cpu(3), 2);
+    cpu_interrupt_down(get_cpu(3), 2);
+    cpu_interrupt_down(get_cpu(3), 5);
+    cpu_interrupt_up(get_cpu(3), 5);
+
+    cpu_deliver_interrupts(&test_cpu);
+    PCUT_ASSERT_INT_EQUALS(0x20, test_lines);
+}
+
+PCUT_EXPORT(posted_interrupts);
@@ -0,0 +1,168 @@
+#include <stdint.h>
+#include <pcut/pcut.h>
+
+#include "common.h"
+
+PCUT_INIT
+
+PCUT_TEST_SUITE(standby_skip);
+
+static rv_cpu_t stepped_cpu;
+static rv_cpu_t skipped_cpu;
+
+static void standby_init(rv_cpu_t *cpu)
+{
+    rv_cpu_init(cpu, 0);
+    cpu->priv_mode = rv_mmode;
+    cpu->stdby = true;
+    cpu->csr.mtime = 0;
+    cpu->csr.mtimecmp = UINT64_MAX;
+    cpu->csr.mtime_source = rv_mtime_virtual;
+    cpu->csr.mtime_period = 7;
+    cpu->csr.mtime_countdown = 7;
+    cpu->csr.scyclecmp = (uxlen_t) -1;
+}
+
+/** Step one cpu and skip the other one by the cycles the standby lasts */
+static uint64_t step_and_skip(void)
+{
+    uint64_t cycles;
+
+    PCUT_ASSERT_TRUE(rv_cpu_standby(&skipped_cpu, &cycles));
+
+    for (uint64_t i = 0; i < cycles; i++) {
+        rv_cpu_step(&stepped_cpu);
+    }
+
+    rv_cpu_skip(&skipped_cpu, cycles);
+
+    PCUT_ASSERT_TRUE(stepped_cpu.csr.cycle == skipped_cpu.csr.cycle);
+    PCUT_ASSERT_TRUE(stepped_cpu.csr.mtime == skipped_cpu.csr.mtime);
+    PCUT_ASSERT_INT_EQUALS(stepped_cpu.csr.mtime_countdown, skipped_cpu.csr.mtime_countdown);
+    PCUT_ASSERT_TRUE(stepped_cpu.csr.mip == skipped_cpu.csr.mip);
+    PCUT_ASSERT_TRUE(stepped_cpu.csr.external_STIP == skipped_cpu.csr.external_STIP);
+    PCUT_ASSERT_TRUE(stepped_cpu.csr.hpmcounters[0] == skipped_cpu.csr.hpmcounters[0]);
+
+    return cycles;
+}
+
+PCUT_TEST_BEFORE
+{
+    standby_init(&stepped_cpu);
+    standby_init(&skipped_cpu);
+}
+
+PCUT_TEST(running_cpu_is_not_in_standby)
+{
+    uint64_t cycles;
+
+    skipped_cpu.stdby = false;
+
+    PCUT_ASSERT_FALSE(rv_cpu_standby(&skipped_cpu, &cycles));
+}
+
+PCUT_TEST(enabled_pending_interrupt_prevents_skip)
+{
+    uint64_t cycles;
+
+    skipped_cpu.csr.mip = rv_csr_msi_mask;
+    skipped_cpu.csr.mie = rv_csr_msi_mask;
+    rv_csr_update_interrupts_pending(&skipped_cpu);
+
+    PCUT_ASSERT_TRUE(rv_cpu_standby(&skipped_cpu, &cycles));
+    PCUT_ASSERT_INT_EQUALS(0, cycles);
+}
+
+PCUT_TEST(skip_stops_before_mtimecmp)
+{
+    stepped_cpu.csr.mtimecmp = 10;
+    skipped_cpu.csr.mtimecmp = 10;
+
+    PCUT_ASSERT_INT_EQUALS(7 + 9 * 7 - 1, step_and_skip());
+    PCUT_ASSERT_INT_EQUALS(0, skipped_cpu.csr.mip & rv_csr_mti_mask);
+
+    rv_cpu_step(&skipped_cpu);
+
+    PCUT_ASSERT_INT_EQUALS(10, skipped_cpu.csr.mtime);
+    PCUT_ASSERT_INT_EQUALS(rv_csr_mti_mask, skipped_cpu.csr.mip & rv_csr_mti_mask);
+}
+
+PCUT_TEST(skip_stops_before_scyclecmp)
+{
+    stepped_cpu.csr.scyclecmp = 50;
+    skipped_cpu.csr.scyclecmp = 50;
+
+    PCUT_ASSERT_INT_EQUALS(49, step_and_skip());
+    PCUT_ASSERT_FALSE(skipped_cpu.csr.external_STIP);
+
+    rv_cpu_step(&skipped_cpu);
+
+    PCUT_ASSERT_TRUE(skipped_cpu.csr.external_STIP);
+}
+
+PCUT_TEST(inhibited_cycle_ignores_scyclecmp)
+{
+    stepped_cpu.csr.mcountinhibit = 0b001;
+    skipped_cpu.csr.mcountinhibit = 0b001;
+    stepped_cpu.csr.scyclecmp = 50;
+    skipped_cpu.csr.scyclecmp = 50;
+    stepped_cpu.csr.mtimecmp = 20;
+    skipped_cpu.csr.mtimecmp = 20;
+
+    PCUT_ASSERT_INT_EQUALS(7 + 19 * 7 - 1, step_and_skip());
+    PCUT_ASSERT_TRUE(skipped_cpu.csr.cycle == 0);
+}
+
+PCUT_TEST(skip_counts_standby_events)
+{
+    stepped_cpu.csr.hpm_event_counters[hpm_w_cycles] = 1;
+    skipped_cpu.csr.hpm_event_counters[hpm_w_cycles] = 1;
+    stepped_cpu.csr.mtimecmp = 3;
+    skipped_cpu.csr.mtimecmp = 3;
+
+    uint64_t cycles = step_and_skip();
+
+    PCUT_ASSERT_TRUE(skipped_cpu.csr.hpmcounters[0] == cycles);
+}
+
+PCUT_TEST(host_waits_without_enabled_timers)
+{
+    uint64_t wait;
+
+    PCUT_ASSERT_TRUE(rv_cpu_standby_host(&skipped_cpu, &wait));
+    PCUT_ASSERT_TRUE(wait == UINT64_MAX);
+}
+
+PCUT_TEST(virtual_timer_is_not_waited_for_by_host)
+{
+    uint64_t wait;
+
+    skipped_cpu.csr.mie = rv_csr_mti_mask;
+    skipped_cpu.csr.mtimecmp = 10;
+
+    PCUT_ASSERT_FALSE(rv_cpu_standby_host(&skipped_cpu, &wait));
+}
+
+PCUT_TEST(host_waits_for_host_timer)
+{
+    uint64_t wait;
+
+    skipped_cpu.csr.mie = rv_csr_mti_mask;
+    skipped_cpu.csr.mtime_source = rv_mtime_host;
+    skipped_cpu.csr.last_tick_time = current_timestamp();
+    skipped_cpu.csr.mtimecmp = 1000;
+
+    PCUT_ASSERT_TRUE(rv_cpu_standby_host(&skipped_cpu, &wait));
+    PCUT_ASSERT_TRUE((wait > 0) && (wait <= 1000));
+}
+
+PCUT_TEST(enabled_scyclecmp_is_not_waited_for_by_host)
+{
+    uint64_t wait;
+
+    skipped_cpu.csr.mie = rv_csr_sti_mask;
+
+    PCUT_ASSERT_FALSE(rv_cpu_standby_host(&skipped_cpu, &wait));
+}
+
+PCUT_EXPORT(standby_skip);
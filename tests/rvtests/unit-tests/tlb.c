@@ -7,7 +7,8 @@
 #include "../../../src/device/cpu/riscv_rv32ima/tlb.h"
 #include "../../../src/device/cpu/riscv_rv32ima/virt_mem.h"
 
-// Memory helpers
+// Memory helpers (checked by PMP)
+#include "../../../src/device/cpu/riscv_rv_ima/pmp.c"
 #include "../../../src/device/cpu/riscv_rv_ima/memory.c"
 
 PCUT_INIT
@@ -35,12 +36,12 @@ PCUT_TEST(simple)
     sv32_pte_t added_pte = { 0 };
     added_pte.ppn = phys >> 12;
 
-    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, false);
+    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, false, 0);
 
     sv32_pte_t pte;
     bool megapage;
 
-    bool success = rv32_tlb_get_mapping(&tlb, asid, virt, &pte, &megapage, true);
+    bool success = rv32_tlb_get_mapping(&tlb, asid, virt, &pte, &megapage, NULL, NULL, true);
 
     ptr36_t mapped_phys = success ? (ptr36_t) pte.ppn << 12 : 0xFF;
 
@@ -61,14 +62,14 @@ PCUT_TEST(get_with_offset)
     sv32_pte_t added_pte = { 0 };
     added_pte.ppn = phys >> 12;
 
-    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, false);
+    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, false, 0);
 
     uint32_t requested_virt = 0x0001;
 
     sv32_pte_t pte;
     bool megapage;
 
-    bool success = rv32_tlb_get_mapping(&tlb, asid, requested_virt, &pte, &megapage, true);
+    bool success = rv32_tlb_get_mapping(&tlb, asid, requested_virt, &pte, &megapage, NULL, NULL, true);
 
     ptr36_t mapped_phys = success ? (ptr36_t) pte.ppn << 12 : 0xFF;
 
@@ -88,14 +89,14 @@ PCUT_TEST(add_with_offset)
     sv32_pte_t added_pte = { 0 };
     added_pte.ppn = phys >> 12;
 
-    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, false);
+    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, false, 0);
 
     uint32_t requested_virt = 0x0;
 
     sv32_pte_t pte;
     bool megapage;
 
-    bool success = rv32_tlb_get_mapping(&tlb, asid, requested_virt, &pte, &megapage, true);
+    bool success = rv32_tlb_get_mapping(&tlb, asid, requested_virt, &pte, &megapage, NULL, NULL, true);
 
     ptr36_t mapped_phys = success ? (ptr36_t) pte.ppn << 12 : 0xFF;
 
@@ -115,12 +116,12 @@ PCUT_TEST(simple_megapage)
     sv32_pte_t added_pte = { 0 };
     added_pte.ppn = phys >> 12;
 
-    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, true, false);
+    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, true, false, 0);
 
     sv32_pte_t pte;
     bool megapage;
 
-    bool success = rv32_tlb_get_mapping(&tlb, asid, virt, &pte, &megapage, true);
+    bool success = rv32_tlb_get_mapping(&tlb, asid, virt, &pte, &megapage, NULL, NULL, true);
 
     ptr36_t mapped_phys = success ? (ptr36_t) pte.ppn << 12 : 0xFF;
 
@@ -139,14 +140,14 @@ PCUT_TEST(simple_megapage_non_base_page_mapping)
     sv32_pte_t added_pte = { 0 };
     added_pte.ppn = phys >> 12;
 
-    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, true, false);
+    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, true, false, 0);
 
     uint32_t requested_virt = 0x1000;
 
     sv32_pte_t pte;
     bool megapage;
 
-    bool success = rv32_tlb_get_mapping(&tlb, asid, requested_virt, &pte, &megapage, true);
+    bool success = rv32_tlb_get_mapping(&tlb, asid, requested_virt, &pte, &megapage, NULL, NULL, true);
 
     ptr36_t mapped_phys = success ? ((ptr36_t) pte.ppn) << 12 : 0xFF;
 
@@ -169,12 +170,12 @@ PCUT_TEST(simple_global)
     added_pte.ppn = phys >> 12;
     added_pte.g = true;
 
-    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, true);
+    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, true, 0);
 
     sv32_pte_t pte;
     bool megapage;
 
-    bool success = rv32_tlb_get_mapping(&tlb, different_asid, virt, &pte, &megapage, true);
+    bool success = rv32_tlb_get_mapping(&tlb, different_asid, virt, &pte, &megapage, NULL, NULL, true);
 
     ptr36_t mapped_phys = success ? (ptr36_t) pte.ppn << 12 : 0xFF;
 
@@ -193,12 +194,12 @@ PCUT_TEST(wrong_asid)
     added_pte.ppn = phys >> 12;
     added_pte.g = false;
 
-    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, false);
+    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, false, 0);
 
     sv32_pte_t pte;
     bool megapage;
 
-    bool success = rv32_tlb_get_mapping(&tlb, different_asid, virt, &pte, &megapage, true);
+    bool success = rv32_tlb_get_mapping(&tlb, different_asid, virt, &pte, &megapage, NULL, NULL, true);
 
     PCUT_ASSERT_EQUALS(false, success);
 }
@@ -214,12 +215,12 @@ PCUT_TEST(unmapped_addr)
     sv32_pte_t added_pte = { 0 };
     added_pte.ppn = phys >> 12;
 
-    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, false);
+    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, false, 0);
 
     sv32_pte_t pte;
     bool megapage;
 
-    bool success = rv32_tlb_get_mapping(&tlb, asid, different_virt, &pte, &megapage, true);
+    bool success = rv32_tlb_get_mapping(&tlb, asid, different_virt, &pte, &megapage, NULL, NULL, true);
 
     PCUT_ASSERT_EQUALS(false, success);
 }
@@ -233,14 +234,14 @@ PCUT_TEST(flush_all)
     sv32_pte_t added_pte = { 0 };
     added_pte.ppn = phys >> 12;
 
-    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, false);
+    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, false, 0);
 
     rv32_tlb_flush(&tlb);
 
     sv32_pte_t pte;
     bool megapage;
 
-    bool success = rv32_tlb_get_mapping(&tlb, asid, virt, &pte, &megapage, true);
+    bool success = rv32_tlb_get_mapping(&tlb, asid, virt, &pte, &megapage, NULL, NULL, true);
 
     PCUT_ASSERT_EQUALS(false, success);
 }
@@ -254,14 +255,14 @@ PCUT_TEST(flush_all_global)
     sv32_pte_t added_pte = { 0 };
     added_pte.ppn = phys >> 12;
 
-    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, true);
+    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, true, 0);
 
     rv32_tlb_flush(&tlb);
 
     sv32_pte_t pte;
     bool megapage;
 
-    bool success = rv32_tlb_get_mapping(&tlb, asid, virt, &pte, &megapage, true);
+    bool success = rv32_tlb_get_mapping(&tlb, asid, virt, &pte, &megapage, NULL, NULL, true);
 
     PCUT_ASSERT_EQUALS(false, success);
 }
@@ -278,16 +279,16 @@ PCUT_TEST(flush_by_asid)
     added_pte.ppn = phys >> 12;
     added_pte.g = false;
 
-    rv32_tlb_add_mapping(&tlb, asid1, virt1, added_pte, false, false);
-    rv32_tlb_add_mapping(&tlb, asid2, virt2, added_pte, false, false);
+    rv32_tlb_add_mapping(&tlb, asid1, virt1, added_pte, false, false, 0);
+    rv32_tlb_add_mapping(&tlb, asid2, virt2, added_pte, false, false, 0);
 
     rv32_tlb_flush_by_asid(&tlb, asid1);
 
     sv32_pte_t pte;
     bool megapage;
 
-    bool success1 = rv32_tlb_get_mapping(&tlb, asid1, virt1, &pte, &megapage, true);
-    bool success2 = rv32_tlb_get_mapping(&tlb, asid2, virt2, &pte, &megapage, true);
+    bool success1 = rv32_tlb_get_mapping(&tlb, asid1, virt1, &pte, &megapage, NULL, NULL, true);
+    bool success2 = rv32_tlb_get_mapping(&tlb, asid2, virt2, &pte, &megapage, NULL, NULL, true);
 
     PCUT_ASSERT_EQUALS(false, success1);
     PCUT_ASSERT_EQUALS(true, success2);
@@ -303,16 +304,16 @@ PCUT_TEST(flush_by_addr)
     sv32_pte_t added_pte = { 0 };
     added_pte.ppn = phys >> 12;
 
-    rv32_tlb_add_mapping(&tlb, asid, virt1, added_pte, false, false);
-    rv32_tlb_add_mapping(&tlb, asid, virt2, added_pte, false, false);
+    rv32_tlb_add_mapping(&tlb, asid, virt1, added_pte, false, false, 0);
+    rv32_tlb_add_mapping(&tlb, asid, virt2, added_pte, false, false, 0);
 
     rv32_tlb_flush_by_addr(&tlb, virt1);
 
     sv32_pte_t pte;
     bool megapage;
 
-    bool success1 = rv32_tlb_get_mapping(&tlb, asid, virt1, &pte, &megapage, true);
-    bool success2 = rv32_tlb_get_mapping(&tlb, asid, virt2, &pte, &megapage, true);
+    bool success1 = rv32_tlb_get_mapping(&tlb, asid, virt1, &pte, &megapage, NULL, NULL, true);
+    bool success2 = rv32_tlb_get_mapping(&tlb, asid, virt2, &pte, &megapage, NULL, NULL, true);
 
     PCUT_ASSERT_EQUALS(false, success1);
     PCUT_ASSERT_EQUALS(true, success2);
@@ -331,18 +332,18 @@ PCUT_TEST(flush_by_asid_and_addr)
     added_pte.ppn = phys >> 12;
     added_pte.g = false;
 
-    rv32_tlb_add_mapping(&tlb, asid1, virt1, added_pte, false, false);
-    rv32_tlb_add_mapping(&tlb, asid1, virt2, added_pte, false, false);
-    rv32_tlb_add_mapping(&tlb, asid2, virt3, added_pte, false, false);
+    rv32_tlb_add_mapping(&tlb, asid1, virt1, added_pte, false, false, 0);
+    rv32_tlb_add_mapping(&tlb, asid1, virt2, added_pte, false, false, 0);
+    rv32_tlb_add_mapping(&tlb, asid2, virt3, added_pte, false, false, 0);
 
     rv32_tlb_flush_by_asid_and_addr(&tlb, asid1, virt1);
 
     sv32_pte_t pte;
     bool megapage;
 
-    bool success1 = rv32_tlb_get_mapping(&tlb, asid1, virt1, &pte, &megapage, true);
-    bool success2 = rv32_tlb_get_mapping(&tlb, asid1, virt2, &pte, &megapage, true);
-    bool success3 = rv32_tlb_get_mapping(&tlb, asid2, virt3, &pte, &megapage, true);
+    bool success1 = rv32_tlb_get_mapping(&tlb, asid1, virt1, &pte, &megapage, NULL, NULL, true);
+    bool success2 = rv32_tlb_get_mapping(&tlb, asid1, virt2, &pte, &megapage, NULL, NULL, true);
+    bool success3 = rv32_tlb_get_mapping(&tlb, asid2, virt3, &pte, &megapage, NULL, NULL, true);
 
     PCUT_ASSERT_EQUALS(false, success1);
     PCUT_ASSERT_EQUALS(true, success2);
@@ -359,14 +360,14 @@ PCUT_TEST(flush_by_asid_ignores_global)
     added_pte.ppn = phys >> 12;
     added_pte.g = true;
 
-    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, true);
+    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, true, 0);
 
     rv32_tlb_flush_by_asid(&tlb, asid);
 
     sv32_pte_t pte;
     bool megapage;
 
-    bool success = rv32_tlb_get_mapping(&tlb, asid, virt, &pte, &megapage, true);
+    bool success = rv32_tlb_get_mapping(&tlb, asid, virt, &pte, &megapage, NULL, NULL, true);
 
     PCUT_ASSERT_EQUALS(true, success);
 }
@@ -381,16 +382,246 @@ PCUT_TEST(flush_by_asid_and_addr_ignores_global)
     added_pte.ppn = phys >> 12;
     added_pte.g = true;
 
-    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, true);
+    rv32_tlb_add_mapping(&tlb, asid, virt, added_pte, false, true, 0);
 
     rv32_tlb_flush_by_asid_and_addr(&tlb, asid, virt);
 
     sv32_pte_t pte;
     bool megapage;
 
-    bool success = rv32_tlb_get_mapping(&tlb, asid, virt, &pte, &megapage, true);
+    bool success = rv32_tlb_get_mapping(&tlb, asid, virt, &pte, &megapage, NULL, NULL, true);
 
     PCUT_ASSERT_EQUALS(true, success);
 }
 
+PCUT_TEST(all_entries_usable)
+{
+    unsigned asid = 1;
+
+    for (uint32_t i = 0; i < tlb.size; ++i) {
+        sv32_pte_t added_pte = { 0 };
+        added_pte.ppn = i + 0x100;
+        rv32_tlb_add_mapping(&tlb, asid, i << 12, added_pte, false, false, 0);
+    }
+
+    for (uint32_t i = 0; i < tlb.size; ++i) {
+        sv32_pte_t pte;
+        bool megapage;
+
+        bool success = rv32_tlb_get_mapping(&tlb, asid, i << 12, &pte, &megapage, NULL, NULL, true);
+
+        PCUT_ASSERT_EQUALS(true, success);
+        PCUT_ASSERT_INT_EQUALS(i + 0x100, pte.ppn);
+    }
+}
+
+PCUT_TEST(megapage_and_page_coexist)
+{
+    unsigned asid = 1;
+
+    sv32_pte_t mega_pte = { 0 };
+    mega_pte.ppn = 0x400;
+    rv32_tlb_add_mapping(&tlb, asid, 0x00400000, mega_pte, true, false, 0);
+
+    sv32_pte_t page_pte = { 0 };
+    page_pte.ppn = 0x123;
+    rv32_tlb_add_mapping(&tlb, asid, 0x00001000, page_pte, false, false, 0);
+
+    sv32_pte_t pte;
+    bool megapage;
+
+    PCUT_ASSERT_EQUALS(true, rv32_tlb_get_mapping(&tlb, asid, 0x00401000, &pte, &megapage, NULL, NULL, true));
+    PCUT_ASSERT_EQUALS(true, megapage);
+    PCUT_ASSERT_INT_EQUALS(0x400, pte.ppn);
+
+    PCUT_ASSERT_EQUALS(true, rv32_tlb_get_mapping(&tlb, asid, 0x00001004, &pte, &megapage, NULL, NULL, true));
+    PCUT_ASSERT_EQUALS(false, megapage);
+    PCUT_ASSERT_INT_EQUALS(0x123, pte.ppn);
+}
+
+PCUT_TEST(statistics_count_noisy_lookups)
+{
+    sv32_pte_t added_pte = { 0 };
+    added_pte.ppn = 0x123;
+
+    rv32_tlb_add_mapping(&tlb, 1, 0x1000, added_pte, false, false, 0);
+
+    sv32_pte_t pte;
+    bool megapage;
+
+    PCUT_ASSERT_TRUE(rv32_tlb_get_mapping(&tlb, 1, 0x1000, &pte, &megapage, NULL, NULL, true));
+    PCUT_ASSERT_FALSE(rv32_tlb_get_mapping(&tlb, 1, 0x2000, &pte, &megapage, NULL, NULL, true));
+
+    // The debugger lookups are not counted
+    PCUT_ASSERT_TRUE(rv32_tlb_get_mapping(&tlb, 1, 0x1000, &pte, &megapage, NULL, NULL, false));
+    PCUT_ASSERT_FALSE(rv32_tlb_get_mapping(&tlb, 1, 0x2000, &pte, &megapage, NULL, NULL, false));
+
+    PCUT_ASSERT_INT_EQUALS(1, tlb.hits);
+    PCUT_ASSERT_INT_EQUALS(1, tlb.misses);
+    PCUT_ASSERT_INT_EQUALS(0, tlb.evictions);
+}
+
+PCUT_TEST(statistics_count_flushes_by_kind)
+{
+    rv32_tlb_flush(&tlb);
+    rv32_tlb_flush_by_asid(&tlb, 1);
+    rv32_tlb_flush_by_asid(&tlb, 2);
+    rv32_tlb_flush_by_addr(&tlb, 0x1000);
+    rv32_tlb_flush_by_asid_and_addr(&tlb, 1, 0x1000);
+
+    PCUT_ASSERT_INT_EQUALS(1, tlb.flushes);
+    PCUT_ASSERT_INT_EQUALS(2, tlb.asid_flushes);
+    PCUT_ASSERT_INT_EQUALS(1, tlb.addr_flushes);
+    PCUT_ASSERT_INT_EQUALS(1, tlb.asid_addr_flushes);
+
+    // Resizing restarts the statistics
+    rv32_tlb_resize(&tlb, DEFAULT_RV_TLB_SIZE);
+
+    PCUT_ASSERT_INT_EQUALS(0, tlb.flushes);
+    PCUT_ASSERT_INT_EQUALS(0, tlb.asid_flushes);
+}
+
+PCUT_TEST(statistics_count_evictions_of_valid_entries)
+{
+    // A single set of a single entry
+    rv32_tlb_resize(&tlb, 1);
+
+    sv32_pte_t added_pte = { 0 };
+
+    rv32_tlb_add_mapping(&tlb, 1, 0x1000, added_pte, false, false, 0);
+    PCUT_ASSERT_INT_EQUALS(0, tlb.evictions);
+
+    rv32_tlb_add_mapping(&tlb, 1, 0x2000, added_pte, false, false, 0);
+    PCUT_ASSERT_INT_EQUALS(1, tlb.evictions);
+
+    rv32_tlb_flush(&tlb);
+    rv32_tlb_add_mapping(&tlb, 1, 0x3000, added_pte, false, false, 0);
+    PCUT_ASSERT_INT_EQUALS(1, tlb.evictions);
+}
+
+PCUT_TEST(allowed_accesses_follow_the_context)
+{
+    sv32_pte_t added_pte = { 0 };
+    added_pte.v = 1;
+    added_pte.r = 1;
+    added_pte.w = 1;
+    added_pte.x = 1;
+    added_pte.u = 1;
+    added_pte.a = 1;
+
+    rv32_tlb_set_context(&tlb, true, false, false);
+    rv32_tlb_add_mapping(&tlb, 1, 0x1000, added_pte, false, false, 0);
+
+    sv32_pte_t pte;
+    bool megapage;
+    unsigned allowed;
+
+    // Writes need the D bit set first
+    PCUT_ASSERT_TRUE(rv32_tlb_get_mapping(&tlb, 1, 0x1000, &pte, &megapage, NULL, &allowed, true));
+    PCUT_ASSERT_INT_EQUALS(RV_TLB_ALLOW_READ | RV_TLB_ALLOW_EXEC, allowed);
+
+    // User pages are not accessible from S-mode without SUM
+    rv32_tlb_set_context(&tlb, false, false, false);
+    PCUT_ASSERT_TRUE(rv32_tlb_get_mapping(&tlb, 1, 0x1000, &pte, &megapage, NULL, &allowed, true));
+    PCUT_ASSERT_INT_EQUALS(0, allowed);
+
+    // and never executable
+    rv32_tlb_set_context(&tlb, false, true, false);
+    PCUT_ASSERT_TRUE(rv32_tlb_get_mapping(&tlb, 1, 0x1000, &pte, &megapage, NULL, &allowed, true));
+    PCUT_ASSERT_INT_EQUALS(RV_TLB_ALLOW_READ, allowed);
+
+    // Unchanged context keeps the generation
+    uint32_t generation = tlb.generation;
+    rv32_tlb_set_context(&tlb, false, true, false);
+    PCUT_ASSERT_INT_EQUALS(generation, tlb.generation);
+}
+
+PCUT_TEST(allowed_reads_of_executable_pages_need_mxr)
+{
+    sv32_pte_t added_pte = { 0 };
+    added_pte.v = 1;
+    added_pte.x = 1;
+    added_pte.a = 1;
+
+    rv32_tlb_set_context(&tlb, false, false, false);
+    rv32_tlb_add_mapping(&tlb, 1, 0x1000, added_pte, false, false, 0);
+
+    sv32_pte_t pte;
+    bool megapage;
+    unsigned allowed;
+
+    PCUT_ASSERT_TRUE(rv32_tlb_get_mapping(&tlb, 1, 0x1000, &pte, &megapage, NULL, &allowed, true));
+    PCUT_ASSERT_INT_EQUALS(RV_TLB_ALLOW_EXEC, allowed);
+
+    rv32_tlb_set_context(&tlb, false, false, true);
+    PCUT_ASSERT_TRUE(rv32_tlb_get_mapping(&tlb, 1, 0x1000, &pte, &megapage, NULL, &allowed, true));
+    PCUT_ASSERT_INT_EQUALS(RV_TLB_ALLOW_READ | RV_TLB_ALLOW_EXEC, allowed);
+}
+
+PCUT_TEST(updated_mapping_keeps_its_pte_address)
+{
+    sv32_pte_t added_pte = { 0 };
+    added_pte.v = 1;
+    added_pte.r = 1;
+    added_pte.w = 1;
+    added_pte.a = 1;
+
+    rv32_tlb_set_context(&tlb, false, false, false);
+    rv32_tlb_add_mapping(&tlb, 1, 0x1000, added_pte, false, false, 0x2004);
+
+    sv32_pte_t pte;
+    bool megapage;
+    ptr36_t pte_addr;
+    unsigned allowed;
+
+    PCUT_ASSERT_TRUE(rv32_tlb_get_mapping(&tlb, 1, 0x1000, &pte, &megapage, &pte_addr, &allowed, true));
+    PCUT_ASSERT_INT_EQUALS(0x2004, pte_addr);
+    PCUT_ASSERT_INT_EQUALS(RV_TLB_ALLOW_READ, allowed);
+
+    // Setting the D bit allows the writes
+    added_pte.d = 1;
+    rv32_tlb_update_mapping(&tlb, 1, 0x1000, added_pte);
+
+    PCUT_ASSERT_TRUE(rv32_tlb_get_mapping(&tlb, 1, 0x1000, &pte, &megapage, &pte_addr, &allowed, true));
+    PCUT_ASSERT_INT_EQUALS(1, pte.d);
+    PCUT_ASSERT_INT_EQUALS(0x2004, pte_addr);
+    PCUT_ASSERT_INT_EQUALS(RV_TLB_ALLOW_READ | RV_TLB_ALLOW_WRITE, allowed);
+}
+
+PCUT_TEST(flushed_entries_are_reused)
+{
+    // A single set of a single entry
+    rv32_tlb_resize(&tlb, 1);
+
+    sv32_pte_t added_pte = { 0 };
+    sv32_pte_t pte;
+    bool megapage;
+
+    rv32_tlb_add_mapping(&tlb, 1, 0x1000, added_pte, false, false, 0);
+    rv32_tlb_flush_by_asid(&tlb, 1);
+    PCUT_ASSERT_FALSE(rv32_tlb_get_mapping(&tlb, 1, 0x1000, &pte, &megapage, NULL, NULL, true));
+
+    // The flushed entry is taken without an eviction
+    rv32_tlb_add_mapping(&tlb, 2, 0x2000, added_pte, false, false, 0);
+    PCUT_ASSERT_INT_EQUALS(0, tlb.evictions);
+    PCUT_ASSERT_TRUE(rv32_tlb_get_mapping(&tlb, 2, 0x2000, &pte, &megapage, NULL, NULL, true));
+}
+
+PCUT_TEST(wrapped_flush_generation_keeps_entries_flushed)
+{
+    sv32_pte_t added_pte = { 0 };
+    sv32_pte_t pte;
+    bool megapage;
+
+    rv32_tlb_add_mapping(&tlb, 1, 0x1000, added_pte, false, false, 0);
+    tlb.epoch = UINT32_MAX;
+    rv32_tlb_add_mapping(&tlb, 1, 0x2000, added_pte, false, false, 0);
+
+    rv32_tlb_flush(&tlb);
+
+    PCUT_ASSERT_INT_EQUALS(0, tlb.epoch);
+    PCUT_ASSERT_FALSE(rv32_tlb_get_mapping(&tlb, 1, 0x1000, &pte, &megapage, NULL, NULL, true));
+    PCUT_ASSERT_FALSE(rv32_tlb_get_mapping(&tlb, 1, 0x2000, &pte, &megapage, NULL, NULL, true));
+}
+
 PCUT_EXPORT(tlb);
@@ -0,0 +1,146 @@
+#include <stdint.h>
+#include <pcut/pcut.h>
+
+#include "common.h"
+
+PCUT_INIT
+
+PCUT_TEST_SUITE(trap_fast_path);
+
+#define TEST_MTVEC 0x1000
+#define TEST_STVEC 0x2000
+
+static rv_cpu_t cpu0;
+
+/** Write, set or clear a CSR in M mode */
+static void csr_instr(int funct3, csr_num_t csr, uxlen_t value)
+{
+    rv_instr_t instr = { .i = {
+                                 .opcode = rv_opcSYSTEM,
+                                 .funct3 = funct3,
+                                 .imm = csr,
+                                 .rs1 = 1,
+                                 .rd = 0 } };
+
+    rv_priv_mode_t priv_mode = cpu0.priv_mode;
+    cpu0.priv_mode = rv_mmode;
+    cpu0.regs[1] = value;
+
+    switch (funct3) {
+    case rv_funcCSRRW:
+        PCUT_ASSERT_INT_EQUALS(rv_exc_none, rv_csrrw_instr(&cpu0, instr));
+        break;
+    case rv_funcCSRRS:
+        PCUT_ASSERT_INT_EQUALS(rv_exc_none, rv_csrrs_instr(&cpu0, instr));
+        break;
+    default:
+        PCUT_ASSERT_INT_EQUALS(rv_exc_none, rv_csrrc_instr(&cpu0, instr));
+        break;
+    }
+
+    cpu0.priv_mode = priv_mode;
+}
+
+/** The standing by processor does not fetch, so no memory is needed */
+PCUT_TEST_BEFORE
+{
+    rv_cpu_init(&cpu0, 0);
+    cpu0.priv_mode = rv_mmode;
+    cpu0.stdby = true;
+    cpu0.csr.mtimecmp = UINT64_MAX;
+    cpu0.csr.scyclecmp = (uxlen_t) -1;
+    cpu0.csr.mtvec = TEST_MTVEC;
+    cpu0.csr.stvec = TEST_STVEC;
+}
+
+PCUT_TEST(disabled_interrupt_is_not_summarized)
+{
+    rv_interrupt_up(&cpu0, RV_INTERRUPT_NO(rv_exc_machine_software_interrupt));
+    PCUT_ASSERT_FALSE(cpu0.csr.interrupts_pending);
+
+    csr_instr(rv_funcCSRRS, csr_mie, rv_csr_msi_mask);
+    PCUT_ASSERT_TRUE(cpu0.csr.interrupts_pending);
+
+    csr_instr(rv_funcCSRRC, csr_mie, rv_csr_msi_mask);
+    PCUT_ASSERT_FALSE(cpu0.csr.interrupts_pending);
+}
+
+PCUT_TEST(cleared_interrupt_is_not_summarized)
+{
+    csr_instr(rv_funcCSRRW, csr_mie, rv_csr_sei_mask);
+
+    rv_interrupt_up(&cpu0, RV_INTERRUPT_NO(rv_exc_supervisor_external_interrupt));
+    PCUT_ASSERT_TRUE(cpu0.csr.interrupts_pending);
+
+    rv_interrupt_down(&cpu0, RV_INTERRUPT_NO(rv_exc_supervisor_external_interrupt));
+    PCUT_ASSERT_FALSE(cpu0.csr.interrupts_pending);
+}
+
+PCUT_TEST(timers_update_the_summary)
+{
+    csr_instr(rv_funcCSRRW, csr_mie, rv_csr_sti_mask | rv_csr_mti_mask);
+    cpu0.csr.scyclecmp = 5;
+
+    for (int i = 0; i < 4; i++) {
+        rv_cpu_step(&cpu0);
+    }
+
+    PCUT_ASSERT_FALSE(cpu0.csr.interrupts_pending);
+
+    rv_cpu_step(&cpu0);
+    PCUT_ASSERT_TRUE(cpu0.csr.interrupts_pending);
+
+    // Still pending with MIE clear in M mode
+    PCUT_ASSERT_TRUE(cpu0.stdby);
+
+    csr_instr(rv_funcCSRRW, csr_scyclecmp, (uxlen_t) -1);
+    PCUT_ASSERT_FALSE(cpu0.csr.interrupts_pending);
+
+    // MTIP follows the write of mtimecmp
+    rv_set_mtimecmp(&cpu0, 0);
+    PCUT_ASSERT_TRUE(cpu0.csr.interrupts_pending);
+
+    rv_cpu_step(&cpu0);
+    PCUT_ASSERT_TRUE(cpu0.csr.interrupts_pending);
+}
+
+PCUT_TEST(m_trap_saves_the_status)
+{
+    cpu0.csr.mstatus |= rv_csr_mstatus_mie_mask;
+    csr_instr(rv_funcCSRRW, csr_mie, rv_csr_msi_mask);
+    rv_interrupt_up(&cpu0, RV_INTERRUPT_NO(rv_exc_machine_software_interrupt));
+
+    rv_cpu_step(&cpu0);
+
+    PCUT_ASSERT_FALSE(cpu0.stdby);
+    PCUT_ASSERT_TRUE(cpu0.csr.mcause == rv_exc_machine_software_interrupt);
+    PCUT_ASSERT_INT_EQUALS(TEST_MTVEC, cpu0.pc);
+    PCUT_ASSERT_FALSE(rv_csr_mstatus_mie(&cpu0));
+    PCUT_ASSERT_TRUE(rv_csr_mstatus_mpie(&cpu0));
+    PCUT_ASSERT_INT_EQUALS(rv_mmode, rv_csr_mstatus_mpp(&cpu0));
+}
+
+PCUT_TEST(delegated_interrupt_traps_to_s_mode)
+{
+    csr_instr(rv_funcCSRRW, csr_mideleg, rv_csr_ssi_mask);
+    csr_instr(rv_funcCSRRW, csr_mie, rv_csr_ssi_mask);
+    csr_instr(rv_funcCSRRS, csr_sip, rv_csr_ssi_mask);
+    PCUT_ASSERT_TRUE(cpu0.csr.interrupts_pending);
+
+    cpu0.csr.mstatus |= rv_csr_sstatus_sie_mask | rv_csr_mstatus_mpp_mask;
+    cpu0.priv_mode = rv_umode;
+
+    rv_cpu_step(&cpu0);
+
+    PCUT_ASSERT_INT_EQUALS(rv_smode, cpu0.priv_mode);
+    PCUT_ASSERT_TRUE(cpu0.csr.scause == rv_exc_supervisor_software_interrupt);
+    PCUT_ASSERT_INT_EQUALS(TEST_STVEC, cpu0.pc);
+    PCUT_ASSERT_FALSE(rv_csr_sstatus_sie(&cpu0));
+    PCUT_ASSERT_TRUE(rv_csr_sstatus_spie(&cpu0));
+    PCUT_ASSERT_INT_EQUALS(rv_umode, rv_csr_sstatus_spp(&cpu0));
+
+    // The M mode bits are kept
+    PCUT_ASSERT_INT_EQUALS(rv_mmode, rv_csr_mstatus_mpp(&cpu0));
+}
+
+PCUT_EXPORT(trap_fast_path);
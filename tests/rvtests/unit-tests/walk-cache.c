@@ -0,0 +1,197 @@
+#include <stdint.h>
+#include <string.h>
+#include <pcut/pcut.h>
+
+#include "common.h"
+
+#include "../../../src/physmem.h"
+
+PCUT_INIT
+
+PCUT_TEST_SUITE(walk_cache);
+
+/** Page tables and the mapped pages, one frame each */
+#define TABLES_ADDR UINT64_C(0x10000)
+#define TABLES_FRAMES 8
+
+#define TABLE_ADDR(n) (TABLES_ADDR + (n) * FRAME_SIZE)
+#define PAGE_ADDR(n) (TABLES_ADDR + (4 + (n)) * FRAME_SIZE)
+
+#define PTE_NONLEAF(addr) ((((addr) >> 12) << 10) | 0x01)
+#define PTE_LEAF(addr) ((((addr) >> 12) << 10) | 0xCF)
+
+#if ARCH == 32
+#define write_pte(addr, val) physmem_write32(0, (addr), (val), false)
+#define PTE_SIZE 4
+#define LEAF_LEVEL 1
+/** Address translated through the first entries of both tables */
+#define TEST_VIRT UINT32_C(0x00400000)
+#else
+#define write_pte(addr, val) physmem_write64(0, (addr), (val), false)
+#define PTE_SIZE 8
+#define LEAF_LEVEL 2
+#define TEST_VIRT UINT64_C(0x40000000)
+#endif
+
+static uint8_t test_data[TABLES_FRAMES * FRAME_SIZE];
+static physmem_area_t test_area;
+
+static rv_cpu_t cpu0;
+
+/** Maps TEST_VIRT + n * page onto PAGE_ADDR(n) for the first three pages */
+PCUT_TEST_BEFORE
+{
+    memset(test_data, 0, sizeof(test_data));
+
+    test_area.type = MEMT_MEM;
+    test_area.writable = true;
+    test_area.start = ADDR2FRAME(TABLES_ADDR);
+    test_area.count = TABLES_FRAMES;
+    test_area.data = test_data;
+
+    physmem_wire(&test_area);
+
+    // The test address uses the entry 1 of the root table and 0 below it
+    write_pte(TABLE_ADDR(0) + PTE_SIZE, PTE_NONLEAF(TABLE_ADDR(1)));
+#if ARCH == 64
+    write_pte(TABLE_ADDR(1), PTE_NONLEAF(TABLE_ADDR(2)));
+#endif
+
+    for (int i = 0; i < 3; i++) {
+        write_pte(TABLE_ADDR(LEAF_LEVEL) + i * PTE_SIZE, PTE_LEAF(PAGE_ADDR(i)));
+    }
+
+    rv_cpu_init(&cpu0, 0);
+    cpu0.priv_mode = rv_smode;
+    cpu0.csr.satp = rv_csr_satp_mode_mask | (TABLE_ADDR(0) >> 12);
+}
+
+PCUT_TEST_AFTER
+{
+    physmem_unwire(&test_area);
+}
+
+static rv_exc_t translate(int page, ptr36_t *phys)
+{
+    return rv_convert_addr(&cpu0, TEST_VIRT + page * FRAME_SIZE, phys, false, false, true);
+}
+
+static void sfence(xlen_t virt)
+{
+    rv_instr_t instr = { .r = {
+                                 .opcode = rv_opcSYSTEM,
+                                 .rs1 = (virt != 0) ? 1 : 0,
+                                 .rs2 = 0 } };
+
+    cpu0.regs[1] = virt;
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, rv_sfence_instr(&cpu0, instr));
+}
+
+PCUT_TEST(refill_reads_only_the_leaf)
+{
+    ptr36_t phys;
+
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, translate(0, &phys));
+    PCUT_ASSERT_INT_EQUALS(PAGE_ADDR(0), phys);
+
+    // Without SFENCE.VMA the upper levels are not read again
+    write_pte(TABLE_ADDR(0) + PTE_SIZE, 0);
+
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, translate(1, &phys));
+    PCUT_ASSERT_INT_EQUALS(PAGE_ADDR(1), phys);
+}
+
+PCUT_TEST(sfence_flushes_the_cached_ptes)
+{
+    ptr36_t phys;
+
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, translate(0, &phys));
+    write_pte(TABLE_ADDR(0) + PTE_SIZE, 0);
+
+    sfence(0);
+
+    PCUT_ASSERT_INT_EQUALS(rv_exc_load_page_fault, translate(1, &phys));
+}
+
+PCUT_TEST(sfence_by_address_flushes_the_cached_ptes)
+{
+    ptr36_t phys;
+
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, translate(0, &phys));
+    write_pte(TABLE_ADDR(0) + PTE_SIZE, 0);
+
+    sfence(TEST_VIRT + 2 * FRAME_SIZE);
+
+    PCUT_ASSERT_INT_EQUALS(rv_exc_load_page_fault, translate(1, &phys));
+}
+
+PCUT_TEST(satp_write_flushes_the_cached_ptes)
+{
+    ptr36_t phys;
+
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, translate(0, &phys));
+    write_pte(TABLE_ADDR(0) + PTE_SIZE, 0);
+
+    rv_instr_t instr = { .i = {
+                                 .opcode = rv_opcSYSTEM,
+                                 .funct3 = rv_funcCSRRW,
+                                 .imm = csr_satp,
+                                 .rs1 = 1,
+                                 .rd = 0 } };
+
+    cpu0.regs[1] = cpu0.csr.satp;
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, rv_csrrw_instr(&cpu0, instr));
+
+    PCUT_ASSERT_INT_EQUALS(rv_exc_load_page_fault, translate(1, &phys));
+}
+
+PCUT_TEST(debugger_walk_does_not_fill_the_cache)
+{
+    ptr36_t phys;
+
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, rv_convert_addr(&cpu0, TEST_VIRT, &phys, false, false, false));
+    write_pte(TABLE_ADDR(0) + PTE_SIZE, 0);
+
+    PCUT_ASSERT_INT_EQUALS(rv_exc_load_page_fault, translate(1, &phys));
+}
+
+PCUT_TEST(walks_are_counted)
+{
+    ptr36_t phys;
+
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, translate(0, &phys));
+    PCUT_ASSERT_INT_EQUALS(1, cpu0.walks);
+    PCUT_ASSERT_INT_EQUALS(LEAF_LEVEL + 1, cpu0.walk_reads);
+    PCUT_ASSERT_INT_EQUALS(0, cpu0.walk_cache_hits);
+
+    // Only the leaf PTE is read again
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, translate(1, &phys));
+    PCUT_ASSERT_INT_EQUALS(2, cpu0.walks);
+    PCUT_ASSERT_INT_EQUALS(LEAF_LEVEL + 2, cpu0.walk_reads);
+    PCUT_ASSERT_INT_EQUALS(1, cpu0.walk_cache_hits);
+
+    // The leaf PTEs have the A and D bits set
+    PCUT_ASSERT_INT_EQUALS(0, cpu0.ad_updates);
+
+    // The debugger walks are not counted
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, rv_convert_addr(&cpu0, TEST_VIRT + 2 * FRAME_SIZE, &phys, false, false, false));
+    PCUT_ASSERT_INT_EQUALS(2, cpu0.walks);
+}
+
+PCUT_TEST(accessed_bit_update_is_counted)
+{
+    ptr36_t phys;
+
+    // Valid, readable, writable and executable, but not accessed
+    write_pte(TABLE_ADDR(LEAF_LEVEL) + 2 * PTE_SIZE, (PAGE_ADDR(2) >> 12) << 10 | 0x0F);
+
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, translate(2, &phys));
+    PCUT_ASSERT_INT_EQUALS(1, cpu0.ad_updates);
+
+    // The refilled TLB entry has the bit set
+    PCUT_ASSERT_INT_EQUALS(rv_exc_none, translate(2, &phys));
+    PCUT_ASSERT_INT_EQUALS(1, cpu0.ad_updates);
+    PCUT_ASSERT_INT_EQUALS(1, cpu0.walks);
+}
+
+PCUT_EXPORT(walk_cache);
@@ -97,3 +97,2169 @@ load "common"
     exit_success=false \
     msim_command_check
 }
+
+@test "Configure RISC-V decoded instruction cache" {
+    config="
+        add drvcpu riscv
+        riscv icache 16 fifo
+        riscv icache
+    " \
+    expected="
+        Decode cache: 0 of 16 pages, fifo replacement
+    " \
+    msim_command_check
+}
+
+@test "Configure RISC-V block execution" {
+    config="
+        add drvcpu riscv
+        riscv block
+        riscv block 64
+        riscv block
+    " \
+    expected="
+        Block execution: disabled
+        Block execution: up to 64 instructions
+    " \
+    msim_command_check
+}
+
+@test "Configure RISC-V block translation" {
+    config="
+        add drvcpu riscv
+        riscv jit
+        riscv jit 8
+        riscv jit
+    " \
+    expected="
+        Block translation: disabled
+        Block translation: after 8 executions
+    " \
+    msim_command_check
+}
+
+@test "Configure R4000 decoded instruction cache" {
+    config="
+        add dr4kcpu mips
+        mips icache 8
+        mips icache
+    " \
+    expected="
+        Decode cache: 0 of 8 pages, lru replacement
+    " \
+    msim_command_check
+}
+
+@test "Cached disassembly follows the register names" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+dumpins r4k 0x1FC00004 1
+set r4k_ireg = 0
+dumpins r4k 0x1FC00004 1
+quit
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+
+    echo "$output" | grep -q '^  0x01fc00004    lui a0, 0x9000 *$'
+    echo "$output" | grep -q '^  0x01fc00004    lui r4, 0x9000 *$'
+}
+
+@test "Configure R4000 block execution" {
+    config="
+        add dr4kcpu mips
+        mips block 128
+        mips block
+    " \
+    expected="
+        Block execution: up to 128 instructions
+    " \
+    msim_command_check
+}
+
+@test "Configure R4000 block translation" {
+    config="
+        add dr4kcpu mips
+        mips jit 4
+        mips jit
+    " \
+    expected="
+        Block translation: after 4 executions
+    " \
+    msim_command_check
+}
+
+@test "Configure R4000 TLB size" {
+    config="
+        add dr4kcpu mips0
+        mips0 info
+        add dr4kcpu mips1 256
+        mips1 info
+    " \
+    expected="
+        R4000
+        R4000 with 256 TLB entries (not architectural)
+    " \
+    msim_command_check
+}
+
+@test "Configure R4000 victim TLB" {
+    config="
+        add dr4kcpu mips
+        mips victim
+        mips victim 64
+        mips victim
+    " \
+    expected="
+        Victim TLB: disabled
+        Victim TLB: 64 entries (not architectural)
+    " \
+    msim_command_check
+}
+
+@test "Configure R4000 pipeline timing" {
+    config="
+        add dr4kcpu mips
+        mips timing
+        mips timing on
+        mips timing
+    " \
+    expected="
+        Pipeline timing: disabled
+        Pipeline timing: enabled
+    " \
+    msim_command_check
+}
+
+@test "Configure RISC-V mtime source" {
+    config="
+        add drvcpu riscv
+        riscv mtime
+        riscv mtime virtual 500
+        riscv mtime
+    " \
+    expected="
+        mtime: host clock, sampled every 1024 cycles
+        mtime: virtual clock, one tick per 500 cycles
+    " \
+    msim_command_check
+}
+
+@test "Configure RISC-V physical memory protection" {
+    config="
+        add drvcpu riscv
+        riscv pmp
+        riscv pmp 16
+        riscv pmp
+    " \
+    expected="
+        PMP: 0 entries (disabled)
+        PMP: 16 entries
+    " \
+    msim_command_check
+}
+
+@test "Copy-on-write file mapping leaves the image intact" {
+    head -c 8192 /dev/zero >"$MSIM_TEST_TMPDIR/image.bin"
+
+    config="
+        add rwm ram 0x1000
+        ram fmap \"image.bin\" cow
+        ram fill \"A\"
+        ram save \"copy.bin\"
+        add ddisk disk 0x10000000 2
+        disk fmap \"image.bin\" cow
+        disk fill 66
+    " \
+    expected="" \
+    msim_command_check
+
+    cmp "$MSIM_TEST_TMPDIR/image.bin" <(head -c 8192 /dev/zero)
+    cmp "$MSIM_TEST_TMPDIR/copy.bin" <(head -c 8192 /dev/zero | tr '\0' 'A')
+}
+
+@test "Shared memory is exported and removed with the machine" {
+    name="msim-bats-$$"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<EOF2
+add rwm ram 0x1000
+ram shared "/$name" 8K
+ram fill "A"
+ram info
+quit
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+    echo "$output" | grep -q "^Shared memory object /$name\$"
+
+    test ! -e "/dev/shm/$name"
+    test ! -e "/dev/shm/$name.map"
+
+    config="
+        add rwm ram 0x1000
+        ram shared \"ram\" 8K
+    " \
+    expected="
+        <msim> Error in msim.conf on line 2:
+        Shared memory object name has to start with a slash and contain no other slash
+        <msim> Fault in msim.conf on line 2:
+        Error in configuration file
+    " \
+    exit_success=false \
+    msim_command_check
+}
+
+@test "Disk image is read and saved by extents" {
+    head -c 131172 /dev/zero | tr '\0' 'A' >"$MSIM_TEST_TMPDIR/image.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add ddisk disk 0x10000000 2
+disk generic 256K
+disk fill 66
+disk load "image.bin"
+disk save "image.bin"
+disk save "image.bin"
+disk stat
+quit
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+
+    # Only the extents which are not the same as the file are written
+    echo "$output" | grep -A 1 'extents read' | grep -q '^  *1  *2$'
+    cmp "$MSIM_TEST_TMPDIR/image.bin" <( head -c 131172 /dev/zero | tr '\0' 'A'; head -c 130972 /dev/zero | tr '\0' 'B' )
+}
+
+@test "Memory and disks are saved as sparse files" {
+    head -c 4096 /dev/zero | tr '\0' 'A' >"$MSIM_TEST_TMPDIR/page.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add rwm ram 0
+ram generic 64M
+ram load "page.bin"
+ram save "ram.bin"
+add ddisk disk 0x10000000 2
+disk generic 64M
+disk save "disk.bin"
+quit
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+
+    cmp "$MSIM_TEST_TMPDIR/ram.bin" <( cat "$MSIM_TEST_TMPDIR/page.bin"; head -c 67104768 /dev/zero )
+    cmp "$MSIM_TEST_TMPDIR/disk.bin" <( head -c 67108864 /dev/zero )
+
+    # The blocks of zeros take no space
+    test "$( du -k "$MSIM_TEST_TMPDIR/ram.bin" | cut -f 1 )" -lt 1024
+    test "$( du -k "$MSIM_TEST_TMPDIR/disk.bin" | cut -f 1 )" -lt 1024
+}
+
+@test "Memory and disks load gzip-compressed images" {
+    head -c 100000 /dev/urandom >"$MSIM_TEST_TMPDIR/image.bin"
+    gzip -c "$MSIM_TEST_TMPDIR/image.bin" >"$MSIM_TEST_TMPDIR/image.gz"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add rwm ram 0
+ram generic 1M
+ram load "image.gz"
+ram save "ram.bin"
+add ddisk disk 0x10000000 2
+disk generic 256K
+disk load "image.gz"
+disk save "disk.bin"
+quit
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+
+    cmp "$MSIM_TEST_TMPDIR/ram.bin" <( cat "$MSIM_TEST_TMPDIR/image.bin"; head -c 948576 /dev/zero )
+    cmp "$MSIM_TEST_TMPDIR/disk.bin" <( cat "$MSIM_TEST_TMPDIR/image.bin"; head -c 162144 /dev/zero )
+
+    # A truncated image is refused
+    head -c 1000 "$MSIM_TEST_TMPDIR/image.gz" >"$MSIM_TEST_TMPDIR/truncated.gz"
+    sed -i 's/image.gz/truncated.gz/' "$MSIM_TEST_TMPDIR/msim.conf"
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -ne 0
+    [[ "$output" == *"unexpected end of file"* ]]
+}
+
+@test "Memory filled with a value reads back the value" {
+    printf 'Hi' >"$MSIM_TEST_TMPDIR/hi.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add rwm ram 0
+ram generic 8M
+ram fill "A"
+ram load "hi.bin"
+ram save "ram.bin"
+quit
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+
+    cmp "$MSIM_TEST_TMPDIR/ram.bin" <( printf 'Hi'; head -c 8388606 /dev/zero | tr '\0' 'A' )
+}
+
+@test "Dump physical memory by rows" {
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add rwm mem 0
+mem generic 16K
+mem fill 0x5a
+dumpmem 0x3ff8 5
+dumpmem 0 1030
+quit
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+
+    # The words outside of the memory read as ones
+    test "$( echo "$output" | head -n 2 )" = "$( printf '%s\n' \
+        '  0x000003ff8   5a5a5a5a 5a5a5a5a ffffffff ffffffff ' \
+        '  0x000004008   ffffffff ' )"
+
+    # The rows go on across the blocks read at once
+    test "$( echo "$output" | sed -n '3p' )" = '  00000000000   5a5a5a5a 5a5a5a5a 5a5a5a5a 5a5a5a5a '
+    test "$( echo "$output" | sed -n '259p' )" = '  0x000001000   5a5a5a5a 5a5a5a5a 5a5a5a5a 5a5a5a5a '
+    test "$( echo "$output" | sed -n '260p' )" = '  0x000001010   5a5a5a5a 5a5a5a5a '
+    test "$( echo "$output" | wc -l )" -eq 260
+}
+
+@test "Configuration with thousands of devices" {
+    for i in $( seq 0 2999 ); do
+        printf 'add rwm m%d %#x\nm%d generic 4K\n' "$i" "$(( 0x100000 + i * 0x1000 ))" "$i"
+    done >"$MSIM_TEST_TMPDIR/msim.conf"
+
+    cat >>"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+m2999 fill 0x5a
+m0 fill 0x3c
+m1500 info
+echo "two words" 'quoted'
+dumpmem 0xcb7000 1
+dumpmem 0x100000 1
+quit
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+
+    test "$( echo "$output" | head -n 5 )" = "$( printf '%s\n' \
+        '[Start    ] [Size      ] [Type]' \
+        '0x0006dc000           4K mem' \
+        'two words quoted' \
+        '  0x000cb7000   5a5a5a5a ' \
+        '  0x000100000   3c3c3c3c ' )"
+}
+
+@test "Configure disk transfer timing" {
+    config="
+        add ddisk disk 0x10000000 2
+        disk timing
+        disk timing fast 16
+        disk timing
+        disk timing word
+        disk timing
+    " \
+    expected="
+        Transfer timing: word, one word per cycle
+        Transfer timing: fast, one sector per 16 cycles
+        Transfer timing: word, one word per cycle
+    " \
+    msim_command_check
+}
+
+@test "Configure disk extended registers" {
+    config="
+        add ddisk disk 0x10000000 2
+        disk extended
+        disk extended on
+        disk extended
+    " \
+    expected="
+        Extended registers: disabled
+        Extended registers: enabled
+    " \
+    msim_command_check
+}
+
+@test "Configure printer output buffering" {
+    config="
+        add dprinter printer 0x10000000
+        printer buffer
+        printer buffer buffered 500
+        printer buffer
+        printer buffer sync
+        printer buffer
+    " \
+    expected="
+        Output: buffered, flushed within 100000 cycles
+        Output: buffered, flushed within 500 cycles
+        Output: synchronous
+    " \
+    msim_command_check
+}
+
+@test "Printer output written by the I/O thread" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF'
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+printer redir "printer.output"
+printer buffer thread 50
+printer buffer
+EOF
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+
+    echo "$output" | grep -q '^Output: buffered, flushed within 50 cycles, written by the I/O thread$'
+    test "$( cat "$MSIM_TEST_TMPDIR/printer.output" )" = "$( cat "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/guest.expected" )"
+}
+
+@test "Configure dorder bank register" {
+    config="
+        add dorder order 0x10000000 3
+        order banked
+        order banked on
+        order banked
+        order info
+    " \
+    expected="
+        Bank register: disabled
+        Bank register: enabled
+        [address ] [int] [banked] [broadcast]
+         0x10000000 3     yes      no
+    " \
+    msim_command_check
+}
+
+@test "Coalesce dorder interrupts on pending ones" {
+    config="
+        add drvcpu rv0
+        add drvcpu rv1
+        add dorder order 0x10000000 3
+        order broadcast
+        order broadcast on
+        order synchup 0x3
+        order synchup 0x2
+        order synchdown 0x2
+        order synchup 0x2
+        order stat
+    " \
+    expected="
+        Broadcast registers: disabled
+        [command count]
+        4
+        [cpu] [raised    ] [coalesced ] [pending]
+        0     1            0            yes
+        1     2            1            yes
+    " \
+    msim_command_check
+}
+
+@test "Route disk interrupt through dplic" {
+    config="
+        add dplic plic 0x10000000 3
+        add ddisk disk 0x10400000 2
+        disk route
+        disk route plic 5
+        disk route
+        plic up 7
+        plic info
+    " \
+    expected="
+        Interrupt: 2
+        Interrupt: source 5 of plic
+        [address ] [int] [pending         ] [claimed         ]
+         0x10000000 3     0000000000000080   0000000000000000
+    " \
+    msim_command_check
+}
+
+@test "Machine takes up to 256 processors" {
+    for i in $( seq 0 255 ); do
+        echo "add drvcpu rv$i"
+    done >"$MSIM_TEST_TMPDIR/msim.conf"
+
+    cat >>"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add dorder order 0x10000000 3
+order synchup 0x80000000 7
+rv255 csrd mip
+rv31 csrd mip
+add drvcpu rv256
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -ne 0
+
+    echo "$output" | grep -q 'Maximum CPU count exceeded (256)'
+    # Bank 7 addresses the processors 224 to 255
+    test "$( echo "$output" | grep '^mip 0x' | cut -d ' ' -f 2 )" = "$( printf '%s\n' 0x00000008 0x00000000 )"
+}
+
+@test "Processors running in parallel" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF'
+set parallel = 100
+add dr4kcpu cpu0
+add dr4kcpu cpu1
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+printer redir "printer.output"
+EOF
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+
+    # The interleaving of the processors is not deterministic
+    sorted="$( fold -w 1 "$MSIM_TEST_TMPDIR/printer.output" | sort | tr -d '\n' )"
+    test "$sorted" = "!!HHeelllloo"
+}
+
+@test "Processors standing by in parallel" {
+    # The harts other than 0 wait for interrupts, hart 0 runs
+    # 2 passes of 1024 loads and halts the machine
+    printf '\xf3\x2e\x40\xf1\x63\x96\x0e\x02\x93\x03\x20\x00\x93\x02\x00\x00\x13\x03\x00\x40\x03\xae\x02\x00\x93\x82\x02\x04\x13\x03\xf3\xff\xe3\x1a\x03\xfe\x93\x83\xf3\xff\xe3\x92\x03\xfe\x73\x00\x00\x8c\x73\x00\x50\x10\x6f\xf0\xdf\xff' >"$MSIM_TEST_TMPDIR/main.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF'
+set parallel = 1000
+add drvcpu cpu0
+add drvcpu cpu1
+add drvcpu cpu2
+add drvcpu cpu3
+add rwm ram 0
+ram generic 128K
+add rom main 0xF0000000
+main generic 4K
+main load "main.bin"
+EOF
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+    echo "$output" | grep -q '^<msim> Alert: EHALT: Machine halt$'
+
+    # The harts standing by may finish the quantum first
+    cycles="$( echo "$output" | sed -n 's/^Cycles: //p' )"
+    test "$cycles" -ge 8204
+    test "$cycles" -le 9000
+}
+
+@test "Processor spinning on a reservation" {
+    # Hart 0 takes the lock at 0x1000 for 2000 iterations, hart 1
+    # spins on it with lr.w and bnez, then reads instret and cycle
+    # into s0 and s1, dumps the registers and lets hart 0 halt
+    printf '\xf3\x2e\x40\xf1\x37\x15\x00\x00\x63\x94\x0e\x02\x93\x02\x10\x00\x23\x20\x55\x00\x13\x03\x00\x7d\x13\x03\xf3\xff\xe3\x1e\x03\xfe\x23\x20\x05\x00\x83\x23\x45\x00\xe3\x8e\x03\xfe\x73\x00\x00\x8c\x13\x00\x00\x00\x13\x00\x00\x00\x13\x00\x00\x00\x13\x00\x00\x00\x13\x00\x00\x00\x13\x00\x00\x00\x13\x00\x00\x00\x13\x00\x00\x00\xaf\x22\x05\x10\xe3\x9e\x02\xfe\x73\x24\x20\xc0\xf3\x24\x00\xc0\x13\x03\x10\x00\x23\x22\x65\x00\x73\x00\x10\x8c\x6f\x00\x00\x00' >"$MSIM_TEST_TMPDIR/main.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF'
+add drvcpu cpu0
+add drvcpu cpu1
+add rwm ram 0
+ram generic 128K
+add rom main 0xF0000000
+main generic 4K
+main load "main.bin"
+EOF
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+    echo "$output" | grep -q '^<msim> Alert: EHALT: Machine halt$'
+
+    # The counters are the same as if the loop was stepped
+    echo "$output" | grep -q '^ s0/fp:      fa9    s1:      faa '
+    echo "$output" | grep -q '^Cycles: 4016$'
+}
+
+@test "Relaxed processors running in parallel" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF'
+set parallel = 100
+set relaxed
+add dr4kcpu cpu0
+add dr4kcpu cpu1
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+printer redir "printer.output"
+EOF
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+
+    sorted="$( fold -w 1 "$MSIM_TEST_TMPDIR/printer.output" | sort | tr -d '\n' )"
+    test "$sorted" = "!!HHeelllloo"
+}
+
+@test "Self-modifying code of processors running in parallel" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-smc/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF'
+set parallel = 10
+add dr4kcpu cpu0
+add dr4kcpu cpu1
+add rwm boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+EOF
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+
+    # The processor patching the code later may see it patched already
+    sums="$( echo "$output" | sed -n 's/^  t2 *\([0-9]*\) .*/\1/p' | tr '\n' ' ' )"
+    case "$sums" in
+        "3 3 "|"3 4 "|"4 3 ") ;;
+        *) fail "Unexpected sums: $sums" ;;
+    esac
+}
+
+@test "Processors pinned to host cores" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF'
+set parallel = 100
+add dr4kcpu cpu0
+add dr4kcpu cpu1
+cpu0 pin 0
+cpu1 pin 0
+cpu1 pin
+add rom boot 0x1FC00000
+boot numa node 0
+boot generic 4K
+boot numa
+boot load "boot.bin"
+add dprinter printer 0x10000000
+printer redir "printer.output"
+EOF
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+    echo "$output" | grep -q '^Host core: 0$'
+    echo "$output" | grep -q '^Host placement: node 0$'
+
+    sorted="$( fold -w 1 "$MSIM_TEST_TMPDIR/printer.output" | sort | tr -d '\n' )"
+    test "$sorted" = "!!HHeelllloo"
+}
+
+@test "Processors interleaved by quanta" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF'
+set quantum = 1000
+add dr4kcpu cpu0
+add dr4kcpu cpu1
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+printer redir "printer.output"
+EOF
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+
+    # The first processor prints and halts within its quantum
+    test "$( cat "$MSIM_TEST_TMPDIR/printer.output" )" = "$( printf 'Hello!\nHello!' )"
+    echo "$output" | grep -q '^Cycles: 18$'
+}
+
+@test "Simulation budgets halt the machine" {
+    # nop, then b . followed by a nop in the delay slot
+    printf '\x00\x00\x00\x00\xff\xff\x00\x10\x00\x00\x00\x00' >"$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF'
+add dr4kcpu cpu0
+add dr4kcpu cpu1
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+EOF
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --max-cycles=1000 </dev/null"
+    test "$status" -eq 0
+    echo "$output" | grep -q '^<msim> Alert: Cycle limit reached (1000), halting$'
+    echo "$output" | grep -q '^Cycles: 1000$'
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --max-instret=777 </dev/null"
+    test "$status" -eq 0
+    echo "$output" | grep -q '^<msim> Alert: Instruction limit reached (777), halting$'
+    # Both processors execute an instruction per cycle
+    echo "$output" | grep -q '^Cycles: 389$'
+
+    # Checked every 4096 cycles (not in the first one at the nop),
+    # the reset leaves the interrupts disabled
+    echo "set loophalt" >>"$MSIM_TEST_TMPDIR/msim.conf"
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+    echo "$output" | grep -q '^<msim> Alert: All processors loop forever with interrupts disabled, halting$'
+    echo "$output" | grep -q '^Cycles: 4096$'
+}
+
+@test "Paced simulation runs at the set frequency" {
+    # b . followed by a nop in the delay slot
+    printf '\xff\xff\x00\x10\x00\x00\x00\x00' >"$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF'
+set pace = 1000000
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+EOF
+
+    # 300 ms of the simulated time
+    start="$( date +%s%N )"
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --max-cycles=300000 --stats </dev/null"
+    elapsed="$(( ( $( date +%s%N ) - start ) / 1000000 ))"
+    test "$status" -eq 0
+    test "$elapsed" -ge 290
+    echo "$output" | grep -q '^Cycles: 300000$'
+    echo "$output" | grep -q '^Pacing: 1000000 Hz requested, [0-9]* Hz achieved'
+    echo "$output" | grep -q '^  [0-9]* host sleeps'
+}
+
+@test "Printer output is compared with the expected output" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF'
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+printer redir "printer.output"
+printer expect "expected.output"
+EOF
+
+    printf 'Hello!\n' >"$MSIM_TEST_TMPDIR/expected.output"
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+
+    printf 'Help!\n' >"$MSIM_TEST_TMPDIR/expected.output"
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 7
+    echo "$output" | grep -q 'output differs from expected.output at offset 3'
+
+    # The output ends before the expected output
+    printf 'Hello!\n\n' >"$MSIM_TEST_TMPDIR/expected.output"
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 7
+    echo "$output" | grep -q 'output differs from expected.output at offset 7'
+}
+
+@test "Code breakpoint stops a running machine" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+printer redir "printer.output"
+cpu0 break 0xBFC00020
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf 'step 2\ncontinue\n' | '$MSIM'"
+    test "$status" -eq 0
+
+    expected="$( printf '%s\n' \
+        '<msim> Alert: Debug: Hit breakpoint at 0xffffffffbfc00020' \
+        '[msim] step 2' \
+        '[msim] continue' \
+        '<msim> Alert: XHLT: Machine halt' \
+        '' \
+        'Cycles: 18' )"
+    if [ "$output" != "$expected" ]; then
+        fail "Unexpected output: '$output'."
+    fi
+
+    test "$( cat "$MSIM_TEST_TMPDIR/printer.output" )" = "Hello!"
+}
+
+@test "RISC-V code breakpoints" {
+    config="
+        add drvcpu riscv
+        riscv break 0x1000
+        riscv break 0x2000
+        riscv br 0x1000
+        riscv bd
+        add dr4kcpu mips
+        mips break 0xBFC00000
+        mips br 0xBFC00000
+        mips bd
+    " \
+    expected="
+        [address ] [hits              ] [kind    ]
+        0x0000000000002000                    0 Simulator
+        [address ] [hits              ] [kind    ]
+    " \
+    msim_command_check
+}
+
+@test "Conditional code breakpoints stop only when the condition holds" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-jit/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add dr4kcpu cpu0
+add rwm boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+cpu0 break 0xBFC0000C "r8 == 150 && cpu == 0"
+cpu0 break 0xBFC00010 "hits == 3 || mem32[0xbfc00100] == 7"
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf 'continue\ncpu0 bd\nquit\n' | '$MSIM'"
+    test "$status" -eq 0
+
+    expected="$( printf '%s\n' \
+        '<msim> Alert: Debug: Hit breakpoint at 0xffffffffbfc00010' \
+        '[msim] continue' \
+        '<msim> Alert: Debug: Hit breakpoint at 0xffffffffbfc0000c' \
+        '[msim] cpu0 bd' \
+        '[address ] [hits              ] [kind    ]' \
+        '0xffffffffbfc0000c                   51 Simulator if r8 == 150 && cpu == 0' \
+        '0xffffffffbfc00010                   50 Simulator if hits == 3 || mem32[0xbfc00100] == 7' \
+        '[msim] quit' \
+        '' \
+        'Cycles: 903' )"
+    if [ "$output" != "$expected" ]; then
+        fail "Unexpected output: '$output'."
+    fi
+}
+
+@test "Invalid breakpoint condition is refused" {
+    config="
+        add dr4kcpu mips
+        mips break 0xBFC00000 \"r8 ==\"
+    " \
+    expected="
+        <msim> Error in msim.conf on line 2:
+        Syntax error at the end of breakpoint condition
+        <msim> Fault in msim.conf on line 2:
+        Error in configuration file
+    " \
+    exit_success=false \
+    msim_command_check
+}
+
+@test "Catchpoints stop on register writes" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-tlb-entries/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add dr4kcpu cpu0 128
+cpu0 catch write EntryHi
+cpu0 catch exception 2 log
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add rwm ram 0
+ram generic 128K
+add dprinter printer 0x10000000
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf 'continue\ncpu0 catch\nquit\n' | '$MSIM'"
+    test "$status" -eq 0
+
+    expected="$( printf '%s\n' \
+        '<msim> Alert: Debug: cpu0 caught write of entryhi (0x80000000)' \
+        '[msim] continue' \
+        '<msim> Alert: Debug: cpu0 caught write of entryhi (0x80002000)' \
+        '[msim] cpu0 catch' \
+        '[event                  ] [hits              ] [action]' \
+        'write entryhi                                2 stop' \
+        'exception 2                                  0 log' \
+        '[msim] quit' \
+        '' \
+        'Cycles: 19' )"
+    if [ "$output" != "$expected" ]; then
+        fail "Unexpected output: '$output'."
+    fi
+}
+
+@test "Catchpoint of an unknown register is refused" {
+    config="
+        add dr4kcpu mips
+        mips catch write nosuchreg
+    " \
+    expected="
+        <msim> Error in msim.conf on line 2:
+        Unknown register
+        <msim> Fault in msim.conf on line 2:
+        Error in configuration file
+    " \
+    exit_success=false \
+    msim_command_check
+}
+
+@test "Scripted keyboard input" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-keyboard-script/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+    printf 'Hello, keyboard!\nq' >"$MSIM_TEST_TMPDIR/keys.txt"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+printer redir "printer.output"
+add dkeyboard keyboard 0x10000010 3
+keyboard script "keys.txt"
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' -n </dev/null"
+    test "$status" -eq 0
+
+    # The keys follow each other without waiting for the input polling
+    expected="$( printf '%s\n' \
+        '<msim> Alert: XHLT: Machine halt' \
+        '' \
+        'Cycles: 145' )"
+    if [ "$output" != "$expected" ]; then
+        fail "Unexpected output: '$output'."
+    fi
+
+    test "$( cat "$MSIM_TEST_TMPDIR/printer.output" )" = "Hello, keyboard!"
+}
+
+@test "Keyboard input is replayed from the record" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-keyboard-script/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+    printf 'Hello, replay!\nq' >"$MSIM_TEST_TMPDIR/keys.txt"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+printer redir "printer.output"
+add dkeyboard keyboard 0x10000010 3
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --record=keys.log <keys.txt"
+    test "$status" -eq 0
+    recorded="$output"
+    test "$( cat "$MSIM_TEST_TMPDIR/printer.output" )" = "Hello, replay!"
+
+    # The standard input is not read by the replay
+    rm "$MSIM_TEST_TMPDIR/printer.output"
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --replay=keys.log </dev/null"
+    test "$status" -eq 0
+    if [ "$output" != "$recorded" ]; then
+        fail "Unexpected output: '$output', recorded: '$recorded'."
+    fi
+
+    test "$( cat "$MSIM_TEST_TMPDIR/printer.output" )" = "Hello, replay!"
+}
+
+@test "LCD is repainted once per refresh period" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-lcd/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dlcd lcd 16 2 0x10000100
+lcd output terminal 50
+lcd output
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' -n </dev/null"
+    test "$status" -eq 0
+
+    test "$( echo "$output" | head -n 1 )" = "Output: terminal, repainted every 50 cycles"
+
+    # Digits written within a refresh period are repainted at once, the last one at exit
+    test "$( echo "$output" | grep -c '^│Hello' )" -eq 4
+    test "$( echo "$output" | grep '^│[0-9]' | tr -d '│ ' | tr -d '\n' )" = "0489"
+}
+
+@test "Skipping standby cycles keeps the counters" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/../rvtests/wfi-timer/main.bin" "$MSIM_TEST_TMPDIR/main.bin"
+
+    for skip in on off; do
+        cat >"$MSIM_TEST_TMPDIR/msim.conf" <<EOF2
+set idleskip = $skip
+add drvcpu cpu0
+cpu0 mtime virtual 1000
+add dclint clint 0xFF000000
+add rom main 0xF0000000
+main generic 4K
+main load "main.bin"
+add dprinter printer 0x90000000
+printer redir "printer-$skip.output"
+EOF2
+
+        run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+        test "$status" -eq 0
+        echo "$output" >"$MSIM_TEST_TMPDIR/msim-$skip.output"
+    done
+
+    cmp "$MSIM_TEST_TMPDIR/msim-on.output" "$MSIM_TEST_TMPDIR/msim-off.output"
+    cmp "$MSIM_TEST_TMPDIR/printer-on.output" "$MSIM_TEST_TMPDIR/printer-off.output"
+    grep -q '^Cycles: 2000148$' "$MSIM_TEST_TMPDIR/msim-on.output"
+    test "$( cat "$MSIM_TEST_TMPDIR/printer-on.output" )" = "001e8481 000007d0"
+}
+
+@test "Parking standing-by processors keeps the counters" {
+    test_dir="$( dirname "$BATS_TEST_FILENAME" )/../rvtests/wfi-smp"
+    cp "$test_dir/main.bin" "$MSIM_TEST_TMPDIR/main.bin"
+    cp "$test_dir/expected-output.txt" "$MSIM_TEST_TMPDIR/expected-output.txt"
+
+    for skip in on off; do
+        (
+            echo "set idleskip = $skip"
+            sed 's/"out.txt"/"printer-'"$skip"'.output"/' "$test_dir/msim.conf"
+        ) >"$MSIM_TEST_TMPDIR/msim.conf"
+
+        run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+        test "$status" -eq 0
+        echo "$output" >"$MSIM_TEST_TMPDIR/msim-$skip.output"
+    done
+
+    # The processors standing by are parked only with the skipping on
+    cmp "$MSIM_TEST_TMPDIR/msim-on.output" "$MSIM_TEST_TMPDIR/msim-off.output"
+    cmp "$MSIM_TEST_TMPDIR/printer-on.output" "$MSIM_TEST_TMPDIR/printer-off.output"
+    cmp "$MSIM_TEST_TMPDIR/printer-on.output" "$test_dir/expected-output.txt"
+}
+
+@test "Fast mode keeps the architectural state" {
+    test_dir="$( dirname "$BATS_TEST_FILENAME" )/mips32-random"
+    cp "$test_dir/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    for fast in on off; do
+        (
+            echo "set fast = $fast"
+            cat "$test_dir/msim.conf"
+            echo "printer redir \"printer-$fast.output\""
+        ) >"$MSIM_TEST_TMPDIR/msim.conf"
+
+        run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+        test "$status" -eq 0
+        # The machine cycles catch up with the blocks
+        echo "$output" >"$MSIM_TEST_TMPDIR/msim-$fast.output"
+    done
+
+    # Random follows Count, so it is the same with the batched counters
+    cmp "$MSIM_TEST_TMPDIR/msim-on.output" "$MSIM_TEST_TMPDIR/msim-off.output"
+    cmp "$MSIM_TEST_TMPDIR/printer-on.output" "$MSIM_TEST_TMPDIR/printer-off.output"
+    grep -q '^<msim> Alert: XHLT: Machine halt$' "$MSIM_TEST_TMPDIR/msim-on.output"
+}
+
+@test "Fast mode keeps the devices in time" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/../bench/riscv-mmio/main32.bin" "$MSIM_TEST_TMPDIR/main32.bin"
+
+    # The guest polls the cycle counter until 10M cycles have passed,
+    # which must not take more instructions in the fast mode
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+set fast
+add drvcpu cpu0
+add rom main 0xF0000000
+main generic 4K
+main load "main32.bin"
+add dcycle cycle 0x90000000
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --max-instret=11000000 </dev/null"
+    test "$status" -eq 0
+    echo "$output" | grep -q '^<msim> Alert: EHALT: Machine halt$'
+
+    cycles="$( echo "$output" | sed -n 's/^Cycles: //p' )"
+    test "$cycles" -ge 10000000
+    test "$cycles" -le 10001000
+}
+
+@test "Host sleeps while the processors wait for the host clock" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/../rvtests/wfi-timer/main.bin" "$MSIM_TEST_TMPDIR/main.bin"
+
+    # The guest waits for 2000 ms of the host mtime
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+set idlesleep
+add drvcpu cpu0
+add dclint clint 0xFF000000
+add rom main 0xF0000000
+main generic 4K
+main load "main.bin"
+add dprinter printer 0x90000000
+printer redir "printer.output"
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && TIMEFORMAT='%U %S' && time '$MSIM' </dev/null >/dev/null 2>&1"
+    test "$status" -eq 0
+
+    # Spinning would take the whole two seconds of the host processor
+    echo "$output" | awk '{ exit !($1 + $2 < 1) }'
+}
+
+@test "Binary trace file decodes to the trace mode output" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+printer redir "printer.output"
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' -t </dev/null >plain.output 2>&1 && '$MSIM' -t --trace-file=trace.bin </dev/null"
+    test "$status" -eq 0
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --trace-decode=trace.bin"
+    test "$status" -eq 0
+
+    # Registers changed by the instructions follow them
+    echo "$output" | grep -q '^      a1: 0x48$'
+    diff <( echo "$output" | grep '^cpu0 ' ) <( grep '^cpu0 ' "$MSIM_TEST_TMPDIR/plain.output" )
+    test "$( cat "$MSIM_TEST_TMPDIR/printer.output" )" = "Hello!"
+}
+
+@test "Event trace records the device register accesses" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+set events
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+printer redir "printer.output"
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null >plain.output 2>&1 && '$MSIM' --trace-file=trace.bin </dev/null"
+    test "$status" -eq 0
+
+    # No instructions, only the characters written to the printer ("Hello!\n")
+    test "$( grep -c '^cpu0  mmio write32 0x10000000$' "$MSIM_TEST_TMPDIR/plain.output" )" -eq "$( wc -c <"$MSIM_TEST_TMPDIR/printer.output" )"
+    grep -q '^      value: 0x48$' "$MSIM_TEST_TMPDIR/plain.output"
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --trace-decode=trace.bin"
+    test "$status" -eq 0
+    diff <( echo "$output" ) <( grep -E '^(cpu0 |      )' "$MSIM_TEST_TMPDIR/plain.output" )
+}
+
+@test "Trace filters narrow down the traced instructions" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+printer redir "printer.output"
+tracefilter add pc 0xBFC00008 0xBFC00010
+tracefilter add cycles 16 17
+tracefilter add mode user
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' -t </dev/null"
+    test "$status" -eq 0
+
+    expected="$( printf '%s\n' \
+        'cpu0  0xffffffffbfc00008 li a1, 72' \
+        'cpu0  0xffffffffbfc0000c sw a1, 0(a0)' \
+        'cpu0  0xffffffffbfc00040 nop' )"
+    if [ "$( echo "$output" | grep '^cpu0 ' )" != "$expected" ]; then
+        fail "Unexpected output: '$output'."
+    fi
+
+    test "$( cat "$MSIM_TEST_TMPDIR/printer.output" )" = "Hello!"
+}
+
+@test "Flight recorder is dumped when dnomem halts the machine" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-dnomem-halt/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+printer redir "printer.output"
+add dnomem nomem 0x08000000 0x1000
+nomem mode halt
+set flight = 3
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+
+    # The size is rounded up to four
+    expected="$( printf '%s\n' \
+        '<msim> Alert: Halting after forbidden READ (at 0x008000004, 0x4 inside nomem).' \
+        'Flight recorder (last 4 instructions):' \
+        'cpu0  0xffffffffbfc0002c sw a1, 0(a0)' \
+        'cpu0  0xffffffffbfc00030 lui a2, 0x8800' \
+        'cpu0  0xffffffffbfc00034 ori a2, a2, 0x4' \
+        'cpu0  0xffffffffbfc00038 lw a3, 0(a2)' \
+        '' \
+        'Cycles: 15' )"
+    if [ "$output" != "$expected" ]; then
+        fail "Unexpected output: '$output'."
+    fi
+}
+
+@test "Statistics count the executed instructions" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+printer redir "printer.output"
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --stats </dev/null"
+    test "$status" -eq 0
+
+    echo "$output" | grep -q '^Statistics: cycles=18 instructions=18 seconds=[0-9.]* mips=[0-9.]* cycles_per_second=[0-9]* ns_per_instruction=[0-9.]*$'
+}
+
+@test "Processor statistics show the interrupt latencies" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-dtimer/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x1F000000
+printer redir "printer.output"
+add dtimer timer0 0x10000000 3
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf 'step 3000\ncpu0 stat\nquit\n' | '$MSIM' -i"
+    test "$status" -eq 0
+
+    # The timer expires at the end of a cycle, the interrupt is taken in the next one
+    echo "$output" | grep -A 1 '^\[Interrupt 3  taken\]' | grep -q '^ *2 *1.00 *1$'
+    echo "$output" | grep -A 1 '^\[Latency (cycles)  \]' | grep -q '^ *1 *2$'
+}
+
+@test "Host time profile samples the machine cycles" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+set profile = 1
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+printer redir "printer.output"
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf 'step 15\nstat\nset profile = 0\nstat\nquit\n' | '$MSIM' -i"
+    test "$status" -eq 0
+
+    # The profile is printed only once, all the printer writes are sampled
+    test "$( echo "$output" | grep -c '^Host time profile' )" -eq 1
+    echo "$output" | grep -q '^Host time profile (1 of 1 cycles sampled, 14 samples):$'
+    echo "$output" | grep -q '^  execute  .* 14$'
+    echo "$output" | grep -q '^  mmio  .* 6$'
+}
+
+@test "Host counters attribute the samples to the guest pages" {
+    # addi t0, t0, 1; j .-4
+    printf '\x93\x82\x12\x00\x6f\xf0\xdf\xff' >"$MSIM_TEST_TMPDIR/loop.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+set hostperf = 10000
+add rwm main 0xF0000000
+main generic 4K
+main load "loop.bin"
+add drvcpu cpu0
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf 'step 2000000\nstat\nquit\n' | '$MSIM' -i"
+    test "$status" -eq 0
+
+    if ! echo "$output" | grep -q '^Host counters by guest page'; then
+        skip "No host performance counters"
+    fi
+
+    # The only page executed gets all the attributed samples
+    echo "$output" | grep -q '^Host counters by guest page (1 of 10000 events sampled):$'
+    echo "$output" | grep -q '^ *0  0x00000000f0000000 .* 100.00%'
+}
+
+@test "PC profile counts the sampled functions" {
+    test_dir="$( dirname "$BATS_TEST_FILENAME" )/mips32-pcprofile"
+    cp "$test_dir/boot.bin" "$test_dir/boot.elf" "$MSIM_TEST_TMPDIR/"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+set pcprofile = 1
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf 'step 49\npcprofile dump \"step.folded\" folded\ncontinue\n' | '$MSIM' -i --symbols=boot.elf --pcprofile=profile.txt"
+    test "$status" -eq 0
+
+    # The first cycle is not sampled
+    test "$( cat "$MSIM_TEST_TMPDIR/step.folded" )" = "$( printf '%s\n' \
+        'cpu0;kernel;__start 7' \
+        'cpu0;kernel;spin 41' )"
+
+    grep -q '^PC profile (1 of 1 cycles sampled, 191 samples)$' "$MSIM_TEST_TMPDIR/profile.txt"
+    grep -q '^ *165  86.39%  86.39%  kernel  *spin$' "$MSIM_TEST_TMPDIR/profile.txt"
+    grep -q '^ *26  13.61% 100.00%  kernel  *__start$' "$MSIM_TEST_TMPDIR/profile.txt"
+    grep -q '^ *50  26.18%  *0  kernel  *0xffffffffbfc00024  spin+0x4$' "$MSIM_TEST_TMPDIR/profile.txt"
+}
+
+@test "PC profile samples the call stacks" {
+    test_dir="$( dirname "$BATS_TEST_FILENAME" )/mips32-pcprofile"
+    cp "$test_dir/boot.bin" "$MSIM_TEST_TMPDIR/"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+set pcprofile = 1
+set callstacks = on
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --pcprofile=profile.folded </dev/null"
+    test "$status" -eq 0
+
+    # Called by bal from __start, the delay slots are not in the callee
+    test "$( cat "$MSIM_TEST_TMPDIR/profile.folded" )" = "$( printf '%s\n' \
+        'cpu0;kernel;0xffffffffbfc00004 5' \
+        'cpu0;kernel;0xffffffffbfc00008 5' \
+        'cpu0;kernel;0xffffffffbfc0000c 5' \
+        'cpu0;kernel;0xffffffffbfc00010 5' \
+        'cpu0;kernel;0xffffffffbfc00014 5' \
+        'cpu0;kernel;0xffffffffbfc00018 1' \
+        'cpu0;kernel;0xffffffffbfc00020;0xffffffffbfc00020 5' \
+        'cpu0;kernel;0xffffffffbfc00020;0xffffffffbfc00024 50' \
+        'cpu0;kernel;0xffffffffbfc00020;0xffffffffbfc00028 50' \
+        'cpu0;kernel;0xffffffffbfc00020;0xffffffffbfc0002c 50' \
+        'cpu0;kernel;0xffffffffbfc00020;0xffffffffbfc00030 5' \
+        'cpu0;kernel;0xffffffffbfc00034 5' )"
+}
+
+@test "Coverage records the executed instructions" {
+    test_dir="$( dirname "$BATS_TEST_FILENAME" )/mips32-pcprofile"
+    cp "$test_dir/boot.bin" "$test_dir/boot.elf" "$MSIM_TEST_TMPDIR/"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf 'step 49\ncoverage dump \"step.drcov\" drcov\ncontinue\n' | '$MSIM' -i --symbols=boot.elf --coverage=coverage.txt"
+    test "$status" -eq 0
+
+    # The halting instruction is only executed at the end
+    test "$( cat "$MSIM_TEST_TMPDIR/coverage.txt" )" = "$( printf '%s\n' \
+        'Coverage (13 instructions in 2 ranges)' \
+        '  start              end                instructions  location' \
+        '  0xffffffffbfc00000 0xffffffffbfc0001c            7  __start' \
+        '  0xffffffffbfc00020 0xffffffffbfc00038            6  spin' )"
+
+    head -n 6 "$MSIM_TEST_TMPDIR/step.drcov" | grep -q '^BB Table: 2 bbs$'
+    grep -q '^0, 0xffffffff00000000, 0xffffffffffffffff, ' "$MSIM_TEST_TMPDIR/step.drcov"
+}
+
+@test "Region of interest is measured and profiled" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-roi/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+set fast
+set pcprofile = 1
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --pcprofile=profile.txt </dev/null"
+    test "$status" -eq 0
+
+    echo "$output" | grep -q '^<msim> Alert: XROIB: Region of interest begins$'
+    echo "$output" | grep -q '^Region of interest: cycles=32 instructions=32 seconds=[0-9.]* mips=[0-9.]* cycles_per_second=[0-9]* ns_per_instruction=[0-9.]*$'
+
+    # Only the cycles of the region are sampled
+    grep -q '^PC profile (1 of 1 cycles sampled, 32 samples)$' "$MSIM_TEST_TMPDIR/profile.txt"
+}
+
+@test "Mixstat counts the instructions and the accessed bytes" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-mixstat/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+set mixstat
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add rwm mem 0
+mem generic 4K
+add dprinter printer 0x10000000
+printer redir "printer.output"
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf 'step 41\nstat\n' | '$MSIM' -i"
+    test "$status" -eq 0
+
+    echo "$output" | grep -q '^addiu  *10  *24.39%$'
+    echo "$output" | grep -q '^sw  *9  *21.95%$'
+    echo "$output" | grep -q '^lbu  *4  *9.76%$'
+
+    # Printer registers and the memory area
+    echo "$output" | grep -A 1 'MMIO bytes read' | grep -q '^  *0  *20$'
+    echo "$output" | grep -A 2 '^mem  *rwm' | grep -q '^  *20  *20$'
+}
+
+@test "Byte accesses to device registers are byte wide" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-mmio-narrow/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+set mixstat
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+printer redir "printer.output"
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf 'step 7\nstat\n' | '$MSIM' -i"
+    test "$status" -eq 0
+
+    # The printer gets the bytes by its 32-bit handler
+    echo "$output" | grep -A 1 'MMIO bytes read' | grep -q '^  *0  *3$'
+    test "$( cat "$MSIM_TEST_TMPDIR/printer.output" )" = "OK"
+}
+
+@test "ELF executable is mapped into the memory" {
+    test_dir="$( dirname "$BATS_TEST_FILENAME" )/mips32-elf"
+    cp "$test_dir/kernel.elf" "$MSIM_TEST_TMPDIR/"
+
+    # The filled memory shows that the bss segment is zeroed
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+set pcprofile = 1
+add dr4kcpu cpu0
+add rwm mem 0
+mem generic 64K
+mem fill 0xff
+elf "kernel.elf"
+add dprinter printer 0x10000000
+printer redir "printer.output"
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --pcprofile=profile.txt </dev/null"
+    test "$status" -eq 0
+
+    test "$( cat "$MSIM_TEST_TMPDIR/printer.output" )" = "Loaded!"
+    cmp "$MSIM_TEST_TMPDIR/kernel.elf" "$test_dir/kernel.elf"
+    grep -q '^ *59 100.00% 100.00%  kernel  *__start$' "$MSIM_TEST_TMPDIR/profile.txt"
+}
+
+@test "Executable ELF segments are pre-decoded" {
+    test_dir="$( dirname "$BATS_TEST_FILENAME" )/mips32-elf"
+    cp "$test_dir/kernel.elf" "$MSIM_TEST_TMPDIR/"
+
+    # Only the code segment gets its page, the data segments do not
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+set predecode
+add dr4kcpu cpu0
+add rwm mem 0
+mem generic 64K
+elf "kernel.elf"
+cpu0 icache
+add dprinter printer 0x10000000
+printer redir "printer.output"
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+
+    echo "$output" | grep -q '^Decode cache: 1 of 1024 pages, lru replacement$'
+    test "$( cat "$MSIM_TEST_TMPDIR/printer.output" )" = "Loaded!"
+}
+
+@test "Decoded pages are restored from the cache directory" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+EOF2
+
+    # The first run stores the page of the code, the second one restores it
+    for restored in 0 1; do
+        run bash -c "cd '$MSIM_TEST_TMPDIR' && printf 'step 5\ncpu0 stat\nquit\n' | '$MSIM' --decode-cache=cache -i"
+        test "$status" -eq 0
+
+        echo "$output" | grep -A 1 '^\[Cache memory (KiB)\]' | grep -q " $restored\$"
+    done
+
+    test -f "$MSIM_TEST_TMPDIR/cache/r4k.dcache"
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --decode-cache=cache </dev/null"
+    test "$status" -eq 0
+    echo "$output" | grep -q '^Hello!$'
+}
+
+@test "ELF segments have to fit into generic memory" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-elf/kernel.elf" "$MSIM_TEST_TMPDIR/"
+
+    config="
+        add dr4kcpu cpu0
+        add rwm mem 0
+        mem generic 12K
+        elf \"kernel.elf\"
+    " \
+    expected="
+        <msim> Error in msim.conf on line 4:
+        Segment at 0x000002000 exceeds the memory area mem
+        <msim> Fault in msim.conf on line 4:
+        Error in configuration file
+    " \
+    exit_success=false \
+    msim_command_check
+}
+
+@test "User program runs with emulated system calls" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/rv32-user/user.elf" "$MSIM_TEST_TMPDIR/"
+
+    # The program exits with the number of its arguments
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --user -- user.elf hello </dev/null"
+    test "$status" -eq 2
+
+    test "$( echo "$output" | head -n 1 )" = "hello"
+    echo "$output" | grep -q '^Cycles: 67$'
+}
+
+@test "Exception terminates the user program" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/rv32-user/user.elf" "$MSIM_TEST_TMPDIR/"
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --user user.elf </dev/null 2>&1"
+    test "$status" -eq 8
+
+    echo "$output" | grep -q 'Program terminated by exception 2 at 0x100bc$'
+}
+
+@test "Restored checkpoint continues the run" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    for run in saved restored; do
+        cat >"$MSIM_TEST_TMPDIR/msim-$run.conf" <<EOF2
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add rwm ram 0
+ram generic 64K
+add dprinter printer 0x10000000
+printer redir "printer-$run.output"
+EOF2
+    done
+    echo 'cpu0 break 0xBFC00020' >>"$MSIM_TEST_TMPDIR/msim-saved.conf"
+    echo 'restore "boot.ckpt"' >>"$MSIM_TEST_TMPDIR/msim-restored.conf"
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf 'checkpoint \"boot.ckpt\"\nquit\n' | '$MSIM' -c msim-saved.conf"
+    test "$status" -eq 0
+    test "$( cat "$MSIM_TEST_TMPDIR/printer-saved.output" )" = "Hel"
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' -c msim-restored.conf </dev/null"
+    test "$status" -eq 0
+
+    expected="$( printf '%s\n' \
+        '<msim> Alert: XHLT: Machine halt' \
+        '' \
+        'Cycles: 18' )"
+    if [ "$output" != "$expected" ]; then
+        fail "Unexpected output: '$output'."
+    fi
+
+    test "$( cat "$MSIM_TEST_TMPDIR/printer-restored.output" )" = "lo!"
+}
+
+@test "Checkpoint keeps the cycle counter" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    for run in saved restored; do
+        cat >"$MSIM_TEST_TMPDIR/msim-$run.conf" <<EOF2
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+printer redir "printer-$run.output"
+EOF2
+    done
+    printf '%s\n' 'add dcycle cyc 0x10000200' 'restore "cycle.ckpt"' 'cyc stat' 'quit' \
+        >>"$MSIM_TEST_TMPDIR/msim-restored.conf"
+
+    # The counter starts when the device is added, not with the machine
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf 'step 5\nadd dcycle cyc 0x10000200\nstep 3\ncheckpoint \"cycle.ckpt\"\nquit\n' | '$MSIM' -i -c msim-saved.conf"
+    test "$status" -eq 0
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' -c msim-restored.conf </dev/null"
+    test "$status" -eq 0
+
+    expected="$( printf '%s\n' \
+        '[cycle              ]' \
+        '                   3' \
+        '' \
+        'Cycles: 8' )"
+    if [ "$output" != "$expected" ]; then
+        fail "Unexpected output: '$output'."
+    fi
+}
+
+@test "Checkpoint keeps the RISC-V timer" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/../rvtests/wfi-timer/main.bin" "$MSIM_TEST_TMPDIR/main.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add drvcpu cpu0
+cpu0 mtime virtual 1000
+add dclint clint 0xFF000000
+add rom main 0xF0000000
+main generic 4K
+main load "main.bin"
+add dprinter printer 0x90000000
+printer redir "printer.output"
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf 'step 500000\ncheckpoint \"wfi.ckpt\"\nquit\n' | '$MSIM' -i"
+    test "$status" -eq 0
+
+    echo 'restore "wfi.ckpt"' >>"$MSIM_TEST_TMPDIR/msim.conf"
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+
+    echo "$output" | grep -q '^Cycles: 2000148$'
+    test "$( cat "$MSIM_TEST_TMPDIR/printer.output" )" = "001e8481 000007d0"
+}
+
+@test "Incremental checkpoints restore the chain of their bases" {
+    test_dir="$( dirname "$BATS_TEST_FILENAME" )/mips32-ddisk-batch"
+    sed "s#\"boot.bin\"#\"$test_dir/boot.bin\"#" <"$test_dir/msim.conf" >"$MSIM_TEST_TMPDIR/msim.conf"
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf '%s\n' \
+        'step 100' 'checkpoint \"c0.ckpt\"' \
+        'step 200' 'checkpoint \"c1.ckpt\" incremental' \
+        'step 50' 'checkpoint \"c2.ckpt\" incremental' \
+        'ram save \"saved.bin\"' quit | '$MSIM' -i"
+    test "$status" -eq 0
+
+    echo 'restore "c2.ckpt"' >>"$MSIM_TEST_TMPDIR/msim.conf"
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf '%s\n' 'ram save \"restored.bin\"' quit | '$MSIM' -i"
+    test "$status" -eq 0
+    cmp "$MSIM_TEST_TMPDIR/saved.bin" "$MSIM_TEST_TMPDIR/restored.bin"
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+    echo "$output" | grep -q '^Cycles: 566$'
+
+    # The base cannot be replaced under its incremental checkpoints
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf '%s\n' 'checkpoint \"c0.ckpt\"' quit | '$MSIM' -i"
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -ne 0
+    echo "$output" | grep -q '^Checkpoint c0.ckpt is not the base of c1.ckpt$'
+}
+
+@test "Checkpoints saved in the background" {
+    test_dir="$( dirname "$BATS_TEST_FILENAME" )/mips32-ddisk-batch"
+    sed "s#\"boot.bin\"#\"$test_dir/boot.bin\"#" <"$test_dir/msim.conf" >"$MSIM_TEST_TMPDIR/msim.conf"
+
+    # The memory written while c0 is being saved goes to c1
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf '%s\n' \
+        'step 100' 'checkpoint \"c0.ckpt\" background' \
+        'step 200' 'checkpoint \"c1.ckpt\" incremental background' \
+        'step 50' 'checkpoint \"c2.ckpt\" background incremental' \
+        'ram save \"saved.bin\"' quit | '$MSIM' -i"
+    test "$status" -eq 0
+
+    echo 'restore "c2.ckpt"' >>"$MSIM_TEST_TMPDIR/msim.conf"
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf '%s\n' 'ram save \"restored.bin\"' quit | '$MSIM' -i"
+    test "$status" -eq 0
+    cmp "$MSIM_TEST_TMPDIR/saved.bin" "$MSIM_TEST_TMPDIR/restored.bin"
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+    echo "$output" | grep -q '^Cycles: 566$'
+}
+
+@test "Reset returns the machine to the reset point" {
+    test_dir="$( dirname "$BATS_TEST_FILENAME" )/mips32-ddisk-batch"
+    sed "s#\"boot.bin\"#\"$test_dir/boot.bin\"#" <"$test_dir/msim.conf" >"$MSIM_TEST_TMPDIR/msim.conf"
+    echo 'reset point' >>"$MSIM_TEST_TMPDIR/msim.conf"
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf '%s\n' \
+        'ram save \"start0.bin\"' 'step 300' 'ram save \"run0.bin\"' 'reset' \
+        'ram save \"start1.bin\"' 'step 300' 'ram save \"run1.bin\"' 'reset' \
+        'reset point' 'reset' quit | '$MSIM' -i"
+    test "$status" -eq 0
+    cmp "$MSIM_TEST_TMPDIR/start0.bin" "$MSIM_TEST_TMPDIR/start1.bin"
+    cmp "$MSIM_TEST_TMPDIR/run0.bin" "$MSIM_TEST_TMPDIR/run1.bin"
+    run cmp -s "$MSIM_TEST_TMPDIR/start0.bin" "$MSIM_TEST_TMPDIR/run0.bin"
+    test "$status" -ne 0
+
+    config="
+        add rwm ram 0
+        ram generic 4K
+        reset
+    " \
+    expected="
+        <msim> Error in msim.conf on line 3:
+        No reset point
+        <msim> Fault in msim.conf on line 3:
+        Error in configuration file
+    " \
+    exit_success=false \
+    msim_command_check
+}
+
+@test "Checkpoint is restored only into the same configuration" {
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add rwm ram 0
+ram generic 8K
+checkpoint "machine.ckpt"
+quit
+EOF2
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+
+    config="
+        add rwm ram 0
+        ram generic 4K
+        restore \"machine.ckpt\"
+    " \
+    expected="
+        <msim> Error in msim.conf on line 3:
+        Device ram is configured differently than in the checkpoint
+        <msim> Error in msim.conf on line 3:
+        Unable to restore the checkpoint, the machine state is inconsistent
+        <msim> Fault in msim.conf on line 3:
+        Error in configuration file
+    " \
+    exit_success=false \
+    msim_command_check
+}
+
+@test "Back command restores the machine from a snapshot" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add rwm ram 0
+ram generic 64K
+add dprinter printer 0x10000000
+printer redir "printer.output"
+set snapshots = 4
+cpu0 break 0xBFC00020
+EOF2
+
+    # The re-executed cycles print nothing, the continued ones print again
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf 'back 2\ncontinue\nquit\n' | '$MSIM'"
+    test "$status" -eq 0
+    test "$( cat "$MSIM_TEST_TMPDIR/printer.output" )" = "Hell"
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf 'back 5\nquit\n' | '$MSIM'"
+    test "$status" -eq 0
+    if [ "$( echo "$output" | tail -n 1 )" != "Cycles: 3" ]; then
+        fail "Unexpected output: '$output'."
+    fi
+}
+
+@test "Batch mode forks the test cases from a shared prefix" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/prefix.conf" <<'EOF2'
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+EOF2
+    for test in hello wrong; do
+        mkdir "$MSIM_TEST_TMPDIR/$test"
+        printf '%s\n' 'add dprinter printer 0x10000000' 'printer redir "out.txt"' >"$MSIM_TEST_TMPDIR/$test/msim.conf"
+    done
+    printf 'Hello!\n' >"$MSIM_TEST_TMPDIR/hello/expected.txt"
+    printf 'Bye!' >"$MSIM_TEST_TMPDIR/wrong/expected.txt"
+    printf '%s\n' '# Test cases' 'hello expected.txt out.txt' 'wrong expected.txt out.txt' >"$MSIM_TEST_TMPDIR/tests.batch"
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' -c prefix.conf --batch=tests.batch -j 2"
+    test "$status" -eq 6
+
+    expected="$( printf '%s\n' \
+        'hello                                    ok' \
+        'wrong                                    failed (output differs)' \
+        '<msim> Alert: XHLT: Machine halt' \
+        '2 tests, 1 failed' )"
+    if [ "$output" != "$expected" ]; then
+        fail "Unexpected output: '$output'."
+    fi
+
+    test "$( cat "$MSIM_TEST_TMPDIR/wrong/out.txt" )" = "Hello!"
+}
+
+@test "Machines of several configuration files run at once" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    printf '%s\n' 'add dr4kcpu cpu0' 'add rom boot 0x1FC00000' 'boot generic 4K' 'boot load "boot.bin"' >"$MSIM_TEST_TMPDIR/prefix.conf"
+    printf '%s\n' 'add dprinter printer 0x10000000' >"$MSIM_TEST_TMPDIR/hello.conf"
+    printf '%s\n' 'add rwm boot 0' >"$MSIM_TEST_TMPDIR/clash.conf"
+    printf '%s\n' 'echo "third"' 'quit' >"$MSIM_TEST_TMPDIR/third.conf"
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' -c prefix.conf -j 3 hello.conf clash.conf third.conf"
+    test "$status" -eq 6
+
+    # The output follows the order of the configuration files
+    expected="$( printf '%s\n' \
+        'Hello!' \
+        '' \
+        'Cycles: 18' \
+        '<msim> Alert: XHLT: Machine halt' \
+        '<msim> Error in clash.conf on line 1:' \
+        'Device name "boot" already added' \
+        '<msim> Fault in clash.conf on line 1:' \
+        'Error in configuration file' \
+        '<msim> Error: Machine clash.conf failed (simulator failed)' \
+        'third' )"
+    if [ "$output" != "$expected" ]; then
+        fail "Unexpected output: '$output'."
+    fi
+}
+
+@test "Statistics socket serves the running machine" {
+    # Endless loop (b . with a nop in the delay slot)
+    printf '\377\377\000\020\000\000\000\000' >"$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+printer redir "printer.output"
+EOF2
+
+    cd "$MSIM_TEST_TMPDIR"
+    "$MSIM" --stats-socket="$MSIM_TEST_TMPDIR/stats.sock" </dev/null >msim.output 2>&1 &
+    local msim_pid=$!
+
+    run python3 - "$MSIM_TEST_TMPDIR/stats.sock" <<'EOF2'
+import json, socket, sys, time
+
+def query(request):
+    for _ in range(100):
+        try:
+            sock = socket.socket(socket.AF_UNIX)
+            sock.connect(sys.argv[1])
+            break
+        except OSError:
+            time.sleep(0.05)
+    sock.sendall(request)
+    data = b""
+    while True:
+        chunk = sock.recv(4096)
+        if not chunk:
+            return data.decode()
+        data += chunk
+
+stats = json.loads(query(b"json\n"))
+cpu = stats["devices"]["cpu0"]
+print(stats["cycles_total"] > 0, cpu["type"],
+      cpu["cpu_kernel_cycles_total"] > 0,
+      stats["devices"]["printer"]["printer_chars_total"])
+
+metrics = query(b"GET /metrics HTTP/1.0\r\n\r\n")
+print(metrics.splitlines()[0])
+print(any(line.startswith('msim_cpu_instructions_total{device="cpu0",type="dr4kcpu"} ')
+          for line in metrics.splitlines()))
+EOF2
+
+    kill "$msim_pid"
+    wait "$msim_pid" || true
+
+    expected="$( printf '%s\n' \
+        'True dr4kcpu True 0' \
+        'HTTP/1.0 200 OK' \
+        'True' )"
+    if [ "$output" != "$expected" ]; then
+        fail "Unexpected output: '$output'."
+    fi
+}
+
+@test "Run report is written at the end" {
+    test_dir="$( dirname "$BATS_TEST_FILENAME" )/mips32-hello"
+    cp "$test_dir/boot.bin" "$test_dir/msim.conf" "$MSIM_TEST_TMPDIR/"
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --report=report.json"
+    test "$status" -eq 0
+
+    run python3 - "$MSIM_TEST_TMPDIR/report.json" <<'EOF2'
+import json, sys
+
+report = json.load(open(sys.argv[1]))
+cpu = report["devices"]["cpu0"]
+print(report["cycles"], report["instructions"], report["exit_status"],
+      cpu["type"], cpu["cpu_kernel_cycles_total"],
+      report["devices"]["printer"]["printer_chars_total"],
+      report["peak_rss_kib"] > 0)
+EOF2
+
+    if [ "$output" != "18 18 0 dr4kcpu 18 7 True" ]; then
+        fail "Unexpected output: '$output'."
+    fi
+}
+
+@test "Compiled machine description runs until stale" {
+    test_dir="$( dirname "$BATS_TEST_FILENAME" )/mips32-hello"
+    cp "$test_dir/boot.bin" "$test_dir/msim.conf" "$MSIM_TEST_TMPDIR/"
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --compile-config=hello.desc"
+    test "$status" -eq 0
+    test -z "$output"
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' -c hello.desc"
+    test "$status" -eq 0
+    test "$output" = "$( cd "$MSIM_TEST_TMPDIR" && "$MSIM" 2>&1 )"
+
+    # The changed image is loaded by the configuration file
+    printf '\0\0\0\0' >>"$MSIM_TEST_TMPDIR/boot.bin"
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' -c hello.desc"
+    test "$status" -eq 0
+    echo "$output" | grep -q '^<msim> Alert: Machine description hello.desc is stale, interpreting msim.conf$'
+    echo "$output" | grep -q '^Hello!$'
+
+    # Errors refer to the lines of the configuration file
+    echo 'boot load "missing.bin"' >>"$MSIM_TEST_TMPDIR/msim.conf"
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --compile-config=hello.desc"
+    test "$status" -ne 0
+    echo "$output" | grep -q '^<msim> Error in msim.conf on line 6:$'
+}
+
+@test "Server runs the jobs from the restored machine" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-hello/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add dr4kcpu cpu0
+add rom boot 0x1FC00000
+boot generic 4K
+boot load "boot.bin"
+add dprinter printer 0x10000000
+printer redir "printer.output"
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf 'checkpoint \"boot.ckpt\"\nquit\n' | '$MSIM' -c <(cat msim.conf; echo 'cpu0 break 0xBFC00020')"
+    test "$status" -eq 0
+    echo 'restore "boot.ckpt"' >>"$MSIM_TEST_TMPDIR/msim.conf"
+
+    cd "$MSIM_TEST_TMPDIR"
+    "$MSIM" --serve="$MSIM_TEST_TMPDIR/jobs.sock" -j 2 </dev/null >msim.output 2>&1 &
+    local msim_pid=$!
+
+    run python3 - "$MSIM_TEST_TMPDIR/jobs.sock" <<'EOF2'
+import socket, sys, time
+
+def job(config):
+    for _ in range(100):
+        try:
+            sock = socket.socket(socket.AF_UNIX)
+            sock.connect(sys.argv[1])
+            break
+        except OSError:
+            time.sleep(0.05)
+    sock.sendall(config)
+    sock.shutdown(socket.SHUT_WR)
+    data = b""
+    while True:
+        chunk = sock.recv(4096)
+        if not chunk:
+            return data.decode()
+        data += chunk
+
+print(job(b'printer redir "job-1.output"\n'), end="")
+print(job(b'printer redir "job-2.output"\n'), end="")
+EOF2
+
+    kill -INT "$msim_pid"
+    wait "$msim_pid" || true
+
+    expected="$( printf '%s\n' \
+        '<msim> Alert: XHLT: Machine halt' \
+        '' \
+        'Cycles: 18' \
+        '<msim> Alert: XHLT: Machine halt' \
+        '' \
+        'Cycles: 18' )"
+    if [ "$output" != "$expected" ]; then
+        fail "Unexpected output: '$output'."
+    fi
+
+    test "$( cat job-1.output )" = "lo!"
+    test "$( cat job-2.output )" = "lo!"
+    test ! -e jobs.sock
+}
+
+@test "Cosimulation checks the blocks against the interpreter" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-jit/boot.bin" "$MSIM_TEST_TMPDIR/boot.bin"
+    cp "$( dirname "$BATS_TEST_FILENAME" )/mips32-jit/msim.conf" "$MSIM_TEST_TMPDIR/msim.conf"
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --cosim"
+    test "$status" -eq 0
+
+    if ! echo "$output" | grep -q '^Cosimulation: [1-9][0-9]* steps checked (.*), 0 skipped, 0 divergences$'; then
+        fail "Unexpected output: '$output'."
+    fi
+}
+
+@test "Cosimulation keeps the reservations of the blocks" {
+    # 200 passes of a store, lr.w and sc.w to 0x1000, the blocks of 2
+    # instructions end the steps between the LR and the SC
+    printf '\x37\x15\x00\x00\x13\x03\x00\x00\x93\x03\x80\x0c\x23\x20\x75\x00\xaf\x22\x05\x10\x93\x82\x12\x00\x2f\x2e\x55\x18\xe3\x18\x0e\xfe\x13\x03\x13\x00\xe3\x14\x73\xfe\x73\x00\x00\x8c' >"$MSIM_TEST_TMPDIR/main.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add drvcpu cpu0
+cpu0 block 2
+add rom main 0xF0000000
+main generic 4K
+main load "main.bin"
+add rwm ram 0x0
+ram generic 16K
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --cosim </dev/null"
+    test "$status" -eq 0
+
+    if ! echo "$output" | grep -q '^Cosimulation: [1-9][0-9]* steps checked (.*), 0 skipped, 0 divergences$'; then
+        fail "Unexpected output: '$output'."
+    fi
+}
+
+@test "Translated RISC-V blocks may call many implementations" {
+    cp "$( dirname "$BATS_TEST_FILENAME" )/../bench/riscv-tlb/main32.bin" "$MSIM_TEST_TMPDIR/main32.bin"
+
+    # The blocks of loads and stores are translated as calls
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add drvcpu cpu0
+cpu0 block 64
+cpu0 jit 2
+add rom main 0xF0000000
+main generic 4K
+main load "main32.bin"
+add rwm ram 0x0
+ram generic 256K
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null"
+    test "$status" -eq 0
+
+    echo "$output" | grep -q '^Cycles: 53865$'
+}
+
+@test "Cache model counts the hits and misses" {
+    # Two passes of 1024 loads 64 bytes apart (64 KiB)
+    printf '\x93\x03\x20\x00\x93\x02\x00\x00\x13\x03\x00\x40\x03\xae\x02\x00' >"$MSIM_TEST_TMPDIR/boot.bin"
+    printf '\x93\x82\x02\x04\x13\x03\xf3\xff\xe3\x1a\x03\xfe\x93\x83\xf3\xff' >>"$MSIM_TEST_TMPDIR/boot.bin"
+    printf '\xe3\x92\x03\xfe\x73\x00\x00\x8c' >>"$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add drvcpu cpu0
+cpu0 cache l1i 16K 4 32
+cpu0 cache l1d 32K 8
+cpu0 cache l2 256K 16
+add rwm ram 0
+ram generic 128K
+add rom main 0xF0000000
+main generic 4K
+main load "boot.bin"
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf 'cpu0 cache\nstep 8200\ncpu0 stat\nquit\n' | '$MSIM' -i"
+    test "$status" -eq 0
+
+    echo "$output" | grep -q '^Cache l1d: 32 KiB, 8-way, 64 B lines$'
+    # The data do not fit the L1D but do fit the L2 on the second pass
+    echo "$output" | grep -q '^ *l1i  *8198  *2  *0.02$'
+    echo "$output" | grep -q '^ *l1d  *0  *2048  *100.00$'
+    echo "$output" | grep -q '^ *l2  *1025  *1025  *50.00$'
+}
+
+@test "Memory access trace records the filtered accesses" {
+    # Two passes of 1024 loads 64 bytes apart, then ehalt
+    printf '\x93\x03\x20\x00\x93\x02\x00\x00\x13\x03\x00\x40\x03\xae\x02\x00' >"$MSIM_TEST_TMPDIR/boot.bin"
+    printf '\x93\x82\x02\x04\x13\x03\xf3\xff\xe3\x1a\x03\xfe\x93\x83\xf3\xff' >>"$MSIM_TEST_TMPDIR/boot.bin"
+    printf '\xe3\x92\x03\xfe\x73\x00\x00\x8c' >>"$MSIM_TEST_TMPDIR/boot.bin"
+
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add drvcpu cpu0
+add rwm ram 0
+ram generic 128K
+add rom main 0xF0000000
+main generic 4K
+main load "boot.bin"
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --memtrace=all.bin </dev/null"
+    test "$status" -eq 0
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' --memtrace-decode=all.bin"
+    test "$status" -eq 0
+    test "$( echo "$output" | grep -c '^cpu0  *[0-9]* R 4 ' )" -eq 2048
+    test "$( echo "$output" | grep -c '^cpu0  *[0-9]* X 4 0x00000000f' )" -eq 8202
+
+    echo 'memtrace filter cpu 0 range 0x40 0x80' >>"$MSIM_TEST_TMPDIR/msim.conf"
+    echo 'memtrace start "some.bin"' >>"$MSIM_TEST_TMPDIR/msim.conf"
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' </dev/null && '$MSIM' --memtrace-decode=some.bin"
+    test "$status" -eq 0
+    echo "$output" | grep -q '^cpu0  *7 R 4 0x0000000000000040 0x000000040$'
+    echo "$output" | grep -q '^cpu0  *4107 R 4 0x0000000000000040 0x000000040$'
+    test "$( echo "$output" | grep -c '^cpu0 ' )" -eq 2
+}
+
+@test "Failing instruction fetches are counted" {
+    # No memory, every fetch is outside of the physical memory
+    cat >"$MSIM_TEST_TMPDIR/msim.conf" <<'EOF2'
+add drvcpu cpu0
+set fetchalerts = 2
+EOF2
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && printf 'step 5\ncpu0 stat\nquit\n' | '$MSIM' -i"
+    test "$status" -eq 0
+    test "$( echo "$output" | grep -c 'fetch instructions from outside of physical memory' )" -eq 2
+    echo "$output" | grep -A1 'Fetches off memory' | grep -q '^ *0  *0  *5$'
+}
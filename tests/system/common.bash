@@ -82,7 +82,7 @@ msim_run_code() {
 
     echo "quit" >>"$MSIM_TEST_TMPDIR/msim.conf"
     (
-        sed "s#\"boot.bin\"#\"$test_dir/boot.bin\"#" <"$test_dir/msim.conf"
+        sed "s#\"\([a-z]*\.bin\)\"#\"$test_dir/\1\"#" <"$test_dir/msim.conf"
         echo "printer redir \"$MSIM_TEST_TMPDIR/printer.output\""
     ) >"$MSIM_TEST_TMPDIR/msim.conf"
 
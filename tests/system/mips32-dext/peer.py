@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+
+"""
+External device of the dext test.
+
+Registers: 0 stores the value written, a write to 8 asserts the
+interrupt at the next tick, 12 reads the cycles ticked so far. The
+messages are logged to the file given.
+"""
+
+import mmap
+import os
+import struct
+import sys
+import time
+
+MAGIC = 0x54584544
+SLOTS = 256
+MSG = struct.Struct('<IIQQQ')
+RING_SIZE = 128 + SLOTS * MSG.size
+REQUEST = 64
+RESPONSE = REQUEST + RING_SIZE
+SIZE = RESPONSE + RING_SIZE
+
+WRITE, READ, TICK, DATA, IRQ, STOP = range(1, 7)
+NAMES = {WRITE: 'write', READ: 'read', TICK: 'tick', STOP: 'stop'}
+
+
+def open_shm(name):
+    path = '/dev/shm/' + name.lstrip('/')
+    deadline = time.monotonic() + 10
+
+    while time.monotonic() < deadline:
+        try:
+            with open(path, 'r+b') as f:
+                if os.fstat(f.fileno()).st_size >= SIZE:
+                    shm = mmap.mmap(f.fileno(), SIZE)
+                    if struct.unpack_from('<I', shm, 0)[0] == MAGIC:
+                        return shm
+                    shm.close()
+        except FileNotFoundError:
+            pass
+        time.sleep(0.01)
+
+    sys.exit('no simulator at ' + path)
+
+
+def main():
+    shm = open_shm(sys.argv[1])
+    log = open(sys.argv[2], 'w')
+    struct.pack_into('<I', shm, 12, 1)
+
+    regs = {}
+    cycles = 0
+    irq = False
+    sent = 0
+
+    def send(kind, value):
+        nonlocal sent
+        MSG.pack_into(shm, RESPONSE + 128 + (sent % SLOTS) * MSG.size,
+                kind, 0, 0, value, 0)
+        sent += 1
+        struct.pack_into('<I', shm, RESPONSE, sent & 0xffffffff)
+
+    tail = 0
+    while True:
+        head = struct.unpack_from('<I', shm, REQUEST)[0]
+        if head == tail:
+            time.sleep(0)
+            continue
+
+        kind, size, offset, value, cycle = MSG.unpack_from(shm,
+                REQUEST + 128 + (tail % SLOTS) * MSG.size)
+        tail += 1
+        struct.pack_into('<I', shm, REQUEST + 64, tail & 0xffffffff)
+
+        if kind != TICK:
+            log.write('%s %d %#x %#x\n' % (NAMES[kind], size, offset, value))
+
+        if kind == WRITE:
+            regs[offset] = value
+            if offset == 8:
+                irq = True
+        elif kind == READ:
+            send(DATA, cycles if offset == 12 else regs.get(offset, 0))
+        elif kind == TICK:
+            cycles += value
+            if irq:
+                send(IRQ, 1)
+                irq = False
+            send(TICK, value)
+        elif kind == STOP:
+            break
+
+    log.close()
+
+
+if __name__ == '__main__':
+    main()
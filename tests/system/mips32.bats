@@ -14,6 +14,10 @@ load "common"
     msim_run_code "mips32-dnomem-break"
 }
 
+@test "MIPS32: dnomem device alerting only the first accesses" {
+    msim_run_code "mips32-dnomem-limit"
+}
+
 @test "MIPS32: dnomem device in halt mode" {
     msim_run_code "mips32-dnomem-halt"
 }
@@ -22,6 +26,40 @@ load "common"
     msim_run_code "mips32-dnomem-rd"
 }
 
+@test "MIPS32: Interprocessor interrupt of the processor 33" {
+    msim_run_code "mips32-dorder-banked"
+}
+
+@test "MIPS32: Interprocessor interrupt of all the other processors" {
+    msim_run_code "mips32-dorder-broadcast"
+}
+
+@test "MIPS32: Virtual clock of dtime" {
+    msim_run_code "mips32-dtime"
+}
+
+@test "MIPS32: Periodic and one-shot dtimer" {
+    msim_run_code "mips32-dtimer"
+}
+
+@test "MIPS32: DMA engine fills and copies memory" {
+    msim_run_code "mips32-ddma"
+}
+
+@test "MIPS32: Framebuffer publishes the changed rectangles" {
+    msim_run_code "mips32-dfb"
+
+    local stream="$MSIM_TEST_TMPDIR/fb.stream"
+
+    test "$( stat -c %s "$stream" )" -eq 20532
+    test "$( od -An -t u4 -N 32 "$stream" | xargs )" = "1111905101 1024 4 0 0 0 1024 4"
+    test "$( od -An -t u4 -j 16416 -N 20 "$stream" | xargs )" = "1 0 2 1024 1"
+    test "$( od -An -t x4 -j 16456 -N 4 "$stream" | xargs )" = "00ff0000"
+    test -s "$MSIM_TEST_TMPDIR/fb-000000.png"
+    test -s "$MSIM_TEST_TMPDIR/fb-000001.png"
+    test ! -e "$MSIM_TEST_TMPDIR/fb-000002.png"
+}
+
 @test "MIPS32: XINT instruction" {
     msim_run_code "mips32-xint"
 }
@@ -29,3 +67,92 @@ load "common"
 @test "MIPS32: Register dumps" {
     msim_run_code "mips32-rd"
 }
+
+@test "MIPS32: Random register" {
+    msim_run_code "mips32-random"
+}
+
+@test "MIPS32: Headless LCD prints the final display" {
+    msim_run_code "mips32-lcd"
+}
+
+@test "MIPS32: Self-modifying code" {
+    msim_run_code "mips32-smc"
+}
+
+@test "MIPS32: Self-modifying code in block execution" {
+    msim_run_code "mips32-smc-runs"
+}
+
+@test "MIPS32: Translated blocks" {
+    msim_run_code "mips32-jit"
+}
+
+@test "MIPS32: TLB of 128 entries" {
+    msim_run_code "mips32-tlb-entries"
+}
+
+@test "MIPS32: Victim TLB saves the refills" {
+    msim_run_code "mips32-tlb-victim"
+}
+
+@test "MIPS32: Processors in different modes share a decoded page" {
+    msim_run_code "mips32-mode-share"
+}
+
+@test "MIPS32: Pipeline timing model stalls Count" {
+    msim_run_code "mips32-timing"
+}
+
+@test "MIPS32: ddisk multi-sector and scatter-gather commands" {
+    msim_run_code "mips32-ddisk-batch"
+}
+
+@test "MIPS32: ddisk batches with fast transfer timing" {
+    msim_run_code "mips32-ddisk-batch-fast"
+}
+
+@test "MIPS32: Hypercalls" {
+    msim_run_code "mips32-hypercall"
+}
+
+@test "MIPS32: Virtio block device" {
+    msim_run_code "mips32-virtblk"
+}
+
+@test "MIPS32: Virtio console" {
+    msim_run_code "mips32-virtcon"
+}
+
+@test "MIPS32: Virtio network device loops a frame by the UDP switch" {
+    local test_dir="$( dirname "$BATS_TEST_FILENAME" )/mips32-virtnet"
+    local port=$(( 20000 + $$ % 20000 ))
+
+    sed -e "s#\"boot.bin\"#\"$test_dir/boot.bin\"#" -e "s#PORT#$port#g" \
+        <"$test_dir/msim.conf" >"$MSIM_TEST_TMPDIR/msim.conf"
+    echo "printer redir \"$MSIM_TEST_TMPDIR/printer.output\"" >>"$MSIM_TEST_TMPDIR/msim.conf"
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' -n </dev/null"
+
+    test "$status" -eq 0
+    test "$( cat "$MSIM_TEST_TMPDIR/printer.output" )" = "$( cat "$test_dir/guest.expected" )"
+}
+
+@test "MIPS32: External device simulated by another process" {
+    local test_dir="$( dirname "$BATS_TEST_FILENAME" )/mips32-dext"
+    local name="/msim-dext-$$"
+
+    sed -e "s#\"boot.bin\"#\"$test_dir/boot.bin\"#" -e "s#\"SHM\"#\"$name\"#" \
+        <"$test_dir/msim.conf" >"$MSIM_TEST_TMPDIR/msim.conf"
+
+    python3 "$test_dir/peer.py" "$name" "$MSIM_TEST_TMPDIR/peer.log" &
+    local peer=$!
+
+    run bash -c "cd '$MSIM_TEST_TMPDIR' && '$MSIM' -n </dev/null"
+    wait "$peer"
+
+    test "$status" -eq 0
+    test "$output" = "$( cat "$test_dir/host.expected" )"
+    diff -u "$test_dir/peer.expected" "$MSIM_TEST_TMPDIR/peer.log"
+    test ! -e "/dev/shm$name"
+}